@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/prctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -43,6 +44,7 @@
 
 #include <chrono>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -67,6 +69,14 @@ constexpr const int kWaitTimeBetweenConnectAttemptsInSec = 1;
 constexpr const int kDumpstateTimeoutInSec = 600;
 // The prefix for screenshot filename in the generated zip file.
 constexpr const char* kScreenshotPrefix = "/screenshot";
+// The name of the extra bugreport zip file in the temporary directory.
+constexpr const char* kExtraZipFilename = "/extra_files.zip";
+// Wait time for the screencap of all displays.
+constexpr const int kScreenshotTimeoutInSec = 10;
+// Interval between checks on the commands run in parallel.
+constexpr const std::chrono::milliseconds kCommandPollInterval(20);
+// Bytes handed to a single sendfile call when sending the zipped bugreport.
+constexpr const size_t kSendfileChunk = 1024 * 1024;
 
 using android::OK;
 using android::PhysicalDisplayId;
@@ -113,6 +123,17 @@ void processLine(const std::string& line, std::string* out_zip_path,
     return;
 }
 
+// Returns true if the file is compressed already, so that deflating it again
+// would only cost time.
+bool isCompressed(const std::string& name) {
+    for (const char* suffix : {".png", ".jpg", ".zip", ".gz"}) {
+        if (android::base::EndsWithIgnoreCase(name, suffix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Sends the contents of the zip fileto |outfd|.
 // Returns true if success
 void zipFilesToFd(const std::vector<std::string>& extra_files, int outfd) {
@@ -128,7 +149,7 @@ void zipFilesToFd(const std::vector<std::string>& extra_files, int outfd) {
     for (const auto& filepath : extra_files) {
         const auto name = android::base::Basename(filepath);
 
-        error = writer->StartEntry(name.c_str(), 0);
+        error = writer->StartEntry(name.c_str(), isCompressed(name) ? 0 : ZipWriter::kCompress);
         if (error) {
             ALOGE("Failed to start entry %s", writer->ErrorCodeString(error));
             return;
@@ -195,12 +216,41 @@ int copyTo(int fd_in, int fd_out, void* buffer, size_t buffer_len) {
     return bytes_read;
 }
 
+// Sends the rest of |fd_in| to |fd_out| without copying it through user space.
+// Returns 1 when all of it is sent, -1 on failure, and 0 if the descriptors do
+// not support sendfile, in which case the file offset is left at the first
+// byte not sent yet.
+int sendFileTo(int fd_in, int fd_out) {
+    while (1) {
+        ssize_t bytes_sent = TEMP_FAILURE_RETRY(sendfile(fd_out, fd_in, nullptr, kSendfileChunk));
+        if (bytes_sent == 0) {
+            return 1;
+        }
+        if (bytes_sent == -1) {
+            if (errno == EINVAL || errno == ENOSYS) {
+                return 0;
+            }
+            ALOGE("sendfile terminated abnormally (%s)", strerror(errno));
+            return -1;
+        }
+    }
+}
+
 bool copyFile(const std::string& zip_path, int output_socket) {
     android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(zip_path.c_str(), O_RDONLY)));
     if (fd == -1) {
         ALOGE("Failed to open zip file %s.", zip_path.c_str());
         return false;
     }
+    int sent = sendFileTo(fd, output_socket);
+    if (sent == 1) {
+        return true;
+    }
+    if (sent == -1) {
+        ALOGE("Failed to send zip file %s to the output_socket.", zip_path.c_str());
+        return false;
+    }
+    ALOGW("sendfile is not supported, copying zip file %s.", zip_path.c_str());
     while (1) {
         char buffer[65536];
         int bytes_copied = copyTo(fd, output_socket, buffer, sizeof(buffer));
@@ -275,51 +325,8 @@ bool doBugreport(int progress_socket, size_t* out_bytes_written, std::string* zi
     return true;
 }
 
-bool waitpid_with_timeout(pid_t pid, int timeout_secs, int* status) {
-    sigset_t child_mask, old_mask;
-    sigemptyset(&child_mask);
-    sigaddset(&child_mask, SIGCHLD);
-
-    if (sigprocmask(SIG_BLOCK, &child_mask, &old_mask) == -1) {
-        ALOGE("*** sigprocmask failed: %s\n", strerror(errno));
-        return false;
-    }
-
-    timespec ts = {.tv_sec = timeout_secs, .tv_nsec = 0};
-    int ret = TEMP_FAILURE_RETRY(sigtimedwait(&child_mask, nullptr, &ts));
-    int saved_errno = errno;
-
-    // Set the signals back the way they were.
-    if (sigprocmask(SIG_SETMASK, &old_mask, nullptr) == -1) {
-        ALOGE("*** sigprocmask failed: %s\n", strerror(errno));
-        if (ret == 0) {
-            return false;
-        }
-    }
-    if (ret == -1) {
-        errno = saved_errno;
-        if (errno == EAGAIN) {
-            errno = ETIMEDOUT;
-        } else {
-            ALOGE("*** sigtimedwait failed: %s\n", strerror(errno));
-        }
-        return false;
-    }
-
-    pid_t child_pid = waitpid(pid, status, WNOHANG);
-    if (child_pid != pid) {
-        if (child_pid != -1) {
-            ALOGE("*** Waiting for pid %d, got pid %d instead\n", pid, child_pid);
-        } else {
-            ALOGE("*** waitpid failed: %s\n", strerror(errno));
-        }
-        return false;
-    }
-    return true;
-}
-
-// Runs the given command. Kills the command if it does not finish by timeout.
-int runCommand(int timeout_secs, const char* file, std::vector<const char*> args) {
+// Starts the given command in a child process. Returns its pid, or -1 on failure.
+pid_t startCommand(const char* file, const std::vector<const char*>& args) {
     pid_t pid = fork();
 
     // handle error case
@@ -340,32 +347,18 @@ int runCommand(int timeout_secs, const char* file, std::vector<const char*> args
         sigaction(SIGPIPE, &sigact, nullptr);
 
         execvp(file, (char**)args.data());
-        // execvp's result will be handled after waitpid_with_timeout() below, but
+        // execvp's result will be handled by the caller waiting on the child, but
         // if it failed, it's safer to exit dumpstate.
         ALOGE("execvp on command %s failed (error: %s)", file, strerror(errno));
         _exit(EXIT_FAILURE);
     }
 
     // handle parent case
-    int status;
-    bool ret = waitpid_with_timeout(pid, timeout_secs, &status);
-
-    if (!ret) {
-        if (errno == ETIMEDOUT) {
-            ALOGE("command %s timed out (killing pid %d)", file, pid);
-        } else {
-            ALOGE("command %s: Error (killing pid %d)\n", file, pid);
-        }
-        kill(pid, SIGTERM);
-        if (!waitpid_with_timeout(pid, 5, nullptr)) {
-            kill(pid, SIGKILL);
-            if (!waitpid_with_timeout(pid, 5, nullptr)) {
-                ALOGE("could not kill command '%s' (pid %d) even with SIGKILL.\n", file, pid);
-            }
-        }
-        return -1;
-    }
+    return pid;
+}
 
+// Returns the exit status of a finished command, logging its failure.
+int commandStatus(const char* file, int status) {
     if (WIFSIGNALED(status)) {
         ALOGE("command '%s' failed: killed by signal %d\n", file, WTERMSIG(status));
     } else if (WIFEXITED(status) && WEXITSTATUS(status) > 0) {
@@ -376,28 +369,105 @@ int runCommand(int timeout_secs, const char* file, std::vector<const char*> args
     return status;
 }
 
-void takeScreenshotForDisplayId(PhysicalDisplayId id, const char* tmp_dir,
-        std::vector<std::string>* extra_files) {
-    std::string id_as_string = std::to_string(id);
-    std::string filename = std::string(tmp_dir) + kScreenshotPrefix + id_as_string + ".png";
-    std::vector<const char*> args { "-p", "-d", id_as_string.c_str(), filename.c_str(), nullptr };
-    ALOGI("capturing screen for display (%s) as %s", id_as_string.c_str(), filename.c_str());
-    int status = runCommand(10, "/system/bin/screencap", args);
-    if (status == 0) {
-        LOG(INFO) << "Screenshot saved for display:" << id_as_string;
+// Waits until the commands in |pids| finish, or until |deadline|. Stores the status of each
+// finished command in |statuses| and clears its pid. Returns the number still running.
+size_t waitForCommands(const char* file, std::chrono::steady_clock::time_point deadline,
+                       std::vector<pid_t>* pids, std::vector<int>* statuses) {
+    // sigtimedwait cannot tell the children apart, so poll each of them until the deadline.
+    while (true) {
+        size_t running = 0;
+        for (size_t i = 0; i < pids->size(); i++) {
+            pid_t pid = (*pids)[i];
+            if (pid <= 0) {
+                continue;
+            }
+            int status;
+            pid_t child_pid = TEMP_FAILURE_RETRY(waitpid(pid, &status, WNOHANG));
+            if (child_pid == 0) {
+                running++;
+                continue;
+            }
+            if (child_pid == pid) {
+                (*statuses)[i] = commandStatus(file, status);
+            } else {
+                ALOGE("*** waitpid failed: %s\n", strerror(errno));
+            }
+            (*pids)[i] = 0;
+        }
+        if (running == 0 || std::chrono::steady_clock::now() >= deadline) {
+            return running;
+        }
+        std::this_thread::sleep_for(kCommandPollInterval);
+    }
+}
+
+// Runs the command |file| once per entry of |args_list|, all at the same time. Kills the commands
+// that do not finish by timeout. Returns the status of each command, -1 for those that failed to
+// start or were killed.
+std::vector<int> runCommandsInParallel(int timeout_secs, const char* file,
+                                       const std::vector<std::vector<const char*>>& args_list) {
+    std::vector<int> statuses(args_list.size(), -1);
+    std::vector<pid_t> pids;
+    for (const auto& args : args_list) {
+        pids.push_back(startCommand(file, args));
     }
-    // add the file regardless of the exit status of the screencap util.
-    extra_files->push_back(filename);
 
-    LOG(ERROR) << "Failed to take screenshot for display:" << id_as_string;
+    auto now = std::chrono::steady_clock::now();
+    if (waitForCommands(file, now + std::chrono::seconds(timeout_secs), &pids, &statuses) == 0) {
+        return statuses;
+    }
+
+    for (pid_t pid : pids) {
+        if (pid > 0) {
+            ALOGE("command %s timed out (killing pid %d)", file, pid);
+            kill(pid, SIGTERM);
+        }
+    }
+    now = std::chrono::steady_clock::now();
+    if (waitForCommands(file, now + std::chrono::seconds(5), &pids, &statuses) == 0) {
+        return statuses;
+    }
+
+    for (pid_t pid : pids) {
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            if (TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0)) != pid) {
+                ALOGE("could not kill command '%s' (pid %d) even with SIGKILL.\n", file, pid);
+            }
+        }
+    }
+    return statuses;
 }
 
+// Captures the physical displays at the same time, one screencap process each.
 void takeScreenshot(const char* tmp_dir, std::vector<std::string>* extra_files) {
     // Now send the screencaptures
     std::vector<PhysicalDisplayId> ids = SurfaceComposerClient::getPhysicalDisplayIds();
 
+    std::vector<std::string> ids_as_string;
+    std::vector<std::string> filenames;
     for (PhysicalDisplayId display_id : ids) {
-        takeScreenshotForDisplayId(display_id, tmp_dir, extra_files);
+        ids_as_string.push_back(std::to_string(display_id));
+        filenames.push_back(std::string(tmp_dir) + kScreenshotPrefix + ids_as_string.back() +
+                            ".png");
+    }
+    std::vector<std::vector<const char*>> args_list;
+    for (size_t i = 0; i < ids.size(); i++) {
+        ALOGI("capturing screen for display (%s) as %s", ids_as_string[i].c_str(),
+              filenames[i].c_str());
+        args_list.push_back({"-p", "-d", ids_as_string[i].c_str(), filenames[i].c_str(), nullptr});
+    }
+
+    std::vector<int> statuses = runCommandsInParallel(kScreenshotTimeoutInSec,
+                                                      "/system/bin/screencap", args_list);
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (statuses[i] == 0) {
+            LOG(INFO) << "Screenshot saved for display:" << ids_as_string[i];
+        } else {
+            LOG(ERROR) << "Failed to take screenshot for display:" << ids_as_string[i];
+        }
+        // add the file regardless of the exit status of the screencap util.
+        extra_files->push_back(filenames[i]);
     }
 }
 
@@ -444,6 +514,23 @@ void cleanupBugreportFile(const std::string& zip_path) {
     }
 }
 
+// Takes the screenshots into |tmp_dir| and zips them into |extra_zip_path|, so that the extra
+// zip file is ready by the time dumpstate finishes. Returns true if the zip file was written.
+bool collectExtraFiles(const char* tmp_dir, const std::string& extra_zip_path) {
+    std::vector<std::string> extra_files;
+    takeScreenshot(tmp_dir, &extra_files);
+
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(
+            open(extra_zip_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)));
+    if (fd == -1) {
+        ALOGE("Failed to create %s (%s)", extra_zip_path.c_str(), strerror(errno));
+        return false;
+    }
+    // zipFilesToFd closes the descriptor.
+    zipFilesToFd(extra_files, fd.release());
+    return true;
+}
+
 }  // namespace
 
 int main(void) {
@@ -451,15 +538,19 @@ int main(void) {
 
     auto t0 = std::chrono::steady_clock::now();
 
-    std::vector<std::string> extra_files;
-    if (createTempDir(kTempDirectory) == OK) {
-        // take screenshots of the physical displays as early as possible
-        takeScreenshot(kTempDirectory, &extra_files);
-    }
-
     // Start the dumpstatez service.
     android::base::SetProperty("ctl.start", "car-dumpstatez");
 
+    // Take screenshots of the physical displays and zip them while dumpstate runs.
+    std::string extra_zip_path = std::string(kTempDirectory) + kExtraZipFilename;
+    bool extra_zip_ready = false;
+    std::thread extra_files_thread;
+    if (createTempDir(kTempDirectory) == OK) {
+        extra_files_thread = std::thread([&extra_zip_path, &extra_zip_ready]() {
+            extra_zip_ready = collectExtraFiles(kTempDirectory, extra_zip_path);
+        });
+    }
+
     size_t bytes_written = 0;
 
     std::string zip_path;
@@ -467,6 +558,10 @@ int main(void) {
     if (progress_socket < 0) {
         // early out. in this case we will not print the final message, but that is ok.
         android::base::SetProperty("ctl.stop", "car-dumpstatez");
+        if (extra_files_thread.joinable()) {
+            extra_files_thread.join();
+        }
+        recursiveRemoveDir(kTempDirectory);
         return EXIT_FAILURE;
     }
     bool ret_val = doBugreport(progress_socket, &bytes_written, &zip_path);
@@ -480,9 +575,17 @@ int main(void) {
         }
     }
 
+    if (extra_files_thread.joinable()) {
+        extra_files_thread.join();
+    }
     int extra_output_socket = openSocket(kCarBrExtraOutputSocket);
     if (extra_output_socket != -1 && ret_val) {
-        zipFilesToFd(extra_files, extra_output_socket);
+        if (extra_zip_ready) {
+            copyFile(extra_zip_path, extra_output_socket);
+        } else {
+            // Sends an empty zip file, so that the client still gets one.
+            zipFilesToFd({}, dup(extra_output_socket));
+        }
     }
     if (extra_output_socket != -1) {
         close(extra_output_socket);
@@ -23,6 +23,9 @@
 
 #include "CarPowerManager.h"
 
+#include <algorithm>
+#include <thread>
+
 namespace android {
 namespace car {
 namespace hardware {
@@ -37,6 +40,10 @@ int CarPowerManager::clearListener() {
         mListenerToService = nullptr;
         retVal = 0;
     }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mListener = nullptr;
+    mListeners.clear();
     return retVal;
 }
 
@@ -53,21 +60,123 @@ int CarPowerManager::requestShutdownOnNextSuspend() {
 int CarPowerManager::setListener(Listener listener) {
     int retVal = -1;
 
-    if (connectToCarService()) {
-        if (mListenerToService == nullptr) {
-            mListenerToService = new CarPowerStateListener(this);
-            mICarPower->registerListener(mListenerToService);
-        }
-
+    if (registerToCarService()) {
         // Set the listener
+        std::lock_guard<std::mutex> lock(mMutex);
         mListener = listener;
         retVal = 0;
     }
     return retVal;
 }
 
+int CarPowerManager::addListener(Listener listener, int priority,
+                                 std::chrono::milliseconds deadline) {
+    if ((listener == nullptr) || !registerToCarService()) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    int id = mNextListenerId++;
+    // Insert after the listeners of the same priority, to keep them in the order added
+    auto it = std::find_if(mListeners.begin(), mListeners.end(),
+                           [priority](const ListenerEntry& entry) {
+                               return entry.priority < priority;
+                           });
+    mListeners.insert(it, {id, priority, deadline, listener});
+    return id;
+}
+
+int CarPowerManager::removeListener(int id) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = std::find_if(mListeners.begin(), mListeners.end(),
+                           [id](const ListenerEntry& entry) { return entry.id == id; });
+    if (it == mListeners.end()) {
+        return -1;
+    }
+    mListeners.erase(it);
+    return 0;
+}
+
+std::vector<CarPowerManager::ListenerLatency> CarPowerManager::getLastDispatchLatencies() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLastLatencies;
+}
+
 
 // Private functions
+bool CarPowerManager::registerToCarService() {
+    if (!connectToCarService()) {
+        return false;
+    }
+    if (mListenerToService == nullptr) {
+        mListenerToService = new CarPowerStateListener(this);
+        // Car service waits for finished() on kShutdownPrepare, which dispatch() sends once
+        // all the listeners have returned
+        mICarPower->registerListenerWithCompletion(mListenerToService);
+    }
+    return true;
+}
+
+void CarPowerManager::dispatch(State state) {
+    std::vector<ListenerEntry> listeners;
+    Listener lastListener;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        listeners = mListeners;
+        lastListener = mListener;
+    }
+
+    auto runListener = [state](const ListenerEntry& entry, ListenerLatency* latency) {
+        auto start = std::chrono::steady_clock::now();
+        entry.listener(state);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        *latency = {entry.id, entry.priority,
+                    std::chrono::duration_cast<std::chrono::microseconds>(elapsed)};
+        if ((entry.deadline > std::chrono::milliseconds::zero()) && (elapsed > entry.deadline)) {
+            ALOGW(LOG_TAG "listener %d took %lldus for state %d, over its %lldms deadline",
+                  entry.id, static_cast<long long>(latency->latency.count()),
+                  static_cast<int>(state), static_cast<long long>(entry.deadline.count()));
+        }
+    };
+
+    std::vector<ListenerLatency> latencies(listeners.size());
+    auto dispatchStart = std::chrono::steady_clock::now();
+    for (size_t first = 0; first < listeners.size();) {
+        // Run the listeners of the same priority in parallel, the first one on this thread
+        size_t last = first + 1;
+        while ((last < listeners.size()) &&
+               (listeners[last].priority == listeners[first].priority)) {
+            last++;
+        }
+        std::vector<std::thread> threads;
+        for (size_t i = first + 1; i < last; i++) {
+            threads.emplace_back(runListener, std::cref(listeners[i]), &latencies[i]);
+        }
+        runListener(listeners[first], &latencies[first]);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        first = last;
+    }
+    if (lastListener != nullptr) {
+        lastListener(state);
+    }
+    auto dispatchTime = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - dispatchStart);
+    ALOGI(LOG_TAG "state %d handled by %zu listeners in %lldus", static_cast<int>(state),
+          listeners.size() + (lastListener != nullptr ? 1 : 0),
+          static_cast<long long>(dispatchTime.count()));
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mLastLatencies = std::move(latencies);
+    }
+
+    if ((state == State::kShutdownPrepare) && (mListenerToService != nullptr)) {
+        mICarPower->finished(mListenerToService);
+    }
+}
+
 bool CarPowerManager::connectToCarService() {
     if (mIsConnected) {
         // Service is already connected
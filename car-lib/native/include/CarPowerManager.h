@@ -20,6 +20,11 @@
 #include <binder/Status.h>
 #include <utils/RefBase.h>
 
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
 #include "android/car/ICar.h"
 #include "android/car/hardware/power/BnCarPowerStateListener.h"
 #include "android/car/hardware/power/ICarPower.h"
@@ -53,13 +58,20 @@ public:
 
     using Listener = std::function<void(State)>;
 
+    // How long a listener took to handle the last state change
+    struct ListenerLatency {
+        int id;
+        int priority;
+        std::chrono::microseconds latency;
+    };
+
     CarPowerManager() = default;
     virtual ~CarPowerManager() {
         // Clear the listener if one is set
         clearListener();
     }
 
-    // Removes the listener and turns off callbacks
+    // Removes all the listeners and turns off callbacks
     //  Returns 0 on success
     int clearListener();
 
@@ -67,25 +79,49 @@ public:
     //  Returns 0 on success
     int requestShutdownOnNextSuspend();
 
-    // Set the callback function.  This will execute in the binder thread.
+    // Set the callback function.  This will execute in the binder thread, after the
+    //  listeners added with addListener().
     //  Returns 0 on success
     int setListener(Listener listener);
 
+    // Add a callback function.  Listeners run in order of decreasing priority, and the
+    //  listeners of the same priority run in parallel, each in a thread of its own.  Car
+    //  service is told that the state change is handled once all of them have returned, so
+    //  that kShutdownPrepare waits for their work.  A listener taking longer than its
+    //  deadline, if not zero, is logged.
+    //  Returns the id of the listener, or -1 on failure
+    int addListener(Listener listener, int priority = 0,
+                    std::chrono::milliseconds deadline = std::chrono::milliseconds::zero());
+
+    // Remove a callback function added with addListener()
+    //  Returns 0 on success
+    int removeListener(int id);
+
+    // Returns how long each listener took to handle the last state change
+    std::vector<ListenerLatency> getLastDispatchLatencies();
+
 private:
+    struct ListenerEntry {
+        int id;
+        int priority;
+        std::chrono::milliseconds deadline;
+        Listener listener;
+    };
+
     class CarPowerStateListener final : public BnCarPowerStateListener {
     public:
         explicit CarPowerStateListener(CarPowerManager* parent) : mParent(parent) {}
 
         Status onStateChanged(int state) override {
             sp<CarPowerManager> parent = mParent;
-            if ((parent == nullptr) || (parent->mListener == nullptr)) {
+            if (parent == nullptr) {
                 ALOGE("CarPowerManagerNative: onStateChanged null pointer detected!");
             } else if ((state < static_cast<int>(State::kFirst)) ||
                        (state > static_cast<int>(State::kLast)) )  {
                 ALOGE("CarPowerManagerNative: onStateChanged unknown state: %d", state);
             } else {
-                // Notify the listener of the state transition
-                parent->mListener(static_cast<State>(state));
+                // Notify the listeners of the state transition
+                parent->dispatch(static_cast<State>(state));
             }
             return binder::Status::ok();
         };
@@ -96,10 +132,23 @@ private:
 
     bool connectToCarService();
 
+    // Registers with car service if not yet done
+    bool registerToCarService();
+
+    // Runs the listeners for the state change and tells car service when they are done
+    void dispatch(State state);
+
     sp<ICarPower> mICarPower;
-    bool mIsConnected;
-    Listener mListener;
+    bool mIsConnected = false;
     sp<CarPowerStateListener> mListenerToService;
+
+    std::mutex mMutex;
+    // The listener set with setListener(), which runs last
+    Listener mListener;
+    // The listeners added with addListener(), by decreasing priority
+    std::vector<ListenerEntry> mListeners;
+    int mNextListenerId = 1;
+    std::vector<ListenerLatency> mLastLatencies;
 };
 
 }  // namespace power
@@ -18,7 +18,9 @@
 
 #include <iostream>
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "ClientConfig.pb.h"
 #include "ClientInterface.h"
@@ -40,6 +42,8 @@ using android::automotive::computepipe::runner::engine::RunnerEngineFactory;
 namespace {
 RunnerEngineFactory sEngineFactory;
 ClientInterfaceFactory sClientFactory;
+// Where graphs keep their state across runs and reboots.
+const std::string kGraphCacheRoot = "/data/computepipe/graph_cache";
 }  // namespace
 void terminate(bool isError, std::string msg) {
     if (isError) {
@@ -50,27 +54,40 @@ void terminate(bool isError, std::string msg) {
     exit(0);
 }
 
-int main(int /* argc */, char** /* argv */) {
-    std::shared_ptr<RunnerEngine> engine =
-            sEngineFactory.createRunnerEngine(RunnerEngineFactory::kDefault, "");
+int main(int argc, char** argv) {
+    // Each graph library named on the command line gets an engine of its own,
+    // and graphs reading the same camera share its stream.
+    std::vector<std::string> graphLibraries(argv + 1, argv + argc);
+    if (graphLibraries.empty()) {
+        graphLibraries.push_back("libfacegraph.so");
+    }
+
+    std::vector<std::shared_ptr<RunnerEngine>> engines;
+    for (const std::string& graphLibrary : graphLibraries) {
+        std::shared_ptr<RunnerEngine> engine =
+                sEngineFactory.createRunnerEngine(RunnerEngineFactory::kDefault, "");
 
-    std::unique_ptr<PrebuiltGraph> graph;
-    graph.reset(android::automotive::computepipe::graph::GetLocalGraphFromLibrary("libfacegraph.so",
-                                                                                  engine));
+        std::unique_ptr<PrebuiltGraph> graph;
+        graph.reset(android::automotive::computepipe::graph::GetLocalGraphFromLibrary(
+                graphLibrary, engine, kGraphCacheRoot));
 
-    Options options = graph->GetSupportedGraphConfigs();
-    engine->setPrebuiltGraph(std::move(graph));
+        Options options = graph->GetSupportedGraphConfigs();
+        engine->setPrebuiltGraph(std::move(graph));
 
-    std::function<void(bool, std::string)> cb = terminate;
-    std::unique_ptr<ClientInterface> client =
-        sClientFactory.createClientInterface("aidl", options, engine);
-    if (!client) {
-        std::cerr << "Unable to allocate client";
-        return -1;
+        std::unique_ptr<ClientInterface> client =
+            sClientFactory.createClientInterface("aidl", options, engine);
+        if (!client) {
+            std::cerr << "Unable to allocate client";
+            return -1;
+        }
+        engine->setClientInterface(std::move(client));
+        engines.push_back(engine);
     }
-    engine->setClientInterface(std::move(client));
+
     ABinderProcess_startThreadPool();
-    engine->activate();
+    for (auto& engine : engines) {
+        engine->activate();
+    }
     ABinderProcess_joinThreadPool();
     return 0;
 }
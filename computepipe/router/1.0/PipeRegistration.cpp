@@ -15,6 +15,10 @@
  */
 #include "PipeRegistration.h"
 
+#include <utils/Log.h>
+
+#include <thread>
+
 namespace android {
 namespace automotive {
 namespace computepipe {
@@ -33,9 +37,24 @@ ScopedAStatus PipeRegistration::registerPipeRunner(const std::string& graphName,
     }
     std::unique_ptr<PipeHandle<PipeRunner>> handle = std::make_unique<RunnerHandle>(graphRunner);
     auto err = mRegistry->RegisterPipe(std::move(handle), graphName);
+    if (err == OK && mPrewarmGraphs.count(graphName) > 0) {
+        prewarmRunner(graphName, graphRunner);
+    }
     return convertToBinderStatus(err);
 }
 
+void PipeRegistration::prewarmRunner(const std::string& graphName,
+                                     const std::shared_ptr<IPipeRunner>& graphRunner) {
+    // The runner may be blocked on this registration call, so it is called back from another
+    // thread.
+    std::thread([graphName, graphRunner]() {
+        ScopedAStatus status = graphRunner->prewarm();
+        if (!status.isOk()) {
+            ALOGE("unable to prewarm runner of graph %s", graphName.c_str());
+        }
+    }).detach();
+}
+
 ScopedAStatus PipeRegistration::convertToBinderStatus(Error err) {
     switch (err) {
         case OK:
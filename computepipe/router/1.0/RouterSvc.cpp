@@ -19,6 +19,10 @@
 #include <android/binder_manager.h>
 #include <binder/IServiceManager.h>
 
+#include <cstring>
+#include <sstream>
+#include <string>
+
 #include "PipeQuery.h"
 #include "PipeRegistration.h"
 #include "Registry.h"
@@ -31,10 +35,24 @@ namespace V1_0 {
 namespace implementation {
 
 const static char kRouterName[] = "router";
+const static char kPrewarmArg[] = "--prewarm=";
 
 Error RouterSvc::parseArgs(int argc, char** argv) {
-    (void)argc;
-    (void)argv;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind(kPrewarmArg, 0) != 0) {
+            ALOGE("unknown argument %s", arg.c_str());
+            return BAD_ARGUMENTS;
+        }
+        // Comma separated names of the graphs whose runners are prewarmed.
+        std::stringstream graphs(arg.substr(strlen(kPrewarmArg)));
+        std::string graph;
+        while (std::getline(graphs, graph, ',')) {
+            if (!graph.empty()) {
+                mPrewarmGraphs.insert(graph);
+            }
+        }
+    }
     return OK;
 }
 
@@ -52,7 +70,7 @@ Error RouterSvc::initSvc() {
 }
 
 Error RouterSvc::initRegistrationEngine() {
-    mRegisterEngine = ndk::SharedRefBase::make<PipeRegistration>(mRegistry);
+    mRegisterEngine = ndk::SharedRefBase::make<PipeRegistration>(mRegistry, mPrewarmGraphs);
     if (!mRegisterEngine) {
         ALOGE("unable to allocate registration engine");
         return NOMEM;
@@ -16,6 +16,9 @@
 #ifndef ANDROID_AUTOMOTIVE_COMPUTEPIPE_ROUTER_V1_0_ROUTERSVC
 #define ANDROID_AUTOMOTIVE_COMPUTEPIPE_ROUTER_V1_0_ROUTERSVC
 
+#include <set>
+#include <string>
+
 #include "PipeQuery.h"
 #include "PipeRegistration.h"
 
@@ -50,6 +53,8 @@ class RouterSvc {
     router::Error initRegistrationEngine();
 
     std::string mSvcName = "ComputePipeRouter";
+    // Graphs whose runners are prewarmed when they register.
+    std::set<std::string> mPrewarmGraphs;
     std::shared_ptr<PipeQuery> mQueryEngine;
     std::shared_ptr<PipeRegistration> mRegisterEngine;
     std::shared_ptr<RouterRegistry> mRegistry;
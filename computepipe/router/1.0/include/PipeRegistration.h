@@ -19,6 +19,8 @@
 #include <aidl/android/automotive/computepipe/registry/BnPipeRegistration.h>
 
 #include <memory>
+#include <set>
+#include <string>
 #include <utility>
 
 #include "PipeRunner.h"
@@ -40,14 +42,23 @@ class PipeRegistration
         const std::shared_ptr<aidl::android::automotive::computepipe::runner::IPipeRunner>&
             graphRunner) override;
 
-    explicit PipeRegistration(std::shared_ptr<PipeRegistry<PipeRunner>> r) : mRegistry(r) {
+    // Runners of the graphs in prewarmGraphs are told to prewarm once they register.
+    explicit PipeRegistration(std::shared_ptr<PipeRegistry<PipeRunner>> r,
+                              std::set<std::string> prewarmGraphs = {})
+        : mRegistry(r), mPrewarmGraphs(std::move(prewarmGraphs)) {
     }
     const char* getIfaceName();
 
   private:
     // Convert internal registry error codes to PipeStatus
     ndk::ScopedAStatus convertToBinderStatus(Error err);
+    // Asks a newly registered runner to prewarm, without holding up its registration.
+    void prewarmRunner(
+        const std::string& graphName,
+        const std::shared_ptr<aidl::android::automotive::computepipe::runner::IPipeRunner>&
+            graphRunner);
     std::shared_ptr<PipeRegistry<PipeRunner>> mRegistry;
+    const std::set<std::string> mPrewarmGraphs;
 };
 
 }  // namespace implementation
@@ -16,6 +16,7 @@
 #ifndef ANDROID_AUTOMOTIVE_COMPUTEPIPE_ROUTER_REGISTRY
 #define ANDROID_AUTOMOTIVE_COMPUTEPIPE_ROUTER_REGISTRY
 
+#include <atomic>
 #include <list>
 #include <memory>
 #include <mutex>
@@ -74,6 +75,7 @@ class PipeRegistry {
     }
     /**
      * Returns list of registered graphs.
+     * Reads the current snapshot of the registry without taking a lock.
      */
     std::list<std::string> getPipeList();
     /**
@@ -83,30 +85,25 @@ class PipeRegistry {
      */
     Error RegisterPipe(std::unique_ptr<PipeHandle<T>> h, const std::string& name) {
         std::lock_guard<std::mutex> lock(mPipeDbLock);
-        if (mPipeRunnerDb.find(name) == mPipeRunnerDb.end()) {
-            if (!h->startPipeMonitor()) {
-                return RUNNER_DEAD;
-            }
-            mPipeRunnerDb.emplace(
-                name, std::unique_ptr<PipeContext<T>>(new PipeContext<T>(std::move(h), name)));
-            return OK;
+        std::shared_ptr<const PipeDb> db = snapshot();
+        auto it = db->find(name);
+        if (it != db->end() && it->second->isAlive()) {
+            return DUPLICATE_PIPE;
         }
-        if (!mPipeRunnerDb[name]->isAlive()) {
-            mPipeRunnerDb.erase(name);
-            if (!h->startPipeMonitor()) {
-                return RUNNER_DEAD;
-            }
-            mPipeRunnerDb.emplace(
-                name, std::unique_ptr<PipeContext<T>>(new PipeContext<T>(std::move(h), name)));
-            return OK;
+        if (!h->startPipeMonitor()) {
+            return RUNNER_DEAD;
         }
-        return DUPLICATE_PIPE;
+        // An entry of a dead runner is replaced.
+        PipeDb newDb = *db;
+        newDb[name] = std::make_shared<PipeContext<T>>(std::move(h), name);
+        publish(std::move(newDb));
+        return OK;
     }
 
     PipeRegistry() = default;
 
     ~PipeRegistry() {
-        mPipeRunnerDb.clear();
+        std::atomic_store(&mPipeRunnerDb, std::shared_ptr<const PipeDb>());
     }
 
   protected:
@@ -117,21 +114,33 @@ class PipeRegistry {
      */
     std::unique_ptr<PipeHandle<T>> getPipeHandle(const std::string& name,
                                                  std::unique_ptr<ClientHandle> clientHandle) {
-        std::lock_guard<std::mutex> lock(mPipeDbLock);
-        if (mPipeRunnerDb.find(name) == mPipeRunnerDb.end()) {
-            return nullptr;
-        }
-
         if (!clientHandle) {
-            return mPipeRunnerDb[name]->isAlive() ? mPipeRunnerDb[name]->dupPipeHandle() : nullptr;
+            // A plain lookup only reads the snapshot.
+            std::shared_ptr<const PipeDb> db = snapshot();
+            auto it = db->find(name);
+            if (it == db->end()) {
+                return nullptr;
+            }
+            return it->second->isAlive() ? it->second->dupPipeHandle() : nullptr;
         }
 
-        if (mPipeRunnerDb[name]->isAvailable()) {
-            if (mPipeRunnerDb[name]->isAlive()) {
-                mPipeRunnerDb[name]->setClient(std::move(clientHandle));
-                return mPipeRunnerDb[name]->dupPipeHandle();
+        // Attaching a client changes the context, so it is done by one caller
+        // at a time.
+        std::lock_guard<std::mutex> lock(mPipeDbLock);
+        std::shared_ptr<const PipeDb> db = snapshot();
+        auto it = db->find(name);
+        if (it == db->end()) {
+            return nullptr;
+        }
+        std::shared_ptr<PipeContext<T>> context = it->second;
+        if (context->isAvailable()) {
+            if (context->isAlive()) {
+                context->setClient(std::move(clientHandle));
+                return context->dupPipeHandle();
             } else {
-                mPipeRunnerDb.erase(name);
+                PipeDb newDb = *db;
+                newDb.erase(name);
+                publish(std::move(newDb));
                 return nullptr;
             }
         }
@@ -143,24 +152,41 @@ class PipeRegistry {
      */
     Error DeletePipeHandle(const std::string& name) {
         std::lock_guard<std::mutex> lock(mPipeDbLock);
-        if (mPipeRunnerDb.find(name) == mPipeRunnerDb.end()) {
+        std::shared_ptr<const PipeDb> db = snapshot();
+        if (db->find(name) == db->end()) {
             return PIPE_NOT_FOUND;
         }
-        mPipeRunnerDb.erase(name);
+        PipeDb newDb = *db;
+        newDb.erase(name);
+        publish(std::move(newDb));
         return OK;
     }
 
   private:
+    using PipeDb = std::unordered_map<std::string, std::shared_ptr<PipeContext<T>>>;
+
+    std::shared_ptr<const PipeDb> snapshot() const {
+        return std::atomic_load(&mPipeRunnerDb);
+    }
+    // Called with mPipeDbLock held. Readers holding the previous snapshot keep
+    // using it until they are done.
+    void publish(PipeDb&& db) {
+        std::atomic_store(&mPipeRunnerDb, std::shared_ptr<const PipeDb>(
+                                                  std::make_shared<PipeDb>(std::move(db))));
+    }
+
+    // Serializes writers, which copy the current snapshot and publish a new
+    // one. Readers only load the snapshot.
     std::mutex mPipeDbLock;
-    std::unordered_map<std::string, std::unique_ptr<PipeContext<T>>> mPipeRunnerDb;
+    std::shared_ptr<const PipeDb> mPipeRunnerDb = std::make_shared<PipeDb>();
 };  // namespace router
 
 template <typename T>
 std::list<std::string> PipeRegistry<T>::getPipeList() {
     std::list<std::string> pNames;
 
-    std::lock_guard<std::mutex> lock(mPipeDbLock);
-    for (auto const& kv : mPipeRunnerDb) {
+    std::shared_ptr<const PipeDb> db = snapshot();
+    for (auto const& kv : *db) {
         pNames.push_back(kv.first);
     }
     return pNames;
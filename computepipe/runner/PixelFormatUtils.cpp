@@ -28,6 +28,7 @@ int numBytesPerPixel(AHardwareBuffer_Format format) {
         case AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_R8G8B8_UNORM:
             return 3;
         case AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_S8_UINT:
+        case AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420:
             return 1;
         default:
             CHECK(false) << "Unrecognized pixel format seen";
@@ -43,12 +44,37 @@ AHardwareBuffer_Format PixelFormatToHardwareBufferFormat(PixelFormat pixelFormat
             return AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_R8G8B8_UNORM;
         case PixelFormat::GRAY:
             return AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_S8_UINT;  // TODO: Check if this works
+        case PixelFormat::NV12:
+        case PixelFormat::NV21:
+        case PixelFormat::YUV420:
+            return AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420;
         default:
             CHECK(false) << "Unrecognized pixel format seen";
     }
     return AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_BLOB;
 }
 
+bool isYuvFormat(PixelFormat pixelFormat) {
+    return pixelFormat == PixelFormat::NV12 || pixelFormat == PixelFormat::NV21 ||
+           pixelFormat == PixelFormat::YUV420;
+}
+
+size_t frameSizeBytes(PixelFormat pixelFormat, uint32_t stride, uint32_t height) {
+    size_t lumaSize = static_cast<size_t>(stride) * height;
+    size_t chromaRows = (height + 1) / 2;
+    switch (pixelFormat) {
+        case PixelFormat::NV12:
+        case PixelFormat::NV21:
+            return lumaSize + static_cast<size_t>(stride) * chromaRows;
+        case PixelFormat::YUV420:
+            return lumaSize + 2 * static_cast<size_t>((stride + 1) / 2) * chromaRows;
+        case PixelFormat::RGB_PLANAR_FLOAT:
+            return 3 * lumaSize;
+        default:
+            return lumaSize;
+    }
+}
+
 }  // namespace runner
 }  // namespace computepipe
 }  // namespace automotive
@@ -48,11 +48,12 @@ void deathNotifier(void* cookie) {
 }  // namespace
 
 Status AidlClient::dispatchPacketToClient(int32_t streamId,
-                                          const std::shared_ptr<MemHandle> packet) {
+                                          const std::shared_ptr<MemHandle> packet,
+                                          int64_t arrivalTimeNs) {
     if (!mPipeRunner) {
         return Status::ILLEGAL_STATE;
     }
-    return mPipeRunner->dispatchPacketToClient(streamId, packet);
+    return mPipeRunner->dispatchPacketToClient(streamId, packet, arrivalTimeNs);
 }
 
 Status AidlClient::activate() {
@@ -69,9 +70,10 @@ Status AidlClient::activate() {
     return Status::SUCCESS;
 }
 
-Status AidlClient::deliverGraphDebugInfo(const std::string& debugData) {
+Status AidlClient::deliverGraphDebugInfo(const std::string& debugData,
+                                         const std::string& runnerDebugData) {
     if (mPipeDebugger) {
-        return mPipeDebugger->deliverGraphDebugInfo(debugData);
+        return mPipeDebugger->deliverGraphDebugInfo(debugData, runnerDebugData);
     }
     return Status::SUCCESS;
 }
@@ -36,10 +36,11 @@ class AidlClient : public ClientInterface {
     /**
      * Override ClientInterface Functions
      */
-    Status dispatchPacketToClient(int32_t streamId,
-                                  const std::shared_ptr<MemHandle> packet) override;
+    Status dispatchPacketToClient(int32_t streamId, const std::shared_ptr<MemHandle> packet,
+                                  int64_t arrivalTimeNs) override;
     Status activate() override;
-    Status deliverGraphDebugInfo(const std::string& debugData) override;
+    Status deliverGraphDebugInfo(const std::string& debugData,
+                                 const std::string& runnerDebugData) override;
     /**
      * Override RunnerComponentInterface function
      */
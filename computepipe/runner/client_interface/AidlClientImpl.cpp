@@ -14,6 +14,12 @@
 
 #include "AidlClientImpl.h"
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "OutputConfig.pb.h"
@@ -81,20 +87,42 @@ Status ToAidlPacketType(proto::PacketType type, PacketDescriptorPacketType* outT
     }
 }
 
+// Packets carry the capture time of their input in microseconds of the monotonic clock. Clients
+// get it in nanoseconds, and in milliseconds since the epoch for older clients.
+void SetTimestamps(uint64_t timestampUs, int64_t arrivalTimeNs, PacketDescriptor* desc) {
+    using namespace std::chrono;
+    microseconds sinceCapture =
+            duration_cast<microseconds>(steady_clock::now().time_since_epoch()) -
+            microseconds(timestampUs);
+    desc->sourceTimeStampMillis =
+            duration_cast<milliseconds>(system_clock::now().time_since_epoch() - sinceCapture)
+                    .count();
+    desc->sourceTimeStampNanos = static_cast<int64_t>(timestampUs) * 1000;
+    desc->arrivalTimeStampNanos = arrivalTimeNs;
+}
+
 }  // namespace
 
 Status AidlClientImpl::DispatchSemanticData(int32_t streamId,
-                                           const std::shared_ptr<MemHandle>& packetHandle) {
+                                           const std::shared_ptr<MemHandle>& packetHandle,
+                                           int64_t arrivalTimeNs) {
     PacketDescriptor desc;
 
     if (mPacketHandlers.find(streamId) == mPacketHandlers.end()) {
         LOG(ERROR) << "Bad streamId";
         return Status::INVALID_ARGUMENT;
     }
+    auto channel = mSemanticChannels.find(streamId);
+    if (channel != mSemanticChannels.end()) {
+        return DispatchSharedSemanticData(streamId, &channel->second, packetHandle,
+                                          arrivalTimeNs);
+    }
     Status status = ToAidlPacketType(packetHandle->getType(), &desc.type);
     if (status != SUCCESS) {
         return status;
     }
+    // The one copy of the packet on its way to the client; the graph's output was moved
+    // into the handle.
     desc.data = std::vector(reinterpret_cast<const signed char*>(packetHandle->getData()),
         reinterpret_cast<const signed char*>(packetHandle->getData() + packetHandle->getSize()));
     desc.size = packetHandle->getSize();
@@ -102,7 +130,7 @@ Status AidlClientImpl::DispatchSemanticData(int32_t streamId,
         LOG(ERROR) << "mismatch in char data size and reported size";
         return Status::INVALID_ARGUMENT;
     }
-    desc.sourceTimeStampMillis = packetHandle->getTimeStamp();
+    SetTimestamps(packetHandle->getTimeStamp(), arrivalTimeNs, &desc);
     desc.bufId = 0;
     ScopedAStatus ret = mPacketHandlers[streamId]->deliverPacket(desc);
     if (!ret.isOk()) {
@@ -111,8 +139,38 @@ Status AidlClientImpl::DispatchSemanticData(int32_t streamId,
     return Status::SUCCESS;
 }
 
+Status AidlClientImpl::DispatchSharedSemanticData(int32_t streamId, SemanticChannel* channel,
+                                                 const std::shared_ptr<MemHandle>& packetHandle,
+                                                 int64_t arrivalTimeNs) {
+    int slot = channel->ring->write(packetHandle->getData(), packetHandle->getSize());
+    if (slot < 0) {
+        LOG(WARNING) << "Dropping Semantic packet of " << packetHandle->getSize()
+                     << " bytes, no free slot in shared memory for stream " << streamId;
+        return Status::SUCCESS;
+    }
+
+    PacketDescriptor desc;
+    desc.type = PacketDescriptorPacketType::SEMANTIC_ZERO_COPY_DATA;
+    desc.bufId = slot;
+    desc.size = packetHandle->getSize();
+    SetTimestamps(packetHandle->getTimeStamp(), arrivalTimeNs, &desc);
+    if (!channel->ringShared) {
+        desc.dataFds.emplace_back(dup(channel->ring->getFd()));
+    }
+
+    ScopedAStatus ret = mPacketHandlers[streamId]->deliverPacket(desc);
+    if (!ret.isOk()) {
+        LOG(ERROR) << "Dropping Semantic packet due to error ";
+        channel->ring->release(slot);
+        return Status::SUCCESS;
+    }
+    channel->ringShared = true;
+    return Status::SUCCESS;
+}
+
 Status AidlClientImpl::DispatchPixelData(int32_t streamId,
-                                         const std::shared_ptr<MemHandle>& packetHandle) {
+                                         const std::shared_ptr<MemHandle>& packetHandle,
+                                         int64_t arrivalTimeNs) {
     PacketDescriptor desc;
 
     if (mPacketHandlers.find(streamId) == mPacketHandlers.end()) {
@@ -148,7 +206,7 @@ Status AidlClientImpl::DispatchPixelData(int32_t streamId,
         static_cast<::aidl::android::hardware::graphics::common::BufferUsage>(bufferDesc.usage);
 
     desc.bufId = packetHandle->getBufferId();
-    desc.sourceTimeStampMillis = packetHandle->getTimeStamp();
+    SetTimestamps(packetHandle->getTimeStamp(), arrivalTimeNs, &desc);
 
     ScopedAStatus ret = mPacketHandlers[streamId]->deliverPacket(desc);
     if (!ret.isOk()) {
@@ -160,7 +218,8 @@ Status AidlClientImpl::DispatchPixelData(int32_t streamId,
 
 // Thread-safe function to deliver new packets to client.
 Status AidlClientImpl::dispatchPacketToClient(int32_t streamId,
-                                              const std::shared_ptr<MemHandle>& packetHandle) {
+                                              const std::shared_ptr<MemHandle>& packetHandle,
+                                              int64_t arrivalTimeNs) {
     // TODO(146464279) implement.
     if (!packetHandle) {
         LOG(ERROR) << "invalid packetHandle";
@@ -169,9 +228,9 @@ Status AidlClientImpl::dispatchPacketToClient(int32_t streamId,
     proto::PacketType packetType = packetHandle->getType();
     switch (packetType) {
         case proto::SEMANTIC_DATA:
-            return DispatchSemanticData(streamId, packetHandle);
+            return DispatchSemanticData(streamId, packetHandle, arrivalTimeNs);
         case proto::PIXEL_DATA:
-            return DispatchPixelData(streamId, packetHandle);
+            return DispatchPixelData(streamId, packetHandle, arrivalTimeNs);
         default:
             LOG(ERROR) << "Unsupported packet type " << packetHandle->getType();
             return Status::INVALID_ARGUMENT;
@@ -274,6 +333,7 @@ ScopedAStatus AidlClientImpl::setPipeOutputConfig(int32_t streamId, int32_t maxI
     }
 
     mPacketHandlers.insert(std::pair<int, std::shared_ptr<IPipeStream>>(streamId, handler));
+    mMaxInFlightCounts[streamId] = maxInFlightCount;
 
     proto::ConfigurationCommand configurationCommand;
     configurationCommand.mutable_set_output_stream()->set_stream_id(streamId);
@@ -284,6 +344,7 @@ ScopedAStatus AidlClientImpl::setPipeOutputConfig(int32_t streamId, int32_t maxI
     if (status != SUCCESS) {
         LOG(INFO) << "Failed to register handler for stream id " << streamId;
         mPacketHandlers.erase(streamId);
+        mMaxInFlightCounts.erase(streamId);
     }
     return ToNdkStatus(status);
 }
@@ -335,6 +396,17 @@ ScopedAStatus AidlClientImpl::doneWithPacket(int32_t bufferId, int32_t streamId)
         return ToNdkStatus(Status::INVALID_ARGUMENT);
     }
 
+    // Slots of the shared memory are recycled here, the stream manager holds
+    // nothing for them
+    auto channel = mSemanticChannels.find(streamId);
+    if (channel != mSemanticChannels.end()) {
+        if (!channel->second.ring->release(bufferId)) {
+            LOG(ERROR) << "Bad buffer id provided for doneWithPacket call";
+            return ToNdkStatus(Status::INVALID_ARGUMENT);
+        }
+        return ScopedAStatus::ok();
+    }
+
     return ToNdkStatus(mEngine->freePacket(bufferId, streamId));
 }
 
@@ -359,6 +431,62 @@ ScopedAStatus AidlClientImpl::releaseRunner() {
 
     mClientStateChangeCallback = nullptr;
     mPacketHandlers.clear();
+    mMaxInFlightCounts.clear();
+    mSemanticChannels.clear();
+    return ToNdkStatus(status);
+}
+
+ScopedAStatus AidlClientImpl::setPipeOutputSharedMemory(int32_t streamId, int32_t slotSize) {
+    if (!isClientInitDone()) {
+        return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+
+    if (mPacketHandlers.find(streamId) == mPacketHandlers.end()) {
+        LOG(ERROR) << "Shared memory requested for stream id " << streamId
+                   << " without an output config";
+        return ToNdkStatus(INVALID_ARGUMENT);
+    }
+    if (mSemanticChannels.find(streamId) != mSemanticChannels.end()) {
+        LOG(INFO) << "Shared memory for stream id " << streamId << " has already been set up.";
+        return ToNdkStatus(INVALID_ARGUMENT);
+    }
+    if (slotSize <= 0) {
+        return ToNdkStatus(INVALID_ARGUMENT);
+    }
+
+    bool isSemantic = false;
+    for (const auto& config : mGraphOptions.output_configs()) {
+        if (config.stream_id() == streamId) {
+            isSemantic = config.type() == proto::PacketType::SEMANTIC_DATA;
+            break;
+        }
+    }
+    if (!isSemantic) {
+        LOG(ERROR) << "Shared memory is only supported for semantic streams";
+        return ToNdkStatus(INVALID_ARGUMENT);
+    }
+
+    const uint32_t numSlots = std::max<int32_t>(mMaxInFlightCounts[streamId], 1);
+    SemanticChannel channel;
+    channel.ring = SemanticRing::create("computepipe_stream_" + std::to_string(streamId),
+                                        numSlots, slotSize);
+    if (channel.ring == nullptr) {
+        return ToNdkStatus(NO_MEMORY);
+    }
+    mSemanticChannels.emplace(streamId, std::move(channel));
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus AidlClientImpl::prewarm() {
+    // A client that has already arrived configures the pipe itself.
+    if (isClientInitDone()) {
+        return ScopedAStatus::ok();
+    }
+
+    proto::ControlCommand controlCommand;
+    *controlCommand.mutable_prewarm() = proto::Prewarm();
+
+    Status status = mEngine->processClientCommand(controlCommand);
     return ToNdkStatus(status);
 }
 
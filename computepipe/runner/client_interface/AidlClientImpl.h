@@ -24,6 +24,7 @@
 #include "ClientEngineInterface.h"
 #include "MemHandle.h"
 #include "Options.pb.h"
+#include "SemanticRing.h"
 #include "types/GraphState.h"
 #include "types/Status.h"
 
@@ -46,7 +47,8 @@ class AidlClientImpl : public aidl::android::automotive::computepipe::runner::Bn
     ~AidlClientImpl() {
     }
 
-    Status dispatchPacketToClient(int32_t streamId, const std::shared_ptr<MemHandle>& packetHandle);
+    Status dispatchPacketToClient(int32_t streamId, const std::shared_ptr<MemHandle>& packetHandle,
+                                  int64_t arrivalTimeNs);
     void setPipeDebugger(
         const std::shared_ptr<aidl::android::automotive::computepipe::runner::IPipeDebugger>&
         pipeDebugger);
@@ -78,16 +80,36 @@ class AidlClientImpl : public aidl::android::automotive::computepipe::runner::Bn
 
     ndk::ScopedAStatus releaseRunner() override;
 
+    ndk::ScopedAStatus setPipeOutputSharedMemory(int32_t streamId, int32_t slotSize) override;
+
+    ndk::ScopedAStatus prewarm() override;
+
     void clientDied();
 
   private:
     // Dispatch semantic data to client. Has copy semantics and does not expect
     // client to invoke doneWithPacket.
-    Status DispatchSemanticData(int32_t streamId, const std::shared_ptr<MemHandle>& packetHandle);
+    Status DispatchSemanticData(int32_t streamId, const std::shared_ptr<MemHandle>& packetHandle,
+                                int64_t arrivalTimeNs);
+
+    // Shared memory of a semantic stream the client set up with
+    // setPipeOutputSharedMemory().
+    struct SemanticChannel {
+        std::unique_ptr<SemanticRing> ring;
+        // Whether the client was sent the ring yet.
+        bool ringShared = false;
+    };
+
+    // Dispatch semantic data to client through the shared memory of the
+    // stream. Expects the client to invoke done with packet.
+    Status DispatchSharedSemanticData(int32_t streamId, SemanticChannel* channel,
+                                      const std::shared_ptr<MemHandle>& packetHandle,
+                                      int64_t arrivalTimeNs);
 
     // Dispatch pixel data to client. Expects the client to invoke done with
     // packet.
-    Status DispatchPixelData(int32_t streamId, const std::shared_ptr<MemHandle>& packetHandle);
+    Status DispatchPixelData(int32_t streamId, const std::shared_ptr<MemHandle>& packetHandle,
+                             int64_t arrivalTimeNs);
 
     bool isClientInitDone();
 
@@ -102,6 +124,11 @@ class AidlClientImpl : public aidl::android::automotive::computepipe::runner::Bn
     std::map<int, std::shared_ptr<aidl::android::automotive::computepipe::runner::IPipeStream>>
         mPacketHandlers;
 
+    // Max in flight packets the client asked for, per stream.
+    std::map<int, int32_t> mMaxInFlightCounts;
+
+    std::map<int, SemanticChannel> mSemanticChannels;
+
     std::shared_ptr<aidl::android::automotive::computepipe::runner::IPipeDebugger> mPipeDebugger =
         nullptr;
 };
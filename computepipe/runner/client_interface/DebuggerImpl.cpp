@@ -90,6 +90,20 @@ Status RecursiveCreateDir(const std::string& dirName) {
     }
 }
 
+Status WriteProfilingDataFile(const std::string& filePath, const std::string& data) {
+    std::string fileRemoveError;
+    if (!android::base::RemoveFileIfExists(filePath, &fileRemoveError)) {
+        LOG(ERROR) << "Failed to remove file " << filePath << ", error: "
+            << fileRemoveError;
+        return Status::INTERNAL_ERROR;
+    }
+    if (!android::base::WriteStringToFile(data, filePath)) {
+        LOG(ERROR) << "Failed to write profiling data to file at path " << filePath;
+        return Status::INTERNAL_ERROR;
+    }
+    return Status::SUCCESS;
+}
+
 }  // namespace
 
 ndk::ScopedAStatus DebuggerImpl::setPipeProfileOptions(PipeProfilingType in_type) {
@@ -226,22 +240,26 @@ Status DebuggerImpl::handleResetPhase(const RunnerEvent& e) {
     return Status::SUCCESS;
 }
 
-Status DebuggerImpl::deliverGraphDebugInfo(const std::string& debugData) {
+Status DebuggerImpl::deliverGraphDebugInfo(const std::string& debugData,
+                                           const std::string& runnerDebugData) {
     Status status = RecursiveCreateDir(mProfilingDataDirName);
     if (status != Status::SUCCESS) {
         return status;
     }
 
     std::string profilingDataFilePath = mProfilingDataDirName + "/" + mGraphOptions.graph_name();
-    std::string fileRemoveError;
-    if (!android::base::RemoveFileIfExists(profilingDataFilePath, &fileRemoveError)) {
-        LOG(ERROR) << "Failed to remove file " << profilingDataFilePath << ", error: "
-            << fileRemoveError;
-        return Status::INTERNAL_ERROR;
+    status = WriteProfilingDataFile(profilingDataFilePath, debugData);
+    if (status != Status::SUCCESS) {
+        return status;
     }
-    if (!android::base::WriteStringToFile(debugData, profilingDataFilePath)) {
-        LOG(ERROR) << "Failed to write profiling data to file at path " << profilingDataFilePath;
-        return Status::INTERNAL_ERROR;
+    // The statistics of the runner go in a file of their own, after the data
+    // of the graph, whose format is up to the graph.
+    std::string runnerDataFilePath = profilingDataFilePath + "_runner";
+    if (!runnerDebugData.empty()) {
+        status = WriteProfilingDataFile(runnerDataFilePath, runnerDebugData);
+        if (status != Status::SUCCESS) {
+            return status;
+        }
     }
 
     std::lock_guard<std::mutex> lk(mLock);
@@ -249,6 +267,10 @@ Status DebuggerImpl::deliverGraphDebugInfo(const std::string& debugData) {
     mProfilingData.size = debugData.size();
     mProfilingData.dataFds.emplace_back(
         ndk::ScopedFileDescriptor(open(profilingDataFilePath.c_str(), O_CREAT, O_RDWR)));
+    if (!runnerDebugData.empty()) {
+        mProfilingData.dataFds.emplace_back(
+            ndk::ScopedFileDescriptor(open(runnerDataFilePath.c_str(), O_CREAT, O_RDWR)));
+    }
     mWait.notify_one();
     return Status::SUCCESS;
 }
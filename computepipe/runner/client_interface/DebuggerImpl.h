@@ -58,7 +58,7 @@ class DebuggerImpl : public aidl::android::automotive::computepipe::runner::BnPi
     Status handleStopImmediatePhase(const RunnerEvent& e) override;
     Status handleResetPhase(const RunnerEvent& e) override;
 
-    Status deliverGraphDebugInfo(const std::string& debugData);
+    Status deliverGraphDebugInfo(const std::string& debugData, const std::string& runnerDebugData);
 
   private:
     std::weak_ptr<ClientEngineInterface> mEngine;
@@ -0,0 +1,103 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SemanticRing.h"
+
+#include <android-base/logging.h>
+#include <cutils/ashmem.h>
+#include <sys/mman.h>
+
+#include <cstring>
+#include <utility>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace client_interface {
+namespace aidl_client {
+
+std::unique_ptr<SemanticRing> SemanticRing::create(const std::string& name, uint32_t numSlots,
+                                                   uint32_t slotSize) {
+    if (numSlots == 0 || slotSize == 0) {
+        return nullptr;
+    }
+    const size_t length = static_cast<size_t>(numSlots) * slotSize;
+
+    android::base::unique_fd fd(ashmem_create_region(name.c_str(), length));
+    if (fd.get() < 0) {
+        LOG(ERROR) << "Unable to create shared memory for " << name;
+        return nullptr;
+    }
+
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (base == MAP_FAILED) {
+        PLOG(ERROR) << "Unable to map shared memory for " << name;
+        return nullptr;
+    }
+
+    return std::unique_ptr<SemanticRing>(
+            new SemanticRing(std::move(fd), static_cast<char*>(base), numSlots, slotSize));
+}
+
+SemanticRing::SemanticRing(android::base::unique_fd fd, char* base, uint32_t numSlots,
+                           uint32_t slotSize)
+    : mFd(std::move(fd)), mBase(base), mSlotSize(slotSize), mInFlight(numSlots, false) {
+}
+
+SemanticRing::~SemanticRing() {
+    munmap(mBase, mInFlight.size() * mSlotSize);
+}
+
+int SemanticRing::write(const char* data, uint32_t size) {
+    if (size > mSlotSize) {
+        return -1;
+    }
+
+    uint32_t slot;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        const uint32_t numSlots = mInFlight.size();
+        uint32_t i = 0;
+        while (i < numSlots && mInFlight[(mNextSlot + i) % numSlots]) {
+            i++;
+        }
+        if (i == numSlots) {
+            return -1;
+        }
+        slot = (mNextSlot + i) % numSlots;
+        mInFlight[slot] = true;
+        mNextSlot = (slot + 1) % numSlots;
+    }
+
+    // Nobody else touches a slot while it is in flight
+    memcpy(mBase + static_cast<size_t>(slot) * mSlotSize, data, size);
+    return slot;
+}
+
+bool SemanticRing::release(int slot) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (slot < 0 || slot >= static_cast<int>(mInFlight.size()) || !mInFlight[slot]) {
+        return false;
+    }
+    mInFlight[slot] = false;
+    return true;
+}
+
+}  // namespace aidl_client
+}  // namespace client_interface
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
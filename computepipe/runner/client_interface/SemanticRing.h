@@ -0,0 +1,71 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_CLIENT_INTERFACE_SEMANTICRING_H_
+#define COMPUTEPIPE_RUNNER_CLIENT_INTERFACE_SEMANTICRING_H_
+
+#include <android-base/unique_fd.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace client_interface {
+namespace aidl_client {
+
+// Shared memory through which the packets of a semantic stream reach the
+// client. The memory is split into equally sized slots that are filled in
+// turn, and a slot stays in flight until the client is done with its packet.
+class SemanticRing {
+  public:
+    // Returns nullptr if the shared memory cannot be set up.
+    static std::unique_ptr<SemanticRing> create(const std::string& name, uint32_t numSlots,
+                                                uint32_t slotSize);
+    ~SemanticRing();
+
+    // Copies a packet into the next free slot. Returns the slot, or -1 if the
+    // packet does not fit a slot or every slot is in flight.
+    int write(const char* data, uint32_t size);
+    // Returns a slot for reuse. Returns false if the slot was not in flight.
+    bool release(int slot);
+
+    int getFd() const {
+        return mFd.get();
+    }
+
+  private:
+    SemanticRing(android::base::unique_fd fd, char* base, uint32_t numSlots, uint32_t slotSize);
+
+    const android::base::unique_fd mFd;
+    char* const mBase;
+    const uint32_t mSlotSize;
+
+    std::mutex mLock;
+    std::vector<bool> mInFlight;
+    uint32_t mNextSlot = 0;
+};
+
+}  // namespace aidl_client
+}  // namespace client_interface
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_CLIENT_INTERFACE_SEMANTICRING_H_
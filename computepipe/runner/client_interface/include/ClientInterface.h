@@ -36,10 +36,13 @@ namespace client_interface {
 class ClientInterface : public RunnerComponentInterface {
   public:
     /**
-     * Used by the runner engine to dispatch Graph output packes to the clients
+     * Used by the runner engine to dispatch Graph output packes to the clients.
+     * arrivalTimeNs is when the input of the packet reached the runner, in
+     * nanoseconds of the monotonic clock, or 0 if not known.
      */
     virtual Status dispatchPacketToClient(int32_t streamId,
-                                          const std::shared_ptr<MemHandle> packet) = 0;
+                                          const std::shared_ptr<MemHandle> packet,
+                                          int64_t arrivalTimeNs) = 0;
     /**
      * Used by the runner engine to activate the client interface and open it to
      * external clients
@@ -47,9 +50,12 @@ class ClientInterface : public RunnerComponentInterface {
     virtual Status activate() = 0;
 
     /*
-     *
+     * Used by the runner engine to hand the profiling data of the graph, and
+     * text describing how the input sources and the stages of the runner
+     * performed, to the debugger.
      */
-    virtual Status deliverGraphDebugInfo(const std::string& debugData) = 0;
+    virtual Status deliverGraphDebugInfo(const std::string& debugData,
+                                         const std::string& runnerDebugData) = 0;
     virtual ~ClientInterface() = default;
 };
 
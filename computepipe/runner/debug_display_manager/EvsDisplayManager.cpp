@@ -60,7 +60,11 @@ EvsDisplayManager::~EvsDisplayManager() {
 }
 
 Status EvsDisplayManager::setArgs(std::string displayManagerArgs) {
-    auto pos = displayManagerArgs.find(kDisplayId);
+    auto pos = displayManagerArgs.find(kDisplayRate);
+    if (pos != std::string::npos) {
+        mDisplayRate = std::stoi(displayManagerArgs.substr(pos + strlen(kDisplayRate)));
+    }
+    pos = displayManagerArgs.find(kDisplayId);
     if (pos == std::string::npos) {
         return Status::SUCCESS;
     }
@@ -127,24 +131,34 @@ void EvsDisplayManager::threadFn() {
             break;
         }
 
+        // Drawn without the lock, so that frames handed over meanwhile only wait for the lock.
+        std::shared_ptr<MemHandle> frame = std::move(mNextFrame);
+        mNextFrame = nullptr;
+        std::function<Status(int bufferId)> freePacketCallback = mFreePacketCallback;
+        lk.unlock();
+
         BufferDesc tgtBuffer = {};
         evsDisplay->getTargetBuffer([&tgtBuffer](const BufferDesc& buff) {
                 tgtBuffer = buff;
                 }
             );
 
-        BufferDesc srcBuffer = getBufferDesc(mNextFrame);
-        if (!evsRenderer.drawFrame(tgtBuffer, srcBuffer)) {
-            LOG(ERROR) << "Error in rendering a frame.";
-            mStopThread = true;
-        }
+        // The hardware buffer is imported as a texture and scaled to the display by the GPU.
+        BufferDesc srcBuffer = getBufferDesc(frame);
+        bool drawn = evsRenderer.drawFrame(tgtBuffer, srcBuffer);
 
         evsDisplay->returnTargetBufferForDisplay(tgtBuffer);
-        if (mFreePacketCallback) {
-            mFreePacketCallback(mNextFrame->getBufferId());
+        if (freePacketCallback) {
+            freePacketCallback(frame->getBufferId());
+        }
+
+        lk.lock();
+        if (!drawn) {
+            LOG(ERROR) << "Error in rendering a frame.";
+            mStopThread = true;
         }
-        mNextFrame = nullptr;
     }
+    lk.unlock();
 
     LOG(INFO) << "Computepipe runner closing debug display.";
     evsRenderer.deactivate();
@@ -164,6 +178,10 @@ Status EvsDisplayManager::displayFrame(const std::shared_ptr<MemHandle>& dataHan
     if (mStopThread) {
         return Status::ILLEGAL_STATE;
     }
+    if (!mRateLimiter.admit(systemTime(SYSTEM_TIME_MONOTONIC))) {
+        return mFreePacketCallback ? mFreePacketCallback(dataHandle->getBufferId())
+                                   : Status::SUCCESS;
+    }
     if (mNextFrame != nullptr && mFreePacketCallback) {
         status = mFreePacketCallback(mNextFrame->getBufferId());
     }
@@ -176,6 +194,7 @@ Status EvsDisplayManager::handleExecutionPhase(const RunnerEvent& e) {
     if (e.isPhaseEntry()) {
         std::lock_guard<std::mutex> lk(mLock);
         mStopThread = false;
+        mRateLimiter.setMaxRate(mDisplayRate);
         mThread = std::thread(&EvsDisplayManager::threadFn, this);
     } else if (e.isAborted()) {
         stopThread();
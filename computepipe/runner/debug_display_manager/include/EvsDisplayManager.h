@@ -20,6 +20,7 @@
 #include <thread>
 
 #include "DebugDisplayManager.h"
+#include "FrameRateLimiter.h"
 #include "InputFrame.h"
 #include "MemHandle.h"
 #include "types/Status.h"
@@ -30,8 +31,14 @@ namespace computepipe {
 namespace runner {
 namespace debug_display_manager {
 
+/* Shows the frames of a stream on an EVS display. Frames are drawn by the GPU straight from their
+ * hardware buffers, scaled to the display, on a thread of the display manager. Frames that come
+ * in faster than the display rate are freed without being drawn. */
 class EvsDisplayManager : public DebugDisplayManager {
   public:
+    static constexpr char kDisplayRate[] = "display_fps:";
+    static constexpr unsigned kDefaultDisplayRate = 15;
+
     /* Override DebugDisplayManager methods */
     /* Send a frame to debug display.
      * This is a non-blocking call. When the frame is ready to be freed, setFreePacketCallback()
@@ -60,6 +67,7 @@ class EvsDisplayManager : public DebugDisplayManager {
     // Variables to remember displayId if set through arguments.
     bool mOverrideDisplayId = false;
     int mDisplayId;
+    unsigned mDisplayRate = kDefaultDisplayRate;
 
     std::thread mThread;
     bool mStopThread = false;
@@ -69,6 +77,7 @@ class EvsDisplayManager : public DebugDisplayManager {
     std::condition_variable mWait;
     std::shared_ptr<MemHandle> mNextFrame = nullptr;
     std::function<Status (int bufferId)> mFreePacketCallback = nullptr;
+    ::android::automotive::evs::support::FrameRateLimiter mRateLimiter;
 };
 
 }  // namespace debug_display_manager
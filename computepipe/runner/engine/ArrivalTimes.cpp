@@ -0,0 +1,49 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "ArrivalTimes.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+
+void ArrivalTimes::record(int64_t timestamp, int64_t arrivalTimeNs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    Entry& entry = mEntries[static_cast<uint64_t>(timestamp) % kCapacity];
+    if (entry.timestamp == timestamp && entry.arrivalTimeNs <= arrivalTimeNs) {
+        return;
+    }
+    entry.timestamp = timestamp;
+    entry.arrivalTimeNs = arrivalTimeNs;
+}
+
+int64_t ArrivalTimes::lookup(int64_t timestamp) const {
+    std::lock_guard<std::mutex> lock(mLock);
+    const Entry& entry = mEntries[static_cast<uint64_t>(timestamp) % kCapacity];
+    return entry.timestamp == timestamp ? entry.arrivalTimeNs : 0;
+}
+
+void ArrivalTimes::clear() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries.fill(Entry());
+}
+
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,67 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef COMPUTEPIPE_RUNNER_ENGINE_ARRIVALTIMES_H_
+#define COMPUTEPIPE_RUNNER_ENGINE_ARRIVALTIMES_H_
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+
+/**
+ * Remembers when the runner received the input frames that are in the graph,
+ * keyed by their timestamp, so that the outputs of a frame can carry its
+ * arrival time to the client. Only the latest inputs are held; colliding
+ * timestamps make the older input forgotten.
+ */
+class ArrivalTimes {
+  public:
+    /**
+     * Notes the arrival of an input. Of frames that share a timestamp, the
+     * earliest arrival is kept.
+     */
+    void record(int64_t timestamp, int64_t arrivalTimeNs);
+    /**
+     * The arrival time of the input with the timestamp, or 0 if not known.
+     */
+    int64_t lookup(int64_t timestamp) const;
+    void clear();
+
+  private:
+    static constexpr int kCapacity = 64;
+    static constexpr int64_t kNoTimestamp = INT64_MIN;
+
+    struct Entry {
+        int64_t timestamp = kNoTimestamp;
+        int64_t arrivalTimeNs = 0;
+    };
+
+    mutable std::mutex mLock;
+    std::array<Entry, kCapacity> mEntries;
+};
+
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_ENGINE_ARRIVALTIMES_H_
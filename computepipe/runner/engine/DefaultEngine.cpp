@@ -15,12 +15,15 @@
 #include "DefaultEngine.h"
 
 #include <android-base/logging.h>
+#include <threadpolicy/ThreadPolicy.h>
 
 #include <algorithm>
 #include <cassert>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include "ClientInterface.h"
@@ -36,14 +39,24 @@ namespace runner {
 namespace engine {
 
 using android::automotive::computepipe::graph::PrebuiltGraph;
+using android::automotive::computepipe::graph::PrebuiltGraphState;
 using android::automotive::computepipe::runner::client_interface::ClientInterface;
 using android::automotive::computepipe::runner::generator::DefaultEvent;
 using android::automotive::computepipe::runner::input_manager::InputEngineInterface;
+using android::automotive::computepipe::runner::input_manager::InputManager;
+using android::automotive::computepipe::runner::stream_manager::BufferPlacement;
+using android::automotive::computepipe::runner::stream_manager::DropPolicy;
 using android::automotive::computepipe::runner::stream_manager::StreamEngineInterface;
 using android::automotive::computepipe::runner::stream_manager::StreamManager;
 
 namespace {
 
+// The debug display is a consumer of the display stream next to the client. It holds the frame
+// it is drawing and the next one, and drops the frames it has no room for rather than slow the
+// client down.
+constexpr int kDebugDisplayConsumer = 1;
+constexpr uint32_t kDebugDisplayMaxInFlightPackets = 2;
+
 int getStreamIdFromSource(std::string source) {
     auto pos = source.find(":");
     return std::stoi(source.substr(pos + 1));
@@ -57,17 +70,107 @@ void DefaultEngine::setClientInterface(std::unique_ptr<ClientInterface>&& client
 void DefaultEngine::setPrebuiltGraph(std::unique_ptr<PrebuiltGraph>&& graph) {
     mGraph = std::move(graph);
     mGraphDescriptor = mGraph->GetSupportedGraphConfigs();
-    if (mGraph->GetGraphType() == graph::PrebuiltGraphType::REMOTE ||
-        mGraphDescriptor.input_configs_size() == 0) {
+    if (!mGraph->AcceptsInputStreams() || mGraphDescriptor.input_configs_size() == 0) {
         mIgnoreInputManager = true;
     }
 }
 
+Status DefaultEngine::swapPrebuiltGraph(std::unique_ptr<PrebuiltGraph>&& graph) {
+    std::lock_guard<std::mutex> lock(mEngineLock);
+    if (!graph || !mGraph) {
+        return Status::INVALID_ARGUMENT;
+    }
+    // Clients were handed the options of the current graph, which the new one
+    // needs to keep honoring.
+    if (graph->GetSupportedGraphConfigs().graph_name() != mGraphDescriptor.graph_name() ||
+        graph->AcceptsInputStreams() != mGraph->AcceptsInputStreams()) {
+        LOG(ERROR) << "Engine::new graph does not match the options of the current graph";
+        return Status::INVALID_ARGUMENT;
+    }
+    if (mCurrentPhase == kStopPhase) {
+        return Status::ILLEGAL_STATE;
+    }
+    releaseRetiredGraph();
+
+    // Warm the new graph up to where the current one is, while the current one
+    // keeps running.
+    Status ret;
+    if (mCurrentPhase != kResetPhase) {
+        ClientConfig config = mConfigBuilder.emitClientOptions();
+        config.setPhaseState(PhaseState::ENTRY);
+        ret = graph->handleConfigPhase(config);
+        if (ret == Status::SUCCESS) {
+            config.setPhaseState(PhaseState::TRANSITION_COMPLETE);
+            ret = graph->handleConfigPhase(config);
+        }
+        if (ret != Status::SUCCESS) {
+            LOG(ERROR) << "Engine::unable to configure the new graph";
+            return ret;
+        }
+    }
+    if (mCurrentPhase == kRunPhase) {
+        ret = graph->handleExecutionPhase(DefaultEvent::generateEntryEvent(DefaultEvent::RUN));
+        if (ret == Status::SUCCESS) {
+            ret = graph->handleExecutionPhase(
+                    DefaultEvent::generateTransitionCompleteEvent(DefaultEvent::RUN));
+        }
+        if (ret != Status::SUCCESS) {
+            LOG(ERROR) << "Engine::unable to start the new graph";
+            mRetiredGraph = std::move(graph);
+            releaseRetiredGraph();
+            return ret;
+        }
+    }
+
+    // Frames that are being handed to the current graph get there before it is
+    // replaced, and the next frame goes to the new graph.
+    {
+        std::unique_lock<std::shared_mutex> routingLock(mGraphRoutingLock);
+        std::swap(mGraph, graph);
+    }
+    mRetiredGraph = std::move(graph);
+    if (mCurrentPhase == kRunPhase) {
+        // Outputs of the frames in flight in the retired graph still reach the
+        // stream managers.
+        (void)mRetiredGraph->handleStopWithFlushPhase(
+                DefaultEvent::generateEntryEvent(DefaultEvent::STOP_WITH_FLUSH));
+    } else {
+        releaseRetiredGraph();
+    }
+    return Status::SUCCESS;
+}
+
 Status DefaultEngine::setArgs(std::string engine_args) {
     auto pos = engine_args.find(kNoInputManager);
     if (pos != std::string::npos) {
         mIgnoreInputManager = true;
     }
+    pos = engine_args.find(kMaxInFlightFrames);
+    if (pos != std::string::npos) {
+        int maxInFlightFrames = std::stoi(engine_args.substr(pos + strlen(kMaxInFlightFrames)));
+        if (maxInFlightFrames < 1) {
+            LOG(ERROR) << "Engine::max in flight frames must be at least 1";
+            return Status::INVALID_ARGUMENT;
+        }
+        bool reentrantGraph = engine_args.find(kReentrantGraph) != std::string::npos;
+        mGraphDispatcher = std::make_unique<GraphDispatcher>(
+                maxInFlightFrames, reentrantGraph,
+                [this](int streamId, int64_t timestamp, const InputFrame& frame) {
+                    return this->setGraphInput(streamId, timestamp, frame);
+                },
+                [this](int64_t timestamp, const InputFrameSet& frames) {
+                    return this->setGraphInputSet(timestamp, frames);
+                });
+    }
+    pos = engine_args.find(kFlushTimeoutMs);
+    if (pos != std::string::npos) {
+        int flushTimeoutMs = std::stoi(engine_args.substr(pos + strlen(kFlushTimeoutMs)));
+        if (flushTimeoutMs < 0) {
+            LOG(ERROR) << "Engine::flush timeout must not be negative";
+            return Status::INVALID_ARGUMENT;
+        }
+        mFlushTimeout = std::chrono::milliseconds(flushTimeoutMs);
+    }
     pos = engine_args.find(kDisplayStreamId);
     if (pos == std::string::npos) {
         return Status::SUCCESS;
@@ -164,12 +267,14 @@ Status DefaultEngine::processClientCommand(const proto::ControlCommand& command)
         if (mCurrentPhase != kRunPhase) {
             return Status::ILLEGAL_STATE;
         }
+        mStageProfiler.start();
         if (mGraph) {
             return mGraph->StartGraphProfiling();
         }
         return Status::SUCCESS;
     }
     if (command.has_stop_pipe_profile()) {
+        mStageProfiler.stop();
         if (mCurrentPhase != kRunPhase) {
             return Status::SUCCESS;
         }
@@ -184,6 +289,13 @@ Status DefaultEngine::processClientCommand(const proto::ControlCommand& command)
         }
         queueCommand("ClientInterface", EngineCommand::Type::RELEASE_DEBUGGER);
     }
+    if (command.has_prewarm()) {
+        if (mCurrentPhase != kResetPhase) {
+            return Status::ILLEGAL_STATE;
+        }
+        queueCommand("ClientInterface", EngineCommand::Type::PREWARM);
+        return Status::SUCCESS;
+    }
     if (command.has_read_debug_data()) {
         queueCommand("ClientInterface", EngineCommand::Type::READ_PROFILING);
         return Status::SUCCESS;
@@ -197,9 +309,19 @@ Status DefaultEngine::freePacket(int bufferId, int streamId) {
             << "Unable to find the stream manager corresponding to the id for freeing the packet.";
         return Status::INVALID_ARGUMENT;
     }
+    mStageProfiler.markReturned(streamId, bufferId);
     return mStreamManagers[streamId]->freePacket(bufferId);
 }
 
+Status DefaultEngine::freeDebugDisplayPacket(int bufferId) {
+    if (mStreamManagers.find(mDisplayStream) == mStreamManagers.end()) {
+        LOG(ERROR) << "Unable to find the stream manager of the display stream for freeing the "
+                      "packet.";
+        return Status::INVALID_ARGUMENT;
+    }
+    return mStreamManagers[mDisplayStream]->freePacket(bufferId, kDebugDisplayConsumer);
+}
+
 /**
  * Methods from PrebuiltEngineInterface
  */
@@ -210,7 +332,13 @@ void DefaultEngine::DispatchPixelData(int streamId, int64_t timestamp, const Inp
         LOG(ERROR) << "Engine::Received bad stream id from prebuilt graph";
         return;
     }
+    if (mGraphDispatcher) {
+        mGraphDispatcher->waitForOutputTurn(timestamp);
+    }
+    mStageProfiler.markOutput(streamId, timestamp);
+    StageProfiler::Clock::time_point begin = StageProfiler::Clock::now();
     mStreamManagers[streamId]->queuePacket(frame, timestamp);
+    mStageProfiler.record(StageProfiler::OUTPUT_COPY, streamId, begin);
 }
 
 void DefaultEngine::DispatchSerializedData(int streamId, int64_t timestamp, std::string&& output) {
@@ -220,15 +348,61 @@ void DefaultEngine::DispatchSerializedData(int streamId, int64_t timestamp, std:
         LOG(ERROR) << "Engine::Received bad stream id from prebuilt graph";
         return;
     }
-    std::string data(output);
-    mStreamManagers[streamId]->queuePacket(data.c_str(), data.size(), timestamp);
+    if (mGraphDispatcher) {
+        mGraphDispatcher->waitForOutputTurn(timestamp);
+    }
+    mStageProfiler.markOutput(streamId, timestamp);
+    StageProfiler::Clock::time_point begin = StageProfiler::Clock::now();
+    mStreamManagers[streamId]->queuePacket(std::move(output), timestamp);
+    mStageProfiler.record(StageProfiler::OUTPUT_COPY, streamId, begin);
+}
+
+AHardwareBuffer* DefaultEngine::AcquirePixelBuffer(int streamId, uint32_t width, uint32_t height,
+                                                   PixelFormat format) {
+    if (mStreamManagers.find(streamId) == mStreamManagers.end()) {
+        LOG(ERROR) << "Engine::Received bad stream id from prebuilt graph";
+        return nullptr;
+    }
+    return mStreamManagers[streamId]->acquireOutputBuffer(width, height, format);
+}
+
+void DefaultEngine::DispatchPixelBuffer(int streamId, int64_t timestamp, AHardwareBuffer* buffer) {
+    LOG(DEBUG) << "Engine::Received buffer for pixel stream  " << streamId << " with timestamp "
+              << timestamp;
+    if (mStreamManagers.find(streamId) == mStreamManagers.end()) {
+        LOG(ERROR) << "Engine::Received bad stream id from prebuilt graph";
+        return;
+    }
+    if (mGraphDispatcher) {
+        mGraphDispatcher->waitForOutputTurn(timestamp);
+    }
+    mStageProfiler.markOutput(streamId, timestamp);
+    StageProfiler::Clock::time_point begin = StageProfiler::Clock::now();
+    mStreamManagers[streamId]->queueOutputBuffer(buffer, timestamp);
+    mStageProfiler.record(StageProfiler::OUTPUT_COPY, streamId, begin);
+}
+
+void DefaultEngine::ReleasePixelBuffer(int streamId, AHardwareBuffer* buffer) {
+    if (mStreamManagers.find(streamId) == mStreamManagers.end()) {
+        LOG(ERROR) << "Engine::Received bad stream id from prebuilt graph";
+        return;
+    }
+    mStreamManagers[streamId]->releaseOutputBuffer(buffer);
 }
 
 void DefaultEngine::DispatchGraphTerminationMessage(Status s, std::string&& msg) {
     std::lock_guard<std::mutex> lock(mEngineLock);
+    // A retired graph reports when it has flushed, which does not end the run.
+    if (mRetiredGraph && mRetiredGraph->GetGraphState() == PrebuiltGraphState::STOPPED &&
+        mGraph->GetGraphState() != PrebuiltGraphState::STOPPED) {
+        LOG(INFO) << "Engine::retired graph terminated";
+        return;
+    }
     if (s == SUCCESS) {
         if (mCurrentPhase == kRunPhase) {
             queueCommand("PrebuiltGraph", EngineCommand::Type::BROADCAST_INITIATE_STOP);
+        } else if (mFlushDeadline) {
+            queueCommand("PrebuiltGraph", EngineCommand::Type::FINISH_FLUSH);
         } else {
             LOG(WARNING) << "Graph termination when not in run phase";
         }
@@ -240,20 +414,31 @@ void DefaultEngine::DispatchGraphTerminationMessage(Status s, std::string&& msg)
 
 Status DefaultEngine::broadcastClientConfig() {
     ClientConfig config = mConfigBuilder.emitClientOptions();
+    std::string managersKey = getManagersKey(config);
 
-    LOG(INFO) << "Engine::create stream manager";
-    Status ret = populateStreamManagers(config);
-    if (ret != Status::SUCCESS) {
-        return ret;
-    }
-
-    if (mGraph) {
-        ret = populateInputManagers(config);
+    Status ret;
+    if (reuseCachedManagers(managersKey)) {
+        LOG(INFO) << "Engine::reuse stream and input managers of the previous config";
+    } else {
+        LOG(INFO) << "Engine::create stream manager";
+        ret = populateStreamManagers(config);
         if (ret != Status::SUCCESS) {
-            abortClientConfig(config);
+            mCachedInputManagers.clear();
             return ret;
         }
+        if (mGraph && reuseCachedInputManagers(config)) {
+            LOG(INFO) << "Engine::reuse input managers of the previous config";
+        } else if (mGraph) {
+            ret = populateInputManagers(config);
+            if (ret != Status::SUCCESS) {
+                abortClientConfig(config);
+                return ret;
+            }
+        }
+        mCachedInputManagers.clear();
+    }
 
+    if (mGraph) {
         LOG(INFO) << "Engine::send client config entry to graph";
         config.setPhaseState(PhaseState::ENTRY);
         ret = mGraph->handleConfigPhase(config);
@@ -272,8 +457,8 @@ Status DefaultEngine::broadcastClientConfig() {
     LOG(INFO) << "Engine::Graph configured";
     // TODO add handling for remote graph
     if (mDebugDisplayManager) {
-        mDebugDisplayManager->setFreePacketCallback(std::bind(
-                &DefaultEngine::freePacket, this, std::placeholders::_1, mDisplayStream));
+        mDebugDisplayManager->setFreePacketCallback(
+                std::bind(&DefaultEngine::freeDebugDisplayPacket, this, std::placeholders::_1));
 
         ret = mDebugDisplayManager->handleConfigPhase(config);
         if (ret != Status::SUCCESS) {
@@ -290,10 +475,87 @@ Status DefaultEngine::broadcastClientConfig() {
         return ret;
     }
 
+    configureStageProfiler(config);
+    mManagersKey = managersKey;
     mCurrentPhase = kConfigPhase;
     return Status::SUCCESS;
 }
 
+std::string DefaultEngine::getManagersKey(const ClientConfig& config) {
+    std::string key = config.getSerializedClientConfig();
+    if (key.empty()) {
+        return key;
+    }
+    // The display stream config depends on whether the client reads the stream too.
+    return key + (mConfigBuilder.clientConfigEnablesDisplayStream() ? "1" : "0");
+}
+
+bool DefaultEngine::reuseCachedManagers(const std::string& key) {
+    bool reuse = !key.empty() && key == mCachedManagersKey;
+    if (reuse) {
+        mStreamManagers = std::move(mCachedStreamManagers);
+        mInputManagers = std::move(mCachedInputManagers);
+    }
+    mCachedStreamManagers.clear();
+    mCachedManagersKey.clear();
+    return reuse;
+}
+
+bool DefaultEngine::reuseCachedInputManagers(const ClientConfig& config) {
+    int inputConfigId;
+    // Input managers are keyed by the input config they were created for.
+    bool reuse = config.getInputConfigId(&inputConfigId) == Status::SUCCESS &&
+                 mCachedInputManagers.size() == 1 &&
+                 mCachedInputManagers.count(inputConfigId) == 1;
+    if (reuse) {
+        mInputManagers = std::move(mCachedInputManagers);
+    }
+    mCachedInputManagers.clear();
+    return reuse;
+}
+
+void DefaultEngine::prewarm() {
+    if (mCurrentPhase != kResetPhase || !mGraph || mGraphDescriptor.input_configs_size() == 0) {
+        return;
+    }
+    // A client that started configuring the pipe meanwhile takes precedence.
+    ConfigBuilder unconfigured = mConfigBuilder;
+    unconfigured.reset();
+    if (mConfigBuilder.emitClientOptions().getSerializedClientConfig() !=
+        unconfigured.emitClientOptions().getSerializedClientConfig()) {
+        return;
+    }
+    LOG(INFO) << "Engine::prewarm for input config "
+              << mGraphDescriptor.input_configs(0).config_id();
+    mConfigBuilder.updateInputConfigOption(mGraphDescriptor.input_configs(0).config_id());
+    if (broadcastClientConfig() != Status::SUCCESS) {
+        LOG(WARNING) << "Engine::prewarm failed to apply the config";
+        mConfigBuilder.reset();
+        return;
+    }
+    broadcastReset(/* cacheManagers = */ true);
+}
+
+void DefaultEngine::configureStageProfiler(const ClientConfig& config) {
+    std::vector<int> inputStreamIds;
+    int inputConfigId;
+    if (config.getInputConfigId(&inputConfigId) == Status::SUCCESS) {
+        for (auto& inputIt : mGraphDescriptor.input_configs()) {
+            if (inputIt.config_id() != inputConfigId) {
+                continue;
+            }
+            for (auto& streamIt : inputIt.input_stream()) {
+                inputStreamIds.push_back(streamIt.stream_id());
+            }
+        }
+    }
+    std::vector<int> outputStreamIds;
+    for (auto& it : mStreamManagers) {
+        outputStreamIds.push_back(it.first);
+    }
+    mStageProfiler.configureStreams(inputStreamIds, outputStreamIds);
+}
+
 void DefaultEngine::abortClientConfig(const ClientConfig& config, bool resetGraph) {
     mStreamManagers.clear();
     mInputManagers.clear();
@@ -306,16 +568,19 @@ void DefaultEngine::abortClientConfig(const ClientConfig& config, bool resetGrap
 
 Status DefaultEngine::broadcastStartRun() {
     DefaultEvent runEvent = DefaultEvent::generateEntryEvent(DefaultEvent::RUN);
+    auto enterRun = [&runEvent](RunnerComponentInterface& component) {
+        return component.handleExecutionPhase(runEvent);
+    };
 
+    // The stream managers are ready for outputs before the graph starts, and
+    // the input managers start once the graph is ready for their frames.
     std::vector<int> successfulStreams;
     std::vector<int> successfulInputs;
-    for (auto& it : mStreamManagers) {
-        if (it.second->handleExecutionPhase(runEvent) != Status::SUCCESS) {
-            LOG(ERROR) << "Engine::failure to enter run phase for stream " << it.first;
-            broadcastAbortRun(successfulStreams, successfulInputs);
-            return Status::INTERNAL_ERROR;
-        }
-        successfulStreams.push_back(it.first);
+    if (mPhaseBroadcaster.broadcast("run", "stream", mStreamManagers, enterRun,
+                                    &successfulStreams) != Status::SUCCESS) {
+        LOG(ERROR) << "Engine::failure to enter run phase for a stream";
+        broadcastAbortRun(successfulStreams, successfulInputs);
+        return Status::INTERNAL_ERROR;
     }
     // TODO: send to remote
     if (mDebugDisplayManager) {
@@ -324,18 +589,21 @@ Status DefaultEngine::broadcastStartRun() {
 
     Status ret;
     if (mGraph) {
+        if (mGraphDispatcher) {
+            mGraphDispatcher->start();
+        }
         LOG(INFO) << "Engine::sending start run to prebuilt";
-        ret = mGraph->handleExecutionPhase(runEvent);
+        ret = mPhaseBroadcaster.run("run", "graph", [this, &enterRun]() {
+            return enterRun(*mGraph);
+        });
         if (ret != Status::SUCCESS) {
             broadcastAbortRun(successfulStreams, successfulInputs);
         }
-        for (auto& it : mInputManagers) {
-            if (it.second->handleExecutionPhase(runEvent) != Status::SUCCESS) {
-                LOG(ERROR) << "Engine::failure to enter run phase for input manager " << it.first;
-                broadcastAbortRun(successfulStreams, successfulInputs, true);
-                return Status::INTERNAL_ERROR;
-            }
-            successfulInputs.push_back(it.first);
+        if (mPhaseBroadcaster.broadcast("run", "input", mInputManagers, enterRun,
+                                        &successfulInputs) != Status::SUCCESS) {
+            LOG(ERROR) << "Engine::failure to enter run phase for an input manager";
+            broadcastAbortRun(successfulStreams, successfulInputs, true);
+            return Status::INTERNAL_ERROR;
         }
     }
 
@@ -380,6 +648,9 @@ void DefaultEngine::broadcastAbortRun(const std::vector<int>& streamIds,
     std::for_each(inputIds.begin(), inputIds.end(), [this, runEvent](int id) {
         (void)this->mInputManagers[id]->handleExecutionPhase(runEvent);
     });
+    if (mGraphDispatcher) {
+        mGraphDispatcher->stop(/* flush = */ false);
+    }
     if (abortGraph) {
         if (mGraph) {
             (void)mGraph->handleExecutionPhase(runEvent);
@@ -395,22 +666,60 @@ Status DefaultEngine::broadcastStopWithFlush() {
     }
 
     if (mGraph) {
-        for (auto& it : mInputManagers) {
-            (void)it.second->handleStopWithFlushPhase(runEvent);
+        (void)mPhaseBroadcaster.broadcast("stop with flush", "input", mInputManagers,
+                                          [&runEvent](InputManager& manager) {
+                                              return manager.handleStopWithFlushPhase(runEvent);
+                                          });
+        // The graph gets the frames already in flight before it is told to stop,
+        // unless it stopped on its own. Frames it cannot take before the flush
+        // timeout are dropped.
+        auto deadline = std::chrono::steady_clock::now() + mFlushTimeout;
+        if (mGraphDispatcher) {
+            size_t discarded = mGraphDispatcher->stop(/* flush = */ mStopFromClient, deadline);
+            if (discarded > 0) {
+                LOG(WARNING) << "Engine::flush discarded " << discarded << " input frames";
+            }
         }
         if (mStopFromClient) {
-            (void)mGraph->handleStopWithFlushPhase(runEvent);
+            (void)mPhaseBroadcaster.run("stop with flush", "graph", [this, &runEvent]() {
+                return mGraph->handleStopWithFlushPhase(runEvent);
+            });
+            // The outputs the graph produces while it flushes still go to the
+            // client, so the stream managers stop once the graph is done.
+            if (mGraph->GetGraphState() == PrebuiltGraphState::FLUSHING) {
+                mFlushDeadline = deadline;
+                mCurrentPhase = kStopPhase;
+                return Status::SUCCESS;
+            }
         }
     }
-    // TODO: send to remote.
-    for (auto& it : mStreamManagers) {
-        (void)it.second->handleStopWithFlushPhase(runEvent);
+    stopStreamManagers(runEvent);
+    mCurrentPhase = kStopPhase;
+    return Status::SUCCESS;
+}
+
+void DefaultEngine::finishFlush(bool timedOut) {
+    mFlushDeadline.reset();
+    if (timedOut) {
+        LOG(WARNING) << "Engine::graph did not flush within " << mFlushTimeout.count()
+                     << " ms, discarding its remaining outputs";
+        if (mGraph) {
+            (void)mGraph->handleStopImmediatePhase(
+                    DefaultEvent::generateEntryEvent(DefaultEvent::STOP_IMMEDIATE));
+        }
     }
+    stopStreamManagers(DefaultEvent::generateEntryEvent(DefaultEvent::STOP_WITH_FLUSH));
+}
+
+void DefaultEngine::stopStreamManagers(const DefaultEvent& runEvent) {
+    // TODO: send to remote.
+    (void)mPhaseBroadcaster.broadcast("stop with flush", "stream", mStreamManagers,
+                                      [&runEvent](StreamManager& manager) {
+                                          return manager.handleStopWithFlushPhase(runEvent);
+                                      });
     if (!mStopFromClient) {
         (void)mClient->handleStopWithFlushPhase(runEvent);
     }
-    mCurrentPhase = kStopPhase;
-    return Status::SUCCESS;
 }
 
 Status DefaultEngine::broadcastStopComplete() {
@@ -436,23 +745,27 @@ Status DefaultEngine::broadcastStopComplete() {
 
 void DefaultEngine::broadcastHalt() {
     DefaultEvent stopEvent = DefaultEvent::generateEntryEvent(DefaultEvent::STOP_IMMEDIATE);
+    auto halt = [&stopEvent](RunnerComponentInterface& component) {
+        return component.handleStopImmediatePhase(stopEvent);
+    };
 
     if (mGraph) {
-        for (auto& it : mInputManagers) {
-            (void)it.second->handleStopImmediatePhase(stopEvent);
+        (void)mPhaseBroadcaster.broadcast("halt", "input", mInputManagers, halt);
+        if (mGraphDispatcher) {
+            mGraphDispatcher->stop(/* flush = */ false);
         }
 
         if ((mCurrentPhaseError->source.find("PrebuiltGraph") == std::string::npos)) {
-            (void)mGraph->handleStopImmediatePhase(stopEvent);
+            (void)mPhaseBroadcaster.run("halt", "graph", [this, &halt]() {
+                return halt(*mGraph);
+            });
         }
     }
     if (mDebugDisplayManager) {
         (void)mDebugDisplayManager->handleStopImmediatePhase(stopEvent);
     }
     // TODO: send to remote if client was source.
-    for (auto& it : mStreamManagers) {
-        (void)it.second->handleStopImmediatePhase(stopEvent);
-    }
+    (void)mPhaseBroadcaster.broadcast("halt", "stream", mStreamManagers, halt);
     if (mCurrentPhaseError->source.find("ClientInterface") == std::string::npos) {
         (void)mClient->handleStopImmediatePhase(stopEvent);
     }
@@ -480,7 +793,66 @@ void DefaultEngine::broadcastHalt() {
     mCurrentPhase = kConfigPhase;
 }
 
-void DefaultEngine::broadcastReset() {
+void DefaultEngine::releaseRetiredGraph() {
+    if (!mRetiredGraph) {
+        return;
+    }
+    if (mRetiredGraph->GetGraphState() != PrebuiltGraphState::STOPPED) {
+        (void)mRetiredGraph->handleStopImmediatePhase(
+                DefaultEvent::generateEntryEvent(DefaultEvent::STOP_IMMEDIATE));
+    }
+    (void)mRetiredGraph->handleResetPhase(DefaultEvent::generateEntryEvent(DefaultEvent::RESET));
+    (void)mRetiredGraph->handleResetPhase(
+            DefaultEvent::generateTransitionCompleteEvent(DefaultEvent::RESET));
+    mRetiredGraph = nullptr;
+}
+
+Status DefaultEngine::setGraphInput(int streamId, int64_t timestamp, const InputFrame& frame) {
+    std::shared_lock<std::shared_mutex> routingLock(mGraphRoutingLock);
+    return mGraph->SetInputStreamPixelData(streamId, timestamp, frame);
+}
+
+Status DefaultEngine::setGraphInputSet(int64_t timestamp, const InputFrameSet& frames) {
+    std::shared_lock<std::shared_mutex> routingLock(mGraphRoutingLock);
+    return mGraph->SetInputStreamsPixelData(timestamp, frames);
+}
+
+void DefaultEngine::setGraphOutputBackpressure(int streamId, bool congested) {
+    std::shared_lock<std::shared_mutex> routingLock(mGraphRoutingLock);
+    if (mGraph == nullptr) {
+        return;
+    }
+    Status status = mGraph->SetOutputStreamBackpressure(streamId, congested);
+    if (status != Status::SUCCESS) {
+        LOG(WARNING) << "Graph did not take the backpressure of stream " << streamId;
+    }
+}
+
+void DefaultEngine::recordArrival(int64_t timestamp, const InputFrame& frame,
+                                  StageProfiler::Clock::time_point now) {
+    int64_t arrivalTimeNs = frame.getFrameInfo().arrivalTimeNs;
+    if (arrivalTimeNs == 0) {
+        arrivalTimeNs =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch())
+                        .count();
+    }
+    mArrivalTimes.record(timestamp, arrivalTimeNs);
+}
+
+void DefaultEngine::broadcastReset(bool cacheManagers) {
+    releaseRetiredGraph();
+    mArrivalTimes.clear();
+    mCachedStreamManagers.clear();
+    mCachedInputManagers.clear();
+    mCachedManagersKey.clear();
+    if (cacheManagers && mCurrentPhase == kConfigPhase) {
+        // Parked rather than freed, so that the cameras stay open and the buffers allocated
+        // for a client that applies the same config again.
+        mCachedStreamManagers = std::move(mStreamManagers);
+        mCachedInputManagers = std::move(mInputManagers);
+        mCachedManagersKey = mManagersKey;
+    }
+    mManagersKey.clear();
     mStreamManagers.clear();
     mInputManagers.clear();
     DefaultEvent resetEvent = DefaultEvent::generateEntryEvent(DefaultEvent::RESET);
@@ -507,6 +879,7 @@ Status DefaultEngine::populateStreamManagers(const ClientConfig& config) {
     if (config.getOutputStreamConfigs(outputConfigs) != Status::SUCCESS) {
         return Status::ILLEGAL_STATE;
     }
+    BufferPlacement placement = getBufferPlacement(config);
     for (auto& configIt : outputConfigs) {
         int streamId = configIt.first;
         int maxInFlightPackets = configIt.second;
@@ -540,38 +913,74 @@ Status DefaultEngine::populateStreamManagers(const ClientConfig& config) {
             this->queueCommand(source, EngineCommand::Type::POLL_COMPLETE);
         };
 
+        // The display stream may only be there for the debug display, in which case the client
+        // gets none of its packets.
+        if (streamId == mDisplayStream && !mConfigBuilder.clientConfigEnablesDisplayStream()) {
+            maxInFlightPackets = 0;
+        }
+
+        std::function<void(bool)> backpressureCb = [this, streamId](bool congested) {
+            this->setGraphOutputBackpressure(streamId, congested);
+        };
+
         std::shared_ptr<StreamEngineInterface> engine = std::make_shared<StreamCallback>(
-            std::move(eos), std::move(errorCb), std::move(packetCb));
-        mStreamManagers.emplace(configIt.first, mStreamFactory.getStreamManager(
-                                                    outputDescriptor, engine, maxInFlightPackets));
+            std::move(eos), std::move(errorCb), std::move(packetCb), std::move(backpressureCb));
+        mStreamManagers.emplace(configIt.first,
+                                mStreamFactory.getStreamManager(outputDescriptor, engine,
+                                                                maxInFlightPackets, placement));
         if (mStreamManagers[streamId] == nullptr) {
             LOG(ERROR) << "unable to create stream manager for stream " << streamId;
             return Status::INTERNAL_ERROR;
         }
+
+        if (streamId == mDisplayStream && mDebugDisplayManager) {
+            Status status = mStreamManagers[streamId]->addConsumer(
+                kDebugDisplayConsumer, kDebugDisplayMaxInFlightPackets, DropPolicy::LATEST_WINS,
+                [this](const std::shared_ptr<MemHandle>& handle) {
+                    return mDebugDisplayManager->displayFrame(handle);
+                });
+            if (status != Status::SUCCESS) {
+                LOG(ERROR) << "unable to add the debug display to stream " << streamId;
+                return status;
+            }
+        }
     }
     return Status::SUCCESS;
 }
 
+BufferPlacement DefaultEngine::getBufferPlacement(const ClientConfig& config) {
+    int offloadId;
+    if (config.getOffloadId(&offloadId) != Status::SUCCESS) {
+        return BufferPlacement();
+    }
+    // Offload configs are identified to clients by their config id, set as a number.
+    for (auto& offloadConfig : mGraphDescriptor.offload_configs()) {
+        if (offloadConfig.config_id() == std::to_string(offloadId)) {
+            return BufferPlacement::forOffload(offloadConfig.options());
+        }
+    }
+    LOG(WARNING) << "no matching offload config for requested id " << offloadId;
+    return BufferPlacement();
+}
+
 Status DefaultEngine::forwardOutputDataToClient(int streamId,
                                                 std::shared_ptr<MemHandle>& dataHandle) {
-    if (streamId != mDisplayStream) {
-        return mClient->dispatchPacketToClient(streamId, dataHandle);
+    int64_t arrivalTimeNs = mArrivalTimes.lookup(dataHandle->getTimeStamp());
+    // The stream managers hand packets to the debug display themselves.
+    if (!mStageProfiler.isEnabled()) {
+        return mClient->dispatchPacketToClient(streamId, dataHandle, arrivalTimeNs);
     }
-
-    auto displayMgrPacket = dataHandle;
-    if (mConfigBuilder.clientConfigEnablesDisplayStream()) {
-        if (mStreamManagers.find(streamId) == mStreamManagers.end()) {
-            displayMgrPacket = nullptr;
-        } else {
-            displayMgrPacket = mStreamManagers[streamId]->clonePacket(dataHandle);
-        }
-        Status status = mClient->dispatchPacketToClient(streamId, dataHandle);
-        if (status != Status::SUCCESS) {
-            return status;
-        }
+    // Marked first, as the client may return the packet before the call does.
+    mStageProfiler.markDelivered(streamId, dataHandle->getBufferId());
+    StageProfiler::Clock::time_point begin = StageProfiler::Clock::now();
+    if (arrivalTimeNs != 0) {
+        mStageProfiler.record(
+                StageProfiler::INPUT_TO_CLIENT, streamId,
+                StageProfiler::Clock::time_point(std::chrono::nanoseconds(arrivalTimeNs)));
     }
-    CHECK(mDebugDisplayManager);
-    return mDebugDisplayManager->displayFrame(dataHandle);
+    Status status = mClient->dispatchPacketToClient(streamId, dataHandle, arrivalTimeNs);
+    mStageProfiler.record(StageProfiler::CLIENT_DELIVERY, streamId, begin);
+    return status;
 }
 
 Status DefaultEngine::populateInputManagers(const ClientConfig& config) {
@@ -596,7 +1005,35 @@ Status DefaultEngine::populateInputManagers(const ClientConfig& config) {
                     this->queueError(source, "", false);
                 },
                 [this](int streamId, int64_t timestamp, const InputFrame& frame) {
-                    return this->mGraph->SetInputStreamPixelData(streamId, timestamp, frame);
+                    StageProfiler::Clock::time_point begin = StageProfiler::Clock::now();
+                    this->recordArrival(timestamp, frame, begin);
+                    this->mStageProfiler.markInput(timestamp);
+                    Status status;
+                    if (this->mGraphDispatcher) {
+                        status = this->mGraphDispatcher->queueFrame(streamId, timestamp, frame);
+                    } else {
+                        status = this->setGraphInput(streamId, timestamp, frame);
+                    }
+                    this->mStageProfiler.record(StageProfiler::INPUT_DISPATCH, streamId, begin);
+                    return status;
+                },
+                [this](int64_t timestamp, const InputFrameSet& frames) {
+                    StageProfiler::Clock::time_point begin = StageProfiler::Clock::now();
+                    for (const auto& [streamId, frame] : frames) {
+                        this->recordArrival(timestamp, *frame, begin);
+                    }
+                    this->mStageProfiler.markInput(timestamp);
+                    Status status;
+                    if (this->mGraphDispatcher) {
+                        status = this->mGraphDispatcher->queueFrameSet(timestamp, frames);
+                    } else {
+                        status = this->setGraphInputSet(timestamp, frames);
+                    }
+                    for (const auto& [streamId, frame] : frames) {
+                        this->mStageProfiler.record(StageProfiler::INPUT_DISPATCH, streamId,
+                                                    begin);
+                    }
+                    return status;
                 });
             mInputManagers.emplace(selectedId,
                                    mInputFactory.createInputManager(inputDescriptor, cb));
@@ -615,17 +1052,29 @@ Status DefaultEngine::populateInputManagers(const ClientConfig& config) {
  * Engine Command Queue and Error Queue handling
  */
 void DefaultEngine::processCommands() {
+    android::automotive::evs::threadpolicy::applyThreadPolicy(
+            android::automotive::evs::threadpolicy::kRoleComputePipe);
+
     std::unique_lock<std::mutex> lock(mEngineLock);
     while (1) {
         LOG(INFO) << "Engine::Waiting on commands ";
-        mWakeLooper.wait(lock, [this] {
+        auto hasWork = [this] {
             if (this->mCommandQueue.empty() && !mCurrentPhaseError) {
                 return false;
             } else {
                 return true;
             }
-        });
+        };
+        if (mFlushDeadline) {
+            if (!mWakeLooper.wait_until(lock, *mFlushDeadline, hasWork)) {
+                finishFlush(/* timedOut = */ true);
+                continue;
+            }
+        } else {
+            mWakeLooper.wait(lock, hasWork);
+        }
         if (mCurrentPhaseError) {
+            mFlushDeadline.reset();
             mErrorQueue.push(*mCurrentPhaseError);
 
             processComponentError(mCurrentPhaseError->source);
@@ -670,8 +1119,17 @@ void DefaultEngine::processCommands() {
                     }
                 }
                 break;
+            case EngineCommand::Type::PREWARM:
+                prewarm();
+                break;
+            case EngineCommand::Type::FINISH_FLUSH:
+                if (mFlushDeadline) {
+                    LOG(INFO) << "Engine::Graph flushed";
+                    finishFlush(/* timedOut = */ false);
+                }
+                break;
             case EngineCommand::Type::RESET_CONFIG:
-                (void)broadcastReset();
+                (void)broadcastReset(/* cacheManagers = */ true);
                 break;
             case EngineCommand::Type::RELEASE_DEBUGGER:
                 {
@@ -689,8 +1147,15 @@ void DefaultEngine::processCommands() {
                                 || mCurrentPhase == kStopPhase)) {
                     debugData = mGraph->GetDebugInfo();
                 }
+                std::string runnerDebugData;
+                for (auto& it : mInputManagers) {
+                    runnerDebugData += it.second->getDebugInfo();
+                }
+                runnerDebugData += mStageProfiler.getDebugInfo();
+                runnerDebugData += mPhaseBroadcaster.getDebugInfo();
+                runnerDebugData += android::automotive::evs::threadpolicy::dumpThreadPolicies();
                 if (mClient) {
-                    Status status = mClient->deliverGraphDebugInfo(debugData);
+                    Status status = mClient->deliverGraphDebugInfo(debugData, runnerDebugData);
                     if (status != Status::SUCCESS) {
                         LOG(ERROR) << "Failed to deliver graph debug info to client.";
                     }
@@ -728,14 +1193,19 @@ void DefaultEngine::queueError(std::string source, std::string msg, bool fatal)
  */
 InputCallback::InputCallback(
     int id, const std::function<void(int)>&& cb,
-    const std::function<Status(int, int64_t timestamp, const InputFrame&)>&& packetCb)
-    : mErrorCallback(cb), mPacketHandler(packetCb), mInputId(id) {
+    const std::function<Status(int, int64_t timestamp, const InputFrame&)>&& packetCb,
+    const std::function<Status(int64_t timestamp, const InputFrameSet&)>&& setCb)
+    : mErrorCallback(cb), mPacketHandler(packetCb), mSetHandler(setCb), mInputId(id) {
 }
 
 Status InputCallback::dispatchInputFrame(int streamId, int64_t timestamp, const InputFrame& frame) {
     return mPacketHandler(streamId, timestamp, frame);
 }
 
+Status InputCallback::dispatchInputFrames(int64_t timestamp, const InputFrameSet& frames) {
+    return mSetHandler(timestamp, frames);
+}
+
 void InputCallback::notifyInputError() {
     mErrorCallback(mInputId);
 }
@@ -745,8 +1215,12 @@ void InputCallback::notifyInputError() {
  */
 StreamCallback::StreamCallback(
     const std::function<void()>&& eos, const std::function<void(std::string)>&& errorCb,
-    const std::function<Status(const std::shared_ptr<MemHandle>&)>&& packetHandler)
-    : mErrorHandler(errorCb), mEndOfStreamHandler(eos), mPacketHandler(packetHandler) {
+    const std::function<Status(const std::shared_ptr<MemHandle>&)>&& packetHandler,
+    const std::function<void(bool)>&& backpressureHandler)
+    : mErrorHandler(errorCb),
+      mEndOfStreamHandler(eos),
+      mPacketHandler(packetHandler),
+      mBackpressureHandler(backpressureHandler) {
 }
 
 void StreamCallback::notifyError(std::string msg) {
@@ -757,6 +1231,10 @@ void StreamCallback::notifyEndOfStream() {
     mEndOfStreamHandler();
 }
 
+void StreamCallback::notifyBackpressure(bool congested) {
+    mBackpressureHandler(congested);
+}
+
 Status StreamCallback::dispatchPacket(const std::shared_ptr<MemHandle>& packet) {
     return mPacketHandler(packet);
 }
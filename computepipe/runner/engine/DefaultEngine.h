@@ -15,19 +15,26 @@
 #ifndef COMPUTEPIPE_RUNNER_ENGINE_DEFAULTENGINE_H_
 #define COMPUTEPIPE_RUNNER_ENGINE_DEFAULTENGINE_H_
 
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <mutex>
+#include <optional>
 #include <queue>
+#include <shared_mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "ArrivalTimes.h"
 #include "ConfigBuilder.h"
 #include "DebugDisplayManager.h"
+#include "GraphDispatcher.h"
 #include "InputManager.h"
 #include "Options.pb.h"
+#include "PhaseBroadcaster.h"
 #include "RunnerEngine.h"
+#include "StageProfiler.h"
 #include "StreamManager.h"
 
 namespace android {
@@ -52,6 +59,8 @@ struct EngineCommand {
         RESET_CONFIG,
         RELEASE_DEBUGGER,
         READ_PROFILING,
+        FINISH_FLUSH,
+        PREWARM,
     };
     std::string source;
     Type cmdType;
@@ -83,6 +92,9 @@ class DefaultEngine : public RunnerEngine {
   public:
     static constexpr char kDisplayStreamId[] = "display_stream:";
     static constexpr char kNoInputManager[] = "no_input_manager";
+    static constexpr char kMaxInFlightFrames[] = "max_in_flight_frames:";
+    static constexpr char kReentrantGraph[] = "reentrant_graph";
+    static constexpr char kFlushTimeoutMs[] = "flush_timeout_ms:";
     static constexpr char kResetPhase[] = "Reset";
     static constexpr char kConfigPhase[] = "Config";
     static constexpr char kRunPhase[] = "Running";
@@ -93,6 +105,7 @@ class DefaultEngine : public RunnerEngine {
     Status setArgs(std::string engine_args) override;
     void setClientInterface(std::unique_ptr<client_interface::ClientInterface>&& client) override;
     void setPrebuiltGraph(std::unique_ptr<graph::PrebuiltGraph>&& graph) override;
+    Status swapPrebuiltGraph(std::unique_ptr<graph::PrebuiltGraph>&& graph) override;
     Status activate() override;
     /**
      * Methods from ClientEngineInterface to override
@@ -107,6 +120,13 @@ class DefaultEngine : public RunnerEngine {
 
     void DispatchSerializedData(int streamId, int64_t timestamp, std::string&& output) override;
 
+    AHardwareBuffer* AcquirePixelBuffer(int streamId, uint32_t width, uint32_t height,
+                                        PixelFormat format) override;
+
+    void DispatchPixelBuffer(int streamId, int64_t timestamp, AHardwareBuffer* buffer) override;
+
+    void ReleasePixelBuffer(int streamId, AHardwareBuffer* buffer) override;
+
     void DispatchGraphTerminationMessage(Status s, std::string&& msg) override;
 
   private:
@@ -151,9 +171,24 @@ class DefaultEngine : public RunnerEngine {
      * A successful return can leave the runner in stopping phase.
      * We transition to stop completely, once all inflight traffic has been drained at a later
      * point, identified by stream managers.
+     * When the client stops the run, the stream managers keep going until the
+     * graph reports that it has flushed, or the flush timeout passes.
      * @Lock held mEngineLock
      */
     Status broadcastStopWithFlush();
+    /**
+     * Ends the flush of the graph. If it timed out, the graph is stopped
+     * immediately and the outputs still in it are discarded. Then the stream
+     * managers are told to stop.
+     * @Lock held mEngineLock
+     */
+    void finishFlush(bool timedOut);
+    /**
+     * Sends the stop with flush event to the stream managers, and to the
+     * client if it did not ask for the stop.
+     * @Lock held mEngineLock
+     */
+    void stopStreamManagers(const DefaultEvent& runEvent);
     /**
      * Broadcast transtion to stop complete. This is a confirmation to all
      * components that stop has finished. At the end of this we transition back
@@ -173,9 +208,12 @@ class DefaultEngine : public RunnerEngine {
      * specific configuration and transition to reset state. For RAII
      * components, they are freed at this point. ALso resets the mConfigBuilder
      * to its original state. Successful return puts the runner in reset phase.
+     * With cacheManagers set, the stream and input managers of a configured
+     * runner are kept for the next config, if it is the same. The input
+     * managers are also kept for a config with the same input config.
      * @Lock held mEngineLock
      */
-    void broadcastReset();
+    void broadcastReset(bool cacheManagers = false);
     /**
      * Populate stream managers for a given client config. For each client
      * selected output config, we generate stream managers. During reset phase
@@ -184,6 +222,11 @@ class DefaultEngine : public RunnerEngine {
      * @Lock held mEngineLock
      */
     Status populateStreamManagers(const ClientConfig& config);
+    /**
+     * How the pixel stream buffers are allocated for the offload option the
+     * client picked. Buffers suit the CPU if the client picked none.
+     */
+    stream_manager::BufferPlacement getBufferPlacement(const ClientConfig& config);
     /**
      * Populate input managers for a given client config. For each client
      * selected output config, we generate input managers. During reset phase
@@ -192,10 +235,67 @@ class DefaultEngine : public RunnerEngine {
      * @Lock held mEngineLock
      */
     Status populateInputManagers(const ClientConfig& config);
+    /**
+     * Identifies the stream and input managers that a client config needs.
+     * Empty if the config cannot be identified.
+     */
+    std::string getManagersKey(const ClientConfig& config);
+    /**
+     * Takes the cached managers if they were set up for the key, and drops
+     * them otherwise. Returns whether they were taken.
+     * @Lock held mEngineLock
+     */
+    bool reuseCachedManagers(const std::string& key);
+    /**
+     * Takes the cached input managers if they were set up for the input
+     * config of the client config. Drops the cached input managers either way.
+     * Returns whether they were taken.
+     * @Lock held mEngineLock
+     */
+    bool reuseCachedInputManagers(const ClientConfig& config);
+    /**
+     * Applies the first input config of the graph ahead of any client and
+     * resets, keeping the input managers for the client that comes next.
+     * @Lock held mEngineLock
+     */
+    void prewarm();
+    /**
+     * Sets up the stage profiler for the streams of the given client config.
+     * @Lock held mEngineLock
+     */
+    void configureStageProfiler(const ClientConfig& config);
+    /**
+     * Stops and frees the graph that the last swap replaced, if any.
+     * @Lock held mEngineLock
+     */
+    void releaseRetiredGraph();
+    /**
+     * Hands an input frame to the current graph.
+     */
+    Status setGraphInput(int streamId, int64_t timestamp, const InputFrame& frame);
+    /**
+     * Notes when an input frame reached the runner, taking now for frames
+     * whose source did not say.
+     */
+    void recordArrival(int64_t timestamp, const InputFrame& frame,
+                       StageProfiler::Clock::time_point now);
+    /**
+     * Hands a set of input frames captured together to the current graph.
+     */
+    Status setGraphInputSet(int64_t timestamp, const InputFrameSet& frames);
+    /**
+     * Tells the current graph whether the consumers of an output stream have
+     * room for its packets.
+     */
+    void setGraphOutputBackpressure(int streamId, bool congested);
     /**
      * Helper method to forward packet to client interface for transmission
      */
     Status forwardOutputDataToClient(int streamId, std::shared_ptr<MemHandle>& handle);
+    /**
+     * Frees a packet of the display stream that the debug display is done with.
+     */
+    Status freeDebugDisplayPacket(int bufferId);
     /**
      * Helper to handle error notification from components, in the errorQueue.
      * In case the source of the error is client interface, it will
@@ -239,6 +339,14 @@ class DefaultEngine : public RunnerEngine {
      */
     std::map<int, std::unique_ptr<input_manager::InputManager>> mInputManagers;
     input_manager::InputManagerFactory mInputFactory;
+    /**
+     * Key of the managers above, and the managers of the last config reset
+     * with their key.
+     */
+    std::string mManagersKey;
+    std::string mCachedManagersKey;
+    std::map<int, std::unique_ptr<stream_manager::StreamManager>> mCachedStreamManagers;
+    std::map<int, std::unique_ptr<input_manager::InputManager>> mCachedInputManagers;
     /**
      * stream to dump to display for debug purposes
      */
@@ -252,10 +360,46 @@ class DefaultEngine : public RunnerEngine {
      */
     proto::Options mGraphDescriptor;
     std::unique_ptr<graph::PrebuiltGraph> mGraph;
+    /**
+     * Held shared while input is handed to mGraph, and exclusively to swap it.
+     */
+    std::shared_mutex mGraphRoutingLock;
+    /**
+     * Graph replaced by the last swap, flushing the frames it had in flight.
+     */
+    std::unique_ptr<graph::PrebuiltGraph> mRetiredGraph;
+    /**
+     * Pipelines input frames into a local graph. Without it, input managers
+     * call into the graph directly, one frame at a time.
+     */
+    std::unique_ptr<GraphDispatcher> mGraphDispatcher = nullptr;
+    /**
+     * Times the stages of the runner while the client profiles the pipe.
+     */
+    StageProfiler mStageProfiler;
+    /**
+     * Runs the phase handlers of independent components at once, and times
+     * them.
+     */
+    PhaseBroadcaster mPhaseBroadcaster;
+    /**
+     * When the inputs that are in the graph reached the runner, for the
+     * packets of their outputs.
+     */
+    ArrivalTimes mArrivalTimes;
     /**
      * stop signal source
      */
     bool mStopFromClient = true;
+    /**
+     * How long a stop with flush waits for the graph to hand out the outputs
+     * of the frames in flight, before they are discarded.
+     */
+    std::chrono::milliseconds mFlushTimeout = std::chrono::milliseconds(1000);
+    /**
+     * Set while the graph is flushing, until when the engine waits for it.
+     */
+    std::optional<std::chrono::steady_clock::time_point> mFlushDeadline;
     /**
      * Phase management members
      */
@@ -296,9 +440,11 @@ class StreamCallback : public stream_manager::StreamEngineInterface {
   public:
     explicit StreamCallback(
         const std::function<void()>&& eos, const std::function<void(std::string)>&& errorCb,
-        const std::function<Status(const std::shared_ptr<MemHandle>&)>&& packetHandler);
+        const std::function<Status(const std::shared_ptr<MemHandle>&)>&& packetHandler,
+        const std::function<void(bool)>&& backpressureHandler);
     void notifyEndOfStream() override;
     void notifyError(std::string msg) override;
+    void notifyBackpressure(bool congested) override;
     Status dispatchPacket(const std::shared_ptr<MemHandle>& outData) override;
     ~StreamCallback() = default;
 
@@ -306,6 +452,7 @@ class StreamCallback : public stream_manager::StreamEngineInterface {
     std::function<void(std::string)> mErrorHandler;
     std::function<void()> mEndOfStreamHandler;
     std::function<Status(const std::shared_ptr<MemHandle>&)> mPacketHandler;
+    std::function<void(bool)> mBackpressureHandler;
 };
 
 /**
@@ -315,14 +462,17 @@ class StreamCallback : public stream_manager::StreamEngineInterface {
 class InputCallback : public input_manager::InputEngineInterface {
   public:
     explicit InputCallback(int id, const std::function<void(int)>&& cb,
-                           const std::function<Status(int, int64_t, const InputFrame&)>&& packetCb);
+                           const std::function<Status(int, int64_t, const InputFrame&)>&& packetCb,
+                           const std::function<Status(int64_t, const InputFrameSet&)>&& setCb);
     Status dispatchInputFrame(int streamId, int64_t timestamp, const InputFrame& frame) override;
+    Status dispatchInputFrames(int64_t timestamp, const InputFrameSet& frames) override;
     void notifyInputError() override;
     ~InputCallback() = default;
 
   private:
     std::function<void(int)> mErrorCallback;
     std::function<Status(int, int64_t, const InputFrame&)> mPacketHandler;
+    std::function<Status(int64_t, const InputFrameSet&)> mSetHandler;
     int mInputId;
 };
 
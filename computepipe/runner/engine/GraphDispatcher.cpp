@@ -0,0 +1,216 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GraphDispatcher.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "PixelFormatUtils.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+
+namespace {
+
+// The dispatcher whose worker runs on this thread, if any
+thread_local const GraphDispatcher* tWorkerOf = nullptr;
+
+}  // namespace
+
+GraphDispatcher::GraphDispatcher(uint32_t maxFramesInFlight, bool reentrantGraph,
+                                 GraphInputFn&& graphInput, GraphSetInputFn&& graphSetInput)
+    : mMaxFramesInFlight(std::max(maxFramesInFlight, 1u)),
+      mNumWorkers(reentrantGraph ? mMaxFramesInFlight : 1),
+      mGraphInput(std::move(graphInput)),
+      mGraphSetInput(std::move(graphSetInput)) {
+}
+
+GraphDispatcher::~GraphDispatcher() {
+    stop(/* flush = */ false);
+}
+
+void GraphDispatcher::start() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mRunning) {
+        return;
+    }
+    mRunning = true;
+    for (uint32_t i = 0; i < mNumWorkers; i++) {
+        mWorkers.emplace_back(&GraphDispatcher::runWorker, this);
+    }
+}
+
+Status GraphDispatcher::queueFrame(int streamId, int64_t timestamp, const InputFrame& frame) {
+    std::pair<int, const InputFrame*> entry(streamId, &frame);
+    return queueInput(timestamp, &entry, 1);
+}
+
+Status GraphDispatcher::queueFrameSet(int64_t timestamp, const InputFrameSet& frames) {
+    if (frames.empty()) {
+        return Status::INVALID_ARGUMENT;
+    }
+    return queueInput(timestamp, frames.data(), frames.size());
+}
+
+Status GraphDispatcher::queueInput(int64_t timestamp,
+                                   const std::pair<int, const InputFrame*>* frames,
+                                   size_t numFrames) {
+    std::vector<PendingFrame> copies;
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        mSignal.wait(lock, [this]() {
+            return !mRunning || mFramesInFlight.size() < mMaxFramesInFlight;
+        });
+        if (!mRunning) {
+            return Status::ILLEGAL_STATE;
+        }
+        mFramesInFlight.insert(timestamp);
+        if (!mSpareFrames.empty()) {
+            copies = std::move(mSpareFrames.back());
+            mSpareFrames.pop_back();
+        }
+    }
+
+    // The frames are only valid until we return, and may be large, so copy
+    // them without holding up the workers.
+    copies.resize(numFrames);
+    for (size_t i = 0; i < numFrames; i++) {
+        PendingFrame& copy = copies[i];
+        const InputFrame& frame = *frames[i].second;
+        copy.streamId = frames[i].first;
+        copy.info = frame.getFrameInfo();
+        copy.data.resize(frameSizeBytes(copy.info.format, copy.info.stride, copy.info.height));
+        memcpy(copy.data.data(), frame.getFramePtr(), copy.data.size());
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mRunning) {
+        retireInput(timestamp, std::move(copies));
+        return Status::ILLEGAL_STATE;
+    }
+    mPendingInputs.push_back({timestamp, std::move(copies)});
+    mSignal.notify_all();
+    return Status::SUCCESS;
+}
+
+void GraphDispatcher::waitForOutputTurn(int64_t timestamp) {
+    // A single worker hands frames to the graph in order already, and output
+    // produced outside of the workers does not belong to a queued frame.
+    if (mNumWorkers == 1 || tWorkerOf != this) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mLock);
+    mSignal.wait(lock, [this, timestamp]() {
+        return mFramesInFlight.empty() || *mFramesInFlight.begin() >= timestamp;
+    });
+}
+
+size_t GraphDispatcher::stop(bool flush, std::chrono::steady_clock::time_point deadline) {
+    std::vector<std::thread> workers;
+    size_t discarded;
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        mRunning = false;
+        mSignal.notify_all();
+        if (flush && !mWorkers.empty()) {
+            auto drained = [this]() { return mPendingInputs.empty(); };
+            if (deadline == std::chrono::steady_clock::time_point::max()) {
+                mSignal.wait(lock, drained);
+            } else {
+                mSignal.wait_until(lock, deadline, drained);
+            }
+        }
+        discarded = mPendingInputs.size();
+        for (auto& input : mPendingInputs) {
+            retireInput(input.timestamp, std::move(input.frames));
+        }
+        mPendingInputs.clear();
+        workers.swap(mWorkers);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return discarded;
+}
+
+void GraphDispatcher::runWorker() {
+    tWorkerOf = this;
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mSignal.wait(lock, [this]() { return !mRunning || !mPendingInputs.empty(); });
+        if (mPendingInputs.empty()) {
+            break;
+        }
+        PendingInput input = std::move(mPendingInputs.front());
+        mPendingInputs.pop_front();
+        lock.unlock();
+
+        deliverInput(input);
+
+        lock.lock();
+        retireInput(input.timestamp, std::move(input.frames));
+    }
+    tWorkerOf = nullptr;
+}
+
+void GraphDispatcher::deliverInput(const PendingInput& input) {
+    if (input.frames.size() == 1 || !mGraphSetInput) {
+        for (const PendingFrame& frame : input.frames) {
+            InputFrame inputFrame(frame.info, frame.data.data());
+            Status status = mGraphInput(frame.streamId, input.timestamp, inputFrame);
+            if (status != Status::SUCCESS) {
+                LOG(ERROR) << "Graph rejected frame of input stream " << frame.streamId
+                           << " with timestamp " << input.timestamp;
+            }
+        }
+        return;
+    }
+
+    // Input frames cannot be moved, so they are kept where they are built.
+    std::deque<InputFrame> inputFrames;
+    InputFrameSet frameSet;
+    frameSet.reserve(input.frames.size());
+    for (const PendingFrame& frame : input.frames) {
+        inputFrames.emplace_back(frame.info, frame.data.data());
+        frameSet.emplace_back(frame.streamId, &inputFrames.back());
+    }
+    Status status = mGraphSetInput(input.timestamp, frameSet);
+    if (status != Status::SUCCESS) {
+        LOG(ERROR) << "Graph rejected set of input frames with timestamp " << input.timestamp;
+    }
+}
+
+void GraphDispatcher::retireInput(int64_t timestamp, std::vector<PendingFrame>&& frames) {
+    auto it = mFramesInFlight.find(timestamp);
+    if (it != mFramesInFlight.end()) {
+        mFramesInFlight.erase(it);
+    }
+    if (mSpareFrames.size() < mMaxFramesInFlight) {
+        mSpareFrames.push_back(std::move(frames));
+    }
+    mSignal.notify_all();
+}
+
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,132 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_ENGINE_GRAPHDISPATCHER_H_
+#define COMPUTEPIPE_RUNNER_ENGINE_GRAPHDISPATCHER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "InputFrame.h"
+#include "types/Status.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+
+/**
+ * Pipelines input frames into a local graph. Each frame is copied so that the
+ * input manager gets its buffer back straight away, and is handed to the graph
+ * from a worker thread. At most maxFramesInFlight frames are queued or inside
+ * the graph at a time; beyond that queueFrame() blocks, which holds back the
+ * input manager.
+ *
+ * A reentrant graph is called from as many workers as there are frames in
+ * flight, any other graph from a single worker. Output that a reentrant graph
+ * produces while handling a frame is held back by waitForOutputTurn() until the
+ * graph is done with all earlier frames, so that it leaves in timestamp order.
+ */
+class GraphDispatcher {
+  public:
+    using GraphInputFn = std::function<Status(int, int64_t, const InputFrame&)>;
+    using GraphSetInputFn = std::function<Status(int64_t, const InputFrameSet&)>;
+
+    explicit GraphDispatcher(uint32_t maxFramesInFlight, bool reentrantGraph,
+                             GraphInputFn&& graphInput, GraphSetInputFn&& graphSetInput = nullptr);
+    ~GraphDispatcher();
+    /**
+     * Starts the workers. Frames are accepted until stop().
+     */
+    void start();
+    /**
+     * Copies the frame and queues it for the graph. Blocks while the maximum
+     * number of frames are in flight. Returns ILLEGAL_STATE if the frame was
+     * dropped because the dispatcher is not running.
+     */
+    Status queueFrame(int streamId, int64_t timestamp, const InputFrame& frame);
+    /**
+     * As queueFrame(), for frames of several input streams that the graph
+     * takes as one set. The set counts as a single frame in flight. Without a
+     * set input function, the frames are handed to the graph one by one.
+     */
+    Status queueFrameSet(int64_t timestamp, const InputFrameSet& frames);
+    /**
+     * Called before output with the given timestamp is forwarded. On a worker
+     * of a reentrant graph, waits until the graph is done with all frames that
+     * are older. Returns immediately anywhere else.
+     */
+    void waitForOutputTurn(int64_t timestamp);
+    /**
+     * Stops accepting frames and joins the workers. With flush, the frames
+     * already queued are handed to the graph first, until the deadline passes.
+     * Frames not handed to the graph are dropped, and their number returned.
+     * A call into the graph that has already started is always waited for.
+     */
+    size_t stop(bool flush, std::chrono::steady_clock::time_point deadline =
+                                    std::chrono::steady_clock::time_point::max());
+
+  private:
+    struct PendingFrame {
+        int streamId;
+        FrameInfo info;
+        std::vector<uint8_t> data;
+    };
+    // A frame, or a set of frames, for the graph
+    struct PendingInput {
+        int64_t timestamp;
+        std::vector<PendingFrame> frames;
+    };
+
+    // Copies the frames and queues them as one input.
+    Status queueInput(int64_t timestamp, const std::pair<int, const InputFrame*>* frames,
+                      size_t numFrames);
+    void runWorker();
+    void deliverInput(const PendingInput& input);
+    // Forgets an input that has left the graph or was dropped. Needs mLock.
+    void retireInput(int64_t timestamp, std::vector<PendingFrame>&& frames);
+
+    const uint32_t mMaxFramesInFlight;
+    const uint32_t mNumWorkers;
+    GraphInputFn mGraphInput;
+    GraphSetInputFn mGraphSetInput;
+
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    bool mRunning = false;
+    // Copied frames waiting for a worker
+    std::deque<PendingInput> mPendingInputs;
+    // Timestamps of the frames in flight, whether being copied, queued, or in the graph
+    std::multiset<int64_t> mFramesInFlight;
+    // Frame copies to reuse, so that steady state runs without allocations
+    std::vector<std::vector<PendingFrame>> mSpareFrames;
+    std::vector<std::thread> mWorkers;
+};
+
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_ENGINE_GRAPHDISPATCHER_H_
@@ -0,0 +1,81 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "PhaseBroadcaster.h"
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+
+std::vector<Status> PhaseBroadcaster::broadcast(const std::string& phase,
+                                                std::vector<Handler>&& handlers) {
+    std::vector<Status> statuses(handlers.size(), Status::SUCCESS);
+    std::vector<int64_t> timingsUs(handlers.size(), 0);
+    auto runHandler = [&handlers, &statuses, &timingsUs](size_t i) {
+        auto begin = std::chrono::steady_clock::now();
+        statuses[i] = handlers[i].run();
+        timingsUs[i] = std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - begin)
+                               .count();
+    };
+
+    // The first handler runs on the calling thread, so a group of one costs no
+    // thread.
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < handlers.size(); i++) {
+        threads.emplace_back(runHandler, i);
+    }
+    if (!handlers.empty()) {
+        runHandler(0);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    for (size_t i = 0; i < handlers.size(); i++) {
+        mTimingsUs[{phase, handlers[i].component}] = timingsUs[i];
+    }
+    return statuses;
+}
+
+Status PhaseBroadcaster::run(const std::string& phase, const std::string& component,
+                             std::function<Status()>&& handler) {
+    std::vector<Handler> handlers;
+    handlers.push_back({component, std::move(handler)});
+    return broadcast(phase, std::move(handlers))[0];
+}
+
+std::string PhaseBroadcaster::getDebugInfo() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    std::ostringstream info;
+    for (const auto& it : mTimingsUs) {
+        info << "phase " << it.first.first << " " << it.first.second << ": us " << it.second
+             << "\n";
+    }
+    return info.str();
+}
+
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,112 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef COMPUTEPIPE_RUNNER_ENGINE_PHASEBROADCASTER_H_
+#define COMPUTEPIPE_RUNNER_ENGINE_PHASEBROADCASTER_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "types/Status.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+
+/**
+ * Hands phase events to groups of runner components. The components of a
+ * group do not depend on each other, such as the stream managers, so their
+ * handlers run at the same time, each on a thread of its own, and a broadcast
+ * takes as long as its slowest handler rather than the sum of them. Groups that
+ * depend on each other are broadcast to one after the other by the engine.
+ * How long each handler took is kept for the debug dump.
+ */
+class PhaseBroadcaster {
+  public:
+    struct Handler {
+        // Names the component in the debug dump.
+        std::string component;
+        std::function<Status()> run;
+    };
+
+    /**
+     * Runs the handlers and waits for all of them. Returns their statuses, in
+     * the order of the handlers.
+     */
+    std::vector<Status> broadcast(const std::string& phase, std::vector<Handler>&& handlers);
+
+    /**
+     * Runs the handler of a single component, which others depend on, on the
+     * calling thread.
+     */
+    Status run(const std::string& phase, const std::string& component,
+               std::function<Status()>&& handler);
+
+    /**
+     * Runs the handler on each of the components, keyed by their id. Returns
+     * SUCCESS if all of them succeeded, or else the status of a failed one. The
+     * ids of the components that succeeded are added to succeeded if given.
+     */
+    template <typename Component, typename ComponentHandler>
+    Status broadcast(const std::string& phase, const std::string& kind,
+                     std::map<int, std::unique_ptr<Component>>& components,
+                     const ComponentHandler& handler,
+                     std::vector<int>* succeeded = nullptr) {
+        std::vector<Handler> handlers;
+        std::vector<int> ids;
+        for (auto& it : components) {
+            Component* component = it.second.get();
+            handlers.push_back({kind + " " + std::to_string(it.first),
+                                [component, &handler]() { return handler(*component); }});
+            ids.push_back(it.first);
+        }
+        std::vector<Status> statuses = broadcast(phase, std::move(handlers));
+        Status result = Status::SUCCESS;
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (statuses[i] != Status::SUCCESS) {
+                result = statuses[i];
+            } else if (succeeded != nullptr) {
+                succeeded->push_back(ids[i]);
+            }
+        }
+        return result;
+    }
+
+    /**
+     * The time each component last took to handle each phase, one line each.
+     */
+    std::string getDebugInfo() const;
+
+  private:
+    mutable std::mutex mLock;
+    // Microseconds, keyed by phase and component.
+    std::map<std::pair<std::string, std::string>, int64_t> mTimingsUs;
+};
+
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_ENGINE_PHASEBROADCASTER_H_
@@ -0,0 +1,213 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+
+#include "StageProfiler.h"
+
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+namespace {
+
+const char* const kStageNames[StageProfiler::NUM_STAGES] = {
+    "input_dispatch", "graph_latency",   "output_copy",
+    "client_delivery", "client_return", "input_to_client",
+};
+
+}  // namespace
+
+void StageProfiler::Histogram::add(uint64_t us) {
+    int bucket = 0;
+    while (bucket < kNumBuckets - 1 && (us >> bucket) > 0) {
+        bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumUs.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = maxUs.load(std::memory_order_relaxed);
+    while (us > max && !maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+void StageProfiler::Histogram::clear() {
+    for (auto& bucket : buckets) {
+        bucket = 0;
+    }
+    count = 0;
+    sumUs = 0;
+    maxUs = 0;
+}
+
+uint64_t StageProfiler::Histogram::percentile(uint64_t total, double fraction) const {
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < kNumBuckets; bucket++) {
+        seen += buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= total * fraction) {
+            // The upper bound of the bucket.
+            return std::min<uint64_t>(bucket == 0 ? 0 : (uint64_t{1} << bucket) - 1, maxUs);
+        }
+    }
+    return maxUs;
+}
+
+void StageProfiler::configureStreams(const std::vector<int>& inputStreamIds,
+                                     const std::vector<int>& outputStreamIds) {
+    mEnabled = false;
+    mStreams.clear();
+    mDeliveries.clear();
+    for (const std::vector<int>* ids : {&inputStreamIds, &outputStreamIds}) {
+        for (int streamId : *ids) {
+            auto stats = std::make_unique<StreamStats>();
+            for (int stage = 0; stage < NUM_STAGES; stage++) {
+                stats->traceName[stage] = std::string("computepipe_") + kStageNames[stage] +
+                                          "_us_" + std::to_string(streamId);
+            }
+            mStreams[streamId] = std::move(stats);
+        }
+    }
+    for (int streamId : outputStreamIds) {
+        mDeliveries[streamId] = std::make_unique<PendingRing>();
+    }
+}
+
+void StageProfiler::start() {
+    for (auto& it : mStreams) {
+        for (Histogram& histogram : it.second->stages) {
+            histogram.clear();
+        }
+    }
+    mEnabled = true;
+}
+
+void StageProfiler::stop() {
+    mEnabled = false;
+}
+
+int64_t StageProfiler::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch())
+            .count();
+}
+
+void StageProfiler::add(Stage stage, int streamId, int64_t durationNs) {
+    auto it = mStreams.find(streamId);
+    if (it == mStreams.end() || durationNs < 0) {
+        return;
+    }
+    uint64_t us = durationNs / 1000;
+    it->second->stages[stage].add(us);
+    ATRACE_INT64(it->second->traceName[stage].c_str(), us);
+}
+
+void StageProfiler::record(Stage stage, int streamId, Clock::time_point begin) {
+    if (!isEnabled()) {
+        return;
+    }
+    add(stage, streamId,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+}
+
+void StageProfiler::putPending(PendingRing& ring, int64_t key) {
+    Pending& pending = ring[static_cast<uint64_t>(key) % kNumPending];
+    pending.key.store(kNoKey, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    pending.beginNs.store(nowNs(), std::memory_order_relaxed);
+    pending.key.store(key, std::memory_order_release);
+}
+
+bool StageProfiler::getPending(PendingRing& ring, int64_t key, bool consume, int64_t* beginNs) {
+    Pending& pending = ring[static_cast<uint64_t>(key) % kNumPending];
+    if (pending.key.load(std::memory_order_acquire) != key) {
+        return false;
+    }
+    *beginNs = pending.beginNs.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (consume) {
+        int64_t expected = key;
+        return pending.key.compare_exchange_strong(expected, kNoKey, std::memory_order_relaxed);
+    }
+    return pending.key.load(std::memory_order_relaxed) == key;
+}
+
+void StageProfiler::markInput(int64_t timestamp) {
+    if (!isEnabled()) {
+        return;
+    }
+    putPending(mInputs, timestamp);
+}
+
+void StageProfiler::markOutput(int streamId, int64_t timestamp) {
+    if (!isEnabled()) {
+        return;
+    }
+    // Every output stream of an input gets its own sample.
+    int64_t beginNs;
+    if (getPending(mInputs, timestamp, /* consume = */ false, &beginNs)) {
+        add(GRAPH_LATENCY, streamId, nowNs() - beginNs);
+    }
+}
+
+void StageProfiler::markDelivered(int streamId, int bufferId) {
+    if (!isEnabled()) {
+        return;
+    }
+    auto it = mDeliveries.find(streamId);
+    if (it != mDeliveries.end()) {
+        putPending(*it->second, bufferId);
+    }
+}
+
+void StageProfiler::markReturned(int streamId, int bufferId) {
+    if (!isEnabled()) {
+        return;
+    }
+    auto it = mDeliveries.find(streamId);
+    int64_t beginNs;
+    if (it != mDeliveries.end() &&
+        getPending(*it->second, bufferId, /* consume = */ true, &beginNs)) {
+        add(CLIENT_RETURN, streamId, nowNs() - beginNs);
+    }
+}
+
+std::string StageProfiler::getDebugInfo() const {
+    std::ostringstream info;
+    for (const auto& it : mStreams) {
+        for (int stage = 0; stage < NUM_STAGES; stage++) {
+            const Histogram& histogram = it.second->stages[stage];
+            uint64_t count = histogram.count;
+            if (count == 0) {
+                continue;
+            }
+            info << "stream " << it.first << " " << kStageNames[stage] << ": count " << count
+                 << ", mean_us " << histogram.sumUs / count << ", p50_us "
+                 << histogram.percentile(count, 0.5) << ", p90_us "
+                 << histogram.percentile(count, 0.9) << ", p99_us "
+                 << histogram.percentile(count, 0.99) << ", max_us " << histogram.maxUs << "\n";
+        }
+    }
+    return info.str();
+}
+
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
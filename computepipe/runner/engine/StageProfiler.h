@@ -0,0 +1,145 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_ENGINE_STAGEPROFILER_H_
+#define COMPUTEPIPE_RUNNER_ENGINE_STAGEPROFILER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+
+/**
+ * Measures how long frames spend in each stage of the runner, per stream.
+ * Streams are registered while the runner is configured, after which samples
+ * are recorded without locks, so that profiling can stay on for a whole run.
+ * While disabled, recording costs one atomic load.
+ */
+class StageProfiler {
+  public:
+    enum Stage {
+        // Handing an input frame to the graph, or to the graph dispatcher.
+        INPUT_DISPATCH = 0,
+        // From an input frame reaching the graph to an output with its timestamp.
+        GRAPH_LATENCY,
+        // Queueing an output packet in its stream manager, including the copy.
+        OUTPUT_COPY,
+        // Handing an output packet to the client.
+        CLIENT_DELIVERY,
+        // From handing a packet to the client to the client returning it.
+        CLIENT_RETURN,
+        // From the runner receiving an input frame to handing an output of it to the client.
+        INPUT_TO_CLIENT,
+        NUM_STAGES,
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Sets up the histograms of the streams of the next run. Must not be
+     * called while samples are recorded.
+     */
+    void configureStreams(const std::vector<int>& inputStreamIds,
+                          const std::vector<int>& outputStreamIds);
+    /**
+     * Clears all samples and starts recording.
+     */
+    void start();
+    /**
+     * Stops recording. The samples are kept until the next start.
+     */
+    void stop();
+
+    bool isEnabled() const {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+
+    void record(Stage stage, int streamId, Clock::time_point begin);
+    /**
+     * Notes that the input frame with the timestamp reached the graph.
+     */
+    void markInput(int64_t timestamp);
+    /**
+     * Records the graph latency of an output, if its input was noted.
+     */
+    void markOutput(int streamId, int64_t timestamp);
+    void markDelivered(int streamId, int bufferId);
+    void markReturned(int streamId, int bufferId);
+    /**
+     * Count, mean, percentiles and maximum in microseconds of each stage of
+     * each stream, one line each.
+     */
+    std::string getDebugInfo() const;
+
+  private:
+    // Powers of two of microseconds, the last bucket taking everything above.
+    static constexpr int kNumBuckets = 24;
+
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, kNumBuckets> buckets = {};
+        std::atomic<uint64_t> count = 0;
+        std::atomic<uint64_t> sumUs = 0;
+        std::atomic<uint64_t> maxUs = 0;
+
+        void add(uint64_t us);
+        void clear();
+        uint64_t percentile(uint64_t total, double fraction) const;
+    };
+
+    struct StreamStats {
+        std::array<Histogram, NUM_STAGES> stages;
+        std::string traceName[NUM_STAGES];
+    };
+
+    // Start times of the frames in flight, keyed by timestamp or buffer id.
+    // Writers invalidate the key before the time changes, so that a reader
+    // that sees the same key before and after reading the time has it right.
+    // Colliding keys lose samples, which is fine for profiling.
+    static constexpr int kNumPending = 64;
+    struct Pending {
+        std::atomic<int64_t> key = kNoKey;
+        std::atomic<int64_t> beginNs = 0;
+    };
+    using PendingRing = std::array<Pending, kNumPending>;
+    static constexpr int64_t kNoKey = INT64_MIN;
+
+    static void putPending(PendingRing& ring, int64_t key);
+    static bool getPending(PendingRing& ring, int64_t key, bool consume, int64_t* beginNs);
+    static int64_t nowNs();
+
+    void add(Stage stage, int streamId, int64_t durationNs);
+
+    std::atomic<bool> mEnabled = false;
+    std::map<int, std::unique_ptr<StreamStats>> mStreams;
+    PendingRing mInputs;
+    std::map<int, std::unique_ptr<PendingRing>> mDeliveries;
+};
+
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_ENGINE_STAGEPROFILER_H_
@@ -46,6 +46,13 @@ class RunnerEngine : public client_interface::ClientEngineInterface,
     virtual void setClientInterface(std::unique_ptr<client_interface::ClientInterface>&& client) = 0;
 
     virtual void setPrebuiltGraph(std::unique_ptr<graph::PrebuiltGraph>&& graph) = 0;
+    /**
+     * Replaces the prebuilt graph with another build of it, without tearing
+     * down the inputs and outputs of the runner. During a run, the new graph
+     * is configured and started first, and input switches over to it between
+     * two frames while the old graph flushes the frames it has in flight.
+     */
+    virtual Status swapPrebuiltGraph(std::unique_ptr<graph::PrebuiltGraph>&& graph) = 0;
     /**
      * Activates the client interface and advertises to the rest of the world
      * that the runner is online
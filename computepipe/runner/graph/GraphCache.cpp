@@ -0,0 +1,182 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "GraphCache.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace graph {
+namespace {
+
+// Keeps names coming from libraries usable as a single path component.
+std::string SanitizeName(const std::string& name) {
+    std::string sanitized = name;
+    for (char& c : sanitized) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '_' && c != '-') {
+            c = '_';
+        }
+    }
+    if (sanitized.empty() || sanitized == "." || sanitized == "..") {
+        sanitized = "_" + sanitized;
+    }
+    return sanitized;
+}
+
+bool CreateDir(const std::string& dirName) {
+    struct stat st;
+    if (stat(dirName.c_str(), &st) == 0) {
+        return S_ISDIR(st.st_mode);
+    }
+    std::string parentDirName = android::base::Dirname(dirName);
+    if (parentDirName != dirName && !CreateDir(parentDirName)) {
+        return false;
+    }
+    return mkdir(dirName.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+std::vector<std::string> ListEntries(const std::string& dirName) {
+    std::vector<std::string> entries;
+    DIR* directory = opendir(dirName.c_str());
+    if (directory == nullptr) {
+        return entries;
+    }
+    while (struct dirent* entry = readdir(directory)) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            entries.push_back(entry->d_name);
+        }
+    }
+    closedir(directory);
+    return entries;
+}
+
+uint64_t TreeSize(const std::string& path) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return st.st_size;
+    }
+    uint64_t size = 0;
+    for (const std::string& entry : ListEntries(path)) {
+        size += TreeSize(path + "/" + entry);
+    }
+    return size;
+}
+
+void RemoveTree(const std::string& path) {
+    auto removeEntry = [](const char* entryPath, const struct stat*, int, struct FTW*) {
+        if (remove(entryPath) != 0) {
+            LOG(WARNING) << "Failed to remove " << entryPath << " from the graph cache: "
+                         << strerror(errno);
+        }
+        return 0;
+    };
+    nftw(path.c_str(), removeEntry, /* nopenfd = */ 16, FTW_DEPTH | FTW_PHYS);
+}
+
+}  // namespace
+
+GraphCache::GraphCache(const std::string& root, uint64_t maxSizeBytes)
+    : mRoot(root), mMaxSizeBytes(maxSizeBytes) {
+}
+
+std::string GraphCache::prepareDirectory(const std::string& library, const std::string& version) {
+    std::string libraryDir = mRoot + "/" + SanitizeName(android::base::Basename(library));
+    std::string versionName = SanitizeName(version);
+    std::string versionDir = libraryDir + "/" + versionName;
+    if (!CreateDir(versionDir)) {
+        LOG(WARNING) << "Failed to create graph cache directory " << versionDir << ": "
+                     << strerror(errno);
+        return "";
+    }
+
+    // State written by other versions of the graph is of no use to this one.
+    for (const std::string& entry : ListEntries(libraryDir)) {
+        if (entry != versionName) {
+            LOG(INFO) << "Removing graph cache of " << library << " version " << entry;
+            RemoveTree(libraryDir + "/" + entry);
+        }
+    }
+
+    // The modification time of a library directory is when it was last used.
+    utimensat(AT_FDCWD, libraryDir.c_str(), nullptr, 0);
+    evict(libraryDir);
+    return versionDir;
+}
+
+void GraphCache::evict(const std::string& keepDir) {
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        struct timespec lastUsed;
+    };
+    std::vector<Entry> entries;
+    uint64_t totalSize = 0;
+    for (const std::string& name : ListEntries(mRoot)) {
+        Entry entry = {mRoot + "/" + name, 0, {}};
+        struct stat st;
+        if (lstat(entry.path.c_str(), &st) != 0) {
+            continue;
+        }
+        entry.size = TreeSize(entry.path);
+        entry.lastUsed = st.st_mtim;
+        totalSize += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    if (totalSize <= mMaxSizeBytes) {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.lastUsed.tv_sec != b.lastUsed.tv_sec) {
+            return a.lastUsed.tv_sec < b.lastUsed.tv_sec;
+        }
+        return a.lastUsed.tv_nsec < b.lastUsed.tv_nsec;
+    });
+    for (const Entry& entry : entries) {
+        if (totalSize <= mMaxSizeBytes) {
+            break;
+        }
+        if (entry.path == keepDir) {
+            continue;
+        }
+        LOG(INFO) << "Evicting " << entry.path << " (" << entry.size
+                  << " bytes) from the graph cache";
+        RemoveTree(entry.path);
+        totalSize -= entry.size;
+    }
+}
+
+}  // namespace graph
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,60 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef COMPUTEPIPE_RUNNER_GRAPH_GRAPHCACHE_H_
+#define COMPUTEPIPE_RUNNER_GRAPH_GRAPHCACHE_H_
+
+#include <cstdint>
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace graph {
+
+// Persistent directories in which graphs keep state that is costly to rebuild,
+// such as loaded models or compiled GPU kernels, so that a graph starts warm
+// on later runs and after a reboot. Each graph library gets a directory of its
+// own under the cache root, holding the state of a single version:
+//   <root>/<library>/<version>/
+// The state of other versions of the library is removed when a version is
+// first used. Once the cache outgrows its budget, the directories of the
+// libraries used least recently are removed.
+class GraphCache {
+  public:
+    static constexpr uint64_t kDefaultMaxSizeBytes = 256 * 1024 * 1024;
+
+    explicit GraphCache(const std::string& root, uint64_t maxSizeBytes = kDefaultMaxSizeBytes);
+
+    // Gets the directory for the given version of the graph library, creating
+    // it if needed. Returns an empty string if the directory could not be
+    // created, in which case the graph runs without a cache.
+    std::string prepareDirectory(const std::string& library, const std::string& version);
+
+  private:
+    // Removes the directories of other libraries, least recently used first,
+    // until the cache fits its budget.
+    void evict(const std::string& keepDir);
+
+    const std::string mRoot;
+    const uint64_t mMaxSizeBytes;
+};
+
+}  // namespace graph
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_GRAPH_GRAPHCACHE_H_
@@ -33,6 +33,16 @@ namespace graph {
 namespace {
 constexpr int64_t kRpcDeadlineMilliseconds = 100;
 
+// Whether a graph at the address runs on the same host as the runner.
+bool IsLocalAddress(const std::string& address) {
+    for (const char* prefix : {"unix:", "localhost:", "127.0.0.1:", "[::1]:", "[::]:"}) {
+        if (address.rfind(prefix, 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 template <class ResponseType, class RpcType>
 std::pair<Status, std::string> FinishRpcAndGetResult(
         ::grpc::ClientAsyncResponseReader<RpcType>* rpc, ::grpc::CompletionQueue* cq,
@@ -114,6 +124,8 @@ Status GrpcGraph::initialize(const std::string& address,
         LOG(ERROR) << "Failed to parse graph options";
         return Status::FATAL_ERROR;
     }
+    mAcceptsInputStreams = response.accepts_input_streams();
+    mUseSharedMemory = response.accepts_shared_memory() && IsLocalAddress(address);
 
     mGraphState = PrebuiltGraphState::STOPPED;
     return Status::SUCCESS;
@@ -215,6 +227,15 @@ Status GrpcGraph::handleExecutionPhase(const runner::RunnerEvent& e) {
         mGraphState = PrebuiltGraphState::RUNNING;
     }
 
+    if (mStatus == Status::SUCCESS && mAcceptsInputStreams) {
+        mInputStreamFeeder =
+                std::make_shared<InputStreamFeeder>(mGraphStub.get(), mUseSharedMemory);
+        mStatus = mInputStreamFeeder->start();
+        if (mStatus != Status::SUCCESS) {
+            mErrorMessage = "Failed to open the input stream";
+        }
+    }
+
     return mStatus;
 }
 
@@ -235,6 +256,12 @@ Status GrpcGraph::handleStopWithFlushPhase(const runner::RunnerEvent& e) {
     context.set_deadline(std::chrono::system_clock::now() +
                          std::chrono::milliseconds(kRpcDeadlineMilliseconds));
 
+    // The graph gets to read all the input sent so far before it is told to stop.
+    if (mInputStreamFeeder) {
+        mInputStreamFeeder->stop(/* cancel = */ false);
+        mInputStreamFeeder.reset();
+    }
+
     proto::StopGraphExecutionRequest stopExecutionRequest;
     stopExecutionRequest.set_stop_immediate(false);
     ::grpc::CompletionQueue cq;
@@ -261,10 +288,11 @@ Status GrpcGraph::handleStopWithFlushPhase(const runner::RunnerEvent& e) {
     return mStatus;
 }
 
-// Stops the graph and cancels all the output packets.
+// Stops the graph and cancels all the output packets, also while it flushes.
 Status GrpcGraph::handleStopImmediatePhase(const runner::RunnerEvent& e) {
     std::lock_guard lock(mLock);
-    if (mGraphState != PrebuiltGraphState::RUNNING) {
+    if (mGraphState != PrebuiltGraphState::RUNNING &&
+        mGraphState != PrebuiltGraphState::FLUSHING) {
         return Status::ILLEGAL_STATE;
     }
 
@@ -278,6 +306,11 @@ Status GrpcGraph::handleStopImmediatePhase(const runner::RunnerEvent& e) {
     context.set_deadline(std::chrono::system_clock::now() +
                          std::chrono::milliseconds(kRpcDeadlineMilliseconds));
 
+    if (mInputStreamFeeder) {
+        mInputStreamFeeder->stop(/* cancel = */ true);
+        mInputStreamFeeder.reset();
+    }
+
     proto::StopGraphExecutionRequest stopExecutionRequest;
     stopExecutionRequest.set_stop_immediate(true);
     ::grpc::CompletionQueue cq;
@@ -334,20 +367,37 @@ Status GrpcGraph::handleResetPhase(const runner::RunnerEvent& e) {
     mStatus = static_cast<Status>(static_cast<int>(response.code()));
     mErrorMessage = response.message();
     mStreamSetObserver.reset();
+    mInputStreamFeeder.reset();
 
     return mStatus;
 }
 
-Status GrpcGraph::SetInputStreamData(int /*streamIndex*/, int64_t /*timestamp*/,
-                                     const std::string& /*streamData*/) {
-    LOG(ERROR) << "Cannot set input stream for remote graphs";
-    return Status::FATAL_ERROR;
+Status GrpcGraph::SetInputStreamData(int streamIndex, int64_t timestamp,
+                                     const std::string& streamData) {
+    std::shared_ptr<InputStreamFeeder> feeder;
+    {
+        std::lock_guard lock(mLock);
+        feeder = mInputStreamFeeder;
+    }
+    if (feeder == nullptr) {
+        LOG(ERROR) << "Remote graph is not taking input streams";
+        return Status::ILLEGAL_STATE;
+    }
+    return feeder->feedSerializedData(streamIndex, timestamp, streamData);
 }
 
-Status GrpcGraph::SetInputStreamPixelData(int /*streamIndex*/, int64_t /*timestamp*/,
-                                          const runner::InputFrame& /*inputFrame*/) {
-    LOG(ERROR) << "Cannot set input streams for remote graphs";
-    return Status::FATAL_ERROR;
+Status GrpcGraph::SetInputStreamPixelData(int streamIndex, int64_t timestamp,
+                                          const runner::InputFrame& inputFrame) {
+    std::shared_ptr<InputStreamFeeder> feeder;
+    {
+        std::lock_guard lock(mLock);
+        feeder = mInputStreamFeeder;
+    }
+    if (feeder == nullptr) {
+        LOG(ERROR) << "Remote graph is not taking input streams";
+        return Status::ILLEGAL_STATE;
+    }
+    return feeder->feedPixelData(streamIndex, timestamp, inputFrame);
 }
 
 Status GrpcGraph::StartGraphProfiling() {
@@ -27,6 +27,7 @@
 #include "GrpcPrebuiltGraphService.grpc.pb.h"
 #include "GrpcPrebuiltGraphService.pb.h"
 #include "InputFrame.h"
+#include "InputStreamFeeder.h"
 #include "Options.pb.h"
 #include "OutputConfig.pb.h"
 #include "PrebuiltEngineInterface.h"
@@ -75,6 +76,10 @@ class GrpcGraph : public PrebuiltGraph, public StreamGraphInterface {
         return mGraphConfig;
     }
 
+    bool AcceptsInputStreams() const override {
+        return mAcceptsInputStreams;
+    }
+
     // Sets input stream data. The string is expected to be a serialized proto
     // the definition of which is known to the graph.
     Status SetInputStreamData(int streamIndex, int64_t timestamp,
@@ -124,6 +129,15 @@ class GrpcGraph : public PrebuiltGraph, public StreamGraphInterface {
     std::unique_ptr<proto::GrpcGraphService::Stub> mGraphStub;
 
     std::unique_ptr<StreamSetObserver> mStreamSetObserver;
+
+    // Whether the graph takes its input from the runner, and whether it can
+    // read the frames from shared memory.
+    bool mAcceptsInputStreams = false;
+    bool mUseSharedMemory = false;
+
+    // Feeds the input streams while the graph runs. Shared, so that a frame
+    // being sent does not hold up a change of the graph state.
+    std::shared_ptr<InputStreamFeeder> mInputStreamFeeder;
 };
 
 }  // namespace graph
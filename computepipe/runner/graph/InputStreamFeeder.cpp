@@ -0,0 +1,238 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "InputStreamFeeder.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <android-base/logging.h>
+
+#include "PixelFormatUtils.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace graph {
+namespace {
+
+// Stays well below the 4MB limit that grpc puts on messages by default.
+constexpr size_t kMaxChunkBytes = 1 << 20;
+
+// Frames that the graph may hold in shared memory at a time. Frames beyond
+// that are sent in chunks.
+constexpr int kSharedMemorySlots = 4;
+
+}  // namespace
+
+InputStreamFeeder::InputStreamFeeder(proto::GrpcGraphService::Stub* stub, bool useSharedMemory)
+    : mStub(stub), mUseSharedMemory(useSharedMemory) {}
+
+InputStreamFeeder::~InputStreamFeeder() {
+    stop(true);
+    if (mMemory != nullptr) {
+        munmap(mMemory, mSlotSize * kSharedMemorySlots);
+    }
+    if (mMemoryFd >= 0) {
+        close(mMemoryFd);
+    }
+}
+
+Status InputStreamFeeder::start() {
+    std::lock_guard lock(mWriteLock);
+    if (mStream != nullptr) {
+        return Status::ILLEGAL_STATE;
+    }
+    mContext = std::make_unique<::grpc::ClientContext>();
+    mStream = mStub->FeedInputStream(mContext.get());
+    if (mStream == nullptr) {
+        LOG(ERROR) << "Failed to open the input stream of the remote graph";
+        return Status::INTERNAL_ERROR;
+    }
+    mWritesDone = false;
+    {
+        // The graph let go of all slots when the previous call closed.
+        std::lock_guard slotLock(mSlotLock);
+        mSlotInUse.assign(mSlotInUse.size(), false);
+    }
+    mReaderThread = std::thread(&InputStreamFeeder::readResponses, this);
+    return Status::SUCCESS;
+}
+
+void InputStreamFeeder::stop(bool cancel) {
+    {
+        std::lock_guard lock(mWriteLock);
+        if (mStream == nullptr) {
+            return;
+        }
+        if (cancel) {
+            mContext->TryCancel();
+        } else if (!mWritesDone) {
+            mStream->WritesDone();
+        }
+        mWritesDone = true;
+    }
+
+    // The graph closes the call once it has read everything.
+    if (mReaderThread.joinable()) {
+        mReaderThread.join();
+    }
+    ::grpc::Status grpcStatus = mStream->Finish();
+    if (!grpcStatus.ok() && !cancel) {
+        LOG(ERROR) << "Input stream of the remote graph failed: " << grpcStatus.error_message();
+    }
+
+    std::lock_guard lock(mWriteLock);
+    mStream.reset();
+    mContext.reset();
+}
+
+Status InputStreamFeeder::feedPixelData(int streamId, int64_t timestamp_us,
+                                        const runner::InputFrame& frame) {
+    runner::FrameInfo info = frame.getFrameInfo();
+    const uint8_t* pixels = frame.getFramePtr();
+    size_t size = runner::frameSizeBytes(info.format, info.stride, info.height);
+
+    int slot = mUseSharedMemory ? acquireSlot(size) : -1;
+    if (slot >= 0) {
+        // The graph reads the frame in place, so nothing but its location goes
+        // through grpc.
+        memcpy(mMemory + slot * mSlotSize, pixels, size);
+    }
+
+    std::lock_guard lock(mWriteLock);
+    proto::InputStreamRequest& request = mPixelRequest;
+    request.set_stream_id(streamId);
+    request.set_timestamp_us(timestamp_us);
+    request.clear_shared_memory();
+    proto::PixelData* pixelData = request.mutable_pixel_data();
+    pixelData->set_width(info.width);
+    pixelData->set_height(info.height);
+    pixelData->set_step(info.stride);
+    pixelData->set_format(static_cast<proto::PixelFormat>(static_cast<int>(info.format)));
+
+    if (slot >= 0) {
+        proto::SharedMemoryBuffer* buffer = request.mutable_shared_memory();
+        buffer->set_path(mMemoryPath);
+        buffer->set_offset(slot * mSlotSize);
+        buffer->set_size(size);
+        buffer->set_slot(slot);
+        pixelData->clear_data();
+        request.set_remaining_chunks(0);
+
+        if (mWritesDone || !mStream->Write(request)) {
+            releaseSlot(slot);
+            return Status::ILLEGAL_STATE;
+        }
+        return Status::SUCCESS;
+    }
+
+    size_t firstChunk = std::min(size, kMaxChunkBytes);
+    pixelData->set_data(pixels, firstChunk);
+    request.set_remaining_chunks((size - firstChunk + kMaxChunkBytes - 1) / kMaxChunkBytes);
+
+    if (mWritesDone || !mStream->Write(request)) {
+        return Status::ILLEGAL_STATE;
+    }
+    for (size_t offset = firstChunk; offset < size; offset += kMaxChunkBytes) {
+        proto::InputStreamRequest& chunk = mChunkRequest;
+        chunk.set_stream_id(streamId);
+        chunk.set_timestamp_us(timestamp_us);
+        chunk.set_pixel_chunk(pixels + offset, std::min(size - offset, kMaxChunkBytes));
+        if (!mStream->Write(chunk)) {
+            return Status::ILLEGAL_STATE;
+        }
+    }
+    return Status::SUCCESS;
+}
+
+Status InputStreamFeeder::feedSerializedData(int streamId, int64_t timestamp_us,
+                                             const std::string& data) {
+    proto::InputStreamRequest request;
+    request.set_stream_id(streamId);
+    request.set_timestamp_us(timestamp_us);
+    request.set_semantic_data(data);
+
+    std::lock_guard lock(mWriteLock);
+    if (mWritesDone || !mStream->Write(request)) {
+        return Status::ILLEGAL_STATE;
+    }
+    return Status::SUCCESS;
+}
+
+int InputStreamFeeder::acquireSlot(size_t size) {
+    std::lock_guard lock(mSlotLock);
+    if (mSharedMemoryFailed) {
+        return -1;
+    }
+    if (mMemory == nullptr) {
+        // Sized for the first frame, as the frames of a stream keep their size.
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t slotSize = (size + pageSize - 1) / pageSize * pageSize;
+        mMemoryFd = memfd_create("computepipe_graph_input", MFD_CLOEXEC);
+        void* memory = MAP_FAILED;
+        if (mMemoryFd >= 0 && ftruncate(mMemoryFd, slotSize * kSharedMemorySlots) == 0) {
+            memory = mmap(nullptr, slotSize * kSharedMemorySlots, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, mMemoryFd, 0);
+        }
+        if (memory == MAP_FAILED) {
+            // Frames go in chunks from now on.
+            LOG(ERROR) << "Failed to set up shared memory for the remote graph";
+            mSharedMemoryFailed = true;
+            return -1;
+        }
+        mMemory = static_cast<uint8_t*>(memory);
+        mSlotSize = slotSize;
+        mMemoryPath = "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(mMemoryFd);
+        mSlotInUse.assign(kSharedMemorySlots, false);
+    }
+    if (size > mSlotSize) {
+        return -1;
+    }
+    auto it = std::find(mSlotInUse.begin(), mSlotInUse.end(), false);
+    if (it == mSlotInUse.end()) {
+        return -1;
+    }
+    *it = true;
+    return it - mSlotInUse.begin();
+}
+
+void InputStreamFeeder::releaseSlot(int slot) {
+    std::lock_guard lock(mSlotLock);
+    if (slot >= 0 && slot < static_cast<int>(mSlotInUse.size())) {
+        mSlotInUse[slot] = false;
+    }
+}
+
+void InputStreamFeeder::readResponses() {
+    proto::InputStreamResponse response;
+    while (mStream->Read(&response)) {
+        for (int slot : response.released_slots()) {
+            releaseSlot(slot);
+        }
+        if (response.has_status() &&
+            response.status().code() != proto::RemoteGraphStatusCode::SUCCESS) {
+            LOG(ERROR) << "Remote graph failed to take an input: "
+                       << response.status().message();
+        }
+    }
+}
+
+}  // namespace graph
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,97 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_GRAPH_INPUT_STREAM_FEEDER_H
+#define COMPUTEPIPE_RUNNER_GRAPH_INPUT_STREAM_FEEDER_H
+
+#include <grpcpp/grpcpp.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GrpcPrebuiltGraphService.grpc.pb.h"
+#include "GrpcPrebuiltGraphService.pb.h"
+#include "InputFrame.h"
+#include "types/Status.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace graph {
+
+// Sends the input streams of a remote graph over one FeedInputStream call, for
+// as long as the graph runs. Frames are split into chunks small enough for a
+// grpc message. With shared memory, frames are instead copied into a ring of
+// slots that the graph maps, and only their location is sent.
+class InputStreamFeeder {
+  public:
+    InputStreamFeeder(proto::GrpcGraphService::Stub* stub, bool useSharedMemory);
+
+    virtual ~InputStreamFeeder();
+
+    Status start();
+
+    // Stops feeding. Unless cancelled, the graph gets to read everything sent
+    // so far first.
+    void stop(bool cancel);
+
+    Status feedPixelData(int streamId, int64_t timestamp_us, const runner::InputFrame& frame);
+
+    Status feedSerializedData(int streamId, int64_t timestamp_us, const std::string& data);
+
+  private:
+    // Returns a slot of at least the given size that the graph does not hold,
+    // or -1 if there is none.
+    int acquireSlot(size_t size);
+
+    void releaseSlot(int slot);
+
+    void readResponses();
+
+    proto::GrpcGraphService::Stub* mStub;
+    const bool mUseSharedMemory;
+
+    // Held while writing, so that the chunks of a frame are not interleaved
+    // with other requests.
+    std::mutex mWriteLock;
+    std::unique_ptr<::grpc::ClientContext> mContext;
+    std::unique_ptr<::grpc::ClientReaderWriter<proto::InputStreamRequest,
+                                               proto::InputStreamResponse>> mStream;
+    bool mWritesDone = true;
+    // Reused for every frame, so that the payload strings keep their storage
+    // and frames of a steady size are sent without allocating. The oneof data
+    // of each never changes case, as that would free it.
+    proto::InputStreamRequest mPixelRequest;
+    proto::InputStreamRequest mChunkRequest;
+    std::thread mReaderThread;
+
+    std::mutex mSlotLock;
+    int mMemoryFd = -1;
+    uint8_t* mMemory = nullptr;
+    size_t mSlotSize = 0;
+    std::string mMemoryPath;
+    std::vector<bool> mSlotInUse;
+    bool mSharedMemoryFailed = false;
+};
+
+}  // namespace graph
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_GRAPH_INPUT_STREAM_FEEDER_H
@@ -19,12 +19,14 @@
 
 #include <functional>
 #include <iostream>
+#include <map>
 #include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <vector>
 
 #include "ClientConfig.pb.h"
+#include "GraphCache.h"
 #include "InputFrame.h"
 #include "PrebuiltGraph.h"
 #include "RunnerComponent.h"
@@ -39,16 +41,15 @@ namespace graph {
 #define LOAD_FUNCTION(name)                                                        \
     {                                                                              \
         std::string func_name = std::string("PrebuiltComputepipeRunner_") + #name; \
-        mPrebuiltGraphInstance->mFn##name =                                        \
-                dlsym(mPrebuiltGraphInstance->mHandle, func_name.c_str());         \
-        if (mPrebuiltGraphInstance->mFn##name == nullptr) {                        \
+        graph->mFn##name = dlsym(graph->mHandle, func_name.c_str());               \
+        if (graph->mFn##name == nullptr) {                                         \
             initialized = false;                                                   \
             LOG(ERROR) << std::string(dlerror()) << std::endl;                     \
         }                                                                          \
     }
 
 std::mutex LocalPrebuiltGraph::mCreationMutex;
-LocalPrebuiltGraph* LocalPrebuiltGraph::mPrebuiltGraphInstance = nullptr;
+std::map<std::string, LocalPrebuiltGraph*> LocalPrebuiltGraph::mPrebuiltGraphInstances;
 
 // Function to confirm that there would be no further changes to the graph configuration. This
 // needs to be called before starting the graph.
@@ -85,6 +86,21 @@ Status LocalPrebuiltGraph::handleConfigPhase(const runner::ClientConfig& e) {
             return static_cast<Status>(static_cast<int>(errorCode));
         }
 
+        // Let the graph render pixel output straight into the stream buffers if it can.
+        if (mFnSetOutputPixelBufferCallbacks != nullptr) {
+            auto pixelBufferCallbacksFn = (PrebuiltComputepipeRunner_ErrorCode(*)(
+                    AHardwareBuffer* (*)(void*, int, int, int, int),
+                    void (*)(void*, int, int64_t, AHardwareBuffer*),
+                    void (*)(void*, int, AHardwareBuffer*)))mFnSetOutputPixelBufferCallbacks;
+            errorCode = pixelBufferCallbacksFn(
+                    LocalPrebuiltGraph::AcquireOutputPixelBufferFunction,
+                    LocalPrebuiltGraph::SubmitOutputPixelBufferFunction,
+                    LocalPrebuiltGraph::ReleaseOutputPixelBufferFunction);
+            if (errorCode != PrebuiltComputepipeRunner_ErrorCode::SUCCESS) {
+                return static_cast<Status>(static_cast<int>(errorCode));
+            }
+        }
+
         // Set the serialized stream callback function. The same callback function will be invoked
         // for all requested serialized output streams.
         auto streamCallbackFn = (PrebuiltComputepipeRunner_ErrorCode(*)(
@@ -144,9 +160,10 @@ Status LocalPrebuiltGraph::handleStopWithFlushPhase(const runner::RunnerEvent& e
     return StopGraphExecution(/* flushOutputFrames = */ true);
 }
 
-// Stops the graph and cancels all the output packets.
+// Stops the graph and cancels all the output packets, also while it flushes.
 Status LocalPrebuiltGraph::handleStopImmediatePhase(const runner::RunnerEvent& e) {
-    if (mGraphState.load() != PrebuiltGraphState::RUNNING) {
+    PrebuiltGraphState state = mGraphState.load();
+    if (state != PrebuiltGraphState::RUNNING && state != PrebuiltGraphState::FLUSHING) {
         return Status::ILLEGAL_STATE;
     }
 
@@ -177,26 +194,30 @@ Status LocalPrebuiltGraph::handleResetPhase(const runner::RunnerEvent& e) {
 
 LocalPrebuiltGraph* LocalPrebuiltGraph::GetPrebuiltGraphFromLibrary(
         const std::string& prebuilt_library,
-        std::weak_ptr<PrebuiltEngineInterface> engineInterface) {
+        std::weak_ptr<PrebuiltEngineInterface> engineInterface, const std::string& cacheRoot) {
     std::unique_lock<std::mutex> lock(LocalPrebuiltGraph::mCreationMutex);
-    if (mPrebuiltGraphInstance == nullptr) {
-        mPrebuiltGraphInstance = new LocalPrebuiltGraph();
+    // The entry points of a prebuilt are global to its library, so there is one
+    // graph per library. Graphs of different libraries, such as two versions of
+    // a graph, can be loaded side by side.
+    LocalPrebuiltGraph*& graph = mPrebuiltGraphInstances[prebuilt_library];
+    if (graph == nullptr) {
+        graph = new LocalPrebuiltGraph();
+        graph->mLibrary = prebuilt_library;
     }
-    if (mPrebuiltGraphInstance->mGraphState.load() != PrebuiltGraphState::UNINITIALIZED) {
-        return mPrebuiltGraphInstance;
+    if (graph->mGraphState.load() != PrebuiltGraphState::UNINITIALIZED) {
+        return graph;
     }
-    mPrebuiltGraphInstance->mHandle = dlopen(prebuilt_library.c_str(), RTLD_NOW);
+    graph->mHandle = dlopen(prebuilt_library.c_str(), RTLD_NOW | RTLD_LOCAL);
 
-    if (mPrebuiltGraphInstance->mHandle) {
+    if (graph->mHandle) {
         bool initialized = true;
 
         // Load config and version number first.
         const unsigned char* (*getVersionFn)() =
-                (const unsigned char* (*)())dlsym(mPrebuiltGraphInstance->mHandle,
+                (const unsigned char* (*)())dlsym(graph->mHandle,
                                                   "PrebuiltComputepipeRunner_GetVersion");
         if (getVersionFn != nullptr) {
-            mPrebuiltGraphInstance->mGraphVersion =
-                    std::string(reinterpret_cast<const char*>(getVersionFn()));
+            graph->mGraphVersion = std::string(reinterpret_cast<const char*>(getVersionFn()));
         } else {
             LOG(ERROR) << std::string(dlerror());
             initialized = false;
@@ -204,7 +225,7 @@ LocalPrebuiltGraph* LocalPrebuiltGraph::GetPrebuiltGraphFromLibrary(
 
         void (*getSupportedGraphConfigsFn)(const void**, size_t*) =
                 (void (*)(const void**,
-                          size_t*))dlsym(mPrebuiltGraphInstance->mHandle,
+                          size_t*))dlsym(graph->mHandle,
                                          "PrebuiltComputepipeRunner_GetSupportedGraphConfigs");
         if (getSupportedGraphConfigsFn != nullptr) {
             size_t graphConfigSize;
@@ -213,7 +234,7 @@ LocalPrebuiltGraph* LocalPrebuiltGraph::GetPrebuiltGraphFromLibrary(
             getSupportedGraphConfigsFn(&graphConfig, &graphConfigSize);
 
             if (graphConfigSize > 0) {
-                initialized &= mPrebuiltGraphInstance->mGraphConfig.ParseFromString(
+                initialized &= graph->mGraphConfig.ParseFromString(
                         std::string(reinterpret_cast<const char*>(graphConfig), graphConfigSize));
             }
         } else {
@@ -241,19 +262,42 @@ LocalPrebuiltGraph* LocalPrebuiltGraph::GetPrebuiltGraphFromLibrary(
         LOAD_FUNCTION(StopGraphProfiling);
         LOAD_FUNCTION(GetDebugInfo);
 
+        // Older prebuilts do not render into runner buffers, so this one may be missing.
+        graph->mFnSetOutputPixelBufferCallbacks =
+                dlsym(graph->mHandle, "PrebuiltComputepipeRunner_SetOutputPixelBufferCallbacks");
+        // Nor do they all take frames of several streams at once.
+        graph->mFnSetInputStreamsPixelData =
+                dlsym(graph->mHandle, "PrebuiltComputepipeRunner_SetInputStreamsPixelData");
+        // Nor do they all keep state across runs.
+        graph->mFnSetCacheDirectory =
+                dlsym(graph->mHandle, "PrebuiltComputepipeRunner_SetCacheDirectory");
+        // Nor do they all adapt to slow clients.
+        graph->mFnSetOutputStreamBackpressure =
+                dlsym(graph->mHandle, "PrebuiltComputepipeRunner_SetOutputStreamBackpressure");
+        if (initialized && !cacheRoot.empty()) {
+            graph->SetUpCacheDirectory(cacheRoot);
+        }
+
         // This is the only way to create this object and there is already a
         // lock around object creation, so no need to hold the graphState lock
         // here.
         if (initialized) {
-            mPrebuiltGraphInstance->mGraphState.store(PrebuiltGraphState::STOPPED);
-            mPrebuiltGraphInstance->mEngineInterface = engineInterface;
+            graph->mGraphState.store(PrebuiltGraphState::STOPPED);
+            graph->mEngineInterface = engineInterface;
         }
     }
 
-    return mPrebuiltGraphInstance;
+    return graph;
 }
 
 LocalPrebuiltGraph::~LocalPrebuiltGraph() {
+    {
+        std::lock_guard<std::mutex> lock(LocalPrebuiltGraph::mCreationMutex);
+        auto it = mPrebuiltGraphInstances.find(mLibrary);
+        if (it != mPrebuiltGraphInstances.end() && it->second == this) {
+            mPrebuiltGraphInstances.erase(it);
+        }
+    }
     if (mHandle) {
         dlclose(mHandle);
     }
@@ -322,6 +366,43 @@ Status LocalPrebuiltGraph::SetInputStreamPixelData(int streamIndex, int64_t time
     return static_cast<Status>(static_cast<int>(errorCode));
 }
 
+Status LocalPrebuiltGraph::SetInputStreamsPixelData(int64_t timestamp,
+                                                    const runner::InputFrameSet& frames) {
+    if (mFnSetInputStreamsPixelData == nullptr) {
+        return PrebuiltGraph::SetInputStreamsPixelData(timestamp, frames);
+    }
+    if (mGraphState.load() == PrebuiltGraphState::UNINITIALIZED) {
+        return Status::ILLEGAL_STATE;
+    }
+
+    std::vector<PrebuiltComputepipeRunner_PixelData> pixelData;
+    pixelData.reserve(frames.size());
+    for (const auto& [streamIndex, frame] : frames) {
+        runner::FrameInfo info = frame->getFrameInfo();
+        pixelData.push_back({streamIndex, frame->getFramePtr(), static_cast<int>(info.width),
+                             static_cast<int>(info.height), static_cast<int>(info.stride),
+                             static_cast<int>(info.format)});
+    }
+    auto mappedFn = (PrebuiltComputepipeRunner_ErrorCode(*)(
+            int64_t, const PrebuiltComputepipeRunner_PixelData*, int))mFnSetInputStreamsPixelData;
+    PrebuiltComputepipeRunner_ErrorCode errorCode =
+            mappedFn(timestamp, pixelData.data(), static_cast<int>(pixelData.size()));
+    return static_cast<Status>(static_cast<int>(errorCode));
+}
+
+Status LocalPrebuiltGraph::SetOutputStreamBackpressure(int streamIndex, bool congested) {
+    if (mFnSetOutputStreamBackpressure == nullptr) {
+        return Status::SUCCESS;
+    }
+    if (mGraphState.load() == PrebuiltGraphState::UNINITIALIZED) {
+        return Status::ILLEGAL_STATE;
+    }
+    auto mappedFn = (PrebuiltComputepipeRunner_ErrorCode(*)(int, bool))
+            mFnSetOutputStreamBackpressure;
+    PrebuiltComputepipeRunner_ErrorCode errorCode = mappedFn(streamIndex, congested);
+    return static_cast<Status>(static_cast<int>(errorCode));
+}
+
 Status LocalPrebuiltGraph::StopGraphExecution(bool flushOutputFrames) {
     auto mappedFn = (PrebuiltComputepipeRunner_ErrorCode(*)(bool))mFnStopGraphExecution;
     PrebuiltComputepipeRunner_ErrorCode errorCode = mappedFn(flushOutputFrames);
@@ -332,6 +413,23 @@ Status LocalPrebuiltGraph::StopGraphExecution(bool flushOutputFrames) {
     return static_cast<Status>(static_cast<int>(errorCode));
 }
 
+void LocalPrebuiltGraph::SetUpCacheDirectory(const std::string& cacheRoot) {
+    if (mFnSetCacheDirectory == nullptr) {
+        return;
+    }
+    std::string cacheDir = GraphCache(cacheRoot).prepareDirectory(mLibrary, mGraphVersion);
+    if (cacheDir.empty()) {
+        return;
+    }
+    auto mappedFn = (PrebuiltComputepipeRunner_ErrorCode(*)(const char*))mFnSetCacheDirectory;
+    PrebuiltComputepipeRunner_ErrorCode errorCode = mappedFn(cacheDir.c_str());
+    // The graph still runs without its cache, just not as fast to start.
+    if (errorCode != PrebuiltComputepipeRunner_ErrorCode::SUCCESS) {
+        LOG(WARNING) << "Graph did not take cache directory " << cacheDir << ", error "
+                     << errorCode;
+    }
+}
+
 Status LocalPrebuiltGraph::StartGraphProfiling() {
     auto mappedFn = (PrebuiltComputepipeRunner_ErrorCode(*)())mFnStartGraphProfiling;
     PrebuiltComputepipeRunner_ErrorCode errorCode = mappedFn();
@@ -390,6 +488,43 @@ void LocalPrebuiltGraph::OutputPixelStreamCallbackFunction(void* cookie, int str
     }
 }
 
+AHardwareBuffer* LocalPrebuiltGraph::AcquireOutputPixelBufferFunction(void* cookie, int streamIndex,
+                                                                     int width, int height,
+                                                                     int format) {
+    LocalPrebuiltGraph* graph = reinterpret_cast<LocalPrebuiltGraph*>(cookie);
+    CHECK(graph);
+    std::shared_ptr<PrebuiltEngineInterface> engineInterface = graph->mEngineInterface.lock();
+
+    if (engineInterface == nullptr || width <= 0 || height <= 0) {
+        return nullptr;
+    }
+    return engineInterface->AcquirePixelBuffer(streamIndex, width, height,
+                                               static_cast<PixelFormat>(format));
+}
+
+void LocalPrebuiltGraph::SubmitOutputPixelBufferFunction(void* cookie, int streamIndex,
+                                                         int64_t timestamp,
+                                                         AHardwareBuffer* buffer) {
+    LocalPrebuiltGraph* graph = reinterpret_cast<LocalPrebuiltGraph*>(cookie);
+    CHECK(graph);
+    std::shared_ptr<PrebuiltEngineInterface> engineInterface = graph->mEngineInterface.lock();
+
+    if (engineInterface) {
+        engineInterface->DispatchPixelBuffer(streamIndex, timestamp, buffer);
+    }
+}
+
+void LocalPrebuiltGraph::ReleaseOutputPixelBufferFunction(void* cookie, int streamIndex,
+                                                          AHardwareBuffer* buffer) {
+    LocalPrebuiltGraph* graph = reinterpret_cast<LocalPrebuiltGraph*>(cookie);
+    CHECK(graph);
+    std::shared_ptr<PrebuiltEngineInterface> engineInterface = graph->mEngineInterface.lock();
+
+    if (engineInterface) {
+        engineInterface->ReleasePixelBuffer(streamIndex, buffer);
+    }
+}
+
 void LocalPrebuiltGraph::GraphTerminationCallbackFunction(void* cookie,
                                                           const unsigned char* termination_message,
                                                           size_t termination_message_size) {
@@ -409,8 +544,10 @@ void LocalPrebuiltGraph::GraphTerminationCallbackFunction(void* cookie,
 }
 
 PrebuiltGraph* GetLocalGraphFromLibrary(const std::string& prebuilt_library,
-                                        std::weak_ptr<PrebuiltEngineInterface> engineInterface) {
-    return LocalPrebuiltGraph::GetPrebuiltGraphFromLibrary(prebuilt_library, engineInterface);
+                                        std::weak_ptr<PrebuiltEngineInterface> engineInterface,
+                                        const std::string& cacheRoot) {
+    return LocalPrebuiltGraph::GetPrebuiltGraphFromLibrary(prebuilt_library, engineInterface,
+                                                           cacheRoot);
 }
 
 }  // namespace graph
@@ -16,6 +16,8 @@
 #define COMPUTEPIPE_RUNNER_GRAPH_GRPC_GRAPH_H
 
 #include <functional>
+#include <map>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
 
@@ -55,7 +57,8 @@ class LocalPrebuiltGraph : public PrebuiltGraph {
     Status handleResetPhase(const runner::RunnerEvent& e) override;
 
     static LocalPrebuiltGraph* GetPrebuiltGraphFromLibrary(
-        const std::string& prebuiltLib, std::weak_ptr<PrebuiltEngineInterface> engineInterface);
+        const std::string& prebuiltLib, std::weak_ptr<PrebuiltEngineInterface> engineInterface,
+        const std::string& cacheRoot = "");
 
     PrebuiltGraphType GetGraphType() const override {
         return PrebuiltGraphType::LOCAL;
@@ -74,6 +77,10 @@ class LocalPrebuiltGraph : public PrebuiltGraph {
         return mGraphConfig;
     }
 
+    bool AcceptsInputStreams() const override {
+        return true;
+    }
+
     // Sets input stream data. The string is expected to be a serialized proto
     // the definition of which is known to the graph.
     Status SetInputStreamData(int streamIndex, int64_t timestamp,
@@ -83,6 +90,14 @@ class LocalPrebuiltGraph : public PrebuiltGraph {
     Status SetInputStreamPixelData(int streamIndex, int64_t timestamp,
                                    const runner::InputFrame& inputFrame) override;
 
+    // Sets pixel data to several input streams with a single call into the prebuilt, if it
+    // supports that.
+    Status SetInputStreamsPixelData(int64_t timestamp,
+                                    const runner::InputFrameSet& frames) override;
+
+    // Passes the backpressure of an output stream to the prebuilt, if it takes it.
+    Status SetOutputStreamBackpressure(int streamIndex, bool congested) override;
+
     Status StartGraphProfiling() override;
 
     Status StopGraphProfiling() override;
@@ -98,12 +113,21 @@ class LocalPrebuiltGraph : public PrebuiltGraph {
     // Stops the graph execution.
     Status StopGraphExecution(bool flushOutputFrames);
 
+    // Hands the prebuilt its cache directory under the given root, if it takes one.
+    void SetUpCacheDirectory(const std::string& cacheRoot);
+
     // Callback functions. The class has a C++ function callback interface while it deals with pure
     // C functions underneath that do not have object context. We need to have these static
     // functions that need to be passed to the C interface.
     static void OutputPixelStreamCallbackFunction(void* cookie, int streamIndex, int64_t timestamp,
                                                   const uint8_t* pixels, int width, int height,
                                                   int step, int format);
+    static AHardwareBuffer* AcquireOutputPixelBufferFunction(void* cookie, int streamIndex,
+                                                             int width, int height, int format);
+    static void SubmitOutputPixelBufferFunction(void* cookie, int streamIndex, int64_t timestamp,
+                                                AHardwareBuffer* buffer);
+    static void ReleaseOutputPixelBufferFunction(void* cookie, int streamIndex,
+                                                 AHardwareBuffer* buffer);
     static void OutputStreamCallbackFunction(void* cookie, int streamIndex, int64_t timestamp,
                                              const unsigned char* data, size_t dataSize);
     static void GraphTerminationCallbackFunction(void* cookie,
@@ -114,7 +138,10 @@ class LocalPrebuiltGraph : public PrebuiltGraph {
     std::weak_ptr<PrebuiltEngineInterface> mEngineInterface;
 
     static std::mutex mCreationMutex;
-    static LocalPrebuiltGraph* mPrebuiltGraphInstance;
+    static std::map<std::string, LocalPrebuiltGraph*> mPrebuiltGraphInstances;
+
+    // The library the graph was loaded from.
+    std::string mLibrary;
 
     // Even though mutexes are generally preferred over atomics, the only varialble in this class
     // that changes after initialization is graph state and that is the only vairable that needs
@@ -123,7 +150,7 @@ class LocalPrebuiltGraph : public PrebuiltGraph {
     std::atomic<PrebuiltGraphState> mGraphState = PrebuiltGraphState::UNINITIALIZED;
 
     // Dynamic library handle
-    void* mHandle;
+    void* mHandle = nullptr;
 
     // Repeated function calls need not be made to get the graph version and the config is this is
     // constant through the operation of the graph. These values are just cached as strings.
@@ -145,6 +172,16 @@ class LocalPrebuiltGraph : public PrebuiltGraph {
     void* mFnStartGraphProfiling;
     void* mFnStopGraphProfiling;
     void* mFnGetDebugInfo;
+
+    // Optional, null for prebuilts that only hand out pixel output through the pixel stream
+    // callback.
+    void* mFnSetOutputPixelBufferCallbacks = nullptr;
+    // Optional, null for prebuilts that take input frames one at a time.
+    void* mFnSetInputStreamsPixelData = nullptr;
+    // Optional, null for prebuilts that keep no state across runs.
+    void* mFnSetCacheDirectory = nullptr;
+    // Optional, null for prebuilts that produce every output regardless of the clients.
+    void* mFnSetOutputStreamBackpressure = nullptr;
 };
 
 }  // namespace graph
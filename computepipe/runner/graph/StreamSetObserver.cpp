@@ -17,9 +17,12 @@
 #include <android-base/logging.h>
 #include <grpcpp/grpcpp.h>
 
+#include <chrono>
+
 #include "ClientConfig.pb.h"
 #include "GrpcGraph.h"
 #include "InputFrame.h"
+#include "PixelFormatUtils.h"
 #include "RunnerComponent.h"
 #include "prebuilt_interface.h"
 #include "types/Status.h"
@@ -28,100 +31,12 @@ namespace android {
 namespace automotive {
 namespace computepipe {
 namespace graph {
+namespace {
 
-SingleStreamObserver::SingleStreamObserver(int streamId, EndOfStreamReporter* endOfStreamReporter,
-                                           StreamGraphInterface* streamGraphInterface) :
-      mStreamId(streamId),
-      mEndOfStreamReporter(endOfStreamReporter),
-      mStreamGraphInterface(streamGraphInterface) {}
-
-Status SingleStreamObserver::startObservingStream() {
-    {
-        std::lock_guard lock(mStopObservationLock);
-        mStopped = false;
-    }
-    mThread = std::thread([this]() {
-        proto::ObserveOutputStreamRequest observeStreamRequest;
-        observeStreamRequest.set_stream_id(mStreamId);
-        ::grpc::ClientContext context;
-        ::grpc::CompletionQueue cq;
-
-        void* tag;
-        bool cqStatus;
-
-        std::unique_ptr<::grpc::ClientAsyncReader<proto::OutputStreamResponse>> rpc(
-                mStreamGraphInterface->getServiceStub()
-                        ->AsyncObserveOutputStream(&context, observeStreamRequest, &cq, nullptr));
-
-        proto::OutputStreamResponse response;
-
-        cq.Next(&tag, &cqStatus);
-        while (cqStatus) {
-            // Dispatch data only stream is being observed.
-            rpc->Read(&response, nullptr);
-            {
-                std::lock_guard lock(mStopObservationLock);
-                if (mStopped || mStreamGraphInterface == nullptr) {
-                    LOG(INFO) << "Graph stopped. ";
-                    break;
-                }
-
-                // Since this is a separate thread, we need not worry about recursive locking
-                // and callback can be executed without creating a new thread.
-                if (response.has_pixel_data()) {
-                    proto::PixelData pixels = response.pixel_data();
-                    runner::InputFrame frame(pixels.height(), pixels.width(),
-                                             static_cast<PixelFormat>(
-                                                     static_cast<int>(pixels.format())),
-                                             pixels.step(),
-                                             reinterpret_cast<const unsigned char*>(
-                                                     pixels.data().c_str()));
-                    mStreamGraphInterface->dispatchPixelData(mStreamId, response.timestamp_us(),
-                                                             frame);
-                } else if (response.has_semantic_data()) {
-                    mStreamGraphInterface
-                            ->dispatchSerializedData(mStreamId, response.timestamp_us(),
-                                                     std::move(*response.mutable_semantic_data()));
-                }
-            }
+// How long cancelled output streams get to close.
+constexpr std::chrono::milliseconds kStreamCancelTimeout(500);
 
-            cq.Next(&tag, &cqStatus);
-        }
-
-        ::grpc::Status grpcStatus;
-        rpc->Finish(&grpcStatus, nullptr);
-        if (!grpcStatus.ok()) {
-            LOG(ERROR) << "Failed RPC with message: " << grpcStatus.error_message();
-        }
-
-        cq.Shutdown();
-        if (mEndOfStreamReporter) {
-            std::lock_guard lock(mStopObservationLock);
-            mStopped = true;
-            std::thread t =
-                    std::thread([this]() { mEndOfStreamReporter->reportStreamClosed(mStreamId); });
-
-            t.detach();
-        }
-
-        proto::OutputStreamResponse streamResponse;
-    });
-
-    return Status::SUCCESS;
-}
-
-void SingleStreamObserver::stopObservingStream() {
-    std::lock_guard lock(mStopObservationLock);
-    mStopped = true;
-}
-
-SingleStreamObserver::~SingleStreamObserver() {
-    stopObservingStream();
-
-    if (mThread.joinable()) {
-        mThread.join();
-    }
-}
+}  // namespace
 
 StreamSetObserver::StreamSetObserver(const runner::ClientConfig& clientConfig,
                                      StreamGraphInterface* streamGraphInterface) :
@@ -132,24 +47,33 @@ Status StreamSetObserver::startObservingStreams() {
     std::map<int, int> outputConfigs = {};
     mClientConfig.getOutputStreamConfigs(outputConfigs);
 
-    if (!mStopped || !mStreamObservers.empty()) {
+    if (!mStopped || !mStreamCalls.empty()) {
         LOG(ERROR) << "Already started observing streams. Duplicate call is not allowed";
         return Status::ILLEGAL_STATE;
     }
 
+    // The reactor of the previous run is done once all of its calls are.
+    if (mReactorThread.joinable()) {
+        mReactorThread.join();
+    }
+    mCancelled = false;
+    mCompletionQueue = std::make_unique<::grpc::CompletionQueue>();
+
     for (const auto& it : outputConfigs) {
-        auto streamObserver =
-                std::make_unique<SingleStreamObserver>(it.first, this, mStreamGraphInterface);
-        Status status = streamObserver->startObservingStream();
-        if (status != Status::SUCCESS) {
-            std::thread t([this]() { stopObservingStreams(true); });
-            t.detach();
-            return status;
-        }
-        mStreamObservers.emplace(std::make_pair(it.first, std::move(streamObserver)));
+        auto call = std::make_unique<StreamCall>();
+        call->streamId = it.first;
+        proto::ObserveOutputStreamRequest observeStreamRequest;
+        observeStreamRequest.set_stream_id(it.first);
+        call->reader = mStreamGraphInterface->getServiceStub()->AsyncObserveOutputStream(
+                &call->context, observeStreamRequest, mCompletionQueue.get(), call.get());
+        mStreamCalls.emplace(it.first, std::move(call));
     }
 
-    mStopped = mStreamObservers.empty();
+    mStopped = mStreamCalls.empty();
+    if (mStopped) {
+        mCompletionQueue->Shutdown();
+    }
+    mReactorThread = std::thread(&StreamSetObserver::runReactor, this);
     return Status::SUCCESS;
 }
 
@@ -168,31 +92,122 @@ void StreamSetObserver::stopObservingStreams(bool stopImmediately) {
 
     // Wait for the streams to close if we are not stopping immediately.
     if (stopImmediately) {
-        for (auto& it : mStreamObservers) {
-            it.second->stopObservingStream();
+        mCancelled = true;
+        for (auto& it : mStreamCalls) {
+            it.second->context.TryCancel();
         }
 
-        mStoppedCv.wait(lock, [this]() -> bool { return mStopped; });
+        if (!mStoppedCv.wait_for(lock, kStreamCancelTimeout,
+                                 [this]() -> bool { return mStopped; })) {
+            LOG(WARNING) << "Output streams did not close within "
+                         << kStreamCancelTimeout.count() << " ms of being cancelled";
+        }
     }
 }
 
-void StreamSetObserver::reportStreamClosed(int streamId) {
-    std::lock_guard lock(mLock);
-    auto streamObserver = mStreamObservers.find(streamId);
-    if (streamObserver == mStreamObservers.end()) {
-        return;
+void StreamSetObserver::runReactor() {
+    void* tag;
+    bool ok;
+    while (mCompletionQueue->Next(&tag, &ok)) {
+        StreamCall* call = static_cast<StreamCall*>(tag);
+        if (handleEvent(call, ok)) {
+            continue;
+        }
+
+        std::thread previousTerminationThread;
+        {
+            std::lock_guard lock(mLock);
+            if (!call->status.ok() && !mCancelled) {
+                LOG(ERROR) << "Failed RPC with message: " << call->status.error_message();
+            }
+            mStreamCalls.erase(call->streamId);
+            if (!mStreamCalls.empty()) {
+                continue;
+            }
+
+            mStopped = true;
+            mStoppedCv.notify_one();
+            mCompletionQueue->Shutdown();
+            // Reported from another thread, as the graph may be waiting on
+            // mLock while holding its own lock.
+            previousTerminationThread = std::move(mGraphTerminationThread);
+            mGraphTerminationThread =
+                    std::thread([streamGraphInterface(mStreamGraphInterface)]() {
+                        streamGraphInterface->dispatchGraphTerminationMessage(Status::SUCCESS,
+                                                                              "");
+                    });
+        }
+        if (previousTerminationThread.joinable()) {
+            previousTerminationThread.join();
+        }
     }
-    mStreamObservers.erase(streamObserver);
-    if (mStreamObservers.empty()) {
-        mStopped = true;
-        mStoppedCv.notify_one();
-        mGraphTerminationThread = std::thread([streamGraphInterface(mStreamGraphInterface)]() {
-            streamGraphInterface->dispatchGraphTerminationMessage(Status::SUCCESS, "");
-        });
+}
+
+bool StreamSetObserver::handleEvent(StreamCall* call, bool ok) {
+    switch (call->state) {
+        case StreamCall::State::STARTING:
+            if (ok) {
+                call->state = StreamCall::State::READING;
+                call->reader->Read(&call->response, call);
+                return true;
+            }
+            break;
+        case StreamCall::State::READING:
+            if (ok) {
+                dispatchResponse(call);
+                call->reader->Read(&call->response, call);
+                return true;
+            }
+            break;
+        case StreamCall::State::FINISHING:
+            return false;
+    }
+
+    // The stream has ended, or failed to start.
+    call->state = StreamCall::State::FINISHING;
+    call->reader->Finish(&call->status, call);
+    return true;
+}
+
+void StreamSetObserver::dispatchResponse(StreamCall* call) {
+    {
+        std::lock_guard lock(mLock);
+        if (mCancelled) {
+            return;
+        }
+    }
+
+    proto::OutputStreamResponse& response = call->response;
+    if (response.has_pixel_data()) {
+        // The frame points into the response, which is reused for the next
+        // read of the stream, so the payload is only copied by its consumer.
+        const proto::PixelData& pixels = response.pixel_data();
+        PixelFormat format = static_cast<PixelFormat>(static_cast<int>(pixels.format()));
+        if (pixels.data().size() < runner::frameSizeBytes(format, pixels.step(), pixels.height())) {
+            LOG(ERROR) << "Dropping a frame of stream " << call->streamId
+                       << " with less pixel data than its size";
+            return;
+        }
+        runner::InputFrame frame(pixels.height(), pixels.width(), format, pixels.step(),
+                                 reinterpret_cast<const unsigned char*>(pixels.data().data()));
+        mStreamGraphInterface->dispatchPixelData(call->streamId, response.timestamp_us(), frame);
+    } else if (response.has_semantic_data()) {
+        mStreamGraphInterface->dispatchSerializedData(call->streamId, response.timestamp_us(),
+                                                      std::move(*response.mutable_semantic_data()));
     }
 }
 
 StreamSetObserver::~StreamSetObserver() {
+    {
+        std::lock_guard lock(mLock);
+        mCancelled = true;
+        for (auto& it : mStreamCalls) {
+            it.second->context.TryCancel();
+        }
+    }
+    if (mReactorThread.joinable()) {
+        mReactorThread.join();
+    }
     std::unique_lock lock(mLock);
     if (mGraphTerminationThread.joinable()) {
         mGraphTerminationThread.join();
@@ -15,6 +15,8 @@
 #ifndef COMPUTEPIPE_RUNNER_GRAPH_STREAM_SET_OBSERVER_H
 #define COMPUTEPIPE_RUNNER_GRAPH_STREAM_SET_OBSERVER_H
 
+#include <grpcpp/grpcpp.h>
+
 #include <condition_variable>
 #include <map>
 #include <memory>
@@ -35,13 +37,6 @@ namespace graph {
 
 class GrpcGraph;
 
-class EndOfStreamReporter {
-  public:
-    virtual ~EndOfStreamReporter() = default;
-
-    virtual void reportStreamClosed(int streamId) = 0;
-};
-
 class StreamGraphInterface {
   public:
     virtual ~StreamGraphInterface() = default;
@@ -57,26 +52,10 @@ class StreamGraphInterface {
     virtual proto::GrpcGraphService::Stub* getServiceStub() = 0;
 };
 
-class SingleStreamObserver {
-  public:
-    SingleStreamObserver(int streamId, EndOfStreamReporter* endOfStreamReporter,
-                         StreamGraphInterface* streamGraphInterface);
-
-    virtual ~SingleStreamObserver();
-
-    Status startObservingStream();
-
-    void stopObservingStream();
-  private:
-    int mStreamId;
-    EndOfStreamReporter* mEndOfStreamReporter;
-    StreamGraphInterface* mStreamGraphInterface;
-    std::thread mThread;
-    bool mStopped = true;
-    std::mutex mStopObservationLock;
-};
-
-class StreamSetObserver : public EndOfStreamReporter {
+// Observes all the output streams of a remote graph from one thread, which
+// drives their reads on a single completion queue and dispatches the packets,
+// so the number of threads does not grow with the number of streams.
+class StreamSetObserver {
   public:
     virtual ~StreamSetObserver();
 
@@ -87,15 +66,39 @@ class StreamSetObserver : public EndOfStreamReporter {
 
     void stopObservingStreams(bool stopImmediately);
 
-    void reportStreamClosed(int streamId) override;
   private:
+    // An ObserveOutputStream call, which is also its tag on the completion queue.
+    struct StreamCall {
+        enum class State { STARTING, READING, FINISHING };
+
+        int streamId;
+        State state = State::STARTING;
+        ::grpc::ClientContext context;
+        std::unique_ptr<::grpc::ClientAsyncReader<proto::OutputStreamResponse>> reader;
+        proto::OutputStreamResponse response;
+        ::grpc::Status status;
+    };
+
+    // Run by the reactor thread until all the calls have finished.
+    void runReactor();
+
+    // Moves a call on once its last operation has completed. Returns false
+    // once the call has finished.
+    bool handleEvent(StreamCall* call, bool ok);
+
+    void dispatchResponse(StreamCall* call);
+
     const runner::ClientConfig& mClientConfig;
     StreamGraphInterface* mStreamGraphInterface;
-    std::map<int, std::unique_ptr<SingleStreamObserver>> mStreamObservers;
+    std::map<int, std::unique_ptr<StreamCall>> mStreamCalls;
+    std::unique_ptr<::grpc::CompletionQueue> mCompletionQueue;
+    std::thread mReactorThread;
     std::mutex mLock;
     std::condition_variable mStoppedCv;
     std::thread mGraphTerminationThread;
     bool mStopped = true;
+    // Set once packets should no longer go to the engine.
+    bool mCancelled = false;
 };
 
 }  // namespace graph
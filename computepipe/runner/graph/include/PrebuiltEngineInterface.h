@@ -33,6 +33,17 @@ class PrebuiltEngineInterface {
 
     virtual void DispatchSerializedData(int streamId, int64_t timestamp, std::string&&) = 0;
 
+    // Lends the graph an empty buffer to render a pixel packet into, or returns nullptr if the
+    // stream cannot spare one.
+    virtual AHardwareBuffer* AcquirePixelBuffer(int streamId, uint32_t width, uint32_t height,
+                                                PixelFormat format) = 0;
+
+    // Sends out a buffer from AcquirePixelBuffer that the graph has rendered into.
+    virtual void DispatchPixelBuffer(int streamId, int64_t timestamp, AHardwareBuffer* buffer) = 0;
+
+    // Returns a buffer from AcquirePixelBuffer that the graph did not fill.
+    virtual void ReleasePixelBuffer(int streamId, AHardwareBuffer* buffer) = 0;
+
     virtual void DispatchGraphTerminationMessage(Status, std::string&&) = 0;
 };
 
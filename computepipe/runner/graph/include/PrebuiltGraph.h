@@ -57,6 +57,11 @@ class PrebuiltGraph : public runner::RunnerComponentInterface {
     // Gets the supported graph config options.
     virtual const proto::Options& GetSupportedGraphConfigs() const = 0;
 
+    // Whether the graph takes its input streams through SetInputStreamData()
+    // and SetInputStreamPixelData(), rather than opening its input sources
+    // itself.
+    virtual bool AcceptsInputStreams() const = 0;
+
     // Sets input stream data. The string is expected to be a serialized proto
     // the definition of which is known to the graph.
     virtual Status SetInputStreamData(int streamIndex, int64_t timestamp,
@@ -66,6 +71,26 @@ class PrebuiltGraph : public runner::RunnerComponentInterface {
     virtual Status SetInputStreamPixelData(int streamIndex, int64_t timestamp,
                                            const runner::InputFrame& inputFrame) = 0;
 
+    // Sets pixel data on several input streams at once, for frames captured
+    // together. Graphs that cannot take them as a set get them one by one.
+    virtual Status SetInputStreamsPixelData(int64_t timestamp,
+                                            const runner::InputFrameSet& frames) {
+        for (const auto& [streamIndex, frame] : frames) {
+            Status status = SetInputStreamPixelData(streamIndex, timestamp, *frame);
+            if (status != Status::SUCCESS) {
+                return status;
+            }
+        }
+        return Status::SUCCESS;
+    }
+
+    // Tells the graph whether the consumers of an output stream have room for
+    // its packets, so that it can skip producing packets that would be dropped.
+    // Graphs that cannot make use of it ignore it.
+    virtual Status SetOutputStreamBackpressure(int /* streamIndex */, bool /* congested */) {
+        return Status::SUCCESS;
+    }
+
     // Start graph profiling.
     virtual Status StartGraphProfiling() = 0;
 
@@ -77,8 +102,11 @@ class PrebuiltGraph : public runner::RunnerComponentInterface {
     virtual std::string GetDebugInfo() = 0;
 };
 
+// Loads the graph of a prebuilt library. If a cache root is given, graphs that
+// support it get a persistent directory under it to start warm from.
 PrebuiltGraph* GetLocalGraphFromLibrary(
-        const std::string& prebuiltLib, std::weak_ptr<PrebuiltEngineInterface> engineInterface);
+        const std::string& prebuiltLib, std::weak_ptr<PrebuiltEngineInterface> engineInterface,
+        const std::string& cacheRoot = "");
 
 std::unique_ptr<PrebuiltGraph> GetRemoteGraphFromAddress(
         const std::string& address, std::weak_ptr<PrebuiltEngineInterface> engineInterface);
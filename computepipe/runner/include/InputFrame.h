@@ -15,8 +15,12 @@
 #ifndef COMPUTEPIPE_RUNNER_INPUT_FRAME
 #define COMPUTEPIPE_RUNNER_INPUT_FRAME
 
+#include <vndk/hardware_buffer.h>
+
 #include <cstdint>
 #include <functional>
+#include <utility>
+#include <vector>
 
 #include "types/Status.h"
 namespace android {
@@ -34,6 +38,9 @@ struct FrameInfo {
     PixelFormat format;
     uint32_t stride;  // In bytes
     int cameraId;
+    // When the runner received the frame, in nanoseconds of the monotonic
+    // clock, or 0 if not known.
+    int64_t arrivalTimeNs;
 };
 
 /**
@@ -50,9 +57,36 @@ struct InputFrame {
         mInfo.width = width;
         mInfo.format = format;
         mInfo.stride = stride;
+        mInfo.arrivalTimeNs = 0;
         mDataPtr = ptr;
     }
 
+    /**
+     * Take info about frame data, as kept by a copy of a frame. InputFrame
+     * does not take ownership of the data.
+     */
+    explicit InputFrame(const FrameInfo& info, const uint8_t* ptr) : mInfo(info), mDataPtr(ptr) {
+    }
+
+    /**
+     * Take info about a frame that lives in a hardware buffer, which consumers
+     * may read in place instead of copying. ptr maps the buffer for reading.
+     * The deleter is invoked with ptr once the frame is destroyed, after which
+     * the producer may reuse the buffer.
+     */
+    explicit InputFrame(uint32_t height, uint32_t width, PixelFormat format, uint32_t stride,
+                        const uint8_t* ptr, AHardwareBuffer* buffer, FrameDeleter deleter)
+        : InputFrame(height, width, format, stride, ptr) {
+        mHardwareBuffer = buffer;
+        mDeleter = std::move(deleter);
+    }
+
+    ~InputFrame() {
+        if (mDeleter) {
+            mDeleter(const_cast<uint8_t*>(mDataPtr));
+        }
+    }
+
     /**
      * This is an unsafe method, that a consumer should use to copy the
      * underlying frame data
@@ -63,6 +97,16 @@ struct InputFrame {
     FrameInfo getFrameInfo() const {
         return mInfo;
     }
+    void setArrivalTime(int64_t arrivalTimeNs) {
+        mInfo.arrivalTimeNs = arrivalTimeNs;
+    }
+    /**
+     * The hardware buffer holding the frame, or nullptr if the frame is only
+     * available through getFramePtr(). Valid as long as the frame is.
+     */
+    AHardwareBuffer* getHardwareBuffer() const {
+        return mHardwareBuffer;
+    }
     /**
      * Delete evil constructors
      */
@@ -76,8 +120,15 @@ struct InputFrame {
     FrameInfo mInfo;
     FrameDeleter mDeleter;
     const uint8_t* mDataPtr;
+    AHardwareBuffer* mHardwareBuffer = nullptr;
 };
 
+/**
+ * Frames of several input streams that were captured together, each with the
+ * id of its input stream. The frames are owned by the caller.
+ */
+using InputFrameSet = std::vector<std::pair<int, const InputFrame*>>;
+
 }  // namespace runner
 }  // namespace computepipe
 }  // namespace automotive
@@ -17,6 +17,9 @@
 
 #include <vndk/hardware_buffer.h>
 
+#include <cstddef>
+#include <cstdint>
+
 #include "types/Status.h"
 
 namespace android {
@@ -24,11 +27,21 @@ namespace automotive {
 namespace computepipe {
 namespace runner {
 
-// Returns number of bytes per pixel for given format.
+// Returns number of bytes per pixel for given format. For YUV formats this is
+// the size of a luma sample.
 int numBytesPerPixel(AHardwareBuffer_Format format);
 
+// All YUV formats map to the flexible YUV 4:2:0 format, whose plane layout is
+// up to the allocator.
 AHardwareBuffer_Format PixelFormatToHardwareBufferFormat(PixelFormat pixelFormat);
 
+// Whether the format has separate luma and chroma planes.
+bool isYuvFormat(PixelFormat pixelFormat);
+
+// Returns the number of bytes of a frame laid out as described by PixelFormat,
+// whose rows, or luma rows or plane rows, are stride bytes apart.
+size_t frameSizeBytes(PixelFormat pixelFormat, uint32_t stride, uint32_t height);
+
 }  // namespace runner
 }  // namespace computepipe
 }  // namespace automotive
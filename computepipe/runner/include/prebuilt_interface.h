@@ -22,6 +22,8 @@
 
 #define COMPUTEPIPE_RUNNER(a) PrebuiltComputepipeRunner_##a
 
+struct AHardwareBuffer;
+
 extern "C" {
 
 // Enum value to report the error code for function calls.
@@ -39,7 +41,21 @@ enum PrebuiltComputepipeRunner_PixelDataFormat {
     RGB = 0,
     RGBA = 1,
     GRAY = 2,
-    PIXEL_DATA_FORMAT_MAX = 3,
+    NV12 = 3,
+    NV21 = 4,
+    YUV420 = 5,
+    RGB_PLANAR_FLOAT = 6,
+    PIXEL_DATA_FORMAT_MAX = 7,
+};
+
+// Pixel data of one input stream, as passed to SetInputStreamsPixelData.
+struct PrebuiltComputepipeRunner_PixelData {
+    int stream_index;
+    const uint8_t* pixels;
+    int width;
+    int height;
+    int step;
+    int format;
 };
 
 // Gets the version of the library. The runner should check if the version of
@@ -67,6 +83,16 @@ PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(GetSupportedGraphConfigs)
 PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(UpdateGraphConfig)(
     const unsigned char* graph_config, size_t graph_config_size);
 
+// Sets a directory in which the graph can keep state that is costly to rebuild,
+// such as loaded models or compiled GPU kernels, to start faster on later runs.
+// The directory persists across runs and reboots and belongs to this version of
+// the graph alone: the runner empties it when the version reported by
+// GetVersion changes, and may remove it when the cache runs out of space, so
+// the graph has to cope with finding it empty. It is called once after the
+// library is loaded and before UpdateGraphConfig. This function is optional;
+// prebuilts that do not export it start from scratch on every run.
+PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(SetCacheDirectory)(const char* cache_dir);
+
 // Sets the stream contents. This can only be used after the graph has started
 // running successfully. The contents of this stream are typically a serialized
 // proto and would be deserialized and fed into the graph.
@@ -81,6 +107,15 @@ PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(SetInputStreamPixelData)(
     int stream_index, int64_t timestamp, const uint8_t* pixels, int width, int height, int step,
     int format);
 
+// Sets pixel data on several input streams at once, for frames that were
+// captured together, such as those of synchronized cameras. The graph gets
+// them as one set with a common timestamp instead of pairing them up itself.
+// As with SetInputStreamPixelData, the pixel data should be copied within this
+// function. This function is optional; for prebuilts that do not export it the
+// runner sets each frame of a set through SetInputStreamPixelData.
+PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(SetInputStreamsPixelData)(
+    int64_t timestamp, const PrebuiltComputepipeRunner_PixelData* frames, int num_frames);
+
 // Sets a callback function for when a packet is generated. Note that a c-style
 // function needs to be passed as no object context is being passed around here.
 // The runner would be responsible for using the buffer provided in the callback
@@ -98,6 +133,38 @@ PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(SetOutputPixelStreamCallb
     void (*streamCallback)(void* cookie, int stream_index, int64_t timestamp, const uint8_t* pixels,
                            int width, int height, int step, int format));
 
+// Sets callback functions through which the graph renders pixel output
+// directly into hardware buffers owned by the runner, instead of passing
+// pixels to the output pixel stream callback for the runner to copy. This
+// function is optional; for prebuilts that do not export it the runner only
+// uses the output pixel stream callback.
+//
+// acquireCallback lends the graph an empty buffer of the given size and
+// format, or returns null if the stream has too many packets in flight, in
+// which case the graph should drop the frame. The graph may write the buffer
+// through AHardwareBuffer_lock or render into it on the GPU, and finds its
+// stride with AHardwareBuffer_describe. Every acquired buffer has to be handed
+// back by exactly one call to either submitCallback, which sends it out as the
+// next packet of the stream, or releaseCallback, which discards it. All writes
+// to the buffer must have completed when submitCallback is called.
+PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(SetOutputPixelBufferCallbacks)(
+    AHardwareBuffer* (*acquireCallback)(void* cookie, int stream_index, int width, int height,
+                                        int format),
+    void (*submitCallback)(void* cookie, int stream_index, int64_t timestamp,
+                           AHardwareBuffer* buffer),
+    void (*releaseCallback)(void* cookie, int stream_index, AHardwareBuffer* buffer));
+
+// Tells the graph that the clients of a pixel output stream have run out of
+// room for its packets, because they are slow to return them, or that they
+// have room again. While a stream is congested, the runner drops the packets
+// output on it, or blocks the output call for streams that may not drop any, so
+// the graph may skip the work of producing them until the stream clears. Called
+// from the threads on which clients return packets, only when the state
+// changes. This function is optional; prebuilts that do not export it keep
+// producing every output.
+PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(SetOutputStreamBackpressure)(
+    int stream_index, bool congested);
+
 // Sets a callback function for when the graph terminates.
 PrebuiltComputepipeRunner_ErrorCode COMPUTEPIPE_RUNNER(SetGraphTerminationCallback)(
     void (*terminationCallback)(void* cookie, const unsigned char* termination_message,
@@ -0,0 +1,138 @@
+// Copyright 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ChangeDetector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+#include "PixelFormatUtils.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+namespace {
+
+// Side of the square patch averaged at the center of each grid cell, which
+// keeps sensor noise from passing for a change.
+constexpr uint32_t kPatchSize = 4;
+
+}  // namespace
+
+ChangeDetector::ChangeDetector(const proto::ChangeDetectionConfig& config)
+    : mGridWidth(std::max(config.grid_width(), 1)),
+      mGridHeight(std::max(config.grid_height(), 1)),
+      mLumaThreshold(config.luma_threshold()),
+      mMinChangedPatches(std::max<uint32_t>(
+              std::ceil(config.changed_fraction() * mGridWidth * mGridHeight),
+              1)),
+      mMaxSkipIntervalNs(static_cast<int64_t>(config.max_skip_interval_ms()) * 1000000) {
+    mSamples.resize(mGridWidth * mGridHeight);
+}
+
+bool ChangeDetector::hasChanged(const InputFrame& frame, int64_t arrivalTimeNs) {
+    if (!sampleLuma(frame)) {
+        // Nothing to compare, so every frame goes to the graph.
+        mFramesPassed++;
+        return true;
+    }
+
+    bool changed = mReference.empty() || (mMaxSkipIntervalNs > 0 &&
+                                          arrivalTimeNs - mReferenceTimeNs >= mMaxSkipIntervalNs);
+    if (!changed) {
+        uint32_t changedPatches = 0;
+        for (size_t i = 0; i < mSamples.size() && changedPatches < mMinChangedPatches; i++) {
+            if (std::abs(mSamples[i] - mReference[i]) > mLumaThreshold) {
+                changedPatches++;
+            }
+        }
+        changed = changedPatches >= mMinChangedPatches;
+    }
+
+    if (!changed) {
+        mFramesSkipped++;
+        return false;
+    }
+
+    // Slow changes, like the light of dusk, add up until they count.
+    mReference.swap(mSamples);
+    mSamples.resize(mReference.size());
+    mReferenceTimeNs = arrivalTimeNs;
+    mFramesPassed++;
+    return true;
+}
+
+void ChangeDetector::reset() {
+    mReference.clear();
+}
+
+std::string ChangeDetector::getDebugInfo() const {
+    std::ostringstream info;
+    info << "passed " << mFramesPassed << ", skipped as unchanged " << mFramesSkipped;
+    return info.str();
+}
+
+bool ChangeDetector::sampleLuma(const InputFrame& frame) {
+    const FrameInfo info = frame.getFrameInfo();
+    const uint8_t* data = frame.getFramePtr();
+    uint32_t bytesPerPixel = 0;
+    switch (info.format) {
+        case PixelFormat::RGBA:
+            bytesPerPixel = 4;
+            break;
+        case PixelFormat::RGB:
+            bytesPerPixel = 3;
+            break;
+        default:
+            // The luma plane of YUV frames comes first.
+            if (info.format != PixelFormat::GRAY && !isYuvFormat(info.format)) {
+                return false;
+            }
+            bytesPerPixel = 1;
+            break;
+    }
+    if (data == nullptr || info.width < mGridWidth * kPatchSize ||
+        info.height < mGridHeight * kPatchSize) {
+        return false;
+    }
+
+    for (uint32_t gy = 0; gy < mGridHeight; gy++) {
+        uint32_t top = (gy * 2 + 1) * info.height / (mGridHeight * 2) - kPatchSize / 2;
+        for (uint32_t gx = 0; gx < mGridWidth; gx++) {
+            uint32_t left = (gx * 2 + 1) * info.width / (mGridWidth * 2) - kPatchSize / 2;
+            uint32_t sum = 0;
+            for (uint32_t y = top; y < top + kPatchSize; y++) {
+                const uint8_t* pixel = data + y * info.stride + left * bytesPerPixel;
+                for (uint32_t x = 0; x < kPatchSize; x++, pixel += bytesPerPixel) {
+                    // BT.601 luma in 8 bit fixed point.
+                    sum += bytesPerPixel == 1
+                                   ? pixel[0]
+                                   : (77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2]) >> 8;
+                }
+            }
+            mSamples[gy * mGridWidth + gx] = sum / (kPatchSize * kPatchSize);
+        }
+    }
+    return true;
+}
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
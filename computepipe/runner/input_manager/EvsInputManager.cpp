@@ -18,14 +18,18 @@
 #include <shared_mutex>
 #include <string>
 #include <thread>
+#include <utility>
+
+#include <gpupolicy/GpuPolicy.h>
+#include <system/graphics.h>
+#include <vndk/hardware_buffer.h>
 
-#include "AnalyzeUseCase.h"
 #include "BaseAnalyzeCallback.h"
 #include "InputConfig.pb.h"
 #include "InputEngineInterface.h"
 #include "Options.pb.h"
+#include "SharedCameraStream.h"
 
-using ::android::automotive::evs::support::AnalyzeUseCase;
 using ::android::automotive::evs::support::BaseAnalyzeCallback;
 
 namespace android {
@@ -33,19 +37,109 @@ namespace automotive {
 namespace computepipe {
 namespace runner {
 namespace input_manager {
+namespace {
+
+// Cameras stream RGBA frames, unless they say otherwise.
+PixelFormat getPixelFormat(const ::android::automotive::evs::support::Frame& frame) {
+    switch (frame.format) {
+        case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+            return PixelFormat::NV21;
+        default:
+            return PixelFormat::RGBA;
+    }
+}
+
+}  // namespace
+
+AnalyzeCallback::AnalyzeCallback(const proto::InputStreamConfig& config,
+                                 std::shared_ptr<FrameSynchronizer> synchronizer,
+                                 std::unique_ptr<GpuPreprocessor> preprocessor)
+    : mInputStreamId(config.stream_id()),
+      mSynchronizer(std::move(synchronizer)),
+      mPreprocessor(std::move(preprocessor)) {
+    if (config.has_change_detection()) {
+        mChangeDetector = std::make_unique<ChangeDetector>(config.change_detection());
+    }
+    if (config.drop_policy() != proto::InputStreamConfig::BLOCK) {
+        mFrameQueue = std::make_unique<InputFrameQueue>(
+                config, [this](int64_t timestamp, const InputFrame& frame) {
+                    dispatchFrame(timestamp, frame);
+                });
+    }
+}
 
 void AnalyzeCallback::analyze(const ::android::automotive::evs::support::Frame& frame) {
     std::shared_lock lock(mEngineInterfaceLock);
     if (mInputEngineInterface != nullptr) {
-        auto time_point = std::chrono::system_clock::now();
-        int64_t timestamp = std::chrono::time_point_cast<std::chrono::microseconds>(time_point)
-                                .time_since_epoch()
-                                .count();
+        // Frames are stamped with when the camera delivered them, on the
+        // monotonic clock, so that wall clock changes do not reorder them.
+        int64_t arrivalTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch())
+                                        .count();
+        int64_t timestamp = (frame.timestamp != 0 ? frame.timestamp : arrivalTimeNs) / 1000;
         // Stride for hardware buffers is specified in pixels whereas for
         // InputFrame, it is specified in bytes. We therefore need to multiply
-        // the stride by 4 for an RGBA frame.
-        InputFrame inputFrame(frame.height, frame.width, PixelFormat::RGBA, frame.stride * 4,
-                              frame.data);
+        // the stride by 4 for an RGBA frame. YUV frames are handed on as they
+        // are, for graphs that read them without converting them first.
+        PixelFormat format = getPixelFormat(frame);
+        uint32_t stride = format == PixelFormat::RGBA ? frame.stride * 4 : frame.stride;
+        if (mChangeDetector != nullptr &&
+            !mChangeDetector->hasChanged(
+                    InputFrame(frame.height, frame.width, format, stride, frame.data),
+                    arrivalTimeNs)) {
+            // Skipped before any copy or GPU work.
+            return;
+        }
+        if (mPreprocessor != nullptr) {
+            // The tensor is ours until the next frame, so it goes on as a
+            // copied frame would.
+            const uint8_t* tensor = mPreprocessor->process(frame);
+            if (tensor == nullptr) {
+                return;
+            }
+            InputFrame inputFrame(mPreprocessor->getHeight(), mPreprocessor->getWidth(),
+                                  mPreprocessor->getFormat(), mPreprocessor->getStride(),
+                                  tensor);
+            inputFrame.setArrivalTime(arrivalTimeNs);
+            if (mFrameQueue != nullptr) {
+                mFrameQueue->push(timestamp, inputFrame);
+            } else if (mSynchronizer != nullptr) {
+                mSynchronizer->push(mInputStreamId, timestamp, inputFrame);
+            } else {
+                mInputEngineInterface->dispatchInputFrame(mInputStreamId, timestamp, inputFrame);
+            }
+            return;
+        }
+        if (mFrameQueue != nullptr) {
+            // The queue copies the frame, so the camera gets its buffer back
+            // without waiting for the graph.
+            InputFrame inputFrame(frame.height, frame.width, format, stride, frame.data);
+            inputFrame.setArrivalTime(arrivalTimeNs);
+            mFrameQueue->push(timestamp, inputFrame);
+            return;
+        }
+        if (mSynchronizer != nullptr) {
+            // The synchronizer copies the frame to hold it for its match.
+            InputFrame inputFrame(frame.height, frame.width, format, stride, frame.data);
+            inputFrame.setArrivalTime(arrivalTimeNs);
+            mSynchronizer->push(mInputStreamId, timestamp, inputFrame);
+            return;
+        }
+        if (frame.hardwareBuffer == nullptr) {
+            InputFrame inputFrame(frame.height, frame.width, format, stride, frame.data);
+            inputFrame.setArrivalTime(arrivalTimeNs);
+            mInputEngineInterface->dispatchInputFrame(mInputStreamId, timestamp, inputFrame);
+            return;
+        }
+
+        // The frame is the camera buffer itself, which goes back to the camera
+        // once we return. The input frame holds its own reference to the buffer
+        // for as long as it lives.
+        AHardwareBuffer* buffer = frame.hardwareBuffer;
+        AHardwareBuffer_acquire(buffer);
+        InputFrame inputFrame(frame.height, frame.width, format, stride, frame.data, buffer,
+                              [buffer](uint8_t[]) { AHardwareBuffer_release(buffer); });
+        inputFrame.setArrivalTime(arrivalTimeNs);
         mInputEngineInterface->dispatchInputFrame(mInputStreamId, timestamp, inputFrame);
     }
 }
@@ -53,6 +147,47 @@ void AnalyzeCallback::analyze(const ::android::automotive::evs::support::Frame&
 void AnalyzeCallback::setEngineInterface(std::shared_ptr<InputEngineInterface> inputEngineInterface) {
     std::lock_guard lock(mEngineInterfaceLock);
     mInputEngineInterface = inputEngineInterface;
+    if (mChangeDetector != nullptr) {
+        // A new run starts with a frame, however static the scene.
+        mChangeDetector->reset();
+    }
+}
+
+void AnalyzeCallback::startQueue() {
+    if (mFrameQueue != nullptr) {
+        mFrameQueue->start();
+    }
+}
+
+void AnalyzeCallback::stopQueue(bool flush) {
+    if (mFrameQueue != nullptr) {
+        mFrameQueue->stop(flush);
+    }
+}
+
+std::string AnalyzeCallback::getDebugInfo() const {
+    std::string debugInfo = mFrameQueue != nullptr ? mFrameQueue->getDebugInfo() : "";
+    if (mPreprocessor != nullptr) {
+        debugInfo += "input stream " + std::to_string(mInputStreamId) + ": " +
+                     mPreprocessor->getDebugInfo() + "\n";
+    }
+    if (mChangeDetector != nullptr) {
+        debugInfo += "input stream " + std::to_string(mInputStreamId) + ": " +
+                     mChangeDetector->getDebugInfo() + "\n";
+    }
+    return debugInfo;
+}
+
+void AnalyzeCallback::dispatchFrame(int64_t timestamp, const InputFrame& frame) {
+    std::shared_lock lock(mEngineInterfaceLock);
+    if (mInputEngineInterface == nullptr) {
+        return;
+    }
+    if (mSynchronizer != nullptr) {
+        mSynchronizer->push(mInputStreamId, timestamp, frame);
+    } else {
+        mInputEngineInterface->dispatchInputFrame(mInputStreamId, timestamp, frame);
+    }
 }
 
 EvsInputManager::EvsInputManager(const proto::InputConfig& inputConfig,
@@ -60,6 +195,11 @@ EvsInputManager::EvsInputManager(const proto::InputConfig& inputConfig,
     : mInputEngineInterface(inputEngineInterface), mInputConfig(inputConfig) {
 }
 
+EvsInputManager::~EvsInputManager() {
+    // Camera streams outlive us if other graphs read the same cameras.
+    stopCameras();
+}
+
 std::unique_ptr<EvsInputManager> EvsInputManager::createEvsInputManager(
     const proto::InputConfig& inputConfig,
     std::shared_ptr<InputEngineInterface> inputEngineInterface) {
@@ -72,6 +212,13 @@ std::unique_ptr<EvsInputManager> EvsInputManager::createEvsInputManager(
 }
 
 Status EvsInputManager::initializeCameras() {
+    if (mInputConfig.sync_window_us() > 0 && mInputConfig.input_stream_size() > 1) {
+        std::shared_ptr<InputEngineInterface> engine = mInputEngineInterface;
+        mSynchronizer = std::make_shared<FrameSynchronizer>(
+                mInputConfig, [engine](int64_t timestamp, const InputFrameSet& frames) {
+                    engine->dispatchInputFrames(timestamp, frames);
+                });
+    }
     for (int i = 0; i < mInputConfig.input_stream_size(); i++) {
         // Verify that the stream type specified is a camera stream which is necessary for evs
         // manager.
@@ -80,25 +227,38 @@ Status EvsInputManager::initializeCameras() {
             return Status::INVALID_ARGUMENT;
         }
         const std::string& cameraId = mInputConfig.input_stream(i).cam_config().cam_id();
-        std::unique_ptr<AnalyzeCallback> analyzeCallback =
-            std::make_unique<AnalyzeCallback>(mInputConfig.input_stream(i).stream_id());
-        AnalyzeUseCase analyzeUseCase =
-            AnalyzeUseCase::createDefaultUseCase(cameraId, analyzeCallback.get());
-        mAnalyzeCallbacks.push_back(std::move(analyzeCallback));
-
         int streamId = mInputConfig.input_stream(i).stream_id();
-        auto [it, result] = mEvsUseCases.try_emplace(std::move(streamId),
-                                                     std::move(analyzeUseCase));
+        auto [it, result] = mCameraStreams.try_emplace(streamId,
+                                                       SharedCameraStream::get(cameraId));
         if (!result) {
             // Multiple camera streams found to have the same camera id.
             ALOGE("Multiple camera streams have the same stream id.");
             return Status::INVALID_ARGUMENT;
         }
+        std::unique_ptr<GpuPreprocessor> preprocessor;
+        if (mInputConfig.input_stream(i).has_preprocess()) {
+            preprocessor =
+                    std::make_unique<GpuPreprocessor>(mInputConfig.input_stream(i).preprocess());
+            Status status = preprocessor->initialize();
+            if (status != Status::SUCCESS) {
+                ALOGE("Unable to preprocess the frames of input stream %d.", streamId);
+                return status;
+            }
+        }
+        mAnalyzeCallbacks.emplace(streamId, std::make_unique<AnalyzeCallback>(
+                                                    mInputConfig.input_stream(i), mSynchronizer,
+                                                    std::move(preprocessor)));
     }
 
     return Status::SUCCESS;
 }
 
+void EvsInputManager::stopCameras() {
+    for (auto& [streamId, cameraStream] : mCameraStreams) {
+        cameraStream->stop(mAnalyzeCallbacks[streamId].get());
+    }
+}
+
 Status EvsInputManager::handleExecutionPhase(const RunnerEvent& e) {
     // Starting execution cannot be stopped in between. handleStopImmediate needs to be called.
     if (e.isAborted()) {
@@ -107,15 +267,15 @@ Status EvsInputManager::handleExecutionPhase(const RunnerEvent& e) {
         return Status::SUCCESS;
     }
 
-    if (mEvsUseCases.empty()) {
+    if (mCameraStreams.empty()) {
         ALOGE("No evs use cases configured. Verify that handleConfigPhase has been called");
         return Status::ILLEGAL_STATE;
     }
 
     // Start all the video streams.
     bool successfullyStartedAllCameras = true;
-    for (auto& [streamId, evsUseCase] : mEvsUseCases) {
-        if (!evsUseCase.startVideoStream()) {
+    for (auto& [streamId, cameraStream] : mCameraStreams) {
+        if (!cameraStream->start(mAnalyzeCallbacks[streamId].get())) {
             successfullyStartedAllCameras = false;
             ALOGE("Unable to successfully start all cameras");
             break;
@@ -124,15 +284,14 @@ Status EvsInputManager::handleExecutionPhase(const RunnerEvent& e) {
 
     // If not all video streams have started successfully, stop the streams.
     if (!successfullyStartedAllCameras) {
-        for (auto& [streamId, evsUseCase] : mEvsUseCases) {
-            evsUseCase.stopVideoStream();
-        }
+        stopCameras();
         return Status::INTERNAL_ERROR;
     }
 
     // Set the input to engine interface for callbacks only when all the streams have successfully
     // started. This prevents any callback from going out unless all of the streams have started.
-    for (auto& analyzeCallback : mAnalyzeCallbacks) {
+    for (auto& [streamId, analyzeCallback] : mAnalyzeCallbacks) {
+        analyzeCallback->startQueue();
         analyzeCallback->setEngineInterface(mInputEngineInterface);
     }
 
@@ -151,12 +310,14 @@ Status EvsInputManager::handleStopImmediatePhase(const RunnerEvent& e) {
 
     // Reset all input engine interfaces so that callbacks stop going out even if there are evs
     // frames in flux.
-    for (auto& analyzeCallback : mAnalyzeCallbacks) {
+    for (auto& [streamId, analyzeCallback] : mAnalyzeCallbacks) {
+        analyzeCallback->stopQueue(/* flush = */ false);
         analyzeCallback->setEngineInterface(nullptr);
     }
 
-    for (auto& [streamId, evsUseCase] : mEvsUseCases) {
-        evsUseCase.stopVideoStream();
+    stopCameras();
+    if (mSynchronizer != nullptr) {
+        mSynchronizer->reset();
     }
 
     return Status::SUCCESS;
@@ -172,8 +333,14 @@ Status EvsInputManager::handleStopWithFlushPhase(const RunnerEvent& e) {
         return Status::SUCCESS;
     }
 
-    for (auto& [streamId, evsUseCase] : mEvsUseCases) {
-        evsUseCase.stopVideoStream();
+    stopCameras();
+    // Frames that were queued before the cameras stopped still go to the graph.
+    for (auto& [streamId, analyzeCallback] : mAnalyzeCallbacks) {
+        analyzeCallback->stopQueue(/* flush = */ true);
+    }
+    // Frames still without a match have nothing left to be paired with.
+    if (mSynchronizer != nullptr) {
+        mSynchronizer->reset();
     }
     return Status::SUCCESS;
 }
@@ -183,11 +350,25 @@ Status EvsInputManager::handleResetPhase(const RunnerEvent& e) {
         ALOGE("Unable to abort reset.");
         return Status::INVALID_ARGUMENT;
     }
-    mEvsUseCases.clear();
+    stopCameras();
+    mCameraStreams.clear();
     mAnalyzeCallbacks.clear();
+    mSynchronizer = nullptr;
     return Status::SUCCESS;
 }
 
+std::string EvsInputManager::getDebugInfo() {
+    std::string debugInfo;
+    for (auto& [streamId, analyzeCallback] : mAnalyzeCallbacks) {
+        debugInfo += analyzeCallback->getDebugInfo();
+    }
+    if (mSynchronizer != nullptr) {
+        debugInfo += mSynchronizer->getDebugInfo();
+    }
+    debugInfo += ::android::automotive::evs::gpupolicy::dumpGpuPolicies();
+    return debugInfo;
+}
+
 }  // namespace input_manager
 }  // namespace runner
 }  // namespace computepipe
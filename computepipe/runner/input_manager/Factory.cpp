@@ -14,6 +14,7 @@
 
 #include "EvsInputManager.h"
 #include "InputManager.h"
+#include "VideoFileInputManager.h"
 
 namespace android {
 namespace automotive {
@@ -29,11 +30,20 @@ enum InputManagerType {
 };
 
 // Helper function to determine the type of input manager to be created from the
-// input config.
-// TODO(b/147803315): Implement the actual algorithm to determine the input manager to be
-// used. Right now, only EVS manager is enabled, so that is used.
-InputManagerType getInputManagerType(const proto::InputConfig& /* inputConfig */) {
-    return InputManagerType::EVS;
+// input config. The type of the first stream decides, and the input manager
+// rejects configs that mix in other types.
+InputManagerType getInputManagerType(const proto::InputConfig& inputConfig) {
+    if (inputConfig.input_stream_size() == 0) {
+        return InputManagerType::EVS;
+    }
+    switch (inputConfig.input_stream(0).type()) {
+        case proto::InputStreamConfig_InputType_IMAGE_FILES:
+            return InputManagerType::IMAGES;
+        case proto::InputStreamConfig_InputType_VIDEO_FILE:
+            return InputManagerType::VIDEO;
+        default:
+            return InputManagerType::EVS;
+    }
 }
 
 }  // namespace
@@ -43,6 +53,9 @@ std::unique_ptr<InputManager> InputManagerFactory::createInputManager(
     switch (inputManagerType) {
         case InputManagerType::EVS:
             return EvsInputManager::createEvsInputManager(config, inputEngineInterface);
+        case InputManagerType::VIDEO:
+            return VideoFileInputManager::createVideoFileInputManager(config,
+                                                                      inputEngineInterface);
         default:
             return nullptr;
     }
@@ -0,0 +1,143 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "FrameSynchronizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <utility>
+
+#include "PixelFormatUtils.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+FrameSynchronizer::FrameSynchronizer(const proto::InputConfig& config, SetHandler&& handler)
+    : mSyncWindow(std::max(config.sync_window_us(), 0)), mHandler(std::move(handler)) {
+    for (const proto::InputStreamConfig& stream : config.input_stream()) {
+        mSlots[stream.stream_id()];
+    }
+}
+
+void FrameSynchronizer::push(int streamId, int64_t timestamp, const InputFrame& frame) {
+    FrameInfo info = frame.getFrameInfo();
+    std::vector<uint8_t> data;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mSlots.find(streamId) == mSlots.end()) {
+            mFramesDropped++;
+            return;
+        }
+        if (!mSpareBuffers.empty()) {
+            data = std::move(mSpareBuffers.back());
+            mSpareBuffers.pop_back();
+        }
+    }
+
+    // The frame goes back to its producer once we return, so copy it. This
+    // happens outside of the lock, to not hold up the other streams.
+    data.resize(frameSizeBytes(info.format, info.stride, info.height));
+    memcpy(data.data(), frame.getFramePtr(), data.size());
+
+    std::unique_lock<std::mutex> lock(mLock);
+    Slot& slot = mSlots[streamId];
+    if (slot.filled) {
+        mFramesDropped++;
+    }
+    std::swap(slot.data, data);
+    slot.filled = true;
+    slot.timestamp = timestamp;
+    slot.info = info;
+    if (!data.empty()) {
+        mSpareBuffers.push_back(std::move(data));
+    }
+    if (!matchSlots()) {
+        return;
+    }
+
+    // Take the delivery lock before letting go of the slots, so that a set
+    // completed meanwhile cannot overtake this one.
+    std::lock_guard<std::mutex> deliveryLock(mDeliveryLock);
+    mDeliverySlots.resize(mSlots.size());
+    int64_t setTimestamp = 0;
+    size_t i = 0;
+    for (auto& [id, heldSlot] : mSlots) {
+        setTimestamp = std::max(setTimestamp, heldSlot.timestamp);
+        std::swap(mDeliverySlots[i++], heldSlot);
+        heldSlot.filled = false;
+    }
+    lock.unlock();
+
+    std::deque<InputFrame> frames;
+    InputFrameSet frameSet;
+    frameSet.reserve(mDeliverySlots.size());
+    i = 0;
+    for (const auto& entry : mSlots) {
+        const Slot& heldSlot = mDeliverySlots[i++];
+        frames.emplace_back(heldSlot.info, heldSlot.data.data());
+        frameSet.emplace_back(entry.first, &frames.back());
+    }
+    mHandler(setTimestamp, frameSet);
+    mSetsDelivered++;
+}
+
+bool FrameSynchronizer::matchSlots() {
+    while (true) {
+        Slot* oldest = nullptr;
+        int64_t newest = 0;
+        for (auto& [id, slot] : mSlots) {
+            if (!slot.filled) {
+                return false;
+            }
+            if (oldest == nullptr || slot.timestamp < oldest->timestamp) {
+                oldest = &slot;
+            }
+            newest = std::max(newest, slot.timestamp);
+        }
+        if (oldest == nullptr || newest - oldest->timestamp <= mSyncWindow) {
+            return oldest != nullptr;
+        }
+        oldest->filled = false;
+        mFramesDropped++;
+    }
+}
+
+void FrameSynchronizer::reset() {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto& [id, slot] : mSlots) {
+        if (slot.filled) {
+            slot.filled = false;
+            mFramesDropped++;
+        }
+    }
+}
+
+std::string FrameSynchronizer::getDebugInfo() const {
+    std::ostringstream info;
+    info << "synchronized input streams: delivered " << mSetsDelivered << " sets, dropped "
+         << mFramesDropped << " frames\n";
+    return info.str();
+}
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
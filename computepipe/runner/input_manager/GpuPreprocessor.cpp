@@ -0,0 +1,545 @@
+// Copyright 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define EGL_EGLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+
+#include "GpuPreprocessor.h"
+
+#include <GLES2/gl2ext.h>
+#include <gpupolicy/GpuPolicy.h>
+#include <log/log.h>
+#include <system/graphics.h>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+namespace {
+
+using ::android::automotive::evs::support::Frame;
+
+namespace gpupolicy = ::android::automotive::evs::gpupolicy;
+
+const char kVertexShaderSource[] = R"(#version 300 es
+layout(location = 0) in vec4 pos;
+void main() {
+    gl_Position = pos;
+}
+)";
+
+// Each fragment writes four bytes of the tensor. Row y of the framebuffer is
+// row y of the tensor and of the crop rectangle, as V=0 is the first row in
+// memory of both the source texture and of what glReadPixels returns.
+const char kFragmentShaderBody[] = R"(
+precision highp float;
+precision highp int;
+uniform SAMPLER tex;
+uniform vec4 crop;      // Origin and size of the crop rectangle, in texture coordinates
+uniform ivec2 size;     // Of the tensor, in pixels
+uniform vec3 mean;
+uniform vec3 invStd;
+out vec4 color;
+
+vec3 sampleAt(int x, int y) {
+    vec2 pos = (vec2(x, y) + 0.5) / vec2(size);
+    return texture(tex, crop.xy + pos * crop.zw).rgb;
+}
+
+#if defined(OUTPUT_RGB)
+float byteAt(int i, int y) {
+    if (i >= size.x * 3) {
+        return 0.0;
+    }
+    vec3 rgb = sampleAt(i / 3, y);
+    int channel = i % 3;
+    return channel == 0 ? rgb.r : (channel == 1 ? rgb.g : rgb.b);
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    int i = p.x * 4;
+    color = vec4(byteAt(i, p.y), byteAt(i + 1, p.y), byteAt(i + 2, p.y), byteAt(i + 3, p.y));
+}
+#elif defined(OUTPUT_GRAY)
+float lumaAt(int x, int y) {
+    return x < size.x ? dot(sampleAt(x, y), vec3(0.299, 0.587, 0.114)) : 0.0;
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    int x = p.x * 4;
+    color = vec4(lumaAt(x, p.y), lumaAt(x + 1, p.y), lumaAt(x + 2, p.y), lumaAt(x + 3, p.y));
+}
+#else
+// The planes are stacked, and each texel holds the bytes of one little endian
+// float.
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    int plane = p.y / size.y;
+    vec3 rgb = (sampleAt(p.x, p.y - plane * size.y) - mean) * invStd;
+    float value = plane == 0 ? rgb.r : (plane == 1 ? rgb.g : rgb.b);
+    uint bits = floatBitsToUint(value);
+    color = vec4(uvec4(bits, bits >> 8, bits >> 16, bits >> 24) & 0xffu) / 255.0;
+}
+#endif
+)";
+
+// The whole framebuffer.
+const GLfloat kQuadPos[] = {-1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f,
+                            -1.0f, 1.0f,  0.0f, 1.0f, 1.0f,  0.0f};
+
+const char* getEGLError() {
+    switch (eglGetError()) {
+        case EGL_SUCCESS:
+            return "EGL_SUCCESS";
+        case EGL_NOT_INITIALIZED:
+            return "EGL_NOT_INITIALIZED";
+        case EGL_BAD_ACCESS:
+            return "EGL_BAD_ACCESS";
+        case EGL_BAD_ALLOC:
+            return "EGL_BAD_ALLOC";
+        case EGL_BAD_ATTRIBUTE:
+            return "EGL_BAD_ATTRIBUTE";
+        case EGL_BAD_CONTEXT:
+            return "EGL_BAD_CONTEXT";
+        case EGL_BAD_CONFIG:
+            return "EGL_BAD_CONFIG";
+        case EGL_BAD_DISPLAY:
+            return "EGL_BAD_DISPLAY";
+        case EGL_BAD_MATCH:
+            return "EGL_BAD_MATCH";
+        case EGL_BAD_NATIVE_PIXMAP:
+            return "EGL_BAD_NATIVE_PIXMAP";
+        case EGL_BAD_PARAMETER:
+            return "EGL_BAD_PARAMETER";
+        case EGL_BAD_SURFACE:
+            return "EGL_BAD_SURFACE";
+        default:
+            return "Unknown EGL error";
+    }
+}
+
+GLuint loadShader(GLenum type, const std::string& source) {
+    GLuint shader = glCreateShader(type);
+    if (shader == 0) {
+        return 0;
+    }
+
+    const char* sources[] = {source.c_str()};
+    glShaderSource(shader, 1, sources, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        char log[512] = {};
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        ALOGE("Failed to compile a preprocessing shader: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint buildProgram(const std::string& fragmentSource) {
+    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, kVertexShaderSource);
+    GLuint fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentSource);
+    GLuint program = vertexShader != 0 && fragmentShader != 0 ? glCreateProgram() : 0;
+    if (program != 0) {
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            char log[512] = {};
+            glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+            ALOGE("Failed to link the preprocessing shaders: %s", log);
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    return program;
+}
+
+const char* getOutputDefine(proto::PreprocessConfig::OutputFormat format) {
+    switch (format) {
+        case proto::PreprocessConfig::GRAY:
+            return "#define OUTPUT_GRAY\n";
+        case proto::PreprocessConfig::RGB_PLANAR_FLOAT:
+            return "#define OUTPUT_FLOAT\n";
+        default:
+            return "#define OUTPUT_RGB\n";
+    }
+}
+
+// Reads one value for all three channels or one per channel.
+bool readChannelValues(const google::protobuf::RepeatedField<float>& values, GLfloat out[3]) {
+    if (values.size() == 1) {
+        out[0] = out[1] = out[2] = values.Get(0);
+    } else if (values.size() == 3) {
+        for (int i = 0; i < 3; i++) {
+            out[i] = values.Get(i);
+        }
+    } else if (values.size() != 0) {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+GpuPreprocessor::GpuPreprocessor(const proto::PreprocessConfig& config) : mConfig(config) {
+}
+
+GpuPreprocessor::~GpuPreprocessor() {
+    if (mDisplay == EGL_NO_DISPLAY) {
+        return;
+    }
+
+    if (mContext != EGL_NO_CONTEXT) {
+        if (eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+            destroyObjects();
+            eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        }
+        eglDestroyContext(mDisplay, mContext);
+    }
+    if (mSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(mDisplay, mSurface);
+    }
+    eglTerminate(mDisplay);
+}
+
+PixelFormat GpuPreprocessor::getFormat() const {
+    switch (mConfig.output_format()) {
+        case proto::PreprocessConfig::GRAY:
+            return PixelFormat::GRAY;
+        case proto::PreprocessConfig::RGB_PLANAR_FLOAT:
+            return PixelFormat::RGB_PLANAR_FLOAT;
+        default:
+            return PixelFormat::RGB;
+    }
+}
+
+Status GpuPreprocessor::initialize() {
+    if (mConfig.output_width() <= 0 || mConfig.output_height() <= 0) {
+        ALOGE("Preprocessing needs the size of its output.");
+        return Status::INVALID_ARGUMENT;
+    }
+    if (mConfig.crop_x() < 0 || mConfig.crop_y() < 0 || mConfig.crop_width() < 0 ||
+        mConfig.crop_height() < 0) {
+        ALOGE("Preprocessing crop rectangle is out of the frame.");
+        return Status::INVALID_ARGUMENT;
+    }
+    GLfloat std[3] = {1.0f, 1.0f, 1.0f};
+    if (!readChannelValues(mConfig.mean(), mMean) || !readChannelValues(mConfig.std(), std)) {
+        ALOGE("Preprocessing takes one mean and std for all channels or one per channel.");
+        return Status::INVALID_ARGUMENT;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (std[i] == 0.0f) {
+            ALOGE("Preprocessing std must not be 0.");
+            return Status::INVALID_ARGUMENT;
+        }
+        mInvStd[i] = 1.0f / std[i];
+    }
+
+    mOutputWidth = mConfig.output_width();
+    mOutputHeight = mConfig.output_height();
+    switch (mConfig.output_format()) {
+        case proto::PreprocessConfig::GRAY:
+            mFramebufferWidth = (mOutputWidth + 3) / 4;
+            mFramebufferHeight = mOutputHeight;
+            break;
+        case proto::PreprocessConfig::RGB_PLANAR_FLOAT:
+            mFramebufferWidth = mOutputWidth;
+            mFramebufferHeight = mOutputHeight * 3;
+            break;
+        default:
+            mFramebufferWidth = (mOutputWidth * 3 + 3) / 4;
+            mFramebufferHeight = mOutputHeight;
+            break;
+    }
+
+    mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (mDisplay == EGL_NO_DISPLAY) {
+        ALOGE("Failed to get the EGL display.");
+        return Status::INTERNAL_ERROR;
+    }
+    EGLint major = 3;
+    EGLint minor = 0;
+    if (!eglInitialize(mDisplay, &major, &minor)) {
+        ALOGE("Failed to initialize EGL: %s", getEGLError());
+        mDisplay = EGL_NO_DISPLAY;
+        return Status::INTERNAL_ERROR;
+    }
+
+    // We only render into our own framebuffer, so a tiny pbuffer is all the
+    // surface we need.
+    const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+            EGL_RED_SIZE,     8,               EGL_GREEN_SIZE,      8,
+            EGL_BLUE_SIZE,    8,               EGL_NONE};
+    EGLConfig eglConfig = {0};
+    EGLint numConfigs = -1;
+    eglChooseConfig(mDisplay, configAttribs, &eglConfig, 1, &numConfigs);
+    if (numConfigs != 1) {
+        ALOGE("Didn't find a suitable EGL configuration to preprocess frames.");
+        return Status::INTERNAL_ERROR;
+    }
+    const EGLint surfaceAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    mSurface = eglCreatePbufferSurface(mDisplay, eglConfig, surfaceAttribs);
+    if (mSurface == EGL_NO_SURFACE) {
+        ALOGE("eglCreatePbufferSurface failed: %s", getEGLError());
+        return Status::INTERNAL_ERROR;
+    }
+    const EGLint es3Attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    const std::vector<EGLint> contextAttribs =
+            gpupolicy::getContextAttributes(mDisplay, gpupolicy::kComponentComputePipe, es3Attribs);
+    mContext = eglCreateContext(mDisplay, eglConfig, EGL_NO_CONTEXT, contextAttribs.data());
+    if (mContext == EGL_NO_CONTEXT) {
+        ALOGE("Failed to create an OpenGL ES context: %s", getEGLError());
+        return Status::INTERNAL_ERROR;
+    }
+    gpupolicy::recordContextPriority(mDisplay, mContext, gpupolicy::kComponentComputePipe);
+    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        ALOGE("Failed to make the OpenGL ES context current: %s", getEGLError());
+        return Status::INTERNAL_ERROR;
+    }
+
+    Status status = Status::SUCCESS;
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    if (mFramebufferWidth > static_cast<uint32_t>(maxSize) ||
+        mFramebufferHeight > static_cast<uint32_t>(maxSize)) {
+        ALOGE("Preprocessing output of %ux%u is too large for the GPU.", mOutputWidth,
+              mOutputHeight);
+        status = Status::INVALID_ARGUMENT;
+    }
+
+    if (status == Status::SUCCESS) {
+        glGenTextures(1, &mTargetTexture);
+        glBindTexture(GL_TEXTURE_2D, mTargetTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, mFramebufferWidth, mFramebufferHeight);
+        glGenFramebuffers(1, &mFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               mTargetTexture, 0);
+        GLenum framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (framebufferStatus != GL_FRAMEBUFFER_COMPLETE) {
+            ALOGE("Can't render the preprocessing output, status = %x", framebufferStatus);
+            status = Status::INTERNAL_ERROR;
+        }
+    }
+
+    // Camera buffers are sampled through an external texture and copied
+    // frames through a plain one.
+    if (status == Status::SUCCESS && (getProgram(true) == 0 || getProgram(false) == 0)) {
+        status = Status::INTERNAL_ERROR;
+    }
+    if (status == Status::SUCCESS) {
+        glGenTextures(1, &mSourceTexture);
+        glGenTextures(1, &mUploadTexture);
+        mOutput.resize(static_cast<size_t>(getStride()) * mFramebufferHeight);
+    } else {
+        destroyObjects();
+    }
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    if (status == Status::SUCCESS) {
+        ALOGI("Frames are preprocessed on the GPU into %ux%u tensors.", mOutputWidth,
+              mOutputHeight);
+    }
+    return status;
+}
+
+GLuint GpuPreprocessor::getProgram(bool external) {
+    GLuint& program = external ? mExternalProgram : mUploadProgram;
+    if (program == 0) {
+        std::string source = "#version 300 es\n";
+        if (external) {
+            source += "#extension GL_OES_EGL_image_external_essl3 : require\n"
+                      "#define SAMPLER samplerExternalOES\n";
+        } else {
+            source += "#define SAMPLER sampler2D\n";
+        }
+        source += getOutputDefine(mConfig.output_format());
+        source += kFragmentShaderBody;
+        program = buildProgram(source);
+    }
+    return program;
+}
+
+bool GpuPreprocessor::bindSource(const Frame& frame, GLenum* target) {
+    if (frame.hardwareBuffer != nullptr) {
+        // The camera buffer is sampled in place, and the external sampler
+        // converts YUV frames to RGB.
+        EGLClientBuffer clientBuffer = eglGetNativeClientBufferANDROID(frame.hardwareBuffer);
+        const EGLint imageAttribs[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+        EGLImageKHR image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
+                                              EGL_NATIVE_BUFFER_ANDROID, clientBuffer,
+                                              imageAttribs);
+        if (image == EGL_NO_IMAGE_KHR) {
+            ALOGE("Failed to import a camera buffer: %s", getEGLError());
+            return false;
+        }
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, mSourceTexture);
+        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, static_cast<GLeglImageOES>(image));
+        // The texture keeps the buffer for as long as it is bound to it.
+        eglDestroyImageKHR(mDisplay, image);
+        *target = GL_TEXTURE_EXTERNAL_OES;
+        return true;
+    }
+
+    if (frame.format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {
+        if (!mLoggedUnsupportedFrame) {
+            ALOGE("Only camera buffers of YUV frames can be preprocessed.");
+            mLoggedUnsupportedFrame = true;
+        }
+        return false;
+    }
+
+    // Copied frames are RGBA, with the stride in pixels.
+    glBindTexture(GL_TEXTURE_2D, mUploadTexture);
+    if (frame.width != mUploadWidth || frame.height != mUploadHeight) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, frame.width, frame.height, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        mUploadWidth = frame.width;
+        mUploadHeight = frame.height;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, frame.stride);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.width, frame.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                    frame.data);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    *target = GL_TEXTURE_2D;
+    return true;
+}
+
+const uint8_t* GpuPreprocessor::process(const Frame& frame) {
+    if (mContext == EGL_NO_CONTEXT || mOutput.empty()) {
+        return nullptr;
+    }
+
+    // The whole frame unless a crop rectangle is given.
+    uint32_t cropX = mConfig.crop_x();
+    uint32_t cropY = mConfig.crop_y();
+    uint32_t cropWidth = mConfig.crop_width() > 0 ? mConfig.crop_width() : frame.width - cropX;
+    uint32_t cropHeight = mConfig.crop_height() > 0 ? mConfig.crop_height() : frame.height - cropY;
+    if (cropX >= frame.width || cropY >= frame.height || cropWidth > frame.width - cropX ||
+        cropHeight > frame.height - cropY) {
+        if (!mLoggedUnsupportedFrame) {
+            ALOGE("Preprocessing crop rectangle is out of a %ux%u frame.", frame.width,
+                  frame.height);
+            mLoggedUnsupportedFrame = true;
+        }
+        mFramesFailed++;
+        return nullptr;
+    }
+
+    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        ALOGE("Failed to make the OpenGL ES context current: %s", getEGLError());
+        mFramesFailed++;
+        return nullptr;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool processed = false;
+    GLenum target = GL_TEXTURE_2D;
+    if (bindSource(frame, &target)) {
+        GLuint program = getProgram(target == GL_TEXTURE_EXTERNAL_OES);
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+        glViewport(0, 0, mFramebufferWidth, mFramebufferHeight);
+        glDisable(GL_BLEND);
+
+        glUseProgram(program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(target, target == GL_TEXTURE_2D ? mUploadTexture : mSourceTexture);
+        glUniform1i(glGetUniformLocation(program, "tex"), 0);
+        glUniform4f(glGetUniformLocation(program, "crop"),
+                    static_cast<GLfloat>(cropX) / frame.width,
+                    static_cast<GLfloat>(cropY) / frame.height,
+                    static_cast<GLfloat>(cropWidth) / frame.width,
+                    static_cast<GLfloat>(cropHeight) / frame.height);
+        glUniform2i(glGetUniformLocation(program, "size"), mOutputWidth, mOutputHeight);
+        glUniform3fv(glGetUniformLocation(program, "mean"), 1, mMean);
+        glUniform3fv(glGetUniformLocation(program, "invStd"), 1, mInvStd);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, kQuadPos);
+        glEnableVertexAttribArray(0);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glDisableVertexAttribArray(0);
+
+        // Waits for the GPU, after which the camera may have its buffer back.
+        glReadPixels(0, 0, mFramebufferWidth, mFramebufferHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+                     mOutput.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // Drops the camera buffer.
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+        processed = glGetError() == GL_NO_ERROR;
+    }
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    if (!processed) {
+        mFramesFailed++;
+        return nullptr;
+    }
+    mFramesProcessed++;
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    mProcessingTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    gpupolicy::recordFrameTime(
+            gpupolicy::kComponentComputePipe,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    return mOutput.data();
+}
+
+std::string GpuPreprocessor::getDebugInfo() const {
+    int64_t processed = mFramesProcessed;
+    std::ostringstream info;
+    info << "preprocessed " << processed << ", failed " << mFramesFailed << ", average "
+         << (processed > 0 ? mProcessingTimeUs / processed : 0) << "us";
+    return info.str();
+}
+
+void GpuPreprocessor::destroyObjects() {
+    glDeleteFramebuffers(1, &mFramebuffer);
+    glDeleteTextures(1, &mTargetTexture);
+    glDeleteTextures(1, &mSourceTexture);
+    glDeleteTextures(1, &mUploadTexture);
+    glDeleteProgram(mExternalProgram);
+    glDeleteProgram(mUploadProgram);
+    mFramebuffer = mTargetTexture = mSourceTexture = mUploadTexture = 0;
+    mExternalProgram = mUploadProgram = 0;
+    mUploadWidth = mUploadHeight = 0;
+}
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
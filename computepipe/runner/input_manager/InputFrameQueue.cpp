@@ -0,0 +1,139 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "InputFrameQueue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+#include "PixelFormatUtils.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+InputFrameQueue::InputFrameQueue(const proto::InputStreamConfig& config, FrameHandler&& handler)
+    : mStreamId(config.stream_id()),
+      mMaxQueuedFrames(std::max(config.max_queued_frames(), 1)),
+      mDecimationFactor(config.drop_policy() == proto::InputStreamConfig::DECIMATE
+                                ? std::max(config.decimation_factor(), 1)
+                                : 1),
+      mHandler(std::move(handler)) {
+}
+
+InputFrameQueue::~InputFrameQueue() {
+    stop(/* flush = */ false);
+}
+
+void InputFrameQueue::start() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mRunning) {
+        return;
+    }
+    mRunning = true;
+    mThread = std::make_unique<std::thread>(&InputFrameQueue::run, this);
+}
+
+void InputFrameQueue::stop(bool flush) {
+    std::unique_ptr<std::thread> thread;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mRunning = false;
+        if (!flush) {
+            mFramesDropped += mFrames.size();
+            mFrames.clear();
+        }
+        thread = std::move(mThread);
+        mSignal.notify_all();
+    }
+    if (thread) {
+        thread->join();
+    }
+}
+
+void InputFrameQueue::push(int64_t timestamp, const InputFrame& frame) {
+    uint64_t frameNumber = mFramesReceived++;
+    if (frameNumber % mDecimationFactor != 0) {
+        mFramesDecimated++;
+        return;
+    }
+
+    QueuedFrame queuedFrame = {timestamp, frame.getFrameInfo(), {}};
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!mSpareBuffers.empty()) {
+            queuedFrame.data = std::move(mSpareBuffers.back());
+            mSpareBuffers.pop_back();
+        }
+    }
+
+    // The frame goes back to its producer once we return, so copy it. This
+    // happens outside of the lock, to not hold up the queue thread.
+    queuedFrame.data.resize(frameSizeBytes(queuedFrame.info.format, queuedFrame.info.stride,
+                                           queuedFrame.info.height));
+    memcpy(queuedFrame.data.data(), frame.getFramePtr(), queuedFrame.data.size());
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mRunning) {
+        mFramesDropped++;
+        return;
+    }
+    if (mFrames.size() >= mMaxQueuedFrames) {
+        mSpareBuffers.push_back(std::move(mFrames.front().data));
+        mFrames.pop_front();
+        mFramesDropped++;
+    }
+    mFrames.push_back(std::move(queuedFrame));
+    mSignal.notify_all();
+}
+
+std::string InputFrameQueue::getDebugInfo() const {
+    std::ostringstream info;
+    info << "input stream " << mStreamId << ": received " << mFramesReceived << ", delivered "
+         << mFramesDelivered << ", dropped " << mFramesDropped << ", decimated "
+         << mFramesDecimated << "\n";
+    return info.str();
+}
+
+void InputFrameQueue::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mSignal.wait(lock, [this]() { return !mRunning || !mFrames.empty(); });
+        if (mFrames.empty()) {
+            break;
+        }
+        QueuedFrame queuedFrame = std::move(mFrames.front());
+        mFrames.pop_front();
+        lock.unlock();
+
+        InputFrame frame(queuedFrame.info, queuedFrame.data.data());
+        mHandler(queuedFrame.timestamp, frame);
+        mFramesDelivered++;
+
+        lock.lock();
+        if (mSpareBuffers.size() < mMaxQueuedFrames) {
+            mSpareBuffers.push_back(std::move(queuedFrame.data));
+        }
+    }
+}
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,93 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SharedCameraStream.h"
+
+#include <algorithm>
+
+using ::android::automotive::evs::support::AnalyzeUseCase;
+using ::android::automotive::evs::support::BaseAnalyzeCallback;
+using ::android::automotive::evs::support::Frame;
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+std::mutex SharedCameraStream::sStreamsLock;
+std::map<std::string, std::weak_ptr<SharedCameraStream>> SharedCameraStream::sStreams;
+
+std::shared_ptr<SharedCameraStream> SharedCameraStream::get(const std::string& cameraId) {
+    std::lock_guard lock(sStreamsLock);
+    std::shared_ptr<SharedCameraStream> stream = sStreams[cameraId].lock();
+    if (stream == nullptr) {
+        stream = std::make_shared<SharedCameraStream>(cameraId);
+        sStreams[cameraId] = stream;
+    }
+    return stream;
+}
+
+SharedCameraStream::SharedCameraStream(const std::string& cameraId)
+    // Subscribers get the camera buffers themselves rather than copies.
+    : mUseCase(AnalyzeUseCase::createDefaultUseCase(cameraId, this, /* zeroCopy = */ true)) {
+}
+
+SharedCameraStream::~SharedCameraStream() {
+    std::lock_guard lock(mStateLock);
+    if (!mSubscribers.empty()) {
+        mUseCase.stopVideoStream();
+    }
+}
+
+bool SharedCameraStream::start(BaseAnalyzeCallback* callback) {
+    std::lock_guard lock(mStateLock);
+    if (std::find(mSubscribers.begin(), mSubscribers.end(), callback) != mSubscribers.end()) {
+        return true;
+    }
+    if (mSubscribers.empty() && !mUseCase.startVideoStream()) {
+        return false;
+    }
+    std::lock_guard subscribersLock(mSubscribersLock);
+    mSubscribers.push_back(callback);
+    return true;
+}
+
+void SharedCameraStream::stop(BaseAnalyzeCallback* callback) {
+    std::lock_guard lock(mStateLock);
+    {
+        std::lock_guard subscribersLock(mSubscribersLock);
+        auto it = std::find(mSubscribers.begin(), mSubscribers.end(), callback);
+        if (it == mSubscribers.end()) {
+            return;
+        }
+        mSubscribers.erase(it);
+    }
+    if (mSubscribers.empty()) {
+        mUseCase.stopVideoStream();
+    }
+}
+
+void SharedCameraStream::analyze(const Frame& frame) {
+    std::shared_lock lock(mSubscribersLock);
+    for (BaseAnalyzeCallback* subscriber : mSubscribers) {
+        subscriber->analyze(frame);
+    }
+}
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,581 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "VideoFileInputManager.h"
+
+#include <android-base/logging.h>
+#include <fcntl.h>
+#include <media/NdkMediaFormat.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+#include "PixelFormatUtils.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+namespace {
+
+// MediaCodecInfo.CodecCapabilities color formats.
+constexpr int32_t kColorFormatYUV420Planar = 19;
+constexpr int32_t kColorFormatYUV420SemiPlanar = 21;
+constexpr int32_t kColorFormatYUV420Flexible = 0x7F420888;
+
+constexpr int64_t kDequeueTimeoutUs = 10000;
+
+struct YuvPlanes {
+    const uint8_t* y;
+    const uint8_t* u;
+    const uint8_t* v;
+    uint32_t yStride;
+    uint32_t uvStride;
+    // Bytes between the chroma samples of a row.
+    uint32_t uvStep;
+};
+
+uint8_t clampToByte(int value) {
+    return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+}
+
+// Lays the planes out as the YUV format asks, which takes no color conversion.
+void repackYuvFrame(const YuvPlanes& planes, uint32_t width, uint32_t height, PixelFormat format,
+                    uint8_t* dst, uint32_t dstStride) {
+    for (uint32_t row = 0; row < height; row++) {
+        memcpy(dst + row * dstStride, planes.y + row * planes.yStride, width);
+    }
+    uint8_t* chroma = dst + static_cast<size_t>(dstStride) * height;
+    const uint32_t chromaWidth = (width + 1) / 2;
+    const uint32_t chromaHeight = (height + 1) / 2;
+    const uint32_t chromaStride = (dstStride + 1) / 2;
+    for (uint32_t row = 0; row < chromaHeight; row++) {
+        const uint8_t* u = planes.u + row * planes.uvStride;
+        const uint8_t* v = planes.v + row * planes.uvStride;
+        if (format == PixelFormat::YUV420) {
+            uint8_t* outU = chroma + row * chromaStride;
+            uint8_t* outV = chroma + (chromaHeight + row) * chromaStride;
+            for (uint32_t col = 0; col < chromaWidth; col++) {
+                outU[col] = u[col * planes.uvStep];
+                outV[col] = v[col * planes.uvStep];
+            }
+            continue;
+        }
+        if (format == PixelFormat::NV21) {
+            std::swap(u, v);
+        }
+        uint8_t* out = chroma + row * dstStride;
+        for (uint32_t col = 0; col < chromaWidth; col++) {
+            out[2 * col] = u[col * planes.uvStep];
+            out[2 * col + 1] = v[col * planes.uvStep];
+        }
+    }
+}
+
+// Converts with the BT.601 limited range coefficients that decoders output by default.
+void convertYuvFrame(const YuvPlanes& planes, uint32_t width, uint32_t height, PixelFormat format,
+                     uint8_t* dst, uint32_t dstStride) {
+    if (isYuvFormat(format)) {
+        repackYuvFrame(planes, width, height, format, dst, dstStride);
+        return;
+    }
+    if (format == PixelFormat::GRAY) {
+        for (uint32_t row = 0; row < height; row++) {
+            memcpy(dst + row * dstStride, planes.y + row * planes.yStride, width);
+        }
+        return;
+    }
+    uint32_t bytesPerPixel = format == PixelFormat::RGBA ? 4 : 3;
+    for (uint32_t row = 0; row < height; row++) {
+        const uint8_t* y = planes.y + row * planes.yStride;
+        const uint8_t* u = planes.u + (row / 2) * planes.uvStride;
+        const uint8_t* v = planes.v + (row / 2) * planes.uvStride;
+        uint8_t* out = dst + row * dstStride;
+        for (uint32_t col = 0; col < width; col++) {
+            int c = 298 * (y[col] - 16);
+            int d = u[(col / 2) * planes.uvStep] - 128;
+            int e = v[(col / 2) * planes.uvStep] - 128;
+            out[0] = clampToByte((c + 409 * e + 128) >> 8);
+            out[1] = clampToByte((c - 100 * d - 208 * e + 128) >> 8);
+            out[2] = clampToByte((c + 516 * d + 128) >> 8);
+            if (bytesPerPixel == 4) {
+                out[3] = 255;
+            }
+            out += bytesPerPixel;
+        }
+    }
+}
+
+PixelFormat getPixelFormat(proto::InputStreamConfig::PixelLayout layout) {
+    switch (layout) {
+        case proto::InputStreamConfig::RGBA32:
+            return PixelFormat::RGBA;
+        case proto::InputStreamConfig::GRAY8:
+            return PixelFormat::GRAY;
+        case proto::InputStreamConfig::NV12:
+            return PixelFormat::NV12;
+        case proto::InputStreamConfig::NV21:
+            return PixelFormat::NV21;
+        case proto::InputStreamConfig::YUV420:
+            return PixelFormat::YUV420;
+        default:
+            return PixelFormat::RGB;
+    }
+}
+
+uint32_t getBytesPerPixel(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::RGBA:
+            return 4;
+        case PixelFormat::GRAY:
+        case PixelFormat::NV12:
+        case PixelFormat::NV21:
+        case PixelFormat::YUV420:
+            return 1;
+        default:
+            return 3;
+    }
+}
+
+}  // namespace
+
+VideoFileStream::VideoFileStream(const proto::InputStreamConfig& config,
+                                 std::shared_ptr<InputEngineInterface> inputEngineInterface)
+    : mConfig(config),
+      mInputStreamId(config.stream_id()),
+      mInputEngineInterface(inputEngineInterface) {
+    if (config.drop_policy() != proto::InputStreamConfig::BLOCK) {
+        mFrameQueue = std::make_unique<InputFrameQueue>(
+                config, [this](int64_t timestamp, const InputFrame& frame) {
+                    mInputEngineInterface->dispatchInputFrame(mInputStreamId, timestamp, frame);
+                });
+    }
+}
+
+VideoFileStream::~VideoFileStream() {
+    stop(/* flush = */ false);
+    releaseFile();
+}
+
+Status VideoFileStream::open() {
+    const std::string& path = mConfig.video_config().file_path();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        PLOG(ERROR) << "Unable to open video file " << path;
+        return Status::INVALID_ARGUMENT;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        LOG(ERROR) << "Unable to read the size of video file " << path;
+        ::close(fd);
+        return Status::INVALID_ARGUMENT;
+    }
+    mMappingSize = fileStat.st_size;
+    mMapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mMapping == MAP_FAILED) {
+        PLOG(ERROR) << "Unable to map video file " << path;
+        mMapping = nullptr;
+        return Status::INTERNAL_ERROR;
+    }
+    (void)madvise(mMapping, mMappingSize, MADV_SEQUENTIAL);
+
+    // The extractor reads the samples straight out of the mapping.
+    mDataSource = AMediaDataSource_new();
+    AMediaDataSource_setUserdata(mDataSource, this);
+    AMediaDataSource_setReadAt(mDataSource, &VideoFileStream::readAt);
+    AMediaDataSource_setGetSize(mDataSource, &VideoFileStream::getSize);
+    AMediaDataSource_setClose(mDataSource, &VideoFileStream::close);
+    mExtractor = AMediaExtractor_new();
+    if (AMediaExtractor_setDataSourceCustom(mExtractor, mDataSource) != AMEDIA_OK) {
+        LOG(ERROR) << "Unable to read the container of video file " << path;
+        return Status::INVALID_ARGUMENT;
+    }
+
+    size_t numTracks = AMediaExtractor_getTrackCount(mExtractor);
+    for (size_t track = 0; track < numTracks; track++) {
+        AMediaFormat* format = AMediaExtractor_getTrackFormat(mExtractor, track);
+        const char* mime = nullptr;
+        if (AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime) &&
+            strncmp(mime, "video/", strlen("video/")) == 0) {
+            mMime = mime;
+            mTrackFormat = format;
+            AMediaExtractor_selectTrack(mExtractor, track);
+            return Status::SUCCESS;
+        }
+        AMediaFormat_delete(format);
+    }
+    LOG(ERROR) << "No video track in video file " << path;
+    return Status::INVALID_ARGUMENT;
+}
+
+void VideoFileStream::releaseFile() {
+    if (mTrackFormat != nullptr) {
+        AMediaFormat_delete(mTrackFormat);
+        mTrackFormat = nullptr;
+    }
+    if (mExtractor != nullptr) {
+        AMediaExtractor_delete(mExtractor);
+        mExtractor = nullptr;
+    }
+    if (mDataSource != nullptr) {
+        AMediaDataSource_delete(mDataSource);
+        mDataSource = nullptr;
+    }
+    if (mMapping != nullptr) {
+        munmap(mMapping, mMappingSize);
+        mMapping = nullptr;
+    }
+}
+
+ssize_t VideoFileStream::readAt(void* userdata, off64_t offset, void* buffer, size_t size) {
+    VideoFileStream* stream = static_cast<VideoFileStream*>(userdata);
+    if (offset < 0 || static_cast<size_t>(offset) >= stream->mMappingSize) {
+        return -1;
+    }
+    size = std::min<size_t>(size, stream->mMappingSize - offset);
+    memcpy(buffer, static_cast<const uint8_t*>(stream->mMapping) + offset, size);
+    return size;
+}
+
+ssize_t VideoFileStream::getSize(void* userdata) {
+    return static_cast<VideoFileStream*>(userdata)->mMappingSize;
+}
+
+void VideoFileStream::close(void* /* userdata */) {
+    // The mapping lives as long as the stream.
+}
+
+Status VideoFileStream::start() {
+    if (mTrackFormat == nullptr) {
+        return Status::ILLEGAL_STATE;
+    }
+    // Each run plays the file from the start.
+    AMediaExtractor_seekTo(mExtractor, 0, AMEDIAEXTRACTOR_SEEK_PREVIOUS_SYNC);
+
+    // Hardware decoders come first in the codec list, so they are picked when there is one.
+    mCodec = AMediaCodec_createDecoderByType(mMime.c_str());
+    if (mCodec == nullptr) {
+        LOG(ERROR) << "No decoder for " << mMime;
+        return Status::INTERNAL_ERROR;
+    }
+    AMediaFormat_setInt32(mTrackFormat, AMEDIAFORMAT_KEY_COLOR_FORMAT, kColorFormatYUV420Flexible);
+    if (AMediaCodec_configure(mCodec, mTrackFormat, nullptr, nullptr, 0) != AMEDIA_OK ||
+        AMediaCodec_start(mCodec) != AMEDIA_OK) {
+        LOG(ERROR) << "Unable to start the decoder for " << mMime;
+        AMediaCodec_delete(mCodec);
+        mCodec = nullptr;
+        return Status::INTERNAL_ERROR;
+    }
+    char* name = nullptr;
+    if (AMediaCodec_getName(mCodec, &name) == AMEDIA_OK) {
+        mCodecName = name;
+        AMediaCodec_releaseName(mCodec, name);
+    }
+
+    mWidth = 0;
+    mHeight = 0;
+    mColorFormat = 0;
+    mFirstPresentationTimeUs = -1;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = false;
+    }
+    if (mFrameQueue != nullptr) {
+        mFrameQueue->start();
+    }
+    mThread = std::thread(&VideoFileStream::run, this);
+    return Status::SUCCESS;
+}
+
+void VideoFileStream::stop(bool flush) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mStopSignal.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    if (mCodec != nullptr) {
+        (void)AMediaCodec_stop(mCodec);
+        AMediaCodec_delete(mCodec);
+        mCodec = nullptr;
+    }
+    if (mFrameQueue != nullptr) {
+        mFrameQueue->stop(flush);
+    }
+}
+
+void VideoFileStream::run() {
+    bool inputDone = false;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mStopping) {
+                break;
+            }
+        }
+        if (!inputDone) {
+            inputDone = !queueInput();
+        }
+
+        AMediaCodecBufferInfo info;
+        ssize_t index = AMediaCodec_dequeueOutputBuffer(mCodec, &info, kDequeueTimeoutUs);
+        if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            updateOutputFormat();
+            continue;
+        }
+        if (index == AMEDIACODEC_INFO_TRY_AGAIN_LATER ||
+            index == AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED) {
+            continue;
+        }
+        if (index < 0) {
+            LOG(ERROR) << "Decoding video stream " << mInputStreamId << " failed with " << index;
+            mInputEngineInterface->notifyInputError();
+            break;
+        }
+
+        if (info.size > 0 && waitUntilDue(info.presentationTimeUs)) {
+            size_t capacity = 0;
+            const uint8_t* data = AMediaCodec_getOutputBuffer(mCodec, index, &capacity);
+            if (data != nullptr && static_cast<size_t>(info.offset) + info.size <= capacity) {
+                deliverFrame(data + info.offset, info.size, info.presentationTimeUs);
+            }
+        }
+        (void)AMediaCodec_releaseOutputBuffer(mCodec, index, /* render = */ false);
+        if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
+            LOG(INFO) << "Video stream " << mInputStreamId << " reached the end of its file";
+            break;
+        }
+    }
+}
+
+bool VideoFileStream::queueInput() {
+    ssize_t index = AMediaCodec_dequeueInputBuffer(mCodec, 0);
+    if (index < 0) {
+        return true;
+    }
+    size_t capacity = 0;
+    uint8_t* buffer = AMediaCodec_getInputBuffer(mCodec, index, &capacity);
+    ssize_t size = AMediaExtractor_readSampleData(mExtractor, buffer, capacity);
+    if (size < 0) {
+        (void)AMediaCodec_queueInputBuffer(mCodec, index, 0, 0, 0,
+                                           AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+        return false;
+    }
+    int64_t sampleTimeUs = AMediaExtractor_getSampleTime(mExtractor);
+    (void)AMediaCodec_queueInputBuffer(mCodec, index, 0, size, sampleTimeUs, 0);
+    AMediaExtractor_advance(mExtractor);
+    return true;
+}
+
+void VideoFileStream::updateOutputFormat() {
+    AMediaFormat* format = AMediaCodec_getOutputFormat(mCodec);
+    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_WIDTH, &mWidth);
+    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_HEIGHT, &mHeight);
+    if (!AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_STRIDE, &mStride)) {
+        mStride = mWidth;
+    }
+    if (!AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_SLICE_HEIGHT, &mSliceHeight)) {
+        mSliceHeight = mHeight;
+    }
+    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, &mColorFormat);
+    AMediaFormat_delete(format);
+    mStride = std::max(mStride, mWidth);
+    mSliceHeight = std::max(mSliceHeight, mHeight);
+}
+
+bool VideoFileStream::waitUntilDue(int64_t presentationTimeUs) {
+    std::unique_lock<std::mutex> lock(mLock);
+    if (!mConfig.video_config().realtime()) {
+        return !mStopping;
+    }
+    if (mFirstPresentationTimeUs < 0) {
+        mFirstPresentationTimeUs = presentationTimeUs;
+        mStartTime = std::chrono::steady_clock::now();
+    }
+    auto dueTime =
+            mStartTime + std::chrono::microseconds(presentationTimeUs - mFirstPresentationTimeUs);
+    return !mStopSignal.wait_until(lock, dueTime, [this]() { return mStopping; });
+}
+
+void VideoFileStream::deliverFrame(const uint8_t* data, size_t size, int64_t presentationTimeUs) {
+    YuvPlanes planes;
+    planes.y = data;
+    planes.yStride = mStride;
+    const uint8_t* chroma = data + static_cast<size_t>(mStride) * mSliceHeight;
+    if (mColorFormat == kColorFormatYUV420Planar) {
+        planes.uvStride = mStride / 2;
+        planes.uvStep = 1;
+        planes.u = chroma;
+        planes.v = chroma + static_cast<size_t>(planes.uvStride) * (mSliceHeight / 2);
+    } else if (mColorFormat == kColorFormatYUV420SemiPlanar) {
+        planes.uvStride = mStride;
+        planes.uvStep = 2;
+        planes.u = chroma;
+        planes.v = chroma + 1;
+    } else {
+        if (mFramesUnsupported++ == 0) {
+            LOG(ERROR) << "Video stream " << mInputStreamId << " decodes to color format "
+                       << mColorFormat << ", which cannot be converted";
+        }
+        return;
+    }
+    // The last chroma sample read must be in the buffer.
+    const uint8_t* end = planes.v + static_cast<size_t>(planes.uvStride) * ((mHeight - 1) / 2) +
+                         ((mWidth - 1) / 2) * planes.uvStep + 1;
+    if (mWidth <= 0 || mHeight <= 0 || end > data + size) {
+        LOG(ERROR) << "Video stream " << mInputStreamId << " got a frame smaller than its format";
+        return;
+    }
+
+    PixelFormat format = getPixelFormat(mConfig.pixel_layout());
+    uint32_t stride = mWidth * getBytesPerPixel(format);
+    mFrame.resize(frameSizeBytes(format, stride, mHeight));
+    convertYuvFrame(planes, mWidth, mHeight, format, mFrame.data(), stride);
+    mFramesDecoded++;
+
+    // The recorded timestamps are kept, so that replaying a file gives the same output.
+    InputFrame frame(mHeight, mWidth, format, stride, mFrame.data());
+    frame.setArrivalTime(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch())
+                                 .count());
+    if (mFrameQueue != nullptr) {
+        mFrameQueue->push(presentationTimeUs, frame);
+    } else {
+        mInputEngineInterface->dispatchInputFrame(mInputStreamId, presentationTimeUs, frame);
+    }
+}
+
+std::string VideoFileStream::getDebugInfo() const {
+    std::ostringstream info;
+    info << "Video stream " << mInputStreamId << " decoder " << mCodecName << ": frames decoded "
+         << mFramesDecoded << ", frames in unsupported formats " << mFramesUnsupported << "\n";
+    if (mFrameQueue != nullptr) {
+        info << mFrameQueue->getDebugInfo();
+    }
+    return info.str();
+}
+
+VideoFileInputManager::VideoFileInputManager(
+    const proto::InputConfig& inputConfig,
+    std::shared_ptr<InputEngineInterface> inputEngineInterface)
+    : mInputEngineInterface(inputEngineInterface), mInputConfig(inputConfig) {
+}
+
+std::unique_ptr<VideoFileInputManager> VideoFileInputManager::createVideoFileInputManager(
+    const proto::InputConfig& inputConfig,
+    std::shared_ptr<InputEngineInterface> inputEngineInterface) {
+    auto videoManager = std::make_unique<VideoFileInputManager>(inputConfig, inputEngineInterface);
+    if (videoManager->openFiles() == Status::SUCCESS) {
+        return videoManager;
+    }
+
+    return nullptr;
+}
+
+Status VideoFileInputManager::openFiles() {
+    for (int i = 0; i < mInputConfig.input_stream_size(); i++) {
+        const proto::InputStreamConfig& streamConfig = mInputConfig.input_stream(i);
+        if (streamConfig.type() != proto::InputStreamConfig_InputType_VIDEO_FILE) {
+            LOG(ERROR) << "Video file input manager expects the input stream type to be video file.";
+            return Status::INVALID_ARGUMENT;
+        }
+        auto stream = std::make_unique<VideoFileStream>(streamConfig, mInputEngineInterface);
+        Status status = stream->open();
+        if (status != Status::SUCCESS) {
+            return status;
+        }
+        if (!mStreams.emplace(streamConfig.stream_id(), std::move(stream)).second) {
+            LOG(ERROR) << "Multiple video streams have the same stream id.";
+            return Status::INVALID_ARGUMENT;
+        }
+    }
+    return Status::SUCCESS;
+}
+
+void VideoFileInputManager::stopStreams(bool flush) {
+    for (auto& [streamId, stream] : mStreams) {
+        stream->stop(flush);
+    }
+}
+
+Status VideoFileInputManager::handleExecutionPhase(const RunnerEvent& e) {
+    if (e.isAborted()) {
+        return Status::INVALID_ARGUMENT;
+    } else if (e.isTransitionComplete()) {
+        return Status::SUCCESS;
+    }
+
+    if (mStreams.empty()) {
+        LOG(ERROR) << "No video files configured.";
+        return Status::ILLEGAL_STATE;
+    }
+
+    for (auto& [streamId, stream] : mStreams) {
+        if (stream->start() != Status::SUCCESS) {
+            LOG(ERROR) << "Unable to start video stream " << streamId;
+            stopStreams(/* flush = */ false);
+            return Status::INTERNAL_ERROR;
+        }
+    }
+    return Status::SUCCESS;
+}
+
+Status VideoFileInputManager::handleStopImmediatePhase(const RunnerEvent& e) {
+    if (e.isTransitionComplete()) {
+        return Status::SUCCESS;
+    }
+    stopStreams(/* flush = */ false);
+    return Status::SUCCESS;
+}
+
+Status VideoFileInputManager::handleStopWithFlushPhase(const RunnerEvent& e) {
+    if (e.isTransitionComplete()) {
+        return Status::SUCCESS;
+    }
+    stopStreams(/* flush = */ true);
+    return Status::SUCCESS;
+}
+
+Status VideoFileInputManager::handleResetPhase(const RunnerEvent& e) {
+    if (e.isAborted()) {
+        LOG(ERROR) << "Unable to abort reset.";
+        return Status::INVALID_ARGUMENT;
+    }
+    stopStreams(/* flush = */ false);
+    mStreams.clear();
+    return Status::SUCCESS;
+}
+
+std::string VideoFileInputManager::getDebugInfo() {
+    std::string debugInfo;
+    for (auto& [streamId, stream] : mStreams) {
+        debugInfo += stream->getDebugInfo();
+    }
+    return debugInfo;
+}
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
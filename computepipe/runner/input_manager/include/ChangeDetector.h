@@ -0,0 +1,86 @@
+// Copyright 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_CHANGEDETECTOR_H_
+#define COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_CHANGEDETECTOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "InputConfig.pb.h"
+#include "InputFrame.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+/**
+ * Tells whether a frame differs enough from the last frame that went to the
+ * graph to be worth processing, as configured by a ChangeDetectionConfig.
+ * Only a small patch at the center of each grid cell is read, so a frame costs
+ * a few thousand pixel reads whatever its size.
+ *
+ * Not thread safe; frames of a stream come one at a time.
+ */
+class ChangeDetector {
+  public:
+    explicit ChangeDetector(const proto::ChangeDetectionConfig& config);
+
+    /**
+     * Returns true if the frame should go to the graph, in which case it
+     * becomes the frame later ones are compared against. arrivalTimeNs is on
+     * the monotonic clock.
+     */
+    bool hasChanged(const InputFrame& frame, int64_t arrivalTimeNs);
+
+    /**
+     * Forgets the last frame, so that the next one goes to the graph.
+     */
+    void reset();
+
+    /**
+     * Counts of the frames passed and skipped, in text.
+     */
+    std::string getDebugInfo() const;
+
+  private:
+    // Averages the luma of the patches into mSamples. Returns false for
+    // formats without a luma to read.
+    bool sampleLuma(const InputFrame& frame);
+
+    const uint32_t mGridWidth;
+    const uint32_t mGridHeight;
+    const int mLumaThreshold;
+    const uint32_t mMinChangedPatches;
+    const int64_t mMaxSkipIntervalNs;
+
+    std::vector<uint8_t> mSamples;
+    std::vector<uint8_t> mReference;  // Empty until a frame went to the graph
+    int64_t mReferenceTimeNs = 0;
+
+    std::atomic<uint64_t> mFramesPassed = 0;
+    std::atomic<uint64_t> mFramesSkipped = 0;
+};
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_CHANGEDETECTOR_H_
@@ -16,15 +16,20 @@
 
 #include <memory>
 #include <shared_mutex>
-#include <unordered_map>
+#include <string>
+#include <map>
 #include <vector>
 
-#include "AnalyzeUseCase.h"
 #include "BaseAnalyzeCallback.h"
+#include "ChangeDetector.h"
+#include "FrameSynchronizer.h"
+#include "GpuPreprocessor.h"
 #include "InputConfig.pb.h"
 #include "InputEngineInterface.h"
+#include "InputFrameQueue.h"
 #include "InputManager.h"
 #include "RunnerComponent.h"
+#include "SharedCameraStream.h"
 #include "types/Status.h"
 
 namespace android {
@@ -36,19 +41,38 @@ namespace input_manager {
 // Class that is used as a callback for EVS camera streams.
 class AnalyzeCallback : public ::android::automotive::evs::support::BaseAnalyzeCallback {
   public:
-    AnalyzeCallback(int inputStreamId) : mInputStreamId(inputStreamId) {
-    }
+    // With a synchronizer, frames go to the engine in sets with those of the
+    // other streams of the graph. With a preprocessor, the graph receives the
+    // preprocessed frames instead of the camera frames.
+    explicit AnalyzeCallback(const proto::InputStreamConfig& config,
+                             std::shared_ptr<FrameSynchronizer> synchronizer = nullptr,
+                             std::unique_ptr<GpuPreprocessor> preprocessor = nullptr);
 
     void analyze(const ::android::automotive::evs::support::Frame&) override;
 
     void setEngineInterface(std::shared_ptr<InputEngineInterface> inputEngineInterface);
 
+    // Start and stop handing queued frames to the engine, if frames are queued
+    void startQueue();
+    void stopQueue(bool flush);
+
+    std::string getDebugInfo() const;
+
     virtual ~AnalyzeCallback(){};
 
   private:
+    void dispatchFrame(int64_t timestamp, const InputFrame& frame);
+
     std::shared_ptr<InputEngineInterface> mInputEngineInterface;
     std::shared_mutex mEngineInterfaceLock;
     const int mInputStreamId;
+    const std::shared_ptr<FrameSynchronizer> mSynchronizer;
+    const std::unique_ptr<GpuPreprocessor> mPreprocessor;
+    // Set if frames of a static scene are skipped.
+    std::unique_ptr<ChangeDetector> mChangeDetector;
+    // Decouples the camera from the engine, unless the drop policy is BLOCK.
+    // Declared last, so that its thread stops before the members it uses go.
+    std::unique_ptr<InputFrameQueue> mFrameQueue;
 };
 
 class EvsInputManager : public InputManager {
@@ -60,6 +84,8 @@ class EvsInputManager : public InputManager {
         const proto::InputConfig& inputConfig,
         std::shared_ptr<InputEngineInterface> inputEngineInterface);
 
+    ~EvsInputManager();
+
     Status initializeCameras();
 
     Status handleExecutionPhase(const RunnerEvent& e) override;
@@ -70,9 +96,18 @@ class EvsInputManager : public InputManager {
 
     Status handleResetPhase(const RunnerEvent& e) override;
 
+    std::string getDebugInfo() override;
+
   private:
-    std::unordered_map<int, ::android::automotive::evs::support::AnalyzeUseCase> mEvsUseCases;
-    std::vector<std::unique_ptr<AnalyzeCallback>> mAnalyzeCallbacks;
+    // Unsubscribes from all camera streams. Stopping a stream is a no-op for
+    // streams not started.
+    void stopCameras();
+
+    // Keyed by input stream id.
+    std::map<int, std::shared_ptr<SharedCameraStream>> mCameraStreams;
+    std::map<int, std::unique_ptr<AnalyzeCallback>> mAnalyzeCallbacks;
+    // Set if the frames of the streams go to the graph in sets.
+    std::shared_ptr<FrameSynchronizer> mSynchronizer;
     std::shared_ptr<InputEngineInterface> mInputEngineInterface;
     const proto::InputConfig mInputConfig;
 };
@@ -0,0 +1,98 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_FRAMESYNCHRONIZER_H_
+#define COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_FRAMESYNCHRONIZER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "InputConfig.pb.h"
+#include "InputFrame.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+/**
+ * Pairs up the frames of the input streams of a graph, so that the graph gets
+ * one frame of each stream per call, all captured within the sync window of
+ * the input config. Each stream holds its latest frame. Once every stream has
+ * one, the set is handed on if it is within the window, and otherwise the
+ * oldest frame is dropped to wait for a newer one of its stream. Sets are
+ * handed on from the thread that completes them.
+ */
+class FrameSynchronizer {
+  public:
+    using SetHandler = std::function<void(int64_t, const InputFrameSet&)>;
+
+    explicit FrameSynchronizer(const proto::InputConfig& config, SetHandler&& handler);
+    /**
+     * Holds a copy of the frame of the stream, and hands on the set if it is
+     * complete. The set timestamp is that of its newest frame.
+     */
+    void push(int streamId, int64_t timestamp, const InputFrame& frame);
+    /**
+     * Drops the frames still waiting for a match.
+     */
+    void reset();
+    /**
+     * Counts of the sets delivered and frames dropped, in text.
+     */
+    std::string getDebugInfo() const;
+
+  private:
+    struct Slot {
+        bool filled = false;
+        int64_t timestamp = 0;
+        FrameInfo info;
+        std::vector<uint8_t> data;
+    };
+
+    // Drops the oldest frames until the held frames are within the window.
+    // Returns whether every stream holds a frame then.
+    bool matchSlots();
+
+    const int64_t mSyncWindow;
+    SetHandler mHandler;
+
+    std::mutex mLock;
+    // Keyed by input stream id.
+    std::map<int, Slot> mSlots;
+    // Frame copies to reuse, so that steady state runs without allocations
+    std::vector<std::vector<uint8_t>> mSpareBuffers;
+
+    // Serializes the delivery of sets, so that they reach the engine in order.
+    std::mutex mDeliveryLock;
+    std::vector<Slot> mDeliverySlots;
+
+    std::atomic<uint64_t> mSetsDelivered = 0;
+    std::atomic<uint64_t> mFramesDropped = 0;
+};
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_FRAMESYNCHRONIZER_H_
@@ -0,0 +1,128 @@
+// Copyright 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_GPUPREPROCESSOR_H_
+#define COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_GPUPREPROCESSOR_H_
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl3.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Frame.h"
+#include "InputConfig.pb.h"
+#include "types/Status.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+/**
+ * Crops, scales and converts camera frames into the input tensor of a model on
+ * the GPU, as described by a PreprocessConfig. Camera buffers are sampled in
+ * place through an EGLImage, which also converts YUV frames, and copied frames
+ * are uploaded as a texture. Each output texel packs four bytes of the tensor,
+ * so the result is read back in the layout the graph expects without any CPU
+ * work.
+ *
+ * The EGL context is made current on the calling thread for each frame only,
+ * so frames may come from any thread, one at a time.
+ */
+class GpuPreprocessor {
+  public:
+    explicit GpuPreprocessor(const proto::PreprocessConfig& config);
+    ~GpuPreprocessor();
+
+    GpuPreprocessor(const GpuPreprocessor&) = delete;
+    GpuPreprocessor& operator=(const GpuPreprocessor&) = delete;
+
+    /**
+     * Checks the config and sets up EGL, the shaders and the output
+     * framebuffer. Returns INVALID_ARGUMENT for a malformed config and
+     * INTERNAL_ERROR if the GPU can't be used.
+     */
+    Status initialize();
+
+    /**
+     * Preprocesses the frame and returns the tensor, which stays valid until
+     * the next frame is processed, or nullptr if the frame can't be processed.
+     */
+    const uint8_t* process(const ::android::automotive::evs::support::Frame& frame);
+
+    /**
+     * Layout of the tensors process() returns, as for an InputFrame. The
+     * height of planar formats is that of one plane.
+     */
+    uint32_t getWidth() const {
+        return mOutputWidth;
+    }
+    uint32_t getHeight() const {
+        return mOutputHeight;
+    }
+    uint32_t getStride() const {
+        return mFramebufferWidth * 4;
+    }
+    PixelFormat getFormat() const;
+
+    std::string getDebugInfo() const;
+
+  private:
+    // These are called with our context current.
+    GLuint getProgram(bool external);
+    bool bindSource(const ::android::automotive::evs::support::Frame& frame, GLenum* target);
+    void destroyObjects();
+
+    const proto::PreprocessConfig mConfig;
+    uint32_t mOutputWidth = 0;
+    uint32_t mOutputHeight = 0;
+    // The framebuffer is RGBA8 and holds four bytes of the tensor per texel.
+    uint32_t mFramebufferWidth = 0;
+    uint32_t mFramebufferHeight = 0;
+    GLfloat mMean[3] = {0.0f, 0.0f, 0.0f};
+    GLfloat mInvStd[3] = {1.0f, 1.0f, 1.0f};
+
+    EGLDisplay mDisplay = EGL_NO_DISPLAY;
+    EGLSurface mSurface = EGL_NO_SURFACE;
+    EGLContext mContext = EGL_NO_CONTEXT;
+    // For camera buffers and for frames uploaded from memory.
+    GLuint mExternalProgram = 0;
+    GLuint mUploadProgram = 0;
+    GLuint mSourceTexture = 0;
+    GLuint mUploadTexture = 0;
+    uint32_t mUploadWidth = 0;
+    uint32_t mUploadHeight = 0;
+    GLuint mTargetTexture = 0;
+    GLuint mFramebuffer = 0;
+
+    std::vector<uint8_t> mOutput;
+
+    std::atomic<int64_t> mFramesProcessed = 0;
+    std::atomic<int64_t> mFramesFailed = 0;
+    std::atomic<int64_t> mProcessingTimeUs = 0;
+    bool mLoggedUnsupportedFrame = false;
+};
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_GPUPREPROCESSOR_H_
@@ -27,9 +27,24 @@ namespace input_manager {
 class InputEngineInterface {
   public:
     /**
-     * Dispatch input frame to engine for consumption by the graph
+     * Dispatch input frame to engine for consumption by the graph. Live
+     * sources stamp frames with their capture time in microseconds of the
+     * monotonic clock.
      */
     virtual Status dispatchInputFrame(int streamId, int64_t timestamp, const InputFrame& frame) = 0;
+    /**
+     * Dispatch a set of frames of different streams, captured together, to
+     * the engine. By default the frames are dispatched one by one.
+     */
+    virtual Status dispatchInputFrames(int64_t timestamp, const InputFrameSet& frames) {
+        for (const auto& [streamId, frame] : frames) {
+            Status status = dispatchInputFrame(streamId, timestamp, *frame);
+            if (status != Status::SUCCESS) {
+                return status;
+            }
+        }
+        return Status::SUCCESS;
+    }
     /**
      * Report Error Halt to Engine. Engine should report error to other
      * components.
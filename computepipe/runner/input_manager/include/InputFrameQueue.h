@@ -0,0 +1,102 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_INPUTFRAMEQUEUE_H_
+#define COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_INPUTFRAMEQUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "InputConfig.pb.h"
+#include "InputFrame.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+/**
+ * Bounded queue between the thread that delivers the frames of an input stream
+ * and the engine. The producer copies each frame in and returns straight away,
+ * dropping the oldest queued frame if the queue is full, or skipping frames
+ * when decimating. A thread of the queue hands the frames to the engine.
+ */
+class InputFrameQueue {
+  public:
+    using FrameHandler = std::function<void(int64_t, const InputFrame&)>;
+
+    explicit InputFrameQueue(const proto::InputStreamConfig& config, FrameHandler&& handler);
+    ~InputFrameQueue();
+    /**
+     * Starts handing frames to the engine.
+     */
+    void start();
+    /**
+     * Stops the queue thread. With flush, the frames still queued are handed
+     * to the engine first, otherwise they are dropped.
+     */
+    void stop(bool flush);
+    /**
+     * Queues a copy of the frame, unless it is decimated.
+     */
+    void push(int64_t timestamp, const InputFrame& frame);
+    /**
+     * Counts of the frames received, delivered, and dropped, in text.
+     */
+    std::string getDebugInfo() const;
+
+  private:
+    struct QueuedFrame {
+        int64_t timestamp;
+        FrameInfo info;
+        std::vector<uint8_t> data;
+    };
+
+    void run();
+
+    const int mStreamId;
+    const uint32_t mMaxQueuedFrames;
+    const uint32_t mDecimationFactor;
+    FrameHandler mHandler;
+
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    bool mRunning = false;
+    std::deque<QueuedFrame> mFrames;
+    // Frame copies to reuse, so that steady state runs without allocations
+    std::vector<std::vector<uint8_t>> mSpareBuffers;
+    std::unique_ptr<std::thread> mThread;
+
+    std::atomic<uint64_t> mFramesReceived = 0;
+    std::atomic<uint64_t> mFramesDelivered = 0;
+    std::atomic<uint64_t> mFramesDropped = 0;
+    std::atomic<uint64_t> mFramesDecimated = 0;
+};
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_INPUTFRAMEQUEUE_H_
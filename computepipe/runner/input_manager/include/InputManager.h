@@ -16,6 +16,7 @@
 #define COMPUTEPIPE_RUNNER_INPUT_MANAGER_H
 
 #include <memory>
+#include <string>
 
 #include "InputConfig.pb.h"
 #include "InputEngineInterface.h"
@@ -33,7 +34,16 @@ namespace input_manager {
  * source for the graph. The Component exposes communications from the engine to
  * the input source.
  */
-class InputManager : public RunnerComponentInterface {};
+class InputManager : public RunnerComponentInterface {
+  public:
+    /**
+     * Text describing how the input sources have performed, such as how many
+     * frames were dropped. Reported with the profiling data of the graph.
+     */
+    virtual std::string getDebugInfo() {
+        return "";
+    }
+};
 
 /**
  * Factory that instantiates the input manager, for a given input option.
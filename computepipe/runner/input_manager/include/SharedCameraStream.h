@@ -0,0 +1,82 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_SHAREDCAMERASTREAM_H_
+#define COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_SHAREDCAMERASTREAM_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "AnalyzeUseCase.h"
+#include "BaseAnalyzeCallback.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+/**
+ * The analyze stream of one EVS camera, shared by every input manager of the
+ * process that reads the camera. EVS takes a single analyze callback per
+ * camera, so frames are handed on to each subscribed callback in turn. This
+ * lets several graphs in one runner read a camera that is opened once.
+ */
+class SharedCameraStream : public ::android::automotive::evs::support::BaseAnalyzeCallback {
+  public:
+    /**
+     * Returns the stream of the camera, creating it if no one holds it.
+     */
+    static std::shared_ptr<SharedCameraStream> get(const std::string& cameraId);
+
+    explicit SharedCameraStream(const std::string& cameraId);
+    ~SharedCameraStream();
+
+    /**
+     * Subscribes the callback to the frames of the camera, starting the
+     * camera for the first subscriber.
+     */
+    bool start(::android::automotive::evs::support::BaseAnalyzeCallback* callback);
+    /**
+     * Unsubscribes the callback, stopping the camera after the last one. The
+     * callback gets no frames once this returns.
+     */
+    void stop(::android::automotive::evs::support::BaseAnalyzeCallback* callback);
+
+    void analyze(const ::android::automotive::evs::support::Frame& frame) override;
+
+  private:
+    // Serializes starting and stopping the camera.
+    std::mutex mStateLock;
+    // Held shared while frames are handed on, so that unsubscribing waits for
+    // a frame in progress.
+    std::shared_mutex mSubscribersLock;
+    std::vector<::android::automotive::evs::support::BaseAnalyzeCallback*> mSubscribers;
+    ::android::automotive::evs::support::AnalyzeUseCase mUseCase;
+
+    static std::mutex sStreamsLock;
+    static std::map<std::string, std::weak_ptr<SharedCameraStream>> sStreams;
+};
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_SHAREDCAMERASTREAM_H_
@@ -0,0 +1,153 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_VIDEOFILEINPUTMANAGER_H_
+#define COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_VIDEOFILEINPUTMANAGER_H_
+
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaDataSource.h>
+#include <media/NdkMediaExtractor.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "InputConfig.pb.h"
+#include "InputEngineInterface.h"
+#include "InputFrameQueue.h"
+#include "InputManager.h"
+#include "RunnerComponent.h"
+#include "types/Status.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace input_manager {
+
+// Plays back the video file of one input stream. The file is memory mapped and
+// demuxed in place, and decoded by MediaCodec, which picks a hardware decoder
+// when there is one. Each run plays the file from its start.
+class VideoFileStream {
+  public:
+    VideoFileStream(const proto::InputStreamConfig& config,
+                    std::shared_ptr<InputEngineInterface> inputEngineInterface);
+    ~VideoFileStream();
+
+    // Maps the file and finds its video track.
+    Status open();
+
+    // Starts the decoder and the thread that hands the frames to the engine.
+    Status start();
+    // Stops decoding. With flush, frames already decoded still go to the
+    // engine.
+    void stop(bool flush);
+
+    std::string getDebugInfo() const;
+
+  private:
+    static ssize_t readAt(void* userdata, off64_t offset, void* buffer, size_t size);
+    static ssize_t getSize(void* userdata);
+    static void close(void* userdata);
+
+    void run();
+    // Hands a sample of the file to the decoder, if it has room. Returns false
+    // once the file has ended.
+    bool queueInput();
+    void updateOutputFormat();
+    // Waits until the frame is due. Returns false if the stream is stopped
+    // meanwhile.
+    bool waitUntilDue(int64_t presentationTimeUs);
+    void deliverFrame(const uint8_t* data, size_t size, int64_t presentationTimeUs);
+    void releaseFile();
+
+    const proto::InputStreamConfig mConfig;
+    const int mInputStreamId;
+    std::shared_ptr<InputEngineInterface> mInputEngineInterface;
+    std::unique_ptr<InputFrameQueue> mFrameQueue;
+
+    void* mMapping = nullptr;
+    size_t mMappingSize = 0;
+    AMediaDataSource* mDataSource = nullptr;
+    AMediaExtractor* mExtractor = nullptr;
+    AMediaFormat* mTrackFormat = nullptr;
+    std::string mMime;
+    AMediaCodec* mCodec = nullptr;
+    std::string mCodecName;
+
+    // Layout of the decoded frames.
+    int32_t mWidth = 0;
+    int32_t mHeight = 0;
+    int32_t mStride = 0;
+    int32_t mSliceHeight = 0;
+    int32_t mColorFormat = 0;
+    // Converted frame, reused from frame to frame.
+    std::vector<uint8_t> mFrame;
+
+    // Wall time at which the first frame was due, and its timestamp.
+    std::chrono::steady_clock::time_point mStartTime;
+    int64_t mFirstPresentationTimeUs = -1;
+
+    std::mutex mLock;
+    std::condition_variable mStopSignal;
+    bool mStopping = false;
+    std::thread mThread;
+
+    std::atomic<uint64_t> mFramesDecoded = 0;
+    std::atomic<uint64_t> mFramesUnsupported = 0;
+};
+
+class VideoFileInputManager : public InputManager {
+  public:
+    explicit VideoFileInputManager(const proto::InputConfig& inputConfig,
+                                   std::shared_ptr<InputEngineInterface> inputEngineInterface);
+
+    static std::unique_ptr<VideoFileInputManager> createVideoFileInputManager(
+        const proto::InputConfig& inputConfig,
+        std::shared_ptr<InputEngineInterface> inputEngineInterface);
+
+    Status openFiles();
+
+    Status handleExecutionPhase(const RunnerEvent& e) override;
+
+    Status handleStopImmediatePhase(const RunnerEvent& e) override;
+
+    Status handleStopWithFlushPhase(const RunnerEvent& e) override;
+
+    Status handleResetPhase(const RunnerEvent& e) override;
+
+    std::string getDebugInfo() override;
+
+  private:
+    void stopStreams(bool flush);
+
+    // Keyed by input stream id.
+    std::map<int, std::unique_ptr<VideoFileStream>> mStreams;
+    std::shared_ptr<InputEngineInterface> mInputEngineInterface;
+    const proto::InputConfig mInputConfig;
+};
+
+}  // namespace input_manager
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_INPUT_MANAGER_INCLUDE_VIDEOFILEINPUTMANAGER_H_
@@ -43,9 +43,9 @@ std::unique_ptr<SemanticManager> buildSemanticManager(const proto::OutputConfig&
 
 std::unique_ptr<PixelStreamManager> buildPixelStreamManager(
     const proto::OutputConfig& config, std::shared_ptr<StreamEngineInterface> engine,
-    uint32_t maxPackets) {
+    uint32_t maxPackets, const BufferPlacement& placement) {
     std::unique_ptr<PixelStreamManager> pixelStreamManager =
-        std::make_unique<PixelStreamManager>(config.stream_name(), config.stream_id());
+        std::make_unique<PixelStreamManager>(config.stream_name(), config.stream_id(), placement);
     pixelStreamManager->setEngineInterface(engine);
     if (pixelStreamManager->setMaxInFlightPackets(maxPackets) != Status::SUCCESS) {
         return nullptr;
@@ -57,7 +57,7 @@ std::unique_ptr<PixelStreamManager> buildPixelStreamManager(
 
 std::unique_ptr<StreamManager> StreamManagerFactory::getStreamManager(
     const proto::OutputConfig& config, std::shared_ptr<StreamEngineInterface> engine,
-    uint32_t maxPackets) {
+    uint32_t maxPackets, const BufferPlacement& placement) {
     if (!config.has_type()) {
         return nullptr;
     }
@@ -65,7 +65,7 @@ std::unique_ptr<StreamManager> StreamManagerFactory::getStreamManager(
         case proto::PacketType::SEMANTIC_DATA:
             return buildSemanticManager(config, engine, maxPackets);
         case proto::PacketType::PIXEL_DATA:
-            return buildPixelStreamManager(config, engine, maxPackets);
+            return buildPixelStreamManager(config, engine, maxPackets, placement);
         default:
             return nullptr;
     }
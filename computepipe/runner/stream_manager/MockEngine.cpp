@@ -29,6 +29,9 @@ void MockEngine::delegateToFake(const std::shared_ptr<StreamEngineInterface>& en
     });
     ON_CALL(*this, notifyError).WillByDefault([this](std::string msg) { mFake->notifyError(msg); });
     ON_CALL(*this, notifyEndOfStream).WillByDefault([this]() { mFake->notifyEndOfStream(); });
+    ON_CALL(*this, notifyBackpressure).WillByDefault([this](bool congested) {
+        mFake->notifyBackpressure(congested);
+    });
 }
 
 }  // namespace stream_manager
@@ -32,6 +32,7 @@ class MockEngine : public StreamEngineInterface {
     MOCK_METHOD(Status, dispatchPacket, (const std::shared_ptr<MemHandle>& data), (override));
     MOCK_METHOD(void, notifyEndOfStream, (), (override));
     MOCK_METHOD(void, notifyError, (std::string msg), (override));
+    MOCK_METHOD(void, notifyBackpressure, (bool congested), (override));
     void delegateToFake(const std::shared_ptr<StreamEngineInterface>& fake);
 
   private:
@@ -17,8 +17,10 @@
 #include <vndk/hardware_buffer.h>
 
 #include <algorithm>
+#include <cstring>
 #include <mutex>
 #include <thread>
+#include <utility>
 
 #include "PixelFormatUtils.h"
 
@@ -28,11 +30,105 @@ namespace computepipe {
 namespace runner {
 namespace stream_manager {
 
-PixelMemHandle::PixelMemHandle(int bufferId, int streamId, int additionalUsageFlags)
+namespace {
+
+// Decrements count unless it is already zero. Returns the previous count.
+int dropReference(std::atomic<int>& count) {
+    int previous = count.load();
+    while (previous > 0 && !count.compare_exchange_weak(previous, previous - 1)) {
+    }
+    return previous;
+}
+
+// Copies a YUV frame into the planes of a buffer of the flexible YUV format, whatever layout the
+// allocator picked for them.
+void copyYuvFrame(const InputFrame& frame, const AHardwareBuffer_Planes& planes) {
+    const FrameInfo info = frame.getFrameInfo();
+    const uint8_t* src = frame.getFramePtr();
+    const AHardwareBuffer_Plane& yPlane = planes.planes[0];
+    for (uint32_t row = 0; row < info.height; row++) {
+        memcpy(static_cast<uint8_t*>(yPlane.data) + row * yPlane.rowStride,
+               src + row * info.stride, info.width);
+    }
+
+    const uint8_t* chroma = src + static_cast<size_t>(info.stride) * info.height;
+    const uint32_t chromaWidth = (info.width + 1) / 2;
+    const uint32_t chromaHeight = (info.height + 1) / 2;
+    const uint8_t* srcU = chroma;
+    const uint8_t* srcV = chroma + 1;
+    uint32_t srcStride = info.stride;
+    // Bytes between the chroma samples of a row.
+    uint32_t srcStep = 2;
+    if (info.format == PixelFormat::NV21) {
+        std::swap(srcU, srcV);
+    } else if (info.format == PixelFormat::YUV420) {
+        srcStride = (info.stride + 1) / 2;
+        srcStep = 1;
+        srcV = chroma + static_cast<size_t>(srcStride) * chromaHeight;
+    }
+
+    uint8_t* dstU = static_cast<uint8_t*>(planes.planes[1].data);
+    uint8_t* dstV = static_cast<uint8_t*>(planes.planes[2].data);
+    const uint32_t dstUStride = planes.planes[1].rowStride;
+    const uint32_t dstVStride = planes.planes[2].rowStride;
+    const uint32_t dstStep = planes.planes[1].pixelStride;
+    // Rows are copied whole when the buffer lays the chroma out like the frame.
+    const bool sameLayout = dstStep == srcStep && planes.planes[2].pixelStride == srcStep &&
+                            (srcStep == 1 || dstV - dstU == srcV - srcU);
+    for (uint32_t row = 0; row < chromaHeight; row++) {
+        uint8_t* dstURow = dstU + row * dstUStride;
+        uint8_t* dstVRow = dstV + row * dstVStride;
+        const uint8_t* srcURow = srcU + row * srcStride;
+        const uint8_t* srcVRow = srcV + row * srcStride;
+        if (sameLayout && srcStep == 2) {
+            memcpy(std::min(dstURow, dstVRow), std::min(srcURow, srcVRow), chromaWidth * 2);
+        } else if (sameLayout) {
+            memcpy(dstURow, srcURow, chromaWidth);
+            memcpy(dstVRow, srcVRow, chromaWidth);
+        } else {
+            for (uint32_t col = 0; col < chromaWidth; col++) {
+                dstURow[col * dstStep] = srcURow[col * srcStep];
+                dstVRow[col * planes.planes[2].pixelStride] = srcVRow[col * srcStep];
+            }
+        }
+    }
+}
+
+}  // namespace
+
+BufferPlacement BufferPlacement::forOffload(const proto::OffloadOption& option) {
+    if (option.offload_types_size() == 0) {
+        return BufferPlacement();
+    }
+    // The NDK has no usage bits for neural or vision engines, which import the buffers as they
+    // are. Leaving out the CPU usage lets the buffers be placed where those devices read them
+    // best, without caches to flush.
+    BufferPlacement placement;
+    placement.cpuRendering = false;
+    for (int type : option.offload_types()) {
+        switch (type) {
+            case proto::OffloadOption::CPU:
+                placement.cpuRendering = true;
+                break;
+            case proto::OffloadOption::GPU:
+                placement.deviceUsage |= AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE;
+                break;
+            default:
+                break;
+        }
+    }
+    return placement;
+}
+
+PixelMemHandle::PixelMemHandle(int bufferId, int streamId, int additionalUsageFlags,
+                               const BufferPlacement& placement)
     : mBufferId(bufferId),
       mStreamId(streamId),
       mBuffer(nullptr),
-      mUsage(AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN | additionalUsageFlags) {
+      mUsage(AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN | additionalUsageFlags | placement.deviceUsage),
+      mRenderUsage(AHARDWAREBUFFER_USAGE_GPU_COLOR_OUTPUT | additionalUsageFlags |
+                   placement.deviceUsage |
+                   (placement.cpuRendering ? AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN : 0)) {
 }
 
 PixelMemHandle::~PixelMemHandle() {
@@ -69,24 +165,11 @@ Status PixelMemHandle::setFrameData(uint64_t timestamp, const InputFrame& inputF
     // Allocate a new buffer if it is currently null.
     FrameInfo frameInfo = inputFrame.getFrameInfo();
     if (mBuffer == nullptr) {
-        mDesc.format = PixelFormatToHardwareBufferFormat(frameInfo.format);
-        mDesc.height = frameInfo.height;
-        mDesc.width = frameInfo.width;
-        mDesc.layers = 1;
-        mDesc.rfu0 = 0;
-        mDesc.rfu1 = 0;
-        mDesc.stride = frameInfo.stride;
-        mDesc.usage = mUsage;
-        int err = AHardwareBuffer_allocate(&mDesc, &mBuffer);
-
-        if (err != 0 || mBuffer == nullptr) {
-            LOG(ERROR) << "Failed to allocate hardware buffer with error " << err;
-            return Status::NO_MEMORY;
+        Status status = allocateBuffer(frameInfo.width, frameInfo.height, frameInfo.format,
+                                       frameInfo.stride, mUsage);
+        if (status != Status::SUCCESS) {
+            return status;
         }
-
-        // Update mDesc with the actual descriptor with which the buffer was created. The actual
-        // stride could be different from the specified stride.
-        AHardwareBuffer_describe(mBuffer, &mDesc);
     }
 
     // Verifies that the input frame data has the same type as the allocated buffer.
@@ -96,6 +179,23 @@ Status PixelMemHandle::setFrameData(uint64_t timestamp, const InputFrame& inputF
         return Status::INVALID_ARGUMENT;
     }
 
+    if (isYuvFormat(frameInfo.format)) {
+        AHardwareBuffer_Planes planes;
+        int err = AHardwareBuffer_lockPlanes(mBuffer, AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN, -1,
+                                             nullptr, &planes);
+        if (err != 0 || planes.planeCount != 3) {
+            LOG(ERROR) << "Unable to lock the planes of a released hardware buffer.";
+            if (err == 0) {
+                AHardwareBuffer_unlock(mBuffer, nullptr);
+            }
+            return Status::INTERNAL_ERROR;
+        }
+        copyYuvFrame(inputFrame, planes);
+        AHardwareBuffer_unlock(mBuffer, nullptr);
+        mTimestamp = timestamp;
+        return Status::SUCCESS;
+    }
+
     // Locks the frame for copying the input frame data.
     void* mappedBuffer = nullptr;
     int err = AHardwareBuffer_lock(mBuffer, AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN, -1, nullptr,
@@ -125,6 +225,54 @@ Status PixelMemHandle::setFrameData(uint64_t timestamp, const InputFrame& inputF
     return Status::SUCCESS;
 }
 
+Status PixelMemHandle::prepareBuffer(uint32_t width, uint32_t height, PixelFormat format) {
+    // The graph renders into the buffer on its devices, and from the CPU only if it runs there.
+    const uint64_t usage = mRenderUsage;
+    if (mBuffer != nullptr) {
+        if (width != mDesc.width || height != mDesc.height ||
+            PixelFormatToHardwareBufferFormat(format) != mDesc.format) {
+            LOG(ERROR) << "Variable image sizes from the same stream id is not supported.";
+            return Status::INVALID_ARGUMENT;
+        }
+        if ((mDesc.usage & usage) == usage) {
+            return Status::SUCCESS;
+        }
+
+        // A buffer that so far only held copied frames cannot be rendered into.
+        AHardwareBuffer_release(mBuffer);
+        mBuffer = nullptr;
+    }
+    return allocateBuffer(width, height, format, 0, usage);
+}
+
+void PixelMemHandle::setTimestamp(uint64_t timestamp) {
+    mTimestamp = timestamp;
+}
+
+Status PixelMemHandle::allocateBuffer(uint32_t width, uint32_t height, PixelFormat format,
+                                      uint32_t stride, uint64_t usage) {
+    mDesc.format = PixelFormatToHardwareBufferFormat(format);
+    mDesc.height = height;
+    mDesc.width = width;
+    mDesc.layers = 1;
+    mDesc.rfu0 = 0;
+    mDesc.rfu1 = 0;
+    mDesc.stride = stride;
+    mDesc.usage = usage;
+    int err = AHardwareBuffer_allocate(&mDesc, &mBuffer);
+
+    if (err != 0 || mBuffer == nullptr) {
+        LOG(ERROR) << "Failed to allocate hardware buffer with error " << err;
+        mBuffer = nullptr;
+        return Status::NO_MEMORY;
+    }
+
+    // Update mDesc with the actual descriptor with which the buffer was created. The actual
+    // stride could be different from the specified stride.
+    AHardwareBuffer_describe(mBuffer, &mDesc);
+    return Status::SUCCESS;
+}
+
 int PixelMemHandle::getBufferId() const {
     return mBufferId;
 }
@@ -134,52 +282,273 @@ void PixelStreamManager::setEngineInterface(std::shared_ptr<StreamEngineInterfac
     mEngine = engine;
 }
 
+std::shared_ptr<StreamEngineInterface> PixelStreamManager::getEngine() {
+    std::lock_guard lock(mLock);
+    return mEngine;
+}
+
 Status PixelStreamManager::setMaxInFlightPackets(uint32_t maxPackets) {
     std::lock_guard lock(mLock);
-    if (mBuffersInUse.size() > maxPackets) {
+    if (hasPacketsInFlight()) {
         LOG(ERROR) << "Cannot set max in flight packets after graph has already started.";
         return Status::ILLEGAL_STATE;
     }
 
-    mMaxInFlightPackets = maxPackets;
+    mConsumers[kClientConsumer]->maxInFlightPackets = maxPackets;
+    resizePool();
+
     std::lock_guard stateLock(mStateLock);
     mState = CONFIG_DONE;
     return Status::SUCCESS;
 }
 
-Status PixelStreamManager::freePacket(int bufferId) {
+Status PixelStreamManager::addConsumer(int consumerId, uint32_t maxInFlightPackets,
+                                       DropPolicy policy, PacketDispatcher dispatcher) {
+    if (consumerId <= kClientConsumer || consumerId >= kMaxConsumers || !dispatcher) {
+        LOG(ERROR) << "Invalid consumer " << consumerId << " for the pixel stream manager.";
+        return Status::INVALID_ARGUMENT;
+    }
+
     std::lock_guard lock(mLock);
+    if (isRunning() || hasPacketsInFlight()) {
+        LOG(ERROR) << "Cannot add a consumer after graph has already started.";
+        return Status::ILLEGAL_STATE;
+    }
 
-    auto it = mBuffersInUse.find(bufferId);
+    std::unique_ptr<Consumer> consumer = std::make_unique<Consumer>();
+    consumer->maxInFlightPackets = maxInFlightPackets;
+    consumer->policy = policy;
+    consumer->dispatcher = std::move(dispatcher);
+    mConsumers[consumerId] = std::move(consumer);
+    resizePool();
+    return Status::SUCCESS;
+}
 
-    if (it == mBuffersInUse.end()) {
-        std::lock_guard stateLock(mStateLock);
-        // If the graph has already been stopped, we free the buffers
-        // asynchronously, so return SUCCESS if freePacket is called later.
-        if (mState == STOPPED) {
-            return Status::SUCCESS;
+bool PixelStreamManager::hasPacketsInFlight() {
+    bool packetsInFlight = !mBuffersLent.empty();
+    for (const auto& slot : mSlots) {
+        packetsInFlight |= slot->refCount.load() > 0;
+    }
+    return packetsInFlight;
+}
+
+void PixelStreamManager::resizePool() {
+    uint32_t numSlots = 0;
+    for (const auto& consumer : mConsumers) {
+        if (consumer != nullptr) {
+            numSlots += consumer->maxInFlightPackets;
+            consumer->numInFlight.store(0);
         }
+    }
 
-        LOG(ERROR) << "Unable to find the mem handle. Duplicate release may possible have been "
-                      "called";
-        return Status::INVALID_ARGUMENT;
+    // Buffers of the current pool keep their memory.
+    mFreeHead.store(kNoSlot);
+    mSlots.resize(std::min<size_t>(mSlots.size(), numSlots));
+    while (mSlots.size() < numSlots) {
+        mSlots.push_back(std::make_unique<BufferSlot>());
+        mSlots.back()->handle = std::make_shared<PixelMemHandle>(
+            mSlots.size() - 1, mStreamId, /* additionalUsageFlags = */ 0, mPlacement);
+    }
+    for (const auto& slot : mSlots) {
+        for (auto& consumerRefCount : slot->consumerRefCounts) {
+            consumerRefCount.store(0);
+        }
+        slot->refCount.store(0);
     }
 
-    it->second.outstandingRefCount -= 1;
-    if (it->second.outstandingRefCount == 0) {
-        mBuffersReady.push_back(it->second.handle);
-        mBuffersInUse.erase(it);
+    // Push in reverse so that the buffers are first used in the order of their ids.
+    for (uint32_t i = numSlots; i > 0; i--) {
+        pushFreeSlot(i - 1);
     }
-    return Status::SUCCESS;
+}
+
+uint32_t PixelStreamManager::popFreeSlot() {
+    uint64_t head = mFreeHead.load(std::memory_order_acquire);
+    while (static_cast<uint32_t>(head) != kNoSlot) {
+        uint32_t slot = static_cast<uint32_t>(head);
+        uint64_t newHead = (head & ~uint64_t{UINT32_MAX}) |
+                           mSlots[slot]->next.load(std::memory_order_relaxed);
+        if (mFreeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire,
+                                            std::memory_order_acquire)) {
+            return slot;
+        }
+    }
+    return kNoSlot;
+}
+
+void PixelStreamManager::pushFreeSlot(uint32_t slot) {
+    uint64_t head = mFreeHead.load(std::memory_order_relaxed);
+    uint64_t newHead;
+    do {
+        mSlots[slot]->next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        newHead = (((head >> 32) + 1) << 32) | slot;
+    } while (!mFreeHead.compare_exchange_weak(head, newHead, std::memory_order_release,
+                                              std::memory_order_relaxed));
+}
+
+Status PixelStreamManager::freePacket(int bufferId) {
+    return freePacket(bufferId, kClientConsumer);
+}
+
+Status PixelStreamManager::freePacket(int bufferId, int consumerId) {
+    if (bufferId >= 0 && bufferId < static_cast<int>(mSlots.size()) && consumerId >= 0 &&
+        consumerId < kMaxConsumers && mConsumers[consumerId] != nullptr) {
+        BufferSlot& slot = *mSlots[bufferId];
+        int consumerRefCount = dropReference(slot.consumerRefCounts[consumerId]);
+        if (consumerRefCount > 0) {
+            if (consumerRefCount == 1) {
+                releaseConsumer(*mConsumers[consumerId]);
+            }
+            if (dropReference(slot.refCount) == 1) {
+                pushFreeSlot(bufferId);
+            }
+            return Status::SUCCESS;
+        }
+    }
+
+    std::lock_guard stateLock(mStateLock);
+    // If the graph has already been stopped, we free the buffers
+    // asynchronously, so return SUCCESS if freePacket is called later.
+    if (mState == STOPPED) {
+        return Status::SUCCESS;
+    }
+
+    LOG(ERROR) << "Unable to find the mem handle. Duplicate release may possible have been "
+                  "called";
+    return Status::INVALID_ARGUMENT;
 }
 
 void PixelStreamManager::freeAllPackets() {
-    std::lock_guard lock(mLock);
+    // Buffers lent to the graph come back when it queues or releases them.
+    uint32_t discarded = 0;
+    for (uint32_t i = 0; i < mSlots.size(); i++) {
+        BufferSlot& slot = *mSlots[i];
+        for (int consumerId = 0; consumerId < kMaxConsumers; consumerId++) {
+            if (slot.consumerRefCounts[consumerId].exchange(0) > 0) {
+                releaseConsumer(*mConsumers[consumerId]);
+                discarded++;
+            }
+        }
+        if (slot.refCount.exchange(0) > 0) {
+            pushFreeSlot(i);
+        }
+    }
+    if (discarded > 0) {
+        LOG(WARNING) << "PixelStreamManager - discarded " << discarded
+                     << " packets still in flight on stop";
+    }
+
+    // Wake up the graph output if it is waiting on a blocking consumer.
+    {
+        std::lock_guard lock(mFlowLock);
+    }
+    mFlowSignal.notify_all();
+}
+
+uint32_t PixelStreamManager::reserveConsumers() {
+    uint32_t consumers = 0;
+    for (int consumerId = 0; consumerId < kMaxConsumers; consumerId++) {
+        Consumer* consumer = mConsumers[consumerId].get();
+        if (consumer == nullptr || consumer->maxInFlightPackets == 0) {
+            continue;
+        }
+        if (tryReserve(*consumer)) {
+            consumers |= 1u << consumerId;
+            continue;
+        }
+        if (consumer->policy != DropPolicy::BLOCK) {
+            continue;
+        }
 
-    for (auto [bufferId, buffer] : mBuffersInUse) {
-        mBuffersReady.push_back(buffer.handle);
+        bool reserved = false;
+        {
+            std::unique_lock lock(mFlowLock);
+            mFlowSignal.wait(lock, [this, consumer, &reserved]() {
+                if (!isRunning()) {
+                    return true;
+                }
+                reserved = tryReserve(*consumer);
+                return reserved;
+            });
+        }
+        if (!reserved) {
+            // The stream stopped, so nobody gets the packet.
+            releaseConsumers(consumers);
+            return 0;
+        }
+        consumers |= 1u << consumerId;
+    }
+    if (consumers != 0) {
+        updateBackpressure();
+    }
+    return consumers;
+}
+
+bool PixelStreamManager::tryReserve(Consumer& consumer) {
+    uint32_t numInFlight = consumer.numInFlight.load();
+    while (numInFlight < consumer.maxInFlightPackets) {
+        if (consumer.numInFlight.compare_exchange_weak(numInFlight, numInFlight + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PixelStreamManager::releaseConsumer(Consumer& consumer) {
+    consumer.numInFlight.fetch_sub(1);
+    if (consumer.policy == DropPolicy::BLOCK) {
+        {
+            std::lock_guard lock(mFlowLock);
+        }
+        mFlowSignal.notify_all();
+    }
+    updateBackpressure();
+}
+
+void PixelStreamManager::releaseConsumers(uint32_t consumers) {
+    for (int consumerId = 0; consumerId < kMaxConsumers; consumerId++) {
+        if (consumers & (1u << consumerId)) {
+            releaseConsumer(*mConsumers[consumerId]);
+        }
+    }
+}
+
+bool PixelStreamManager::isCongested() {
+    bool hasBudget = false;
+    for (int consumerId = 0; consumerId < kMaxConsumers; consumerId++) {
+        Consumer* consumer = mConsumers[consumerId].get();
+        if (consumer == nullptr || consumer->maxInFlightPackets == 0) {
+            continue;
+        }
+        if (consumer->numInFlight.load() < consumer->maxInFlightPackets) {
+            return false;
+        }
+        hasBudget = true;
     }
-    mBuffersInUse.clear();
+    return hasBudget;
+}
+
+void PixelStreamManager::updateBackpressure() {
+    // Most packets leave the stream as congested as they found it.
+    if (isCongested() == mCongested.load()) {
+        return;
+    }
+    std::shared_ptr<StreamEngineInterface> engine = getEngine();
+    std::lock_guard lock(mBackpressureLock);
+    // Checked again under the lock, so that the last notification matches the stream.
+    bool congested = isCongested();
+    if (congested == mCongested.load()) {
+        return;
+    }
+    mCongested.store(congested);
+    if (engine != nullptr) {
+        engine->notifyBackpressure(congested);
+    }
+}
+
+bool PixelStreamManager::isRunning() {
+    std::lock_guard stateLock(mStateLock);
+    return mState == RUNNING;
 }
 
 Status PixelStreamManager::queuePacket(const char* /*data*/, const uint32_t /*size*/,
@@ -188,9 +557,12 @@ Status PixelStreamManager::queuePacket(const char* /*data*/, const uint32_t /*si
     return Status::ILLEGAL_STATE;
 }
 
-Status PixelStreamManager::queuePacket(const InputFrame& frame, uint64_t timestamp) {
-    std::lock_guard lock(mLock);
+Status PixelStreamManager::queuePacket(std::string&& /*data*/, uint64_t /*timestamp*/) {
+    LOG(ERROR) << "Trying to queue a semantic packet to a pixel stream manager";
+    return Status::ILLEGAL_STATE;
+}
 
+Status PixelStreamManager::queuePacket(const InputFrame& frame, uint64_t timestamp) {
     // State has to be running for the callback to go back.
     {
         std::lock_guard stateLock(mStateLock);
@@ -201,52 +573,156 @@ Status PixelStreamManager::queuePacket(const InputFrame& frame, uint64_t timesta
         }
     }
 
-    if (mEngine == nullptr) {
+    std::shared_ptr<StreamEngineInterface> engine = getEngine();
+    if (engine == nullptr) {
         LOG(ERROR) << "Stream to engine interface is not set";
         return Status::ILLEGAL_STATE;
     }
 
-    if (mBuffersInUse.size() >= mMaxInFlightPackets) {
+    uint32_t consumers = reserveConsumers();
+    uint32_t slot = consumers != 0 ? popFreeSlot() : kNoSlot;
+    if (slot == kNoSlot) {
         LOG(INFO) << "Too many frames in flight. Skipping frame at timestamp " << timestamp;
+        releaseConsumers(consumers);
         return Status::SUCCESS;
     }
 
-    // A unique id per buffer is maintained by incrementing the unique id from the previously
-    // created buffer. The unique id is therefore the number of buffers already created.
-    if (mBuffersReady.empty()) {
-        mBuffersReady.push_back(std::make_shared<PixelMemHandle>(mBuffersInUse.size(), mStreamId));
+    // The buffer is ours until it is dispatched, so the copy needs no lock.
+    Status status = mSlots[slot]->handle->setFrameData(timestamp, frame);
+    if (status != Status::SUCCESS) {
+        LOG(ERROR) << "Setting frame data failed with error code " << status;
+        pushFreeSlot(slot);
+        releaseConsumers(consumers);
+        return status;
     }
 
-    // The previously used buffer is pushed to the back of the vector. Picking the last used buffer
-    // may be more cache efficient if accessing through CPU, so we use that strategy here.
-    std::shared_ptr<PixelMemHandle> memHandle = mBuffersReady[mBuffersReady.size() - 1];
-    mBuffersReady.resize(mBuffersReady.size() - 1);
+    dispatchSlot(slot, consumers, engine);
+    return Status::SUCCESS;
+}
 
-    BufferMetadata bufferMetadata;
-    bufferMetadata.outstandingRefCount = 1;
-    bufferMetadata.handle = memHandle;
+AHardwareBuffer* PixelStreamManager::acquireOutputBuffer(uint32_t width, uint32_t height,
+                                                         PixelFormat format) {
+    {
+        std::lock_guard stateLock(mStateLock);
+        if (mState != RUNNING) {
+            LOG(ERROR) << "Output buffer cannot be acquired when state is not RUNNING. Current "
+                          "state is "
+                       << mState;
+            return nullptr;
+        }
+    }
 
-    mBuffersInUse.emplace(memHandle->getBufferId(), bufferMetadata);
+    uint32_t slot = popFreeSlot();
+    if (slot == kNoSlot) {
+        LOG(INFO) << "Too many frames in flight. No output buffer available";
+        return nullptr;
+    }
 
-    Status status = memHandle->setFrameData(timestamp, frame);
+    std::shared_ptr<PixelMemHandle> memHandle = mSlots[slot]->handle;
+    Status status = memHandle->prepareBuffer(width, height, format);
     if (status != Status::SUCCESS) {
-        LOG(ERROR) << "Setting frame data failed with error code " << status;
-        return status;
+        LOG(ERROR) << "Preparing output buffer failed with error code " << status;
+        pushFreeSlot(slot);
+        return nullptr;
     }
 
-    // Dispatch packet to the engine asynchronously in order to avoid circularly
-    // waiting for each others' locks.
-    std::thread t([this, memHandle]() {
-        Status status = mEngine->dispatchPacket(memHandle);
-        if (status != Status::SUCCESS) {
-            mEngine->notifyError(std::string(__func__) + ":" + std::to_string(__LINE__) +
-                                 " Failed to dispatch packet");
+    std::lock_guard lock(mLock);
+    mBuffersLent.emplace(memHandle->getHardwareBuffer(), slot);
+    return memHandle->getHardwareBuffer();
+}
+
+Status PixelStreamManager::queueOutputBuffer(AHardwareBuffer* buffer, uint64_t timestamp) {
+    uint32_t slot;
+    std::shared_ptr<StreamEngineInterface> engine;
+    {
+        std::lock_guard lock(mLock);
+        auto it = mBuffersLent.find(buffer);
+        if (it == mBuffersLent.end()) {
+            LOG(ERROR) << "Queued output buffer was not acquired from this stream";
+            return Status::INVALID_ARGUMENT;
+        }
+        slot = it->second;
+        mBuffersLent.erase(it);
+        engine = mEngine;
+    }
+
+    // The graph may finish a frame after the stream has been stopped, which only returns the
+    // buffer.
+    {
+        std::lock_guard stateLock(mStateLock);
+        if (mState != RUNNING) {
+            LOG(ERROR) << "Packet cannot be queued when state is not RUNNING. Current state is"
+                       << mState;
+            pushFreeSlot(slot);
+            return Status::ILLEGAL_STATE;
         }
-    });
-    t.detach();
+    }
+
+    if (engine == nullptr) {
+        LOG(ERROR) << "Stream to engine interface is not set";
+        pushFreeSlot(slot);
+        return Status::ILLEGAL_STATE;
+    }
+
+    uint32_t consumers = reserveConsumers();
+    if (consumers == 0) {
+        LOG(INFO) << "Too many frames in flight. Skipping frame at timestamp " << timestamp;
+        pushFreeSlot(slot);
+        return Status::SUCCESS;
+    }
+
+    mSlots[slot]->handle->setTimestamp(timestamp);
+    dispatchSlot(slot, consumers, engine);
+    return Status::SUCCESS;
+}
+
+Status PixelStreamManager::releaseOutputBuffer(AHardwareBuffer* buffer) {
+    uint32_t slot;
+    {
+        std::lock_guard lock(mLock);
+        auto it = mBuffersLent.find(buffer);
+        if (it == mBuffersLent.end()) {
+            LOG(ERROR) << "Released output buffer was not acquired from this stream";
+            return Status::INVALID_ARGUMENT;
+        }
+        slot = it->second;
+        mBuffersLent.erase(it);
+    }
+    pushFreeSlot(slot);
     return Status::SUCCESS;
 }
 
+void PixelStreamManager::dispatchSlot(uint32_t slot, uint32_t consumers,
+                                      std::shared_ptr<StreamEngineInterface> engine) {
+    BufferSlot& bufferSlot = *mSlots[slot];
+    std::shared_ptr<PixelMemHandle> memHandle = bufferSlot.handle;
+    int refCount = 0;
+    for (int consumerId = 0; consumerId < kMaxConsumers; consumerId++) {
+        bool dispatched = consumers & (1u << consumerId);
+        bufferSlot.consumerRefCounts[consumerId].store(dispatched ? 1 : 0);
+        refCount += dispatched ? 1 : 0;
+    }
+    bufferSlot.refCount.store(refCount);
+
+    // Dispatch packet to the engine asynchronously in order to avoid circularly
+    // waiting for each others' locks. Each consumer gets its own thread so that one that is slow
+    // to take the packet does not delay the others.
+    for (int consumerId = 0; consumerId < kMaxConsumers; consumerId++) {
+        if (!(consumers & (1u << consumerId))) {
+            continue;
+        }
+        PacketDispatcher dispatcher = mConsumers[consumerId]->dispatcher;
+        std::thread t([engine, dispatcher, memHandle]() {
+            Status status = dispatcher ? dispatcher(memHandle) : engine->dispatchPacket(memHandle);
+            if (status != Status::SUCCESS) {
+                engine->notifyError(std::string(__func__) + ":" + std::to_string(__LINE__) +
+                                    " Failed to dispatch packet");
+            }
+        });
+        t.detach();
+    }
+}
+
 Status PixelStreamManager::handleExecutionPhase(const RunnerEvent& e) {
     std::lock_guard<std::mutex> lock(mStateLock);
     if (mState == CONFIG_DONE && e.isPhaseEntry()) {
@@ -310,19 +786,29 @@ std::shared_ptr<MemHandle> PixelStreamManager::clonePacket(std::shared_ptr<MemHa
         return nullptr;
     }
 
-    std::lock_guard<std::mutex> lock(mLock);
+    // Clones are taken by the client.
     int bufferId = handle->getBufferId();
-    auto it = mBuffersInUse.find(bufferId);
-    if (it == mBuffersInUse.end()) {
-        LOG(ERROR) << "PixelStreamManager - Attempting to clone an already freed packet.";
-        return nullptr;
+    if (bufferId >= 0 && bufferId < static_cast<int>(mSlots.size())) {
+        BufferSlot& slot = *mSlots[bufferId];
+        std::atomic<int>& consumerRefCount = slot.consumerRefCounts[kClientConsumer];
+        int count = consumerRefCount.load();
+        while (count > 0) {
+            if (consumerRefCount.compare_exchange_weak(count, count + 1)) {
+                slot.refCount.fetch_add(1);
+                return handle;
+            }
+        }
     }
-    it->second.outstandingRefCount += 1;
-    return handle;
+    LOG(ERROR) << "PixelStreamManager - Attempting to clone an already freed packet.";
+    return nullptr;
 }
 
-PixelStreamManager::PixelStreamManager(std::string name, int streamId)
-    : StreamManager(name, proto::PacketType::PIXEL_DATA), mStreamId(streamId) {
+PixelStreamManager::PixelStreamManager(std::string name, int streamId,
+                                       const BufferPlacement& placement)
+    : StreamManager(name, proto::PacketType::PIXEL_DATA),
+      mStreamId(streamId),
+      mPlacement(placement) {
+    mConsumers[kClientConsumer] = std::make_unique<Consumer>();
 }
 
 }  // namespace stream_manager
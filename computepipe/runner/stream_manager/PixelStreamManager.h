@@ -16,6 +16,8 @@
 
 #include <vndk/hardware_buffer.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -35,7 +37,8 @@ namespace stream_manager {
 
 class PixelMemHandle : public MemHandle {
   public:
-    explicit PixelMemHandle(int bufferId, int streamId, int additionalUsageFlags = 0);
+    explicit PixelMemHandle(int bufferId, int streamId, int additionalUsageFlags = 0,
+                            const BufferPlacement& placement = {});
 
     virtual ~PixelMemHandle();
 
@@ -59,13 +62,24 @@ class PixelMemHandle : public MemHandle {
     /* Sets frame info */
     Status setFrameData(uint64_t timestamp, const InputFrame& inputFrame);
 
+    /* Makes the buffer ready for the graph to render a frame of the given size into */
+    Status prepareBuffer(uint32_t width, uint32_t height, PixelFormat format);
+
+    /* Sets the timestamp of a frame the graph rendered into the buffer */
+    void setTimestamp(uint64_t timestamp);
+
   private:
+    Status allocateBuffer(uint32_t width, uint32_t height, PixelFormat format, uint32_t stride,
+                          uint64_t usage);
+
     const int mBufferId;
     const int mStreamId;
     AHardwareBuffer_Desc mDesc;
     AHardwareBuffer* mBuffer;
     uint64_t mTimestamp;
-    int mUsage;
+    // Usage of buffers that frames are copied into, and of buffers the graph renders into.
+    uint64_t mUsage;
+    uint64_t mRenderUsage;
 };
 
 class PixelStreamManager : public StreamManager, StreamManagerInit {
@@ -75,10 +89,20 @@ class PixelStreamManager : public StreamManager, StreamManagerInit {
     Status setMaxInFlightPackets(uint32_t maxPackets) override;
     // Free previously dispatched packet. Once client has confirmed usage
     Status freePacket(int bufferId) override;
+    Status freePacket(int bufferId, int consumerId) override;
+    // Add a consumer besides the client, with its own flow control
+    Status addConsumer(int consumerId, uint32_t maxInFlightPackets, DropPolicy policy,
+                       PacketDispatcher dispatcher) override;
     // Queue packet produced by graph stream
     Status queuePacket(const char* data, const uint32_t size, uint64_t timestamp) override;
+    Status queuePacket(std::string&& data, uint64_t timestamp) override;
     // Queues pixel packet produced by graph stream
     Status queuePacket(const InputFrame& frame, uint64_t timestamp) override;
+    // Lends out and takes back buffers the graph renders pixel packets into
+    AHardwareBuffer* acquireOutputBuffer(uint32_t width, uint32_t height,
+                                         PixelFormat format) override;
+    Status queueOutputBuffer(AHardwareBuffer* buffer, uint64_t timestamp) override;
+    Status releaseOutputBuffer(AHardwareBuffer* buffer) override;
     /* Make a copy of the packet. */
     std::shared_ptr<MemHandle> clonePacket(std::shared_ptr<MemHandle> handle) override;
 
@@ -86,24 +110,88 @@ class PixelStreamManager : public StreamManager, StreamManagerInit {
     Status handleStopWithFlushPhase(const RunnerEvent& e) override;
     Status handleStopImmediatePhase(const RunnerEvent& e) override;
 
-    explicit PixelStreamManager(std::string name, int streamId);
+    explicit PixelStreamManager(std::string name, int streamId,
+                                const BufferPlacement& placement = {});
     ~PixelStreamManager() = default;
 
   private:
+    // Marks the end of the free list.
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+    // The consumers of a packet are kept in a bit mask.
+    static constexpr int kMaxConsumers = 8;
+
+    struct Consumer {
+        uint32_t maxInFlightPackets = 0;
+        DropPolicy policy = DropPolicy::LATEST_WINS;
+        // Empty for the client, whose packets go through the engine interface.
+        PacketDispatcher dispatcher;
+        // Packets the consumer has not returned yet.
+        std::atomic<uint32_t> numInFlight{0};
+    };
+
+    // A buffer of the stream. The buffer id of its handle is its index in mSlots.
+    struct BufferSlot {
+        std::shared_ptr<PixelMemHandle> handle;
+        // References each consumer holds on the dispatched packet, and their total. Zero while
+        // the buffer is free or being filled.
+        std::atomic<int> consumerRefCounts[kMaxConsumers];
+        std::atomic<int> refCount{0};
+        // Next slot in the free list.
+        std::atomic<uint32_t> next{kNoSlot};
+    };
+
     void freeAllPackets();
+    std::shared_ptr<StreamEngineInterface> getEngine();
+    // Whether any buffer is in flight or lent to the graph. Called with mLock held.
+    bool hasPacketsInFlight();
+    // Sizes the pool so that every consumer can have its budget of packets in flight at once,
+    // whatever the others hold. Called with mLock held and no packets in flight.
+    void resizePool();
+    // The free list is a lock free stack, so clients returning packets never wait for the graph
+    // thread while it fills a buffer. The most recently freed buffer is reused first, which may
+    // be more cache efficient when it is accessed through the CPU.
+    uint32_t popFreeSlot();
+    void pushFreeSlot(uint32_t slot);
+    // Picks the consumers that get the next packet and counts it against their budgets, waiting
+    // for the blocking consumers that have no room. Returns a bit mask of the consumers.
+    uint32_t reserveConsumers();
+    bool tryReserve(Consumer& consumer);
+    // Takes a packet off the budget of the consumer.
+    void releaseConsumer(Consumer& consumer);
+    void releaseConsumers(uint32_t consumers);
+    // Whether every consumer with a budget has all of it in flight.
+    bool isCongested();
+    // Tells the engine when the stream becomes congested or stops being so.
+    void updateBackpressure();
+    bool isRunning();
+    // Hands a filled buffer to each of the consumers, with a reference for each.
+    void dispatchSlot(uint32_t slot, uint32_t consumers,
+                      std::shared_ptr<StreamEngineInterface> engine);
+
+    // Guards the configuration and the buffers lent to the graph. Clients returning packets do
+    // not take it.
     std::mutex mLock;
     std::mutex mStateLock;
     int mStreamId;
-    uint32_t mMaxInFlightPackets;
+    const BufferPlacement mPlacement;
     std::shared_ptr<StreamEngineInterface> mEngine;
 
-    struct BufferMetadata {
-        int outstandingRefCount;
-        std::shared_ptr<PixelMemHandle> handle;
-    };
-
-    std::map<int, BufferMetadata> mBuffersInUse;
-    std::vector<std::shared_ptr<PixelMemHandle>> mBuffersReady;
+    // Indexed by consumer id. Only changed while no packet is in flight.
+    std::unique_ptr<Consumer> mConsumers[kMaxConsumers];
+    // Signalled when a blocking consumer returns a packet or the stream stops.
+    std::mutex mFlowLock;
+    std::condition_variable mFlowSignal;
+    // Orders the backpressure notifications to the engine.
+    std::mutex mBackpressureLock;
+    std::atomic<bool> mCongested{false};
+
+    // Only resized while no packet is in flight.
+    std::vector<std::unique_ptr<BufferSlot>> mSlots;
+    // Index of the first free slot in the low 32 bits, and in the high 32 bits a count of the
+    // pushes, which keeps a thread that read a stale head from popping on top of it.
+    std::atomic<uint64_t> mFreeHead{kNoSlot};
+    // Slots of the buffers the graph is rendering into, which also count as in flight.
+    std::map<AHardwareBuffer*, uint32_t> mBuffersLent;
 };
 
 }  // namespace stream_manager
@@ -2,8 +2,10 @@
 
 #include <android-base/logging.h>
 
-#include <cstdlib>
+#include <algorithm>
+#include <atomic>
 #include <thread>
+#include <utility>
 
 #include "InputFrame.h"
 #include "types/Status.h"
@@ -23,11 +25,11 @@ uint64_t SemanticHandle::getTimeStamp() const {
 }
 
 uint32_t SemanticHandle::getSize() const {
-    return mSize;
+    return mData.size();
 }
 
 const char* SemanticHandle::getData() const {
-    return mData;
+    return mData.data();
 }
 
 AHardwareBuffer* SemanticHandle::getHardwareBuffer() const {
@@ -50,20 +52,59 @@ Status SemanticHandle::setMemInfo(int streamId, const char* data, uint32_t size,
         return INVALID_ARGUMENT;
     }
     mStreamId = streamId;
-    mData = (char*)malloc(size);
-    if (!mData) {
-        return NO_MEMORY;
+    // Reuses the storage of a recycled handle when it is large enough
+    mData.assign(data, size);
+    mType = type;
+    mTimestamp = timestamp;
+    return SUCCESS;
+}
+
+Status SemanticHandle::setMemInfo(int streamId, std::string&& data, uint64_t timestamp,
+                                  const proto::PacketType& type) {
+    if (data.empty() || data.size() > kMaxSemanticDataSize) {
+        return INVALID_ARGUMENT;
     }
-    memcpy(mData, data, size);
+    mStreamId = streamId;
+    mData = std::move(data);
     mType = type;
     mTimestamp = timestamp;
-    mSize = size;
     return SUCCESS;
 }
 
-/* Destroy local copy */
-SemanticHandle::~SemanticHandle() {
-    free(mData);
+void SemanticHandle::reserve(uint32_t size) {
+    mData.reserve(size);
+}
+
+std::shared_ptr<SemanticHandle> SemanticHandlePool::acquire(uint32_t payloadSize) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (payloadSize > mPayloadCapacity) {
+        uint32_t rounded = (payloadSize + kPayloadGranularity - 1) / kPayloadGranularity *
+                           kPayloadGranularity;
+        mPayloadCapacity = std::min(rounded, SemanticHandle::kMaxSemanticDataSize);
+    }
+
+    std::shared_ptr<SemanticHandle> handle;
+    for (const auto& pooled : mHandles) {
+        // Nobody else can take a new reference to a handle only the pool holds
+        if (pooled.use_count() == 1) {
+            // Pairs with the release of the last reference, so the previous
+            // user is done with the payload
+            std::atomic_thread_fence(std::memory_order_acquire);
+            handle = pooled;
+            break;
+        }
+    }
+    if (handle == nullptr) {
+        handle = std::make_shared<SemanticHandle>();
+        if (mHandles.size() < kMaxPooledHandles) {
+            mHandles.push_back(handle);
+        }
+    }
+
+    if (payloadSize > 0) {
+        handle->reserve(mPayloadCapacity);
+    }
+    return handle;
 }
 
 void SemanticManager::setEngineInterface(std::shared_ptr<StreamEngineInterface> engine) {
@@ -143,6 +184,16 @@ Status SemanticManager::freePacket(int /* bufferId */) {
     return SUCCESS;
 }
 
+Status SemanticManager::freePacket(int /* bufferId */, int /* consumerId */) {
+    return SUCCESS;
+}
+
+Status SemanticManager::addConsumer(int /* consumerId */, uint32_t /* maxInFlightPackets */,
+                                    DropPolicy /* policy */, PacketDispatcher /* dispatcher */) {
+    LOG(ERROR) << "Semantic streams cannot have consumers besides the client.";
+    return ILLEGAL_STATE;
+}
+
 Status SemanticManager::queuePacket(const char* data, const uint32_t size, uint64_t timestamp) {
     std::lock_guard<std::mutex> lock(mStateLock);
     // We drop the packet since we have received the stop notifications.
@@ -153,7 +204,7 @@ Status SemanticManager::queuePacket(const char* data, const uint32_t size, uint6
     if (mEngine == nullptr) {
         return INTERNAL_ERROR;
     }
-    auto memHandle = std::make_shared<SemanticHandle>();
+    auto memHandle = mHandlePool.acquire(size);
     auto status = memHandle->setMemInfo(mStreamId, data, size, timestamp, mType);
     if (status != SUCCESS) {
         return status;
@@ -162,11 +213,46 @@ Status SemanticManager::queuePacket(const char* data, const uint32_t size, uint6
     return SUCCESS;
 }
 
+Status SemanticManager::queuePacket(std::string&& data, uint64_t timestamp) {
+    std::lock_guard<std::mutex> lock(mStateLock);
+    // We drop the packet since we have received the stop notifications.
+    if (mState != RUNNING) {
+        return SUCCESS;
+    }
+    // Invalid state.
+    if (mEngine == nullptr) {
+        return INTERNAL_ERROR;
+    }
+    auto memHandle = mHandlePool.acquire(0);
+    auto status = memHandle->setMemInfo(mStreamId, std::move(data), timestamp, mType);
+    if (status != SUCCESS) {
+        return status;
+    }
+    mEngine->dispatchPacket(memHandle);
+    return SUCCESS;
+}
+
 Status SemanticManager::queuePacket(const InputFrame& /*inputData*/, uint64_t /*timestamp*/) {
     LOG(ERROR) << "Unexpected call to queue a pixel packet from a semantic stream manager.";
     return Status::ILLEGAL_STATE;
 }
 
+AHardwareBuffer* SemanticManager::acquireOutputBuffer(uint32_t /*width*/, uint32_t /*height*/,
+                                                      PixelFormat /*format*/) {
+    LOG(ERROR) << "Unexpected call to acquire a pixel buffer from a semantic stream manager.";
+    return nullptr;
+}
+
+Status SemanticManager::queueOutputBuffer(AHardwareBuffer* /*buffer*/, uint64_t /*timestamp*/) {
+    LOG(ERROR) << "Unexpected call to queue a pixel buffer to a semantic stream manager.";
+    return Status::ILLEGAL_STATE;
+}
+
+Status SemanticManager::releaseOutputBuffer(AHardwareBuffer* /*buffer*/) {
+    LOG(ERROR) << "Unexpected call to release a pixel buffer to a semantic stream manager.";
+    return Status::ILLEGAL_STATE;
+}
+
 std::shared_ptr<MemHandle> SemanticManager::clonePacket(std::shared_ptr<MemHandle> handle) {
     return handle;
 }
@@ -15,7 +15,10 @@
 #ifndef COMPUTEPIPE_RUNNER_STREAM_MANAGER_SEMANTIC_MANAGER_H
 #define COMPUTEPIPE_RUNNER_STREAM_MANAGER_SEMANTIC_MANAGER_H
 
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include "InputFrame.h"
 #include "OutputConfig.pb.h"
@@ -45,17 +48,43 @@ class SemanticHandle : public MemHandle {
     /* set info for the memory. Make a copy */
     Status setMemInfo(int streamId, const char* data, uint32_t size, uint64_t timestamp,
                       const proto::PacketType& type);
-    /* Destroy local copy */
-    ~SemanticHandle();
+    /* set info for the memory. Take over the data */
+    Status setMemInfo(int streamId, std::string&& data, uint64_t timestamp,
+                      const proto::PacketType& type);
+    /* Make room for a copied packet of up to size bytes */
+    void reserve(uint32_t size);
 
   private:
-    char* mData = nullptr;
-    uint32_t mSize;
+    std::string mData;
     uint64_t mTimestamp;
     proto::PacketType mType;
     int mStreamId;
 };
 
+/**
+ * Recycles the semantic handles of a stream along with their payload storage,
+ * so a stream emitting a packet per frame neither allocates nor frees memory
+ * once it has warmed up. A handle is reused once the pool holds the only
+ * reference to it. The storage grows to the largest packet seen on the stream,
+ * in steps of kPayloadGranularity, so a recycled handle fits the next packet.
+ */
+class SemanticHandlePool {
+  public:
+    static constexpr uint32_t kMaxPooledHandles = 8;
+    static constexpr uint32_t kPayloadGranularity = 64;
+    /**
+     * Retrieve a handle no one else holds. payloadSize is the size of the
+     * packet to be copied into it, or 0 if the handle takes over the packet's
+     * storage.
+     */
+    std::shared_ptr<SemanticHandle> acquire(uint32_t payloadSize);
+
+  private:
+    std::mutex mLock;
+    std::vector<std::shared_ptr<SemanticHandle>> mHandles;
+    uint32_t mPayloadCapacity = 0;
+};
+
 class SemanticManager : public StreamManager, StreamManagerInit {
   public:
     void setEngineInterface(std::shared_ptr<StreamEngineInterface> engine) override;
@@ -63,10 +92,21 @@ class SemanticManager : public StreamManager, StreamManagerInit {
     Status setMaxInFlightPackets(uint32_t maxPackets) override;
     /* Free previously dispatched packet. Once client has confirmed usage */
     Status freePacket(int bufferId) override;
+    Status freePacket(int bufferId, int consumerId) override;
+    /* Semantic packets only go to the client */
+    Status addConsumer(int consumerId, uint32_t maxInFlightPackets, DropPolicy policy,
+                       PacketDispatcher dispatcher) override;
     /* Queue packet produced by graph stream */
     Status queuePacket(const char* data, const uint32_t size, uint64_t timestamp) override;
+    /* Queue packet produced by graph stream, taking over its data */
+    Status queuePacket(std::string&& data, uint64_t timestamp) override;
     /* Queues an image packet produced by graph stream */
     Status queuePacket(const InputFrame& inputData, uint64_t timestamp) override;
+    /* Pixel buffers are not supported by semantic streams */
+    AHardwareBuffer* acquireOutputBuffer(uint32_t width, uint32_t height,
+                                         PixelFormat format) override;
+    Status queueOutputBuffer(AHardwareBuffer* buffer, uint64_t timestamp) override;
+    Status releaseOutputBuffer(AHardwareBuffer* buffer) override;
     /* Make a copy of the packet. */
     std::shared_ptr<MemHandle> clonePacket(std::shared_ptr<MemHandle> handle) override;
     /* Override handling of Runner Engine Events */
@@ -83,6 +123,7 @@ class SemanticManager : public StreamManager, StreamManagerInit {
     std::mutex mStateLock;
     int mStreamId;
     std::shared_ptr<StreamEngineInterface> mEngine;
+    SemanticHandlePool mHandlePool;
 };
 }  // namespace stream_manager
 }  // namespace runner
@@ -44,6 +44,12 @@ class StreamEngineInterface {
      * Notify engine of error
      */
     virtual void notifyError(std::string msg) = 0;
+    /**
+     * Notify engine that the consumers of the stream have run out of room for
+     * packets, or have room again. Called only when that changes.
+     */
+    virtual void notifyBackpressure(bool /* congested */) {
+    }
     virtual ~StreamEngineInterface() = default;
 };
 
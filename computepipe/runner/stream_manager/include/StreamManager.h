@@ -21,6 +21,7 @@
 
 #include "InputFrame.h"
 #include "MemHandle.h"
+#include "OffloadConfig.pb.h"
 #include "OutputConfig.pb.h"
 #include "RunnerComponent.h"
 #include "StreamEngineInterface.h"
@@ -39,8 +40,33 @@ namespace stream_manager {
  * description specified in OuputConfig.
  */
 
+/* What becomes of the packets a consumer of a stream has no room for */
+enum class DropPolicy {
+    /* The consumer misses them, and gets the next packet after it returns one. */
+    LATEST_WINS = 0,
+    /* The graph output waits until the consumer returns a packet. */
+    BLOCK = 1,
+};
+
+/* How the buffers of a pixel stream are allocated for the devices the graph runs on */
+struct BufferPlacement {
+    /* AHardwareBuffer usage bits of the devices besides the CPU that access the buffers */
+    uint64_t deviceUsage = 0;
+    /* Whether the graph writes the buffers it renders into from the CPU */
+    bool cpuRendering = true;
+
+    /* Placement for a graph offloaded to the devices of the option */
+    static BufferPlacement forOffload(const proto::OffloadOption& option);
+};
+
+/* Hands a packet to a consumer of a stream */
+using PacketDispatcher = std::function<Status(const std::shared_ptr<MemHandle>&)>;
+
 class StreamManager : public RunnerComponentInterface {
   public:
+    /* The consumer whose packets go out through StreamEngineInterface::dispatchPacket() */
+    static constexpr int kClientConsumer = 0;
+
     enum State {
         /* State on construction. */
         RESET = 0,
@@ -66,10 +92,33 @@ class StreamManager : public RunnerComponentInterface {
     virtual std::shared_ptr<MemHandle> clonePacket(std::shared_ptr<MemHandle> handle) = 0;
     /* Frees previously dispatched packet based on bufferID. Once client has confirmed usage */
     virtual Status freePacket(int bufferId) = 0;
+    /* Frees a packet the given consumer is done with */
+    virtual Status freePacket(int bufferId, int consumerId) = 0;
+    /**
+     * Adds a consumer of the stream besides the client. It gets its own budget of packets in
+     * flight and its own policy for packets it has no room for, so that a slow consumer only
+     * holds up the others if its policy is to block. Packets are handed to it through dispatcher,
+     * and come back through freePacket(bufferId, consumerId). Must be called before the stream
+     * runs.
+     */
+    virtual Status addConsumer(int consumerId, uint32_t maxInFlightPackets, DropPolicy policy,
+                               PacketDispatcher dispatcher) = 0;
     /* Queue's packet produced by graph stream */
     virtual Status queuePacket(const char* data, const uint32_t size, uint64_t timestamp) = 0;
+    /* Queue's packet produced by graph stream, taking over its data without a copy */
+    virtual Status queuePacket(std::string&& data, uint64_t timestamp) = 0;
     /* Queues a pixel stream packet produced by graph stream */
     virtual Status queuePacket(const InputFrame& pixelData, uint64_t timestamp) = 0;
+    /**
+     * Lends the graph an empty buffer to render a pixel stream packet into in place. Returns
+     * nullptr if the stream cannot spare a buffer, in which case the frame is dropped.
+     */
+    virtual AHardwareBuffer* acquireOutputBuffer(uint32_t width, uint32_t height,
+                                                 PixelFormat format) = 0;
+    /* Queues a packet the graph rendered into a buffer from acquireOutputBuffer() */
+    virtual Status queueOutputBuffer(AHardwareBuffer* buffer, uint64_t timestamp) = 0;
+    /* Takes back a buffer from acquireOutputBuffer() that the graph did not fill */
+    virtual Status releaseOutputBuffer(AHardwareBuffer* buffer) = 0;
     /* Destructor */
     virtual ~StreamManager() = default;
 
@@ -88,7 +137,8 @@ class StreamManagerFactory {
   public:
     std::unique_ptr<StreamManager> getStreamManager(const proto::OutputConfig& config,
                                                     std::shared_ptr<StreamEngineInterface> engine,
-                                                    uint32_t maxInFlightPackets);
+                                                    uint32_t maxInFlightPackets,
+                                                    const BufferPlacement& placement = {});
     StreamManagerFactory(const StreamManagerFactory&) = delete;
     StreamManagerFactory(const StreamManagerFactory&&) = delete;
     StreamManagerFactory& operator=(const StreamManagerFactory&&) = delete;
@@ -98,6 +98,17 @@ using namespace aidl::android::automotive::computepipe::runner;
     _aidl_status.set(AStatus_fromStatus(STATUS_UNKNOWN_TRANSACTION));
     return _aidl_status;
 }
+::ndk::ScopedAStatus FakeRunner::setPipeOutputSharedMemory(int32_t /*in_configId*/,
+                                                           int32_t /*in_slotSize*/) {
+    ::ndk::ScopedAStatus _aidl_status;
+    _aidl_status.set(AStatus_fromStatus(STATUS_UNKNOWN_TRANSACTION));
+    return _aidl_status;
+}
+::ndk::ScopedAStatus FakeRunner::prewarm() {
+    ::ndk::ScopedAStatus _aidl_status;
+    _aidl_status.set(AStatus_fromStatus(STATUS_UNKNOWN_TRANSACTION));
+    return _aidl_status;
+}
 }  // namespace tests
 }  // namespace computepipe
 }  // namespace automotive
@@ -55,6 +55,9 @@ class FakeRunner : public aidl::android::automotive::computepipe::runner::BnPipe
         std::shared_ptr<::aidl::android::automotive::computepipe::runner::IPipeDebugger>*
             _aidl_return) override;
     ::ndk::ScopedAStatus releaseRunner() override;
+    ::ndk::ScopedAStatus setPipeOutputSharedMemory(int32_t in_configId,
+                                                   int32_t in_slotSize) override;
+    ::ndk::ScopedAStatus prewarm() override;
     ~FakeRunner() {
         mOutputCallbacks.clear();
     }
@@ -0,0 +1,296 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the packet paths of the runner: pixel and semantic packets going through their stream
+// managers to a client that returns them at once, and input frames going through the graph
+// dispatcher of the engine to the graph. Run on a device with:
+//   atest computepipe_runner_benchmark
+// or, for machine-readable results to compare between builds:
+//   computepipe_runner_benchmark --benchmark_format=json --benchmark_out=<file>
+//
+// The time of each iteration is the time per packet. Counters:
+//   allocs_per_packet      heap allocations of the whole process per packet
+//   latency_p50/p99_us     time from queueing an input frame to the graph getting it
+
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "EventGenerator.h"
+#include "GraphDispatcher.h"
+#include "InputFrame.h"
+#include "MockEngine.h"
+#include "OutputConfig.pb.h"
+#include "StreamEngineInterface.h"
+#include "StreamManager.h"
+#include "types/Status.h"
+
+namespace {
+
+std::atomic<uint64_t> gAllocations = 0;
+
+}  // namespace
+
+// Counts every allocation of the process, including those of the threads the runner starts.
+void* operator new(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /* size */) noexcept {
+    std::free(ptr);
+}
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace {
+
+using engine::GraphDispatcher;
+using generator::DefaultEvent;
+using stream_manager::MockEngine;
+using stream_manager::StreamEngineInterface;
+using stream_manager::StreamManager;
+using stream_manager::StreamManagerFactory;
+
+// Client that returns each packet as soon as it gets it, and lets the benchmark keep the given
+// number of packets in flight.
+class ReturningClient : public StreamEngineInterface {
+  public:
+    explicit ReturningClient(uint32_t maxInFlight) : mMaxInFlight(maxInFlight) {
+    }
+
+    void setStreamManager(StreamManager* manager) {
+        mManager = manager;
+    }
+
+    // Waits for room for one more packet and counts it as sent.
+    void waitToSend() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mSignal.wait(lock, [this]() { return mSent - mReturned < mMaxInFlight; });
+        mSent++;
+    }
+
+    void waitForAllReturned() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mSignal.wait(lock, [this]() { return mReturned == mSent; });
+    }
+
+    void waitForEndOfStream() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mSignal.wait(lock, [this]() { return mEndOfStream; });
+    }
+
+    Status dispatchPacket(const std::shared_ptr<MemHandle>& data) override {
+        Status status = mManager->freePacket(data->getBufferId());
+        std::lock_guard<std::mutex> lock(mLock);
+        mReturned++;
+        mSignal.notify_all();
+        return status;
+    }
+
+    void notifyEndOfStream() override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEndOfStream = true;
+        mSignal.notify_all();
+    }
+
+    void notifyError(std::string /* msg */) override {
+    }
+
+  private:
+    const uint64_t mMaxInFlight;
+    StreamManager* mManager = nullptr;
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    uint64_t mSent = 0;
+    uint64_t mReturned = 0;
+    bool mEndOfStream = false;
+};
+
+struct StreamUnderTest {
+    std::shared_ptr<ReturningClient> client;
+    std::shared_ptr<MockEngine> engine;
+    std::unique_ptr<StreamManager> manager;
+};
+
+StreamUnderTest startStream(proto::PacketType type, uint32_t maxInFlight) {
+    StreamUnderTest stream;
+    stream.client = std::make_shared<ReturningClient>(maxInFlight);
+    stream.engine = std::make_shared<::testing::NiceMock<MockEngine>>();
+    stream.engine->delegateToFake(stream.client);
+
+    proto::OutputConfig config;
+    config.set_type(type);
+    config.set_stream_name("benchmark_stream");
+    StreamManagerFactory factory;
+    stream.manager = factory.getStreamManager(config, stream.engine, maxInFlight);
+    stream.client->setStreamManager(stream.manager.get());
+    (void)stream.manager->handleExecutionPhase(
+            DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN));
+    return stream;
+}
+
+void stopStream(StreamUnderTest& stream) {
+    stream.client->waitForAllReturned();
+    (void)stream.manager->handleStopImmediatePhase(
+            DefaultEvent::generateEntryEvent(DefaultEvent::Phase::STOP_IMMEDIATE));
+    // The manager signals the end of the stream from a thread of its own.
+    stream.client->waitForEndOfStream();
+}
+
+void setAllocsPerPacket(benchmark::State& state, uint64_t allocationsBefore) {
+    state.counters["allocs_per_packet"] = benchmark::Counter(
+            static_cast<double>(gAllocations.load() - allocationsBefore),
+            benchmark::Counter::kAvgIterations);
+}
+
+// Args: width, height, packets in flight.
+void BM_PixelStreamQueueAndFree(benchmark::State& state) {
+    const uint32_t width = state.range(0);
+    const uint32_t height = state.range(1);
+    StreamUnderTest stream = startStream(proto::PacketType::PIXEL_DATA, state.range(2));
+    std::vector<uint8_t> data(width * height * 4, 0x80);
+    InputFrame frame(height, width, PixelFormat::RGBA, width * 4, data.data());
+
+    uint64_t timestamp = 0;
+    uint64_t allocationsBefore = gAllocations.load();
+    for (auto _ : state) {
+        stream.client->waitToSend();
+        (void)stream.manager->queuePacket(frame, timestamp++);
+    }
+    stream.client->waitForAllReturned();
+    setAllocsPerPacket(state, allocationsBefore);
+    state.SetBytesProcessed(state.iterations() * data.size());
+    stopStream(stream);
+}
+
+BENCHMARK(BM_PixelStreamQueueAndFree)
+        ->ArgNames({"width", "height", "in_flight"})
+        ->Args({640, 480, 1})
+        ->Args({640, 480, 4})
+        ->Args({1280, 720, 1})
+        ->Args({1280, 720, 4})
+        ->Args({1920, 1080, 1})
+        ->Args({1920, 1080, 4})
+        ->UseRealTime();
+
+// Args: packet size in bytes.
+void BM_SemanticStreamQueueAndFree(benchmark::State& state) {
+    StreamUnderTest stream = startStream(proto::PacketType::SEMANTIC_DATA, 1);
+    std::string data(state.range(0), 'x');
+
+    uint64_t timestamp = 0;
+    uint64_t allocationsBefore = gAllocations.load();
+    for (auto _ : state) {
+        stream.client->waitToSend();
+        (void)stream.manager->queuePacket(data.c_str(), data.size(), timestamp++);
+    }
+    stream.client->waitForAllReturned();
+    setAllocsPerPacket(state, allocationsBefore);
+    state.SetBytesProcessed(state.iterations() * data.size());
+    stopStream(stream);
+}
+
+BENCHMARK(BM_SemanticStreamQueueAndFree)
+        ->ArgName("bytes")
+        ->Arg(16)
+        ->Arg(128)
+        ->Arg(512)
+        ->Arg(1024)
+        ->UseRealTime();
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+double percentileUs(std::vector<int64_t>& samples, int percentile) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = (samples.size() - 1) * percentile / 100;
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return static_cast<double>(samples[index]) / 1000;
+}
+
+// Args: width, height, frames in flight, whether the graph is reentrant.
+void BM_GraphDispatch(benchmark::State& state) {
+    const uint32_t width = state.range(0);
+    const uint32_t height = state.range(1);
+    std::vector<uint8_t> data(width * height * 4, 0x80);
+    InputFrame frame(height, width, PixelFormat::RGBA, width * 4, data.data());
+
+    std::mutex lock;
+    std::vector<int64_t> latencies;
+    latencies.reserve(1 << 20);
+    // Frames are queued with the time they were queued at as their timestamp.
+    GraphDispatcher dispatcher(state.range(2), state.range(3) != 0,
+                               [&](int, int64_t timestamp, const InputFrame&) {
+                                   int64_t latency = nowNs() - timestamp;
+                                   std::lock_guard<std::mutex> guard(lock);
+                                   if (latencies.size() < latencies.capacity()) {
+                                       latencies.push_back(latency);
+                                   }
+                                   return Status::SUCCESS;
+                               });
+    dispatcher.start();
+
+    uint64_t allocationsBefore = gAllocations.load();
+    for (auto _ : state) {
+        (void)dispatcher.queueFrame(0, nowNs(), frame);
+    }
+    dispatcher.stop(/* flush = */ true);
+    setAllocsPerPacket(state, allocationsBefore);
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.counters["latency_p50_us"] = percentileUs(latencies, 50);
+    state.counters["latency_p99_us"] = percentileUs(latencies, 99);
+}
+
+BENCHMARK(BM_GraphDispatch)
+        ->ArgNames({"width", "height", "in_flight", "reentrant"})
+        ->Args({640, 480, 1, 0})
+        ->Args({640, 480, 4, 0})
+        ->Args({640, 480, 4, 1})
+        ->Args({1920, 1080, 1, 0})
+        ->Args({1920, 1080, 4, 0})
+        ->Args({1920, 1080, 4, 1})
+        ->UseRealTime();
+
+}  // namespace
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+BENCHMARK_MAIN();
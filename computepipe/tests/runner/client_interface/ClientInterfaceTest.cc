@@ -18,9 +18,12 @@
 #include <aidl/android/automotive/computepipe/runner/BnPipeStateCallback.h>
 #include <aidl/android/automotive/computepipe/runner/BnPipeStream.h>
 #include <aidl/android/automotive/computepipe/runner/PipeState.h>
+#include <android-base/unique_fd.h>
 #include <android/binder_manager.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <utility>
 #include <vector>
@@ -52,6 +55,7 @@ using ::aidl::android::automotive::computepipe::runner::BnPipeStream;
 using ::aidl::android::automotive::computepipe::runner::IPipeRunner;
 using ::aidl::android::automotive::computepipe::runner::IPipeStateCallback;
 using ::aidl::android::automotive::computepipe::runner::PacketDescriptor;
+using ::aidl::android::automotive::computepipe::runner::PacketDescriptorPacketType;
 using ::aidl::android::automotive::computepipe::runner::PipeState;
 using ::android::automotive::computepipe::runner::tests::MockRunnerEvent;
 using ::android::automotive::computepipe::tests::MockMemHandle;
@@ -80,11 +84,25 @@ class StreamCallback : public BnPipeStream {
   public:
     ScopedAStatus deliverPacket(const PacketDescriptor& in_packet) override {
         data = std::string(in_packet.data.begin(), in_packet.data.end());
-        timestamp = in_packet.sourceTimeStampMillis;
+        timestampNanos = in_packet.sourceTimeStampNanos;
+        arrivalTimestampNanos = in_packet.arrivalTimeStampNanos;
+        type = in_packet.type;
+        bufId = in_packet.bufId;
+        size = in_packet.size;
+        if (!in_packet.dataFds.empty()) {
+            sharedFd.reset(dup(in_packet.dataFds[0].get()));
+        }
+        packetCount++;
         return ScopedAStatus::ok();
     }
     std::string data;
-    uint64_t timestamp;
+    int64_t timestampNanos;
+    int64_t arrivalTimestampNanos;
+    PacketDescriptorPacketType type;
+    int32_t bufId = -1;
+    int32_t size = 0;
+    android::base::unique_fd sharedFd;
+    int packetCount = 0;
 };
 
 class ClientInfo : public BnClientInfo {
@@ -104,6 +122,10 @@ class ClientInterface : public ::testing::Test {
         const std::string graphName = "graph " + std::to_string(++testIx);
         proto::Options options;
         options.set_graph_name(graphName);
+        proto::OutputConfig* output = options.add_output_configs();
+        output->set_stream_name("semantic");
+        output->set_type(proto::PacketType::SEMANTIC_DATA);
+        output->set_stream_id(0);
         mAidlClient = std::make_unique<AidlClient>(options, mEngine);
 
         // Register the instance with router.
@@ -390,11 +412,68 @@ TEST_F(ClientInterface, TestPacketDelivery) {
     EXPECT_CALL(*packet, getTimeStamp()).Times(AtLeast(1)).WillRepeatedly(Return(timestamp));
     EXPECT_CALL(*packet, getSize()).Times(AtLeast(1)).WillRepeatedly(Return(testData.size()));
     EXPECT_CALL(*packet, getData()).Times(AtLeast(1)).WillRepeatedly(Return(testData.c_str()));
-    EXPECT_EQ(
-        mAidlClient->dispatchPacketToClient(0, static_cast<std::shared_ptr<MemHandle>>(packet)),
-        Status::SUCCESS);
+    const int64_t arrivalTimeNs = 250;
+    EXPECT_EQ(mAidlClient->dispatchPacketToClient(
+                      0, static_cast<std::shared_ptr<MemHandle>>(packet), arrivalTimeNs),
+              Status::SUCCESS);
     EXPECT_EQ(streamCb->data, packet->getData());
-    EXPECT_EQ(streamCb->timestamp, packet->getTimeStamp());
+    // Packet timestamps are in microseconds, and reach the client in nanoseconds.
+    EXPECT_EQ(streamCb->timestampNanos, static_cast<int64_t>(timestamp) * 1000);
+    EXPECT_EQ(streamCb->arrivalTimestampNanos, arrivalTimeNs);
+}
+
+TEST_F(ClientInterface, TestSharedMemoryPacketDelivery) {
+    EXPECT_CALL(*mEngine, processClientConfigUpdate(_))
+        .Times(1)
+        .WillOnce(Return(Status::SUCCESS));
+    // Slots are recycled by the client interface, not the engine.
+    EXPECT_CALL(*mEngine, freePacket(_, _)).Times(0);
+
+    std::shared_ptr<StateChangeCallback> stateCallback =
+        ndk::SharedRefBase::make<StateChangeCallback>();
+    EXPECT_TRUE(mPipeRunner->init(stateCallback).isOk());
+
+    // Set up stream 0 with two slots of 64 bytes.
+    const int32_t slotSize = 64;
+    std::shared_ptr<StreamCallback> streamCb = ndk::SharedRefBase::make<StreamCallback>();
+    EXPECT_TRUE(mPipeRunner->setPipeOutputConfig(0, 2, streamCb).isOk());
+    EXPECT_TRUE(mPipeRunner->setPipeOutputSharedMemory(0, slotSize).isOk());
+    EXPECT_FALSE(mPipeRunner->setPipeOutputSharedMemory(0, slotSize).isOk());
+
+    const std::string testData = "Test String.";
+    std::shared_ptr<MockMemHandle> packet = std::make_unique<MockMemHandle>();
+    EXPECT_CALL(*packet, getType())
+        .WillRepeatedly(Return(proto::PacketType::SEMANTIC_DATA));
+    EXPECT_CALL(*packet, getTimeStamp()).WillRepeatedly(Return(100));
+    EXPECT_CALL(*packet, getSize()).WillRepeatedly(Return(testData.size()));
+    EXPECT_CALL(*packet, getData()).WillRepeatedly(Return(testData.c_str()));
+
+    // The first packet carries the shared memory and is found in slot 0.
+    EXPECT_EQ(mAidlClient->dispatchPacketToClient(0, packet, 0), Status::SUCCESS);
+    EXPECT_EQ(streamCb->type, PacketDescriptorPacketType::SEMANTIC_ZERO_COPY_DATA);
+    EXPECT_EQ(streamCb->bufId, 0);
+    EXPECT_EQ(streamCb->size, static_cast<int32_t>(testData.size()));
+    EXPECT_TRUE(streamCb->data.empty());
+    ASSERT_GE(streamCb->sharedFd.get(), 0);
+    void* ring = mmap(nullptr, 2 * slotSize, PROT_READ, MAP_SHARED, streamCb->sharedFd.get(), 0);
+    ASSERT_NE(ring, MAP_FAILED);
+    EXPECT_EQ(std::string(static_cast<const char*>(ring), streamCb->size), testData);
+
+    // The next one goes to slot 1, and the one after is dropped as both are in flight.
+    EXPECT_EQ(mAidlClient->dispatchPacketToClient(0, packet, 0), Status::SUCCESS);
+    EXPECT_EQ(streamCb->bufId, 1);
+    EXPECT_EQ(std::string(static_cast<const char*>(ring) + slotSize, streamCb->size), testData);
+    EXPECT_EQ(mAidlClient->dispatchPacketToClient(0, packet, 0), Status::SUCCESS);
+    EXPECT_EQ(streamCb->packetCount, 2);
+
+    // Returning slot 0 makes room again.
+    EXPECT_TRUE(mPipeRunner->doneWithPacket(0, 0).isOk());
+    EXPECT_FALSE(mPipeRunner->doneWithPacket(0, 0).isOk());
+    EXPECT_EQ(mAidlClient->dispatchPacketToClient(0, packet, 0), Status::SUCCESS);
+    EXPECT_EQ(streamCb->packetCount, 3);
+    EXPECT_EQ(streamCb->bufId, 0);
+
+    munmap(ring, 2 * slotSize);
 }
 
 }  // namespace
@@ -0,0 +1,231 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "GraphDispatcher.h"
+#include "InputFrame.h"
+#include "types/Status.h"
+
+using ::testing::ElementsAre;
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+namespace {
+
+constexpr uint32_t kWidth = 4;
+constexpr uint32_t kHeight = 4;
+constexpr uint32_t kStride = kWidth * 4;
+
+Status queueFrame(GraphDispatcher& dispatcher, int64_t timestamp, uint8_t value) {
+    std::vector<uint8_t> data(kStride * kHeight, value);
+    InputFrame frame(kHeight, kWidth, PixelFormat::RGBA, kStride, data.data());
+    return dispatcher.queueFrame(0, timestamp, frame);
+}
+
+TEST(GraphDispatcherTest, GraphReceivesACopyOfEachFrame) {
+    std::mutex lock;
+    std::vector<uint8_t> received;
+    GraphDispatcher dispatcher(2, false, [&](int, int64_t, const InputFrame& frame) {
+        std::lock_guard<std::mutex> guard(lock);
+        received.push_back(frame.getFramePtr()[kStride * kHeight - 1]);
+        return Status::SUCCESS;
+    });
+    dispatcher.start();
+
+    EXPECT_EQ(queueFrame(dispatcher, 1, 10), Status::SUCCESS);
+    EXPECT_EQ(queueFrame(dispatcher, 2, 20), Status::SUCCESS);
+    EXPECT_EQ(queueFrame(dispatcher, 3, 30), Status::SUCCESS);
+    dispatcher.stop(/* flush = */ true);
+
+    EXPECT_THAT(received, ElementsAre(10, 20, 30));
+    EXPECT_EQ(queueFrame(dispatcher, 4, 40), Status::ILLEGAL_STATE);
+}
+
+TEST(GraphDispatcherTest, FramesBeyondTheLimitWaitForTheGraph) {
+    std::atomic<bool> graphBlocked = true;
+    GraphDispatcher dispatcher(2, false, [&](int, int64_t, const InputFrame&) {
+        while (graphBlocked) {
+            usleep(1000);
+        }
+        return Status::SUCCESS;
+    });
+    dispatcher.start();
+
+    EXPECT_EQ(queueFrame(dispatcher, 1, 0), Status::SUCCESS);
+    EXPECT_EQ(queueFrame(dispatcher, 2, 0), Status::SUCCESS);
+
+    std::atomic<bool> thirdFrameQueued = false;
+    std::thread producer([&]() {
+        EXPECT_EQ(queueFrame(dispatcher, 3, 0), Status::SUCCESS);
+        thirdFrameQueued = true;
+    });
+    sleep(1);
+    EXPECT_FALSE(thirdFrameQueued);
+
+    graphBlocked = false;
+    producer.join();
+    EXPECT_TRUE(thirdFrameQueued);
+    dispatcher.stop(/* flush = */ true);
+}
+
+TEST(GraphDispatcherTest, ReentrantGraphIsCalledConcurrently) {
+    std::atomic<int> activeCalls = 0;
+    std::atomic<int> mostActiveCalls = 0;
+    GraphDispatcher dispatcher(3, true, [&](int, int64_t, const InputFrame&) {
+        int active = ++activeCalls;
+        int most = mostActiveCalls;
+        while (active > most && !mostActiveCalls.compare_exchange_weak(most, active)) {
+        }
+        usleep(200000);
+        --activeCalls;
+        return Status::SUCCESS;
+    });
+    dispatcher.start();
+
+    for (int64_t timestamp = 1; timestamp <= 3; timestamp++) {
+        EXPECT_EQ(queueFrame(dispatcher, timestamp, 0), Status::SUCCESS);
+    }
+    dispatcher.stop(/* flush = */ true);
+
+    EXPECT_EQ(mostActiveCalls, 3);
+}
+
+TEST(GraphDispatcherTest, OutputOfAReentrantGraphLeavesInTimestampOrder) {
+    std::mutex lock;
+    std::vector<int64_t> outputs;
+    GraphDispatcher* dispatcherPtr = nullptr;
+    GraphDispatcher dispatcher(2, true, [&](int, int64_t timestamp, const InputFrame&) {
+        // The older frame takes longer, so its output is ready last.
+        if (timestamp == 1) {
+            usleep(300000);
+        }
+        dispatcherPtr->waitForOutputTurn(timestamp);
+        std::lock_guard<std::mutex> guard(lock);
+        outputs.push_back(timestamp);
+        return Status::SUCCESS;
+    });
+    dispatcherPtr = &dispatcher;
+    dispatcher.start();
+
+    EXPECT_EQ(queueFrame(dispatcher, 1, 0), Status::SUCCESS);
+    EXPECT_EQ(queueFrame(dispatcher, 2, 0), Status::SUCCESS);
+    dispatcher.stop(/* flush = */ true);
+
+    EXPECT_THAT(outputs, ElementsAre(1, 2));
+}
+
+TEST(GraphDispatcherTest, StopWithoutFlushDropsQueuedFrames) {
+    std::atomic<bool> graphBlocked = true;
+    std::atomic<int> calls = 0;
+    GraphDispatcher dispatcher(3, false, [&](int, int64_t, const InputFrame&) {
+        ++calls;
+        while (graphBlocked) {
+            usleep(1000);
+        }
+        return Status::SUCCESS;
+    });
+    dispatcher.start();
+
+    for (int64_t timestamp = 1; timestamp <= 3; timestamp++) {
+        EXPECT_EQ(queueFrame(dispatcher, timestamp, 0), Status::SUCCESS);
+    }
+    sleep(1);
+
+    std::thread stopper([&]() { dispatcher.stop(/* flush = */ false); });
+    sleep(1);
+    graphBlocked = false;
+    stopper.join();
+
+    EXPECT_EQ(calls, 1);
+}
+
+TEST(GraphDispatcherTest, FlushPastItsDeadlineDropsQueuedFrames) {
+    std::atomic<bool> graphBlocked = true;
+    std::atomic<int> calls = 0;
+    GraphDispatcher dispatcher(3, false, [&](int, int64_t, const InputFrame&) {
+        ++calls;
+        while (graphBlocked) {
+            usleep(1000);
+        }
+        return Status::SUCCESS;
+    });
+    dispatcher.start();
+
+    for (int64_t timestamp = 1; timestamp <= 3; timestamp++) {
+        EXPECT_EQ(queueFrame(dispatcher, timestamp, 0), Status::SUCCESS);
+    }
+    sleep(1);
+
+    size_t discarded = 0;
+    std::thread stopper([&]() {
+        discarded = dispatcher.stop(/* flush = */ true, std::chrono::steady_clock::now() +
+                                                                std::chrono::milliseconds(100));
+    });
+    sleep(1);
+    graphBlocked = false;
+    stopper.join();
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(discarded, 2u);
+}
+
+TEST(GraphDispatcherTest, FrameSetsReachTheGraphInOneCall) {
+    std::vector<std::pair<int, uint8_t>> received;
+    std::atomic<int> singleFrames = 0;
+    GraphDispatcher dispatcher(
+            1, false,
+            [&](int, int64_t, const InputFrame&) {
+                ++singleFrames;
+                return Status::SUCCESS;
+            },
+            [&](int64_t timestamp, const InputFrameSet& frames) {
+                EXPECT_EQ(timestamp, 5);
+                for (const auto& [streamId, frame] : frames) {
+                    received.emplace_back(streamId, frame->getFramePtr()[0]);
+                }
+                return Status::SUCCESS;
+            });
+    dispatcher.start();
+
+    std::vector<uint8_t> front(kStride * kHeight, 10);
+    std::vector<uint8_t> rear(kStride * kHeight, 20);
+    InputFrame frontFrame(kHeight, kWidth, PixelFormat::RGBA, kStride, front.data());
+    InputFrame rearFrame(kHeight, kWidth, PixelFormat::RGBA, kStride, rear.data());
+    EXPECT_EQ(dispatcher.queueFrameSet(5, {{1, &frontFrame}, {2, &rearFrame}}), Status::SUCCESS);
+    dispatcher.stop(/* flush = */ true);
+
+    EXPECT_THAT(received, ElementsAre(std::pair<int, uint8_t>(1, 10),
+                                      std::pair<int, uint8_t>(2, 20)));
+    EXPECT_EQ(singleFrames, 0);
+}
+
+}  // namespace
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,102 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "PhaseBroadcaster.h"
+
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+namespace {
+
+struct FakeComponent {
+    Status status = Status::SUCCESS;
+};
+
+TEST(PhaseBroadcasterTest, HandlersOfAGroupRunAtOnce) {
+    PhaseBroadcaster broadcaster;
+    std::mutex lock;
+    std::condition_variable signal;
+    int arrived = 0;
+    // Each handler waits for the other, which only returns in time if they run
+    // at the same time.
+    auto meet = [&]() {
+        std::unique_lock<std::mutex> guard(lock);
+        arrived++;
+        signal.notify_all();
+        bool met = signal.wait_for(guard, std::chrono::seconds(5), [&]() { return arrived == 2; });
+        return met ? Status::SUCCESS : Status::INTERNAL_ERROR;
+    };
+
+    std::vector<PhaseBroadcaster::Handler> handlers;
+    handlers.push_back({"stream 0", meet});
+    handlers.push_back({"stream 1", meet});
+    EXPECT_THAT(broadcaster.broadcast("run", std::move(handlers)),
+                ElementsAre(Status::SUCCESS, Status::SUCCESS));
+}
+
+TEST(PhaseBroadcasterTest, ComponentsThatSucceededAreReported) {
+    PhaseBroadcaster broadcaster;
+    std::map<int, std::unique_ptr<FakeComponent>> components;
+    components[0] = std::make_unique<FakeComponent>();
+    components[1] = std::make_unique<FakeComponent>();
+    components[1]->status = Status::INTERNAL_ERROR;
+    components[2] = std::make_unique<FakeComponent>();
+
+    std::vector<int> succeeded;
+    Status status = broadcaster.broadcast(
+            "run", "input", components,
+            [](FakeComponent& component) { return component.status; }, &succeeded);
+
+    EXPECT_EQ(status, Status::INTERNAL_ERROR);
+    EXPECT_THAT(succeeded, ElementsAre(0, 2));
+}
+
+TEST(PhaseBroadcasterTest, DebugInfoHasEveryComponentOfEveryPhase) {
+    PhaseBroadcaster broadcaster;
+    std::map<int, std::unique_ptr<FakeComponent>> components;
+    components[3] = std::make_unique<FakeComponent>();
+    auto handler = [](FakeComponent& component) { return component.status; };
+
+    EXPECT_EQ(broadcaster.broadcast("run", "stream", components, handler), Status::SUCCESS);
+    EXPECT_EQ(broadcaster.run("run", "graph", []() { return Status::SUCCESS; }),
+              Status::SUCCESS);
+    EXPECT_EQ(broadcaster.broadcast("halt", "stream", components, handler), Status::SUCCESS);
+
+    std::string info = broadcaster.getDebugInfo();
+    EXPECT_THAT(info, HasSubstr("phase run stream 3: us "));
+    EXPECT_THAT(info, HasSubstr("phase run graph: us "));
+    EXPECT_THAT(info, HasSubstr("phase halt stream 3: us "));
+}
+
+}  // namespace
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,94 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "StageProfiler.h"
+
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace engine {
+namespace {
+
+TEST(StageProfilerTest, NothingIsRecordedWhileDisabled) {
+    StageProfiler profiler;
+    profiler.configureStreams({0}, {1});
+
+    profiler.record(StageProfiler::INPUT_DISPATCH, 0, StageProfiler::Clock::now());
+    profiler.markInput(10);
+    profiler.markOutput(1, 10);
+
+    EXPECT_EQ(profiler.getDebugInfo(), "");
+}
+
+TEST(StageProfilerTest, StagesAreRecordedPerStream) {
+    StageProfiler profiler;
+    profiler.configureStreams({0}, {1, 2});
+    profiler.start();
+
+    profiler.record(StageProfiler::INPUT_DISPATCH, 0, StageProfiler::Clock::now());
+    profiler.markInput(10);
+    usleep(2000);
+    profiler.markOutput(1, 10);
+    profiler.markOutput(2, 10);
+    // Unknown streams and timestamps are ignored.
+    profiler.markOutput(3, 10);
+    profiler.markOutput(1, 20);
+
+    std::string info = profiler.getDebugInfo();
+    EXPECT_THAT(info, HasSubstr("stream 0 input_dispatch: count 1"));
+    EXPECT_THAT(info, HasSubstr("stream 1 graph_latency: count 1"));
+    EXPECT_THAT(info, HasSubstr("stream 2 graph_latency: count 1"));
+    EXPECT_THAT(info, Not(HasSubstr("stream 3")));
+}
+
+TEST(StageProfilerTest, ClientReturnIsCountedOncePerDelivery) {
+    StageProfiler profiler;
+    profiler.configureStreams({}, {1});
+    profiler.start();
+
+    profiler.markDelivered(1, 5);
+    usleep(1000);
+    profiler.markReturned(1, 5);
+    profiler.markReturned(1, 5);
+    profiler.markReturned(1, 6);
+
+    EXPECT_THAT(profiler.getDebugInfo(), HasSubstr("stream 1 client_return: count 1,"));
+}
+
+TEST(StageProfilerTest, StartClearsPreviousSamples) {
+    StageProfiler profiler;
+    profiler.configureStreams({0}, {});
+    profiler.start();
+    profiler.record(StageProfiler::INPUT_DISPATCH, 0, StageProfiler::Clock::now());
+    profiler.stop();
+    EXPECT_THAT(profiler.getDebugInfo(), HasSubstr("count 1,"));
+
+    profiler.start();
+    EXPECT_EQ(profiler.getDebugInfo(), "");
+}
+
+}  // namespace
+}  // namespace engine
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
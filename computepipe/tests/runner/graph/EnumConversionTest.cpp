@@ -44,7 +44,11 @@ enum PrebuiltComputepipeRunner_PixelDataFormat {
     RGB = 0,
     RGBA = 1,
     GRAY = 2,
-    PIXEL_DATA_FORMAT_MAX = 3,
+    NV12 = 3,
+    NV21 = 4,
+    YUV420 = 5,
+    RGB_PLANAR_FLOAT = 6,
+    PIXEL_DATA_FORMAT_MAX = 7,
 };
 TEST(EnumConversionTest, PixelFormatEnums) {
     EXPECT_EQ(static_cast<int>(PrebuiltComputepipeRunner_PixelDataFormat::RGB),
@@ -52,6 +56,12 @@ TEST(EnumConversionTest, PixelFormatEnums) {
     EXPECT_EQ(static_cast<int>(PrebuiltComputepipeRunner_PixelDataFormat::RGBA),
               static_cast<int>(PixelFormat::RGBA));
     EXPECT_EQ(PrebuiltComputepipeRunner_PixelDataFormat::GRAY, static_cast<int>(PixelFormat::GRAY));
+    EXPECT_EQ(PrebuiltComputepipeRunner_PixelDataFormat::NV12, static_cast<int>(PixelFormat::NV12));
+    EXPECT_EQ(PrebuiltComputepipeRunner_PixelDataFormat::NV21, static_cast<int>(PixelFormat::NV21));
+    EXPECT_EQ(PrebuiltComputepipeRunner_PixelDataFormat::YUV420,
+              static_cast<int>(PixelFormat::YUV420));
+    EXPECT_EQ(PrebuiltComputepipeRunner_PixelDataFormat::RGB_PLANAR_FLOAT,
+              static_cast<int>(PixelFormat::RGB_PLANAR_FLOAT));
     EXPECT_EQ(PrebuiltComputepipeRunner_PixelDataFormat::PIXEL_DATA_FORMAT_MAX,
               static_cast<int>(PixelFormat::PIXELFORMAT_MAX));
 }
@@ -0,0 +1,87 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "GraphCache.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace graph {
+namespace {
+
+bool Exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+void WriteFile(const std::string& path, size_t size) {
+    ASSERT_TRUE(android::base::WriteStringToFile(std::string(size, 'x'), path));
+}
+
+TEST(GraphCacheTest, DirectoryIsKeptAcrossRuns) {
+    android::base::TemporaryDir root;
+    GraphCache cache(root.path);
+
+    std::string dir = cache.prepareDirectory("/system/lib64/libgraph.so", "1.0");
+    ASSERT_EQ(dir, std::string(root.path) + "/libgraph.so/1.0");
+    WriteFile(dir + "/model", 16);
+
+    EXPECT_EQ(cache.prepareDirectory("/system/lib64/libgraph.so", "1.0"), dir);
+    EXPECT_TRUE(Exists(dir + "/model"));
+}
+
+TEST(GraphCacheTest, NewVersionDropsStateOfOldVersion) {
+    android::base::TemporaryDir root;
+    GraphCache cache(root.path);
+
+    std::string oldDir = cache.prepareDirectory("libgraph.so", "1.0");
+    WriteFile(oldDir + "/model", 16);
+
+    std::string newDir = cache.prepareDirectory("libgraph.so", "2.0/beta");
+    EXPECT_EQ(newDir, std::string(root.path) + "/libgraph.so/2.0_beta");
+    EXPECT_TRUE(Exists(newDir));
+    EXPECT_FALSE(Exists(oldDir));
+}
+
+TEST(GraphCacheTest, LeastRecentlyUsedLibraryIsEvicted) {
+    android::base::TemporaryDir root;
+    GraphCache cache(root.path, /* maxSizeBytes = */ 100);
+
+    std::string firstDir = cache.prepareDirectory("libfirst.so", "1");
+    WriteFile(firstDir + "/model", 60);
+    // Modification times need to differ for the order of use to be known.
+    sleep(1);
+    std::string secondDir = cache.prepareDirectory("libsecond.so", "1");
+    WriteFile(secondDir + "/model", 60);
+    sleep(1);
+
+    std::string thirdDir = cache.prepareDirectory("libthird.so", "1");
+    EXPECT_FALSE(Exists(firstDir));
+    EXPECT_TRUE(Exists(secondDir + "/model"));
+    EXPECT_TRUE(Exists(thirdDir));
+}
+
+}  // namespace
+}  // namespace graph
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -17,6 +17,7 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <android-base/logging.h>
 #include <grpc++/grpc++.h>
@@ -72,6 +73,8 @@ public:
     bool waitForTermination() { return mEngine->waitForTermination(); }
 
     int numPacketsForStream(int streamId) { return mEngine->numPacketsForStream(streamId); }
+
+    GrpcGraphServerImpl* server() { return mServer.get(); }
 };
 
 class TestRunnerEvent : public runner::RunnerEvent {
@@ -148,10 +151,33 @@ TEST_F(GrpcGraphTest, GraphStopCallbackProducedOnFlushedStopWithNoOutputStreams)
     EXPECT_TRUE(waitForTermination());
 }
 
-TEST_F(GrpcGraphTest, SetInputStreamsFailAsExpected) {
+TEST_F(GrpcGraphTest, SetInputStreamsFailWhenGraphIsNotRunning) {
     runner::InputFrame frame(0, 0, static_cast<PixelFormat>(0), 0, nullptr);
-    EXPECT_EQ(mGrpcGraph->SetInputStreamData(0, 0, ""), Status::FATAL_ERROR);
-    EXPECT_EQ(mGrpcGraph->SetInputStreamPixelData(0, 0, frame), Status::FATAL_ERROR);
+    EXPECT_EQ(mGrpcGraph->SetInputStreamData(0, 0, ""), Status::ILLEGAL_STATE);
+    EXPECT_EQ(mGrpcGraph->SetInputStreamPixelData(0, 0, frame), Status::ILLEGAL_STATE);
+}
+
+TEST_F(GrpcGraphTest, InputStreamsReachTheGraphBeforeItStops) {
+    std::map<int, int> outputConfigs = {};
+    runner::ClientConfig clientConfig(0, 0, 0, outputConfigs, proto::ProfilingType::DISABLED);
+    EXPECT_EQ(mGrpcGraph->handleConfigPhase(clientConfig), Status::SUCCESS);
+    EXPECT_TRUE(mGrpcGraph->AcceptsInputStreams());
+
+    TestRunnerEvent e;
+    EXPECT_EQ(mGrpcGraph->handleExecutionPhase(e), Status::SUCCESS);
+
+    // Larger than a grpc message may be, so the frame goes in chunks.
+    std::vector<uint8_t> pixels(1280 * 4 * 720, 7);
+    runner::InputFrame frame(720, 1280, PixelFormat::RGBA, 1280 * 4, pixels.data());
+    EXPECT_EQ(mGrpcGraph->SetInputStreamPixelData(0, 1, frame), Status::SUCCESS);
+    EXPECT_EQ(mGrpcGraph->SetInputStreamPixelData(0, 2, frame), Status::SUCCESS);
+    EXPECT_EQ(mGrpcGraph->SetInputStreamData(1, 2, kOutputStreamPacket), Status::SUCCESS);
+
+    EXPECT_EQ(mGrpcGraph->handleStopWithFlushPhase(e), Status::SUCCESS);
+    EXPECT_TRUE(waitForTermination());
+    EXPECT_EQ(server()->numInputFrames(), 2);
+    EXPECT_EQ(server()->numInputFrameBytes(), static_cast<int>(2 * pixels.size()));
+    EXPECT_EQ(server()->numInputDataPackets(), 1);
 }
 
 }  // namespace
@@ -17,6 +17,7 @@
 #ifndef CPP_COMPUTEPIPE_TESTS_RUNNER_GRAPH_INCLUDES_GRPCGRAPHSERVERIMPL_H_
 #define CPP_COMPUTEPIPE_TESTS_RUNNER_GRAPH_INCLUDES_GRPCGRAPHSERVERIMPL_H_
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
@@ -59,6 +60,9 @@ private:
     std::mutex mLock;
     std::condition_variable mShutdownCv;
     bool mShutdown = false;
+    std::atomic<int> mInputFrames = 0;
+    std::atomic<int> mInputFrameBytes = 0;
+    std::atomic<int> mInputDataPackets = 0;
 
 public:
     explicit GrpcGraphServerImpl(std::string address) : mServerAddress(address) {}
@@ -93,9 +97,44 @@ public:
         proto::Options options;
         options.set_graph_name(kGraphName);
         response->set_serialized_options(options.SerializeAsString());
+        response->set_accepts_input_streams(true);
         return ::grpc::Status::OK;
     }
 
+    // Counts the input frames once all of their chunks have arrived.
+    ::grpc::Status FeedInputStream(
+            ::grpc::ServerContext* context,
+            ::grpc::ServerReaderWriter<proto::InputStreamResponse, proto::InputStreamRequest>*
+                    stream) override {
+        proto::InputStreamRequest request;
+        int remainingChunks = 0;
+        int frameBytes = 0;
+        while (stream->Read(&request)) {
+            if (request.has_semantic_data()) {
+                mInputDataPackets++;
+                continue;
+            }
+            if (request.has_pixel_data()) {
+                remainingChunks = request.remaining_chunks();
+                frameBytes = request.pixel_data().data().size();
+            } else if (request.has_pixel_chunk()) {
+                remainingChunks--;
+                frameBytes += request.pixel_chunk().size();
+            }
+            if (remainingChunks == 0) {
+                mInputFrames++;
+                mInputFrameBytes += frameBytes;
+            }
+        }
+        return ::grpc::Status::OK;
+    }
+
+    int numInputFrames() { return mInputFrames; }
+
+    int numInputFrameBytes() { return mInputFrameBytes; }
+
+    int numInputDataPackets() { return mInputDataPackets; }
+
     ::grpc::Status SetGraphConfig(::grpc::ServerContext* context,
                                   const proto::SetGraphConfigRequest* request,
                                   proto::StatusResponse* response) override {
@@ -207,6 +246,17 @@ public:
         mCv.notify_one();
     }
 
+    // Remote graphs only send pixel data.
+    AHardwareBuffer* AcquirePixelBuffer(int, uint32_t, uint32_t, PixelFormat) override {
+        return nullptr;
+    }
+
+    void DispatchPixelBuffer(int, int64_t, AHardwareBuffer*) override {
+    }
+
+    void ReleasePixelBuffer(int, AHardwareBuffer*) override {
+    }
+
     bool waitForTermination() {
         std::unique_lock lock(mLock);
         if (!mGraphTerminated) {
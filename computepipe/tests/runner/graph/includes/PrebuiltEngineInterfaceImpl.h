@@ -61,6 +61,17 @@ public:
         mGraphTerminationCallbackFn(status, std::move(msg));
     }
 
+    // The stub graph does not render into runner buffers.
+    AHardwareBuffer* AcquirePixelBuffer(int, uint32_t, uint32_t, PixelFormat) override {
+        return nullptr;
+    }
+
+    void DispatchPixelBuffer(int, int64_t, AHardwareBuffer*) override {
+    }
+
+    void ReleasePixelBuffer(int, AHardwareBuffer*) override {
+    }
+
     void SetPixelCallback(PixelCallback callback) { mPixelCallbackFn = callback; }
 
     void SetSerializedStreamCallback(SerializedStreamCallback callback) {
@@ -19,6 +19,10 @@
 #include <vndk/hardware_buffer.h>
 #include <android-base/logging.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 #include "EventGenerator.h"
 #include "InputFrame.h"
 #include "MockEngine.h"
@@ -194,6 +198,46 @@ TEST(PixelMemHandleTest, CreatesBuffersOfExpectedFormats) {
     EXPECT_THAT(yHandle.getHardwareBuffer(), ContainsDataFromFrame(&yFrame));
 }
 
+TEST(PixelMemHandleTest, CopiesYuvFramesIntoThePlanesOfTheBuffer) {
+    // An NV21 frame with a luma plane of 10s, V samples of 20s and U samples of 30s.
+    std::vector<uint8_t> data(16 * 16 * 3 / 2, 10);
+    for (size_t i = 16 * 16; i < data.size(); i += 2) {
+        data[i] = 20;
+        data[i + 1] = 30;
+    }
+    InputFrame frame(16, 16, PixelFormat::NV21, 16, &data[0]);
+    PixelMemHandle memHandle(10, 1, AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN);
+    ASSERT_EQ(memHandle.setFrameData(100, frame), Status::SUCCESS);
+
+    AHardwareBuffer_Desc desc;
+    AHardwareBuffer_describe(memHandle.getHardwareBuffer(), &desc);
+    EXPECT_EQ(desc.format, AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420);
+
+    // Whatever layout the allocator picked, the samples land in their planes.
+    AHardwareBuffer_Planes planes;
+    ASSERT_EQ(AHardwareBuffer_lockPlanes(memHandle.getHardwareBuffer(),
+                                         AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN, -1, nullptr, &planes),
+              0);
+    ASSERT_EQ(planes.planeCount, 3);
+    for (int y = 0; y < 16; y++) {
+        for (int x = 0; x < 16; x++) {
+            EXPECT_EQ(static_cast<uint8_t*>(
+                          planes.planes[0].data)[y * planes.planes[0].rowStride + x], 10);
+        }
+    }
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            EXPECT_EQ(static_cast<uint8_t*>(planes.planes[1].data)[y * planes.planes[1].rowStride +
+                                                                   x * planes.planes[1].pixelStride],
+                      30);
+            EXPECT_EQ(static_cast<uint8_t*>(planes.planes[2].data)[y * planes.planes[2].rowStride +
+                                                                   x * planes.planes[2].pixelStride],
+                      20);
+        }
+    }
+    AHardwareBuffer_unlock(memHandle.getHardwareBuffer(), nullptr);
+}
+
 std::pair<std::shared_ptr<MockEngine>, std::unique_ptr<StreamManager>> CreateStreamManagerAndEngine(
     int maxInFlightPackets) {
     StreamManagerFactory factory;
@@ -207,6 +251,20 @@ std::pair<std::shared_ptr<MockEngine>, std::unique_ptr<StreamManager>> CreateStr
     return std::pair(mockEngine, std::move(manager));
 }
 
+TEST(PixelMemHandleTest, BuffersRenderedOnTheGpuAreNotMappedForTheCpu) {
+    proto::OffloadOption option;
+    option.add_offload_types(proto::OffloadOption::GPU);
+    PixelMemHandle memHandle(0, 1, 0, BufferPlacement::forOffload(option));
+
+    ASSERT_EQ(memHandle.prepareBuffer(16, 16, PixelFormat::RGBA), Status::SUCCESS);
+    ASSERT_NE(memHandle.getHardwareBuffer(), nullptr);
+
+    AHardwareBuffer_Desc desc;
+    AHardwareBuffer_describe(memHandle.getHardwareBuffer(), &desc);
+    EXPECT_EQ(desc.usage,
+              AHARDWAREBUFFER_USAGE_GPU_COLOR_OUTPUT | AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE);
+}
+
 TEST(PixelStreamManagerTest, PacketQueueingProducesACallback) {
     // Create stream manager
     int maxInFlightPackets = 1;
@@ -317,6 +375,33 @@ TEST(PixelStreamManagerTest, DoneWithPacketCallReleasesAPacket) {
     EXPECT_THAT(memHandle->getTimeStamp(), 30);
 }
 
+TEST(PixelStreamManagerTest, EngineIsToldWhenTheClientRunsOutOfRoom) {
+    int maxInFlightPackets = 2;
+    auto [mockEngine, manager] = CreateStreamManagerAndEngine(maxInFlightPackets);
+
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+    std::vector<uint8_t> data(16 * 16 * 3, 100);
+    InputFrame frame(16, 16, PixelFormat::RGB, 16 * 3, &data[0]);
+
+    std::shared_ptr<MemHandle> memHandle;
+    EXPECT_CALL((*mockEngine), dispatchPacket)
+        .Times(2)
+        .WillRepeatedly(testing::DoAll(testing::SaveArg<0>(&memHandle), (Return(Status::SUCCESS))));
+    // Only changes of the state are reported, so the dropped third packet reports nothing.
+    testing::InSequence sequence;
+    EXPECT_CALL((*mockEngine), notifyBackpressure(true)).Times(1);
+    EXPECT_CALL((*mockEngine), notifyBackpressure(false)).Times(1);
+
+    EXPECT_EQ(manager->queuePacket(frame, 10), Status::SUCCESS);
+    EXPECT_EQ(manager->queuePacket(frame, 20), Status::SUCCESS);
+    EXPECT_EQ(manager->queuePacket(frame, 30), Status::SUCCESS);
+    sleep(1);
+    ASSERT_NE(memHandle, nullptr);
+    EXPECT_THAT(manager->freePacket(memHandle->getBufferId()), Status::SUCCESS);
+}
+
 TEST(PixelStreamManagerTest, EngineReceivesEndOfStreamCallbackOnStoppage) {
     int maxInFlightPackets = 1;
     auto [mockEngine, manager] = CreateStreamManagerAndEngine(maxInFlightPackets);
@@ -384,6 +469,188 @@ TEST(PixelStreamManagerTest, MultipleFreePacketReleasesPacketAfterClone) {
     EXPECT_THAT(memHandle->getTimeStamp(), 30);
 }
 
+TEST(PixelStreamManagerTest, QueuedOutputBufferIsDispatchedWithoutACopy) {
+    int maxInFlightPackets = 1;
+    auto [mockEngine, manager] = CreateStreamManagerAndEngine(maxInFlightPackets);
+
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+
+    AHardwareBuffer* buffer = manager->acquireOutputBuffer(16, 16, PixelFormat::RGB);
+    ASSERT_NE(buffer, nullptr);
+
+    AHardwareBuffer_Desc desc;
+    AHardwareBuffer_describe(buffer, &desc);
+    EXPECT_EQ(desc.width, 16);
+    EXPECT_EQ(desc.height, 16);
+    EXPECT_EQ(desc.format, AHardwareBuffer_Format::AHARDWAREBUFFER_FORMAT_R8G8B8_UNORM);
+
+    // Render the frame into the buffer the way a graph would.
+    std::vector<uint8_t> data(16 * 16 * 3, 100);
+    InputFrame frame(16, 16, PixelFormat::RGB, 16 * 3, &data[0]);
+    void* mappedBuffer = nullptr;
+    ASSERT_EQ(AHardwareBuffer_lock(buffer, AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN, -1, nullptr,
+                                   &mappedBuffer),
+              0);
+    for (int y = 0; y < 16; y++) {
+        memcpy((uint8_t*)mappedBuffer + y * desc.stride * 3, &data[y * 16 * 3], 16 * 3);
+    }
+    AHardwareBuffer_unlock(buffer, nullptr);
+
+    std::shared_ptr<MemHandle> memHandle;
+    EXPECT_CALL((*mockEngine), dispatchPacket)
+        .WillOnce(testing::DoAll(testing::SaveArg<0>(&memHandle), (Return(Status::SUCCESS))));
+
+    EXPECT_EQ(manager->queueOutputBuffer(buffer, 10), Status::SUCCESS);
+    sleep(1);
+    ASSERT_NE(memHandle, nullptr);
+    EXPECT_EQ(memHandle->getHardwareBuffer(), buffer);
+    EXPECT_THAT(memHandle->getHardwareBuffer(), ContainsDataFromFrame(&frame));
+    EXPECT_THAT(memHandle->getTimeStamp(), 10);
+    EXPECT_THAT(memHandle->getStreamId(), 0);
+
+    // A buffer can only be queued once.
+    EXPECT_EQ(manager->queueOutputBuffer(buffer, 20), Status::INVALID_ARGUMENT);
+}
+
+TEST(PixelStreamManagerTest, AcquiredOutputBuffersCountAsInFlight) {
+    int maxInFlightPackets = 1;
+    auto [mockEngine, manager] = CreateStreamManagerAndEngine(maxInFlightPackets);
+
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+    std::vector<uint8_t> data(16 * 16 * 3, 100);
+    InputFrame frame(16, 16, PixelFormat::RGB, 16 * 3, &data[0]);
+
+    EXPECT_CALL((*mockEngine), dispatchPacket).Times(0);
+
+    AHardwareBuffer* buffer = manager->acquireOutputBuffer(16, 16, PixelFormat::RGB);
+    ASSERT_NE(buffer, nullptr);
+    EXPECT_EQ(manager->acquireOutputBuffer(16, 16, PixelFormat::RGB), nullptr);
+
+    // The frame is skipped as the only buffer is lent to the graph.
+    EXPECT_EQ(manager->queuePacket(frame, 10), Status::SUCCESS);
+    sleep(1);
+
+    // Releasing the buffer makes it available again.
+    EXPECT_EQ(manager->releaseOutputBuffer(buffer), Status::SUCCESS);
+    EXPECT_EQ(manager->releaseOutputBuffer(buffer), Status::INVALID_ARGUMENT);
+    EXPECT_EQ(manager->acquireOutputBuffer(16, 16, PixelFormat::RGB), buffer);
+}
+TEST(PixelStreamManagerTest, PacketsFreedFromClientThreadAreRecycled) {
+    int maxInFlightPackets = 1;
+    auto [mockEngine, manager] = CreateStreamManagerAndEngine(maxInFlightPackets);
+    StreamManager* streamManager = manager.get();
+
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+    std::vector<uint8_t> data(16 * 16 * 3, 100);
+    InputFrame frame(16, 16, PixelFormat::RGB, 16 * 3, &data[0]);
+
+    // The client returns every packet as soon as it receives it, on the dispatch thread.
+    std::atomic<int> numFreed = 0;
+    EXPECT_CALL((*mockEngine), dispatchPacket)
+        .Times(10)
+        .WillRepeatedly(testing::Invoke([&](const std::shared_ptr<MemHandle>& memHandle) {
+            EXPECT_EQ(streamManager->freePacket(memHandle->getBufferId()), Status::SUCCESS);
+            numFreed++;
+            return Status::SUCCESS;
+        }));
+
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(manager->queuePacket(frame, i), Status::SUCCESS);
+        for (int wait = 0; wait < 100 && numFreed.load() <= i; wait++) {
+            usleep(10000);
+        }
+        ASSERT_EQ(numFreed.load(), i + 1);
+    }
+}
+TEST(PixelStreamManagerTest, SlowConsumerDoesNotHoldUpTheClient) {
+    int maxInFlightPackets = 1;
+    auto [mockEngine, manager] = CreateStreamManagerAndEngine(maxInFlightPackets);
+    StreamManager* streamManager = manager.get();
+
+    // The second consumer never returns its packet.
+    std::atomic<int> numDisplayed = 0;
+    ASSERT_EQ(manager->addConsumer(1, 1, DropPolicy::LATEST_WINS,
+                                   [&](const std::shared_ptr<MemHandle>& /*memHandle*/) {
+                                       numDisplayed++;
+                                       return Status::SUCCESS;
+                                   }),
+              Status::SUCCESS);
+
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+    std::vector<uint8_t> data(16 * 16 * 3, 100);
+    InputFrame frame(16, 16, PixelFormat::RGB, 16 * 3, &data[0]);
+
+    std::atomic<int> numFreed = 0;
+    EXPECT_CALL((*mockEngine), dispatchPacket)
+        .Times(5)
+        .WillRepeatedly(testing::Invoke([&](const std::shared_ptr<MemHandle>& memHandle) {
+            EXPECT_EQ(streamManager->freePacket(memHandle->getBufferId()), Status::SUCCESS);
+            numFreed++;
+            return Status::SUCCESS;
+        }));
+
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(manager->queuePacket(frame, i), Status::SUCCESS);
+        for (int wait = 0; wait < 100 && numFreed.load() <= i; wait++) {
+            usleep(10000);
+        }
+        ASSERT_EQ(numFreed.load(), i + 1);
+    }
+    EXPECT_EQ(numDisplayed.load(), 1);
+}
+
+TEST(PixelStreamManagerTest, BlockingConsumerHoldsUpGraphOutput) {
+    int maxInFlightPackets = 2;
+    auto [mockEngine, manager] = CreateStreamManagerAndEngine(maxInFlightPackets);
+
+    std::shared_ptr<MemHandle> consumerHandle;
+    std::mutex consumerLock;
+    ASSERT_EQ(manager->addConsumer(1, 1, DropPolicy::BLOCK,
+                                   [&](const std::shared_ptr<MemHandle>& memHandle) {
+                                       std::lock_guard lock(consumerLock);
+                                       consumerHandle = memHandle;
+                                       return Status::SUCCESS;
+                                   }),
+              Status::SUCCESS);
+
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+    std::vector<uint8_t> data(16 * 16 * 3, 100);
+    InputFrame frame(16, 16, PixelFormat::RGB, 16 * 3, &data[0]);
+
+    EXPECT_CALL((*mockEngine), dispatchPacket).Times(2).WillRepeatedly(Return(Status::SUCCESS));
+
+    EXPECT_EQ(manager->queuePacket(frame, 10), Status::SUCCESS);
+    sleep(1);
+
+    // The client has room for the second frame, but the consumer does not.
+    std::atomic<bool> queued = false;
+    std::thread graphThread([&]() {
+        EXPECT_EQ(manager->queuePacket(frame, 20), Status::SUCCESS);
+        queued = true;
+    });
+    sleep(1);
+    EXPECT_FALSE(queued.load());
+
+    int bufferId;
+    {
+        std::lock_guard lock(consumerLock);
+        ASSERT_NE(consumerHandle, nullptr);
+        EXPECT_EQ(consumerHandle->getTimeStamp(), 10);
+        bufferId = consumerHandle->getBufferId();
+    }
+    EXPECT_EQ(manager->freePacket(bufferId, 1), Status::SUCCESS);
+    graphThread.join();
+    EXPECT_TRUE(queued.load());
+    sleep(1);
+
+    std::lock_guard lock(consumerLock);
+    EXPECT_EQ(consumerHandle->getTimeStamp(), 20);
+}
 
 }  // namespace
 }  // namespace stream_manager
@@ -33,6 +33,16 @@ enum PixelFormat {
     RGB = 0,
     RGBA,
     GRAY,
+    // YUV 4:2:0 formats. The stride of a frame is that of its luma plane, and
+    // the chroma planes follow the luma plane. NV12 and NV21 have a plane of
+    // interleaved U and V, or V and U, samples with the stride of the luma.
+    // YUV420 has a U plane and then a V plane with half the stride of the luma.
+    NV12,
+    NV21,
+    YUV420,
+    // 32 bit floats in three planes, R, G and then B, of height rows each.
+    // The stride is that of a plane's rows, in bytes.
+    RGB_PLANAR_FLOAT,
     PIXELFORMAT_MAX,
 };
 
@@ -16,10 +16,14 @@
 
 #include "SurroundViewServiceCallback.h"
 
+#include <sys/stat.h>
+
 #include <android-base/logging.h>
+#include <gpupolicy/GpuPolicy.h>
 #include <math/mat4.h>
 #include <ui/GraphicBuffer.h>
 #include <utils/Log.h>
+#include <utils/SystemClock.h>
 
 #include "shader_simpleTex.h"
 #include "shader.h"
@@ -31,12 +35,20 @@ using android::hardware::Return;
 using android::sp;
 using std::string;
 
+namespace gpupolicy = android::automotive::evs::gpupolicy;
+
 EGLDisplay   SurroundViewServiceCallback::sGLDisplay;
 GLuint       SurroundViewServiceCallback::sFrameBuffer;
 GLuint       SurroundViewServiceCallback::sColorBuffer;
 GLuint       SurroundViewServiceCallback::sDepthBuffer;
 GLuint       SurroundViewServiceCallback::sTextureId;
-EGLImageKHR  SurroundViewServiceCallback::sKHRimage;
+std::map<SurroundViewServiceCallback::ImageKey, SurroundViewServiceCallback::CachedImage>
+        SurroundViewServiceCallback::sFrameImages;
+std::map<SurroundViewServiceCallback::ImageKey, SurroundViewServiceCallback::CachedImage>
+        SurroundViewServiceCallback::sTargetImages;
+
+// Bounds the images kept per cache, in case buffers keep being reallocated.
+static const size_t kMaxCachedImages = 16;
 
 const char* SurroundViewServiceCallback::getEGLError(void) {
     switch (eglGetError()) {
@@ -111,7 +123,7 @@ bool SurroundViewServiceCallback::prepareGL() {
     };
 
     // Select OpenGL ES v 3
-    const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    const EGLint es3_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
 
     // Set up our OpenGL ES context associated with the default display
     // (though we won't be visible)
@@ -158,13 +170,16 @@ bool SurroundViewServiceCallback::prepareGL() {
     //
     // Create the EGL context
     //
+    const std::vector<EGLint> context_attribs =
+            gpupolicy::getContextAttributes(display, gpupolicy::kComponentSvApp, es3_attribs);
     EGLContext context = eglCreateContext(display, egl_config,
-                                          EGL_NO_CONTEXT, context_attribs);
+                                          EGL_NO_CONTEXT, context_attribs.data());
     if (context == EGL_NO_CONTEXT) {
         LOG(ERROR) << "Failed to create OpenGL ES Context: "
                    << getEGLError();
         return false;
     }
+    gpupolicy::recordContextPriority(display, context, gpupolicy::kComponentSvApp);
 
     // Activate our render target for drawing
     if (!eglMakeCurrent(display, sPlaceholderSurface, sPlaceholderSurface, context)) {
@@ -254,48 +269,81 @@ BufferDesc SurroundViewServiceCallback::convertBufferDesc(
     return dst;
 }
 
-bool SurroundViewServiceCallback::attachRenderTarget(
-    const BufferDesc& tgtBuffer) {
-    const AHardwareBuffer_Desc* pDesc =
-        reinterpret_cast<const AHardwareBuffer_Desc *>(
-            &tgtBuffer.buffer.description);
-    // Hardcoded to RGBx for now
-    if (pDesc->format != HAL_PIXEL_FORMAT_RGBA_8888) {
-        LOG(ERROR) << "Unsupported target buffer format";
-        return false;
+EGLImageKHR SurroundViewServiceCallback::getImage(const native_handle_t* handle,
+                                                  const AHardwareBuffer_Desc* pDesc,
+                                                  uint64_t usage,
+                                                  std::map<ImageKey, CachedImage>* cache) {
+    struct stat bufferStat;
+    if (handle == nullptr || handle->numFds < 1 || fstat(handle->data[0], &bufferStat) != 0) {
+        LOG(ERROR) << "Invalid buffer handle";
+        return EGL_NO_IMAGE_KHR;
+    }
+
+    const ImageKey key(bufferStat.st_dev, bufferStat.st_ino);
+    const auto it = cache->find(key);
+    if (it != cache->end()) {
+        return it->second.image;
+    }
+
+    if (cache->size() >= kMaxCachedImages) {
+        releaseImages(cache);
     }
 
     // create a GraphicBuffer from the existing handle
-    sp<GraphicBuffer> pGfxBuffer =
-        new GraphicBuffer(tgtBuffer.buffer.nativeHandle,
-                          GraphicBuffer::CLONE_HANDLE,
-                          pDesc->width,
-                          pDesc->height,
-                          pDesc->format,
-                          pDesc->layers,
-                          GRALLOC_USAGE_HW_RENDER,
-                          pDesc->stride);
-    if (pGfxBuffer == nullptr) {
+    CachedImage cachedImage;
+    cachedImage.graphicBuffer = new GraphicBuffer(handle,
+                                                  GraphicBuffer::CLONE_HANDLE,
+                                                  pDesc->width,
+                                                  pDesc->height,
+                                                  pDesc->format,
+                                                  pDesc->layers,
+                                                  usage,
+                                                  pDesc->stride);
+    if (cachedImage.graphicBuffer == nullptr ||
+        cachedImage.graphicBuffer->initCheck() != android::OK) {
         LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
-        return false;
+        return EGL_NO_IMAGE_KHR;
     }
 
     // Get a GL compatible reference to the graphics buffer we've been given
     EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
     EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(
-        pGfxBuffer->getNativeBuffer());
+        cachedImage.graphicBuffer->getNativeBuffer());
+    cachedImage.image = eglCreateImageKHR(sGLDisplay, EGL_NO_CONTEXT,
+                                          EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                          eglImageAttributes);
+    if (cachedImage.image == EGL_NO_IMAGE_KHR) {
+        LOG(ERROR) << "error creating EGLImage: " << getEGLError();
+        return EGL_NO_IMAGE_KHR;
+    }
 
-    // Destroy current KHR image due to new request.
-    if (sKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(sGLDisplay, sKHRimage);
+    LOG(INFO) << "Created EGLImage for a new buffer, " << cache->size() + 1 << " cached";
+    cache->emplace(key, cachedImage);
+    return cachedImage.image;
+}
+
+void SurroundViewServiceCallback::releaseImages(std::map<ImageKey, CachedImage>* cache) {
+    for (auto& [key, cachedImage] : *cache) {
+        eglDestroyImageKHR(sGLDisplay, cachedImage.image);
     }
+    cache->clear();
+}
 
-    sKHRimage = eglCreateImageKHR(sGLDisplay, EGL_NO_CONTEXT,
-                                  EGL_NATIVE_BUFFER_ANDROID, clientBuf,
-                                  eglImageAttributes);
-    if (sKHRimage == EGL_NO_IMAGE_KHR) {
-        LOG(ERROR) << "error creating EGLImage for target buffer: "
-                   << getEGLError();
+bool SurroundViewServiceCallback::attachRenderTarget(
+    const BufferDesc& tgtBuffer) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(
+            &tgtBuffer.buffer.description);
+    // Hardcoded to RGBx for now
+    if (pDesc->format != HAL_PIXEL_FORMAT_RGBA_8888) {
+        LOG(ERROR) << "Unsupported target buffer format";
+        return false;
+    }
+
+    EGLImageKHR targetImage = getImage(tgtBuffer.buffer.nativeHandle, pDesc,
+                                       GRALLOC_USAGE_HW_RENDER, &sTargetImages);
+    if (targetImage == EGL_NO_IMAGE_KHR) {
+        LOG(ERROR) << "error creating EGLImage for target buffer";
         return false;
     }
 
@@ -304,7 +352,7 @@ bool SurroundViewServiceCallback::attachRenderTarget(
     // Construct a render buffer around the external buffer
     glBindRenderbuffer(GL_RENDERBUFFER, sColorBuffer);
     glEGLImageTargetRenderbufferStorageOES(
-        GL_RENDERBUFFER, static_cast<GLeglImageOES>(sKHRimage));
+        GL_RENDERBUFFER, static_cast<GLeglImageOES>(targetImage));
     if (eglGetError() != EGL_SUCCESS) {
         LOG(INFO) << "glEGLImageTargetRenderbufferStorageOES => %s"
                   << getEGLError();
@@ -344,14 +392,6 @@ bool SurroundViewServiceCallback::attachRenderTarget(
     return true;
 }
 
-void SurroundViewServiceCallback::detachRenderTarget() {
-    // Drop our external render target
-    if (sKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(sGLDisplay, sKHRimage);
-        sKHRimage = EGL_NO_IMAGE_KHR;
-    }
-}
-
 SurroundViewServiceCallback::SurroundViewServiceCallback(
     sp<IEvsDisplay> pDisplay,
     sp<ISurroundViewSession> pSession) :
@@ -386,6 +426,10 @@ Return<void> SurroundViewServiceCallback::notify(SvEvent svEvent) {
         LOG(INFO) << "Received CONFIG_UPDATED event";
     } else if (svEvent == SvEvent::STREAM_STOPPED) {
         LOG(INFO) << "Received STREAM_STOPPED event";
+
+        // The next stream may come with other buffers.
+        releaseImages(&sFrameImages);
+        releaseImages(&sTargetImages);
     } else if (svEvent == SvEvent::FRAME_DROPPED) {
         LOG(INFO) << "Received FRAME_DROPPED event";
     } else if (svEvent == SvEvent::TIMEOUT) {
@@ -441,71 +485,37 @@ Return<void> SurroundViewServiceCallback::receiveFrames(
             LOG(INFO) << "Successfully attached render target";
         }
 
-        // Call HIDL API "doneWithFrames" to return the ownership
-        // back to SV service
-        if (mSession == nullptr) {
-            LOG(ERROR) << "SurroundViewSession in callback is invalid";
-            return {};
-        } else {
-            mSession->doneWithFrames(svFramesDesc);
-        }
-
         // Render frame to EVS display
         LOG(INFO) << "Rendering to display buffer";
-        sp<GraphicBuffer> graphicBuffer =
-            new GraphicBuffer(handle,
-                              GraphicBuffer::CLONE_HANDLE,
-                              pDesc->width,
-                              pDesc->height,
-                              pDesc->format,
-                              pDesc->layers,  // layer count
-                              pDesc->usage,
-                              pDesc->stride);
-
-        EGLImageKHR KHRimage = EGL_NO_IMAGE_KHR;
-
-        // Get a GL compatible reference to the graphics buffer we've been given
-        EGLint eglImageAttributes[] = {
-            EGL_IMAGE_PRESERVED_KHR,
-            EGL_TRUE,
-            EGL_NONE
-        };
-        EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(
-            graphicBuffer->getNativeBuffer());
-        KHRimage = eglCreateImageKHR(sGLDisplay, EGL_NO_CONTEXT,
-                                     EGL_NATIVE_BUFFER_ANDROID, clientBuf,
-                                     eglImageAttributes);
-        if (KHRimage == EGL_NO_IMAGE_KHR) {
-            const char *msg = getEGLError();
-            LOG(ERROR) << "error creating EGLImage: "
-                       << msg;
+        const int64_t renderStartNs = android::elapsedRealtimeNano();
+        EGLImageKHR frameImage = getImage(handle, pDesc, pDesc->usage, &sFrameImages);
+        if (frameImage == EGL_NO_IMAGE_KHR) {
+            LOG(ERROR) << "Failed to get the EGLImage of the frame";
+            if (mSession != nullptr) {
+                mSession->doneWithFrames(svFramesDesc);
+            }
+            mDisplay->returnTargetBufferForDisplay(tgtBuffer);
             return {};
-        } else {
-            LOG(INFO) << "Successfully created EGLImage";
-
-            // Update the texture handle we already created to refer to
-            // this gralloc buffer
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, sTextureId);
-            glEGLImageTargetTexture2DOES(GL_TEXTURE_2D,
-                                         static_cast<GLeglImageOES>(KHRimage));
-
-            // Initialize the sampling properties (it seems the sample may
-            // not work if this isn't done)
-            // The user of this texture may very well want to set their own
-            // filtering, but we're going to pay the (minor) price of
-            // setting this up for them to avoid the dreaded "black image"
-            // if they forget.
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                            GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                            GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-                            GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
-                            GL_CLAMP_TO_EDGE);
         }
 
+        // Update the texture handle we already created to refer to this
+        // gralloc buffer
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sTextureId);
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D,
+                                     static_cast<GLeglImageOES>(frameImage));
+
+        // Initialize the sampling properties (it seems the sample may not
+        // work if this isn't done)
+        // The user of this texture may very well want to set their own
+        // filtering, but we're going to pay the (minor) price of setting
+        // this up for them to avoid the dreaded "black image" if they
+        // forget.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
         // Bind the texture and assign it to the shader's sampler
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, sTextureId);
@@ -536,19 +546,19 @@ Return<void> SurroundViewServiceCallback::receiveFrames(
         glDisableVertexAttribArray(0);
         glDisableVertexAttribArray(1);
 
-        // Now that everything is submitted, release our hold on the
-        // texture resource
-        detachRenderTarget();
-
-        // Wait for the rendering to finish
-        glFinish();
-        detachRenderTarget();
-
-        // Drop our external render target
-        if (KHRimage != EGL_NO_IMAGE_KHR) {
-            eglDestroyImageKHR(sGLDisplay, KHRimage);
-            KHRimage = EGL_NO_IMAGE_KHR;
+        // Wait for the rendering to finish on a fence, which flushes the
+        // commands, before the frame and the display buffer are handed back.
+        EGLSyncKHR fence = eglCreateSyncKHR(sGLDisplay, EGL_SYNC_FENCE_KHR, nullptr);
+        if (fence != EGL_NO_SYNC_KHR) {
+            eglClientWaitSyncKHR(sGLDisplay, fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+                                 EGL_FOREVER_KHR);
+            eglDestroySyncKHR(sGLDisplay, fence);
+        } else {
+            LOG(WARNING) << "Failed to create a fence: " << getEGLError();
+            glFinish();
         }
+        gpupolicy::recordFrameTime(gpupolicy::kComponentSvApp,
+                                   android::elapsedRealtimeNano() - renderStartNs);
 
         LOG(DEBUG) << "Rendering finished. Going to return the buffer";
 
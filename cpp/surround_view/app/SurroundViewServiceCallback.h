@@ -14,7 +14,12 @@
  * limitations under the License.
  */
 #include <stdio.h>
+#include <sys/types.h>
 
+#include <map>
+#include <utility>
+
+#include <ui/GraphicBuffer.h>
 #include <utils/StrongPointer.h>
 
 #include <android/hardware/automotive/sv/1.0/ISurroundViewService.h>
@@ -50,14 +55,32 @@ private:
     bool prepareGL();
     BufferDesc convertBufferDesc(const BufferDesc_1_0& src);
     bool attachRenderTarget(const BufferDesc& tgtBuffer);
-    void detachRenderTarget();
+
+    // Images are created once per buffer and kept, as the service and the
+    // display cycle through a few buffers. Each call hands over a new handle
+    // to the same buffer, so they are keyed by the dma-buf behind the handle.
+    using ImageKey = std::pair<dev_t, ino_t>;
+    struct CachedImage {
+        android::sp<android::GraphicBuffer> graphicBuffer;
+        EGLImageKHR image = EGL_NO_IMAGE_KHR;
+    };
+
+    // Returns the EGLImage of the buffer, or EGL_NO_IMAGE_KHR on failure.
+    static EGLImageKHR getImage(const native_handle_t* handle,
+                                const AHardwareBuffer_Desc* pDesc,
+                                uint64_t usage,
+                                std::map<ImageKey, CachedImage>* cache);
+    static void releaseImages(std::map<ImageKey, CachedImage>* cache);
 
     static EGLDisplay   sGLDisplay;
     static GLuint       sFrameBuffer;
     static GLuint       sColorBuffer;
     static GLuint       sDepthBuffer;
     static GLuint       sTextureId;
-    static EGLImageKHR  sKHRimage;
+
+    // Images of the frames from the service and of the display buffers.
+    static std::map<ImageKey, CachedImage> sFrameImages;
+    static std::map<ImageKey, CachedImage> sTargetImages;
 
     android::sp<IEvsDisplay> mDisplay;
     android::sp<ISurroundViewSession> mSession;
@@ -19,6 +19,7 @@
 #include <android/hardware/automotive/sv/1.0/ISurroundViewService.h>
 #include <android/hardware/automotive/sv/1.0/ISurroundView2dSession.h>
 #include <android/hardware/automotive/sv/1.0/ISurroundView3dSession.h>
+#include <gpupolicy/GpuPolicy.h>
 #include <hidl/HidlTransportSupport.h>
 #include <stdio.h>
 #include <utils/StrongPointer.h>
@@ -151,6 +152,7 @@ bool run2dSurroundView(sp<ISurroundViewService> pSurroundViewService,
     surroundView2dSession = nullptr;
 
     LOG(INFO) << "SV 2D session finished.";
+    LOG(INFO) << android::automotive::evs::gpupolicy::dumpGpuPolicies();
 
     return true;
 };
@@ -251,6 +253,7 @@ bool run3dSurroundView(sp<ISurroundViewService> pSurroundViewService,
     surroundView3dSession = nullptr;
 
     LOG(DEBUG) << "SV 3D session finished.";
+    LOG(INFO) << android::automotive::evs::gpupolicy::dumpGpuPolicies();
 
     return true;
 };
@@ -71,11 +71,12 @@ float getVhalValueFloat(const VehiclePropValue& vhalValue) {
 }  // namespace
 
 AnimationModule::AnimationModule(const std::map<std::string, CarPart>& partsMap,
-                                 const std::map<std::string, CarTexture>& texturesMap,
+                                 const std::map<std::string, CarTexture>& /* texturesMap */,
                                  const std::vector<AnimationInfo>& animations) :
-      mIsCalled(false), mPartsMap(partsMap), mTexturesMap(texturesMap), mAnimations(animations) {
+      mIsCalled(false), mAnimations(animations) {
     mapVhalToParts();
-    initCarPartStatus();
+    // Only the part ids are needed, the vertices of the parts are not kept.
+    initCarPartStatus(partsMap);
 }
 
 void AnimationModule::mapVhalToParts() {
@@ -117,8 +118,8 @@ void AnimationModule::mapVhalToParts() {
     }
 }
 
-void AnimationModule::initCarPartStatus() {
-    for (const auto& part : mPartsMap) {
+void AnimationModule::initCarPartStatus(const std::map<std::string, CarPart>& partsMap) {
+    for (const auto& part : partsMap) {
         // Get child parts list from mPartsToAnimationMap.
         std::vector<std::string> childIds;
         if (mPartsToAnimationMap.find(part.first) != mPartsToAnimationMap.end()) {
@@ -177,6 +178,51 @@ void AnimationModule::updateChildrenParts(const std::string& partId, const Mat4x
     }
 }
 
+bool AnimationModule::isSettled(uint64_t vhalProperty) const {
+    for (const auto& partId : mVhalToPartsMap.at(vhalProperty)) {
+        const CarPartStatus& carPartStatus = mCarPartsStatusMap.at(partId);
+        const float progress = carPartStatus.vhalProgressMap.at(vhalProperty);
+        if (carPartStatus.vhalOffMap.at(vhalProperty)) {
+            // Parts go back to rest and stay there.
+            if (progress > 0) {
+                return false;
+            }
+            continue;
+        }
+
+        // Continuous values are applied at once, others animate until the
+        // progress is complete. Repeated and speed animations never end.
+        const auto& animationInfo = mPartsToAnimationMap.at(partId);
+        const auto gammaOps = animationInfo.gammaOpsMap.find(vhalProperty);
+        if (gammaOps != animationInfo.gammaOpsMap.end()) {
+            for (const auto& gammaOp : gammaOps->second) {
+                if (gammaOp.animationTime != 0 &&
+                    (gammaOp.type == ADJUST_GAMMA_REPEAT || progress < 1)) {
+                    return false;
+                }
+            }
+        }
+        const auto rotationOps = animationInfo.rotationOpsMap.find(vhalProperty);
+        if (rotationOps != animationInfo.rotationOpsMap.end()) {
+            for (const auto& rotationOp : rotationOps->second) {
+                if (rotationOp.type == ROTATION_SPEED ||
+                    (rotationOp.animationTime != 0 && progress < 1)) {
+                    return false;
+                }
+            }
+        }
+        const auto translationOps = animationInfo.translationOpsMap.find(vhalProperty);
+        if (translationOps != animationInfo.translationOpsMap.end()) {
+            for (const auto& translationOp : translationOps->second) {
+                if (translationOp.animationTime != 0 && progress < 1) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 void AnimationModule::performGammaOp(const std::string& partId, uint64_t vhalProperty,
                                      const GammaOp& gammaOp) {
     CarPartStatus& currentCarPartStatus = mCarPartsStatusMap.at(partId);
@@ -447,7 +493,11 @@ std::vector<AnimationParam> AnimationModule::getUpdatedAnimationParams(
         if (mVhalToPartsMap.find(combinedId) != mVhalToPartsMap.end()) {
             const float valueFloat = getVhalValueFloat(vhalSignal);
             if (mVhalStatusMap.find(combinedId) != mVhalStatusMap.end()) {
-                mVhalStatusMap.at(combinedId).vhalValueFloat = valueFloat;
+                VhalStatus& vhalStatus = mVhalStatusMap.at(combinedId);
+                if (vhalStatus.vhalValueFloat != valueFloat) {
+                    vhalStatus.vhalValueFloat = valueFloat;
+                    vhalStatus.settled = false;
+                }
             } else {
                 mVhalStatusMap.emplace(std::make_pair(combinedId,
                                                       VhalStatus{
@@ -461,9 +511,31 @@ std::vector<AnimationParam> AnimationModule::getUpdatedAnimationParams(
         }
     }
 
+    // Settled vhal properties are skipped, unless they share a part with one
+    // that is not, so that the ops of a part still run in the same order.
+    std::set<uint64_t> activeProperties;
+    for (const auto& vhalStatus : mVhalStatusMap) {
+        if (vhalStatus.second.settled ||
+            mVhalToPartsMap.find(vhalStatus.first) == mVhalToPartsMap.end()) {
+            continue;
+        }
+        activeProperties.insert(vhalStatus.first);
+        for (const auto& partId : mVhalToPartsMap.at(vhalStatus.first)) {
+            for (const auto& vhalProgress : mCarPartsStatusMap.at(partId).vhalProgressMap) {
+                activeProperties.insert(vhalProgress.first);
+            }
+        }
+    }
+    if (activeProperties.empty()) {
+        return {};
+    }
+
     for (auto& vhalStatus : mVhalStatusMap) {
-        // VHAL signal not found in animation
         uint64_t vhalProperty = vhalStatus.first;
+        if (activeProperties.find(vhalProperty) == activeProperties.end()) {
+            continue;
+        }
+        // VHAL signal not found in animation
         if (mVhalToPartsMap.find(vhalProperty) == mVhalToPartsMap.end()) {
             LOG(WARNING) << "VHAL " << vhalProperty << " not processed.";
         } else {  // VHAL signal found
@@ -500,6 +572,7 @@ std::vector<AnimationParam> AnimationModule::getUpdatedAnimationParams(
                     }
                 }
             }
+            vhalStatus.second.settled = isSettled(vhalProperty);
         }
     }
 
@@ -510,6 +583,20 @@ std::vector<AnimationParam> AnimationModule::getUpdatedAnimationParams(
     return output;
 }
 
+std::vector<AnimationParam> AnimationModule::getCurrentAnimationParams() const {
+    std::vector<AnimationParam> output;
+    for (const auto& [partId, partStatus] : mCarPartsStatusMap) {
+        if (mPartsToAnimationMap.find(partId) == mPartsToAnimationMap.end()) {
+            continue;
+        }
+        AnimationParam animationParam(partId);
+        animationParam.SetModelMatrix(partStatus.currentModel);
+        animationParam.SetGamma(partStatus.gamma);
+        output.push_back(animationParam);
+    }
+    return output;
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace sv
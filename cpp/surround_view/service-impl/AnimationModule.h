@@ -45,16 +45,23 @@ class AnimationModule {
 public:
     // Constructor.
     // |parts| is from I/O module. The key value is part id.
-    // |textures| is from I/O module. The key value is texture id.
+    // |textures| is from I/O module. The key value is texture id. Texture
+    // operations are not implemented yet, so the textures are not kept.
     // |animations| is from I/O module.
     AnimationModule(const std::map<std::string, CarPart>& partsMap,
                     const std::map<std::string, CarTexture>& texturesMap,
                     const std::vector<AnimationInfo>& animations);
 
-    // Gets Animation parameters with input of VehiclePropValue.
+    // Gets Animation parameters with input of VehiclePropValue. Only the parts
+    // that changed since the last call are returned, so the result is empty
+    // while no animation is in progress and no vhal value changed.
     std::vector<AnimationParam> getUpdatedAnimationParams(
             const std::vector<VehiclePropValue>& vehiclePropValue);
 
+    // Gets the current model matrix and gamma of every animated part, e.g. to
+    // apply them again after the car model was replaced.
+    std::vector<AnimationParam> getCurrentAnimationParams() const;
+
 private:
     // Internal car part status.
     struct CarPartStatus {
@@ -94,17 +101,25 @@ private:
     // Internal Vhal status.
     struct VhalStatus {
         float vhalValueFloat;
+
+        // Whether the parts reached the state the value leads them to, so
+        // they need no update until the value changes.
+        bool settled = false;
     };
 
     // Help function to get vhal to parts map.
     void mapVhalToParts();
 
     // Help function to init car part status for constructor.
-    void initCarPartStatus();
+    void initCarPartStatus(const std::map<std::string, CarPart>& partsMap);
 
     // Iteratively update children parts status if partent status is changed.
     void updateChildrenParts(const std::string& partId, const Mat4x4& parentModel);
 
+    // Checks whether the ops of the vhal property would leave its parts as
+    // they are, as long as the vhal value stays the same.
+    bool isSettled(uint64_t vhalProperty) const;
+
     // Perform gamma opertion for the part with given vhal property.
     void performGammaOp(const std::string& partId, uint64_t vhalProperty, const GammaOp& gammaOp);
 
@@ -130,10 +145,6 @@ private:
     // Flag indicating if GetUpdatedAnimationParams() was called before.
     bool mIsCalled;
 
-    std::map<std::string, CarPart> mPartsMap;
-
-    std::map<std::string, CarTexture> mTexturesMap;
-
     std::vector<AnimationInfo> mAnimations;
 
     std::map<std::string, AnimationInfo> mPartsToAnimationMap;
@@ -430,6 +430,27 @@ TEST(AnimationModuleTests, All5PartsAnimationOnceSuccess) {
     EXPECT_EQ(result.size(), 5);
 }
 
+TEST(AnimationModuleTests, UnchangedContinuousValueSkipped) {
+    // Makes the left door follow the vhal value without animating.
+    std::vector<AnimationInfo> animations = getSampleAnimations();
+    animations[1].rotationOpsMap.begin()->second[0].animationTime = 0;
+    AnimationModule animationModule(getSampleCarPartsMap(), std::map<std::string, CarTexture>(),
+                                    animations);
+    auto getLeftDoorValue = [](int32_t value) {
+        return std::vector<VehiclePropValue>{VehiclePropValue{
+                .areaId = (int32_t)VehicleArea::DOOR,
+                .prop = 0x0200 | VehiclePropertyGroup::SYSTEM | VehiclePropertyType::INT32 |
+                        VehicleArea::DOOR,
+                .value.int32Values = std::vector<int32_t>(1, value),
+        }};
+    };
+
+    EXPECT_EQ(animationModule.getUpdatedAnimationParams(getLeftDoorValue(INT32_MAX)).size(), 1);
+    EXPECT_EQ(animationModule.getUpdatedAnimationParams(getLeftDoorValue(INT32_MAX)).size(), 0);
+    EXPECT_EQ(animationModule.getUpdatedAnimationParams(getLeftDoorValue(INT32_MAX / 2)).size(),
+              1);
+}
+
 }  // namespace
 }  // namespace implementation
 }  // namespace V1_0
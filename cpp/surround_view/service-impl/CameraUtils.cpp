@@ -21,6 +21,8 @@
 
 #include <math.h>
 
+#include <algorithm>
+
 using namespace android::hardware::automotive::evs::V1_1;
 
 using ::android::sp;
@@ -287,6 +289,20 @@ vector<SurroundViewCameraParams> convertToSurroundViewCameraParams(
     return result;
 }
 
+int64_t getFrameSkewUs(const hidl_vec<BufferDesc_1_1>& buffers) {
+    if (buffers.size() == 0) {
+        return 0;
+    }
+
+    int64_t first = buffers[0].timestamp;
+    int64_t last = buffers[0].timestamp;
+    for (const auto& buffer : buffers) {
+        first = std::min<int64_t>(first, buffer.timestamp);
+        last = std::max<int64_t>(last, buffer.timestamp);
+    }
+    return last - first;
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace sv
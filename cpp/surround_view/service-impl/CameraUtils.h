@@ -25,6 +25,7 @@
 #include "core_lib.h"
 
 using ::android::hardware::automotive::evs::V1_1::IEvsCamera;
+using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
 using ::android_auto::surround_view::SurroundViewCameraParams;
 
 namespace android {
@@ -63,6 +64,9 @@ bool getAndroidCameraParams(android::sp<IEvsCamera> camera,
 std::vector<SurroundViewCameraParams> convertToSurroundViewCameraParams(
         const std::map<std::string, AndroidCameraParams>& androidCameraParamsMap);
 
+// Returns the spread of the capture timestamps of the frames, in microseconds.
+int64_t getFrameSkewUs(const android::hardware::hidl_vec<BufferDesc_1_1>& buffers);
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace sv
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SURROUND_VIEW_SERVICE_IMPL_CARMODELLODSELECTOR_H_
+#define SURROUND_VIEW_SERVICE_IMPL_CARMODELLODSELECTOR_H_
+
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "IOModuleCommon.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Picks the level of detail of the car model to render, from how wide the
+// views are at the car. Level 0 is the full model, level i is
+// SvConfig3d::carModelLods[i - 1]. As all views render the same model, the
+// finest level any of them needs is used. A level is only left once the width
+// went a margin past its threshold, so a view that moves around a threshold
+// does not switch the model back and forth.
+//
+// The levels are picked on the render thread. The level may be read from any
+// thread.
+class CarModelLodSelector {
+public:
+    // Fraction of a threshold the width has to go past it to change the
+    // level.
+    static constexpr float kHysteresis = 0.1f;
+
+    explicit CarModelLodSelector(const std::vector<CarModelLod>& lods) {
+        for (const CarModelLod& lod : lods) {
+            mMinViewWidths.push_back(lod.minViewWidth);
+        }
+    }
+
+    bool isEnabled() const { return !mMinViewWidths.empty(); }
+
+    // Width in meters that a view of the given horizontal field of view, in
+    // degrees, sees at the given distance.
+    static float getViewWidth(float distance, float horizontalFovDeg) {
+        const float halfFov = std::clamp(horizontalFovDeg, 1.0f, 179.0f) * M_PI / 360.0f;
+        return 2.0f * std::fabs(distance) * std::tan(halfFov);
+    }
+
+    // Picks the level for the widths of the views at the car. Returns true if
+    // the level changed.
+    bool update(const std::vector<float>& viewWidths) {
+        if (!isEnabled() || viewWidths.empty()) {
+            return false;
+        }
+
+        const int numLevels = static_cast<int>(mMinViewWidths.size()) + 1;
+        int level = numLevels - 1;
+        for (float width : viewWidths) {
+            int viewLevel = mLevel;
+            while (viewLevel > 0 &&
+                   width < mMinViewWidths[viewLevel - 1] * (1.0f - kHysteresis)) {
+                --viewLevel;
+            }
+            while (viewLevel < numLevels - 1 &&
+                   width >= mMinViewWidths[viewLevel] * (1.0f + kHysteresis)) {
+                ++viewLevel;
+            }
+            level = std::min(level, viewLevel);
+        }
+
+        if (level == mLevel) {
+            return false;
+        }
+        mLevel = level;
+        ++mLevelChanges;
+        return true;
+    }
+
+    int getLevel() const { return mLevel; }
+
+    std::string toString(const char* indent = "") const {
+        if (!isEnabled()) {
+            return android::base::StringPrintf("%sCar model detail: full\n", indent);
+        }
+        return android::base::StringPrintf("%sCar model detail: level %d of %zu, %" PRIu64
+                                           " level changes\n",
+                                           indent, mLevel.load(), mMinViewWidths.size(),
+                                           mLevelChanges.load());
+    }
+
+private:
+    std::vector<float> mMinViewWidths;
+
+    std::atomic<int> mLevel = 0;
+    std::atomic<uint64_t> mLevelChanges = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // SURROUND_VIEW_SERVICE_IMPL_CARMODELLODSELECTOR_H_
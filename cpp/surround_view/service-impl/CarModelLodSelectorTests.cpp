@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CarModelLodSelectorTests"
+
+#include "CarModelLodSelector.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+std::vector<CarModelLod> makeLods() {
+    CarModelLod medium;
+    medium.minViewWidth = 10.0f;
+    CarModelLod low;
+    low.minViewWidth = 20.0f;
+    return {medium, low};
+}
+
+TEST(CarModelLodSelectorTests, DisabledWithoutLods) {
+    CarModelLodSelector selector({});
+    EXPECT_FALSE(selector.isEnabled());
+    EXPECT_FALSE(selector.update({100.0f}));
+    EXPECT_EQ(selector.getLevel(), 0);
+}
+
+TEST(CarModelLodSelectorTests, ViewWidthGrowsWithDistanceAndFov) {
+    EXPECT_NEAR(CarModelLodSelector::getViewWidth(5.0f, 90.0f), 10.0f, 1e-4f);
+    EXPECT_NEAR(CarModelLodSelector::getViewWidth(-5.0f, 90.0f), 10.0f, 1e-4f);
+    EXPECT_GT(CarModelLodSelector::getViewWidth(5.0f, 120.0f), 10.0f);
+}
+
+TEST(CarModelLodSelectorTests, PicksFinestLevelOfTheViews) {
+    CarModelLodSelector selector(makeLods());
+
+    EXPECT_TRUE(selector.update({30.0f}));
+    EXPECT_EQ(selector.getLevel(), 2);
+
+    // A close view needs the full model, whatever the other views are.
+    EXPECT_TRUE(selector.update({30.0f, 5.0f}));
+    EXPECT_EQ(selector.getLevel(), 0);
+
+    EXPECT_TRUE(selector.update({15.0f, 30.0f}));
+    EXPECT_EQ(selector.getLevel(), 1);
+}
+
+TEST(CarModelLodSelectorTests, HoldsLevelAroundThreshold) {
+    CarModelLodSelector selector(makeLods());
+
+    // Just past the threshold is not enough to leave the full model.
+    EXPECT_FALSE(selector.update({10.5f}));
+    EXPECT_EQ(selector.getLevel(), 0);
+    EXPECT_TRUE(selector.update({11.5f}));
+    EXPECT_EQ(selector.getLevel(), 1);
+
+    // Nor is just under it enough to go back.
+    EXPECT_FALSE(selector.update({9.5f}));
+    EXPECT_EQ(selector.getLevel(), 1);
+    EXPECT_TRUE(selector.update({8.5f}));
+    EXPECT_EQ(selector.getLevel(), 0);
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -136,6 +136,12 @@ bool ReadSvConfig2d(const XMLElement* parent, SvConfig2d* sv2dConfig) {
         // GPU Acceleration enabled or not
         RETURN_IF_FALSE(ReadValue(param2dElem, "GpuAccelerationEnabled",
                                   &sv2dParams->gpu_acceleration_enabled));
+
+        // Number of output buffers (Optional).
+        if (param2dElem->FirstChildElement("NumOutputBuffers") != nullptr) {
+            RETURN_IF_FALSE(ReadValue(param2dElem, "NumOutputBuffers",
+                                      &sv2dConfig->numOutputBuffers));
+        }
     }
     return true;
 }
@@ -153,6 +159,28 @@ bool ReadSvConfig3d(const XMLElement* parent, SvConfig3d* sv3dConfig) {
 
     RETURN_IF_FALSE(ReadValue(parent, "CarModelObjFile", &sv3dConfig->carModelObjFile));
 
+    // Car model cache file (Optional).
+    if (parent->FirstChildElement("CarModelCacheFile") != nullptr) {
+        RETURN_IF_FALSE(ReadValue(parent, "CarModelCacheFile", &sv3dConfig->carModelCacheFile));
+    }
+
+    // Car model levels of detail (Optional).
+    const XMLElement* lodsElem = parent->FirstChildElement("CarModelLods");
+    if (lodsElem != nullptr) {
+        for (const XMLElement* lodElem = lodsElem->FirstChildElement("Lod"); lodElem != nullptr;
+             lodElem = lodElem->NextSiblingElement("Lod")) {
+            CarModelLod lod;
+            RETURN_IF_FALSE(ReadValue(lodElem, "ObjFile", &lod.objFile));
+            RETURN_IF_FALSE(ReadValue(lodElem, "MinViewWidth", &lod.minViewWidth));
+            if (!sv3dConfig->carModelLods.empty() &&
+                lod.minViewWidth <= sv3dConfig->carModelLods.back().minViewWidth) {
+                LOG(ERROR) << "Car model levels of detail must be in increasing MinViewWidth.";
+                return false;
+            }
+            sv3dConfig->carModelLods.push_back(lod);
+        }
+    }
+
     SurroundView3dParams* sv3dParams = &sv3dConfig->sv3dParams;
     const XMLElement* param3dElem = nullptr;
     RETURN_IF_FALSE(GetElement(parent, "Sv3dParams", &param3dElem));
@@ -192,6 +220,28 @@ bool ReadSvConfig3d(const XMLElement* parent, SvConfig3d* sv3dConfig) {
             RETURN_IF_FALSE(ReadValue(highQualityDetailsElem, "Reflections",
                                       &sv3dParams->high_details_reflections));
         }
+
+        // Number of output buffers (Optional).
+        if (param3dElem->FirstChildElement("NumOutputBuffers") != nullptr) {
+            RETURN_IF_FALSE(ReadValue(param3dElem, "NumOutputBuffers",
+                                      &sv3dConfig->numOutputBuffers));
+        }
+
+        // Adaptive quality (Optional).
+        const XMLElement* adaptiveQualityElem = param3dElem->FirstChildElement("AdaptiveQuality");
+        if (adaptiveQualityElem != nullptr) {
+            AdaptiveQualityConfig* adaptiveQuality = &sv3dConfig->adaptiveQuality;
+            RETURN_IF_FALSE(ReadValue(adaptiveQualityElem, "TargetFrameTimeMs",
+                                      &adaptiveQuality->targetFrameTimeMs));
+            if (adaptiveQualityElem->FirstChildElement("MinRenderScale") != nullptr) {
+                RETURN_IF_FALSE(ReadValue(adaptiveQualityElem, "MinRenderScale",
+                                          &adaptiveQuality->minRenderScale));
+            }
+            if (adaptiveQualityElem->FirstChildElement("MaxFrameInterval") != nullptr) {
+                RETURN_IF_FALSE(ReadValue(adaptiveQualityElem, "MaxFrameInterval",
+                                          &adaptiveQuality->maxFrameInterval));
+            }
+        }
     }
     return true;
 }
@@ -224,6 +274,24 @@ bool ReadCameraConfig(const XMLElement* parent, CameraConfig* cameraConfig) {
             RETURN_IF_FALSE(ReadValue(masksElem, "Rear", &cameraConfig->maskFilenames[2]));
             RETURN_IF_FALSE(ReadValue(masksElem, "Left", &cameraConfig->maskFilenames[3]));
         }
+
+        // Max frame skew (Optional).
+        if (cameraConfigElem->FirstChildElement("MaxFrameSkewMs") != nullptr) {
+            RETURN_IF_FALSE(ReadValue(cameraConfigElem, "MaxFrameSkewMs",
+                                      &cameraConfig->maxFrameSkewMs));
+        }
+
+        // Frame rate policy (Optional).
+        const XMLElement* frameRateElem = cameraConfigElem->FirstChildElement("FrameRatePolicy");
+        if (frameRateElem != nullptr) {
+            FrameRatePolicy* policy = &cameraConfig->frameRatePolicy;
+            RETURN_IF_FALSE(ReadValue(frameRateElem, "ManeuveringFps", &policy->maneuveringFps));
+            RETURN_IF_FALSE(ReadValue(frameRateElem, "StationaryFps", &policy->stationaryFps));
+            if (frameRateElem->FirstChildElement("StationarySpeedMps") != nullptr) {
+                RETURN_IF_FALSE(ReadValue(frameRateElem, "StationarySpeedMps",
+                                          &policy->stationarySpeedMps));
+            }
+        }
     }
     return true;
 }
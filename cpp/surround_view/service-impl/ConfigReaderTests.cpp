@@ -57,6 +57,15 @@ TEST(ConfigReaderTests, ReadConfigSuccess) {
     EXPECT_EQ(svConfig.cameraConfig.maskFilenames[2], "/vendor/etc/automotive/sv/mask_rear.png");
     EXPECT_EQ(svConfig.cameraConfig.maskFilenames[3], "/vendor/etc/automotive/sv/mask_left.png");
 
+    // Max frame skew
+    EXPECT_EQ(svConfig.cameraConfig.maxFrameSkewMs, 20);
+
+    // Frame rate policy
+    EXPECT_EQ(svConfig.cameraConfig.frameRatePolicy.maneuveringFps, 30);
+    EXPECT_EQ(svConfig.cameraConfig.frameRatePolicy.stationaryFps, 10);
+    // Not in the file, so the default.
+    EXPECT_EQ(svConfig.cameraConfig.frameRatePolicy.stationarySpeedMps, 0.1f);
+
     // Surround view 2D
     EXPECT_EQ(svConfig.sv2dConfig.sv2dEnabled, true);
     EXPECT_EQ(svConfig.sv2dConfig.sv2dParams.resolution.width, 768);
@@ -66,6 +75,7 @@ TEST(ConfigReaderTests, ReadConfigSuccess) {
     EXPECT_EQ(svConfig.sv2dConfig.sv2dParams.physical_center.x, 0.0);
     EXPECT_EQ(svConfig.sv2dConfig.sv2dParams.physical_center.y, 0.0);
     EXPECT_EQ(svConfig.sv2dConfig.sv2dParams.gpu_acceleration_enabled, false);
+    EXPECT_EQ(svConfig.sv2dConfig.numOutputBuffers, 3);
     EXPECT_EQ(svConfig.sv2dConfig.carBoundingBox.width, 2.0);
     EXPECT_EQ(svConfig.sv2dConfig.carBoundingBox.height, 3.0);
     EXPECT_EQ(svConfig.sv2dConfig.carBoundingBox.x, 1.0);
@@ -87,6 +97,12 @@ TEST(ConfigReaderTests, ReadConfigSuccess) {
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.curve_coefficient, 3.0);
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.high_details_shadows, true);
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.high_details_reflections, true);
+    // Not in the file, so the default.
+    EXPECT_EQ(svConfig.sv3dConfig.numOutputBuffers, 2);
+    EXPECT_EQ(svConfig.sv3dConfig.adaptiveQuality.targetFrameTimeMs, 30);
+    EXPECT_EQ(svConfig.sv3dConfig.adaptiveQuality.minRenderScale, 0.5);
+    // Not in the file, so the default.
+    EXPECT_EQ(svConfig.sv3dConfig.adaptiveQuality.maxFrameInterval, 2);
 }
 
 }  // namespace
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SURROUND_VIEW_SERVICE_IMPL_FRAMERATESCHEDULER_H_
+#define SURROUND_VIEW_SERVICE_IMPL_FRAMERATESCHEDULER_H_
+
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include "IOModuleCommon.h"
+#include "VhalHandler.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Picks the frame rate a session processes camera frames at, following a
+// FrameRatePolicy, and tells which frame sets to process at that rate.
+//
+// The rate is picked on the camera callback thread, where the frame sets
+// come in one at a time. The rate may be read from any thread.
+class FrameRateScheduler {
+public:
+    // Extended info the EVS manager takes as the frame rate a client wants,
+    // as an int32_t; 0 lifts the limit. Must match HalCamera::kFrameRateHintId
+    // of the EVS manager.
+    static constexpr uint32_t kEvsFrameRateId = 0x45565346;  // 'EVSF'
+
+    // A change of the views or overlays keeps the maneuvering rate this long,
+    // so that the client sees it move smoothly.
+    static constexpr int64_t kSceneChangeHoldNs = 1000 * 1000 * 1000;
+
+    explicit FrameRateScheduler(const FrameRatePolicy& policy) : mPolicy(policy) {}
+
+    bool isEnabled() const { return mPolicy.stationaryFps > 0; }
+
+    // Forgets the rate and the last frame set, e.g. for a new stream, so
+    // that the next update() reports a change.
+    void reset() {
+        mFrameRate = -1;
+        mLastFrameUs = -1;
+        mSceneChangedAtNs = -1;
+    }
+
+    // Picks the rate for the driving state, or for a moving vehicle when the
+    // state is not known. Returns true if the rate changed.
+    bool update(const VhalHandler::DrivingState* drivingState, bool sceneChanged,
+                int64_t nowNs) {
+        if (sceneChanged) {
+            mSceneChangedAtNs = nowNs;
+        }
+        const bool stationary = drivingState != nullptr &&
+                std::fabs(drivingState->speedMps) < mPolicy.stationarySpeedMps &&
+                !drivingState->isReversing() &&
+                (mSceneChangedAtNs < 0 || nowNs - mSceneChangedAtNs >= kSceneChangeHoldNs);
+        const int frameRate = stationary ? mPolicy.stationaryFps : mPolicy.maneuveringFps;
+        if (frameRate == mFrameRate) {
+            return false;
+        }
+        mFrameRate = frameRate;
+        return true;
+    }
+
+    // Frames per second to process, 0 for every frame.
+    int getFrameRate() const { return std::max(mFrameRate.load(), 0); }
+
+    // Returns true if the frame set captured at timestampUs is due at the
+    // current rate. A set is due once three quarters of the frame interval
+    // went by since the last one, so the jitter of the camera does not skip
+    // a set that is only a little early.
+    bool isFrameDue(int64_t timestampUs) {
+        const int frameRate = getFrameRate();
+        if (frameRate > 0 && mLastFrameUs >= 0 && timestampUs >= mLastFrameUs &&
+            (timestampUs - mLastFrameUs) * frameRate * 4 < 3 * 1000 * 1000) {
+            return false;
+        }
+        mLastFrameUs = timestampUs;
+        return true;
+    }
+
+    std::string toString(const char* indent = "") const {
+        if (!isEnabled()) {
+            return android::base::StringPrintf("%sFrame rate policy: disabled\n", indent);
+        }
+        const int frameRate = getFrameRate();
+        return frameRate > 0
+                ? android::base::StringPrintf("%sFrame rate policy: %d fps\n", indent, frameRate)
+                : android::base::StringPrintf("%sFrame rate policy: every frame\n", indent);
+    }
+
+private:
+    const FrameRatePolicy mPolicy;
+
+    std::atomic<int> mFrameRate = -1;
+    int64_t mLastFrameUs = -1;
+    int64_t mSceneChangedAtNs = -1;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // SURROUND_VIEW_SERVICE_IMPL_FRAMERATESCHEDULER_H_
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FrameRateSchedulerTests"
+
+#include "FrameRateScheduler.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+using vehicle::V2_0::VehicleGear;
+
+constexpr int64_t kSecondNs = 1000 * 1000 * 1000;
+
+FrameRatePolicy makePolicy() {
+    FrameRatePolicy policy;
+    policy.maneuveringFps = 30;
+    policy.stationaryFps = 10;
+    return policy;
+}
+
+VhalHandler::DrivingState makeDrivingState(float speedMps, VehicleGear gear) {
+    VhalHandler::DrivingState drivingState;
+    drivingState.speedMps = speedMps;
+    drivingState.gear = static_cast<int32_t>(gear);
+    return drivingState;
+}
+
+// Counts the sets due out of a second of sets at 30 fps.
+int countFramesDue(FrameRateScheduler* scheduler, int64_t startUs) {
+    int due = 0;
+    for (int i = 0; i < 30; i++) {
+        // Some jitter around 33.3 ms.
+        const int64_t timestampUs = startUs + i * 33333 + (i % 2 == 0 ? 2000 : -2000);
+        if (scheduler->isFrameDue(timestampUs)) {
+            due++;
+        }
+    }
+    return due;
+}
+
+TEST(FrameRateSchedulerTests, DisabledWithoutStationaryRate) {
+    FrameRatePolicy policy = makePolicy();
+    policy.stationaryFps = 0;
+    FrameRateScheduler scheduler(policy);
+    EXPECT_FALSE(scheduler.isEnabled());
+}
+
+TEST(FrameRateSchedulerTests, PicksRateFromDrivingState) {
+    FrameRateScheduler scheduler(makePolicy());
+    scheduler.reset();
+
+    const auto parked = makeDrivingState(0.0f, VehicleGear::GEAR_PARK);
+    EXPECT_TRUE(scheduler.update(&parked, false, kSecondNs));
+    EXPECT_EQ(scheduler.getFrameRate(), 10);
+    EXPECT_FALSE(scheduler.update(&parked, false, 2 * kSecondNs));
+
+    const auto moving = makeDrivingState(2.0f, VehicleGear::GEAR_DRIVE);
+    EXPECT_TRUE(scheduler.update(&moving, false, 3 * kSecondNs));
+    EXPECT_EQ(scheduler.getFrameRate(), 30);
+
+    // About to back into a parking spot.
+    const auto reverse = makeDrivingState(0.0f, VehicleGear::GEAR_REVERSE);
+    EXPECT_FALSE(scheduler.update(&reverse, false, 4 * kSecondNs));
+    EXPECT_EQ(scheduler.getFrameRate(), 30);
+
+    // Without a driving state, every frame that may matter is processed.
+    EXPECT_TRUE(scheduler.update(&parked, false, 5 * kSecondNs));
+    EXPECT_TRUE(scheduler.update(nullptr, false, 6 * kSecondNs));
+    EXPECT_EQ(scheduler.getFrameRate(), 30);
+}
+
+TEST(FrameRateSchedulerTests, SceneChangeHoldsManeuveringRate) {
+    FrameRateScheduler scheduler(makePolicy());
+    scheduler.reset();
+
+    const auto parked = makeDrivingState(0.0f, VehicleGear::GEAR_PARK);
+    EXPECT_TRUE(scheduler.update(&parked, true, kSecondNs));
+    EXPECT_EQ(scheduler.getFrameRate(), 30);
+    EXPECT_FALSE(scheduler.update(&parked, false, kSecondNs + kSecondNs / 2));
+    EXPECT_TRUE(scheduler.update(&parked, false, 2 * kSecondNs));
+    EXPECT_EQ(scheduler.getFrameRate(), 10);
+}
+
+TEST(FrameRateSchedulerTests, SkipsFramesBetweenDueSets) {
+    FrameRateScheduler scheduler(makePolicy());
+    scheduler.reset();
+
+    const auto parked = makeDrivingState(0.0f, VehicleGear::GEAR_PARK);
+    ASSERT_TRUE(scheduler.update(&parked, false, kSecondNs));
+    EXPECT_EQ(countFramesDue(&scheduler, 0), 10);
+
+    const auto moving = makeDrivingState(2.0f, VehicleGear::GEAR_DRIVE);
+    ASSERT_TRUE(scheduler.update(&moving, false, 2 * kSecondNs));
+    EXPECT_EQ(countFramesDue(&scheduler, 1000000), 30);
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -16,6 +16,8 @@
 
 #include <android-base/logging.h>
 
+#include <future>
+
 #include "CarModelConfigReader.h"
 #include "ConfigReader.h"
 #include "IOModule.h"
@@ -49,20 +51,52 @@ IOStatus IOModule::initialize() {
     mIOModuleConfig.sv3dConfig = svConfig.sv3dConfig;
 
     if (mIOModuleConfig.sv3dConfig.sv3dEnabled) {
-        // Read obj and mtl files.
-        if (!ReadObjFromFile(svConfig.sv3dConfig.carModelObjFile,
-                             &mIOModuleConfig.carModelConfig.carModel.partsMap)) {
-            LOG(ERROR) << "ReadObjFromFile() failed.";
-            return IOStatus::ERROR_READ_CAR_MODEL;
+        // Read obj and mtl files, through the cache if there is one. This
+        // takes the longest, so it runs on a thread of its own while the
+        // animations are read.
+        const SvConfig3d& sv3dConfig = svConfig.sv3dConfig;
+        std::map<std::string, CarPart>* partsMap =
+                &mIOModuleConfig.carModelConfig.carModel.partsMap;
+        std::future<bool> carModelRead = std::async(std::launch::async, [&sv3dConfig, partsMap] {
+            return sv3dConfig.carModelCacheFile.empty()
+                    ? ReadObjFromFile(sv3dConfig.carModelObjFile, partsMap)
+                    : ReadObjFromFileCached(sv3dConfig.carModelObjFile, ReadObjOptions(),
+                                            sv3dConfig.carModelCacheFile, partsMap);
+        });
+
+        // Read the levels of detail, each on a thread of its own.
+        std::vector<std::future<std::map<std::string, CarPart>>> lodsRead;
+        for (const CarModelLod& lod : sv3dConfig.carModelLods) {
+            lodsRead.push_back(std::async(std::launch::async, [&lod] {
+                std::map<std::string, CarPart> lodPartsMap;
+                if (!ReadObjFromFile(lod.objFile, &lodPartsMap)) {
+                    LOG(WARNING) << "Failed to read car model level of detail: " << lod.objFile;
+                }
+                return lodPartsMap;
+            }));
         }
+
         // Read animations.
         if (mIOModuleConfig.sv3dConfig.sv3dAnimationsEnabled) {
-            if ((status = ReadCarModelConfig(svConfig.sv3dConfig.carModelConfigFile,
-                                             &mIOModuleConfig.carModelConfig.animationConfig)) !=
-                IOStatus::OK) {
-                LOG(ERROR) << "ReadObjFromFile() failed.";
-                return status;
-            }
+            status = ReadCarModelConfig(sv3dConfig.carModelConfigFile,
+                                        &mIOModuleConfig.carModelConfig.animationConfig);
+        }
+
+        if (!carModelRead.get()) {
+            LOG(ERROR) << "ReadObjFromFile() failed.";
+            return IOStatus::ERROR_READ_CAR_MODEL;
+        }
+
+        // A level of detail that failed to read is the full model, so that
+        // the levels still match the config.
+        for (auto& lodRead : lodsRead) {
+            mIOModuleConfig.carModelConfig.carModel.lodPartsMaps.push_back(
+                    MakeLodPartsMap(*partsMap, lodRead.get()));
+        }
+
+        if (status != IOStatus::OK) {
+            LOG(ERROR) << "ReadCarModelConfig() failed.";
+            return status;
         }
     }
     mIsInitialized = true;
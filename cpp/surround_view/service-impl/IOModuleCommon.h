@@ -28,6 +28,21 @@ namespace sv {
 namespace V1_0 {
 namespace implementation {
 
+// Frame rates the sessions process camera frames at, picked from the speed
+// and gear of the vehicle. The EVS manager is asked for the same rate, so
+// that the cameras slow down as well.
+struct FrameRatePolicy {
+    // Frame rate while the vehicle moves, or is in reverse, or the views or
+    // overlays change. 0 processes every frame.
+    int maneuveringFps = 0;
+
+    // Frame rate while the vehicle stands still. 0 disables the policy.
+    int stationaryFps = 0;
+
+    // Speed under which the vehicle counts as standing still, in m/s.
+    float stationarySpeedMps = 0.1f;
+};
+
 // Struct for camera related configurations.
 // Note: Does not include camera intrinsics and extrinsics, these are specified in EVS metadata.
 struct CameraConfig {
@@ -39,6 +54,13 @@ struct CameraConfig {
 
     // In order: front, right, rear, left.
     std::vector<std::string> maskFilenames;
+
+    // Largest spread of the capture timestamps within a set of frames, in
+    // milliseconds. Sets spread wider are dropped, as stitching them shows
+    // seams. 0 accepts every set.
+    int maxFrameSkewMs = 0;
+
+    FrameRatePolicy frameRatePolicy;
 };
 
 struct SvConfig2d {
@@ -51,6 +73,40 @@ struct SvConfig2d {
     // Car model bounding box for 2d surround view.
     // To be moved into sv 2d params.
     android_auto::surround_view::BoundingBox carBoundingBox;
+
+    // Number of output frames, so that the next frame is stitched while the
+    // client still renders the earlier ones.
+    int numOutputBuffers = 2;
+};
+
+// Lowers the 3d rendering quality step by step while frames take longer than
+// the target, e.g. under thermal throttling, and raises it back once they
+// don't.
+struct AdaptiveQualityConfig {
+    // Render time of a set of frames to hold, in milliseconds. 0 always
+    // renders at full quality.
+    int targetFrameTimeMs = 0;
+
+    // Smallest fraction of the output resolution rendered, and upscaled to
+    // the output resolution.
+    float minRenderScale = 0.5f;
+
+    // Largest number of camera frame sets per rendered set, once the render
+    // scale is at its smallest.
+    int maxFrameInterval = 2;
+};
+
+// A coarser mesh of the car model, rendered while the car is small in every
+// view.
+struct CarModelLod {
+    // Obj file of the mesh. Its parts replace the meshes of the parts of the
+    // full model with the same names; the other parts keep their full mesh.
+    std::string objFile;
+
+    // Width of a view at the car, in meters, from which the mesh is used.
+    // The width grows with the distance of the view from the car and with
+    // its field of view.
+    float minViewWidth = 0.0f;
 };
 
 struct SvConfig3d {
@@ -66,8 +122,22 @@ struct SvConfig3d {
     // Car model obj file.
     std::string carModelObjFile;
 
+    // Binary cache of the parsed car model obj file (Optional). Reading the
+    // cache is much faster than parsing the obj file.
+    std::string carModelCacheFile;
+
+    // Levels of detail of the car model (Optional), from the finest to the
+    // coarsest. The car model obj file is the full detail.
+    std::vector<CarModelLod> carModelLods;
+
     // Surround view 3d params.
     android_auto::surround_view::SurroundView3dParams sv3dParams;
+
+    // Number of output frames, so that the next frame is rendered while the
+    // client still renders the earlier ones.
+    int numOutputBuffers = 2;
+
+    AdaptiveQualityConfig adaptiveQuality;
 };
 
 // Main struct in which surround view config is parsed into.
@@ -300,6 +370,10 @@ struct CarModel {
     // Car model parts map.
     std::map<std::string, android_auto::surround_view::CarPart> partsMap;
 
+    // Parts maps of the levels of detail of SvConfig3d::carModelLods, with
+    // the same parts as partsMap.
+    std::vector<std::map<std::string, android_auto::surround_view::CarPart>> lodPartsMaps;
+
     // Car testures map.
     std::map<std::string, android_auto::surround_view::CarTexture> texturesMap;
 };
@@ -21,6 +21,13 @@
 #include "core_lib.h"
 
 #include <android-base/logging.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -83,18 +90,58 @@ inline Matrix4x4F toMatrix4x4F(const Mat4x4& mat4x4) {
     return matrix4x4F.transpose();
 }
 
+// Returns matL * matR. Mat4x4 stores the matrices column by column, so each
+// column of the result is a sum of the columns of matL, which is computed four
+// floats at a time where SIMD is available.
+inline Mat4x4 multiplyMat4x4(const Mat4x4& matL, const Mat4x4& matR) {
+    Mat4x4 result;
+#if defined(__ARM_NEON)
+    const float32x4_t col0 = vld1q_f32(&matL[0]);
+    const float32x4_t col1 = vld1q_f32(&matL[4]);
+    const float32x4_t col2 = vld1q_f32(&matL[8]);
+    const float32x4_t col3 = vld1q_f32(&matL[12]);
+    for (int i = 0; i < 4; i++) {
+        float32x4_t col = vmulq_n_f32(col0, matR[i * 4]);
+        col = vmlaq_n_f32(col, col1, matR[i * 4 + 1]);
+        col = vmlaq_n_f32(col, col2, matR[i * 4 + 2]);
+        col = vmlaq_n_f32(col, col3, matR[i * 4 + 3]);
+        vst1q_f32(&result[i * 4], col);
+    }
+#elif defined(__SSE__)
+    const __m128 col0 = _mm_loadu_ps(&matL[0]);
+    const __m128 col1 = _mm_loadu_ps(&matL[4]);
+    const __m128 col2 = _mm_loadu_ps(&matL[8]);
+    const __m128 col3 = _mm_loadu_ps(&matL[12]);
+    for (int i = 0; i < 4; i++) {
+        __m128 col = _mm_mul_ps(col0, _mm_set1_ps(matR[i * 4]));
+        col = _mm_add_ps(col, _mm_mul_ps(col1, _mm_set1_ps(matR[i * 4 + 1])));
+        col = _mm_add_ps(col, _mm_mul_ps(col2, _mm_set1_ps(matR[i * 4 + 2])));
+        col = _mm_add_ps(col, _mm_mul_ps(col3, _mm_set1_ps(matR[i * 4 + 3])));
+        _mm_storeu_ps(&result[i * 4], col);
+    }
+#else
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            result[i * 4 + j] = matL[j] * matR[i * 4] + matL[4 + j] * matR[i * 4 + 1] +
+                    matL[8 + j] * matR[i * 4 + 2] + matL[12 + j] * matR[i * 4 + 3];
+        }
+    }
+#endif
+    return result;
+}
+
 // Create a Rotation Matrix, around a unit vector by a ccw angle.
 inline Mat4x4 rotationMatrix(float angleInDegrees, const VectorT& axis) {
     return toMat4x4(rotationMatrix(axis, degToRad(angleInDegrees), 1));
 }
 
 inline Mat4x4 appendRotation(float angleInDegrees, const VectorT& axis, const Mat4x4& mat4) {
-    return toMat4x4(toMatrix4x4F(mat4) * rotationMatrix(axis, degToRad(angleInDegrees), 1));
+    return multiplyMat4x4(mat4, rotationMatrix(angleInDegrees, axis));
 }
 
 // Append mat_l * mat_r;
 inline Mat4x4 appendMat(const Mat4x4& matL, const Mat4x4& matR) {
-    return toMat4x4(toMatrix4x4F(matL) * toMatrix4x4F(matR));
+    return multiplyMat4x4(matL, matR);
 }
 
 // Rotate about a point about a unit vector.
@@ -112,11 +159,11 @@ inline Mat4x4 translationMatrixToMat4x4(const VectorT& translation) {
 }
 
 inline Mat4x4 appendTranslation(const VectorT& translation, const Mat4x4& mat4) {
-    return toMat4x4(toMatrix4x4F(mat4) * translationMatrix(translation));
+    return multiplyMat4x4(mat4, translationMatrixToMat4x4(translation));
 }
 
 inline Mat4x4 appendMatrix(const Mat4x4& deltaMatrix, const Mat4x4& currentMatrix) {
-    return toMat4x4(toMatrix4x4F(deltaMatrix) * toMatrix4x4F(currentMatrix));
+    return multiplyMat4x4(deltaMatrix, currentMatrix);
 }
 
 }  // namespace implementation
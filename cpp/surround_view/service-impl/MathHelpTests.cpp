@@ -0,0 +1,92 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "MathHelpTests"
+
+#include "MathHelp.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+// Multiplies the matrices with the generic Matrix4x4 template.
+Mat4x4 referenceMultiply(const Mat4x4& matL, const Mat4x4& matR) {
+    return toMat4x4(toMatrix4x4F(matL) * toMatrix4x4F(matR));
+}
+
+Mat4x4 randomMat4x4(std::mt19937* generator) {
+    std::uniform_real_distribution<float> distribution(-10.0f, 10.0f);
+    Mat4x4 mat;
+    for (auto& value : mat) {
+        value = distribution(*generator);
+    }
+    return mat;
+}
+
+void expectMat4x4Eq(const Mat4x4& actual, const Mat4x4& expected) {
+    for (int i = 0; i < 16; i++) {
+        // The SIMD kernels may fuse multiplications and additions, so allow
+        // rounding differences.
+        EXPECT_NEAR(actual[i], expected[i], 1e-5f * std::max(1.0f, std::fabs(expected[i])))
+                << "at index " << i;
+    }
+}
+
+TEST(MathHelpTests, MultiplyByIdentity) {
+    std::mt19937 generator(0);
+    const Mat4x4 mat = randomMat4x4(&generator);
+    EXPECT_EQ(multiplyMat4x4(mat, gMat4Identity), mat);
+    EXPECT_EQ(multiplyMat4x4(gMat4Identity, mat), mat);
+}
+
+TEST(MathHelpTests, MultiplyMatchesMatrix4x4) {
+    std::mt19937 generator(0);
+    for (int i = 0; i < 1000; i++) {
+        const Mat4x4 matL = randomMat4x4(&generator);
+        const Mat4x4 matR = randomMat4x4(&generator);
+        expectMat4x4Eq(multiplyMat4x4(matL, matR), referenceMultiply(matL, matR));
+    }
+}
+
+TEST(MathHelpTests, AppendTransformsMatchMatrix4x4) {
+    std::mt19937 generator(0);
+    const Mat4x4 mat = randomMat4x4(&generator);
+    const VectorT axis = {0.0f, 0.6f, 0.8f};
+    const VectorT translation = {1.0f, -2.0f, 3.0f};
+
+    expectMat4x4Eq(appendRotation(30.0f, axis, mat),
+                   referenceMultiply(mat, rotationMatrix(30.0f, axis)));
+    expectMat4x4Eq(appendTranslation(translation, mat),
+                   referenceMultiply(mat, translationMatrixToMat4x4(translation)));
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -16,9 +16,16 @@
 
 #include "ObjReader.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <array>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <type_traits>
 #include <vector>
 
 #include "MtlReader.h"
@@ -67,14 +74,11 @@ void CopyFaceToCarVertex(const std::vector<std::array<float, kNumberOfAxes>>& cu
                 currentNormals[normalId - 1].size() * sizeof(float));
 }
 
-}  // namespace
-
-bool ReadObjFromFile(const std::string& objFilename, std::map<std::string, CarPart>* carPartsMap) {
-    return ReadObjFromFile(objFilename, ReadObjOptions(), carPartsMap);
-}
-
-bool ReadObjFromFile(const std::string& objFilename, const ReadObjOptions& option,
-                     std::map<std::string, CarPart>* carPartsMap) {
+// Parses the obj file, and the mtl files it refers to, which are added to
+// |mtlFilenames|.
+bool ParseObjFile(const std::string& objFilename, const ReadObjOptions& option,
+                  std::map<std::string, CarPart>* carPartsMap,
+                  std::vector<std::string>* mtlFilenames) {
     FILE* file = fopen(objFilename.c_str(), "r");
     if (!file) {
         LOG(ERROR) << "Failed to open obj file: " << objFilename;
@@ -186,6 +190,7 @@ bool ReadObjFromFile(const std::string& objFilename, const ReadObjOptions& optio
                 LOG(ERROR) << "Parse MTL file " << mtlFilename << " failed.";
                 return false;
             }
+            mtlFilenames->push_back(mtlFilename);
             continue;
         }
 
@@ -297,6 +302,314 @@ bool ReadObjFromFile(const std::string& objFilename, const ReadObjOptions& optio
     return true;
 }
 
+// The cache holds the parsed car parts, with the vertices of each part stored as
+// they are in memory, so that reading it is a copy per part.
+// Layout, in native byte order:
+//   magic, version,
+//   ReadObjOptions coordinate mapping, scales, offsets and mtl filename,
+//   number of source files, then per source file: filename, size, mtime,
+//   number of parts, then per part: name, material, number of vertices, vertices.
+// Strings are stored as their uint32_t length followed by their characters.
+constexpr uint32_t kCacheMagic = 0x4d435653;  // "SVCM"
+constexpr uint32_t kCacheVersion = 1;
+
+static_assert(std::is_trivially_copyable<CarVertex>::value,
+              "CarVertex is stored in the cache as raw bytes.");
+
+// Size and modification time of a file the car parts are parsed from, so that
+// the cache is rebuilt when the file changes.
+struct SourceFileStamp {
+    std::string filename;
+    int64_t size = 0;
+    int64_t mtimeNs = 0;
+
+    bool operator==(const SourceFileStamp& other) const {
+        return filename == other.filename && size == other.size && mtimeNs == other.mtimeNs;
+    }
+};
+
+bool GetSourceFileStamp(const std::string& filename, SourceFileStamp* stamp) {
+    struct stat fileStat;
+    if (stat(filename.c_str(), &fileStat) != 0) {
+        return false;
+    }
+    stamp->filename = filename;
+    stamp->size = fileStat.st_size;
+    stamp->mtimeNs = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 +
+            fileStat.st_mtim.tv_nsec;
+    return true;
+}
+
+class CacheWriter {
+public:
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only raw values are written.");
+        writeBytes(&value, sizeof(T));
+    }
+
+    void writeString(const std::string& value) {
+        write(static_cast<uint32_t>(value.size()));
+        writeBytes(value.data(), value.size());
+    }
+
+    void writeBytes(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        mBuffer.insert(mBuffer.end(), bytes, bytes + size);
+    }
+
+    const std::vector<char>& buffer() const { return mBuffer; }
+
+private:
+    std::vector<char> mBuffer;
+};
+
+class CacheReader {
+public:
+    CacheReader(const char* data, size_t size) : mData(data), mSize(size) {}
+
+    template <typename T>
+    bool read(T* value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Only raw values are read.");
+        return readBytes(value, sizeof(T));
+    }
+
+    bool readString(std::string* value) {
+        uint32_t length = 0;
+        if (!read(&length) || length > mSize - mOffset) {
+            return false;
+        }
+        value->assign(mData + mOffset, length);
+        mOffset += length;
+        return true;
+    }
+
+    bool readBytes(void* data, size_t size) {
+        if (size > mSize - mOffset) {
+            return false;
+        }
+        std::memcpy(data, mData + mOffset, size);
+        mOffset += size;
+        return true;
+    }
+
+    bool atEnd() const { return mOffset == mSize; }
+
+private:
+    const char* mData;
+    const size_t mSize;
+    size_t mOffset = 0;
+};
+
+void WriteCacheKey(const ReadObjOptions& option, const std::vector<SourceFileStamp>& sources,
+                   CacheWriter* writer) {
+    writer->write(kCacheMagic);
+    writer->write(kCacheVersion);
+    writer->write(option.coordinateMapping);
+    writer->write(option.scales);
+    writer->write(option.offsets);
+    writer->writeString(option.mtlFilename);
+    writer->write(static_cast<uint32_t>(sources.size()));
+    for (const auto& source : sources) {
+        writer->writeString(source.filename);
+        writer->write(source.size);
+        writer->write(source.mtimeNs);
+    }
+}
+
+// Returns true if the cache was made from |objFilename| with |option|, and its
+// source files did not change since.
+bool ReadCacheKey(const std::string& objFilename, const ReadObjOptions& option,
+                  CacheReader* reader) {
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    if (!reader->read(&magic) || magic != kCacheMagic || !reader->read(&version) ||
+        version != kCacheVersion) {
+        return false;
+    }
+
+    ReadObjOptions cachedOption;
+    if (!reader->read(&cachedOption.coordinateMapping) || !reader->read(&cachedOption.scales) ||
+        !reader->read(&cachedOption.offsets) || !reader->readString(&cachedOption.mtlFilename)) {
+        return false;
+    }
+    if (std::memcmp(cachedOption.coordinateMapping, option.coordinateMapping,
+                    sizeof(option.coordinateMapping)) != 0 ||
+        std::memcmp(cachedOption.scales, option.scales, sizeof(option.scales)) != 0 ||
+        std::memcmp(cachedOption.offsets, option.offsets, sizeof(option.offsets)) != 0 ||
+        cachedOption.mtlFilename != option.mtlFilename) {
+        return false;
+    }
+
+    uint32_t numSources = 0;
+    if (!reader->read(&numSources) || numSources == 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < numSources; ++i) {
+        SourceFileStamp cachedSource;
+        SourceFileStamp currentSource;
+        if (!reader->readString(&cachedSource.filename) || !reader->read(&cachedSource.size) ||
+            !reader->read(&cachedSource.mtimeNs)) {
+            return false;
+        }
+        // The first source is the obj file, the mtl files it refers to follow.
+        if (i == 0 && cachedSource.filename != objFilename) {
+            return false;
+        }
+        if (!GetSourceFileStamp(cachedSource.filename, &currentSource) ||
+            !(currentSource == cachedSource)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReadCacheFile(const std::string& cacheFilename, const std::string& objFilename,
+                   const ReadObjOptions& option, std::map<std::string, CarPart>* carPartsMap) {
+    int fd = open(cacheFilename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    const size_t size = fileStat.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG(WARNING) << "Failed to map car model cache: " << cacheFilename;
+        return false;
+    }
+
+    CacheReader reader(static_cast<const char*>(data), size);
+    std::map<std::string, CarPart> cachedPartsMap;
+    bool valid = ReadCacheKey(objFilename, option, &reader);
+    uint32_t numParts = 0;
+    valid = valid && reader.read(&numParts);
+    for (uint32_t i = 0; valid && i < numParts; ++i) {
+        std::string name;
+        CarMaterial material;
+        uint32_t numVertices = 0;
+        valid = reader.readString(&name) && reader.read(&material.illum) &&
+                reader.read(&material.ka) && reader.read(&material.kd) &&
+                reader.read(&material.ks) && reader.read(&material.d) &&
+                reader.read(&material.ns) && reader.read(&numVertices);
+        if (!valid) {
+            break;
+        }
+        auto inserted = cachedPartsMap.emplace(
+                std::make_pair(name,
+                               CarPart((std::vector<CarVertex>()), material, kMat4Identity,
+                                       std::string(), std::vector<std::string>())));
+        std::vector<CarVertex>& vertices = inserted.first->second.vertices;
+        // Checked before resizing, so that a corrupted count does not allocate.
+        valid = inserted.second && numVertices <= size / sizeof(CarVertex);
+        if (valid) {
+            vertices.resize(numVertices);
+            valid = reader.readBytes(vertices.data(), numVertices * sizeof(CarVertex));
+        }
+    }
+    valid = valid && reader.atEnd();
+    munmap(data, size);
+
+    if (!valid) {
+        return false;
+    }
+    carPartsMap->insert(std::make_move_iterator(cachedPartsMap.begin()),
+                        std::make_move_iterator(cachedPartsMap.end()));
+    return true;
+}
+
+bool WriteCacheFile(const std::string& cacheFilename, const ReadObjOptions& option,
+                    const std::vector<SourceFileStamp>& sources,
+                    const std::map<std::string, CarPart>& carPartsMap) {
+    CacheWriter writer;
+    WriteCacheKey(option, sources, &writer);
+    writer.write(static_cast<uint32_t>(carPartsMap.size()));
+    for (const auto& [name, part] : carPartsMap) {
+        writer.writeString(name);
+        writer.write(part.material.illum);
+        writer.write(part.material.ka);
+        writer.write(part.material.kd);
+        writer.write(part.material.ks);
+        writer.write(part.material.d);
+        writer.write(part.material.ns);
+        writer.write(static_cast<uint32_t>(part.vertices.size()));
+        writer.writeBytes(part.vertices.data(), part.vertices.size() * sizeof(CarVertex));
+    }
+
+    // Written aside and renamed, so that a reader never sees a partial cache.
+    const std::string tempFilename = cacheFilename + ".tmp";
+    FILE* file = fopen(tempFilename.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    const std::vector<char>& buffer = writer.buffer();
+    bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    written = (fclose(file) == 0) && written;
+    if (!written || rename(tempFilename.c_str(), cacheFilename.c_str()) != 0) {
+        unlink(tempFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool ReadObjFromFile(const std::string& objFilename, std::map<std::string, CarPart>* carPartsMap) {
+    return ReadObjFromFile(objFilename, ReadObjOptions(), carPartsMap);
+}
+
+bool ReadObjFromFile(const std::string& objFilename, const ReadObjOptions& option,
+                     std::map<std::string, CarPart>* carPartsMap) {
+    std::vector<std::string> mtlFilenames;
+    return ParseObjFile(objFilename, option, carPartsMap, &mtlFilenames);
+}
+
+bool ReadObjFromFileCached(const std::string& objFilename, const ReadObjOptions& option,
+                           const std::string& cacheFilename,
+                           std::map<std::string, CarPart>* carPartsMap) {
+    if (ReadCacheFile(cacheFilename, objFilename, option, carPartsMap)) {
+        LOG(INFO) << "Read car model from cache: " << cacheFilename;
+        return true;
+    }
+
+    std::vector<std::string> mtlFilenames;
+    std::map<std::string, CarPart> parsedPartsMap;
+    if (!ParseObjFile(objFilename, option, &parsedPartsMap, &mtlFilenames)) {
+        return false;
+    }
+
+    std::vector<SourceFileStamp> sources(1 + mtlFilenames.size());
+    bool stamped = GetSourceFileStamp(objFilename, &sources[0]);
+    for (size_t i = 0; stamped && i < mtlFilenames.size(); ++i) {
+        stamped = GetSourceFileStamp(mtlFilenames[i], &sources[i + 1]);
+    }
+    if (!stamped || !WriteCacheFile(cacheFilename, option, sources, parsedPartsMap)) {
+        LOG(WARNING) << "Failed to write car model cache: " << cacheFilename;
+    }
+
+    carPartsMap->insert(std::make_move_iterator(parsedPartsMap.begin()),
+                        std::make_move_iterator(parsedPartsMap.end()));
+    return true;
+}
+
+std::map<std::string, CarPart> MakeLodPartsMap(
+        const std::map<std::string, CarPart>& fullDetailPartsMap,
+        const std::map<std::string, CarPart>& lodPartsMap) {
+    std::map<std::string, CarPart> partsMap = fullDetailPartsMap;
+    for (auto& [name, part] : partsMap) {
+        const auto lodPart = lodPartsMap.find(name);
+        if (lodPart != lodPartsMap.end()) {
+            part.vertices = lodPart->second.vertices;
+            part.material = lodPart->second.material;
+        }
+    }
+    return partsMap;
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace sv
@@ -68,6 +68,24 @@ bool ReadObjFromFile(const std::string& objFilename, std::map<std::string, CarPa
 bool ReadObjFromFile(const std::string& obFilename, const ReadObjOptions& option,
                      std::map<std::string, CarPart>* carPartsMap);
 
+// Reads obj file like ReadObjFromFile(), through a binary cache of the parsed
+// car parts at |cacheFilename|.
+// The cache is used if it was made with the same |option| from the same obj and
+// mtl files, and these did not change since. Otherwise the obj file is parsed
+// and the cache is written anew; failing to write it is not an error, so the
+// cache may live on a read-only partition once generated.
+bool ReadObjFromFileCached(const std::string& objFilename, const ReadObjOptions& option,
+                           const std::string& cacheFilename,
+                           std::map<std::string, CarPart>* carPartsMap);
+
+// Makes the parts map of a level of detail of the car model: the parts of
+// |fullDetailPartsMap|, with the vertices and material of the parts of the
+// same name in |lodPartsMap|. Parts only in |lodPartsMap| are left out, as
+// the part hierarchy and the animations follow the full model.
+std::map<std::string, CarPart> MakeLodPartsMap(
+        const std::map<std::string, CarPart>& fullDetailPartsMap,
+        const std::map<std::string, CarPart>& lodPartsMap);
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace sv
@@ -22,6 +22,8 @@
 #include "core_lib.h"
 
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
 #include <map>
 #include <string>
 
@@ -33,12 +35,69 @@ namespace V1_0 {
 namespace implementation {
 namespace {
 
+using android_auto::surround_view::CarVertex;
+
 TEST(ObjParserTests, ReadObjFileSuccess) {
     std::map<std::string, CarPart> carPartsMap;
     EXPECT_TRUE(ReadObjFromFile("vendor/etc/automotive/sv/sample_car.obj", &carPartsMap));
     EXPECT_NE(carPartsMap.size(), 0);
 }
 
+TEST(ObjParserTests, ReadObjFileCachedSuccess) {
+    const std::string objFilename = "vendor/etc/automotive/sv/sample_car.obj";
+    const std::string cacheFilename = "/data/local/tmp/sample_car.svcache";
+    std::remove(cacheFilename.c_str());
+
+    std::map<std::string, CarPart> parsedPartsMap;
+    ASSERT_TRUE(ReadObjFromFile(objFilename, &parsedPartsMap));
+
+    // The first read parses the obj file and writes the cache, the second reads the cache.
+    for (int i = 0; i < 2; ++i) {
+        std::map<std::string, CarPart> carPartsMap;
+        ASSERT_TRUE(ReadObjFromFileCached(objFilename, ReadObjOptions(), cacheFilename,
+                                          &carPartsMap));
+        ASSERT_EQ(carPartsMap.size(), parsedPartsMap.size());
+        for (const auto& [name, part] : parsedPartsMap) {
+            const auto it = carPartsMap.find(name);
+            ASSERT_NE(it, carPartsMap.end());
+            EXPECT_EQ(it->second.material.kd, part.material.kd);
+            ASSERT_EQ(it->second.vertices.size(), part.vertices.size());
+            EXPECT_EQ(std::memcmp(it->second.vertices.data(), part.vertices.data(),
+                                  part.vertices.size() * sizeof(part.vertices[0])),
+                      0);
+        }
+    }
+    std::remove(cacheFilename.c_str());
+}
+
+TEST(ObjParserTests, MakeLodPartsMapKeepsFullModelHierarchy) {
+    std::map<std::string, CarPart> fullPartsMap;
+    ASSERT_TRUE(ReadObjFromFile("vendor/etc/automotive/sv/sample_car.obj", &fullPartsMap));
+    ASSERT_FALSE(fullPartsMap.empty());
+
+    // A coarse mesh of the first part, and a part the full model does not have.
+    const std::string coarseName = fullPartsMap.begin()->first;
+    const CarPart& fullPart = fullPartsMap.begin()->second;
+    std::map<std::string, CarPart> lodPartsMap;
+    lodPartsMap.emplace(coarseName,
+                        CarPart(std::vector<CarVertex>(3), fullPart.material, fullPart.model_mat,
+                                "", {}));
+    lodPartsMap.emplace("not_in_full_model",
+                        CarPart(std::vector<CarVertex>(3), fullPart.material, fullPart.model_mat,
+                                "", {}));
+
+    const std::map<std::string, CarPart> partsMap = MakeLodPartsMap(fullPartsMap, lodPartsMap);
+    ASSERT_EQ(partsMap.size(), fullPartsMap.size());
+    for (const auto& [name, part] : fullPartsMap) {
+        const auto it = partsMap.find(name);
+        ASSERT_NE(it, partsMap.end());
+        EXPECT_EQ(it->second.parent_part_id, part.parent_part_id);
+        EXPECT_EQ(it->second.child_part_ids, part.child_part_ids);
+        EXPECT_EQ(it->second.vertices.size(),
+                  name == coarseName ? 3u : part.vertices.size());
+    }
+}
+
 }  // namespace
 }  // namespace implementation
 }  // namespace V1_0
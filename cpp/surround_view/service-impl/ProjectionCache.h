@@ -0,0 +1,91 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SURROUND_VIEW_SERVICE_IMPL_PROJECTIONCACHE_H_
+#define SURROUND_VIEW_SERVICE_IMPL_PROJECTIONCACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Projected camera points, one table per camera, keyed by the camera point.
+// Overlays ask for the same camera points frame after frame, so most points
+// are found here instead of being projected by the core lib again.
+// It is not thread safe, the sessions guard it with a lock of their own.
+template <typename PointT>
+class ProjectionCache {
+public:
+    // |maxPointsPerCamera| bounds the memory of each table. Once a table is
+    // full, the points it holds are kept and new points are not added.
+    explicit ProjectionCache(size_t maxPointsPerCamera) :
+          mMaxPointsPerCamera(maxPointsPerCamera) {}
+
+    // Drops all the points, e.g. when the projection changes.
+    void reset(int numCameras) {
+        mTables.clear();
+        mTables.resize(numCameras);
+    }
+
+    bool find(int cameraIndex, int x, int y, PointT* point) const {
+        if (cameraIndex < 0 || cameraIndex >= static_cast<int>(mTables.size())) {
+            return false;
+        }
+        const auto& table = mTables[cameraIndex];
+        const auto it = table.find(key(x, y));
+        if (it == table.end()) {
+            return false;
+        }
+        *point = it->second;
+        return true;
+    }
+
+    void insert(int cameraIndex, int x, int y, const PointT& point) {
+        if (cameraIndex < 0 || cameraIndex >= static_cast<int>(mTables.size())) {
+            return;
+        }
+        auto& table = mTables[cameraIndex];
+        if (table.size() < mMaxPointsPerCamera) {
+            table.emplace(key(x, y), point);
+        }
+    }
+
+private:
+    // Camera points are within the camera resolution, so each coordinate fits
+    // in 32 bits.
+    static uint64_t key(int x, int y) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32) | static_cast<uint32_t>(x);
+    }
+
+    const size_t mMaxPointsPerCamera;
+    std::vector<std::unordered_map<uint64_t, PointT>> mTables;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // SURROUND_VIEW_SERVICE_IMPL_PROJECTIONCACHE_H_
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SURROUND_VIEW_SERVICE_IMPL_QUALITYCONTROLLER_H_
+#define SURROUND_VIEW_SERVICE_IMPL_QUALITYCONTROLLER_H_
+
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "IOModuleCommon.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Picks the quality the 3d session renders at, to hold the target render time
+// of a set of frames. The levels first lower the render resolution, which the
+// session upscales to the output resolution, and then the frame rate. A level
+// is left for a lower one once the smoothed render time goes over the target,
+// and for a higher one once it stayed well under the target for a while, so
+// that it doesn't flip back and forth. The thermal throttling severity sets
+// the lowest level that may be used, so the GPU is relieved before it slows
+// down.
+//
+// The render times are recorded on the render thread. The thermal severity
+// may be set from any thread.
+class QualityController {
+public:
+    struct Level {
+        float renderScale;
+        // Camera frame sets per rendered set.
+        int frameInterval;
+    };
+
+    // Thermal throttling severities, as in the thermal HAL.
+    enum ThermalSeverity {
+        THERMAL_NONE = 0,
+        THERMAL_LIGHT,
+        THERMAL_MODERATE,
+        THERMAL_SEVERE,
+        THERMAL_CRITICAL,
+        THERMAL_EMERGENCY,
+        THERMAL_SHUTDOWN,
+    };
+
+    // Scale lost at each level, until the smallest scale.
+    static constexpr float kScaleStep = 0.125f;
+
+    // Render times, weighted by 1/2^kSmoothingShift, are averaged so that a
+    // single slow frame does not change the level.
+    static constexpr int kSmoothingShift = 3;
+
+    // Frames rendered at a level before it may be lowered again, and before
+    // it may be raised.
+    static constexpr int kFramesBeforeStepDown = 8;
+    static constexpr int kFramesBeforeStepUp = 90;
+
+    // The level is only raised while the render time stays under this
+    // percentage of the target, leaving room for the higher cost.
+    static constexpr int kStepUpPercent = 60;
+
+    explicit QualityController(const AdaptiveQualityConfig& config) :
+          mTargetFrameTimeUs(static_cast<int64_t>(std::max(config.targetFrameTimeMs, 0)) * 1000) {
+        const float minScale = std::clamp(config.minRenderScale, kScaleStep, 1.0f);
+        for (float scale = 1.0f; scale > minScale; scale -= kScaleStep) {
+            mLevels.push_back({scale, 1});
+        }
+        for (int interval = 1; interval <= std::max(config.maxFrameInterval, 1); ++interval) {
+            mLevels.push_back({minScale, interval});
+        }
+    }
+
+    bool isEnabled() const { return mTargetFrameTimeUs > 0; }
+
+    // Goes back to full quality, e.g. for a new stream.
+    void reset() {
+        mLevel = 0;
+        mFramesAtLevel = 0;
+        mSmoothedFrameTimeUs = 0;
+        mLevelChanges = 0;
+        mLevelForDump = 0;
+        mFrameInterval = 1;
+    }
+
+    void setThermalSeverity(int severity) { mThermalSeverity = severity; }
+
+    // Records how long the last set of frames took to render. Returns true if
+    // the level changed, in which case the next set is rendered at the new
+    // level.
+    bool recordFrameTime(int64_t frameTimeUs) {
+        if (!isEnabled()) {
+            return false;
+        }
+
+        // The first frame of a stream starts the average.
+        mSmoothedFrameTimeUs = mSmoothedFrameTimeUs == 0
+                ? frameTimeUs
+                : mSmoothedFrameTimeUs +
+                        ((frameTimeUs - mSmoothedFrameTimeUs) >> kSmoothingShift);
+        ++mFramesAtLevel;
+
+        int level = mLevel;
+        if (mSmoothedFrameTimeUs > mTargetFrameTimeUs && mFramesAtLevel >= kFramesBeforeStepDown) {
+            level = std::min(level + 1, static_cast<int>(mLevels.size()) - 1);
+        } else if (mSmoothedFrameTimeUs * 100 < mTargetFrameTimeUs * kStepUpPercent &&
+                   mFramesAtLevel >= kFramesBeforeStepUp) {
+            level = std::max(level - 1, 0);
+        }
+        level = std::max(level, getThermalFloor());
+
+        if (level == mLevel) {
+            return false;
+        }
+
+        // The new level starts over from the time it is expected to take, as
+        // the render time scales with the rendered area.
+        const float areaRatio = (mLevels[level].renderScale * mLevels[level].renderScale) /
+                (mLevels[mLevel].renderScale * mLevels[mLevel].renderScale);
+        mSmoothedFrameTimeUs = static_cast<int64_t>(mSmoothedFrameTimeUs * areaRatio);
+        mLevel = level;
+        mFramesAtLevel = 0;
+        ++mLevelChanges;
+        mLevelForDump = level;
+        mFrameInterval = mLevels[level].frameInterval;
+        return true;
+    }
+
+    const Level& getLevel() const { return mLevels[mLevel]; }
+
+    // Safe to read from any thread.
+    int getFrameInterval() const { return mFrameInterval; }
+
+    std::string toString(const char* indent = "") const {
+        if (!isEnabled()) {
+            return android::base::StringPrintf("%sAdaptive quality: disabled\n", indent);
+        }
+        const Level& level = mLevels[mLevelForDump];
+        return android::base::StringPrintf(
+                "%sAdaptive quality: level %d of %zu, render scale %.3f, frame interval %d, "
+                "%" PRIu64 " level changes, thermal severity %d\n",
+                indent, mLevelForDump.load(), mLevels.size() - 1, level.renderScale,
+                level.frameInterval, mLevelChanges.load(), mThermalSeverity.load());
+    }
+
+private:
+    // Light throttling is left to the render times. From moderate throttling
+    // on, each severity takes away two more levels, and critical throttling
+    // or worse takes the lowest level.
+    int getThermalFloor() const {
+        const int severity = mThermalSeverity;
+        const int lowest = static_cast<int>(mLevels.size()) - 1;
+        if (severity >= THERMAL_CRITICAL) {
+            return lowest;
+        }
+        return std::clamp((severity - THERMAL_LIGHT) * 2, 0, lowest);
+    }
+
+    const int64_t mTargetFrameTimeUs;
+    std::vector<Level> mLevels;
+
+    // Owned by the render thread.
+    int mLevel = 0;
+    int mFramesAtLevel = 0;
+    int64_t mSmoothedFrameTimeUs = 0;
+
+    std::atomic<int> mThermalSeverity = THERMAL_NONE;
+    std::atomic<int> mFrameInterval = 1;
+    std::atomic<int> mLevelForDump = 0;
+    std::atomic<uint64_t> mLevelChanges = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // SURROUND_VIEW_SERVICE_IMPL_QUALITYCONTROLLER_H_
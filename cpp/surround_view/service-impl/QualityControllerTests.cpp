@@ -0,0 +1,130 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "QualityControllerTests"
+
+#include "QualityController.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+AdaptiveQualityConfig makeConfig(int targetFrameTimeMs) {
+    AdaptiveQualityConfig config;
+    config.targetFrameTimeMs = targetFrameTimeMs;
+    config.minRenderScale = 0.5f;
+    config.maxFrameInterval = 2;
+    return config;
+}
+
+// Records frames of the given time until the level changes, or maxFrames.
+int recordUntilChange(QualityController* controller, int64_t frameTimeUs, int maxFrames) {
+    for (int i = 1; i <= maxFrames; i++) {
+        if (controller->recordFrameTime(frameTimeUs)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+TEST(QualityControllerTests, DisabledWithoutTarget) {
+    QualityController controller(makeConfig(0));
+    EXPECT_FALSE(controller.isEnabled());
+    EXPECT_EQ(recordUntilChange(&controller, 1000000, 100), -1);
+    EXPECT_EQ(controller.getLevel().renderScale, 1.0f);
+    EXPECT_EQ(controller.getFrameInterval(), 1);
+}
+
+TEST(QualityControllerTests, StepsDownResolutionThenFrameRate) {
+    QualityController controller(makeConfig(30));
+
+    // 1.0, 0.875, 0.75, 0.625, then 0.5 at one and two frame intervals.
+    for (float scale : {0.875f, 0.75f, 0.625f, 0.5f}) {
+        EXPECT_EQ(recordUntilChange(&controller, 60000, 100),
+                  QualityController::kFramesBeforeStepDown);
+        EXPECT_EQ(controller.getLevel().renderScale, scale);
+        EXPECT_EQ(controller.getFrameInterval(), 1);
+    }
+    EXPECT_EQ(recordUntilChange(&controller, 60000, 100),
+              QualityController::kFramesBeforeStepDown);
+    EXPECT_EQ(controller.getLevel().renderScale, 0.5f);
+    EXPECT_EQ(controller.getFrameInterval(), 2);
+
+    // The lowest level is kept however slow the frames are.
+    EXPECT_EQ(recordUntilChange(&controller, 60000, 100), -1);
+}
+
+TEST(QualityControllerTests, StepsUpOnlyWellUnderTarget) {
+    QualityController controller(makeConfig(30));
+    ASSERT_GT(recordUntilChange(&controller, 60000, 100), 0);
+    ASSERT_EQ(controller.getLevel().renderScale, 0.875f);
+
+    // Once the average settled just under the target, the level is held.
+    recordUntilChange(&controller, 25000, 100);
+    const float scale = controller.getLevel().renderScale;
+    EXPECT_EQ(recordUntilChange(&controller, 25000, 500), -1);
+    EXPECT_EQ(controller.getLevel().renderScale, scale);
+
+    // Well under it raises the level, though not right away.
+    QualityController fast(makeConfig(30));
+    ASSERT_GT(recordUntilChange(&fast, 60000, 100), 0);
+    const int frames = recordUntilChange(&fast, 5000, 500);
+    EXPECT_GE(frames, QualityController::kFramesBeforeStepUp);
+    EXPECT_EQ(fast.getLevel().renderScale, 1.0f);
+}
+
+TEST(QualityControllerTests, ThermalSeverityLowersLevel) {
+    QualityController controller(makeConfig(30));
+
+    controller.setThermalSeverity(QualityController::THERMAL_LIGHT);
+    EXPECT_EQ(recordUntilChange(&controller, 1000, 10), -1);
+
+    controller.setThermalSeverity(QualityController::THERMAL_MODERATE);
+    EXPECT_EQ(recordUntilChange(&controller, 1000, 10), 1);
+    EXPECT_EQ(controller.getLevel().renderScale, 0.75f);
+
+    controller.setThermalSeverity(QualityController::THERMAL_CRITICAL);
+    EXPECT_EQ(recordUntilChange(&controller, 1000, 10), 1);
+    EXPECT_EQ(controller.getFrameInterval(), 2);
+
+    // Fast frames raise the level again once the device cooled down.
+    controller.setThermalSeverity(QualityController::THERMAL_NONE);
+    EXPECT_GT(recordUntilChange(&controller, 1000, 500), 0);
+    EXPECT_EQ(controller.getFrameInterval(), 1);
+}
+
+TEST(QualityControllerTests, ResetGoesBackToFullQuality) {
+    QualityController controller(makeConfig(30));
+    ASSERT_GT(recordUntilChange(&controller, 60000, 100), 0);
+
+    controller.reset();
+    EXPECT_EQ(controller.getLevel().renderScale, 1.0f);
+    EXPECT_EQ(controller.getFrameInterval(), 1);
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
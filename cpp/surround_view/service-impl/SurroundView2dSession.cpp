@@ -23,15 +23,18 @@
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <android/hardware_buffer.h>
 #include <system/camera_metadata.h>
+#include <threadpolicy/ThreadPolicy.h>
 #include <utils/SystemClock.h>
 #include <utils/Trace.h>
 #include <vndk/hardware_buffer.h>
 
+#include <algorithm>
 #include <thread>
 
 using ::std::adopt_lock;
 using ::std::lock;
 using ::std::lock_guard;
+using ::std::make_pair;
 using ::std::map;
 using ::std::mutex;
 using ::std::scoped_lock;
@@ -68,9 +71,56 @@ static const size_t kStreamCfgSz = sizeof(RawStreamConfig) / sizeof(int32_t);
 static const int kInputNumChannels = 4;
 static const int kOutputNumChannels = 3;
 static const int kNumFrames = 4;
+
+// Bounds the projected points kept per camera, about 1.5 MB with the overhead
+// of the table.
+static const size_t kMaxProjectedPointsPerCamera = 1 << 15;
+// One set of input frames is copied while the other one is stitched.
+static const int kNumInputSets = 2;
 static const int kSv2dViewId = 0;
 static const float kUndistortionScales[4] = {1.0f, 1.0f, 1.0f, 1.0f};
 
+// The core lib builds the stitching tables of the 2d view from the camera
+// calibration and the output resolution in SetStaticData. A session that ends
+// leaves its instance here, so that the next one skips building the tables
+// again as long as the calibration and the resolution did not change.
+struct Cached2dSurroundView {
+    vector<SurroundViewCameraParams> cameraParams;
+    SurroundView2dParams sv2dParams;
+    unique_ptr<SurroundView> surroundView;
+};
+static mutex sCachedSurroundViewLock;
+static Cached2dSurroundView sCachedSurroundView GUARDED_BY(sCachedSurroundViewLock);
+
+static bool isSameCalibration(const vector<SurroundViewCameraParams>& lhs,
+                              const vector<SurroundViewCameraParams>& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); i++) {
+        // operator== leaves the validity mask out.
+        if (!(lhs[i] == rhs[i]) ||
+            lhs[i].validity_mask_filename != rhs[i].validity_mask_filename) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Takes the cached instance if it was set up with the same calibration and
+// 2d parameters. The instance is dropped otherwise.
+static unique_ptr<SurroundView> takeCachedSurroundView(
+        const vector<SurroundViewCameraParams>& cameraParams,
+        const SurroundView2dParams& sv2dParams) {
+    scoped_lock<mutex> lock(sCachedSurroundViewLock);
+    unique_ptr<SurroundView> surroundView = std::move(sCachedSurroundView.surroundView);
+    if (surroundView == nullptr || !(sCachedSurroundView.sv2dParams == sv2dParams) ||
+        !isSameCalibration(sCachedSurroundView.cameraParams, cameraParams)) {
+        return nullptr;
+    }
+    return surroundView;
+}
+
 SurroundView2dSession::FramesHandler::FramesHandler(
     sp<IEvsCamera> pCamera, sp<SurroundView2dSession> pSession)
     : mCamera(pCamera),
@@ -84,24 +134,70 @@ Return<void> SurroundView2dSession::FramesHandler::deliverFrame(
     return {};
 }
 
+bool SurroundView2dSession::FramesHandler::isFrameSetDue(
+        const hidl_vec<BufferDesc_1_1>& buffers) {
+    FrameRateScheduler& scheduler = mSession->mFrameRateScheduler;
+    if (!scheduler.isEnabled() || buffers.size() == 0) {
+        return true;
+    }
+
+    VhalHandler::DrivingState drivingState;
+    const bool hasDrivingState = mSession->mVhalHandler != nullptr &&
+            mSession->mVhalHandler->getDrivingState(&drivingState);
+    if (scheduler.update(hasDrivingState ? &drivingState : nullptr,
+                         mSession->mSceneChanged.exchange(false), elapsedRealtimeNano())) {
+        // The EVS manager slows the cameras down to the rate as well.
+        const int32_t frameRate = scheduler.getFrameRate();
+        LOG(INFO) << "Frame rate policy: " << frameRate << " fps";
+        hidl_vec<uint8_t> value;
+        value.resize(sizeof(frameRate));
+        memcpy(value.data(), &frameRate, sizeof(frameRate));
+        mCamera->setExtendedInfo_1_1(FrameRateScheduler::kEvsFrameRateId, value);
+    }
+    return scheduler.isFrameDue(buffers[0].timestamp);
+}
+
 Return<void> SurroundView2dSession::FramesHandler::deliverFrame_1_1(
     const hidl_vec<BufferDesc_1_1>& buffers) {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
     LOG(INFO) << "Received " << buffers.size() << " frames from the camera";
     mSession->mSequenceId++;
+    mSession->mStats.frameReceived();
 
+    if (!isFrameSetDue(buffers)) {
+        mSession->mStats.frameThrottled();
+        mCamera->doneWithFrame_1_1(buffers);
+        return {};
+    }
+
+    const int64_t skewUs = getFrameSkewUs(buffers);
+    mSession->mStats.recordLatency(SurroundViewStats::FRAME_SKEW, skewUs);
+    const int maxSkewMs = mSession->mIOModuleConfig->cameraConfig.maxFrameSkewMs;
+    if (maxSkewMs > 0 && skewUs > maxSkewMs * 1000) {
+        // The EVS buffers come and go back as a set, so a lagging frame is
+        // not held for the next one and the whole set is dropped.
+        LOG(WARNING) << "Frames are " << skewUs << "us apart, more than " << maxSkewMs
+                     << "ms. Skip frames:" << mSession->mSequenceId;
+        mSession->mStats.frameUnsynced();
+        mCamera->doneWithFrame_1_1(buffers);
+        return {};
+    }
+
+    int inputSetIndex;
     {
         scoped_lock<mutex> lock(mSession->mAccessLock);
-        if (mSession->mProcessingEvsFrames) {
+        if (mSession->mStreamState != RUNNING || mSession->mFreeInputSets.empty()) {
             LOG(WARNING) << "EVS frames are being processed. Skip frames:"
                          << mSession->mSequenceId;
+            mSession->mStats.frameSkipped();
             mCamera->doneWithFrame_1_1(buffers);
             return {};
         } else {
-            // Sets the flag to true immediately so the new coming frames will
-            // be skipped.
-            mSession->mProcessingEvsFrames = true;
+            // Takes the set immediately so the new coming frames go to
+            // another one, or are skipped.
+            inputSetIndex = mSession->mFreeInputSets.front();
+            mSession->mFreeInputSets.pop_front();
         }
     }
 
@@ -110,14 +206,23 @@ Return<void> SurroundView2dSession::FramesHandler::deliverFrame_1_1(
         LOG(ERROR) << "The number of incoming frames is " << buffers.size()
                    << ", which is different from the number " << kNumFrames
                    << ", specified in config file";
-        mSession->mProcessingEvsFrames = false;
+        mSession->mFreeInputSets.push_back(inputSetIndex);
+        mSession->mFramesSignal.notify_all();
         mCamera->doneWithFrame_1_1(buffers);
         return {};
     }
 
+    InputSet& inputSet = mSession->mInputSets[inputSetIndex];
+    inputSet.sequenceId = mSession->mSequenceId;
+    inputSet.timestampUs = buffers[0].timestamp;
+    for (const auto& buffer : buffers) {
+        inputSet.timestampUs = std::min<int64_t>(inputSet.timestampUs, buffer.timestamp);
+    }
+
+    const int64_t copyStartNs = elapsedRealtimeNano();
+    vector<int> indices;
     {
         scoped_lock<mutex> lock(mSession->mAccessLock);
-        vector<int> indices;
         for (const auto& id
                 : mSession->mIOModuleConfig->cameraConfig.evsCameraIds) {
             for (int i = 0; i < kNumFrames; i++) {
@@ -130,46 +235,55 @@ Return<void> SurroundView2dSession::FramesHandler::deliverFrame_1_1(
 
         if (indices.size() != kNumFrames) {
             LOG(ERROR) << "The frames are not from the cameras we expected!";
-            mSession->mProcessingEvsFrames = false;
+            mSession->mFreeInputSets.push_back(inputSetIndex);
+            mSession->mFramesSignal.notify_all();
             mCamera->doneWithFrame_1_1(buffers);
             return {};
         }
 
         if (mSession->mGpuAccelerationEnabled) {
             for (int i = 0; i < kNumFrames; i++) {
-                LOG(DEBUG) << "Importing graphic buffer from camera ["
-                           << buffers[indices[i]].deviceId << "]";
-                const AHardwareBuffer_Desc* pDesc = reinterpret_cast<const AHardwareBuffer_Desc*>(
-                        &buffers[indices[i]].buffer.description);
-
-                AHardwareBuffer* hardwareBuffer;
-                status_t status = AHardwareBuffer_createFromHandle(
-                        pDesc, buffers[indices[i]].buffer.nativeHandle,
-                        AHARDWAREBUFFER_CREATE_FROM_HANDLE_METHOD_CLONE, &hardwareBuffer);
-
-                if (status != NO_ERROR) {
-                    LOG(ERROR) << "Can't create AHardwareBuffer from handle. Error: " << status;
+                // The core lib samples the Evs buffer directly, so the frame
+                // is neither read back nor copied.
+                sp<GraphicBuffer> inputBuffer = mSession->getInputBuffer(buffers[indices[i]]);
+                if (inputBuffer == nullptr) {
+                    LOG(ERROR) << "Can't import graphic buffer from camera ["
+                               << buffers[indices[i]].deviceId << "]";
+                    mSession->mFreeInputSets.push_back(inputSetIndex);
+                    mSession->mFramesSignal.notify_all();
+                    mCamera->doneWithFrame_1_1(buffers);
                     return {};
                 }
 
-                mSession->mInputPointers[i].gpu_data_pointer = static_cast<void*>(hardwareBuffer);
-
-                // Keep a reference to the EVS graphic buffers, so we can
-                // release them after Surround View stitching is done.
-                mSession->mEvsGraphicBuffers = buffers;
-            }
-        } else {
-            for (int i = 0; i < kNumFrames; i++) {
-                LOG(DEBUG) << "Copying buffer from camera [" << buffers[indices[i]].deviceId
-                           << "] to Surround View Service";
-                mSession->copyFromBufferToPointers(buffers[indices[i]],
-                                                   mSession->mInputPointers[i]);
+                inputSet.pointers[i].gpu_data_pointer =
+                        static_cast<void*>(inputBuffer->toAHardwareBuffer());
             }
 
-            // On the CPU version, we do not need to hold the Graphic Buffers
-            // any more since they are copied already.
-            mCamera->doneWithFrame_1_1(buffers);
+            // Keep a reference to the EVS graphic buffers, so we can release
+            // them after Surround View stitching is done.
+            inputSet.evsBuffers = buffers;
+        }
+    }
+
+    if (!mSession->mGpuAccelerationEnabled) {
+        // The copy runs without the lock, so it overlaps the stitching of the
+        // frames before.
+        for (int i = 0; i < kNumFrames; i++) {
+            LOG(DEBUG) << "Copying buffer from camera [" << buffers[indices[i]].deviceId
+                       << "] to Surround View Service";
+            mSession->copyFromBufferToPointers(buffers[indices[i]], inputSet.pointers[i]);
         }
+
+        // On the CPU version, we do not need to hold the Graphic Buffers
+        // any more since they are copied already.
+        mCamera->doneWithFrame_1_1(buffers);
+    }
+    mSession->mStats.recordLatency(SurroundViewStats::INPUT_COPY,
+                                   (elapsedRealtimeNano() - copyStartNs) / 1000);
+
+    {
+        scoped_lock<mutex> lock(mSession->mAccessLock);
+        mSession->mReadyInputSets.push_back(inputSetIndex);
     }
 
     // Notify the session that a new set of frames is ready
@@ -211,34 +325,56 @@ Return<void> SurroundView2dSession::FramesHandler::notify(const EvsEventDesc& ev
     return {};
 }
 
-bool SurroundView2dSession::copyFromBufferToPointers(
-    BufferDesc_1_1 buffer, SurroundViewInputBufferPointers pointers) {
-    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+sp<GraphicBuffer> SurroundView2dSession::getInputBuffer(const BufferDesc_1_1& buffer) {
+    const auto key = make_pair(string(buffer.deviceId), buffer.bufferId);
+    const auto it = mInputBuffers.find(key);
+    if (it != mInputBuffers.end()) {
+        return it->second;
+    }
 
-    AHardwareBuffer_Desc* pDesc =
-        reinterpret_cast<AHardwareBuffer_Desc *>(&buffer.buffer.description);
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&buffer.buffer.description);
 
-    ATRACE_BEGIN("Create Graphic Buffer");
     // create a GraphicBuffer from the existing handle
     sp<GraphicBuffer> inputBuffer = new GraphicBuffer(
         buffer.buffer.nativeHandle, GraphicBuffer::CLONE_HANDLE, pDesc->width,
         pDesc->height, pDesc->format, pDesc->layers,
         GRALLOC_USAGE_HW_TEXTURE, pDesc->stride);
 
-    if (inputBuffer == nullptr) {
+    if (inputBuffer == nullptr || inputBuffer->initCheck() != OK) {
         LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
-        // Returning "true" in this error condition because we already released the
-        // previous image (if any) and so the texture may change in unpredictable
-        // ways now!
-        return false;
-    } else {
-        LOG(INFO) << "Managed to allocate GraphicBuffer with "
-                  << " width: " << pDesc->width
-                  << " height: " << pDesc->height
-                  << " format: " << pDesc->format
-                  << " stride: " << pDesc->stride;
+        return nullptr;
+    }
+
+    LOG(INFO) << "Imported buffer " << buffer.bufferId
+              << " of camera [" << buffer.deviceId << "] with"
+              << " width: " << pDesc->width
+              << " height: " << pDesc->height
+              << " format: " << pDesc->format
+              << " stride: " << pDesc->stride;
+    mInputBuffers.emplace(key, inputBuffer);
+    return inputBuffer;
+}
+
+bool SurroundView2dSession::copyFromBufferToPointers(
+    BufferDesc_1_1 buffer, SurroundViewInputBufferPointers pointers) {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc *>(&buffer.buffer.description);
+
+    ATRACE_BEGIN("Get Graphic Buffer");
+    sp<GraphicBuffer> inputBuffer;
+    {
+        // The copy itself runs without the lock.
+        scoped_lock<mutex> lock(mAccessLock);
+        inputBuffer = getInputBuffer(buffer);
     }
     ATRACE_END();
+    if (inputBuffer == nullptr) {
+        ATRACE_END();
+        return false;
+    }
 
     ATRACE_BEGIN("Lock input buffer (gpu to cpu)");
     // Lock the input GraphicBuffer and map it to a pointer.  If we failed to
@@ -276,26 +412,50 @@ bool SurroundView2dSession::copyFromBufferToPointers(
 void SurroundView2dSession::processFrames() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
+    // The delivery thread started below inherits the policy
+    android::automotive::evs::threadpolicy::applyThreadPolicy(
+            android::automotive::evs::threadpolicy::kRoleSurroundView);
+
+    mDeliveryThread = thread([this]() {
+        deliverFrames();
+    });
+
     while (true) {
+        int inputSetIndex;
         {
             unique_lock<mutex> lock(mAccessLock);
 
-            if (mStreamState != RUNNING) {
+            // Once the stream stops, the sets of frames being copied still
+            // get stitched.
+            mFramesSignal.wait(lock, [this]() {
+                return !mReadyInputSets.empty() ||
+                        (mStreamState != RUNNING && mFreeInputSets.size() == mInputSets.size());
+            });
+            if (mReadyInputSets.empty()) {
                 break;
             }
 
-            mFramesSignal.wait(lock, [this]() { return mProcessingEvsFrames; });
+            inputSetIndex = mReadyInputSets.front();
+            mReadyInputSets.pop_front();
         }
 
-        handleFrames(mSequenceId);
+        handleFrames(inputSetIndex);
 
         {
-            // Set the boolean to false to receive the next set of frames.
+            // Give the set back to receive the next set of frames.
             scoped_lock<mutex> lock(mAccessLock);
-            mProcessingEvsFrames = false;
+            mFreeInputSets.push_back(inputSetIndex);
         }
+        mFramesSignal.notify_all();
     }
 
+    {
+        scoped_lock<mutex> lock(mAccessLock);
+        mDeliveryStopping = true;
+    }
+    mDeliverySignal.notify_all();
+    mDeliveryThread.join();
+
     // Notify the SV client that no new results will be delivered.
     LOG(DEBUG) << "Notify SvEvent::STREAM_STOPPED";
     mStream->notify(SvEvent::STREAM_STOPPED);
@@ -310,11 +470,52 @@ void SurroundView2dSession::processFrames() {
     ATRACE_END();
 }
 
+void SurroundView2dSession::deliverFrames() {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    while (true) {
+        int recordIndex;
+        {
+            unique_lock<mutex> lock(mAccessLock);
+            mDeliverySignal.wait(lock, [this]() {
+                return !mDeliveryQueue.empty() || mDeliveryStopping;
+            });
+            if (mDeliveryQueue.empty()) {
+                break;
+            }
+
+            recordIndex = mDeliveryQueue.front();
+            mDeliveryQueue.pop_front();
+        }
+
+        // The record is in use until the client returns it, so nothing else
+        // touches it meanwhile.
+        const FramesRecord& record = mFramesRecords[recordIndex];
+        ATRACE_BEGIN("Deliver the frames");
+        const int64_t deliveryStartNs = elapsedRealtimeNano();
+        mStream->receiveFrames(record.frames);
+        const int64_t deliveryEndNs = elapsedRealtimeNano();
+        ATRACE_END();
+
+        mStats.recordLatency(SurroundViewStats::DELIVERY,
+                             (deliveryEndNs - deliveryStartNs) / 1000);
+        mStats.recordLatency(SurroundViewStats::END_TO_END,
+                             deliveryEndNs / 1000 - record.cameraTimestampUs);
+        mStats.frameDelivered();
+    }
+
+    ATRACE_END();
+}
+
 SurroundView2dSession::SurroundView2dSession(sp<IEvsEnumerator> pEvs,
-                                             IOModuleConfig* pConfig)
+                                             IOModuleConfig* pConfig,
+                                             VhalHandler* vhalHandler)
     : mEvs(pEvs),
       mIOModuleConfig(pConfig),
-      mStreamState(STOPPED) {}
+      mStreamState(STOPPED),
+      mProjectionCache(kMaxProjectedPointsPerCamera),
+      mVhalHandler(vhalHandler),
+      mFrameRateScheduler(pConfig->cameraConfig.frameRatePolicy) {}
 
 SurroundView2dSession::~SurroundView2dSession() {
     // In case the client did not call stopStream properly, we should stop the
@@ -329,7 +530,19 @@ SurroundView2dSession::~SurroundView2dSession() {
 
     mEvs->closeCamera(mCamera);
 
-    // TODO(b/175176576): properly release the mInputPointers and mOutputPointer
+    if (mIsInitialized && mSurroundView != nullptr) {
+        // Keyed by the resolution the instance renders at now, which
+        // set2dConfig may have changed.
+        SurroundView2dParams sv2dParams = mIOModuleConfig->sv2dConfig.sv2dParams;
+        sv2dParams.resolution = Size2dInteger(mOutputWidth, mOutputHeight);
+
+        scoped_lock<mutex> lock(sCachedSurroundViewLock);
+        sCachedSurroundView.cameraParams = mCameraParams;
+        sCachedSurroundView.sv2dParams = sv2dParams;
+        sCachedSurroundView.surroundView = std::move(mSurroundView);
+    }
+
+    // TODO(b/175176576): properly release the mInputSets and mOutputPointer
 }
 
 // Methods from ::android::hardware::automotive::sv::V1_0::ISurroundViewSession
@@ -357,14 +570,30 @@ Return<SvResult> SurroundView2dSession::startStream(
     mStream = stream;
 
     mSequenceId = 0;
+    // The buffers of the next Evs stream may not be those of the last one.
+    mInputBuffers.clear();
+    mStats.reset();
+    mFrameRateScheduler.reset();
     startEvs();
 
+    // The driving state is only read for the frame rate policy.
+    if (mVhalHandler != nullptr && mFrameRateScheduler.isEnabled() &&
+        !mVhalHandler->startPropertiesUpdate()) {
+        LOG(WARNING) << "VhalHandler cannot be started properly";
+    }
+
     // TODO(b/158131080): the STREAM_STARTED event is not implemented in EVS
     // reference implementation yet. Once implemented, this logic should be
     // moved to EVS notify callback.
     LOG(DEBUG) << "Notify SvEvent::STREAM_STARTED";
     mStream->notify(SvEvent::STREAM_STARTED);
-    mProcessingEvsFrames = false;
+    mFreeInputSets.clear();
+    mReadyInputSets.clear();
+    for (int i = 0; i < static_cast<int>(mInputSets.size()); i++) {
+        mFreeInputSets.push_back(i);
+    }
+    mDeliveryQueue.clear();
+    mDeliveryStopping = false;
 
     // Start the frame generation thread
     mStreamState = RUNNING;
@@ -381,12 +610,17 @@ Return<void> SurroundView2dSession::stopStream() {
     unique_lock<mutex> lock(mAccessLock);
 
     if (mStreamState == RUNNING) {
+        if (mVhalHandler != nullptr && mFrameRateScheduler.isEnabled()) {
+            mVhalHandler->stopPropertiesUpdate();
+        }
+
         // Tell the processFrames loop to stop processing frames
         mStreamState = STOPPING;
 
         // Stop the EVS stream asynchronizely
         mCamera->stopVideoStream();
         mFramesHandler = nullptr;
+        mFramesSignal.notify_all();
     }
 
     return {};
@@ -397,12 +631,60 @@ Return<void> SurroundView2dSession::doneWithFrames(
     LOG(DEBUG) << __FUNCTION__;
     scoped_lock <mutex> lock(mAccessLock);
 
-    mFramesRecord.inUse = false;
+    for (auto& record : mFramesRecords) {
+        if (record.inUse && record.frames.sequenceId == svFramesDesc.sequenceId) {
+            record.inUse = false;
+            return {};
+        }
+    }
 
-    (void)svFramesDesc;
+    LOG(WARNING) << "Frames " << svFramesDesc.sequenceId
+                 << " were not delivered or were returned already";
     return {};
 }
 
+int SurroundView2dSession::findFreeFramesRecord() {
+    for (int i = 0; i < static_cast<int>(mFramesRecords.size()); i++) {
+        if (!mFramesRecords[i].inUse) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool SurroundView2dSession::prepareTexture(int recordIndex) {
+    sp<GraphicBuffer>& texture = mFramesRecords[recordIndex].texture;
+    if (texture != nullptr) {
+        const int width = static_cast<int>(texture->getWidth());
+        const int height = static_cast<int>(texture->getHeight());
+        // The CPU solution writes the output at the top left of a larger
+        // texture, and describes the output size to the client, so resizing
+        // the output down allocates nothing.
+        if (mGpuAccelerationEnabled ? width == mOutputWidth && height == mOutputHeight
+                                    : width >= mOutputWidth && height >= mOutputHeight) {
+            return true;
+        }
+    }
+
+    // The GPU solution renders to the texture directly, the CPU solution
+    // copies its RGB output into it.
+    if (mGpuAccelerationEnabled) {
+        texture = new GraphicBuffer(mOutputWidth, mOutputHeight, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                                    GRALLOC_USAGE_HW_TEXTURE, "SvOutputHolder");
+    } else {
+        texture = new GraphicBuffer(mOutputWidth, mOutputHeight, HAL_PIXEL_FORMAT_RGB_888, 1,
+                                    GRALLOC_USAGE_HW_TEXTURE, "SvTexture");
+    }
+    if (texture->initCheck() != OK) {
+        LOG(ERROR) << "Failed to allocate Graphic Buffer for output " << recordIndex;
+        texture = nullptr;
+        return false;
+    }
+
+    LOG(INFO) << "Successfully allocated Graphic Buffer for output " << recordIndex;
+    return true;
+}
+
 // Methods from ISurroundView2dSession follow.
 Return<void> SurroundView2dSession::get2dMappingInfo(
     get2dMappingInfo_cb _hidl_cb) {
@@ -426,6 +708,7 @@ Return<SvResult> SurroundView2dSession::set2dConfig(
     mConfig.width = sv2dConfig.width;
     mConfig.blending = sv2dConfig.blending;
     mHeight = mConfig.width * mInfo.height / mInfo.width;
+    mSceneChanged = true;
 
     if (mStream != nullptr) {
         LOG(DEBUG) << "Notify SvEvent::CONFIG_UPDATED";
@@ -467,29 +750,43 @@ Return<void> SurroundView2dSession::projectCameraPoints(const hidl_vec<Point2dIn
 
     int width = mConfig.width;
     int height = mHeight;
-    for (const auto& cameraPoint : points2dCamera) {
-        Point2dFloat outPoint = {false, 0.0, 0.0};
-        // Check of the camear point is within the camera resolution bounds.
-        if (cameraPoint.x < 0 || cameraPoint.x > width - 1 || cameraPoint.y < 0 ||
-            cameraPoint.y > height - 1) {
-            LOG(WARNING) << "Camera point (" << cameraPoint.x << ", " << cameraPoint.y
-                         << ") is out of camera resolution bounds.";
-            outPoint.isValid = false;
+    int numOutOfBounds = 0;
+    outPoints.reserve(points2dCamera.size());
+    {
+        scoped_lock<mutex> projectionLock(mProjectionLock);
+        for (const auto& cameraPoint : points2dCamera) {
+            Point2dFloat outPoint = {false, 0.0, 0.0};
+            // Check of the camear point is within the camera resolution bounds.
+            if (cameraPoint.x < 0 || cameraPoint.x > width - 1 || cameraPoint.y < 0 ||
+                cameraPoint.y > height - 1) {
+                numOutOfBounds++;
+                outPoints.push_back(outPoint);
+                continue;
+            }
+
+            if (mProjectionCache.find(cameraIndex, cameraPoint.x, cameraPoint.y, &outPoint)) {
+                outPoints.push_back(outPoint);
+                continue;
+            }
+
+            // Project points using mSurroundView function.
+            const Coordinate2dInteger camPoint(cameraPoint.x, cameraPoint.y);
+            Coordinate2dFloat projPoint2d(0.0, 0.0);
+
+            outPoint.isValid =
+                    mSurroundView->GetProjectionPointFromRawCameraToSurroundView2d(camPoint,
+                                                                                   cameraIndex,
+                                                                                   &projPoint2d);
+            outPoint.x = projPoint2d.x;
+            outPoint.y = projPoint2d.y;
+            mProjectionCache.insert(cameraIndex, cameraPoint.x, cameraPoint.y, outPoint);
             outPoints.push_back(outPoint);
-            continue;
         }
+    }
 
-        // Project points using mSurroundView function.
-        const Coordinate2dInteger camPoint(cameraPoint.x, cameraPoint.y);
-        Coordinate2dFloat projPoint2d(0.0, 0.0);
-
-        outPoint.isValid =
-                mSurroundView->GetProjectionPointFromRawCameraToSurroundView2d(camPoint,
-                                                                               cameraIndex,
-                                                                               &projPoint2d);
-        outPoint.x = projPoint2d.x;
-        outPoint.y = projPoint2d.y;
-        outPoints.push_back(outPoint);
+    if (numOutOfBounds > 0) {
+        LOG(WARNING) << numOutOfBounds << " of " << points2dCamera.size()
+                     << " camera points are out of camera resolution bounds.";
     }
 
     _hidl_cb(outPoints);
@@ -497,23 +794,26 @@ Return<void> SurroundView2dSession::projectCameraPoints(const hidl_vec<Point2dIn
 }
 
 // TODO(b/175176765): implement a GPU version of this method separately.
-bool SurroundView2dSession::handleFrames(int sequenceId) {
+bool SurroundView2dSession::handleFrames(int inputSetIndex) {
+    const InputSet& inputSet = mInputSets[inputSetIndex];
+    const int sequenceId = inputSet.sequenceId;
     LOG(INFO) << __FUNCTION__ << "Handling sequenceId " << sequenceId << ".";
 
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
-    // TODO(b/157498592): Now only one sets of EVS input frames and one SV
-    // output frame is supported. Implement buffer queue for both of them.
+    int recordIndex;
     {
         scoped_lock<mutex> lock(mAccessLock);
 
-        if (mFramesRecord.inUse) {
+        recordIndex = findFreeFramesRecord();
+        if (recordIndex < 0) {
             LOG(DEBUG) << "Notify SvEvent::FRAME_DROPPED";
             mStream->notify(SvEvent::FRAME_DROPPED);
+            mStats.frameDropped();
 
             // For GPU solution only (the frames were released already for CPU solution).
             if (mGpuAccelerationEnabled) {
-                mCamera->doneWithFrame_1_1(mEvsGraphicBuffers);
+                mCamera->doneWithFrame_1_1(inputSet.evsBuffers);
             }
             return true;
         }
@@ -523,17 +823,24 @@ bool SurroundView2dSession::handleFrames(int sequenceId) {
     // yet.
     if (!mGpuAccelerationEnabled) {
         if (mOutputWidth != mConfig.width || mOutputHeight != mHeight) {
-            LOG(DEBUG) << "Config changed. Re-allocate memory."
+            LOG(DEBUG) << "Config changed."
                        << " Old width: " << mOutputWidth << " Old height: " << mOutputHeight
                        << " New width: " << mConfig.width << " New height: " << mHeight;
-            delete[] static_cast<char*>(mOutputPointer.cpu_data_pointer);
             mOutputWidth = mConfig.width;
             mOutputHeight = mHeight;
             mOutputPointer.height = mOutputHeight;
             mOutputPointer.width = mOutputWidth;
             mOutputPointer.format = Format::RGB;
-            mOutputPointer.cpu_data_pointer =
-                    static_cast<void*>(new char[mOutputHeight * mOutputWidth * kOutputNumChannels]);
+
+            // The buffer is only reallocated to grow, a smaller output uses
+            // the start of it.
+            const size_t outputSize = mOutputHeight * mOutputWidth * kOutputNumChannels;
+            if (outputSize > mOutputCapacity) {
+                LOG(DEBUG) << "Re-allocate memory.";
+                delete[] static_cast<char*>(mOutputPointer.cpu_data_pointer);
+                mOutputPointer.cpu_data_pointer = static_cast<void*>(new char[outputSize]);
+                mOutputCapacity = outputSize;
+            }
 
             if (!mOutputPointer.cpu_data_pointer) {
                 LOG(ERROR) << "Memory allocation failed. Exiting.";
@@ -541,86 +848,112 @@ bool SurroundView2dSession::handleFrames(int sequenceId) {
             }
 
             Size2dInteger size = Size2dInteger(mOutputWidth, mOutputHeight);
+            // Camera points project to other output points at the new
+            // resolution.
+            scoped_lock<mutex> projectionLock(mProjectionLock);
             mSurroundView->Update2dOutputResolution(size);
-
-            mSvTexture = new GraphicBuffer(mOutputWidth, mOutputHeight, HAL_PIXEL_FORMAT_RGB_888, 1,
-                                           GRALLOC_USAGE_HW_TEXTURE, "SvTexture");
-            if (mSvTexture->initCheck() == OK) {
-                LOG(INFO) << "Successfully allocated Graphic Buffer";
-            } else {
-                LOG(ERROR) << "Failed to allocate Graphic Buffer";
-                return false;
-            }
+            mProjectionCache.reset(kNumFrames);
         }
         LOG(INFO) << "Output Pointer data format: " << mOutputPointer.format;
     }
 
+    // Textures the client still holds keep their size until they come back.
+    if (!prepareTexture(recordIndex)) {
+        if (mGpuAccelerationEnabled) {
+            mCamera->doneWithFrame_1_1(inputSet.evsBuffers);
+        }
+        return false;
+    }
+    sp<GraphicBuffer> texture = mFramesRecords[recordIndex].texture;
+    if (mGpuAccelerationEnabled) {
+        mOutputPointer.gpu_data_pointer = static_cast<void*>(texture->toAHardwareBuffer());
+    }
+
+    // The CPU solution renders into the locked texture when its rows are
+    // packed, as the core lib writes them back to back. Otherwise it renders
+    // into mOutputPointer and the rows are copied over.
+    void* textureDataPtr = nullptr;
+    bool renderInPlace = false;
+    int64_t outputCopyNs = 0;
+    if (!mGpuAccelerationEnabled) {
+        const int64_t lockStartNs = elapsedRealtimeNano();
+        ATRACE_BEGIN("Lock output texture (gpu to cpu)");
+        texture->lock(GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                      &textureDataPtr);
+        ATRACE_END();
+        outputCopyNs = elapsedRealtimeNano() - lockStartNs;
+
+        if (!textureDataPtr) {
+            LOG(ERROR) << "Failed to gain write access to GraphicBuffer!";
+            return false;
+        }
+        renderInPlace = static_cast<int>(texture->getStride()) == mOutputWidth;
+    }
+    SurroundViewResultPointer textureOutputPointer(nullptr, textureDataPtr, Format::RGB,
+                                                   mOutputWidth, mOutputHeight);
+    SurroundViewResultPointer* outputPointer =
+            renderInPlace ? &textureOutputPointer : &mOutputPointer;
+
     ATRACE_BEGIN("SV core lib method: Get2dSurroundView");
+    const int64_t stitchStartNs = elapsedRealtimeNano();
     const string gpuEnabledText = mGpuAccelerationEnabled ? " with GPU acceleration flag enabled"
                                                           : " with GPU acceleration flag disabled";
-    if (mSurroundView->Get2dSurroundView(mInputPointers, &mOutputPointer)) {
+    if (mSurroundView->Get2dSurroundView(inputSet.pointers, outputPointer)) {
         LOG(INFO) << "Get2dSurroundView succeeded" << gpuEnabledText;
     } else {
         LOG(ERROR) << "Get2dSurroundView failed" << gpuEnabledText;
     }
+    mStats.recordLatency(SurroundViewStats::STITCH,
+                         (elapsedRealtimeNano() - stitchStartNs) / 1000);
     ATRACE_END();
 
     // For GPU solution only (the frames were released already for CPU solution).
     if (mGpuAccelerationEnabled) {
         ATRACE_BEGIN("Release the evs frames");
-        mCamera->doneWithFrame_1_1(mEvsGraphicBuffers);
+        mCamera->doneWithFrame_1_1(inputSet.evsBuffers);
         ATRACE_END();
     }
 
     ANativeWindowBuffer* buffer;
     if (mGpuAccelerationEnabled) {
-        buffer = mOutputHolder->getNativeBuffer();
+        buffer = texture->getNativeBuffer();
     } else {
-        ATRACE_BEGIN("Lock output texture (gpu to cpu)");
-        void* textureDataPtr = nullptr;
-        mSvTexture->lock(GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
-                         &textureDataPtr);
-        ATRACE_END();
-
-        if (!textureDataPtr) {
-            LOG(ERROR) << "Failed to gain write access to GraphicBuffer!";
-            return false;
-        }
-
-        ATRACE_BEGIN("Copy output result");
-        // Note: there is a chance that the stride of the texture is not the same
-        // as the width. For example, when the input frame is 1920 * 1080, the
-        // width is 1080, but the stride is 2048. So we'd better copy the data line
-        // by line, instead of single memcpy.
-        uint8_t* writePtr = static_cast<uint8_t*>(textureDataPtr);
-        uint8_t* readPtr = static_cast<uint8_t*>(mOutputPointer.cpu_data_pointer);
-        const int readStride = mOutputWidth * kOutputNumChannels;
-        const int writeStride = mSvTexture->getStride() * kOutputNumChannels;
-        if (readStride == writeStride) {
-            memcpy(writePtr, readPtr, readStride * mSvTexture->getHeight());
-        } else {
-            for (int i = 0; i < mSvTexture->getHeight(); i++) {
+        const int64_t copyStartNs = elapsedRealtimeNano();
+        if (!renderInPlace) {
+            ATRACE_BEGIN("Copy output result");
+            // Note: there is a chance that the stride of the texture is not the
+            // same as the width. For example, when the input frame is
+            // 1920 * 1080, the width is 1080, but the stride is 2048. So we
+            // copy the data line by line.
+            uint8_t* writePtr = static_cast<uint8_t*>(textureDataPtr);
+            uint8_t* readPtr = static_cast<uint8_t*>(mOutputPointer.cpu_data_pointer);
+            const int readStride = mOutputWidth * kOutputNumChannels;
+            const int writeStride = texture->getStride() * kOutputNumChannels;
+            for (int i = 0; i < mOutputHeight; i++) {
                 memcpy(writePtr, readPtr, readStride);
                 writePtr = writePtr + writeStride;
                 readPtr = readPtr + readStride;
             }
+            LOG(DEBUG) << "memcpy finished";
+            ATRACE_END();
         }
-        LOG(DEBUG) << "memcpy finished";
-        ATRACE_END();
 
         ATRACE_BEGIN("Unlock output texture (cpu to gpu)");
-        mSvTexture->unlock();
+        texture->unlock();
         ATRACE_END();
+        outputCopyNs += elapsedRealtimeNano() - copyStartNs;
+        mStats.recordLatency(SurroundViewStats::OUTPUT_COPY, outputCopyNs / 1000);
 
-        buffer = mSvTexture->getNativeBuffer();
+        buffer = texture->getNativeBuffer();
         LOG(DEBUG) << "ANativeWindowBuffer->handle: " << buffer->handle;
     }
 
     {
         scoped_lock<mutex> lock(mAccessLock);
 
-        mFramesRecord.frames.svBuffers.resize(1);
-        SvBuffer& svBuffer = mFramesRecord.frames.svBuffers[0];
+        FramesRecord& record = mFramesRecords[recordIndex];
+        record.frames.svBuffers.resize(1);
+        SvBuffer& svBuffer = record.frames.svBuffers[0];
         svBuffer.viewId = kSv2dViewId;
         svBuffer.hardwareBuffer.nativeHandle = buffer->handle;
         AHardwareBuffer_Desc* pDesc =
@@ -629,22 +962,24 @@ bool SurroundView2dSession::handleFrames(int sequenceId) {
         if (mGpuAccelerationEnabled) {
             pDesc->width = mOutputPointer.width;
             pDesc->height = mOutputPointer.height;
-            pDesc->stride = mOutputHolder->getStride();
+            pDesc->stride = texture->getStride();
             pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
         } else {
             pDesc->width = mOutputWidth;
             pDesc->height = mOutputHeight;
-            pDesc->stride = mSvTexture->getStride();
+            pDesc->stride = texture->getStride();
             pDesc->format = HAL_PIXEL_FORMAT_RGB_888;
         }
         pDesc->layers = 1;
         pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
-        mFramesRecord.frames.timestampNs = elapsedRealtimeNano();
-        mFramesRecord.frames.sequenceId = sequenceId;
+        record.frames.timestampNs = elapsedRealtimeNano();
+        record.frames.sequenceId = sequenceId;
+        record.cameraTimestampUs = inputSet.timestampUs;
 
-        mFramesRecord.inUse = true;
-        mStream->receiveFrames(mFramesRecord.frames);
+        record.inUse = true;
+        mDeliveryQueue.push_back(recordIndex);
     }
+    mDeliverySignal.notify_one();
 
     ATRACE_END();
 
@@ -663,55 +998,69 @@ bool SurroundView2dSession::initialize() {
         return false;
     }
 
-    // TODO(b/150412555): ask core-lib team to add API description for "create"
-    // method in the .h file.
-    // The create method will never return a null pointer based the API
-    // description.
-    mSurroundView = unique_ptr<SurroundView>(Create());
-
-    SurroundViewStaticDataParams params =
-            SurroundViewStaticDataParams(mCameraParams,
-                                         mIOModuleConfig->sv2dConfig.sv2dParams,
-                                         mIOModuleConfig->sv3dConfig.sv3dParams,
-                                         vector<float>(std::begin(kUndistortionScales),
-                                                       std::end(kUndistortionScales)),
-                                         mIOModuleConfig->sv2dConfig.carBoundingBox,
-                                         mIOModuleConfig->carModelConfig.carModel.texturesMap,
-                                         mIOModuleConfig->carModelConfig.carModel.partsMap);
     mGpuAccelerationEnabled = mIOModuleConfig->sv2dConfig.sv2dParams.gpu_acceleration_enabled;
+    mSurroundView = takeCachedSurroundView(mCameraParams, mIOModuleConfig->sv2dConfig.sv2dParams);
+    if (mSurroundView != nullptr) {
+        LOG(INFO) << "Calibration and resolution unchanged, reusing the 2d pipeline";
+    } else {
+        // TODO(b/150412555): ask core-lib team to add API description for
+        // "create" method in the .h file.
+        // The create method will never return a null pointer based the API
+        // description.
+        mSurroundView = unique_ptr<SurroundView>(Create());
+
+        SurroundViewStaticDataParams params =
+                SurroundViewStaticDataParams(mCameraParams,
+                                             mIOModuleConfig->sv2dConfig.sv2dParams,
+                                             mIOModuleConfig->sv3dConfig.sv3dParams,
+                                             vector<float>(std::begin(kUndistortionScales),
+                                                           std::end(kUndistortionScales)),
+                                             mIOModuleConfig->sv2dConfig.carBoundingBox,
+                                             mIOModuleConfig->carModelConfig.carModel.texturesMap,
+                                             mIOModuleConfig->carModelConfig.carModel.partsMap);
+
+        ATRACE_BEGIN("SV core lib method: SetStaticData");
+        mSurroundView->SetStaticData(params);
+        ATRACE_END();
 
-    ATRACE_BEGIN("SV core lib method: SetStaticData");
-    mSurroundView->SetStaticData(params);
-    ATRACE_END();
+        ATRACE_BEGIN("SV core lib method: Start2dPipeline");
+        const string gpuEnabledText = mGpuAccelerationEnabled
+                ? "with GPU acceleration flag enabled"
+                : "with GPU acceleration flag disabled";
+        if (mSurroundView->Start2dPipeline()) {
+            LOG(INFO) << "Start2dPipeline succeeded " << gpuEnabledText;
+        } else {
+            LOG(ERROR) << "Start2dPipeline failed " << gpuEnabledText;
+            return false;
+        }
+        ATRACE_END();
+    }
 
-    ATRACE_BEGIN("SV core lib method: Start2dPipeline");
-    const string gpuEnabledText = mGpuAccelerationEnabled ? "with GPU acceleration flag enabled"
-                                                          : "with GPU acceleration flag disabled";
-    if (mSurroundView->Start2dPipeline()) {
-        LOG(INFO) << "Start2dPipeline succeeded " << gpuEnabledText;
-    } else {
-        LOG(ERROR) << "Start2dPipeline failed " << gpuEnabledText;
-        return false;
+    {
+        scoped_lock<mutex> projectionLock(mProjectionLock);
+        mProjectionCache.reset(kNumFrames);
     }
-    ATRACE_END();
 
     ATRACE_BEGIN("Allocate cpu buffers");
-    mInputPointers.resize(kNumFrames);
-    for (int i = 0; i < kNumFrames; i++) {
-        mInputPointers[i].width = mCameraParams[i].size.width;
-        mInputPointers[i].height = mCameraParams[i].size.height;
-
-        // Only allocate CPU memory for CPU solution
-        // For GPU solutions, the Graphic Buffers from EVS will be converted and
-        // stored in gpu_data_pointer
-        if (!mGpuAccelerationEnabled) {
-            mInputPointers[i].format = Format::RGBA;
-            mInputPointers[i].cpu_data_pointer =
-                    static_cast<void*>(new char[mInputPointers[i].width * mInputPointers[i].height *
-                                                kInputNumChannels]);
+    mInputSets.resize(kNumInputSets);
+    for (auto& inputSet : mInputSets) {
+        vector<SurroundViewInputBufferPointers>& pointers = inputSet.pointers;
+        pointers.resize(kNumFrames);
+        for (int i = 0; i < kNumFrames; i++) {
+            pointers[i].width = mCameraParams[i].size.width;
+            pointers[i].height = mCameraParams[i].size.height;
+
+            // Only allocate CPU memory for CPU solution
+            // For GPU solutions, the Graphic Buffers from EVS will be converted and
+            // stored in gpu_data_pointer
+            if (!mGpuAccelerationEnabled) {
+                pointers[i].format = Format::RGBA;
+                pointers[i].cpu_data_pointer = static_cast<void*>(
+                        new char[pointers[i].width * pointers[i].height * kInputNumChannels]);
+            }
         }
     }
-    LOG(INFO) << "Allocated " << kNumFrames << " input pointers";
+    LOG(INFO) << "Allocated " << kNumInputSets << " sets of " << kNumFrames << " input pointers";
 
     mOutputWidth = mIOModuleConfig->sv2dConfig.sv2dParams.resolution.width;
     mOutputHeight = mIOModuleConfig->sv2dConfig.sv2dParams.resolution.height;
@@ -726,8 +1075,8 @@ bool SurroundView2dSession::initialize() {
     // Only allocate CPU memory for CPU solution
     if (!mGpuAccelerationEnabled) {
         mOutputPointer.format = Format::RGB;
-        mOutputPointer.cpu_data_pointer =
-                static_cast<void*>(new char[mOutputHeight * mOutputWidth * kOutputNumChannels]);
+        mOutputCapacity = mOutputHeight * mOutputWidth * kOutputNumChannels;
+        mOutputPointer.cpu_data_pointer = static_cast<void*>(new char[mOutputCapacity]);
 
         if (!mOutputPointer.cpu_data_pointer) {
             LOG(ERROR) << "Memory allocation failed. Exiting.";
@@ -736,27 +1085,14 @@ bool SurroundView2dSession::initialize() {
     }
     ATRACE_END();
 
-    ATRACE_BEGIN("Allocate output texture");
-    if (mGpuAccelerationEnabled) {
-        mOutputHolder = new GraphicBuffer(mOutputWidth, mOutputHeight, HAL_PIXEL_FORMAT_RGBA_8888,
-                                          1, GRALLOC_USAGE_HW_TEXTURE, "SvOutputHolder");
-        if (mOutputHolder->initCheck() == OK) {
-            LOG(INFO) << "Successfully allocated Graphic Buffer for SvOutputHolder";
-        } else {
-            LOG(ERROR) << "Failed to allocate Graphic Buffer for SvOutputHolder";
-            return false;
-        }
-        mOutputPointer.gpu_data_pointer = static_cast<void*>(mOutputHolder->toAHardwareBuffer());
-    } else {
-        mSvTexture = new GraphicBuffer(mOutputWidth, mOutputHeight, HAL_PIXEL_FORMAT_RGB_888, 1,
-                                       GRALLOC_USAGE_HW_TEXTURE, "SvTexture");
-        if (mSvTexture->initCheck() == OK) {
-            LOG(INFO) << "Successfully allocated Graphic Buffer";
-        } else {
-            LOG(ERROR) << "Failed to allocate Graphic Buffer";
+    ATRACE_BEGIN("Allocate output textures");
+    mFramesRecords.resize(std::max(1, mIOModuleConfig->sv2dConfig.numOutputBuffers));
+    for (int i = 0; i < static_cast<int>(mFramesRecords.size()); i++) {
+        if (!prepareTexture(i)) {
             return false;
         }
     }
+    LOG(INFO) << "Allocated " << mFramesRecords.size() << " output textures";
 
     // Note: sv2dParams is in meters while mInfo must be in milli-meters.
     mInfo.width = mIOModuleConfig->sv2dConfig.sv2dParams.physical_size.width * 1000.0;
@@ -16,7 +16,11 @@
 
 #pragma once
 
+#include "FrameRateScheduler.h"
 #include "IOModule.h"
+#include "ProjectionCache.h"
+#include "SurroundViewStats.h"
+#include "VhalHandler.h"
 
 #include <android/hardware/automotive/evs/1.1/IEvsCamera.h>
 #include <android/hardware/automotive/evs/1.1/IEvsCameraStream.h>
@@ -30,7 +34,11 @@
 
 #include <ui/GraphicBuffer.h>
 
+#include <deque>
+#include <map>
+#include <string>
 #include <thread>
+#include <utility>
 
 using namespace ::android::hardware::automotive::evs::V1_1;
 using namespace ::android::hardware::automotive::sv::V1_0;
@@ -72,6 +80,10 @@ class SurroundView2dSession : public ISurroundView2dSession {
         Return<void> deliverFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffer) override;
         Return<void> notify(const EvsEventDesc& event) override;
 
+        // Picks the frame rate of the session, and returns true if the set
+        // of frames is due at that rate.
+        bool isFrameSetDue(const hidl_vec<BufferDesc_1_1>& buffers);
+
         // Values initialized as startup
         sp <IEvsCamera> mCamera;
 
@@ -79,7 +91,10 @@ class SurroundView2dSession : public ISurroundView2dSession {
     };
 
 public:
-    SurroundView2dSession(sp<IEvsEnumerator> pEvs, IOModuleConfig* pConfig);
+    // The vhal handler, if any, gives the driving state for the frame rate
+    // policy of the config.
+    SurroundView2dSession(sp<IEvsEnumerator> pEvs, IOModuleConfig* pConfig,
+                          VhalHandler* vhalHandler = nullptr);
     ~SurroundView2dSession();
     bool initialize();
 
@@ -98,20 +113,45 @@ public:
         const hidl_string& cameraId,
         projectCameraPoints_cb _hidl_cb) override;
 
+    // Frame counters and stage latencies of the current, or last, stream.
+    const SurroundViewStats& getStats() const { return mStats; }
+
+    // The frame rate the frames are stitched at, in text.
+    std::string getFrameRateInfo(const char* indent = "") const {
+        return mFrameRateScheduler.toString(indent);
+    }
+
 private:
+    // Stitch stage: turns each set of input frames into an output record.
     void processFrames();
 
+    // Delivery stage: hands the stitched output records to the client, in
+    // order, while the next set of frames is stitched.
+    void deliverFrames();
+
     // Set up and open the Evs camera(s), triggered when session is created.
     bool setupEvs();
 
     // Start Evs camera video stream, triggered when SV stream is started.
     bool startEvs();
 
-    bool handleFrames(int sequenceId);
+    bool handleFrames(int inputSetIndex);
 
     bool copyFromBufferToPointers(BufferDesc_1_1 buffer,
                                   SurroundViewInputBufferPointers pointers);
 
+    // Returns the GraphicBuffer that wraps the Evs buffer, importing the
+    // buffer the first time it is seen.
+    sp<GraphicBuffer> getInputBuffer(const BufferDesc_1_1& buffer);
+
+    // Returns the index of an output record that the client is done with, or
+    // -1 if the client holds all of them.
+    int findFreeFramesRecord();
+
+    // Allocates the texture of the output record, unless it already has the
+    // output size.
+    bool prepareTexture(int recordIndex);
+
     enum StreamStateValues {
         STOPPED,
         RUNNING,
@@ -140,16 +180,42 @@ private:
 
     // Used to signal a set of frames is ready
     condition_variable mFramesSignal GUARDED_BY(mAccessLock);
-    bool mProcessingEvsFrames GUARDED_BY(mAccessLock);
+
+    // Sets of input frames. The Evs callback fills a free set while the
+    // process thread stitches the one before, so a set belongs to one stage
+    // at a time and only changes hands under mAccessLock.
+    struct InputSet {
+        std::vector<SurroundViewInputBufferPointers> pointers;
+        // Evs buffers the GPU solution samples, returned after stitching.
+        hidl_vec<BufferDesc_1_1> evsBuffers;
+        int sequenceId = 0;
+        // Camera timestamp of the oldest frame of the set, in microseconds.
+        int64_t timestampUs = 0;
+    };
+    std::vector<InputSet> mInputSets;
+    std::deque<int> mFreeInputSets GUARDED_BY(mAccessLock);
+    std::deque<int> mReadyInputSets GUARDED_BY(mAccessLock);
 
     int mSequenceId;
 
     struct FramesRecord {
         SvFramesDesc frames;
+        // Texture the frames are delivered in.
+        sp<GraphicBuffer> texture;
+        // Camera timestamp of the input frames, in microseconds.
+        int64_t cameraTimestampUs = 0;
         bool inUse = false;
     };
 
-    FramesRecord mFramesRecord GUARDED_BY(mAccessLock);
+    // Output frames, each with a texture of its own, so that the next frame is
+    // stitched while the client still renders the earlier ones.
+    std::vector<FramesRecord> mFramesRecords GUARDED_BY(mAccessLock);
+
+    // Output records stitched but not handed to the client yet.
+    std::deque<int> mDeliveryQueue GUARDED_BY(mAccessLock);
+    condition_variable mDeliverySignal GUARDED_BY(mAccessLock);
+    bool mDeliveryStopping GUARDED_BY(mAccessLock) = false;
+    std::thread mDeliveryThread;
 
     // Synchronization necessary to deconflict mCaptureThread from the main
     // service thread
@@ -159,24 +225,38 @@ private:
 
     std::unique_ptr<SurroundView> mSurroundView GUARDED_BY(mAccessLock);
 
-    std::vector<SurroundViewInputBufferPointers>
-        mInputPointers GUARDED_BY(mAccessLock);
     SurroundViewResultPointer mOutputPointer GUARDED_BY(mAccessLock);
 
+    // The Evs buffers imported so far, keyed by camera id and buffer id. Evs
+    // cycles through a few buffers per camera, so they are only imported once
+    // per stream instead of once per frame.
+    std::map<std::pair<std::string, uint32_t>, sp<GraphicBuffer>>
+        mInputBuffers GUARDED_BY(mAccessLock);
+
     Sv2dConfig mConfig GUARDED_BY(mAccessLock);
     int mHeight GUARDED_BY(mAccessLock);
 
     // TODO(b/158479099): Rename it to mMappingInfo
     Sv2dMappingInfo mInfo GUARDED_BY(mAccessLock);
     int mOutputWidth, mOutputHeight GUARDED_BY(mAccessLock);
-    sp<GraphicBuffer> mOutputHolder;
-
-    sp<GraphicBuffer> mSvTexture GUARDED_BY(mAccessLock);
-
+    // Size in bytes of the CPU output buffer, which only grows, so that
+    // smaller outputs reuse it.
+    size_t mOutputCapacity GUARDED_BY(mAccessLock) = 0;
     bool mIsInitialized GUARDED_BY(mAccessLock) = false;
 
     bool mGpuAccelerationEnabled;
-    hidl_vec<BufferDesc_1_1> mEvsGraphicBuffers;
+
+    // Guards the projection of camera points, which is separate from
+    // mAccessLock so that it does not wait on the frames being stitched.
+    std::mutex mProjectionLock;
+    ProjectionCache<Point2dFloat> mProjectionCache GUARDED_BY(mProjectionLock);
+
+    SurroundViewStats mStats;
+
+    VhalHandler* mVhalHandler;
+    FrameRateScheduler mFrameRateScheduler;
+    // Set when the 2d config changes, until the frame rate is picked again.
+    std::atomic<bool> mSceneChanged = false;
 };
 
 }  // namespace implementation
@@ -20,12 +20,16 @@
 #include <android-base/logging.h>
 #include <android/hardware_buffer.h>
 #include <android/hidl/memory/1.0/IMemory.h>
+#include <gpupolicy/GpuPolicy.h>
 #include <hidlmemory/mapping.h>
 #include <system/camera_metadata.h>
+#include <threadpolicy/ThreadPolicy.h>
 #include <utils/SystemClock.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <thread>
 #include <set>
 
@@ -38,6 +42,7 @@ using ::std::adopt_lock;
 using ::std::array;
 using ::std::lock;
 using ::std::lock_guard;
+using ::std::make_pair;
 using ::std::map;
 using ::std::mutex;
 using ::std::scoped_lock;
@@ -74,6 +79,12 @@ typedef struct {
 static const size_t kStreamCfgSz = sizeof(RawStreamConfig) / sizeof(int32_t);
 static const uint8_t kGrayColor = 128;
 static const int kNumFrames = 4;
+
+// Bounds the projected points kept per camera, about 2 MB with the overhead of
+// the table.
+static const size_t kMaxProjectedPointsPerCamera = 1 << 15;
+// One set of input frames is copied while the other one is stitched.
+static const int kNumInputSets = 2;
 static const int kInputNumChannels = 4;
 static const int kOutputNumChannels = 4;
 static const float kUndistortionScales[4] = {1.0f, 1.0f, 1.0f, 1.0f};
@@ -91,24 +102,78 @@ Return<void> SurroundView3dSession::FramesHandler::deliverFrame(
     return {};
 }
 
+bool SurroundView3dSession::FramesHandler::isFrameSetDue(
+        const hidl_vec<BufferDesc_1_1>& buffers) {
+    FrameRateScheduler& scheduler = mSession->mFrameRateScheduler;
+    if (!scheduler.isEnabled() || buffers.size() == 0) {
+        return true;
+    }
+
+    VhalHandler::DrivingState drivingState;
+    const bool hasDrivingState = mSession->mVhalHandler != nullptr &&
+            mSession->mVhalHandler->getDrivingState(&drivingState);
+    if (scheduler.update(hasDrivingState ? &drivingState : nullptr,
+                         mSession->mSceneChanged.exchange(false), elapsedRealtimeNano())) {
+        // The EVS manager slows the cameras down to the rate as well.
+        const int32_t frameRate = scheduler.getFrameRate();
+        LOG(INFO) << "Frame rate policy: " << frameRate << " fps";
+        hidl_vec<uint8_t> value;
+        value.resize(sizeof(frameRate));
+        memcpy(value.data(), &frameRate, sizeof(frameRate));
+        mCamera->setExtendedInfo_1_1(FrameRateScheduler::kEvsFrameRateId, value);
+    }
+    return scheduler.isFrameDue(buffers[0].timestamp);
+}
+
 Return<void> SurroundView3dSession::FramesHandler::deliverFrame_1_1(
     const hidl_vec<BufferDesc_1_1>& buffers) {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
     LOG(INFO) << "Received " << buffers.size() << " frames from the camera";
     mSession->mSequenceId++;
+    mSession->mStats.frameReceived();
 
+    if (!isFrameSetDue(buffers)) {
+        mSession->mStats.frameThrottled();
+        mCamera->doneWithFrame_1_1(buffers);
+        return {};
+    }
+
+    const int frameInterval = mSession->mQualityController.getFrameInterval();
+    if (frameInterval > 1 && mSession->mSequenceId % frameInterval != 0) {
+        // The frame rate is lowered to hold the render time under load.
+        mSession->mStats.frameThrottled();
+        mCamera->doneWithFrame_1_1(buffers);
+        return {};
+    }
+
+    const int64_t skewUs = getFrameSkewUs(buffers);
+    mSession->mStats.recordLatency(SurroundViewStats::FRAME_SKEW, skewUs);
+    const int maxSkewMs = mSession->mIOModuleConfig->cameraConfig.maxFrameSkewMs;
+    if (maxSkewMs > 0 && skewUs > maxSkewMs * 1000) {
+        // The EVS buffers come and go back as a set, so a lagging frame is
+        // not held for the next one and the whole set is dropped.
+        LOG(WARNING) << "Frames are " << skewUs << "us apart, more than " << maxSkewMs
+                     << "ms. Skip frames:" << mSession->mSequenceId;
+        mSession->mStats.frameUnsynced();
+        mCamera->doneWithFrame_1_1(buffers);
+        return {};
+    }
+
+    int inputSetIndex;
     {
         scoped_lock<mutex> lock(mSession->mAccessLock);
-        if (mSession->mProcessingEvsFrames) {
+        if (mSession->mStreamState != RUNNING || mSession->mFreeInputSets.empty()) {
             LOG(WARNING) << "EVS frames are being processed. Skip frames:"
                          << mSession->mSequenceId;
+            mSession->mStats.frameSkipped();
             mCamera->doneWithFrame_1_1(buffers);
             return {};
         } else {
-            // Sets the flag to true immediately so the new coming frames will
-            // be skipped.
-            mSession->mProcessingEvsFrames = true;
+            // Takes the set immediately so the new coming frames go to
+            // another one, or are skipped.
+            inputSetIndex = mSession->mFreeInputSets.front();
+            mSession->mFreeInputSets.pop_front();
         }
     }
 
@@ -117,18 +182,25 @@ Return<void> SurroundView3dSession::FramesHandler::deliverFrame_1_1(
         LOG(ERROR) << "The number of incoming frames is " << buffers.size()
                    << ", which is different from the number " << kNumFrames
                    << ", specified in config file";
-        mSession->mProcessingEvsFrames = false;
+        mSession->mFreeInputSets.push_back(inputSetIndex);
+        mSession->mFramesSignal.notify_all();
         mCamera->doneWithFrame_1_1(buffers);
         return {};
     }
 
+    InputSet& inputSet = mSession->mInputSets[inputSetIndex];
+    inputSet.sequenceId = mSession->mSequenceId;
+    inputSet.timestampUs = buffers[0].timestamp;
+    for (const auto& buffer : buffers) {
+        inputSet.timestampUs = std::min<int64_t>(inputSet.timestampUs, buffer.timestamp);
+    }
+    vector<int> indices;
     {
         scoped_lock<mutex> lock(mSession->mAccessLock);
 
         // The incoming frames may not follow the same order as listed cameras.
         // We should re-order them following the camera ids listed in camera
         // config.
-        vector<int> indices;
         for (const auto& id
                 : mSession->mIOModuleConfig->cameraConfig.evsCameraIds) {
             for (int i = 0; i < kNumFrames; i++) {
@@ -144,22 +216,33 @@ Return<void> SurroundView3dSession::FramesHandler::deliverFrame_1_1(
         // expected.
         if (indices.size() != kNumFrames) {
             LOG(ERROR) << "The frames are not from the cameras we expected!";
-            mSession->mProcessingEvsFrames = false;
+            mSession->mFreeInputSets.push_back(inputSetIndex);
+            mSession->mFramesSignal.notify_all();
             mCamera->doneWithFrame_1_1(buffers);
             return {};
         }
+    }
 
-        for (int i = 0; i < kNumFrames; i++) {
-            LOG(DEBUG) << "Copying buffer from camera ["
-                       << buffers[indices[i]].deviceId
-                       << "] to Surround View Service";
-            mSession->copyFromBufferToPointers(buffers[indices[i]],
-                                               mSession->mInputPointers[i]);
-        }
+    // The copy runs without the lock, so it overlaps the stitching of the
+    // frames before.
+    const int64_t copyStartNs = elapsedRealtimeNano();
+    for (int i = 0; i < kNumFrames; i++) {
+        LOG(DEBUG) << "Copying buffer from camera ["
+                   << buffers[indices[i]].deviceId
+                   << "] to Surround View Service";
+        mSession->copyFromBufferToPointers(buffers[indices[i]],
+                                           inputSet.pointers[i]);
     }
+    mSession->mStats.recordLatency(SurroundViewStats::INPUT_COPY,
+                                   (elapsedRealtimeNano() - copyStartNs) / 1000);
 
     mCamera->doneWithFrame_1_1(buffers);
 
+    {
+        scoped_lock<mutex> lock(mSession->mAccessLock);
+        mSession->mReadyInputSets.push_back(inputSetIndex);
+    }
+
     // Notify the session that a new set of frames is ready
     mSession->mFramesSignal.notify_all();
 
@@ -199,35 +282,57 @@ Return<void> SurroundView3dSession::FramesHandler::notify(const EvsEventDesc& ev
     return {};
 }
 
-bool SurroundView3dSession::copyFromBufferToPointers(
-    BufferDesc_1_1 buffer, SurroundViewInputBufferPointers pointers) {
+sp<GraphicBuffer> SurroundView3dSession::getInputBuffer(const BufferDesc_1_1& buffer) {
+    const auto key = make_pair(string(buffer.deviceId), buffer.bufferId);
+    const auto it = mInputBuffers.find(key);
+    if (it != mInputBuffers.end()) {
+        return it->second;
+    }
 
-    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&buffer.buffer.description);
 
-    AHardwareBuffer_Desc* pDesc =
-        reinterpret_cast<AHardwareBuffer_Desc *>(&buffer.buffer.description);
-
-    ATRACE_BEGIN("Create Graphic Buffer");
     // create a GraphicBuffer from the existing handle
     sp<GraphicBuffer> inputBuffer = new GraphicBuffer(
         buffer.buffer.nativeHandle, GraphicBuffer::CLONE_HANDLE, pDesc->width,
         pDesc->height, pDesc->format, pDesc->layers,
         GRALLOC_USAGE_HW_TEXTURE, pDesc->stride);
 
-    if (inputBuffer == nullptr) {
+    if (inputBuffer == nullptr || inputBuffer->initCheck() != OK) {
         LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
-        // Returning "true" in this error condition because we already released the
-        // previous image (if any) and so the texture may change in unpredictable
-        // ways now!
-        return false;
-    } else {
-        LOG(INFO) << "Managed to allocate GraphicBuffer with "
-                  << " width: " << pDesc->width
-                  << " height: " << pDesc->height
-                  << " format: " << pDesc->format
-                  << " stride: " << pDesc->stride;
+        return nullptr;
+    }
+
+    LOG(INFO) << "Imported buffer " << buffer.bufferId
+              << " of camera [" << buffer.deviceId << "] with"
+              << " width: " << pDesc->width
+              << " height: " << pDesc->height
+              << " format: " << pDesc->format
+              << " stride: " << pDesc->stride;
+    mInputBuffers.emplace(key, inputBuffer);
+    return inputBuffer;
+}
+
+bool SurroundView3dSession::copyFromBufferToPointers(
+    BufferDesc_1_1 buffer, SurroundViewInputBufferPointers pointers) {
+
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc *>(&buffer.buffer.description);
+
+    ATRACE_BEGIN("Get Graphic Buffer");
+    sp<GraphicBuffer> inputBuffer;
+    {
+        // The copy itself runs without the lock.
+        scoped_lock<mutex> lock(mAccessLock);
+        inputBuffer = getInputBuffer(buffer);
     }
     ATRACE_END();
+    if (inputBuffer == nullptr) {
+        ATRACE_END();
+        return false;
+    }
 
     ATRACE_BEGIN("Lock input buffer (gpu to cpu)");
     // Lock the input GraphicBuffer and map it to a pointer.  If we failed to
@@ -265,6 +370,10 @@ bool SurroundView3dSession::copyFromBufferToPointers(
 void SurroundView3dSession::processFrames() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
+    // The delivery thread started below inherits the policy
+    android::automotive::evs::threadpolicy::applyThreadPolicy(
+            android::automotive::evs::threadpolicy::kRoleSurroundView);
+
     ATRACE_BEGIN("SV core lib method: Start3dPipeline");
     if (mSurroundView->Start3dPipeline()) {
         LOG(INFO) << "Start3dPipeline succeeded";
@@ -274,26 +383,47 @@ void SurroundView3dSession::processFrames() {
     }
     ATRACE_END();
 
+    mDeliveryThread = thread([this]() {
+        deliverFrames();
+    });
+
     while (true) {
+        int inputSetIndex;
         {
             unique_lock<mutex> lock(mAccessLock);
 
-            if (mStreamState != RUNNING) {
+            // Once the stream stops, the sets of frames being copied still
+            // get stitched.
+            mFramesSignal.wait(lock, [this]() {
+                return !mReadyInputSets.empty()
+                        || (mStreamState != RUNNING
+                            && mFreeInputSets.size() == mInputSets.size());
+            });
+            if (mReadyInputSets.empty()) {
                 break;
             }
 
-            mFramesSignal.wait(lock, [this]() { return mProcessingEvsFrames; });
+            inputSetIndex = mReadyInputSets.front();
+            mReadyInputSets.pop_front();
         }
 
-        handleFrames(mSequenceId);
+        handleFrames(inputSetIndex);
 
         {
-            // Set the boolean to false to receive the next set of frames.
+            // Give the set back to receive the next set of frames.
             scoped_lock<mutex> lock(mAccessLock);
-            mProcessingEvsFrames = false;
+            mFreeInputSets.push_back(inputSetIndex);
         }
+        mFramesSignal.notify_all();
     }
 
+    {
+        scoped_lock<mutex> lock(mAccessLock);
+        mDeliveryStopping = true;
+    }
+    mDeliverySignal.notify_all();
+    mDeliveryThread.join();
+
     // Notify the SV client that no new results will be delivered.
     LOG(DEBUG) << "Notify SvEvent::STREAM_STOPPED";
     mStream->notify(SvEvent::STREAM_STOPPED);
@@ -308,6 +438,43 @@ void SurroundView3dSession::processFrames() {
     ATRACE_END();
 }
 
+void SurroundView3dSession::deliverFrames() {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    while (true) {
+        int recordIndex;
+        {
+            unique_lock<mutex> lock(mAccessLock);
+            mDeliverySignal.wait(lock, [this]() {
+                return !mDeliveryQueue.empty() || mDeliveryStopping;
+            });
+            if (mDeliveryQueue.empty()) {
+                break;
+            }
+
+            recordIndex = mDeliveryQueue.front();
+            mDeliveryQueue.pop_front();
+        }
+
+        // The record is in use until the client returns it, so nothing else
+        // touches it meanwhile.
+        const FramesRecord& record = mFramesRecords[recordIndex];
+        ATRACE_BEGIN("Deliver the frames");
+        const int64_t deliveryStartNs = elapsedRealtimeNano();
+        mStream->receiveFrames(record.frames);
+        const int64_t deliveryEndNs = elapsedRealtimeNano();
+        ATRACE_END();
+
+        mStats.recordLatency(SurroundViewStats::DELIVERY,
+                             (deliveryEndNs - deliveryStartNs) / 1000);
+        mStats.recordLatency(SurroundViewStats::END_TO_END,
+                             deliveryEndNs / 1000 - record.cameraTimestampUs);
+        mStats.frameDelivered();
+    }
+
+    ATRACE_END();
+}
+
 SurroundView3dSession::SurroundView3dSession(sp<IEvsEnumerator> pEvs,
                                              VhalHandler* vhalHandler,
                                              AnimationModule* animationModule,
@@ -316,7 +483,11 @@ SurroundView3dSession::SurroundView3dSession(sp<IEvsEnumerator> pEvs,
       mStreamState(STOPPED),
       mVhalHandler(vhalHandler),
       mAnimationModule(animationModule),
-      mIOModuleConfig(pConfig) {}
+      mIOModuleConfig(pConfig),
+      mProjectionCache(kMaxProjectedPointsPerCamera),
+      mQualityController(pConfig->sv3dConfig.adaptiveQuality),
+      mFrameRateScheduler(pConfig->cameraConfig.frameRatePolicy),
+      mCarModelLodSelector(pConfig->sv3dConfig.carModelLods) {}
 
 SurroundView3dSession::~SurroundView3dSession() {
     // In case the client did not call stopStream properly, we should stop the
@@ -329,6 +500,9 @@ SurroundView3dSession::~SurroundView3dSession() {
         mProcessThread.join();
     }
 
+    if (mThermalMonitor != nullptr) {
+        mThermalMonitor->stop();
+    }
     mEvs->closeCamera(mCamera);
 }
 
@@ -364,6 +538,11 @@ Return<SvResult> SurroundView3dSession::startStream(
     mStream = stream;
 
     mSequenceId = 0;
+    // The buffers of the next Evs stream may not be those of the last one.
+    mInputBuffers.clear();
+    mStats.reset();
+    mQualityController.reset();
+    mFrameRateScheduler.reset();
     startEvs();
 
     if (mVhalHandler != nullptr) {
@@ -379,7 +558,13 @@ Return<SvResult> SurroundView3dSession::startStream(
     // moved to EVS notify callback.
     LOG(DEBUG) << "Notify SvEvent::STREAM_STARTED";
     mStream->notify(SvEvent::STREAM_STARTED);
-    mProcessingEvsFrames = false;
+    mFreeInputSets.clear();
+    mReadyInputSets.clear();
+    for (int i = 0; i < static_cast<int>(mInputSets.size()); i++) {
+        mFreeInputSets.push_back(i);
+    }
+    mDeliveryQueue.clear();
+    mDeliveryStopping = false;
 
     // Start the frame generation thread
     mStreamState = RUNNING;
@@ -395,18 +580,20 @@ Return<void> SurroundView3dSession::stopStream() {
     LOG(DEBUG) << __FUNCTION__;
     unique_lock <mutex> lock(mAccessLock);
 
-    if (mVhalHandler != nullptr) {
-        mVhalHandler->stopPropertiesUpdate();
-    } else {
-        LOG(WARNING) << "VhalHandler is null. Ignored";
-    }
-
     if (mStreamState == RUNNING) {
+        // The 2d session may still use the vhal property updates.
+        if (mVhalHandler != nullptr) {
+            mVhalHandler->stopPropertiesUpdate();
+        } else {
+            LOG(WARNING) << "VhalHandler is null. Ignored";
+        }
+
         // Tell the processFrames loop to stop processing frames
         mStreamState = STOPPING;
 
         // Stop the EVS stream asynchronizely
         mCamera->stopVideoStream();
+        mFramesSignal.notify_all();
     }
 
     return {};
@@ -417,9 +604,15 @@ Return<void> SurroundView3dSession::doneWithFrames(
     LOG(DEBUG) << __FUNCTION__;
     scoped_lock <mutex> lock(mAccessLock);
 
-    mFramesRecord.inUse = false;
+    for (auto& record : mFramesRecords) {
+        if (record.inUse && record.frames.sequenceId == svFramesDesc.sequenceId) {
+            record.inUse = false;
+            return {};
+        }
+    }
 
-    (void)svFramesDesc;
+    LOG(WARNING) << "Frames " << svFramesDesc.sequenceId
+                 << " were not delivered or were returned already";
     return {};
 }
 
@@ -438,6 +631,7 @@ Return<SvResult> SurroundView3dSession::setViews(
     for (int i=0; i<views.size(); i++) {
         mViews[i] = views[i];
     }
+    mSceneChanged = true;
 
     return SvResult::OK;
 }
@@ -477,95 +671,122 @@ Return<void> SurroundView3dSession::get3dConfig(get3dConfig_cb _hidl_cb) {
     return {};
 }
 
-bool VerifyAndGetOverlays(const OverlaysData& overlaysData, std::vector<Overlay>* svCoreOverlays) {
-    // Clear the overlays.
-    svCoreOverlays->clear();
+static const int kOverlayVertexSize = 16;
+static const int kOverlayIdSize = 2;
 
+// Checks the overlays in the shared memory against their descriptors, and
+// returns the mapped memory, or nullptr if they do not match. Nothing is
+// copied out of the memory yet.
+static sp<IMemory> VerifyOverlays(const OverlaysData& overlaysData) {
     // Check size of shared memory matches overlaysMemoryDesc.
-    const int kVertexSize = 16;
-    const int kIdSize = 2;
-    int memDescSize = 0;
+    size_t memDescSize = 0;
     for (auto& overlayMemDesc : overlaysData.overlaysMemoryDesc) {
-        memDescSize += kIdSize + kVertexSize * overlayMemDesc.verticesCount;
+        memDescSize += kOverlayIdSize + kOverlayVertexSize * overlayMemDesc.verticesCount;
     }
     if (overlaysData.overlaysMemory.size() < memDescSize) {
         LOG(ERROR) << "Allocated shared memory size is less than overlaysMemoryDesc size.";
-        return false;
+        return nullptr;
     }
 
     // Map memory.
     sp<IMemory> pSharedMemory = mapMemory(overlaysData.overlaysMemory);
     if(pSharedMemory == nullptr) {
         LOG(ERROR) << "mapMemory failed.";
-        return false;
+        return nullptr;
     }
 
     // Get Data pointer.
-    uint8_t* pData = static_cast<uint8_t*>(
+    const uint8_t* pData = static_cast<uint8_t*>(
         static_cast<void*>(pSharedMemory->getPointer()));
     if (pData == nullptr) {
         LOG(ERROR) << "Shared memory getPointer() failed.";
-        return false;
+        return nullptr;
     }
 
-    int idOffset = 0;
+    size_t idOffset = 0;
     set<uint16_t> overlayIdSet;
     for (auto& overlayMemDesc : overlaysData.overlaysMemoryDesc) {
 
-        if (overlayIdSet.find(overlayMemDesc.id) != overlayIdSet.end()) {
+        if (!overlayIdSet.insert(overlayMemDesc.id).second) {
             LOG(ERROR) << "Duplicate id within memory descriptor.";
-            svCoreOverlays->clear();
-            return false;
+            return nullptr;
         }
-        overlayIdSet.insert(overlayMemDesc.id);
 
         if(overlayMemDesc.verticesCount < 3) {
             LOG(ERROR) << "Less than 3 vertices.";
-            svCoreOverlays->clear();
-            return false;
+            return nullptr;
         }
 
         if (overlayMemDesc.overlayPrimitive == OverlayPrimitive::TRIANGLES &&
                 overlayMemDesc.verticesCount % 3 != 0) {
             LOG(ERROR) << "Triangles primitive does not have vertices "
                        << "multiple of 3.";
-            svCoreOverlays->clear();
-            return false;
+            return nullptr;
         }
 
-        const uint16_t overlayId = *((uint16_t*)(pData + idOffset));
-
+        uint16_t overlayId;
+        memcpy(&overlayId, pData + idOffset, kOverlayIdSize);
         if (overlayId != overlayMemDesc.id) {
             LOG(ERROR) << "Overlay id mismatch " << overlayId << ", " << overlayMemDesc.id;
-            svCoreOverlays->clear();
-            return false;
+            return nullptr;
+        }
+
+        idOffset += kOverlayIdSize + (kOverlayVertexSize * overlayMemDesc.verticesCount);
+    }
+
+    return pSharedMemory;
+}
+
+// Brings the sv core overlays up to date with the verified shared memory.
+// Overlays whose vertices did not change are left alone, and the others reuse
+// their storage. Returns whether any overlay changed.
+static bool UpdateOverlaysFromMemory(const OverlaysData& overlaysData, const uint8_t* pData,
+                                     std::vector<Overlay>* svCoreOverlays) {
+    const size_t numOverlays = overlaysData.overlaysMemoryDesc.size();
+    bool changed = svCoreOverlays->size() != numOverlays;
+    svCoreOverlays->resize(numOverlays);
+
+    size_t idOffset = 0;
+    for (size_t i = 0; i < numOverlays; i++) {
+        const auto& overlayMemDesc = overlaysData.overlaysMemoryDesc[i];
+        const uint8_t* verticesDataPtr = pData + idOffset + kOverlayIdSize;
+        const size_t verticesSize = kOverlayVertexSize * overlayMemDesc.verticesCount;
+        idOffset += kOverlayIdSize + verticesSize;
+
+        Overlay& svCoreOverlay = (*svCoreOverlays)[i];
+        if (svCoreOverlay.id == overlayMemDesc.id &&
+            svCoreOverlay.vertices.size() == overlayMemDesc.verticesCount &&
+            memcmp(svCoreOverlay.vertices.data(), verticesDataPtr, verticesSize) == 0) {
+            continue;
         }
 
-        // Copy over shared memory data to sv core overlays.
-        Overlay svCoreOverlay;
         svCoreOverlay.id = overlayMemDesc.id;
         svCoreOverlay.vertices.resize(overlayMemDesc.verticesCount);
-        uint8_t* verticesDataPtr = pData + idOffset + kIdSize;
-        memcpy(svCoreOverlay.vertices.data(), verticesDataPtr,
-                kVertexSize * overlayMemDesc.verticesCount);
-        svCoreOverlays->push_back(svCoreOverlay);
-
-        idOffset += kIdSize + (kVertexSize * overlayMemDesc.verticesCount);
+        memcpy(svCoreOverlay.vertices.data(), verticesDataPtr, verticesSize);
+        changed = true;
     }
 
-    return true;
+    return changed;
 }
 
 Return<SvResult>  SurroundView3dSession::updateOverlays(const OverlaysData& overlaysData) {
     LOG(DEBUG) << __FUNCTION__;
 
-    scoped_lock <mutex> lock(mAccessLock);
-    if(!VerifyAndGetOverlays(overlaysData, &mOverlays)) {
-        LOG(ERROR) << "VerifyAndGetOverlays failed.";
+    // The memory is checked without the lock, so that it does not hold up
+    // the frames being rendered.
+    sp<IMemory> pSharedMemory = VerifyOverlays(overlaysData);
+    if (pSharedMemory == nullptr) {
+        LOG(ERROR) << "VerifyOverlays failed.";
         return SvResult::INVALID_ARG;
     }
 
-    mOverlayIsUpdated = true;
+    scoped_lock <mutex> lock(mAccessLock);
+    const uint8_t* pData = static_cast<uint8_t*>(
+        static_cast<void*>(pSharedMemory->getPointer()));
+    if (UpdateOverlaysFromMemory(overlaysData, pData, &mOverlays)) {
+        mOverlayIsUpdated = true;
+        mSceneChanged = true;
+    }
     return SvResult::OK;
 }
 
@@ -593,58 +814,77 @@ Return<void> SurroundView3dSession::projectCameraPointsTo3dSurface(
         return {};
     }
 
-    for (const auto& cameraPoint : cameraPoints) {
-        Point3dFloat point3d = {false, 0.0, 0.0, 0.0};
+    const Size2dInteger cameraSize = mCameraParams[cameraIndex].size;
+    int numOutOfBounds = 0;
+    points3d.reserve(cameraPoints.size());
+    {
+        scoped_lock<mutex> projectionLock(mProjectionLock);
+        for (const auto& cameraPoint : cameraPoints) {
+            Point3dFloat point3d = {false, 0.0, 0.0, 0.0};
+
+            // Verify if camera point is within the camera resolution bounds.
+            point3d.isValid = (cameraPoint.x >= 0 && cameraPoint.x < cameraSize.width &&
+                               cameraPoint.y >= 0 && cameraPoint.y < cameraSize.height);
+            if (!point3d.isValid) {
+                numOutOfBounds++;
+                points3d.push_back(point3d);
+                continue;
+            }
 
-        // Verify if camera point is within the camera resolution bounds.
-        const Size2dInteger cameraSize = mCameraParams[cameraIndex].size;
-        point3d.isValid = (cameraPoint.x >= 0 && cameraPoint.x < cameraSize.width &&
-                           cameraPoint.y >= 0 && cameraPoint.y < cameraSize.height);
-        if (!point3d.isValid) {
-            LOG(WARNING) << "Camera point (" << cameraPoint.x << ", " << cameraPoint.y
-                         << ") is out of camera resolution bounds.";
+            if (mProjectionCache.find(cameraIndex, cameraPoint.x, cameraPoint.y, &point3d)) {
+                points3d.push_back(point3d);
+                continue;
+            }
+
+            // Project points using mSurroundView function.
+            const Coordinate2dInteger camCoord(cameraPoint.x, cameraPoint.y);
+            Coordinate3dFloat projPoint3d(0.0, 0.0, 0.0);
+            point3d.isValid =
+                    mSurroundView->GetProjectionPointFromRawCameraToSurroundView3d(camCoord,
+                                                                                   cameraIndex,
+                                                                                   &projPoint3d);
+            // Convert projPoint3d in meters to point3d which is in milli-meters.
+            point3d.x = projPoint3d.x * 1000.0;
+            point3d.y = projPoint3d.y * 1000.0;
+            point3d.z = projPoint3d.z * 1000.0;
+            mProjectionCache.insert(cameraIndex, cameraPoint.x, cameraPoint.y, point3d);
             points3d.push_back(point3d);
-            continue;
         }
+    }
 
-        // Project points using mSurroundView function.
-        const Coordinate2dInteger camCoord(cameraPoint.x, cameraPoint.y);
-        Coordinate3dFloat projPoint3d(0.0, 0.0, 0.0);
-        point3d.isValid =
-                mSurroundView->GetProjectionPointFromRawCameraToSurroundView3d(camCoord,
-                                                                               cameraIndex,
-                                                                               &projPoint3d);
-        // Convert projPoint3d in meters to point3d which is in milli-meters.
-        point3d.x = projPoint3d.x * 1000.0;
-        point3d.y = projPoint3d.y * 1000.0;
-        point3d.z = projPoint3d.z * 1000.0;
-        points3d.push_back(point3d);
+    if (numOutOfBounds > 0) {
+        LOG(WARNING) << numOutOfBounds << " of " << cameraPoints.size()
+                     << " camera points are out of camera resolution bounds.";
     }
     _hidl_cb(points3d);
     return {};
 }
 
-bool SurroundView3dSession::handleFrames(int sequenceId) {
+bool SurroundView3dSession::handleFrames(int inputSetIndex) {
+    const InputSet& inputSet = mInputSets[inputSetIndex];
+    const int sequenceId = inputSet.sequenceId;
     LOG(INFO) << __FUNCTION__ << "Handling sequenceId " << sequenceId << ".";
 
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
-    // TODO(b/157498592): Now only one sets of EVS input frames and one SV
-    // output frame is supported. Implement buffer queue for both of them.
+    int recordIndex;
+    vector<View3d> views;
     {
         scoped_lock<mutex> lock(mAccessLock);
 
-        if (mFramesRecord.inUse) {
+        recordIndex = findFreeFramesRecord();
+        if (recordIndex < 0) {
             LOG(DEBUG) << "Notify SvEvent::FRAME_DROPPED";
             mStream->notify(SvEvent::FRAME_DROPPED);
+            mStats.frameDropped();
             return true;
         }
+        views = mViews;
     }
 
-    // If the width/height was changed, re-allocate the data pointer.
     if (mOutputWidth != mConfig.width
         || mOutputHeight != mConfig.height) {
-        LOG(DEBUG) << "Config changed. Re-allocate memory. "
+        LOG(DEBUG) << "Config changed. "
                    << "Old width: "
                    << mOutputWidth
                    << ", old height: "
@@ -653,37 +893,54 @@ bool SurroundView3dSession::handleFrames(int sequenceId) {
                    << mConfig.width
                    << ", new height: "
                    << mConfig.height;
-        delete[] static_cast<char*>(mOutputPointer.cpu_data_pointer);
         mOutputWidth = mConfig.width;
         mOutputHeight = mConfig.height;
-        mOutputPointer.height = mOutputHeight;
-        mOutputPointer.width = mOutputWidth;
+    }
+
+    // Under load the views are rendered at a lower resolution, and upscaled
+    // into the output textures.
+    const float renderScale = mQualityController.getLevel().renderScale;
+    const int renderWidth = std::max(1, static_cast<int>(std::lround(mOutputWidth * renderScale)));
+    const int renderHeight =
+            std::max(1, static_cast<int>(std::lround(mOutputHeight * renderScale)));
+
+    // If the render resolution was changed, re-allocate the data pointer.
+    if (mRenderWidth != renderWidth || mRenderHeight != renderHeight) {
+        LOG(INFO) << "Rendering at " << renderWidth << "x" << renderHeight
+                  << " for an output of " << mOutputWidth << "x" << mOutputHeight;
+        delete[] static_cast<char*>(mOutputPointer.cpu_data_pointer);
+        mRenderWidth = renderWidth;
+        mRenderHeight = renderHeight;
+        mOutputPointer.height = mRenderHeight;
+        mOutputPointer.width = mRenderWidth;
         mOutputPointer.format = Format::RGBA;
         mOutputPointer.cpu_data_pointer =
-                static_cast<void*>(new char[mOutputHeight * mOutputWidth * kOutputNumChannels]);
+                static_cast<void*>(new char[mRenderHeight * mRenderWidth * kOutputNumChannels]);
 
         if (!mOutputPointer.cpu_data_pointer) {
             LOG(ERROR) << "Memory allocation failed. Exiting.";
             return false;
         }
 
-        Size2dInteger size = Size2dInteger(mOutputWidth, mOutputHeight);
+        Size2dInteger size = Size2dInteger(mRenderWidth, mRenderHeight);
         mSurroundView->Update3dOutputResolution(size);
-
-        mSvTexture = new GraphicBuffer(mOutputWidth,
-                                       mOutputHeight,
-                                       HAL_PIXEL_FORMAT_RGBA_8888,
-                                       1,
-                                       GRALLOC_USAGE_HW_TEXTURE,
-                                       "SvTexture");
-        if (mSvTexture->initCheck() == OK) {
-            LOG(INFO) << "Successfully allocated Graphic Buffer";
-        } else {
-            LOG(ERROR) << "Failed to allocate Graphic Buffer";
-            return false;
+        mUpscaleColumns.clear();
+    }
+    if (static_cast<int>(mUpscaleColumns.size()) != mOutputWidth) {
+        mUpscaleColumns.resize(mOutputWidth);
+        for (int x = 0; x < mOutputWidth; x++) {
+            mUpscaleColumns[x] = x * mRenderWidth / mOutputWidth;
         }
     }
 
+    updateCarModelLod(views);
+
+    // Textures the client still holds keep their size until they come back.
+    if (!prepareTextures(recordIndex, views.size())) {
+        return false;
+    }
+    const vector<sp<GraphicBuffer>> textures = mFramesRecords[recordIndex].textures;
+
     ATRACE_BEGIN("SV core lib method: Set3dOverlay");
     // Set 3d overlays.
     {
@@ -697,10 +954,11 @@ bool SurroundView3dSession::handleFrames(int sequenceId) {
     }
     ATRACE_END();
 
-    ATRACE_BEGIN("VhalHandler method: getPropertyValues");
+    ATRACE_BEGIN("VhalHandler method: getChangedPropertyValues");
     // Get the latest VHal property values
     if (mVhalHandler != nullptr) {
-        if (!mVhalHandler->getPropertyValues(&mPropertyValues)) {
+        // Only the values that changed, the animation module keeps the others.
+        if (!mVhalHandler->getChangedPropertyValues(&mPropertySequence, &mPropertyValues)) {
             LOG(ERROR) << "Failed to get property values";
         }
     } else {
@@ -725,90 +983,209 @@ bool SurroundView3dSession::handleFrames(int sequenceId) {
     }
     ATRACE_END();
 
-    // Get the view.
-    // TODO(161399517): Only single view is currently supported, add support for multiple views.
-    const View3d view3d = mViews[0];
-    const RotationQuat quat = view3d.pose.rotation;
-    const Translation trans = view3d.pose.translation;
-    const std::array<float, 4> viewQuaternion = {quat.x, quat.y, quat.z, quat.w};
-    const std::array<float, 3> viewTranslation = {trans.x, trans.y, trans.z};
+    // Everything above is shared by the views, only the projection of the
+    // scene is done per view.
+    const int64_t renderStartNs = elapsedRealtimeNano();
+    for (int i = 0; i < static_cast<int>(views.size()); i++) {
+        if (!renderView(inputSet, views[i], textures[i])) {
+            return false;
+        }
+    }
+    const int64_t renderTimeNs = elapsedRealtimeNano() - renderStartNs;
+    android::automotive::evs::gpupolicy::recordFrameTime(
+            android::automotive::evs::gpupolicy::kComponentSvRender, renderTimeNs);
+    if (mQualityController.recordFrameTime(renderTimeNs / 1000)) {
+        const QualityController::Level& level = mQualityController.getLevel();
+        LOG(INFO) << "Render quality changed to scale " << level.renderScale
+                  << ", frame interval " << level.frameInterval;
+    }
 
-    ATRACE_BEGIN("SV core lib method: Get3dSurroundView");
-    if (mSurroundView->Get3dSurroundView(
-            mInputPointers, viewQuaternion, viewTranslation, &mOutputPointer)) {
-        LOG(INFO) << "Get3dSurroundView succeeded";
-    } else {
-        LOG(ERROR) << "Get3dSurroundView failed. "
-                   << "Using memset to initialize to gray.";
-        memset(mOutputPointer.cpu_data_pointer, kGrayColor,
-               mOutputHeight * mOutputWidth * kOutputNumChannels);
+    {
+        scoped_lock<mutex> lock(mAccessLock);
+
+        FramesRecord& record = mFramesRecords[recordIndex];
+        record.frames.svBuffers.resize(views.size());
+        for (int i = 0; i < static_cast<int>(views.size()); i++) {
+            ANativeWindowBuffer* buffer = textures[i]->getNativeBuffer();
+            LOG(DEBUG) << "ANativeWindowBuffer->handle: " << buffer->handle;
+
+            SvBuffer& svBuffer = record.frames.svBuffers[i];
+            svBuffer.viewId = views[i].viewId;
+            svBuffer.hardwareBuffer.nativeHandle = buffer->handle;
+            AHardwareBuffer_Desc* pDesc =
+                reinterpret_cast<AHardwareBuffer_Desc *>(
+                    &svBuffer.hardwareBuffer.description);
+            pDesc->width = mOutputWidth;
+            pDesc->height = mOutputHeight;
+            pDesc->layers = 1;
+            pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
+            pDesc->stride = textures[i]->getStride();
+            pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
+        }
+        record.frames.timestampNs = elapsedRealtimeNano();
+        record.frames.sequenceId = sequenceId;
+        record.cameraTimestampUs = inputSet.timestampUs;
+
+        record.inUse = true;
+        mDeliveryQueue.push_back(recordIndex);
+    }
+    mDeliverySignal.notify_one();
+
+    ATRACE_END();
+
+    return true;
+}
+
+void SurroundView3dSession::updateCarModelLod(const vector<View3d>& views) {
+    vector<float> viewWidths;
+    for (const auto& view : views) {
+        const Translation& trans = view.pose.translation;
+        const float distance = std::sqrt(trans.x * trans.x + trans.y * trans.y + trans.z * trans.z);
+        viewWidths.push_back(CarModelLodSelector::getViewWidth(distance, view.horizontalFov));
+    }
+    if (!mCarModelLodSelector.update(viewWidths)) {
+        return;
     }
+
+    const int level = mCarModelLodSelector.getLevel();
+    const auto& carModel = mIOModuleConfig->carModelConfig.carModel;
+    if (level > static_cast<int>(carModel.lodPartsMaps.size())) {
+        LOG(ERROR) << "Car model level of detail " << level << " was not read.";
+        return;
+    }
+    LOG(INFO) << "Car model level of detail changed to " << level;
+
+    // The core lib only takes the car model with the rest of the static data,
+    // which leaves it at the configured resolution with no overlays or
+    // animations, so those are set again.
+    ATRACE_BEGIN("SV core lib method: SetStaticData");
+    const SurroundViewStaticDataParams params(
+            mCameraParams, mIOModuleConfig->sv2dConfig.sv2dParams,
+            mIOModuleConfig->sv3dConfig.sv3dParams,
+            vector<float>(std::begin(kUndistortionScales), std::end(kUndistortionScales)),
+            mIOModuleConfig->sv2dConfig.carBoundingBox, carModel.texturesMap,
+            level == 0 ? carModel.partsMap : carModel.lodPartsMaps[level - 1]);
+    mSurroundView->SetStaticData(params);
+    mSurroundView->Update3dOutputResolution(Size2dInteger(mRenderWidth, mRenderHeight));
     ATRACE_END();
 
+    if (mAnimationModule != nullptr) {
+        const vector<AnimationParam> animationParams =
+                mAnimationModule->getCurrentAnimationParams();
+        if (!animationParams.empty()) {
+            mSurroundView->SetAnimations(animationParams);
+        }
+    }
+
+    scoped_lock<mutex> lock(mAccessLock);
+    mOverlayIsUpdated = true;
+}
+
+// Scales the rendered RGBA image up to the output with the nearest rendered
+// pixel. An output row that comes from the same rendered row as the one before
+// is copied from it.
+static void UpscaleNearest(const uint32_t* src, int srcWidth, int srcHeight,
+                           const vector<int>& columns, uint32_t* dst, int dstHeight,
+                           int dstStride) {
+    const int dstWidth = columns.size();
+    int lastSrcRow = -1;
+    uint32_t* lastDstRow = nullptr;
+    for (int y = 0; y < dstHeight; y++) {
+        uint32_t* dstRow = dst + static_cast<size_t>(y) * dstStride;
+        const int srcRow = y * srcHeight / dstHeight;
+        if (srcRow == lastSrcRow) {
+            memcpy(dstRow, lastDstRow, dstWidth * sizeof(uint32_t));
+        } else {
+            const uint32_t* srcPixels = src + static_cast<size_t>(srcRow) * srcWidth;
+            for (int x = 0; x < dstWidth; x++) {
+                dstRow[x] = srcPixels[columns[x]];
+            }
+        }
+        lastSrcRow = srcRow;
+        lastDstRow = dstRow;
+    }
+}
+
+bool SurroundView3dSession::renderView(const InputSet& inputSet, const View3d& view,
+                                       const sp<GraphicBuffer>& texture) {
+    const RotationQuat quat = view.pose.rotation;
+    const Translation trans = view.pose.translation;
+    const std::array<float, 4> viewQuaternion = {quat.x, quat.y, quat.z, quat.w};
+    const std::array<float, 3> viewTranslation = {trans.x, trans.y, trans.z};
+
+    const int64_t lockStartNs = elapsedRealtimeNano();
     ATRACE_BEGIN("Lock output texture (gpu to cpu)");
     void* textureDataPtr = nullptr;
-    mSvTexture->lock(GRALLOC_USAGE_SW_WRITE_OFTEN
-                    | GRALLOC_USAGE_SW_READ_NEVER,
-                    &textureDataPtr);
+    texture->lock(GRALLOC_USAGE_SW_WRITE_OFTEN
+                  | GRALLOC_USAGE_SW_READ_NEVER,
+                  &textureDataPtr);
     ATRACE_END();
+    const int64_t lockNs = elapsedRealtimeNano() - lockStartNs;
 
     if (!textureDataPtr) {
         LOG(ERROR) << "Failed to gain write access to GraphicBuffer!";
         return false;
     }
 
-    ATRACE_BEGIN("Copy output result");
-    // Note: there is a chance that the stride of the texture is not the
-    // same as the width. For example, when the input frame is 1920 * 1080,
-    // the width is 1080, but the stride is 2048. So we'd better copy the
-    // data line by line, instead of single memcpy.
-    uint8_t* writePtr = static_cast<uint8_t*>(textureDataPtr);
-    uint8_t* readPtr = static_cast<uint8_t*>(mOutputPointer.cpu_data_pointer);
-    const int readStride = mOutputWidth * kOutputNumChannels;
-    const int writeStride = mSvTexture->getStride() * kOutputNumChannels;
-    if (readStride == writeStride) {
-        memcpy(writePtr, readPtr, readStride * mSvTexture->getHeight());
+    // Render into the locked texture when its rows are packed, as the core
+    // lib writes them back to back. Otherwise render into mOutputPointer and
+    // copy the rows over, or upscale them at a lower render resolution.
+    const bool upscale = mRenderWidth != mOutputWidth || mRenderHeight != mOutputHeight;
+    const bool renderInPlace = !upscale && static_cast<int>(texture->getStride()) == mOutputWidth;
+    SurroundViewResultPointer textureOutputPointer(nullptr,
+                                                   textureDataPtr,
+                                                   Format::RGBA,
+                                                   mOutputWidth,
+                                                   mOutputHeight);
+    SurroundViewResultPointer* outputPointer =
+            renderInPlace ? &textureOutputPointer : &mOutputPointer;
+
+    ATRACE_BEGIN("SV core lib method: Get3dSurroundView");
+    const int64_t stitchStartNs = elapsedRealtimeNano();
+    if (mSurroundView->Get3dSurroundView(
+            inputSet.pointers, viewQuaternion, viewTranslation, outputPointer)) {
+        LOG(INFO) << "Get3dSurroundView succeeded";
     } else {
-        for (int i=0; i<mSvTexture->getHeight(); i++) {
+        LOG(ERROR) << "Get3dSurroundView failed. "
+                   << "Using memset to initialize to gray.";
+        memset(outputPointer->cpu_data_pointer, kGrayColor,
+               outputPointer->height * outputPointer->width * kOutputNumChannels);
+    }
+    const int64_t copyStartNs = elapsedRealtimeNano();
+    mStats.recordLatency(SurroundViewStats::STITCH, (copyStartNs - stitchStartNs) / 1000);
+    ATRACE_END();
+
+    if (upscale) {
+        ATRACE_BEGIN("Upscale output result");
+        UpscaleNearest(static_cast<const uint32_t*>(mOutputPointer.cpu_data_pointer),
+                       mRenderWidth, mRenderHeight, mUpscaleColumns,
+                       static_cast<uint32_t*>(textureDataPtr), mOutputHeight,
+                       texture->getStride());
+        ATRACE_END();
+    } else if (!renderInPlace) {
+        ATRACE_BEGIN("Copy output result");
+        // Note: there is a chance that the stride of the texture is not the
+        // same as the width. For example, when the input frame is 1920 * 1080,
+        // the width is 1080, but the stride is 2048. So we copy the data line
+        // by line.
+        uint8_t* writePtr = static_cast<uint8_t*>(textureDataPtr);
+        uint8_t* readPtr = static_cast<uint8_t*>(mOutputPointer.cpu_data_pointer);
+        const int readStride = mOutputWidth * kOutputNumChannels;
+        const int writeStride = texture->getStride() * kOutputNumChannels;
+        for (int i=0; i<texture->getHeight(); i++) {
             memcpy(writePtr, readPtr, readStride);
             writePtr = writePtr + writeStride;
             readPtr = readPtr + readStride;
         }
+        LOG(INFO) << "memcpy finished!";
+        ATRACE_END();
     }
-    LOG(INFO) << "memcpy finished!";
-    ATRACE_END();
 
     ATRACE_BEGIN("Unlock output texture (cpu to gpu)");
-    mSvTexture->unlock();
-    ATRACE_END();
-
-    ANativeWindowBuffer* buffer = mSvTexture->getNativeBuffer();
-    LOG(DEBUG) << "ANativeWindowBuffer->handle: " << buffer->handle;
-
-    {
-        scoped_lock<mutex> lock(mAccessLock);
-
-        mFramesRecord.frames.svBuffers.resize(1);
-        SvBuffer& svBuffer = mFramesRecord.frames.svBuffers[0];
-        svBuffer.viewId = 0;
-        svBuffer.hardwareBuffer.nativeHandle = buffer->handle;
-        AHardwareBuffer_Desc* pDesc =
-            reinterpret_cast<AHardwareBuffer_Desc *>(
-                &svBuffer.hardwareBuffer.description);
-        pDesc->width = mOutputWidth;
-        pDesc->height = mOutputHeight;
-        pDesc->layers = 1;
-        pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
-        pDesc->stride = mSvTexture->getStride();
-        pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
-        mFramesRecord.frames.timestampNs = elapsedRealtimeNano();
-        mFramesRecord.frames.sequenceId = sequenceId;
-
-        mFramesRecord.inUse = true;
-        mStream->receiveFrames(mFramesRecord.frames);
-    }
-
+    texture->unlock();
     ATRACE_END();
+    mStats.recordLatency(SurroundViewStats::OUTPUT_COPY,
+                         (lockNs + elapsedRealtimeNano() - copyStartNs) / 1000);
 
     return true;
 }
@@ -843,17 +1220,26 @@ bool SurroundView3dSession::initialize() {
     mSurroundView->SetStaticData(params);
     ATRACE_END();
 
+    // The projection to the 3d surface only depends on the static data.
+    {
+        scoped_lock<mutex> projectionLock(mProjectionLock);
+        mProjectionCache.reset(kNumFrames);
+    }
+
     ATRACE_BEGIN("Allocate cpu buffers");
-    mInputPointers.resize(kNumFrames);
-    for (int i = 0; i < kNumFrames; i++) {
-        mInputPointers[i].width = mCameraParams[i].size.width;
-        mInputPointers[i].height = mCameraParams[i].size.height;
-        mInputPointers[i].format = Format::RGBA;
-        mInputPointers[i].cpu_data_pointer =
-                static_cast<void*>(new uint8_t[mInputPointers[i].width * mInputPointers[i].height *
-                                               kInputNumChannels]);
+    mInputSets.resize(kNumInputSets);
+    for (auto& inputSet : mInputSets) {
+        vector<SurroundViewInputBufferPointers>& pointers = inputSet.pointers;
+        pointers.resize(kNumFrames);
+        for (int i = 0; i < kNumFrames; i++) {
+            pointers[i].width = mCameraParams[i].size.width;
+            pointers[i].height = mCameraParams[i].size.height;
+            pointers[i].format = Format::RGBA;
+            pointers[i].cpu_data_pointer = static_cast<void*>(
+                    new uint8_t[pointers[i].width * pointers[i].height * kInputNumChannels]);
+        }
     }
-    LOG(INFO) << "Allocated " << kNumFrames << " input pointers";
+    LOG(INFO) << "Allocated " << kNumInputSets << " sets of " << kNumFrames << " input pointers";
 
     mOutputWidth = mIOModuleConfig->sv3dConfig.sv3dParams.resolution.width;
     mOutputHeight = mIOModuleConfig->sv3dConfig.sv3dParams.resolution.height;
@@ -862,6 +1248,10 @@ bool SurroundView3dSession::initialize() {
     mConfig.height = mOutputHeight;
     mConfig.carDetails = SvQuality::HIGH;
 
+    // The core lib starts at the output resolution.
+    mRenderWidth = mOutputWidth;
+    mRenderHeight = mOutputHeight;
+
     mOutputPointer.height = mOutputHeight;
     mOutputPointer.width = mOutputWidth;
     mOutputPointer.format = Format::RGBA;
@@ -874,22 +1264,27 @@ bool SurroundView3dSession::initialize() {
     }
     ATRACE_END();
 
-    ATRACE_BEGIN("Allocate output texture");
-    mSvTexture = new GraphicBuffer(mOutputWidth,
-                                   mOutputHeight,
-                                   HAL_PIXEL_FORMAT_RGBA_8888,
-                                   1,
-                                   GRALLOC_USAGE_HW_TEXTURE,
-                                   "SvTexture");
-
-    if (mSvTexture->initCheck() == OK) {
-        LOG(INFO) << "Successfully allocated Graphic Buffer";
-    } else {
-        LOG(ERROR) << "Failed to allocate Graphic Buffer";
-        return false;
+    ATRACE_BEGIN("Allocate output textures");
+    mFramesRecords.resize(std::max(1, mIOModuleConfig->sv3dConfig.numOutputBuffers));
+    for (int i = 0; i < static_cast<int>(mFramesRecords.size()); i++) {
+        // Until the views are set, each record is prepared for one.
+        if (!prepareTextures(i, 1)) {
+            return false;
+        }
     }
+    LOG(INFO) << "Allocated " << mFramesRecords.size() << " output textures";
     ATRACE_END();
 
+    if (mQualityController.isEnabled()) {
+        // The render quality drops ahead of the GPU throttling.
+        mThermalMonitor = new ThermalMonitor([this](thermal::V2_0::ThrottlingSeverity severity) {
+            mQualityController.setThermalSeverity(static_cast<int>(severity));
+        });
+        if (!mThermalMonitor->start()) {
+            mThermalMonitor = nullptr;
+        }
+    }
+
     mIsInitialized = true;
 
     ATRACE_END();
@@ -897,6 +1292,42 @@ bool SurroundView3dSession::initialize() {
     return true;
 }
 
+int SurroundView3dSession::findFreeFramesRecord() {
+    for (int i = 0; i < static_cast<int>(mFramesRecords.size()); i++) {
+        if (!mFramesRecords[i].inUse) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool SurroundView3dSession::prepareTextures(int recordIndex, int numViews) {
+    vector<sp<GraphicBuffer>>& textures = mFramesRecords[recordIndex].textures;
+    textures.resize(numViews);
+    for (auto& texture : textures) {
+        if (texture != nullptr
+            && static_cast<int>(texture->getWidth()) == mOutputWidth
+            && static_cast<int>(texture->getHeight()) == mOutputHeight) {
+            continue;
+        }
+
+        texture = new GraphicBuffer(mOutputWidth,
+                                    mOutputHeight,
+                                    HAL_PIXEL_FORMAT_RGBA_8888,
+                                    1,
+                                    GRALLOC_USAGE_HW_TEXTURE,
+                                    "SvTexture");
+        if (texture->initCheck() != OK) {
+            LOG(ERROR) << "Failed to allocate Graphic Buffer for output " << recordIndex;
+            texture = nullptr;
+            return false;
+        }
+
+        LOG(INFO) << "Successfully allocated Graphic Buffer for output " << recordIndex;
+    }
+    return true;
+}
+
 bool SurroundView3dSession::setupEvs() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
@@ -27,9 +27,19 @@
 #include <hidl/Status.h>
 
 #include "AnimationModule.h"
+#include "CarModelLodSelector.h"
+#include "FrameRateScheduler.h"
+#include "ProjectionCache.h"
+#include "QualityController.h"
+#include "SurroundViewStats.h"
+#include "ThermalMonitor.h"
 #include "VhalHandler.h"
 
+#include <deque>
+#include <map>
+#include <string>
 #include <thread>
+#include <utility>
 
 #include <ui/GraphicBuffer.h>
 
@@ -74,6 +84,10 @@ class SurroundView3dSession : public ISurroundView3dSession {
         Return<void> deliverFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffer) override;
         Return<void> notify(const EvsEventDesc& event) override;
 
+        // Picks the frame rate of the session, and returns true if the set
+        // of frames is due at that rate.
+        bool isFrameSetDue(const hidl_vec<BufferDesc_1_1>& buffers);
+
         // Values initialized as startup
         sp<IEvsCamera> mCamera;
 
@@ -105,20 +119,46 @@ public:
         const hidl_string& cameraId,
         projectCameraPointsTo3dSurface_cb _hidl_cb);
 
+    // Frame counters and stage latencies of the current, or last, stream.
+    const SurroundViewStats& getStats() const { return mStats; }
+
+    // The quality the views are rendered at, in text.
+    std::string getQualityInfo(const char* indent = "") const {
+        return mQualityController.toString(indent) + mFrameRateScheduler.toString(indent) +
+                mCarModelLodSelector.toString(indent);
+    }
+
 private:
+    // Stitch stage: turns each set of input frames into an output record.
     void processFrames();
 
+    // Delivery stage: hands the stitched output records to the client, in
+    // order, while the next set of frames is stitched.
+    void deliverFrames();
+
     // Set up and open the Evs camera(s), triggered when session is created.
     bool setupEvs();
 
     // Start Evs camera video stream, triggered when SV stream is started.
     bool startEvs();
 
-    bool handleFrames(int sequenceId);
+    bool handleFrames(int inputSetIndex);
 
     bool copyFromBufferToPointers(BufferDesc_1_1 buffer,
                                   SurroundViewInputBufferPointers pointers);
 
+    // Returns the GraphicBuffer that wraps the Evs buffer, importing the
+    // buffer the first time it is seen.
+    sp<GraphicBuffer> getInputBuffer(const BufferDesc_1_1& buffer);
+
+    // Returns the index of an output record that the client is done with, or
+    // -1 if the client holds all of them.
+    int findFreeFramesRecord();
+
+    // Allocates a texture per view for the output record, keeping those that
+    // already have the output size.
+    bool prepareTextures(int recordIndex, int numViews);
+
     enum StreamStateValues {
         STOPPED,
         RUNNING,
@@ -145,16 +185,48 @@ private:
 
     // Used to signal a set of frames is ready
     condition_variable mFramesSignal GUARDED_BY(mAccessLock);
-    bool mProcessingEvsFrames GUARDED_BY(mAccessLock);
+
+    // Sets of input frames. The Evs callback fills a free set while the
+    // process thread stitches the one before, so a set belongs to one stage
+    // at a time and only changes hands under mAccessLock.
+    struct InputSet {
+        std::vector<SurroundViewInputBufferPointers> pointers;
+        int sequenceId = 0;
+        // Camera timestamp of the oldest frame of the set, in microseconds.
+        int64_t timestampUs = 0;
+    };
+    std::vector<InputSet> mInputSets;
+    std::deque<int> mFreeInputSets GUARDED_BY(mAccessLock);
+    std::deque<int> mReadyInputSets GUARDED_BY(mAccessLock);
+
+    // Renders the view of the input frames into the texture.
+    bool renderView(const InputSet& inputSet, const View3d& view,
+                    const sp<GraphicBuffer>& texture);
 
     int mSequenceId;
 
     struct FramesRecord {
         SvFramesDesc frames;
+        // Textures the frames are delivered in, one per view.
+        std::vector<sp<GraphicBuffer>> textures;
+        // Camera timestamp of the input frames, in microseconds.
+        int64_t cameraTimestampUs = 0;
         bool inUse = false;
     };
 
-    FramesRecord mFramesRecord GUARDED_BY(mAccessLock);
+    // Output frames, each with textures of its own, so that the next frame is
+    // stitched while the client still renders the earlier ones.
+    std::vector<FramesRecord> mFramesRecords GUARDED_BY(mAccessLock);
+
+    // Output records stitched but not handed to the client yet.
+    std::deque<int> mDeliveryQueue GUARDED_BY(mAccessLock);
+    condition_variable mDeliverySignal GUARDED_BY(mAccessLock);
+    bool mDeliveryStopping GUARDED_BY(mAccessLock) = false;
+    std::thread mDeliveryThread;
+
+    // Picks the level of detail of the car model for the views, and hands its
+    // parts to the core lib when it changed. Only used by the process thread.
+    void updateCarModelLod(const std::vector<View3d>& views);
 
     // Synchronization necessary to deconflict mCaptureThread from the main service thread
     std::mutex mAccessLock;
@@ -167,12 +239,22 @@ private:
 
     std::unique_ptr<SurroundView> mSurroundView GUARDED_BY(mAccessLock);
 
-    std::vector<SurroundViewInputBufferPointers>
-        mInputPointers GUARDED_BY(mAccessLock);
     SurroundViewResultPointer mOutputPointer GUARDED_BY(mAccessLock);
+
+    // The Evs buffers imported so far, keyed by camera id and buffer id. Evs
+    // cycles through a few buffers per camera, so they are only imported once
+    // per stream instead of once per frame.
+    std::map<std::pair<std::string, uint32_t>, sp<GraphicBuffer>>
+        mInputBuffers GUARDED_BY(mAccessLock);
     int mOutputWidth, mOutputHeight GUARDED_BY(mAccessLock);
 
-    sp<GraphicBuffer> mSvTexture GUARDED_BY(mAccessLock);
+    // Resolution the core lib renders the views at, which is lower than the
+    // output resolution while the quality controller asks for it. Only used
+    // by the process thread.
+    int mRenderWidth = 0;
+    int mRenderHeight = 0;
+    // Rendered column of each output column, while upscaling.
+    std::vector<int> mUpscaleColumns;
 
     bool mIsInitialized GUARDED_BY(mAccessLock) = false;
 
@@ -184,6 +266,25 @@ private:
     bool mOverlayIsUpdated GUARDED_BY(mAccessLock) = false;
 
     std::vector<VehiclePropValue> mPropertyValues;
+    // Sequence of the last vhal property change read.
+    uint64_t mPropertySequence = 0;
+
+    // Guards the projection of camera points, which is separate from
+    // mAccessLock so that it does not wait on the frames being rendered.
+    std::mutex mProjectionLock;
+    ProjectionCache<Point3dFloat> mProjectionCache GUARDED_BY(mProjectionLock);
+
+    SurroundViewStats mStats;
+
+    QualityController mQualityController;
+    sp<ThermalMonitor> mThermalMonitor;
+
+    FrameRateScheduler mFrameRateScheduler;
+    // Set when the views or the overlays change, until the frame rate is
+    // picked again.
+    std::atomic<bool> mSceneChanged = false;
+
+    CarModelLodSelector mCarModelLodSelector;
 };
 
 }  // namespace implementation
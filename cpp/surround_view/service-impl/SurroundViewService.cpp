@@ -14,10 +14,15 @@
  * limitations under the License.
  */
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <gpupolicy/GpuPolicy.h>
+#include <threadpolicy/ThreadPolicy.h>
 
 #include "SurroundViewService.h"
 
+#include <future>
+
 using namespace android_auto::surround_view;
 
 namespace android {
@@ -93,15 +98,31 @@ std::vector<uint64_t> getAnimationPropertiesToRead(const AnimationConfig& animat
 }
 
 bool SurroundViewService::initialize() {
+    // Connecting to the EVS manager and to the VHal does not depend on the
+    // config, so it is done while the I/O module reads the config and the car
+    // model.
     // Get the EVS manager service
     LOG(INFO) << "Acquiring EVS Enumerator";
-    mEvs = IEvsEnumerator::getService("default");
+    std::future<sp<IEvsEnumerator>> evs =
+            std::async(std::launch::async, [] { return IEvsEnumerator::getService("default"); });
+
+    // Initialize the VHal Handler with update method and rate. Subscribing
+    // saves a get call per property per update, the handler polls if the VHal
+    // rejects the subscription.
+    // TODO(b/157498592): The update rate should align with the EVS camera
+    // update rate.
+    std::future<bool> vhalInitialized = std::async(std::launch::async, [this] {
+        return mVhalHandler->initialize(VhalHandler::SUBSCRIBE, kVhalUpdateRate);
+    });
+
+    IOStatus status = mIOModule->initialize();
+
+    mEvs = evs.get();
     if (mEvs == nullptr) {
         LOG(ERROR) << "getService returned NULL.  Exiting.";
         return false;
     }
 
-    IOStatus status = mIOModule->initialize();
     if (status != IOStatus::OK) {
         LOG(ERROR) << "IO Module cannot be initialized properly";
         return false;
@@ -112,6 +133,11 @@ bool SurroundViewService::initialize() {
         return false;
     }
 
+    // The config is kept in mConfig from now on. The I/O module holds a copy of
+    // the car model vertices, which is released here.
+    delete mIOModule;
+    mIOModule = nullptr;
+
     // Since we only keep one instance of the SurroundViewService and initialize
     // method is always called after the constructor, it is safe to put the
     // allocation here and the de-allocation in service's constructor.
@@ -120,10 +146,7 @@ bool SurroundViewService::initialize() {
             mConfig.carModelConfig.carModel.texturesMap,
             mConfig.carModelConfig.animationConfig.animations);
 
-    // Initialize the VHal Handler with update method and rate.
-    // TODO(b/157498592): The update rate should align with the EVS camera
-    // update rate.
-    if (mVhalHandler->initialize(VhalHandler::GET, kVhalUpdateRate)) {
+    if (vhalInitialized.get()) {
         // Initialize the vhal handler properties to read.
         std::vector<uint64_t> propertiesToRead;
 
@@ -135,6 +158,14 @@ bool SurroundViewService::initialize() {
                     animationPropertiesToRead.end());
         }
 
+        // Add the speed and gear if the sessions pace the cameras by them.
+        if (mConfig.cameraConfig.frameRatePolicy.stationaryFps > 0) {
+            const std::vector<uint64_t> drivingStateProperties =
+                    VhalHandler::getDrivingStateProperties();
+            propertiesToRead.insert(propertiesToRead.end(), drivingStateProperties.begin(),
+                    drivingStateProperties.end());
+        }
+
         // Call vhal handler setPropertiesToRead with all properties.
         if (!mVhalHandler->setPropertiesToRead(propertiesToRead)) {
             LOG(WARNING) << "VhalHandler setPropertiesToRead failed.";
@@ -161,7 +192,7 @@ Return<void> SurroundViewService::start2dSession(start2dSession_cb _hidl_cb) {
         LOG(WARNING) << "Only one 2d session is supported at the same time";
         _hidl_cb(nullptr, SvResult::INTERNAL_ERROR);
     } else {
-        sSurroundView2dSession = new SurroundView2dSession(mEvs, &mConfig);
+        sSurroundView2dSession = new SurroundView2dSession(mEvs, &mConfig, mVhalHandler);
         if (sSurroundView2dSession->initialize()) {
             _hidl_cb(sSurroundView2dSession, SvResult::OK);
         } else {
@@ -220,6 +251,36 @@ Return<SvResult> SurroundViewService::stop3dSession(
     }
 }
 
+Return<void> SurroundViewService::debug(const hidl_handle& fd,
+                                        const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        LOG(ERROR) << "Given file descriptor is not valid.";
+        return {};
+    }
+
+    std::string buffer;
+    {
+        std::scoped_lock<std::mutex> lock(sLock);
+        buffer += "2d session:\n";
+        buffer += sSurroundView2dSession != nullptr
+                ? sSurroundView2dSession->getStats().toString("  ") +
+                  sSurroundView2dSession->getFrameRateInfo("  ")
+                : "  Not running\n";
+        buffer += "3d session:\n";
+        buffer += sSurroundView3dSession != nullptr
+                ? sSurroundView3dSession->getStats().toString("  ") +
+                  sSurroundView3dSession->getQualityInfo("  ")
+                : "  Not running\n";
+    }
+    buffer += android::automotive::evs::threadpolicy::dumpThreadPolicies();
+    buffer += android::automotive::evs::gpupolicy::dumpGpuPolicies();
+
+    if (!android::base::WriteStringToFd(buffer, fd->data[0])) {
+        LOG(ERROR) << "Failed to write the debug dump.";
+    }
+    return {};
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace sv
@@ -36,6 +36,7 @@
 using namespace ::android::hardware::automotive::evs::V1_1;
 using namespace ::android::hardware::automotive::sv::V1_0;
 using ::android::hardware::Return;
+using ::android::hardware::hidl_handle;
 using ::android::sp;
 
 namespace android {
@@ -57,6 +58,9 @@ public:
     Return<SvResult> stop3dSession(
         const sp<ISurroundView3dSession>& sv3dSession) override;
 
+    // Dumps the frame statistics of the running sessions.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
     static sp<SurroundViewService> getInstance();
 private:
     SurroundViewService();
@@ -0,0 +1,324 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks the 2d and 3d sessions fed by the mock EVS cameras. Run on a
+// device with:
+//   atest sv_session_benchmark
+// or, for machine-readable results to compare between builds:
+//   sv_session_benchmark --benchmark_format=json --benchmark_out=<file>
+//
+// Each iteration streams for kStreamSeconds. Counters:
+//   fps                     frames delivered per second
+//   skipped, dropped        sets of frames skipped for lack of a free input
+//                           set, and outputs dropped as the client held all
+//   unsynced                sets of frames dropped as their cameras were
+//                           further apart than the configured skew
+//   <stage>_p50/p99_us      stage latencies of the session, and the skew of
+//                           the camera timestamps, as the upper bounds of
+//                           their histogram buckets
+//   cpu_percent             CPU time of the process over the wall time
+//   max_rss_mb              peak resident memory of the process
+
+#define LOG_TAG "SurroundViewSessionBenchmark"
+
+#include "mock-evs/MockEvsEnumerator.h"
+#include "mock-evs/MockSurroundViewCallback.h"
+
+#include "AnimationModule.h"
+#include "IOModule.h"
+#include "SurroundView2dSession.h"
+#include "SurroundView3dSession.h"
+#include "SurroundViewStats.h"
+#include "VhalHandler.h"
+
+#include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+using ::android::hardware::automotive::vehicle::V2_0::IVehicle;
+using ::android::hardware::automotive::vehicle::V2_0::VehiclePropValue;
+
+const char* kSvConfigFilename = "vendor/etc/automotive/sv/sv_sample_config.xml";
+
+const int kStreamSeconds = 10;
+
+struct Usage {
+    std::chrono::steady_clock::time_point wallTime;
+    int64_t cpuTimeUs;
+};
+
+Usage getUsage() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return {std::chrono::steady_clock::now(),
+            (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL +
+                    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec};
+}
+
+void setCounters(benchmark::State& state, const SurroundViewStats& stats, const Usage& start) {
+    static const struct {
+        SurroundViewStats::Stage stage;
+        const char* name;
+    } kStages[] = {
+        {SurroundViewStats::INPUT_COPY, "input_copy"},
+        {SurroundViewStats::STITCH, "stitch"},
+        {SurroundViewStats::OUTPUT_COPY, "output_copy"},
+        {SurroundViewStats::DELIVERY, "delivery"},
+        {SurroundViewStats::END_TO_END, "end_to_end"},
+        {SurroundViewStats::FRAME_SKEW, "frame_skew"},
+    };
+
+    const Usage end = getUsage();
+    const double wallTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            end.wallTime - start.wallTime).count();
+
+    state.counters["fps"] = stats.framesDelivered() * 1e6 / wallTimeUs;
+    state.counters["skipped"] = stats.framesSkipped();
+    state.counters["unsynced"] = stats.framesUnsynced();
+    state.counters["dropped"] = stats.framesDropped();
+    for (const auto& stage : kStages) {
+        state.counters[std::string(stage.name) + "_p50_us"] =
+                stats.latencyPercentileUs(stage.stage, 50);
+        state.counters[std::string(stage.name) + "_p99_us"] =
+                stats.latencyPercentileUs(stage.stage, 99);
+    }
+    state.counters["cpu_percent"] = (end.cpuTimeUs - start.cpuTimeUs) * 100.0 / wallTimeUs;
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    state.counters["max_rss_mb"] = usage.ru_maxrss / 1024.0;
+}
+
+// Returns the vhal properties the car model animates on.
+std::vector<uint64_t> getAnimationProperties(const AnimationConfig& animationConfig) {
+    std::set<uint64_t> properties;
+    for (const auto& animation : animationConfig.animations) {
+        for (const auto& opPair : animation.gammaOpsMap) {
+            properties.insert(opPair.first);
+        }
+        for (const auto& opPair : animation.textureOpsMap) {
+            properties.insert(opPair.first);
+        }
+        for (const auto& opPair : animation.rotationOpsMap) {
+            properties.insert(opPair.first);
+        }
+        for (const auto& opPair : animation.translationOpsMap) {
+            properties.insert(opPair.first);
+        }
+    }
+    return std::vector<uint64_t>(properties.begin(), properties.end());
+}
+
+// Sets the vhal properties, sweeping them over their range at the given rate,
+// until stopped.
+class PropertyChurn {
+public:
+    PropertyChurn(const std::vector<uint64_t>& properties, int rateHz) :
+          mRateHz(rateHz), mProperties(properties) {}
+
+    void start() {
+        if (mRateHz <= 0 || mProperties.empty()) {
+            return;
+        }
+
+        mVehicle = IVehicle::getService();
+        if (mVehicle == nullptr) {
+            LOG(WARNING) << "Vhal is not available, the car model stays still";
+            return;
+        }
+
+        mStopping = false;
+        mThread = std::thread([this]() { run(); });
+    }
+
+    void stop() {
+        mStopping = true;
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+    }
+
+private:
+    void run() {
+        const auto interval = std::chrono::microseconds(1000000 / mRateHz);
+        auto nextTime = std::chrono::steady_clock::now();
+        int32_t step = 0;
+        while (!mStopping) {
+            // Goes from closed to open in 16 steps and back.
+            const int32_t phase = step % 32 < 16 ? step % 16 : 16 - step % 16;
+            for (const uint64_t property : mProperties) {
+                VehiclePropValue propValue;
+                propValue.prop = static_cast<int32_t>(property >> 32);
+                propValue.areaId = static_cast<int32_t>(property & 0xFFFFFFFF);
+                propValue.value.int32Values = {static_cast<int32_t>(INT32_MAX / 16 * phase)};
+                mVehicle->set(propValue);
+            }
+            step++;
+
+            nextTime += interval;
+            std::this_thread::sleep_until(nextTime);
+        }
+    }
+
+    const int mRateHz;
+    std::vector<uint64_t> mProperties;
+    sp<IVehicle> mVehicle;
+    std::atomic<bool> mStopping = false;
+    std::thread mThread;
+};
+
+IOModuleConfig readConfig() {
+    IOModuleConfig config;
+    IOModule ioModule(kSvConfigFilename);
+    if (ioModule.initialize() != IOStatus::OK) {
+        LOG(ERROR) << "Failed to read " << kSvConfigFilename;
+    }
+    ioModule.getConfig(&config);
+    return config;
+}
+
+// Args: output width, camera frame interval in ms.
+void BM_2dSession(benchmark::State& state) {
+    IOModuleConfig config = readConfig();
+    sp<IEvsEnumerator> evs = new MockEvsEnumerator(state.range(1));
+    sp<SurroundView2dSession> session = new SurroundView2dSession(evs, &config);
+    if (!session->initialize()) {
+        state.SkipWithError("Failed to initialize the 2d session");
+        return;
+    }
+    session->set2dConfig({static_cast<uint32_t>(state.range(0)), SvQuality::HIGH});
+    sp<MockSurroundViewCallback> callback = new MockSurroundViewCallback(session);
+
+    for (auto _ : state) {
+        const Usage start = getUsage();
+        if (session->startStream(callback) != SvResult::OK) {
+            state.SkipWithError("Failed to start the 2d stream");
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(kStreamSeconds));
+        session->stopStream();
+        setCounters(state, session->getStats(), start);
+    }
+}
+
+BENCHMARK(BM_2dSession)
+        ->ArgNames({"width", "interval_ms"})
+        ->Args({768, 33})
+        ->Args({768, 16})
+        ->Args({384, 33})
+        ->Iterations(1)
+        ->UseRealTime();
+
+// Args: output width, output height, number of views, camera frame interval
+// in ms, vhal property updates per second (0 for no animation).
+void BM_3dSession(benchmark::State& state) {
+    IOModuleConfig config = readConfig();
+    sp<IEvsEnumerator> evs = new MockEvsEnumerator(state.range(3));
+
+    const int propertyRateHz = state.range(4);
+    std::unique_ptr<VhalHandler> vhalHandler;
+    std::unique_ptr<AnimationModule> animationModule;
+    if (propertyRateHz > 0) {
+        vhalHandler = std::make_unique<VhalHandler>();
+        if (!vhalHandler->initialize(VhalHandler::UpdateMethod::GET, propertyRateHz) ||
+            !vhalHandler->setPropertiesToRead(
+                    getAnimationProperties(config.carModelConfig.animationConfig))) {
+            state.SkipWithError("Failed to initialize the vhal handler");
+            return;
+        }
+        animationModule = std::make_unique<AnimationModule>(
+                config.carModelConfig.carModel.partsMap,
+                config.carModelConfig.carModel.texturesMap,
+                config.carModelConfig.animationConfig.animations);
+    }
+
+    sp<SurroundView3dSession> session = new SurroundView3dSession(
+            evs, vhalHandler.get(), animationModule.get(), &config);
+    if (!session->initialize()) {
+        state.SkipWithError("Failed to initialize the 3d session");
+        return;
+    }
+
+    Sv3dConfig sv3dConfig = {static_cast<uint32_t>(state.range(0)),
+                             static_cast<uint32_t>(state.range(1)), SvQuality::HIGH};
+    session->set3dConfig(sv3dConfig);
+    std::vector<View3d> views(state.range(2));
+    for (int i = 0; i < static_cast<int>(views.size()); i++) {
+        // Views spread around the car.
+        const float angle = 2 * M_PI * i / views.size();
+        views[i].viewId = i;
+        views[i].pose.rotation = {.x = 0, .y = 0, .z = sinf(angle / 2), .w = cosf(angle / 2)};
+        views[i].pose.translation = {.x = 0, .y = 0, .z = 0};
+        views[i].horizontalFov = 90;
+    }
+    session->setViews(views);
+    sp<MockSurroundViewCallback> callback = new MockSurroundViewCallback(session);
+    PropertyChurn churn(getAnimationProperties(config.carModelConfig.animationConfig),
+                        propertyRateHz);
+
+    for (auto _ : state) {
+        const Usage start = getUsage();
+        if (session->startStream(callback) != SvResult::OK) {
+            state.SkipWithError("Failed to start the 3d stream");
+            break;
+        }
+        churn.start();
+        std::this_thread::sleep_for(std::chrono::seconds(kStreamSeconds));
+        churn.stop();
+        session->stopStream();
+        setCounters(state, session->getStats(), start);
+    }
+
+    // The session uses the handler and the module until it is gone.
+    session = nullptr;
+}
+
+BENCHMARK(BM_3dSession)
+        ->ArgNames({"width", "height", "views", "interval_ms", "property_hz"})
+        ->Args({1920, 1080, 1, 33, 0})
+        ->Args({1920, 1080, 1, 33, 30})
+        ->Args({1920, 1080, 2, 33, 0})
+        ->Args({1280, 720, 1, 16, 0})
+        ->Iterations(1)
+        ->UseRealTime();
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Frame counters and per-stage latencies of a surround view session. They are
+// recorded on the frame path without locking, and read for the debug dump.
+class SurroundViewStats {
+public:
+    enum Stage {
+        // Copying the camera frames into an input set, or importing them.
+        INPUT_COPY = 0,
+        // The core lib rendering the output.
+        STITCH,
+        // Locking the output texture, copying the output into it and
+        // unlocking it.
+        OUTPUT_COPY,
+        // Handing the output to the client.
+        DELIVERY,
+        // From the camera timestamp of the frames to the output delivery.
+        END_TO_END,
+        // Not a stage: the spread of the camera timestamps within a set of
+        // frames.
+        FRAME_SKEW,
+        NUM_STAGES,
+    };
+
+    // Bucket i, except the last one, counts the latencies shorter than
+    // 250us * 2^i that are not counted by the buckets before it. The last
+    // bucket counts the rest.
+    static constexpr size_t kNumLatencyBuckets = 12;
+    static constexpr int64_t kFirstBucketUs = 250;
+
+    void recordLatency(Stage stage, int64_t latencyUs) {
+        const int64_t units = std::max<int64_t>(latencyUs, 0) / kFirstBucketUs;
+        size_t bucket = units == 0 ? 0 : 64 - __builtin_clzll(units);
+        bucket = std::min(bucket, kNumLatencyBuckets - 1);
+        mLatencies[stage][bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Sets of frames received from the cameras.
+    void frameReceived() { mFramesReceived.fetch_add(1, std::memory_order_relaxed); }
+
+    // Sets of frames skipped because no input set was free.
+    void frameSkipped() { mFramesSkipped.fetch_add(1, std::memory_order_relaxed); }
+
+    // Sets of frames dropped because their cameras were out of sync.
+    void frameUnsynced() { mFramesUnsynced.fetch_add(1, std::memory_order_relaxed); }
+
+    // Sets of frames left out to lower the frame rate under load.
+    void frameThrottled() { mFramesThrottled.fetch_add(1, std::memory_order_relaxed); }
+
+    // Outputs dropped because the client held all of the output records.
+    void frameDropped() { mFramesDropped.fetch_add(1, std::memory_order_relaxed); }
+
+    // Outputs handed to the client.
+    void frameDelivered() { mFramesDelivered.fetch_add(1, std::memory_order_relaxed); }
+
+    // Clears the statistics, as each stream is reported on its own.
+    void reset() {
+        mFramesReceived = 0;
+        mFramesSkipped = 0;
+        mFramesUnsynced = 0;
+        mFramesThrottled = 0;
+        mFramesDropped = 0;
+        mFramesDelivered = 0;
+        for (auto& buckets : mLatencies) {
+            for (auto& bucket : buckets) {
+                bucket = 0;
+            }
+        }
+    }
+
+    uint64_t framesReceived() const { return mFramesReceived.load(std::memory_order_relaxed); }
+    uint64_t framesSkipped() const { return mFramesSkipped.load(std::memory_order_relaxed); }
+    uint64_t framesUnsynced() const { return mFramesUnsynced.load(std::memory_order_relaxed); }
+    uint64_t framesThrottled() const { return mFramesThrottled.load(std::memory_order_relaxed); }
+    uint64_t framesDropped() const { return mFramesDropped.load(std::memory_order_relaxed); }
+    uint64_t framesDelivered() const { return mFramesDelivered.load(std::memory_order_relaxed); }
+
+    // Returns the upper bound of the bucket holding the given percentile of
+    // the latencies of the stage, or 0 if none was recorded. Latencies that
+    // fall in the last bucket are reported as its lower bound.
+    int64_t latencyPercentileUs(Stage stage, int percentile) const {
+        uint64_t total = 0;
+        std::array<uint64_t, kNumLatencyBuckets> buckets;
+        for (size_t i = 0; i < kNumLatencyBuckets; ++i) {
+            buckets[i] = mLatencies[stage][i].load(std::memory_order_relaxed);
+            total += buckets[i];
+        }
+        if (total == 0) {
+            return 0;
+        }
+
+        const uint64_t rank = std::max<uint64_t>(1, (total * percentile + 99) / 100);
+        uint64_t count = 0;
+        for (size_t i = 0; i < kNumLatencyBuckets - 1; ++i) {
+            count += buckets[i];
+            if (count >= rank) {
+                return kFirstBucketUs << i;
+            }
+        }
+        return kFirstBucketUs << (kNumLatencyBuckets - 2);
+    }
+
+    std::string toString(const char* indent = "") const {
+        static const char* const kStageNames[NUM_STAGES] = {
+            "Input Copy", "Stitch", "Output Copy", "Delivery", "End To End", "Frame Skew",
+        };
+
+        std::string buffer;
+        android::base::StringAppendF(&buffer,
+                "%sFrames Received: %" PRIu64 "\n"
+                "%sFrames Skipped : %" PRIu64 "\n"
+                "%sFrames Unsynced: %" PRIu64 "\n"
+                "%sFrames Throttled: %" PRIu64 "\n"
+                "%sFrames Dropped : %" PRIu64 "\n"
+                "%sFrames Delivered: %" PRIu64 "\n",
+                indent, framesReceived(),
+                indent, framesSkipped(),
+                indent, framesUnsynced(),
+                indent, framesThrottled(),
+                indent, framesDropped(),
+                indent, framesDelivered());
+        for (int stage = 0; stage < NUM_STAGES; ++stage) {
+            android::base::StringAppendF(&buffer, "%s%s%s:", indent, kStageNames[stage],
+                                         stage == FRAME_SKEW ? "" : " Latency");
+            for (size_t i = 0; i < kNumLatencyBuckets; ++i) {
+                const uint64_t count = mLatencies[stage][i].load(std::memory_order_relaxed);
+                if (i == kNumLatencyBuckets - 1) {
+                    android::base::StringAppendF(&buffer, " >=%" PRId64 "us: %" PRIu64 "\n",
+                                                 kFirstBucketUs << (i - 1), count);
+                } else {
+                    android::base::StringAppendF(&buffer, " <%" PRId64 "us: %" PRIu64 ",",
+                                                 kFirstBucketUs << i, count);
+                }
+            }
+        }
+
+        return buffer;
+    }
+
+private:
+    std::atomic<uint64_t> mFramesReceived = 0;
+    std::atomic<uint64_t> mFramesSkipped = 0;
+    std::atomic<uint64_t> mFramesUnsynced = 0;
+    std::atomic<uint64_t> mFramesThrottled = 0;
+    std::atomic<uint64_t> mFramesDropped = 0;
+    std::atomic<uint64_t> mFramesDelivered = 0;
+    std::array<std::array<std::atomic<uint64_t>, kNumLatencyBuckets>, NUM_STAGES>
+        mLatencies = {};
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
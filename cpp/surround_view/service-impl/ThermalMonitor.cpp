@@ -0,0 +1,109 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ThermalMonitor.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::thermal::V1_0::ThermalStatus;
+using ::android::hardware::thermal::V1_0::ThermalStatusCode;
+using ::android::hardware::thermal::V2_0::IThermal;
+using ::android::hardware::thermal::V2_0::Temperature;
+using ::android::hardware::thermal::V2_0::TemperatureType;
+using ::android::hardware::thermal::V2_0::ThrottlingSeverity;
+
+bool ThermalMonitor::start() {
+    sp<IThermal> thermal = IThermal::tryGetService();
+    if (thermal == nullptr) {
+        LOG(WARNING) << "No thermal HAL; the render quality only follows the render times.";
+        return false;
+    }
+
+    thermal->getCurrentTemperatures(
+            false, TemperatureType::UNKNOWN,
+            [this](ThermalStatus status, const hidl_vec<Temperature>& temperatures) {
+                if (status.code != ThermalStatusCode::SUCCESS) {
+                    LOG(WARNING) << "Failed to read the temperatures: " << status.debugMessage;
+                    return;
+                }
+                for (const auto& temperature : temperatures) {
+                    update(temperature);
+                }
+            });
+
+    Return<ThermalStatus> result =
+            thermal->registerThermalChangedCallback(this, false, TemperatureType::UNKNOWN);
+    if (!result.isOk() || static_cast<ThermalStatus>(result).code != ThermalStatusCode::SUCCESS) {
+        LOG(WARNING) << "Failed to register for thermal changes.";
+        return false;
+    }
+
+    std::scoped_lock<std::mutex> lock(mLock);
+    mThermal = thermal;
+    return true;
+}
+
+void ThermalMonitor::stop() {
+    sp<IThermal> thermal;
+    {
+        std::scoped_lock<std::mutex> lock(mLock);
+        thermal = mThermal;
+        mThermal = nullptr;
+    }
+    if (thermal != nullptr) {
+        thermal->unregisterThermalChangedCallback(this);
+    }
+}
+
+Return<void> ThermalMonitor::notifyThrottling(const Temperature& temperature) {
+    update(temperature);
+    return {};
+}
+
+void ThermalMonitor::update(const Temperature& temperature) {
+    ThrottlingSeverity severity = ThrottlingSeverity::NONE;
+    {
+        std::scoped_lock<std::mutex> lock(mLock);
+        mSeverities[temperature.name] = temperature.throttlingStatus;
+        for (const auto& [name, sensorSeverity] : mSeverities) {
+            severity = std::max(severity, sensorSeverity);
+        }
+        if (severity == mSeverity) {
+            return;
+        }
+        mSeverity = severity;
+    }
+
+    LOG(INFO) << "Thermal throttling severity is now " << toString(severity);
+    mListener(severity);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SURROUND_VIEW_SERVICE_IMPL_THERMALMONITOR_H_
+#define SURROUND_VIEW_SERVICE_IMPL_THERMALMONITOR_H_
+
+#include <android/hardware/thermal/2.0/IThermal.h>
+#include <android/hardware/thermal/2.0/IThermalChangedCallback.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Follows the thermal throttling severity of the device, as the highest one
+// reported by the thermal HAL for any of its sensors.
+class ThermalMonitor : public thermal::V2_0::IThermalChangedCallback {
+public:
+    // Called with the new severity whenever it changes.
+    using Listener = std::function<void(thermal::V2_0::ThrottlingSeverity)>;
+
+    explicit ThermalMonitor(Listener listener) : mListener(std::move(listener)) {}
+
+    // Reads the current severity and registers for its changes. Returns false
+    // if there is no thermal HAL to ask, in which case the severity is never
+    // reported.
+    bool start();
+    void stop();
+
+    // Implementation for ::android::hardware::thermal::V2_0::IThermalChangedCallback.
+    Return<void> notifyThrottling(const thermal::V2_0::Temperature& temperature) override;
+
+private:
+    void update(const thermal::V2_0::Temperature& temperature);
+
+    const Listener mListener;
+
+    std::mutex mLock;
+    sp<thermal::V2_0::IThermal> mThermal;
+    // The last severity reported for each sensor, by name.
+    std::map<std::string, thermal::V2_0::ThrottlingSeverity> mSeverities;
+    thermal::V2_0::ThrottlingSeverity mSeverity = thermal::V2_0::ThrottlingSeverity::NONE;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // SURROUND_VIEW_SERVICE_IMPL_THERMALMONITOR_H_
@@ -36,9 +36,46 @@ namespace implementation {
 
 using vehicle::V2_0::IVehicle;
 using vehicle::V2_0::StatusCode;
+using vehicle::V2_0::SubscribeFlags;
+using vehicle::V2_0::SubscribeOptions;
+using vehicle::V2_0::VehicleArea;
+using vehicle::V2_0::VehicleProperty;
 using vehicle::V2_0::VehiclePropertyType;
 using vehicle::V2_0::VehiclePropValue;
 
+namespace {
+
+inline uint64_t getPropertyKey(const VehiclePropValue& propValue) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(propValue.prop)) << 32 |
+            static_cast<uint32_t>(propValue.areaId);
+}
+
+inline uint64_t getPropertyKey(VehicleProperty property) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(property)) << 32 |
+            static_cast<uint32_t>(VehicleArea::GLOBAL);
+}
+
+}  // namespace
+
+Return<void> VhalHandler::PropertyEventCallback::onPropertyEvent(
+        const hidl_vec<VehiclePropValue>& propValues) {
+    mVhalHandler->updatePropertyValues(propValues);
+    return {};
+}
+
+Return<void> VhalHandler::PropertyEventCallback::onPropertySet(
+        const VehiclePropValue& /* propValue */) {
+    return {};
+}
+
+Return<void> VhalHandler::PropertyEventCallback::onPropertySetError(StatusCode errorCode,
+                                                                    int32_t propId,
+                                                                    int32_t areaId) {
+    LOG(WARNING) << "Vhal property " << propId << " in area " << areaId
+                 << " failed to be set, with status code: " << static_cast<int32_t>(errorCode);
+    return {};
+}
+
 bool VhalHandler::initialize(UpdateMethod updateMethod, int rate) {
     LOG(DEBUG) << __FUNCTION__;
     std::scoped_lock<std::mutex> lock(mAccessLock);
@@ -60,12 +97,10 @@ bool VhalHandler::initialize(UpdateMethod updateMethod, int rate) {
         return false;
     }
 
+    mUpdateMethod = updateMethod;
     if (mUpdateMethod == UpdateMethod::SUBSCRIBE) {
-        LOG(ERROR) << "Update method Subscribe is not currently implemented.";
-        return false;
+        mPropertyEventCallback = new PropertyEventCallback(this);
     }
-
-    mUpdateMethod = updateMethod;
     mRate = rate;
     mIsInitialized = true;
     mIsUpdateActive = false;
@@ -91,32 +126,7 @@ void VhalHandler::pollProperties() {
             rate = mRate;
         }
 
-        // Make get call for each VHAL property.
-        // Write to back property values, note lock is not needed as only this thread uses it.
-        std::vector<VehiclePropValue> vehiclePropValuesUpdated;
-        for (auto& propertyToRead : propertiesToRead) {
-            StatusCode statusResult;
-            VehiclePropValue propValueResult;
-            mVhalServicePtr->get(propertyToRead,
-                                 [&statusResult,
-                                  &propValueResult](StatusCode status,
-                                                    const VehiclePropValue& propValue) {
-                                     statusResult = status;
-                                     propValueResult = propValue;
-                                 });
-            if (statusResult != StatusCode::OK) {
-                LOG(WARNING) << "Failed to read vhal property: " << propertyToRead.prop
-                             << ", with status code: " << static_cast<int32_t>(statusResult);
-            } else {
-                vehiclePropValuesUpdated.push_back(propValueResult);
-            }
-        }
-
-        // Update property values by swapping with updated property values.
-        {
-            std::scoped_lock<std::mutex> lock(mAccessLock);
-            std::swap(mPropertyValues, vehiclePropValuesUpdated);
-        }
+        updatePropertyValues(readProperties(propertiesToRead));
 
         std::unique_lock<std::mutex> sleepLock(mPollThreadSleepMutex);
         // Sleep to generate frames at kTargetFrameRate.
@@ -134,33 +144,121 @@ void VhalHandler::pollProperties() {
     }
 }
 
-bool VhalHandler::startPropertiesUpdate() {
-    LOG(DEBUG) << __FUNCTION__;
-    std::scoped_lock<std::mutex> lock(mAccessLock);
+std::vector<VehiclePropValue> VhalHandler::readProperties(
+        const std::vector<VehiclePropValue>& propertiesToRead) {
+    std::vector<VehiclePropValue> propValues;
+    for (auto& propertyToRead : propertiesToRead) {
+        StatusCode statusResult;
+        VehiclePropValue propValueResult;
+        mVhalServicePtr->get(propertyToRead,
+                             [&statusResult,
+                              &propValueResult](StatusCode status,
+                                                const VehiclePropValue& propValue) {
+                                 statusResult = status;
+                                 propValueResult = propValue;
+                             });
+        if (statusResult != StatusCode::OK) {
+            LOG(WARNING) << "Failed to read vhal property: " << propertyToRead.prop
+                         << ", with status code: " << static_cast<int32_t>(statusResult);
+        } else {
+            propValues.push_back(propValueResult);
+        }
+    }
+    return propValues;
+}
 
-    // Check Vhal service is initialized.
-    if (!mIsInitialized) {
-        LOG(ERROR) << "VHAL handler not initialized.";
-        return false;
+bool VhalHandler::subscribeProperties(const std::vector<VehiclePropValue>& propertiesToRead) {
+    // Subscriptions are per property, events come for all of its areas.
+    std::set<int32_t> propIds;
+    for (const auto& propertyToRead : propertiesToRead) {
+        propIds.insert(propertyToRead.prop);
+    }
+    if (propIds.empty()) {
+        return true;
     }
 
-    if (mIsUpdateActive) {
-        LOG(ERROR) << "Polling is already started.";
+    std::vector<SubscribeOptions> options;
+    for (const auto& propId : propIds) {
+        options.push_back(SubscribeOptions{
+                .propId = propId,
+                .sampleRate = static_cast<float>(mRate),
+                .flags = SubscribeFlags::EVENTS_FROM_CAR,
+        });
+    }
+    const StatusCode status = mVhalServicePtr->subscribe(mPropertyEventCallback, options);
+    if (status != StatusCode::OK) {
+        LOG(WARNING) << "Failed to subscribe to vhal properties, with status code: "
+                     << static_cast<int32_t>(status);
         return false;
     }
 
-    mIsUpdateActive = true;
+    std::scoped_lock<std::mutex> lock(mAccessLock);
+    mSubscribedPropIds.assign(propIds.begin(), propIds.end());
+    return true;
+}
 
+void VhalHandler::updatePropertyValues(const std::vector<VehiclePropValue>& propValues) {
+    std::scoped_lock<std::mutex> lock(mAccessLock);
+    for (const auto& propValue : propValues) {
+        const uint64_t key = getPropertyKey(propValue);
+        if (mPropertyKeys.find(key) == mPropertyKeys.end()) {
+            continue;
+        }
+
+        // Timestamps change with every read, so only the value counts as a change.
+        auto entry = mPropertyEntries.find(key);
+        if (entry == mPropertyEntries.end()) {
+            mPropertyEntries.emplace(key, PropertyEntry{propValue, ++mSequence});
+        } else if (entry->second.value.status != propValue.status ||
+                   entry->second.value.value != propValue.value) {
+            entry->second = PropertyEntry{propValue, ++mSequence};
+        }
+    }
+}
+
+bool VhalHandler::startPropertiesUpdate() {
+    LOG(DEBUG) << __FUNCTION__;
+    std::vector<VehiclePropValue> propertiesToRead;
     {
-        std::scoped_lock<std::mutex> sleepLock(mPollThreadSleepMutex);
-        mPollStopSleeping = false;
+        std::scoped_lock<std::mutex> lock(mAccessLock);
+
+        // Check Vhal service is initialized.
+        if (!mIsInitialized) {
+            LOG(ERROR) << "VHAL handler not initialized.";
+            return false;
+        }
+
+        // Another user started the updates already.
+        if (mUpdateUsers++ > 0) {
+            return true;
+        }
+
+        mIsUpdateActive = true;
+
+        {
+            std::scoped_lock<std::mutex> sleepLock(mPollThreadSleepMutex);
+            mPollStopSleeping = false;
+        }
+
+        // Start polling thread if updated method is GET.
+        if (mUpdateMethod == UpdateMethod::GET) {
+            mPollingThread = std::thread([this]() { pollProperties(); });
+            return true;
+        }
+
+        propertiesToRead = mPropertiesToRead;
     }
 
-    // Start polling thread if updated method is GET.
-    if (mUpdateMethod == UpdateMethod::GET) {
-        mPollingThread = std::thread([this]() { pollProperties(); });
+    // Reads the values once before subscribing, so that no event is overwritten by an older
+    // value. On-change properties only send events when they change.
+    updatePropertyValues(readProperties(propertiesToRead));
+    if (subscribeProperties(propertiesToRead)) {
+        return true;
     }
 
+    LOG(WARNING) << "Polling the vhal properties instead.";
+    std::scoped_lock<std::mutex> lock(mAccessLock);
+    mPollingThread = std::thread([this]() { pollProperties(); });
     return true;
 }
 
@@ -170,6 +268,17 @@ bool VhalHandler::setPropertiesToRead(const std::vector<VehiclePropValue>& prope
 
     // Replace property ids to read.
     mPropertiesToRead = propertiesToRead;
+    mPropertyKeys.clear();
+    for (const auto& propertyToRead : mPropertiesToRead) {
+        mPropertyKeys.insert(getPropertyKey(propertyToRead));
+    }
+    for (auto entry = mPropertyEntries.begin(); entry != mPropertyEntries.end();) {
+        if (mPropertyKeys.find(entry->first) == mPropertyKeys.end()) {
+            entry = mPropertyEntries.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
 
     return true;
 }
@@ -198,13 +307,61 @@ bool VhalHandler::getPropertyValues(std::vector<VehiclePropValue>* property_valu
     }
 
     // Copy current property values to argument.
-    *property_values = mPropertyValues;
+    property_values->clear();
+    for (const auto& entry : mPropertyEntries) {
+        property_values->push_back(entry.second.value);
+    }
 
     return true;
 }
 
+bool VhalHandler::getChangedPropertyValues(uint64_t* sequence,
+                                           std::vector<VehiclePropValue>* propertyValues) {
+    LOG(DEBUG) << __FUNCTION__;
+    std::scoped_lock<std::mutex> lock(mAccessLock);
+
+    // Check Vhal service is initialized.
+    if (!mIsInitialized) {
+        LOG(ERROR) << "VHAL handler not initialized.";
+        return false;
+    }
+
+    propertyValues->clear();
+    if (*sequence == mSequence) {
+        return true;
+    }
+    for (const auto& entry : mPropertyEntries) {
+        if (entry.second.sequence > *sequence) {
+            propertyValues->push_back(entry.second.value);
+        }
+    }
+    *sequence = mSequence;
+
+    return true;
+}
+
+std::vector<uint64_t> VhalHandler::getDrivingStateProperties() {
+    return {getPropertyKey(VehicleProperty::PERF_VEHICLE_SPEED),
+            getPropertyKey(VehicleProperty::GEAR_SELECTION)};
+}
+
+bool VhalHandler::getDrivingState(DrivingState* drivingState) {
+    std::scoped_lock<std::mutex> lock(mAccessLock);
+    const auto speed = mPropertyEntries.find(getPropertyKey(VehicleProperty::PERF_VEHICLE_SPEED));
+    const auto gear = mPropertyEntries.find(getPropertyKey(VehicleProperty::GEAR_SELECTION));
+    if (speed == mPropertyEntries.end() || speed->second.value.value.floatValues.empty() ||
+        gear == mPropertyEntries.end() || gear->second.value.value.int32Values.empty()) {
+        return false;
+    }
+
+    drivingState->speedMps = speed->second.value.value.floatValues[0];
+    drivingState->gear = gear->second.value.value.int32Values[0];
+    return true;
+}
+
 bool VhalHandler::stopPropertiesUpdate() {
     LOG(DEBUG) << __FUNCTION__;
+    std::vector<int32_t> subscribedPropIds;
     {
         std::scoped_lock<std::mutex> lock(mAccessLock);
 
@@ -219,7 +376,22 @@ bool VhalHandler::stopPropertiesUpdate() {
             return false;
         }
 
+        // Others still use the updates.
+        if (--mUpdateUsers > 0) {
+            return true;
+        }
+
         mIsUpdateActive = false;
+        std::swap(subscribedPropIds, mSubscribedPropIds);
+    }
+
+    // Property events take mAccessLock, so unsubscribe without it.
+    for (const auto& propId : subscribedPropIds) {
+        const StatusCode status = mVhalServicePtr->unsubscribe(mPropertyEventCallback, propId);
+        if (status != StatusCode::OK) {
+            LOG(WARNING) << "Failed to unsubscribe from vhal property: " << propId
+                         << ", with status code: " << static_cast<int32_t>(status);
+        }
     }
 
     // Wake up the polling thread.
@@ -230,7 +402,9 @@ bool VhalHandler::stopPropertiesUpdate() {
     mPollThreadCondition.notify_one();
 
     // Wait for polling thread to exit.
-    mPollingThread.join();
+    if (mPollingThread.joinable()) {
+        mPollingThread.join();
+    }
 
     return true;
 }
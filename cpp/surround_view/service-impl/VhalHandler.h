@@ -17,7 +17,10 @@
 #ifndef SURROUND_VIEW_SERVICE_IMPL_VHALHANDLER_H_
 #define SURROUND_VIEW_SERVICE_IMPL_VHALHANDLER_H_
 
+#include <condition_variable>
+#include <map>
 #include <mutex>
+#include <set>
 #include <thread>
 #include <vector>
 
@@ -43,10 +46,28 @@ public:
 
         // Subscribes to the VHAL properties, to receive values periodically in a callback.
         // Use when VHAL implementation support multiple clients in subscribe calls.
-        // NOTE: Currently not implemented.
+        // Falls back to GET if the VHAL rejects the subscription.
         SUBSCRIBE
     };
 
+    // Speed and gear of the vehicle, for the sessions to pace the cameras by.
+    struct DrivingState {
+        // Speed in m/s, from PERF_VEHICLE_SPEED. Negative while reversing.
+        float speedMps = 0.0f;
+
+        // Selected gear, as a vehicle::V2_0::VehicleGear from GEAR_SELECTION.
+        int32_t gear = 0;
+
+        bool isReversing() const {
+            return speedMps < 0.0f ||
+                    gear == static_cast<int32_t>(vehicle::V2_0::VehicleGear::GEAR_REVERSE);
+        }
+    };
+
+    // Properties getDrivingState() reads, to add to the properties to read, as
+    // (32 bits vhal property id) | (32 bits area id).
+    static std::vector<uint64_t> getDrivingStateProperties();
+
     // Empty vhal handler constructor.
     VhalHandler() : mIsInitialized(false), mUpdateMethod(GET), mRate(0), mIsUpdateActive(false) {}
 
@@ -64,21 +85,64 @@ public:
     // uint64_t = (32 bits vhal property id) | (32 bits area id).
     bool setPropertiesToRead(const std::vector<uint64_t>& propertiesToRead);
 
-    // Starts updating the VHAL properties with the specified rate.
+    // Starts updating the VHAL properties with the specified rate. The updates
+    // are shared: each call must be paired with a stopPropertiesUpdate() call,
+    // and the updates stop with the last one.
     bool startPropertiesUpdate();
 
     // Gets the last updated VHAL property values.
     // property_values is empty if startPropertiesUpdate() has not been called.
     bool getPropertyValues(std::vector<vehicle::V2_0::VehiclePropValue>* property_values);
 
-    // Stops updating the VHAL properties.
+    // Gets the VHAL property values that changed after |sequence|, and sets |sequence| to the
+    // last change. Start with a sequence of 0 to get all values.
+    bool getChangedPropertyValues(uint64_t* sequence,
+                                  std::vector<vehicle::V2_0::VehiclePropValue>* propertyValues);
+
+    // Gets the last driving state. Returns false if either property was not
+    // read, e.g. as they are not among the properties to read.
+    bool getDrivingState(DrivingState* drivingState);
+
+    // Stops updating the VHAL properties, unless others still use them.
     // For Get method, waits for the polling thread to exit.
     bool stopPropertiesUpdate();
 
 private:
+    // Receives the property events of SUBSCRIBE.
+    class PropertyEventCallback : public vehicle::V2_0::IVehicleCallback {
+    public:
+        explicit PropertyEventCallback(VhalHandler* vhalHandler) : mVhalHandler(vhalHandler) {}
+
+        Return<void> onPropertyEvent(
+                const hidl_vec<vehicle::V2_0::VehiclePropValue>& propValues) override;
+        Return<void> onPropertySet(const vehicle::V2_0::VehiclePropValue& propValue) override;
+        Return<void> onPropertySetError(vehicle::V2_0::StatusCode errorCode, int32_t propId,
+                                        int32_t areaId) override;
+
+    private:
+        VhalHandler* mVhalHandler;
+    };
+
+    // Last value of a property, and the sequence number of its last change.
+    struct PropertyEntry {
+        vehicle::V2_0::VehiclePropValue value;
+        uint64_t sequence;
+    };
+
     // Thread function to poll properties.
     void pollProperties();
 
+    // Makes a get call for each property. Properties that fail to be read are left out.
+    std::vector<vehicle::V2_0::VehiclePropValue> readProperties(
+            const std::vector<vehicle::V2_0::VehiclePropValue>& propertiesToRead);
+
+    // Subscribes to the properties for SUBSCRIBE.
+    bool subscribeProperties(const std::vector<vehicle::V2_0::VehiclePropValue>& propertiesToRead);
+
+    // Stores the values of the properties to read, and gives each value that changed a new
+    // sequence number.
+    void updatePropertyValues(const std::vector<vehicle::V2_0::VehiclePropValue>& propValues);
+
     // Pointer to VHAL service.
     sp<vehicle::V2_0::IVehicle> mVhalServicePtr;
 
@@ -90,6 +154,8 @@ private:
     UpdateMethod mUpdateMethod;
     int mRate;
     bool mIsUpdateActive;
+    // Number of startPropertiesUpdate() calls not yet stopped.
+    int mUpdateUsers = 0;
 
     // GET method related data members.
     std::thread mPollingThread;
@@ -97,11 +163,21 @@ private:
     std::condition_variable mPollThreadCondition;
     bool mPollStopSleeping;
 
+    // SUBSCRIBE method related data members.
+    sp<PropertyEventCallback> mPropertyEventCallback;
+    std::vector<int32_t> mSubscribedPropIds;
+
     // List of properties to read.
     std::vector<vehicle::V2_0::VehiclePropValue> mPropertiesToRead;
 
-    // Updated list of property values.
-    std::vector<vehicle::V2_0::VehiclePropValue> mPropertyValues;
+    // Properties to read, as (32 bits vhal property id) | (32 bits area id).
+    std::set<uint64_t> mPropertyKeys;
+
+    // Updated property values, keyed as mPropertyKeys.
+    std::map<uint64_t, PropertyEntry> mPropertyEntries;
+
+    // Sequence number of the last change of a property value.
+    uint64_t mSequence = 0;
 };
 
 }  // namespace implementation
@@ -88,6 +88,17 @@ TEST(VhalhandlerTests, StartAgainSuccess) {
     ASSERT_TRUE(vhalHandler.stopPropertiesUpdate());
 }
 
+TEST(VhalhandlerTests, SharedUpdatesStopWithLastUser) {
+    VhalHandler vhalHandler;
+    ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::GET, 10));
+    SetSamplePropertiesToRead(&vhalHandler);
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+    ASSERT_TRUE(vhalHandler.stopPropertiesUpdate());
+    ASSERT_TRUE(vhalHandler.stopPropertiesUpdate());
+    ASSERT_FALSE(vhalHandler.stopPropertiesUpdate());
+}
+
 TEST(VhalhandlerTests, GetMethodSuccess) {
     VhalHandler vhalHandler;
     ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::GET, 10));
@@ -118,6 +129,57 @@ TEST(VhalhandlerTests, GetMethodInt64Success) {
     EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
 }
 
+TEST(VhalhandlerTests, SubscribeMethodSuccess) {
+    VhalHandler vhalHandler;
+    ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::SUBSCRIBE, 10));
+
+    SetSamplePropertiesToRead(&vhalHandler);
+
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+    sleep(1);
+    std::vector<vehicle::V2_0::VehiclePropValue> propertyValues;
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues));
+    EXPECT_EQ(propertyValues.size(), 1);
+
+    EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
+}
+
+TEST(VhalhandlerTests, GetChangedPropertyValuesSuccess) {
+    VhalHandler vhalHandler;
+    ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::GET, 10));
+
+    SetSamplePropertiesToRead(&vhalHandler);
+
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+    sleep(1);
+    uint64_t sequence = 0;
+    std::vector<vehicle::V2_0::VehiclePropValue> propertyValues;
+    EXPECT_TRUE(vhalHandler.getChangedPropertyValues(&sequence, &propertyValues));
+    EXPECT_EQ(propertyValues.size(), 1);
+
+    // The make of the car does not change.
+    sleep(1);
+    EXPECT_TRUE(vhalHandler.getChangedPropertyValues(&sequence, &propertyValues));
+    EXPECT_EQ(propertyValues.size(), 0);
+
+    EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
+}
+
+TEST(VhalhandlerTests, GetDrivingStateSuccess) {
+    VhalHandler vhalHandler;
+    ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::GET, 10));
+
+    VhalHandler::DrivingState drivingState;
+    EXPECT_FALSE(vhalHandler.getDrivingState(&drivingState));
+
+    ASSERT_TRUE(vhalHandler.setPropertiesToRead(VhalHandler::getDrivingStateProperties()));
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+    sleep(1);
+    EXPECT_TRUE(vhalHandler.getDrivingState(&drivingState));
+
+    EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
+}
+
 }  // namespace
 }  // namespace implementation
 }  // namespace V1_0
@@ -17,6 +17,10 @@
 #include "MockEvsCamera.h"
 
 #include <stdlib.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+#include <chrono>
 
 namespace android {
 namespace hardware {
@@ -27,9 +31,10 @@ namespace implementation {
 
 // TODO(b/159733690): the number should come from xml
 const int kFramesCount = 4;
-const int kFrameGenerationDelayMillis = 30;
 
-MockEvsCamera::MockEvsCamera(const string& cameraId, const Stream& streamCfg) {
+MockEvsCamera::MockEvsCamera(const string& cameraId, const Stream& streamCfg,
+                             int frameIntervalMs) :
+        mFrameIntervalMs(frameIntervalMs) {
     mConfigManager = ConfigManager::Create();
 
     mStreamCfg.height = streamCfg.height;
@@ -268,6 +273,7 @@ void MockEvsCamera::initializeFrames(int framesCount) {
 void MockEvsCamera::generateFrames() {
     initializeFrames(kFramesCount);
 
+    auto nextFrameTime = std::chrono::steady_clock::now();
     while (true) {
         {
             scoped_lock<mutex> lock(mAccessLock);
@@ -279,9 +285,17 @@ void MockEvsCamera::generateFrames() {
             }
         }
 
+        // The frames of a set are captured together.
+        const int64_t timestampUs = elapsedRealtimeNano() / 1000;
+        for (auto& bufferDesc : mBufferDescs) {
+            bufferDesc.timestamp = timestampUs;
+        }
         mStream->deliverFrame_1_1(mBufferDescs);
-        std::this_thread::sleep_for(
-                std::chrono::milliseconds(kFrameGenerationDelayMillis));
+
+        // Keeps the rate steady regardless of how long the delivery took.
+        nextFrameTime = std::max(nextFrameTime + std::chrono::milliseconds(mFrameIntervalMs),
+                                 std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(nextFrameTime);
     }
 
     {
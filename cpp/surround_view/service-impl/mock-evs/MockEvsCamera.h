@@ -54,7 +54,12 @@ using IEvsEnumerator_1_1 = ::android::hardware::automotive::evs::V1_1::IEvsEnume
 // implemented.
 class MockEvsCamera : public IEvsCamera_1_1 {
 public:
-    MockEvsCamera(const std::string& cameraId, const Stream& streamCfg);
+    // Frames are delivered every frameIntervalMs, or as soon as the last
+    // delivery returns if that takes longer.
+    MockEvsCamera(const std::string& cameraId, const Stream& streamCfg,
+                  int frameIntervalMs = kDefaultFrameIntervalMs);
+
+    static constexpr int kDefaultFrameIntervalMs = 30;
 
     // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
     Return<void> getCameraInfo(getCameraInfo_cb _hidl_cb) override;
@@ -103,6 +108,7 @@ private:
     };
     StreamStateValues mStreamState GUARDED_BY(mAccessLock);
     Stream mStreamCfg;
+    const int mFrameIntervalMs;
 
     std::vector<android::sp<GraphicBuffer>> mGraphicBuffers;
     std::vector<BufferDesc_1_1> mBufferDescs;
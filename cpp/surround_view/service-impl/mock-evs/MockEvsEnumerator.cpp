@@ -29,7 +29,8 @@ using ::android::sp;
 using CameraDesc_1_0 = ::android::hardware::automotive::evs::V1_0::CameraDesc;
 using CameraDesc_1_1 = ::android::hardware::automotive::evs::V1_1::CameraDesc;
 
-MockEvsEnumerator::MockEvsEnumerator() {
+MockEvsEnumerator::MockEvsEnumerator(int frameIntervalMs) :
+        mFrameIntervalMs(frameIntervalMs) {
     mConfigManager = ConfigManager::Create();
 }
 
@@ -109,7 +110,7 @@ Return<void> MockEvsEnumerator::getCameraList_1_1(
 Return<sp<IEvsCamera_1_1>> MockEvsEnumerator::openCamera_1_1(
         const hidl_string& cameraId, const Stream& streamCfg) {
     LOG(INFO) << __FUNCTION__ << ": " << streamCfg.width << ", " << streamCfg.height;
-    return new MockEvsCamera(cameraId, streamCfg);
+    return new MockEvsCamera(cameraId, streamCfg, mFrameIntervalMs);
 }
 
 Return<void> MockEvsEnumerator::getDisplayIdList(getDisplayIdList_cb _list_cb) {
@@ -24,6 +24,8 @@
 
 #include <ConfigManager.h>
 
+#include "MockEvsCamera.h"
+
 using namespace ::android::hardware::automotive::evs::V1_1;
 using ::android::hardware::camera::device::V3_2::Stream;
 
@@ -43,7 +45,8 @@ using IEvsEnumerator_1_1 = ::android::hardware::automotive::evs::V1_1::IEvsEnume
 
 class MockEvsEnumerator : public IEvsEnumerator_1_1 {
 public:
-    MockEvsEnumerator();
+    // The cameras it opens deliver frames every frameIntervalMs.
+    explicit MockEvsEnumerator(int frameIntervalMs = MockEvsCamera::kDefaultFrameIntervalMs);
 
     // Methods from ::android::hardware::automotive::evs::V1_0::IEvsEnumerator follow.
     Return<void> getCameraList(getCameraList_cb _hidl_cb) override;
@@ -71,6 +74,7 @@ public:
 
 private:
     std::unique_ptr<ConfigManager> mConfigManager;
+    const int mFrameIntervalMs;
 };
 
 }  // namespace implementation
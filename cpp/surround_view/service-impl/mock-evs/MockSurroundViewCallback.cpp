@@ -54,7 +54,8 @@ Return<void> MockSurroundViewCallback::receiveFrames(
 
     // Create a separate thread to return the frames to the session. This
     // simulates the behavior of oneway HIDL method call.
-    thread mockHidlThread([this, &svFramesDesc]() {
+    // The descriptor is copied, as the thread outlives this call.
+    thread mockHidlThread([this, svFramesDesc]() {
         mSession->doneWithFrames(svFramesDesc);
     });
     mockHidlThread.detach();
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "BootTimeline.h"
+
+#include <sstream>
+
+#include <android-base/logging.h>
+#include <utils/SystemClock.h>
+
+
+namespace {
+
+const char* kPhaseNames[BootTimeline::NUM_PHASES] = {
+    "app started",
+    "config loaded",
+    "EVS connected",
+    "display opened",
+    "vehicle connected",
+    "first frame shown",
+};
+
+// The rear view has to be on the screen within two seconds of power-on
+const int64_t kFirstFrameTargetMs = 2000;
+
+} // namespace
+
+
+std::atomic<int64_t> BootTimeline::sPhaseTimesMs[BootTimeline::NUM_PHASES] = {};
+
+
+void BootTimeline::mark(Phase phase) {
+    const int64_t nowMs = android::elapsedRealtime();
+    int64_t unset = 0;
+    if (!sPhaseTimesMs[phase].compare_exchange_strong(unset, nowMs)) {
+        // Only the first time counts
+        return;
+    }
+
+    LOG(INFO) << "Boot phase " << kPhaseNames[phase] << " at " << nowMs << " ms";
+    if (phase != FIRST_FRAME_SHOWN) {
+        return;
+    }
+
+    // Summarize the phases that were reached on the way to the first frame
+    std::ostringstream timeline;
+    for (int i = 0; i < NUM_PHASES; ++i) {
+        const int64_t timeMs = sPhaseTimesMs[i];
+        if (timeMs > 0) {
+            timeline << (timeline.tellp() > 0 ? ", " : "")
+                     << kPhaseNames[i] << " " << timeMs << " ms";
+        }
+    }
+
+    if (nowMs > kFirstFrameTargetMs) {
+        LOG(WARNING) << "First frame missed the " << kFirstFrameTargetMs
+                     << " ms target: " << timeline.str();
+    } else {
+        LOG(INFO) << "Boot timeline: " << timeline.str();
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_EVS_APP_BOOTTIMELINE_H
+#define CAR_EVS_APP_BOOTTIMELINE_H
+
+#include <atomic>
+#include <cstdint>
+
+
+/*
+ * Records when the EVS application reaches each phase of its start-up, in milliseconds since the
+ * device booted, so the time from power-on to the first camera frame on the screen can be
+ * tracked against its target.
+ */
+class BootTimeline {
+public:
+    enum Phase {
+        APP_STARTED = 0,
+        CONFIG_LOADED,
+        EVS_CONNECTED,
+        DISPLAY_OPENED,
+        VEHICLE_CONNECTED,
+        FIRST_FRAME_SHOWN,
+        NUM_PHASES  // Must come last
+    };
+
+    // Records that |phase| has been reached, unless it already was.  Safe to be called from any
+    // thread.
+    static void mark(Phase phase);
+
+private:
+    // 0 until a phase is reached
+    static std::atomic<int64_t> sPhaseTimesMs[NUM_PHASES];
+};
+
+
+#endif //CAR_EVS_APP_BOOTTIMELINE_H
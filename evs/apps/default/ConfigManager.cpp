@@ -17,9 +17,16 @@
 
 #include "json/json.h"
 
-#include <fstream>
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+
 #include <math.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 static const float kDegreesToRadians = M_PI / 180.0f;
@@ -49,17 +56,159 @@ static bool readChildNodeAsFloat(const char* groupName,
 }
 
 
-bool ConfigManager::initialize(const char* configFileName)
+namespace {
+
+// Layout of the configuration snapshot.  Fields are in the native byte order and every offset is
+// from the start of the snapshot.  Bump kCacheVersion whenever the layout changes.
+constexpr char     kCacheMagic[8] = { 'E', 'V', 'S', 'A', 'P', 'P', 'C', '\0' };
+constexpr uint32_t kCacheVersion = 1;
+
+// A string in the snapshot; it is not null-terminated
+struct CacheString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t size;              // Of the whole snapshot in bytes
+    uint64_t checksum;          // Hash of everything after the header
+    uint64_t sourceSize;        // Of the JSON file the snapshot was taken from
+    int64_t  sourceMtimeNs;
+    uint64_t sourceHash;
+    float    carWidth;
+    float    wheelBase;
+    float    frontExtent;
+    float    rearExtent;
+    float    carGraphicFrontPixel;
+    float    carGraphicRearPixel;
+    uint32_t displayOffset;     // CacheDisplay[numDisplays]
+    uint32_t numDisplays;
+    uint32_t cameraOffset;      // CacheCamera[numCameras]
+    uint32_t numCameras;
+};
+
+struct CacheDisplay {
+    uint32_t    port;
+    CacheString function;
+    float       frontRangeInCarSpace;
+    float       rearRangeInCarSpace;
+};
+
+struct CacheCamera {
+    CacheString cameraId;
+    CacheString function;
+    float       position[3];
+    float       yaw;
+    float       pitch;
+    float       roll;
+    float       hfov;
+    float       vfov;
+    uint32_t    hflip;
+    uint32_t    vflip;
+};
+
+
+// 64-bit FNV-1a, which is plenty to tell configuration files apart
+uint64_t hashBytes(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+
+// Returns |count| elements of T at |offset| of the snapshot, or nullptr if they don't fit in it
+template <typename T>
+const T* getCacheArray(const uint8_t* cache, size_t cacheSize, uint32_t offset, uint32_t count) {
+    if (offset > cacheSize ||
+        count > (cacheSize - offset) / sizeof(T) ||
+        offset % alignof(T) != 0) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<const T*>(cache + offset);
+}
+
+
+bool getCacheString(const uint8_t* cache, size_t cacheSize,
+                    const CacheString& str, std::string* out) {
+    const char* chars = getCacheArray<char>(cache, cacheSize, str.offset, str.length);
+    if (chars == nullptr) {
+        return false;
+    }
+
+    out->assign(chars, str.length);
+    return true;
+}
+
+
+// Appends |size| bytes of |data| aligned to |alignment| and returns their offset
+uint32_t appendToCache(std::vector<uint8_t>& cache, const void* data, size_t size,
+                       size_t alignment = 4) {
+    const size_t offset = (cache.size() + alignment - 1) / alignment * alignment;
+    cache.resize(offset + size, 0);
+    if (data != nullptr && size > 0) {
+        memcpy(cache.data() + offset, data, size);
+    }
+
+    return static_cast<uint32_t>(offset);
+}
+
+
+CacheString appendStringToCache(std::vector<uint8_t>& cache, const std::string& str) {
+    return { appendToCache(cache, str.data(), str.size(), 1),
+             static_cast<uint32_t>(str.size()) };
+}
+
+} // namespace
+
+
+bool ConfigManager::initialize(const char* configFileName, const char* cacheFileName)
 {
-    bool complete = true;
+    // Read the whole file in; its contents tell whether a snapshot may be used instead
+    std::string json;
+    struct stat st;
+    {
+        android::base::unique_fd fd(open(configFileName, O_RDONLY | O_CLOEXEC));
+        if (fd < 0 || fstat(fd, &st) < 0 || !android::base::ReadFdToString(fd, &json)) {
+            printf("Failed to read configuration file %s\n", configFileName);
+            return false;
+        }
+    }
+
+    const uint64_t sourceSize = json.size();
+    const int64_t sourceMtimeNs = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+    const uint64_t sourceHash = hashBytes(json.data(), json.size());
+    if (cacheFileName != nullptr &&
+        readCache(cacheFileName, sourceSize, sourceMtimeNs, sourceHash)) {
+        return true;
+    }
+
+    if (!parseConfig(json, configFileName)) {
+        return false;
+    }
+
+    if (cacheFileName != nullptr) {
+        writeCache(cacheFileName, sourceSize, sourceMtimeNs, sourceHash);
+    }
+
+    return true;
+}
+
 
-    // Set up a stream to read in the input file
-    std::ifstream configStream(configFileName);
+bool ConfigManager::parseConfig(const std::string& json, const char* configFileName)
+{
+    bool complete = true;
 
-    // Parse the stream into JSON objects
+    // Parse the file into JSON objects
     Json::Reader reader;
     Json::Value rootNode;
-    bool parseOk = reader.parse(configStream, rootNode, false /* don't need comments */);
+    bool parseOk = reader.parse(json, rootNode, false /* don't need comments */);
     if (!parseOk) {
         printf("Failed to read configuration file %s\n", configFileName);
         printf("%s\n", reader.getFormatedErrorMessages().c_str());
@@ -202,3 +351,179 @@ bool ConfigManager::initialize(const char* configFileName)
     // If we got this far, we were successful as long as we found all our child fields
     return complete;
 }
+
+
+bool ConfigManager::readCache(const char* cacheFileName,
+                              uint64_t sourceSize, int64_t sourceMtimeNs, uint64_t sourceHash)
+{
+    android::base::unique_fd fd(open(cacheFileName, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        // There is none until the configuration has been parsed once
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(CacheHeader))) {
+        printf("Ignoring a configuration cache that is too small\n");
+        return false;
+    }
+
+    const size_t cacheSize = st.st_size;
+    void* cacheData = mmap(nullptr, cacheSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (cacheData == MAP_FAILED) {
+        printf("Failed to map configuration cache %s: %s\n", cacheFileName, strerror(errno));
+        return false;
+    }
+
+    const uint8_t* cache = static_cast<const uint8_t*>(cacheData);
+    const CacheHeader* header = reinterpret_cast<const CacheHeader*>(cache);
+    auto fail = [cacheData, cacheSize](const char* reason) {
+        printf("Ignoring a configuration cache: %s\n", reason);
+        munmap(cacheData, cacheSize);
+        return false;
+    };
+
+    if (memcmp(header->magic, kCacheMagic, sizeof(kCacheMagic)) ||
+        header->version != kCacheVersion) {
+        return fail("unsupported format");
+    }
+    if (header->size != cacheSize ||
+        header->checksum != hashBytes(cache + sizeof(CacheHeader),
+                                      cacheSize - sizeof(CacheHeader))) {
+        return fail("corrupted");
+    }
+    if (header->sourceSize != sourceSize ||
+        header->sourceMtimeNs != sourceMtimeNs ||
+        header->sourceHash != sourceHash) {
+        // Taken from another configuration file or an older version of this one
+        munmap(cacheData, cacheSize);
+        return false;
+    }
+
+    const CacheDisplay* displayRecs =
+        getCacheArray<CacheDisplay>(cache, cacheSize, header->displayOffset, header->numDisplays);
+    const CacheCamera* cameraRecs =
+        getCacheArray<CacheCamera>(cache, cacheSize, header->cameraOffset, header->numCameras);
+    if (displayRecs == nullptr || cameraRecs == nullptr) {
+        return fail("corrupted record table");
+    }
+
+    std::vector<DisplayInfo> displays(header->numDisplays);
+    for (uint32_t i = 0; i < header->numDisplays; ++i) {
+        const CacheDisplay& rec = displayRecs[i];
+        DisplayInfo& info = displays[i];
+        if (!getCacheString(cache, cacheSize, rec.function, &info.function)) {
+            return fail("corrupted display record");
+        }
+        info.port = rec.port;
+        info.frontRangeInCarSpace = rec.frontRangeInCarSpace;
+        info.rearRangeInCarSpace = rec.rearRangeInCarSpace;
+    }
+
+    std::vector<CameraInfo> cameras(header->numCameras);
+    for (uint32_t i = 0; i < header->numCameras; ++i) {
+        const CacheCamera& rec = cameraRecs[i];
+        CameraInfo& info = cameras[i];
+        if (!getCacheString(cache, cacheSize, rec.cameraId, &info.cameraId) ||
+            !getCacheString(cache, cacheSize, rec.function, &info.function)) {
+            return fail("corrupted camera record");
+        }
+        memcpy(info.position, rec.position, sizeof(info.position));
+        info.yaw   = rec.yaw;
+        info.pitch = rec.pitch;
+        info.roll  = rec.roll;
+        info.hfov  = rec.hfov;
+        info.vfov  = rec.vfov;
+        info.hflip = rec.hflip != 0;
+        info.vflip = rec.vflip != 0;
+    }
+
+    mCarWidth = header->carWidth;
+    mWheelBase = header->wheelBase;
+    mFrontExtent = header->frontExtent;
+    mRearExtent = header->rearExtent;
+    mCarGraphicFrontPixel = header->carGraphicFrontPixel;
+    mCarGraphicRearPixel = header->carGraphicRearPixel;
+    mDisplays = std::move(displays);
+    mCameras = std::move(cameras);
+
+    munmap(cacheData, cacheSize);
+    return true;
+}
+
+
+void ConfigManager::writeCache(const char* cacheFileName,
+                               uint64_t sourceSize, int64_t sourceMtimeNs,
+                               uint64_t sourceHash) const
+{
+    std::vector<uint8_t> cache;
+    appendToCache(cache, nullptr, sizeof(CacheHeader));
+    const uint32_t displayOffset =
+        appendToCache(cache, nullptr, mDisplays.size() * sizeof(CacheDisplay));
+    const uint32_t cameraOffset =
+        appendToCache(cache, nullptr, mCameras.size() * sizeof(CacheCamera));
+
+    // Records are filled in by index because appending strings may move the buffer
+    for (size_t i = 0; i < mDisplays.size(); ++i) {
+        const DisplayInfo& info = mDisplays[i];
+        CacheDisplay rec = {};
+        rec.port = info.port;
+        rec.function = appendStringToCache(cache, info.function);
+        rec.frontRangeInCarSpace = info.frontRangeInCarSpace;
+        rec.rearRangeInCarSpace = info.rearRangeInCarSpace;
+        memcpy(cache.data() + displayOffset + i * sizeof(rec), &rec, sizeof(rec));
+    }
+
+    for (size_t i = 0; i < mCameras.size(); ++i) {
+        const CameraInfo& info = mCameras[i];
+        CacheCamera rec = {};
+        rec.cameraId = appendStringToCache(cache, info.cameraId);
+        rec.function = appendStringToCache(cache, info.function);
+        memcpy(rec.position, info.position, sizeof(rec.position));
+        rec.yaw   = info.yaw;
+        rec.pitch = info.pitch;
+        rec.roll  = info.roll;
+        rec.hfov  = info.hfov;
+        rec.vfov  = info.vfov;
+        rec.hflip = info.hflip ? 1 : 0;
+        rec.vflip = info.vflip ? 1 : 0;
+        memcpy(cache.data() + cameraOffset + i * sizeof(rec), &rec, sizeof(rec));
+    }
+
+    CacheHeader header = {};
+    memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.size = cache.size();
+    header.checksum = hashBytes(cache.data() + sizeof(CacheHeader),
+                                cache.size() - sizeof(CacheHeader));
+    header.sourceSize = sourceSize;
+    header.sourceMtimeNs = sourceMtimeNs;
+    header.sourceHash = sourceHash;
+    header.carWidth = mCarWidth;
+    header.wheelBase = mWheelBase;
+    header.frontExtent = mFrontExtent;
+    header.rearExtent = mRearExtent;
+    header.carGraphicFrontPixel = mCarGraphicFrontPixel;
+    header.carGraphicRearPixel = mCarGraphicRearPixel;
+    header.displayOffset = displayOffset;
+    header.numDisplays = mDisplays.size();
+    header.cameraOffset = cameraOffset;
+    header.numCameras = mCameras.size();
+    memcpy(cache.data(), &header, sizeof(header));
+
+    // Write a new file and rename it over the old one so a reader never sees a partial snapshot
+    const std::string tmpFileName = std::string(cacheFileName) + ".tmp";
+    android::base::unique_fd fd(open(tmpFileName.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640));
+    if (fd < 0) {
+        printf("Failed to create configuration cache %s: %s\n",
+               tmpFileName.c_str(), strerror(errno));
+        return;
+    }
+
+    if (!android::base::WriteFully(fd, cache.data(), cache.size()) || fsync(fd) < 0 ||
+        rename(tmpFileName.c_str(), cacheFileName) < 0) {
+        printf("Failed to write configuration cache %s: %s\n", cacheFileName, strerror(errno));
+        unlink(tmpFileName.c_str());
+    }
+}
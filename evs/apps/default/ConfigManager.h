@@ -45,7 +45,10 @@ public:
         float rearRangeInCarSpace;  // How far the display extends behind the car
     };
 
-    bool initialize(const char* configFileName);
+    // Reads the configuration from |configFileName|.  If |cacheFileName| is given, a binary
+    // snapshot there is used instead of parsing the file when it was taken from the same
+    // contents, and it is written anew after the file has been parsed.
+    bool initialize(const char* configFileName, const char* cacheFileName = nullptr);
 
     // World space dimensions of the car
     float getCarWidth() const   { return mCarWidth; };
@@ -114,10 +117,27 @@ public:
     android_pixel_format_t getExternalMemoryFormat() const {
         return mExternalMemoryFormat;
     }
+    void  usePassthrough(bool flag) { mUsePassthrough = flag; }
+    bool  getUsePassthrough() const { return mUsePassthrough; }
+    void  measureLatency(bool flag) { mMeasureLatency = flag; }
+    bool  getMeasureLatency() const { return mMeasureLatency; }
     void    setMockGearSignal(int32_t signal) { mMockGearSignal = signal; }
     int32_t getMockGearSignal() const { return mMockGearSignal; }
 
 private:
+    // Fills in the configuration from the contents of a JSON file
+    bool parseConfig(const std::string& json, const char* configFileName);
+
+    // Loads the configuration from a snapshot taken of a JSON file of |sourceSize| bytes, last
+    // modified at |sourceMtimeNs|, whose contents hash to |sourceHash|.  Returns false if there
+    // is no such snapshot at |cacheFileName|.
+    bool readCache(const char* cacheFileName,
+                   uint64_t sourceSize, int64_t sourceMtimeNs, uint64_t sourceHash);
+
+    // Stores a snapshot of the configuration read from the JSON file described as above
+    void writeCache(const char* cacheFileName,
+                    uint64_t sourceSize, int64_t sourceMtimeNs, uint64_t sourceHash) const;
+
     // Camera information
     std::vector<CameraInfo> mCameras;
 
@@ -131,6 +151,12 @@ private:
     // Format of external memory
     android_pixel_format_t mExternalMemoryFormat;
 
+    // Show camera frames without drawing them into a display buffer first
+    bool mUsePassthrough = false;
+
+    // Report the time from the capture of camera frames to their presentation
+    bool mMeasureLatency = false;
+
     // Gear signal to simulate in test mode
     int32_t mMockGearSignal;
 
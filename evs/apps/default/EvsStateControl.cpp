@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include "EvsStateControl.h"
+#include "BootTimeline.h"
 #include "RenderDirectView.h"
 #include "RenderTopView.h"
 #include "RenderPixelCopy.h"
@@ -25,13 +26,21 @@
 #include <android-base/logging.h>
 #include <inttypes.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
 #include <binder/IServiceManager.h>
+#include <gpupolicy/GpuPolicy.h>
+#include <threadpolicy/ThreadPolicy.h>
 
 using ::android::hardware::automotive::evs::V1_0::EvsResult;
 using EvsDisplayState = ::android::hardware::automotive::evs::V1_0::DisplayState;
 using BufferDesc_1_0  = ::android::hardware::automotive::evs::V1_0::BufferDesc;
 using BufferDesc_1_1  = ::android::hardware::automotive::evs::V1_1::BufferDesc;
 
+namespace gpupolicy = ::android::automotive::evs::gpupolicy;
+
+// How often the latency histograms are logged while frames are shown
+static const nsecs_t kLatencyReportIntervalNs = 10 * 1000 * 1000 * 1000LL;
+
 static bool isSfReady() {
     const android::String16 serviceName("SurfaceFlinger");
     return android::defaultServiceManager()->checkService(serviceName) != nullptr;
@@ -61,6 +70,9 @@ EvsStateControl::EvsStateControl(android::sp <IVehicle>       pVnet,
     static_assert(getPropType(VehicleProperty::TURN_SIGNAL_STATE) == VehiclePropertyType::INT32,
                   "Unexpected type for TURN_SIGNAL_STATE property");
 
+    // Renderers draw the capture time into the frames they draw while the latency is measured
+    RenderBase::setMarkTimestamps(mConfig.getMeasureLatency());
+
     mGearValue.prop       = static_cast<int32_t>(VehicleProperty::GEAR_SELECTION);
     mTurnSignalValue.prop = static_cast<int32_t>(VehicleProperty::TURN_SIGNAL_STATE);
 
@@ -115,6 +127,23 @@ EvsStateControl::EvsStateControl(android::sp <IVehicle>       pVnet,
 }
 
 
+void EvsStateControl::setStateUntilVehicleConnected(State state) {
+    mWaitingForVehicle = true;
+    mStateUntilVehicle = state;
+}
+
+
+void EvsStateControl::connectVehicle(const sp<IVehicle>& pVnet) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPendingVehicle = pVnet;
+        mCommandQueue.push({Op::VEHICLE_CONNECTED, 0, 0});
+    }
+
+    mWakeSignal.notify_all();
+}
+
+
 bool EvsStateControl::startUpdateLoop() {
     // Create the thread and report success if it gets started
     mRenderThread = std::thread([this](){ updateLoop(); });
@@ -146,10 +175,47 @@ void EvsStateControl::postCommand(const Command& cmd, bool clear) {
 }
 
 
+void EvsStateControl::postPropertyEvents(const hidl_vec<VehiclePropValue>& values) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        bool changed = false;
+        for (auto&& value : values) {
+            if (value.value.int32Values.size() < 1) {
+                continue;
+            }
+
+            if (value.prop == static_cast<int32_t>(VehicleProperty::GEAR_SELECTION)) {
+                mGearEvent = value.value.int32Values[0];
+                changed = true;
+            } else if (value.prop == static_cast<int32_t>(VehicleProperty::TURN_SIGNAL_STATE)) {
+                mTurnSignalEvent = value.value.int32Values[0];
+                changed = true;
+            }
+        }
+
+        if (!changed) {
+            return;
+        }
+
+        mCommandQueue.push({Op::VEHICLE_STATE_CHANGED, 0, 0});
+    }
+
+    mWakeSignal.notify_all();
+}
+
+
 void EvsStateControl::updateLoop() {
     LOG(DEBUG) << "Starting EvsStateControl update loop";
 
+    // The app has no dump of its own, so the policy is logged as it's applied
+    namespace threadpolicy = ::android::automotive::evs::threadpolicy;
+    if (threadpolicy::applyThreadPolicy(threadpolicy::kRoleRender)) {
+        LOG(INFO) << threadpolicy::dumpThreadPolicies();
+    }
+
     bool run = true;
+    bool queryVehicle = true;   // Start from the current vehicle state
+    bool stateChanged = false;
     while (run) {
         // Process incoming commands
         {
@@ -161,7 +227,31 @@ void EvsStateControl::updateLoop() {
                     run = false;
                     break;
                 case Op::CHECK_VEHICLE_STATE:
-                    // Just running selectStateForCurrentConditions below will take care of this
+                    // Running selectStateForCurrentConditions below will take care of this
+                    queryVehicle = true;
+                    break;
+                case Op::VEHICLE_STATE_CHANGED:
+                    // Take the latest values reported by the Vehicle HAL
+                    if (mGearEvent) {
+                        mGearValue.value.int32Values = hidl_vec<int32_t>({*mGearEvent});
+                        mGearEvent.reset();
+                    }
+                    if (mTurnSignalEvent) {
+                        // Unless we found the vehicle has no turn signal state
+                        if (mTurnSignalValue.prop != 0) {
+                            mTurnSignalValue.value.int32Values =
+                                    hidl_vec<int32_t>({*mTurnSignalEvent});
+                        }
+                        mTurnSignalEvent.reset();
+                    }
+                    stateChanged = true;
+                    break;
+                case Op::VEHICLE_CONNECTED:
+                    // From now on, the view follows the vehicle state
+                    mVehicle = mPendingVehicle;
+                    mPendingVehicle = nullptr;
+                    mWaitingForVehicle = false;
+                    queryVehicle = true;
                     break;
                 case Op::TOUCH_EVENT:
                     // Implement this given the x/y location of the touch event
@@ -171,14 +261,30 @@ void EvsStateControl::updateLoop() {
             }
         }
 
-        // Review vehicle state and choose an appropriate renderer
-        if (!selectStateForCurrentConditions()) {
-            LOG(ERROR) << "selectStateForCurrentConditions failed so we're going to die";
-            break;
+        // Review vehicle state and choose an appropriate renderer.  This only happens when the
+        // vehicle state may have changed, so rendering a frame makes no Vehicle HAL calls.
+        if (queryVehicle || stateChanged) {
+            if (!selectStateForCurrentConditions(queryVehicle)) {
+                LOG(ERROR) << "selectStateForCurrentConditions failed so we're going to die";
+                break;
+            }
+            queryVehicle = false;
+            stateChanged = false;
         }
 
         // If we have an active renderer, give it a chance to draw
-        if (mCurrentRenderer) {
+        if (mCurrentRenderer && mCurrentRenderer->canPassThrough()) {
+            // Let the display show the camera frames without drawing them ourselves
+            if (!mCurrentRenderer->passThroughFrame(mDisplay)) {
+                LOG(WARNING) << "Failed to pass a camera frame through to the display";
+            } else {
+                recordLatency();
+                if (!mFrameShown) {
+                    BootTimeline::mark(BootTimeline::FIRST_FRAME_SHOWN);
+                    mFrameShown = true;
+                }
+            }
+        } else if (mCurrentRenderer) {
             // Get the output buffer we'll use to display the imagery
             BufferDesc_1_0 tgtBuffer = {};
             mDisplay->getTargetBuffer([&tgtBuffer](const BufferDesc_1_0& buff) {
@@ -189,20 +295,30 @@ void EvsStateControl::updateLoop() {
             if (tgtBuffer.memHandle == nullptr) {
                 LOG(ERROR) << "Didn't get requested output buffer -- skipping this frame.";
             } else {
-                // Generate our output image
+                // Generate our output image.  The renderers wait for the GPU to finish.
+                const nsecs_t drawStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
                 if (!mCurrentRenderer->drawFrame(convertBufferDesc(tgtBuffer))) {
                     // If drawing failed, we want to exit quickly so an app restart can happen
                     run = false;
                 }
+                gpupolicy::recordFrameTime(gpupolicy::kComponentRender,
+                                           systemTime(SYSTEM_TIME_MONOTONIC) - drawStartNs);
 
                 // Send the finished image back for display
                 mDisplay->returnTargetBufferForDisplay(tgtBuffer);
+                if (run) {
+                    recordLatency();
+                }
+                if (run && !mFrameShown) {
+                    BootTimeline::mark(BootTimeline::FIRST_FRAME_SHOWN);
+                    mFrameShown = true;
+                }
             }
         } else if (run) {
             // No active renderer, so sleep until somebody wakes us with another command
             // or exit if we received EXIT command
             std::unique_lock<std::mutex> lock(mLock);
-            mWakeSignal.wait(lock);
+            mWakeSignal.wait(lock, [this]() { return !mCommandQueue.empty(); });
         }
     }
 
@@ -212,26 +328,65 @@ void EvsStateControl::updateLoop() {
         // Deactive the renderer
         mCurrentRenderer->deactivate();
     }
+    reportLatency();
+    LOG(INFO) << gpupolicy::dumpGpuPolicies();
 
     printf("Shutting down app due to state control loop ending\n");
     LOG(ERROR) << "Shutting down app due to state control loop ending";
 }
 
 
-bool EvsStateControl::selectStateForCurrentConditions() {
+void EvsStateControl::recordLatency() {
+    if (!mConfig.getMeasureLatency()) {
+        return;
+    }
+
+    // The display HAL gives no present fence, so a frame counts as presented once the display
+    // took it back.  The cameras stamp their frames on CLOCK_MONOTONIC, as V4L2 does.
+    const nsecs_t nowNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    mLatencyHistograms[mCurrentRenderer->getName()].record(
+            mCurrentRenderer->getFrameTimestamp(), nowNs / 1000);
+
+    if (mLastLatencyReportNs == 0) {
+        mLastLatencyReportNs = nowNs;
+    } else if (nowNs - mLastLatencyReportNs >= kLatencyReportIntervalNs) {
+        reportLatency();
+        mLastLatencyReportNs = nowNs;
+    }
+}
+
+
+void EvsStateControl::reportLatency() {
+    for (auto&& [name, histogram] : mLatencyHistograms) {
+        if (histogram.getCount() > 0) {
+            LOG(INFO) << "Capture to present latency of " << name << ": " << histogram.toString();
+        }
+    }
+}
+
+
+bool EvsStateControl::selectStateForCurrentConditions(bool queryVehicle) {
     static int32_t sDummyGear   = mConfig.getMockGearSignal();
     static int32_t sDummySignal = int32_t(VehicleTurnSignal::NONE);
 
+    if (mWaitingForVehicle) {
+        // Nothing is known about the vehicle yet
+        return configureEvsPipeline(mStateUntilVehicle);
+    }
+
     if (mVehicle != nullptr) {
-        // Query the car state
-        if (invokeGet(&mGearValue) != StatusCode::OK) {
-            LOG(ERROR) << "GEAR_SELECTION not available from vehicle.  Exiting.";
-            return false;
-        }
-        if ((mTurnSignalValue.prop == 0) || (invokeGet(&mTurnSignalValue) != StatusCode::OK)) {
-            // Silently treat missing turn signal state as no turn signal active
-            mTurnSignalValue.value.int32Values.setToExternal(&sDummySignal, 1);
-            mTurnSignalValue.prop = 0;
+        // Query the car state, unless the property events have kept us up to date
+        if (queryVehicle) {
+            if (invokeGet(&mGearValue) != StatusCode::OK) {
+                LOG(ERROR) << "GEAR_SELECTION not available from vehicle.  Exiting.";
+                return false;
+            }
+            if ((mTurnSignalValue.prop == 0) ||
+                (invokeGet(&mTurnSignalValue) != StatusCode::OK)) {
+                // Silently treat missing turn signal state as no turn signal active
+                mTurnSignalValue.value.int32Values.setToExternal(&sDummySignal, 1);
+                mTurnSignalValue.prop = 0;
+            }
         }
     } else {
         // While testing without a vehicle, behave as if we're in reverse for the first 20 seconds
@@ -345,8 +500,10 @@ bool EvsStateControl::configureEvsPipeline(State desiredState) {
         isGlReady = true;
     }
 
-    // Since we're changing states, shut down the current renderer
+    // Since we're changing states, shut down the current renderer.  The app has no dump of its
+    // own, so the frames that missed their deadlines are logged as the view goes.
     if (mCurrentRenderer != nullptr) {
+        LOG(INFO) << gpupolicy::dumpGpuPolicies();
         mCurrentRenderer->deactivate();
         mCurrentRenderer = nullptr; // It's a smart pointer, so destructs on assignment to null
     }
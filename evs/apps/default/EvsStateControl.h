@@ -19,6 +19,7 @@
 
 #include "StreamHandler.h"
 #include "ConfigManager.h"
+#include "LatencyHistogram.h"
 #include "RenderBase.h"
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
@@ -26,6 +27,8 @@
 #include <android/hardware/automotive/evs/1.1/IEvsDisplay.h>
 #include <android/hardware/automotive/evs/1.1/IEvsCamera.h>
 
+#include <map>
+#include <optional>
 #include <thread>
 
 
@@ -63,7 +66,9 @@ public:
 
     enum class Op {
         EXIT,
-        CHECK_VEHICLE_STATE,
+        CHECK_VEHICLE_STATE,    // Query the vehicle state from the Vehicle HAL
+        VEHICLE_STATE_CHANGED,  // Apply the property values passed to postPropertyEvents()
+        VEHICLE_CONNECTED,      // Start following the Vehicle HAL passed to connectVehicle()
         TOUCH_EVENT,
     };
 
@@ -73,6 +78,14 @@ public:
         uint32_t    arg2;
     };
 
+    // Shows the view for |state| until connectVehicle() hands over the Vehicle HAL, instead of
+    // the mock vehicle state used without one.  Must be called before startUpdateLoop().
+    void setStateUntilVehicleConnected(State state);
+
+    // Starts following the state of |pVnet|, for a controller constructed without it.  Safe to
+    // be called from other threads.
+    void connectVehicle(const sp<IVehicle>& pVnet);
+
     // This spawns a new thread that is expected to run continuously
     bool startUpdateLoop();
 
@@ -82,12 +95,22 @@ public:
     // Safe to be called from other threads
     void postCommand(const Command& cmd, bool clear = false);
 
+    // Caches the gear and turn signal values among |values| and re-evaluates the state with
+    // them, so the update loop needn't query the Vehicle HAL.  Safe to be called from other
+    // threads.
+    void postPropertyEvents(const hidl_vec<VehiclePropValue>& values);
+
 private:
     void updateLoop();
     StatusCode invokeGet(VehiclePropValue *pRequestedPropValue);
-    bool selectStateForCurrentConditions();
+    bool selectStateForCurrentConditions(bool queryVehicle);
     bool configureEvsPipeline(State desiredState);  // Only call from one thread!
 
+    // Records the latency of the frame the current renderer just showed, and reports the
+    // histograms now and then.  Only for the render thread.
+    void recordLatency();
+    void reportLatency();
+
     sp<IVehicle>                mVehicle;
     sp<IEvsEnumerator>          mEvs;
     sp<IEvsDisplay>             mDisplay;
@@ -96,8 +119,23 @@ private:
     VehiclePropValue            mGearValue;
     VehiclePropValue            mTurnSignalValue;
 
+    // Latest values from postPropertyEvents() not yet applied by the update loop
+    std::optional<int32_t>      mGearEvent;         // Guarded by mLock
+    std::optional<int32_t>      mTurnSignalEvent;   // Guarded by mLock
+
     State                       mCurrentState = OFF;
 
+    // Set while the view for mStateUntilVehicle is shown until the Vehicle HAL is connected
+    bool                        mWaitingForVehicle = false;
+    State                       mStateUntilVehicle = OFF;
+    sp<IVehicle>                mPendingVehicle;    // Guarded by mLock
+
+    bool                        mFrameShown = false;
+
+    // Capture to present latency per renderer, keyed by the renderer name
+    std::map<std::string, LatencyHistogram> mLatencyHistograms;
+    int64_t                     mLastLatencyReportNs = 0;
+
     // mCameraList is a redundant storage for camera device info, which is also
     // stored in mCameraDescList and, however, not removed for backward
     // compatibility.
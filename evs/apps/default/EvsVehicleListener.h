@@ -20,21 +20,18 @@
 #include "EvsStateControl.h"
 
 /*
- * This class listens for asynchronous updates from the Vehicle HAL.  While the EVS
- * applications is active, it can poll the vehicle state directly.  However, when it goes to
- * sleep, we need these notifications to bring it active again.
+ * This class listens for asynchronous updates from the Vehicle HAL.  The property values are
+ * handed to the state controller as they arrive, so it needn't poll the vehicle state while it
+ * is rendering.  When it goes to sleep, these notifications also bring it active again.
  */
 class EvsVehicleListener : public IVehicleCallback {
 public:
     // Methods from ::android::hardware::automotive::vehicle::V2_0::IVehicleCallback follow.
-    Return<void> onPropertyEvent(const hidl_vec <VehiclePropValue> & /*values*/) override {
-        {
-            // Our use case is so simple, we don't actually need to update a variable,
-            // but the docs seem to say we have to take the lock anyway to keep
-            // the condition variable implementation happy.
-            std::lock_guard<std::mutex> g(mLock);
+    Return<void> onPropertyEvent(const hidl_vec <VehiclePropValue> & values) override {
+        std::lock_guard<std::mutex> g(mLock);
+        if (mStateController != nullptr) {
+            mStateController->postPropertyEvents(values);
         }
-        mEventCond.notify_one();
         return Return<void>();
     }
 
@@ -50,19 +47,18 @@ public:
         return Return<void>();
     }
 
-    bool waitForEvents(int timeout_ms) {
-        std::unique_lock<std::mutex> g(mLock);
-        std::cv_status result = mEventCond.wait_for(g, std::chrono::milliseconds(timeout_ms));
-        return (result == std::cv_status::no_timeout);
-    }
-
     void run(EvsStateControl *pStateController) {
+        {
+            // Events that came before are covered by the state controller's initial query
+            std::lock_guard<std::mutex> g(mLock);
+            mStateController = pStateController;
+        }
+
         while (true) {
-            // Wait until we have an event to which to react
-            // (wake up and validate our current state "just in case" every so often)
-            waitForEvents(5000);
+            // Wake up and validate our current state "just in case" every so often, which also
+            // moves the mock vehicle state along when there is no Vehicle HAL
+            std::this_thread::sleep_for(std::chrono::seconds(5));
 
-            // If we were delivered an event (or it's been a while) update as necessary
             EvsStateControl::Command cmd = {
                 .operation = EvsStateControl::Op::CHECK_VEHICLE_STATE,
                 .arg1      = 0,
@@ -74,7 +70,7 @@ public:
 
 private:
     std::mutex mLock;
-    std::condition_variable mEventCond;
+    EvsStateControl* mStateController = nullptr;    // Guarded by mLock
 };
 
 #endif //CAR_EVS_APP_VEHICLELISTENER_H
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <sstream>
+
+
+namespace {
+
+// Width of the buckets listed after the summary, in milliseconds
+const int kListedBucketMs = 5;
+
+} // namespace
+
+
+LatencyHistogram::LatencyHistogram() :
+    mBuckets(kMaxLatencyMs + 1, 0) {
+}
+
+
+void LatencyHistogram::record(int64_t captureUs, int64_t presentUs) {
+    if (captureUs <= 0 || captureUs == mLastCaptureUs) {
+        return;
+    }
+    mLastCaptureUs = captureUs;
+
+    const int64_t latencyUs = presentUs - captureUs;
+    if (latencyUs < 0) {
+        ++mOutOfRange;
+        return;
+    }
+
+    ++mBuckets[std::min(latencyUs / 1000, kMaxLatencyMs)];
+    ++mCount;
+    mSumUs += latencyUs;
+    mMaxUs = std::max(mMaxUs, latencyUs);
+}
+
+
+int64_t LatencyHistogram::getPercentileMs(int percent) const {
+    const uint64_t target = (mCount * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t ms = 0; ms < mBuckets.size(); ++ms) {
+        seen += mBuckets[ms];
+        if (seen >= target) {
+            return ms;
+        }
+    }
+    return kMaxLatencyMs;
+}
+
+
+std::string LatencyHistogram::toString() const {
+    std::ostringstream out;
+    if (mCount == 0) {
+        out << "no frames";
+    } else {
+        out << mCount << " frames, mean " << (mSumUs / mCount) / 1000.0 << " ms"
+            << ", p50 " << getPercentileMs(50) << " ms"
+            << ", p90 " << getPercentileMs(90) << " ms"
+            << ", p99 " << getPercentileMs(99) << " ms"
+            << ", max " << mMaxUs / 1000.0 << " ms";
+    }
+    if (mOutOfRange > 0) {
+        out << ", " << mOutOfRange << " frames stamped after they were shown";
+    }
+
+    for (size_t start = 0; start < mBuckets.size(); start += kListedBucketMs) {
+        const size_t end = std::min(start + kListedBucketMs, mBuckets.size());
+        uint64_t count = 0;
+        for (size_t ms = start; ms < end; ++ms) {
+            count += mBuckets[ms];
+        }
+        if (count > 0) {
+            out << "\n  " << start << (end == mBuckets.size() ? "+" : "-" + std::to_string(end))
+                << " ms: " << count;
+        }
+    }
+
+    return out.str();
+}
+
+
+void LatencyHistogram::reset() {
+    std::fill(mBuckets.begin(), mBuckets.end(), 0);
+    mCount = 0;
+    mOutOfRange = 0;
+    mSumUs = 0;
+    mMaxUs = 0;
+    mLastCaptureUs = -1;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_EVS_APP_LATENCYHISTOGRAM_H
+#define CAR_EVS_APP_LATENCYHISTOGRAM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/*
+ * Collects the time from the capture of camera frames to their presentation on the display, in
+ * one millisecond buckets, so the distribution and not only the average of the latency can be
+ * reported.  Not thread safe; it's only used by the render thread.
+ */
+class LatencyHistogram {
+public:
+    // Latencies from this on land in the last bucket.  Anything over it most likely means the
+    // camera stamps its frames on another clock than ours.
+    static constexpr int64_t kMaxLatencyMs = 500;
+
+    LatencyHistogram();
+
+    // Records a frame captured at |captureUs| and presented at |presentUs|, both on
+    // CLOCK_MONOTONIC.  A frame presented again is only recorded the first time.
+    void record(int64_t captureUs, int64_t presentUs);
+
+    uint64_t getCount() const { return mCount; }
+
+    // One line summary of the percentiles, followed by the populated buckets in steps of 5 ms
+    std::string toString() const;
+
+    void reset();
+
+private:
+    // The smallest latency, in milliseconds, that at least |percent| of the frames had
+    int64_t getPercentileMs(int percent) const;
+
+    std::vector<uint64_t>   mBuckets;
+    uint64_t                mCount = 0;
+    uint64_t                mOutOfRange = 0;    // Frames presented before they were captured
+    int64_t                 mSumUs = 0;
+    int64_t                 mMaxUs = 0;
+    int64_t                 mLastCaptureUs = -1;
+};
+
+
+#endif //CAR_EVS_APP_LATENCYHISTOGRAM_H
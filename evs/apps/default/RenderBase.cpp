@@ -18,6 +18,7 @@
 #include "glError.h"
 
 #include <android-base/logging.h>
+#include <gpupolicy/GpuPolicy.h>
 #include <ui/GraphicBuffer.h>
 
 // Eventually we shouldn't need this dependency, but for now the
@@ -37,6 +38,16 @@ EGLImageKHR  RenderBase::sKHRimage = EGL_NO_IMAGE_KHR;
 unsigned     RenderBase::sWidth  = 0;
 unsigned     RenderBase::sHeight = 0;
 float        RenderBase::sAspectRatio = 0.0f;
+bool         RenderBase::sMarkTimestamps = false;
+
+
+namespace {
+
+// Bits of the timestamp marker, and the side of the square showing each of them in pixels
+const unsigned kMarkerBits = 32;
+const unsigned kMarkerBitSize = 8;
+
+} // namespace
 
 
 bool RenderBase::prepareGL() {
@@ -98,13 +109,17 @@ bool RenderBase::prepareGL() {
 
 
     //
-    // Create the EGL context
+    // Create the EGL context, at the priority configured for the renderers
     //
-    EGLContext context = eglCreateContext(display, egl_config, EGL_NO_CONTEXT, context_attribs);
+    namespace gpupolicy = ::android::automotive::evs::gpupolicy;
+    const std::vector<EGLint> attribs =
+            gpupolicy::getContextAttributes(display, gpupolicy::kComponentRender, context_attribs);
+    EGLContext context = eglCreateContext(display, egl_config, EGL_NO_CONTEXT, attribs.data());
     if (context == EGL_NO_CONTEXT) {
         LOG(ERROR) << "Failed to create OpenGL ES Context: " << getEGLError();
         return false;
     }
+    gpupolicy::recordContextPriority(display, context, gpupolicy::kComponentRender);
 
 
     // Activate our render target for drawing
@@ -210,6 +225,40 @@ bool RenderBase::attachRenderTarget(const BufferDesc& tgtBuffer) {
 }
 
 
+void RenderBase::drawTimestampMarker(int64_t timestampUs) {
+    if (!sMarkTimestamps || sWidth < kMarkerBits * kMarkerBitSize || sHeight < kMarkerBitSize) {
+        return;
+    }
+
+    const uint32_t timestampMs = static_cast<uint32_t>(timestampUs / 1000);
+    glEnable(GL_SCISSOR_TEST);
+    for (unsigned bit = 0; bit < kMarkerBits; ++bit) {
+        const float value = (timestampMs >> (kMarkerBits - 1 - bit)) & 1 ? 1.0f : 0.0f;
+        glScissor(bit * kMarkerBitSize, 0, kMarkerBitSize, kMarkerBitSize);
+        glClearColor(value, value, value, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glDisable(GL_SCISSOR_TEST);
+}
+
+
+void RenderBase::drawTimestampMarker(int64_t timestampUs, uint32_t* pixels,
+                                     unsigned width, unsigned height, unsigned stride) {
+    if (!sMarkTimestamps || width < kMarkerBits * kMarkerBitSize || height < kMarkerBitSize) {
+        return;
+    }
+
+    const uint32_t timestampMs = static_cast<uint32_t>(timestampUs / 1000);
+    for (unsigned y = 0; y < kMarkerBitSize; ++y) {
+        uint32_t* row = pixels + y * stride;
+        for (unsigned x = 0; x < kMarkerBits * kMarkerBitSize; ++x) {
+            const unsigned bit = x / kMarkerBitSize;
+            row[x] = (timestampMs >> (kMarkerBits - 1 - bit)) & 1 ? 0xFFFFFFFF : 0xFF000000;
+        }
+    }
+}
+
+
 void RenderBase::detachRenderTarget() {
     // Drop our external render target
     if (sKHRimage != EGL_NO_IMAGE_KHR) {
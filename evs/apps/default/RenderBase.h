@@ -43,9 +43,33 @@ public:
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer) = 0;
 
+    // Renderers showing a camera as is may hand its frames straight to the display, which saves
+    // drawing each of them into a display buffer first
+    virtual bool canPassThrough() { return false; }
+    virtual bool passThroughFrame(const sp<IEvsDisplay>& /*display*/) { return false; }
+
+    // Name of the renderer in the latency reports
+    virtual const char* getName() const = 0;
+
+    // Capture time, in microseconds, of the camera frame the last image drawn or passed through
+    // showed for the first time, or zero if it showed no new frame.  A view of several cameras
+    // reports the oldest of its new frames.
+    int64_t getFrameTimestamp() const { return mFrameTimestampUs; }
+
+    // Draws the capture time of the camera frames into the images drawn from now on, so the
+    // time until they're on the screen can be read off it
+    static void setMarkTimestamps(bool flag) { sMarkTimestamps = flag; }
+
 protected:
     static bool prepareGL();
 
+    // Draws the low 32 bits of |timestampUs| in milliseconds, if enabled, as a strip of black
+    // and white squares along the first rows of the render target or of the given RGBA8888
+    // pixels, with the most significant bit first and white for a one
+    static void drawTimestampMarker(int64_t timestampUs);
+    static void drawTimestampMarker(int64_t timestampUs, uint32_t* pixels,
+                                    unsigned width, unsigned height, unsigned stride);
+
     static bool attachRenderTarget(const BufferDesc& tgtBuffer);
     static void detachRenderTarget();
 
@@ -62,6 +86,10 @@ protected:
     static unsigned     sWidth;
     static unsigned     sHeight;
     static float        sAspectRatio;
+
+    static bool         sMarkTimestamps;
+
+    int64_t             mFrameTimestampUs = 0;
 };
 
 
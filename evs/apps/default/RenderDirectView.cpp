@@ -152,6 +152,21 @@ void RenderDirectView::deactivate() {
 }
 
 
+bool RenderDirectView::canPassThrough() {
+    // The display shows frames as they are, so neither rotation nor flips can be applied
+    return mConfig.getUsePassthrough() && mTexture &&
+           mCameraInfo.roll == 0.0f && !mCameraInfo.hflip && !mCameraInfo.vflip;
+}
+
+
+bool RenderDirectView::passThroughFrame(const sp<IEvsDisplay>& display) {
+    // A frame passed again is told apart by the latency report from its timestamp
+    const bool success = mTexture->presentFrame(display);
+    mFrameTimestampUs = success ? mTexture->getFrameTimestamp() : 0;
+    return success;
+}
+
+
 bool RenderDirectView::drawFrame(const BufferDesc& tgtBuffer) {
     // Tell GL to render to the given buffer
     if (!attachRenderTarget(tgtBuffer)) {
@@ -183,7 +198,7 @@ bool RenderDirectView::drawFrame(const BufferDesc& tgtBuffer) {
     }
 
     // Bind the texture and assign it to the shader's sampler
-    mTexture->refresh();
+    mFrameTimestampUs = mTexture->refresh() ? mTexture->getFrameTimestamp() : 0;
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, mTexture->glId());
 
@@ -234,6 +249,7 @@ bool RenderDirectView::drawFrame(const BufferDesc& tgtBuffer) {
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
 
+    drawTimestampMarker(mTexture->getFrameTimestamp());
 
     // Now that everything is submitted, release our hold on the texture resource
     detachRenderTarget();
@@ -42,6 +42,11 @@ public:
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer);
 
+    virtual bool canPassThrough() override;
+    virtual bool passThroughFrame(const sp<IEvsDisplay>& display) override;
+
+    virtual const char* getName() const override { return "RenderDirectView"; }
+
 protected:
     sp<IEvsEnumerator>              mEnumerator;
     ConfigManager::CameraInfo       mCameraInfo;
@@ -16,6 +16,9 @@
 
 #include "RenderPixelCopy.h"
 #include "FormatConvert.h"
+#include "glError.h"
+#include "shader.h"
+#include "shader_externalTex.h"
 
 #include <android-base/logging.h>
 
@@ -53,16 +56,162 @@ bool RenderPixelCopy::activate() {
 
     mStreamHandler = pStreamHandler;
 
+    // Copy on the GPU if there is one
+    if (!mShaderProgram && prepareGL()) {
+        mShaderProgram = buildShaderProgram(vtxShader_externalTexture,
+                                            pixShader_externalTexture,
+                                            "externalTexture");
+    }
+    if (!mShaderProgram) {
+        LOG(WARNING) << "Copying camera frames on the CPU";
+    }
+
     return true;
 }
 
 
 void RenderPixelCopy::deactivate() {
     mStreamHandler = nullptr;
+    releaseSourceImages();
 }
 
 
 bool RenderPixelCopy::drawFrame(const BufferDesc& tgtBuffer) {
+    // Make sure we have the latest frame data
+    if (!mStreamHandler->newFrameAvailable()) {
+        mFrameTimestampUs = 0;
+        return true;
+    }
+
+    const BufferDesc& srcBuffer = mStreamHandler->getNewFrame();
+    mFrameTimestampUs = srcBuffer.timestamp;
+    bool success = mShaderProgram && blitOnGpu(srcBuffer, tgtBuffer);
+    if (!success) {
+        success = copyOnCpu(srcBuffer, tgtBuffer);
+    }
+    mStreamHandler->doneWithFrame(srcBuffer);
+
+    return success;
+}
+
+
+bool RenderPixelCopy::blitOnGpu(const BufferDesc& srcBuffer, const BufferDesc& tgtBuffer) {
+    SourceImage* source = getSourceImage(srcBuffer);
+    if (source == nullptr || !attachRenderTarget(tgtBuffer)) {
+        return false;
+    }
+
+    // Like the CPU copy, the frame isn't scaled and whatever it doesn't cover is black
+    const AHardwareBuffer_Desc* pSrcDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&srcBuffer.buffer.description);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glViewport(0, 0, std::min(sWidth, pSrcDesc->width), std::min(sHeight, pSrcDesc->height));
+    const GLfloat srcWidth = std::min(1.0f, (GLfloat)sWidth / pSrcDesc->width);
+    const GLfloat srcHeight = std::min(1.0f, (GLfloat)sHeight / pSrcDesc->height);
+
+    glUseProgram(mShaderProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, source->texture);
+    glUniform1i(glGetUniformLocation(mShaderProgram, "tex"), 0);
+    glDisable(GL_BLEND);
+
+    // The first rows of both buffers are at the bottom of the clip space
+    const GLfloat vertsPos[] = { -1.0f,  1.0f, 0.0f,
+                                  1.0f,  1.0f, 0.0f,
+                                 -1.0f, -1.0f, 0.0f,
+                                  1.0f, -1.0f, 0.0f };
+    const GLfloat vertsTex[] = { 0.0f,     srcHeight,
+                                 srcWidth, srcHeight,
+                                 0.0f,     0.0f,
+                                 srcWidth, 0.0f };
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertsPos);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, vertsTex);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glDisableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+
+    drawTimestampMarker(srcBuffer.timestamp);
+
+    // The camera buffer goes back once the GPU is done reading it
+    glFinish();
+    detachRenderTarget();
+
+    return true;
+}
+
+
+RenderPixelCopy::SourceImage* RenderPixelCopy::getSourceImage(const BufferDesc& buffer) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&buffer.buffer.description);
+
+    auto it = mSourceImages.find(buffer.bufferId);
+    if (it != mSourceImages.end()) {
+        const sp<GraphicBuffer>& gfxBuffer = it->second.graphicBuffer;
+        if (gfxBuffer->getWidth() == pDesc->width &&
+            gfxBuffer->getHeight() == pDesc->height &&
+            gfxBuffer->getPixelFormat() == static_cast<android::PixelFormat>(pDesc->format) &&
+            gfxBuffer->getStride() == pDesc->stride) {
+            return &it->second;
+        }
+
+        // The camera reused the id for a different buffer
+        glDeleteTextures(1, &it->second.texture);
+        eglDestroyImageKHR(sDisplay, it->second.image);
+        mSourceImages.erase(it);
+    }
+
+    SourceImage source;
+    source.graphicBuffer = new GraphicBuffer(buffer.buffer.nativeHandle,
+                                             GraphicBuffer::CLONE_HANDLE,
+                                             pDesc->width,
+                                             pDesc->height,
+                                             pDesc->format,
+                                             1,
+                                             GRALLOC_USAGE_HW_TEXTURE,
+                                             pDesc->stride);
+    if (source.graphicBuffer.get() == nullptr) {
+        LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
+        return nullptr;
+    }
+
+    EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    EGLClientBuffer clientBuf =
+            static_cast<EGLClientBuffer>(source.graphicBuffer->getNativeBuffer());
+    source.image = eglCreateImageKHR(sDisplay, EGL_NO_CONTEXT,
+                                     EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                     eglImageAttributes);
+    if (source.image == EGL_NO_IMAGE_KHR) {
+        LOG(ERROR) << "Error creating EGLImage for camera buffer: " << getEGLError();
+        return nullptr;
+    }
+
+    glGenTextures(1, &source.texture);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, source.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, static_cast<GLeglImageOES>(source.image));
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return &mSourceImages.emplace(buffer.bufferId, std::move(source)).first->second;
+}
+
+
+void RenderPixelCopy::releaseSourceImages() {
+    for (auto&& [id, source] : mSourceImages) {
+        glDeleteTextures(1, &source.texture);
+        eglDestroyImageKHR(sDisplay, source.image);
+    }
+    mSourceImages.clear();
+}
+
+
+bool RenderPixelCopy::copyOnCpu(const BufferDesc& srcBuffer, const BufferDesc& tgtBuffer) {
     bool success = true;
     const AHardwareBuffer_Desc* pTgtDesc =
         reinterpret_cast<const AHardwareBuffer_Desc *>(&tgtBuffer.buffer.description);
@@ -86,55 +235,51 @@ bool RenderPixelCopy::drawFrame(const BufferDesc& tgtBuffer) {
             LOG(ERROR) << "Diplay buffer is always expected to be 32bit RGBA";
             success = false;
         } else {
-            // Make sure we have the latest frame data
-            if (mStreamHandler->newFrameAvailable()) {
-                const BufferDesc& srcBuffer = mStreamHandler->getNewFrame();
-                const AHardwareBuffer_Desc* pSrcDesc =
-                    reinterpret_cast<const AHardwareBuffer_Desc *>(&srcBuffer.buffer.description);
-
-                // Lock our source buffer for reading (current expectation are for this to be NV21 format)
-                sp<android::GraphicBuffer> src = new android::GraphicBuffer(srcBuffer.buffer.nativeHandle,
-                                                                            android::GraphicBuffer::CLONE_HANDLE,
-                                                                            pSrcDesc->width,
-                                                                            pSrcDesc->height,
-                                                                            pSrcDesc->format,
-                                                                            pSrcDesc->layers,
-                                                                            pSrcDesc->usage,
-                                                                            pSrcDesc->stride);
-
-                unsigned char* srcPixels = nullptr;
-                src->lock(GRALLOC_USAGE_SW_READ_OFTEN, (void**)&srcPixels);
-                if (srcPixels != nullptr) {
-                    // Make sure we don't run off the end of either buffer
-                    const unsigned width  = std::min(pTgtDesc->width,
-                                                     pSrcDesc->width);
-                    const unsigned height = std::min(pTgtDesc->height,
-                                                     pSrcDesc->height);
-
-                    if (pSrcDesc->format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {   // 420SP == NV21
-                        copyNV21toRGB32(width, height,
-                                        srcPixels,
-                                        tgtPixels, pTgtDesc->stride);
-                    } else if (pSrcDesc->format == HAL_PIXEL_FORMAT_YV12) { // YUV_420P == YV12
-                        copyYV12toRGB32(width, height,
-                                        srcPixels,
-                                        tgtPixels, pTgtDesc->stride);
-                    } else if (pSrcDesc->format == HAL_PIXEL_FORMAT_YCBCR_422_I) { // YUYV
-                        copyYUYVtoRGB32(width, height,
-                                        srcPixels, pSrcDesc->stride,
-                                        tgtPixels, pTgtDesc->stride);
-                    } else if (pSrcDesc->format == pTgtDesc->format) {  // 32bit RGBA
-                        copyMatchedInterleavedFormats(width, height,
-                                                      srcPixels, pSrcDesc->stride,
-                                                      tgtPixels, pTgtDesc->stride,
-                                                      tgtBuffer.pixelSize);
-                    }
-                } else {
-                    LOG(ERROR) << "Failed to get pointer into src image data";
-                    success = false;
-                }
+            const AHardwareBuffer_Desc* pSrcDesc =
+                reinterpret_cast<const AHardwareBuffer_Desc *>(&srcBuffer.buffer.description);
+
+            // Lock our source buffer for reading (current expectation are for this to be NV21 format)
+            sp<android::GraphicBuffer> src = new android::GraphicBuffer(srcBuffer.buffer.nativeHandle,
+                                                                        android::GraphicBuffer::CLONE_HANDLE,
+                                                                        pSrcDesc->width,
+                                                                        pSrcDesc->height,
+                                                                        pSrcDesc->format,
+                                                                        pSrcDesc->layers,
+                                                                        pSrcDesc->usage,
+                                                                        pSrcDesc->stride);
 
-                mStreamHandler->doneWithFrame(srcBuffer);
+            unsigned char* srcPixels = nullptr;
+            src->lock(GRALLOC_USAGE_SW_READ_OFTEN, (void**)&srcPixels);
+            if (srcPixels != nullptr) {
+                // Make sure we don't run off the end of either buffer
+                const unsigned width  = std::min(pTgtDesc->width,
+                                                 pSrcDesc->width);
+                const unsigned height = std::min(pTgtDesc->height,
+                                                 pSrcDesc->height);
+
+                if (pSrcDesc->format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {   // 420SP == NV21
+                    copyNV21toRGB32(width, height,
+                                    srcPixels,
+                                    tgtPixels, pTgtDesc->stride);
+                } else if (pSrcDesc->format == HAL_PIXEL_FORMAT_YV12) { // YUV_420P == YV12
+                    copyYV12toRGB32(width, height,
+                                    srcPixels,
+                                    tgtPixels, pTgtDesc->stride);
+                } else if (pSrcDesc->format == HAL_PIXEL_FORMAT_YCBCR_422_I) { // YUYV
+                    copyYUYVtoRGB32(width, height,
+                                    srcPixels, pSrcDesc->stride,
+                                    tgtPixels, pTgtDesc->stride);
+                } else if (pSrcDesc->format == pTgtDesc->format) {  // 32bit RGBA
+                    copyMatchedInterleavedFormats(width, height,
+                                                  srcPixels, pSrcDesc->stride,
+                                                  tgtPixels, pTgtDesc->stride,
+                                                  tgtBuffer.pixelSize);
+                }
+                drawTimestampMarker(srcBuffer.timestamp, tgtPixels,
+                                    pTgtDesc->width, pTgtDesc->height, pTgtDesc->stride);
+            } else {
+                LOG(ERROR) << "Failed to get pointer into src image data";
+                success = false;
             }
         }
     } else {
@@ -24,12 +24,15 @@
 #include "ConfigManager.h"
 #include "VideoTex.h"
 
+#include <unordered_map>
+
 
 using namespace ::android::hardware::automotive::evs::V1_1;
 
 
 /*
- * Renders the view from a single specified camera directly to the full display.
+ * Renders the view from a single specified camera directly to the full display.  The GPU copies
+ * and converts the frames in a single pass if GLES is available; the CPU does otherwise.
  */
 class RenderPixelCopy: public RenderBase {
 public:
@@ -40,11 +43,34 @@ public:
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer);
 
+    virtual const char* getName() const override { return "RenderPixelCopy"; }
+
 protected:
+    // A camera buffer imported as an external texture.  The camera cycles through a fixed set
+    // of buffers, so these are kept rather than recreated for every frame.
+    struct SourceImage {
+        sp<GraphicBuffer>   graphicBuffer;
+        EGLImageKHR         image = EGL_NO_IMAGE_KHR;
+        GLuint              texture = 0;
+    };
+
+    // Renders |srcBuffer| into |tgtBuffer|.  Returns false if either buffer can't be used by
+    // the GPU, so the frame can be copied on the CPU instead.
+    bool blitOnGpu(const BufferDesc& srcBuffer, const BufferDesc& tgtBuffer);
+    bool copyOnCpu(const BufferDesc& srcBuffer, const BufferDesc& tgtBuffer);
+
+    SourceImage* getSourceImage(const BufferDesc& buffer);
+    void releaseSourceImages();
+
     sp<IEvsEnumerator>              mEnumerator;
     ConfigManager::CameraInfo       mCameraInfo;
 
     sp<StreamHandler>               mStreamHandler;
+
+    // Zero if the frames are copied on the CPU
+    GLuint                          mShaderProgram = 0;
+    std::unordered_map<uint32_t, SourceImage>
+                                    mSourceImages;      // By bufferId
 };
 
 
@@ -23,9 +23,12 @@
 
 #include <math/mat4.h>
 #include <math/vec3.h>
+#include <math/vec4.h>
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <android-base/logging.h>
 
+#include <algorithm>
+
 using ::android::hardware::camera::device::V3_2::Stream;
 
 
@@ -36,6 +39,16 @@ static const unsigned Z = 2;
 //static const unsigned W = 3;
 
 
+// The number of cameras the projectedTexture shader can combine in one pass
+static const unsigned kMaxCamerasPerPass = 4;
+
+// Each ground plane vertex holds its position followed by its projection into every camera of
+// its group
+static const unsigned kPositionFloats = 3;
+static const unsigned kProjectedFloats = 4;
+static const unsigned kVertexFloats = kPositionFloats + kProjectedFloats * kMaxCamerasPerPass;
+
+
 // Since we assume no roll in these views, we can simplify the required math
 static android::vec3 unitVectorFromPitchAndYaw(float pitch, float yaw) {
     float sinPitch, cosPitch;
@@ -132,6 +145,12 @@ bool RenderTopView::activate() {
         return false;
     }
 
+    // Each camera of a pass samples from the texture unit matching its slot
+    const GLint texUnits[kMaxCamerasPerPass] = { 0, 1, 2, 3 };
+    glUseProgram(mPgmAssets.projectedTexture);
+    GLint locTex = glGetUniformLocation(mPgmAssets.projectedTexture, "tex");
+    glUniform1iv(locTex, kMaxCamerasPerPass, texUnits);
+
 
     // Load the checkerboard text image
     mTexAssets.checkerBoard.reset(createTextureFromPng(
@@ -176,6 +195,8 @@ void RenderTopView::deactivate() {
     for (auto&& cam: mActiveCameras) {
         cam.tex = nullptr;
     }
+
+    releaseGroundMeshes();
 }
 
 
@@ -202,23 +223,39 @@ bool RenderTopView::drawFrame(const BufferDesc& tgtBuffer) {
 //    orthoMatrix = android::mat4::ortho(left, right, bottom, top, near, far);
     orthoMatrix = android::mat4::ortho(left, right, top, bottom, near, far);
 
+    // The cameras don't move, so their projections of the ground plane only need computing
+    // again if the shape of the display changes.  We don't know that shape until we have a
+    // render target, so this can't happen in activate().
+    if (mSensorGroups.empty() || mMeshAspectRatio != sAspectRatio) {
+        buildGroundMeshes();
+    }
 
     // Refresh our video texture contents.  We do it all at once in hopes of getting
     // better coherence among images.  This does not guarantee synchronization, of course...
+    mFrameTimestampUs = 0;
+    int64_t oldestShownUs = 0;
     for (auto&& cam: mActiveCameras) {
         if (cam.tex) {
-            cam.tex->refresh();
+            if (cam.tex->refresh() &&
+                (mFrameTimestampUs == 0 || cam.tex->getFrameTimestamp() < mFrameTimestampUs)) {
+                mFrameTimestampUs = cam.tex->getFrameTimestamp();
+            }
+            if (oldestShownUs == 0 || cam.tex->getFrameTimestamp() < oldestShownUs) {
+                oldestShownUs = cam.tex->getFrameTimestamp();
+            }
         }
     }
 
-    // Iterate over all the cameras and project their images onto the ground plane
-    for (auto&& cam: mActiveCameras) {
-        renderCameraOntoGroundPlane(cam);
+    // Project the images of all the cameras onto the ground plane
+    for (auto&& group: mSensorGroups) {
+        renderCamerasOntoGroundPlane(group);
     }
 
     // Draw the car image
     renderCarTopView();
 
+    drawTimestampMarker(oldestShownUs);
+
     // Now that everythign is submitted, release our hold on the texture resource
     detachRenderTarget();
 
@@ -289,18 +326,14 @@ void RenderTopView::renderCarTopView() {
 // http://math.stackexchange.com/questions/1691895/inverse-of-perspective-matrix
 // to see if that simplifies the math, although we'll still want to compute the actual ground
 // interception points taking into account the pitchLimit as below.
-void RenderTopView::renderCameraOntoGroundPlane(const ActiveCamera& cam) {
+void RenderTopView::buildGroundMeshes() {
+    releaseGroundMeshes();
+
     // How far is the farthest any camera should even consider projecting it's image?
     const float visibleSizeV = mConfig.getDisplayTopLocation() - mConfig.getDisplayBottomLocation();
     const float visibleSizeH = visibleSizeV * sAspectRatio;
     const float maxRange = (visibleSizeH > visibleSizeV) ? visibleSizeH : visibleSizeV;
 
-    // Construct the projection matrix (View + Projection) associated with this sensor
-    // TODO:  Consider just hard coding the far plane distance as it likely doesn't matter
-    const android::mat4 V = cameraLookMatrix(cam.info);
-    const android::mat4 P = perspective(cam.info.hfov, cam.info.vfov, cam.info.position[Z], maxRange);
-    const android::mat4 projectionMatix = P*V;
-
     // Just draw the whole darn ground plane for now -- we're wasting fill rate, but so what?
     // A 2x optimization would be to draw only the 1/2 space of the window in the direction
     // the sensor is facing.  A more complex solution would be to construct the intersection
@@ -312,18 +345,80 @@ void RenderTopView::renderCameraOntoGroundPlane(const ActiveCamera& cam) {
     const float right =  wsWidth * 0.5f;
     const float left = -right;
 
-    const android::vec3 topLeft(left, top, 0.0f);
-    const android::vec3 topRight(right, top, 0.0f);
-    const android::vec3 botLeft(left, bottom, 0.0f);
-    const android::vec3 botRight(right, bottom, 0.0f);
-
-    GLfloat vertsPos[] = { topLeft[X],  topLeft[Y],  topLeft[Z],
-                           topRight[X], topRight[Y], topRight[Z],
-                           botLeft[X],  botLeft[Y],  botLeft[Z],
-                           botRight[X], botRight[Y], botRight[Z],
+    const android::vec4 corners[] = {
+        android::vec4(left,  top,    0.0f, 1.0f),
+        android::vec4(right, top,    0.0f, 1.0f),
+        android::vec4(left,  bottom, 0.0f, 1.0f),
+        android::vec4(right, bottom, 0.0f, 1.0f),
     };
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertsPos);
+    const unsigned numCorners = sizeof(corners) / sizeof(corners[0]);
+
+    for (unsigned first = 0; first < mActiveCameras.size(); first += kMaxCamerasPerPass) {
+        SensorGroup group = {};
+        group.firstCamera = first;
+        group.numCameras = std::min<unsigned>(kMaxCamerasPerPass,
+                                              mActiveCameras.size() - first);
+
+        // Slots of the group without a camera keep w == 0, which the shader never samples
+        GLfloat verts[numCorners * kVertexFloats] = {};
+        for (unsigned v = 0; v < numCorners; v++) {
+            GLfloat* vert = verts + v * kVertexFloats;
+            vert[X] = corners[v][X];
+            vert[Y] = corners[v][Y];
+            vert[Z] = corners[v][Z];
+        }
+
+        for (unsigned i = 0; i < group.numCameras; i++) {
+            const ConfigManager::CameraInfo& info = mActiveCameras[first + i].info;
+
+            // Construct the projection matrix (View + Projection) associated with this sensor
+            // TODO:  Consider just hard coding the far plane distance as it likely doesn't matter
+            const android::mat4 V = cameraLookMatrix(info);
+            const android::mat4 P = perspective(info.hfov, info.vfov, info.position[Z], maxRange);
+            const android::mat4 projectionMatrix = P*V;
+
+            // The projection is linear, so projecting the corners here and letting GL
+            // interpolate gives the same result as projecting every fragment
+            for (unsigned v = 0; v < numCorners; v++) {
+                const android::vec4 projected = projectionMatrix * corners[v];
+                GLfloat* dst = verts + v * kVertexFloats + kPositionFloats + i * kProjectedFloats;
+                for (unsigned c = 0; c < kProjectedFloats; c++) {
+                    dst[c] = projected[c];
+                }
+            }
+        }
+
+        glGenBuffers(1, &group.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, group.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
+        mSensorGroups.push_back(group);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mMeshAspectRatio = sAspectRatio;
+}
+
+
+void RenderTopView::releaseGroundMeshes() {
+    for (auto&& group: mSensorGroups) {
+        glDeleteBuffers(1, &group.vertexBuffer);
+    }
+    mSensorGroups.clear();
+}
+
+
+void RenderTopView::renderCamerasOntoGroundPlane(const SensorGroup& group) {
+    const GLsizei stride = kVertexFloats * sizeof(GLfloat);
+
+    glBindBuffer(GL_ARRAY_BUFFER, group.vertexBuffer);
+    glVertexAttribPointer(0, kPositionFloats, GL_FLOAT, GL_FALSE, stride, 0);
     glEnableVertexAttribArray(0);
+    for (unsigned i = 0; i < kMaxCamerasPerPass; i++) {
+        const uintptr_t offset = (kPositionFloats + i * kProjectedFloats) * sizeof(GLfloat);
+        glVertexAttribPointer(1 + i, kProjectedFloats, GL_FLOAT, GL_FALSE, stride,
+                              reinterpret_cast<const void*>(offset));
+        glEnableVertexAttribArray(1 + i);
+    }
 
 
     glDisable(GL_BLEND);
@@ -331,19 +426,27 @@ void RenderTopView::renderCameraOntoGroundPlane(const ActiveCamera& cam) {
     glUseProgram(mPgmAssets.projectedTexture);
     GLint locCam = glGetUniformLocation(mPgmAssets.projectedTexture, "cameraMat");
     glUniformMatrix4fv(locCam, 1, false, orthoMatrix.asArray());
-    GLint locProj = glGetUniformLocation(mPgmAssets.projectedTexture, "projectionMat");
-    glUniformMatrix4fv(locProj, 1, false, projectionMatix.asArray());
-
-    GLuint texId;
-    if (cam.tex) {
-        texId = cam.tex->glId();
-    } else {
-        texId = mTexAssets.checkerBoard->glId();
+    GLint locCount = glGetUniformLocation(mPgmAssets.projectedTexture, "numSensors");
+    glUniform1i(locCount, group.numCameras);
+
+    for (unsigned i = 0; i < group.numCameras; i++) {
+        const ActiveCamera& cam = mActiveCameras[group.firstCamera + i];
+        GLuint texId;
+        if (cam.tex) {
+            texId = cam.tex->glId();
+        } else {
+            texId = mTexAssets.checkerBoard->glId();
+        }
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, texId);
     }
-    glBindTexture(GL_TEXTURE_2D, texId);
+    glActiveTexture(GL_TEXTURE0);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
 
-    glDisableVertexAttribArray(0);
+    for (unsigned i = 0; i <= kMaxCamerasPerPass; i++) {
+        glDisableVertexAttribArray(i);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
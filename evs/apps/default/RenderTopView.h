@@ -44,6 +44,8 @@ public:
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer);
 
+    virtual const char* getName() const override { return "RenderTopView"; }
+
 protected:
     struct ActiveCamera {
         const ConfigManager::CameraInfo&    info;
@@ -52,12 +54,24 @@ protected:
         ActiveCamera(const ConfigManager::CameraInfo& c) : info(c) {};
     };
 
+    // A batch of cameras projected onto the ground plane in a single draw call, along with
+    // the ground geometry carrying each vertex's position as seen by each of those cameras
+    struct SensorGroup {
+        unsigned    firstCamera;
+        unsigned    numCameras;
+        GLuint      vertexBuffer;
+    };
+
     void renderCarTopView();
-    void renderCameraOntoGroundPlane(const ActiveCamera& cam);
+    void buildGroundMeshes();
+    void releaseGroundMeshes();
+    void renderCamerasOntoGroundPlane(const SensorGroup& group);
 
     sp<IEvsEnumerator>              mEnumerator;
     const ConfigManager&            mConfig;
     std::vector<ActiveCamera>       mActiveCameras;
+    std::vector<SensorGroup>        mSensorGroups;
+    float                           mMeshAspectRatio = 0.0f;
 
     struct {
         std::unique_ptr<TexWrapper> checkerBoard;
@@ -160,19 +160,33 @@ bool StreamHandler::newFrameAvailable() {
 }
 
 
+bool StreamHandler::waitForNewFrame(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mLock);
+    return mSignal.wait_for(lock, timeout, [this]() {
+        return mReadyBuffer >= 0 || !mRunning;
+    }) && mReadyBuffer >= 0;
+}
+
+
 const BufferDesc_1_1& StreamHandler::getNewFrame() {
     std::unique_lock<std::mutex> lock(mLock);
 
-    if (mHeldBuffer >= 0) {
-        LOG(ERROR) << "Ignored call for new frame while still holding the old one.";
+    int numHeld = 0;
+    for (auto&& held : mHeld) {
+        numHeld += held ? 1 : 0;
+    }
+
+    if (numHeld >= kMaxHeldBuffers) {
+        LOG(ERROR) << "Ignored call for new frame while still holding " << numHeld << " frames.";
     } else {
         if (mReadyBuffer < 0) {
             LOG(ERROR) << "Returning invalid buffer because we don't have any.  "
                        << "Call newFrameAvailable first?";
-            mReadyBuffer = 0;   // This is a lie!
+            mReadyBuffer = freeSlot_Locked();   // This is a lie!
         }
 
         // Move the ready buffer into the held position, and clear the ready position
+        mHeld[mReadyBuffer] = true;
         mHeldBuffer = mReadyBuffer;
         mReadyBuffer = -1;
     }
@@ -184,22 +198,44 @@ const BufferDesc_1_1& StreamHandler::getNewFrame() {
 void StreamHandler::doneWithFrame(const BufferDesc_1_1& bufDesc_1_1) {
     std::unique_lock<std::mutex> lock(mLock);
 
-    // We better be getting back the buffer we original delivered!
-    if ((mHeldBuffer < 0) || (bufDesc_1_1.bufferId != mBuffers[mHeldBuffer].bufferId)) {
+    // We better be getting back a buffer we original delivered!
+    int slot = -1;
+    for (int i = 0; i <= kMaxHeldBuffers; ++i) {
+        if (mHeld[i] && mBuffers[i].bufferId == bufDesc_1_1.bufferId) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
         LOG(ERROR) << "StreamHandler::doneWithFrame got an unexpected bufDesc_1_1!";
+        return;
     }
 
     // Send the buffer back to the underlying camera
     hidl_vec<BufferDesc_1_1> frames;
     frames.resize(1);
-    frames[0] = mBuffers[mHeldBuffer];
+    frames[0] = mBuffers[slot];
     auto ret = mCamera->doneWithFrame_1_1(frames);
     if (!ret.isOk()) {
         LOG(WARNING) << __FUNCTION__ << " fails to return a buffer";
     }
 
     // Clear the held position
-    mHeldBuffer = -1;
+    mHeld[slot] = false;
+    if (mHeldBuffer == slot) {
+        mHeldBuffer = -1;
+    }
+}
+
+
+int StreamHandler::freeSlot_Locked() const {
+    // With at most kMaxHeldBuffers held there is always one left
+    for (int i = 0; i <= kMaxHeldBuffers; ++i) {
+        if (!mHeld[i]) {
+            return i;
+        }
+    }
+    return 0;
 }
 
 
@@ -237,12 +273,9 @@ Return<void> StreamHandler::deliverFrame_1_1(const hidl_vec<BufferDesc_1_1>& buf
             }
 
             // We'll reuse the same ready buffer index
-        } else if (mHeldBuffer >= 0) {
-            // The client is holding a buffer, so use the other slot for "on deck"
-            mReadyBuffer = 1 - mHeldBuffer;
         } else {
-            // This is our first buffer, so just pick a slot
-            mReadyBuffer = 0;
+            // Use a slot the client isn't holding for "on deck"
+            mReadyBuffer = freeSlot_Locked();
         }
 
         // Save this frame until our client is interested in it
@@ -17,6 +17,7 @@
 #ifndef EVS_VTS_STREAMHANDLER_H
 #define EVS_VTS_STREAMHANDLER_H
 
+#include <chrono>
 #include <queue>
 
 #include "ui/GraphicBuffer.h"
@@ -40,7 +41,8 @@ using BufferDesc_1_1  = ::android::hardware::automotive::evs::V1_1::BufferDesc;
 /*
  * StreamHandler:
  * This class can be used to receive camera imagery from an IEvsCamera implementation.  It will
- * hold onto the most recent image buffer, returning older ones.
+ * hold onto the most recent image buffer, returning older ones.  The client may hold up to two
+ * frames at a time.
  * Note that the video frames are delivered on a background thread, while the control interface
  * is actuated from the applications foreground thread.
  */
@@ -63,6 +65,7 @@ public:
     bool isRunning();
 
     bool newFrameAvailable();
+    bool waitForNewFrame(std::chrono::milliseconds timeout);  // false if none came in time
     const BufferDesc_1_1& getNewFrame();
     void doneWithFrame(const BufferDesc_1_1& buffer);
 
@@ -74,6 +77,9 @@ private:
     Return<void> deliverFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffer)  override;
     Return<void> notify(const EvsEventDesc& event) override;
 
+    // Returns a slot the client isn't holding.  Called with mLock held.
+    int freeSlot_Locked() const;
+
     // Values initialized as startup
     android::sp <IEvsCamera>    mCamera;
 
@@ -85,8 +91,13 @@ private:
 
     bool                        mRunning = false;
 
-    BufferDesc                  mBuffers[2];
-    int                         mHeldBuffer = -1;   // Index of the one currently held by the client
+    // The client may hold this many frames at once, so it can keep sampling one while it starts
+    // on the next.  One more slot keeps the newest frame ready for it.
+    static const int            kMaxHeldBuffers = 2;
+
+    BufferDesc                  mBuffers[kMaxHeldBuffers + 1];
+    bool                        mHeld[kMaxHeldBuffers + 1] = {};
+    int                         mHeldBuffer = -1;   // Index of the newest one held by the client
     int                         mReadyBuffer = -1;  // Index of the newest available buffer
     hidl_vec<BufferDesc_1_1>    mOwnBuffers;
     bool                        mUseOwnBuffers;
@@ -29,10 +29,7 @@
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <android-base/logging.h>
 
-// Eventually we shouldn't need this dependency, but for now the
-// graphics allocator interface isn't fully supported on all platforms
-// and this is our work around.
-using ::android::GraphicBuffer;
+using ::android::hardware::automotive::evs::V1_0::EvsResult;
 
 
 VideoTex::VideoTex(sp<IEvsEnumerator> pEnum,
@@ -51,82 +48,201 @@ VideoTex::~VideoTex() {
     // Tell the stream to stop flowing
     mStreamHandler->asyncStopStream();
 
+    // Give back the frames we still hold
+    releaseImageBuffers();
+
     // Close the camera
     mEnumerator->closeCamera(mCamera);
 
-    // Drop our device texture image
-    if (mKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(mDisplay, mKHRimage);
-        mKHRimage = EGL_NO_IMAGE_KHR;
+    // Drop our device texture images
+    for (auto&& [id, source] : mSourceImages) {
+        eglDestroyImageKHR(mDisplay, source.image);
     }
+    mSourceImages.clear();
 }
 
 
 // Return true if the texture contents are changed
 bool VideoTex::refresh() {
+    // Give the frame we showed before back to the camera if the GPU is done with it.  We can
+    // only take a new frame once it's gone, but by the time a new one has arrived the draw calls
+    // reading the old one have almost always completed.
+    if (!retireImageBuffer(false)) {
+        if (!mStreamHandler->newFrameAvailable()) {
+            return false;
+        }
+        retireImageBuffer(true);
+    }
+
     if (!mStreamHandler->newFrameAvailable()) {
         // No new image has been delivered, so there's nothing to do here
         return false;
     }
 
-    // If we already have an image backing us, then it's time to return it
+    // The frame we're showing now stays with us until the draw calls already issued against it
+    // have been executed, which the fence tells us
     if (mImageBuffer.buffer.nativeHandle.getNativeHandle() != nullptr) {
-        // Drop our device texture image
-        if (mKHRimage != EGL_NO_IMAGE_KHR) {
-            eglDestroyImageKHR(mDisplay, mKHRimage);
-            mKHRimage = EGL_NO_IMAGE_KHR;
+        mRetiredBuffer = mImageBuffer;
+        mRetiredFence = eglCreateSyncKHR(mDisplay, EGL_SYNC_FENCE_KHR, nullptr);
+        if (mRetiredFence == EGL_NO_SYNC_KHR) {
+            LOG(WARNING) << "Failed to create a fence: " << getEGLError();
         }
-
-        // Return it since we're done with it
-        mStreamHandler->doneWithFrame(mImageBuffer);
+        mImageBuffer = {};
     }
 
     // Get the new image we want to use as our contents
     mImageBuffer = mStreamHandler->getNewFrame();
+    mFrameTimestampUs = mImageBuffer.timestamp;
 
-
-    // create a GraphicBuffer from the existing handle
-    const AHardwareBuffer_Desc* pDesc =
-        reinterpret_cast<const AHardwareBuffer_Desc *>(&mImageBuffer.buffer.description);
-    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(mImageBuffer.buffer.nativeHandle,
-                                                     GraphicBuffer::CLONE_HANDLE,
-                                                     pDesc->width,
-                                                     pDesc->height,
-                                                     pDesc->format,
-                                                     1,//pDesc->layers,
-                                                     GRALLOC_USAGE_HW_TEXTURE,
-                                                     pDesc->stride);
-    if (pGfxBuffer.get() == nullptr) {
-        LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
+    EGLImageKHR image = getSourceImage(mImageBuffer);
+    if (image == EGL_NO_IMAGE_KHR) {
         // Returning "true" in this error condition because we already released the
         // previous image (if any) and so the texture may change in unpredictable ways now!
         return true;
     }
 
+    // Update the texture handle we already created to refer to this gralloc buffer
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, glId());
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(image));
+
+    // Initialize the sampling properties (it seems the sample may not work if this isn't done)
+    // The user of this texture may very well want to set their own filtering, but we're going
+    // to pay the (minor) price of setting this up for them to avoid the dreaded "black image"
+    // if they forget.  They belong to the texture object, so once is enough.
+    if (!mSamplingSet) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        mSamplingSet = true;
+    }
+
+    return true;
+}
+
+
+EGLImageKHR VideoTex::getSourceImage(const BufferDesc& buffer) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&buffer.buffer.description);
+
+    auto it = mSourceImages.find(buffer.bufferId);
+    if (it != mSourceImages.end()) {
+        const sp<GraphicBuffer>& gfxBuffer = it->second.graphicBuffer;
+        if (gfxBuffer->getWidth() == pDesc->width &&
+            gfxBuffer->getHeight() == pDesc->height &&
+            gfxBuffer->getPixelFormat() == static_cast<android::PixelFormat>(pDesc->format) &&
+            gfxBuffer->getStride() == pDesc->stride) {
+            return it->second.image;
+        }
+
+        // The camera reused the id for a different buffer
+        eglDestroyImageKHR(mDisplay, it->second.image);
+        mSourceImages.erase(it);
+    }
+
+    // create a GraphicBuffer from the existing handle
+    SourceImage source;
+    source.graphicBuffer = new GraphicBuffer(buffer.buffer.nativeHandle,
+                                             GraphicBuffer::CLONE_HANDLE,
+                                             pDesc->width,
+                                             pDesc->height,
+                                             pDesc->format,
+                                             1,//pDesc->layers,
+                                             GRALLOC_USAGE_HW_TEXTURE,
+                                             pDesc->stride);
+    if (source.graphicBuffer.get() == nullptr) {
+        LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
+        return EGL_NO_IMAGE_KHR;
+    }
+
     // Get a GL compatible reference to the graphics buffer we've been given
     EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
-    EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-    mKHRimage = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
-                                  EGL_NATIVE_BUFFER_ANDROID, clientBuf,
-                                  eglImageAttributes);
-    if (mKHRimage == EGL_NO_IMAGE_KHR) {
+    EGLClientBuffer clientBuf =
+            static_cast<EGLClientBuffer>(source.graphicBuffer->getNativeBuffer());
+    source.image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
+                                     EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                     eglImageAttributes);
+    if (source.image == EGL_NO_IMAGE_KHR) {
         const char *msg = getEGLError();
         LOG(ERROR) << "Error creating EGLImage: " << msg;
+        return EGL_NO_IMAGE_KHR;
+    }
+
+    mSourceImages[buffer.bufferId] = source;
+    return source.image;
+}
+
+
+// Returns the retired frame to the camera if the GPU is done reading it, or waits for that if
+// |wait| is set.  Returns true if we no longer hold a retired frame.
+bool VideoTex::retireImageBuffer(bool wait) {
+    if (mRetiredBuffer.buffer.nativeHandle.getNativeHandle() == nullptr) {
+        return true;
+    }
+
+    if (mRetiredFence != EGL_NO_SYNC_KHR) {
+        const EGLint result = eglClientWaitSyncKHR(mDisplay, mRetiredFence,
+                                                   EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+                                                   wait ? EGL_FOREVER_KHR : 0);
+        if (result == EGL_TIMEOUT_EXPIRED_KHR) {
+            return false;
+        } else if (result != EGL_CONDITION_SATISFIED_KHR) {
+            LOG(WARNING) << "Failed to wait for the GPU to release a frame: " << getEGLError();
+            glFinish();
+        }
+        eglDestroySyncKHR(mDisplay, mRetiredFence);
+        mRetiredFence = EGL_NO_SYNC_KHR;
     } else {
-        // Update the texture handle we already created to refer to this gralloc buffer
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, glId());
-        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(mKHRimage));
-
-        // Initialize the sampling properties (it seems the sample may not work if this isn't done)
-        // The user of this texture may very well want to set their own filtering, but we're going
-        // to pay the (minor) price of setting this up for them to avoid the dreaded "black image"
-        // if they forget.
-        // TODO:  Can we do this once for the texture ID rather than ever refresh?
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // Without a fence we can't tell, so make sure
+        glFinish();
+    }
+
+    mStreamHandler->doneWithFrame(mRetiredBuffer);
+    mRetiredBuffer = {};
+    return true;
+}
+
+
+void VideoTex::releaseImageBuffers() {
+    retireImageBuffer(true);
+
+    if (mImageBuffer.buffer.nativeHandle.getNativeHandle() != nullptr) {
+        glFinish();
+        mStreamHandler->doneWithFrame(mImageBuffer);
+        mImageBuffer = {};
+    }
+}
+
+
+bool VideoTex::presentFrame(const sp<IEvsDisplay>& display) {
+    // Don't show the same frame again if the camera is slower than the display
+    if (!mStreamHandler->waitForNewFrame(std::chrono::milliseconds(100))) {
+        return true;
+    }
+
+    // The display is done with the frame once it returns, so drop the ones we held as well
+    releaseImageBuffers();
+
+    const BufferDesc_1_1& frame = mStreamHandler->getNewFrame();
+    mFrameTimestampUs = frame.timestamp;
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&frame.buffer.description);
+    BufferDesc_1_0 buffer = {};
+    buffer.width     = pDesc->width;
+    buffer.height    = pDesc->height;
+    buffer.stride    = pDesc->stride;
+    buffer.pixelSize = frame.pixelSize;
+    buffer.format    = pDesc->format;
+    buffer.usage     = pDesc->usage;
+    buffer.bufferId  = frame.bufferId;
+    buffer.memHandle = frame.buffer.nativeHandle.getNativeHandle();
+
+    const EvsResult result = display->returnTargetBufferForDisplay(buffer);
+    mStreamHandler->doneWithFrame(frame);
+    if (result != EvsResult::OK) {
+        LOG(ERROR) << "Display didn't take a camera frame, " << toString(result);
+        return false;
     }
 
     return true;
@@ -147,7 +263,7 @@ VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
 
         // Initialize the stream that will help us update this texture's contents
         pStreamHandler = new StreamHandler(pCamera,
-                                           2,     // number of buffers
+                                           4,     // shown, retiring, ready and capturing
                                            useExternalMemory,
                                            format,
                                            streamCfg->width,
@@ -159,7 +275,7 @@ VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
 
         // Initialize the stream with the default resolution
         pStreamHandler = new StreamHandler(pCamera,
-                                           2,     // number of buffers
+                                           4,     // shown, retiring, ready and capturing
                                            useExternalMemory,
                                            format);
     }
@@ -29,7 +29,11 @@
 #include <android/hardware/automotive/evs/1.1/IEvsEnumerator.h>
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <system/graphics-base.h>
+#include <ui/GraphicBuffer.h>
 
+#include <unordered_map>
+
+using ::android::GraphicBuffer;
 using ::android::hardware::camera::device::V3_2::Stream;
 using namespace ::android::hardware::automotive::evs::V1_1;
 
@@ -48,19 +52,43 @@ public:
 
     bool refresh();     // returns true if the texture contents were updated
 
+    // Hands the next camera frame straight to |display| instead of the texture.  Returns false
+    // if the display didn't take it.
+    bool presentFrame(const sp<IEvsDisplay>& display);
+
+    // Capture time, in microseconds, of the frame shown or presented last
+    int64_t getFrameTimestamp() const { return mFrameTimestampUs; }
+
 private:
     VideoTex(sp<IEvsEnumerator> pEnum,
              sp<IEvsCamera> pCamera,
              sp<StreamHandler> pStreamHandler,
              EGLDisplay glDisplay);
 
+    // A camera buffer wrapped for GL.  The camera cycles through a fixed set of buffers, so we
+    // keep these around rather than recreating them for every frame.
+    struct SourceImage {
+        sp<GraphicBuffer>   graphicBuffer;
+        EGLImageKHR         image = EGL_NO_IMAGE_KHR;
+    };
+
+    EGLImageKHR getSourceImage(const BufferDesc& buffer);
+    bool retireImageBuffer(bool wait);
+    void releaseImageBuffers();
+
     sp<IEvsEnumerator>  mEnumerator;
     sp<IEvsCamera>      mCamera;
     sp<StreamHandler>   mStreamHandler;
-    BufferDesc          mImageBuffer;
+    BufferDesc          mImageBuffer;       // The frame the texture shows now
+
+    // The frame the texture showed before, which we return once the GPU is done reading it
+    BufferDesc          mRetiredBuffer;
+    EGLSyncKHR          mRetiredFence = EGL_NO_SYNC_KHR;
 
     EGLDisplay          mDisplay;
-    EGLImageKHR mKHRimage = EGL_NO_IMAGE_KHR;
+    std::unordered_map<uint32_t, SourceImage> mSourceImages;   // Keyed by bufferId
+    bool                mSamplingSet = false;
+    int64_t             mFrameTimestampUs = 0;
 };
 
 
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include "BootTimeline.h"
 #include "ConfigManager.h"
 #include "EvsStateControl.h"
 #include "EvsVehicleListener.h"
@@ -21,6 +22,8 @@
 #include <signal.h>
 #include <stdio.h>
 
+#include <future>
+
 #include <android/hardware/automotive/evs/1.1/IEvsDisplay.h>
 #include <android/hardware/automotive/evs/1.1/IEvsEnumerator.h>
 #include <android-base/logging.h>
@@ -44,6 +47,7 @@ namespace {
 
 const char* CONFIG_DEFAULT_PATH = "/system/etc/automotive/evs/config.json";
 const char* CONFIG_OVERRIDE_PATH = "/system/etc/automotive/evs/config_override.json";
+const char* CONFIG_CACHE_PATH = "/data/system/evs/config.bin";
 
 android::sp<IEvsEnumerator> pEvs;
 android::sp<IEvsDisplay> pDisplay;
@@ -103,6 +107,21 @@ static bool subscribeToVHal(sp<IVehicle> pVnet,
 }
 
 
+// Helper to subscribe to the vehicle state changes the EVS pipeline reacts to
+static bool subscribeToVehicleState(sp<IVehicle> pVnet, sp<IVehicleCallback> listener) {
+    // Changes in these values are what will trigger a reconfiguration of the EVS pipeline
+    if (!subscribeToVHal(pVnet, listener, VehicleProperty::GEAR_SELECTION)) {
+        LOG(ERROR) << "Without gear notification, we can't support EVS.  Exiting.";
+        return false;
+    }
+    if (!subscribeToVHal(pVnet, listener, VehicleProperty::TURN_SIGNAL_STATE)) {
+        LOG(WARNING) << "Didn't get turn signal notifications, so we'll ignore those.";
+    }
+
+    return true;
+}
+
+
 static bool convertStringToFormat(const char* str, android_pixel_format_t* output) {
     bool result = true;
     if (EqualsIgnoreCase(str, "RGBA8888")) {
@@ -125,6 +144,7 @@ static bool convertStringToFormat(const char* str, android_pixel_format_t* outpu
 int main(int argc, char** argv)
 {
     LOG(INFO) << "EVS app starting";
+    BootTimeline::mark(BootTimeline::APP_STARTED);
 
     // Register a signal handler
     registerSigHandler();
@@ -135,8 +155,12 @@ int main(int argc, char** argv)
     const char* evsServiceName = "default";
     int displayId = -1;
     bool useExternalMemory = false;
+    bool usePassthrough = false;
+    bool measureLatency = false;
     android_pixel_format_t extMemoryFormat = HAL_PIXEL_FORMAT_RGBA_8888;
     int32_t mockGearSignal = static_cast<int32_t>(VehicleGear::GEAR_REVERSE);
+    bool fastStart = false;
+    EvsStateControl::State stateUntilVehicle = EvsStateControl::REVERSE;
     for (int i=1; i< argc; i++) {
         if (strcmp(argv[i], "--test") == 0) {
             useVehicleHal = false;
@@ -163,6 +187,10 @@ int main(int argc, char** argv)
                     ++i;
                 }
             }
+        } else if (strcmp(argv[i], "--passthrough") == 0) {
+            usePassthrough = true;
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            measureLatency = true;
         } else if (strcmp(argv[i], "--gear") == 0) {
             // Gear signal to simulate
             i += 1; // increase an index to next argument
@@ -172,6 +200,17 @@ int main(int argc, char** argv)
                 LOG(WARNING) << "Unknown gear signal, " << argv[i] << ", is ignored "
                              << "and the reverse signal will be used instead";
             }
+        } else if (strcmp(argv[i], "--fast-start") == 0) {
+            fastStart = true;
+            if (i + 1 < argc) {
+                // Optional view to show until the gear is known; the reverse view by default
+                if (strcasecmp(argv[i + 1], "Off") == 0) {
+                    stateUntilVehicle = EvsStateControl::OFF;
+                    ++i;
+                } else if (strcasecmp(argv[i + 1], "Reverse") == 0) {
+                    ++i;
+                }
+            }
         } else {
             printf("Ignoring unrecognized command line arg '%s'\n", argv[i]);
             printHelp = true;
@@ -198,36 +237,62 @@ int main(int argc, char** argv)
                "followed by a single chrome plane with weaved V and U values.\n");
         printf("\t\tYUYV: Packed format with a half horizontal chrome resolution.  "
                "Known as YUV4:2:2.\n");
+        printf("  --passthrough\n\tHand camera frames straight to the display when they "
+               "don't need to be rotated or flipped.\n");
+        printf("  --latency\n\tLog histograms of the time from the capture of camera frames to "
+               "their presentation, per renderer, and draw the capture time of the frames into "
+               "the top left corner of the screen.\n");
+        printf("  --fast-start  <view>\n\t"
+               "Start showing camera frames without waiting for the Vehicle HAL, which is "
+               "connected in parallel.  Available views to show until the gear is known are "
+               "Reverse, the default, and Off (case insensitive).\n");
 
         return EXIT_FAILURE;
     }
 
+    // Set thread pool size to one to avoid concurrent events from the HAL.
+    // This pool will handle the EvsCameraStream callbacks.
+    // Note:  This _will_ run in parallel with the EvsListener run() loop below which
+    // runs the application logic that reacts to the async events.
+    configureRpcThreadpool(1, false /* callerWillJoin */);
+
+    // To start fast, the services are looked up while the configuration is loaded and the
+    // Vehicle HAL may go on starting up while the first frames are shown
+    std::future<sp<IEvsEnumerator>> evsService;
+    std::future<sp<IVehicle>> vehicleService;
+    if (fastStart) {
+        evsService = std::async(std::launch::async, [evsServiceName]() {
+            return IEvsEnumerator::getService(evsServiceName);
+        });
+        if (useVehicleHal) {
+            vehicleService = std::async(std::launch::async, []() {
+                return IVehicle::getService();
+            });
+        }
+    }
+
     // Load our configuration information
     ConfigManager config;
-    if (!config.initialize(CONFIG_OVERRIDE_PATH)) {
-        if (!config.initialize(CONFIG_DEFAULT_PATH)) {
+    if (!config.initialize(CONFIG_OVERRIDE_PATH, CONFIG_CACHE_PATH)) {
+        if (!config.initialize(CONFIG_DEFAULT_PATH, CONFIG_CACHE_PATH)) {
             LOG(ERROR) << "Missing or improper configuration for the EVS application.  Exiting.";
             return EXIT_FAILURE;
         }
     }
-
-    // Set thread pool size to one to avoid concurrent events from the HAL.
-    // This pool will handle the EvsCameraStream callbacks.
-    // Note:  This _will_ run in parallel with the EvsListener run() loop below which
-    // runs the application logic that reacts to the async events.
-    configureRpcThreadpool(1, false /* callerWillJoin */);
+    BootTimeline::mark(BootTimeline::CONFIG_LOADED);
 
     // Construct our async helper object
     sp<EvsVehicleListener> pEvsListener = new EvsVehicleListener();
 
     // Get the EVS manager service
     LOG(INFO) << "Acquiring EVS Enumerator";
-    pEvs = IEvsEnumerator::getService(evsServiceName);
+    pEvs = fastStart ? evsService.get() : IEvsEnumerator::getService(evsServiceName);
     if (pEvs.get() == nullptr) {
         LOG(ERROR) << "getService(" << evsServiceName
                    << ") returned NULL.  Exiting.";
         return EXIT_FAILURE;
     }
+    BootTimeline::mark(BootTimeline::EVS_CONNECTED);
 
     // Request exclusive access to the EVS display
     LOG(INFO) << "Acquiring EVS Display";
@@ -244,31 +309,33 @@ int main(int argc, char** argv)
         LOG(ERROR) << "EVS Display unavailable.  Exiting.";
         return EXIT_FAILURE;
     }
+    BootTimeline::mark(BootTimeline::DISPLAY_OPENED);
 
     config.useExternalMemory(useExternalMemory);
     config.setExternalMemoryFormat(extMemoryFormat);
+    config.usePassthrough(usePassthrough);
+    config.measureLatency(measureLatency);
 
     // Set a mock gear signal for the test mode
     config.setMockGearSignal(mockGearSignal);
 
-    // Connect to the Vehicle HAL so we can monitor state
+    // Connect to the Vehicle HAL so we can monitor state, unless we start without it
+    const bool connectVehicleLater = useVehicleHal && fastStart;
     sp<IVehicle> pVnet;
-    if (useVehicleHal) {
+    if (connectVehicleLater) {
+        LOG(INFO) << "Fast start selected, so connecting to Vehicle HAL in parallel";
+    } else if (useVehicleHal) {
         LOG(INFO) << "Connecting to Vehicle HAL";
         pVnet = IVehicle::getService();
         if (pVnet.get() == nullptr) {
             LOG(ERROR) << "Vehicle HAL getService returned NULL.  Exiting.";
             return EXIT_FAILURE;
-        } else {
-            // Register for vehicle state change callbacks we care about
-            // Changes in these values are what will trigger a reconfiguration of the EVS pipeline
-            if (!subscribeToVHal(pVnet, pEvsListener, VehicleProperty::GEAR_SELECTION)) {
-                LOG(ERROR) << "Without gear notification, we can't support EVS.  Exiting.";
-                return EXIT_FAILURE;
-            }
-            if (!subscribeToVHal(pVnet, pEvsListener, VehicleProperty::TURN_SIGNAL_STATE)) {
-                LOG(WARNING) << "Didn't get turn signal notifications, so we'll ignore those.";
-            }
+        }
+        BootTimeline::mark(BootTimeline::VEHICLE_CONNECTED);
+
+        // Register for vehicle state change callbacks we care about
+        if (!subscribeToVehicleState(pVnet, pEvsListener)) {
+            return EXIT_FAILURE;
         }
     } else {
         LOG(WARNING) << "Test mode selected, so not talking to Vehicle HAL";
@@ -277,11 +344,33 @@ int main(int argc, char** argv)
     // Configure ourselves for the current vehicle state at startup
     LOG(INFO) << "Constructing state controller";
     pStateController = new EvsStateControl(pVnet, pEvs, pDisplay, config);
+    if (connectVehicleLater) {
+        pStateController->setStateUntilVehicleConnected(stateUntilVehicle);
+    }
     if (!pStateController->startUpdateLoop()) {
         LOG(ERROR) << "Initial configuration failed.  Exiting.";
         return EXIT_FAILURE;
     }
 
+    if (connectVehicleLater) {
+        pVnet = vehicleService.get();
+        if (pVnet.get() == nullptr) {
+            LOG(ERROR) << "Vehicle HAL getService returned NULL.  Exiting.";
+            pStateController->postCommand({EvsStateControl::Op::EXIT, 0, 0}, true);
+            pStateController->terminateUpdateLoop();
+            return EXIT_FAILURE;
+        }
+        BootTimeline::mark(BootTimeline::VEHICLE_CONNECTED);
+
+        // Hand the Vehicle HAL over before subscribing, so no event comes ahead of it
+        pStateController->connectVehicle(pVnet);
+        if (!subscribeToVehicleState(pVnet, pEvsListener)) {
+            pStateController->postCommand({EvsStateControl::Op::EXIT, 0, 0}, true);
+            pStateController->terminateUpdateLoop();
+            return EXIT_FAILURE;
+        }
+    }
+
     // Run forever, reacting to events as necessary
     LOG(INFO) << "Entering running state";
     pEvsListener->run(pStateController);
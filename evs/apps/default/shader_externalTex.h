@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHADER_EXTERNAL_TEX_H
+#define SHADER_EXTERNAL_TEX_H
+
+// Samples a camera buffer imported as an external texture, which lets the GPU convert YUV
+// formats such as NV21 and YV12 to RGB as it reads them
+const char vtxShader_externalTexture[] = ""
+        "#version 300 es                    \n"
+        "layout(location = 0) in vec4 pos;  \n"
+        "layout(location = 1) in vec2 tex;  \n"
+        "out vec2 uv;                       \n"
+        "void main()                        \n"
+        "{                                  \n"
+        "   gl_Position = pos;              \n"
+        "   uv = tex;                       \n"
+        "}                                  \n";
+
+const char pixShader_externalTexture[] =
+        "#version 300 es                                \n"
+        "#extension GL_OES_EGL_image_external_essl3 : require \n"
+        "precision mediump float;                       \n"
+        "uniform samplerExternalOES tex;                \n"
+        "in vec2 uv;                                    \n"
+        "out vec4 color;                                \n"
+        "void main()                                    \n"
+        "{                                              \n"
+        "    color = vec4(texture(tex, uv).rgb, 1.0);   \n"
+        "}                                              \n";
+
+#endif // SHADER_EXTERNAL_TEX_H
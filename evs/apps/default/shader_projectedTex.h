@@ -17,28 +17,46 @@
 #ifndef SHADER_PROJECTED_TEX_H
 #define SHADER_PROJECTED_TEX_H
 
-// This shader is used to project a sensors image onto wold space geometry
-// as if it were projected from the original sensor's point of view in the world.
+// This shader is used to project the images of up to four sensors onto world space geometry
+// as if each were projected from the original sensor's point of view in the world, all in one
+// pass.  Each vertex carries its position in the projection space of every sensor, computed
+// ahead of time since the sensors don't move.  Where several sensors see the same spot, the
+// one with the highest index wins.
 
 const char vtxShader_projectedTexture[] = ""
         "#version 300 es                            \n"
         "layout(location = 0) in vec4 pos;          \n"
+        "layout(location = 1) in vec4 projected0;   \n"
+        "layout(location = 2) in vec4 projected1;   \n"
+        "layout(location = 3) in vec4 projected2;   \n"
+        "layout(location = 4) in vec4 projected3;   \n"
         "uniform mat4 cameraMat;                    \n"
-        "uniform mat4 projectionMat;                \n"
-        "out vec4 projectionSpace;                  \n"
+        "out vec4 projectionSpace0;                 \n"
+        "out vec4 projectionSpace1;                 \n"
+        "out vec4 projectionSpace2;                 \n"
+        "out vec4 projectionSpace3;                 \n"
         "void main()                                \n"
         "{                                          \n"
         "   gl_Position = cameraMat * pos;          \n"
-        "   projectionSpace = projectionMat * pos;  \n"
+        "   projectionSpace0 = projected0;          \n"
+        "   projectionSpace1 = projected1;          \n"
+        "   projectionSpace2 = projected2;          \n"
+        "   projectionSpace3 = projected3;          \n"
         "}                                          \n";
 
 const char pixShader_projectedTexture[] =
         "#version 300 es                                        \n"
         "precision mediump float;                               \n"
-        "uniform sampler2D tex;                                 \n"
-        "in vec4 projectionSpace;                               \n"
+        "uniform sampler2D tex[4];                              \n"
+        "uniform int numSensors;                                \n"
+        "in vec4 projectionSpace0;                              \n"
+        "in vec4 projectionSpace1;                              \n"
+        "in vec4 projectionSpace2;                              \n"
+        "in vec4 projectionSpace3;                              \n"
         "out vec4 color;                                        \n"
-        "void main()                                            \n"
+        "                                                       \n"
+        "// Finds where a point lands in a sensor's image       \n"
+        "bool project(vec4 projectionSpace, out vec2 uv)        \n"
         "{                                                      \n"
         "    const vec2 zero = vec2(0.0f, 0.0f);                \n"
         "    const vec2 one  = vec2(1.0f, 1.0f);                \n"
@@ -51,15 +69,31 @@ const char pixShader_projectedTexture[] =
         "    cs.y = -cs.y;                                      \n"
         "                                                       \n"
         "    // scale from -1/1 clip space to 0/1 uv space      \n"
-        "    vec2 uv = (cs + 1.0f) * 0.5f;                      \n"
+        "    uv = (cs + 1.0f) * 0.5f;                           \n"
+        "                                                       \n"
+        "    // Fail if we don't have a valid projection        \n"
+        "    return (projectionSpace.w > 0.0f) &&               \n"
+        "           !any(greaterThan(uv, one)) &&               \n"
+        "           !any(lessThan(uv, zero));                   \n"
+        "}                                                      \n"
         "                                                       \n"
-        "    // Bail if we don't have a valid projection        \n"
-        "    if ((projectionSpace.w <= 0.0f) ||                 \n"
-        "        any(greaterThan(uv, one)) ||                   \n"
-        "        any(lessThan(uv, zero))) {                     \n"
+        "void main()                                            \n"
+        "{                                                      \n"
+        "    vec2 uv;                                           \n"
+        "    if (numSensors > 3 &&                              \n"
+        "        project(projectionSpace3, uv)) {               \n"
+        "        color = texture(tex[3], uv);                   \n"
+        "    } else if (numSensors > 2 &&                       \n"
+        "               project(projectionSpace2, uv)) {        \n"
+        "        color = texture(tex[2], uv);                   \n"
+        "    } else if (numSensors > 1 &&                       \n"
+        "               project(projectionSpace1, uv)) {        \n"
+        "        color = texture(tex[1], uv);                   \n"
+        "    } else if (project(projectionSpace0, uv)) {        \n"
+        "        color = texture(tex[0], uv);                   \n"
+        "    } else {                                           \n"
         "        discard;                                       \n"
         "    }                                                  \n"
-        "    color = texture(tex, uv);                          \n"
         "}                                                      \n";
 
 #endif // SHADER_PROJECTED_TEX_H
\ No newline at end of file
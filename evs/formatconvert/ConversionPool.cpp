@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "formatconvert/ConversionPool.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace formatconvert {
+
+
+ConversionPool::ConversionPool(unsigned numThreads) :
+        mNumStripes(std::max(numThreads, 1u)) {
+    for (unsigned stripe = 1; stripe < mNumStripes; ++stripe) {
+        mWorkers.emplace_back([this, stripe]() { workerLoop(stripe); });
+    }
+
+    LOG(INFO) << "Converting frames in " << mNumStripes << " stripes";
+}
+
+
+ConversionPool::~ConversionPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mQuit = true;
+    }
+    mWorkSignal.notify_all();
+
+    for (auto&& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+
+unsigned ConversionPool::getStripeStart(unsigned stripe) const {
+    // Rounds down to an even row; the last stripe takes whatever is left
+    const uint64_t row = static_cast<uint64_t>(mNumRows) * stripe / mNumStripes;
+    return static_cast<unsigned>(row) & ~1u;
+}
+
+
+void ConversionPool::run(unsigned numRows, const StripeFn& convert) {
+    if (mWorkers.empty()) {
+        convert(0, numRows);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mConvert = &convert;
+        mNumRows = numRows;
+        mPending = mWorkers.size();
+        ++mGeneration;
+    }
+    mWorkSignal.notify_all();
+
+    // Our share of the work
+    convert(0, getStripeStart(1));
+
+    std::unique_lock<std::mutex> lock(mLock);
+    mDoneSignal.wait(lock, [this]() { return mPending == 0; });
+    mConvert = nullptr;
+}
+
+
+void ConversionPool::workerLoop(unsigned stripe) {
+    uint64_t lastGeneration = 0;
+    while (true) {
+        const StripeFn* convert = nullptr;
+        unsigned firstRow = 0;
+        unsigned lastRow = 0;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mWorkSignal.wait(lock, [this, lastGeneration]() {
+                return mQuit || mGeneration != lastGeneration;
+            });
+            if (mQuit) {
+                break;
+            }
+
+            lastGeneration = mGeneration;
+            convert = mConvert;
+            firstRow = getStripeStart(stripe);
+            lastRow = stripe + 1 < mNumStripes ? getStripeStart(stripe + 1) : mNumRows;
+        }
+
+        (*convert)(firstRow, lastRow);
+
+        bool done = false;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            done = --mPending == 0;
+        }
+        if (done) {
+            mDoneSignal.notify_one();
+        }
+    }
+}
+
+}  // namespace formatconvert
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,649 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "formatconvert/FormatConvert.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace formatconvert {
+
+namespace {
+
+// The YUV to RGB conversion uses these coefficients in 10.6 fixed point, small enough for
+// every term to fit in 16 bits so the SIMD kernels below can produce the same bits as
+// yuvToRgbx():
+//   R = Y + 1.140 V
+//   G = Y - 0.395 U - 0.581 V
+//   B = Y + 2.032 U
+// with U and V centered on zero and every term rounded to the nearest integer.
+constexpr int kFixedPointShift = 6;
+constexpr int kFixedPointRound = 1 << (kFixedPointShift - 1);
+constexpr int kCoeffRV = 73;    // 1.140
+constexpr int kCoeffGU = 25;    // 0.395
+constexpr int kCoeffGV = 37;    // 0.581
+constexpr int kCoeffBU = 130;   // 2.032
+
+// Pixels converted at a time by the kernels that have to rearrange their input first.  Even,
+// so chunks of a row never split a pair of pixels sharing their chroma.
+constexpr unsigned kChunkPixels = 256;
+
+
+inline uint8_t clampToByte(int v) {
+    if (v < 0) return 0;
+    if (v > 255) return 255;
+    return static_cast<uint8_t>(v);
+}
+
+
+inline uint32_t yuvToRgbx(const unsigned char Y, const unsigned char Uin, const unsigned char Vin) {
+    const int U = Uin - 128;
+    const int V = Vin - 128;
+
+    const uint8_t R = clampToByte(Y + ((kCoeffRV * V + kFixedPointRound) >> kFixedPointShift));
+    const uint8_t G = clampToByte(Y - ((kCoeffGU * U + kCoeffGV * V + kFixedPointRound) >>
+                                       kFixedPointShift));
+    const uint8_t B = clampToByte(Y + ((kCoeffBU * U + kFixedPointRound) >> kFixedPointShift));
+
+    return ((R & 0xFF))       |
+           ((G & 0xFF) << 8)  |
+           ((B & 0xFF) << 16) |
+           0xFF000000;  // Fill the alpha channel with ones
+}
+
+
+template <typename T>
+inline T* getRow(const Image& image, unsigned row) {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(image.data) + row * image.stride);
+}
+
+
+// Row converters.  Each of them converts |width| pixels of one row, or of two rows for NV21,
+// and has a scalar version that also finishes the pixels left over by the SIMD versions.
+// The planar one takes a chroma sample of each of U and V for every two pixels.
+using YuyvToRgbaRowFn = void (*)(const uint8_t* src, uint32_t* dst, unsigned width);
+using PlanarToRgbaRowFn = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                                   uint32_t* dst, unsigned width);
+using YuyvToNv21RowsFn = void (*)(const uint8_t* topSrc, const uint8_t* botSrc,
+                                  uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width);
+using UyvyToYuyvRowFn = void (*)(const uint8_t* src, uint8_t* dst, unsigned width);
+
+
+void yuyvToRgbaRow(const uint8_t* src, uint32_t* dst, unsigned width) {
+    for (unsigned c = 0; c < width; c += 2) {
+        // Note:  we're walking two pixels at a time here (even/odd)
+        const uint8_t Y1 = src[0];
+        const uint8_t U  = src[1];
+        const uint8_t Y2 = src[2];
+        const uint8_t V  = src[3];
+
+        // On the RGB output, we're writing one pixel at a time
+        dst[0] = yuvToRgbx(Y1, U, V);
+        dst[1] = yuvToRgbx(Y2, U, V);
+        src += 4;
+        dst += 2;
+    }
+}
+
+
+void planarToRgbaRow(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                     uint32_t* dst, unsigned width) {
+    for (unsigned c = 0; c < width; c++) {
+        dst[c] = yuvToRgbx(y[c], u[c / 2], v[c / 2]);
+    }
+}
+
+
+void yuyvToNv21Rows(const uint8_t* topSrc, const uint8_t* botSrc,
+                    uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    for (unsigned cellCol = 0; cellCol < width / 2; cellCol++) {
+        // Collect the values from the YUYV interleaved data
+        const uint8_t* pTopMacroPixel = topSrc + cellCol * 4;
+        const uint8_t* pBotMacroPixel = botSrc + cellCol * 4;
+
+        // Down sample the U/V values by linear average between rows
+        const uint8_t uValue = (pTopMacroPixel[1] + pBotMacroPixel[1]) >> 1;
+        const uint8_t vValue = (pTopMacroPixel[3] + pBotMacroPixel[3]) >> 1;
+
+        // Store the values into the NV21 layout
+        yTop[cellCol*2]   = pTopMacroPixel[0];
+        yTop[cellCol*2+1] = pTopMacroPixel[2];
+        yBot[cellCol*2]   = pBotMacroPixel[0];
+        yBot[cellCol*2+1] = pBotMacroPixel[2];
+        uv[cellCol*2]     = uValue;
+        uv[cellCol*2+1]   = vValue;
+    }
+}
+
+
+void uyvyToYuyvRow(const uint8_t* src, uint8_t* dst, unsigned width) {
+    for (unsigned c = 0; c < width; c += 2) {
+        // Now we write back the pair of pixels with the components swizzled
+        dst[0] = src[1];
+        dst[1] = src[0];
+        dst[2] = src[3];
+        dst[3] = src[2];
+        src += 4;
+        dst += 4;
+    }
+}
+
+
+#if defined(__aarch64__)
+
+// Converts 16 pixels given their even and odd luma and the chroma they share
+inline void storeRgbaNeon(uint8x8_t yEvenIn, uint8x8_t yOddIn, uint8x8_t uIn, uint8x8_t vIn,
+                          uint32_t* dst) {
+    const uint8x8_t bias = vdup_n_u8(128);
+    const int16x8_t U = vreinterpretq_s16_u16(vsubl_u8(uIn, bias));
+    const int16x8_t V = vreinterpretq_s16_u16(vsubl_u8(vIn, bias));
+
+    const int16x8_t rTerm = vrshrq_n_s16(vmulq_n_s16(V, kCoeffRV), kFixedPointShift);
+    const int16x8_t gTerm = vrshrq_n_s16(vmlaq_n_s16(vmulq_n_s16(U, kCoeffGU), V, kCoeffGV),
+                                         kFixedPointShift);
+    const int16x8_t bTerm = vrshrq_n_s16(vmulq_n_s16(U, kCoeffBU), kFixedPointShift);
+
+    const int16x8_t yEven = vreinterpretq_s16_u16(vmovl_u8(yEvenIn));
+    const int16x8_t yOdd = vreinterpretq_s16_u16(vmovl_u8(yOddIn));
+
+    // Interleaves the even and odd pixels back in order
+    const uint8x8x2_t r = vzip_u8(vqmovun_s16(vaddq_s16(yEven, rTerm)),
+                                  vqmovun_s16(vaddq_s16(yOdd, rTerm)));
+    const uint8x8x2_t g = vzip_u8(vqmovun_s16(vsubq_s16(yEven, gTerm)),
+                                  vqmovun_s16(vsubq_s16(yOdd, gTerm)));
+    const uint8x8x2_t b = vzip_u8(vqmovun_s16(vaddq_s16(yEven, bTerm)),
+                                  vqmovun_s16(vaddq_s16(yOdd, bTerm)));
+    uint8x16x4_t rgba;
+    rgba.val[0] = vcombine_u8(r.val[0], r.val[1]);
+    rgba.val[1] = vcombine_u8(g.val[0], g.val[1]);
+    rgba.val[2] = vcombine_u8(b.val[0], b.val[1]);
+    rgba.val[3] = vdupq_n_u8(0xFF);
+    vst4q_u8(reinterpret_cast<uint8_t*>(dst), rgba);
+}
+
+
+void yuyvToRgbaRowNeon(const uint8_t* src, uint32_t* dst, unsigned width) {
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        // Even luma, U, odd luma and V of 8 macro pixels
+        const uint8x8x4_t yuyv = vld4_u8(src);
+        storeRgbaNeon(yuyv.val[0], yuyv.val[2], yuyv.val[1], yuyv.val[3], dst);
+
+        src += 32;
+        dst += 16;
+    }
+
+    yuyvToRgbaRow(src, dst, width - c);
+}
+
+
+void planarToRgbaRowNeon(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                         uint32_t* dst, unsigned width) {
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        const uint8x8x2_t luma = vld2_u8(y + c);
+        storeRgbaNeon(luma.val[0], luma.val[1], vld1_u8(u + c / 2), vld1_u8(v + c / 2), dst + c);
+    }
+
+    planarToRgbaRow(y + c, u + c / 2, v + c / 2, dst + c, width - c);
+}
+
+
+void yuyvToNv21RowsNeon(const uint8_t* topSrc, const uint8_t* botSrc,
+                        uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        // Luma and interleaved U/V of 16 pixels
+        const uint8x16x2_t top = vld2q_u8(topSrc + c * 2);
+        const uint8x16x2_t bot = vld2q_u8(botSrc + c * 2);
+        vst1q_u8(yTop + c, top.val[0]);
+        vst1q_u8(yBot + c, bot.val[0]);
+
+        // Truncating average, as the scalar version does
+        vst1q_u8(uv + c, vhaddq_u8(top.val[1], bot.val[1]));
+    }
+
+    yuyvToNv21Rows(topSrc + c * 2, botSrc + c * 2, yTop + c, yBot + c, uv + c, width - c);
+}
+
+
+void uyvyToYuyvRowNeon(const uint8_t* src, uint8_t* dst, unsigned width) {
+    unsigned c = 0;
+    for (; c + 8 <= width; c += 8) {
+        vst1q_u8(dst + c * 2, vrev16q_u8(vld1q_u8(src + c * 2)));
+    }
+
+    uyvyToYuyvRow(src + c * 2, dst + c * 2, width - c);
+}
+
+#elif defined(__x86_64__)
+
+// Converts 8 pixels given their luma and their own copy of the chroma, centered on zero, in
+// 16-bit lanes
+inline void storeRgbaSse2(__m128i Y, __m128i U, __m128i V, uint32_t* dst) {
+    const __m128i round = _mm_set1_epi16(kFixedPointRound);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+
+    const __m128i rTerm = _mm_srai_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(V, _mm_set1_epi16(kCoeffRV)), round),
+            kFixedPointShift);
+    const __m128i gTerm = _mm_srai_epi16(
+            _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(U, _mm_set1_epi16(kCoeffGU)),
+                                        _mm_mullo_epi16(V, _mm_set1_epi16(kCoeffGV))),
+                          round),
+            kFixedPointShift);
+    const __m128i bTerm = _mm_srai_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(U, _mm_set1_epi16(kCoeffBU)), round),
+            kFixedPointShift);
+
+    const __m128i R = _mm_packus_epi16(_mm_add_epi16(Y, rTerm), zero);
+    const __m128i G = _mm_packus_epi16(_mm_sub_epi16(Y, gTerm), zero);
+    const __m128i B = _mm_packus_epi16(_mm_add_epi16(Y, bTerm), zero);
+
+    const __m128i rg = _mm_unpacklo_epi8(R, G);
+    const __m128i ba = _mm_unpacklo_epi8(B, alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4), _mm_unpackhi_epi16(rg, ba));
+}
+
+
+void yuyvToRgbaRowSse2(const uint8_t* src, uint32_t* dst, unsigned width) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i bias = _mm_set1_epi16(128);
+
+    unsigned c = 0;
+    for (; c + 8 <= width; c += 8) {
+        // Y0 U0 Y1 V0 ... of 4 macro pixels
+        const __m128i yuyv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i Y = _mm_and_si128(yuyv, lowBytes);
+        const __m128i chroma = _mm_sub_epi16(_mm_srli_epi16(yuyv, 8), bias);
+
+        // Repeats U and V for both pixels of each macro pixel
+        const __m128i U = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(2, 2, 0, 0)),
+                                              _MM_SHUFFLE(2, 2, 0, 0));
+        const __m128i V = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(3, 3, 1, 1)),
+                                              _MM_SHUFFLE(3, 3, 1, 1));
+        storeRgbaSse2(Y, U, V, dst);
+
+        src += 16;
+        dst += 8;
+    }
+
+    yuyvToRgbaRow(src, dst, width - c);
+}
+
+
+__attribute__((target("avx2")))
+void yuyvToRgbaRowAvx2(const uint8_t* src, uint32_t* dst, unsigned width) {
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i round = _mm256_set1_epi16(kFixedPointRound);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi8(static_cast<char>(0xFF));
+
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        // Same as the SSE2 version, on 8 pixels in each 128-bit lane
+        const __m256i yuyv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        const __m256i Y = _mm256_and_si256(yuyv, lowBytes);
+        const __m256i chroma = _mm256_sub_epi16(_mm256_srli_epi16(yuyv, 8), bias);
+
+        const __m256i U = _mm256_shufflehi_epi16(
+                _mm256_shufflelo_epi16(chroma, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+        const __m256i V = _mm256_shufflehi_epi16(
+                _mm256_shufflelo_epi16(chroma, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+        const __m256i rTerm = _mm256_srai_epi16(
+                _mm256_add_epi16(_mm256_mullo_epi16(V, _mm256_set1_epi16(kCoeffRV)), round),
+                kFixedPointShift);
+        const __m256i gTerm = _mm256_srai_epi16(
+                _mm256_add_epi16(
+                        _mm256_add_epi16(_mm256_mullo_epi16(U, _mm256_set1_epi16(kCoeffGU)),
+                                         _mm256_mullo_epi16(V, _mm256_set1_epi16(kCoeffGV))),
+                        round),
+                kFixedPointShift);
+        const __m256i bTerm = _mm256_srai_epi16(
+                _mm256_add_epi16(_mm256_mullo_epi16(U, _mm256_set1_epi16(kCoeffBU)), round),
+                kFixedPointShift);
+
+        const __m256i R = _mm256_packus_epi16(_mm256_add_epi16(Y, rTerm), zero);
+        const __m256i G = _mm256_packus_epi16(_mm256_sub_epi16(Y, gTerm), zero);
+        const __m256i B = _mm256_packus_epi16(_mm256_add_epi16(Y, bTerm), zero);
+
+        const __m256i rg = _mm256_unpacklo_epi8(R, G);
+        const __m256i ba = _mm256_unpacklo_epi8(B, alpha);
+        const __m256i lo = _mm256_unpacklo_epi16(rg, ba);   // Pixels 0-3 and 8-11
+        const __m256i hi = _mm256_unpackhi_epi16(rg, ba);   // Pixels 4-7 and 12-15
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 8),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+
+        src += 32;
+        dst += 16;
+    }
+
+    yuyvToRgbaRowSse2(src, dst, width - c);
+}
+
+
+void planarToRgbaRowSse2(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                         uint32_t* dst, unsigned width) {
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+
+    unsigned c = 0;
+    for (; c + 8 <= width; c += 8) {
+        int32_t u4, v4;
+        memcpy(&u4, u + c / 2, sizeof(u4));
+        memcpy(&v4, v + c / 2, sizeof(v4));
+
+        const __m128i Y = _mm_unpacklo_epi8(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + c)), zero);
+
+        // Repeats each chroma sample for the two pixels sharing it
+        __m128i U = _mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), zero);
+        __m128i V = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v4), zero);
+        U = _mm_sub_epi16(_mm_unpacklo_epi16(U, U), bias);
+        V = _mm_sub_epi16(_mm_unpacklo_epi16(V, V), bias);
+        storeRgbaSse2(Y, U, V, dst + c);
+    }
+
+    planarToRgbaRow(y + c, u + c / 2, v + c / 2, dst + c, width - c);
+}
+
+
+void yuyvToNv21RowsSse2(const uint8_t* topSrc, const uint8_t* botSrc,
+                        uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+
+    unsigned c = 0;
+    for (; c + 16 <= width; c += 16) {
+        const __m128i* top = reinterpret_cast<const __m128i*>(topSrc + c * 2);
+        const __m128i* bot = reinterpret_cast<const __m128i*>(botSrc + c * 2);
+        const __m128i top0 = _mm_loadu_si128(top);
+        const __m128i top1 = _mm_loadu_si128(top + 1);
+        const __m128i bot0 = _mm_loadu_si128(bot);
+        const __m128i bot1 = _mm_loadu_si128(bot + 1);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(yTop + c),
+                         _mm_packus_epi16(_mm_and_si128(top0, lowBytes),
+                                          _mm_and_si128(top1, lowBytes)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(yBot + c),
+                         _mm_packus_epi16(_mm_and_si128(bot0, lowBytes),
+                                          _mm_and_si128(bot1, lowBytes)));
+
+        // Truncating average, as the scalar version does
+        const __m128i uv0 = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(top0, 8),
+                                                         _mm_srli_epi16(bot0, 8)), 1);
+        const __m128i uv1 = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(top1, 8),
+                                                         _mm_srli_epi16(bot1, 8)), 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + c), _mm_packus_epi16(uv0, uv1));
+    }
+
+    yuyvToNv21Rows(topSrc + c * 2, botSrc + c * 2, yTop + c, yBot + c, uv + c, width - c);
+}
+
+
+void uyvyToYuyvRowSse2(const uint8_t* src, uint8_t* dst, unsigned width) {
+    unsigned c = 0;
+    for (; c + 8 <= width; c += 8) {
+        const __m128i uyvy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c * 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c * 2),
+                         _mm_or_si128(_mm_slli_epi16(uyvy, 8), _mm_srli_epi16(uyvy, 8)));
+    }
+
+    uyvyToYuyvRow(src + c * 2, dst + c * 2, width - c);
+}
+
+#endif
+
+
+YuyvToRgbaRowFn getYuyvToRgbaRow() {
+#if defined(__aarch64__)
+    return yuyvToRgbaRowNeon;
+#elif defined(__x86_64__)
+    return __builtin_cpu_supports("avx2") ? yuyvToRgbaRowAvx2 : yuyvToRgbaRowSse2;
+#else
+    return yuyvToRgbaRow;
+#endif
+}
+
+
+PlanarToRgbaRowFn getPlanarToRgbaRow() {
+#if defined(__aarch64__)
+    return planarToRgbaRowNeon;
+#elif defined(__x86_64__)
+    return planarToRgbaRowSse2;
+#else
+    return planarToRgbaRow;
+#endif
+}
+
+
+YuyvToNv21RowsFn getYuyvToNv21Rows() {
+#if defined(__aarch64__)
+    return yuyvToNv21RowsNeon;
+#elif defined(__x86_64__)
+    return yuyvToNv21RowsSse2;
+#else
+    return yuyvToNv21Rows;
+#endif
+}
+
+
+UyvyToYuyvRowFn getUyvyToYuyvRow() {
+#if defined(__aarch64__)
+    return uyvyToYuyvRowNeon;
+#elif defined(__x86_64__)
+    return uyvyToYuyvRowSse2;
+#else
+    return uyvyToYuyvRow;
+#endif
+}
+
+} // namespace
+
+
+void nv21ToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    static const PlanarToRgbaRowFn convertRow = getPlanarToRgbaRow();
+
+    const uint8_t* srcUV = static_cast<const uint8_t*>(src.data) + src.stride * src.height;
+
+    // Splits the interleaved chroma into the planes the row converter takes, a chunk at a time
+    uint8_t u[kChunkPixels / 2];
+    uint8_t v[kChunkPixels / 2];
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        // Note that we're walking the same UV row twice for even/odd luminance rows
+        const uint8_t* rowY = getRow<const uint8_t>(src, r);
+        const uint8_t* rowUV = srcUV + r / 2 * src.stride;
+        uint32_t* rowDst = getRow<uint32_t>(dst, r);
+
+        for (unsigned c = 0; c < dst.width; c += kChunkPixels) {
+            const unsigned numPixels = std::min(kChunkPixels, dst.width - c);
+            for (unsigned i = 0; i < (numPixels + 1) / 2; i++) {
+                u[i] = rowUV[c + i * 2];
+                v[i] = rowUV[c + i * 2 + 1];
+            }
+            convertRow(rowY + c, u, v, rowDst + c, numPixels);
+        }
+    }
+}
+
+
+void yv12ToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    static const PlanarToRgbaRowFn convertRow = getPlanarToRgbaRow();
+
+    const unsigned strideColor = getLumaStride(src.stride / 2);
+    const uint8_t* srcU = static_cast<const uint8_t*>(src.data) + src.stride * src.height;
+    const uint8_t* srcV = srcU + strideColor * (src.height / 2);
+
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        // Note that we're walking the same U and V rows twice for even/odd luminance rows
+        convertRow(getRow<const uint8_t>(src, r),
+                   srcU + r / 2 * strideColor,
+                   srcV + r / 2 * strideColor,
+                   getRow<uint32_t>(dst, r),
+                   dst.width);
+    }
+}
+
+
+void yuyvToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    static const YuyvToRgbaRowFn convertRow = getYuyvToRgbaRow();
+
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        convertRow(getRow<const uint8_t>(src, r), getRow<uint32_t>(dst, r), dst.width);
+    }
+}
+
+
+void uyvyToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    static const UyvyToYuyvRowFn swizzleRow = getUyvyToYuyvRow();
+    static const YuyvToRgbaRowFn convertRow = getYuyvToRgbaRow();
+
+    // Swizzles a chunk of the row into YUYV first
+    uint8_t yuyv[kChunkPixels * 2];
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        const uint8_t* rowSrc = getRow<const uint8_t>(src, r);
+        uint32_t* rowDst = getRow<uint32_t>(dst, r);
+
+        for (unsigned c = 0; c < dst.width; c += kChunkPixels) {
+            const unsigned numPixels = std::min(kChunkPixels, dst.width - c);
+            swizzleRow(rowSrc + c * 2, yuyv, numPixels);
+            convertRow(yuyv, rowDst + c, numPixels);
+        }
+    }
+}
+
+
+void grayToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        const uint8_t* rowSrc = getRow<const uint8_t>(src, r);
+        uint32_t* rowDst = getRow<uint32_t>(dst, r);
+
+        for (unsigned c = 0; c < dst.width; c++) {
+            rowDst[c] = rowSrc[c] * 0x010101u | 0xFF000000;
+        }
+    }
+}
+
+
+void yuyvToNv21(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    // The YUYV format provides an interleaved array of pixel values with U and V subsampled in
+    // the horizontal direction only.  Also known as interleaved 422 format.  A 4 byte
+    // "macro pixel" provides the Y value for two adjacent pixels and the U and V values shared
+    // between those two pixels.  We need to down sample the UV values and collect them together
+    // after all the packed Y values to construct the NV21 format.
+    static const YuyvToNv21RowsFn convertRows = getYuyvToNv21Rows();
+
+    uint8_t* dstUV = static_cast<uint8_t*>(dst.data) + dst.stride * dst.height;
+
+    // We're going to work on two rows of 2x2 cells in the output image at at time
+    for (unsigned cellRow = firstRow / 2; cellRow < lastRow / 2; cellRow++) {
+        convertRows(getRow<const uint8_t>(src, cellRow * 2),
+                    getRow<const uint8_t>(src, cellRow * 2 + 1),
+                    getRow<uint8_t>(dst, cellRow * 2),
+                    getRow<uint8_t>(dst, cellRow * 2 + 1),
+                    dstUV + cellRow * dst.stride,
+                    dst.width);
+    }
+}
+
+
+void uyvyToYuyv(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    static const UyvyToYuyvRowFn convertRow = getUyvyToYuyvRow();
+
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        convertRow(getRow<const uint8_t>(src, r), getRow<uint8_t>(dst, r), dst.width);
+    }
+}
+
+
+void copyNv21(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    // The luma rows of the stripe, then their chroma rows
+    copyInterleaved(src, dst, 1, firstRow, lastRow);
+
+    const uint8_t* srcUV = static_cast<const uint8_t*>(src.data) + src.stride * src.height;
+    uint8_t* dstUV = static_cast<uint8_t*>(dst.data) + dst.stride * dst.height;
+    for (unsigned r = firstRow / 2; r < lastRow / 2; r++) {
+        memcpy(dstUV + r * dst.stride, srcUV + r * src.stride, dst.width);
+    }
+}
+
+
+void copyInterleaved(const Image& src, const Image& dst, unsigned pixelSize,
+                     unsigned firstRow, unsigned lastRow) {
+    if (src.stride == dst.stride && src.stride == dst.width * pixelSize) {
+        // The rows follow each other without padding
+        memcpy(getRow<uint8_t>(dst, firstRow), getRow<const uint8_t>(src, firstRow),
+               (lastRow - firstRow) * dst.stride);
+        return;
+    }
+
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        memcpy(getRow<uint8_t>(dst, r), getRow<const uint8_t>(src, r), dst.width * pixelSize);
+    }
+}
+
+
+void downscaleRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    const unsigned blockWidth = std::max(src.width / std::max(dst.width, 1u), 1u);
+    const unsigned blockHeight = std::max(src.height / std::max(dst.height, 1u), 1u);
+    const unsigned blockSize = blockWidth * blockHeight;
+
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        uint32_t* rowDst = getRow<uint32_t>(dst, r);
+
+        for (unsigned c = 0; c < dst.width; c++) {
+            // Sums up each channel over the block separately
+            unsigned sums[4] = {};
+            for (unsigned by = 0; by < blockHeight; by++) {
+                const uint8_t* pixel =
+                        getRow<const uint8_t>(src, r * blockHeight + by) + c * blockWidth * 4;
+                for (unsigned bx = 0; bx < blockWidth; bx++) {
+                    sums[0] += pixel[0];
+                    sums[1] += pixel[1];
+                    sums[2] += pixel[2];
+                    sums[3] += pixel[3];
+                    pixel += 4;
+                }
+            }
+
+            uint8_t* out = reinterpret_cast<uint8_t*>(rowDst + c);
+            for (unsigned channel = 0; channel < 4; channel++) {
+                out[channel] = static_cast<uint8_t>((sums[channel] + blockSize / 2) / blockSize);
+            }
+        }
+    }
+}
+
+}  // namespace formatconvert
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
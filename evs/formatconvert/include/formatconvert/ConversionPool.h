@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_FORMATCONVERT_CONVERSIONPOOL_H
+#define ANDROID_AUTOMOTIVE_EVS_FORMATCONVERT_CONVERSIONPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace formatconvert {
+
+
+// Worker threads that convert a frame in stripes of rows, as the functions of FormatConvert.h
+// take them.  The calling thread converts the first stripe itself, so a pool of N threads has
+// N - 1 workers.
+class ConversionPool {
+public:
+    using StripeFn = std::function<void(unsigned firstRow, unsigned lastRow)>;
+
+    explicit ConversionPool(unsigned numThreads);
+    ~ConversionPool();
+
+    ConversionPool(const ConversionPool&) = delete;
+    ConversionPool& operator=(const ConversionPool&) = delete;
+
+    // Calls |convert| once for each stripe of |numRows| rows and returns when all of them are
+    // done.  Stripes start and end on even rows so they never split a pair of rows that share
+    // chroma samples.  Not reentrant; a camera converts one frame at a time.
+    void run(unsigned numRows, const StripeFn& convert);
+
+    unsigned getNumThreads() const { return mWorkers.size() + 1; }
+
+private:
+    void workerLoop(unsigned stripe);
+
+    // Returns the first row of |stripe| out of mNumStripes
+    unsigned getStripeStart(unsigned stripe) const;
+
+    std::vector<std::thread>    mWorkers;
+
+    std::mutex                  mLock;
+    std::condition_variable     mWorkSignal;
+    std::condition_variable     mDoneSignal;
+    const StripeFn*             mConvert = nullptr;     // Guarded by mLock
+    unsigned                    mNumRows = 0;           // Guarded by mLock
+    unsigned                    mNumStripes = 0;
+    uint64_t                    mGeneration = 0;        // Guarded by mLock; counts frames
+    unsigned                    mPending = 0;           // Guarded by mLock
+    bool                        mQuit = false;          // Guarded by mLock
+};
+
+}  // namespace formatconvert
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_FORMATCONVERT_CONVERSIONPOOL_H
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_FORMATCONVERT_FORMATCONVERT_H
+#define ANDROID_AUTOMOTIVE_EVS_FORMATCONVERT_FORMATCONVERT_H
+
+#include <stdint.h>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace formatconvert {
+
+// An image in memory.  |stride| is the distance between the starts of two rows in bytes.
+//
+// NV21 and YV12 images are laid out the way the EVS camera HAL produces them: the luma plane is
+// followed by the chroma of each 2x2 block of pixels.  NV21 stores it as one plane of U/V pairs
+// with the luma stride, U first as the EVS sample driver writes it.  YV12 stores a U plane and
+// then a V plane, each with a stride of half the luma stride rounded up to 16 bytes, which is
+// the order the EVS apps have always read it in.
+struct Image {
+    void*    data   = nullptr;
+    unsigned width  = 0;
+    unsigned height = 0;
+    unsigned stride = 0;
+};
+
+// Returns the luma stride of the NV21 and YV12 images of the EVS camera HAL
+inline unsigned getLumaStride(unsigned width) {
+    return (width + 15) & ~15u;
+}
+
+// Each of these converts the rows [firstRow, lastRow) of |dst|, so stripes of the same image
+// can be converted in parallel, for instance by a ConversionPool.  Stripes of NV21 and YV12
+// images must start and end on even rows, since every two rows share their chroma samples.
+// Unless noted, |src| and |dst| are expected to have the same size, and YUV images an even
+// width.  YUV is converted to RGB with the analog YUV coefficients of BT.601 in fixed point;
+// the alpha channel of RGBA output is filled with ones.
+
+void nv21ToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+void yv12ToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+void yuyvToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+void uyvyToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+
+// Expands 8-bit grayscale into opaque RGBA
+void grayToRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+
+// Chroma of two rows is averaged into the single chroma row of NV21
+void yuyvToNv21(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+void uyvyToYuyv(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+
+// Copies the luma and chroma rows of the stripe
+void copyNv21(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+
+// Copies an image of any format with |pixelSize| bytes per pixel, RGBA or YUYV for instance
+void copyInterleaved(const Image& src, const Image& dst, unsigned pixelSize,
+                     unsigned firstRow, unsigned lastRow);
+
+// Shrinks an RGBA image by averaging blocks of pixels.  The blocks are src.width / dst.width by
+// src.height / dst.height pixels, so the source columns and rows beyond the last whole block
+// are left out.  |dst| must not be larger than |src|.
+void downscaleRgba(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow);
+
+}  // namespace formatconvert
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_FORMATCONVERT_FORMATCONVERT_H
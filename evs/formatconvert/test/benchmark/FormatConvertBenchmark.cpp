@@ -0,0 +1,168 @@
+// Copyright 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the conversions of libevsformatconvert on whole frames of the usual camera
+// resolutions.  Run on a device with:
+//   atest evs_formatconvert_benchmark
+// or, for machine-readable results to compare between builds:
+//   evs_formatconvert_benchmark --benchmark_format=json --benchmark_out=<file>
+//
+// The ConversionPool variants split every frame into as many stripes as the given number of
+// threads, the way the sample driver does with <conversion_threads>.
+//
+// Counters:
+//   frames_per_sec         frames converted per second
+//   bytes_per_second       source bytes read per second
+
+#include <benchmark/benchmark.h>
+
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include <formatconvert/ConversionPool.h>
+#include <formatconvert/FormatConvert.h>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace formatconvert {
+
+namespace {
+
+using ConvertFn = void (*)(const Image& src, const Image& dst,
+                           unsigned firstRow, unsigned lastRow);
+
+// Bytes per pixel of the source and target images of a conversion, or 0 for NV21 and YV12
+struct Layout {
+    unsigned srcPixelSize;
+    unsigned dstPixelSize;
+};
+
+constexpr unsigned kPlanar = 0;
+
+constexpr Layout kYuyvToRgba = {2, 4};
+constexpr Layout kYuyvToYuyv = {2, 2};
+constexpr Layout kYuyvToNv21 = {2, kPlanar};
+constexpr Layout kPlanarToRgba = {kPlanar, 4};
+constexpr Layout kGrayToRgba = {1, 4};
+
+// Allocates an image, with room for the chroma planes of NV21 and YV12 images
+Image allocateImage(std::vector<uint8_t>& data, unsigned width, unsigned height,
+                    unsigned pixelSize) {
+    if (pixelSize == kPlanar) {
+        const unsigned stride = getLumaStride(width);
+        data.resize(stride * height * 2);
+        return {data.data(), width, height, stride};
+    }
+
+    data.resize(width * pixelSize * height);
+    return {data.data(), width, height, width * pixelSize};
+}
+
+void runConversion(benchmark::State& state, ConvertFn convert, const Layout& layout) {
+    const unsigned width = state.range(0);
+    const unsigned height = state.range(1);
+    const unsigned numThreads = state.range(2);
+
+    std::vector<uint8_t> srcData;
+    std::vector<uint8_t> dstData;
+    const Image src = allocateImage(srcData, width, height, layout.srcPixelSize);
+    const Image dst = allocateImage(dstData, width, height, layout.dstPixelSize);
+
+    // A gradient, so the kernels see varied values
+    for (size_t i = 0; i < srcData.size(); ++i) {
+        srcData[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    ConversionPool pool(numThreads);
+    const ConversionPool::StripeFn stripe = [&](unsigned firstRow, unsigned lastRow) {
+        convert(src, dst, firstRow, lastRow);
+    };
+
+    for (auto _ : state) {
+        pool.run(height, stripe);
+        benchmark::DoNotOptimize(dstData.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(state.iterations() * srcData.size());
+    state.counters["frames_per_sec"] =
+            benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void copyYuyv(const Image& src, const Image& dst, unsigned firstRow, unsigned lastRow) {
+    copyInterleaved(src, dst, 2, firstRow, lastRow);
+}
+
+void downscaleRgbaByTwo(benchmark::State& state) {
+    const unsigned width = state.range(0);
+    const unsigned height = state.range(1);
+    const unsigned numThreads = state.range(2);
+
+    std::vector<uint8_t> srcData(width * height * 4);
+    std::vector<uint8_t> dstData(width / 2 * height / 2 * 4);
+    for (size_t i = 0; i < srcData.size(); ++i) {
+        srcData[i] = static_cast<uint8_t>(i * 7);
+    }
+    const Image src = {srcData.data(), width, height, width * 4};
+    const Image dst = {dstData.data(), width / 2, height / 2, width / 2 * 4};
+
+    ConversionPool pool(numThreads);
+    const ConversionPool::StripeFn stripe = [&](unsigned firstRow, unsigned lastRow) {
+        downscaleRgba(src, dst, firstRow, lastRow);
+    };
+
+    for (auto _ : state) {
+        pool.run(dst.height, stripe);
+        benchmark::DoNotOptimize(dstData.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(state.iterations() * srcData.size());
+    state.counters["frames_per_sec"] =
+            benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// Frame sizes and conversion threads
+void frameArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"width", "height", "threads"});
+    for (const auto& size : {std::make_pair(640, 480), std::make_pair(1280, 720),
+                             std::make_pair(1920, 1080)}) {
+        for (int threads : {1, 2, 4}) {
+            b->Args({size.first, size.second, threads});
+        }
+    }
+    b->UseRealTime();
+}
+
+BENCHMARK_CAPTURE(runConversion, yuyvToRgba, yuyvToRgba, kYuyvToRgba)->Apply(frameArgs);
+BENCHMARK_CAPTURE(runConversion, uyvyToRgba, uyvyToRgba, kYuyvToRgba)->Apply(frameArgs);
+BENCHMARK_CAPTURE(runConversion, nv21ToRgba, nv21ToRgba, kPlanarToRgba)->Apply(frameArgs);
+BENCHMARK_CAPTURE(runConversion, yv12ToRgba, yv12ToRgba, kPlanarToRgba)->Apply(frameArgs);
+BENCHMARK_CAPTURE(runConversion, grayToRgba, grayToRgba, kGrayToRgba)->Apply(frameArgs);
+BENCHMARK_CAPTURE(runConversion, yuyvToNv21, yuyvToNv21, kYuyvToNv21)->Apply(frameArgs);
+BENCHMARK_CAPTURE(runConversion, uyvyToYuyv, uyvyToYuyv, kYuyvToYuyv)->Apply(frameArgs);
+BENCHMARK_CAPTURE(runConversion, copyYuyv, copyYuyv, kYuyvToYuyv)->Apply(frameArgs);
+BENCHMARK(downscaleRgbaByTwo)->Apply(frameArgs);
+
+}  // namespace
+
+}  // namespace formatconvert
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+BENCHMARK_MAIN();
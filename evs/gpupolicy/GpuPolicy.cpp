@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gpupolicy/GpuPolicy.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace gpupolicy {
+
+namespace {
+
+using ::android::base::ParseInt;
+using ::android::base::ReadFileToString;
+using ::android::base::Split;
+using ::android::base::StringAppendF;
+using ::android::base::StringPrintf;
+using ::android::base::Tokenize;
+using ::android::base::Trim;
+
+constexpr char kContextPriorityExtension[] = "EGL_IMG_context_priority";
+constexpr int64_t kNsPerMs = 1000 * 1000;
+constexpr int kMaxDeadlineMs = 10 * 1000;
+
+
+// What happened to the GPU work of a component in this process
+struct ComponentStats {
+    std::atomic<EGLint> grantedPriority = EGL_NONE;     // EGL_NONE until a context is made
+    std::atomic<uint64_t> frames = 0;
+    std::atomic<uint64_t> missed = 0;
+    std::atomic<int64_t> worstNs = 0;
+};
+
+// The policies read from kGpuPolicyPath and the stats of the components they configure.  Both
+// maps aren't changed once loaded, so the stats can be updated without a lock.
+struct Registry {
+    std::once_flag loaded;
+    std::unordered_map<std::string, GpuPolicy> policies;
+    std::unordered_map<std::string, std::unique_ptr<ComponentStats>> stats;
+};
+
+// Frames may still be recorded while the process exits, so it is never destroyed
+Registry& getRegistry() {
+    static Registry* registry = new Registry();
+    std::call_once(registry->loaded, []() {
+        std::string text;
+        if (!ReadFileToString(kGpuPolicyPath, &text)) {
+            // Without the file, every context gets the driver's default priority
+            LOG(DEBUG) << "No GPU policy is configured";
+            return;
+        }
+
+        if (!parseGpuPolicies(text, &registry->policies)) {
+            LOG(ERROR) << "Ignoring malformed " << kGpuPolicyPath;
+            return;
+        }
+
+        for (auto&& [component, policy] : registry->policies) {
+            registry->stats.emplace(component, std::make_unique<ComponentStats>());
+        }
+        LOG(INFO) << "Loaded " << registry->policies.size() << " GPU policies";
+    });
+
+    return *registry;
+}
+
+
+const char* getPriorityName(ContextPriority priority) {
+    switch (priority) {
+        case ContextPriority::LOW:    return "low";
+        case ContextPriority::MEDIUM: return "medium";
+        case ContextPriority::HIGH:   return "high";
+        default:                      return "default";
+    }
+}
+
+
+const char* getEglPriorityName(EGLint priority) {
+    switch (priority) {
+        case EGL_CONTEXT_PRIORITY_LOW_IMG:    return "low";
+        case EGL_CONTEXT_PRIORITY_MEDIUM_IMG: return "medium";
+        case EGL_CONTEXT_PRIORITY_HIGH_IMG:   return "high";
+        default:                              return "unknown";
+    }
+}
+
+
+bool parsePriorityName(const std::string& name, ContextPriority* priority) {
+    if (name == "default") {
+        *priority = ContextPriority::DEFAULT;
+    } else if (name == "low") {
+        *priority = ContextPriority::LOW;
+    } else if (name == "medium") {
+        *priority = ContextPriority::MEDIUM;
+    } else if (name == "high") {
+        *priority = ContextPriority::HIGH;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+
+EGLint toEglPriority(ContextPriority priority) {
+    switch (priority) {
+        case ContextPriority::LOW:    return EGL_CONTEXT_PRIORITY_LOW_IMG;
+        case ContextPriority::MEDIUM: return EGL_CONTEXT_PRIORITY_MEDIUM_IMG;
+        case ContextPriority::HIGH:   return EGL_CONTEXT_PRIORITY_HIGH_IMG;
+        default:                      return EGL_NONE;
+    }
+}
+
+
+bool hasContextPriority(EGLDisplay display) {
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (extensions == nullptr) {
+        return false;
+    }
+
+    const auto names = Tokenize(extensions, " ");
+    return std::find(names.begin(), names.end(), kContextPriorityExtension) != names.end();
+}
+
+
+const GpuPolicy* findPolicy(const char* component) {
+    const auto& policies = getRegistry().policies;
+    const auto it = policies.find(component);
+    return it == policies.end() ? nullptr : &it->second;
+}
+
+
+ComponentStats* findStats(const char* component) {
+    const auto& stats = getRegistry().stats;
+    const auto it = stats.find(component);
+    return it == stats.end() ? nullptr : it->second.get();
+}
+
+}  // namespace
+
+
+std::string GpuPolicy::toString() const {
+    std::string str = getPriorityName(priority);
+    if (deadlineNs > 0) {
+        StringAppendF(&str, " deadline_ms=%" PRId64, deadlineNs / kNsPerMs);
+    }
+
+    return str;
+}
+
+
+bool parseGpuPolicies(const std::string& text,
+                      std::unordered_map<std::string, GpuPolicy>* policies) {
+    std::unordered_map<std::string, GpuPolicy> parsed;
+    for (auto&& rawLine : Split(text, "\n")) {
+        const std::string line = Trim(rawLine.substr(0, rawLine.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+
+        const auto fields = Tokenize(line, " \t");
+        GpuPolicy policy;
+        bool valid = fields.size() >= 2 && parsePriorityName(fields[1], &policy.priority);
+        for (size_t i = 2; valid && i < fields.size(); ++i) {
+            const auto pos = fields[i].find('=');
+            const std::string key = fields[i].substr(0, pos);
+            const std::string value = pos == std::string::npos ? "" : fields[i].substr(pos + 1);
+            int deadlineMs = 0;
+            if (key == "deadline_ms") {
+                valid = ParseInt(value, &deadlineMs, 1, kMaxDeadlineMs);
+                policy.deadlineNs = deadlineMs * kNsPerMs;
+            } else {
+                valid = false;
+            }
+        }
+
+        if (!valid) {
+            LOG(ERROR) << "Malformed GPU policy: " << line;
+            return false;
+        }
+
+        parsed.insert_or_assign(fields[0], std::move(policy));
+    }
+
+    *policies = std::move(parsed);
+    return true;
+}
+
+
+std::vector<EGLint> getContextAttributes(EGLDisplay display, const char* component,
+                                         const EGLint* attribs) {
+    std::vector<EGLint> result;
+    for (const EGLint* attrib = attribs; *attrib != EGL_NONE; attrib += 2) {
+        result.push_back(attrib[0]);
+        result.push_back(attrib[1]);
+    }
+
+    const GpuPolicy* policy = findPolicy(component);
+    if (policy != nullptr && policy->priority != ContextPriority::DEFAULT) {
+        if (hasContextPriority(display)) {
+            result.push_back(EGL_CONTEXT_PRIORITY_LEVEL_IMG);
+            result.push_back(toEglPriority(policy->priority));
+        } else {
+            LOG(WARNING) << "No " << kContextPriorityExtension << ", so " << component
+                         << " renders at the default priority";
+        }
+    }
+
+    result.push_back(EGL_NONE);
+    return result;
+}
+
+
+void recordContextPriority(EGLDisplay display, EGLContext context, const char* component) {
+    const GpuPolicy* policy = findPolicy(component);
+    ComponentStats* stats = findStats(component);
+    if (policy == nullptr || policy->priority == ContextPriority::DEFAULT ||
+        !hasContextPriority(display)) {
+        return;
+    }
+
+    EGLint granted = EGL_NONE;
+    if (!eglQueryContext(display, context, EGL_CONTEXT_PRIORITY_LEVEL_IMG, &granted)) {
+        LOG(WARNING) << "Failed to query the context priority of " << component;
+        return;
+    }
+
+    stats->grantedPriority = granted;
+    if (granted != toEglPriority(policy->priority)) {
+        // Typically the process lacks the capability for a high priority
+        LOG(WARNING) << component << " asked for a " << getPriorityName(policy->priority)
+                     << " priority context and got " << getEglPriorityName(granted);
+    } else {
+        LOG(INFO) << component << " renders at " << getEglPriorityName(granted) << " priority";
+    }
+}
+
+
+void recordFrameTime(const char* component, int64_t frameTimeNs) {
+    ComponentStats* stats = findStats(component);
+    if (stats == nullptr) {
+        return;
+    }
+
+    ++stats->frames;
+    const int64_t deadlineNs = findPolicy(component)->deadlineNs;
+    if (deadlineNs > 0 && frameTimeNs > deadlineNs) {
+        ++stats->missed;
+    }
+
+    int64_t worstNs = stats->worstNs;
+    while (frameTimeNs > worstNs && !stats->worstNs.compare_exchange_weak(worstNs, frameTimeNs)) {
+    }
+}
+
+
+std::string dumpGpuPolicies(const char* indent) {
+    const Registry& registry = getRegistry();
+    if (registry.policies.empty()) {
+        return StringPrintf("%sNo GPU policy is configured.\n", indent);
+    }
+
+    std::string buffer = StringPrintf("%sGPU policies:\n", indent);
+    for (auto&& [component, policy] : registry.policies) {
+        const ComponentStats& stats = *registry.stats.at(component);
+        StringAppendF(&buffer, "%s  %s: %s", indent, component.c_str(),
+                      policy.toString().c_str());
+        if (stats.grantedPriority != EGL_NONE) {
+            StringAppendF(&buffer, ", got %s priority",
+                          getEglPriorityName(stats.grantedPriority));
+        }
+        if (stats.frames > 0) {
+            StringAppendF(&buffer, ", %" PRIu64 " frames, %" PRIu64 " missed the deadline"
+                          ", worst %.1f ms",
+                          stats.frames.load(), stats.missed.load(),
+                          stats.worstNs / static_cast<double>(kNsPerMs));
+        }
+        buffer += "\n";
+    }
+
+    return buffer;
+}
+
+}  // namespace gpupolicy
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
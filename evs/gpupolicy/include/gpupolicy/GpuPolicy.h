@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_GPUPOLICY_GPUPOLICY_H
+#define ANDROID_AUTOMOTIVE_EVS_GPUPOLICY_GPUPOLICY_H
+
+#include <EGL/egl.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace gpupolicy {
+
+
+// Components that render with a GL context of their own
+constexpr char kComponentDisplay[]      = "evs.display";      // Sample driver display
+constexpr char kComponentConverter[]    = "evs.converter";    // Sample driver format conversion
+constexpr char kComponentRender[]       = "evs.render";       // evs_app renderers
+constexpr char kComponentSvRender[]     = "sv.render";        // Surround view 3d rendering
+constexpr char kComponentSvApp[]        = "sv.app";           // Surround view sample app
+constexpr char kComponentComputePipe[]  = "computepipe.preprocess";
+
+// Where the policies are read from.  It is a vendor file so system and vendor processes
+// alike can read it.
+constexpr char kGpuPolicyPath[] = "/vendor/etc/automotive/evs/gpu_policy.conf";
+
+
+// Priority of the GL contexts of a component, against the other contexts sharing the GPU.
+// DEFAULT leaves it to the driver.
+enum class ContextPriority {
+    DEFAULT = 0,
+    LOW,
+    MEDIUM,
+    HIGH,
+};
+
+// How the GPU work of a component is prioritized.  In the configuration file, each line gives
+// the policy of a component as
+//
+//     <component> <default|low|medium|high> [deadline_ms=N]
+//
+// where the deadline is the time a frame of the component may take to render; the frames that
+// take longer are counted as missed.  Text after a '#' is ignored.
+struct GpuPolicy {
+    ContextPriority priority = ContextPriority::DEFAULT;
+    int64_t deadlineNs = 0;             // 0 counts no frame as missed
+
+    std::string toString() const;
+};
+
+// Parses the policies in |text|, as laid out above, into |policies|.  Returns false and leaves
+// |policies| alone if a line is malformed.
+bool parseGpuPolicies(const std::string& text,
+                      std::unordered_map<std::string, GpuPolicy>* policies);
+
+// Returns |attribs|, a list of context attributes ending with EGL_NONE, with the priority
+// configured for |component| added if |display| supports EGL_IMG_context_priority
+std::vector<EGLint> getContextAttributes(EGLDisplay display, const char* component,
+                                         const EGLint* attribs);
+
+// Records the priority the driver gave |context| of |component|, which may be lower than the
+// one asked for, e.g. if the process isn't allowed a high priority
+void recordContextPriority(EGLDisplay display, EGLContext context, const char* component);
+
+// Records that a frame of |component| took |frameTimeNs| to render.  Cheap enough to be called
+// for every frame.
+void recordFrameTime(const char* component, int64_t frameTimeNs);
+
+// Describes the configured policies, the priorities the contexts got and the frames that missed
+// their deadlines in this process
+std::string dumpGpuPolicies(const char* indent = "");
+
+}  // namespace gpupolicy
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_GPUPOLICY_GPUPOLICY_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DeliveryScheduler.h"
+
+#include <android-base/logging.h>
+#include <threadpolicy/ThreadPolicy.h>
+
+#include <pthread.h>
+
+#include <algorithm>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+// The deliveries are mostly oneway binder calls, so a thread per core keeps up with any number
+// of clients.  Two at least, so a client that is slow to take a call doesn't stall the others.
+constexpr unsigned kMinDeliveryThreads = 2;
+
+}  // namespace
+
+
+std::shared_ptr<DeliveryScheduler> DeliveryScheduler::getDefault() {
+    static std::shared_ptr<DeliveryScheduler> scheduler = std::make_shared<DeliveryScheduler>(
+            std::max(kMinDeliveryThreads, std::thread::hardware_concurrency()));
+    return scheduler;
+}
+
+
+DeliveryScheduler::DeliveryScheduler(unsigned numThreads) {
+    LOG(INFO) << "Delivering frames on " << numThreads << " threads";
+    for (unsigned i = 0; i < numThreads; ++i) {
+        mThreads.emplace_back([this]() { run(); });
+        pthread_setname_np(mThreads.back().native_handle(), "EvsDelivery");
+    }
+}
+
+
+DeliveryScheduler::~DeliveryScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mExit = true;
+    }
+    mWorkSignal.notify_all();
+    for (auto&& thread : mThreads) {
+        thread.join();
+    }
+}
+
+
+std::shared_ptr<DeliveryScheduler::Task> DeliveryScheduler::createTask(
+        std::function<void()> function) {
+    return std::make_shared<Task>(std::move(function));
+}
+
+
+void DeliveryScheduler::schedule(const std::shared_ptr<Task>& task) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (task->mCancelled) {
+            return;
+        } else if (task->mRunning) {
+            task->mRunAgain = true;
+            return;
+        }
+        queueLocked(task);
+    }
+    mWorkSignal.notify_one();
+}
+
+
+void DeliveryScheduler::scheduleAt(const std::shared_ptr<Task>& task,
+                                   Clock::time_point deadline) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (task->mCancelled || task->mDeadline <= deadline) {
+            return;
+        }
+        task->mDeadline = deadline;
+        mTimers.emplace(deadline, task);
+    }
+    // The waiting threads may be sleeping until a later deadline
+    mWorkSignal.notify_all();
+}
+
+
+void DeliveryScheduler::cancel(const std::shared_ptr<Task>& task) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    task->mCancelled = true;
+    task->mRunAgain = false;
+    task->mDeadline = Clock::time_point::max();
+    if (task->mRunner == std::this_thread::get_id()) {
+        return;
+    }
+    mIdleSignal.wait(lock, [&task]() { return !task->mRunning; });
+}
+
+
+void DeliveryScheduler::queueLocked(const std::shared_ptr<Task>& task) {
+    if (!task->mQueued) {
+        task->mQueued = true;
+        mReadyTasks.emplace_back(task);
+    }
+}
+
+
+void DeliveryScheduler::run() {
+    threadpolicy::applyThreadPolicy(threadpolicy::kRoleFrameDelivery);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mExit) {
+        // Moves the tasks whose deadlines have passed to the ready queue
+        const auto now = Clock::now();
+        while (!mTimers.empty() && mTimers.begin()->first <= now) {
+            auto task = mTimers.begin()->second.lock();
+            if (task != nullptr && task->mDeadline == mTimers.begin()->first) {
+                task->mDeadline = Clock::time_point::max();
+                if (task->mRunning) {
+                    task->mRunAgain = true;
+                } else {
+                    queueLocked(task);
+                }
+            }
+            mTimers.erase(mTimers.begin());
+        }
+
+        if (mReadyTasks.empty()) {
+            if (mTimers.empty()) {
+                mWorkSignal.wait(lock);
+            } else {
+                mWorkSignal.wait_until(lock, mTimers.begin()->first);
+            }
+            continue;
+        }
+
+        auto task = std::move(mReadyTasks.front());
+        mReadyTasks.pop_front();
+        task->mQueued = false;
+        if (task->mCancelled || task->mRunning) {
+            // A running task is queued again once it ends, if it has to be.
+            continue;
+        }
+
+        task->mRunning = true;
+        task->mRunner = std::this_thread::get_id();
+        lock.unlock();
+        task->mFunction();
+        lock.lock();
+        task->mRunning = false;
+        task->mRunner = std::thread::id();
+        if (task->mRunAgain && !task->mCancelled) {
+            task->mRunAgain = false;
+            queueLocked(task);
+            mWorkSignal.notify_one();
+        }
+        mIdleSignal.notify_all();
+    }
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_DELIVERYSCHEDULER_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_1_DELIVERYSCHEDULER_H
+
+#include <android-base/thread_annotations.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Runs the frame and event deliveries of all the clients on a fixed pool of threads, so the
+// number of threads of the manager follows the number of cores rather than of clients.  Each
+// client owns tasks that are run when they are scheduled, either as soon as a thread is free
+// or at a deadline.  A task never runs on two threads at once, and a task scheduled while it
+// runs is run again right after.
+class DeliveryScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    class Task {
+    public:
+        explicit Task(std::function<void()> function) : mFunction(std::move(function)) {}
+
+    private:
+        friend class DeliveryScheduler;
+
+        const std::function<void()> mFunction;
+
+        // Guarded by the mutex of the scheduler
+        bool                        mQueued = false;
+        bool                        mRunning = false;
+        bool                        mRunAgain = false;
+        bool                        mCancelled = false;
+        std::thread::id             mRunner;
+        Clock::time_point           mDeadline = Clock::time_point::max();
+    };
+
+    // The scheduler shared by all the clients of the manager
+    static std::shared_ptr<DeliveryScheduler> getDefault();
+
+    explicit DeliveryScheduler(unsigned numThreads);
+    ~DeliveryScheduler();
+
+    std::shared_ptr<Task> createTask(std::function<void()> function);
+
+    // Runs |task| as soon as a thread is free.
+    void schedule(const std::shared_ptr<Task>& task);
+
+    // Runs |task| at |deadline|, or earlier if it is scheduled otherwise before then.
+    void scheduleAt(const std::shared_ptr<Task>& task, Clock::time_point deadline);
+
+    // Stops running |task| and waits for a run in progress to end, unless called from the task
+    // itself.  A cancelled task is never run again.
+    void cancel(const std::shared_ptr<Task>& task);
+
+    unsigned getNumThreads() const { return mThreads.size(); }
+
+private:
+    void run();
+
+    // Queues |task| for the next free thread, unless it is queued already.
+    void queueLocked(const std::shared_ptr<Task>& task) REQUIRES(mMutex);
+
+    std::mutex                                mMutex;
+    std::condition_variable                   mWorkSignal;
+    std::condition_variable                   mIdleSignal;
+    bool                                      mExit GUARDED_BY(mMutex) = false;
+    std::deque<std::shared_ptr<Task>>         mReadyTasks GUARDED_BY(mMutex);
+    // Deadlines of the tasks.  A deadline is stale if the task has changed it since.
+    std::multimap<Clock::time_point, std::weak_ptr<Task>>
+                                              mTimers GUARDED_BY(mMutex);
+    std::vector<std::thread>                  mThreads;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_1_DELIVERYSCHEDULER_H
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DerivedStream.h"
+
+#include <android-base/logging.h>
+#include <android/hardware_buffer.h>
+#include <system/graphics.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+constexpr uint64_t kDerivedBufferUsage =
+        GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE;
+
+bool isSupportedFormat(int32_t format) {
+    return format == HAL_PIXEL_FORMAT_RGBA_8888 || format == HAL_PIXEL_FORMAT_Y8;
+}
+
+}  // namespace
+
+
+bool DerivedStream::isSupported(const Stream& native, const Stream& derived) {
+    if (!isSupportedFormat(static_cast<int32_t>(derived.format)) ||
+        derived.width < 1 || derived.height < 1) {
+        return false;
+    }
+
+    // Only scales down; the native size is unknown for the cameras opened by v1.0 clients.
+    return native.width < 1 || native.height < 1 ||
+           (derived.width <= native.width && derived.height <= native.height);
+}
+
+
+DerivedStream::DerivedStream(const Stream& config, uint32_t firstBufferId, uint32_t numBuffers) :
+        mConfig(config),
+        mFirstBufferId(firstBufferId),
+        mNumBuffers(numBuffers),
+        mSlots(new Slot[numBuffers]) {}
+
+
+DerivedStream::~DerivedStream() {
+    auto& mapper = GraphicBufferMapper::get();
+    for (auto&& [id, source] : mSources) {
+        mapper.freeBuffer(source.imported);
+    }
+}
+
+
+bool DerivedStream::init() {
+    for (uint32_t i = 0; i < mNumBuffers; ++i) {
+        mSlots[i].buffer = new GraphicBuffer(mConfig.width, mConfig.height,
+                                             static_cast<PixelFormat>(mConfig.format),
+                                             /*layerCount=*/1, kDerivedBufferUsage,
+                                             "EvsDerivedStream");
+        if (mSlots[i].buffer->initCheck() != NO_ERROR) {
+            LOG(ERROR) << "Failed to allocate a " << mConfig.width << "x" << mConfig.height
+                       << " buffer in format " << static_cast<int32_t>(mConfig.format);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool DerivedStream::matches(const Stream& config) const {
+    return config.width == mConfig.width && config.height == mConfig.height &&
+           config.format == mConfig.format;
+}
+
+
+buffer_handle_t DerivedStream::importSource(const BufferDesc_1_1& src) {
+    auto& mapper = GraphicBufferMapper::get();
+    const native_handle_t* handle = src.buffer.nativeHandle.getNativeHandle();
+    auto& source = mSources[src.bufferId];
+    if (source.original == handle && source.imported != nullptr) {
+        return source.imported;
+    }
+
+    // The hardware camera replaced the buffer behind this bufferId
+    if (source.imported != nullptr) {
+        mapper.freeBuffer(source.imported);
+        source.imported = nullptr;
+    }
+
+    const AHardwareBuffer_Desc* desc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&src.buffer.description);
+    if (mapper.importBuffer(handle, desc->width, desc->height, desc->layers, desc->format,
+                            desc->usage, desc->stride, &source.imported) != NO_ERROR) {
+        LOG(ERROR) << "Failed to import buffer #" << src.bufferId;
+        mSources.erase(src.bufferId);
+        return nullptr;
+    }
+
+    source.original = handle;
+    return source.imported;
+}
+
+
+bool DerivedStream::convert(const BufferDesc_1_1& src, BufferDesc_1_1* dst) {
+    const AHardwareBuffer_Desc* srcDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&src.buffer.description);
+    if (srcDesc->format != HAL_PIXEL_FORMAT_RGBA_8888) {
+        LOG(WARNING) << "Can't derive frames from format " << srcDesc->format;
+        return false;
+    }
+
+    // Claims a free buffer
+    Slot* slot = nullptr;
+    uint32_t index = 0;
+    for (; index < mNumBuffers; ++index) {
+        int32_t expected = 0;
+        if (mSlots[index].refCount.compare_exchange_strong(expected, 1)) {
+            slot = &mSlots[index];
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        return false;
+    }
+
+    buffer_handle_t source = importSource(src);
+    void* srcPixels = nullptr;
+    void* dstPixels = nullptr;
+    auto& mapper = GraphicBufferMapper::get();
+    if (source == nullptr ||
+        mapper.lock(source, GRALLOC_USAGE_SW_READ_OFTEN,
+                    Rect(srcDesc->width, srcDesc->height), &srcPixels) != NO_ERROR) {
+        slot->refCount.store(0);
+        return false;
+    }
+    if (slot->buffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, &dstPixels) != NO_ERROR) {
+        mapper.unlock(source);
+        slot->refCount.store(0);
+        return false;
+    }
+
+    // Scales with the nearest pixels, computing the source columns once per frame
+    const uint32_t width = slot->buffer->getWidth();
+    const uint32_t height = slot->buffer->getHeight();
+    const uint32_t dstStride = slot->buffer->getStride();
+    std::vector<uint32_t> columns(width);
+    for (uint32_t x = 0; x < width; ++x) {
+        columns[x] = x * srcDesc->width / width;
+    }
+
+    const bool toGray = static_cast<int32_t>(mConfig.format) == HAL_PIXEL_FORMAT_Y8;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* srcRow = static_cast<const uint8_t*>(srcPixels) +
+                static_cast<size_t>(y * srcDesc->height / height) * srcDesc->stride * 4;
+        const size_t dstOffset = static_cast<size_t>(y) * dstStride;
+        if (toGray) {
+            uint8_t* dstRow = static_cast<uint8_t*>(dstPixels) + dstOffset;
+            for (uint32_t x = 0; x < width; ++x) {
+                const uint8_t* rgba = srcRow + columns[x] * 4;
+                dstRow[x] =
+                        static_cast<uint8_t>((77 * rgba[0] + 150 * rgba[1] + 29 * rgba[2]) >> 8);
+            }
+        } else {
+            uint32_t* dstRow = static_cast<uint32_t*>(dstPixels) + dstOffset;
+            const uint32_t* srcRgba = reinterpret_cast<const uint32_t*>(srcRow);
+            for (uint32_t x = 0; x < width; ++x) {
+                dstRow[x] = srcRgba[columns[x]];
+            }
+        }
+    }
+
+    slot->buffer->unlock();
+    mapper.unlock(source);
+
+    // Describes the derived frame; the rest is inherited from the source frame
+    *dst = src;
+    dst->bufferId = mFirstBufferId + index;
+    dst->buffer.nativeHandle = slot->buffer->handle;
+    AHardwareBuffer_Desc* dstDesc =
+            reinterpret_cast<AHardwareBuffer_Desc*>(&dst->buffer.description);
+    dstDesc->width = width;
+    dstDesc->height = height;
+    dstDesc->layers = 1;
+    dstDesc->format = static_cast<uint32_t>(mConfig.format);
+    dstDesc->usage = kDerivedBufferUsage;
+    dstDesc->stride = dstStride;
+    return true;
+}
+
+
+void DerivedStream::acquire(uint32_t bufferId) {
+    mSlots[bufferId - mFirstBufferId].refCount.fetch_add(1);
+}
+
+
+void DerivedStream::release(uint32_t bufferId) {
+    if (mSlots[bufferId - mFirstBufferId].refCount.fetch_sub(1) < 1) {
+        LOG(ERROR) << "Derived buffer #" << bufferId << " released more than acquired";
+        mSlots[bufferId - mFirstBufferId].refCount.store(0);
+    }
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
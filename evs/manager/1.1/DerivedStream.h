@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_DERIVEDSTREAM_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_1_DERIVEDSTREAM_H
+
+#include <android/hardware/automotive/evs/1.1/types.h>
+#include <android/hardware/camera/device/3.2/ICameraDevice.h>
+#include <ui/GraphicBuffer.h>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
+using ::android::hardware::camera::device::V3_2::Stream;
+
+
+// Stream derived from the native stream of a hardware camera at a lower resolution or in
+// another format.  Every frame is converted once into a buffer of its own pool and shared by
+// all the clients that asked for this configuration.  The buffers have their own range of
+// bufferIds, so their returns can be told apart from the hardware camera's buffers.
+//
+// RGBA_8888 frames can be scaled down to RGBA_8888 or to Y8 grayscale.
+class DerivedStream {
+public:
+    // Returns true if frames of the |native| configuration can be converted to |derived|.
+    static bool isSupported(const Stream& native, const Stream& derived);
+
+    DerivedStream(const Stream& config, uint32_t firstBufferId, uint32_t numBuffers);
+    ~DerivedStream();
+
+    // Allocates the buffers.  Returns false if they can't be allocated.
+    bool init();
+
+    // Returns true if this stream serves the resolution and the format of |config|.
+    bool matches(const Stream& config) const;
+
+    // Returns true if |bufferId| is one of the buffers of this stream.
+    bool owns(uint32_t bufferId) const {
+        return bufferId >= mFirstBufferId && bufferId - mFirstBufferId < mNumBuffers;
+    }
+
+    // Converts |src| into a free buffer and describes it in |dst|, with a reference held by
+    // the caller.  Returns false if no buffer is free or |src| can't be read.  Called only from
+    // the stream callback.
+    bool convert(const BufferDesc_1_1& src, BufferDesc_1_1* dst);
+
+    // Takes and drops a reference on one of the buffers of this stream.
+    void acquire(uint32_t bufferId);
+    void release(uint32_t bufferId);
+
+    const Stream& getConfig() const { return mConfig; }
+
+private:
+    struct Slot {
+        sp<GraphicBuffer>       buffer;
+        std::atomic<int32_t>    refCount{0};
+    };
+
+    // Buffer of the hardware camera, imported once to be locked for reading
+    struct SourceBuffer {
+        const native_handle_t*  original = nullptr;
+        buffer_handle_t         imported = nullptr;
+    };
+
+    // Returns the imported handle of |src|, importing it if it's new.
+    buffer_handle_t importSource(const BufferDesc_1_1& src);
+
+    const Stream                mConfig;
+    const uint32_t              mFirstBufferId;
+    const uint32_t              mNumBuffers;
+    std::unique_ptr<Slot[]>     mSlots;
+
+    // Imported hardware camera buffers, indexed by bufferId.  Used only from the stream
+    // callback.
+    std::unordered_map<uint32_t, SourceBuffer> mSources;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_1_DERIVEDSTREAM_H
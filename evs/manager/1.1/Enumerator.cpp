@@ -21,10 +21,14 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android-base/properties.h>
 #include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 #include <cutils/android_filesystem_config.h>
 #include <hwbinder/IPCThreadState.h>
+#include <threadpolicy/ThreadPolicy.h>
+
+#include <algorithm>
 
 namespace {
 
@@ -32,12 +36,14 @@ namespace {
     const char* kDumpOptionAll = "all";
     const char* kDumpDeviceCamera = "camera";
     const char* kDumpDeviceDisplay = "display";
+    const char* kDumpDeviceThreads = "threads";
 
     const char* kDumpCameraCommandCurrent = "--current";
     const char* kDumpCameraCommandCollected = "--collected";
     const char* kDumpCameraCommandCustom = "--custom";
     const char* kDumpCameraCommandCustomStart = "start";
     const char* kDumpCameraCommandCustomStop = "stop";
+    const char* kDumpCameraCommandCustomStopBinary = "binary";
 
     const int kDumpCameraMinNumArgs = 4;
     const int kOptionDumpDeviceTypeIndex = 1;
@@ -55,18 +61,108 @@ namespace implementation {
 
 using ::android::base::Error;
 using ::android::base::EqualsIgnoreCase;
+using ::android::base::GetIntProperty;
 using ::android::base::StringAppendF;
 using ::android::base::StringPrintf;
 using ::android::base::WriteStringToFd;
 using CameraDesc_1_0 = ::android::hardware::automotive::evs::V1_0::CameraDesc;
 using CameraDesc_1_1 = ::android::hardware::automotive::evs::V1_1::CameraDesc;
 
+namespace {
+
+// How long a camera stays open after its last client closed it, and how many cameras are kept
+// open that way.  Keeping cameras open is disabled unless the period is set.
+constexpr char kWarmPeriodPropertyName[] = "ro.automotive.evs.camera_warm_period_ms";
+constexpr char kMaxWarmCamerasPropertyName[] = "ro.automotive.evs.camera_warm_pool_size";
+constexpr int32_t kDefaultMaxWarmCameras = 2;
+
+}  // namespace
+
+
 Enumerator::~Enumerator() {
+    stopWarmPool();
+
     if (mClientsMonitor != nullptr) {
         mClientsMonitor->stopCollection();
     }
 }
 
+
+sp<HalCamera> Enumerator::takeWarmCamera(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mWarmPoolMutex);
+    for (auto it = mWarmCameras.begin(); it != mWarmCameras.end(); ++it) {
+        if (it->camera->getId() == id) {
+            sp<HalCamera> camera = std::move(it->camera);
+            mWarmCameras.erase(it);
+            LOG(DEBUG) << "Reopening " << id << " from the warm pool";
+            return camera;
+        }
+    }
+
+    return nullptr;
+}
+
+
+void Enumerator::keepCameraWarm(const sp<HalCamera>& camera) {
+    if (mWarmPeriod.count() <= 0 || mMaxWarmCameras < 1) {
+        // Drops the camera with the caller's reference
+        return;
+    }
+
+    // The evicted cameras are released after the lock is dropped
+    std::list<WarmCamera> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mWarmPoolMutex);
+        if (mWarmCameras.size() >= mMaxWarmCameras) {
+            evicted.splice(evicted.end(), mWarmCameras, mWarmCameras.begin());
+        }
+        mWarmCameras.push_back({camera, std::chrono::steady_clock::now() + mWarmPeriod});
+
+        if (!mWarmPoolThread.joinable()) {
+            mWarmPoolExit = false;
+            mWarmPoolThread = std::thread([this]() {
+                std::unique_lock<std::mutex> lock(mWarmPoolMutex);
+                while (!mWarmPoolExit) {
+                    if (mWarmCameras.empty()) {
+                        mWarmPoolSignal.wait(lock);
+                        continue;
+                    }
+
+                    if (mWarmPoolSignal.wait_until(lock, mWarmCameras.front().expiry) ==
+                            std::cv_status::timeout) {
+                        std::list<WarmCamera> expired;
+                        const auto now = std::chrono::steady_clock::now();
+                        while (!mWarmCameras.empty() && mWarmCameras.front().expiry <= now) {
+                            expired.splice(expired.end(), mWarmCameras, mWarmCameras.begin());
+                        }
+
+                        // Closes the expired cameras
+                        lock.unlock();
+                        expired.clear();
+                        lock.lock();
+                    }
+                }
+            });
+        }
+    }
+    mWarmPoolSignal.notify_one();
+}
+
+
+void Enumerator::stopWarmPool() {
+    std::list<WarmCamera> released;
+    {
+        std::lock_guard<std::mutex> lock(mWarmPoolMutex);
+        mWarmPoolExit = true;
+        released.swap(mWarmCameras);
+    }
+    mWarmPoolSignal.notify_one();
+
+    if (mWarmPoolThread.joinable()) {
+        mWarmPoolThread.join();
+    }
+}
+
 bool Enumerator::init(const char* hardwareServiceName) {
     LOG(DEBUG) << "init";
 
@@ -90,6 +186,20 @@ bool Enumerator::init(const char* hardwareServiceName) {
         );
     }
 
+    // Caches the cameras and their topology
+    if (result) {
+        mHwEnumerator->getCameraList_1_1(
+            [this](const hardware::hidl_vec<CameraDesc_1_1>& cameras) {
+                updateCameraDevices(cameras);
+            }
+        );
+    }
+
+    // Configures the warm pool of the cameras
+    mWarmPeriod = std::chrono::milliseconds(GetIntProperty(kWarmPeriodPropertyName, 0));
+    mMaxWarmCameras = std::max(GetIntProperty(kMaxWarmCamerasPropertyName,
+                                              kDefaultMaxWarmCameras), 0);
+
     // Starts the statistics collection
     mMonitorEnabled = false;
     mClientsMonitor = new StatsCollector();
@@ -160,30 +270,27 @@ bool Enumerator::isLogicalCamera(const camera_metadata_t *metadata) {
 }
 
 
-std::unordered_set<std::string> Enumerator::getPhysicalCameraIds(const std::string& id) {
-    std::unordered_set<std::string> physicalCameras;
-    if (mCameraDevices.find(id) == mCameraDevices.end()) {
-        LOG(ERROR) << "Queried device " << id << " does not exist!";
-        return physicalCameras;
-    }
-
+Enumerator::CameraTopology Enumerator::parseCameraTopology(const CameraDesc& desc) {
+    CameraTopology topology;
+    const auto& id = desc.v1.cameraId;
     const camera_metadata_t *metadata =
-        reinterpret_cast<camera_metadata_t *>(&mCameraDevices[id].metadata[0]);
-    if (!isLogicalCamera(metadata)) {
+        reinterpret_cast<const camera_metadata_t *>(desc.metadata.data());
+    if (desc.metadata.size() < 1 || !isLogicalCamera(metadata)) {
         // EVS assumes that the device w/o a valid metadata is a physical
         // device.
         LOG(INFO) << id << " is not a logical camera device.";
-        physicalCameras.emplace(id);
-        return physicalCameras;
+        topology.physicalIds.emplace(id);
+        return topology;
     }
 
+    topology.isLogical = true;
     camera_metadata_ro_entry entry;
     int rc = find_camera_metadata_ro_entry(metadata,
                                            ANDROID_LOGICAL_MULTI_CAMERA_PHYSICAL_IDS,
                                            &entry);
     if (0 != rc) {
         LOG(ERROR) << "No physical camera ID is found for a logical camera device " << id;
-        return physicalCameras;
+        return topology;
     }
 
     const uint8_t *ids = entry.data.u8;
@@ -192,15 +299,49 @@ std::unordered_set<std::string> Enumerator::getPhysicalCameraIds(const std::stri
         if (ids[i] == '\0') {
             if (start != i) {
                 std::string id(reinterpret_cast<const char *>(ids + start));
-                physicalCameras.emplace(id);
+                topology.physicalIds.emplace(id);
             }
             start = i + 1;
         }
     }
 
     LOG(INFO) << id << " consists of "
-               << physicalCameras.size() << " physical camera devices.";
-    return physicalCameras;
+               << topology.physicalIds.size() << " physical camera devices.";
+    return topology;
+}
+
+
+void Enumerator::updateCameraDevices(const hardware::hidl_vec<CameraDesc>& cameras) {
+    // Keeps the cache, and the descriptors logical cameras point to, unless a camera has been
+    // added, removed or changed.
+    bool changed = cameras.size() != mCameraDevices.size();
+    for (size_t i = 0; !changed && i < cameras.size(); ++i) {
+        auto it = mCameraDevices.find(cameras[i].v1.cameraId);
+        changed = it == mCameraDevices.end() || !(it->second == cameras[i]);
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    mCameraDevices.clear();
+    mCameraTopology.clear();
+    for (auto&& desc : cameras) {
+        mCameraDevices.insert_or_assign(desc.v1.cameraId, desc);
+        mCameraTopology.insert_or_assign(desc.v1.cameraId, parseCameraTopology(desc));
+    }
+}
+
+
+const std::unordered_set<std::string>& Enumerator::getPhysicalCameraIds(const std::string& id) {
+    static const std::unordered_set<std::string> kNoCameras;
+    auto it = mCameraTopology.find(id);
+    if (it == mCameraTopology.end()) {
+        LOG(ERROR) << "Queried device " << id << " does not exist!";
+        return kNoCameras;
+    }
+
+    return it->second.physicalIds;
 }
 
 
@@ -232,6 +373,11 @@ Return<sp<IEvsCamera_1_0>> Enumerator::openCamera(const hidl_string& cameraId) {
     if (mActiveCameras.find(cameraId) != mActiveCameras.end()) {
         hwCamera = mActiveCameras[cameraId];
     } else {
+        // Reuses the camera kept open since its last client closed it
+        hwCamera = takeWarmCamera(cameraId);
+    }
+
+    if (hwCamera == nullptr) {
         // Is the hardware camera available?
         sp<IEvsCamera_1_1> device =
             IEvsCamera_1_1::castFrom(mHwEnumerator->openCamera(cameraId))
@@ -290,12 +436,13 @@ Return<void> Enumerator::closeCamera(const ::android::sp<IEvsCamera_1_0>& client
         // Did we just remove the last client of this camera?
         if (halCamera->getClientCount() == 0) {
             // Take this now unused camera out of our list
-            // NOTE:  This should drop our last reference to the camera, resulting in its
-            //        destruction.
+            // NOTE:  Unless the camera is kept warm, this should drop our last reference to
+            //        the camera, resulting in its destruction.
             mActiveCameras.erase(halCamera->getId());
             if (mMonitorEnabled) {
                 mClientsMonitor->unregisterClientToMonitor(halCamera->getId());
             }
+            keepCameraWarm(halCamera);
         }
     }
 
@@ -316,8 +463,9 @@ Return<sp<IEvsCamera_1_1>> Enumerator::openCamera_1_1(const hidl_string& cameraI
 
     // If hwCamera is null, a requested camera device is either a logical camera
     // device or a hardware camera, which is not being used now.
-    std::unordered_set<std::string> physicalCameras = getPhysicalCameraIds(cameraId);
+    const auto& physicalCameras = getPhysicalCameraIds(cameraId);
     std::vector<sp<HalCamera>> sourceCameras;
+    std::vector<sp<HalCamera>> derivedCameras;
     sp<HalCamera> hwCamera;
     bool success = true;
 
@@ -325,24 +473,34 @@ Return<sp<IEvsCamera_1_1>> Enumerator::openCamera_1_1(const hidl_string& cameraI
     for (auto&& id : physicalCameras) {
         auto it = mActiveCameras.find(id);
         if (it == mActiveCameras.end()) {
-            // Try to open a hardware camera.
-            sp<IEvsCamera_1_1> device =
-                IEvsCamera_1_1::castFrom(mHwEnumerator->openCamera_1_1(id, streamCfg))
-                .withDefault(nullptr);
-            if (device == nullptr) {
-                LOG(ERROR) << "Failed to open hardware camera " << cameraId;
-                success = false;
-                break;
-            } else {
-                // Calculates the usage statistics record identifier
-                auto fn = mCameraDevices.hash_function();
-                auto recordId = fn(id) & 0xFF;
-                hwCamera = new HalCamera(device, id, recordId, streamCfg);
-                if (hwCamera == nullptr) {
-                    LOG(ERROR) << "Failed to allocate camera wrapper object";
-                    mHwEnumerator->closeCamera(device);
+            // Reuses the camera kept open since its last client closed it, if it streams in
+            // the requested configuration.  Otherwise, it is released here so the hardware
+            // camera can be opened again.
+            hwCamera = takeWarmCamera(id);
+            if (hwCamera != nullptr && hwCamera->getStreamConfig().id != streamCfg.id) {
+                hwCamera = nullptr;
+            }
+
+            if (hwCamera == nullptr) {
+                // Try to open a hardware camera.
+                sp<IEvsCamera_1_1> device =
+                    IEvsCamera_1_1::castFrom(mHwEnumerator->openCamera_1_1(id, streamCfg))
+                    .withDefault(nullptr);
+                if (device == nullptr) {
+                    LOG(ERROR) << "Failed to open hardware camera " << cameraId;
                     success = false;
                     break;
+                } else {
+                    // Calculates the usage statistics record identifier
+                    auto fn = mCameraDevices.hash_function();
+                    auto recordId = fn(id) & 0xFF;
+                    hwCamera = new HalCamera(device, id, recordId, streamCfg);
+                    if (hwCamera == nullptr) {
+                        LOG(ERROR) << "Failed to allocate camera wrapper object";
+                        mHwEnumerator->closeCamera(device);
+                        success = false;
+                        break;
+                    }
                 }
             }
 
@@ -354,10 +512,14 @@ Return<sp<IEvsCamera_1_1>> Enumerator::openCamera_1_1(const hidl_string& cameraI
 
             sourceCameras.push_back(hwCamera);
         } else {
-            if (it->second->getStreamConfig().id != streamCfg.id) {
-                LOG(WARNING) << "Requested camera is already active in different configuration.";
-            } else {
+            if (it->second->getStreamConfig().id == streamCfg.id) {
+                sourceCameras.push_back(it->second);
+            } else if (it->second->canDeriveStream(streamCfg)) {
+                // Serves the requested configuration from the active stream
                 sourceCameras.push_back(it->second);
+                derivedCameras.push_back(it->second);
+            } else {
+                LOG(WARNING) << "Requested camera is already active in different configuration.";
             }
         }
     }
@@ -389,6 +551,13 @@ Return<sp<IEvsCamera_1_1>> Enumerator::openCamera_1_1(const hidl_string& cameraI
                            << " failed to own a created proxy camera object.";
             }
         }
+
+        for (auto&& hwCamera : derivedCameras) {
+            if (!hwCamera->setClientStreamConfig(clientCamera.get(), streamCfg)) {
+                LOG(WARNING) << hwCamera->getId()
+                             << " delivers frames in its active configuration instead.";
+            }
+        }
     }
 
     // Send the virtual camera object back to the client by strong pointer which will keep it alive
@@ -414,10 +583,7 @@ Return<void> Enumerator::getCameraList_1_1(getCameraList_1_1_cb list_cb)  {
     );
 
     // Update the cached device list
-    mCameraDevices.clear();
-    for (auto&& desc : hidlCameras) {
-        mCameraDevices.insert_or_assign(desc.v1.cameraId, desc);
-    }
+    updateCameraDevices(hidlCameras);
 
     list_cb(hidlCameras);
     return Void();
@@ -467,7 +633,9 @@ Return<void> Enumerator::closeDisplay(const ::android::sp<IEvsDisplay_1_0>& disp
     } else {
         // Pass this request through to the hardware layer
         sp<HalDisplay> halDisplay = reinterpret_cast<HalDisplay *>(pActiveDisplay.get());
-        mHwEnumerator->closeDisplay(halDisplay->getHwDisplay());
+        sp<IEvsDisplay_1_0> hwDisplay = halDisplay->getHwDisplay();
+        halDisplay->shutdown();
+        mHwEnumerator->closeDisplay(hwDisplay);
         mActiveDisplay = nullptr;
     }
 
@@ -538,25 +706,83 @@ Return<void> Enumerator::getDisplayIdList(getDisplayIdList_cb _list_cb)  {
 
 // TODO(b/149874793): Add implementation for EVS Manager and Sample driver
 Return<void> Enumerator::getUltrasonicsArrayList(getUltrasonicsArrayList_cb _hidl_cb) {
-    hardware::hidl_vec<UltrasonicsArrayDesc> ultrasonicsArrayDesc;
-    _hidl_cb(ultrasonicsArrayDesc);
-    return Void();
+    LOG(DEBUG) << __FUNCTION__;
+    if (!checkPermission()) {
+        _hidl_cb({});
+        return Void();
+    }
+
+    // Straight pass through to the hardware layer
+    return mHwEnumerator->getUltrasonicsArrayList(_hidl_cb);
 }
 
 
-// TODO(b/149874793): Add implementation for EVS Manager and Sample driver
 Return<sp<IEvsUltrasonicsArray>> Enumerator::openUltrasonicsArray(
         const hidl_string& ultrasonicsArrayId) {
-    (void)ultrasonicsArrayId;
-    sp<IEvsUltrasonicsArray> pEvsUltrasonicsArray;
-    return pEvsUltrasonicsArray;
+    LOG(DEBUG) << __FUNCTION__;
+    if (!checkPermission()) {
+        return nullptr;
+    }
+
+    // Shares the array with its other clients if it is open already
+    sp<HalUltrasonicsArray> halArray;
+    auto it = mActiveUltrasonicsArrays.find(ultrasonicsArrayId);
+    if (it != mActiveUltrasonicsArrays.end()) {
+        halArray = it->second;
+    } else {
+        sp<IEvsUltrasonicsArray> device =
+                mHwEnumerator->openUltrasonicsArray(ultrasonicsArrayId).withDefault(nullptr);
+        if (device == nullptr) {
+            LOG(ERROR) << "Failed to open hardware ultrasonics array " << ultrasonicsArrayId;
+            return nullptr;
+        }
+
+        halArray = new HalUltrasonicsArray(device, ultrasonicsArrayId);
+        mActiveUltrasonicsArrays.try_emplace(ultrasonicsArrayId, halArray);
+    }
+
+    sp<VirtualUltrasonicsArray> clientArray = halArray->makeVirtualArray();
+    if (clientArray == nullptr) {
+        LOG(ERROR) << "Failed to create a client ultrasonics array object";
+        if (halArray->getClientCount() == 0) {
+            mActiveUltrasonicsArrays.erase(halArray->getId());
+            mHwEnumerator->closeUltrasonicsArray(halArray->getHwArray());
+        }
+    }
+
+    return clientArray;
 }
 
 
-// TODO(b/149874793): Add implementation for EVS Manager and Sample driver
 Return<void> Enumerator::closeUltrasonicsArray(
         const ::android::sp<IEvsUltrasonicsArray>& evsUltrasonicsArray)  {
-    (void)evsUltrasonicsArray;
+    LOG(DEBUG) << __FUNCTION__;
+
+    if (evsUltrasonicsArray.get() == nullptr) {
+        LOG(ERROR) << "Ignoring call with null ultrasonics array pointer.";
+        return Void();
+    }
+
+    // All our client arrays are actually VirtualUltrasonicsArray objects
+    sp<VirtualUltrasonicsArray> clientArray =
+            reinterpret_cast<VirtualUltrasonicsArray*>(evsUltrasonicsArray.get());
+
+    // Make sure the stream is stopped and the frames held are back
+    clientArray->shutdown();
+
+    sp<HalUltrasonicsArray> halArray = clientArray->getHalArray();
+    if (halArray == nullptr) {
+        return Void();
+    }
+
+    halArray->disownVirtualArray(clientArray);
+
+    // Did we just remove the last client of this array?
+    if (halArray->getClientCount() == 0) {
+        mActiveUltrasonicsArrays.erase(halArray->getId());
+        mHwEnumerator->closeUltrasonicsArray(halArray->getHwArray());
+    }
+
     return Void();
 }
 
@@ -606,8 +832,10 @@ void Enumerator::cmdHelp(int fd) {
                     "\t\tstart [interval] [duration]: starts collecting usage statistics "
                     "at every [interval] during [duration].  Interval and duration are in "
                     "milliseconds.\n"
-                    "\t\tstop: stops collecting usage statistics and shows collected records.\n"
-                    "--dump display: shows current status of the display\n", fd);
+                    "\t\tstop [binary]: stops collecting usage statistics and shows collected "
+                    "records, or writes them in the binary format of StatsCollector.\n"
+                    "--dump display: shows current status of the display\n"
+                    "--dump threads: shows the scheduling policies of the frame threads\n", fd);
 }
 
 
@@ -651,6 +879,10 @@ void Enumerator::cmdList(int fd, const hidl_vec<hidl_string>& options) {
         for (auto& [id, ptr] : mActiveCameras) {
             StringAppendF(&buffer, "%s%s\n", kSingleIndent, id.c_str());
         }
+        StringAppendF(&buffer, "%sUltrasonics arrays currently in use:\n", kSingleIndent);
+        for (auto& [id, ptr] : mActiveUltrasonicsArrays) {
+            buffer += ptr->toString(kSingleIndent);
+        }
         StringAppendF(&buffer, "\n");
     }
 
@@ -680,12 +912,14 @@ void Enumerator::cmdDumpDevice(int fd, const hidl_vec<hidl_string>& options) {
     // Dumps both cameras and displays if the target device type is not given
     bool dumpCameras = false;
     bool dumpDisplays = false;
+    bool dumpThreads = false;
     const auto numOptions = options.size();
     if (numOptions > kOptionDumpDeviceTypeIndex) {
         const std::string target = options[kOptionDumpDeviceTypeIndex];
         dumpCameras = EqualsIgnoreCase(target, kDumpDeviceCamera);
         dumpDisplays = EqualsIgnoreCase(target, kDumpDeviceDisplay);
-        if (!dumpCameras && !dumpDisplays) {
+        dumpThreads = EqualsIgnoreCase(target, kDumpDeviceThreads);
+        if (!dumpCameras && !dumpDisplays && !dumpThreads) {
             WriteStringToFd(StringPrintf("Unrecognized option, %s, is ignored.\n",
                                          target.c_str()),
                             fd);
@@ -810,7 +1044,14 @@ void Enumerator::cmdDumpDevice(int fd, const hidl_vec<hidl_string>& options) {
                     return;
                 }
 
-                auto result = mClientsMonitor->stopCustomCollection(deviceId);
+                auto format = StatsCollector::ExportFormat::TEXT;
+                if (numOptions > kOptionDumpCameraArgsStartIndex + 1 &&
+                    EqualsIgnoreCase(std::string(options[kOptionDumpCameraArgsStartIndex + 1]),
+                                     kDumpCameraCommandCustomStopBinary)) {
+                    format = StatsCollector::ExportFormat::BINARY;
+                }
+
+                auto result = mClientsMonitor->stopCustomCollection(deviceId, format);
                 if (!result) {
                     LOG(ERROR) << "Failed to stop a custom collection.  "
                                << result.error();
@@ -848,6 +1089,10 @@ void Enumerator::cmdDumpDevice(int fd, const hidl_vec<hidl_string>& options) {
             WriteStringToFd(pDisplay->toString(kSingleIndent), fd);
         }
     }
+
+    if (dumpThreads) {
+        WriteStringToFd(threadpolicy::dumpThreadPolicies(), fd);
+    }
 }
 
 } // namespace implementation
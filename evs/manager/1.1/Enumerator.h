@@ -18,10 +18,16 @@
 #define ANDROID_AUTOMOTIVE_EVS_V1_1_EVSCAMERAENUMERATOR_H
 
 #include "HalCamera.h"
+#include "HalUltrasonicsArray.h"
 #include "VirtualCamera.h"
+#include "VirtualUltrasonicsArray.h"
 #include "stats/StatsCollector.h"
 
+#include <chrono>
+#include <condition_variable>
 #include <list>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -84,7 +90,29 @@ public:
 private:
     bool inline                     checkPermission();
     bool                            isLogicalCamera(const camera_metadata_t *metadata);
-    std::unordered_set<std::string> getPhysicalCameraIds(const std::string& id);
+
+    // Parsed from the metadata of a camera device
+    struct CameraTopology {
+        bool                            isLogical = false;
+        // The camera itself, unless it is a logical camera
+        std::unordered_set<std::string> physicalIds;
+    };
+    CameraTopology                  parseCameraTopology(const CameraDesc& desc);
+
+    // Replaces the cached cameras and their topology if the list of cameras has changed
+    void                            updateCameraDevices(
+                                            const hardware::hidl_vec<CameraDesc>& cameras);
+
+    // Returns the physical cameras of a camera from the cache, without parsing its metadata
+    const std::unordered_set<std::string>& getPhysicalCameraIds(const std::string& id);
+
+    // Returns the camera kept open after its last client closed it, or nullptr.
+    sp<HalCamera>                   takeWarmCamera(const std::string& id);
+    // Keeps a camera without clients open for the warm period, or releases it if the warm
+    // pool is disabled.
+    void                            keepCameraWarm(const sp<HalCamera>& camera);
+    // Releases all the cameras kept open.
+    void                            stopWarmPool();
 
     sp<IEvsEnumerator_1_1>            mHwEnumerator;  // Hardware enumerator
     wp<IEvsDisplay_1_0>               mActiveDisplay; // Display proxy object warpping hw display
@@ -93,10 +121,18 @@ private:
     std::unordered_map<std::string,
                        sp<HalCamera>> mActiveCameras;
 
+    // Active proxy objects that share hw ultrasonics arrays among their clients
+    std::unordered_map<std::string,
+                       sp<HalUltrasonicsArray>> mActiveUltrasonicsArrays;
+
     // List of camera descriptors of enumerated hw cameras
     std::unordered_map<std::string,
                        CameraDesc>    mCameraDevices;
 
+    // Topology of the enumerated hw cameras, parsed once per camera list update
+    std::unordered_map<std::string,
+                       CameraTopology> mCameraTopology;
+
     // List of available physical display devices
     std::list<uint8_t>                mDisplayPorts;
 
@@ -109,6 +145,22 @@ private:
     // Boolean flag to tell whether the camera usages are being monitored or not
     bool                              mMonitorEnabled;
 
+    // Cameras kept open, with their streams stopped, after their last clients closed them.
+    // Reopening one of them skips the hardware enumerator.  mWarmPoolThread releases them
+    // once they expire.  mWarmCameras and mWarmPoolExit are guarded by mWarmPoolMutex, which
+    // the thread waits on with a unique_lock, so they are left unannotated.
+    struct WarmCamera {
+        sp<HalCamera>                         camera;
+        std::chrono::steady_clock::time_point expiry;
+    };
+    std::chrono::milliseconds         mWarmPeriod = std::chrono::milliseconds(0);
+    size_t                            mMaxWarmCameras = 0;
+    std::mutex                        mWarmPoolMutex;
+    std::condition_variable           mWarmPoolSignal;
+    std::list<WarmCamera>             mWarmCameras;     // From the oldest
+    bool                              mWarmPoolExit = false;
+    std::thread                       mWarmPoolThread;
+
     // LSHAL dump
     void cmdDump(int fd, const hidl_vec<hidl_string>& options);
     void cmdHelp(int fd);
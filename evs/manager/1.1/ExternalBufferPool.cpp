@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ExternalBufferPool.h"
+
+#include <android-base/logging.h>
+#include <android/hardware_buffer.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+// Imports the buffer |buffer| describes, or returns nullptr.
+buffer_handle_t importBuffer(const BufferDesc_1_1& buffer) {
+    const AHardwareBuffer_Desc* desc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&buffer.buffer.description);
+    buffer_handle_t imported = nullptr;
+    if (GraphicBufferMapper::get().importBuffer(buffer.buffer.nativeHandle.getNativeHandle(),
+                                                desc->width, desc->height, desc->layers,
+                                                desc->format, desc->usage, desc->stride,
+                                                &imported) != NO_ERROR) {
+        return nullptr;
+    }
+
+    return imported;
+}
+
+}  // namespace
+
+
+ExternalBufferPool::~ExternalBufferPool() {
+    auto& mapper = GraphicBufferMapper::get();
+    for (auto&& [id, handle] : mBuffers) {
+        mapper.freeBuffer(handle);
+    }
+}
+
+
+bool ExternalBufferPool::add(const hardware::hidl_vec<BufferDesc_1_1>& buffers) {
+    auto& mapper = GraphicBufferMapper::get();
+    std::vector<std::pair<uint64_t, buffer_handle_t>> imported;
+    imported.reserve(buffers.size());
+    for (auto&& buffer : buffers) {
+        buffer_handle_t handle = importBuffer(buffer);
+        uint64_t id = 0;
+        if (handle == nullptr || mapper.getBufferId(handle, &id) != NO_ERROR || id == 0) {
+            LOG(ERROR) << "Failed to import external buffer #" << buffer.bufferId;
+            if (handle != nullptr) {
+                mapper.freeBuffer(handle);
+            }
+            for (auto&& entry : imported) {
+                mapper.freeBuffer(entry.second);
+            }
+            return false;
+        }
+
+        imported.emplace_back(id, handle);
+    }
+
+    for (auto&& [id, handle] : imported) {
+        auto [it, inserted] = mBuffers.try_emplace(id, handle);
+        if (!inserted) {
+            // Imported twice; the first import stays.
+            mapper.freeBuffer(handle);
+        }
+    }
+
+    return true;
+}
+
+
+uint64_t ExternalBufferPool::getGrallocId(const BufferDesc_1_1& buffer) {
+    auto& mapper = GraphicBufferMapper::get();
+    buffer_handle_t handle = importBuffer(buffer);
+    if (handle == nullptr) {
+        return 0;
+    }
+
+    uint64_t id = 0;
+    if (mapper.getBufferId(handle, &id) != NO_ERROR) {
+        id = 0;
+    }
+    mapper.freeBuffer(handle);
+    return id;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
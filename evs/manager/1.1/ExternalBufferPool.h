@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_EXTERNALBUFFERPOOL_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_1_EXTERNALBUFFERPOOL_H
+
+#include <android/hardware/automotive/evs/1.1/types.h>
+#include <cutils/native_handle.h>
+#include <utils/RefBase.h>
+
+#include <unordered_map>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+class VirtualCamera;    // From VirtualCamera.h
+
+
+// Buffers a client allocated and imported into a hardware camera.  They are imported into
+// this process once, when they are added, and known by their gralloc buffer IDs, which stay
+// the same in every process.  The frames the hardware camera renders into them are routed
+// back to the client that owns them.  Not thread-safe.
+class ExternalBufferPool {
+public:
+    explicit ExternalBufferPool(const wp<VirtualCamera>& owner) : mOwner(owner) {}
+    ~ExternalBufferPool();
+
+    // Imports |buffers| into the pool.  Returns false, adding none of them, if one of them
+    // can't be imported.
+    bool add(const hardware::hidl_vec<BufferDesc_1_1>& buffers);
+
+    // Returns true if the buffer of |grallocId| belongs to this pool.
+    bool contains(uint64_t grallocId) const { return mBuffers.count(grallocId) > 0; }
+
+    const wp<VirtualCamera>& getOwner() const { return mOwner; }
+    size_t size() const { return mBuffers.size(); }
+
+    // Returns the gralloc buffer ID of the buffer |buffer| describes, or 0 if it can't be read.
+    static uint64_t getGrallocId(const BufferDesc_1_1& buffer);
+
+private:
+    const wp<VirtualCamera> mOwner;
+
+    // Imported buffers by their gralloc buffer IDs
+    std::unordered_map<uint64_t, buffer_handle_t> mBuffers;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_1_EXTERNALBUFFERPOOL_H
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameSynchronizer.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+FrameSynchronizer::FrameSynchronizer(const std::vector<std::string>& deviceIds,
+                                     int64_t toleranceUs,
+                                     size_t maxQueueDepth,
+                                     StalePolicy policy) :
+        mDeviceIds(deviceIds),
+        mToleranceUs(std::max<int64_t>(toleranceUs, 0)),
+        mMaxQueueDepth(std::max<size_t>(maxQueueDepth, 1)),
+        mPolicy(policy) {
+    for (auto&& id : mDeviceIds) {
+        mQueues[id];
+    }
+}
+
+
+void FrameSynchronizer::push(const BufferDesc_1_1& frame, std::vector<BufferDesc_1_1>* dropped) {
+    auto it = mQueues.find(frame.deviceId);
+    if (it == mQueues.end()) {
+        LOG(WARNING) << "Dropping a frame from unknown camera " << frame.deviceId;
+        dropped->emplace_back(frame);
+        return;
+    }
+
+    auto& queue = it->second;
+    if (queue.frames.size() >= mMaxQueueDepth) {
+        dropped->emplace_back(queue.frames.front());
+        queue.frames.pop_front();
+    }
+    queue.frames.emplace_back(frame);
+    queue.lastTimestamp = std::max(queue.lastTimestamp, frame.timestamp);
+}
+
+
+bool FrameSynchronizer::pop(std::vector<BufferDesc_1_1>* frames,
+                            std::vector<BufferDesc_1_1>* dropped) {
+    while (true) {
+        // Every camera must have a candidate.
+        int64_t newest = -1;
+        int64_t oldest = -1;
+        for (auto&& id : mDeviceIds) {
+            const auto& queue = mQueues[id].frames;
+            if (queue.empty()) {
+                return false;
+            }
+
+            const auto timestamp = queue.front().timestamp;
+            newest = std::max(newest, timestamp);
+            oldest = oldest < 0 ? timestamp : std::min(oldest, timestamp);
+        }
+
+        if (newest - oldest <= mToleranceUs) {
+            frames->clear();
+            frames->reserve(mDeviceIds.size());
+            for (auto&& id : mDeviceIds) {
+                auto& queue = mQueues[id].frames;
+                frames->emplace_back(queue.front());
+                queue.pop_front();
+            }
+            return true;
+        }
+
+        // The cameras behind the newest head can't catch up with it with their current
+        // frames; drop them.
+        for (auto&& id : mDeviceIds) {
+            auto& queue = mQueues[id].frames;
+            if (queue.front().timestamp + mToleranceUs >= newest) {
+                continue;
+            }
+
+            if (mPolicy == StalePolicy::DROP_QUEUE) {
+                dropped->insert(dropped->end(), queue.begin(), queue.end());
+                queue.clear();
+                continue;
+            }
+
+            while (!queue.empty() && queue.front().timestamp + mToleranceUs < newest) {
+                dropped->emplace_back(queue.front());
+                queue.pop_front();
+            }
+        }
+    }
+}
+
+
+bool FrameSynchronizer::isStarved(const std::string& deviceId) const {
+    auto it = mQueues.find(deviceId);
+    return it == mQueues.end() || it->second.frames.empty();
+}
+
+
+int64_t FrameSynchronizer::lastTimestamp(const std::string& deviceId) const {
+    auto it = mQueues.find(deviceId);
+    return it == mQueues.end() ? -1 : it->second.lastTimestamp;
+}
+
+
+void FrameSynchronizer::clear(std::vector<BufferDesc_1_1>* dropped) {
+    for (auto&& [id, queue] : mQueues) {
+        dropped->insert(dropped->end(), queue.frames.begin(), queue.frames.end());
+        queue.frames.clear();
+    }
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_FRAMESYNCHRONIZER_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_1_FRAMESYNCHRONIZER_H
+
+#include <android/hardware/automotive/evs/1.1/types.h>
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+
+// Groups the frames of the physical cameras of a logical camera into sets taken at the same
+// time, by their hardware timestamps.  Each physical camera has a bounded queue of frames
+// waiting for a match.  Frames that can no longer be part of a set are handed back to the
+// caller to be returned.  Not thread-safe.
+class FrameSynchronizer {
+public:
+    enum class StalePolicy {
+        // Drops the queued frames older than the newest head by more than the tolerance, so
+        // the sets follow the most recent frames.
+        DROP_OLDEST,
+        // Drops the whole queue of the camera that is behind, so a slow camera restarts from
+        // its next frame.
+        DROP_QUEUE,
+    };
+
+    FrameSynchronizer(const std::vector<std::string>& deviceIds,
+                      int64_t toleranceUs,
+                      size_t maxQueueDepth,
+                      StalePolicy policy = StalePolicy::DROP_OLDEST);
+
+    // Queues a frame of its physical camera.  If the queue of the camera is full, its oldest
+    // frame is appended to |dropped|.
+    void push(const BufferDesc_1_1& frame, std::vector<BufferDesc_1_1>* dropped);
+
+    // Takes a set of frames, one per camera in the order of the device IDs given at the
+    // construction, whose timestamps are within the tolerance.  The stale frames dropped
+    // on the way are appended to |dropped|.  Returns false if no set is complete yet.
+    bool pop(std::vector<BufferDesc_1_1>* frames, std::vector<BufferDesc_1_1>* dropped);
+
+    // Returns true if the camera has no frame waiting for a match.
+    bool isStarved(const std::string& deviceId) const;
+
+    // Timestamp of the newest frame seen from the camera, or -1.
+    int64_t lastTimestamp(const std::string& deviceId) const;
+
+    // Drops all the queued frames into |dropped|.
+    void clear(std::vector<BufferDesc_1_1>* dropped);
+
+    int64_t getTolerance() const { return mToleranceUs; }
+
+private:
+    struct CameraQueue {
+        std::deque<BufferDesc_1_1> frames;
+        int64_t                    lastTimestamp = -1;
+    };
+
+    const std::vector<std::string> mDeviceIds;
+    const int64_t                  mToleranceUs;
+    const size_t                   mMaxQueueDepth;
+    const StalePolicy              mPolicy;
+    std::unordered_map<std::string, CameraQueue> mQueues;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_1_FRAMESYNCHRONIZER_H
@@ -14,13 +14,23 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+
 #include "Enumerator.h"
 #include "HalCamera.h"
 #include "VirtualCamera.h"
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <android-base/strings.h>
+#include <threadpolicy/ThreadPolicy.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 
 namespace android {
 namespace automotive {
@@ -32,10 +42,47 @@ namespace implementation {
 // TODO(changyeon):
 // We need to hook up death monitoring to detect stream death so we can attempt a reconnect
 
+using ::android::base::GetIntProperty;
 using ::android::base::StringAppendF;
 using ::android::base::WriteStringToFd;
 
+namespace {
+
+// Frame interval assumed until the camera cadence is measured, 30 fps.
+constexpr int64_t kDefaultFrameIntervalUs = 33333;
+
+// Frame timestamps further apart than this are treated as a stream gap, not a cadence change.
+constexpr int64_t kMaxFrameIntervalUs = 1000 * 1000;
+
+// How long the frames in use must stay below the buffer count of the hardware camera before
+// the idle buffers are released, and how many buffers are kept on top of the peak use.  A
+// period of zero disables the trimming.
+constexpr int64_t kDefaultBufferTrimPeriodMs = 10 * 1000;
+constexpr char kBufferTrimPeriodPropertyName[] = "ro.automotive.evs.buffer_trim_period_ms";
+constexpr unsigned kDefaultBufferWarmReserve = 1;
+constexpr char kBufferWarmReservePropertyName[] = "ro.automotive.evs.buffer_warm_reserve";
+
+// The hardware camera is asked for this much more than the clients consume, so a client that
+// speeds up is not starved before the next hint, and the hint is sent again only when the
+// demand moves by more than kFrameRateHysteresisPercent.  The demand is checked at most once
+// per period as the clients request frames.
+constexpr int64_t kFrameRateHeadroomPercent = 25;
+constexpr int64_t kFrameRateHysteresisPercent = 20;
+constexpr nsecs_t kFrameRateHintPeriodNs = 1000 * 1000 * 1000;
+
+// Returns the delivery priority of |client|, raised to HIGH for the master client.
+VirtualCamera::DeliveryPriority getDeliveryPriority(const sp<VirtualCamera>& client,
+                                                    const sp<VirtualCamera>& master) {
+    return client == master ?
+            std::max(client->getDeliveryPriority(), VirtualCamera::DeliveryPriority::HIGH) :
+            client->getDeliveryPriority();
+}
+
+}  // namespace
+
 HalCamera::~HalCamera() {
+    stopFrameReturns();
+
     // Reports the usage statistics before the destruction
     // EvsUsageStatsReported atom is defined in
     // frameworks/base/cmds/statsd/src/atoms.proto
@@ -78,10 +125,10 @@ bool HalCamera::ownVirtualCamera(sp<VirtualCamera> virtualCamera) {
     }
 
     // Add this virtualCamera to our ownership list via weak pointer
-    mClients.emplace_back(virtualCamera);
+    updateClients([&](ClientList* clientList) { clientList->emplace_back(virtualCamera); });
 
     // Update statistics
-    mUsageStats->updateNumClients(mClients.size());
+    mUsageStats->updateNumClients(clients()->size());
 
     return true;
 }
@@ -95,11 +142,23 @@ void HalCamera::disownVirtualCamera(sp<VirtualCamera> virtualCamera) {
     }
 
     // Remove the virtual camera from our client list
-    unsigned clientCount = mClients.size();
-    mClients.remove(virtualCamera);
-    if (clientCount != mClients.size() + 1) {
+    bool removed = false;
+    const wp<VirtualCamera> target = virtualCamera;
+    updateClients([&](ClientList* clientList) {
+        const auto size = clientList->size();
+        clientList->erase(std::remove(clientList->begin(), clientList->end(), target),
+                          clientList->end());
+        removed = clientList->size() + 1 == size;
+    });
+    if (!removed) {
         LOG(ERROR) << "Couldn't find camera in our client list to remove it";
     }
+    removeDerivedClient(virtualCamera.get());
+    {
+        // The hardware camera keeps the buffers; their frames go to all clients from now on.
+        std::lock_guard<std::mutex> lock(mPoolMutex);
+        mBufferPools.erase(virtualCamera.get());
+    }
 
     // Recompute the number of buffers required with the target camera removed from the list
     if (!changeFramesInFlight(0)) {
@@ -107,14 +166,17 @@ void HalCamera::disownVirtualCamera(sp<VirtualCamera> virtualCamera) {
     }
 
     // Update statistics
-    mUsageStats->updateNumClients(mClients.size());
+    mUsageStats->updateNumClients(clients()->size());
 }
 
 
 bool HalCamera::changeFramesInFlight(int delta) {
+    std::lock_guard<std::mutex> lock(mFramesInFlightMutex);
+
     // Walk all our clients and count their currently required frames
     unsigned bufferCount = 0;
-    for (auto&& client :  mClients) {
+    const auto clientsSnapshot = clients();
+    for (auto&& client : *clientsSnapshot) {
         sp<VirtualCamera> virtCam = client.promote();
         if (virtCam != nullptr) {
             bufferCount += virtCam->getAllowedBuffers();
@@ -129,43 +191,114 @@ bool HalCamera::changeFramesInFlight(int delta) {
         bufferCount = 1;
     }
 
-    // Ask the hardware for the resulting buffer count
+    // Ask the hardware for the resulting buffer count, and start a new trim period with it
+    bool success = setFramesInFlightLocked(bufferCount);
+    if (success) {
+        mFramesRequested = bufferCount;
+        mFramesWanted = false;
+        mPeakFramesInUse = countFramesInUse();
+        mTrimPeriodStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+
+    if (success && countFramesInUse() > bufferCount) {
+        LOG(WARNING) << "We found more frames in use than requested.";
+    }
+    if (bufferCount > kNumFrameSlots) {
+        LOG(WARNING) << bufferCount << " frames in flight exceed " << kNumFrameSlots
+                     << " frame slots; excess frames will be returned immediately.";
+    }
+
+    return success;
+}
+
+
+bool HalCamera::setFramesInFlightLocked(unsigned bufferCount) {
     Return<EvsResult> result = mHwCamera->setMaxFramesInFlight(bufferCount);
     bool success = (result.isOk() && result == EvsResult::OK);
-
-    // Update the size of our array of outstanding frame records
     if (success) {
-        std::vector<FrameRecord> newRecords;
-        newRecords.reserve(bufferCount);
+        mFramesInFlight = bufferCount;
+        std::lock_guard<std::mutex> lock(mPoolMutex);
+        mHwBufferIds.clear();
+    }
+
+    return success;
+}
+
+
+void HalCamera::trimFramesInFlight() {
+    static const nsecs_t trimPeriodNs = ms2ns(
+            GetIntProperty<int64_t>(kBufferTrimPeriodPropertyName, kDefaultBufferTrimPeriodMs));
+    static const unsigned warmReserve =
+            GetIntProperty<unsigned>(kBufferWarmReservePropertyName, kDefaultBufferWarmReserve);
+    if (trimPeriodNs <= 0) {
+        return;
+    }
 
-        // Copy and compact the old records that are still active
-        for (const auto& rec : mFrames) {
-            if (rec.refCount > 0) {
-                newRecords.emplace_back(rec);
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (!mFramesWanted && now - mTrimPeriodStart < trimPeriodNs) {
+        return;
+    }
+
+    // Another client returning a frame is taking care of it
+    std::unique_lock<std::mutex> lock(mFramesInFlightMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    const unsigned framesRequested = mFramesRequested;
+    if (mFramesWanted.exchange(false)) {
+        if (mFramesInFlight < framesRequested) {
+            LOG(INFO) << mId << ": restores " << framesRequested << " frames in flight";
+            if (!setFramesInFlightLocked(framesRequested)) {
+                LOG(WARNING) << mId << ": failed to restore the frames in flight";
             }
         }
-        if (newRecords.size() > (unsigned)bufferCount) {
-            LOG(WARNING) << "We found more frames in use than requested.";
-        }
+        mPeakFramesInUse = countFramesInUse();
+        mTrimPeriodStart = now;
+        return;
+    } else if (now - mTrimPeriodStart < trimPeriodNs) {
+        return;
+    }
 
-        mFrames.swap(newRecords);
+    const unsigned peak = mPeakFramesInUse.exchange(countFramesInUse());
+    mTrimPeriodStart = now;
+    const unsigned target = std::max(1u, std::min(framesRequested,
+                                                  peak + kMinFreeFrames + warmReserve));
+    if (target >= mFramesInFlight) {
+        return;
     }
 
-    return success;
+    {
+        // The buffers imported for a client are not ours to release
+        std::lock_guard<std::mutex> poolLock(mPoolMutex);
+        if (!mBufferPools.empty()) {
+            return;
+        }
+    }
+
+    LOG(INFO) << mId << ": trims frames in flight from " << mFramesInFlight << " to "
+              << target << " for a peak use of " << peak;
+    if (!setFramesInFlightLocked(target)) {
+        LOG(WARNING) << mId << ": failed to trim the frames in flight";
+    }
 }
 
 
 bool HalCamera::changeFramesInFlight(const hidl_vec<BufferDesc_1_1>& buffers,
-                                     int* delta) {
+                                     int* delta,
+                                     const sp<VirtualCamera>& owner) {
     // Return immediately if a list is empty.
     if (buffers.size() < 1) {
         LOG(DEBUG) << "No external buffers to add.";
         return true;
     }
 
+    std::lock_guard<std::mutex> framesInFlightLock(mFramesInFlightMutex);
+
     // Walk all our clients and count their currently required frames
     auto bufferCount = 0;
-    for (auto&& client :  mClients) {
+    const auto clientsSnapshot = clients();
+    for (auto&& client : *clientsSnapshot) {
         sp<VirtualCamera> virtCam = client.promote();
         if (virtCam != nullptr) {
             bufferCount += virtCam->getAllowedBuffers();
@@ -185,24 +318,28 @@ bool HalCamera::changeFramesInFlight(const hidl_vec<BufferDesc_1_1>& buffers,
     }
 
     bufferCount += *delta;
+    mFramesInFlight = bufferCount;
+    mFramesRequested = bufferCount;
 
-    // Update the size of our array of outstanding frame records
-    std::vector<FrameRecord> newRecords;
-    newRecords.reserve(bufferCount);
-
-    // Copy and compact the old records that are still active
-    for (const auto& rec : mFrames) {
-        if (rec.refCount > 0) {
-            newRecords.emplace_back(rec);
+    {
+        std::lock_guard<std::mutex> lock(mPoolMutex);
+        mHwBufferIds.clear();
+        if (owner != nullptr) {
+            auto& pool = mBufferPools[owner.get()];
+            if (pool == nullptr) {
+                pool = std::make_unique<ExternalBufferPool>(owner);
+            }
+            if (!pool->add(buffers)) {
+                LOG(WARNING) << "Frames in the buffers of " << owner.get()
+                             << " will be delivered to all clients.";
+            }
         }
     }
 
-    if (newRecords.size() > (unsigned)bufferCount) {
+    if (countFramesInUse() > (unsigned)bufferCount) {
         LOG(WARNING) << "We found more frames in use than requested.";
     }
 
-    mFrames.swap(newRecords);
-
     return true;
 }
 
@@ -213,8 +350,158 @@ void HalCamera::requestNewFrame(sp<VirtualCamera> client,
     req.client = client;
     req.timestamp = lastTimestamp;
 
-    std::lock_guard<std::mutex> lock(mFrameMutex);
-    mNextRequests->push_back(req);
+    {
+        std::lock_guard<std::mutex> lock(mFrameMutex);
+        // Negotiates the delivery interval of the client.  A client that takes longer than a
+        // frame interval to come back is paced at the next multiple of the interval, so it gets
+        // evenly spaced frames instead of whichever frame arrives first after it is ready.
+        auto& pacer = mClientPacers[client.get()];
+        if (pacer.deliveredAtNs >= 0) {
+            const nsecs_t busyNs = systemTime(SYSTEM_TIME_MONOTONIC) - pacer.deliveredAtNs;
+            pacer.busyNs = pacer.busyNs > 0 ? (pacer.busyNs * 7 + busyNs) / 8 : busyNs;
+        }
+        const int64_t frameIntervalUs =
+                mFrameIntervalUs > 0 ? mFrameIntervalUs : kDefaultFrameIntervalUs;
+        const int64_t busyUs = pacer.busyNs / 1000;
+        int64_t multiple = std::max<int64_t>(1, (busyUs + frameIntervalUs - 1) / frameIntervalUs);
+        if (pacer.maxFramesPerSecond > 0) {
+            // The nearest multiple, so a camera slightly faster than its nominal rate doesn't
+            // drop the client a whole frame interval below the rate it asked for.
+            const int64_t minIntervalUs = 1000000 / pacer.maxFramesPerSecond;
+            multiple = std::max(multiple, (minIntervalUs + frameIntervalUs / 2) / frameIntervalUs);
+        }
+        pacer.intervalUs = multiple * frameIntervalUs;
+
+        mNextRequests->push_back(req);
+    }
+
+    updateFrameRateHint(/* force = */ false);
+}
+
+
+void HalCamera::setClientFrameRate(const VirtualCamera* client, int32_t framesPerSecond) {
+    {
+        std::lock_guard<std::mutex> lock(mFrameMutex);
+        mClientPacers[client].maxFramesPerSecond = std::max(framesPerSecond, 0);
+    }
+
+    updateFrameRateHint(/* force = */ true);
+}
+
+
+void HalCamera::updateFrameRateHint(bool force) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    {
+        std::lock_guard<std::mutex> lock(mFrameMutex);
+        if (!force && now - mFrameRateCheckedAtNs < kFrameRateHintPeriodNs) {
+            return;
+        }
+        mFrameRateCheckedAtNs = now;
+    }
+
+    // A v1.0 client isn't paced and a new client hasn't shown its rate yet, so both want
+    // every frame.  Otherwise the fastest client sets the rate.
+    std::vector<const VirtualCamera*> streamingClients;
+    bool wantsFullRate = false;
+    const auto clientsSnapshot = clients();
+    for (auto&& client : *clientsSnapshot) {
+        sp<VirtualCamera> virtCam = client.promote();
+        if (virtCam == nullptr || !virtCam->isStreaming()) {
+            continue;
+        } else if (virtCam->getVersion() == 0) {
+            wantsFullRate = true;
+            break;
+        }
+        streamingClients.push_back(virtCam.get());
+    }
+
+    int32_t framesPerSecond = 0;
+    {
+        std::lock_guard<std::mutex> lock(mFrameMutex);
+        for (auto&& client : streamingClients) {
+            if (wantsFullRate) {
+                break;
+            }
+            const auto it = mClientPacers.find(client);
+            const int32_t maxRate = it != mClientPacers.end() ? it->second.maxFramesPerSecond : 0;
+            if (maxRate <= 0 && (it == mClientPacers.end() || it->second.busyNs <= 0)) {
+                wantsFullRate = true;
+                break;
+            }
+
+            // A client that asked for a rate needs no more than that, however fast it is
+            int64_t rate = std::numeric_limits<int32_t>::max();
+            if (it->second.busyNs > 0) {
+                const int64_t busyNs = it->second.busyNs;
+                rate = (1000000000LL * (100 + kFrameRateHeadroomPercent) + 100 * busyNs - 1) /
+                       (100 * busyNs);
+            }
+            if (maxRate > 0) {
+                rate = std::min<int64_t>(rate, (static_cast<int64_t>(maxRate) *
+                                                (100 + kFrameRateHeadroomPercent) + 99) / 100);
+            }
+            framesPerSecond = std::max<int32_t>(framesPerSecond, std::max<int64_t>(1, rate));
+        }
+        if (wantsFullRate) {
+            framesPerSecond = 0;
+        }
+
+        // Skips the small changes unless the limit is being set or lifted
+        const int32_t lastSent = mFrameRateHint;
+        if (framesPerSecond == lastSent ||
+            (framesPerSecond > 0 && lastSent > 0 &&
+             std::abs(framesPerSecond - lastSent) * 100 < lastSent * kFrameRateHysteresisPercent)) {
+            return;
+        }
+        mFrameRateHint = framesPerSecond;
+    }
+
+    LOG(DEBUG) << "Clients of " << mId << " need "
+               << (framesPerSecond > 0 ? std::to_string(framesPerSecond) : "all") << " fps";
+    hidl_vec<uint8_t> value;
+    value.resize(sizeof(framesPerSecond));
+    memcpy(value.data(), &framesPerSecond, sizeof(framesPerSecond));
+    mHwCamera->setExtendedInfo_1_1(kFrameRateHintId, value);
+}
+
+
+void HalCamera::updateFrameIntervalLocked(int64_t timestamp) {
+    if (mLastFrameTimestamp >= 0 && timestamp > mLastFrameTimestamp) {
+        const int64_t intervalUs = timestamp - mLastFrameTimestamp;
+        if (intervalUs < kMaxFrameIntervalUs) {
+            mFrameIntervalUs = mFrameIntervalUs > 0 ?
+                    (mFrameIntervalUs * 7 + intervalUs) / 8 : intervalUs;
+        }
+    }
+    mLastFrameTimestamp = timestamp;
+}
+
+
+bool HalCamera::isFrameDueLocked(const FrameRequest& request, int64_t timestamp) {
+    if (timestamp <= request.timestamp) {
+        // The client has seen this frame already.
+        return false;
+    }
+
+    auto& pacer = mClientPacers[request.client.unsafe_get()];
+    if (pacer.lastSlotUs < 0 || pacer.intervalUs <= 0) {
+        pacer.lastSlotUs = timestamp;
+        return true;
+    }
+
+    // Accepts frames within a half frame interval of the next slot, so the timestamp jitter
+    // doesn't push a frame into the next slot.
+    const int64_t frameIntervalUs =
+            mFrameIntervalUs > 0 ? mFrameIntervalUs : kDefaultFrameIntervalUs;
+    const int64_t nextSlotUs = pacer.lastSlotUs + pacer.intervalUs;
+    if (timestamp + frameIntervalUs / 2 < nextSlotUs) {
+        return false;
+    }
+
+    // Moves along the timeline rather than to the frame timestamp, so the jitter doesn't
+    // accumulate.  Resynchronizes when the client fell behind by a whole slot.
+    pacer.lastSlotUs = timestamp - nextSlotUs >= pacer.intervalUs ? timestamp : nextSlotUs;
+    return true;
 }
 
 
@@ -226,6 +513,9 @@ Return<EvsResult> HalCamera::clientStreamStarting() {
         result = mHwCamera->startVideoStream(this);
     }
 
+    // The new client gets every frame until its own rate is known
+    updateFrameRateHint(/* force = */ true);
+
     return result;
 }
 
@@ -245,9 +535,13 @@ void HalCamera::clientStreamEnding(const VirtualCamera* client) {
         if (itReq != mNextRequests->end()) {
             mNextRequests->erase(itReq);
         }
+        mClientPacers.erase(client);
+    }
+    removeDerivedClient(client);
 
-        auto itCam = mClients.begin();
-        while (itCam != mClients.end()) {
+    updateClients([&](ClientList* clientList) {
+        auto itCam = clientList->begin();
+        while (itCam != clientList->end()) {
             if (itCam->promote() == client) {
                 break;
             } else {
@@ -255,43 +549,113 @@ void HalCamera::clientStreamEnding(const VirtualCamera* client) {
             }
         }
 
-        if (itCam != mClients.end()) {
+        if (itCam != clientList->end()) {
             // Remove a client, which requested to stop, from the list.
-            mClients.erase(itCam);
+            clientList->erase(itCam);
         }
-    }
+    });
 
     // Do we still have a running client?
     bool stillRunning = false;
-    for (auto&& client : mClients) {
+    const auto clientsSnapshot = clients();
+    for (auto&& client : *clientsSnapshot) {
         sp<VirtualCamera> virtCam = client.promote();
         if (virtCam != nullptr) {
             stillRunning |= virtCam->isStreaming();
         }
     }
 
+    // The remaining clients may need fewer frames
+    updateFrameRateHint(/* force = */ true);
+
     // If not, then stop the hardware stream
     if (!stillRunning) {
+        // The hardware may wait for its buffers before it stops
+        flushFrameReturns();
         mStreamState = STOPPING;
         mHwCamera->stopVideoStream();
     }
 }
 
 
-Return<void> HalCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
-    // Find this frame in our list of outstanding frames
-    unsigned i;
-    for (i = 0; i < mFrames.size(); i++) {
-        if (mFrames[i].frameId == buffer.bufferId) {
-            break;
+void HalCamera::reclaimClientFrames(const VirtualCamera* client,
+                                    const std::deque<BufferDesc_1_1>& frames,
+                                    nsecs_t diedAt) {
+    // Returned in a single batch rather than as the batch window expires, and before the
+    // stream ends, as the hardware may wait for its buffers before it stops
+    for (auto&& frame : frames) {
+        doneWithFrame(frame);
+    }
+    flushFrameReturns();
+
+    clientStreamEnding(client);
+
+    // The client is off the list now, so this leaves the buffers the others need
+    if (!changeFramesInFlight(0)) {
+        LOG(WARNING) << getId() << ": Failed to rebalance the frames in flight";
+    }
+
+    const nsecs_t reclaimTimeNs = systemTime(SYSTEM_TIME_MONOTONIC) - diedAt;
+    mUsageStats->clientDied(frames.size(), ns2us(reclaimTimeNs));
+    LOG(INFO) << getId() << ": Reclaimed " << frames.size() << " frames of a dead client in "
+              << ns2us(reclaimTimeNs) << " us";
+}
+
+
+HalCamera::FrameRecord* HalCamera::claimFrameRecord(uint32_t bufferId) {
+    // Buffer IDs are usually small and dense, so the home slot is nearly always free.
+    for (uint32_t probe = 0; probe < kNumFrameSlots; ++probe) {
+        auto& record = mFrames[(bufferId + probe) & (kNumFrameSlots - 1)];
+        int32_t expected = 0;
+        if (record.refCount.compare_exchange_strong(expected, 1)) {
+            record.frameId.store(bufferId);
+            return &record;
+        }
+    }
+
+    return nullptr;
+}
+
+
+HalCamera::FrameRecord* HalCamera::findFrameRecord(uint32_t bufferId) {
+    for (uint32_t probe = 0; probe < kNumFrameSlots; ++probe) {
+        auto& record = mFrames[(bufferId + probe) & (kNumFrameSlots - 1)];
+        if (record.frameId.load() == bufferId && record.refCount.load() > 0) {
+            return &record;
+        }
+    }
+
+    return nullptr;
+}
+
+
+bool HalCamera::releaseFrameRecord(FrameRecord* record) {
+    return record->refCount.fetch_sub(1) == 1;
+}
+
+
+unsigned HalCamera::countFramesInUse() const {
+    unsigned count = 0;
+    for (const auto& record : mFrames) {
+        if (record.refCount.load() > 0) {
+            ++count;
         }
     }
-    if (i == mFrames.size()) {
+
+    return count;
+}
+
+
+Return<void> HalCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
+    // Find this frame in our table of outstanding frames
+    FrameRecord* record = findFrameRecord(buffer.bufferId);
+    if (record == nullptr) {
         LOG(ERROR) << "We got a frame back with an ID we don't recognize!";
     } else {
         // Are there still clients using this buffer?
-        mFrames[i].refCount--;
-        if (mFrames[i].refCount <= 0) {
+        if (releaseFrameRecord(record)) {
+            ATRACE_ASYNC_END(mFrameTraceName.c_str(), buffer.bufferId);
+
             // Since all our clients are done with this buffer, return it to the device layer
             mHwCamera->doneWithFrame(buffer);
 
@@ -300,39 +664,137 @@ Return<void> HalCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
         }
     }
 
+    trimFramesInFlight();
     return Void();
 }
 
 
 Return<void> HalCamera::doneWithFrame(const BufferDesc_1_1& buffer) {
-    // Find this frame in our list of outstanding frames
-    unsigned i;
-    for (i = 0; i < mFrames.size(); i++) {
-        if (mFrames[i].frameId == buffer.bufferId) {
-            break;
-        }
+    // Converted frames go back to their derived stream
+    DerivedStream* derivedStream = findDerivedStreamByBuffer(buffer.bufferId);
+    if (derivedStream != nullptr) {
+        derivedStream->release(buffer.bufferId);
+        return Void();
     }
-    if (i == mFrames.size()) {
+
+    // Find this frame in our table of outstanding frames
+    FrameRecord* record = findFrameRecord(buffer.bufferId);
+    if (record == nullptr) {
         LOG(ERROR) << "We got a frame back with an ID we don't recognize!";
     } else {
         // Are there still clients using this buffer?
-        mFrames[i].refCount--;
-        if (mFrames[i].refCount <= 0) {
-            // Since all our clients are done with this buffer, return it to the device layer
-            hardware::hidl_vec<BufferDesc_1_1> returnedBuffers;
-            returnedBuffers.resize(1);
-            returnedBuffers[0] = buffer;
-            mHwCamera->doneWithFrame_1_1(returnedBuffers);
+        if (releaseFrameRecord(record)) {
+            ATRACE_ASYNC_END(mFrameTraceName.c_str(), buffer.bufferId);
 
-            // Counts a returned buffer
-            mUsageStats->framesReturned(returnedBuffers);
+            // Since all our clients are done with this buffer, return it to the device layer
+            queueFrameReturn(buffer);
         }
     }
 
+    trimFramesInFlight();
     return Void();
 }
 
 
+void HalCamera::queueFrameReturn(const BufferDesc_1_1& buffer) {
+    bool batchFull = false;
+    {
+        std::lock_guard<std::mutex> lock(mReturnMutex);
+        if (!mReturnThread.joinable()) {
+            mReturnThread = std::thread([this]() {
+                std::unique_lock<std::mutex> lock(mReturnMutex);
+                while (!mReturnThreadExit) {
+                    if (mPendingReturns.empty()) {
+                        mReturnSignal.wait(lock);
+                        continue;
+                    }
+
+                    if (mReturnSignal.wait_until(lock, mReturnDeadline) ==
+                            std::cv_status::timeout) {
+                        lock.unlock();
+                        flushFrameReturns();
+                        lock.lock();
+                    }
+                }
+            });
+        }
+
+        if (mPendingReturns.empty()) {
+            mReturnDeadline = std::chrono::steady_clock::now() + kReturnBatchWindow;
+        }
+        mPendingReturns.emplace_back(buffer);
+        batchFull = mPendingReturns.size() >= kMaxReturnBatchSize;
+    }
+
+    if (batchFull) {
+        flushFrameReturns();
+    } else {
+        mReturnSignal.notify_one();
+    }
+}
+
+
+void HalCamera::flushFrameReturns() {
+    hardware::hidl_vec<BufferDesc_1_1> returnedBuffers;
+    {
+        std::lock_guard<std::mutex> lock(mReturnMutex);
+        if (mPendingReturns.empty()) {
+            return;
+        }
+
+        returnedBuffers = mPendingReturns;
+        mPendingReturns.clear();
+    }
+
+    mHwCamera->doneWithFrame_1_1(returnedBuffers);
+
+    // Counts returned buffers
+    mUsageStats->framesReturned(returnedBuffers);
+}
+
+
+void HalCamera::stopFrameReturns() {
+    {
+        std::lock_guard<std::mutex> lock(mReturnMutex);
+        mReturnThreadExit = true;
+    }
+    mReturnSignal.notify_one();
+    if (mReturnThread.joinable()) {
+        mReturnThread.join();
+    }
+
+    flushFrameReturns();
+}
+
+
+sp<VirtualCamera> HalCamera::findBufferOwner(const BufferDesc_1_1& buffer) {
+    std::lock_guard<std::mutex> lock(mPoolMutex);
+    if (mBufferPools.empty()) {
+        return nullptr;
+    }
+
+    // Looks up the gralloc buffer ID once per hardware camera buffer.
+    auto it = mHwBufferIds.find(buffer.bufferId);
+    if (it == mHwBufferIds.end()) {
+        it = mHwBufferIds.emplace(buffer.bufferId,
+                                  ExternalBufferPool::getGrallocId(buffer)).first;
+    }
+
+    const uint64_t grallocId = it->second;
+    if (grallocId == 0) {
+        return nullptr;
+    }
+
+    for (auto&& [client, pool] : mBufferPools) {
+        if (pool->contains(grallocId)) {
+            return pool->getOwner().promote();
+        }
+    }
+
+    return nullptr;
+}
+
+
 // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCameraStream follow.
 Return<void> HalCamera::deliverFrame(const BufferDesc_1_0& buffer) {
     /* Frames are delivered via deliverFrame_1_1 callback for clients that implement
@@ -352,51 +814,164 @@ Return<void> HalCamera::deliverFrame(const BufferDesc_1_0& buffer) {
 
 // Methods from ::android::hardware::automotive::evs::V1_1::IEvsCameraStream follow.
 Return<void> HalCamera::deliverFrame_1_1(const hardware::hidl_vec<BufferDesc_1_1>& buffer) {
+    ATRACE_CALL();
+    // Frames come on the threads of the HIDL thread pool; each takes the policy once
+    threadpolicy::applyThreadPolicy(threadpolicy::kRoleFrameCallback);
     LOG(VERBOSE) << "Received a frame";
     // Frames are being forwarded to v1.1 clients only who requested new frame.
     const auto timestamp = buffer[0].timestamp;
-    // TODO(b/145750636): For now, we are using a approximately half of 1 seconds / 30 frames = 33ms
-    //           but this must be derived from current framerate.
-    constexpr int64_t kThreshold = 16 * 1e+3; // ms
+
+    // Holds a reference on the frame while forwarding it, so the clients can return it
+    // before the fan-out completes.
+    FrameRecord* record = claimFrameRecord(buffer[0].bufferId);
+    if (record == nullptr) {
+        LOG(WARNING) << "No frame slot for buffer #" << buffer[0].bufferId
+                     << "; returning it to " << getId();
+        mHwCamera->doneWithFrame_1_1(buffer);
+
+        // Reports a received and returned buffer
+        mUsageStats->framesReceived(buffer);
+        mUsageStats->framesReturned(buffer);
+        return Void();
+    }
+
+    // Spans the frame's life in the manager, until it goes back to the hardware camera
+    ATRACE_ASYNC_BEGIN(mFrameTraceName.c_str(), buffer[0].bufferId);
+
+    // Frames converted for the clients of derived streams, once per stream.  Each holds a
+    // reference until the fan-out completes.
+    std::vector<std::pair<DerivedStream*, BufferDesc_1_1>> derivedFrames;
+    const auto forwardDerivedFrame = [&](const sp<VirtualCamera>& vCam, DerivedStream* stream) {
+        auto it = std::find_if(derivedFrames.begin(), derivedFrames.end(),
+                               [stream](const auto& frame) { return frame.first == stream; });
+        if (it == derivedFrames.end()) {
+            BufferDesc_1_1 converted;
+            if (!stream->convert(buffer[0], &converted)) {
+                LOG(WARNING) << "Failed to convert buffer #" << buffer[0].bufferId
+                             << " from " << getId();
+                return false;
+            }
+            it = derivedFrames.emplace(derivedFrames.end(), stream, std::move(converted));
+        }
+
+        stream->acquire(it->second.bufferId);
+        if (vCam->deliverFrame(it->second)) {
+            return true;
+        }
+
+        stream->release(it->second.bufferId);
+        return false;
+    };
+
+    const auto forwardFrame = [&](const sp<VirtualCamera>& vCam) {
+        DerivedStream* derivedStream = findDerivedStream(vCam.get());
+        if (derivedStream != nullptr) {
+            return forwardDerivedFrame(vCam, derivedStream);
+        }
+
+        record->refCount.fetch_add(1);
+        if (vCam->deliverFrame(buffer[0])) {
+            return true;
+        }
+
+        // Never the last reference while this method holds its own.
+        releaseFrameRecord(record);
+        return false;
+    };
+
+    // A frame rendered into the buffer of a client goes to that client only.
+    const sp<VirtualCamera> bufferOwner = findBufferOwner(buffer[0]);
+
+    // When the hardware camera is short of buffers, the frame goes only to the clients of
+    // the highest priority, so the others can't take the last buffers away from them.
+    const sp<VirtualCamera> master = mMaster.promote();
+    const auto clientsSnapshot = clients();
+    auto topPriority = VirtualCamera::DeliveryPriority::LOW;
+    for (auto&& client : *clientsSnapshot) {
+        sp<VirtualCamera> vCam = client.promote();
+        if (vCam != nullptr && vCam->isStreaming()) {
+            topPriority = std::max(topPriority, getDeliveryPriority(vCam, master));
+        }
+    }
+    const unsigned framesInUse = countFramesInUse();
+    const bool shortOfBuffers = framesInUse + kMinFreeFrames >= mFramesInFlight;
+    if (framesInUse > mPeakFramesInUse) {
+        mPeakFramesInUse = framesInUse;
+    }
+    if (shortOfBuffers && mFramesInFlight < mFramesRequested) {
+        // The pool was trimmed too far; the next frame returned restores it
+        mFramesWanted = true;
+    }
+    const auto isPreempted = [&](const sp<VirtualCamera>& vCam) {
+        return shortOfBuffers && getDeliveryPriority(vCam, master) < topPriority;
+    };
+
     unsigned frameDeliveriesV1 = 0;
+    std::vector<sp<VirtualCamera>> dueClients;
     {
         // Handle frame requests from v1.1 clients
         std::lock_guard<std::mutex> lock(mFrameMutex);
+        updateFrameIntervalLocked(timestamp);
         std::swap(mCurrentRequests, mNextRequests);
         while (!mCurrentRequests->empty()) {
             auto req = mCurrentRequests->front(); mCurrentRequests->pop_front();
             sp<VirtualCamera> vCam = req.client.promote();
             if (vCam == nullptr) {
                 // Ignore a client already dead.
+                mClientPacers.erase(req.client.unsafe_get());
                 continue;
-            } else if (timestamp - req.timestamp < kThreshold) {
-                // Skip current frame because it arrives too soon.
+            } else if (bufferOwner != nullptr && vCam != bufferOwner) {
+                // Waits for a frame in a buffer it may read.
+                mNextRequests->push_back(req);
+            } else if (isPreempted(vCam)) {
+                // Waits until the buffers are back.
+                mNextRequests->push_back(req);
+                vCam->framePreempted();
+            } else if (!isFrameDueLocked(req, timestamp)) {
+                // Skip current frame because it arrives before the client's next slot.
                 LOG(DEBUG) << "Skips a frame from " << getId();
                 mNextRequests->push_back(req);
 
                 // Reports a skipped frame
                 mUsageStats->framesSkippedToSync();
-            } else if (vCam != nullptr && vCam->deliverFrame(buffer[0])) {
-                // Forward a frame and move a timeline.
-                LOG(DEBUG) << getId() << " forwarded the buffer #" << buffer[0].bufferId;
-                ++frameDeliveriesV1;
+            } else {
+                mClientPacers[vCam.get()].deliveredAtNs = systemTime(SYSTEM_TIME_MONOTONIC);
+                dueClients.emplace_back(std::move(vCam));
             }
         }
     }
 
+    // Forwards the frame outside of the lock, so the clients requesting new frames
+    // don't wait on the fan-out.  Higher priority clients get it first.
+    std::stable_sort(dueClients.begin(), dueClients.end(),
+                     [&master](const auto& lhs, const auto& rhs) {
+                         return getDeliveryPriority(lhs, master) >
+                                getDeliveryPriority(rhs, master);
+                     });
+    for (auto&& vCam : dueClients) {
+        if (forwardFrame(vCam)) {
+            // Forward a frame and move a timeline.
+            LOG(DEBUG) << getId() << " forwarded the buffer #" << buffer[0].bufferId;
+            ++frameDeliveriesV1;
+        }
+    }
+
     // Reports the number of received buffers
     mUsageStats->framesReceived(buffer);
 
     // Frames are being forwarded to active v1.0 clients and v1.1 clients if we
     // failed to create a timeline.
     unsigned frameDeliveries = 0;
-    for (auto&& client : mClients) {
+    for (auto&& client : *clientsSnapshot) {
         sp<VirtualCamera> vCam = client.promote();
-        if (vCam == nullptr || vCam->getVersion() > 0) {
+        if (vCam == nullptr || vCam->getVersion() > 0 || bufferOwner != nullptr) {
+            continue;
+        } else if (isPreempted(vCam)) {
+            vCam->framePreempted();
             continue;
         }
 
-        if (vCam->deliverFrame(buffer[0])) {
+        if (forwardFrame(vCam)) {
             ++frameDeliveries;
         }
     }
@@ -407,25 +982,20 @@ Return<void> HalCamera::deliverFrame_1_1(const hardware::hidl_vec<BufferDesc_1_1
         // right away.
         LOG(INFO) << "Trivially rejecting frame (" << buffer[0].bufferId
                   << ") from " << getId() << " with no acceptance";
+    }
+
+    for (auto&& [stream, frame] : derivedFrames) {
+        stream->release(frame.bufferId);
+    }
+
+    // Drops our own reference.  The frame goes back to the hardware here if no client
+    // accepted it or all of them have already returned it.
+    if (releaseFrameRecord(record)) {
+        ATRACE_ASYNC_END(mFrameTraceName.c_str(), buffer[0].bufferId);
         mHwCamera->doneWithFrame_1_1(buffer);
 
         // Reports a returned buffer
         mUsageStats->framesReturned(buffer);
-    } else {
-        // Add an entry for this frame in our tracking list.
-        unsigned i;
-        for (i = 0; i < mFrames.size(); ++i) {
-            if (mFrames[i].refCount == 0) {
-                break;
-            }
-        }
-
-        if (i == mFrames.size()) {
-            mFrames.emplace_back(buffer[0].bufferId);
-        } else {
-            mFrames[i].frameId = buffer[0].bufferId;
-        }
-        mFrames[i].refCount = frameDeliveries;
     }
 
     return Void();
@@ -444,7 +1014,8 @@ Return<void> HalCamera::notify(const EvsEventDesc& event) {
     }
 
     // Forward all other events to the clients
-    for (auto&& client : mClients) {
+    const auto clientsSnapshot = clients();
+    for (auto&& client : *clientsSnapshot) {
         sp<VirtualCamera> vCam = client.promote();
         if (vCam != nullptr) {
             if (!vCam->notify(event)) {
@@ -525,15 +1096,7 @@ Return<EvsResult> HalCamera::setParameter(sp<VirtualCamera> virtualCamera,
                                    });
 
         if (result == EvsResult::OK) {
-            /* Notify a parameter change */
-            EvsEventDesc event;
-            event.aType = EvsEventType::PARAMETER_CHANGED;
-            event.payload[0] = static_cast<uint32_t>(id);
-            event.payload[1] = static_cast<uint32_t>(value);
-            auto cbResult = this->notify(event);
-            if (!cbResult.isOk()) {
-                LOG(ERROR) << "Fail to deliver a parameter change notification";
-            }
+            notifyParameterChanged(id, value);
         }
     } else {
         LOG(WARNING) << "A parameter change request from a non-master client is declined.";
@@ -546,6 +1109,107 @@ Return<EvsResult> HalCamera::setParameter(sp<VirtualCamera> virtualCamera,
 }
 
 
+Return<EvsResult> HalCamera::setParameters(sp<VirtualCamera> virtualCamera,
+                                           hidl_vec<uint8_t>& batch) {
+    constexpr size_t kEntrySize = 2 * sizeof(int32_t);
+    if (batch.size() == 0 || batch.size() % kEntrySize != 0) {
+        return EvsResult::INVALID_ARG;
+    }
+
+    const auto readEntry = [&batch](size_t index, CameraParam* id, int32_t* value) {
+        int32_t entry[2];
+        memcpy(entry, batch.data() + index * kEntrySize, kEntrySize);
+        *id = static_cast<CameraParam>(entry[0]);
+        *value = entry[1];
+    };
+    const auto writeValue = [&batch](size_t index, int32_t value) {
+        memcpy(batch.data() + index * kEntrySize + sizeof(int32_t), &value, sizeof(value));
+    };
+    const size_t numEntries = batch.size() / kEntrySize;
+
+    if (virtualCamera != mMaster.promote()) {
+        LOG(WARNING) << "A parameter change request from a non-master client is declined.";
+
+        /* Read the current values of the requested camera parameters */
+        for (size_t i = 0; i < numEntries; ++i) {
+            CameraParam id;
+            int32_t value;
+            readEntry(i, &id, &value);
+            getParameter(id, value);
+            writeValue(i, value);
+        }
+        return EvsResult::INVALID_ARG;
+    }
+
+    // A driver taking batches answers for them before any was set
+    std::call_once(mParameterBatchProbe, [this]() {
+        mHwCamera->getExtendedInfo_1_1(kParameterBatchId, [this](auto status, const auto&) {
+            mParameterBatchSupported = status == EvsResult::OK;
+        });
+        LOG(INFO) << mId << (mParameterBatchSupported ? " takes" : " does not take")
+                  << " parameter batches";
+    });
+
+    EvsResult result = EvsResult::OK;
+    size_t numApplied = numEntries;
+    if (mParameterBatchSupported) {
+        result = mHwCamera->setExtendedInfo_1_1(kParameterBatchId, batch);
+        if (result == EvsResult::OK) {
+            mHwCamera->getExtendedInfo_1_1(kParameterBatchId,
+                                           [&result, &batch](auto status, const auto& applied) {
+                                               if (status != EvsResult::OK ||
+                                                   applied.size() != batch.size()) {
+                                                   result = EvsResult::UNDERLYING_SERVICE_ERROR;
+                                               } else {
+                                                   batch = applied;
+                                               }
+                                           });
+        }
+        if (result != EvsResult::OK) {
+            return result;
+        }
+    } else {
+        for (size_t i = 0; i < numEntries; ++i) {
+            CameraParam id;
+            int32_t value;
+            readEntry(i, &id, &value);
+            mHwCamera->setIntParameter(id, value, [&result, &value](auto status, auto readValue) {
+                result = status;
+                value = readValue[0];
+            });
+            if (result != EvsResult::OK) {
+                numApplied = i;
+                break;
+            }
+            writeValue(i, value);
+        }
+    }
+
+    // The clients coalesce the changes of each parameter, so a batch set on every frame
+    // reaches them as one event per parameter for each coalescing window.
+    for (size_t i = 0; i < numApplied; ++i) {
+        CameraParam id;
+        int32_t value;
+        readEntry(i, &id, &value);
+        notifyParameterChanged(id, value);
+    }
+
+    return result;
+}
+
+
+void HalCamera::notifyParameterChanged(CameraParam id, int32_t value) {
+    EvsEventDesc event;
+    event.aType = EvsEventType::PARAMETER_CHANGED;
+    event.payload[0] = static_cast<uint32_t>(id);
+    event.payload[1] = static_cast<uint32_t>(value);
+    auto cbResult = this->notify(event);
+    if (!cbResult.isOk()) {
+        LOG(ERROR) << "Fail to deliver a parameter change notification";
+    }
+}
+
+
 Return<EvsResult> HalCamera::getParameter(CameraParam id, int32_t& value) {
     EvsResult result = EvsResult::OK;
     mHwCamera->getIntParameter(id, [&result, &value](auto status, auto readValue) {
@@ -564,11 +1228,81 @@ CameraUsageStatsRecord HalCamera::getStats() const {
 }
 
 
+std::shared_ptr<ClientFrameStats> HalCamera::registerClientStats(const std::string& name) {
+    return mUsageStats->registerClient(name);
+}
+
+
 Stream HalCamera::getStreamConfiguration() const {
     return mStreamConfig;
 }
 
 
+bool HalCamera::canDeriveStream(const Stream& config) const {
+    return DerivedStream::isSupported(mStreamConfig, config);
+}
+
+
+bool HalCamera::setClientStreamConfig(const VirtualCamera* client, const Stream& config) {
+    if (!canDeriveStream(config)) {
+        LOG(WARNING) << getId() << " can't derive a " << config.width << "x" << config.height
+                     << " stream in format " << static_cast<int32_t>(config.format);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mDerivedMutex);
+    auto it = std::find_if(mDerivedStreams.begin(), mDerivedStreams.end(),
+                           [&config](const auto& stream) { return stream->matches(config); });
+    if (it == mDerivedStreams.end()) {
+        if (mDerivedStreams.size() >= kMaxDerivedStreams) {
+            LOG(WARNING) << getId() << " already serves " << kMaxDerivedStreams
+                         << " derived streams";
+            return false;
+        }
+
+        const uint32_t firstBufferId =
+                kDerivedBufferIdBase + mDerivedStreams.size() * kNumDerivedBuffers;
+        auto stream = std::make_unique<DerivedStream>(config, firstBufferId, kNumDerivedBuffers);
+        if (!stream->init()) {
+            return false;
+        }
+        it = mDerivedStreams.emplace(mDerivedStreams.end(), std::move(stream));
+    }
+
+    mDerivedClients[client] = it->get();
+    return true;
+}
+
+
+DerivedStream* HalCamera::findDerivedStream(const VirtualCamera* client) const {
+    std::lock_guard<std::mutex> lock(mDerivedMutex);
+    auto it = mDerivedClients.find(client);
+    return it == mDerivedClients.end() ? nullptr : it->second;
+}
+
+
+DerivedStream* HalCamera::findDerivedStreamByBuffer(uint32_t bufferId) const {
+    if (bufferId < kDerivedBufferIdBase) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mDerivedMutex);
+    for (auto&& stream : mDerivedStreams) {
+        if (stream->owns(bufferId)) {
+            return stream.get();
+        }
+    }
+
+    return nullptr;
+}
+
+
+void HalCamera::removeDerivedClient(const VirtualCamera* client) {
+    std::lock_guard<std::mutex> lock(mDerivedMutex);
+    mDerivedClients.erase(client);
+}
+
+
 std::string HalCamera::toString(const char* indent) const {
     std::string buffer;
 
@@ -579,7 +1313,8 @@ std::string HalCamera::toString(const char* indent) const {
     std::string double_indent(indent);
     double_indent += indent;
     buffer += CameraUsageStats::toString(getStats(), double_indent.c_str());
-    for (auto&& client : mClients) {
+    const auto clientsSnapshot = clients();
+    for (auto&& client : *clientsSnapshot) {
         auto handle = client.promote();
         if (!handle) {
             continue;
@@ -592,9 +1327,40 @@ std::string HalCamera::toString(const char* indent) const {
 
     StringAppendF(&buffer, "%sMaster client: %p\n",
                            indent, mMaster.promote().get());
+    StringAppendF(&buffer, "%sFrames in use: %u of %u, %u requested\n",
+                           indent, countFramesInUse(), mFramesInFlight.load(),
+                           mFramesRequested.load());
+
+    {
+        std::lock_guard<std::mutex> lock(mFrameMutex);
+        StringAppendF(&buffer, "%sFrame interval: %" PRId64 " us\n",
+                               indent, mFrameIntervalUs);
+        for (auto&& [client, pacer] : mClientPacers) {
+            StringAppendF(&buffer, "%sClient %p paced at %" PRId64 " us, asked for %d fps\n",
+                                   double_indent.c_str(), client, pacer.intervalUs,
+                                   pacer.maxFramesPerSecond);
+        }
+    }
 
     buffer += HalCamera::toString(mStreamConfig, indent);
 
+    {
+        std::lock_guard<std::mutex> lock(mDerivedMutex);
+        for (auto&& stream : mDerivedStreams) {
+            const auto& config = stream->getConfig();
+            StringAppendF(&buffer, "%sDerived stream: %dx%d, format 0x%X\n",
+                                   indent, config.width, config.height, config.format);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mPoolMutex);
+        for (auto&& [client, pool] : mBufferPools) {
+            StringAppendF(&buffer, "%sClient %p imported %zu buffers\n",
+                                   indent, client, pool->size());
+        }
+    }
+
     return buffer;
 }
 
@@ -17,18 +17,28 @@
 #ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_HALCAMERA_H
 #define ANDROID_AUTOMOTIVE_EVS_V1_1_HALCAMERA_H
 
+#include "DerivedStream.h"
+#include "ExternalBufferPool.h"
 #include "stats/CameraUsageStats.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <android/hardware/automotive/evs/1.1/types.h>
 #include <android/hardware/automotive/evs/1.1/IEvsCamera.h>
 #include <android/hardware/automotive/evs/1.1/IEvsCameraStream.h>
 #include <utils/Mutex.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
 
 using namespace ::android::hardware::automotive::evs::V1_1;
 using ::android::hardware::camera::device::V3_2::Stream;
@@ -66,9 +76,11 @@ public:
           mId(deviceId),
           mStreamConfig(cfg),
           mTimeCreatedMs(android::uptimeMillis()),
-          mUsageStats(new CameraUsageStats(recordId)) {
+          mUsageStats(new CameraUsageStats(recordId, mId)),
+          mClients(std::make_shared<ClientList>()) {
         mCurrentRequests = &mFrameRequests[0];
         mNextRequests    = &mFrameRequests[1];
+        mFrameTraceName  = "EVS frame " + mId;
     }
 
     virtual ~HalCamera();
@@ -80,17 +92,25 @@ public:
 
     // Implementation details
     sp<IEvsCamera_1_0>  getHwCamera()       { return mHwCamera; };
-    unsigned            getClientCount()    { return mClients.size(); };
+    unsigned            getClientCount()    { return clients()->size(); };
     std::string         getId()             { return mId; }
     Stream&             getStreamConfig()   { return mStreamConfig; }
     bool                changeFramesInFlight(int delta);
+    // Imports |buffers| into the hardware camera.  If |owner| is given, the buffers join its
+    // pool and the frames rendered into them are delivered only to |owner|.
     bool                changeFramesInFlight(const hardware::hidl_vec<BufferDesc_1_1>& buffers,
-                                             int* delta);
+                                             int* delta,
+                                             const sp<VirtualCamera>& owner = nullptr);
     void                requestNewFrame(sp<VirtualCamera> virtualCamera,
                                         const int64_t timestamp);
 
     Return<EvsResult>   clientStreamStarting();
     void                clientStreamEnding(const VirtualCamera* client);
+    // Takes back at once the |frames| held by |client|, whose process died at |diedAt|, ends
+    // its stream and gives its frames in flight back to the other clients.
+    void                reclaimClientFrames(const VirtualCamera* client,
+                                            const std::deque<BufferDesc_1_1>& frames,
+                                            nsecs_t diedAt);
     Return<void>        doneWithFrame(const BufferDesc_1_0& buffer);
     Return<void>        doneWithFrame(const BufferDesc_1_1& buffer);
     Return<EvsResult>   setMaster(sp<VirtualCamera> virtualCamera);
@@ -100,12 +120,44 @@ public:
                                      CameraParam id, int32_t& value);
     Return<EvsResult>   getParameter(CameraParam id, int32_t& value);
 
+    // Extended info a client sets to program several parameters at once, holding pairs of a
+    // CameraParam and a value as int32_t.  Must match EvsV4lCamera::kParameterBatchId of the
+    // sample driver.
+    static constexpr uint32_t kParameterBatchId = 0x45565350;   // 'EVSP'
+
+    // Programs the parameters of |batch|, encoded as described for kParameterBatchId, and
+    // replaces their values with the ones applied.  The hardware camera takes them in a single
+    // call if it supports batches, or one at a time otherwise.
+    Return<EvsResult>   setParameters(sp<VirtualCamera> virtualCamera,
+                                      hardware::hidl_vec<uint8_t>& batch);
+
+    // Extended info telling the hardware camera how many frames per second the clients use, as
+    // an int32_t; 0 lifts the limit.  Must match EvsV4lCamera::kFrameRateHintId of the sample
+    // driver.  Drivers that don't know it just store it.  A client sets it on its virtual
+    // camera to ask for no more than that rate itself.
+    static constexpr uint32_t kFrameRateHintId = 0x45565346;    // 'EVSF'
+
+    // Paces |client| at no more than |framesPerSecond|, or lifts its limit if 0, and lowers
+    // the rate of the hardware camera if no other client needs more.
+    void                setClientFrameRate(const VirtualCamera* client, int32_t framesPerSecond);
+
     // Returns a snapshot of collected usage statistics
     CameraUsageStatsRecord getStats() const;
 
+    // Returns the histograms a client records its frame latencies into
+    std::shared_ptr<ClientFrameStats> registerClientStats(const std::string& name);
+
     // Returns active stream configuration
     Stream getStreamConfiguration() const;
 
+    // Returns true if the frames of this camera can be converted to |config|.
+    bool canDeriveStream(const Stream& config) const;
+
+    // Delivers the frames to |client| converted to |config| instead of the native frames.
+    // Clients asking for the same configuration share the converted frames.  Returns false
+    // if the conversion isn't supported or its buffers can't be allocated.
+    bool setClientStreamConfig(const VirtualCamera* client, const Stream& config);
+
     // Returns a string showing the current status
     std::string toString(const char* indent = "") const;
 
@@ -120,8 +172,23 @@ public:
     Return<void> notify(const EvsEventDesc& event) override;
 
 private:
+    // Weak pointers -> objects destruct if client dies
+    using ClientList = std::vector<wp<VirtualCamera>>;
+
+    // Returns a snapshot of the client list.  The stream callback walks the snapshot without
+    // a lock while the list is being updated.
+    std::shared_ptr<const ClientList> clients() const { return std::atomic_load(&mClients); }
+
+    // Publishes a copy of the client list modified by |update|.
+    template <typename Update>
+    void                updateClients(Update update) {
+        std::lock_guard<std::mutex> lock(mClientsMutex);
+        auto newClients = std::make_shared<ClientList>(*mClients);
+        update(newClients.get());
+        std::atomic_store(&mClients, std::shared_ptr<const ClientList>(std::move(newClients)));
+    }
+
     sp<IEvsCamera_1_1>              mHwCamera;
-    std::list<wp<VirtualCamera>>    mClients;   // Weak pointers -> objects destruct if client dies
 
     enum {
         STOPPED,
@@ -129,12 +196,46 @@ private:
         STOPPING,
     }                               mStreamState = STOPPED;
 
+    // Outstanding frames.  The slot of a frame is found by its bufferId, so the buffer returns
+    // don't scan the table or take a lock.  deliverFrame_1_1 claims the slots and holds a
+    // reference while it forwards a frame, so the clients may return it concurrently.
+    static constexpr uint32_t kNumFrameSlots = 64;   // Must be a power of two
     struct FrameRecord {
-        uint32_t    frameId;
-        uint32_t    refCount;
-        FrameRecord(uint32_t id) : frameId(id), refCount(0) {};
+        std::atomic<uint32_t>   frameId{0};
+        std::atomic<int32_t>    refCount{0};
     };
-    std::vector<FrameRecord>        mFrames;
+    std::array<FrameRecord, kNumFrameSlots> mFrames;
+
+    // Buffers released by the clients are returned to the hardware camera in batches.  A batch
+    // is sent when it fills up or when its oldest buffer has waited for kReturnBatchWindow.
+    static constexpr size_t kMaxReturnBatchSize = 8;
+    static constexpr std::chrono::milliseconds kReturnBatchWindow{2};
+
+    // Queues |buffer| to be returned to the hardware camera.
+    void                queueFrameReturn(const BufferDesc_1_1& buffer);
+    // Returns the queued buffers to the hardware camera right away.
+    void                flushFrameReturns();
+    // Stops the batching thread after returning the queued buffers.
+    void                stopFrameReturns();
+
+    // The members below are guarded by mReturnMutex.  They are not annotated because the
+    // batching thread waits on them with a std::unique_lock.
+    std::mutex                  mReturnMutex;
+    std::condition_variable     mReturnSignal;
+    std::vector<BufferDesc_1_1> mPendingReturns;
+    // When the oldest pending buffer must be returned
+    std::chrono::steady_clock::time_point mReturnDeadline;
+    bool                        mReturnThreadExit = false;
+    std::thread                 mReturnThread;
+
+    // Claims a free slot for |bufferId| with a single reference, or returns nullptr if all
+    // slots are in use.  Called only from the stream callback.
+    FrameRecord*        claimFrameRecord(uint32_t bufferId);
+    // Returns the outstanding frame record of |bufferId|, or nullptr if there is none.
+    FrameRecord*        findFrameRecord(uint32_t bufferId);
+    // Drops a reference and returns true if it was the last one.
+    static bool         releaseFrameRecord(FrameRecord* record);
+    unsigned            countFramesInUse() const;
     wp<VirtualCamera>               mMaster = nullptr;
     std::string                     mId;
     Stream                          mStreamConfig;
@@ -144,17 +245,124 @@ private:
         int64_t           timestamp = -1;
     };
 
+    // Delivery timeline of a v1.1 client.  The client is paced at an integer multiple of the
+    // camera frame interval, negotiated from how long the client takes to request a new frame
+    // after a delivery, and from the rate the client asked for.
+    struct ClientPacer {
+        int64_t intervalUs = 0;         // Negotiated delivery interval
+        int64_t lastSlotUs = -1;        // Timeline slot of the last delivered frame
+        nsecs_t deliveredAtNs = -1;     // When the last frame was delivered
+        nsecs_t busyNs = 0;             // Smoothed delay between a delivery and a new request
+        int32_t maxFramesPerSecond = 0; // Rate the client asked for at most; 0 for no limit
+    };
+
+    // The hardware camera is short of buffers when no more than this many are free.  Its
+    // frames then go only to the clients of the highest priority.
+    static constexpr unsigned kMinFreeFrames = 1;
+
+    // Buffers last requested from the hardware camera
+    std::atomic<unsigned>           mFramesInFlight{1};
+
+    // Buffers the clients asked for.  mFramesInFlight stays below it while the pool is
+    // trimmed, until the hardware camera runs short of buffers again.
+    std::atomic<unsigned>           mFramesRequested{1};
+
+    // Serializes the changes of the buffer count of the hardware camera
+    std::mutex                      mFramesInFlightMutex;
+
+    // Asks the hardware camera for |bufferCount| buffers.  Called with mFramesInFlightMutex
+    // held, which is not annotated because the trimming only tries to take it.
+    bool                setFramesInFlightLocked(unsigned bufferCount);
+
+    // Releases the buffers left idle over the last trim period, keeping a warm reserve above
+    // the peak of the frames in use, or restores the requested buffers once the trimmed pool
+    // runs short.  Called as the clients return frames, so it never blocks the stream.
+    void                trimFramesInFlight();
+
+    // Peak of the frames in use since the trim period started, and whether the stream ran
+    // short of buffers while the pool was trimmed.  Updated by the stream callback.
+    std::atomic<unsigned>           mPeakFramesInUse{0};
+    std::atomic<nsecs_t>            mTrimPeriodStart{0};
+    std::atomic<bool>               mFramesWanted{false};
+
+    // Tells the hardware camera how many frames per second the clients use, so it can lower
+    // the sensor rate.  Unless |force| is set, the demand is checked at most once a second.
+    void updateFrameRateHint(bool force);
+
+    // Whether the hardware camera takes parameter batches, probed on the first batch
+    std::once_flag                  mParameterBatchProbe;
+    bool                            mParameterBatchSupported = false;
+
+    // Notifies the clients that |id| was set to |value|
+    void                notifyParameterChanged(CameraParam id, int32_t value);
+
+    // Updates the measured camera frame interval with a new frame timestamp.
+    void updateFrameIntervalLocked(int64_t timestamp) REQUIRES(mFrameMutex);
+
+    // Returns true if a frame taken at |timestamp| is due for the client of |request|
+    // and moves the client timeline if so.
+    bool isFrameDueLocked(const FrameRequest& request, int64_t timestamp) REQUIRES(mFrameMutex);
+
     // synchronization
     mutable std::mutex        mFrameMutex;
     std::deque<FrameRequest>  mFrameRequests[2] GUARDED_BY(mFrameMutex);
     std::deque<FrameRequest>* mCurrentRequests  PT_GUARDED_BY(mFrameMutex);
     std::deque<FrameRequest>* mNextRequests     PT_GUARDED_BY(mFrameMutex);
 
+    // Frame pacing
+    int64_t                   mLastFrameTimestamp GUARDED_BY(mFrameMutex) = -1;
+    int64_t                   mFrameIntervalUs GUARDED_BY(mFrameMutex) = 0;
+    std::unordered_map<const VirtualCamera*, ClientPacer> mClientPacers GUARDED_BY(mFrameMutex);
+
+    // Frame rate last sent to the hardware camera, 0 for no limit, and when the demand of the
+    // clients was last checked
+    int32_t                   mFrameRateHint GUARDED_BY(mFrameMutex) = 0;
+    nsecs_t                   mFrameRateCheckedAtNs GUARDED_BY(mFrameMutex) = 0;
+
+    // Derived streams live as long as this camera, so the stream callback and the buffer
+    // returns use them without holding mDerivedMutex.  Each stream owns kNumDerivedBuffers
+    // bufferIds from kDerivedBufferIdBase up, which the hardware cameras don't use.
+    static constexpr size_t   kMaxDerivedStreams = 4;
+    static constexpr uint32_t kNumDerivedBuffers = 8;
+    static constexpr uint32_t kDerivedBufferIdBase = 0x80000000;
+
+    // Returns the derived stream |client| subscribes to, or nullptr.
+    DerivedStream*      findDerivedStream(const VirtualCamera* client) const;
+    // Returns the derived stream owning |bufferId|, or nullptr.
+    DerivedStream*      findDerivedStreamByBuffer(uint32_t bufferId) const;
+    // Drops the subscription of |client| to a derived stream.
+    void                removeDerivedClient(const VirtualCamera* client);
+
+    mutable std::mutex                           mDerivedMutex;
+    std::vector<std::unique_ptr<DerivedStream>>  mDerivedStreams GUARDED_BY(mDerivedMutex);
+    std::unordered_map<const VirtualCamera*, DerivedStream*> mDerivedClients
+            GUARDED_BY(mDerivedMutex);
+
+    // Returns the client owning the buffer of |buffer|, or nullptr if the buffer belongs to
+    // the hardware camera or its owner is gone.  Called only from the stream callback.
+    sp<VirtualCamera>   findBufferOwner(const BufferDesc_1_1& buffer);
+
+    // Pools of the buffers the clients imported, and the gralloc buffer IDs of the buffers
+    // the hardware camera delivered, by bufferId.  The hardware camera may replace its
+    // buffers when the number of frames in flight changes, so the IDs are looked up again
+    // after that.
+    mutable std::mutex        mPoolMutex;
+    std::unordered_map<const VirtualCamera*, std::unique_ptr<ExternalBufferPool>> mBufferPools
+            GUARDED_BY(mPoolMutex);
+    std::unordered_map<uint32_t, uint64_t> mHwBufferIds GUARDED_BY(mPoolMutex);
+
+    // Name of the trace slices spanning the frames from this camera, tagged by bufferId
+    std::string mFrameTraceName;
+
     // Time this object was created
     int64_t mTimeCreatedMs;
 
     // usage statistics to collect
     android::sp<CameraUsageStats> mUsageStats;
+
+    // Registered clients.  Replaced as a whole under mClientsMutex and read with atomic_load.
+    std::mutex                        mClientsMutex;
+    std::shared_ptr<const ClientList> mClients;
 };
 
 } // namespace implementation
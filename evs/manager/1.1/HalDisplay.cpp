@@ -17,9 +17,12 @@
 #include "HalDisplay.h"
 
 #include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
+#include <threadpolicy/ThreadPolicy.h>
 #include <ui/DisplayConfig.h>
 #include <ui/DisplayState.h>
 
@@ -31,10 +34,19 @@ namespace evs {
 namespace V1_1 {
 namespace implementation {
 
+namespace {
+
+// SCHED_FIFO priority of the buffer lane unless another policy is configured
+constexpr int kBufferLanePriority = 2;
+
+}  // namespace
+
 HalDisplay::HalDisplay(sp<IEvsDisplay_1_0> display, int32_t id) :
   mHwDisplay(display),
   mId(id) {
-    // nothing to do.
+    if (mHwDisplay != nullptr) {
+        mLaneThread = std::thread([this]() { runBufferLane(); });
+    }
 }
 
 HalDisplay::~HalDisplay() {
@@ -42,10 +54,73 @@ HalDisplay::~HalDisplay() {
 }
 
 void HalDisplay::shutdown() {
+    // Stops calling the hardware display before releasing it
+    stopBufferLane();
+
     // simply release a strong pointer to remote display object.
     mHwDisplay = nullptr;
 }
 
+void HalDisplay::runBufferLane() {
+    pthread_setname_np(pthread_self(), "EvsDisplayLane");
+    if (!threadpolicy::applyThreadPolicy(threadpolicy::kRoleDisplayLane)) {
+        sched_param param = { .sched_priority = kBufferLanePriority };
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+            LOG(WARNING) << "Display buffer lane runs without real-time priority";
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mLaneMutex);
+    while (!mLaneExit) {
+        if (!mReturnedBuffer) {
+            mLaneSignal.wait(lock);
+            continue;
+        }
+
+        // Returns the buffer and answers the waiting client
+        const BufferDesc_1_0 buffer = *mReturnedBuffer;
+        mReturnedBuffer.reset();
+
+        // A client passing camera frames through doesn't take the buffer fetched last time
+        mPrefetching = mVisible && !mPrefetchedBuffer;
+        lock.unlock();
+        const EvsResult result = mHwDisplay->returnTargetBufferForDisplay(buffer);
+        lock.lock();
+        mReturnResult = result;
+        mLaneSignal.notify_all();
+        if (!mPrefetching) {
+            continue;
+        }
+
+        // Fetches the next buffer while the client works on its next frame
+        lock.unlock();
+        std::optional<BufferDesc_1_0> next;
+        if (result == EvsResult::OK) {
+            mHwDisplay->getTargetBuffer([&next](const BufferDesc_1_0& buff) {
+                if (buff.memHandle != nullptr) {
+                    next = buff;
+                }
+            });
+        }
+        lock.lock();
+        mPrefetchedBuffer = std::move(next);
+        mPrefetching = false;
+        mLaneSignal.notify_all();
+    }
+}
+
+void HalDisplay::stopBufferLane() {
+    {
+        std::lock_guard<std::mutex> lock(mLaneMutex);
+        mLaneExit = true;
+    }
+    mLaneSignal.notify_all();
+
+    if (mLaneThread.joinable()) {
+        mLaneThread.join();
+    }
+}
+
 /**
  * Returns a strong pointer to remote display object.
  */
@@ -69,6 +144,12 @@ Return<void> HalDisplay::getDisplayInfo(getDisplayInfo_cb _hidl_cb) {
  * Sets the display state as what the clients wants.
  */
 Return<EvsResult> HalDisplay::setDisplayState(EvsDisplayState state) {
+    {
+        std::lock_guard<std::mutex> lock(mLaneMutex);
+        mVisible = state == EvsDisplayState::VISIBLE_ON_NEXT_FRAME ||
+                   state == EvsDisplayState::VISIBLE;
+    }
+
     if (mHwDisplay) {
         return mHwDisplay->setDisplayState(state);
     } else {
@@ -91,7 +172,21 @@ Return<EvsDisplayState> HalDisplay::getDisplayState() {
  * Returns a handle to a frame buffer associated with the display.
  */
 Return<void> HalDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb) {
-    if (mHwDisplay) {
+    if (!mHwDisplay) {
+        return Void();
+    }
+
+    // Hands over the buffer the lane fetched ahead, if any
+    std::optional<BufferDesc_1_0> buffer;
+    {
+        std::unique_lock<std::mutex> lock(mLaneMutex);
+        mLaneSignal.wait(lock, [this]() { return !mPrefetching; });
+        buffer.swap(mPrefetchedBuffer);
+    }
+
+    if (buffer) {
+        _hidl_cb(*buffer);
+    } else {
         mHwDisplay->getTargetBuffer(_hidl_cb);
     }
 
@@ -102,11 +197,23 @@ Return<void> HalDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb) {
  * Notifies the display that the buffer is ready to be used.
  */
 Return<EvsResult> HalDisplay::returnTargetBufferForDisplay(const BufferDesc_1_0& buffer) {
-    if (mHwDisplay) {
-        return mHwDisplay->returnTargetBufferForDisplay(buffer);
-    } else {
+    if (!mHwDisplay) {
         return EvsResult::OWNERSHIP_LOST;
     }
+
+    // Hands the buffer to the lane and waits until the hardware display takes it
+    std::unique_lock<std::mutex> lock(mLaneMutex);
+    if (mLaneExit || !mLaneThread.joinable()) {
+        lock.unlock();
+        return mHwDisplay->returnTargetBufferForDisplay(buffer);
+    }
+
+    mLaneSignal.wait(lock, [this]() { return !mReturnedBuffer && !mPrefetching; });
+    mReturnedBuffer = buffer;
+    mReturnResult.reset();
+    mLaneSignal.notify_all();
+    mLaneSignal.wait(lock, [this]() { return mReturnResult.has_value() || mLaneExit; });
+    return mReturnResult.value_or(EvsResult::OWNERSHIP_LOST);
 }
 
 /**
@@ -17,7 +17,11 @@
 #ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_DISPLAYPROXY_H
 #define ANDROID_AUTOMOTIVE_EVS_V1_1_DISPLAYPROXY_H
 
+#include <condition_variable>
 #include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
 
 #include <android/hardware/automotive/evs/1.1/types.h>
 #include <android/hardware/automotive/evs/1.1/IEvsDisplay.h>
@@ -48,7 +52,7 @@ public:
                         int32_t port = std::numeric_limits<int32_t>::min());
     virtual ~HalDisplay() override;
 
-    inline void         shutdown();
+    void                shutdown();
     sp<IEvsDisplay_1_0> getHwDisplay();
 
     // Methods from ::android::hardware::automotive::evs::V1_0::IEvsDisplay follow.
@@ -65,8 +69,31 @@ public:
     std::string toString(const char* indent = "");
 
 private:
+    // Runs the buffer cycle of the display owner on mLaneThread.
+    void                    runBufferLane();
+    void                    stopBufferLane();
+
     sp<IEvsDisplay_1_0>     mHwDisplay; // The low level display interface that backs this proxy
     int32_t                 mId; // Display identifier
+
+    // Buffer lane: a real-time thread returns the target buffers to the hardware display and
+    // fetches the next one ahead of the client, so the display owner's buffer cycle doesn't
+    // wait behind the camera traffic.  The members below are guarded by mLaneMutex, which
+    // the lane waits on with a unique_lock, so they are left unannotated.
+    std::mutex                      mLaneMutex;
+    std::condition_variable         mLaneSignal;
+    // Buffer the client returned, waiting for the lane
+    std::optional<BufferDesc_1_0>   mReturnedBuffer;
+    // Result of the last buffer returned by the lane
+    std::optional<EvsResult>        mReturnResult;
+    // Buffer fetched by the lane for the next getTargetBuffer() call
+    std::optional<BufferDesc_1_0>   mPrefetchedBuffer;
+    // True while the lane is fetching a buffer
+    bool                            mPrefetching = false;
+    // Buffers are fetched ahead only while the client wants the display visible
+    bool                            mVisible = false;
+    bool                            mLaneExit = false;
+    std::thread                     mLaneThread;
 };
 
 } // namespace implementation
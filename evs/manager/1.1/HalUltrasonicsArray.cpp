@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HalUltrasonicsArray.h"
+#include "VirtualUltrasonicsArray.h"
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <inttypes.h>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+using ::android::base::StringAppendF;
+using ::android::hardware::Void;
+using ::android::hardware::automotive::evs::V1_1::EvsEventType;
+
+
+HalUltrasonicsArray::HalUltrasonicsArray(const sp<IEvsUltrasonicsArray>& hwArray,
+                                         const std::string& id) :
+        mHwArray(hwArray),
+        mId(id) {}
+
+
+sp<VirtualUltrasonicsArray> HalUltrasonicsArray::makeVirtualArray() {
+    sp<VirtualUltrasonicsArray> client = new VirtualUltrasonicsArray(this);
+    if (client == nullptr) {
+        LOG(ERROR) << "Failed to create a client ultrasonics array object";
+        return nullptr;
+    }
+
+    if (!ownVirtualArray(client)) {
+        LOG(ERROR) << "Failed to own a client ultrasonics array object";
+        client = nullptr;
+    }
+
+    return client;
+}
+
+
+bool HalUltrasonicsArray::ownVirtualArray(const sp<VirtualUltrasonicsArray>& client) {
+    if (client == nullptr) {
+        return false;
+    }
+
+    // Make sure the hardware array lends enough frames to all our clients
+    if (!changeFramesInFlight(client->getAllowedFrames())) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mClients.emplace_back(client);
+    return true;
+}
+
+
+void HalUltrasonicsArray::disownVirtualArray(const sp<VirtualUltrasonicsArray>& client) {
+    if (client == nullptr) {
+        LOG(WARNING) << "Ignoring disownVirtualArray call with null pointer";
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const wp<VirtualUltrasonicsArray> target = client;
+        auto it = std::find(mClients.begin(), mClients.end(), target);
+        if (it == mClients.end()) {
+            LOG(ERROR) << "Couldn't find an ultrasonics array client to remove it";
+            return;
+        }
+        mClients.erase(it);
+    }
+
+    // Recompute the number of frames required without the removed client
+    if (!changeFramesInFlight(0)) {
+        LOG(ERROR) << "Error when trying to reduce the in flight frame count";
+    }
+}
+
+
+unsigned HalUltrasonicsArray::getClientCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mClients.size();
+}
+
+
+std::vector<sp<VirtualUltrasonicsArray>> HalUltrasonicsArray::getClients() const {
+    std::vector<sp<VirtualUltrasonicsArray>> clients;
+    std::lock_guard<std::mutex> lock(mMutex);
+    clients.reserve(mClients.size());
+    for (auto&& client : mClients) {
+        sp<VirtualUltrasonicsArray> handle = client.promote();
+        if (handle != nullptr) {
+            clients.emplace_back(std::move(handle));
+        }
+    }
+
+    return clients;
+}
+
+
+bool HalUltrasonicsArray::changeFramesInFlight(int delta) {
+    // Walk all our clients and count their currently required frames
+    int frameCount = delta;
+    for (auto&& client : getClients()) {
+        frameCount += client->getAllowedFrames();
+    }
+
+    // Never drop below 1 frame -- even if all clients get closed
+    frameCount = std::max(frameCount, 1);
+
+    Return<EvsResult> result = mHwArray->setMaxFramesInFlight(frameCount);
+    return result.isOk() && result == EvsResult::OK;
+}
+
+
+Return<EvsResult> HalUltrasonicsArray::clientStreamStarting() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mStreaming) {
+            return EvsResult::OK;
+        }
+    }
+
+    // Not under the lock, as the hardware array may deliver the first frame right away
+    Return<EvsResult> result = mHwArray->startStream(this);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStreaming = result.isOk() && result == EvsResult::OK;
+    return result;
+}
+
+
+void HalUltrasonicsArray::clientStreamEnding(const VirtualUltrasonicsArray* client) {
+    // Do we still have a running client?
+    bool stillRunning = false;
+    for (auto&& handle : getClients()) {
+        if (handle.get() != client) {
+            stillRunning |= handle->isStreaming();
+        }
+    }
+
+    // If not, then stop the hardware stream
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (stillRunning || !mStreaming) {
+            return;
+        }
+        mStreaming = false;
+    }
+    mHwArray->stopStream();
+}
+
+
+void HalUltrasonicsArray::releaseDataFrame(uint32_t dataFrameId) {
+    UltrasonicsDataFrameDesc returned;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mLentFrames.find(dataFrameId);
+        if (it == mLentFrames.end()) {
+            LOG(ERROR) << "We got a data frame back with an ID we don't recognize!";
+            return;
+        } else if (--it->second.refCount > 0) {
+            return;
+        }
+
+        returned = std::move(it->second.desc);
+        mLentFrames.erase(it);
+        ++mFramesReturned;
+    }
+
+    // Since all our clients are done with this frame, return it to the hardware array
+    mHwArray->doneWithDataFrame(returned);
+}
+
+
+void HalUltrasonicsArray::doneWithDataFrame(const UltrasonicsDataFrameDesc& dataFrame) {
+    releaseDataFrame(dataFrame.dataFrameId);
+}
+
+
+// Methods from ::android::hardware::automotive::evs::V1_1::IEvsUltrasonicsArrayStream follow.
+Return<void> HalUltrasonicsArray::deliverDataFrame(const UltrasonicsDataFrameDesc& dataFrame) {
+    LOG(VERBOSE) << "Received a data frame";
+
+    // Holds a reference while the frame is lent, so the clients can return it before the
+    // fan-out completes.
+    bool lent = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto [it, inserted] = mLentFrames.try_emplace(dataFrame.dataFrameId);
+        if (inserted) {
+            it->second.desc = dataFrame;
+            it->second.refCount = 1;
+            ++mFramesReceived;
+            lent = true;
+        }
+    }
+    if (!lent) {
+        LOG(WARNING) << "Data frame " << dataFrame.dataFrameId
+                     << " is delivered again before its return; returning it";
+        mHwArray->doneWithDataFrame(dataFrame);
+        return Void();
+    }
+
+    // Every client shares the data frame's memory; nothing is copied.
+    unsigned deliveries = 0;
+    for (auto&& client : getClients()) {
+        if (!client->isStreaming()) {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mLentFrames[dataFrame.dataFrameId].refCount;
+        }
+        if (client->deliverDataFrame(dataFrame)) {
+            ++deliveries;
+        } else {
+            releaseDataFrame(dataFrame.dataFrameId);
+        }
+    }
+
+    if (deliveries < 1) {
+        LOG(DEBUG) << "Trivially rejecting data frame " << dataFrame.dataFrameId
+                   << " from " << mId << " with no acceptance";
+    }
+
+    // Drops our own reference
+    releaseDataFrame(dataFrame.dataFrameId);
+    return Void();
+}
+
+
+Return<void> HalUltrasonicsArray::notify(const EvsEventDesc& event) {
+    LOG(DEBUG) << "Received an event id: " << static_cast<int32_t>(event.aType);
+    if (event.aType == EvsEventType::STREAM_STOPPED) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mStreaming) {
+            LOG(WARNING) << "Ultrasonics array stream stopped unexpectedly";
+        }
+        mStreaming = false;
+    }
+
+    // Forward the event to the streaming clients
+    for (auto&& client : getClients()) {
+        if (client->isStreaming() && !client->notify(event)) {
+            LOG(INFO) << "Failed to forward an event";
+        }
+    }
+
+    return Void();
+}
+
+
+std::string HalUltrasonicsArray::toString(const char* indent) const {
+    std::string buffer;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        StringAppendF(&buffer, "%sUltrasonics array %s: %s, %zu frames lent, "
+                               "%" PRIu64 " received, %" PRIu64 " returned\n",
+                               indent, mId.c_str(), mStreaming ? "streaming" : "stopped",
+                               mLentFrames.size(), mFramesReceived, mFramesReturned);
+    }
+
+    std::string double_indent(indent);
+    double_indent += indent;
+    for (auto&& client : getClients()) {
+        StringAppendF(&buffer, "%sClient %p\n", indent, client.get());
+        buffer += client->toString(double_indent.c_str());
+    }
+
+    return buffer;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
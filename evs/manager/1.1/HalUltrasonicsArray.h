@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_HALULTRASONICSARRAY_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_1_HALULTRASONICSARRAY_H
+
+#include <android/hardware/automotive/evs/1.1/types.h>
+#include <android/hardware/automotive/evs/1.1/IEvsUltrasonicsArray.h>
+#include <android/hardware/automotive/evs/1.1/IEvsUltrasonicsArrayStream.h>
+#include <utils/Mutex.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+using ::android::hardware::Return;
+using ::android::hardware::automotive::evs::V1_0::EvsResult;
+using ::android::hardware::automotive::evs::V1_1::EvsEventDesc;
+using ::android::hardware::automotive::evs::V1_1::IEvsUltrasonicsArray;
+using ::android::hardware::automotive::evs::V1_1::IEvsUltrasonicsArrayStream;
+using ::android::hardware::automotive::evs::V1_1::UltrasonicsDataFrameDesc;
+
+
+class VirtualUltrasonicsArray;    // From VirtualUltrasonicsArray.h
+
+
+// Wraps a hardware ultrasonics array and shares its stream among VirtualUltrasonicsArray
+// clients, in the same way HalCamera shares a hardware camera.  Every data frame is lent to
+// all the streaming clients at once, with the same shared memory, and goes back to the
+// hardware array once the last of them is done with it.
+class HalUltrasonicsArray : public IEvsUltrasonicsArrayStream {
+public:
+    HalUltrasonicsArray(const sp<IEvsUltrasonicsArray>& hwArray, const std::string& id);
+    virtual ~HalUltrasonicsArray() = default;
+
+    // Factory methods for client VirtualUltrasonicsArrays
+    sp<VirtualUltrasonicsArray> makeVirtualArray();
+    bool                        ownVirtualArray(const sp<VirtualUltrasonicsArray>& client);
+    void                        disownVirtualArray(const sp<VirtualUltrasonicsArray>& client);
+
+    // Implementation details
+    sp<IEvsUltrasonicsArray>    getHwArray()        { return mHwArray; }
+    const std::string&          getId() const       { return mId; }
+    unsigned                    getClientCount() const;
+    bool                        changeFramesInFlight(int delta);
+
+    Return<EvsResult>           clientStreamStarting();
+    void                        clientStreamEnding(const VirtualUltrasonicsArray* client);
+    void                        doneWithDataFrame(const UltrasonicsDataFrameDesc& dataFrame);
+
+    // Returns a string showing the current status
+    std::string                 toString(const char* indent = "") const;
+
+    // Methods from ::android::hardware::automotive::evs::V1_1::IEvsUltrasonicsArrayStream
+    // follow.
+    Return<void> deliverDataFrame(const UltrasonicsDataFrameDesc& dataFrame) override;
+    Return<void> notify(const EvsEventDesc& event) override;
+
+private:
+    // Data frame lent to the clients, with the count of references on it
+    struct LentFrame {
+        UltrasonicsDataFrameDesc    desc;
+        int32_t                     refCount = 0;
+    };
+
+    // Returns the clients alive, streaming or not.
+    std::vector<sp<VirtualUltrasonicsArray>> getClients() const;
+
+    // Drops a reference on a data frame and returns it to the hardware array after the last.
+    void                        releaseDataFrame(uint32_t dataFrameId);
+
+    const sp<IEvsUltrasonicsArray>  mHwArray;
+    const std::string               mId;
+
+    mutable std::mutex              mMutex;
+    // Weak pointers -> objects destruct if client dies
+    std::vector<wp<VirtualUltrasonicsArray>>
+                                    mClients GUARDED_BY(mMutex);
+    std::unordered_map<uint32_t, LentFrame>
+                                    mLentFrames GUARDED_BY(mMutex);
+    bool                            mStreaming GUARDED_BY(mMutex) = false;
+    uint64_t                        mFramesReceived GUARDED_BY(mMutex) = 0;
+    uint64_t                        mFramesReturned GUARDED_BY(mMutex) = 0;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_1_HALULTRASONICSARRAY_H
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_SPSCQUEUE_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_1_SPSCQUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+template <typename T, size_t kCapacity>
+class SpscQueue {
+    static_assert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+public:
+    // Called by the producer only.  Returns false if the queue is full.
+    bool push(T&& item) {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) >= kCapacity) {
+            return false;
+        }
+
+        mItems[tail & (kCapacity - 1)] = std::move(item);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Called by the consumer only.  Returns false if the queue is empty.
+    bool pop(T* item) {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        *item = std::move(mItems[head & (kCapacity - 1)]);
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<T, kCapacity> mItems;
+    // Indices keep counting up and wrap around with size_t, so a full queue is told apart
+    // from an empty one.
+    std::atomic<size_t>      mHead{0};
+    std::atomic<size_t>      mTail{0};
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_1_SPSCQUEUE_H
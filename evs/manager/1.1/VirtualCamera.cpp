@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+
 #include "VirtualCamera.h"
 #include "HalCamera.h"
 #include "Enumerator.h"
@@ -21,8 +23,16 @@
 #include <android/hardware_buffer.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <android-base/stringprintf.h>
+#include <utils/Trace.h>
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <cstring>
 
+using ::android::base::GetIntProperty;
 using ::android::base::StringAppendF;
 using ::android::base::StringPrintf;
 using ::android::base::WriteStringToFd;
@@ -35,17 +45,62 @@ namespace evs {
 namespace V1_1 {
 namespace implementation {
 
+namespace {
+
+// Largest difference between the timestamps of the frames delivered together from the
+// physical cameras of a logical camera.  Half a frame at 30 fps, unless overridden.
+constexpr int64_t kDefaultSyncToleranceUs = 16666;
+constexpr char kSyncTolerancePropertyName[] = "ro.automotive.evs.frame_sync_tolerance_us";
+
+// Frames of a physical camera waiting for the other cameras
+constexpr size_t kMaxSyncQueueDepth = 3;
+
+// Longest a frame drop waits to be reported while drops are coalesced
+constexpr nsecs_t kMaxFrameDropDelayNs = s2ns(1);
+
+}  // namespace
+
 
 VirtualCamera::VirtualCamera(const std::vector<sp<HalCamera>>& halCameras) :
-    mStreamState(STOPPED) {
+    mStreamState(STOPPED),
+    mScheduler(DeliveryScheduler::getDefault()) {
+    const auto name = StringPrintf("%p", this);
     for (auto&& cam : halCameras) {
         mHalCamera.try_emplace(cam->getId(), cam);
+        mFrameStats.try_emplace(cam->getId(), cam->registerClientStats(name));
+        mTraceNames.try_emplace(cam->getId(),
+                                TraceNames{StringPrintf("EVS %p %s frame", this,
+                                                        cam->getId().c_str()),
+                                           StringPrintf("EVS %p %s held frames", this,
+                                                        cam->getId().c_str())});
     }
 }
 
 
+void VirtualCamera::traceFrameHeld(const BufferDesc_1_1& buffer, bool held) {
+    if (!ATRACE_ENABLED()) {
+        return;
+    }
+
+    auto it = mTraceNames.find(buffer.deviceId);
+    if (it == mTraceNames.end()) {
+        return;
+    }
+
+    if (held) {
+        ATRACE_ASYNC_BEGIN(it->second.frame.c_str(), buffer.bufferId);
+    } else {
+        ATRACE_ASYNC_END(it->second.frame.c_str(), buffer.bufferId);
+    }
+    ATRACE_INT(it->second.heldFrames.c_str(),
+               static_cast<int32_t>(mFramesHeld[buffer.deviceId].size()));
+}
+
+
 VirtualCamera::~VirtualCamera() {
     shutdown();
+    stopCapture();
+    stopDelivery();
 }
 
 
@@ -58,6 +113,7 @@ void VirtualCamera::shutdown() {
 
         // Tell the frame delivery pipeline we don't want any more frames
         mStreamState = STOPPING;
+        mStream->unlinkToDeath(mDeathRecipient);
 
         for (auto&& [key, hwCamera] : mHalCamera) {
             auto pHwCamera = hwCamera.promote();
@@ -84,12 +140,12 @@ void VirtualCamera::shutdown() {
             pHwCamera->clientStreamEnding(this);
         }
 
-        // Join a capture thread
-        if (mCaptureThread.joinable()) {
-            mCaptureThread.join();
-        }
+        // Stop capturing frames and sending them
+        stopCapture();
+        stopDelivery();
 
         mFramesHeld.clear();
+        mFramesDeliveredAt.clear();
 
         // Drop our reference to our associated hardware camera
         mHalCamera.clear();
@@ -97,6 +153,349 @@ void VirtualCamera::shutdown() {
 }
 
 
+void VirtualCamera::StreamDeathRecipient::serviceDied(
+        uint64_t /*cookie*/, const wp<hidl::base::V1_0::IBase>& /*who*/) {
+    const nsecs_t diedAt = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<VirtualCamera> client = mClient.promote();
+    if (client != nullptr) {
+        client->reclaimFrames(diedAt);
+    }
+}
+
+
+void VirtualCamera::reclaimFrames(nsecs_t diedAt) {
+    if (mStreamState != RUNNING) {
+        // The client stopped its stream before it died
+        return;
+    }
+
+    LOG(WARNING) << this << ": The client died while streaming; reclaiming its frames";
+
+    // Nothing goes to the client anymore
+    mStreamState = STOPPING;
+    stopCapture();
+    stopDelivery(/*discard=*/true);
+
+    for (auto&& [key, hwCamera] : mHalCamera) {
+        auto pHwCamera = hwCamera.promote();
+        if (pHwCamera == nullptr) {
+            LOG(WARNING) << "Camera device " << key << " is not alive.";
+            continue;
+        }
+
+        // Lets another client take over the master role, then returns the held frames
+        pHwCamera->unsetMaster(this);
+        pHwCamera->reclaimClientFrames(this, mFramesHeld[key], diedAt);
+    }
+
+    // The hardware cameras are kept, so the client camera can still be closed as usual
+    mFramesHeld.clear();
+    mFramesDeliveredAt.clear();
+    mStreamState = STOPPED;
+}
+
+
+void VirtualCamera::startDelivery() {
+    std::lock_guard<std::mutex> lock(mDeliveryProducerMutex);
+    if (mDeliveryRunning) {
+        return;
+    }
+
+    mDeliveryTask = mScheduler->createTask([this]() { sendDeliveries(); });
+    mDeliveryRunning = true;
+}
+
+
+void VirtualCamera::stopDelivery(bool discard) {
+    std::shared_ptr<DeliveryScheduler::Task> task;
+    {
+        // No new deliveries once this returns, so everything queued is sent below.
+        std::lock_guard<std::mutex> lock(mDeliveryProducerMutex);
+        if (!mDeliveryRunning) {
+            return;
+        }
+        mDeliveryRunning = false;
+        task = std::move(mDeliveryTask);
+    }
+
+    // Once the task is cancelled, this thread is the only consumer of the queue.
+    mScheduler->cancel(task);
+    PendingDelivery delivery;
+    while (mPendingDeliveries.pop(&delivery)) {
+        if (!discard) {
+            sendDelivery(delivery);
+        }
+    }
+
+    if (!discard) {
+        std::chrono::steady_clock::time_point eventsDue;
+        sendCoalescedEvents(/*force=*/true, &eventsDue);
+    }
+}
+
+
+bool VirtualCamera::queueDelivery(PendingDelivery&& delivery) {
+    std::shared_ptr<DeliveryScheduler::Task> task;
+    {
+        std::lock_guard<std::mutex> lock(mDeliveryProducerMutex);
+        if (!mDeliveryRunning || !mPendingDeliveries.push(std::move(delivery))) {
+            return false;
+        }
+        task = mDeliveryTask;
+    }
+
+    mScheduler->schedule(task);
+    return true;
+}
+
+
+void VirtualCamera::sendDeliveries() {
+    PendingDelivery delivery;
+    while (mPendingDeliveries.pop(&delivery)) {
+        sendDelivery(delivery);
+    }
+
+    std::chrono::steady_clock::time_point eventsDue;
+    if (sendCoalescedEvents(/*force=*/false, &eventsDue)) {
+        std::shared_ptr<DeliveryScheduler::Task> task;
+        {
+            std::lock_guard<std::mutex> lock(mDeliveryProducerMutex);
+            task = mDeliveryTask;
+        }
+        if (task != nullptr) {
+            mScheduler->scheduleAt(task, eventsDue);
+        }
+    }
+}
+
+
+void VirtualCamera::reportFrameDrop(const std::string& deviceId) {
+    PendingDelivery delivery;
+    delivery.type = PendingDelivery::EVENT_1_1;
+    delivery.event.deviceId = deviceId;
+    delivery.event.aType = EvsEventType::FRAME_DROPPED;
+    {
+        std::lock_guard<std::mutex> lock(mDropMutex);
+        auto& drops = mFrameDrops[deviceId];
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (drops.count++ == 0) {
+            drops.firstDropTime = now;
+        }
+        if (drops.count < mDropsPerEvent && now - drops.firstDropTime < kMaxFrameDropDelayNs) {
+            return;
+        }
+
+        delivery.event.payload[0] = drops.count;
+        drops.count = 0;
+    }
+
+    if (!queueDelivery(std::move(delivery))) {
+        LOG(WARNING) << "Failed to queue a frame drop event";
+    }
+}
+
+
+void VirtualCamera::flushFrameDrops(const std::string& deviceId) {
+    PendingDelivery delivery;
+    delivery.type = PendingDelivery::EVENT_1_1;
+    delivery.event.deviceId = deviceId;
+    delivery.event.aType = EvsEventType::FRAME_DROPPED;
+    {
+        std::lock_guard<std::mutex> lock(mDropMutex);
+        auto it = mFrameDrops.find(deviceId);
+        if (it == mFrameDrops.end() || it->second.count == 0) {
+            return;
+        }
+
+        delivery.event.payload[0] = it->second.count;
+        it->second.count = 0;
+    }
+
+    if (!queueDelivery(std::move(delivery))) {
+        LOG(WARNING) << "Failed to queue a frame drop event";
+    }
+}
+
+
+void VirtualCamera::recordFrameReturn(const std::string& deviceId, uint32_t bufferId) {
+    auto frames = mFramesDeliveredAt.find(deviceId);
+    auto stats = mFrameStats.find(deviceId);
+    if (frames == mFramesDeliveredAt.end() || stats == mFrameStats.end()) {
+        return;
+    }
+
+    auto frame = frames->second.find(bufferId);
+    if (frame == frames->second.end()) {
+        return;
+    }
+
+    const nsecs_t holdTime = systemTime(SYSTEM_TIME_MONOTONIC) - frame->second;
+    stats->second->holdTime.record(ns2us(holdTime));
+    stats->second->live.framesReturned();
+    frames->second.erase(frame);
+
+    nsecs_t maxHoldTime = mMaxHoldTimeInWindow.load();
+    while (holdTime > maxHoldTime &&
+           !mMaxHoldTimeInWindow.compare_exchange_weak(maxHoldTime, holdTime)) {}
+}
+
+
+void VirtualCamera::recordFramesDroppedToSync(const std::vector<BufferDesc_1_1>& dropped) {
+    for (auto&& buffer : dropped) {
+        auto stats = mFrameStats.find(buffer.deviceId);
+        if (stats != mFrameStats.end()) {
+            stats->second->live.framesDropped();
+        }
+    }
+}
+
+
+const BufferDesc_1_0& VirtualCamera::getFrameDesc_1_0(const BufferDesc_1_1& bufDesc) {
+    auto it = mFrameDescs_1_0.find(bufDesc.bufferId);
+    if (it != mFrameDescs_1_0.end() &&
+        it->second.memHandle.getNativeHandle() == bufDesc.buffer.nativeHandle.getNativeHandle()) {
+        return it->second;
+    }
+
+    // First time we see this buffer, or the hardware replaced it
+    BufferDesc_1_0 frame_1_0 = {};
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&bufDesc.buffer.description);
+    frame_1_0.width     = pDesc->width;
+    frame_1_0.height    = pDesc->height;
+    frame_1_0.format    = pDesc->format;
+    frame_1_0.usage     = pDesc->usage;
+    frame_1_0.stride    = pDesc->stride;
+    frame_1_0.memHandle = bufDesc.buffer.nativeHandle;
+    frame_1_0.pixelSize = bufDesc.pixelSize;
+    frame_1_0.bufferId  = bufDesc.bufferId;
+
+    return mFrameDescs_1_0.insert_or_assign(bufDesc.bufferId, std::move(frame_1_0)).first->second;
+}
+
+
+void VirtualCamera::returnFrames(const std::vector<BufferDesc_1_1>& frames) {
+    if (frames.empty()) {
+        return;
+    }
+
+    hardware::hidl_vec<BufferDesc_1_1> buffers(frames);
+    returnHeldFrames(buffers);
+}
+
+
+void VirtualCamera::sendDelivery(const PendingDelivery& delivery) {
+    switch (delivery.type) {
+        case PendingDelivery::FRAME_1_0: {
+            ATRACE_NAME("IEvsCameraStream::deliverFrame");
+            auto result = mStream->deliverFrame(delivery.frame);
+            if (!result.isOk()) {
+                LOG(ERROR) << "Error delivering a frame";
+            }
+            break;
+        }
+
+        case PendingDelivery::EVENT_1_1: {
+            auto result = mStream_1_1->notify(delivery.event);
+            if (!result.isOk()) {
+                LOG(ERROR) << "Error delivering an event";
+            }
+            break;
+        }
+    }
+}
+
+
+bool VirtualCamera::coalesceEvent(const EvsEventDesc& event) {
+    if (event.aType != EvsEventType::PARAMETER_CHANGED &&
+        event.aType != EvsEventType::MASTER_RELEASED) {
+        return false;
+    }
+
+    std::shared_ptr<DeliveryScheduler::Task> task;
+    {
+        // The delivery task sends the coalesced events only while it runs.
+        std::lock_guard<std::mutex> lock(mDeliveryProducerMutex);
+        if (!mDeliveryRunning) {
+            return false;
+        }
+        task = mDeliveryTask;
+    }
+
+    bool windowOpened = false;
+    std::chrono::steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(mEventMutex);
+        auto it = std::find_if(mCoalescedEvents.begin(), mCoalescedEvents.end(),
+                               [&event](const EvsEventDesc& pending) {
+                                   return pending.aType == event.aType &&
+                                          pending.deviceId == event.deviceId &&
+                                          (event.aType != EvsEventType::PARAMETER_CHANGED ||
+                                           pending.payload[0] == event.payload[0]);
+                               });
+        if (it != mCoalescedEvents.end()) {
+            *it = event;
+        } else {
+            windowOpened = mCoalescedEvents.empty();
+            if (windowOpened) {
+                mCoalescedEventsDue = std::chrono::steady_clock::now() + kEventCoalescingWindow;
+                due = mCoalescedEventsDue;
+            }
+            mCoalescedEvents.emplace_back(event);
+        }
+    }
+
+    if (windowOpened) {
+        mScheduler->scheduleAt(task, due);
+    }
+
+    return true;
+}
+
+
+bool VirtualCamera::sendCoalescedEvents(bool force, std::chrono::steady_clock::time_point* due) {
+    std::vector<EvsEventDesc> events;
+    {
+        std::lock_guard<std::mutex> lock(mEventMutex);
+        if (mCoalescedEvents.empty()) {
+            return false;
+        } else if (!force && std::chrono::steady_clock::now() < mCoalescedEventsDue) {
+            *due = mCoalescedEventsDue;
+            return true;
+        }
+
+        events.swap(mCoalescedEvents);
+    }
+
+    for (auto&& event : events) {
+        auto result = mStream_1_1->notify(event);
+        if (!result.isOk()) {
+            LOG(ERROR) << "Error delivering an event";
+        }
+    }
+
+    return false;
+}
+
+
+void VirtualCamera::queueCoalescedEvents() {
+    std::vector<EvsEventDesc> events;
+    {
+        std::lock_guard<std::mutex> lock(mEventMutex);
+        events.swap(mCoalescedEvents);
+    }
+
+    for (auto&& event : events) {
+        PendingDelivery delivery;
+        delivery.type = PendingDelivery::EVENT_1_1;
+        delivery.event = event;
+        if (!queueDelivery(std::move(delivery))) {
+            LOG(WARNING) << "Failed to queue a coalesced event";
+        }
+    }
+}
+
+
 std::vector<sp<HalCamera>> VirtualCamera::getHalCameras() {
     std::vector<sp<HalCamera>> cameras;
     for (auto&& [key, cam] : mHalCamera) {
@@ -115,61 +514,87 @@ bool VirtualCamera::deliverFrame(const BufferDesc_1_1& bufDesc) {
         // A stopped stream gets no frames
         LOG(ERROR) << "A stopped stream should not get any frames";
         return false;
+    } else if (mStreamState == STOPPING) {
+        // Nor does a stream on its way out, whose held frames may already be returned
+        return false;
     } else if (mFramesHeld[bufDesc.deviceId].size() >= mFramesAllowed) {
         // Indicate that we declined to send the frame to the client because they're at quota
         LOG(INFO) << "Skipping new frame as we hold " << mFramesHeld[bufDesc.deviceId].size()
                   << " of " << mFramesAllowed;
+        ++mQuotaDropsInWindow;
+        ++mFramesDroppedAtQuota;
+        auto stats = mFrameStats.find(bufDesc.deviceId);
+        if (stats != mFrameStats.end()) {
+            stats->second->live.framesDropped();
+        }
 
         if (mStream_1_1 != nullptr) {
             // Report a frame drop to v1.1 client.
-            EvsEventDesc event;
-            event.deviceId = bufDesc.deviceId;
-            event.aType = EvsEventType::FRAME_DROPPED;
-            auto result = mStream_1_1->notify(event);
-            if (!result.isOk()) {
-                LOG(ERROR) << "Error delivering end of stream event";
-            }
+            reportFrameDrop(bufDesc.deviceId);
         }
 
         return false;
     } else {
-        // Keep a record of this frame so we can clean up if we have to in case of client death
-        mFramesHeld[bufDesc.deviceId].emplace_back(bufDesc);
+        // Records the delivery latency from the hardware timestamp
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        auto stats = mFrameStats.find(bufDesc.deviceId);
+        if (stats != mFrameStats.end()) {
+            stats->second->deliveryLatency.record(ns2us(now) - bufDesc.timestamp);
+            stats->second->live.framesReceived();
+        }
+        mFramesDeliveredAt[bufDesc.deviceId][bufDesc.bufferId] = now;
+        ++mFramesDeliveredInWindow;
 
         // v1.0 client uses an old frame-delivery mechanism.
         if (mStream_1_1 == nullptr) {
             // Forward a frame to v1.0 client
-            BufferDesc_1_0 frame_1_0 = {};
-            const AHardwareBuffer_Desc* pDesc =
-                reinterpret_cast<const AHardwareBuffer_Desc *>(&bufDesc.buffer.description);
-            frame_1_0.width     = pDesc->width;
-            frame_1_0.height    = pDesc->height;
-            frame_1_0.format    = pDesc->format;
-            frame_1_0.usage     = pDesc->usage;
-            frame_1_0.stride    = pDesc->stride;
-            frame_1_0.memHandle = bufDesc.buffer.nativeHandle;
-            frame_1_0.pixelSize = bufDesc.pixelSize;
-            frame_1_0.bufferId  = bufDesc.bufferId;
-
-            mStream->deliverFrame(frame_1_0);
-        } else if (mCaptureThread.joinable()) {
-            // Keep forwarding frames as long as a capture thread is alive
-            if (mFramesHeld.size() > 0 && mStream_1_1 != nullptr) {
-                // Pass this buffer through to our client
-                hardware::hidl_vec<BufferDesc_1_1> frames;
-                frames.resize(1);
-                auto pHwCamera = mHalCamera.begin()->second.promote();
-                if (pHwCamera != nullptr) {
-                    frames[0] = mFramesHeld[mHalCamera.begin()->first].back();
+            PendingDelivery delivery;
+            delivery.frame = getFrameDesc_1_0(bufDesc);
+
+            // Keep a record of this frame so we can clean up if we have to in case of client
+            // death.  The record is made before queueing, as the client may return the frame
+            // as soon as it is sent.
+            mFramesHeld[bufDesc.deviceId].emplace_back(bufDesc);
+            traceFrameHeld(bufDesc, /*held=*/true);
+            if (!queueDelivery(std::move(delivery))) {
+                LOG(WARNING) << "Delivery queue is full; declining a frame";
+                mFramesHeld[bufDesc.deviceId].pop_back();
+                mFramesDeliveredAt[bufDesc.deviceId].erase(bufDesc.bufferId);
+                traceFrameHeld(bufDesc, /*held=*/false);
+                return false;
+            }
+        } else {
+            // Keep a record of this frame so we can clean up if we have to in case of client
+            // death
+            mFramesHeld[bufDesc.deviceId].emplace_back(bufDesc);
+            traceFrameHeld(bufDesc, /*held=*/true);
+        }
+
+        if (mStream_1_1 != nullptr) {
+            // Report the drops coalesced before this frame
+            flushFrameDrops(bufDesc.deviceId);
+
+            // Queue this frame for the capture task to match with the other cameras
+            std::vector<BufferDesc_1_1> dropped;
+            std::shared_ptr<DeliveryScheduler::Task> task;
+            {
+                std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+                if (mFrameSync != nullptr) {
+                    mFrameSync->push(bufDesc, &dropped);
+                    mFramesDroppedToSync += dropped.size();
                 }
+                recordFramesDroppedToSync(dropped);
 
                 // Notify a new frame receipt
-                {
-                    std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
-                    mSourceCameras.erase(bufDesc.deviceId);
+                if (mSourceCameras.erase(bufDesc.deviceId) > 0) {
+                    mCaptureProgressAt = std::chrono::steady_clock::now();
                 }
-                mFramesReadySignal.notify_all();
+                task = mCaptureTask;
+            }
+            if (task != nullptr) {
+                mScheduler->schedule(task);
             }
+            returnFrames(dropped);
         }
 
         return true;
@@ -193,7 +618,8 @@ bool VirtualCamera::notify(const EvsEventDesc& event) {
             }
 
             if (mStream_1_1 == nullptr) {
-                // Send a null frame instead, for v1.0 client
+                // Send a null frame instead, for v1.0 client, after the frames still queued
+                stopDelivery();
                 auto result = mStream->deliverFrame({});
                 if (!result.isOk()) {
                     LOG(ERROR) << "Error delivering end of stream marker";
@@ -217,6 +643,22 @@ bool VirtualCamera::notify(const EvsEventDesc& event) {
     }
 
     if (mStream_1_1 != nullptr) {
+        // Bursts of events are coalesced and sent from the delivery thread, after the
+        // events queued before them.  The end of the stream is sent right away.
+        if (event.aType != EvsEventType::STREAM_STOPPED) {
+            if (coalesceEvent(event)) {
+                return true;
+            }
+
+            queueCoalescedEvents();
+            PendingDelivery delivery;
+            delivery.type = PendingDelivery::EVENT_1_1;
+            delivery.event = event;
+            if (queueDelivery(std::move(delivery))) {
+                return true;
+            }
+        }
+
         // Forward a received event to the v1.1 client
         auto result = mStream_1_1->notify(event);
         if (!result.isOk()) {
@@ -250,6 +692,17 @@ Return<void> VirtualCamera::getCameraInfo(getCameraInfo_cb info_cb) {
 
 
 Return<EvsResult> VirtualCamera::setMaxFramesInFlight(uint32_t bufferCount) {
+    if (!resizeFramesInFlight(bufferCount)) {
+        return EvsResult::BUFFER_NOT_AVAILABLE;
+    }
+
+    // In auto mode, the tuning starts over from the new count
+    mFramesRequested = bufferCount;
+    return EvsResult::OK;
+}
+
+
+bool VirtualCamera::resizeFramesInFlight(uint32_t bufferCount) {
     // How many buffers are we trying to add (or remove if negative)
     int bufferCountChange = bufferCount - mFramesAllowed;
 
@@ -285,9 +738,56 @@ Return<EvsResult> VirtualCamera::setMaxFramesInFlight(uint32_t bufferCount) {
 
         // Restore the original buffer count
         mFramesAllowed -= bufferCountChange;
-        return EvsResult::BUFFER_NOT_AVAILABLE;
+        return false;
     } else {
-        return EvsResult::OK;
+        return true;
+    }
+}
+
+
+void VirtualCamera::tuneFramesInFlight() {
+    if (!mAutoFramesInFlight) {
+        return;
+    }
+
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const nsecs_t windowNs = now - mTuningWindowStart;
+    if (windowNs < kTuningWindowNs) {
+        return;
+    }
+
+    mTuningWindowStart = now;
+    const uint32_t framesDelivered = mFramesDeliveredInWindow.exchange(0);
+    const uint32_t quotaDrops = mQuotaDropsInWindow.exchange(0);
+    const nsecs_t maxHoldTime = mMaxHoldTimeInWindow.exchange(0);
+    if (framesDelivered < 1 || windowNs > 2 * kTuningWindowNs) {
+        // Idle, or the first window since the stream started
+        return;
+    }
+
+    // A frame arrives every interval, so a client holding each frame for up to maxHoldTime
+    // holds that many intervals' worth of frames, plus the one in transit.
+    const nsecs_t frameIntervalNs = windowNs / framesDelivered;
+    const unsigned current = mFramesAllowed;
+    unsigned needed = static_cast<unsigned>(
+            (maxHoldTime + frameIntervalNs - 1) / frameIntervalNs) + 1;
+    if (quotaDrops > 0) {
+        // The client hit its quota; the hold times alone may not show it.
+        needed = std::max(needed, current + 1);
+    }
+
+    // Grows at once to avoid drops but shrinks a frame per window, so a short burst of fast
+    // returns doesn't take the frames a slower period needs.
+    unsigned target = needed > current ? needed : current - (needed < current ? 1 : 0);
+    target = std::clamp(target, 1u, std::max(mFramesRequested, 1u));
+    if (target == current) {
+        return;
+    }
+
+    LOG(DEBUG) << this << ": tunes frames in flight from " << current << " to " << target
+               << " for a hold time of " << ns2us(maxHoldTime) << " us";
+    if (!resizeFramesInFlight(target)) {
+        LOG(WARNING) << "Failed to tune frames in flight to " << target;
     }
 }
 
@@ -311,7 +811,31 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
         LOG(INFO) << "Start video stream for v1.1 client.";
     }
 
+    // Reclaim the frames of the client at once if its process dies while streaming
+    if (mDeathRecipient == nullptr) {
+        mDeathRecipient = new StreamDeathRecipient(this);
+    }
+    auto linked = mStream->linkToDeath(mDeathRecipient, /*cookie=*/0);
+    if (!linked.isOk() || !linked) {
+        LOG(WARNING) << "Failed to link to the death of the client";
+    }
+
     mStreamState = RUNNING;
+    mFrameDescs_1_0.clear();
+    startDelivery();
+    if (mStream_1_1 != nullptr) {
+        std::vector<std::string> deviceIds;
+        for (auto&& [key, hwCamera] : mHalCamera) {
+            deviceIds.emplace_back(key);
+        }
+
+        const int64_t toleranceUs =
+                GetIntProperty<int64_t>(kSyncTolerancePropertyName, kDefaultSyncToleranceUs);
+        std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+        mFrameSync = std::make_unique<FrameSynchronizer>(deviceIds, toleranceUs,
+                                                         kMaxSyncQueueDepth);
+        mSourceCameras.clear();
+    }
 
     // Tell the underlying camera hardware that we want to stream
     auto iter = mHalCamera.begin();
@@ -327,6 +851,8 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
         Return<EvsResult> result = pHwCamera->clientStreamStarting();
         if ((!result.isOk()) || (result != EvsResult::OK)) {
             // If we failed to start the underlying stream, then we're not actually running
+            stopDelivery();
+            mStream->unlinkToDeath(mDeathRecipient);
             mStream = mStream_1_1 = nullptr;
             mStreamState = STOPPED;
 
@@ -344,68 +870,17 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
         ++iter;
     }
 
-    // Start a thread that waits on the fence and forwards collected frames
-    // to the v1.1 client.
+    // Start capturing the sets of frames for the v1.1 client.  The capture task runs on the
+    // shared delivery threads whenever a requested frame arrives.
     auto pHwCamera = mHalCamera.begin()->second.promote();
     if (mStream_1_1 != nullptr && pHwCamera != nullptr) {
-        mCaptureThread = std::thread([this]() {
-            // TODO(b/145466570): With a proper camera hang handler, we may want
-            // to reduce an amount of timeout.
-            constexpr auto kFrameTimeout = 5s; // timeout in seconds.
-            int64_t lastFrameTimestamp = -1;
-            while (mStreamState == RUNNING) {
-                unsigned count = 0;
-                for (auto&& [key, hwCamera] : mHalCamera) {
-                    auto pHwCamera = hwCamera.promote();
-                    if (pHwCamera == nullptr) {
-                        LOG(WARNING) << "Invalid camera " << key << " is ignored.";
-                        continue;
-                    }
-
-                    pHwCamera->requestNewFrame(this, lastFrameTimestamp);
-                    {
-                        std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
-                        mSourceCameras.emplace(pHwCamera->getId());
-                    }
-                    ++count;
-                }
-
-                std::unique_lock<std::mutex> lock(mFrameDeliveryMutex);
-                if (!mFramesReadySignal.wait_for(lock,
-                                                 kFrameTimeout,
-                                                 [this]() REQUIRES(mFrameDeliveryMutex) {
-                                                     return mSourceCameras.empty();
-                                                 })) {
-                    PLOG(ERROR) << this << ": Camera hangs?";
-                    break;
-                } else if (mStreamState == RUNNING) {
-                    // Fetch frames and forward to the client
-                    if (mFramesHeld.size() > 0 && mStream_1_1 != nullptr) {
-                        // Pass this buffer through to our client
-                        hardware::hidl_vec<BufferDesc_1_1> frames;
-                        frames.resize(count);
-                        unsigned i = 0;
-                        for (auto&& [key, hwCamera] : mHalCamera) {
-                            auto pHwCamera = hwCamera.promote();
-                            if (pHwCamera == nullptr) {
-                                continue;
-                            }
-
-                            const auto frame = mFramesHeld[key].back();
-                            if (frame.timestamp > lastFrameTimestamp) {
-                                lastFrameTimestamp = frame.timestamp;
-                            }
-                            frames[i++] = frame;
-                        }
-
-                        auto ret = mStream_1_1->deliverFrame_1_1(frames);
-                        if (!ret.isOk()) {
-                            LOG(WARNING) << "Failed to forward frames";
-                        }
-                    }
-                }
-            }
-        });
+        auto task = mScheduler->createTask([this]() { captureFrames(); });
+        {
+            std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+            mCaptureTask = task;
+            mCaptureProgressAt = std::chrono::steady_clock::now();
+        }
+        mScheduler->schedule(task);
     }
 
     // TODO(changyeon):
@@ -416,6 +891,113 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
 }
 
 
+void VirtualCamera::captureFrames() {
+    std::shared_ptr<DeliveryScheduler::Task> task;
+    {
+        std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+        task = mCaptureTask;
+    }
+    if (task == nullptr) {
+        return;
+    }
+
+    // Request a frame from each camera that has none waiting for a match
+    for (auto&& [key, hwCamera] : mHalCamera) {
+        auto pHwCamera = hwCamera.promote();
+        if (pHwCamera == nullptr) {
+            LOG(WARNING) << "Invalid camera " << key << " is ignored.";
+            continue;
+        }
+
+        int64_t lastFrameTimestamp = -1;
+        {
+            std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+            if (!mFrameSync->isStarved(key) || mSourceCameras.count(key) > 0) {
+                continue;
+            }
+            if (mSourceCameras.empty()) {
+                mCaptureProgressAt = std::chrono::steady_clock::now();
+            }
+            mSourceCameras.emplace(key);
+            lastFrameTimestamp = mFrameSync->lastTimestamp(key);
+        }
+        pHwCamera->requestNewFrame(this, lastFrameTimestamp);
+    }
+
+    // Deliver every complete set of frames
+    while (mStreamState == RUNNING) {
+        std::vector<BufferDesc_1_1> frames;
+        std::vector<BufferDesc_1_1> dropped;
+        bool matched = false;
+        {
+            std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+            matched = mFrameSync->pop(&frames, &dropped);
+            mFramesDroppedToSync += dropped.size();
+        }
+        recordFramesDroppedToSync(dropped);
+        returnFrames(dropped);
+
+        if (!matched) {
+            break;
+        } else if (mStream_1_1 == nullptr) {
+            returnFrames(frames);
+            continue;
+        }
+
+        // Pass this set of frames through to our client
+        ATRACE_NAME("IEvsCameraStream::deliverFrame_1_1");
+        hardware::hidl_vec<BufferDesc_1_1> frameSet(frames);
+        auto ret = mStream_1_1->deliverFrame_1_1(frameSet);
+        if (!ret.isOk()) {
+            LOG(WARNING) << "Failed to forward frames";
+        }
+    }
+
+    // Check on the requested frames again once they are overdue
+    std::chrono::steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+        if (mSourceCameras.empty()) {
+            return;
+        }
+        due = mCaptureProgressAt + kFrameTimeout;
+    }
+    if (std::chrono::steady_clock::now() < due) {
+        mScheduler->scheduleAt(task, due);
+        return;
+    }
+
+    // TODO(b/145466570): With a proper camera hang handler, we may want
+    // to reduce an amount of timeout.
+    LOG(ERROR) << this << ": Camera hangs?";
+    stopCapture();
+}
+
+
+void VirtualCamera::stopCapture() {
+    std::shared_ptr<DeliveryScheduler::Task> task;
+    {
+        std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+        task = std::move(mCaptureTask);
+    }
+    if (task == nullptr) {
+        return;
+    }
+
+    // Waits for a capture in progress, unless called from the capture itself
+    mScheduler->cancel(task);
+
+    // Return the frames still waiting for a match
+    std::vector<BufferDesc_1_1> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+        mFrameSync->clear(&dropped);
+        mSourceCameras.clear();
+    }
+    returnFrames(dropped);
+}
+
+
 Return<void> VirtualCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
     if (buffer.memHandle == nullptr) {
         LOG(ERROR) << "Ignoring doneWithFrame called with invalid handle";
@@ -439,7 +1021,10 @@ Return<void> VirtualCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
                        << buffer.bufferId;
         } else {
             // Take this frame out of our "held" list
+            const BufferDesc_1_1 returned = *it;
             frameQueue.erase(it);
+            recordFrameReturn(mFramesHeld.begin()->first, buffer.bufferId);
+            traceFrameHeld(returned, /*held=*/false);
 
             // Tell our parent that we're done with this buffer
             auto pHwCamera = mHalCamera.begin()->second.promote();
@@ -453,6 +1038,7 @@ Return<void> VirtualCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
         }
     }
 
+    tuneFramesInFlight();
     return Void();
 }
 
@@ -461,6 +1047,10 @@ Return<void> VirtualCamera::stopVideoStream()  {
     if (mStreamState == RUNNING) {
         // Tell the frame delivery pipeline we don't want any more frames
         mStreamState = STOPPING;
+        stopCapture();
+
+        // Send the queued frames and events before closing out the stream
+        stopDelivery();
 
         // Deliver an empty frame to close out the frame stream
         if (mStream_1_1 != nullptr) {
@@ -484,6 +1074,7 @@ Return<void> VirtualCamera::stopVideoStream()  {
         // Note, however, that there still might be frames already queued that client will see
         // after returning from the client side of this call.
         mStreamState = STOPPED;
+        mStream->unlinkToDeath(mDeathRecipient);
 
         // Give the underlying hardware camera the heads up that it might be time to stop
         for (auto&& [key, hwCamera] : mHalCamera) {
@@ -493,11 +1084,6 @@ Return<void> VirtualCamera::stopVideoStream()  {
             }
         }
 
-        // Join a thread
-        if (mCaptureThread.joinable()) {
-            mCaptureThread.join();
-        }
-
     }
 
     return Void();
@@ -505,6 +1091,15 @@ Return<void> VirtualCamera::stopVideoStream()  {
 
 
 Return<int32_t> VirtualCamera::getExtendedInfo(uint32_t opaqueIdentifier)  {
+    if (opaqueIdentifier == kFrameDropsPerEventId) {
+        std::lock_guard<std::mutex> lock(mDropMutex);
+        return static_cast<int32_t>(mDropsPerEvent);
+    } else if (opaqueIdentifier == kAutoFramesInFlightId) {
+        return mAutoFramesInFlight ? 1 : 0;
+    } else if (opaqueIdentifier == kDeliveryPriorityId) {
+        return static_cast<int32_t>(mDeliveryPriority.load());
+    }
+
     if (mHalCamera.size() > 1) {
         LOG(WARNING) << "Logical camera device does not support " << __FUNCTION__;
         return 0;
@@ -522,6 +1117,40 @@ Return<int32_t> VirtualCamera::getExtendedInfo(uint32_t opaqueIdentifier)  {
 
 
 Return<EvsResult> VirtualCamera::setExtendedInfo(uint32_t opaqueIdentifier, int32_t opaqueValue)  {
+    if (opaqueIdentifier == kFrameDropsPerEventId) {
+        // Handled here for logical cameras too, as it configures the stream to the client
+        if (opaqueValue < 1) {
+            return EvsResult::INVALID_ARG;
+        }
+
+        std::lock_guard<std::mutex> lock(mDropMutex);
+        mDropsPerEvent = static_cast<uint32_t>(opaqueValue);
+        return EvsResult::OK;
+    } else if (opaqueIdentifier == kAutoFramesInFlightId) {
+        if (opaqueValue != 0 && opaqueValue != 1) {
+            return EvsResult::INVALID_ARG;
+        }
+
+        mAutoFramesInFlight = opaqueValue == 1;
+        mTuningWindowStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        mFramesDeliveredInWindow = 0;
+        mQuotaDropsInWindow = 0;
+        mMaxHoldTimeInWindow = 0;
+        if (!mAutoFramesInFlight && mFramesAllowed != mFramesRequested &&
+            !resizeFramesInFlight(mFramesRequested)) {
+            LOG(WARNING) << "Failed to restore " << mFramesRequested << " frames in flight";
+        }
+        return EvsResult::OK;
+    } else if (opaqueIdentifier == kDeliveryPriorityId) {
+        if (opaqueValue < static_cast<int32_t>(DeliveryPriority::LOW) ||
+            opaqueValue > static_cast<int32_t>(DeliveryPriority::HIGH)) {
+            return EvsResult::INVALID_ARG;
+        }
+
+        mDeliveryPriority = static_cast<DeliveryPriority>(opaqueValue);
+        return EvsResult::OK;
+    }
+
     if (mHalCamera.size() > 1) {
         LOG(WARNING) << "Logical camera device does not support " << __FUNCTION__;
         return EvsResult::INVALID_ARG;
@@ -596,7 +1225,13 @@ Return<void> VirtualCamera::getPhysicalCameraInfo(const hidl_string& deviceId,
 
 Return<EvsResult> VirtualCamera::doneWithFrame_1_1(
     const hardware::hidl_vec<BufferDesc_1_1>& buffers) {
+    returnHeldFrames(buffers);
+    tuneFramesInFlight();
+    return EvsResult::OK;
+}
 
+
+void VirtualCamera::returnHeldFrames(const hardware::hidl_vec<BufferDesc_1_1>& buffers) {
     for (auto&& buffer : buffers) {
         if (buffer.buffer.nativeHandle == nullptr) {
             LOG(WARNING) << "Ignoring doneWithFrame called with invalid handle";
@@ -617,6 +1252,8 @@ Return<EvsResult> VirtualCamera::doneWithFrame_1_1(
             } else {
                 // Take this frame out of our "held" list
                 mFramesHeld[buffer.deviceId].erase(it);
+                recordFrameReturn(buffer.deviceId, buffer.bufferId);
+                traceFrameHeld(buffer, /*held=*/false);
 
                 // Tell our parent that we're done with this buffer
                 auto pHwCamera = mHalCamera[buffer.deviceId].promote();
@@ -629,8 +1266,6 @@ Return<EvsResult> VirtualCamera::doneWithFrame_1_1(
             }
         }
     }
-
-    return EvsResult::OK;
 }
 
 
@@ -826,7 +1461,22 @@ Return<void> VirtualCamera::getIntParameter(CameraParam id,
 Return<EvsResult> VirtualCamera::setExtendedInfo_1_1(uint32_t opaqueIdentifier,
                                                      const hidl_vec<uint8_t>& opaqueValue) {
     hardware::hidl_vec<int32_t> values;
-    if (mHalCamera.size() > 1) {
+    if (opaqueIdentifier == HalCamera::kFrameRateHintId) {
+        // The rate this client wants, which paces it and, with the other clients, sets the
+        // rate of each of its hardware cameras
+        int32_t framesPerSecond = 0;
+        if (opaqueValue.size() != sizeof(framesPerSecond)) {
+            return EvsResult::INVALID_ARG;
+        }
+        memcpy(&framesPerSecond, opaqueValue.data(), sizeof(framesPerSecond));
+        for (auto&& [key, hwCamera] : mHalCamera) {
+            auto pHwCamera = hwCamera.promote();
+            if (pHwCamera != nullptr) {
+                pHwCamera->setClientFrameRate(this, framesPerSecond);
+            }
+        }
+        return EvsResult::OK;
+    } else if (mHalCamera.size() > 1) {
         LOG(WARNING) << "Logical camera device does not support " << __FUNCTION__;
         return EvsResult::INVALID_ARG;
     }
@@ -835,6 +1485,14 @@ Return<EvsResult> VirtualCamera::setExtendedInfo_1_1(uint32_t opaqueIdentifier,
     if (pHwCamera == nullptr) {
         LOG(WARNING) << "Camera device " << mHalCamera.begin()->first << " is not alive.";
         return EvsResult::INVALID_ARG;
+    } else if (opaqueIdentifier == HalCamera::kParameterBatchId) {
+        // Only the master client may program the parameters, and the values applied are
+        // kept for this client to read back
+        hidl_vec<uint8_t> batch = opaqueValue;
+        const EvsResult result = pHwCamera->setParameters(this, batch);
+        std::lock_guard<std::mutex> lock(mParameterBatchMutex);
+        mParameterBatch = std::move(batch);
+        return result;
     } else {
         auto hwCamera = IEvsCamera_1_1::castFrom(pHwCamera->getHwCamera()).withDefault(nullptr);
         if (hwCamera != nullptr) {
@@ -861,6 +1519,12 @@ Return<void> VirtualCamera::getExtendedInfo_1_1(uint32_t opaqueIdentifier,
     if (pHwCamera == nullptr) {
         LOG(WARNING) << "Camera device " << mHalCamera.begin()->first << " is not alive.";
         _hidl_cb(status, values);
+    } else if (opaqueIdentifier == HalCamera::kParameterBatchId) {
+        {
+            std::lock_guard<std::mutex> lock(mParameterBatchMutex);
+            values = mParameterBatch;
+        }
+        _hidl_cb(EvsResult::OK, values);
     } else {
         auto hwCamera = IEvsCamera_1_1::castFrom(pHwCamera->getHwCamera()).withDefault(nullptr);
         if (hwCamera != nullptr) {
@@ -892,13 +1556,14 @@ VirtualCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& buffers,
     }
 
     int delta = 0;
-    if (!pHwCamera->changeFramesInFlight(buffers, &delta)) {
+    if (!pHwCamera->changeFramesInFlight(buffers, &delta, this)) {
         LOG(ERROR) << "Failed to add extenral capture buffers.";
         _hidl_cb(EvsResult::UNDERLYING_SERVICE_ERROR, 0);
         return {};
     }
 
     mFramesAllowed += delta;
+    mFramesRequested += delta;
     _hidl_cb(EvsResult::OK, delta);
     return {};
 }
@@ -910,7 +1575,7 @@ std::string VirtualCamera::toString(const char* indent) const {
                            "%sFramesAllowed: %u\n"
                            "%sFrames in use:\n",
                            indent, mHalCamera.size() > 1 ? "T" : "F",
-                           indent, mFramesAllowed,
+                           indent, mFramesAllowed.load(),
                            indent);
 
     std::string next_indent(indent);
@@ -923,6 +1588,18 @@ std::string VirtualCamera::toString(const char* indent) const {
     }
     StringAppendF(&buffer, "%sCurrent stream state: %d\n",
                                  indent, mStreamState);
+    StringAppendF(&buffer, "%sDelivery priority: %d, frames preempted: %" PRIu64 ", "
+                           "frames dropped at quota: %" PRIu64 "\n",
+                           indent, static_cast<int32_t>(mDeliveryPriority.load()),
+                           mFramesPreempted.load(), mFramesDroppedAtQuota.load());
+    {
+        std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+        if (mFrameSync != nullptr) {
+            StringAppendF(&buffer, "%sFrame sync tolerance: %" PRId64 " us, "
+                                   "frames dropped to sync: %" PRIu64 "\n",
+                                   indent, mFrameSync->getTolerance(), mFramesDroppedToSync);
+        }
+    }
 
     return buffer;
 }
@@ -21,13 +21,24 @@
 #include <android/hardware/automotive/evs/1.1/IEvsCamera.h>
 #include <android/hardware/automotive/evs/1.1/IEvsCameraStream.h>
 #include <android/hardware/automotive/evs/1.1/IEvsDisplay.h>
+#include <hidl/HidlSupport.h>
 
+#include "DeliveryScheduler.h"
+#include "FrameSynchronizer.h"
+#include "SpscQueue.h"
+#include "stats/CameraUsageStats.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <memory>
 #include <set>
 #include <thread>
 #include <unordered_map>
 
 #include <utils/Mutex.h>
+#include <utils/Timers.h>
 
 
 using namespace std;
@@ -63,6 +74,28 @@ class HalCamera;        // From HalCamera.h
 // IEvsCameraStream object.
 class VirtualCamera : public IEvsCamera_1_1 {
 public:
+    // setExtendedInfo() identifier handled by the manager itself.  The value is the number of
+    // frame drops reported at most by one FRAME_DROPPED event, whose payload[0] carries the
+    // count.  Pending drops are also reported once a frame is delivered again or a second has
+    // passed since the first of them.  1, the default, reports every drop.
+    static constexpr uint32_t kFrameDropsPerEventId = 0x4D445250;
+
+    // setExtendedInfo() identifier handled by the manager itself.  1 lets the manager tune the
+    // frames in flight of this client to how long it holds its frames, between 1 and the
+    // count set by setMaxFramesInFlight(); 0, the default, keeps that count.
+    static constexpr uint32_t kAutoFramesInFlightId = 0x46494641;
+
+    // setExtendedInfo() identifier handled by the manager itself.  The value is the delivery
+    // priority of this client, one of DeliveryPriority; NORMAL by default.  When the buffers
+    // of a hardware camera run low, its frames go only to the clients of the highest priority
+    // streaming from it.  A master client is delivered at HIGH priority at least.
+    static constexpr uint32_t kDeliveryPriorityId = 0x49525044;
+    enum class DeliveryPriority : int32_t {
+        LOW = 0,
+        NORMAL = 1,
+        HIGH = 2,
+    };
+
     explicit          VirtualCamera(const std::vector<sp<HalCamera>>& halCameras);
     virtual           ~VirtualCamera();
 
@@ -77,6 +110,10 @@ public:
     bool              notify(const EvsEventDesc& event);
     bool              deliverFrame(const BufferDesc& bufDesc);
 
+    DeliveryPriority  getDeliveryPriority() const { return mDeliveryPriority; }
+    // Counts a frame withheld from this client to keep the buffers for higher priority clients
+    void              framePreempted()    { ++mFramesPreempted; }
+
     // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
     Return<void>      getCameraInfo(getCameraInfo_cb _hidl_cb)  override;
     Return<EvsResult> setMaxFramesInFlight(uint32_t bufferCount) override;
@@ -117,6 +154,86 @@ public:
 private:
     void shutdown();
 
+    // Notices the death of the client's process through its stream object
+    class StreamDeathRecipient : public hardware::hidl_death_recipient {
+    public:
+        explicit StreamDeathRecipient(const wp<VirtualCamera>& client) : mClient(client) {}
+
+        void serviceDied(uint64_t cookie, const wp<hidl::base::V1_0::IBase>& who) override;
+
+    private:
+        const wp<VirtualCamera> mClient;
+    };
+
+    // Stops the stream of a client that died at |diedAt| and returns the frames it held to the
+    // hardware cameras at once, rather than when the client camera is closed or destroyed.
+    void reclaimFrames(nsecs_t diedAt);
+
+    // Changes the frames in flight on all hardware cameras, or none of them.
+    bool resizeFramesInFlight(uint32_t bufferCount);
+
+    // Moves the frames in flight toward what the hold times of the last tuning window need,
+    // in auto mode.  Called only from the client's binder calls.
+    void tuneFramesInFlight();
+
+    // Returns frames taken out of the held list to the hardware cameras.
+    void returnHeldFrames(const hardware::hidl_vec<BufferDesc_1_1>& buffers);
+
+    // A frame or an event waiting to be sent to the client.  The binder calls to the client are
+    // made from a delivery task, so a slow client doesn't hold up the camera stream callback.
+    struct PendingDelivery {
+        enum {
+            FRAME_1_0,
+            EVENT_1_1,
+        }                           type = FRAME_1_0;
+        BufferDesc_1_0              frame = {};
+        EvsEventDesc                event = {};
+    };
+
+    void startDelivery();
+    // Stops the delivery task and sends the pending deliveries, or drops them if |discard|.
+    void stopDelivery(bool discard = false);
+    // Returns false if the delivery is stopped or too far behind.
+    bool queueDelivery(PendingDelivery&& delivery);
+    void sendDelivery(const PendingDelivery& delivery);
+    // Body of the delivery task.  Sends the queued deliveries and the coalesced events that
+    // are due.
+    void sendDeliveries();
+
+    // Body of the capture task of a v1.1 client.  Requests a frame from each camera that has
+    // none waiting for a match, and delivers the complete sets.
+    void captureFrames();
+    // Stops the capture task and returns the frames still waiting for a match.
+    void stopCapture();
+
+    // Stores |event| with the coalesced events if it may wait.  Returns false if it can't.
+    bool coalesceEvent(const EvsEventDesc& event);
+    // Sends the coalesced events if their window has closed or |force| is set.  Returns true
+    // and when they are due in |due| if they are still waiting.
+    bool sendCoalescedEvents(bool force, std::chrono::steady_clock::time_point* due);
+    // Queues the coalesced events for delivery ahead of an event that can't wait.
+    void queueCoalescedEvents();
+
+    // Counts a frame dropped for |deviceId| and notifies the client if the drops are due.
+    void reportFrameDrop(const std::string& deviceId);
+    // Notifies the client of the pending drops of |deviceId|, if any.
+    void flushFrameDrops(const std::string& deviceId);
+
+    // Returns the v1.0 descriptor of |bufDesc|, converted once per buffer.
+    const BufferDesc_1_0& getFrameDesc_1_0(const BufferDesc_1_1& bufDesc);
+
+    // Traces the life of |buffer| with the client and the count of frames it holds.
+    void traceFrameHeld(const BufferDesc_1_1& buffer, bool held);
+
+    // Records how long the client held a frame it returned.
+    void recordFrameReturn(const std::string& deviceId, uint32_t bufferId);
+
+    // Counts the frames skipped to synchronize cameras as drops of this client.
+    void recordFramesDroppedToSync(const std::vector<BufferDesc_1_1>& dropped);
+
+    // Returns frames the client never saw to the hardware cameras.
+    void returnFrames(const std::vector<BufferDesc_1_1>& frames);
+
     // The low level camera interface that backs this proxy
     unordered_map<string,
                  wp<HalCamera>> mHalCamera;
@@ -124,7 +241,27 @@ private:
     sp<IEvsCameraStream_1_0>    mStream;
     sp<IEvsCameraStream_1_1>    mStream_1_1;
 
-    unsigned                    mFramesAllowed  = 1;
+    // Linked to mStream while the stream runs
+    sp<StreamDeathRecipient>    mDeathRecipient;
+
+    // Frames the client may hold.  Read by the stream callbacks.
+    std::atomic<unsigned>       mFramesAllowed{1};
+
+    // Frames in flight in auto mode.  mFramesRequested is the count the client asked for and
+    // the ceiling of the tuning.  The window counters are updated by the stream callbacks.
+    static constexpr nsecs_t    kTuningWindowNs = 1000000000;
+    std::atomic<bool>           mAutoFramesInFlight{false};
+    unsigned                    mFramesRequested = 1;
+    nsecs_t                     mTuningWindowStart = 0;
+    std::atomic<uint32_t>       mFramesDeliveredInWindow{0};
+    std::atomic<uint32_t>       mQuotaDropsInWindow{0};
+    std::atomic<nsecs_t>        mMaxHoldTimeInWindow{0};
+
+    // Delivery priority, and the frames this client missed to preemption or at its quota
+    std::atomic<DeliveryPriority>
+                                mDeliveryPriority{DeliveryPriority::NORMAL};
+    std::atomic<uint64_t>       mFramesPreempted{0};
+    std::atomic<uint64_t>       mFramesDroppedAtQuota{0};
     enum {
         STOPPED,
         RUNNING,
@@ -133,13 +270,87 @@ private:
 
     unordered_map<string,
          deque<BufferDesc_1_1>> mFramesHeld;
-    thread                      mCaptureThread;
+
+    // Latency histograms of this client per hardware camera, and the delivery times of the
+    // frames held, indexed by deviceId and then bufferId
+    unordered_map<string,
+         std::shared_ptr<ClientFrameStats>>
+                                mFrameStats;
+    unordered_map<string,
+         unordered_map<uint32_t, nsecs_t>>
+                                mFramesDeliveredAt;
+
+    // Names of the trace slices and counters of this client per hardware camera
+    struct TraceNames {
+        std::string frame;
+        std::string heldFrames;
+    };
+    unordered_map<string, TraceNames>
+                                mTraceNames;
+
+    // v1.0 descriptors of the buffers seen by a v1.0 client, indexed by bufferId.  Used only
+    // from the stream callback and reset when the stream starts.
+    unordered_map<uint32_t,
+         BufferDesc_1_0>        mFrameDescs_1_0;
     CameraDesc*                 mDesc;
 
+    // Runs the capture and delivery tasks of this client, shared with the other clients
+    const std::shared_ptr<DeliveryScheduler>
+                                mScheduler;
+
+    // The capture task is scheduled whenever a requested frame arrives.  If none arrives
+    // within kFrameTimeout of the last progress, the camera is assumed to hang and the
+    // capture stops.
+    static constexpr std::chrono::seconds
+                                kFrameTimeout{5};
     mutable std::mutex          mFrameDeliveryMutex;
-    std::condition_variable     mFramesReadySignal;
+    std::shared_ptr<DeliveryScheduler::Task>
+                                mCaptureTask GUARDED_BY(mFrameDeliveryMutex);
+    std::chrono::steady_clock::time_point
+                                mCaptureProgressAt GUARDED_BY(mFrameDeliveryMutex);
     std::set<std::string>       mSourceCameras GUARDED_BY(mFrameDeliveryMutex);
 
+    // Frame drops not reported to the v1.1 client yet
+    struct FrameDrops {
+        uint32_t count = 0;
+        nsecs_t  firstDropTime = 0;
+    };
+    std::mutex                  mDropMutex;
+    uint32_t                    mDropsPerEvent GUARDED_BY(mDropMutex) = 1;
+    unordered_map<string, FrameDrops>
+                                mFrameDrops GUARDED_BY(mDropMutex);
+
+    // Matches the frames of the physical cameras by their timestamps for v1.1 clients
+    std::unique_ptr<FrameSynchronizer>
+                                mFrameSync GUARDED_BY(mFrameDeliveryMutex);
+    uint64_t                    mFramesDroppedToSync GUARDED_BY(mFrameDeliveryMutex) = 0;
+
+    // Deliveries to the client.  Each physical camera calls us from its own stream callback,
+    // so the producers of a logical camera are serialized by mDeliveryProducerMutex.  The
+    // delivery task is the only consumer and sends without that lock, and the scheduler
+    // never runs it on two threads at once.
+    static constexpr size_t     kMaxPendingDeliveries = 16;
+    SpscQueue<PendingDelivery, kMaxPendingDeliveries>
+                                mPendingDeliveries;
+    std::mutex                  mDeliveryProducerMutex;
+    bool                        mDeliveryRunning GUARDED_BY(mDeliveryProducerMutex) = false;
+    std::shared_ptr<DeliveryScheduler::Task>
+                                mDeliveryTask GUARDED_BY(mDeliveryProducerMutex);
+
+    // Parameter changes and master releases for a v1.1 client, coalesced within
+    // kEventCoalescingWindow of the first of them, with the last value of each parameter
+    // winning.  The delivery task sends them once the window closes.
+    static constexpr std::chrono::milliseconds
+                                kEventCoalescingWindow{20};
+    std::mutex                  mEventMutex;
+    std::vector<EvsEventDesc>   mCoalescedEvents GUARDED_BY(mEventMutex);
+    std::chrono::steady_clock::time_point
+                                mCoalescedEventsDue GUARDED_BY(mEventMutex);
+
+    // Values applied by the last parameter batch of this client
+    std::mutex                  mParameterBatchMutex;
+    hardware::hidl_vec<uint8_t> mParameterBatch GUARDED_BY(mParameterBatchMutex);
+
 };
 
 } // namespace implementation
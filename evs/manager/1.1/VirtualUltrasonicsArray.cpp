@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "VirtualUltrasonicsArray.h"
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <inttypes.h>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+using ::android::base::StringAppendF;
+using ::android::hardware::Void;
+using ::android::hardware::automotive::evs::V1_1::EvsEventType;
+
+
+VirtualUltrasonicsArray::VirtualUltrasonicsArray(const sp<HalUltrasonicsArray>& halArray) :
+        mHalArray(halArray) {}
+
+
+VirtualUltrasonicsArray::~VirtualUltrasonicsArray() {
+    shutdown();
+}
+
+
+unsigned VirtualUltrasonicsArray::getAllowedFrames() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFramesAllowed;
+}
+
+
+bool VirtualUltrasonicsArray::isStreaming() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStream != nullptr;
+}
+
+
+void VirtualUltrasonicsArray::shutdown() {
+    if (isStreaming()) {
+        LOG(WARNING) << "Virtual ultrasonics array being shutdown while stream is running";
+        stopStream();
+    }
+}
+
+
+bool VirtualUltrasonicsArray::deliverDataFrame(const UltrasonicsDataFrameDesc& dataFrame) {
+    sp<IEvsUltrasonicsArrayStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mStream == nullptr) {
+            return false;
+        } else if (mFramesHeld.size() >= mFramesAllowed) {
+            // Declines the frame as the client is at quota
+            LOG(INFO) << "Skipping a data frame as we hold " << mFramesHeld.size()
+                      << " of " << mFramesAllowed;
+            ++mFramesDropped;
+            return false;
+        }
+
+        // Keep a record of this frame so we can clean up if we have to in case of client
+        // death.  The record is made first, as the client may return it at once.
+        mFramesHeld.emplace_back(dataFrame);
+        stream = mStream;
+    }
+
+    // deliverDataFrame() is oneway, so the client doesn't hold up the other clients.
+    auto result = stream->deliverDataFrame(dataFrame);
+    if (!result.isOk()) {
+        LOG(ERROR) << "Error delivering a data frame";
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = std::find_if(mFramesHeld.begin(), mFramesHeld.end(),
+                               [&dataFrame](const auto& held) {
+                                   return held.dataFrameId == dataFrame.dataFrameId;
+                               });
+        if (it != mFramesHeld.end()) {
+            mFramesHeld.erase(it);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool VirtualUltrasonicsArray::notify(const EvsEventDesc& event) {
+    sp<IEvsUltrasonicsArrayStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        stream = mStream;
+    }
+    if (stream == nullptr) {
+        return false;
+    }
+
+    if (event.aType == EvsEventType::STREAM_STOPPED) {
+        // The hardware stream is gone; clean up and let the client know.
+        LOG(WARNING) << "Ultrasonics array stream unexpectedly stopped";
+        stopStream();
+        return true;
+    }
+
+    auto result = stream->notify(event);
+    if (!result.isOk()) {
+        LOG(ERROR) << "Failed to forward an event";
+        return false;
+    }
+
+    return true;
+}
+
+
+// Methods from ::android::hardware::automotive::evs::V1_1::IEvsUltrasonicsArray follow.
+Return<void> VirtualUltrasonicsArray::getUltrasonicArrayInfo(getUltrasonicArrayInfo_cb _hidl_cb) {
+    auto halArray = mHalArray.promote();
+    if (halArray == nullptr) {
+        _hidl_cb({});
+        return Void();
+    }
+
+    return halArray->getHwArray()->getUltrasonicArrayInfo(_hidl_cb);
+}
+
+
+Return<EvsResult> VirtualUltrasonicsArray::setMaxFramesInFlight(uint32_t bufferCount) {
+    if (bufferCount < 1) {
+        return EvsResult::INVALID_ARG;
+    }
+
+    auto halArray = mHalArray.promote();
+    if (halArray == nullptr) {
+        return EvsResult::UNDERLYING_SERVICE_ERROR;
+    }
+
+    // Ask our parent for the frames we're adding (or removing if negative)
+    const int delta = static_cast<int>(bufferCount) - static_cast<int>(getAllowedFrames());
+    if (!halArray->changeFramesInFlight(delta)) {
+        LOG(ERROR) << "Failed to change the frames in flight by " << delta;
+        return EvsResult::BUFFER_NOT_AVAILABLE;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFramesAllowed = bufferCount;
+    return EvsResult::OK;
+}
+
+
+Return<EvsResult> VirtualUltrasonicsArray::startStream(
+        const sp<IEvsUltrasonicsArrayStream>& stream) {
+    if (stream == nullptr) {
+        return EvsResult::INVALID_ARG;
+    }
+
+    auto halArray = mHalArray.promote();
+    if (halArray == nullptr) {
+        return EvsResult::UNDERLYING_SERVICE_ERROR;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mStream != nullptr) {
+            LOG(ERROR) << "Ignoring startStream call when a stream is already running.";
+            return EvsResult::STREAM_ALREADY_RUNNING;
+        }
+        mStream = stream;
+    }
+
+    // Start the underlying hardware stream, unless it is already running
+    Return<EvsResult> result = halArray->clientStreamStarting();
+    if (!result.isOk() || result != EvsResult::OK) {
+        LOG(ERROR) << "Failed to start the ultrasonics array stream";
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStream = nullptr;
+        return EvsResult::UNDERLYING_SERVICE_ERROR;
+    }
+
+    return EvsResult::OK;
+}
+
+
+Return<void> VirtualUltrasonicsArray::stopStream() {
+    sp<IEvsUltrasonicsArrayStream> stream;
+    std::deque<UltrasonicsDataFrameDesc> framesHeld;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mStream == nullptr) {
+            return Void();
+        }
+
+        stream = mStream;
+        mStream = nullptr;
+        framesHeld.swap(mFramesHeld);
+    }
+
+    // Return the frames the client was holding and stop the hardware stream if this was
+    // its last client
+    auto halArray = mHalArray.promote();
+    if (halArray != nullptr) {
+        for (auto&& dataFrame : framesHeld) {
+            halArray->doneWithDataFrame(dataFrame);
+        }
+        halArray->clientStreamEnding(this);
+    }
+
+    // The hardware stream may go on for the other clients, so the event comes from here.
+    EvsEventDesc event;
+    event.aType = EvsEventType::STREAM_STOPPED;
+    auto result = stream->notify(event);
+    if (!result.isOk()) {
+        LOG(ERROR) << "Error delivering end of stream event";
+    }
+
+    return Void();
+}
+
+
+Return<void> VirtualUltrasonicsArray::doneWithDataFrame(
+        const UltrasonicsDataFrameDesc& dataFrame) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = std::find_if(mFramesHeld.begin(), mFramesHeld.end(),
+                               [&dataFrame](const auto& held) {
+                                   return held.dataFrameId == dataFrame.dataFrameId;
+                               });
+        if (it == mFramesHeld.end()) {
+            LOG(ERROR) << "Ignoring doneWithDataFrame called with unrecognized frame ID "
+                       << dataFrame.dataFrameId;
+            return Void();
+        }
+        mFramesHeld.erase(it);
+    }
+
+    // Tell our parent that we're done with this frame
+    auto halArray = mHalArray.promote();
+    if (halArray != nullptr) {
+        halArray->doneWithDataFrame(dataFrame);
+    } else {
+        LOG(WARNING) << "Possible memory leak because the ultrasonics array is not valid.";
+    }
+
+    return Void();
+}
+
+
+std::string VirtualUltrasonicsArray::toString(const char* indent) const {
+    std::string buffer;
+    std::lock_guard<std::mutex> lock(mMutex);
+    StringAppendF(&buffer, "%sStreaming: %s, frames held: %zu of %u, "
+                           "frames dropped: %" PRIu64 "\n",
+                           indent, mStream != nullptr ? "T" : "F", mFramesHeld.size(),
+                           mFramesAllowed, mFramesDropped);
+    return buffer;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_VIRTUALULTRASONICSARRAY_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_1_VIRTUALULTRASONICSARRAY_H
+
+#include "HalUltrasonicsArray.h"
+
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Represents an ultrasonics array to a client.  It presents the IEvsUltrasonicsArray
+// interface and proxies the data frames of the shared HalUltrasonicsArray to the client's
+// IEvsUltrasonicsArrayStream.
+class VirtualUltrasonicsArray : public IEvsUltrasonicsArray {
+public:
+    explicit          VirtualUltrasonicsArray(const sp<HalUltrasonicsArray>& halArray);
+    virtual           ~VirtualUltrasonicsArray();
+
+    unsigned          getAllowedFrames() const;
+    bool              isStreaming() const;
+    sp<HalUltrasonicsArray>
+                      getHalArray()     { return mHalArray.promote(); }
+
+    // Stops the stream and returns the frames held, before the client is disowned.
+    void              shutdown();
+
+    // Proxy to receive data frames and events and forward them to the client's stream
+    bool              deliverDataFrame(const UltrasonicsDataFrameDesc& dataFrame);
+    bool              notify(const EvsEventDesc& event);
+
+    // Methods from ::android::hardware::automotive::evs::V1_1::IEvsUltrasonicsArray follow.
+    Return<void>      getUltrasonicArrayInfo(getUltrasonicArrayInfo_cb _hidl_cb) override;
+    Return<EvsResult> setMaxFramesInFlight(uint32_t bufferCount) override;
+    Return<EvsResult> startStream(const sp<IEvsUltrasonicsArrayStream>& stream) override;
+    Return<void>      stopStream() override;
+    Return<void>      doneWithDataFrame(const UltrasonicsDataFrameDesc& dataFrame) override;
+
+    // Returns a string showing the current status
+    std::string       toString(const char* indent = "") const;
+
+private:
+    const wp<HalUltrasonicsArray>   mHalArray;
+
+    mutable std::mutex              mMutex;
+    sp<IEvsUltrasonicsArrayStream>  mStream GUARDED_BY(mMutex);
+    unsigned                        mFramesAllowed GUARDED_BY(mMutex) = 1;
+    std::deque<UltrasonicsDataFrameDesc>
+                                    mFramesHeld GUARDED_BY(mMutex);
+    uint64_t                        mFramesDropped GUARDED_BY(mMutex) = 0;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_1_VIRTUALULTRASONICSARRAY_H
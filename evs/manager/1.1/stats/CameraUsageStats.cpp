@@ -82,6 +82,7 @@ void CameraUsageStats::updateFrameStatsOnReturn(
 
 
 void CameraUsageStats::framesReceived(int n) {
+    mLive.framesReceived(n);
     AutoMutex lock(mMutex);
     mStats.framesReceived += n;
 }
@@ -89,6 +90,7 @@ void CameraUsageStats::framesReceived(int n) {
 
 void CameraUsageStats::framesReceived(
         const hidl_vec<BufferDesc>& bufs) {
+    mLive.framesReceived(bufs.size());
     AutoMutex lock(mMutex);
     mStats.framesReceived += bufs.size();
 
@@ -97,6 +99,7 @@ void CameraUsageStats::framesReceived(
 
 
 void CameraUsageStats::framesReturned(int n) {
+    mLive.framesReturned(n);
     AutoMutex lock(mMutex);
     mStats.framesReturned += n;
 }
@@ -104,6 +107,7 @@ void CameraUsageStats::framesReturned(int n) {
 
 void CameraUsageStats::framesReturned(
         const hidl_vec<BufferDesc>& bufs) {
+    mLive.framesReturned(bufs.size());
     AutoMutex lock(mMutex);
     mStats.framesReturned += bufs.size();
 
@@ -112,12 +116,14 @@ void CameraUsageStats::framesReturned(
 
 
 void CameraUsageStats::framesIgnored(int n) {
+    mLive.framesDropped(n);
     AutoMutex lock(mMutex);
     mStats.framesIgnored += n;
 }
 
 
 void CameraUsageStats::framesSkippedToSync(int n) {
+    mLive.framesDropped(n);
     AutoMutex lock(mMutex);
     mStats.framesSkippedToSync += n;
 }
@@ -137,6 +143,14 @@ void CameraUsageStats::updateNumClients(size_t n) {
 }
 
 
+void CameraUsageStats::clientDied(int framesReclaimed, int64_t reclaimTimeUs) {
+    AutoMutex lock(mMutex);
+    ++mStats.clientsDied;
+    mStats.framesReclaimed += framesReclaimed;
+    mStats.peakReclaimTimeUs = std::max(mStats.peakReclaimTimeUs, reclaimTimeUs);
+}
+
+
 int64_t CameraUsageStats::getTimeCreated() const {
     AutoMutex lock(mMutex);
     return mTimeCreatedMs;
@@ -155,6 +169,15 @@ int64_t CameraUsageStats::getFramesReturned() const {
 }
 
 
+std::shared_ptr<ClientFrameStats> CameraUsageStats::registerClient(const std::string& name) {
+    auto stats = std::make_shared<ClientFrameStats>(mCameraId, name);
+
+    AutoMutex lock(mMutex);
+    mClientStats.emplace_back(stats);
+    return stats;
+}
+
+
 CameraUsageStatsRecord CameraUsageStats::snapshot() {
     AutoMutex lock(mMutex);
 
@@ -171,6 +194,25 @@ CameraUsageStatsRecord CameraUsageStats::snapshot() {
 
     mStats.framesPeakRoundtripLatency = peak;
     mStats.framesAvgRoundtripLatency = (double)sum / len;
+
+    // Drops the clients gone since the last snapshot
+    mStats.clientLatencies.clear();
+    auto it = mClientStats.begin();
+    while (it != mClientStats.end()) {
+        auto stats = it->lock();
+        if (stats == nullptr) {
+            it = mClientStats.erase(it);
+            continue;
+        }
+
+        ClientLatencyRecord latencies;
+        latencies.client = stats->name;
+        latencies.deliveryLatency = stats->deliveryLatency.snapshot();
+        latencies.holdTime = stats->holdTime.snapshot();
+        mStats.clientLatencies.emplace_back(std::move(latencies));
+        ++it;
+    }
+
     return mStats;
 }
 
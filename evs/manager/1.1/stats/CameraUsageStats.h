@@ -17,8 +17,14 @@
 #ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_CAMERAUSAGESTATS_H
 #define ANDROID_AUTOMOTIVE_EVS_V1_1_CAMERAUSAGESTATS_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
 #include <queue>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <inttypes.h>
 
@@ -29,12 +35,82 @@
 #include <utils/RefBase.h>
 #include <utils/SystemClock.h>
 
+#include "LiveCounters.h"
+
 namespace android {
 namespace automotive {
 namespace evs {
 namespace V1_1 {
 namespace implementation {
 
+// Number of buckets of a latency histogram.  Bucket i, except the last one, counts the
+// latencies shorter than 2^i ms that are not counted by the buckets before it.  The last bucket
+// counts the rest.
+constexpr size_t kNumLatencyBuckets = 12;
+static_assert(kNumLatencyBuckets == kNumLiveLatencyBuckets);
+
+using LatencyBuckets = std::array<int64_t, kNumLatencyBuckets>;
+
+
+// Latencies of the frames a client of a camera received, in histograms
+struct ClientLatencyRecord {
+    // Identifies the client
+    std::string client;
+
+    // From the hardware timestamp of a frame to its delivery to the client
+    LatencyBuckets deliveryLatency = {};
+
+    // From the delivery of a frame to its return by the client
+    LatencyBuckets holdTime = {};
+};
+
+
+// Latency histogram with fixed buckets, recorded without locking.
+class LatencyHistogram {
+public:
+    void record(int64_t latencyUs) {
+        const int64_t latencyMs = std::max<int64_t>(latencyUs, 0) / 1000;
+        size_t bucket = latencyMs == 0 ? 0 : 64 - __builtin_clzll(latencyMs);
+        bucket = std::min(bucket, kNumLatencyBuckets - 1);
+        mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        if (mMirror != nullptr) {
+            mMirror[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Also counts the latencies in |buckets|, if not null, from now on
+    void mirrorTo(std::atomic<int64_t>* buckets) { mMirror = buckets; }
+
+    LatencyBuckets snapshot() const {
+        LatencyBuckets buckets;
+        for (size_t i = 0; i < kNumLatencyBuckets; ++i) {
+            buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+        }
+        return buckets;
+    }
+
+private:
+    std::array<std::atomic<int64_t>, kNumLatencyBuckets> mBuckets = {};
+    std::atomic<int64_t>* mMirror = nullptr;
+};
+
+
+// Latencies recorded by a client of a camera, also published with its frame counts in the live
+// counters page
+struct ClientFrameStats {
+    ClientFrameStats(const std::string& cameraId, const std::string& name) :
+            name(name), live(cameraId, name) {
+        deliveryLatency.mirrorTo(live.deliveryLatency());
+        holdTime.mirrorTo(live.holdTime());
+    }
+
+    const std::string name;
+    LatencyHistogram  deliveryLatency;
+    LatencyHistogram  holdTime;
+    LiveCounterRef    live;
+};
+
+
 struct CameraUsageStatsRecord {
 public:
     // Time a snapshot is generated
@@ -67,6 +143,15 @@ public:
     // Peak number of active clients
     int32_t peakClientsCount;
 
+    // Clients that died while streaming, the frames they held and the longest time taken to
+    // return those to the hardware camera after the death was noticed
+    int32_t clientsDied;
+    int64_t framesReclaimed;
+    int64_t peakReclaimTimeUs;
+
+    // Latencies of the active clients
+    std::vector<ClientLatencyRecord> clientLatencies;
+
     // Calculates a delta between two records
     CameraUsageStatsRecord& operator-=(const CameraUsageStatsRecord& rhs) {
         // Only calculates differences in the frame statistics
@@ -75,6 +160,21 @@ public:
         framesIgnored = framesIgnored - rhs.framesIgnored;
         framesSkippedToSync = framesSkippedToSync - rhs.framesSkippedToSync;
         erroneousEventsCount = erroneousEventsCount - rhs.erroneousEventsCount;
+        clientsDied = clientsDied - rhs.clientsDied;
+        framesReclaimed = framesReclaimed - rhs.framesReclaimed;
+        for (auto&& latencies : clientLatencies) {
+            for (auto&& prev : rhs.clientLatencies) {
+                if (prev.client != latencies.client) {
+                    continue;
+                }
+
+                for (size_t i = 0; i < kNumLatencyBuckets; ++i) {
+                    latencies.deliveryLatency[i] -= prev.deliveryLatency[i];
+                    latencies.holdTime[i] -= prev.holdTime[i];
+                }
+                break;
+            }
+        }
 
         return *this;
     }
@@ -97,7 +197,10 @@ public:
                 "%sFrames First Roundtrip: %" PRId64 "\n"
                 "%sFrames Peak Roundtrip: %" PRId64 "\n"
                 "%sFrames Average Roundtrip: %f\n"
-                "%sPeak Number of Clients: %" PRId32 "\n\n",
+                "%sPeak Number of Clients: %" PRId32 "\n"
+                "%sClients Died: %" PRId32 "\n"
+                "%sFrames Reclaimed: %" PRId64 "\n"
+                "%sPeak Reclaim Time: %" PRId64 "us\n\n",
                 indent, ns2ms(timestamp),
                 indent, framesReceived,
                 indent, framesReturned,
@@ -106,10 +209,37 @@ public:
                 indent, framesFirstRoundtripLatency,
                 indent, framesPeakRoundtripLatency,
                 indent, framesAvgRoundtripLatency,
-                indent, peakClientsCount);
+                indent, peakClientsCount,
+                indent, clientsDied,
+                indent, framesReclaimed,
+                indent, peakReclaimTimeUs);
+        for (auto&& latencies : clientLatencies) {
+            android::base::StringAppendF(&buffer, "%sClient %s\n", indent,
+                                         latencies.client.c_str());
+            android::base::StringAppendF(&buffer, "%s  Delivery Latency: %s\n", indent,
+                                         toString(latencies.deliveryLatency).c_str());
+            android::base::StringAppendF(&buffer, "%s  Hold Time: %s\n", indent,
+                                         toString(latencies.holdTime).c_str());
+        }
+        if (!clientLatencies.empty()) {
+            buffer += "\n";
+        }
 
         return buffer;
     }
+
+    // Lists the counts of the buckets of a latency histogram
+    static std::string toString(const LatencyBuckets& buckets) {
+        std::string buffer;
+        for (size_t i = 0; i < kNumLatencyBuckets - 1; ++i) {
+            android::base::StringAppendF(&buffer, "<%dms: %" PRId64 ", ",
+                                         1 << i, buckets[i]);
+        }
+        android::base::StringAppendF(&buffer, ">=%dms: %" PRId64,
+                                     1 << (kNumLatencyBuckets - 2),
+                                     buckets[kNumLatencyBuckets - 1]);
+        return buffer;
+    }
 };
 
 
@@ -135,11 +265,13 @@ struct BufferRecord {
 
 class CameraUsageStats : public RefBase {
 public:
-    CameraUsageStats(int32_t id)
+    CameraUsageStats(int32_t id, const std::string& cameraId = "")
         : mMutex(Mutex()),
           mId(id),
+          mCameraId(cameraId),
           mTimeCreatedMs(android::uptimeMillis()),
-          mStats({}) {}
+          mStats({}),
+          mLive(cameraId) {}
 
 private:
     // Mutex to protect a collection record
@@ -148,6 +280,9 @@ private:
     // Unique identifier
     int32_t mId;
 
+    // Camera device the statistics are collected for
+    const std::string mCameraId;
+
     // Time this object was created
     int64_t mTimeCreatedMs;
 
@@ -157,6 +292,12 @@ private:
     // Frame buffer histories
     std::unordered_map<int, BufferRecord> mBufferHistory GUARDED_BY(mMutex);
 
+    // Latencies of the clients, which record them without taking mMutex
+    std::vector<std::weak_ptr<ClientFrameStats>> mClientStats GUARDED_BY(mMutex);
+
+    // Frame counts published in the live counters page, updated without taking mMutex
+    LiveCounterRef mLive;
+
 public:
     void framesReceived(int n = 1) EXCLUDES(mMutex);
     void framesReturned(int n = 1) EXCLUDES(mMutex);
@@ -173,6 +314,9 @@ public:
     int64_t getFramesReceived() const EXCLUDES(mMutex);
     int64_t getFramesReturned() const EXCLUDES(mMutex);
     void updateNumClients(size_t n) EXCLUDES(mMutex);
+    // Counts a client that died holding |framesReclaimed| frames, which took |reclaimTimeUs|
+    // to return
+    void clientDied(int framesReclaimed, int64_t reclaimTimeUs) EXCLUDES(mMutex);
     void updateFrameStatsOnArrival(
             const hardware::hidl_vec<::android::hardware::automotive::evs::V1_1::BufferDesc>& bufs
         ) REQUIRES(mMutex);
@@ -180,6 +324,10 @@ public:
             const hardware::hidl_vec<::android::hardware::automotive::evs::V1_1::BufferDesc>& bufs
         ) REQUIRES(mMutex);
 
+    // Returns the histograms a client records its frame latencies into.  They are reported
+    // as long as the client keeps them.
+    std::shared_ptr<ClientFrameStats> registerClient(const std::string& name) EXCLUDES(mMutex);
+
     // Returns the statistics collected so far
     CameraUsageStatsRecord snapshot() EXCLUDES(mMutex);
 
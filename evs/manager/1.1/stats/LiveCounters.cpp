@@ -0,0 +1,154 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LiveCounters.h"
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+void copyName(char* dst, const std::string& src) {
+    const size_t length = std::min(src.size(), kLiveCounterNameLength - 1);
+    memcpy(dst, src.data(), length);
+    memset(dst + length, 0, kLiveCounterNameLength - length);
+}
+
+}  // namespace
+
+
+LiveCounterRef::LiveCounterRef(const std::string& cameraId, const std::string& clientName) :
+    mSlot(LiveCounters::getInstance().acquire(cameraId, clientName)) {}
+
+
+LiveCounterRef::~LiveCounterRef() {
+    if (mSlot != nullptr) {
+        LiveCounters::getInstance().release(mSlot);
+    }
+}
+
+
+LiveCounters& LiveCounters::getInstance() {
+    // Slots may still be released while the process exits, so it is never destroyed
+    static LiveCounters* instance = new LiveCounters();
+    return *instance;
+}
+
+
+LiveCounters::LiveCounters() {
+    // Monitors keep the page of a previous instance mapped, so it is replaced rather than
+    // truncated under them
+    unlink(kLiveCountersPath);
+    android::base::unique_fd fd(open(kLiveCountersPath,
+                                     O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0640));
+    if (fd < 0) {
+        PLOG(WARNING) << "Failed to create " << kLiveCountersPath
+                      << "; live counters are not published";
+        return;
+    }
+
+    if (ftruncate(fd, sizeof(LiveCountersPage)) != 0) {
+        PLOG(WARNING) << "Failed to size " << kLiveCountersPath;
+        unlink(kLiveCountersPath);
+        return;
+    }
+
+    void* addr = mmap(nullptr, sizeof(LiveCountersPage), PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    if (addr == MAP_FAILED) {
+        PLOG(WARNING) << "Failed to map " << kLiveCountersPath;
+        unlink(kLiveCountersPath);
+        return;
+    }
+
+    // A new file reads as zeros, which leaves every slot free
+    mPage = static_cast<LiveCountersPage*>(addr);
+    mPage->version = kLiveCountersVersion;
+    mPage->numSlots = kMaxLiveCounterSlots;
+    mPage->slotSize = sizeof(LiveCounterSlot);
+    mPage->numLatencyBuckets = kNumLiveLatencyBuckets;
+
+    // The magic goes last so a monitor never sees a half written header
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(mPage->magic, kLiveCountersMagic, sizeof(mPage->magic));
+    LOG(INFO) << "Publishing live counters in " << kLiveCountersPath;
+}
+
+
+LiveCounterSlot* LiveCounters::acquire(const std::string& cameraId,
+                                       const std::string& clientName) {
+    if (mPage == nullptr) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto&& slot : mPage->slots) {
+        if (slot.type.load(std::memory_order_relaxed) != LiveCounterSlot::FREE) {
+            continue;
+        }
+
+        const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        copyName(slot.cameraId, cameraId);
+        copyName(slot.clientName, clientName);
+        slot.framesReceived.store(0, std::memory_order_relaxed);
+        slot.framesReturned.store(0, std::memory_order_relaxed);
+        slot.framesDropped.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < kNumLiveLatencyBuckets; ++i) {
+            slot.deliveryLatency[i].store(0, std::memory_order_relaxed);
+            slot.holdTime[i].store(0, std::memory_order_relaxed);
+        }
+        slot.type.store(clientName.empty() ? LiveCounterSlot::CAMERA : LiveCounterSlot::CLIENT,
+                        std::memory_order_relaxed);
+
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        return &slot;
+    }
+
+    LOG(WARNING) << "No live counter slot is left for " << cameraId << " " << clientName;
+    return nullptr;
+}
+
+
+void LiveCounters::release(LiveCounterSlot* slot) {
+    std::lock_guard<std::mutex> lock(mLock);
+    const uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->type.store(LiveCounterSlot::FREE, std::memory_order_relaxed);
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_1_LIVECOUNTERS_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_1_LIVECOUNTERS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+// The frame counters of every camera and client, published in a shared memory file so that
+// monitors can watch them without calling into the manager.  A monitor maps kLiveCountersPath
+// read-only and reads a slot like this:
+//   1. load |sequence| with acquire semantics; if it is odd, the slot is being reassigned, so
+//      retry later
+//   2. read |type|, the names and the counters
+//   3. load |sequence| again; if it changed, the slot was reassigned while it was read, so
+//      retry
+// Counters only grow while a slot keeps its owner.  The manager replaces the file when it
+// restarts, so a monitor maps it again once the path no longer refers to the file it mapped.
+constexpr char kLiveCountersPath[] = "/dev/evs/live_counters";
+constexpr char kLiveCountersMagic[8] = {'E', 'V', 'S', 'L', 'I', 'V', 'E', '\0'};
+constexpr uint32_t kLiveCountersVersion = 1;
+constexpr size_t kMaxLiveCounterSlots = 64;
+constexpr size_t kLiveCounterNameLength = 64;
+
+// Must match kNumLatencyBuckets of CameraUsageStats.h
+constexpr size_t kNumLiveLatencyBuckets = 12;
+
+static_assert(std::atomic<int64_t>::is_always_lock_free &&
+              std::atomic<uint32_t>::is_always_lock_free,
+              "Counters in shared memory must be lock free");
+
+struct LiveCounterSlot {
+    enum Type : uint32_t {
+        FREE = 0,
+        CAMERA,         // Counts the frames of a hardware camera
+        CLIENT,         // Counts the frames a client received from a hardware camera
+    };
+
+    std::atomic<uint32_t> sequence;             // Odd while the slot is being reassigned
+    std::atomic<uint32_t> type;
+    char cameraId[kLiveCounterNameLength];      // Null terminated
+    char clientName[kLiveCounterNameLength];    // Null terminated; empty for a camera
+
+    // A camera counts the frames it received from and returned to the hardware, and the ones
+    // dropped because nobody listened or to synchronize cameras.  A client counts the frames
+    // it was given, the ones it returned and the ones it missed at its quota or to synchronize.
+    std::atomic<int64_t> framesReceived;
+    std::atomic<int64_t> framesReturned;
+    std::atomic<int64_t> framesDropped;
+
+    // Histograms of a client, as described for kNumLatencyBuckets; zero for a camera
+    std::atomic<int64_t> deliveryLatency[kNumLiveLatencyBuckets];
+    std::atomic<int64_t> holdTime[kNumLiveLatencyBuckets];
+};
+
+struct LiveCountersPage {
+    char     magic[8];              // kLiveCountersMagic
+    uint32_t version;               // kLiveCountersVersion
+    uint32_t numSlots;
+    uint32_t slotSize;              // sizeof(LiveCounterSlot)
+    uint32_t numLatencyBuckets;
+    LiveCounterSlot slots[kMaxLiveCounterSlots];
+};
+
+
+// Owns a slot of the live counters page while it lives.  If the page couldn't be created or
+// every slot is taken, the counts are simply not published.
+class LiveCounterRef {
+public:
+    LiveCounterRef(const std::string& cameraId, const std::string& clientName = "");
+    ~LiveCounterRef();
+
+    LiveCounterRef(const LiveCounterRef&) = delete;
+    LiveCounterRef& operator=(const LiveCounterRef&) = delete;
+
+    void framesReceived(int64_t n = 1) { add(mSlot ? &mSlot->framesReceived : nullptr, n); }
+    void framesReturned(int64_t n = 1) { add(mSlot ? &mSlot->framesReturned : nullptr, n); }
+    void framesDropped(int64_t n = 1)  { add(mSlot ? &mSlot->framesDropped : nullptr, n); }
+
+    // Buckets to mirror a client's latency histograms into, or nullptr
+    std::atomic<int64_t>* deliveryLatency() { return mSlot ? mSlot->deliveryLatency : nullptr; }
+    std::atomic<int64_t>* holdTime() { return mSlot ? mSlot->holdTime : nullptr; }
+
+private:
+    static void add(std::atomic<int64_t>* counter, int64_t n) {
+        if (counter != nullptr) {
+            counter->fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    LiveCounterSlot* mSlot = nullptr;
+};
+
+
+// Creates the live counters page on first use and hands out its slots
+class LiveCounters {
+public:
+    static LiveCounters& getInstance();
+
+    // Returns a free slot, assigned to the given names, or nullptr
+    LiveCounterSlot* acquire(const std::string& cameraId, const std::string& clientName);
+    void release(LiveCounterSlot* slot);
+
+private:
+    LiveCounters();
+
+    std::mutex mLock;                       // Serializes the slot assignments
+    LiveCountersPage* mPage = nullptr;      // Null if the page couldn't be created
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif // ANDROID_AUTOMOTIVE_EVS_V1_1_LIVECOUNTERS_H
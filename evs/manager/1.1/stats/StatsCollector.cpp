@@ -21,6 +21,9 @@
 #include <processgroup/sched_policy.h>
 #include <pthread.h>
 
+#include <algorithm>
+#include <utility>
+
 #include <android-base/file.h>
 #include <android-base/strings.h>
 #include <android-base/stringprintf.h>
@@ -56,6 +59,12 @@ const auto kMinCollectionInterval = 1s;
 const auto kCustomCollectionMaxDuration = 30min;
 const auto kMaxDumpHistory = 10;
 
+// Appends the bytes of a value, in the native byte order
+template <typename T>
+void appendBinary(std::string* buffer, const T& value) {
+    buffer->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
 }
 
 void StatsCollector::handleMessage(const Message& message) {
@@ -147,6 +156,38 @@ Result<void> StatsCollector::handleCollectionEvent(CollectionEvent event,
 }
 
 
+CompactStatsRecord CompactStatsRecord::from(const CameraUsageStatsRecord& record) {
+    return {
+        .timestamp = record.timestamp,
+        .framesReceived = record.framesReceived,
+        .framesReturned = record.framesReturned,
+        .framesIgnored = record.framesIgnored,
+        .framesSkippedToSync = record.framesSkippedToSync,
+        .framesFirstRoundtripLatency = record.framesFirstRoundtripLatency,
+        .framesPeakRoundtripLatency = record.framesPeakRoundtripLatency,
+        .framesAvgRoundtripLatency = record.framesAvgRoundtripLatency,
+        .erroneousEventsCount = record.erroneousEventsCount,
+        .peakClientsCount = record.peakClientsCount,
+    };
+}
+
+
+CameraUsageStatsRecord CompactStatsRecord::toRecord() const {
+    CameraUsageStatsRecord record = {};
+    record.timestamp = timestamp;
+    record.framesReceived = framesReceived;
+    record.framesReturned = framesReturned;
+    record.framesIgnored = framesIgnored;
+    record.framesSkippedToSync = framesSkippedToSync;
+    record.framesFirstRoundtripLatency = framesFirstRoundtripLatency;
+    record.framesPeakRoundtripLatency = framesPeakRoundtripLatency;
+    record.framesAvgRoundtripLatency = framesAvgRoundtripLatency;
+    record.erroneousEventsCount = erroneousEventsCount;
+    record.peakClientsCount = peakClientsCount;
+    return record;
+}
+
+
 Result<void> StatsCollector::collectLocked(CollectionInfo* info) REQUIRES(mMutex) {
     for (auto&& [id, ptr] : mClientsToMonitor) {
         auto pClient = ptr.promote();
@@ -159,15 +200,17 @@ Result<void> StatsCollector::collectLocked(CollectionInfo* info) REQUIRES(mMutex
         auto snapshot = pClient->getStats();
         snapshot.timestamp = mLooper->now();
 
-        // Removes the oldest record if cache is full
-        if (info->records[id].history.size() > info->maxCacheSize) {
-            info->records[id].history.pop_front();
+        // Allocates the whole history of a camera when it is first collected
+        auto it = info->records.find(id);
+        if (it == info->records.end()) {
+            it = info->records.try_emplace(id, info->maxCacheSize).first;
         }
 
-        // Stores the latest record and the deltas
-        auto delta = snapshot - info->records[id].latest;
-        info->records[id].history.emplace_back(delta);
-        info->records[id].latest = snapshot;
+        // Stores the latest record and the deltas.  The oldest delta is overwritten once the
+        // history is full.
+        auto& record = it->second;
+        record.history.push(CompactStatsRecord::from(snapshot - record.latest));
+        record.latest = std::move(snapshot);
     }
 
     return {};
@@ -296,10 +339,11 @@ Result<void> StatsCollector::startCustomCollection(
                          << " has not pulled yet will be overwritten.";
         }
 
-        // Programs custom collection configurations
+        // Programs custom collection configurations.  The history holds every collection
+        // until the end, including the ones at the start and at the stop.
         mCustomCollectionInfo = {
                 .interval = interval,
-                .maxCacheSize = std::numeric_limits<std::size_t>::max(),
+                .maxCacheSize = static_cast<size_t>(maxDuration / interval) + 2,
                 .lastCollectionTime = mLooper->now(),
                 .records = {},
         };
@@ -315,7 +359,8 @@ Result<void> StatsCollector::startCustomCollection(
 }
 
 
-Result<std::string> StatsCollector::stopCustomCollection(std::string targetId) {
+Result<std::string> StatsCollector::stopCustomCollection(std::string targetId,
+                                                         ExportFormat format) {
     Mutex::Autolock lock(mMutex);
     if (mCurrentCollectionEvent == CollectionEvent::CUSTOM_START) {
         // Stops a running custom collection
@@ -329,52 +374,57 @@ Result<std::string> StatsCollector::stopCustomCollection(std::string targetId) {
                        << ret.error();
     }
 
-    // Prints out the all collected statistics
-    std::string buffer;
-    using std::chrono::duration_cast;
-    using std::chrono::seconds;
-    const intmax_t interval =
-        duration_cast<seconds>(mCustomCollectionInfo.interval).count();
+    // Selects the devices to report
+    std::vector<std::pair<std::string, const CollectionRecord*>> targets;
     if (EqualsIgnoreCase(targetId, kDumpAllDevices)) {
         for (auto& [id, records] : mCustomCollectionInfo.records) {
+            targets.emplace_back(id, &records);
+        }
+    } else {
+        auto it = mCustomCollectionInfo.records.find(targetId);
+        if (it == mCustomCollectionInfo.records.end()) {
+            // Keeps the collection as the users may want to execute a command
+            // again with a right device id
+            return StringPrintf("%s has not been monitored.", targetId.c_str());
+        }
+        targets.emplace_back(targetId, &it->second);
+    }
 
-            StringAppendF(&buffer, "%s\n"
-                                   "%sNumber of collections: %zu\n"
-                                   "%sCollection interval: %" PRIdMAX " secs\n",
-                                   id.c_str(),
-                                   kSingleIndent, records.history.size(),
-                                   kSingleIndent, interval);
-            auto it = records.history.rbegin();
-            while (it != records.history.rend()) {
-                buffer += it++->toString(kDoubleIndent);
+    // Prints out the all collected statistics
+    std::string buffer;
+    if (format == ExportFormat::BINARY) {
+        appendBinary(&buffer, kBinaryExportMagic);
+        appendBinary(&buffer, kBinaryExportVersion);
+        appendBinary(&buffer, static_cast<uint32_t>(sizeof(CompactStatsRecord)));
+        for (auto&& [id, records] : targets) {
+            appendBinary(&buffer, static_cast<uint32_t>(id.size()));
+            buffer += id;
+            appendBinary(&buffer, static_cast<uint32_t>(records->history.size()));
+            for (size_t i = records->history.size(); i > 0; --i) {
+                appendBinary(&buffer, records->history.newest(i - 1));
             }
         }
-
-        // Clears the collection
-        mCustomCollectionInfo = {};
     } else {
-        auto it = mCustomCollectionInfo.records.find(targetId);
-        if (it != mCustomCollectionInfo.records.end()) {
+        using std::chrono::duration_cast;
+        using std::chrono::seconds;
+        const intmax_t interval =
+            duration_cast<seconds>(mCustomCollectionInfo.interval).count();
+        for (auto&& [id, records] : targets) {
             StringAppendF(&buffer, "%s\n"
                                    "%sNumber of collections: %zu\n"
                                    "%sCollection interval: %" PRIdMAX " secs\n",
-                                   targetId.c_str(),
-                                   kSingleIndent, it->second.history.size(),
+                                   id.c_str(),
+                                   kSingleIndent, records->history.size(),
                                    kSingleIndent, interval);
-            auto recordIter = it->second.history.rbegin();
-            while (recordIter != it->second.history.rend()) {
-                buffer += recordIter++->toString(kDoubleIndent);
+            for (size_t i = 0; i < records->history.size(); ++i) {
+                buffer += records->history.newest(i).toRecord().toString(kDoubleIndent);
             }
-
-            // Clears the collection
-            mCustomCollectionInfo = {};
-        } else {
-            // Keeps the collection as the users may want to execute a command
-            // again with a right device id
-            StringAppendF(&buffer, "%s has not been monitored.", targetId.c_str());
         }
     }
 
+    // Clears the collection
+    mCustomCollectionInfo = {};
+
     return buffer;
 }
 
@@ -449,13 +499,19 @@ Result<void> StatsCollector::toString(std::unordered_map<std::string, std::strin
                                    indent, records.history.size(),
                                    indent, interval);
 
-            // Adding up to kMaxDumpHistory records
-            auto it = records.history.rbegin();
-            auto count = 0;
-            while (it != records.history.rend() && count < kMaxDumpHistory) {
-                buffer += it->toString(double_indent.c_str());
-                ++it;
-                ++count;
+            // Adding the latencies of the clients, as of the latest collection, and up to
+            // kMaxDumpHistory records
+            for (auto&& latencies : records.latest.clientLatencies) {
+                StringAppendF(&buffer, "%sClient %s\n", indent, latencies.client.c_str());
+                StringAppendF(&buffer, "%s  Delivery Latency: %s\n", indent,
+                              CameraUsageStatsRecord::toString(latencies.deliveryLatency).c_str());
+                StringAppendF(&buffer, "%s  Hold Time: %s\n", indent,
+                              CameraUsageStatsRecord::toString(latencies.holdTime).c_str());
+            }
+
+            const size_t count = std::min<size_t>(records.history.size(), kMaxDumpHistory);
+            for (size_t i = 0; i < count; ++i) {
+                buffer += records.history.newest(i).toRecord().toString(double_indent.c_str());
             }
 
             usages->insert_or_assign(id, std::move(buffer));
@@ -20,8 +20,8 @@
 #include "CameraUsageStats.h"
 #include "LooperWrapper.h"
 
-#include <deque>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -50,12 +50,70 @@ enum CollectionEvent {
 };
 
 
+// Fixed-size form of a CameraUsageStatsRecord kept in the collection history.  The per-client
+// latencies and the reclaims of dead clients are left out; only the latest collection reports
+// them.  The binary export of a
+// custom collection writes these records as they are in memory.
+struct CompactStatsRecord {
+    int64_t timestamp;
+    int64_t framesReceived;
+    int64_t framesReturned;
+    int64_t framesIgnored;
+    int64_t framesSkippedToSync;
+    int64_t framesFirstRoundtripLatency;
+    int64_t framesPeakRoundtripLatency;
+    double  framesAvgRoundtripLatency;
+    int32_t erroneousEventsCount;
+    int32_t peakClientsCount;
+
+    static CompactStatsRecord from(const CameraUsageStatsRecord& record);
+    CameraUsageStatsRecord toRecord() const;
+};
+
+static_assert(std::is_trivially_copyable<CompactStatsRecord>::value,
+              "CompactStatsRecord is exported as raw bytes");
+
+
+// Collection history allocated once, which overwrites its oldest record when full.
+class StatsRecordRing {
+public:
+    explicit StatsRecordRing(size_t capacity) : mRecords(capacity) {}
+
+    void push(const CompactStatsRecord& record) {
+        if (mRecords.empty()) {
+            return;
+        }
+
+        mRecords[(mHead + mSize) % mRecords.size()] = record;
+        if (mSize < mRecords.size()) {
+            ++mSize;
+        } else {
+            mHead = (mHead + 1) % mRecords.size();
+        }
+    }
+
+    size_t size() const { return mSize; }
+
+    // Returns the i-th record, counting from the newest one
+    const CompactStatsRecord& newest(size_t i) const {
+        return mRecords[(mHead + mSize - 1 - i) % mRecords.size()];
+    }
+
+private:
+    std::vector<CompactStatsRecord> mRecords;
+    size_t mHead = 0;
+    size_t mSize = 0;
+};
+
+
 struct CollectionRecord {
+    explicit CollectionRecord(size_t capacity) : history(capacity) {}
+
     // Latest statistics collection
     CameraUsageStatsRecord latest = {};
 
-    // History of collected statistics records
-    std::deque<CameraUsageStatsRecord> history;
+    // History of the deltas between the collections
+    StatsRecordRing history;
 };
 
 
@@ -76,6 +134,19 @@ struct CollectionInfo {
 
 class StatsCollector : public MessageHandler {
 public:
+    // Formats of the records of a custom collection
+    enum class ExportFormat {
+        // Human-readable report
+        TEXT,
+        // For each device: the length of its id as uint32_t, the id, the number of records as
+        // uint32_t and then the CompactStatsRecords from the oldest one.  Preceded by
+        // kBinaryExportMagic, kBinaryExportVersion and sizeof(CompactStatsRecord) as uint32_t.
+        BINARY,
+    };
+
+    static constexpr uint32_t kBinaryExportMagic = 0x53535645;  // "EVSS"
+    static constexpr uint32_t kBinaryExportVersion = 1;
+
     explicit StatsCollector() :
         mLooper(new LooperWrapper()),
         mCurrentCollectionEvent(CollectionEvent::INIT),
@@ -100,7 +171,8 @@ public:
     // a given unique id.  If this is "all",all results
     // will be returned.
     android::base::Result<std::string> stopCustomCollection(
-            std::string id = "") EXCLUDES(mMutex);
+            std::string id = "",
+            ExportFormat format = ExportFormat::TEXT) EXCLUDES(mMutex);
 
     // Registers HalCamera object to monitor
     android::base::Result<void> registerClientToMonitor(
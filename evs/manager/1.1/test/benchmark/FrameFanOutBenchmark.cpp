@@ -0,0 +1,318 @@
+// Copyright 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the frame fan-out of HalCamera and VirtualCamera.  A mock hardware camera streams
+// frames at a given resolution and rate to a number of v1.1 clients, which hold every frame
+// for a given time before returning it.  Run on a device with:
+//   atest evs_manager_fanout_benchmark
+// or, for machine-readable results to compare between builds:
+//   evs_manager_fanout_benchmark --benchmark_format=json --benchmark_out=<file>
+//
+// Counters:
+//   frames_per_sec         frames delivered to all the clients per second
+//   deliver_p50/p99_us     time the manager spends in deliverFrame_1_1 per frame
+//   return_p50/p99_us      time a client's doneWithFrame_1_1 call takes, which grows with the
+//                          lock contention between the clients and the stream
+//   drop_rate              share of the frames a client didn't get, reported by FRAME_DROPPED
+//                          events or missing
+//   camera_starved         frames the camera couldn't capture as all its buffers were in use
+
+#include <android/hardware_buffer.h>
+#include <benchmark/benchmark.h>
+#include <cutils/native_handle.h>
+#include <utils/Timers.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "HalCamera.h"
+#include "VirtualCamera.h"
+#include "../fuzzer/MockHWCamera.h"
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+using ::android::hardware::automotive::evs::V1_1::EvsEventDesc;
+using ::android::hardware::automotive::evs::V1_1::EvsEventType;
+using ::android::hardware::automotive::evs::V1_1::IEvsCameraStream;
+
+// Length of the stream in each iteration
+constexpr std::chrono::seconds kStreamDuration = std::chrono::seconds(1);
+
+// Buffers of the mock camera
+constexpr uint32_t kNumBuffers = 16;
+
+// Latency samples of a call, in nanoseconds
+class Latencies {
+public:
+    void add(nsecs_t latency) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSamples.push_back(latency);
+    }
+
+    double percentileUs(int percentile) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mSamples.empty()) {
+            return 0;
+        }
+
+        const size_t index = (mSamples.size() - 1) * percentile / 100;
+        std::nth_element(mSamples.begin(), mSamples.begin() + index, mSamples.end());
+        return static_cast<double>(mSamples[index]) / 1000;
+    }
+
+private:
+    std::mutex mMutex;
+    std::vector<nsecs_t> mSamples;
+};
+
+// Mock hardware camera that keeps track of the buffers the manager returns
+class FanOutHWCamera : public MockHWCamera {
+public:
+    FanOutHWCamera() {
+        for (uint32_t id = 0; id < kNumBuffers; ++id) {
+            mFreeBuffers.push_back(id);
+            mHandles.push_back(native_handle_create(/*numFds=*/0, /*numInts=*/0));
+        }
+    }
+
+    ~FanOutHWCamera() {
+        for (auto&& handle : mHandles) {
+            native_handle_delete(handle);
+        }
+    }
+
+    // Fills a frame in a free buffer.  Returns false if all the buffers are in use.
+    bool capture(uint32_t width, uint32_t height, BufferDesc_1_1* frame) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mFreeBuffers.empty()) {
+            return false;
+        }
+
+        frame->bufferId = mFreeBuffers.front();
+        mFreeBuffers.pop_front();
+        frame->buffer.nativeHandle = mHandles[frame->bufferId];
+        AHardwareBuffer_Desc* desc =
+                reinterpret_cast<AHardwareBuffer_Desc*>(&frame->buffer.description);
+        desc->width = width;
+        desc->height = height;
+        desc->layers = 1;
+        desc->stride = width;
+        frame->timestamp = ns2us(systemTime(SYSTEM_TIME_MONOTONIC));
+        return true;
+    }
+
+    Return<EvsResult> doneWithFrame_1_1(const hardware::hidl_vec<BufferDesc_1_1>& buffers)
+            override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto&& buffer : buffers) {
+            mFreeBuffers.push_back(buffer.bufferId);
+        }
+        return EvsResult::OK;
+    }
+
+private:
+    std::mutex mMutex;
+    std::deque<uint32_t> mFreeBuffers;
+    std::vector<native_handle_t*> mHandles;
+};
+
+// v1.1 client that returns every frame after holding it
+class FanOutClient : public IEvsCameraStream {
+public:
+    FanOutClient(const sp<VirtualCamera>& camera, std::chrono::milliseconds holdTime,
+                 Latencies* returnLatencies) :
+          mCamera(camera), mHoldTime(holdTime), mReturnLatencies(returnLatencies) {
+        mThread = std::thread([this]() { returnFrames(); });
+    }
+
+    // Stops returning frames and returns the frames still held
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mExit = true;
+        }
+        mSignal.notify_one();
+        mThread.join();
+
+        for (auto&& [frame, dueTime] : mHeldFrames) {
+            mCamera->doneWithFrame_1_1({frame});
+        }
+        mHeldFrames.clear();
+        mCamera = nullptr;
+    }
+
+    int64_t framesReceived() const { return mFramesReceived.load(); }
+    int64_t framesDropped() const { return mFramesDropped.load(); }
+
+    Return<void> deliverFrame(const BufferDesc_1_0&) override { return {}; }
+
+    Return<void> deliverFrame_1_1(const hardware::hidl_vec<BufferDesc_1_1>& buffers) override {
+        const auto dueTime = std::chrono::steady_clock::now() + mHoldTime;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (auto&& buffer : buffers) {
+                mHeldFrames.emplace_back(buffer, dueTime);
+            }
+        }
+        mFramesReceived += buffers.size();
+        mSignal.notify_one();
+        return {};
+    }
+
+    Return<void> notify(const EvsEventDesc& event) override {
+        if (event.aType == EvsEventType::FRAME_DROPPED) {
+            mFramesDropped += std::max<uint32_t>(event.payload[0], 1);
+        }
+        return {};
+    }
+
+private:
+    void returnFrames() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mExit) {
+            if (mHeldFrames.empty()) {
+                mSignal.wait(lock);
+                continue;
+            }
+
+            const auto [frame, dueTime] = mHeldFrames.front();
+            if (mSignal.wait_until(lock, dueTime) == std::cv_status::no_timeout) {
+                continue;
+            }
+
+            mHeldFrames.pop_front();
+            lock.unlock();
+            const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            mCamera->doneWithFrame_1_1({frame});
+            mReturnLatencies->add(systemTime(SYSTEM_TIME_MONOTONIC) - start);
+            lock.lock();
+        }
+    }
+
+    sp<VirtualCamera> mCamera;
+    const std::chrono::milliseconds mHoldTime;
+    Latencies* mReturnLatencies;
+    std::atomic<int64_t> mFramesReceived = 0;
+    std::atomic<int64_t> mFramesDropped = 0;
+
+    std::mutex mMutex;
+    std::condition_variable mSignal;
+    std::deque<std::pair<BufferDesc_1_1, std::chrono::steady_clock::time_point>> mHeldFrames;
+    bool mExit = false;
+    std::thread mThread;
+};
+
+// Arguments: number of clients, hold time in ms, frame rate, width, height
+void BM_FrameFanOut(benchmark::State& state) {
+    const size_t numClients = static_cast<size_t>(state.range(0));
+    const auto holdTime = std::chrono::milliseconds(state.range(1));
+    const auto frameInterval = std::chrono::microseconds(1000000 / state.range(2));
+    const uint32_t width = static_cast<uint32_t>(state.range(3));
+    const uint32_t height = static_cast<uint32_t>(state.range(4));
+
+    sp<FanOutHWCamera> hwCamera = new FanOutHWCamera();
+    sp<HalCamera> halCamera = new HalCamera(hwCamera, "fanout");
+    Latencies deliverLatencies;
+    Latencies returnLatencies;
+    std::vector<sp<VirtualCamera>> cameras;
+    std::vector<sp<FanOutClient>> clients;
+
+    // Each client may hold all the frames it receives during its hold time
+    const uint32_t framesAllowed =
+            static_cast<uint32_t>(holdTime / frameInterval) + 1;
+    for (size_t i = 0; i < numClients; ++i) {
+        sp<VirtualCamera> camera = halCamera->makeVirtualCamera();
+        camera->setMaxFramesInFlight(framesAllowed);
+        sp<FanOutClient> client = new FanOutClient(camera, holdTime, &returnLatencies);
+        camera->startVideoStream(client);
+        cameras.emplace_back(camera);
+        clients.emplace_back(client);
+    }
+
+    int64_t framesCaptured = 0;
+    int64_t cameraStarved = 0;
+    for (auto _ : state) {
+        const auto end = std::chrono::steady_clock::now() + kStreamDuration;
+        auto nextFrame = std::chrono::steady_clock::now();
+        while (nextFrame < end) {
+            std::this_thread::sleep_until(nextFrame);
+            nextFrame += frameInterval;
+
+            BufferDesc_1_1 frame = {};
+            frame.deviceId = "fanout";
+            if (!hwCamera->capture(width, height, &frame)) {
+                ++cameraStarved;
+                continue;
+            }
+
+            ++framesCaptured;
+            const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            halCamera->deliverFrame_1_1({frame});
+            deliverLatencies.add(systemTime(SYSTEM_TIME_MONOTONIC) - start);
+        }
+    }
+
+    int64_t framesReceived = 0;
+    int64_t framesDropped = 0;
+    for (size_t i = 0; i < numClients; ++i) {
+        cameras[i]->stopVideoStream();
+        clients[i]->stop();
+        framesReceived += clients[i]->framesReceived();
+        framesDropped += clients[i]->framesDropped();
+        halCamera->disownVirtualCamera(cameras[i]);
+    }
+
+    const int64_t framesExpected = framesCaptured * static_cast<int64_t>(numClients);
+    state.counters["frames_per_sec"] =
+            benchmark::Counter(static_cast<double>(framesReceived), benchmark::Counter::kIsRate);
+    state.counters["deliver_p50_us"] = deliverLatencies.percentileUs(50);
+    state.counters["deliver_p99_us"] = deliverLatencies.percentileUs(99);
+    state.counters["return_p50_us"] = returnLatencies.percentileUs(50);
+    state.counters["return_p99_us"] = returnLatencies.percentileUs(99);
+    state.counters["drop_rate"] = framesExpected > 0 ?
+            static_cast<double>(std::max(framesExpected - framesReceived, framesDropped)) /
+                    framesExpected : 0;
+    state.counters["camera_starved"] = static_cast<double>(cameraStarved);
+}
+BENCHMARK(BM_FrameFanOut)
+        ->Args({1, 10, 30, 1280, 720})
+        ->Args({4, 10, 30, 1280, 720})
+        ->Args({4, 50, 30, 1280, 720})
+        ->Args({8, 10, 60, 1920, 1080})
+        ->Args({8, 100, 60, 1920, 1080})
+        ->Iterations(3)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConfigManager.h"
+
+#include <android-base/logging.h>
+
+// Compiles an EVS configuration file into the configuration cache the sample driver maps while
+// it starts.  Run at build time by the evs_configuration_bin genrule.
+int main(int argc, char** argv) {
+    android::base::InitLogging(argv, android::base::StderrLogger);
+
+    if (argc != 3) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <configuration xml> <output cache>";
+        return 1;
+    }
+
+    return ConfigManager::compileCache(argv[1], argv[2]) ? 0 : 1;
+}
@@ -17,7 +17,14 @@
 #include <sstream>
 #include <fstream>
 #include <thread>
+#include <algorithm>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/unique_fd.h>
 #include <hardware/gralloc.h>
 #include <utils/SystemClock.h>
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
@@ -30,9 +37,14 @@ const char* ConfigManager::CONFIG_DEFAULT_PATH =
         "/vendor/etc/automotive/evs/evs_configuration.xml";
 const char* ConfigManager::CONFIG_OVERRIDE_PATH =
         "/vendor/etc/automotive/evs/evs_configuration_override.xml";
+const char* ConfigManager::CONFIG_CACHE_PATH =
+        "/vendor/etc/automotive/evs/evs_configuration.bin";
 
 ConfigManager::~ConfigManager() {
-    /* Nothing to do */
+    /* camera information is destroyed after this, but never touches the cache */
+    if (mCacheData != nullptr) {
+        munmap(mCacheData, mCacheSize);
+    }
 }
 
 
@@ -148,6 +160,20 @@ ConfigManager::readCameraDeviceInfo(CameraInfo *aCamera,
                            aCamera,
                            totalDataSize);
 
+    /* read how to convert the frames */
+    const XMLElement *convElem = aDeviceElem->FirstChildElement("conversion");
+    if (convElem != nullptr) {
+        const XMLAttribute *threadsAttr = convElem->FindAttribute("threads");
+        if (threadsAttr != nullptr) {
+            aCamera->conversionThreads = max(stoi(threadsAttr->Value()), 1);
+        }
+
+        const XMLAttribute *backendAttr = convElem->FindAttribute("backend");
+        if (backendAttr != nullptr) {
+            aCamera->gpuConversion = !strcmp(backendAttr->Value(), "gpu");
+        }
+    }
+
     /* construct camera_metadata_t */
     if (!constructCameraMetadata(aCamera, totalEntries, totalDataSize)) {
         LOG(WARNING) << "Either failed to allocate memory or "
@@ -492,20 +518,20 @@ void ConfigManager::readDisplayInfo(const XMLElement * const aDisplayElem) {
 }
 
 
-bool ConfigManager::readConfigDataFromXML() noexcept {
+bool ConfigManager::readConfigDataFromXML(const char *filePath) noexcept {
     XMLDocument xmlDoc;
 
     const int64_t parsingStart = android::elapsedRealtimeNano();
 
     /* load and parse a configuration file */
-    xmlDoc.LoadFile(CONFIG_OVERRIDE_PATH);
-    if (xmlDoc.ErrorID() != XML_SUCCESS) {
+    xmlDoc.LoadFile(filePath != nullptr ? filePath : CONFIG_OVERRIDE_PATH);
+    if (xmlDoc.ErrorID() != XML_SUCCESS && filePath == nullptr) {
         xmlDoc.LoadFile(CONFIG_DEFAULT_PATH);
-        if (xmlDoc.ErrorID() != XML_SUCCESS) {
-            LOG(ERROR) << "Failed to load and/or parse a configuration file, "
-                       << xmlDoc.ErrorStr();
-            return false;
-        }
+    }
+    if (xmlDoc.ErrorID() != XML_SUCCESS) {
+        LOG(ERROR) << "Failed to load and/or parse a configuration file, "
+                   << xmlDoc.ErrorStr();
+        return false;
     }
 
     /* retrieve the root element */
@@ -546,267 +572,323 @@ bool ConfigManager::readConfigDataFromXML() noexcept {
 }
 
 
-bool ConfigManager::readConfigDataFromBinary() {
-    /* Temporary buffer to hold configuration data read from a binary file */
-    char mBuffer[1024];
+namespace {
 
-    fstream srcFile;
-    const int64_t readStart = android::elapsedRealtimeNano();
+/*
+ * Layout of the configuration cache.  All fields are stored in the native
+ * byte order of the target and every offset is from the start of the cache.
+ * Bump kCacheVersion whenever the layout changes.
+ */
+constexpr char     kCacheMagic[8] = { 'E', 'V', 'S', 'C', 'F', 'G', '\0', '\0' };
+constexpr uint32_t kCacheVersion = 1;
+
+/* camera_metadata_t needs this alignment to be used in place */
+constexpr size_t kCacheMetadataAlignment = 8;
+
+/* A string in the cache; it is not null-terminated */
+struct CacheString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t size;              /* of the whole cache in bytes */
+    uint32_t checksum;          /* CRC-32 of everything after the header */
+    int32_t  numCameras;        /* SystemInfo::numCameras */
+    uint32_t cameraOffset;      /* CacheCamera[numCameraRecords] */
+    uint32_t numCameraRecords;
+    uint32_t displayOffset;     /* CacheDisplay[numDisplayRecords] */
+    uint32_t numDisplayRecords;
+};
+
+struct CacheCamera {
+    CacheString id;
+    CacheString position;       /* empty for a camera group */
+    CacheString members;        /* comma-separated members of a camera group */
+    uint32_t    isGroup;
+    int32_t     synchronized;
+    int32_t     conversionThreads;
+    uint32_t    gpuConversion;
+    uint32_t    controlOffset;  /* CacheControl[numControls] */
+    uint32_t    numControls;
+    uint32_t    streamOffset;   /* RawStreamConfiguration[numStreams] */
+    uint32_t    numStreams;
+    uint32_t    metadataOffset; /* camera_metadata_t */
+    uint32_t    metadataSize;
+};
+
+struct CacheControl {
+    int32_t id;
+    int32_t min;
+    int32_t max;
+    int32_t step;
+};
+
+struct CacheDisplay {
+    CacheString id;
+    uint32_t    streamOffset;   /* RawStreamConfiguration[numStreams] */
+    uint32_t    numStreams;
+};
+
+uint32_t computeCacheChecksum(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
 
-    srcFile.open(mBinaryFilePath, fstream::in | fstream::binary);
-    if (!srcFile) {
-        LOG(ERROR) << "Failed to open a source binary file, " << mBinaryFilePath;
+/*
+ * Return a pointer to |count| elements of T at |offset| of the cache, or a
+ * null pointer if they don't fit in the cache or are misaligned.
+ */
+template <typename T>
+const T *getCacheArray(const uint8_t *cache, size_t cacheSize,
+                       uint32_t offset, uint32_t count) {
+    if (offset > cacheSize ||
+        count > (cacheSize - offset) / sizeof(T) ||
+        offset % alignof(T) != 0) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<const T *>(cache + offset);
+}
+
+bool getCacheString(const uint8_t *cache, size_t cacheSize,
+                    const CacheString &str, string &out) {
+    const char *chars = getCacheArray<char>(cache, cacheSize, str.offset, str.length);
+    if (chars == nullptr) {
         return false;
     }
 
-    unique_lock<mutex> lock(mConfigLock);
-    mIsReady = false;
-
-    /* read configuration data into the internal buffer */
-    srcFile.read(mBuffer, sizeof(mBuffer));
-    LOG(VERBOSE) << __FUNCTION__ << ": " << srcFile.gcount() << " bytes are read.";
-    char *p = mBuffer;
-    size_t sz = 0;
-
-    /* read number of camera group information entries */
-    size_t ngrps = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-
-    /* read each camera information entry */
-    for (auto cidx = 0; cidx < ngrps; ++cidx) {
-        /* read camera identifier */
-        string cameraId = *(reinterpret_cast<string *>(p)); p += sizeof(string);
-
-        /* size of camera_metadata_t */
-        size_t num_entry = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        size_t num_data  = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-
-        /* create CameraInfo and add it to hash map */
-        unique_ptr<ConfigManager::CameraGroupInfo> aCamera;
-        if (aCamera == nullptr ||
-            !aCamera->allocate(num_entry, num_data))  {
-            LOG(ERROR) << "Failed to create new CameraInfo object";
-            mCameraInfo.clear();
-            return false;
-        }
+    out.assign(chars, str.length);
+    return true;
+}
 
-        /* controls */
-        typedef struct {
-            CameraParam cid;
-            int32_t min;
-            int32_t max;
-            int32_t step;
-        } CameraCtrl;
-        sz = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        CameraCtrl *ptr = reinterpret_cast<CameraCtrl *>(p);
-        for (auto idx = 0; idx < sz; ++idx) {
-            CameraCtrl temp = *ptr++;
-            aCamera->controls.emplace(temp.cid,
-                                      make_tuple(temp.min, temp.max, temp.step));
+/* Builds a configuration cache in memory */
+class CacheWriter {
+public:
+    /* Reserve |size| bytes aligned to |alignment| and return their offset */
+    uint32_t reserve(size_t size, size_t alignment = 4) {
+        const size_t offset = (mData.size() + alignment - 1) / alignment * alignment;
+        mData.resize(offset + size, 0);
+        return static_cast<uint32_t>(offset);
+    }
+
+    uint32_t append(const void *data, size_t size, size_t alignment = 4) {
+        const uint32_t offset = reserve(size, alignment);
+        if (size > 0) {
+            memcpy(mData.data() + offset, data, size);
         }
-        p = reinterpret_cast<char *>(ptr);
+        return offset;
+    }
 
-        /* stream configurations */
-        sz = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        int32_t *i32_ptr = reinterpret_cast<int32_t *>(p);
-        for (auto idx = 0; idx < sz; ++idx) {
-            const int32_t id = *i32_ptr++;
+    CacheString appendString(const string &str) {
+        return { append(str.data(), str.size(), 1), static_cast<uint32_t>(str.size()) };
+    }
 
-            std::array<int32_t, kStreamCfgSz> temp;
-            for (auto i = 0; i < kStreamCfgSz; ++i) {
-                temp[i] = *i32_ptr++;
-            }
-            aCamera->streamConfigurations.insert_or_assign(id, temp);
-        }
-        p = reinterpret_cast<char *>(i32_ptr);
-
-        /* synchronization */
-        aCamera->synchronized =
-            *(reinterpret_cast<int32_t *>(p)); p += sizeof(int32_t);
-
-        for (auto idx = 0; idx < num_entry; ++idx) {
-            /* Read camera metadata entries */
-            camera_metadata_tag_t tag =
-                *reinterpret_cast<camera_metadata_tag_t *>(p);
-            p += sizeof(camera_metadata_tag_t);
-            size_t count = *reinterpret_cast<size_t *>(p); p += sizeof(size_t);
-
-            int32_t type = get_camera_metadata_tag_type(tag);
-            switch (type) {
-                case TYPE_BYTE: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(uint8_t);
-                    break;
-                }
-                case TYPE_INT32: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(int32_t);
-                    break;
-                }
-                case TYPE_FLOAT: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(float);
-                    break;
-                }
-                case TYPE_INT64: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(int64_t);
-                    break;
-                }
-                case TYPE_DOUBLE: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(double);
-                    break;
-                }
-                case TYPE_RATIONAL:
-                    p += count * sizeof(camera_metadata_rational_t);
-                    break;
-                default:
-                    LOG(WARNING) << "Type " << type << " is unknown; "
-                                 << "data may be corrupted.";
-                    break;
-            }
+    uint32_t appendStreams(const unordered_map<int32_t, RawStreamConfiguration> &streams) {
+        const uint32_t offset = reserve(streams.size() * sizeof(RawStreamConfiguration));
+        auto ptr = reinterpret_cast<RawStreamConfiguration *>(mData.data() + offset);
+        for (auto&& [id, cfg] : streams) {
+            *ptr++ = cfg;
         }
+        return offset;
+    }
+
+    template <typename T>
+    T *at(uint32_t offset) {
+        return reinterpret_cast<T *>(mData.data() + offset);
+    }
 
-        mCameraInfo.insert_or_assign(cameraId, std::move(aCamera));
+    vector<uint8_t> &data() {
+        return mData;
     }
 
+private:
+    vector<uint8_t> mData;
+};
 
+} // namespace
 
-    /* read number of camera information entries */
-    size_t ncams = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
 
-    /* read each camera information entry */
-    for (auto cidx = 0; cidx < ncams; ++cidx) {
-        /* read camera identifier */
-        string cameraId = *(reinterpret_cast<string *>(p)); p += sizeof(string);
+bool ConfigManager::readConfigDataFromCache(const char *filePath) {
+    const int64_t readStart = android::elapsedRealtimeNano();
 
-        /* size of camera_metadata_t */
-        size_t num_entry = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        size_t num_data  = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
+    android::base::unique_fd fd(open(filePath, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        PLOG(DEBUG) << "Failed to open a configuration cache, " << filePath;
+        return false;
+    }
 
-        /* create CameraInfo and add it to hash map */
-        unique_ptr<ConfigManager::CameraInfo> aCamera;
-        if (aCamera == nullptr ||
-            !aCamera->allocate(num_entry, num_data))  {
-            LOG(ERROR) << "Failed to create new CameraInfo object";
-            mCameraInfo.clear();
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(CacheHeader))) {
+        LOG(ERROR) << "A configuration cache is too small";
+        return false;
+    }
+
+    const size_t cacheSize = st.st_size;
+    void *cacheData = mmap(nullptr, cacheSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (cacheData == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to map a configuration cache";
+        return false;
+    }
+
+    const uint8_t *cache = static_cast<const uint8_t *>(cacheData);
+    auto fail = [cacheData, cacheSize](const char *reason) {
+        LOG(ERROR) << "Ignoring a configuration cache: " << reason;
+        munmap(cacheData, cacheSize);
+        return false;
+    };
+
+    const CacheHeader *header = reinterpret_cast<const CacheHeader *>(cache);
+    if (memcmp(header->magic, kCacheMagic, sizeof(kCacheMagic))) {
+        return fail("not a configuration cache");
+    }
+    if (header->version != kCacheVersion) {
+        return fail("unsupported version");
+    }
+    if (header->size != cacheSize) {
+        return fail("truncated");
+    }
+    if (header->checksum != computeCacheChecksum(cache + sizeof(CacheHeader),
+                                                 cacheSize - sizeof(CacheHeader))) {
+        return fail("checksum mismatch");
+    }
+
+    const CacheCamera *cameras =
+        getCacheArray<CacheCamera>(cache, cacheSize,
+                                   header->cameraOffset, header->numCameraRecords);
+    const CacheDisplay *displays =
+        getCacheArray<CacheDisplay>(cache, cacheSize,
+                                    header->displayOffset, header->numDisplayRecords);
+    if (cameras == nullptr || displays == nullptr) {
+        return fail("corrupted record table");
+    }
+
+    unordered_map<string, unique_ptr<CameraInfo>> cameraInfo;
+    unordered_map<string, unique_ptr<CameraGroupInfo>> cameraGroups;
+    unordered_map<string, unordered_set<string>> cameraPosition;
+    unordered_map<string, unique_ptr<DisplayInfo>> displayInfo;
+
+    /* fill in what cameras and camera groups have in common */
+    auto readCamera = [cache, cacheSize](const CacheCamera &rec, CameraInfo *aCamera) {
+        const CacheControl *controls =
+            getCacheArray<CacheControl>(cache, cacheSize, rec.controlOffset, rec.numControls);
+        const RawStreamConfiguration *streams =
+            getCacheArray<RawStreamConfiguration>(cache, cacheSize,
+                                                  rec.streamOffset, rec.numStreams);
+        const uint8_t *metadata =
+            getCacheArray<uint8_t>(cache, cacheSize, rec.metadataOffset, rec.metadataSize);
+        if (controls == nullptr || streams == nullptr || metadata == nullptr ||
+            rec.metadataOffset % kCacheMetadataAlignment != 0) {
             return false;
         }
 
-        /* controls */
-        typedef struct {
-            CameraParam cid;
-            int32_t min;
-            int32_t max;
-            int32_t step;
-        } CameraCtrl;
-        sz = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        CameraCtrl *ptr = reinterpret_cast<CameraCtrl *>(p);
-        for (auto idx = 0; idx < sz; ++idx) {
-            CameraCtrl temp = *ptr++;
-            aCamera->controls.emplace(temp.cid,
-                                      make_tuple(temp.min, temp.max, temp.step));
+        for (uint32_t i = 0; i < rec.numControls; ++i) {
+            aCamera->controls.emplace(static_cast<CameraParam>(controls[i].id),
+                                      make_tuple(controls[i].min,
+                                                 controls[i].max,
+                                                 controls[i].step));
+        }
+        for (uint32_t i = 0; i < rec.numStreams; ++i) {
+            aCamera->streamConfigurations.insert_or_assign(streams[i][0], streams[i]);
         }
-        p = reinterpret_cast<char *>(ptr);
-
-        /* stream configurations */
-        sz = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        int32_t *i32_ptr = reinterpret_cast<int32_t *>(p);
-        for (auto idx = 0; idx < sz; ++idx) {
-            const int32_t id = *i32_ptr++;
 
-            std::array<int32_t, kStreamCfgSz> temp;
-            for (auto i = 0; i < kStreamCfgSz; ++i) {
-                temp[i] = *i32_ptr++;
+        /* camera metadata is used right where it is mapped */
+        if (rec.metadataSize > 0) {
+            camera_metadata_t *characteristics =
+                reinterpret_cast<camera_metadata_t *>(const_cast<uint8_t *>(metadata));
+            size_t expectedSize = rec.metadataSize;
+            if (validate_camera_metadata_structure(characteristics, &expectedSize)) {
+                return false;
             }
-            aCamera->streamConfigurations.insert_or_assign(id, temp);
+            aCamera->characteristics = characteristics;
+            aCamera->mappedCharacteristics = true;
         }
-        p = reinterpret_cast<char *>(i32_ptr);
-
-        for (auto idx = 0; idx < num_entry; ++idx) {
-            /* Read camera metadata entries */
-            camera_metadata_tag_t tag =
-                *reinterpret_cast<camera_metadata_tag_t *>(p);
-            p += sizeof(camera_metadata_tag_t);
-            size_t count = *reinterpret_cast<size_t *>(p); p += sizeof(size_t);
-
-            int32_t type = get_camera_metadata_tag_type(tag);
-            switch (type) {
-                case TYPE_BYTE: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(uint8_t);
-                    break;
-                }
-                case TYPE_INT32: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(int32_t);
-                    break;
-                }
-                case TYPE_FLOAT: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(float);
-                    break;
-                }
-                case TYPE_INT64: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(int64_t);
-                    break;
-                }
-                case TYPE_DOUBLE: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(double);
-                    break;
-                }
-                case TYPE_RATIONAL:
-                    p += count * sizeof(camera_metadata_rational_t);
-                    break;
-                default:
-                    LOG(WARNING) << "Type " << type << " is unknown; "
-                                 << "data may be corrupted.";
-                    break;
+
+        aCamera->conversionThreads = rec.conversionThreads;
+        aCamera->gpuConversion = rec.gpuConversion != 0;
+        return true;
+    };
+
+    for (uint32_t idx = 0; idx < header->numCameraRecords; ++idx) {
+        const CacheCamera &rec = cameras[idx];
+
+        string id, position, members;
+        if (!getCacheString(cache, cacheSize, rec.id, id) ||
+            !getCacheString(cache, cacheSize, rec.position, position) ||
+            !getCacheString(cache, cacheSize, rec.members, members)) {
+            return fail("corrupted camera identifier");
+        }
+
+        if (rec.isGroup) {
+            unique_ptr<CameraGroupInfo> aGroup(new CameraGroupInfo());
+            if (!readCamera(rec, aGroup.get())) {
+                return fail("corrupted camera group record");
             }
+
+            aGroup->synchronized = rec.synchronized;
+
+            stringstream ss(members);
+            string member;
+            while (getline(ss, member, ',')) {
+                aGroup->devices.emplace(member);
+            }
+
+            cameraGroups.insert_or_assign(id, std::move(aGroup));
+        } else {
+            unique_ptr<CameraInfo> aCamera(new CameraInfo());
+            if (!readCamera(rec, aCamera.get())) {
+                return fail("corrupted camera record");
+            }
+
+            cameraPosition[position].emplace(id);
+            cameraInfo.insert_or_assign(id, std::move(aCamera));
+        }
+    }
+
+    for (uint32_t idx = 0; idx < header->numDisplayRecords; ++idx) {
+        const CacheDisplay &rec = displays[idx];
+
+        string id;
+        const RawStreamConfiguration *streams =
+            getCacheArray<RawStreamConfiguration>(cache, cacheSize,
+                                                  rec.streamOffset, rec.numStreams);
+        if (!getCacheString(cache, cacheSize, rec.id, id) || streams == nullptr) {
+            return fail("corrupted display record");
         }
 
-        mCameraInfo.insert_or_assign(cameraId, std::move(aCamera));
+        unique_ptr<DisplayInfo> dpy(new DisplayInfo());
+        for (uint32_t i = 0; i < rec.numStreams; ++i) {
+            dpy->streamConfigurations.insert_or_assign(streams[i][0], streams[i]);
+        }
+        displayInfo.insert_or_assign(id, std::move(dpy));
     }
 
+    unique_lock<mutex> lock(mConfigLock);
+    mSystemInfo.numCameras = header->numCameras;
+    mCameraInfo = std::move(cameraInfo);
+    mCameraGroups = std::move(cameraGroups);
+    mCameraPosition = std::move(cameraPosition);
+    mDisplayInfo = std::move(displayInfo);
+    mCacheData = cacheData;
+    mCacheSize = cacheSize;
+
+    /* configuration data is ready to be consumed */
     mIsReady = true;
 
     /* notify that configuration data is ready */
     lock.unlock();
     mConfigCond.notify_all();
 
-    int64_t readEnd = android::elapsedRealtimeNano();
+    const int64_t readEnd = android::elapsedRealtimeNano();
     LOG(INFO) << __FUNCTION__ << " takes "
               << std::scientific << (double)(readEnd - readStart) / 1000000.0
               << " ms.";
@@ -815,242 +897,151 @@ bool ConfigManager::readConfigDataFromBinary() {
 }
 
 
-bool ConfigManager::writeConfigDataToBinary() {
-    fstream outFile;
-
-    int64_t writeStart = android::elapsedRealtimeNano();
-
-    outFile.open(mBinaryFilePath, fstream::out | fstream::binary);
-    if (!outFile) {
-        LOG(ERROR) << "Failed to open a destination binary file, " << mBinaryFilePath;
-        return false;
-    }
-
+bool ConfigManager::writeConfigDataToCache(const char *filePath) {
     /* lock a configuration data while it's being written to the filesystem */
     lock_guard<mutex> lock(mConfigLock);
 
-    /* write camera group information */
-    size_t sz = mCameraGroups.size();
-    outFile.write(reinterpret_cast<const char *>(&sz),
-                  sizeof(size_t));
-    for (auto&& [camId, camInfo] : mCameraGroups) {
-        LOG(INFO) << "Storing camera group " << camId;
-
-        /* write a camera identifier string */
-        outFile.write(reinterpret_cast<const char *>(&camId),
-                      sizeof(string));
-
-        /* controls */
-        sz = camInfo->controls.size();
-        outFile.write(reinterpret_cast<const char *>(&sz),
-                      sizeof(size_t));
-        for (auto&& [ctrl, range] : camInfo->controls) {
-            outFile.write(reinterpret_cast<const char *>(&ctrl),
-                          sizeof(CameraParam));
-            outFile.write(reinterpret_cast<const char *>(&get<0>(range)),
-                          sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char *>(&get<1>(range)),
-                          sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char *>(&get<2>(range)),
-                          sizeof(int32_t));
-        }
-
-        /* stream configurations */
-        sz = camInfo->streamConfigurations.size();
-        outFile.write(reinterpret_cast<const char *>(&sz),
-                      sizeof(size_t));
-        for (auto&& [sid, cfg] : camInfo->streamConfigurations) {
-            outFile.write(reinterpret_cast<const char *>(sid),
-                          sizeof(int32_t));
-            for (int idx = 0; idx < kStreamCfgSz; ++idx) {
-                outFile.write(reinterpret_cast<const char *>(&cfg[idx]),
-                              sizeof(int32_t));
-            }
-        }
+    CacheWriter writer;
+    writer.reserve(sizeof(CacheHeader));
 
-        /* synchronization */
-        outFile.write(reinterpret_cast<const char *>(&camInfo->synchronized),
-                      sizeof(int32_t));
+    const size_t numCameraRecords = mCameraInfo.size() + mCameraGroups.size();
+    const uint32_t cameraOffset = writer.reserve(numCameraRecords * sizeof(CacheCamera));
+    const uint32_t displayOffset = writer.reserve(mDisplayInfo.size() * sizeof(CacheDisplay));
 
-        /* size of camera_metadata_t */
-        size_t num_entry = 0;
-        size_t num_data  = 0;
-        if (camInfo->characteristics != nullptr) {
-            num_entry = get_camera_metadata_entry_count(camInfo->characteristics);
-            num_data  = get_camera_metadata_data_count(camInfo->characteristics);
+    /* camera positions are stored with each camera */
+    unordered_map<string, string> positions;
+    for (auto&& [position, ids] : mCameraPosition) {
+        for (auto&& id : ids) {
+            positions[id] = position;
         }
-        outFile.write(reinterpret_cast<const char *>(&num_entry),
-                      sizeof(size_t));
-        outFile.write(reinterpret_cast<const char *>(&num_data),
-                      sizeof(size_t));
-
-        /* write each camera metadata entry */
-        if (num_entry > 0) {
-            camera_metadata_entry_t entry;
-            for (auto idx = 0; idx < num_entry; ++idx) {
-                if (get_camera_metadata_entry(camInfo->characteristics, idx, &entry)) {
-                    LOG(ERROR) << "Failed to retrieve camera metadata entry " << idx;
-                    outFile.close();
-                    return false;
-                }
+    }
 
-                outFile.write(reinterpret_cast<const char *>(&entry.tag),
-                              sizeof(entry.tag));
-                outFile.write(reinterpret_cast<const char *>(&entry.count),
-                              sizeof(entry.count));
-
-                int32_t type = get_camera_metadata_tag_type(entry.tag);
-                switch (type) {
-                    case TYPE_BYTE:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.u8),
-                                      sizeof(uint8_t) * entry.count);
-                        break;
-                    case TYPE_INT32:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.i32),
-                                      sizeof(int32_t) * entry.count);
-                        break;
-                    case TYPE_FLOAT:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.f),
-                                      sizeof(float) * entry.count);
-                        break;
-                    case TYPE_INT64:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.i64),
-                                      sizeof(int64_t) * entry.count);
-                        break;
-                    case TYPE_DOUBLE:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.d),
-                                      sizeof(double) * entry.count);
-                        break;
-                    case TYPE_RATIONAL:
-                        [[fallthrough]];
-                    default:
-                        LOG(WARNING) << "Type " << type << " is not supported.";
-                        break;
+    uint32_t recIdx = 0;
+    auto writeCamera = [&](const string &id, const CameraInfo &camInfo,
+                           const CameraGroupInfo *groupInfo) {
+        CacheCamera rec = {};
+        rec.id = writer.appendString(id);
+        rec.position = writer.appendString(groupInfo != nullptr ? "" : positions[id]);
+
+        if (groupInfo != nullptr) {
+            string members;
+            for (auto&& member : groupInfo->devices) {
+                if (!members.empty()) {
+                    members += ',';
                 }
+                members += member;
             }
+            rec.members = writer.appendString(members);
+            rec.isGroup = 1;
+            rec.synchronized = groupInfo->synchronized;
+        } else {
+            rec.members = writer.appendString("");
         }
-    }
 
-    /* write camera device information */
-    sz = mCameraInfo.size();
-    outFile.write(reinterpret_cast<const char *>(&sz),
-                  sizeof(size_t));
-    for (auto&& [camId, camInfo] : mCameraInfo) {
-        LOG(INFO) << "Storing camera " << camId;
-
-        /* write a camera identifier string */
-        outFile.write(reinterpret_cast<const char *>(&camId),
-                      sizeof(string));
-
-        /* controls */
-        sz = camInfo->controls.size();
-        outFile.write(reinterpret_cast<const char *>(&sz),
-                      sizeof(size_t));
-        for (auto& [ctrl, range] : camInfo->controls) {
-            outFile.write(reinterpret_cast<const char *>(&ctrl),
-                          sizeof(CameraParam));
-            outFile.write(reinterpret_cast<const char *>(&get<0>(range)),
-                          sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char *>(&get<1>(range)),
-                          sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char *>(&get<2>(range)),
-                          sizeof(int32_t));
+        rec.conversionThreads = camInfo.conversionThreads;
+        rec.gpuConversion = camInfo.gpuConversion ? 1 : 0;
+
+        rec.numControls = camInfo.controls.size();
+        rec.controlOffset = writer.reserve(rec.numControls * sizeof(CacheControl));
+        CacheControl *ctrl = writer.at<CacheControl>(rec.controlOffset);
+        for (auto&& [cid, range] : camInfo.controls) {
+            *ctrl++ = { static_cast<int32_t>(cid),
+                        get<0>(range), get<1>(range), get<2>(range) };
         }
 
-        /* stream configurations */
-        sz = camInfo->streamConfigurations.size();
-        outFile.write(reinterpret_cast<const char *>(&sz),
-                      sizeof(size_t));
-        for (auto&& [sid, cfg] : camInfo->streamConfigurations) {
-            outFile.write(reinterpret_cast<const char *>(sid),
-                          sizeof(int32_t));
-            for (int idx = 0; idx < kStreamCfgSz; ++idx) {
-                outFile.write(reinterpret_cast<const char *>(&cfg[idx]),
-                              sizeof(int32_t));
+        rec.numStreams = camInfo.streamConfigurations.size();
+        rec.streamOffset = writer.appendStreams(camInfo.streamConfigurations);
+
+        if (camInfo.characteristics != nullptr) {
+            /* store a packed copy that can be used in place */
+            const size_t size = get_camera_metadata_compact_size(camInfo.characteristics);
+            rec.metadataOffset = writer.reserve(size, kCacheMetadataAlignment);
+            rec.metadataSize = size;
+            if (copy_camera_metadata(writer.at<void>(rec.metadataOffset), size,
+                                     camInfo.characteristics) == nullptr) {
+                LOG(ERROR) << "Failed to copy camera metadata of " << id;
+                return false;
             }
         }
 
-        /* size of camera_metadata_t */
-        size_t num_entry = 0;
-        size_t num_data  = 0;
-        if (camInfo->characteristics != nullptr) {
-            num_entry = get_camera_metadata_entry_count(camInfo->characteristics);
-            num_data  = get_camera_metadata_data_count(camInfo->characteristics);
-        }
-        outFile.write(reinterpret_cast<const char *>(&num_entry),
-                      sizeof(size_t));
-        outFile.write(reinterpret_cast<const char *>(&num_data),
-                      sizeof(size_t));
-
-        /* write each camera metadata entry */
-        if (num_entry > 0) {
-            camera_metadata_entry_t entry;
-            for (auto idx = 0; idx < num_entry; ++idx) {
-                if (get_camera_metadata_entry(camInfo->characteristics, idx, &entry)) {
-                    LOG(ERROR) << "Failed to retrieve camera metadata entry " << idx;
-                    outFile.close();
-                    return false;
-                }
+        *writer.at<CacheCamera>(cameraOffset + recIdx++ * sizeof(CacheCamera)) = rec;
+        return true;
+    };
 
-                outFile.write(reinterpret_cast<const char *>(&entry.tag),
-                              sizeof(entry.tag));
-                outFile.write(reinterpret_cast<const char *>(&entry.count),
-                              sizeof(entry.count));
-
-                int32_t type = get_camera_metadata_tag_type(entry.tag);
-                switch (type) {
-                    case TYPE_BYTE:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.u8),
-                                      sizeof(uint8_t) * entry.count);
-                        break;
-                    case TYPE_INT32:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.i32),
-                                      sizeof(int32_t) * entry.count);
-                        break;
-                    case TYPE_FLOAT:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.f),
-                                      sizeof(float) * entry.count);
-                        break;
-                    case TYPE_INT64:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.i64),
-                                      sizeof(int64_t) * entry.count);
-                        break;
-                    case TYPE_DOUBLE:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.d),
-                                      sizeof(double) * entry.count);
-                        break;
-                    case TYPE_RATIONAL:
-                        [[fallthrough]];
-                    default:
-                        LOG(WARNING) << "Type " << type << " is not supported.";
-                        break;
-                }
-            }
+    for (auto&& [id, camInfo] : mCameraInfo) {
+        if (!writeCamera(id, *camInfo, nullptr)) {
+            return false;
+        }
+    }
+    for (auto&& [id, groupInfo] : mCameraGroups) {
+        if (!writeCamera(id, *groupInfo, groupInfo.get())) {
+            return false;
         }
     }
 
-    outFile.close();
-    int64_t writeEnd = android::elapsedRealtimeNano();
-    LOG(INFO) << __FUNCTION__ << " takes "
-              << std::scientific << (double)(writeEnd - writeStart) / 1000000.0
-              << " ms.";
+    recIdx = 0;
+    for (auto&& [id, dpyInfo] : mDisplayInfo) {
+        CacheDisplay rec = {};
+        rec.id = writer.appendString(id);
+        rec.numStreams = dpyInfo->streamConfigurations.size();
+        rec.streamOffset = writer.appendStreams(dpyInfo->streamConfigurations);
 
+        *writer.at<CacheDisplay>(displayOffset + recIdx++ * sizeof(CacheDisplay)) = rec;
+    }
 
+    vector<uint8_t> &data = writer.data();
+    CacheHeader *header = writer.at<CacheHeader>(0);
+    memcpy(header->magic, kCacheMagic, sizeof(kCacheMagic));
+    header->version = kCacheVersion;
+    header->size = data.size();
+    header->numCameras = mSystemInfo.numCameras;
+    header->cameraOffset = cameraOffset;
+    header->numCameraRecords = numCameraRecords;
+    header->displayOffset = displayOffset;
+    header->numDisplayRecords = mDisplayInfo.size();
+    header->checksum = computeCacheChecksum(data.data() + sizeof(CacheHeader),
+                                            data.size() - sizeof(CacheHeader));
+
+    fstream outFile;
+    outFile.open(filePath, fstream::out | fstream::binary | fstream::trunc);
+    if (!outFile) {
+        LOG(ERROR) << "Failed to open a destination cache file, " << filePath;
+        return false;
+    }
+
+    outFile.write(reinterpret_cast<const char *>(data.data()), data.size());
+    outFile.close();
+    if (!outFile) {
+        LOG(ERROR) << "Failed to write a configuration cache, " << filePath;
+        return false;
+    }
+
+    LOG(INFO) << "Stored " << data.size() << " bytes of configuration data";
     return true;
 }
 
 
+bool ConfigManager::compileCache(const char *xmlPath, const char *cachePath) {
+    unique_ptr<ConfigManager> cfgMgr(new ConfigManager());
+    return cfgMgr->readConfigDataFromXML(xmlPath) &&
+           cfgMgr->writeConfigDataToCache(cachePath);
+}
+
+
 std::unique_ptr<ConfigManager> ConfigManager::Create() {
     unique_ptr<ConfigManager> cfgMgr(new ConfigManager());
 
     /*
-     * Read a configuration from XML file
-     *
-     * If this is too slow, ConfigManager::readConfigDataFromBinary() and
-     * ConfigManager::writeConfigDataToBinary()can serialize CameraInfo object
-     * to the filesystem and construct CameraInfo instead; this was
-     * evaluated as 10x faster.
+     * Map the configuration cache compiled from the default configuration
+     * file at build time, which spares parsing XML while the service starts.
+     * An override configuration file and a missing or stale cache fall back
+     * to parsing XML.
      */
+    if (access(CONFIG_OVERRIDE_PATH, F_OK) != 0 &&
+        cfgMgr->readConfigDataFromCache(CONFIG_CACHE_PATH)) {
+        return cfgMgr;
+    }
+
     if (!cfgMgr->readConfigDataFromXML()) {
         return nullptr;
     } else {
@@ -1059,7 +1050,9 @@ std::unique_ptr<ConfigManager> ConfigManager::Create() {
 }
 
 ConfigManager::CameraInfo::~CameraInfo() {
-    free_camera_metadata(characteristics);
+    if (!mappedCharacteristics) {
+        free_camera_metadata(characteristics);
+    }
 
     for (auto&& [tag, val] : cameraMetadata) {
         switch(tag) {
@@ -47,6 +47,22 @@ typedef std::array<int32_t, kStreamCfgSz> RawStreamConfiguration;
 class ConfigManager {
 public:
     static std::unique_ptr<ConfigManager> Create();
+
+    /*
+     * Compile a given EVS configuration file into a configuration cache
+     * that Create() maps instead of parsing the XML file.  This runs at
+     * build time.
+     *
+     * @param  xmlPath
+     *         A path to the EVS configuration file to compile.
+     * @param  cachePath
+     *         A path to the configuration cache to write.
+     *
+     * @return bool
+     *         True if it writes the configuration cache successfully.
+     */
+    static bool compileCache(const char *xmlPath, const char *cachePath);
+
     ConfigManager(const ConfigManager&) = delete;
     ConfigManager& operator=(const ConfigManager&) = delete;
 
@@ -95,6 +111,18 @@ public:
 
         /* Camera module characteristics */
         camera_metadata_t *characteristics;
+
+        /*
+         * Characteristics point into a mapped configuration cache, which
+         * owns them
+         */
+        bool mappedCharacteristics = false;
+
+        /* Number of threads converting each frame of this camera */
+        int32_t conversionThreads = 1;
+
+        /* Frames of this camera are converted on the GPU if they can be */
+        bool gpuConversion = false;
     };
 
     class CameraGroupInfo : public CameraInfo {
@@ -218,12 +246,12 @@ public:
 
 private:
     /* Constructors */
-    ConfigManager() :
-        mBinaryFilePath("") {
+    ConfigManager() {
     }
 
     static const char* CONFIG_DEFAULT_PATH;
     static const char* CONFIG_OVERRIDE_PATH;
+    static const char* CONFIG_CACHE_PATH;
 
     /* System configuration */
     SystemInfo mSystemInfo;
@@ -252,8 +280,9 @@ private:
      */
     condition_variable mConfigCond;
 
-    /* A path to a binary configuration file */
-    const char *mBinaryFilePath;
+    /* Mapped configuration cache the camera characteristics point into */
+    void   *mCacheData = nullptr;
+    size_t  mCacheSize = 0;
 
     /* Configuration data readiness */
     bool mIsReady = false;
@@ -262,10 +291,15 @@ private:
      * Parse a given EVS configuration file and store the information
      * internally.
      *
+     * @param  filePath
+     *         A path to the configuration file to parse.  If this is null,
+     *         the override configuration file is parsed if it exists and the
+     *         default one otherwise.
+     *
      * @return bool
      *         True if it completes parsing a file successfully.
      */
-    bool readConfigDataFromXML() noexcept;
+    bool readConfigDataFromXML(const char *filePath = nullptr) noexcept;
 
     /*
      * read the information of the vehicle
@@ -367,21 +401,26 @@ private:
                                  const size_t totalDataSize);
 
     /*
-     * Read configuration data from the binary file
+     * Map a configuration cache and use its contents in place
+     *
+     * @param  filePath
+     *         A path to the configuration cache.
      *
      * @return bool
-     *         True if it succeeds to read configuration data from a binary
-     *         file.
+     *         True if the cache is intact and of the current version.
      */
-    bool readConfigDataFromBinary();
+    bool readConfigDataFromCache(const char *filePath);
 
     /*
-     * Store configuration data to the file
+     * Store configuration data to a configuration cache
+     *
+     * @param  filePath
+     *         A path to the configuration cache to write.
      *
      * @return bool
-     *         True if it succeeds to serialize mCameraInfo to the file.
+     *         True if it succeeds to write all configuration data.
      */
-    bool writeConfigDataToBinary();
+    bool writeConfigDataToCache(const char *filePath);
 
     /*
      * debugging method to print out all XML elements and their attributes in
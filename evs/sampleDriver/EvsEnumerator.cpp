@@ -20,9 +20,16 @@
 #include "ConfigManager.h"
 
 #include <dirent.h>
-#include <hardware_legacy/uevent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 #include <hwbinder/IPCThreadState.h>
 #include <cutils/android_filesystem_config.h>
+#include <cutils/uevent.h>
+#include <gpupolicy/GpuPolicy.h>
+#include <threadpolicy/ThreadPolicy.h>
 
 
 using namespace std::chrono_literals;
@@ -44,6 +51,7 @@ std::unordered_map<std::string, EvsEnumerator::CameraRecord> EvsEnumerator::sCam
 wp<EvsGlDisplay>                                             EvsEnumerator::sActiveDisplay;
 std::mutex                                                   EvsEnumerator::sLock;
 std::condition_variable                                      EvsEnumerator::sCameraSignal;
+unsigned                                                     EvsEnumerator::sPendingProbes = 0;
 std::unique_ptr<ConfigManager>                               EvsEnumerator::sConfigManager;
 sp<IAutomotiveDisplayProxyService>                           EvsEnumerator::sDisplayProxy;
 std::unordered_map<uint8_t, uint64_t>                        EvsEnumerator::sDisplayPortList;
@@ -53,6 +61,12 @@ uint64_t                                                     EvsEnumerator::sInt
 // Constants
 const auto kEnumerationTimeout = 10s;
 
+// How often the uevent listener checks whether it should exit
+constexpr int kUeventPollTimeoutMs = 500;
+
+// Receive buffer of the uevent socket; large enough for a burst of events at boot
+constexpr int kUeventSocketBufferSize = 256 * 1024;
+
 
 bool EvsEnumerator::checkPermission() {
     hardware::IPCThreadState *ipc = hardware::IPCThreadState::self();
@@ -68,76 +82,95 @@ bool EvsEnumerator::checkPermission() {
 }
 
 void EvsEnumerator::EvsUeventThread(std::atomic<bool>& running) {
-    int status = uevent_init();
-    if (!status) {
+    android::base::unique_fd sock(uevent_open_socket(kUeventSocketBufferSize, true));
+    if (sock < 0) {
         LOG(ERROR) << "Failed to initialize uevent handler.";
         return;
     }
+    // Drain every queued event when the socket becomes readable
+    fcntl(sock, F_SETFL, O_NONBLOCK);
 
-    char uevent_data[PAGE_SIZE - 2] = {};
-    while (running) {
-        int length = uevent_next_event(uevent_data, static_cast<int32_t>(sizeof(uevent_data)));
-
-        // Ensure double-null termination.
-        uevent_data[length] = uevent_data[length + 1] = '\0';
-
-        const char *action = nullptr;
-        const char *devname = nullptr;
-        const char *subsys = nullptr;
-        char *cp = uevent_data;
-        while (*cp) {
-            // EVS is interested only in ACTION, SUBSYSTEM, and DEVNAME.
-            if (!std::strncmp(cp, "ACTION=", 7)) {
-                action = cp + 7;
-            } else if (!std::strncmp(cp, "SUBSYSTEM=", 10)) {
-                subsys = cp + 10;
-            } else if (!std::strncmp(cp, "DEVNAME=", 8)) {
-                devname = cp + 8;
-            }
-
-            // Advance to after next \0
-            while (*cp++);
-        }
+    android::base::unique_fd epollFd(epoll_create1(EPOLL_CLOEXEC));
+    if (epollFd < 0) {
+        PLOG(ERROR) << "Failed to create an epoll instance for uevents";
+        return;
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &ev) < 0) {
+        PLOG(ERROR) << "Failed to listen to uevents";
+        return;
+    }
 
-        if (!devname || !subsys || std::strcmp(subsys, "video4linux")) {
-            // EVS expects that the subsystem of enabled video devices is
-            // video4linux.
+    char uevent_data[PAGE_SIZE] = {};
+    while (running) {
+        int numEvents = epoll_wait(epollFd, &ev, 1, kUeventPollTimeoutMs);
+        if (numEvents < 0 && errno != EINTR) {
+            PLOG(ERROR) << "Failed to wait for uevents";
+            break;
+        } else if (numEvents <= 0) {
             continue;
         }
 
-        // Update shared list.
-        bool cmd_addition = !std::strcmp(action, "add");
-        bool cmd_removal  = !std::strcmp(action, "remove");
-        {
-            std::string devpath = "/dev/";
-            devpath += devname;
+        ssize_t length;
+        while ((length = uevent_kernel_multicast_recv(sock, uevent_data,
+                                                      sizeof(uevent_data) - 2)) > 0) {
+            // Ensure double-null termination.
+            uevent_data[length] = uevent_data[length + 1] = '\0';
 
-            std::lock_guard<std::mutex> lock(sLock);
-            if (cmd_removal) {
-                sCameraList.erase(devpath);
-                LOG(INFO) << devpath << " is removed.";
-            } else if (cmd_addition) {
-                // NOTE: we are here adding new device without a validation
-                // because it always fails to open, b/132164956.
-                CameraRecord cam(devpath.c_str());
-                if (sConfigManager != nullptr) {
-                    unique_ptr<ConfigManager::CameraInfo> &camInfo =
-                        sConfigManager->getCameraInfo(devpath);
-                    if (camInfo != nullptr) {
-                        cam.desc.metadata.setToExternal(
-                            (uint8_t *)camInfo->characteristics,
-                             get_camera_metadata_size(camInfo->characteristics)
-                        );
-                    }
+            // The header is "ACTION@DEVPATH" and every video device lives under a
+            // video4linux directory, so most events are dropped without looking at their keys.
+            if (std::strstr(uevent_data, "/video4linux/") == nullptr) {
+                continue;
+            }
+
+            const char *action = nullptr;
+            const char *devname = nullptr;
+            const char *subsys = nullptr;
+            char *cp = uevent_data;
+            while (*cp) {
+                // EVS is interested only in ACTION, SUBSYSTEM, and DEVNAME.
+                if (!std::strncmp(cp, "ACTION=", 7)) {
+                    action = cp + 7;
+                } else if (!std::strncmp(cp, "SUBSYSTEM=", 10)) {
+                    subsys = cp + 10;
+                } else if (!std::strncmp(cp, "DEVNAME=", 8)) {
+                    devname = cp + 8;
                 }
-                sCameraList.emplace(devpath, cam);
-                LOG(INFO) << devpath << " is added.";
-            } else {
-                // Ignore all other actions including "change".
+
+                // Advance to after next \0
+                while (*cp++);
             }
 
-            // Notify the change.
-            sCameraSignal.notify_all();
+            if (!action || !devname || !subsys || std::strcmp(subsys, "video4linux")) {
+                // EVS expects that the subsystem of enabled video devices is
+                // video4linux.
+                continue;
+            }
+
+            // Update shared list.
+            bool cmd_addition = !std::strcmp(action, "add");
+            bool cmd_removal  = !std::strcmp(action, "remove");
+            {
+                std::string devpath = "/dev/";
+                devpath += devname;
+
+                std::lock_guard<std::mutex> lock(sLock);
+                if (cmd_removal) {
+                    sCameraList.erase(devpath);
+                    LOG(INFO) << devpath << " is removed.";
+                } else if (cmd_addition) {
+                    // NOTE: we are here adding new device without a validation
+                    // because it always fails to open, b/132164956.
+                    addCamera_Locked(devpath);
+                    LOG(INFO) << devpath << " is added.";
+                } else {
+                    // Ignore all other actions including "change".
+                }
+
+                // Notify the change.
+                sCameraSignal.notify_all();
+            }
         }
     }
 
@@ -164,44 +197,72 @@ EvsEnumerator::EvsEnumerator(sp<IAutomotiveDisplayProxyService> proxyService) {
 
 void EvsEnumerator::enumerateCameras() {
     // For every video* entry in the dev folder, see if it reports suitable capabilities
-    // WARNING:  Depending on the driver implementations this could be slow, especially if
-    //           there are timeouts or round trips to hardware required to collect the needed
-    //           information.  Platform implementers should consider hard coding this list of
-    //           known good devices to speed up the startup time of their EVS implementation.
-    //           For example, this code might be replaced with nothing more than:
-    //                   sCameraList.emplace("/dev/video0");
-    //                   sCameraList.emplace("/dev/video1");
+    // NOTE:  Depending on the driver implementations probing could be slow, especially if
+    //        there are timeouts or round trips to hardware required to collect the needed
+    //        information.  Each device is therefore probed on its own thread and joins
+    //        sCameraList as soon as it qualifies, so a slow camera never delays the others
+    //        and this returns without waiting for any of them.
     LOG(INFO) << __FUNCTION__
               << ": Starting dev/video* enumeration";
-    unsigned videoCount   = 0;
-    unsigned captureCount = 0;
     DIR* dir = opendir("/dev");
     if (!dir) {
         LOG_FATAL("Failed to open /dev folder\n");
     }
+
+    std::vector<std::string> deviceNames;
     struct dirent* entry;
-    {
-        std::lock_guard<std::mutex> lock(sLock);
+    while ((entry = readdir(dir)) != nullptr) {
+        // We're only looking for entries starting with 'video'
+        if (strncmp(entry->d_name, "video", 5) == 0) {
+            deviceNames.emplace_back(std::string("/dev/") + entry->d_name);
+        }
+    }
+    closedir(dir);
 
-        while ((entry = readdir(dir)) != nullptr) {
-            // We're only looking for entries starting with 'video'
-            if (strncmp(entry->d_name, "video", 5) == 0) {
-                std::string deviceName("/dev/");
-                deviceName += entry->d_name;
-                videoCount++;
-                if (sCameraList.find(deviceName) != sCameraList.end()) {
-                    LOG(INFO) << deviceName << " has been added already.";
-                    captureCount++;
-                } else if(qualifyCaptureDevice(deviceName.c_str())) {
-                    sCameraList.emplace(deviceName, deviceName.c_str());
-                    captureCount++;
-                }
-            }
+    std::lock_guard<std::mutex> lock(sLock);
+    for (auto&& deviceName : deviceNames) {
+        if (sCameraList.find(deviceName) != sCameraList.end()) {
+            LOG(INFO) << deviceName << " has been added already.";
+            continue;
         }
+
+        ++sPendingProbes;
+        std::thread([deviceName]() {
+            const bool qualified = qualifyCaptureDevice(deviceName.c_str());
+
+            std::lock_guard<std::mutex> lock(sLock);
+            if (qualified && sCameraList.find(deviceName) == sCameraList.end()) {
+                addCamera_Locked(deviceName);
+                LOG(INFO) << deviceName << " is a qualified video capture device.";
+            }
+            if (--sPendingProbes == 0) {
+                LOG(INFO) << "Enumeration completed with " << sCameraList.size()
+                          << " video capture devices.";
+            }
+
+            // Notify the change.
+            sCameraSignal.notify_all();
+        }).detach();
     }
 
-    LOG(INFO) << "Found " << captureCount << " qualified video capture devices "
-              << "of " << videoCount << " checked.";
+    LOG(INFO) << "Probing " << sPendingProbes << " of " << deviceNames.size()
+              << " video devices.";
+}
+
+
+void EvsEnumerator::addCamera_Locked(const std::string& deviceName) {
+    CameraRecord cam(deviceName.c_str());
+    if (sConfigManager != nullptr) {
+        unique_ptr<ConfigManager::CameraInfo> &camInfo =
+            sConfigManager->getCameraInfo(deviceName);
+        if (camInfo != nullptr) {
+            cam.desc.metadata.setToExternal(
+                (uint8_t *)camInfo->characteristics,
+                 get_camera_metadata_size(camInfo->characteristics)
+            );
+        }
+    }
+    sCameraList.emplace(deviceName, cam);
 }
 
 
@@ -240,16 +301,15 @@ Return<void> EvsEnumerator::getCameraList(getCameraList_cb _hidl_cb)  {
         return Void();
     }
 
-    {
-        std::unique_lock<std::mutex> lock(sLock);
-        if (sCameraList.size() < 1) {
-            // No qualified device has been found.  Wait until new device is ready,
-            // for 10 seconds.
-            if (!sCameraSignal.wait_for(lock,
-                                        kEnumerationTimeout,
-                                        []{ return sCameraList.size() > 0; })) {
-                LOG(DEBUG) << "Timer expired.  No new device has been added.";
-            }
+    // Report the cameras that are ready; the others are added as their probes complete
+    std::unique_lock<std::mutex> lock(sLock);
+    if (sCameraList.size() < 1) {
+        // No qualified device has been found.  Wait until new device is ready,
+        // for 10 seconds.
+        if (!sCameraSignal.wait_for(lock,
+                                    kEnumerationTimeout,
+                                    []{ return sCameraList.size() > 0; })) {
+            LOG(DEBUG) << "Timer expired.  No new device has been added.";
         }
     }
 
@@ -396,15 +456,14 @@ Return<void> EvsEnumerator::getCameraList_1_1(getCameraList_1_1_cb _hidl_cb)  {
         return Void();
     }
 
-    {
-        std::unique_lock<std::mutex> lock(sLock);
-        if (sCameraList.size() < 1) {
-            // No qualified device has been found.  Wait until new device is ready,
-            if (!sCameraSignal.wait_for(lock,
-                                        kEnumerationTimeout,
-                                        []{ return sCameraList.size() > 0; })) {
-                LOG(DEBUG) << "Timer expired.  No new device has been added.";
-            }
+    // Report the cameras that are ready; the others are added as their probes complete
+    std::unique_lock<std::mutex> lock(sLock);
+    if (sCameraList.size() < 1) {
+        // No qualified device has been found.  Wait until new device is ready,
+        if (!sCameraSignal.wait_for(lock,
+                                    kEnumerationTimeout,
+                                    []{ return sCameraList.size() > 0; })) {
+            LOG(DEBUG) << "Timer expired.  No new device has been added.";
         }
     }
 
@@ -647,6 +706,7 @@ bool EvsEnumerator::qualifyCaptureDevice(const char* deviceName) {
 
 EvsEnumerator::CameraRecord* EvsEnumerator::findCameraById(const std::string& cameraId) {
     // Find the named camera
+    std::lock_guard<std::mutex> lock(sLock);
     auto found = sCameraList.find(cameraId);
     if (sCameraList.end() != found) {
         // Found a match!
@@ -658,6 +718,39 @@ EvsEnumerator::CameraRecord* EvsEnumerator::findCameraById(const std::string& ca
 }
 
 
+Return<void> EvsEnumerator::debug(const hidl_handle& fd,
+                                  const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        LOG(ERROR) << "Given file descriptor is not valid.";
+        return {};
+    }
+
+    // Frame latency of the cameras that are currently open
+    std::string buffer;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        for (auto&& [id, cam] : sCameraList) {
+            sp<EvsV4lCamera> pActiveCamera = cam.activeInstance.promote();
+            if (pActiveCamera == nullptr) {
+                continue;
+            }
+
+            android::base::StringAppendF(&buffer, "%s:\n", id.c_str());
+            buffer += pActiveCamera->dumpLatency("    ");
+        }
+    }
+
+    if (buffer.empty()) {
+        buffer = "No camera is open.\n";
+    }
+    buffer += android::automotive::evs::threadpolicy::dumpThreadPolicies();
+    buffer += android::automotive::evs::gpupolicy::dumpGpuPolicies();
+    android::base::WriteStringToFd(buffer, fd->data[0]);
+
+    return {};
+}
+
+
 // TODO(b/149874793): Add implementation for EVS Manager and Sample driver
 Return<void> EvsEnumerator::getUltrasonicsArrayList(getUltrasonicsArrayList_cb _hidl_cb) {
     hidl_vec<UltrasonicsArrayDesc> ultrasonicsArrayDesc;
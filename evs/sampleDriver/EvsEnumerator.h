@@ -70,6 +70,9 @@ public:
     Return<void> closeUltrasonicsArray(
             const ::android::sp<IEvsUltrasonicsArray>& evsUltrasonicsArray) override;
 
+    // Methods from ::android.hidl.base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
     // Implementation details
     EvsEnumerator(sp<IAutomotiveDisplayProxyService> proxyService = nullptr);
 
@@ -89,6 +92,7 @@ private:
     static bool qualifyCaptureDevice(const char* deviceName);
     static CameraRecord* findCameraById(const std::string& cameraId);
     static void enumerateCameras();
+    static void addCamera_Locked(const std::string& deviceName);
     static void enumerateDisplays();
 
     void closeCamera_impl(const sp<IEvsCamera_1_0>& pCamera, const std::string& cameraId);
@@ -98,7 +102,8 @@ private:
     //        constructs a new instance for each client.
     //        Because our server has a single thread in the thread pool, these values are
     //        never accessed concurrently despite potentially having multiple instance objects
-    //        using them.
+    //        using them, except sCameraList, which the uevent listener and the device probes
+    //        update under sLock.
     static std::unordered_map<std::string,
                               CameraRecord> sCameraList;
 
@@ -107,6 +112,8 @@ private:
 
     static std::mutex                       sLock;          // Mutex on shared camera device list.
     static std::condition_variable          sCameraSignal;  // Signal on camera device addition.
+    static unsigned                         sPendingProbes; // Devices still being probed; guarded
+                                                            // by sLock.
 
     static std::unique_ptr<ConfigManager>   sConfigManager; // ConfigManager
 
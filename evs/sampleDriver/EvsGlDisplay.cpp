@@ -16,10 +16,13 @@
 
 #include "EvsGlDisplay.h"
 
+#include <android-base/properties.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 #include <utils/SystemClock.h>
 
+#include <algorithm>
+
 using ::android::frameworks::automotive::display::V1_0::HwDisplayConfig;
 using ::android::frameworks::automotive::display::V1_0::HwDisplayState;
 
@@ -34,6 +37,12 @@ namespace implementation {
 static bool sDebugFirstFrameDisplayed = false;
 #endif
 
+// Number of target buffers; more let the client fill a frame while the previous ones are shown
+constexpr char kTargetBuffersPropertyName[] = "ro.vendor.evs.display_buffers";
+
+// Arbitrary magic number for self recognition; the buffers take the ids that follow
+constexpr uint32_t kBufferIdBase = 0x3870;
+
 
 EvsGlDisplay::EvsGlDisplay(sp<IAutomotiveDisplayProxyService> pDisplayProxy, uint64_t displayId)
     : mDisplayProxy(pDisplayProxy),
@@ -61,19 +70,11 @@ void EvsGlDisplay::forceShutdown()
     LOG(DEBUG) << "EvsGlDisplay forceShutdown";
     std::lock_guard<std::mutex> lock(mAccessLock);
 
-    // If the buffer isn't being held by a remote client, release it now as an
+    // If the buffers aren't being held by a remote client, release them now as an
     // optimization to release the resources more quickly than the destructor might
     // get called.
-    if (mBuffer.memHandle) {
-        // Report if we're going away while a buffer is outstanding
-        if (mFrameBusy) {
-            LOG(ERROR) << "EvsGlDisplay going down while client is holding a buffer";
-        }
-
-        // Drop the graphics buffer we've been using
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        alloc.free(mBuffer.memHandle);
-        mBuffer.memHandle = nullptr;
+    if (!mBuffers.empty()) {
+        freeBuffers_Locked();
 
         mGlWrapper.hideWindow(mDisplayProxy, mDisplayId);
         mGlWrapper.shutdown();
@@ -170,73 +171,45 @@ Return<void> EvsGlDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb)  {
         return Void();
     }
 
-    // If we don't already have a buffer, allocate one now
-    if (!mBuffer.memHandle) {
-        // Initialize our display window
-        // NOTE:  This will cause the display to become "VISIBLE" before a frame is actually
-        // returned, which is contrary to the spec and will likely result in a black frame being
-        // (briefly) shown.
-        if (!mGlWrapper.initialize(mDisplayProxy, mDisplayId)) {
-            // Report the failure
-            LOG(ERROR) << "Failed to initialize GL display";
-            _hidl_cb({});
-            return Void();
-        }
-
-        // Assemble the buffer description we'll use for our render target
-        mBuffer.width       = mGlWrapper.getWidth();
-        mBuffer.height      = mGlWrapper.getHeight();
-        mBuffer.format      = HAL_PIXEL_FORMAT_RGBA_8888;
-        mBuffer.usage       = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_COMPOSER;
-        mBuffer.bufferId    = 0x3870;  // Arbitrary magic number for self recognition
-        mBuffer.pixelSize   = 4;
+    // If we don't already have buffers, allocate them now
+    if (mBuffers.empty() && !allocateBuffers_Locked()) {
+        _hidl_cb({});
+        return Void();
+    }
 
-        // Allocate the buffer that will hold our displayable image
-        buffer_handle_t handle = nullptr;
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        status_t result = alloc.allocate(mBuffer.width, mBuffer.height,
-                                         mBuffer.format, 1,
-                                         mBuffer.usage, &handle,
-                                         &mBuffer.stride,
-                                         0, "EvsGlDisplay");
-        if (result != NO_ERROR) {
-            LOG(ERROR) << "Error " << result
-                       << " allocating " << mBuffer.width << " x " << mBuffer.height
-                       << " graphics buffer.";
-            _hidl_cb({});
-            mGlWrapper.shutdown();
-            return Void();
-        }
-        if (!handle) {
-            LOG(ERROR) << "We didn't get a buffer handle back from the allocator";
-            _hidl_cb({});
-            mGlWrapper.shutdown();
-            return Void();
+    // Pick the buffer that was shown the longest time ago
+    TargetBuffer* pBuffer = nullptr;
+    for (unsigned i = 0; i < mBuffers.size(); ++i) {
+        auto& candidate = mBuffers[(mNextBuffer + i) % mBuffers.size()];
+        if (!candidate.busy) {
+            pBuffer = &candidate;
+            break;
         }
-
-        mBuffer.memHandle = handle;
-        LOG(DEBUG) << "Allocated new buffer " << mBuffer.memHandle.getNativeHandle()
-                   << " with stride " <<  mBuffer.stride;
-        mFrameBusy = false;
     }
 
     // Do we have a frame available?
-    if (mFrameBusy) {
+    if (pBuffer == nullptr) {
         // This means either we have a 2nd client trying to compete for buffers
         // (an unsupported mode of operation) or else the client hasn't returned
-        // a previously issued buffer yet (they're behaving badly).
+        // previously issued buffers yet (they're behaving badly).
         // NOTE:  We have to make the callback even if we have nothing to provide
         LOG(ERROR) << "getTargetBuffer called while no buffers available.";
         _hidl_cb({});
         return Void();
     } else {
+        // The client may not write the buffer before the GPU is done showing it
+        mGlWrapper.waitForFence(pBuffer->fence);
+        pBuffer->fence = EGL_NO_SYNC_KHR;
+
         // Mark our buffer as busy
-        mFrameBusy = true;
+        pBuffer->busy = true;
+        mNextBuffer = (pBuffer->desc.bufferId - kBufferIdBase + 1) % mBuffers.size();
 
         // Send the buffer to the client
-        LOG(VERBOSE) << "Providing display buffer handle " << mBuffer.memHandle.getNativeHandle()
-                     << " as id " << mBuffer.bufferId;
-        _hidl_cb(mBuffer);
+        LOG(VERBOSE) << "Providing display buffer handle "
+                     << pBuffer->desc.memHandle.getNativeHandle()
+                     << " as id " << pBuffer->desc.bufferId;
+        _hidl_cb(pBuffer->desc);
         return Void();
     }
 }
@@ -256,16 +229,20 @@ Return<EvsResult> EvsGlDisplay::returnTargetBufferForDisplay(const BufferDesc_1_
                    << " called without a valid buffer handle.";
         return EvsResult::INVALID_ARG;
     }
-    if (buffer.bufferId != mBuffer.bufferId) {
-        LOG(ERROR) << "Got an unrecognized frame returned.";
-        return EvsResult::INVALID_ARG;
-    }
-    if (!mFrameBusy) {
-        LOG(ERROR) << "A frame was returned with no outstanding frames.";
-        return EvsResult::BUFFER_NOT_AVAILABLE;
-    }
 
-    mFrameBusy = false;
+    // A buffer we didn't hand out is a camera frame the client passes through untouched, which
+    // saves the client from drawing it into one of ours first
+    TargetBuffer* pTarget = nullptr;
+    if (buffer.bufferId >= kBufferIdBase &&
+        buffer.bufferId - kBufferIdBase < mBuffers.size()) {
+        pTarget = &mBuffers[buffer.bufferId - kBufferIdBase];
+        if (!pTarget->busy) {
+            LOG(ERROR) << "A frame was returned with no outstanding frames.";
+            return EvsResult::BUFFER_NOT_AVAILABLE;
+        }
+
+        pTarget->busy = false;
+    }
 
     // If we've been displaced by another owner of the display, then we can't do anything else
     if (mRequestedState == EvsDisplayState::DEAD) {
@@ -283,15 +260,26 @@ Return<EvsResult> EvsGlDisplay::returnTargetBufferForDisplay(const BufferDesc_1_
         // Not sure why a client would send frames back when we're not visible.
         LOG(WARNING) << "Got a frame returned while not visible - ignoring.";
     } else {
+        // A frame may be passed through before any target buffer was asked for
+        if (mBuffers.empty() && !allocateBuffers_Locked()) {
+            return EvsResult::UNDERLYING_SERVICE_ERROR;
+        }
+
         // Update the texture contents with the provided data
-// TODO:  Why doesn't it work to pass in the buffer handle we got from HIDL?
-//        if (!mGlWrapper.updateImageTexture(buffer)) {
-        if (!mGlWrapper.updateImageTexture(mBuffer)) {
+        if (!mGlWrapper.updateImageTexture(pTarget != nullptr ? pTarget->desc : buffer)) {
             return EvsResult::UNDERLYING_SERVICE_ERROR;
         }
 
-        // Put the image on the screen
-        mGlWrapper.renderImageToScreen();
+        // Put the image on the screen.  A target buffer isn't handed out again before the GPU is
+        // done, but a camera frame goes back to the camera once we return and its handle is
+        // only good for this call.
+        EGLSyncKHR fence = mGlWrapper.renderImageToScreen();
+        if (pTarget != nullptr) {
+            pTarget->fence = fence;
+        } else {
+            mGlWrapper.waitForFence(fence);
+            mGlWrapper.releaseImage(buffer.memHandle.getNativeHandle());
+        }
 #ifdef EVS_DEBUG
         if (!sDebugFirstFrameDisplayed) {
             LOG(DEBUG) << "EvsFirstFrameDisplayTiming start time: "
@@ -306,6 +294,87 @@ Return<EvsResult> EvsGlDisplay::returnTargetBufferForDisplay(const BufferDesc_1_
 }
 
 
+bool EvsGlDisplay::allocateBuffers_Locked() {
+    // Initialize our display window
+    // NOTE:  This will cause the display to become "VISIBLE" before a frame is actually
+    // returned, which is contrary to the spec and will likely result in a black frame being
+    // (briefly) shown.
+    if (!mGlWrapper.initialize(mDisplayProxy, mDisplayId)) {
+        // Report the failure
+        LOG(ERROR) << "Failed to initialize GL display";
+        return false;
+    }
+
+    const unsigned numBuffers =
+            std::max(android::base::GetUintProperty<unsigned>(kTargetBuffersPropertyName, 2,
+                                                              MAX_TARGET_BUFFERS), 1u);
+
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    for (unsigned i = 0; i < numBuffers; ++i) {
+        // Assemble the buffer description we'll use for our render target
+        TargetBuffer target;
+        target.desc.width       = mGlWrapper.getWidth();
+        target.desc.height      = mGlWrapper.getHeight();
+        target.desc.format      = HAL_PIXEL_FORMAT_RGBA_8888;
+        target.desc.usage       = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_COMPOSER;
+        target.desc.bufferId    = kBufferIdBase + i;
+        target.desc.pixelSize   = 4;
+
+        // Allocate the buffer that will hold our displayable image
+        buffer_handle_t handle = nullptr;
+        status_t result = alloc.allocate(target.desc.width, target.desc.height,
+                                         target.desc.format, 1,
+                                         target.desc.usage, &handle,
+                                         &target.desc.stride,
+                                         0, "EvsGlDisplay");
+        if (result != NO_ERROR) {
+            LOG(ERROR) << "Error " << result
+                       << " allocating " << target.desc.width << " x " << target.desc.height
+                       << " graphics buffer.";
+            break;
+        }
+        if (!handle) {
+            LOG(ERROR) << "We didn't get a buffer handle back from the allocator";
+            break;
+        }
+
+        target.desc.memHandle = handle;
+        LOG(DEBUG) << "Allocated new buffer " << target.desc.memHandle.getNativeHandle()
+                   << " with stride " <<  target.desc.stride;
+        mBuffers.emplace_back(std::move(target));
+    }
+
+    // Carry on with fewer buffers unless we got none at all
+    if (mBuffers.empty()) {
+        mGlWrapper.shutdown();
+        return false;
+    }
+
+    mNextBuffer = 0;
+    return true;
+}
+
+
+void EvsGlDisplay::freeBuffers_Locked() {
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    for (auto&& target : mBuffers) {
+        // Report if we're going away while a buffer is outstanding
+        if (target.busy) {
+            LOG(ERROR) << "EvsGlDisplay going down while client is holding a buffer";
+        }
+
+        mGlWrapper.waitForFence(target.fence);
+    }
+
+    // Drop the images wrapping the graphics buffers before the buffers themselves
+    mGlWrapper.releaseImages();
+    for (auto&& target : mBuffers) {
+        alloc.free(target.desc.memHandle);
+    }
+    mBuffers.clear();
+}
+
+
 Return<void> EvsGlDisplay::getDisplayInfo_1_1(getDisplayInfo_1_1_cb _info_cb) {
     if (mDisplayProxy != nullptr) {
         return mDisplayProxy->getDisplayInfo(mDisplayId, _info_cb);
@@ -21,6 +21,8 @@
 #include <android/frameworks/automotive/display/1.0/IAutomotiveDisplayProxyService.h>
 #include <ui/GraphicBuffer.h>
 
+#include <vector>
+
 #include "GlWrapper.h"
 
 using ::android::hardware::automotive::evs::V1_0::EvsResult;
@@ -59,10 +61,27 @@ public:
     void forceShutdown();   // This gets called if another caller "steals" ownership of the display
 
 private:
+    // Arbitrary limit on the number of target buffers, the default being two
+    static constexpr unsigned MAX_TARGET_BUFFERS = 8;
+
+    struct TargetBuffer {
+        BufferDesc_1_0  desc;                       // A graphics buffer into which we'll store images
+        bool            busy  = false;              // Held by the client
+        EGLSyncKHR      fence = EGL_NO_SYNC_KHR;    // Signals once the GPU no longer reads it
+    };
+
+    // Allocates the target buffers along with the GL display
+    bool allocateBuffers_Locked();
+
+    // Waits for the GPU and frees the target buffers
+    void freeBuffers_Locked();
+
     DisplayDesc     mInfo           = {};
-    BufferDesc_1_0  mBuffer         = {};       // A graphics buffer into which we'll store images
 
-    bool            mFrameBusy      = false;    // A flag telling us our buffer is in use
+    // Target buffers are handed out in turn, so the one the GPU is least likely to be still
+    // reading goes out next
+    std::vector<TargetBuffer> mBuffers;
+    unsigned        mNextBuffer     = 0;
     EvsDisplayState mRequestedState = EvsDisplayState::NOT_VISIBLE;
 
     GlWrapper       mGlWrapper;
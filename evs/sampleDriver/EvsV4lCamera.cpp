@@ -14,15 +14,27 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+
 #include "EvsV4lCamera.h"
 #include "EvsEnumerator.h"
 #include "bufferCopy.h"
 
 #include <android/hardware_buffer.h>
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include <linux/dma-buf.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
 
 
 namespace android {
@@ -35,9 +47,30 @@ namespace implementation {
 // Default camera output image resolution
 const std::array<int32_t, 2> kDefaultResolution = {640, 480};
 
-// Arbitrary limit on number of graphics buffers allowed to be allocated
-// Safeguards against unreasonable resource consumption and provides a testable limit
-static const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
+// Number of V4L2 buffers to capture into; deeper queues let capture overlap the conversion
+constexpr char kCaptureBuffersPropertyName[] = "ro.vendor.evs.v4l2_capture_buffers";
+
+// Whether to capture straight into our graphics buffers when no conversion is needed
+constexpr char kZeroCopyPropertyName[] = "ro.vendor.evs.v4l2_zero_copy";
+
+// V4L2 memory-to-memory JPEG decoder for the frames of MJPEG cameras; unset to decode on the CPU
+constexpr char kJpegDecoderPropertyName[] = "ro.vendor.evs.jpeg_decoder";
+
+
+// Brackets CPU access to a buffer that stays mapped so its contents are coherent with the
+// devices that read it.  Buffers that aren't dma-bufs need no such care.
+static void syncBuffer(buffer_handle_t handle, uint64_t flags) {
+    if (handle->numFds < 1) {
+        return;
+    }
+
+    struct dma_buf_sync sync = {};
+    sync.flags = flags;
+    if (TEMP_FAILURE_RETRY(ioctl(handle->data[0], DMA_BUF_IOCTL_SYNC, &sync)) < 0 &&
+        errno != ENOTTY) {
+        PLOG(WARNING) << "Failed to sync a camera frame buffer";
+    }
+}
 
 EvsV4lCamera::EvsV4lCamera(const char *deviceName,
                            unique_ptr<ConfigManager::CameraInfo> &camInfo) :
@@ -85,16 +118,27 @@ void EvsV4lCamera::shutdown()
     mVideo.close();
 
     // Drop all the graphics buffers we've been using
-    if (mBuffers.size() > 0) {
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        for (auto&& rec : mBuffers) {
+    if (mNumBuffers > 0) {
+        uint32_t slot;
+        while (mFreeSlots.pop(&slot)) {
+            // Empty the list; every slot is released below
+        }
+
+        for (unsigned i = 0; i < mNumBuffers; ++i) {
+            auto&& rec = mBuffers[i];
             if (rec.inUse) {
                 LOG(WARNING) << "Releasing buffer despite remote ownership";
             }
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+            if (rec.handle != nullptr) {
+                freeBuffer_Locked(rec);
+            }
+            rec.inUse = false;
         }
-        mBuffers.clear();
+        mNumBuffers = 0;
+        mEmptySlots.clear();
+        mFramesAllowed = 0;
+        mFramesInUse = 0;
+        mFramesTarget = 0;
     }
 }
 
@@ -162,9 +206,17 @@ Return<EvsResult> EvsV4lCamera::startVideoStream(const sp<IEvsCameraStream_1_0>&
     LOG(INFO) << "Configuring to accept " << (char*)&videoSrcFormat
               << " camera data and convert to " << std::hex << mFormat;
 
+    mGpuConversion = mGpuConverter != nullptr &&
+                     GpuConverter::isSupported(videoSrcFormat, mFormat);
+    mFillBufferFromVideo = nullptr;
+
+    // MJPEG frames are converted once the hardware decoder has turned them into YUYV
+    const uint32_t fillSrcFormat =
+            mJpegDecoder != nullptr ? (uint32_t)V4L2_PIX_FMT_YUYV : videoSrcFormat;
+
     switch (mFormat) {
     case HAL_PIXEL_FORMAT_YCRCB_420_SP:
-        switch (videoSrcFormat) {
+        switch (fillSrcFormat) {
         case V4L2_PIX_FMT_NV21:     mFillBufferFromVideo = fillNV21FromNV21;    break;
         case V4L2_PIX_FMT_YUYV:     mFillBufferFromVideo = fillNV21FromYUYV;    break;
         default:
@@ -177,14 +229,14 @@ Return<EvsResult> EvsV4lCamera::startVideoStream(const sp<IEvsCameraStream_1_0>&
         }
         break;
     case HAL_PIXEL_FORMAT_RGBA_8888:
-        switch (videoSrcFormat) {
+        switch (fillSrcFormat) {
         case V4L2_PIX_FMT_YUYV:     mFillBufferFromVideo = fillRGBAFromYUYV;    break;
         default:
             LOG(ERROR) << "Unhandled camera format " << (char*)&videoSrcFormat;
         }
         break;
     case HAL_PIXEL_FORMAT_YCBCR_422_I:
-        switch (videoSrcFormat) {
+        switch (fillSrcFormat) {
         case V4L2_PIX_FMT_YUYV:     mFillBufferFromVideo = fillYUYVFromYUYV;    break;
         case V4L2_PIX_FMT_UYVY:     mFillBufferFromVideo = fillYUYVFromUYVY;    break;
         default:
@@ -200,11 +252,17 @@ Return<EvsResult> EvsV4lCamera::startVideoStream(const sp<IEvsCameraStream_1_0>&
     mStream = stream;
     mStream_1_1 = IEvsCameraStream_1_1::castFrom(mStream).withDefault(nullptr);
 
+    const unsigned numCaptureBuffers =
+            android::base::GetUintProperty<unsigned>(kCaptureBuffersPropertyName,
+                                                     VideoCapture::kDefaultNumBuffers,
+                                                     VideoCapture::kMaxNumBuffers);
+
     // Set up the video stream with a callback to our member function forwardFrame()
-    if (!mVideo.startStream([this](VideoCapture*, imageBuffer* tgt, void* data) {
-                                this->forwardFrame(tgt, data);
-                            })
-    ) {
+    auto callback = [this](VideoCapture*, imageBuffer* tgt, void* data) {
+        this->forwardFrame(tgt, data);
+    };
+    if (!startZeroCopyStream_Locked(callback) &&
+        !mVideo.startStream(callback, numCaptureBuffers)) {
         // No need to hold onto this if we failed to start
         mStream = nullptr;
         mStream_1_1 = nullptr;
@@ -230,6 +288,36 @@ Return<void> EvsV4lCamera::stopVideoStream()  {
     // Tell the capture device to stop (and block until it does)
     mVideo.stopStream();
 
+    if (mGpuConverter != nullptr) {
+        // The capture buffers are gone
+        mGpuConverter->releaseBuffers();
+    }
+
+    if (mZeroCopy) {
+        // Our buffers are ours alone again, so release any we kept for the driver after the
+        // client asked for fewer
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        // Idle buffers go back on the free list.  The ones the client still holds join it
+        // when they are returned, which waits for mAccessLock until mZeroCopy is cleared.
+        unsigned numBuffers = 0;
+        for (unsigned i = 0; i < mNumBuffers; ++i) {
+            if (mBuffers[i].handle != nullptr) {
+                ++numBuffers;
+                if (!mBuffers[i].inUse) {
+                    mFreeSlots.push(i);
+                }
+            }
+        }
+        mZeroCopy = false;
+
+        if (numBuffers > mFramesAllowed) {
+            const unsigned framesAllowed = mFramesAllowed;
+            mFramesAllowed = numBuffers;
+            decreaseAvailableFrames_Locked(numBuffers - framesAllowed);
+        }
+    }
+
     if (mStream_1_1 != nullptr) {
         // V1.1 client is waiting on STREAM_STOPPED event.
         std::unique_lock <std::mutex> lock(mAccessLock);
@@ -428,18 +516,78 @@ Return<void> EvsV4lCamera::getIntParameter(CameraParam id,
 
 Return<EvsResult> EvsV4lCamera::setExtendedInfo_1_1(uint32_t opaqueIdentifier,
                                                     const hidl_vec<uint8_t>& opaqueValue) {
+    if (opaqueIdentifier == kFrameRateHintId) {
+        // Runs the sensor no faster than the clients of the manager consume frames
+        int32_t framesPerSecond = 0;
+        if (opaqueValue.size() != sizeof(framesPerSecond)) {
+            return EvsResult::INVALID_ARG;
+        }
+        memcpy(&framesPerSecond, opaqueValue.data(), sizeof(framesPerSecond));
+
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (!mVideo.isOpen()) {
+            LOG(WARNING) << "Ignoring a frame rate hint when camera has been lost.";
+            return EvsResult::OWNERSHIP_LOST;
+        }
+        if (!mVideo.setFrameRate(std::max(framesPerSecond, 0))) {
+            // Not an error; the sensor just keeps running at its own rate
+            LOG(DEBUG) << "Frame rate hint of " << framesPerSecond << " fps not applied";
+        }
+    }
+
+    if (opaqueIdentifier == kParameterBatchId) {
+        return setParameterBatch(opaqueValue);
+    }
+
     mExtInfo.insert_or_assign(opaqueIdentifier, opaqueValue);
     return EvsResult::OK;
 }
 
 
+EvsResult EvsV4lCamera::setParameterBatch(const hidl_vec<uint8_t>& opaqueValue) {
+    constexpr size_t kEntrySize = 2 * sizeof(int32_t);
+    if (opaqueValue.size() == 0 || opaqueValue.size() % kEntrySize != 0) {
+        return EvsResult::INVALID_ARG;
+    }
+
+    std::vector<v4l2_ext_control> controls(opaqueValue.size() / kEntrySize);
+    for (size_t i = 0; i < controls.size(); ++i) {
+        int32_t entry[2];
+        memcpy(entry, opaqueValue.data() + i * kEntrySize, kEntrySize);
+        if (!convertToV4l2CID(static_cast<CameraParam>(entry[0]), controls[i].id)) {
+            return EvsResult::INVALID_ARG;
+        }
+        controls[i].value = entry[1];
+    }
+
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    if (!mVideo.isOpen()) {
+        LOG(WARNING) << "Ignoring a parameter batch when camera has been lost.";
+        return EvsResult::OWNERSHIP_LOST;
+    }
+    if (mVideo.setParameters(controls) < 0) {
+        return EvsResult::UNDERLYING_SERVICE_ERROR;
+    }
+
+    // Keeps the applied values for the manager to read back
+    std::vector<uint8_t> applied = opaqueValue;
+    for (size_t i = 0; i < controls.size(); ++i) {
+        memcpy(applied.data() + i * kEntrySize + sizeof(int32_t), &controls[i].value,
+               sizeof(int32_t));
+    }
+    mExtInfo.insert_or_assign(kParameterBatchId, std::move(applied));
+    return EvsResult::OK;
+}
+
+
 Return<void> EvsV4lCamera::getExtendedInfo_1_1(uint32_t opaqueIdentifier,
                                                getExtendedInfo_1_1_cb _hidl_cb) {
     const auto it = mExtInfo.find(opaqueIdentifier);
     hidl_vec<uint8_t> value;
     auto status = EvsResult::OK;
     if (it == mExtInfo.end()) {
-        status = EvsResult::INVALID_ARG;
+        // Batches are taken before any was set
+        status = opaqueIdentifier == kParameterBatchId ? EvsResult::OK : EvsResult::INVALID_ARG;
     } else {
         value = mExtInfo[opaqueIdentifier];
     }
@@ -473,13 +621,13 @@ EvsV4lCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& buffers,
         std::scoped_lock<std::mutex> lock(mAccessLock);
 
         if (numBuffersToAdd > (MAX_BUFFERS_IN_FLIGHT - mFramesAllowed)) {
-            numBuffersToAdd -= (MAX_BUFFERS_IN_FLIGHT - mFramesAllowed);
+            numBuffersToAdd = MAX_BUFFERS_IN_FLIGHT - mFramesAllowed;
             LOG(WARNING) << "Exceed the limit on number of buffers.  "
                          << numBuffersToAdd << " buffers will be added only.";
         }
 
         GraphicBufferMapper& mapper = GraphicBufferMapper::get();
-        const auto before = mFramesAllowed;
+        const unsigned before = mFramesAllowed;
         for (auto i = 0; i < numBuffersToAdd; ++i) {
             // TODO: reject if external buffer is configured differently.
             auto& b = buffers[i];
@@ -501,24 +649,13 @@ EvsV4lCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& buffers,
                 continue;
             }
 
-            auto stored = false;
-            for (auto&& rec : mBuffers) {
-                if (rec.handle == nullptr) {
-                    // Use this existing entry
-                    rec.handle = memHandle;
-                    rec.inUse = false;
-
-                    stored = true;
-                    break;
-                }
-            }
-
-            if (!stored) {
-                // Add a BufferRecord wrapping this handle to our set of available buffers
-                mBuffers.emplace_back(memHandle);
+            if (!addBuffer_Locked(memHandle)) {
+                mapper.freeBuffer(memHandle);
+                break;
             }
 
             ++mFramesAllowed;
+            ++mFramesTarget;
         }
 
         _hidl_cb(EvsResult::OK, mFramesAllowed - before);
@@ -529,38 +666,52 @@ EvsV4lCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& buffers,
 
 EvsResult EvsV4lCamera::doneWithFrame_impl(const uint32_t bufferId,
                                            const buffer_handle_t memHandle) {
-    std::lock_guard <std::mutex> lock(mAccessLock);
-
     // If we've been displaced by another owner of the camera, then we can't do anything else
     if (!mVideo.isOpen()) {
         LOG(WARNING) << "Ignoring doneWithFrame call when camera has been lost.";
-    } else {
-        if (memHandle == nullptr) {
-            LOG(ERROR) << "Ignoring doneWithFrame called with null handle";
-        } else if (bufferId >= mBuffers.size()) {
-            LOG(ERROR) << "Ignoring doneWithFrame called with invalid bufferId " << bufferId
-                       << " (max is " << mBuffers.size() - 1 << ")";
-        } else if (!mBuffers[bufferId].inUse) {
+    } else if (memHandle == nullptr) {
+        LOG(ERROR) << "Ignoring doneWithFrame called with null handle";
+    } else if (bufferId >= mNumBuffers) {
+        LOG(ERROR) << "Ignoring doneWithFrame called with invalid bufferId " << bufferId
+                   << " (max is " << mNumBuffers - 1 << ")";
+    } else if (mZeroCopy) {
+        // The buffer is pinned to a capture buffer of the driver; mAccessLock keeps the stream
+        // from leaving zero-copy mode under us
+        std::lock_guard <std::mutex> lock(mAccessLock);
+        if (!mBuffers[bufferId].inUse.exchange(false)) {
             LOG(ERROR) << "Ignoring doneWithFrame called on frame " << bufferId
                        << " which is already free";
+        } else if (mZeroCopy) {
+            // Let the driver capture into this buffer again; its index must not change
+            mFramesInUse--;
+            mVideo.markFrameConsumed(bufferId);
         } else {
-            // Mark the frame as available
-            mBuffers[bufferId].inUse = false;
             mFramesInUse--;
-
-            // If this frame's index is high in the array, try to move it down
-            // to improve locality after mFramesAllowed has been reduced.
-            if (bufferId >= mFramesAllowed) {
-                // Find an empty slot lower in the array (which should always exist in this case)
-                for (auto&& rec : mBuffers) {
-                    if (rec.handle == nullptr) {
-                        rec.handle = mBuffers[bufferId].handle;
-                        mBuffers[bufferId].handle = nullptr;
-                        break;
-                    }
-                }
+            mFreeSlots.push(bufferId);
+        }
+    } else if (!mBuffers[bufferId].inUse.exchange(false)) {
+        LOG(ERROR) << "Ignoring doneWithFrame called on frame " << bufferId
+                   << " which is already free";
+    } else if (mFramesAllowed > mFramesTarget) {
+        // The pool was shrunk while this buffer was out, so release it rather than reuse it.
+        // The slot is not on the free list, so the capture thread can't be filling it.
+        std::lock_guard <std::mutex> lock(mAccessLock);
+        mFramesInUse--;
+        if (mFramesAllowed > mFramesTarget) {
+            LOG(DEBUG) << "Releasing returned buffer " << bufferId << " to shrink the pool";
+            freeBuffer_Locked(mBuffers[bufferId]);
+            mEmptySlots.emplace_back(bufferId);
+            mFramesAllowed--;
+            if (mGpuConverter != nullptr) {
+                mGpuConverter->invalidate();
             }
+        } else {
+            mFreeSlots.push(bufferId);
         }
+    } else {
+        // Mark the frame as available
+        mFramesInUse--;
+        mFreeSlots.push(bufferId);
     }
 
     return EvsResult::OK;
@@ -577,6 +728,14 @@ bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
         return false;
     }
 
+    if (mZeroCopy) {
+        if (!setAvailableZeroCopyFrames_Locked(bufferCount)) {
+            return false;
+        }
+        mFramesTarget = bufferCount;
+        return true;
+    }
+
     // Is an increase required?
     if (mFramesAllowed < bufferCount) {
         // An increase is required
@@ -597,13 +756,49 @@ bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
 
         unsigned released = decreaseAvailableFrames_Locked(framesToRelease);
         if (released != framesToRelease) {
-            // This shouldn't happen with a properly behaving client because the client
-            // should only make this call after returning sufficient outstanding buffers
-            // to allow a clean resize.
-            LOG(ERROR) << "Buffer queue shrink failed -- too many buffers currently in use?";
+            // The buffers still in use are released as they come back
+            LOG(INFO) << framesToRelease - released
+                      << " buffers in use will be released when they are returned";
         }
     }
 
+    mFramesTarget = bufferCount;
+    return true;
+}
+
+
+bool EvsV4lCamera::setAvailableZeroCopyFrames_Locked(unsigned bufferCount) {
+    // Our buffers are queued to the driver until the stream stops, so none of them can be
+    // released or moved; we only lend fewer of them to the client for now.
+    unsigned numBuffers = 0;
+    for (unsigned i = 0; i < mNumBuffers; ++i) {
+        if (mBuffers[i].handle != nullptr) {
+            ++numBuffers;
+        }
+    }
+    if (bufferCount <= numBuffers) {
+        LOG(INFO) << "Lending " << bufferCount << " of " << numBuffers
+                  << " camera frame buffers";
+        mFramesAllowed = bufferCount;
+        return true;
+    }
+
+    // New buffers are appended and become capture buffers when the stream restarts
+    mFramesAllowed = numBuffers;
+    const unsigned needed = bufferCount - numBuffers;
+    LOG(INFO) << "Allocating " << needed << " buffers for camera frames";
+
+    unsigned added = increaseAvailableFrames_Locked(needed);
+    if (added != needed) {
+        LOG(ERROR) << "Rolling back to previous frame queue size";
+        for (; added > 0; --added) {
+            // The new buffers were appended and haven't been handed out
+            freeBuffer_Locked(mBuffers[--mNumBuffers]);
+            mFramesAllowed--;
+        }
+        return false;
+    }
+
     return true;
 }
 
@@ -642,19 +837,9 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
         }
 
         // Find a place to store the new buffer
-        bool stored = false;
-        for (auto&& rec : mBuffers) {
-            if (rec.handle == nullptr) {
-                // Use this existing entry
-                rec.handle = memHandle;
-                rec.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-        if (!stored) {
-            // Add a BufferRecord wrapping this handle to our set of available buffers
-            mBuffers.emplace_back(memHandle);
+        if (!addBuffer_Locked(memHandle)) {
+            alloc.free(memHandle);
+            break;
         }
 
         mFramesAllowed++;
@@ -666,24 +851,20 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
 
 
 unsigned EvsV4lCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
-    // Acquire the graphics buffer allocator
-    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
-
     unsigned removed = 0;
 
-    for (auto&& rec : mBuffers) {
-        // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
-            // Release buffer and update the record so we can recognize it as "empty"
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+    // Only idle buffers are on the free list, and popping one keeps the capture thread off it
+    uint32_t slot;
+    while (removed < numToRemove && mFreeSlots.pop(&slot)) {
+        // Release buffer and update the record so we can recognize it as "empty"
+        freeBuffer_Locked(mBuffers[slot]);
+        mEmptySlots.emplace_back(slot);
 
-            mFramesAllowed--;
-            removed++;
+        mFramesAllowed--;
+        removed++;
 
-            if (removed == numToRemove) {
-                break;
-            }
+        if (mGpuConverter != nullptr) {
+            mGpuConverter->invalidate();
         }
     }
 
@@ -691,38 +872,107 @@ unsigned EvsV4lCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
 }
 
 
+bool EvsV4lCamera::addBuffer_Locked(buffer_handle_t handle) {
+    uint32_t slot;
+    if (!mEmptySlots.empty()) {
+        // Reuse an existing entry
+        slot = mEmptySlots.back();
+        mEmptySlots.pop_back();
+    } else if (mNumBuffers < MAX_BUFFERS_IN_FLIGHT) {
+        slot = mNumBuffers;
+    } else {
+        LOG(ERROR) << "No room for another buffer";
+        return false;
+    }
+
+    // Map the buffer for as long as we hold it; the frames converted on the CPU then only
+    // need their caches synced instead of a lock and an unlock each
+    void* pixels = nullptr;
+    status_t result =
+        GraphicBufferMapper::get().lock(handle,
+                                        GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                                        android::Rect(mVideo.getWidth(), mVideo.getHeight()),
+                                        &pixels);
+    if (result != NO_ERROR || pixels == nullptr) {
+        LOG(WARNING) << "Failed to map a camera frame buffer; it will be locked for each frame";
+        pixels = nullptr;
+    }
+
+    mBuffers[slot].handle = handle;
+    mBuffers[slot].pixels = pixels;
+    mBuffers[slot].inUse = false;
+    if (slot == mNumBuffers) {
+        mNumBuffers++;
+    }
+
+    // Buffers become capture buffers when a zero-copy stream restarts instead
+    if (!mZeroCopy) {
+        mFreeSlots.push(slot);
+    }
+
+    return true;
+}
+
+
+void EvsV4lCamera::freeBuffer_Locked(BufferRecord& rec) {
+    if (rec.pixels != nullptr) {
+        GraphicBufferMapper::get().unlock(rec.handle);
+        rec.pixels = nullptr;
+    }
+
+    GraphicBufferAllocator::get().free(rec.handle);
+    rec.handle = nullptr;
+}
+
+
 // This is the async callback from the video camera that tells us a frame is ready
 void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
+    ATRACE_CALL();
+
     bool readyForFrame = false;
+    bool zeroCopy = false;
     size_t idx = 0;
 
-    // Lock scope for updating shared state
-    {
-        std::lock_guard<std::mutex> lock(mAccessLock);
-
-        // Are we allowed to issue another buffer?
-        if (mFramesInUse >= mFramesAllowed) {
+    // V4L2 stamps frames with the monotonic clock when they are captured
+    FrameLatencyStats::FrameTiming timing = {};
+    nsecs_t stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    timing[FrameLatencyStats::DEQUEUE] =
+        stageStart - (pV4lBuff->timestamp.tv_sec * 1000000000LL +
+                      pV4lBuff->timestamp.tv_usec * 1000LL);
+    auto endStage = [&timing, &stageStart](FrameLatencyStats::Stage stage) {
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        timing[stage] += now - stageStart;
+        stageStart = now;
+    };
+
+    // mZeroCopy only changes while the stream is stopped
+    zeroCopy = mZeroCopy;
+    if (zeroCopy) {
+        // The frame has been captured straight into the buffer of the same index
+        idx = pV4lBuff->index;
+        if (++mFramesInUse > mFramesAllowed) {
             // Can't do anything right now -- skip this frame
+            mFramesInUse--;
             LOG(WARNING) << "Skipped a frame because too many are in flight";
+        } else if (idx >= mNumBuffers || mBuffers[idx].handle == nullptr ||
+                   mBuffers[idx].inUse.exchange(true)) {
+            mFramesInUse--;
+            LOG(ERROR) << "Captured into an unexpected buffer " << idx;
         } else {
-            // Identify an available buffer to fill
-            for (idx = 0; idx < mBuffers.size(); idx++) {
-                if (!mBuffers[idx].inUse) {
-                    if (mBuffers[idx].handle != nullptr) {
-                        // Found an available record, so stop looking
-                        break;
-                    }
-                }
-            }
-            if (idx >= mBuffers.size()) {
-                // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
-                LOG(ERROR) << "Failed to find an available buffer slot";
-            } else {
-                // We're going to make the frame busy
-                mBuffers[idx].inUse = true;
-                mFramesInUse++;
-                readyForFrame = true;
-            }
+            readyForFrame = true;
+        }
+    } else {
+        // Take an available buffer to fill; there is none if the client holds all of them
+        uint32_t slot;
+        if (!mFreeSlots.pop(&slot)) {
+            // Can't do anything right now -- skip this frame
+            LOG(WARNING) << "Skipped a frame because too many are in flight";
+        } else {
+            // We're going to make the frame busy
+            idx = slot;
+            mBuffers[idx].inUse = true;
+            mFramesInUse++;
+            readyForFrame = true;
         }
     }
 
@@ -747,47 +997,107 @@ void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
         bufDesc_1_1.timestamp =
             pV4lBuff->timestamp.tv_sec * 1e+6 + pV4lBuff->timestamp.tv_usec;
 
-        // Lock our output buffer for writing
-        // TODO(b/145459970): Sometimes, physical camera device maps a buffer
-        // into the address that is about to be unmapped by another device; this
-        // causes SEGV_MAPPER.
-        void *targetPixels = nullptr;
-        GraphicBufferMapper &mapper = GraphicBufferMapper::get();
-        status_t result =
-            mapper.lock(bufDesc_1_1.buffer.nativeHandle,
-                        GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
-                        android::Rect(pDesc->width, pDesc->height),
-                        (void **)&targetPixels);
-
-        // If we failed to lock the pixel buffer, we're about to crash, but log it first
-        if (!targetPixels) {
-            // TODO(b/145457727): When EvsHidlTest::CameraToDisplayRoundTrip
-            // test case was repeatedly executed, EVS occasionally fails to map
-            // a buffer.
-            LOG(ERROR) << "Camera failed to gain access to image buffer for writing - "
-                       << " status: " << statusToString(result)
-                       << " , error: " << strerror(errno);
-        }
-
-        // Transfer the video image into the output buffer, making any needed
-        // format conversion along the way
-        mFillBufferFromVideo(bufDesc_1_1, (uint8_t *)targetPixels, pData, mVideo.getStride());
-
-        // Unlock the output buffer
-        mapper.unlock(bufDesc_1_1.buffer.nativeHandle);
-
-        // Give the video frame back to the underlying device for reuse
-        // Note that we do this before making the client callback to give the
-        // underlying camera more time to capture the next frame
-        mVideo.markFrameConsumed(pV4lBuff->index);
+        if (!zeroCopy) {
+            // Render on the GPU if we can; convert on the CPU otherwise
+            bool converted = false;
+            if (mGpuConversion) {
+                ATRACE_NAME("EvsV4lCamera::convertOnGpu");
+                stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+                converted = mGpuConverter->convert(mVideo, pV4lBuff->index, bufDesc_1_1);
+                endStage(FrameLatencyStats::CONVERT);
+            }
+            if (!converted && mFillBufferFromVideo != nullptr) {
+                // MJPEG frames are decoded into YUYV on the hardware decoder if there is one
+                void* srcData = pData;
+                unsigned srcStride = mVideo.getStride();
+                if (mJpegDecoder != nullptr) {
+                    ATRACE_NAME("EvsV4lCamera::decode");
+                    stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+                    srcData = const_cast<void*>(
+                            mJpegDecoder->decodeToYuyv(pData, pV4lBuff->bytesused, &srcStride));
+                    endStage(FrameLatencyStats::CONVERT);
+                }
+
+                stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+                ATRACE_BEGIN("EvsV4lCamera::lockBuffer");
+                const BufferRecord& rec = mBuffers[idx];
+                void *targetPixels = rec.pixels;
+                GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+                if (targetPixels != nullptr) {
+                    // Mapped since we got the buffer
+                    syncBuffer(rec.handle, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+                } else {
+                    // Lock our output buffer for writing
+                    // TODO(b/145459970): Sometimes, physical camera device maps a buffer
+                    // into the address that is about to be unmapped by another device; this
+                    // causes SEGV_MAPPER.
+                    status_t result =
+                        mapper.lock(bufDesc_1_1.buffer.nativeHandle,
+                                    GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                                    android::Rect(pDesc->width, pDesc->height),
+                                    (void **)&targetPixels);
+
+                    // If we failed to lock the pixel buffer, we're about to crash, but log it
+                    // first
+                    if (!targetPixels) {
+                        // TODO(b/145457727): When EvsHidlTest::CameraToDisplayRoundTrip
+                        // test case was repeatedly executed, EVS occasionally fails to map
+                        // a buffer.
+                        LOG(ERROR) << "Camera failed to gain access to image buffer for writing - "
+                                   << " status: " << statusToString(result)
+                                   << " , error: " << strerror(errno);
+                    }
+                }
+                ATRACE_END();
+                endStage(FrameLatencyStats::LOCK);
+
+                // Transfer the video image into the output buffer, making any needed
+                // format conversion along the way
+                ATRACE_BEGIN("EvsV4lCamera::convert");
+                auto convert = [&](unsigned firstRow, unsigned lastRow) {
+                    mFillBufferFromVideo(bufDesc_1_1, (uint8_t *)targetPixels, srcData,
+                                         srcStride, firstRow, lastRow);
+                };
+                if (srcData == nullptr) {
+                    // Without a hardware decoder, the CPU decodes right into the buffer
+                    if (targetPixels != nullptr) {
+                        mJpegDecoder->decodeInto(pData, pV4lBuff->bytesused, bufDesc_1_1,
+                                                 (uint8_t *)targetPixels);
+                    }
+                } else if (mConversionPool != nullptr) {
+                    mConversionPool->run(pDesc->height, convert);
+                } else {
+                    convert(0, pDesc->height);
+                }
+                ATRACE_END();
+                endStage(FrameLatencyStats::CONVERT);
+
+                // Flush or unlock the output buffer
+                ATRACE_BEGIN("EvsV4lCamera::unlockBuffer");
+                if (rec.pixels != nullptr) {
+                    syncBuffer(rec.handle, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+                } else {
+                    mapper.unlock(bufDesc_1_1.buffer.nativeHandle);
+                }
+                ATRACE_END();
+                endStage(FrameLatencyStats::UNLOCK);
+            }
+
+            // Give the video frame back to the underlying device for reuse
+            // Note that we do this before making the client callback to give the
+            // underlying camera more time to capture the next frame
+            mVideo.markFrameConsumed(pV4lBuff->index);
+        }
 
         // Issue the (asynchronous) callback to the client -- can't be holding
         // the lock
         bool flag = false;
+        stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
         if (mStream_1_1 != nullptr) {
             hidl_vec<BufferDesc_1_1> frames;
             frames.resize(1);
             frames[0] = bufDesc_1_1;
+            ATRACE_NAME("IEvsCameraStream::deliverFrame_1_1");
             auto result = mStream_1_1->deliverFrame_1_1(frames);
             flag = result.isOk();
         } else {
@@ -802,11 +1112,14 @@ void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
                 bufDesc_1_1.buffer.nativeHandle
             };
 
+            ATRACE_NAME("IEvsCameraStream::deliverFrame");
             auto result = mStream->deliverFrame(bufDesc_1_0);
             flag = result.isOk();
         }
+        endStage(FrameLatencyStats::DELIVER);
 
         if (flag) {
+            mLatencyStats.record(timing);
             LOG(DEBUG) << "Delivered " << bufDesc_1_1.buffer.nativeHandle.getNativeHandle()
                        << " as id " << bufDesc_1_1.bufferId;
         } else {
@@ -817,15 +1130,88 @@ void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
             LOG(ERROR) << "Frame delivery call failed in the transport layer.";
 
             // Since we didn't actually deliver it, mark the frame as available
-            std::lock_guard<std::mutex> lock(mAccessLock);
             mBuffers[idx].inUse = false;
-
             mFramesInUse--;
+            if (zeroCopy) {
+                mVideo.markFrameConsumed(pV4lBuff->index);
+            } else {
+                mFreeSlots.push(idx);
+            }
         }
     }
 }
 
 
+std::string EvsV4lCamera::dumpLatency(const char* indent) const {
+    return mLatencyStats.toString(indent);
+}
+
+
+bool EvsV4lCamera::startZeroCopyStream_Locked(
+        std::function<void(VideoCapture*, imageBuffer*, void*)> callback) {
+    if (!android::base::GetBoolProperty(kZeroCopyPropertyName, true)) {
+        return false;
+    }
+
+    // Only when the camera produces our output format as is
+    const uint32_t videoSrcFormat = mVideo.getV4LFormat();
+    unsigned bytesPerPixel = 0;
+    if (mFormat == HAL_PIXEL_FORMAT_YCBCR_422_I && videoSrcFormat == V4L2_PIX_FMT_YUYV) {
+        bytesPerPixel = 2;
+    } else if (mFormat == HAL_PIXEL_FORMAT_YCRCB_420_SP && videoSrcFormat == V4L2_PIX_FMT_NV21) {
+        bytesPerPixel = 1;
+    } else {
+        return false;
+    }
+
+    // The rows have to be laid out alike, too
+    if (mStride * bytesPerPixel != mVideo.getStride()) {
+        LOG(INFO) << "Copying frames because the buffer stride " << mStride
+                  << " doesn't match the camera stride " << mVideo.getStride();
+        return false;
+    }
+
+    // Each of our buffers becomes the capture buffer of the same index
+    if (mNumBuffers == 0 || mNumBuffers > VideoCapture::kMaxNumBuffers) {
+        return false;
+    }
+
+    std::vector<int> dmaBufFds;
+    for (unsigned i = 0; i < mNumBuffers; ++i) {
+        auto&& rec = mBuffers[i];
+        if (rec.handle == nullptr || rec.inUse || rec.handle->numFds < 1) {
+            return false;
+        }
+
+        // Gralloc keeps the dma-buf of a buffer as its first file descriptor
+        dmaBufFds.emplace_back(rec.handle->data[0]);
+    }
+
+    // The driver picks the buffers from now on, so take them all off the free list before
+    // the first frame arrives.  One may be missing if the client is returning it right now.
+    std::vector<uint32_t> freeSlots;
+    uint32_t slot;
+    while (mFreeSlots.pop(&slot)) {
+        freeSlots.emplace_back(slot);
+    }
+    if (freeSlots.size() == mNumBuffers) {
+        mZeroCopy = true;
+        if (mVideo.startStream(callback, dmaBufFds)) {
+            LOG(INFO) << "Capturing straight into " << dmaBufFds.size() << " graphics buffers";
+            return true;
+        }
+
+        LOG(INFO) << "Copying frames because the camera can't capture into our buffers";
+        mZeroCopy = false;
+    }
+
+    for (auto&& freeSlot : freeSlots) {
+        mFreeSlots.push(freeSlot);
+    }
+    return false;
+}
+
+
 bool EvsV4lCamera::convertToV4l2CID(CameraParam id, uint32_t& v4l2cid) {
     switch (id) {
         case CameraParam::BRIGHTNESS:
@@ -944,6 +1330,41 @@ sp<EvsV4lCamera> EvsV4lCamera::Create(const char *deviceName,
                          GRALLOC_USAGE_SW_READ_RARELY |
                          GRALLOC_USAGE_SW_WRITE_OFTEN;
 
+    // Spread the conversion of each frame across threads if configured so
+    if (camInfo != nullptr && camInfo->conversionThreads > 1) {
+        evsCamera->mConversionPool =
+            std::make_unique<ConversionPool>(camInfo->conversionThreads);
+    }
+
+    // Decode the frames of MJPEG cameras, on the hardware decoder if the platform names one
+    if (evsCamera->mVideo.getV4LFormat() == V4L2_PIX_FMT_MJPEG) {
+        if (!JpegDecoder::isSupported(evsCamera->mFormat)) {
+            LOG(ERROR) << "MJPEG frames can't be decoded into format " << evsCamera->mFormat;
+        } else {
+            evsCamera->mJpegDecoder = std::make_unique<JpegDecoder>();
+            const std::string decoderName =
+                    android::base::GetProperty(kJpegDecoderPropertyName, "");
+            if (!decoderName.empty() &&
+                !evsCamera->mJpegDecoder->openHardwareDecoder(decoderName.c_str(),
+                                                              evsCamera->mVideo.getWidth(),
+                                                              evsCamera->mVideo.getHeight())) {
+                LOG(WARNING) << "Decoding MJPEG frames on the CPU";
+            }
+        }
+    }
+
+    // Convert on the GPU if configured so and the GPU is usable
+    if (camInfo != nullptr && camInfo->gpuConversion) {
+        evsCamera->mGpuConverter = std::make_unique<GpuConverter>();
+        if (!evsCamera->mGpuConverter->initialize()) {
+            LOG(WARNING) << "Converting frames on the CPU since the GPU can't be used";
+            evsCamera->mGpuConverter = nullptr;
+        } else {
+            // The GPU renders into our buffers
+            evsCamera->mUsage |= GRALLOC_USAGE_HW_RENDER;
+        }
+    }
+
     return evsCamera;
 }
 
@@ -24,12 +24,20 @@
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <ui/GraphicBuffer.h>
 
+#include <array>
+#include <atomic>
 #include <functional>
 #include <thread>
 #include <set>
 
+#include <formatconvert/ConversionPool.h>
+
 #include "VideoCapture.h"
 #include "ConfigManager.h"
+#include "FrameLatencyStats.h"
+#include "FreeSlotList.h"
+#include "GpuConverter.h"
+#include "JpegDecoder.h"
 
 using ::android::hardware::hidl_string;
 using ::android::hardware::camera::device::V3_2::Stream;
@@ -41,6 +49,7 @@ using BufferDesc_1_0       = ::android::hardware::automotive::evs::V1_0::BufferD
 using BufferDesc_1_1       = ::android::hardware::automotive::evs::V1_1::BufferDesc;
 using IEvsCameraStream_1_0 = ::android::hardware::automotive::evs::V1_0::IEvsCameraStream;
 using IEvsCameraStream_1_1 = ::android::hardware::automotive::evs::V1_1::IEvsCameraStream;
+using ::android::automotive::evs::formatconvert::ConversionPool;
 
 namespace android {
 namespace hardware {
@@ -101,19 +110,53 @@ public:
 
     const CameraDesc& getDesc() { return mDescription; };
 
+    // Summary of where the time of the recently delivered frames went
+    std::string dumpLatency(const char* indent = "") const;
+
+    // Extended info the EVS manager sets to tell how many frames per second its clients use, as
+    // an int32_t; 0 lifts the limit.  Must match HalCamera::kFrameRateHintId of the manager.
+    static constexpr uint32_t kFrameRateHintId = 0x45565346;    // 'EVSF'
+
+    // Extended info holding pairs of a CameraParam and a value, as int32_t, to program at once.
+    // Reading it back gives the values applied by the last batch, or an empty value if there
+    // was none, which tells the manager this driver takes batches.  Must match
+    // HalCamera::kParameterBatchId of the manager.
+    static constexpr uint32_t kParameterBatchId = 0x45565350;   // 'EVSP'
+
 private:
     // Constructors
     EvsV4lCamera(const char *deviceName,
                  unique_ptr<ConfigManager::CameraInfo> &camInfo);
 
-    // These three functions are expected to be called while mAccessLock is held
+    // These functions are expected to be called while mAccessLock is held
     bool setAvailableFrames_Locked(unsigned bufferCount);
     unsigned increaseAvailableFrames_Locked(unsigned numToAdd);
     unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
 
+    // Resizes the buffer pool while our buffers are the capture buffers of the driver
+    bool setAvailableZeroCopyFrames_Locked(unsigned bufferCount);
+
+    // Stores |handle| in an empty slot, which joins mFreeSlots unless the stream captures
+    // straight into our buffers.  Returns false if all slots are taken.
+    bool addBuffer_Locked(buffer_handle_t handle);
+
+    struct BufferRecord;
+
+    // Unmaps and frees the buffer of |rec|, leaving the slot empty
+    void freeBuffer_Locked(BufferRecord& rec);
+
     void forwardFrame(imageBuffer* tgt, void* data);
+
+    // Starts capturing straight into our graphics buffers if the camera produces the output
+    // format as is.  Returns false if frames have to be copied instead.
+    bool startZeroCopyStream_Locked(
+            std::function<void(VideoCapture*, imageBuffer*, void*)> callback);
+
     inline bool convertToV4l2CID(CameraParam id, uint32_t& v4l2cid);
 
+    // Programs a batch of parameters encoded as described for kParameterBatchId
+    EvsResult setParameterBatch(const hidl_vec<uint8_t>& opaqueValue);
+
     sp <IEvsCameraStream_1_0> mStream     = nullptr;  // The callback used to deliver each frame
     sp <IEvsCameraStream_1_1> mStream_1_1 = nullptr;  // The callback used to deliver each frame
 
@@ -124,22 +167,53 @@ private:
     uint32_t mUsage  = 0;           // Values from from Gralloc.h
     uint32_t mStride = 0;           // Pixels per row (may be greater than image width)
 
-    struct BufferRecord {
-        buffer_handle_t handle;
-        bool inUse;
+    // Arbitrary limit on number of graphics buffers allowed to be allocated
+    // Safeguards against unreasonable resource consumption and provides a testable limit
+    static constexpr unsigned MAX_BUFFERS_IN_FLIGHT = 100;
 
-        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false) {};
+    struct BufferRecord {
+        buffer_handle_t handle = nullptr;
+        void* pixels = nullptr;             // Kept mapped for the CPU while we hold the buffer
+        std::atomic<bool> inUse{false};
     };
 
-    std::vector <BufferRecord> mBuffers;    // Graphics buffers to transfer images
-    unsigned mFramesAllowed;                // How many buffers are we currently using
-    unsigned mFramesInUse;                  // How many buffers are currently outstanding
+    // Graphics buffers to transfer images.  The slots never move, so the capture thread and the
+    // client may use a slot they own while another one is being resized under mAccessLock.
+    std::array<BufferRecord, MAX_BUFFERS_IN_FLIGHT> mBuffers;
+    std::atomic<unsigned> mNumBuffers{0};   // Slots used so far; some may be empty
+    std::vector<uint32_t> mEmptySlots;      // Slots without a buffer below mNumBuffers
+
+    // Slots holding a buffer that is ready to be filled.  Not used while mZeroCopy is set
+    // because the driver then decides which buffer is filled next.
+    FreeSlotList<MAX_BUFFERS_IN_FLIGHT> mFreeSlots;
+
+    std::atomic<unsigned> mFramesAllowed;   // How many buffers are we currently using
+    std::atomic<unsigned> mFramesInUse;     // How many buffers are currently outstanding
+    std::atomic<unsigned> mFramesTarget{0}; // How many buffers the client last asked for.
+                                            // While mFramesAllowed is above it, returned
+                                            // buffers are released instead of reused
+    std::atomic<bool> mZeroCopy{false};     // mBuffers are queued to the driver as capture
+                                            // buffers, indexed alike
 
     std::set<uint32_t> mCameraControls;     // Available camera controls
 
     // Which format specific function we need to use to move camera imagery into our output buffers
     void(*mFillBufferFromVideo)(const BufferDesc& tgtBuff, uint8_t* tgt,
-                                void* imgData, unsigned imgStride);
+                                void* imgData, unsigned imgStride,
+                                unsigned firstRow, unsigned lastRow) = nullptr;
+
+    // Threads converting stripes of each frame; null to convert on the capture thread
+    std::unique_ptr<ConversionPool> mConversionPool;
+
+    // Renders the frames of RGBA clients on the GPU; null if the GPU isn't used
+    std::unique_ptr<GpuConverter> mGpuConverter;
+    bool mGpuConversion = false;            // The current stream is converted by mGpuConverter
+
+    // Decodes the frames of an MJPEG camera; null for uncompressed cameras
+    std::unique_ptr<JpegDecoder> mJpegDecoder;
+
+    // Timing of the recently delivered frames
+    FrameLatencyStats mLatencyStats;
 
 
     EvsResult doneWithFrame_impl(const uint32_t id, const buffer_handle_t handle);
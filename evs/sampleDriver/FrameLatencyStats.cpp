@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameLatencyStats.h"
+
+#include <android-base/stringprintf.h>
+
+#include <algorithm>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+using ::android::base::StringAppendF;
+
+namespace {
+
+const char* const kStageNames[FrameLatencyStats::NUM_STAGES] = {
+    "dequeue", "lock", "convert", "unlock", "deliver",
+};
+
+} // namespace
+
+
+void FrameLatencyStats::record(const FrameTiming& timing) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mFrames[mNext] = timing;
+    mNext = (mNext + 1) % kWindowSize;
+    mCount = std::min(mCount + 1, kWindowSize);
+}
+
+
+std::string FrameLatencyStats::toString(const char* indent) const {
+    std::vector<FrameTiming> frames;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        frames.assign(mFrames.begin(), mFrames.begin() + mCount);
+    }
+
+    std::string buffer;
+    StringAppendF(&buffer, "%sLatency of the last %zu frames in microseconds "
+                           "(mean / p50 / p99 / max):\n", indent, frames.size());
+    if (frames.empty()) {
+        return buffer;
+    }
+
+    std::vector<int64_t> samples(frames.size());
+    for (int stage = 0; stage < NUM_STAGES; ++stage) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < frames.size(); ++i) {
+            samples[i] = frames[i][stage];
+            sum += samples[i];
+        }
+        std::sort(samples.begin(), samples.end());
+
+        const size_t n = samples.size();
+        StringAppendF(&buffer, "%s  %-8s %8.1f %8.1f %8.1f %8.1f\n",
+                      indent, kStageNames[stage],
+                      sum / 1000.0 / n,
+                      samples[n / 2] / 1000.0,
+                      samples[std::min(n - 1, n * 99 / 100)] / 1000.0,
+                      samples[n - 1] / 1000.0);
+    }
+
+    return buffer;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
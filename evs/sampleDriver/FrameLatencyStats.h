@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMELATENCYSTATS_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMELATENCYSTATS_H
+
+#include <array>
+#include <mutex>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Where the time of a frame goes between its capture and the return of its delivery call
+class FrameLatencyStats {
+public:
+    enum Stage {
+        DEQUEUE = 0,    // From the capture timestamp until forwardFrame picks the frame up
+        LOCK,           // Mapping the output buffer for the CPU
+        CONVERT,        // Converting or copying the frame into the output buffer
+        UNLOCK,         // Unmapping or flushing the output buffer
+        DELIVER,        // The deliverFrame call to the client
+        NUM_STAGES
+    };
+
+    // Durations of one frame in nanoseconds; stages the frame skipped stay zero
+    using FrameTiming = std::array<int64_t, NUM_STAGES>;
+
+    void record(const FrameTiming& timing);
+
+    // Mean, median, 99th percentile and maximum of each stage over the recent frames
+    std::string toString(const char* indent = "") const;
+
+private:
+    // Number of recent frames the summary covers
+    static constexpr size_t kWindowSize = 256;
+
+    mutable std::mutex                      mLock;
+    std::array<FrameTiming, kWindowSize>    mFrames = {};   // Guarded by mLock
+    size_t                                  mNext = 0;      // Guarded by mLock
+    size_t                                  mCount = 0;     // Guarded by mLock
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FRAMELATENCYSTATS_H
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FREESLOTLIST_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FREESLOTLIST_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Lock-free LIFO of the indices of up to |N| slots.  A slot belongs to whoever popped it until
+// it is pushed again, so any number of threads may push and pop concurrently without sharing a
+// mutex.  The head carries a counter bumped on every change so that a slot popped and pushed
+// again between the load and the exchange of another pop can't corrupt the list.
+template <uint32_t N>
+class FreeSlotList {
+public:
+    FreeSlotList() {
+        for (auto&& next : mNext) {
+            next.store(kEmpty, std::memory_order_relaxed);
+        }
+    }
+
+    FreeSlotList(const FreeSlotList&) = delete;
+    FreeSlotList& operator=(const FreeSlotList&) = delete;
+
+    // |slot| must be less than N and not be in the list already
+    void push(uint32_t slot) {
+        uint64_t head = mHead.load(std::memory_order_relaxed);
+        do {
+            mNext[slot].store(getSlot(head), std::memory_order_relaxed);
+        } while (!mHead.compare_exchange_weak(head, pack(slot, getTag(head) + 1),
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+    }
+
+    // Returns false if the list is empty
+    bool pop(uint32_t* slot) {
+        uint64_t head = mHead.load(std::memory_order_acquire);
+        while (getSlot(head) != kEmpty) {
+            const uint32_t next = mNext[getSlot(head)].load(std::memory_order_relaxed);
+            if (mHead.compare_exchange_weak(head, pack(next, getTag(head) + 1),
+                                            std::memory_order_acquire,
+                                            std::memory_order_acquire)) {
+                *slot = getSlot(head);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+
+    static constexpr uint64_t pack(uint32_t slot, uint32_t tag) {
+        return (static_cast<uint64_t>(tag) << 32) | slot;
+    }
+    static constexpr uint32_t getSlot(uint64_t head) { return static_cast<uint32_t>(head); }
+    static constexpr uint32_t getTag(uint64_t head)  { return static_cast<uint32_t>(head >> 32); }
+
+    std::atomic<uint64_t> mHead{pack(kEmpty, 0)};
+    std::atomic<uint32_t> mNext[N];     // The slot below each slot in the list
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_FREESLOTLIST_H
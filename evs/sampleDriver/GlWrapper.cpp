@@ -22,9 +22,11 @@
 
 #include <utility>
 
+#include <gpupolicy/GpuPolicy.h>
 #include <ui/DisplayConfig.h>
 #include <ui/DisplayState.h>
 #include <ui/GraphicBuffer.h>
+#include <utils/Timers.h>
 
 
 using namespace android;
@@ -33,6 +35,8 @@ using namespace android;
 using android::GraphicBuffer;
 using android::sp;
 
+namespace gpupolicy = ::android::automotive::evs::gpupolicy;
+
 
 const char vertexShaderSource[] = ""
         "#version 300 es                    \n"
@@ -58,7 +62,7 @@ const char pixelShaderSource[] =
         "}                                          \n";
 
 
-static const char *getEGLError(void) {
+const char *getEGLError(void) {
     switch (eglGetError()) {
         case EGL_SUCCESS:
             return "EGL_SUCCESS";
@@ -134,7 +138,7 @@ static GLuint loadShader(GLenum type, const char *shaderSrc) {
 
 
 // Create a program object given vertex and pixels shader source
-static GLuint buildShaderProgram(const char* vtxSrc, const char* pxlSrc) {
+GLuint buildShaderProgram(const char* vtxSrc, const char* pxlSrc) {
     GLuint program = glCreateProgram();
     if (program == 0) {
         LOG(ERROR) << "Failed to allocate program object";
@@ -274,12 +278,17 @@ bool GlWrapper::initialize(sp<IAutomotiveDisplayProxyService> pWindowProxy,
     // Create the EGL context
     // NOTE:  Our shader is (currently at least) written to require version 3, so this
     //        is required.
+    // The display shows the rear view, so its context is usually given a high priority.
     const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
-    mContext = eglCreateContext(mDisplay, egl_config, EGL_NO_CONTEXT, context_attribs);
+    const std::vector<EGLint> attribs =
+            gpupolicy::getContextAttributes(mDisplay, gpupolicy::kComponentDisplay,
+                                            context_attribs);
+    mContext = eglCreateContext(mDisplay, egl_config, EGL_NO_CONTEXT, attribs.data());
     if (mContext == EGL_NO_CONTEXT) {
         LOG(ERROR) << "Failed to create OpenGL ES Context: " << getEGLError();
         return false;
     }
+    gpupolicy::recordContextPriority(mDisplay, mContext, gpupolicy::kComponentDisplay);
 
 
     // Activate our render target for drawing
@@ -296,19 +305,6 @@ bool GlWrapper::initialize(sp<IAutomotiveDisplayProxyService> pWindowProxy,
         return false;
     }
 
-    // Create a GL texture that will eventually wrap our externally created texture surface(s)
-    glGenTextures(1, &mTextureMap);
-    if (mTextureMap <= 0) {
-        LOG(ERROR) << "Didn't get a texture handle allocated: " << getEGLError();
-        return false;
-    }
-
-    // Turn off mip-mapping for the created texture surface
-    // (the inbound camera imagery doesn't have MIPs)
-    glBindTexture(GL_TEXTURE_2D, mTextureMap);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     return true;
 }
 
@@ -316,10 +312,7 @@ bool GlWrapper::initialize(sp<IAutomotiveDisplayProxyService> pWindowProxy,
 void GlWrapper::shutdown() {
 
     // Drop our device textures
-    if (mKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(mDisplay, mKHRimage);
-        mKHRimage = EGL_NO_IMAGE_KHR;
-    }
+    releaseImages();
 
     // Release all GL resources
     eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
@@ -363,7 +356,8 @@ bool GlWrapper::updateImageTexture(const BufferDesc_1_0& buffer) {
     pDesc->format = buffer.format;
     pDesc->usage = buffer.usage;
     pDesc->stride = buffer.stride;
-    newBuffer.buffer.nativeHandle = buffer.memHandle;
+    // Refer to the same handle rather than a copy so the cached image can be found again
+    newBuffer.buffer.nativeHandle = buffer.memHandle.getNativeHandle();
     newBuffer.pixelSize = buffer.pixelSize;
     newBuffer.bufferId = buffer.bufferId;
 
@@ -372,53 +366,105 @@ bool GlWrapper::updateImageTexture(const BufferDesc_1_0& buffer) {
 
 
 bool GlWrapper::updateImageTexture(const BufferDesc_1_1& aFrame) {
-
-    // If we haven't done it yet, create an "image" object to wrap the gralloc buffer
-    if (mKHRimage == EGL_NO_IMAGE_KHR) {
-        // create a temporary GraphicBuffer to wrap the provided handle
-        const AHardwareBuffer_Desc* pDesc =
-            reinterpret_cast<const AHardwareBuffer_Desc *>(&aFrame.buffer.description);
-        sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(
-                pDesc->width,
-                pDesc->height,
-                pDesc->format,
-                pDesc->layers,
-                pDesc->usage,
-                pDesc->stride,
-                const_cast<native_handle_t*>(aFrame.buffer.nativeHandle.getNativeHandle()),
-                false   /* keep ownership */
-        );
-        if (pGfxBuffer.get() == nullptr) {
-            LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap our native handle";
-            return false;
+    const native_handle_t* handle = aFrame.buffer.nativeHandle.getNativeHandle();
+
+    // Reuse the image we made when this buffer was shown before.  A handle of a freed buffer
+    // may come back with another buffer, so the id has to match too.
+    auto it = mImages.find(handle);
+    if (it != mImages.end()) {
+        if (it->second.bufferId == aFrame.bufferId) {
+            mTextureMap = it->second.texture;
+            return true;
         }
 
-        // Get a GL compatible reference to the graphics buffer we've been given
-        EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
-        EGLClientBuffer cbuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-        mKHRimage = eglCreateImageKHR(mDisplay,
-                                      EGL_NO_CONTEXT,
-                                      EGL_NATIVE_BUFFER_ANDROID,
-                                      cbuf,
-                                      eglImageAttributes);
-        if (mKHRimage == EGL_NO_IMAGE_KHR) {
-            LOG(ERROR) << "Error creating EGLImage: " << getEGLError();
-            return false;
-        }
+        glDeleteTextures(1, &it->second.texture);
+        eglDestroyImageKHR(mDisplay, it->second.image);
+        mImages.erase(it);
+    }
 
+    // create a temporary GraphicBuffer to wrap the provided handle
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&aFrame.buffer.description);
+    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(
+            pDesc->width,
+            pDesc->height,
+            pDesc->format,
+            pDesc->layers,
+            pDesc->usage,
+            pDesc->stride,
+            const_cast<native_handle_t*>(handle),
+            false   /* keep ownership */
+    );
+    if (pGfxBuffer.get() == nullptr) {
+        LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap our native handle";
+        return false;
+    }
 
-        // Update the texture handle we already created to refer to this gralloc buffer
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, mTextureMap);
-        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(mKHRimage));
+    // Get a GL compatible reference to the graphics buffer we've been given
+    ImageTexture entry;
+    entry.bufferId = aFrame.bufferId;
+    EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    EGLClientBuffer cbuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
+    entry.image = eglCreateImageKHR(mDisplay,
+                                    EGL_NO_CONTEXT,
+                                    EGL_NATIVE_BUFFER_ANDROID,
+                                    cbuf,
+                                    eglImageAttributes);
+    if (entry.image == EGL_NO_IMAGE_KHR) {
+        LOG(ERROR) << "Error creating EGLImage: " << getEGLError();
+        return false;
+    }
 
+    // Create a GL texture that refers to this gralloc buffer
+    glGenTextures(1, &entry.texture);
+    if (entry.texture <= 0) {
+        LOG(ERROR) << "Didn't get a texture handle allocated: " << getEGLError();
+        eglDestroyImageKHR(mDisplay, entry.image);
+        return false;
     }
 
+    // Turn off mip-mapping for the created texture surface
+    // (the inbound camera imagery doesn't have MIPs)
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, entry.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(entry.image));
+
+    mImages.emplace(handle, entry);
+    mTextureMap = entry.texture;
+
     return true;
 }
 
 
-void GlWrapper::renderImageToScreen() {
+void GlWrapper::releaseImage(const native_handle_t* handle) {
+    auto it = mImages.find(handle);
+    if (it == mImages.end()) {
+        return;
+    }
+
+    if (mTextureMap == it->second.texture) {
+        mTextureMap = 0;
+    }
+    glDeleteTextures(1, &it->second.texture);
+    eglDestroyImageKHR(mDisplay, it->second.image);
+    mImages.erase(it);
+}
+
+
+void GlWrapper::releaseImages() {
+    for (auto&& [handle, entry] : mImages) {
+        glDeleteTextures(1, &entry.texture);
+        eglDestroyImageKHR(mDisplay, entry.image);
+    }
+    mImages.clear();
+    mTextureMap = 0;
+}
+
+
+EGLSyncKHR GlWrapper::renderImageToScreen() {
+    const nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+
     // Set the viewport
     glViewport(0, 0, mWidth, mHeight);
 
@@ -464,8 +510,33 @@ void GlWrapper::renderImageToScreen() {
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
 
-    glFinish();
+    // The texture is only read until this fence signals, so the buffer can go back to the
+    // client without stalling on the GPU here
+    EGLSyncKHR fence = eglCreateSyncKHR(mDisplay, EGL_SYNC_FENCE_KHR, nullptr);
+    if (fence == EGL_NO_SYNC_KHR) {
+        glFinish();
+    }
 
     eglSwapBuffers(mDisplay, mSurface);
+
+    // The swap blocks while the GPU is behind, so this takes longer when it's contended
+    gpupolicy::recordFrameTime(gpupolicy::kComponentDisplay,
+                               systemTime(SYSTEM_TIME_MONOTONIC) - startNs);
+
+    return fence;
+}
+
+
+void GlWrapper::waitForFence(EGLSyncKHR fence) {
+    if (fence == EGL_NO_SYNC_KHR) {
+        return;
+    }
+
+    if (eglClientWaitSyncKHR(mDisplay, fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+                             EGL_FOREVER_KHR) != EGL_CONDITION_SATISFIED_KHR) {
+        LOG(WARNING) << "Failed to wait for a frame to be rendered: " << getEGLError();
+        glFinish();
+    }
+    eglDestroySyncKHR(mDisplay, fence);
 }
 
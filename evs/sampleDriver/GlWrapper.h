@@ -29,6 +29,8 @@
 #include <android-base/logging.h>
 #include <bufferqueueconverter/BufferQueueConverter.h>
 
+#include <unordered_map>
+
 
 using ::android::sp;
 using ::android::SurfaceHolder;
@@ -47,7 +49,21 @@ public:
 
     bool updateImageTexture(const BufferDesc_1_0& buffer);
     bool updateImageTexture(const BufferDesc_1_1& buffer);
-    void renderImageToScreen();
+
+    // Draws the current texture and queues the frame for display without waiting for the GPU.
+    // Returns a fence that signals once the GPU is done reading the texture, or EGL_NO_SYNC_KHR
+    // if the frame has been waited for already.
+    EGLSyncKHR renderImageToScreen();
+
+    // Blocks until |fence| signals, then destroys it
+    void waitForFence(EGLSyncKHR fence);
+
+    // Destroys the images and textures cached for the buffers shown so far.  Call it before the
+    // buffers are freed or replaced by another pool.
+    void releaseImages();
+
+    // Destroys the image and texture cached for |handle|, if any
+    void releaseImage(const native_handle_t* handle);
 
     void showWindow(sp<IAutomotiveDisplayProxyService>& pWindowService, uint64_t id);
     void hideWindow(sp<IAutomotiveDisplayProxyService>& pWindowService, uint64_t id);
@@ -65,9 +81,18 @@ private:
     unsigned mWidth  = 0;
     unsigned mHeight = 0;
 
-    EGLImageKHR mKHRimage = EGL_NO_IMAGE_KHR;
+    // A gralloc buffer wrapped for GL; kept while the buffer may be shown again
+    struct ImageTexture {
+        uint32_t    bufferId = 0;
+        EGLImageKHR image    = EGL_NO_IMAGE_KHR;
+        GLuint      texture  = 0;
+    };
+
+    // Camera and display buffers come from small pools, so the same handles are shown over and
+    // over again
+    std::unordered_map<const native_handle_t*, ImageTexture> mImages;
 
-    GLuint mTextureMap    = 0;
+    GLuint mTextureMap    = 0;      // Texture of the buffer to render, owned by mImages
     GLuint mShaderProgram = 0;
 
     // Opaque handle for a native hardware buffer defined in
@@ -78,4 +103,10 @@ private:
     android::SurfaceHolderUniquePtr mSurfaceHolder;
 };
 
+// Returns the name of the last EGL error
+const char *getEGLError(void);
+
+// Create a program object given vertex and pixels shader source
+GLuint buildShaderProgram(const char* vtxSrc, const char* pxlSrc);
+
 #endif // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_DISPLAY_GLWRAPPER_H
@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GpuConverter.h"
+
+#include <unistd.h>
+
+#include <vector>
+
+#include <android-base/logging.h>
+#include <gpupolicy/GpuPolicy.h>
+#include <system/graphics.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Timers.h>
+
+namespace gpupolicy = ::android::automotive::evs::gpupolicy;
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+const char kVertexShaderSource[] =
+        "#version 300 es                    \n"
+        "layout(location = 0) in vec4 pos;  \n"
+        "layout(location = 1) in vec2 tex;  \n"
+        "out vec2 uv;                       \n"
+        "void main()                        \n"
+        "{                                  \n"
+        "   gl_Position = pos;              \n"
+        "   uv = tex;                       \n"
+        "}                                  \n";
+
+// The external sampler does the YUV to RGB conversion
+const char kPixelShaderSource[] =
+        "#version 300 es                                        \n"
+        "#extension GL_OES_EGL_image_external_essl3 : require   \n"
+        "precision mediump float;                               \n"
+        "uniform samplerExternalOES tex;                        \n"
+        "in vec2 uv;                                            \n"
+        "out vec4 color;                                        \n"
+        "void main()                                            \n"
+        "{                                                      \n"
+        "    color = vec4(texture(tex, uv).rgb, 1.0);           \n"
+        "}                                                      \n";
+
+// The whole target; V=0 is the first row in memory of both the source and the target
+const GLfloat kQuadPos[] = { -1.0f, -1.0f, 0.0f,
+                              1.0f, -1.0f, 0.0f,
+                             -1.0f,  1.0f, 0.0f,
+                              1.0f,  1.0f, 0.0f };
+const GLfloat kQuadTex[] = { 0.0f, 0.0f,
+                             1.0f, 0.0f,
+                             0.0f, 1.0f,
+                             1.0f, 1.0f };
+
+}  // namespace
+
+
+bool GpuConverter::isSupported(uint32_t v4l2Format, uint32_t halFormat) {
+    // The DRM fourcc codes of these formats are the V4L2 ones
+    return halFormat == HAL_PIXEL_FORMAT_RGBA_8888 &&
+           (v4l2Format == V4L2_PIX_FMT_YUYV || v4l2Format == V4L2_PIX_FMT_NV21);
+}
+
+
+GpuConverter::~GpuConverter() {
+    if (mDisplay == EGL_NO_DISPLAY) {
+        return;
+    }
+
+    releaseBuffers();
+    if (mContext != EGL_NO_CONTEXT) {
+        eglDestroyContext(mDisplay, mContext);
+    }
+    if (mSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(mDisplay, mSurface);
+    }
+    eglTerminate(mDisplay);
+}
+
+
+bool GpuConverter::initialize() {
+    mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (mDisplay == EGL_NO_DISPLAY) {
+        LOG(ERROR) << "Failed to get egl display";
+        return false;
+    }
+
+    EGLint major = 3;
+    EGLint minor = 0;
+    if (!eglInitialize(mDisplay, &major, &minor)) {
+        LOG(ERROR) << "Failed to initialize EGL: " << getEGLError();
+        mDisplay = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    // We only render into our own framebuffers, so a tiny pbuffer is all the surface we need
+    const EGLint config_attribs[] = {
+            // Tag                  Value
+            EGL_SURFACE_TYPE,       EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE,    EGL_OPENGL_ES3_BIT_KHR,
+            EGL_RED_SIZE,           8,
+            EGL_GREEN_SIZE,         8,
+            EGL_BLUE_SIZE,          8,
+            EGL_NONE
+    };
+
+    EGLConfig egl_config = {0};
+    EGLint numConfigs = -1;
+    eglChooseConfig(mDisplay, config_attribs, &egl_config, 1, &numConfigs);
+    if (numConfigs != 1) {
+        LOG(ERROR) << "Didn't find a suitable EGL configuration to convert frames";
+        return false;
+    }
+
+    const EGLint surface_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    mSurface = eglCreatePbufferSurface(mDisplay, egl_config, surface_attribs);
+    if (mSurface == EGL_NO_SURFACE) {
+        LOG(ERROR) << "eglCreatePbufferSurface failed: " << getEGLError();
+        return false;
+    }
+
+    const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    const std::vector<EGLint> attribs =
+            gpupolicy::getContextAttributes(mDisplay, gpupolicy::kComponentConverter,
+                                            context_attribs);
+    mContext = eglCreateContext(mDisplay, egl_config, EGL_NO_CONTEXT, attribs.data());
+    if (mContext == EGL_NO_CONTEXT) {
+        LOG(ERROR) << "Failed to create OpenGL ES Context: " << getEGLError();
+        return false;
+    }
+    gpupolicy::recordContextPriority(mDisplay, mContext, gpupolicy::kComponentConverter);
+
+    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        LOG(ERROR) << "Failed to make the OpenGL ES Context current: " << getEGLError();
+        return false;
+    }
+
+    mShaderProgram = buildShaderProgram(kVertexShaderSource, kPixelShaderSource);
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (!mShaderProgram) {
+        LOG(ERROR) << "Failed to build the conversion shader program";
+        return false;
+    }
+
+    LOG(INFO) << "Camera frames will be converted on the GPU";
+    return true;
+}
+
+
+GpuConverter::SourceImage* GpuConverter::getSource(VideoCapture& video, unsigned index) {
+    auto it = mSources.find(index);
+    if (it != mSources.end()) {
+        return &it->second;
+    }
+
+    SourceImage source;
+    source.fd = video.exportDmaBuf(index);
+    if (source.fd < 0) {
+        return nullptr;
+    }
+
+    const EGLint width = video.getWidth();
+    const EGLint height = video.getHeight();
+    const EGLint stride = video.getStride();
+    std::vector<EGLint> attribs = {
+            EGL_WIDTH,                      width,
+            EGL_HEIGHT,                     height,
+            EGL_LINUX_DRM_FOURCC_EXT,       static_cast<EGLint>(video.getV4LFormat()),
+            EGL_DMA_BUF_PLANE0_FD_EXT,      source.fd,
+            EGL_DMA_BUF_PLANE0_OFFSET_EXT,  0,
+            EGL_DMA_BUF_PLANE0_PITCH_EXT,   stride,
+            EGL_YUV_COLOR_SPACE_HINT_EXT,   EGL_ITU_REC601_EXT,
+            EGL_SAMPLE_RANGE_HINT_EXT,      EGL_YUV_FULL_RANGE_EXT,
+    };
+    if (video.getV4LFormat() == V4L2_PIX_FMT_NV21) {
+        // The interleaved chroma plane follows the luma plane
+        attribs.insert(attribs.end(), {
+                EGL_DMA_BUF_PLANE1_FD_EXT,      source.fd,
+                EGL_DMA_BUF_PLANE1_OFFSET_EXT,  stride * height,
+                EGL_DMA_BUF_PLANE1_PITCH_EXT,   stride,
+        });
+    }
+    attribs.emplace_back(EGL_NONE);
+
+    source.image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                                     nullptr, attribs.data());
+    if (source.image == EGL_NO_IMAGE_KHR) {
+        LOG(ERROR) << "Error importing capture buffer " << index << ": " << getEGLError();
+        close(source.fd);
+        return nullptr;
+    }
+
+    glGenTextures(1, &source.texture);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, source.texture);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, static_cast<GLeglImageOES>(source.image));
+
+    return &mSources.emplace(index, source).first->second;
+}
+
+
+GpuConverter::TargetImage* GpuConverter::getTarget(const BufferDesc_1_1& tgtBuff) {
+    const native_handle_t* handle = tgtBuff.buffer.nativeHandle.getNativeHandle();
+    auto it = mTargets.find(handle);
+    if (it != mTargets.end()) {
+        return &it->second;
+    }
+
+    // Create a temporary GraphicBuffer to wrap the provided handle
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&tgtBuff.buffer.description);
+    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(
+            pDesc->width,
+            pDesc->height,
+            pDesc->format,
+            pDesc->layers,
+            pDesc->usage,
+            pDesc->stride,
+            const_cast<native_handle_t*>(handle),
+            false   /* keep ownership */
+    );
+
+    TargetImage target;
+    EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    EGLClientBuffer cbuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
+    target.image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+                                     cbuf, eglImageAttributes);
+    if (target.image == EGL_NO_IMAGE_KHR) {
+        LOG(ERROR) << "Error creating EGLImage of an output buffer: " << getEGLError();
+        return nullptr;
+    }
+
+    glGenTextures(1, &target.texture);
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(target.image));
+
+    glGenFramebuffers(1, &target.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           target.texture, 0);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LOG(ERROR) << "Can't render into an output buffer, status = " << std::hex << status;
+        glDeleteFramebuffers(1, &target.framebuffer);
+        glDeleteTextures(1, &target.texture);
+        eglDestroyImageKHR(mDisplay, target.image);
+        return nullptr;
+    }
+
+    return &mTargets.emplace(handle, target).first->second;
+}
+
+
+bool GpuConverter::convert(VideoCapture& video, unsigned index, const BufferDesc_1_1& tgtBuff) {
+    if (mShaderProgram == 0) {
+        return false;
+    }
+
+    const nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        LOG(ERROR) << "Failed to make the OpenGL ES Context current: " << getEGLError();
+        return false;
+    }
+
+    if (mInvalidated.exchange(false)) {
+        destroyImages();
+    }
+
+    bool converted = false;
+    SourceImage* source = getSource(video, index);
+    TargetImage* target = source != nullptr ? getTarget(tgtBuff) : nullptr;
+    if (target != nullptr) {
+        const AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc *>(&tgtBuff.buffer.description);
+        glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+        glViewport(0, 0, pDesc->width, pDesc->height);
+        glDisable(GL_BLEND);
+
+        glUseProgram(mShaderProgram);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, source->texture);
+        glUniform1i(glGetUniformLocation(mShaderProgram, "tex"), 0);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, kQuadPos);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, kQuadTex);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glDisableVertexAttribArray(0);
+        glDisableVertexAttribArray(1);
+
+        // The client reads the buffer as soon as we deliver it
+        glFinish();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        converted = glGetError() == GL_NO_ERROR;
+        gpupolicy::recordFrameTime(gpupolicy::kComponentConverter,
+                                   systemTime(SYSTEM_TIME_MONOTONIC) - startNs);
+    }
+
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    return converted;
+}
+
+
+void GpuConverter::releaseBuffers() {
+    if (mContext == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        return;
+    }
+
+    mInvalidated = false;
+    destroyImages();
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+
+void GpuConverter::destroyImages() {
+    for (auto&& [index, source] : mSources) {
+        glDeleteTextures(1, &source.texture);
+        eglDestroyImageKHR(mDisplay, source.image);
+        close(source.fd);
+    }
+    mSources.clear();
+
+    for (auto&& [handle, target] : mTargets) {
+        glDeleteFramebuffers(1, &target.framebuffer);
+        glDeleteTextures(1, &target.texture);
+        eglDestroyImageKHR(mDisplay, target.image);
+    }
+    mTargets.clear();
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
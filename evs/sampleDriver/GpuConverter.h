@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_GPUCONVERTER_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_GPUCONVERTER_H
+
+#include <atomic>
+#include <unordered_map>
+
+#include "GlWrapper.h"
+#include "VideoCapture.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Converts camera frames on the GPU.  Each V4L2 capture buffer is exported as a dma-buf and
+// imported as an external YUV texture, and the frame is rendered into an output graphics buffer
+// bound as a framebuffer, so the color conversion never touches the CPU.
+//
+// The EGL context is made current on the calling thread for each frame only, since the capture
+// thread changes whenever the stream restarts.
+class GpuConverter {
+public:
+    GpuConverter() = default;
+    ~GpuConverter();
+
+    GpuConverter(const GpuConverter&) = delete;
+    GpuConverter& operator=(const GpuConverter&) = delete;
+
+    // Returns true if frames in |v4l2Format| can be converted into |halFormat|.
+    static bool isSupported(uint32_t v4l2Format, uint32_t halFormat);
+
+    // Sets up EGL and the shader.  Returns false if the GPU can't be used.
+    bool initialize();
+
+    // Renders the frame in capture buffer |index| of |video| into |tgtBuff| and waits for the
+    // GPU to finish.  Returns false if either buffer can't be used, so the caller can convert
+    // the frame on the CPU instead.
+    bool convert(VideoCapture& video, unsigned index, const BufferDesc_1_1& tgtBuff);
+
+    // Drops what we know about the buffers before the next frame is converted; call it when
+    // the capture buffers or the output buffers change.
+    void invalidate() { mInvalidated = true; }
+
+    // Releases the buffers right away.  Must not be called while a frame is being converted.
+    void releaseBuffers();
+
+private:
+    struct SourceImage {
+        int         fd = -1;
+        EGLImageKHR image = EGL_NO_IMAGE_KHR;
+        GLuint      texture = 0;
+    };
+
+    struct TargetImage {
+        EGLImageKHR image = EGL_NO_IMAGE_KHR;
+        GLuint      texture = 0;
+        GLuint      framebuffer = 0;
+    };
+
+    // These are called with our context current
+    SourceImage* getSource(VideoCapture& video, unsigned index);
+    TargetImage* getTarget(const BufferDesc_1_1& tgtBuff);
+    void destroyImages();
+
+    EGLDisplay  mDisplay = EGL_NO_DISPLAY;
+    EGLSurface  mSurface = EGL_NO_SURFACE;
+    EGLContext  mContext = EGL_NO_CONTEXT;
+    GLuint      mShaderProgram = 0;
+
+    std::unordered_map<unsigned, SourceImage>                  mSources;  // By capture buffer
+    std::unordered_map<const native_handle_t*, TargetImage>    mTargets;  // By output buffer
+    std::atomic<bool>                                          mInvalidated = false;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_GPUCONVERTER_H
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "JpegDecoder.h"
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <android/hardware_buffer.h>
+#include <android-base/logging.h>
+#include <formatconvert/FormatConvert.h>
+#include <jpeglib.h>
+#include <system/graphics.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+namespace fc = ::android::automotive::evs::formatconvert;
+
+// How long the hardware decoder may take on a frame before it is given up on
+constexpr int kHardwareDecodeTimeoutMs = 100;
+
+// Takes the errors of libjpeg, which would otherwise end the process
+struct JpegErrorManager {
+    jpeg_error_mgr  base;
+    jmp_buf         jump;
+};
+
+
+void onJpegError(j_common_ptr cinfo) {
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    LOG(WARNING) << "Failed to decode a camera frame: " << message;
+    longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+
+void onJpegMessage(j_common_ptr cinfo) {
+    // Warnings about corrupt data are common with USB cameras and the frame is still usable
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    LOG(DEBUG) << "While decoding a camera frame: " << message;
+}
+
+
+// Allocates and maps the single buffer of the queue of |type|
+void* mapSingleBuffer(int fd, uint32_t type, size_t* size) {
+    v4l2_requestbuffers bufrequest = {};
+    bufrequest.type = type;
+    bufrequest.memory = V4L2_MEMORY_MMAP;
+    bufrequest.count = 1;
+    if (ioctl(fd, VIDIOC_REQBUFS, &bufrequest) < 0 || bufrequest.count < 1) {
+        PLOG(ERROR) << "VIDIOC_REQBUFS failed on the JPEG decoder";
+        return nullptr;
+    }
+
+    v4l2_buffer buffer = {};
+    buffer.type = type;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = 0;
+    if (ioctl(fd, VIDIOC_QUERYBUF, &buffer) < 0) {
+        PLOG(ERROR) << "VIDIOC_QUERYBUF failed on the JPEG decoder";
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                      buffer.m.offset);
+    if (data == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to map a buffer of the JPEG decoder";
+        return nullptr;
+    }
+
+    *size = buffer.length;
+    return data;
+}
+
+}  // namespace
+
+
+JpegDecoder::~JpegDecoder() {
+    closeHardwareDecoder();
+}
+
+
+bool JpegDecoder::isSupported(uint32_t halFormat) {
+    return halFormat == HAL_PIXEL_FORMAT_RGBA_8888 ||
+           halFormat == HAL_PIXEL_FORMAT_YCBCR_422_I ||
+           halFormat == HAL_PIXEL_FORMAT_YCRCB_420_SP;
+}
+
+
+bool JpegDecoder::openHardwareDecoder(const char* deviceName, unsigned width, unsigned height) {
+    closeHardwareDecoder();
+
+    mDeviceFd = ::open(deviceName, O_RDWR | O_CLOEXEC);
+    if (mDeviceFd < 0) {
+        PLOG(ERROR) << "Failed to open the JPEG decoder " << deviceName;
+        return false;
+    }
+
+    // Only single planar decoders, which take JPEG and give YUYV, are used
+    v4l2_capability caps = {};
+    if (ioctl(mDeviceFd, VIDIOC_QUERYCAP, &caps) < 0 ||
+        !(caps.capabilities & V4L2_CAP_VIDEO_M2M) ||
+        !(caps.capabilities & V4L2_CAP_STREAMING)) {
+        LOG(ERROR) << deviceName << " is not a memory-to-memory decoder";
+        closeHardwareDecoder();
+        return false;
+    }
+
+    // A compressed frame is smaller than the YUYV image, so that bounds the input buffer
+    v4l2_format format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_JPEG;
+    format.fmt.pix.width = width;
+    format.fmt.pix.height = height;
+    format.fmt.pix.sizeimage = width * height * 2;
+    if (ioctl(mDeviceFd, VIDIOC_S_FMT, &format) < 0 ||
+        format.fmt.pix.pixelformat != V4L2_PIX_FMT_JPEG) {
+        format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+        if (ioctl(mDeviceFd, VIDIOC_S_FMT, &format) < 0 ||
+            format.fmt.pix.pixelformat != V4L2_PIX_FMT_MJPEG) {
+            LOG(ERROR) << deviceName << " doesn't take JPEG images";
+            closeHardwareDecoder();
+            return false;
+        }
+    }
+
+    format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    format.fmt.pix.width = width;
+    format.fmt.pix.height = height;
+    if (ioctl(mDeviceFd, VIDIOC_S_FMT, &format) < 0 ||
+        format.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV ||
+        format.fmt.pix.width != width || format.fmt.pix.height != height) {
+        LOG(ERROR) << deviceName << " can't decode into " << width << "x" << height << " YUYV";
+        closeHardwareDecoder();
+        return false;
+    }
+    mImageStride = format.fmt.pix.bytesperline;
+
+    mJpegBuffer = mapSingleBuffer(mDeviceFd, V4L2_BUF_TYPE_VIDEO_OUTPUT, &mJpegBufferSize);
+    mImageBuffer = mapSingleBuffer(mDeviceFd, V4L2_BUF_TYPE_VIDEO_CAPTURE, &mImageBufferSize);
+    if (mJpegBuffer == nullptr || mImageBuffer == nullptr) {
+        closeHardwareDecoder();
+        return false;
+    }
+
+    for (int type : { V4L2_BUF_TYPE_VIDEO_OUTPUT, V4L2_BUF_TYPE_VIDEO_CAPTURE }) {
+        if (ioctl(mDeviceFd, VIDIOC_STREAMON, &type) < 0) {
+            PLOG(ERROR) << "VIDIOC_STREAMON failed on the JPEG decoder";
+            closeHardwareDecoder();
+            return false;
+        }
+    }
+
+    LOG(INFO) << "Decoding camera frames on " << deviceName << " (" << caps.card << ")";
+    return true;
+}
+
+
+void JpegDecoder::closeHardwareDecoder() {
+    if (mDeviceFd < 0) {
+        return;
+    }
+
+    // Stopping the queues takes back the buffers the decoder still holds
+    for (int type : { V4L2_BUF_TYPE_VIDEO_OUTPUT, V4L2_BUF_TYPE_VIDEO_CAPTURE }) {
+        ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type);
+    }
+    if (mJpegBuffer != nullptr) {
+        munmap(mJpegBuffer, mJpegBufferSize);
+        mJpegBuffer = nullptr;
+    }
+    if (mImageBuffer != nullptr) {
+        munmap(mImageBuffer, mImageBufferSize);
+        mImageBuffer = nullptr;
+    }
+    ::close(mDeviceFd);
+    mDeviceFd = -1;
+}
+
+
+const void* JpegDecoder::decodeToYuyv(const void* jpeg, size_t size, unsigned* stride) {
+    if (mDeviceFd < 0) {
+        return nullptr;
+    } else if (size > mJpegBufferSize) {
+        LOG(WARNING) << "A camera frame of " << size << " bytes is too large to decode";
+        return nullptr;
+    }
+
+    memcpy(mJpegBuffer, jpeg, size);
+
+    v4l2_buffer input = {};
+    input.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    input.memory = V4L2_MEMORY_MMAP;
+    input.index = 0;
+    input.bytesused = size;
+    v4l2_buffer output = {};
+    output.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    output.memory = V4L2_MEMORY_MMAP;
+    output.index = 0;
+    if (ioctl(mDeviceFd, VIDIOC_QBUF, &input) < 0 ||
+        ioctl(mDeviceFd, VIDIOC_QBUF, &output) < 0) {
+        PLOG(ERROR) << "Failed to queue a frame to the JPEG decoder; decoding on the CPU";
+        closeHardwareDecoder();
+        return nullptr;
+    }
+
+    pollfd pfd = { mDeviceFd, POLLIN, 0 };
+    if (TEMP_FAILURE_RETRY(poll(&pfd, 1, kHardwareDecodeTimeoutMs)) <= 0 ||
+        ioctl(mDeviceFd, VIDIOC_DQBUF, &output) < 0 ||
+        ioctl(mDeviceFd, VIDIOC_DQBUF, &input) < 0) {
+        LOG(ERROR) << "The JPEG decoder didn't return a frame; decoding on the CPU";
+        closeHardwareDecoder();
+        return nullptr;
+    }
+
+    if (output.flags & V4L2_BUF_FLAG_ERROR) {
+        // A corrupt frame; the CPU may still make something of it
+        return nullptr;
+    }
+
+    *stride = mImageStride;
+    return mImageBuffer;
+}
+
+
+bool JpegDecoder::decodeInto(const void* jpeg, size_t size, const BufferDesc& tgtBuff,
+                             uint8_t* tgt) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const unsigned width = pDesc->width;
+    const unsigned height = pDesc->height;
+    const unsigned rowSize = width * 3;
+    if (pDesc->format != HAL_PIXEL_FORMAT_RGBA_8888 && mRows.size() < rowSize * 2) {
+        mRows.resize(rowSize * 2);
+    }
+
+    // Nothing with a destructor may live between here and the end, as errors longjmp back
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager error;
+    cinfo.err = jpeg_std_error(&error.base);
+    error.base.error_exit = onJpegError;
+    error.base.output_message = onJpegMessage;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, static_cast<const unsigned char*>(jpeg), size);
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.image_width != width || cinfo.image_height != height) {
+        LOG(WARNING) << "Dropped a camera frame of " << cinfo.image_width << "x"
+                     << cinfo.image_height << " for a " << width << "x" << height << " buffer";
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    // The fast paths are good enough for a preview and keep up with 1080p at 30 fps
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+    cinfo.out_color_space =
+            pDesc->format == HAL_PIXEL_FORMAT_RGBA_8888 ? JCS_EXT_RGBA : JCS_YCbCr;
+    jpeg_start_decompress(&cinfo);
+
+    if (pDesc->format == HAL_PIXEL_FORMAT_RGBA_8888) {
+        // Rows go straight into the output buffer
+        const unsigned stride = pDesc->stride * 4;
+        while (cinfo.output_scanline < height) {
+            JSAMPROW row = tgt + cinfo.output_scanline * stride;
+            jpeg_read_scanlines(&cinfo, &row, 1);
+        }
+    } else if (pDesc->format == HAL_PIXEL_FORMAT_YCBCR_422_I) {
+        // Each pair of pixels shares the average of their chroma
+        const unsigned stride = pDesc->stride * 2;
+        while (cinfo.output_scanline < height) {
+            uint8_t* out = tgt + cinfo.output_scanline * stride;
+            JSAMPROW row = mRows.data();
+            jpeg_read_scanlines(&cinfo, &row, 1);
+            for (unsigned x = 0; x + 1 < width; x += 2, row += 6, out += 4) {
+                out[0] = row[0];
+                out[1] = (row[1] + row[4] + 1) / 2;
+                out[2] = row[3];
+                out[3] = (row[2] + row[5] + 1) / 2;
+            }
+        }
+    } else {
+        // Each 2x2 block of pixels shares the average of their chroma, U first in our NV21
+        const unsigned stride = fc::getLumaStride(width);
+        uint8_t* chroma = tgt + stride * height;
+        while (cinfo.output_scanline < height) {
+            const unsigned y = cinfo.output_scanline;
+            JSAMPROW rows[2] = { mRows.data(), mRows.data() + rowSize };
+            while (cinfo.output_scanline < std::min(y + 2, height)) {
+                jpeg_read_scanlines(&cinfo, &rows[cinfo.output_scanline - y], 1);
+            }
+            const uint8_t* top = rows[0];
+            const uint8_t* bottom = y + 1 < height ? rows[1] : rows[0];
+            uint8_t* luma = tgt + y * stride;
+            for (unsigned x = 0; x < width; ++x) {
+                luma[x] = top[x * 3];
+            }
+            if (y + 1 < height) {
+                luma += stride;
+                for (unsigned x = 0; x < width; ++x) {
+                    luma[x] = bottom[x * 3];
+                }
+            }
+            uint8_t* uv = chroma + (y / 2) * stride;
+            for (unsigned x = 0; x + 1 < width; x += 2, top += 6, bottom += 6, uv += 2) {
+                uv[0] = (top[1] + top[4] + bottom[1] + bottom[4] + 2) / 4;
+                uv[1] = (top[2] + top[5] + bottom[2] + bottom[5] + 2) / 4;
+            }
+        }
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_JPEGDECODER_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_JPEGDECODER_H
+
+#include <android/hardware/automotive/evs/1.1/types.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Decodes the MJPEG frames of USB cameras, which can't send larger images uncompressed at full
+// rate.  A V4L2 memory-to-memory JPEG decoder, if the platform has one, decodes a frame into
+// YUYV for the usual conversions to run on.  Otherwise, or if the decoder fails on a frame,
+// libjpeg-turbo decodes it on the CPU straight into the output buffer.
+class JpegDecoder {
+public:
+    JpegDecoder() = default;
+    ~JpegDecoder();
+
+    JpegDecoder(const JpegDecoder&) = delete;
+    JpegDecoder& operator=(const JpegDecoder&) = delete;
+
+    // Returns true if frames can be decoded into |halFormat|.
+    static bool isSupported(uint32_t halFormat);
+
+    // Opens the hardware decoder at |deviceName| for frames of |width| x |height|.  Returns
+    // false if it can't be used, in which case the frames are decoded on the CPU.
+    bool openHardwareDecoder(const char* deviceName, unsigned width, unsigned height);
+
+    // Decodes |size| bytes of |jpeg| on the hardware decoder and returns the YUYV image, which
+    // stays valid until the next frame is decoded, with its row stride in |stride|.  Returns
+    // nullptr if there is no hardware decoder or it failed on this frame.
+    const void* decodeToYuyv(const void* jpeg, size_t size, unsigned* stride);
+
+    // Decodes |size| bytes of |jpeg| on the CPU into |tgt|, which is laid out as |tgtBuff|
+    // describes.  Returns false if the frame is corrupt or doesn't match the buffer size.
+    bool decodeInto(const void* jpeg, size_t size, const BufferDesc& tgtBuff, uint8_t* tgt);
+
+private:
+    void closeHardwareDecoder();
+
+    // The hardware decoder and its single buffer on each queue
+    int         mDeviceFd = -1;
+    void*       mJpegBuffer = nullptr;      // Compressed frames go in here
+    size_t      mJpegBufferSize = 0;
+    void*       mImageBuffer = nullptr;     // Decoded YUYV frames come out here
+    size_t      mImageBufferSize = 0;
+    unsigned    mImageStride = 0;
+
+    // Two rows of decoded YCbCr pixels on their way into a YUV output buffer
+    std::vector<uint8_t> mRows;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_JPEGDECODER_H
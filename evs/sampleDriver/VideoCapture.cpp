@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <error.h>
 #include <errno.h>
+#include <algorithm>
 #include <iomanip>
 #include <memory.h>
 #include <fcntl.h>
@@ -25,12 +26,43 @@
 #include <sys/mman.h>
 
 #include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <threadpolicy/ThreadPolicy.h>
 
 #include "assert.h"
 
 #include "VideoCapture.h"
 
 
+// Whether to capture MJPEG from cameras that give a higher frame rate in it than in YUYV
+static const char kMjpegPropertyName[] = "ro.vendor.evs.v4l2_mjpeg";
+
+
+// Returns the highest frame rate of |pixelFormat| at |width| x |height|, or 0 if the device
+// doesn't list one
+static float getMaxFrameRate(int fd, __u32 pixelFormat, __u32 width, __u32 height) {
+    v4l2_frmivalenum interval = {};
+    interval.pixel_format = pixelFormat;
+    interval.width = width;
+    interval.height = height;
+    float maxRate = 0.0f;
+    for (interval.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &interval) == 0;
+         ++interval.index) {
+        // Stepwise intervals are described by the first entry alone
+        const v4l2_fract& shortest = interval.type == V4L2_FRMIVAL_TYPE_DISCRETE ?
+                interval.discrete : interval.stepwise.min;
+        if (shortest.numerator > 0) {
+            maxRate = std::max(maxRate, (float)shortest.denominator / shortest.numerator);
+        }
+        if (interval.type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+            break;
+        }
+    }
+
+    return maxRate;
+}
+
+
 // NOTE:  This developmental code does not properly clean up resources in case of failure
 //        during the resource setup phase.  Of particular note is the potential to leak
 //        the file descriptor.  This must be fixed before using this code for anything but
@@ -67,6 +99,8 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
     LOG(INFO) << "Supported capture formats:";
     v4l2_fmtdesc formatDescriptions;
     formatDescriptions.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    bool hasYuyv = false;
+    bool hasMjpeg = false;
     for (int i=0; true; i++) {
         formatDescriptions.index = i;
         if (ioctl(mDeviceFd, VIDIOC_ENUM_FMT, &formatDescriptions) == 0) {
@@ -74,6 +108,8 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
                       << ": " << formatDescriptions.description
                       << " " << std::hex << std::setw(8) << formatDescriptions.pixelformat
                       << " " << std::hex << formatDescriptions.flags;
+            hasYuyv |= formatDescriptions.pixelformat == V4L2_PIX_FMT_YUYV;
+            hasMjpeg |= formatDescriptions.pixelformat == V4L2_PIX_FMT_MJPEG;
         } else {
             // No more formats available
             break;
@@ -94,6 +130,19 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
     format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
     format.fmt.pix.width = width;
     format.fmt.pix.height = height;
+
+    // USB cameras often can't send larger images uncompressed at full rate, so MJPEG is taken
+    // when it is faster at this size
+    if (hasMjpeg && android::base::GetBoolProperty(kMjpegPropertyName, true)) {
+        const float yuyvRate = hasYuyv ? getMaxFrameRate(mDeviceFd, V4L2_PIX_FMT_YUYV,
+                                                         width, height) : 0.0f;
+        const float mjpegRate = getMaxFrameRate(mDeviceFd, V4L2_PIX_FMT_MJPEG, width, height);
+        if (!hasYuyv || mjpegRate > yuyvRate) {
+            LOG(INFO) << "Capturing MJPEG at up to " << mjpegRate << " fps rather than YUYV at "
+                      << yuyvRate << " fps";
+            format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+        }
+    }
     LOG(INFO) << "Requesting format: "
               << ((char*)&format.fmt.pix.pixelformat)[0]
               << ((char*)&format.fmt.pix.pixelformat)[1]
@@ -123,9 +172,29 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
         return false;
     }
 
+    // Remember the default frame rate if the device lets us lower it
+    v4l2_streamparm streamParm = {};
+    streamParm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    mDefaultTimePerFrame = {};
+    mFrameRate = 0;
+    if (ioctl(mDeviceFd, VIDIOC_G_PARM, &streamParm) == 0 &&
+        (streamParm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME) &&
+        streamParm.parm.capture.timeperframe.numerator > 0 &&
+        streamParm.parm.capture.timeperframe.denominator > 0) {
+        mDefaultTimePerFrame = streamParm.parm.capture.timeperframe;
+        LOG(INFO) << "Default frame rate: " << std::dec << mDefaultTimePerFrame.denominator
+                  << "/" << mDefaultTimePerFrame.numerator << " fps";
+    } else {
+        LOG(INFO) << "Frame rate control not supported";
+    }
+
     // Make sure we're initialized to the STOPPED state
     mRunMode = STOPPED;
-    mFrames.clear();
+    {
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        mFrames.clear();
+        mLatestFrame = -1;
+    }
 
     // Ready to go!
     return true;
@@ -145,7 +214,8 @@ void VideoCapture::close() {
 }
 
 
-bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback) {
+bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback,
+                               unsigned numBuffers) {
     // Set the state of our background thread
     int prevRunMode = mRunMode.fetch_or(RUN);
     if (prevRunMode & RUN) {
@@ -155,15 +225,23 @@ bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, v
     }
 
     // Tell the L4V2 driver to prepare our streaming buffers
+    mMemoryType = V4L2_MEMORY_MMAP;
     v4l2_requestbuffers bufrequest;
     bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     bufrequest.memory = V4L2_MEMORY_MMAP;
-    bufrequest.count = 1;
+    bufrequest.count = std::clamp(numBuffers, 1u, kMaxNumBuffers);
     if (ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
         PLOG(ERROR) << "VIDIOC_REQBUFS failed";
         return false;
     }
 
+    if (bufrequest.count < 1) {
+        LOG(ERROR) << "The driver did not allocate any capture buffer";
+        return false;
+    }
+
+    LOG(INFO) << "Capturing into " << bufrequest.count << " buffers ("
+              << numBuffers << " requested)";
     mNumBuffers = bufrequest.count;
     mBufferInfos = std::make_unique<v4l2_buffer[]>(mNumBuffers);
     mPixelBuffers = std::make_unique<void *[]>(mNumBuffers);
@@ -203,13 +281,93 @@ bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, v
         memset(mPixelBuffers[i], 0, mBufferInfos[i].length);
         LOG(INFO) << "Buffer mapped at " << mPixelBuffers[i];
 
-        // Queue the first capture buffer
+        // Queue all the capture buffers so the driver can fill one while others are consumed
         if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[i]) < 0) {
             PLOG(ERROR) << "VIDIOC_QBUF failed";
             return false;
         }
     }
 
+    return startCapture(callback);
+}
+
+
+bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback,
+                               const std::vector<int>& dmaBufFds) {
+    // Set the state of our background thread
+    int prevRunMode = mRunMode.fetch_or(RUN);
+    if (prevRunMode & RUN) {
+        // The background thread is already running, so we can't start a new stream
+        LOG(ERROR) << "Already in RUN state, so we can't start a new streaming thread";
+        return false;
+    }
+
+    if (dmaBufFds.empty() || dmaBufFds.size() > kMaxNumBuffers) {
+        LOG(ERROR) << "Can't capture into " << dmaBufFds.size() << " dma-bufs";
+        mRunMode = STOPPED;
+        return false;
+    }
+
+    // Tell the L4V2 driver to capture into buffers we provide
+    v4l2_requestbuffers bufrequest;
+    bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    bufrequest.memory = V4L2_MEMORY_DMABUF;
+    bufrequest.count = dmaBufFds.size();
+    if (ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
+        PLOG(WARNING) << "VIDIOC_REQBUFS failed; the driver may not support dma-bufs";
+        mRunMode = STOPPED;
+        return false;
+    }
+
+    if (bufrequest.count != dmaBufFds.size()) {
+        // Buffer indices must match the positions in dmaBufFds
+        LOG(ERROR) << "The driver accepted " << bufrequest.count << " of "
+                   << dmaBufFds.size() << " dma-bufs";
+        mMemoryType = V4L2_MEMORY_DMABUF;
+        releaseBuffers();
+        mRunMode = STOPPED;
+        return false;
+    }
+
+    mMemoryType = V4L2_MEMORY_DMABUF;
+    mNumBuffers = bufrequest.count;
+    mDmaBufFds = dmaBufFds;
+    mBufferInfos = std::make_unique<v4l2_buffer[]>(mNumBuffers);
+    mPixelBuffers = std::make_unique<void *[]>(mNumBuffers);
+
+    for (int i = 0; i < mNumBuffers; ++i) {
+        memset(&mBufferInfos[i], 0, sizeof(v4l2_buffer));
+        mBufferInfos[i].type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        mBufferInfos[i].memory = V4L2_MEMORY_DMABUF;
+        mBufferInfos[i].index = i;
+        mBufferInfos[i].m.fd = mDmaBufFds[i];
+
+        // Nothing is mapped; the consumer reads the pixels through its own handle
+        mPixelBuffers[i] = nullptr;
+
+        if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[i]) < 0) {
+            PLOG(ERROR) << "VIDIOC_QBUF failed with dma-buf fd " << mDmaBufFds[i];
+            releaseBuffers();
+            mRunMode = STOPPED;
+            return false;
+        }
+    }
+
+    LOG(INFO) << "Capturing into " << mNumBuffers << " dma-bufs";
+    if (!startCapture(callback)) {
+        releaseBuffers();
+        mRunMode = STOPPED;
+        return false;
+    }
+
+    return true;
+}
+
+
+bool VideoCapture::startCapture(std::function<void(VideoCapture*, imageBuffer*, void*)> callback) {
+    // A rate asked for while the device was streaming may not have been taken yet
+    applyFrameRate();
+
     // Start the video stream
     const int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if (ioctl(mDeviceFd, VIDIOC_STREAMON, &type) < 0) {
@@ -253,35 +411,55 @@ void VideoCapture::stopStream() {
         LOG(DEBUG) << "Capture thread stopped.";
     }
 
-    for (int i = 0; i < mNumBuffers; ++i) {
-        // Unmap the buffers we allocated
-        munmap(mPixelBuffers[i], mBufferInfos[i].length);
+    {
+        // STREAMOFF took back all the buffers, including the ones we didn't return
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        mFrames.clear();
+        mLatestFrame = -1;
     }
 
-    // Tell the L4V2 driver to release our streaming buffers
+    releaseBuffers();
+
+    // Drop our reference to the frame delivery callback interface
+    mCallback = nullptr;
+}
+
+
+void VideoCapture::releaseBuffers() {
+    if (mMemoryType == V4L2_MEMORY_MMAP) {
+        for (int i = 0; i < mNumBuffers; ++i) {
+            // Unmap the buffers we allocated
+            munmap(mPixelBuffers[i], mBufferInfos[i].length);
+        }
+    }
+
+    // Tell the L4V2 driver to release our streaming buffers; dma-bufs stay with their owner
     v4l2_requestbuffers bufrequest;
     bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    bufrequest.memory = V4L2_MEMORY_MMAP;
+    bufrequest.memory = mMemoryType;
     bufrequest.count = 0;
     ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest);
 
-    // Drop our reference to the frame delivery callback interface
-    mCallback = nullptr;
-
     // Release capture buffers
     mNumBuffers = 0;
     mBufferInfos = nullptr;
     mPixelBuffers = nullptr;
+    mDmaBufFds.clear();
+    mMemoryType = V4L2_MEMORY_MMAP;
 }
 
 
 bool VideoCapture::returnFrame(int id) {
+    std::lock_guard<std::mutex> lock(mFramesLock);
     if (mFrames.find(id) == mFrames.end()) {
         LOG(WARNING) << "Invalid request to return a buffer " << id << " is ignored.";
         return false;
     }
 
     // Requeue the buffer to capture the next available frame
+    if (mMemoryType == V4L2_MEMORY_DMABUF) {
+        mBufferInfos[id].m.fd = mDmaBufFds[id];
+    }
     if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[id]) < 0) {
         PLOG(ERROR) << "VIDIOC_QBUF failed";
         return false;
@@ -289,30 +467,69 @@ bool VideoCapture::returnFrame(int id) {
 
     // Remove ID of returned buffer from the set
     mFrames.erase(id);
+    if (mLatestFrame == id) {
+        mLatestFrame = -1;
+    }
 
     return true;
 }
 
 
+int VideoCapture::exportDmaBuf(int id) {
+    if (mMemoryType != V4L2_MEMORY_MMAP || id < 0 || id >= mNumBuffers) {
+        LOG(ERROR) << "Can't export capture buffer " << id;
+        return -1;
+    }
+
+    v4l2_exportbuffer expbuf = {};
+    expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    expbuf.index = id;
+    expbuf.flags = O_RDONLY | O_CLOEXEC;
+    if (ioctl(mDeviceFd, VIDIOC_EXPBUF, &expbuf) < 0) {
+        PLOG(ERROR) << "VIDIOC_EXPBUF failed";
+        return -1;
+    }
+
+    return expbuf.fd;
+}
+
+
 // This runs on a background thread to receive and dispatch video frames
 void VideoCapture::collectFrames() {
+    android::automotive::evs::threadpolicy::applyThreadPolicy(
+            android::automotive::evs::threadpolicy::kRoleCameraCapture);
+
     // Run until our atomic signal is cleared
     while (mRunMode == RUN) {
         struct v4l2_buffer buf = {
             .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-            .memory = V4L2_MEMORY_MMAP
+            .memory = mMemoryType
         };
 
         // Wait for a buffer to be ready
         if (ioctl(mDeviceFd, VIDIOC_DQBUF, &buf) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             PLOG(ERROR) << "VIDIOC_DQBUF failed";
             break;
         }
 
-        mFrames.insert(buf.index);
+        if (buf.index >= static_cast<__u32>(mNumBuffers)) {
+            LOG(ERROR) << "Driver returned an unknown buffer " << buf.index;
+            continue;
+        }
+
+        {
+            // The other buffers stay queued, so the driver keeps capturing while this one is
+            // being consumed
+            std::lock_guard<std::mutex> lock(mFramesLock);
+            mFrames.insert(buf.index);
+            mLatestFrame = buf.index;
 
-        // Update a frame metadata
-        mBufferInfos[buf.index] = buf;
+            // Update a frame metadata
+            mBufferInfos[buf.index] = buf;
+        }
 
         // If a callback was requested per frame, do that now
         if (mCallback) {
@@ -326,6 +543,49 @@ void VideoCapture::collectFrames() {
 }
 
 
+bool VideoCapture::setFrameRate(unsigned framesPerSecond) {
+    if (mDefaultTimePerFrame.numerator == 0) {
+        return false;
+    }
+
+    mFrameRate = framesPerSecond;
+    if (!applyFrameRate() && errno != EBUSY) {
+        return false;
+    }
+
+    return true;
+}
+
+
+bool VideoCapture::applyFrameRate() {
+    if (mDefaultTimePerFrame.numerator == 0) {
+        return true;
+    }
+
+    v4l2_streamparm streamParm = {};
+    streamParm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    streamParm.parm.capture.timeperframe = mDefaultTimePerFrame;
+    if (mFrameRate > 0 &&
+        mFrameRate * mDefaultTimePerFrame.numerator < mDefaultTimePerFrame.denominator) {
+        streamParm.parm.capture.timeperframe = {1, mFrameRate};
+    }
+
+    if (ioctl(mDeviceFd, VIDIOC_S_PARM, &streamParm) < 0) {
+        if (errno == EBUSY) {
+            LOG(DEBUG) << "Frame rate will change when the stream restarts";
+        } else {
+            PLOG(ERROR) << "VIDIOC_S_PARM failed";
+        }
+        return false;
+    }
+
+    // The driver picks the nearest rate it supports
+    LOG(INFO) << "Frame rate set to " << streamParm.parm.capture.timeperframe.denominator
+              << "/" << streamParm.parm.capture.timeperframe.numerator << " fps";
+    return true;
+}
+
+
 int VideoCapture::setParameter(v4l2_control& control) {
     int status = ioctl(mDeviceFd, VIDIOC_S_CTRL, &control);
     if (status < 0) {
@@ -337,6 +597,41 @@ int VideoCapture::setParameter(v4l2_control& control) {
 }
 
 
+int VideoCapture::setParameters(std::vector<v4l2_ext_control>& controls) {
+    if (controls.empty()) {
+        return 0;
+    }
+
+    v4l2_ext_controls extControls = {};
+    extControls.which = V4L2_CTRL_WHICH_CUR_VAL;
+    extControls.count = controls.size();
+    extControls.controls = controls.data();
+    int status = ioctl(mDeviceFd, VIDIOC_S_EXT_CTRLS, &extControls);
+    if (status < 0 && errno == ENOTTY) {
+        // Old drivers only have the single control ioctls
+        for (auto&& extControl : controls) {
+            v4l2_control control = {extControl.id, extControl.value};
+            if (setParameter(control) < 0 || getParameter(control) < 0) {
+                return -1;
+            }
+            extControl.value = control.value;
+        }
+        return 0;
+    } else if (status < 0) {
+        PLOG(ERROR) << "Failed to program " << controls.size() << " parameter values, "
+                    << "error at index " << extControls.error_idx;
+        return status;
+    }
+
+    status = ioctl(mDeviceFd, VIDIOC_G_EXT_CTRLS, &extControls);
+    if (status < 0) {
+        PLOG(ERROR) << "Failed to read back " << controls.size() << " parameter values";
+    }
+
+    return status;
+}
+
+
 int VideoCapture::getParameter(v4l2_control& control) {
     int status = ioctl(mDeviceFd, VIDIOC_G_CTRL, &control);
     if (status < 0) {
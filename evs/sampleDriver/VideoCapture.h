@@ -18,8 +18,10 @@
 
 #include <atomic>
 #include <functional>
+#include <mutex>
 #include <set>
 #include <thread>
+#include <vector>
 
 #include <linux/videodev2.h>
 
@@ -28,10 +30,26 @@ typedef v4l2_buffer imageBuffer;
 
 class VideoCapture {
 public:
+    // Number of capture buffers queued to the driver unless the caller asks otherwise.  More
+    // than one lets the sensor capture the next frame while the current one is being consumed.
+    static constexpr unsigned kDefaultNumBuffers = 4;
+    static constexpr unsigned kMaxNumBuffers = 8;
+
     bool open(const char* deviceName, const int32_t width = 0, const int32_t height = 0);
     void close();
 
-    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr);
+    // Requests |numBuffers| capture buffers, clamped to [1, kMaxNumBuffers]; the driver may
+    // grant a different number.
+    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr,
+                     unsigned numBuffers = kDefaultNumBuffers);
+
+    // Captures straight into the dma-bufs in |dmaBufFds|, which must fit the current format,
+    // instead of buffers mapped from the driver.  The index of a captured frame is its position
+    // in |dmaBufFds|, no pixel pointer is passed to the callback, and the buffer is refilled only
+    // after markFrameConsumed().  Returns false, leaving the stream stopped, if the driver can't
+    // import them.
+    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback,
+                     const std::vector<int>& dmaBufFds);
     void stopStream();
 
     // Valid only after open()
@@ -42,32 +60,59 @@ public:
 
     // NULL until stream is started
     void* getLatestData() {
-        if (mFrames.empty()) {
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        if (mLatestFrame < 0 || mFrames.find(mLatestFrame) == mFrames.end()) {
             // No frame is available
             return nullptr;
         }
 
         // Return a pointer to the buffer captured most recently
-        const int latestBufferId = *mFrames.end();
-        return mPixelBuffers[latestBufferId];
+        return mPixelBuffers[mLatestFrame];
     }
 
-    bool isFrameReady()             { return !mFrames.empty(); }
+    // Exports capture buffer |id| of a stream started with driver buffers as a dma-buf.
+    // Returns its file descriptor, owned by the caller, or -1 on failure.
+    int exportDmaBuf(int id);
+
+    bool isFrameReady() {
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        return !mFrames.empty();
+    }
+    int getNumBuffers()             { return mNumBuffers; }
+    bool isZeroCopy()               { return mMemoryType == V4L2_MEMORY_DMABUF; }
     void markFrameConsumed(int id)  { returnFrame(id); }
 
     bool isOpen()                   { return mDeviceFd >= 0; }
 
     int setParameter(struct v4l2_control& control);
     int getParameter(struct v4l2_control& control);
+    // Programs all of |controls| with a single VIDIOC_S_EXT_CTRLS, so the device takes them
+    // at once, and reads back the values it applied.  Falls back to one control at a time on
+    // devices without extended controls.
+    int setParameters(std::vector<v4l2_ext_control>& controls);
     std::set<uint32_t> enumerateCameraControls();
 
+    // Limits the sensor to |framesPerSecond|, or lets it run at its default rate if 0.  The
+    // rate never goes above the default.  A device that can't change its rate while it streams
+    // takes the new rate when the stream starts again.  Returns false if the device has no
+    // frame rate control.
+    bool setFrameRate(unsigned framesPerSecond);
+
 private:
+    bool startCapture(std::function<void(VideoCapture*, imageBuffer*, void*)> callback);
+
+    // Programs mFrameRate into the device.  Returns false if the device refuses it.
+    bool applyFrameRate();
+
+    void releaseBuffers();
     void collectFrames();
     bool returnFrame(int id);
 
     int mDeviceFd = -1;
 
     int mNumBuffers = 0;
+    __u32 mMemoryType = V4L2_MEMORY_MMAP;   // V4L2_MEMORY_MMAP or V4L2_MEMORY_DMABUF
+    std::vector<int> mDmaBufFds;            // Capture buffers when mMemoryType is DMABUF
     std::unique_ptr<v4l2_buffer[]> mBufferInfos = nullptr;
     std::unique_ptr<void*[]>       mPixelBuffers = nullptr;
 
@@ -76,11 +121,16 @@ private:
     __u32   mHeight = 0;
     __u32   mStride = 0;
 
+    v4l2_fract mDefaultTimePerFrame = {};   // Zero if the frame rate can't be changed
+    unsigned   mFrameRate = 0;              // Frame rate limit asked for; 0 for the default
+
     std::function<void(VideoCapture*, imageBuffer*, void*)> mCallback;
 
     std::thread mCaptureThread;             // The thread we'll use to dispatch frames
     std::atomic<int> mRunMode;              // Used to signal the frame loop (see RunModes below)
-    std::set<int> mFrames;                  // Set of available frame buffers
+    std::mutex mFramesLock;                 // Guards mFrames and mLatestFrame
+    std::set<int> mFrames;                  // Buffers dequeued from the driver, not yet returned
+    int mLatestFrame = -1;                  // Buffer dequeued most recently
 
     // Careful changing these -- we're using bit-wise ops to manipulate these
     enum RunModes {
@@ -29,20 +29,28 @@ namespace V1_1 {
 namespace implementation {
 
 
+// Each of these converts the rows [firstRow, lastRow) of a frame, so stripes of the same
+// frame can be converted in parallel.  Stripes of the NV21 targets must start and end on even
+// rows, since every two rows share their chroma samples.
 void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned lastRow);
 
 void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned lastRow);
 
 void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned lastRow);
 
 void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned lastRow);
 
 void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned lastRow);
 
 } // namespace implementation
 } // namespace V1_1
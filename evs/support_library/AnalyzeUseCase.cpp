@@ -28,9 +28,12 @@ namespace automotive {
 namespace evs {
 namespace support {
 
-AnalyzeUseCase::AnalyzeUseCase(string cameraId, BaseAnalyzeCallback* callback)
+AnalyzeUseCase::AnalyzeUseCase(string cameraId, BaseAnalyzeCallback* callback,
+                               bool zeroCopy, unsigned maxFps)
               : BaseUseCase(vector<string>(1, cameraId)),
-                mAnalyzeCallback(callback) {}
+                mAnalyzeCallback(callback),
+                mZeroCopy(zeroCopy),
+                mMaxFps(maxFps) {}
 
 AnalyzeUseCase::~AnalyzeUseCase() {}
 
@@ -86,7 +89,7 @@ bool AnalyzeUseCase::startVideoStream() {
 
     ALOGD("Attach callback to StreamHandler");
     if (mAnalyzeCallback != nullptr) {
-        mStreamHandler->attachAnalyzeCallback(mAnalyzeCallback);
+        mStreamHandler->attachAnalyzeCallback(mAnalyzeCallback, mZeroCopy, mMaxFps);
     }
 
     mStreamHandler->startStream();
@@ -129,8 +132,8 @@ void AnalyzeUseCase::stopVideoStream() {
 // TODO(b/130246434): For both Analyze use case and Display use case, return a
 // pointer instead of an object.
 AnalyzeUseCase AnalyzeUseCase::createDefaultUseCase(
-    string cameraId, BaseAnalyzeCallback* callback) {
-    return AnalyzeUseCase(cameraId, callback);
+    string cameraId, BaseAnalyzeCallback* callback, bool zeroCopy, unsigned maxFps) {
+    return AnalyzeUseCase(cameraId, callback, zeroCopy, maxFps);
 }
 
 }  // namespace support
@@ -34,19 +34,27 @@ namespace support {
 
 class AnalyzeUseCase : public BaseUseCase {
 public:
-    AnalyzeUseCase(string cameraId, BaseAnalyzeCallback* analyzeCallback);
+    // With |zeroCopy| set, the callback reads the camera buffers directly
+    // instead of copies, and a non-zero |maxFps| limits it to that many frames
+    // per second; see StreamHandler::attachAnalyzeCallback().
+    AnalyzeUseCase(string cameraId, BaseAnalyzeCallback* analyzeCallback,
+                   bool zeroCopy = false, unsigned maxFps = 0);
     virtual ~AnalyzeUseCase();
     virtual bool startVideoStream() override;
     virtual void stopVideoStream() override;
 
     static AnalyzeUseCase createDefaultUseCase(string cameraId,
-                                               BaseAnalyzeCallback* cb = nullptr);
+                                               BaseAnalyzeCallback* cb = nullptr,
+                                               bool zeroCopy = false,
+                                               unsigned maxFps = 0);
 
 private:
     bool initialize();
 
     bool mIsInitialized = false;
     BaseAnalyzeCallback* mAnalyzeCallback = nullptr;
+    bool mZeroCopy = false;
+    unsigned mMaxFps = 0;
 
     sp<StreamHandler>           mStreamHandler;
     sp<ResourceManager>         mResourceManager;
@@ -27,6 +27,12 @@ namespace support {
 class BaseAnalyzeCallback{
     public:
         virtual void analyze(const Frame&) = 0;
+
+        // Called before analyze() with the number of frames dropped since the
+        // previous call because the analyzer was still busy.  The newest frame
+        // always wins, so a slow analyzer sees fewer but recent frames.
+        virtual void onFramesSkipped(unsigned /* count */) {}
+
         virtual ~BaseAnalyzeCallback() {};
 };
 
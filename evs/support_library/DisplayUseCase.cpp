@@ -32,9 +32,11 @@ using android::hardware::joinRpcThreadpool;
 // TODO(b/130246434): since we don't support multi-display use case, there
 // should only be one DisplayUseCase. Add the logic to prevent more than
 // one DisplayUseCases running at the same time.
-DisplayUseCase::DisplayUseCase(string cameraId, BaseRenderCallback* callback)
+DisplayUseCase::DisplayUseCase(string cameraId, BaseRenderCallback* callback,
+                               unsigned maxFps)
               : BaseUseCase(vector<string>(1, cameraId)) {
     mRenderCallback = callback;
+    mMaxFps = maxFps;
 }
 
 DisplayUseCase::~DisplayUseCase() {
@@ -115,6 +117,7 @@ bool DisplayUseCase::startVideoStream() {
     if (mRenderCallback != nullptr) {
         mStreamHandler->attachRenderCallback(mRenderCallback);
     }
+    mStreamHandler->setDisplayFrameRate(mMaxFps);
 
     ALOGD("Start video streaming using worker thread");
     mIsReadyToRun = true;
@@ -171,6 +174,7 @@ void DisplayUseCase::stopVideoStream() {
         // release other resources.
     } else {
         mStreamHandler->detachRenderCallback();
+        mStreamHandler->setDisplayFrameRate(0);
     }
 
     if (mResourceManager == nullptr) {
@@ -244,8 +248,9 @@ bool DisplayUseCase::streamFrame() {
     }
 }
 
-DisplayUseCase DisplayUseCase::createDefaultUseCase(string cameraId, BaseRenderCallback* callback) {
-    return DisplayUseCase(cameraId, callback);
+DisplayUseCase DisplayUseCase::createDefaultUseCase(string cameraId, BaseRenderCallback* callback,
+                                                    unsigned maxFps) {
+    return DisplayUseCase(cameraId, callback, maxFps);
 }
 
 }  // namespace support
@@ -46,11 +46,13 @@ class DisplayUseCase : public BaseUseCase {
     void stopVideoStream() override;
 
     // TODO(b/130246434): Add configuration class to create more use case.
+    // A non-zero |maxFps| shows at most that many frames per second.
     static DisplayUseCase createDefaultUseCase(string cameraId,
-                                               BaseRenderCallback* cb = nullptr);
+                                               BaseRenderCallback* cb = nullptr,
+                                               unsigned maxFps = 0);
 
   private:
-    DisplayUseCase(string cameraId, BaseRenderCallback* renderCallback);
+    DisplayUseCase(string cameraId, BaseRenderCallback* renderCallback, unsigned maxFps);
 
     // TODO(b/130246434): Think about whether we should make init public so
     // users can call it.
@@ -59,6 +61,7 @@ class DisplayUseCase : public BaseUseCase {
 
     bool mIsInitialized = false;
     BaseRenderCallback* mRenderCallback = nullptr;
+    unsigned mMaxFps = 0;
     std::unique_ptr<RenderBase> mCurrentRenderer;
 
     sp<IEvsDisplay> mDisplay;
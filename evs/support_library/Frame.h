@@ -16,6 +16,8 @@
 #ifndef CAR_LIB_EVS_SUPPORT_FRAME_H
 #define CAR_LIB_EVS_SUPPORT_FRAME_H
 
+struct AHardwareBuffer;
+
 namespace android {
 namespace automotive {
 namespace evs {
@@ -26,6 +28,18 @@ struct Frame {
     unsigned height;
     unsigned stride;
     uint8_t* data;
+
+    // The camera buffer |data| maps, for frames analyzed without a copy.  Like
+    // |data| it is only valid until analyze() returns.
+    AHardwareBuffer* hardwareBuffer = nullptr;
+
+    // The Android pixel format (HAL_PIXEL_FORMAT_*) of |data|, or 0 if unknown.
+    uint32_t format = 0;
+
+    // When the camera delivered the frame, in nanoseconds of the monotonic
+    // clock.  EVS 1.0 reports no capture time, so this is the closest there is
+    // to compare frames of different cameras by.
+    int64_t timestamp = 0;
 };
 
 }  // namespace support
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CAR_LIB_EVS_SUPPORT_FRAME_RATE_LIMITER_H
+#define CAR_LIB_EVS_SUPPORT_FRAME_RATE_LIMITER_H
+
+#include <utils/Timers.h>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+/*
+ * Picks the frames of a stream that one use case gets, so that it sees at
+ * most a given number of frames per second.  A rate of zero lets every frame
+ * through.
+ */
+class FrameRateLimiter {
+public:
+    void setMaxRate(unsigned framesPerSecond) {
+        mInterval = framesPerSecond > 0 ? s2ns(1) / framesPerSecond : 0;
+        mNextTime = 0;
+    }
+
+    // Returns whether the frame arriving at |now| should be delivered
+    bool admit(nsecs_t now) {
+        if (mInterval == 0) {
+            return true;
+        }
+        if (now < mNextTime) {
+            return false;
+        }
+
+        // Keeps to the schedule so the average rate holds although the frames
+        // don't arrive exactly on it, unless we have fallen a period behind
+        mNextTime = now - mNextTime < mInterval ? mNextTime + mInterval : now + mInterval;
+        return true;
+    }
+
+private:
+    nsecs_t mInterval = 0;
+    nsecs_t mNextTime = 0;
+};
+
+}  // namespace support
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+#endif  // CAR_LIB_EVS_SUPPORT_FRAME_RATE_LIMITER_H
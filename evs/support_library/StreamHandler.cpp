@@ -36,14 +36,19 @@ namespace support {
 using ::std::lock_guard;
 using ::std::unique_lock;
 
+// Frames in flight we ask for: one held by the client and one on deck
+static constexpr unsigned kDisplayFramesInFlight = 2;
+
+// Zero-copy analysis also keeps the frame being analyzed and the pending one
+static constexpr unsigned kZeroCopyFramesInFlight = kDisplayFramesInFlight + 2;
+
 StreamHandler::StreamHandler(android::sp <IEvsCamera> pCamera) :
     mCamera(pCamera),
-    mAnalyzeCallback(nullptr),
-    mAnalyzerRunning(false)
+    mAnalyzeCallback(nullptr)
 {
     // We rely on the camera having at least two buffers available since we'll hold one and
     // expect the camera to be able to capture a new image in the background.
-    pCamera->setMaxFramesInFlight(2);
+    pCamera->setMaxFramesInFlight(kDisplayFramesInFlight);
 }
 
 // TODO(b/130246343): investigate further to make sure the resources are cleaned
@@ -127,8 +132,9 @@ void StreamHandler::doneWithFrame(const BufferDesc& buffer) {
         return;
     }
 
-    // Send the buffer back to the underlying camera
-    mCamera->doneWithFrame(mOriginalBuffers[mHeldBuffer]);
+    // Send the buffer back to the underlying camera unless it is still being
+    // analyzed
+    releaseFrame_Locked(mOriginalBuffers[mHeldBuffer]);
 
     // Clear the held position
     mHeldBuffer = -1;
@@ -147,41 +153,46 @@ Return<void> StreamHandler::deliverFrame(const BufferDesc& buffer) {
             // Signal that the last frame has been received and the stream is stopped
             mRunning = false;
         } else {
-            // Do we already have a "ready" frame?
-            if (mReadyBuffer >= 0) {
-                // Send the previously saved buffer back to the camera unused
-                mCamera->doneWithFrame(mOriginalBuffers[mReadyBuffer]);
-
-                // We'll reuse the same ready buffer index
-            } else if (mHeldBuffer >= 0) {
-                // The client is holding a buffer, so use the other slot for "on deck"
-                mReadyBuffer = 1 - mHeldBuffer;
-            } else {
-                // This is our first buffer, so just pick a slot
-                mReadyBuffer = 0;
-            }
-
-            // Save this frame until our client is interested in it
-            mOriginalBuffers[mReadyBuffer] = buffer;
-
-            // If render callback is not null, process the frame with render
-            // callback.
-            if (mRenderCallback != nullptr) {
-                processFrame(mOriginalBuffers[mReadyBuffer],
-                             mProcessedBuffers[mReadyBuffer]);
-            } else {
-                ALOGI("Render callback is null in deliverFrame.");
-            }
+            const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+            // Hold the frame while we hand it out
+            mFrameRefs[buffer.bufferId] = 1;
+
+            if (mDisplayRate.admit(now)) {
+                // Do we already have a "ready" frame?
+                if (mReadyBuffer >= 0) {
+                    // Send the previously saved buffer back to the camera unused
+                    releaseFrame_Locked(mOriginalBuffers[mReadyBuffer]);
+
+                    // We'll reuse the same ready buffer index
+                } else if (mHeldBuffer >= 0) {
+                    // The client is holding a buffer, so use the other slot for "on deck"
+                    mReadyBuffer = 1 - mHeldBuffer;
+                } else {
+                    // This is our first buffer, so just pick a slot
+                    mReadyBuffer = 0;
+                }
 
-            // If analyze callback is not null and the analyze thread is
-            // available, copy the frame and run the analyze callback in
-            // analyze thread.
-            {
-                std::shared_lock<std::shared_mutex> analyzerLock(mAnalyzerLock);
-                if (mAnalyzeCallback != nullptr && !mAnalyzerRunning) {
-                    copyAndAnalyzeFrame(mOriginalBuffers[mReadyBuffer]);
+                // Save this frame until our client is interested in it
+                mOriginalBuffers[mReadyBuffer] = buffer;
+                mFrameRefs[buffer.bufferId]++;
+
+                // If render callback is not null, process the frame with render
+                // callback.
+                if (mRenderCallback != nullptr) {
+                    processFrame(mOriginalBuffers[mReadyBuffer],
+                                 mProcessedBuffers[mReadyBuffer]);
+                } else {
+                    ALOGI("Render callback is null in deliverFrame.");
                 }
             }
+
+            // If analyze callback is not null, copy the frame for the analyze
+            // thread, or share it in zero-copy mode.
+            copyAndAnalyzeFrame(buffer, now);
+
+            // Returns the frame right away unless somebody took it
+            releaseFrame_Locked(buffer);
         }
     }
 
@@ -203,6 +214,14 @@ void StreamHandler::attachRenderCallback(BaseRenderCallback* callback) {
     mRenderCallback = callback;
 }
 
+void StreamHandler::setDisplayFrameRate(unsigned maxFps) {
+    ALOGD("StreamHandler::setDisplayFrameRate %u", maxFps);
+
+    lock_guard<mutex> lock(mLock);
+
+    mDisplayRate.setMaxRate(maxFps);
+}
+
 void StreamHandler::detachRenderCallback() {
     ALOGD("StreamHandler::detachRenderCallback");
 
@@ -211,32 +230,156 @@ void StreamHandler::detachRenderCallback() {
     mRenderCallback = nullptr;
 }
 
-void StreamHandler::attachAnalyzeCallback(BaseAnalyzeCallback* callback) {
+void StreamHandler::attachAnalyzeCallback(BaseAnalyzeCallback* callback, bool zeroCopy,
+                                          unsigned maxFps) {
     ALOGD("StreamHandler::attachAnalyzeCallback");
 
+    if (callback == nullptr) {
+        ALOGW("Ignored! The analyze callback is null");
+        return;
+    }
+
+    lock_guard<mutex> lock(mLock);
+    lock_guard<mutex> analyzerLock(mAnalyzerLock);
+
     if (mAnalyzeCallback != nullptr) {
         ALOGW("Ignored! There should only be one analyze callcack");
         return;
     }
 
-    {
-        lock_guard<std::shared_mutex> lock(mAnalyzerLock);
-        mAnalyzeCallback = callback;
+    // The analyze thread holds up to two more camera frames in zero-copy mode
+    if (zeroCopy && mCamera != nullptr &&
+        mCamera->setMaxFramesInFlight(kZeroCopyFramesInFlight) != EvsResult::OK) {
+        ALOGW("Camera can't hold %u frames in flight; analyzing copies of the frames",
+              kZeroCopyFramesInFlight);
+        zeroCopy = false;
     }
+
+    mAnalyzeCallback = callback;
+    mAnalyzeZeroCopy = zeroCopy;
+    mAnalyzeRate.setMaxRate(maxFps);
+    mAnalyzerQuit = false;
+    mSkippedFrames = 0;
+    mAnalyzeThread = std::thread([this]() { analyzeThreadLoop(); });
 }
 
 void StreamHandler::detachAnalyzeCallback() {
     ALOGD("StreamHandler::detachAnalyzeCallback");
 
+    // Holding mLock as well makes sure that no frame is being copied for the
+    // analyze thread.
+    std::thread analyzeThread;
     {
-        std::unique_lock<std::shared_mutex> lock(mAnalyzerLock);
-
-        // Wait until current running analyzer ends
-        mAnalyzerSignal.wait(lock, [this] { return !mAnalyzerRunning; });
+        lock_guard<mutex> lock(mLock);
+        lock_guard<mutex> analyzerLock(mAnalyzerLock);
         mAnalyzeCallback = nullptr;
+        mAnalyzerQuit = true;
+        analyzeThread = std::move(mAnalyzeThread);
+    }
+    mAnalyzerSignal.notify_one();
+
+    // Wait until current running analyzer ends
+    if (analyzeThread.joinable()) {
+        analyzeThread.join();
+    }
+
+    releaseAnalyzeBuffers();
+}
+
+void StreamHandler::analyzeThreadLoop() {
+    ALOGD("StreamHandler: Analyze Thread starts");
+
+    unique_lock<mutex> lock(mAnalyzerLock);
+    while (true) {
+        mAnalyzerSignal.wait(lock, [this] { return mAnalyzerQuit || mPendingBuffer >= 0; });
+        if (mAnalyzerQuit) {
+            break;
+        }
+
+        // Take the newest frame out of the mailbox
+        const int slot = mPendingBuffer;
+        mAnalyzingBuffer = slot;
+        mPendingBuffer = -1;
+        const unsigned skipped = mSkippedFrames;
+        mSkippedFrames = 0;
+        BaseAnalyzeCallback* callback = mAnalyzeCallback;
+        lock.unlock();
+
+        // mAnalyzeCallback can only be cleared by detachAnalyzeCallback(),
+        // which waits for us before returning.
+        if (skipped > 0) {
+            ALOGD("StreamHandler: %u frames skipped while the analyzer was busy", skipped);
+            callback->onFramesSkipped(skipped);
+        }
+        callback->analyze(mAnalyzeFrames[slot]);
+
+        {
+            lock_guard<mutex> frameLock(mLock);
+            unmapAnalyzeFrame_Locked(slot);
+        }
+
+        lock.lock();
+        mAnalyzingBuffer = -1;
+    }
+
+    ALOGD("StreamHandler: Analyze Thread ends");
+}
+
+void StreamHandler::releaseAnalyzeBuffers() {
+    lock_guard<mutex> lock(mLock);
+    lock_guard<mutex> analyzerLock(mAnalyzerLock);
+
+    for (int i = 0; i < 2; i++) {
+        // A frame left in the mailbox is still mapped
+        unmapAnalyzeFrame_Locked(i);
+
+        BufferDesc& buffer = mAnalyzeBuffers[i];
+        if (buffer.memHandle.getNativeHandle() != nullptr) {
+            GraphicBufferAllocator::get().free(buffer.memHandle);
+            buffer = {};
+        }
+    }
+
+    mPendingBuffer = -1;
+    mAnalyzingBuffer = -1;
+
+    if (mAnalyzeZeroCopy) {
+        mAnalyzeZeroCopy = false;
+        if (mCamera != nullptr) {
+            mCamera->setMaxFramesInFlight(kDisplayFramesInFlight);
+        }
+    }
+}
+
+void StreamHandler::releaseFrame_Locked(const BufferDesc& buffer) {
+    auto it = mFrameRefs.find(buffer.bufferId);
+    if (it != mFrameRefs.end() && --it->second > 0) {
+        return;
+    }
+
+    if (it != mFrameRefs.end()) {
+        mFrameRefs.erase(it);
+    }
+
+    // The camera is gone once the stream has been shut down
+    if (mCamera != nullptr) {
+        mCamera->doneWithFrame(buffer);
     }
 }
 
+void StreamHandler::unmapAnalyzeFrame_Locked(int slot) {
+    if (mAnalyzeCameraBuffers[slot] != nullptr) {
+        mAnalyzeCameraBuffers[slot]->unlock();
+        mAnalyzeCameraBuffers[slot] = nullptr;
+        releaseFrame_Locked(mAnalyzeCameraFrames[slot]);
+        mAnalyzeCameraFrames[slot] = {};
+    } else if (mAnalyzeFrames[slot].data != nullptr) {
+        android::GraphicBufferMapper::get().unlock(mAnalyzeBuffers[slot].memHandle);
+    }
+
+    mAnalyzeFrames[slot].data = nullptr;
+}
+
 bool isSameFormat(const BufferDesc& input, const BufferDesc& output) {
     return input.width == output.width
         && input.height == output.height
@@ -380,28 +523,58 @@ bool StreamHandler::processFrame(const BufferDesc& input,
     return true;
 }
 
-bool StreamHandler::copyAndAnalyzeFrame(const BufferDesc& input) {
+bool StreamHandler::copyAndAnalyzeFrame(const BufferDesc& input, nsecs_t now) {
     ALOGD("StreamHandler::copyAndAnalyzeFrame");
 
+    // Pick the buffer the analyze thread isn't working on.  If it holds a frame
+    // that hasn't been picked up yet, the new frame replaces it.
+    int slot;
+    bool zeroCopy;
+    {
+        lock_guard<mutex> lock(mAnalyzerLock);
+        if (mAnalyzeCallback == nullptr || !mAnalyzeRate.admit(now)) {
+            return false;
+        }
+
+        zeroCopy = mAnalyzeZeroCopy;
+
+        slot = mAnalyzingBuffer == 0 ? 1 : 0;
+        if (mPendingBuffer == slot) {
+            mPendingBuffer = -1;
+            mSkippedFrames++;
+        }
+    }
+
+    BufferDesc& analyzeBuffer = mAnalyzeBuffers[slot];
+    Frame& analyzeFrame = mAnalyzeFrames[slot];
+
+    // A replaced frame is still mapped
+    unmapAnalyzeFrame_Locked(slot);
+
+    if (zeroCopy) {
+        return shareFrameForAnalysis_Locked(input, slot, now);
+    }
+
     // TODO(b/130246434): make the following into a method. Some lines are
     // duplicated with processFrame, move them into new methods as well.
-    if (!isSameFormat(input, mAnalyzeBuffer)
-        || mAnalyzeBuffer.memHandle.getNativeHandle() == nullptr) {
-        mAnalyzeBuffer.width = input.width;
-        mAnalyzeBuffer.height = input.height;
-        mAnalyzeBuffer.format = input.format;
-        mAnalyzeBuffer.usage = input.usage;
-        mAnalyzeBuffer.stride = input.stride;
-        mAnalyzeBuffer.pixelSize = input.pixelSize;
-        mAnalyzeBuffer.bufferId = input.bufferId;
+    if (!isSameFormat(input, analyzeBuffer)
+        || analyzeBuffer.memHandle.getNativeHandle() == nullptr) {
+        analyzeBuffer.width = input.width;
+        analyzeBuffer.height = input.height;
+        analyzeBuffer.format = input.format;
+        analyzeBuffer.usage = input.usage;
+        analyzeBuffer.stride = input.stride;
+        analyzeBuffer.pixelSize = input.pixelSize;
+        analyzeBuffer.bufferId = input.bufferId;
 
         // free the allocated output frame handle if it is not null
-        if (mAnalyzeBuffer.memHandle.getNativeHandle() != nullptr) {
-            GraphicBufferAllocator::get().free(mAnalyzeBuffer.memHandle);
+        if (analyzeBuffer.memHandle.getNativeHandle() != nullptr) {
+            GraphicBufferAllocator::get().free(analyzeBuffer.memHandle);
         }
 
-        if (!allocate(mAnalyzeBuffer)) {
+        if (!allocate(analyzeBuffer)) {
             ALOGE("Error allocating buffer");
+            analyzeBuffer = {};
             return false;
         }
     }
@@ -432,51 +605,99 @@ bool StreamHandler::copyAndAnalyzeFrame(const BufferDesc& input) {
         return false;
     }
 
-    // Lock the allocated buffer in output BufferDesc and map it to a pointer
+    // Lock the allocated buffer in output BufferDesc and map it to a pointer.
+    // It stays mapped until the analyze thread is done with it.
     void* analyzeDataPtr = nullptr;
     android::GraphicBufferMapper::get().lock(
-        mAnalyzeBuffer.memHandle,
-        GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
-        android::Rect(mAnalyzeBuffer.width, mAnalyzeBuffer.height),
+        analyzeBuffer.memHandle,
+        GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_OFTEN,
+        android::Rect(analyzeBuffer.width, analyzeBuffer.height),
         (void**)&analyzeDataPtr);
 
     // If we failed to lock the pixel buffer, return false, and unlock both
     // input and output buffers.
     if (!analyzeDataPtr) {
         ALOGE("Camera failed to gain access to image buffer for analyzing");
+        inputBuffer->unlock();
+        android::GraphicBufferMapper::get().unlock(analyzeBuffer.memHandle);
         return false;
     }
 
-    // Wrap the raw data and copied data, and pass them to the callback.
-    Frame analyzeFrame = {
-        .width = mAnalyzeBuffer.width,
-        .height = mAnalyzeBuffer.height,
-        .stride = mAnalyzeBuffer.stride,
+    // Frames are RGBA, unless the camera streams NV21
+    size_t frameSize = analyzeBuffer.stride * analyzeBuffer.height;
+    if (analyzeBuffer.format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {
+        frameSize += analyzeBuffer.stride * ((analyzeBuffer.height + 1) / 2);
+    } else {
+        frameSize *= 4;
+    }
+    memcpy(analyzeDataPtr, inputDataPtr, frameSize);
+
+    // Unlock the buffers after all changes to the buffer are completed.
+    inputBuffer->unlock();
+
+    // Wrap the copied data for the callback, and post it to the mailbox
+    analyzeFrame = {
+        .width = analyzeBuffer.width,
+        .height = analyzeBuffer.height,
+        .stride = analyzeBuffer.stride,
         .data = (uint8_t*)analyzeDataPtr,
+        .format = analyzeBuffer.format,
+        .timestamp = now,
     };
 
-    memcpy(analyzeDataPtr, inputDataPtr, mAnalyzeBuffer.stride * mAnalyzeBuffer.height * 4);
+    postAnalyzeFrame(slot);
+    return true;
+}
 
-    // Unlock the buffers after all changes to the buffer are completed.
-    inputBuffer->unlock();
+bool StreamHandler::shareFrameForAnalysis_Locked(const BufferDesc& input, int slot,
+                                                 nsecs_t now) {
+    // Map the camera buffer for reading until the analyze thread is done
+    sp<GraphicBuffer> inputBuffer = new GraphicBuffer(
+        input.memHandle, GraphicBuffer::CLONE_HANDLE, input.width,
+        input.height, input.format, 1,  // layer count
+        GRALLOC_USAGE_HW_TEXTURE, input.stride);
 
-    mAnalyzerRunning = true;
-    std::thread([this, analyzeFrame]() {
-        ALOGD("StreamHandler: Analyze Thread starts");
+    if (inputBuffer.get() == nullptr) {
+        ALOGE("Failed to allocate GraphicBuffer to wrap image handle");
+        return false;
+    }
 
-        std::shared_lock<std::shared_mutex> lock(mAnalyzerLock);
-        if (this->mAnalyzeCallback != nullptr) {
-            this->mAnalyzeCallback->analyze(analyzeFrame);
-            android::GraphicBufferMapper::get().unlock(this->mAnalyzeBuffer.memHandle);
-        }
-        this->mAnalyzerRunning = false;
-        mAnalyzerSignal.notify_one();
-        ALOGD("StreamHandler: Analyze Thread ends");
-    }).detach();
+    void* inputDataPtr = nullptr;
+    inputBuffer->lock(
+        GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_NEVER,
+        &inputDataPtr);
+    if (!inputDataPtr) {
+        ALOGE("Failed to gain read access to imageGraphicBuffer");
+        inputBuffer->unlock();
+        return false;
+    }
 
+    // The analyze thread keeps the camera frame from going back to the camera
+    mFrameRefs[input.bufferId]++;
+    mAnalyzeCameraFrames[slot] = input;
+    mAnalyzeCameraBuffers[slot] = inputBuffer;
+    mAnalyzeFrames[slot] = {
+        .width = input.width,
+        .height = input.height,
+        .stride = input.stride,
+        .data = (uint8_t*)inputDataPtr,
+        .hardwareBuffer = inputBuffer->toAHardwareBuffer(),
+        .format = input.format,
+        .timestamp = now,
+    };
+
+    postAnalyzeFrame(slot);
     return true;
 }
 
+void StreamHandler::postAnalyzeFrame(int slot) {
+    {
+        lock_guard<mutex> lock(mAnalyzerLock);
+        mPendingBuffer = slot;
+    }
+    mAnalyzerSignal.notify_one();
+}
+
 }  // namespace support
 }  // namespace evs
 }  // namespace automotive
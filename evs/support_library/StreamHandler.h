@@ -20,7 +20,7 @@
 #include <condition_variable>
 #include <queue>
 #include <thread>
-#include <shared_mutex>
+#include <unordered_map>
 #include <ui/GraphicBuffer.h>
 #include <android/hardware/automotive/evs/1.0/IEvsCameraStream.h>
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
@@ -28,6 +28,8 @@
 
 #include "BaseRenderCallback.h"
 #include "BaseAnalyzeCallback.h"
+#include "Frame.h"
+#include "FrameRateLimiter.h"
 
 namespace android {
 namespace automotive {
@@ -58,6 +60,7 @@ public:
         if (mCamera != nullptr) {
             shutdown();
         }
+        detachAnalyzeCallback();
     };
 
     StreamHandler(android::sp <IEvsCamera> pCamera);
@@ -86,6 +89,13 @@ public:
      */
     void attachRenderCallback(BaseRenderCallback*);
 
+    /*
+     * Limits the frames offered through getNewDisplayFrame() to at most
+     * |maxFps| per second; 0 offers every frame.  Frames the display doesn't
+     * get still go to the analyze callback, if its own rate allows.
+     */
+    void setDisplayFrameRate(unsigned maxFps);
+
     /*
      * Detaches the current render callback.
      *
@@ -99,10 +109,23 @@ public:
      * Attaches an analyze callback to the StreamHandler.
      *
      * When there is a valid analyze callback attached, a thread dedicated for
-     * the analyze callback will be allocated. When the thread is not busy, the
-     * next available evs frame will be copied (now happens in binder thread).
-     * And the copy will be passed into the analyze thread, and be processed by
-     * the analyze callback.
+     * the analyze callback is started and kept until the callback is detached.
+     * Every evs frame is copied (now happens in binder thread) into a mailbox
+     * that holds a single frame, and the analyze thread processes the newest
+     * frame in it whenever it is done with the previous one. A frame that is
+     * replaced before the analyze thread gets to it is dropped and reported
+     * through BaseAnalyzeCallback::onFramesSkipped().
+     *
+     * With |zeroCopy| set, the analyze callback reads the camera buffer itself
+     * through a read-only mapping instead of a copy. The camera buffer is then
+     * returned only once both the display and the analyze thread are done with
+     * it, so the analyzer should finish within a frame time to keep the camera
+     * from running out of buffers. Falls back to copying if the camera can't
+     * provide the extra buffers in flight.
+     *
+     * A non-zero |maxFps| limits the frames passed to the analyze callback to
+     * that many per second, independently of the display. Frames left out this
+     * way are not reported as skipped.
      *
      * Since there is only one AnalyzeUseCase allowed at the same time, at most
      * only one analyze callback can be attached. The current analyze callback
@@ -116,14 +139,17 @@ public:
     // analyze thread id good enough. But we should be able to support several
     // analyze use cases running at the same time, so we should probably use a
     // thread pool to handle the cases.
-    void attachAnalyzeCallback(BaseAnalyzeCallback*);
+    void attachAnalyzeCallback(BaseAnalyzeCallback*, bool zeroCopy = false,
+                               unsigned maxFps = 0);
 
     /*
      * Detaches the current analyze callback.
      *
-     * If no analyze callback is attached, this call will be ignored.
+     * Waits for the analyze thread to finish the frame it is processing, if
+     * any, and stops it. Frames left in the mailbox are dropped. If no analyze
+     * callback is attached, this call will be ignored.
      *
-     * @see attachAnalyzeCallback(BaseAnalyzeCallback*)
+     * @see attachAnalyzeCallback(BaseAnalyzeCallback*, bool, unsigned)
      */
     void detachAnalyzeCallback();
 
@@ -132,7 +158,29 @@ private:
     Return<void> deliverFrame(const BufferDesc& buffer)  override;
 
     bool processFrame(const BufferDesc&, BufferDesc&);
-    bool copyAndAnalyzeFrame(const BufferDesc&);
+    bool copyAndAnalyzeFrame(const BufferDesc&, nsecs_t now);
+
+    // Hands a frame to the analyze thread in the given slot
+    void postAnalyzeFrame(int slot);
+
+    // Body of the analyze thread
+    void analyzeThreadLoop();
+
+    // Unmaps and frees the analyze buffers.  The analyze thread must be stopped.
+    void releaseAnalyzeBuffers();
+
+    // These functions are expected to be called while mLock is held
+
+    // Drops a reference to a camera frame, and returns it to the camera once
+    // neither the client nor the analyze thread uses it
+    void releaseFrame_Locked(const BufferDesc& buffer);
+
+    // Unmaps the frame of an analyze slot, releasing the camera frame it
+    // refers to in zero-copy mode
+    void unmapAnalyzeFrame_Locked(int slot);
+
+    // Maps a camera frame for the analyze thread in zero-copy mode
+    bool shareFrameForAnalysis_Locked(const BufferDesc& input, int slot, nsecs_t now);
 
     // Values initialized as startup
     android::sp <IEvsCamera>    mCamera;
@@ -150,14 +198,37 @@ private:
     int                         mReadyBuffer = -1;  // Index of the newest available buffer
 
     BufferDesc                  mProcessedBuffers[2];
-    BufferDesc                  mAnalyzeBuffer GUARDED_BY(mAnalyzerLock);
 
     BaseRenderCallback*         mRenderCallback = nullptr;
+    FrameRateLimiter            mDisplayRate;
+
+    // Copies of the frames for the analyze callback.  The analyze thread works on
+    // one of them while the binder thread copies the newest frame into the other,
+    // replacing the pending frame if the analyze thread hasn't taken it yet.
+    BufferDesc                  mAnalyzeBuffers[2];
+    Frame                       mAnalyzeFrames[2] = {};     // Mapped mAnalyzeBuffers
+
+    // In zero-copy mode, the camera frames in the analyze slots instead, kept
+    // mapped for reading
+    BufferDesc                  mAnalyzeCameraFrames[2];
+    sp<GraphicBuffer>           mAnalyzeCameraBuffers[2];
+
+    // Number of users of each camera frame we hold, by bufferId.  In zero-copy
+    // mode the client and the analyze thread may share a frame.  deliverFrame()
+    // holds one more while handing the frame out, so a frame nobody takes goes
+    // straight back.
+    std::unordered_map<uint32_t, unsigned> mFrameRefs;
+    int                         mAnalyzingBuffer GUARDED_BY(mAnalyzerLock) = -1;
+    int                         mPendingBuffer GUARDED_BY(mAnalyzerLock) = -1;
+    unsigned                    mSkippedFrames GUARDED_BY(mAnalyzerLock) = 0;
 
     BaseAnalyzeCallback*        mAnalyzeCallback GUARDED_BY(mAnalyzerLock);
-    std::atomic<bool>           mAnalyzerRunning;
-    std::shared_mutex           mAnalyzerLock;
-    std::condition_variable_any mAnalyzerSignal;
+    bool                        mAnalyzerQuit GUARDED_BY(mAnalyzerLock) = false;
+    bool                        mAnalyzeZeroCopy GUARDED_BY(mAnalyzerLock) = false;
+    FrameRateLimiter            mAnalyzeRate GUARDED_BY(mAnalyzerLock);
+    std::thread                 mAnalyzeThread;
+    std::mutex                  mAnalyzerLock;
+    std::condition_variable     mAnalyzerSignal;
 };
 
 }  // namespace support
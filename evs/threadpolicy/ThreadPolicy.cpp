@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "threadpolicy/ThreadPolicy.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <processgroup/processgroup.h>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace threadpolicy {
+
+namespace {
+
+using ::android::base::ParseInt;
+using ::android::base::ReadFileToString;
+using ::android::base::Split;
+using ::android::base::StringAppendF;
+using ::android::base::StringPrintf;
+using ::android::base::Tokenize;
+using ::android::base::Trim;
+
+// The kernel takes utilization clamps through sched_setattr(), which libc doesn't wrap
+struct SchedAttr {
+    uint32_t size;
+    uint32_t schedPolicy;
+    uint64_t schedFlags;
+    int32_t  schedNice;
+    uint32_t schedPriority;
+    uint64_t schedRuntime;
+    uint64_t schedDeadline;
+    uint64_t schedPeriod;
+    uint32_t schedUtilMin;
+    uint32_t schedUtilMax;
+};
+
+constexpr uint64_t kSchedFlagKeepAll = 0x08 | 0x10;     // Keep the policy and its parameters
+constexpr uint64_t kSchedFlagUtilClampMin = 0x20;
+constexpr uint64_t kSchedFlagUtilClampMax = 0x40;
+constexpr int kMaxUtilClamp = 1024;
+
+
+// The policies read from kThreadPolicyPath and the threads they were applied to
+struct Registry {
+    std::once_flag loaded;
+    std::unordered_map<std::string, ThreadPolicy> policies;     // Not changed once loaded
+
+    // Role of each thread a policy was applied to and whether it succeeded.  A thread that has
+    // exited is dropped when it is found gone by a dump.
+    std::mutex lock;
+    std::map<pid_t, std::pair<std::string, bool>> threads;      // Guarded by lock
+};
+
+// Threads may still apply their policies while the process exits, so it is never destroyed
+Registry& getRegistry() {
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+
+const std::unordered_map<std::string, ThreadPolicy>& getPolicies() {
+    Registry& registry = getRegistry();
+    std::call_once(registry.loaded, [&registry]() {
+        std::string text;
+        if (!ReadFileToString(kThreadPolicyPath, &text)) {
+            // Without the file, every thread keeps the scheduling it inherits
+            LOG(DEBUG) << "No thread policy is configured";
+            return;
+        }
+
+        if (!parseThreadPolicies(text, &registry.policies)) {
+            LOG(ERROR) << "Ignoring malformed " << kThreadPolicyPath;
+        } else {
+            LOG(INFO) << "Loaded " << registry.policies.size() << " thread policies";
+        }
+    });
+
+    return registry.policies;
+}
+
+
+const char* getPolicyName(int policy) {
+    switch (policy) {
+        case SCHED_OTHER: return "other";
+        case SCHED_FIFO:  return "fifo";
+        case SCHED_RR:    return "rr";
+        case SCHED_BATCH: return "batch";
+        case SCHED_IDLE:  return "idle";
+        default:          return "unknown";
+    }
+}
+
+
+bool parsePolicyName(const std::string& name, int* policy) {
+    if (name == "other") {
+        *policy = SCHED_OTHER;
+    } else if (name == "fifo") {
+        *policy = SCHED_FIFO;
+    } else if (name == "rr") {
+        *policy = SCHED_RR;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+
+// Parses a list of CPUs like "0-3,6"
+bool parseCpuList(const std::string& list, std::vector<int>* cpus) {
+    for (auto&& range : Split(list, ",")) {
+        const auto bounds = Split(range, "-");
+        int first = 0, last = 0;
+        if (bounds.size() > 2 ||
+            !ParseInt(bounds[0], &first, 0, CPU_SETSIZE - 1) ||
+            !ParseInt(bounds.back(), &last, first, CPU_SETSIZE - 1)) {
+            return false;
+        }
+
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus->push_back(cpu);
+        }
+    }
+
+    return true;
+}
+
+
+bool setThreadPolicy(pid_t tid, const ThreadPolicy& policy) {
+    bool success = true;
+
+    // The cgroups go first, since a cpuset bounds the affinity
+    if (!policy.profiles.empty() && !SetTaskProfiles(tid, policy.profiles)) {
+        LOG(WARNING) << "Failed to apply the task profiles to thread " << tid;
+        success = false;
+    }
+
+    if (!policy.cpus.empty()) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (auto&& cpu : policy.cpus) {
+            CPU_SET(cpu, &cpus);
+        }
+        if (sched_setaffinity(tid, sizeof(cpus), &cpus) != 0) {
+            PLOG(WARNING) << "Failed to set the CPU affinity of thread " << tid;
+            success = false;
+        }
+    }
+
+    sched_param param = {
+        .sched_priority = policy.policy == SCHED_OTHER ? 0 : policy.priority,
+    };
+    if (sched_setscheduler(tid, policy.policy, &param) != 0) {
+        PLOG(WARNING) << "Failed to set the scheduling policy of thread " << tid;
+        success = false;
+    } else if (policy.policy == SCHED_OTHER &&
+               setpriority(PRIO_PROCESS, tid, policy.priority) != 0) {
+        PLOG(WARNING) << "Failed to set the nice value of thread " << tid;
+        success = false;
+    }
+
+    if (policy.uclampMin >= 0 || policy.uclampMax >= 0) {
+        SchedAttr attr = {};
+        attr.size = sizeof(attr);
+        attr.schedFlags = kSchedFlagKeepAll;
+        if (policy.uclampMin >= 0) {
+            attr.schedFlags |= kSchedFlagUtilClampMin;
+            attr.schedUtilMin = policy.uclampMin;
+        }
+        if (policy.uclampMax >= 0) {
+            attr.schedFlags |= kSchedFlagUtilClampMax;
+            attr.schedUtilMax = policy.uclampMax;
+        }
+        if (syscall(__NR_sched_setattr, tid, &attr, 0) != 0) {
+            PLOG(WARNING) << "Failed to clamp the utilization of thread " << tid;
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+}  // namespace
+
+
+std::string ThreadPolicy::toString() const {
+    std::string str = StringPrintf("%s %d", getPolicyName(policy), priority);
+    if (uclampMin >= 0) {
+        StringAppendF(&str, " uclamp.min=%d", uclampMin);
+    }
+    if (uclampMax >= 0) {
+        StringAppendF(&str, " uclamp.max=%d", uclampMax);
+    }
+    if (!cpus.empty()) {
+        std::vector<std::string> names;
+        for (auto&& cpu : cpus) {
+            names.emplace_back(std::to_string(cpu));
+        }
+        str += " cpus=" + android::base::Join(names, ",");
+    }
+    if (!profiles.empty()) {
+        str += " profiles=" + android::base::Join(profiles, ",");
+    }
+
+    return str;
+}
+
+
+bool parseThreadPolicies(const std::string& text,
+                         std::unordered_map<std::string, ThreadPolicy>* policies) {
+    std::unordered_map<std::string, ThreadPolicy> parsed;
+    for (auto&& rawLine : Split(text, "\n")) {
+        const std::string line = Trim(rawLine.substr(0, rawLine.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+
+        const auto fields = Tokenize(line, " \t");
+        ThreadPolicy policy;
+        bool valid = fields.size() >= 3 && parsePolicyName(fields[1], &policy.policy);
+        if (valid) {
+            valid = policy.policy == SCHED_OTHER
+                    ? ParseInt(fields[2], &policy.priority, -20, 19)
+                    : ParseInt(fields[2], &policy.priority, 1, 99);
+        }
+
+        for (size_t i = 3; valid && i < fields.size(); ++i) {
+            const auto pos = fields[i].find('=');
+            const std::string key = fields[i].substr(0, pos);
+            const std::string value = pos == std::string::npos ? "" : fields[i].substr(pos + 1);
+            if (key == "uclamp.min") {
+                valid = ParseInt(value, &policy.uclampMin, 0, kMaxUtilClamp);
+            } else if (key == "uclamp.max") {
+                valid = ParseInt(value, &policy.uclampMax, 0, kMaxUtilClamp);
+            } else if (key == "cpus") {
+                valid = parseCpuList(value, &policy.cpus);
+            } else if (key == "profiles") {
+                policy.profiles = Split(value, ",");
+            } else {
+                valid = false;
+            }
+        }
+
+        if (!valid) {
+            LOG(ERROR) << "Malformed thread policy: " << line;
+            return false;
+        }
+
+        parsed.insert_or_assign(fields[0], std::move(policy));
+    }
+
+    *policies = std::move(parsed);
+    return true;
+}
+
+
+bool applyThreadPolicy(const char* role) {
+    // The role this thread was last given and whether that worked
+    thread_local std::string tRole;
+    thread_local bool tApplied = false;
+    if (tRole == role) {
+        return tApplied;
+    }
+
+    tRole = role;
+    tApplied = false;
+
+    const auto& policies = getPolicies();
+    const auto it = policies.find(role);
+    if (it == policies.end()) {
+        return false;
+    }
+
+    const pid_t tid = gettid();
+    tApplied = setThreadPolicy(tid, it->second);
+    LOG(INFO) << "Thread " << tid << " runs as " << role << ": " << it->second.toString()
+              << (tApplied ? "" : " (failed)");
+
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    registry.threads.insert_or_assign(tid, std::make_pair(std::string(role), tApplied));
+
+    return tApplied;
+}
+
+
+std::string dumpThreadPolicies(const char* indent) {
+    const auto& policies = getPolicies();
+    if (policies.empty()) {
+        return StringPrintf("%sNo thread policy is configured.\n", indent);
+    }
+
+    std::string buffer = StringPrintf("%sThread policies:\n", indent);
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    for (auto&& [role, policy] : policies) {
+        StringAppendF(&buffer, "%s  %s: %s\n", indent, role.c_str(), policy.toString().c_str());
+
+        for (auto it = registry.threads.begin(); it != registry.threads.end();) {
+            const auto& [tid, record] = *it;
+            if (record.first != role) {
+                ++it;
+                continue;
+            }
+
+            // Reads back how the thread is scheduled now
+            const int current = sched_getscheduler(tid);
+            if (current < 0) {
+                // The thread is gone
+                it = registry.threads.erase(it);
+                continue;
+            }
+
+            int priority = 0;
+            sched_param param = {};
+            if ((current & ~SCHED_RESET_ON_FORK) == SCHED_OTHER) {
+                priority = getpriority(PRIO_PROCESS, tid);
+            } else if (sched_getparam(tid, &param) == 0) {
+                priority = param.sched_priority;
+            }
+
+            std::string name;
+            ReadFileToString(StringPrintf("/proc/self/task/%d/comm", tid), &name);
+            StringAppendF(&buffer, "%s    thread %d (%s): %s %d%s\n", indent, tid,
+                          Trim(name).c_str(), getPolicyName(current & ~SCHED_RESET_ON_FORK),
+                          priority, record.second ? "" : ", failed to apply the policy");
+            ++it;
+        }
+    }
+
+    return buffer;
+}
+
+}  // namespace threadpolicy
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
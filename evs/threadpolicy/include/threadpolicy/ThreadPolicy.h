@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_THREADPOLICY_THREADPOLICY_H
+#define ANDROID_AUTOMOTIVE_EVS_THREADPOLICY_THREADPOLICY_H
+
+#include <sched.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace threadpolicy {
+
+
+// Roles of the threads whose scheduling can be configured
+constexpr char kRoleCameraCapture[] = "evs.capture";    // Sample driver V4L2 capture threads
+constexpr char kRoleFrameCallback[] = "evs.callback";   // Manager threads taking HAL frames
+constexpr char kRoleFrameDelivery[] = "evs.delivery";   // Manager threads forwarding frames
+constexpr char kRoleDisplayLane[]   = "evs.display";    // Manager display buffer lane
+constexpr char kRoleRender[]        = "evs.render";     // evs_app render loop
+constexpr char kRoleSurroundView[]  = "sv.process";     // Surround view frame processing
+constexpr char kRoleComputePipe[]   = "computepipe.engine";
+
+// Where the policies are read from.  It is a vendor file so system and vendor processes
+// alike can read it.
+constexpr char kThreadPolicyPath[] = "/vendor/etc/automotive/evs/thread_policy.conf";
+
+
+// How the threads of a role are scheduled.  In the configuration file, each line gives the
+// policy of a role as
+//
+//     <role> <other|fifo|rr> <priority> [uclamp.min=N] [uclamp.max=N] [cpus=LIST]
+//                                       [profiles=NAME,...]
+//
+// where the priority is a nice value for "other" and a real-time priority otherwise, the
+// utilization clamps range from 0 to 1024, LIST is like "0-3,6" and the profiles are task
+// profiles, such as a cpuset, to apply.  Text after a '#' is ignored.
+struct ThreadPolicy {
+    int policy = SCHED_OTHER;
+    int priority = 0;
+    int uclampMin = -1;                 // -1 leaves the clamp alone
+    int uclampMax = -1;
+    std::vector<int> cpus;              // Empty leaves the affinity alone
+    std::vector<std::string> profiles;
+
+    std::string toString() const;
+};
+
+// Parses the policies in |text|, as laid out above, into |policies|.  Returns false and leaves
+// |policies| alone if a line is malformed.
+bool parseThreadPolicies(const std::string& text,
+                         std::unordered_map<std::string, ThreadPolicy>* policies);
+
+// Applies the policy configured for |role| to the calling thread.  Returns false if none is
+// configured or it couldn't be applied.  Calling it again from the same thread for the same role
+// is cheap, so it may be called on every callback of a thread pool.
+bool applyThreadPolicy(const char* role);
+
+// Describes the configured policies and how the threads they were applied to are scheduled now
+std::string dumpThreadPolicies(const char* indent = "");
+
+}  // namespace threadpolicy
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_THREADPOLICY_THREADPOLICY_H
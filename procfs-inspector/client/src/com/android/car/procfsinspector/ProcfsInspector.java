@@ -51,4 +51,50 @@ public final class ProcfsInspector {
 
         return Collections.emptyList();
     }
+
+    /**
+     * Returns a number that changes whenever the process table does, or -1 if the service is not
+     * available. Callers that poll the process table can read it only when this changes.
+     */
+    public static long getProcessTableGeneration() {
+        IProcfsInspector procfsInspector = tryGet();
+        if (procfsInspector != null) {
+            try {
+                return procfsInspector.getProcessTableGeneration();
+            } catch (RemoteException e) {
+                Log.w(TAG, "caught RemoteException", e);
+            }
+        }
+
+        return -1;
+    }
+
+    /**
+     * Registers a listener told when processes start or exit. Returns false if the service is
+     * not available.
+     */
+    public static boolean registerListener(IProcessTableListener listener) {
+        IProcfsInspector procfsInspector = tryGet();
+        if (procfsInspector != null) {
+            try {
+                procfsInspector.registerListener(listener);
+                return true;
+            } catch (RemoteException e) {
+                Log.w(TAG, "caught RemoteException", e);
+            }
+        }
+
+        return false;
+    }
+
+    public static void unregisterListener(IProcessTableListener listener) {
+        IProcfsInspector procfsInspector = tryGet();
+        if (procfsInspector != null) {
+            try {
+                procfsInspector.unregisterListener(listener);
+            } catch (RemoteException e) {
+                Log.w(TAG, "caught RemoteException", e);
+            }
+        }
+    }
 }
@@ -23,7 +23,8 @@ LOCAL_SRC_FILES := \
     server.cpp \
     impl.cpp \
     process.cpp \
-    directory.cpp
+    directory.cpp \
+    watcher.cpp
 
 LOCAL_SHARED_LIBRARIES := \
     libbinder \
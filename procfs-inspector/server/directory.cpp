@@ -29,8 +29,8 @@ bool procfsinspector::Directory::Entry::isEmpty() const {
     return mParent.empty() && mChild.empty();
 }
 
-procfsinspector::Directory::Entry::Entry(std::string parent, std::string child) :
-    mParent(parent), mChild(child) {
+procfsinspector::Directory::Entry::Entry(std::string parent, std::string child, int parentFd) :
+    mParent(parent), mChild(child), mParentFd(parentFd) {
     if (!isEmpty()) {
         if (mParent.back() != '/') {
             mParent += '/';
@@ -47,8 +47,11 @@ uid_t procfsinspector::Directory::Entry::getOwnerUserId() {
         return -1;
     }
     struct stat buf;
-    // fill in stat info for this entry, or return invalid UID on failure
-    if (stat(str().c_str(), &buf)) {
+    // fill in stat info for this entry, or return invalid UID on failure.
+    // resolving the name against the open parent saves a path lookup per entry
+    int result = mParentFd >= 0 ? fstatat(mParentFd, mChild.c_str(), &buf, 0)
+                                : stat(str().c_str(), &buf);
+    if (result) {
         return -1;
     }
     return buf.st_uid;
@@ -63,7 +66,7 @@ procfsinspector::Directory::Entry procfsinspector::Directory::next(unsigned char
             if (entry->d_type == DT_UNKNOWN ||
                 type == DT_UNKNOWN ||
                 entry->d_type == type) {
-                return Entry(mPath, entry->d_name);
+                return Entry(mPath, entry->d_name, dirfd(dir));
             }
         }
     }
@@ -31,7 +31,7 @@ class Directory {
 public:
     class Entry {
     public:
-        Entry(std::string parent = "", std::string child = "");
+        Entry(std::string parent = "", std::string child = "", int parentFd = -1);
 
         const std::string& getChild() { return mChild; }
         std::string str();
@@ -47,6 +47,8 @@ public:
     private:
         std::string mParent;
         std::string mChild;
+        // descriptor of the open parent directory, or -1 to go by path
+        int mParentFd;
     };
 
     Directory(const char* path);
@@ -17,6 +17,8 @@
 #include "directory.h"
 #include "server.h"
 
+#include <algorithm>
+
 template<typename IntTy>
 static bool asNumber(const std::string& s, IntTy *value) {
     IntTy v = 0;
@@ -33,8 +35,13 @@ static bool asNumber(const std::string& s, IntTy *value) {
     return true;
 }
 
-std::vector<procfsinspector::ProcessInfo> procfsinspector::Impl::readProcessTable() {
+procfsinspector::Impl::Impl() :
+    mDeathRecipient(new ListenerDeathRecipient(this)),
+    mWatcher([this] { onProcessesChanged(); }) {}
+
+void procfsinspector::Impl::updateProcessTable() {
     std::vector<procfsinspector::ProcessInfo> processes;
+    processes.reserve(mProcesses.size());
 
     Directory dir("/proc");
     while (auto entry = dir.next()) {
@@ -44,5 +51,85 @@ std::vector<procfsinspector::ProcessInfo> procfsinspector::Impl::readProcessTabl
         }
     }
 
-    return processes;
+    // a pid reused by a process of the same uid leaves the table as it was,
+    // so comparing pids and uids is all the diff this table needs
+    if (processes != mProcesses) {
+        mProcesses.swap(processes);
+        ++mGeneration;
+    }
+}
+
+std::vector<procfsinspector::ProcessInfo> procfsinspector::Impl::readProcessTable() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    updateProcessTable();
+    return mProcesses;
+}
+
+int64_t procfsinspector::Impl::getProcessTableGeneration() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    updateProcessTable();
+    return mGeneration;
+}
+
+void procfsinspector::Impl::registerListener(const sp<IBinder>& listener) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (std::find(mListeners.begin(), mListeners.end(), listener) != mListeners.end()) {
+        return;
+    }
+    if (listener->linkToDeath(mDeathRecipient) != NO_ERROR) {
+        ALOGW("listener died before it was registered");
+        return;
+    }
+    mListeners.push_back(listener);
+
+    // only watch processes once someone is interested
+    if (!mWatcherStarted) {
+        updateProcessTable();
+        mWatcher.start();
+        mWatcherStarted = true;
+    }
+}
+
+void procfsinspector::Impl::unregisterListener(const sp<IBinder>& listener) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = std::find(mListeners.begin(), mListeners.end(), listener);
+    if (it != mListeners.end()) {
+        listener->unlinkToDeath(mDeathRecipient);
+        mListeners.erase(it);
+    }
+}
+
+void procfsinspector::Impl::removeListener(const wp<IBinder>& listener) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mListeners.erase(std::remove_if(mListeners.begin(), mListeners.end(),
+        [&listener](const sp<IBinder>& binder) { return listener == binder; }),
+        mListeners.end());
+}
+
+void procfsinspector::Impl::ListenerDeathRecipient::binderDied(const wp<IBinder>& who) {
+    mImpl->removeListener(who);
+}
+
+void procfsinspector::Impl::onProcessesChanged() {
+    std::vector<sp<IBinder>> listeners;
+    int64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        int64_t oldGeneration = mGeneration;
+        updateProcessTable();
+        if (mGeneration == oldGeneration || mListeners.empty()) {
+            return;
+        }
+        generation = mGeneration;
+        listeners = mListeners;
+    }
+
+    // the calls are oneway, so a slow listener does not hold up the others
+    for (const auto& listener : listeners) {
+        Parcel data;
+        data.writeInterfaceToken(IProcessTableListener::kDescriptor);
+        data.writeInt64(generation);
+        listener->transact((uint32_t)IProcessTableListener::Call::ON_PROCESS_TABLE_CHANGED,
+            data, nullptr, IBinder::FLAG_ONEWAY);
+    }
 }
@@ -32,6 +32,10 @@ namespace procfsinspector {
         // default initialize to invalid values
         ProcessInfo(pid_t pid = -1, uid_t uid = -1) : mPid(pid), mUid(uid) {}
 
+        bool operator==(const ProcessInfo& other) const {
+            return mPid == other.mPid && mUid == other.mUid;
+        }
+
         virtual status_t writeToParcel(Parcel* parcel) const override;
         virtual status_t readFromParcel(const Parcel* parcel) override;
 
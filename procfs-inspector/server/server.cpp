@@ -49,10 +49,35 @@ class BpProcfsInspector: public BpInterface<IProcfsInspector> {
             return result;
         }
 
+        virtual int64_t getProcessTableGeneration() override {
+            Parcel data, reply;
+            remote()->transact(
+                (uint32_t)IProcfsInspector::Call::GET_PROCESS_TABLE_GENERATION, data, &reply);
+
+            return reply.readInt64();
+        }
+
+        virtual void registerListener(const sp<IBinder>& listener) override {
+            Parcel data, reply;
+            data.writeStrongBinder(listener);
+            remote()->transact(
+                (uint32_t)IProcfsInspector::Call::REGISTER_LISTENER, data, &reply);
+        }
+
+        virtual void unregisterListener(const sp<IBinder>& listener) override {
+            Parcel data, reply;
+            data.writeStrongBinder(listener);
+            remote()->transact(
+                (uint32_t)IProcfsInspector::Call::UNREGISTER_LISTENER, data, &reply);
+        }
+
 };
 
 IMPLEMENT_META_INTERFACE(ProcfsInspector, "com.android.car.procfsinspector.IProcfsInspector");
 
+const String16 IProcessTableListener::kDescriptor(
+    "com.android.car.procfsinspector.IProcessTableListener");
+
 status_t Impl::onTransact(uint32_t code,
     const Parcel& data, Parcel* reply, uint32_t flags) {
 
@@ -67,6 +92,37 @@ status_t Impl::onTransact(uint32_t code,
         }
     }
 
+    if (code == (uint32_t)IProcfsInspector::Call::GET_PROCESS_TABLE_GENERATION) {
+        CHECK_INTERFACE(IProcfsInspector, data, reply);
+        if (isSystemUser()) {
+            reply->writeNoException();
+            reply->writeInt64(getProcessTableGeneration());
+            return NO_ERROR;
+        } else {
+            return PERMISSION_DENIED;
+        }
+    }
+
+    if (code == (uint32_t)IProcfsInspector::Call::REGISTER_LISTENER ||
+        code == (uint32_t)IProcfsInspector::Call::UNREGISTER_LISTENER) {
+        CHECK_INTERFACE(IProcfsInspector, data, reply);
+        if (isSystemUser()) {
+            sp<IBinder> listener = data.readStrongBinder();
+            if (listener == nullptr) {
+                return BAD_VALUE;
+            }
+            if (code == (uint32_t)IProcfsInspector::Call::REGISTER_LISTENER) {
+                registerListener(listener);
+            } else {
+                unregisterListener(listener);
+            }
+            reply->writeNoException();
+            return NO_ERROR;
+        } else {
+            return PERMISSION_DENIED;
+        }
+    }
+
     return BBinder::onTransact(code, data, reply, flags);
 }
 
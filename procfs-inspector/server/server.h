@@ -20,6 +20,7 @@
 #define LOG_TAG "com.android.car.procfsinspector"
 #define SERVICE_NAME "com.android.car.procfsinspector"
 
+#include <mutex>
 #include <vector>
 
 #include <binder/Parcel.h>
@@ -33,6 +34,7 @@
 #include <utils/String16.h>
 
 #include "process.h"
+#include "watcher.h"
 
 using namespace android;
 
@@ -43,19 +45,75 @@ namespace procfsinspector {
 
         enum class Call : uint32_t {
             READ_PROCESS_TABLE = IBinder::FIRST_CALL_TRANSACTION,
+            GET_PROCESS_TABLE_GENERATION,
+            REGISTER_LISTENER,
+            UNREGISTER_LISTENER,
         };
 
         // API declarations start here
         virtual std::vector<ProcessInfo> readProcessTable() = 0;
+
+        // Returns a number that changes whenever the process table does, so
+        // that callers polling it only read the table when it changed.
+        virtual int64_t getProcessTableGeneration() = 0;
+
+        // Registers an IProcessTableListener binder, which is told the new
+        // generation whenever processes start or exit, in batches.
+        virtual void registerListener(const sp<IBinder>& listener) = 0;
+        virtual void unregisterListener(const sp<IBinder>& listener) = 0;
+    };
+
+    // Transactions of the IProcessTableListener callback interface
+    class IProcessTableListener {
+    public:
+        static const String16 kDescriptor;
+
+        enum class Call : uint32_t {
+            ON_PROCESS_TABLE_CHANGED = IBinder::FIRST_CALL_TRANSACTION,
+        };
     };
 
     class Impl : public BnInterface<IProcfsInspector> {
     public:
+        Impl();
+
         virtual status_t onTransact(uint32_t code,
             const Parcel& data,
             Parcel *reply,
             uint32_t flags) override;
         virtual std::vector<ProcessInfo> readProcessTable() override;
+        virtual int64_t getProcessTableGeneration() override;
+        virtual void registerListener(const sp<IBinder>& listener) override;
+        virtual void unregisterListener(const sp<IBinder>& listener) override;
+
+    private:
+        class ListenerDeathRecipient : public IBinder::DeathRecipient {
+        public:
+            ListenerDeathRecipient(Impl* impl) : mImpl(impl) {}
+
+            virtual void binderDied(const wp<IBinder>& who) override;
+
+        private:
+            Impl* mImpl;
+        };
+
+        // rescans /proc into mProcesses, bumping mGeneration if it changed
+        void updateProcessTable();
+
+        // called by mWatcher when processes may have changed
+        void onProcessesChanged();
+
+        void removeListener(const wp<IBinder>& listener);
+
+        std::mutex mMutex;
+        // the last process table read, in /proc order
+        std::vector<ProcessInfo> mProcesses;
+        int64_t mGeneration = 0;
+
+        std::vector<sp<IBinder>> mListeners;
+        sp<ListenerDeathRecipient> mDeathRecipient;
+        ProcessWatcher mWatcher;
+        bool mWatcherStarted = false;
     };
 }
 
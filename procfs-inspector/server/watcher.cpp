@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "server.h"
+#include "watcher.h"
+
+#include <errno.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// how long to gather process events before calling back
+static constexpr std::chrono::milliseconds kBatchInterval(500);
+// how often to call back when the proc connector is not available
+static constexpr std::chrono::seconds kPollInterval(5);
+
+procfsinspector::ProcessWatcher::ProcessWatcher(Callback callback) : mCallback(callback) {}
+
+void procfsinspector::ProcessWatcher::start() {
+    std::thread([this] { run(); }).detach();
+}
+
+int procfsinspector::ProcessWatcher::openProcConnector() {
+    int sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (sock < 0) {
+        ALOGW("cannot open proc connector socket: %s", strerror(errno));
+        return -1;
+    }
+
+    struct sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid = 0;
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        ALOGW("cannot bind proc connector socket: %s", strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    char request[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))]
+        __attribute__((aligned(NLMSG_ALIGNTO))) = {};
+    struct nlmsghdr* header = (struct nlmsghdr*)request;
+    header->nlmsg_len = sizeof(request);
+    header->nlmsg_type = NLMSG_DONE;
+    struct cn_msg* message = (struct cn_msg*)NLMSG_DATA(header);
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = sizeof(enum proc_cn_mcast_op);
+    *(enum proc_cn_mcast_op*)message->data = PROC_CN_MCAST_LISTEN;
+    if (TEMP_FAILURE_RETRY(send(sock, request, sizeof(request), 0)) < 0) {
+        ALOGW("cannot subscribe to proc connector: %s", strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+// returns true if the event may change the process table
+static bool changesProcessTable(const struct proc_event& event) {
+    switch (event.what) {
+        case proc_event::PROC_EVENT_FORK: {
+            // threads are forked too, but only processes are in the table
+            return event.event_data.fork.child_pid == event.event_data.fork.child_tgid;
+        } break;
+        case proc_event::PROC_EVENT_EXIT: {
+            return event.event_data.exit.process_pid == event.event_data.exit.process_tgid;
+        } break;
+        case proc_event::PROC_EVENT_UID: {
+            return true;
+        } break;
+        default: {
+            return false;
+        } break;
+    }
+}
+
+void procfsinspector::ProcessWatcher::watchProcConnector(int sock) {
+    using std::chrono::steady_clock;
+
+    bool pending = false;
+    steady_clock::time_point deadline;
+    while (true) {
+        int timeoutMs = -1;
+        if (pending) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - steady_clock::now());
+            timeoutMs = std::max<int>(remaining.count(), 0);
+        }
+
+        struct pollfd pfd = {sock, POLLIN, 0};
+        int ready = TEMP_FAILURE_RETRY(::poll(&pfd, 1, timeoutMs));
+        if (ready < 0) {
+            ALOGE("poll on proc connector failed: %s", strerror(errno));
+            return;
+        }
+        if (ready == 0) {
+            pending = false;
+            mCallback();
+            continue;
+        }
+
+        char buffer[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+        ssize_t length = TEMP_FAILURE_RETRY(recv(sock, buffer, sizeof(buffer), 0));
+        if (length < 0) {
+            if (errno == ENOBUFS) {
+                // events were lost, so the table has to be read anyway
+                ALOGW("proc connector overrun");
+                if (!pending) {
+                    pending = true;
+                    deadline = steady_clock::now() + kBatchInterval;
+                }
+                continue;
+            }
+            ALOGE("recv on proc connector failed: %s", strerror(errno));
+            return;
+        }
+
+        for (struct nlmsghdr* header = (struct nlmsghdr*)buffer; NLMSG_OK(header, length);
+             header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_type != NLMSG_DONE) {
+                continue;
+            }
+            struct cn_msg* message = (struct cn_msg*)NLMSG_DATA(header);
+            if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC) {
+                continue;
+            }
+            if (!pending && changesProcessTable(*(struct proc_event*)message->data)) {
+                pending = true;
+                deadline = steady_clock::now() + kBatchInterval;
+            }
+        }
+    }
+}
+
+void procfsinspector::ProcessWatcher::poll() {
+    while (true) {
+        std::this_thread::sleep_for(kPollInterval);
+        mCallback();
+    }
+}
+
+void procfsinspector::ProcessWatcher::run() {
+    int sock = openProcConnector();
+    if (sock >= 0) {
+        ALOGI("watching processes through the proc connector");
+        watchProcConnector(sock);
+        close(sock);
+    }
+
+    ALOGI("watching processes by polling every %llds", (long long)kPollInterval.count());
+    poll();
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_PROCFS_WATCHER
+#define CAR_PROCFS_WATCHER
+
+#include <functional>
+
+namespace procfsinspector {
+
+// Calls back whenever processes may have started or exited. Events come from
+// the kernel proc connector and are batched, so that a burst of forks and exits
+// results in a single callback. Where the proc connector is not available, the
+// callback is made periodically instead and the caller is left to tell whether
+// anything changed.
+class ProcessWatcher {
+public:
+    using Callback = std::function<void()>;
+
+    // the callback runs on the watcher thread
+    ProcessWatcher(Callback callback);
+
+    // starts the watcher thread, which runs for the lifetime of the process
+    void start();
+
+private:
+    // returns a socket subscribed to the proc connector, or -1 if unavailable
+    static int openProcConnector();
+
+    // waits on the proc connector, returning only if it fails
+    void watchProcConnector(int socket);
+
+    void poll();
+
+    void run();
+
+    Callback mCallback;
+};
+
+}
+
+#endif // CAR_PROCFS_WATCHER
@@ -0,0 +1,640 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Summarizes carwatchdogd binary I/O performance history files, as dumped with
+//   adb shell dumpsys android.automotive.watchdog.ICarWatchdog/default --dump_io_history
+//
+// Unlike ioperf_history.py, the files are decoded in a single streaming pass over a read-only
+// mapping, several files at a time, so fleet-sized inputs can be triaged in bounded memory. The
+// format is documented in packages/services/Car/watchdog/server/src/IoPerfHistory.h.
+
+#include <android-base/parsedouble.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using android::base::ParseDouble;
+using android::base::ParseUint;
+using android::base::StringPrintf;
+using android::base::unique_fd;
+
+constexpr std::string_view kMagic = "CWIOHIST";
+constexpr uint8_t kMinVersion = 1;
+constexpr uint8_t kMaxVersion = 3;
+constexpr uint8_t kDeltaFlag = 1 << 0;
+constexpr uint8_t kBootTimeRecord = 1;
+constexpr int kPressureValues = 6;  // (some, full) for each of cpu, io and memory.
+constexpr int kMetricTypes = 3;     // Read bytes, write bytes and fsync calls.
+constexpr int kWriteBytes = 1;
+constexpr int kUidStates = 2;       // Foreground and background.
+
+// Mapped pages behind the decoder are dropped every this many bytes so the resident size stays
+// bounded however large the file is.
+constexpr size_t kReleaseChunkSize = 64 * 1024 * 1024;
+
+// Records whose write rate is this many times the moving average start or extend an anomaly
+// window, once the average has seen |kAnomalyWarmupRecords| records.
+constexpr double kDefaultAnomalyFactor = 4.0;
+constexpr double kDefaultAnomalyMinRate = 1024 * 1024;
+constexpr double kAnomalyAverageWeight = 0.1;
+constexpr int kAnomalyWarmupRecords = 10;
+
+// Collections further apart than this are treated as a gap, e.g. the car was off, and do not
+// count towards the covered time.
+constexpr int64_t kDefaultMaxGapSecs = 3600;
+
+constexpr size_t kDefaultTopCount = 20;
+
+struct Options {
+    double anomalyFactor = kDefaultAnomalyFactor;
+    double anomalyMinRate = kDefaultAnomalyMinRate;
+    int64_t maxGapSecs = kDefaultMaxGapSecs;
+    size_t topCount = kDefaultTopCount;
+    size_t threads = 0;
+};
+
+struct PackageStats {
+    uint64_t writtenBytes[kUidStates] = {0, 0};
+    uint64_t records = 0;
+
+    uint64_t totalWrittenBytes() const { return writtenBytes[0] + writtenBytes[1]; }
+};
+
+struct PhaseStats {
+    uint64_t records = 0;
+    int64_t coveredSecs = 0;
+    uint64_t writtenBytes[kUidStates] = {0, 0};
+};
+
+struct AnomalyWindow {
+    size_t fileIndex = 0;
+    int64_t startTime = 0;
+    int64_t endTime = 0;
+    uint64_t records = 0;
+    uint64_t writtenBytes = 0;
+    double peakRate = 0;
+    double baselineRate = 0;
+    // Top writer of the record with the peak rate.
+    std::string topPackage;
+};
+
+// Everything learnt from one file. Its size depends on the number of packages and of kept
+// anomaly windows, not on the size of the file.
+struct Summary {
+    uint64_t records = 0;
+    uint64_t boots = 0;
+    int64_t firstTime = 0;
+    int64_t lastTime = 0;
+    PhaseStats phases[2];  // Boot-time and periodic.
+    std::unordered_map<std::string, PackageStats> packages;
+    std::vector<AnomalyWindow> anomalies;
+    std::string error;
+};
+
+bool isBetterAnomaly(const AnomalyWindow& lhs, const AnomalyWindow& rhs) {
+    return lhs.writtenBytes > rhs.writtenBytes;
+}
+
+// Keeps the |topCount| anomaly windows with the most written bytes.
+void addAnomaly(AnomalyWindow window, size_t topCount, std::vector<AnomalyWindow>* anomalies) {
+    if (anomalies->size() < topCount) {
+        anomalies->push_back(std::move(window));
+        std::push_heap(anomalies->begin(), anomalies->end(), isBetterAnomaly);
+        return;
+    }
+    if (topCount == 0 || !isBetterAnomaly(window, anomalies->front())) {
+        return;
+    }
+    std::pop_heap(anomalies->begin(), anomalies->end(), isBetterAnomaly);
+    anomalies->back() = std::move(window);
+    std::push_heap(anomalies->begin(), anomalies->end(), isBetterAnomaly);
+}
+
+class TruncatedError {};
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t pos, size_t end) : mData(data), mPos(pos), mEnd(end) {}
+
+    bool done() const { return mPos >= mEnd; }
+    size_t pos() const { return mPos; }
+
+    uint8_t byte() {
+        if (mPos >= mEnd) throw TruncatedError();
+        return mData[mPos++];
+    }
+
+    std::string_view bytes(uint64_t size) {
+        if (size > mEnd - mPos) throw TruncatedError();
+        std::string_view value(reinterpret_cast<const char*>(mData + mPos), size);
+        mPos += size;
+        return value;
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (b < 0x80) return value;
+        }
+        throw TruncatedError();
+    }
+
+    int64_t signedVarint() {
+        const uint64_t value = varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+private:
+    const uint8_t* mData;
+    size_t mPos;
+    size_t mEnd;
+};
+
+// Decodes the records of one file and folds them into a |Summary|. Only the fields needed for
+// the summary are kept; the rest are skipped but still parsed to keep the string table in step
+// with the encoder.
+class Analyzer {
+public:
+    Analyzer(const Options& options, size_t fileIndex, Summary* summary) :
+          mOptions(options), mFileIndex(fileIndex), mSummary(summary) {}
+
+    void analyze(const uint8_t* data, size_t size);
+
+private:
+    void reset() {
+        // Interned strings point into the mapping, which outlives the analyzer.
+        mStrings.clear();
+        mLastTime = 0;
+    }
+
+    std::string_view string(Reader* r) {
+        const uint64_t index = r->varint();
+        if (index == 0) {
+            mStrings.push_back(r->bytes(r->varint()));
+            return mStrings.back();
+        }
+        if (index > mStrings.size()) throw TruncatedError();
+        return mStrings[index - 1];
+    }
+
+    void skipUidProcessStats(Reader* r, bool withTotalTasks) {
+        for (uint64_t i = 0, n = r->varint(); i < n; ++i) {
+            r->varint();
+            string(r);
+            r->varint();
+            if (withTotalTasks) r->varint();
+            for (uint64_t j = 0, m = r->varint(); j < m; ++j) {
+                string(r);
+                r->varint();
+            }
+        }
+    }
+
+    void record(Reader* r);
+    void updateAnomaly(int64_t time, int64_t elapsedSecs, uint64_t writtenBytes,
+                       std::string_view topPackage);
+    void closeAnomaly();
+
+    const Options& mOptions;
+    const size_t mFileIndex;
+    Summary* mSummary;
+
+    uint8_t mVersion = kMaxVersion;
+    std::vector<std::string_view> mStrings;
+    int64_t mLastTime = 0;
+    // Time of the previous record, across string table resets. Zero before the first record.
+    int64_t mPreviousTime = 0;
+    bool mInBoot = false;
+
+    double mAverageRate = 0;
+    int mAverageRecords = 0;
+    bool mInAnomaly = false;
+    AnomalyWindow mAnomaly;
+};
+
+void Analyzer::analyze(const uint8_t* data, size_t size) {
+    Reader r(data, 0, size);
+    size_t released = 0;
+    try {
+        while (!r.done()) {
+            if (size - r.pos() >= kMagic.size() &&
+                memcmp(data + r.pos(), kMagic.data(), kMagic.size()) == 0) {
+                r.bytes(kMagic.size());
+                mVersion = r.byte();
+                if (mVersion < kMinVersion || mVersion > kMaxVersion) {
+                    mSummary->error = StringPrintf("Unsupported history version %d at offset %zu",
+                                                   mVersion, r.pos());
+                    break;
+                }
+                reset();
+                continue;
+            }
+            const uint64_t payloadSize = r.varint();
+            const size_t start = r.pos();
+            r.bytes(payloadSize);
+            Reader payload(data, start, start + payloadSize);
+            record(&payload);
+
+            // Interned strings may still point into the released pages, which are read back from
+            // the file if such a string is used again.
+            const size_t pageSize = getpagesize();
+            if (r.pos() - released >= kReleaseChunkSize) {
+                const size_t end = (r.pos() - kReleaseChunkSize / 2) / pageSize * pageSize;
+                if (end > released) {
+                    madvise(const_cast<uint8_t*>(data) + released, end - released,
+                            MADV_DONTNEED);
+                    released = end;
+                }
+            }
+        }
+    } catch (const TruncatedError&) {
+        mSummary->error = StringPrintf("Ignoring truncated record at offset %zu", r.pos());
+    }
+    closeAnomaly();
+}
+
+void Analyzer::record(Reader* r) {
+    const uint8_t type = r->byte();
+    const uint8_t flags = r->byte();
+    if (!(flags & kDeltaFlag)) {
+        reset();
+    }
+    mLastTime += r->signedVarint();
+    for (int i = 0; i < 4; ++i) {
+        r->signedVarint();
+    }
+    if (mVersion >= 2) {
+        for (int i = 0; i < kPressureValues; ++i) {
+            r->varint();
+        }
+    }
+    uint64_t total[kMetricTypes][kUidStates];
+    for (int i = 0; i < kMetricTypes; ++i) {
+        for (int j = 0; j < kUidStates; ++j) {
+            total[i][j] = r->varint();
+        }
+    }
+
+    // Top N reads are only parsed for their strings.
+    for (uint64_t i = 0, n = r->varint(); i < n; ++i) {
+        r->varint();
+        string(r);
+        for (int j = 0; j < 2 * kUidStates; ++j) {
+            r->varint();
+        }
+    }
+    std::string_view topPackage;
+    uint64_t topBytes = 0;
+    for (uint64_t i = 0, n = r->varint(); i < n; ++i) {
+        r->varint();
+        const std::string_view packageName = string(r);
+        uint64_t bytes[kUidStates];
+        for (int j = 0; j < kUidStates; ++j) {
+            bytes[j] = r->varint();
+        }
+        for (int j = 0; j < kUidStates; ++j) {
+            r->varint();
+        }
+        PackageStats& stats = mSummary->packages[std::string(packageName)];
+        stats.writtenBytes[0] += bytes[0];
+        stats.writtenBytes[1] += bytes[1];
+        ++stats.records;
+        if (bytes[0] + bytes[1] > topBytes) {
+            topBytes = bytes[0] + bytes[1];
+            topPackage = packageName;
+        }
+    }
+
+    r->varint();  // Total major faults.
+    skipUidProcessStats(r, /*withTotalTasks=*/true);
+    skipUidProcessStats(r, /*withTotalTasks=*/false);
+    if (mVersion >= 3) {
+        r->varint();  // Total CPU time.
+        skipUidProcessStats(r, /*withTotalTasks=*/false);
+    }
+
+    const int64_t time = mLastTime;
+    const bool isBootTime = type == kBootTimeRecord;
+    if (isBootTime && !mInBoot) {
+        ++mSummary->boots;
+    }
+    mInBoot = isBootTime;
+
+    int64_t elapsedSecs = 0;
+    if (mPreviousTime != 0 && time > mPreviousTime &&
+        time - mPreviousTime <= mOptions.maxGapSecs) {
+        elapsedSecs = time - mPreviousTime;
+    }
+    mPreviousTime = time;
+    if (mSummary->records == 0) {
+        mSummary->firstTime = time;
+    }
+    mSummary->lastTime = time;
+    ++mSummary->records;
+
+    PhaseStats& phase = mSummary->phases[isBootTime ? 0 : 1];
+    ++phase.records;
+    phase.coveredSecs += elapsedSecs;
+    phase.writtenBytes[0] += total[kWriteBytes][0];
+    phase.writtenBytes[1] += total[kWriteBytes][1];
+
+    updateAnomaly(time, elapsedSecs, total[kWriteBytes][0] + total[kWriteBytes][1], topPackage);
+}
+
+void Analyzer::updateAnomaly(int64_t time, int64_t elapsedSecs, uint64_t writtenBytes,
+                             std::string_view topPackage) {
+    if (elapsedSecs == 0) {
+        // Without the elapsed time there is no rate, and a gap ends any window.
+        closeAnomaly();
+        return;
+    }
+    const double rate = static_cast<double>(writtenBytes) / elapsedSecs;
+    const bool isAnomaly = mAverageRecords >= kAnomalyWarmupRecords &&
+            rate >= mOptions.anomalyMinRate && rate >= mOptions.anomalyFactor * mAverageRate;
+    if (isAnomaly) {
+        if (!mInAnomaly) {
+            mInAnomaly = true;
+            mAnomaly = AnomalyWindow{};
+            mAnomaly.fileIndex = mFileIndex;
+            mAnomaly.startTime = time - elapsedSecs;
+            mAnomaly.baselineRate = mAverageRate;
+        }
+        mAnomaly.endTime = time;
+        ++mAnomaly.records;
+        mAnomaly.writtenBytes += writtenBytes;
+        if (rate > mAnomaly.peakRate) {
+            mAnomaly.peakRate = rate;
+            mAnomaly.topPackage = std::string(topPackage);
+        }
+    } else {
+        closeAnomaly();
+    }
+    mAverageRate = mAverageRecords == 0
+            ? rate
+            : mAverageRate + kAnomalyAverageWeight * (rate - mAverageRate);
+    ++mAverageRecords;
+}
+
+void Analyzer::closeAnomaly() {
+    if (!mInAnomaly) {
+        return;
+    }
+    mInAnomaly = false;
+    addAnomaly(std::move(mAnomaly), mOptions.topCount, &mSummary->anomalies);
+}
+
+void analyzeFile(const std::string& path, const Options& options, size_t fileIndex,
+                 Summary* summary) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        summary->error = StringPrintf("Failed to open: %s", strerror(errno));
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        summary->error = StringPrintf("Failed to stat: %s", strerror(errno));
+        return;
+    }
+    if (st.st_size == 0) {
+        return;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        summary->error = StringPrintf("Failed to map: %s", strerror(errno));
+        return;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    Analyzer(options, fileIndex, summary).analyze(static_cast<const uint8_t*>(data), size);
+    munmap(data, size);
+}
+
+void merge(Summary&& from, size_t topCount, Summary* to) {
+    if (from.records == 0) {
+        return;
+    }
+    if (to->records == 0 || from.firstTime < to->firstTime) {
+        to->firstTime = from.firstTime;
+    }
+    to->lastTime = std::max(to->lastTime, from.lastTime);
+    to->records += from.records;
+    to->boots += from.boots;
+    for (int i = 0; i < 2; ++i) {
+        to->phases[i].records += from.phases[i].records;
+        to->phases[i].coveredSecs += from.phases[i].coveredSecs;
+        to->phases[i].writtenBytes[0] += from.phases[i].writtenBytes[0];
+        to->phases[i].writtenBytes[1] += from.phases[i].writtenBytes[1];
+    }
+    for (auto& [packageName, stats] : from.packages) {
+        PackageStats& merged = to->packages[packageName];
+        merged.writtenBytes[0] += stats.writtenBytes[0];
+        merged.writtenBytes[1] += stats.writtenBytes[1];
+        merged.records += stats.records;
+    }
+    for (auto& window : from.anomalies) {
+        addAnomaly(std::move(window), topCount, &to->anomalies);
+    }
+}
+
+std::string prettyBytes(double bytes) {
+    static const char* const kUnits[] = {"bytes", "KB", "MB", "GB", "TB"};
+    size_t unit = 0;
+    while (bytes >= 1024 && unit < std::size(kUnits) - 1) {
+        bytes /= 1024;
+        ++unit;
+    }
+    return StringPrintf(unit == 0 ? "%.0f %s" : "%.1f %s", bytes, kUnits[unit]);
+}
+
+std::string rate(double bytes, int64_t secs) {
+    if (secs <= 0) {
+        return "n/a";
+    }
+    return prettyBytes(bytes / secs) + "/s";
+}
+
+void printReport(const Summary& summary, const std::vector<std::string>& paths, size_t topCount) {
+    int64_t coveredSecs = summary.phases[0].coveredSecs + summary.phases[1].coveredSecs;
+    printf("Records: %" PRIu64 " over %zu file(s), %" PRIu64 " boot(s)\n", summary.records,
+           paths.size(), summary.boots);
+    printf("Time span: %" PRId64 " to %" PRId64 ", %" PRId64 "s covered by collections\n\n",
+           summary.firstTime, summary.lastTime, coveredSecs);
+
+    static const char* const kPhaseNames[] = {"Boot-time", "Periodic"};
+    printf("Writes per phase (records, covered time, foreground, background, rate):\n");
+    for (int i = 0; i < 2; ++i) {
+        const PhaseStats& phase = summary.phases[i];
+        const uint64_t total = phase.writtenBytes[0] + phase.writtenBytes[1];
+        printf("  %s: %" PRIu64 ", %" PRId64 "s, %s, %s, %s\n", kPhaseNames[i], phase.records,
+               phase.coveredSecs, prettyBytes(phase.writtenBytes[0]).c_str(),
+               prettyBytes(phase.writtenBytes[1]).c_str(),
+               rate(total, phase.coveredSecs).c_str());
+    }
+
+    std::vector<std::pair<const std::string*, const PackageStats*>> packages;
+    packages.reserve(summary.packages.size());
+    for (const auto& [packageName, stats] : summary.packages) {
+        packages.emplace_back(&packageName, &stats);
+    }
+    const size_t count = std::min(topCount, packages.size());
+    std::partial_sort(packages.begin(), packages.begin() + count, packages.end(),
+                      [](const auto& lhs, const auto& rhs) {
+                          return lhs.second->totalWrittenBytes() > rhs.second->totalWrittenBytes();
+                      });
+    // Packages are only seen when they are among the top N writers of a collection, so these are
+    // lower bounds.
+    printf("\nTop %zu of %zu writing packages (foreground, background, average rate, "
+           "records in top N):\n", count, packages.size());
+    for (size_t i = 0; i < count; ++i) {
+        const PackageStats& stats = *packages[i].second;
+        printf("  %s: %s, %s, %s, %" PRIu64 "\n", packages[i].first->c_str(),
+               prettyBytes(stats.writtenBytes[0]).c_str(),
+               prettyBytes(stats.writtenBytes[1]).c_str(),
+               rate(stats.totalWrittenBytes(), coveredSecs).c_str(), stats.records);
+    }
+
+    std::vector<AnomalyWindow> anomalies = summary.anomalies;
+    std::sort(anomalies.begin(), anomalies.end(), isBetterAnomaly);
+    printf("\nTop %zu write anomaly windows (file, start, end, written, peak rate, baseline "
+           "rate, top writer at peak):\n", anomalies.size());
+    for (const auto& window : anomalies) {
+        printf("  %s, %" PRId64 ", %" PRId64 ", %s, %s/s, %s/s, %s\n",
+               paths[window.fileIndex].c_str(), window.startTime, window.endTime,
+               prettyBytes(window.writtenBytes).c_str(), prettyBytes(window.peakRate).c_str(),
+               prettyBytes(window.baselineRate).c_str(), window.topPackage.c_str());
+    }
+}
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options] <history file>...\n"
+            "  --threads <n>               Files to analyze at a time. Defaults to the number "
+            "of CPUs.\n"
+            "  --top <n>                   Packages and anomaly windows to report. Defaults to "
+            "%zu.\n"
+            "  --anomaly_factor <x>        Rate over the moving average that is anomalous. "
+            "Defaults to %.1f.\n"
+            "  --anomaly_min_rate <bytes>  Write rate below which nothing is anomalous. "
+            "Defaults to %.0f.\n"
+            "  --max_gap <secs>            Collection interval treated as a gap. Defaults to "
+            "%" PRId64 ".\n",
+            name, kDefaultTopCount, kDefaultAnomalyFactor, kDefaultAnomalyMinRate,
+            kDefaultMaxGapSecs);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static const struct option kLongOptions[] = {
+            {"threads", required_argument, nullptr, 't'},
+            {"top", required_argument, nullptr, 'n'},
+            {"anomaly_factor", required_argument, nullptr, 'f'},
+            {"anomaly_min_rate", required_argument, nullptr, 'r'},
+            {"max_gap", required_argument, nullptr, 'g'},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, 0, nullptr, 0},
+    };
+    Options options;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", kLongOptions, nullptr)) != -1) {
+        bool valid = true;
+        uint64_t maxGapSecs = 0;
+        switch (opt) {
+            case 't':
+                valid = ParseUint(optarg, &options.threads);
+                break;
+            case 'n':
+                valid = ParseUint(optarg, &options.topCount);
+                break;
+            case 'f':
+                valid = ParseDouble(optarg, &options.anomalyFactor, 1.0);
+                break;
+            case 'r':
+                valid = ParseDouble(optarg, &options.anomalyMinRate, 0.0);
+                break;
+            case 'g':
+                valid = ParseUint(optarg, &maxGapSecs, static_cast<uint64_t>(INT64_MAX));
+                options.maxGapSecs = static_cast<int64_t>(maxGapSecs);
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const std::vector<std::string> paths(argv + optind, argv + argc);
+    if (options.threads == 0) {
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    options.threads = std::min(options.threads, paths.size());
+
+    // Each file is decoded on its own, so files are handed out to the workers one at a time. Each
+    // worker folds its files into its own summary, which bounds the memory by the number of
+    // workers rather than of files.
+    std::vector<Summary> summaries(options.threads);
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < options.threads; ++i) {
+        workers.emplace_back([&, i]() {
+            for (size_t index = next++; index < paths.size(); index = next++) {
+                Summary summary;
+                analyzeFile(paths[index], options, index, &summary);
+                if (!summary.error.empty()) {
+                    fprintf(stderr, "%s: %s\n", paths[index].c_str(), summary.error.c_str());
+                }
+                merge(std::move(summary), options.topCount, &summaries[i]);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    Summary total;
+    for (auto& summary : summaries) {
+        merge(std::move(summary), options.topCount, &total);
+    }
+    printReport(total, paths, options.topCount);
+    return 0;
+}
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+
+# Decodes the binary I/O performance history written by carwatchdogd.
+#
+# Capture the history with:
+#   adb shell dumpsys android.automotive.watchdog.ICarWatchdog/default --dump_io_history > history
+#
+# The format is documented in packages/services/Car/watchdog/server/src/IoPerfHistory.h.
+
+import argparse
+import datetime
+import json
+import sys
+
+MAGIC = b"CWIOHIST"
+VERSIONS = (1, 2, 3)
+DELTA_FLAG = 1 << 0
+RECORD_TYPES = {1: "BOOT_TIME", 2: "PERIODIC"}
+PRESSURE_RESOURCES = ("cpu", "io", "memory")
+
+class TruncatedError(Exception):
+    pass
+
+class Reader(object):
+    def __init__(self, data, pos=0, end=None):
+        self.data = data
+        self.pos = pos
+        self.end = len(data) if end is None else end
+
+    def done(self):
+        return self.pos >= self.end
+
+    def byte(self):
+        if self.pos >= self.end: raise TruncatedError()
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def bytes(self, n):
+        if self.pos + n > self.end: raise TruncatedError()
+        value = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return value
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7f) << shift
+            if b < 0x80: return value
+            shift += 7
+
+    def signed(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+class Decoder(object):
+    def __init__(self):
+        self.reset(VERSIONS[-1])
+
+    def reset(self, version=None):
+        if version is not None: self.version = version
+        self.strings = []
+        self.lastTime = 0
+        self.lastSystem = [0, 0, 0, 0]
+        self.lastMajorFaults = 0
+
+    def string(self, r):
+        index = r.varint()
+        if index == 0:
+            value = r.bytes(r.varint()).decode("utf-8", "replace")
+            self.strings.append(value)
+            return value
+        return self.strings[index - 1]
+
+    def uidProcessStats(self, r, withTotalTasks):
+        stats = {"userId": r.varint(), "packageName": self.string(r), "count": r.varint()}
+        if withTotalTasks: stats["totalTasksCount"] = r.varint()
+        stats["topNProcesses"] = [
+            {"comm": self.string(r), "count": r.varint()} for _ in range(r.varint())]
+        return stats
+
+    def record(self, r):
+        recordType = r.byte()
+        flags = r.byte()
+        if not flags & DELTA_FLAG: self.reset()
+        self.lastTime += r.signed()
+        for i in range(4):
+            self.lastSystem[i] += r.signed()
+        pressure = {}
+        if self.version >= 2:
+            for resource in PRESSURE_RESOURCES:
+                pressure[resource] = {"some": r.varint(), "full": r.varint()}
+        totals = [[r.varint() for _ in range(2)] for _ in range(3)]
+        topN = []
+        for _ in range(2):
+            topN.append([{
+                "userId": r.varint(),
+                "packageName": self.string(r),
+                "bytes": [r.varint(), r.varint()],
+                "fsync": [r.varint(), r.varint()],
+            } for _ in range(r.varint())])
+        totalMajorFaults = r.varint()
+        ioBlocked = [self.uidProcessStats(r, True) for _ in range(r.varint())]
+        majorFaults = [self.uidProcessStats(r, False) for _ in range(r.varint())]
+        totalCpuTime = 0
+        cpuTime = []
+        if self.version >= 3:
+            totalCpuTime = r.varint()
+            cpuTime = [self.uidProcessStats(r, False) for _ in range(r.varint())]
+        percentChange = 0.0
+        if self.lastMajorFaults != 0:
+            percentChange = (totalMajorFaults - self.lastMajorFaults) * 100.0 / self.lastMajorFaults
+        self.lastMajorFaults = totalMajorFaults
+        return {
+            "type": RECORD_TYPES.get(recordType, str(recordType)),
+            "time": self.lastTime,
+            "systemIoPerfData": {
+                "cpuIoWaitTime": self.lastSystem[0],
+                "totalCpuTime": self.lastSystem[1],
+                "ioBlockedProcessesCnt": self.lastSystem[2],
+                "totalProcessesCnt": self.lastSystem[3],
+            },
+            "pressurePerfData": pressure,
+            "uidIoPerfData": {
+                "total": {"readBytes": totals[0], "writeBytes": totals[1], "fsync": totals[2]},
+                "topNReads": topN[0],
+                "topNWrites": topN[1],
+            },
+            "processIoPerfData": {
+                "totalMajorFaults": totalMajorFaults,
+                "majorFaultsPercentChange": percentChange,
+                "topNIoBlockedUids": ioBlocked,
+                "topNMajorFaultUids": majorFaults,
+                "totalCpuTime": totalCpuTime,
+                "topNCpuTimeUids": cpuTime,
+            },
+        }
+
+def decode(data):
+    """Yields the records in |data|, which may hold several concatenated history files."""
+    r = Reader(data)
+    decoder = Decoder()
+    while not r.done():
+        if data[r.pos:r.pos + len(MAGIC)] == MAGIC:
+            r.pos += len(MAGIC)
+            version = r.byte()
+            if version not in VERSIONS:
+                raise ValueError("Unsupported history version %d at offset %d" % (version, r.pos))
+            decoder.reset(version)
+            continue
+        try:
+            size = r.varint()
+            payload = Reader(data, r.pos, r.pos + size)
+            if payload.end > len(data): raise TruncatedError()
+            record = decoder.record(payload)
+        except TruncatedError:
+            print("Ignoring truncated record at offset %d" % r.pos, file=sys.stderr)
+            return
+        r.pos += size
+        yield record
+
+def printRecord(record):
+    timestamp = datetime.datetime.fromtimestamp(record["time"])
+    system = record["systemIoPerfData"]
+    uid = record["uidIoPerfData"]
+    process = record["processIoPerfData"]
+    print("%s collection: <%s>" % (record["type"], timestamp))
+    print("  CPU I/O wait time: %d of %d, I/O blocked processes: %d of %d" % (
+        system["cpuIoWaitTime"], system["totalCpuTime"], system["ioBlockedProcessesCnt"],
+        system["totalProcessesCnt"]))
+    for resource, stallTime in record["pressurePerfData"].items():
+        print("  %s pressure stall time (some, full): %d, %d us" % (
+            resource, stallTime["some"], stallTime["full"]))
+    for title, key, metric in [("reads", "topNReads", "readBytes"),
+                               ("writes", "topNWrites", "writeBytes")]:
+        print("  Top N %s (foreground, background bytes):" % title)
+        for stats in uid[key]:
+            print("    %d, %s, %d, %d" % (stats["userId"], stats["packageName"],
+                                         stats["bytes"][0], stats["bytes"][1]))
+    print("  Major page faults: %d (%.2f%%)" % (process["totalMajorFaults"],
+                                               process["majorFaultsPercentChange"]))
+    print("  CPU time: %d clock ticks" % process["totalCpuTime"])
+    for title, key in [("I/O blocked UIDs", "topNIoBlockedUids"),
+                       ("major fault UIDs", "topNMajorFaultUids"),
+                       ("CPU time UIDs", "topNCpuTimeUids")]:
+        print("  Top N %s:" % title)
+        for stats in process[key]:
+            print("    %d, %s, %d" % (stats["userId"], stats["packageName"], stats["count"]))
+            for p in stats["topNProcesses"]:
+                print("      %s, %d" % (p["comm"], p["count"]))
+
+def main():
+    parser = argparse.ArgumentParser("Decode carwatchdogd I/O performance history")
+    parser.add_argument("filename")
+    parser.add_argument("--json", action="store_true", default=False,
+                        help="Print one JSON object per record")
+    args = parser.parse_args()
+
+    with open(args.filename, "rb") as f:
+        data = f.read()
+    for record in decode(data):
+        if args.json:
+            print(json.dumps(record))
+        else:
+            printRecord(record)
+
+if __name__ == "__main__":
+    main()
@@ -23,6 +23,7 @@ LOCAL_MODULE_TAGS := optional
 
 LOCAL_SRC_FILES := $(call all-java-files-under, src)
 
+LOCAL_SRC_FILES += ../common/com/android/car/keventreader/IEventBatchCallback.aidl
 LOCAL_SRC_FILES += ../common/com/android/car/keventreader/IEventCallback.aidl
 LOCAL_SRC_FILES += ../common/com/android/car/keventreader/IEventProvider.aidl
 
@@ -52,6 +52,26 @@ public final class EventReaderService {
       }
   }
 
+  public boolean registerBatchCallback(IEventBatchCallback callback) {
+      try {
+          mService.registerBatchCallback(callback);
+          return true;
+      } catch (RemoteException e) {
+          Log.e(TAG, "unable to register new batch callback", e);
+          return false;
+      }
+  }
+
+  public boolean unregisterBatchCallback(IEventBatchCallback callback) {
+      try {
+          mService.unregisterBatchCallback(callback);
+          return true;
+      } catch (RemoteException e) {
+          Log.e(TAG, "unable to remove batch callback registration", e);
+          return false;
+      }
+  }
+
   public boolean unregisterCallback(IEventCallback callback) {
       try {
           mService.unregisterCallback(callback);
@@ -581,6 +581,8 @@ public final class KeypressEvent implements Parcelable {
     public final String source;
     public final int keycode;
     public final boolean isKeydown;
+    /** When the kernel saw the event, in microseconds of the clock of the input source. */
+    public final long timestampUs;
 
     public static final Parcelable.Creator<KeypressEvent> CREATOR =
         new Parcelable.Creator<KeypressEvent>() {
@@ -597,6 +599,7 @@ public final class KeypressEvent implements Parcelable {
         source = in.readString();
         keycode = in.readInt();
         isKeydown = (in.readInt() != 0);
+        timestampUs = in.readLong();
     }
 
     @Override
@@ -609,6 +612,7 @@ public final class KeypressEvent implements Parcelable {
         dest.writeString(source);
         dest.writeInt(keycode);
         dest.writeInt(isKeydown ? 1 : 0);
+        dest.writeLong(timestampUs);
     }
 
     @Override
@@ -625,7 +629,7 @@ public final class KeypressEvent implements Parcelable {
     @Override
     public String toString() {
         return"Event{source = " + source + ", keycode = " + keycode +
-                ", isKeydown = " + isKeydown + "}";
+                ", isKeydown = " + isKeydown + ", timestampUs = " + timestampUs + "}";
     }
 
     public String keycodeToString() {
@@ -25,10 +25,12 @@ LOCAL_SRC_FILES := \
     keymap.cpp \
     event.cpp \
     eventprovider.cpp \
+    ../common/com/android/car/keventreader/IEventBatchCallback.aidl \
     ../common/com/android/car/keventreader/IEventCallback.aidl \
     ../common/com/android/car/keventreader/IEventProvider.aidl \
 
 LOCAL_SHARED_LIBRARIES := \
+    libbase \
     libbinder \
     liblog \
     libutils
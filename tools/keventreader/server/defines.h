@@ -15,3 +15,4 @@
  */
 #define LOG_TAG "com.android.car.keventreader"
 #define SERVICE_NAME "com.android.car.keventreader"
+#define MONOTONIC_CLOCK_OPTION "--monotonic"
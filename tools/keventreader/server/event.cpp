@@ -21,10 +21,12 @@
 
 using namespace com::android::car::keventreader;
 
-KeypressEvent::KeypressEvent(const std::string source, uint32_t keycode, bool keydown) {
+KeypressEvent::KeypressEvent(const std::string source, uint32_t keycode, bool keydown,
+                             int64_t timestampUs) {
     this->source = source;
     this->keycode = keycode;
     this->keydown = keydown;
+    this->timestampUs = timestampUs;
 }
 
 status_t KeypressEvent::writeToParcel(Parcel* parcel) const {
@@ -32,6 +34,7 @@ status_t KeypressEvent::writeToParcel(Parcel* parcel) const {
     parcel->writeString16(s16);
     parcel->writeUint32(keycode);
     parcel->writeBool(keydown);
+    parcel->writeInt64(timestampUs);
 
     return OK;
 }
@@ -41,6 +44,7 @@ status_t KeypressEvent::readFromParcel(const Parcel* parcel) {
     source = std::string(String8(s16).c_str());
     keycode = parcel->readUint32();
     keydown = parcel->readBool();
+    timestampUs = parcel->readInt64();
 
     return OK;
 }
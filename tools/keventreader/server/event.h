@@ -25,11 +25,14 @@ using namespace android;
 namespace com::android::car::keventreader {
     struct KeypressEvent : public Parcelable {
         // required to be callable as KeypressEvent() because Parcelable
-        KeypressEvent(const std::string source = "", uint32_t keycode = 0, bool keydown = false);
+        KeypressEvent(const std::string source = "", uint32_t keycode = 0, bool keydown = false,
+                      int64_t timestampUs = 0);
 
         std::string source;
         uint32_t keycode;
         bool keydown;
+        // when the kernel saw the event, on the clock of the input source
+        int64_t timestampUs;
 
         virtual status_t writeToParcel(Parcel* parcel) const override;
         virtual status_t readFromParcel(const Parcel* parcel) override;
@@ -15,51 +15,66 @@
  */
 #include "eventgatherer.h"
 #include "defines.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 #include <utils/Log.h>
 
 using namespace com::android::car::keventreader;
 
-EventGatherer::EventGatherer(int argc, const char** argv) {
+EventGatherer::EventGatherer(int argc, const char** argv) : mEpoll(epoll_create1(EPOLL_CLOEXEC)) {
+    if (mEpoll < 0) {
+        ALOGE("epoll_create1 failed: errno = %d", errno);
+        return;
+    }
+    auto monotonic = false;
     for (auto i = 1; i < argc; ++i) {
-        auto dev = std::make_unique<InputSource>(argv[i]);
+        if (strcmp(argv[i], MONOTONIC_CLOCK_OPTION) == 0) {
+            monotonic = true;
+            continue;
+        }
+        auto dev = std::make_unique<InputSource>(argv[i], monotonic);
         if (dev && *dev) {
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLET;
+            event.data.fd = dev->descriptor();
+            if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, dev->descriptor(), &event) < 0) {
+                ALOGW("failed to watch input source file %s: errno = %d", argv[i], errno);
+                continue;
+            }
             ALOGD("opened input source file %s", argv[i]);
-            mFds.push_back({dev->descriptor(), POLLIN, 0});
             mDevices.emplace(dev->descriptor(), std::move(dev));
         } else {
             ALOGW("failed to open input source file %s", argv[i]);
         }
     }
+    mReady.resize(mDevices.size());
 }
 
 size_t EventGatherer::size() const {
     return mDevices.size();
 }
 
-std::vector<com::android::car::keventreader::KeypressEvent> EventGatherer::read() {
+void EventGatherer::read(std::vector<com::android::car::keventreader::KeypressEvent>* events) {
     constexpr int FOREVER = -1;
-    std::vector<com::android::car::keventreader::KeypressEvent> result;
+    events->clear();
 
-    int count = poll(&mFds[0], mFds.size(), FOREVER);
+    int count = TEMP_FAILURE_RETRY(epoll_wait(mEpoll, mReady.data(), mReady.size(), FOREVER));
     if (count < 0) {
-        ALOGE("poll failed: errno = %d", errno);
-        return result;
+        ALOGE("epoll_wait failed: errno = %d", errno);
+        return;
     }
 
-    for (auto& fd : mFds) {
-        if (fd.revents != 0) {
-            if (fd.revents == POLLIN) {
-                if (auto dev = mDevices[fd.fd].get()) {
-                    while(auto evt = dev->read()) {
-                        result.push_back(*evt);
-                    }
-                    --count; // found one source of events we care abour
-                }
-            }
-            fd.revents = 0;
-            if (count == 0) break; // if we read all events, no point in continuing the scan
+    for (int i = 0; i < count; ++i) {
+        auto fd = mReady[i].data.fd;
+        auto dev = mDevices.find(fd);
+        if (dev == mDevices.end()) {
+            continue;
+        }
+        if (!dev->second->read(events) || (mReady[i].events & (EPOLLERR | EPOLLHUP))) {
+            // stop watching a source that went away, rather than spinning on it
+            epoll_ctl(mEpoll, EPOLL_CTL_DEL, fd, nullptr);
+            mDevices.erase(dev);
         }
     }
-
-    return result;
 }
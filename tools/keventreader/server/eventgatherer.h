@@ -19,22 +19,28 @@
 #include "inputsource.h"
 #include "event.h"
 
+#include <android-base/unique_fd.h>
 #include <map>
 #include <memory>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <vector>
 
 namespace com::android::car::keventreader {
     class EventGatherer {
     public:
+        // opens the input source files named on the command line. the sources named
+        // after MONOTONIC_CLOCK_OPTION have their events stamped with CLOCK_MONOTONIC
         EventGatherer(int argc, const char** argv);
 
         size_t size() const;
 
-        std::vector<com::android::car::keventreader::KeypressEvent> read();
+        // waits for keypresses and stores them in events, replacing its contents.
+        // the vector is meant to be reused across calls so that its storage is too
+        void read(std::vector<com::android::car::keventreader::KeypressEvent>* events);
     private:
         std::map<int, std::unique_ptr<InputSource>> mDevices;
-        std::vector<pollfd> mFds;
+        ::android::base::unique_fd mEpoll;
+        std::vector<epoll_event> mReady;
     };
 }
 
@@ -24,8 +24,10 @@ EventProviderImpl::EventProviderImpl(EventGatherer&& g) : mGatherer(std::move(g)
 
 std::thread EventProviderImpl::startLoop() {
     auto t = std::thread( [this] () -> void {
+        std::vector<com::android::car::keventreader::KeypressEvent> events;
         while(true) {
-            auto events = mGatherer.read();
+            mGatherer.read(&events);
+            if (events.empty()) continue;
             {
                 std::scoped_lock lock(mMutex);
                 for (auto&& cb : mCallbacks) {
@@ -33,6 +35,9 @@ std::thread EventProviderImpl::startLoop() {
                         cb->onEvent(event);
                     }
                 }
+                for (auto&& cb : mBatchCallbacks) {
+                    cb->onEvents(events);
+                }
             }
         }
     });
@@ -50,3 +55,16 @@ Status EventProviderImpl::unregisterCallback(const sp<IEventCallback>& cb) {
     std::remove(mCallbacks.begin(), mCallbacks.end(), cb);
     return Status::ok();
 }
+
+Status EventProviderImpl::registerBatchCallback(const sp<IEventBatchCallback>& cb) {
+    std::scoped_lock lock(mMutex);
+    mBatchCallbacks.push_back(cb);
+    return Status::ok();
+}
+
+Status EventProviderImpl::unregisterBatchCallback(const sp<IEventBatchCallback>& cb) {
+    std::scoped_lock lock(mMutex);
+    mBatchCallbacks.erase(std::remove(mBatchCallbacks.begin(), mBatchCallbacks.end(), cb),
+        mBatchCallbacks.end());
+    return Status::ok();
+}
@@ -16,6 +16,7 @@
 #ifndef CAR_KEVENTREADER_EVENTPROVIDER
 #define CAR_KEVENTREADER_EVENTPROVIDER
 
+#include "com/android/car/keventreader/IEventBatchCallback.h"
 #include "com/android/car/keventreader/IEventCallback.h"
 #include "com/android/car/keventreader/BnEventProvider.h"
 #include <binder/Binder.h>
@@ -35,10 +36,13 @@ namespace com::android::car::keventreader {
 
         virtual Status registerCallback(const sp<IEventCallback>& callback) override;
         virtual Status unregisterCallback(const sp<IEventCallback>& callback) override;
+        virtual Status registerBatchCallback(const sp<IEventBatchCallback>& callback) override;
+        virtual Status unregisterBatchCallback(const sp<IEventBatchCallback>& callback) override;
     private:
         EventGatherer mGatherer;
         std::mutex mMutex;
         std::vector<sp<IEventCallback>> mCallbacks;
+        std::vector<sp<IEventBatchCallback>> mBatchCallbacks;
     };
 }
 
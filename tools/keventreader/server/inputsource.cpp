@@ -17,9 +17,12 @@
 #include "defines.h"
 #include <utils/Log.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <sstream>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
 using namespace com::android::car::keventreader;
@@ -40,7 +43,16 @@ bool InputSource::kevent::isKeyup() const {
     return isKeypress() && (value == 0);
 }
 
-InputSource::InputSource(const char* file) : mFilePath(file), mDescriptor(open(file, O_RDONLY)) {}
+InputSource::InputSource(const char* file, bool monotonic) :
+    mFilePath(file), mDescriptor(open(file, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) {
+    if (mDescriptor >= 0 && monotonic) {
+        int clockId = CLOCK_MONOTONIC;
+        if (ioctl(mDescriptor, EVIOCSCLOCKID, &clockId) != 0) {
+            ALOGW("input source %s cannot use the monotonic clock: errno = %d",
+              mFilePath.c_str(), errno);
+        }
+    }
+}
 
 InputSource::operator bool() const {
     return descriptor() >= 0;
@@ -50,24 +62,38 @@ int InputSource::descriptor() const {
     return mDescriptor;
 }
 
-std::optional<com::android::car::keventreader::KeypressEvent> InputSource::read() const {
-    kevent evt;
-
-    auto cnt = ::read(mDescriptor, &evt, sizeof(evt));
+bool InputSource::read(std::vector<com::android::car::keventreader::KeypressEvent>* events) {
+    // the source is polled edge triggered, so drain it until the kernel has no more events
+    while (true) {
+        auto cnt = TEMP_FAILURE_RETRY(::read(mDescriptor, mBuffer.data(), sizeof(mBuffer)));
+        if (cnt < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            ALOGE("input source %s failed: errno = %d", mFilePath.c_str(), errno);
+            return false;
+        }
+        if (cnt == 0) {
+            ALOGE("input source %s closed", mFilePath.c_str());
+            return false;
+        }
 
-    // the kernel guarantees that we will always be able to read a whole number of events
-    if (cnt < static_cast<decltype(cnt)>(sizeof(evt))) {
-        return std::nullopt;
+        // the kernel guarantees that we will always be able to read a whole number of events
+        auto num = static_cast<size_t>(cnt) / sizeof(kevent);
+        for (size_t i = 0; i < num; ++i) {
+            const auto& evt = mBuffer[i];
+            if (!evt.isKeypress()) {
+                continue;
+            }
+            ALOGD("input source %s generated code %u (down = %s)",
+              mFilePath.c_str(), evt.code, evt.isKeydown() ? "true" : "false");
+            auto timestampUs = static_cast<int64_t>(evt.input_event_sec) * 1000000 +
+                evt.input_event_usec;
+            events->emplace_back(mFilePath, evt.code, evt.isKeydown(), timestampUs);
+        }
     }
-    if (!evt.isKeypress()) {
-        return std::nullopt;
-    }
-
-    ALOGD("input source %s generated code %u (down = %s)",
-      mFilePath.c_str(), evt.code, evt.isKeydown() ? "true" : "false");
-    return com::android::car::keventreader::KeypressEvent(mFilePath, evt.code, evt.isKeydown());
 }
 
 InputSource::~InputSource() {
-    if (mDescriptor) ::close(mDescriptor);
+    if (mDescriptor >= 0) ::close(mDescriptor);
 }
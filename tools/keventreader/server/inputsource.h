@@ -16,21 +16,26 @@
 #ifndef CAR_KEVENTREADER_INPUTSOURCE
 #define CAR_KEVENTREADER_INPUTSOURCE
 
+#include <array>
 #include <linux/input.h>
-#include <optional>
 #include <string>
+#include <vector>
 #include "event.h"
 
 namespace com::android::car::keventreader {
     class InputSource {
     public:
-        explicit InputSource(const char* file);
+        // monotonic asks the kernel to stamp the events with CLOCK_MONOTONIC, which
+        // consumers can compare against SystemClock.uptimeMillis, instead of CLOCK_REALTIME
+        InputSource(const char* file, bool monotonic);
 
         explicit operator bool() const;
 
         int descriptor() const;
 
-        std::optional<com::android::car::keventreader::KeypressEvent> read() const;
+        // appends the keypresses available on this source to events, without
+        // blocking. returns false if the source failed and should be dropped
+        bool read(std::vector<com::android::car::keventreader::KeypressEvent>* events);
 
         virtual ~InputSource();
     private:
@@ -42,8 +47,12 @@ namespace com::android::car::keventreader {
         };
         static_assert(sizeof(kevent) == sizeof(::input_event), "do not add data to input_event");
 
+        // input events read per syscall
+        static constexpr size_t kMaxEventsPerRead = 64;
+
         std::string mFilePath;
         int mDescriptor;
+        std::array<kevent, kMaxEventsPerRead> mBuffer;
     };
 }
 
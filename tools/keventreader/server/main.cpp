@@ -36,7 +36,8 @@ using namespace com::android::car::keventreader;
  * The tool will hook up to each such file passed as input
  */
 static const char* SYNTAX_INSTRUCTIONS =
-    "invalid command line arguments - provide one or more /dev/input/event files";
+    "invalid command line arguments - provide one or more /dev/input/event files, "
+    "preceded by " MONOTONIC_CLOCK_OPTION " to timestamp their events with CLOCK_MONOTONIC";
 
 static void error(int code) {
     ALOGE("%s", SYNTAX_INSTRUCTIONS);
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_CLIENT_INCLUDE_WATCHDOGHEALTHCLIENT_H_
+#define WATCHDOG_CLIENT_INCLUDE_WATCHDOGHEALTHCLIENT_H_
+
+#include <aidl/android/automotive/watchdog/BnCarWatchdogClient.h>
+#include <aidl/android/automotive/watchdog/ICarWatchdog.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace aidl {
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Health check client for native processes. It answers the pings of car watchdog daemon on the
+// binder thread that receives them, based on an epoch counter that the application's main loop
+// advances with heartbeat(). A ping is answered only if the main loop beat since the previous
+// ping, so a stuck main loop goes unanswered and is caught by the watchdog, while the
+// application itself does no work per ping.
+//
+// Usage:
+//   auto client = WatchdogHealthClient::create(TimeoutLength::TIMEOUT_NORMAL);
+//   while (running) {
+//       client->heartbeat();
+//       ...
+//   }
+//   client->unregister();
+//
+// A main loop that can idle for longer than the timeout must beat from a periodic timer.
+class WatchdogHealthClient : public BnCarWatchdogClient {
+public:
+    // Connects to car watchdog daemon and registers a client with the given timeout. Returns
+    // nullptr if the daemon is not available.
+    static std::shared_ptr<WatchdogHealthClient> create(TimeoutLength timeout);
+
+    WatchdogHealthClient(const std::shared_ptr<ICarWatchdog>& watchdogServer,
+                         TimeoutLength timeout);
+
+    // Marks the application as making progress. Safe to call from any thread; it is a relaxed
+    // atomic increment and never blocks.
+    void heartbeat() { mEpoch.fetch_add(1, std::memory_order_relaxed); }
+
+    // Unregisters the client. The daemon holds the client until then.
+    void unregister();
+
+    ndk::ScopedAStatus checkIfAlive(int32_t sessionId, TimeoutLength timeout) override;
+    ndk::ScopedAStatus prepareProcessTermination() override;
+
+    // Returns whether heartbeat() was called since the last call. The first call after creation
+    // returns true, so that the application gets a whole timeout to make its first beat.
+    bool hasProgressed();
+
+private:
+    bool registerClient();
+
+    std::atomic<uint64_t> mEpoch;
+    // Epoch seen by the last ping. Only accessed from the binder threads under mMutex.
+    uint64_t mLastEpoch;
+    bool mFirstCheck;
+
+    const TimeoutLength mTimeout;
+    std::mutex mMutex;
+    std::shared_ptr<ICarWatchdog> mWatchdogServer;
+    std::shared_ptr<ICarWatchdogClient> mSelf;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+}  // namespace aidl
+
+#endif  // WATCHDOG_CLIENT_INCLUDE_WATCHDOGHEALTHCLIENT_H_
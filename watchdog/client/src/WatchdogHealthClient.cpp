@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdog_client"
+
+#include "WatchdogHealthClient.h"
+
+#include <android/binder_manager.h>
+#include <log/log.h>
+
+namespace aidl {
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+namespace {
+
+constexpr const char* kWatchdogServerName = "android.automotive.watchdog.ICarWatchdog/default";
+
+}  // namespace
+
+std::shared_ptr<WatchdogHealthClient> WatchdogHealthClient::create(TimeoutLength timeout) {
+    ndk::SpAIBinder binder(AServiceManager_getService(kWatchdogServerName));
+    if (binder.get() == nullptr) {
+        ALOGE("Getting carwatchdog daemon failed");
+        return nullptr;
+    }
+    std::shared_ptr<ICarWatchdog> server = ICarWatchdog::fromBinder(binder);
+    if (server == nullptr) {
+        ALOGE("Failed to connect to carwatchdog daemon");
+        return nullptr;
+    }
+    auto client = ndk::SharedRefBase::make<WatchdogHealthClient>(server, timeout);
+    if (!client->registerClient()) {
+        return nullptr;
+    }
+    return client;
+}
+
+WatchdogHealthClient::WatchdogHealthClient(const std::shared_ptr<ICarWatchdog>& watchdogServer,
+                                           TimeoutLength timeout) :
+      mEpoch(0),
+      mLastEpoch(0),
+      mFirstCheck(true),
+      mTimeout(timeout),
+      mWatchdogServer(watchdogServer) {}
+
+bool WatchdogHealthClient::registerClient() {
+    std::shared_ptr<ICarWatchdogClient> self = ICarWatchdogClient::fromBinder(asBinder());
+    if (self == nullptr) {
+        ALOGW("Failed to get ICarWatchdogClient from binder");
+        return false;
+    }
+    ndk::ScopedAStatus status = mWatchdogServer->registerClient(self, mTimeout);
+    if (!status.isOk()) {
+        ALOGW("Failed to register the client to car watchdog server: %d", status.getStatus());
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSelf = self;
+    return true;
+}
+
+void WatchdogHealthClient::unregister() {
+    std::shared_ptr<ICarWatchdog> watchdogServer;
+    std::shared_ptr<ICarWatchdogClient> self;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mWatchdogServer == nullptr || mSelf == nullptr) {
+            return;
+        }
+        watchdogServer = mWatchdogServer;
+        self = std::move(mSelf);
+    }
+    watchdogServer->unregisterClient(self);
+}
+
+bool WatchdogHealthClient::hasProgressed() {
+    uint64_t epoch = mEpoch.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mMutex);
+    bool progressed = mFirstCheck || epoch != mLastEpoch;
+    mFirstCheck = false;
+    mLastEpoch = epoch;
+    return progressed;
+}
+
+ndk::ScopedAStatus WatchdogHealthClient::checkIfAlive(int32_t sessionId,
+                                                      TimeoutLength /*timeout*/) {
+    if (!hasProgressed()) {
+        // Leaving the ping unanswered lets car watchdog daemon handle the stuck process.
+        ALOGW("Main loop made no progress since the last health check (session id = %d)",
+              sessionId);
+        return ndk::ScopedAStatus::ok();
+    }
+    std::shared_ptr<ICarWatchdog> watchdogServer;
+    std::shared_ptr<ICarWatchdogClient> self;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        watchdogServer = mWatchdogServer;
+        self = mSelf;
+    }
+    if (watchdogServer == nullptr || self == nullptr) {
+        return ndk::ScopedAStatus::ok();
+    }
+    ndk::ScopedAStatus status = watchdogServer->tellClientAlive(self, sessionId);
+    if (!status.isOk()) {
+        ALOGE("Failed to call binder interface: %d", status.getStatus());
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+ndk::ScopedAStatus WatchdogHealthClient::prepareProcessTermination() {
+    ALOGI("This process is being terminated by car watchdog");
+    return ndk::ScopedAStatus::ok();
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+}  // namespace aidl
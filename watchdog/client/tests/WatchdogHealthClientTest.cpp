@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WatchdogHealthClient.h"
+
+#include <gtest/gtest.h>
+
+namespace aidl {
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+namespace {
+
+std::shared_ptr<WatchdogHealthClient> createClient() {
+    return ndk::SharedRefBase::make<WatchdogHealthClient>(nullptr,
+                                                          TimeoutLength::TIMEOUT_CRITICAL);
+}
+
+}  // namespace
+
+TEST(WatchdogHealthClientTest, TestFirstCheckPasses) {
+    auto client = createClient();
+    EXPECT_TRUE(client->hasProgressed());
+    EXPECT_FALSE(client->hasProgressed());
+}
+
+TEST(WatchdogHealthClientTest, TestProgressesOnlyAfterHeartbeat) {
+    auto client = createClient();
+    client->hasProgressed();
+
+    client->heartbeat();
+    EXPECT_TRUE(client->hasProgressed());
+    EXPECT_FALSE(client->hasProgressed());
+
+    client->heartbeat();
+    client->heartbeat();
+    EXPECT_TRUE(client->hasProgressed());
+    EXPECT_FALSE(client->hasProgressed());
+}
+
+TEST(WatchdogHealthClientTest, TestCheckIfAliveWithoutServer) {
+    auto client = createClient();
+    EXPECT_TRUE(client->checkIfAlive(1, TimeoutLength::TIMEOUT_CRITICAL).isOk());
+    EXPECT_TRUE(client->checkIfAlive(2, TimeoutLength::TIMEOUT_CRITICAL).isOk());
+    client->unregister();
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,294 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks the `/proc` collectors and a whole I/O performance collection against synthetic
+// `/proc` trees. Run on a device with:
+//   atest libwatchdog_benchmark
+//
+// Each benchmark reports the allocations per iteration as the "allocs" counter.
+//
+// BM_IoPerfCollectionReplay replays the `/proc` snapshots recorded with
+// benchmarks/record_proc_snapshots.sh from the directory in the CARWATCHDOG_PROC_RECORDING
+// environment variable, and is skipped when it is not set.
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "IoPerfCollection.h"
+#include "ProcPidDir.h"
+#include "ProcSnapshotReplay.h"
+#include "ProcPidStat.h"
+#include "ProcStat.h"
+#include "UidIoStats.h"
+
+namespace {
+
+std::atomic<uint64_t> gNumAllocations(0);
+
+}  // namespace
+
+void* operator new(size_t size) {
+    gNumAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = malloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+    free(ptr);
+}
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringAppendF;
+using android::base::StringPrintf;
+using android::base::WriteStringToFile;
+using testing::populateProcPidDir;
+using testing::ProcSnapshotReplay;
+
+// Sets up and runs the private collection steps of IoPerfCollection without starting the
+// collection thread.
+class IoPerfCollectionBenchmark {
+public:
+    static void setCollectors(IoPerfCollection* collection, const std::string& uidIoStatsPath,
+                              const std::string& procStatPath, const std::string& procDirPath,
+                              const std::string& procPressureDirPath) {
+        collection->mUidIoStats = new UidIoStats(uidIoStatsPath);
+        collection->mProcStat = new ProcStat(procStatPath);
+        collection->mProcPidStat = new ProcPidStat(procDirPath);
+        collection->mProcPressure = new ProcPressure(procPressureDirPath);
+        // Same as the defaults used when the top N sysprops are not set.
+        collection->mTopNStatsPerCategory = 10;
+        collection->mTopNStatsPerSubcategory = 5;
+    }
+
+    static android::base::Result<void> collect(IoPerfCollection* collection,
+                                               IoPerfRecord* record) {
+        return collection->collect(CollectionInfo{}, record);
+    }
+};
+
+namespace {
+
+constexpr uint32_t kThreadsPerProcess = 10;
+constexpr uint32_t kFirstAppUid = 10000;
+constexpr uint32_t kNumUids = 200;
+
+constexpr char kProcStatContents[] =
+        "cpu  6200 5700 1700 3100 1100 5200 3900 0 0 0\n"
+        "cpu0 2400 2900 600 690 340 4300 2100 0 0 0\n"
+        "intr 694351583 0 0 0 297062868 0 5922464 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+        "ctxt 579020168\n"
+        "btime 1579718450\n"
+        "processes 113804\n"
+        "procs_running 17\n"
+        "procs_blocked 5\n"
+        "softirq 33275060 934664 11958403 5111 516325 200333 0 341482 10651335 0 8667407\n";
+
+// Synthetic `/proc` tree with |numTasks| tasks, |kThreadsPerProcess| per process, owned by
+// |kNumUids| UIDs, and a `uid_io/stats` table with |numUids| UIDs.
+class SyntheticProc {
+public:
+    SyntheticProc(uint32_t numTasks, uint32_t numUids) {
+        std::unordered_map<uint32_t, std::vector<uint32_t>> pidToTids;
+        std::unordered_map<uint32_t, std::string> processStat;
+        std::unordered_map<uint32_t, std::string> processStatus;
+        std::unordered_map<uint32_t, std::string> threadStat;
+        for (uint32_t pid = 1; pid <= numTasks; pid += kThreadsPerProcess) {
+            const uint32_t uid = kFirstAppUid + pid % kNumUids;
+            const std::string comm = StringPrintf("process%" PRIu32, pid);
+            std::vector<uint32_t>& tids = pidToTids[pid];
+            for (uint32_t tid = pid; tid < pid + kThreadsPerProcess && tid <= numTasks; ++tid) {
+                tids.push_back(tid);
+                threadStat[tid] = StringPrintf("%" PRIu32 " (%s) %s 1 0 0 0 0 0 0 0 %" PRIu32
+                                               " 0 0 0 0 0 0 0 1 0 %" PRIu32 "\n",
+                                               tid, comm.c_str(), tid % 4 == 0 ? "D" : "S",
+                                               tid % 97, pid);
+            }
+            processStat[pid] = StringPrintf("%" PRIu32 " (%s) S 1 0 0 0 0 0 0 0 %" PRIu32
+                                            " 0 0 0 0 0 0 0 %zu 0 %" PRIu32 "\n",
+                                            pid, comm.c_str(), pid % 997, tids.size(), pid);
+            processStatus[pid] = StringPrintf("Pid:\t%" PRIu32 "\nTgid:\t%" PRIu32
+                                              "\nUid:\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32
+                                              "\t%" PRIu32 "\n",
+                                              pid, pid, uid, uid, uid, uid);
+        }
+        mResult = populateProcPidDir(mProcDir.path, pidToTids, processStat, processStatus,
+                                     threadStat);
+        std::string uidIoStats;
+        for (uint32_t i = 0; i < numUids; ++i) {
+            // Format: uid fgRdChar fgWrChar fgRdBytes fgWrBytes bgRdChar bgWrChar bgRdBytes
+            // bgWrBytes fgFsync bgFsync
+            StringAppendF(&uidIoStats,
+                          "%" PRIu32 " 5000 1000 %" PRIu32 " %" PRIu32 " 0 0 %" PRIu32 " %" PRIu32
+                          " 20 0\n",
+                          kFirstAppUid + i, i * 3, i * 5, i * 7, i * 11);
+        }
+        if (mResult.ok() && !WriteStringToFile(uidIoStats, mUidIoStatsFile.path)) {
+            mResult = android::base::Error() << "Failed to write " << mUidIoStatsFile.path;
+        }
+        if (mResult.ok() && !WriteStringToFile(kProcStatContents, mProcStatFile.path)) {
+            mResult = android::base::Error() << "Failed to write " << mProcStatFile.path;
+        }
+    }
+
+    const android::base::Result<void>& result() const { return mResult; }
+    const char* procDirPath() const { return mProcDir.path; }
+    const char* uidIoStatsPath() const { return mUidIoStatsFile.path; }
+    const char* procStatPath() const { return mProcStatFile.path; }
+    // Has no pressure files, so the pressure collector is disabled.
+    const char* procPressureDirPath() const { return mProcPressureDir.path; }
+
+private:
+    TemporaryDir mProcDir;
+    TemporaryDir mProcPressureDir;
+    TemporaryFile mUidIoStatsFile;
+    TemporaryFile mProcStatFile;
+    android::base::Result<void> mResult;
+};
+
+void reportAllocations(benchmark::State& state, uint64_t numAllocationsBefore) {
+    state.counters["allocs"] =
+            benchmark::Counter(static_cast<double>(gNumAllocations.load() - numAllocationsBefore),
+                               benchmark::Counter::kAvgIterations);
+}
+
+void BM_ProcPidStatCollect(benchmark::State& state) {
+    SyntheticProc proc(static_cast<uint32_t>(state.range(0)), /*numUids=*/0);
+    if (!proc.result().ok()) {
+        state.SkipWithError(proc.result().error().message().c_str());
+        return;
+    }
+    ProcPidStat procPidStat(proc.procDirPath());
+    const uint64_t numAllocationsBefore = gNumAllocations.load();
+    for (auto _ : state) {
+        auto ret = procPidStat.collect();
+        benchmark::DoNotOptimize(ret);
+    }
+    reportAllocations(state, numAllocationsBefore);
+}
+BENCHMARK(BM_ProcPidStatCollect)->Arg(1000)->Arg(5000)->Arg(20000)->Unit(benchmark::kMillisecond);
+
+void BM_UidIoStatsCollect(benchmark::State& state) {
+    SyntheticProc proc(/*numTasks=*/0, static_cast<uint32_t>(state.range(0)));
+    if (!proc.result().ok()) {
+        state.SkipWithError(proc.result().error().message().c_str());
+        return;
+    }
+    UidIoStats uidIoStats(proc.uidIoStatsPath());
+    const uint64_t numAllocationsBefore = gNumAllocations.load();
+    for (auto _ : state) {
+        auto ret = uidIoStats.collect();
+        benchmark::DoNotOptimize(ret);
+    }
+    reportAllocations(state, numAllocationsBefore);
+}
+BENCHMARK(BM_UidIoStatsCollect)->Arg(1000)->Arg(5000)->Arg(20000)->Unit(benchmark::kMillisecond);
+
+// Tasks and UIDs are scaled together as both grow with the number of installed packages.
+void BM_IoPerfCollectionTick(benchmark::State& state) {
+    const uint32_t numTasksAndUids = static_cast<uint32_t>(state.range(0));
+    SyntheticProc proc(numTasksAndUids, numTasksAndUids);
+    if (!proc.result().ok()) {
+        state.SkipWithError(proc.result().error().message().c_str());
+        return;
+    }
+    sp<IoPerfCollection> collection = new IoPerfCollection();
+    IoPerfCollectionBenchmark::setCollectors(collection.get(), proc.uidIoStatsPath(),
+                                             proc.procStatPath(), proc.procDirPath(),
+                                             proc.procPressureDirPath());
+    IoPerfRecord record;
+    const uint64_t numAllocationsBefore = gNumAllocations.load();
+    for (auto _ : state) {
+        auto ret = IoPerfCollectionBenchmark::collect(collection.get(), &record);
+        if (!ret.ok()) {
+            state.SkipWithError(ret.error().message().c_str());
+            break;
+        }
+    }
+    reportAllocations(state, numAllocationsBefore);
+}
+BENCHMARK(BM_IoPerfCollectionTick)
+        ->Arg(1000)
+        ->Arg(5000)
+        ->Arg(20000)
+        ->Unit(benchmark::kMillisecond);
+
+// Collects one snapshot of a recording per iteration, as fast as the collection runs.
+void BM_IoPerfCollectionReplay(benchmark::State& state) {
+    const char* recordingPath = getenv("CARWATCHDOG_PROC_RECORDING");
+    if (recordingPath == nullptr) {
+        state.SkipWithError("CARWATCHDOG_PROC_RECORDING is not set");
+        return;
+    }
+    ProcSnapshotReplay replay(recordingPath);
+    if (!replay.result().ok()) {
+        state.SkipWithError(replay.result().error().message().c_str());
+        return;
+    }
+    sp<IoPerfCollection> collection = new IoPerfCollection();
+    const auto setCollectors = [&]() {
+        IoPerfCollectionBenchmark::setCollectors(collection.get(), replay.uidIoStatsPath(),
+                                                 replay.procStatPath(), replay.procDirPath(),
+                                                 replay.procPressureDirPath());
+    };
+    setCollectors();
+    IoPerfRecord record;
+    const uint64_t numAllocationsBefore = gNumAllocations.load();
+    for (auto _ : state) {
+        auto ret = IoPerfCollectionBenchmark::collect(collection.get(), &record);
+        if (!ret.ok()) {
+            state.SkipWithError(ret.error().message().c_str());
+            break;
+        }
+        if (!replay.next()) {
+            // Start over with new collectors, so the first snapshot isn't diffed with the last.
+            state.PauseTiming();
+            if (const auto rewindRet = replay.rewind(); !rewindRet.ok()) {
+                state.SkipWithError(rewindRet.error().message().c_str());
+                break;
+            }
+            setCollectors();
+            state.ResumeTiming();
+        }
+    }
+    reportAllocations(state, numAllocationsBefore);
+    state.counters["snapshots"] = static_cast<double>(replay.size());
+}
+BENCHMARK(BM_IoPerfCollectionReplay)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+BENCHMARK_MAIN();
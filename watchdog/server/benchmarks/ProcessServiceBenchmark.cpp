@@ -0,0 +1,143 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks WatchdogProcessService under a synthetic client load. Run on a device with:
+//   atest libwatchdog_benchmark
+//
+// The latencies are reported in microseconds as the "<call>_p50_us" and "<call>_p99_us"
+// counters. The clients are local binder objects, so the latencies don't include the binder
+// transport.
+
+#include <benchmark/benchmark.h>
+#include <time.h>
+#include <utils/Looper.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "ClientLoadGenerator.h"
+#include "WatchdogProcessService.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using testing::CallLatencies;
+using testing::ClientLoadConfig;
+using testing::ClientLoadGenerator;
+
+namespace {
+
+// Length of the health check window of the TIMEOUT_CRITICAL clients.
+constexpr std::chrono::seconds kCriticalWindow = std::chrono::seconds(3);
+
+nsecs_t processCpuTime() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<nsecs_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void reportLatencies(benchmark::State& state, const std::string& call, CallLatencies* latencies) {
+    state.counters[call + "_p50_us"] = static_cast<double>(latencies->percentile(50)) / 1000;
+    state.counters[call + "_p99_us"] = static_cast<double>(latencies->percentile(99)) / 1000;
+}
+
+// Runs the looper of the service, which sends the health check messages, on its own thread.
+class LooperThread {
+public:
+    LooperThread() : mLooper(new Looper(/*allowNonCallbacks=*/false)), mIsRunning(true) {
+        mThread = std::thread([this]() {
+            while (mIsRunning.load()) {
+                mLooper->pollAll(/*timeoutMillis=*/-1);
+            }
+        });
+    }
+
+    ~LooperThread() {
+        mIsRunning.store(false);
+        mLooper->wake();
+        mThread.join();
+    }
+
+    const sp<Looper>& looper() const { return mLooper; }
+
+private:
+    sp<Looper> mLooper;
+    std::atomic<bool> mIsRunning;
+    std::thread mThread;
+};
+
+void BM_RegisterUnregisterClients(benchmark::State& state) {
+    LooperThread looperThread;
+    sp<WatchdogProcessService> service = new WatchdogProcessService(looperThread.looper());
+    ClientLoadConfig config;
+    config.numClients = static_cast<size_t>(state.range(0));
+    ClientLoadGenerator generator(service, config);
+    CallLatencies registerLatencies;
+    CallLatencies unregisterLatencies;
+    for (auto _ : state) {
+        registerLatencies.merge(generator.registerClients());
+        unregisterLatencies.merge(generator.unregisterClients());
+    }
+    reportLatencies(state, "register", &registerLatencies);
+    reportLatencies(state, "unregister", &unregisterLatencies);
+    service->terminate();
+}
+BENCHMARK(BM_RegisterUnregisterClients)
+        ->Arg(100)
+        ->Arg(1000)
+        ->Arg(5000)
+        ->Unit(benchmark::kMillisecond);
+
+// Each iteration is one health check window of the TIMEOUT_CRITICAL clients. Reports the CPU
+// time of the whole process, including the pinging and the responding clients, per window.
+void BM_CriticalHealthCheckLoad(benchmark::State& state) {
+    LooperThread looperThread;
+    sp<WatchdogProcessService> service = new WatchdogProcessService(looperThread.looper());
+    ClientLoadConfig config;
+    config.numClients = static_cast<size_t>(state.range(0));
+    config.timeouts = {TimeoutLength::TIMEOUT_CRITICAL};
+    ClientLoadGenerator generator(service, config);
+    generator.registerClients();
+    const nsecs_t cpuTimeBefore = processCpuTime();
+    for (auto _ : state) {
+        std::this_thread::sleep_for(kCriticalWindow);
+    }
+    state.counters["cpu_ms"] =
+            benchmark::Counter(static_cast<double>(processCpuTime() - cpuTimeBefore) / 1000000,
+                               benchmark::Counter::kAvgIterations);
+    state.counters["pings"] = benchmark::Counter(static_cast<double>(generator.numPings()),
+                                                 benchmark::Counter::kAvgIterations);
+    state.counters["failed_responses"] =
+            benchmark::Counter(static_cast<double>(generator.numFailedResponses()));
+    CallLatencies aliveLatencies = generator.aliveLatencies();
+    reportLatencies(state, "alive", &aliveLatencies);
+    generator.unregisterClients();
+    service->terminate();
+}
+BENCHMARK(BM_CriticalHealthCheckLoad)
+        ->Arg(100)
+        ->Arg(1000)
+        ->Arg(5000)
+        ->Iterations(3)
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,71 @@
+#!/bin/bash
+#
+# Copyright (C) 2020 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Records snapshots of the `/proc` files read by the carwatchdogd collectors from a connected
+# device. The output directory is replayed by tests/ProcSnapshotReplay.h, e.g. with:
+#   CARWATCHDOG_PROC_RECORDING=<output dir> libwatchdog_benchmark \
+#       --benchmark_filter=BM_IoPerfCollectionReplay
+#
+# The `/proc` files report a zero size, so they are copied with cat rather than pulled directly.
+
+set -e
+
+if [[ $# -lt 1 ]]; then
+  echo "Usage: $0 <output dir> [number of snapshots (default 60)] [interval in seconds (default 10)]"
+  exit 1
+fi
+
+readonly OUTPUT_DIR=$1
+readonly NUM_SNAPSHOTS=${2:-60}
+readonly INTERVAL=${3:-10}
+readonly DEVICE_DIR=/data/local/tmp/proc_snapshots
+
+adb root > /dev/null
+adb wait-for-device
+adb shell "rm -rf ${DEVICE_DIR} && mkdir -p ${DEVICE_DIR}"
+
+for ((i = 0; i < NUM_SNAPSHOTS; i++)); do
+  echo "Recording snapshot ${i}/${NUM_SNAPSHOTS}"
+  adb shell "
+    out=${DEVICE_DIR}/${i}
+    mkdir -p \${out}/uid_io \${out}/pressure
+    cat /proc/uid_io/stats > \${out}/uid_io/stats
+    cat /proc/stat > \${out}/stat
+    for f in cpu io memory; do
+      cat /proc/pressure/\${f} > \${out}/pressure/\${f} 2> /dev/null || rm -f \${out}/pressure/\${f}
+    done
+    cd /proc
+    for pid in [0-9]*; do
+      mkdir -p \${out}/\${pid}/task
+      cat \${pid}/stat > \${out}/\${pid}/stat 2> /dev/null || { rm -rf \${out}/\${pid}; continue; }
+      cat \${pid}/status > \${out}/\${pid}/status 2> /dev/null
+      cat \${pid}/io > \${out}/\${pid}/io 2> /dev/null
+      for tid in \$(ls \${pid}/task 2> /dev/null); do
+        mkdir -p \${out}/\${pid}/task/\${tid}
+        cat \${pid}/task/\${tid}/stat > \${out}/\${pid}/task/\${tid}/stat 2> /dev/null
+        cat \${pid}/task/\${tid}/io > \${out}/\${pid}/task/\${tid}/io 2> /dev/null
+      done
+    done
+  "
+  if [[ $((i + 1)) -lt ${NUM_SNAPSHOTS} ]]; then
+    sleep "${INTERVAL}"
+  fi
+done
+
+mkdir -p "${OUTPUT_DIR}"
+adb pull "${DEVICE_DIR}/." "${OUTPUT_DIR}"
+adb shell "rm -rf ${DEVICE_DIR}"
+echo "Recorded ${NUM_SNAPSHOTS} snapshots to ${OUTPUT_DIR}"
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Per-UID I/O accounting for carwatchdogd. bpfloader loads and pins these programs and the map
+// on boot. carwatchdogd attaches the programs to their tracepoints and reads the map.
+
+#include <bpf_helpers.h>
+
+#include "carwatchdog_uid_io_stats.h"
+
+DEFINE_BPF_MAP_GRO(uid_io_stats_map, PERCPU_HASH, uint32_t, struct uid_io_value,
+                   CARWATCHDOG_UID_IO_STATS_MAX_UIDS, AID_SYSTEM)
+
+// Layout of the android_fs dataread_start and datawrite_start tracepoint arguments. See
+// /sys/kernel/tracing/events/android_fs/android_fs_dataread_start/format.
+struct android_fs_data_args {
+    uint64_t ignore;
+    char* pathbuf;
+    int64_t offset;
+    int bytes;
+    int pid;
+    char* cmdline;
+    uint64_t ino;
+};
+
+static inline __always_inline struct uid_io_value* get_uid_io_value() {
+    uint32_t uid = bpf_get_current_uid_gid();
+    struct uid_io_value* value = bpf_uid_io_stats_map_lookup_elem(&uid);
+    if (value) {
+        return value;
+    }
+    struct uid_io_value zero = {};
+    bpf_uid_io_stats_map_update_elem(&uid, &zero, BPF_NOEXIST);
+    return bpf_uid_io_stats_map_lookup_elem(&uid);
+}
+
+// The map is per-CPU, so the counters are updated without atomic operations.
+DEFINE_BPF_PROG("tracepoint/android_fs/android_fs_dataread_start", AID_ROOT, AID_SYSTEM,
+                tp_dataread_start)
+(struct android_fs_data_args* args) {
+    struct uid_io_value* value = get_uid_io_value();
+    if (value && args->bytes > 0) {
+        value->read_bytes += args->bytes;
+    }
+    return 0;
+}
+
+DEFINE_BPF_PROG("tracepoint/android_fs/android_fs_datawrite_start", AID_ROOT, AID_SYSTEM,
+                tp_datawrite_start)
+(struct android_fs_data_args* args) {
+    struct uid_io_value* value = get_uid_io_value();
+    if (value && args->bytes > 0) {
+        value->write_bytes += args->bytes;
+    }
+    return 0;
+}
+
+DEFINE_BPF_PROG("tracepoint/f2fs/f2fs_sync_file_enter", AID_ROOT, AID_SYSTEM,
+                tp_f2fs_sync_file_enter)
+(void* args) {
+    struct uid_io_value* value = get_uid_io_value();
+    if (value) {
+        value->fsync++;
+    }
+    return 0;
+}
+
+DEFINE_BPF_PROG("tracepoint/ext4/ext4_sync_file_enter", AID_ROOT, AID_SYSTEM,
+                tp_ext4_sync_file_enter)
+(void* args) {
+    struct uid_io_value* value = get_uid_io_value();
+    if (value) {
+        value->fsync++;
+    }
+    return 0;
+}
+
+LICENSE("GPL");
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_BPF_CARWATCHDOG_UID_IO_STATS_H_
+#define WATCHDOG_SERVER_BPF_CARWATCHDOG_UID_IO_STATS_H_
+
+#include <stdint.h>
+
+// Shared between the eBPF programs in carwatchdogUidIoStats.c and carwatchdogd.
+
+#define CARWATCHDOG_UID_IO_STATS_MAP_PATH "/sys/fs/bpf/map_carwatchdogUidIoStats_uid_io_stats_map"
+#define CARWATCHDOG_UID_IO_STATS_PROG_PATH(group, event) \
+    "/sys/fs/bpf/prog_carwatchdogUidIoStats_tracepoint_" group "_" event
+
+// Maximum number of UIDs tracked by the map. I/O by UIDs beyond this limit is not accounted.
+#define CARWATCHDOG_UID_IO_STATS_MAX_UIDS 4096
+
+// Per-CPU value of the UID keyed map. Counters are cumulative since the programs were loaded.
+struct uid_io_value {
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t fsync;
+};
+
+#endif  // WATCHDOG_SERVER_BPF_CARWATCHDOG_UID_IO_STATS_H_
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AdaptiveInterval.h"
+
+#include <algorithm>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+std::chrono::nanoseconds AdaptiveInterval::next(const IoActivity& activity, nsecs_t uptime) {
+    // The first collection after a reset covers an unknown duration, so assume it covered the
+    // current interval.
+    const nsecs_t elapsed =
+            mLastUptime != 0 && uptime > mLastUptime ? uptime - mLastUptime : mInterval.count();
+    mLastUptime = uptime;
+    const double elapsedSeconds = std::max(static_cast<double>(elapsed) / s2ns(1), 1e-3);
+    const double ioWaitPercent = activity.totalCpuTime == 0
+            ? 0.0
+            : activity.cpuIoWaitTime * 100.0 / activity.totalCpuTime;
+    const double majorFaultsPerSecond = activity.majorFaults / elapsedSeconds;
+    const double writeBytesPerSecond = activity.writeBytes / elapsedSeconds;
+
+    // Returns the highest ratio of the activity to its storm threshold.
+    const double load = std::max({ioWaitPercent / kConfig.ioWaitPercentThreshold,
+                                  majorFaultsPerSecond / kConfig.majorFaultsPerSecondThreshold,
+                                  writeBytesPerSecond / kConfig.writeBytesPerSecondThreshold});
+    if (load >= 1.0) {
+        mInterval = kConfig.minInterval;
+        return mInterval;
+    }
+    const std::chrono::nanoseconds maxInterval =
+            load < kIdleThresholdFraction ? kConfig.idleInterval : kConfig.defaultInterval;
+    if (mInterval >= maxInterval) {
+        // Drop straight back to the default interval once the system is no longer idle.
+        mInterval = maxInterval;
+        return mInterval;
+    }
+    mInterval = std::min(mInterval * 2, maxInterval);
+    return mInterval;
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
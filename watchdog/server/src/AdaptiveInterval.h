@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_ADAPTIVEINTERVAL_H_
+#define WATCHDOG_SERVER_SRC_ADAPTIVEINTERVAL_H_
+
+#include <stdint.h>
+#include <utils/Timers.h>
+
+#include <chrono>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+struct AdaptiveIntervalConfig {
+    // Interval used while an I/O storm is in progress.
+    std::chrono::nanoseconds minInterval;
+    // Interval used while the system is active but below the storm thresholds.
+    std::chrono::nanoseconds defaultInterval;
+    // Longest interval to back off to while the system is idle.
+    std::chrono::nanoseconds idleInterval;
+    // Thresholds above which the system is considered to be in an I/O storm.
+    uint32_t ioWaitPercentThreshold;
+    uint64_t majorFaultsPerSecondThreshold;
+    uint64_t writeBytesPerSecondThreshold;
+};
+
+// I/O activity observed by a single collection.
+struct IoActivity {
+    uint64_t cpuIoWaitTime = 0;
+    uint64_t totalCpuTime = 0;
+    uint64_t majorFaults = 0;
+    uint64_t writeBytes = 0;
+};
+
+// Picks the interval to the next periodic collection from the I/O activity of the last
+// collection. The interval drops to |minInterval| as soon as any activity crosses its storm
+// threshold. Otherwise, the interval doubles on every collection up to |defaultInterval|, and
+// further up to |idleInterval| while all the activity stays below |kIdleThresholdFraction| of
+// the storm thresholds.
+class AdaptiveInterval {
+public:
+    explicit AdaptiveInterval(const AdaptiveIntervalConfig& config) :
+          kConfig(config), mInterval(config.defaultInterval), mLastUptime(0) {}
+
+    // Returns the interval to the collection following the collection at |uptime| that observed
+    // |activity|.
+    std::chrono::nanoseconds next(const IoActivity& activity, nsecs_t uptime);
+
+    // Restarts from |defaultInterval|. Called when the periodic collection (re)starts.
+    void reset() {
+        mInterval = kConfig.defaultInterval;
+        mLastUptime = 0;
+    }
+
+    std::chrono::nanoseconds interval() const { return mInterval; }
+
+    // Fraction of the storm thresholds below which the system is considered idle.
+    static constexpr double kIdleThresholdFraction = 0.1;
+
+private:
+    const AdaptiveIntervalConfig kConfig;
+
+    // Interval to the next collection.
+    std::chrono::nanoseconds mInterval;
+
+    // Uptime of the last collection. Used to normalize the activity to per second rates.
+    nsecs_t mLastUptime;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_ADAPTIVEINTERVAL_H_
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BootStageTracker.h"
+
+#include <android-base/properties.h>
+
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::GetProperty;
+
+namespace {
+
+// Set by init once the zygote service is started.
+constexpr const char* kZygoteStateProperty = "init.svc.zygote";
+// Set by system_server once it starts running.
+constexpr const char* kSystemServerStartProperty = "sys.system_server.start_uptime";
+// Set by vold once the system user's credential encrypted storage is unlocked.
+constexpr const char* kUserUnlockedProperty = "sys.user.0.ce_available";
+
+}  // namespace
+
+std::string toString(BootStage stage) {
+    switch (stage) {
+        case BOOT_STAGE_INIT:
+            return "init";
+        case BOOT_STAGE_ZYGOTE:
+            return "zygote";
+        case BOOT_STAGE_SYSTEM_SERVER_READY:
+            return "system_server ready";
+        case BOOT_STAGE_USER_UNLOCKED:
+            return "user unlocked";
+        default:
+            return "invalid boot stage";
+    }
+}
+
+BootStage BootStageTracker::currentStage() {
+    Mutex::Autolock lock(mMutex);
+    // Check the later stages first as the properties of the earlier stages may change after they
+    // are reached, e.g., the zygote service is restarted.
+    BootStage stage = BOOT_STAGE_INIT;
+    if (getProperty(kUserUnlockedProperty) == "true") {
+        stage = BOOT_STAGE_USER_UNLOCKED;
+    } else if (!getProperty(kSystemServerStartProperty).empty()) {
+        stage = BOOT_STAGE_SYSTEM_SERVER_READY;
+    } else if (getProperty(kZygoteStateProperty) == "running") {
+        stage = BOOT_STAGE_ZYGOTE;
+    }
+    if (stage > mStage) {
+        mStage = stage;
+    }
+    return mStage;
+}
+
+std::string BootStageTracker::getProperty(const std::string& name) {
+    return GetProperty(name, "");
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
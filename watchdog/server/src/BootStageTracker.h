@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_BOOTSTAGETRACKER_H_
+#define WATCHDOG_SERVER_SRC_BOOTSTAGETRACKER_H_
+
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Boot stages in the order they are reached.
+enum BootStage {
+    // Only init and the early native services are running.
+    BOOT_STAGE_INIT = 0,
+    // Zygote is running and starting system_server.
+    BOOT_STAGE_ZYGOTE,
+    // system_server has started and is bringing up the system services.
+    BOOT_STAGE_SYSTEM_SERVER_READY,
+    // The credential encrypted storage of the system user is unlocked.
+    BOOT_STAGE_USER_UNLOCKED,
+    BOOT_STAGES,
+};
+
+std::string toString(BootStage stage);
+
+// Tracks the boot stage from the system properties set by init and system_server during boot.
+// The stage only moves forward, so a service restart late in the boot doesn't move it back.
+class BootStageTracker : public RefBase {
+public:
+    BootStageTracker() : mStage(BOOT_STAGE_INIT) {}
+
+    virtual ~BootStageTracker() {}
+
+    // Returns the latest boot stage reached.
+    BootStage currentStage();
+
+protected:
+    // Returns the value of the system property |name|, or an empty string when it is not set.
+    // Overridden by tests.
+    virtual std::string getProperty(const std::string& name);
+
+private:
+    // Makes sure only one update is running at any given time.
+    Mutex mMutex;
+
+    BootStage mStage GUARDED_BY(mMutex);
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_BOOTSTAGETRACKER_H_
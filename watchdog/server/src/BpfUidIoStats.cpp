@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "BpfUidIoStats.h"
+
+#include <bpf/BpfUtils.h>
+#include <errno.h>
+#include <libbpf.h>
+#include <log/log.h>
+#include <sys/sysinfo.h>
+
+#include <string>
+#include <vector>
+
+#include "carwatchdog_uid_io_stats.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::sp;
+using android::base::Error;
+using android::base::ErrnoError;
+using android::base::Result;
+using android::base::unique_fd;
+using android::bpf::BpfLevel;
+using android::bpf::findMapEntry;
+using android::bpf::getBpfSupportLevel;
+using android::bpf::getFirstMapKey;
+using android::bpf::getNextMapKey;
+using android::bpf::mapRetrieveRO;
+using android::bpf::retrieveProgram;
+
+namespace {
+
+struct Tracepoint {
+    const char* group;
+    const char* event;
+    const char* programPath;
+    // The collector is unusable when a required tracepoint can't be attached. Optional
+    // tracepoints depend on the filesystems built into the kernel.
+    bool isRequired;
+};
+
+const Tracepoint kTracepoints[] = {
+        {"android_fs", "android_fs_dataread_start",
+         CARWATCHDOG_UID_IO_STATS_PROG_PATH("android_fs", "android_fs_dataread_start"), true},
+        {"android_fs", "android_fs_datawrite_start",
+         CARWATCHDOG_UID_IO_STATS_PROG_PATH("android_fs", "android_fs_datawrite_start"), true},
+        {"f2fs", "f2fs_sync_file_enter",
+         CARWATCHDOG_UID_IO_STATS_PROG_PATH("f2fs", "f2fs_sync_file_enter"), false},
+        {"ext4", "ext4_sync_file_enter",
+         CARWATCHDOG_UID_IO_STATS_PROG_PATH("ext4", "ext4_sync_file_enter"), false},
+};
+
+}  // namespace
+
+BpfUidIoStats::BpfUidIoStats(unique_fd mapFd) :
+      UidIoStats(CARWATCHDOG_UID_IO_STATS_MAP_PATH),
+      mMapFd(std::move(mapFd)),
+      kCpuCount(get_nprocs_conf()) {}
+
+Result<sp<BpfUidIoStats>> BpfUidIoStats::create() {
+    if (getBpfSupportLevel() == BpfLevel::NONE) {
+        return Error() << "eBPF is not supported by the kernel";
+    }
+    std::vector<unique_fd> tracepointFds;
+    for (const auto& tracepoint : kTracepoints) {
+        unique_fd programFd(retrieveProgram(tracepoint.programPath));
+        if (programFd.get() == -1) {
+            if (!tracepoint.isRequired) {
+                continue;
+            }
+            return ErrnoError() << "Failed to retrieve " << tracepoint.programPath;
+        }
+        unique_fd tracepointFd(
+                bpf_attach_tracepoint(programFd.get(), tracepoint.group, tracepoint.event));
+        if (tracepointFd.get() < 0) {
+            if (!tracepoint.isRequired) {
+                continue;
+            }
+            return ErrnoError() << "Failed to attach " << tracepoint.programPath << " to "
+                                << tracepoint.group << "/" << tracepoint.event;
+        }
+        tracepointFds.emplace_back(std::move(tracepointFd));
+    }
+    unique_fd mapFd(mapRetrieveRO(CARWATCHDOG_UID_IO_STATS_MAP_PATH));
+    if (mapFd.get() == -1) {
+        return ErrnoError() << "Failed to retrieve " << CARWATCHDOG_UID_IO_STATS_MAP_PATH;
+    }
+    sp<BpfUidIoStats> uidIoStats = new BpfUidIoStats(std::move(mapFd));
+    uidIoStats->mTracepointFds = std::move(tracepointFds);
+    return uidIoStats;
+}
+
+std::string BpfUidIoStats::filePath() {
+    return CARWATCHDOG_UID_IO_STATS_MAP_PATH;
+}
+
+Result<void> BpfUidIoStats::readUidIoStatsLocked(UidIoTable* table) {
+    std::vector<uid_io_value> values(kCpuCount);
+    uint32_t uid;
+    int ret = getFirstMapKey(mMapFd.get(), &uid);
+    while (ret == 0) {
+        // Skip the per-CPU lookup for the UIDs excluded by the app ID filter.
+        const bool isFilteredOut = isFilteredOutLocked(uid);
+        if (!isFilteredOut && findMapEntry(mMapFd.get(), &uid, values.data()) == 0) {
+            IoUsage usage;
+            for (const auto& value : values) {
+                usage.metrics[READ_BYTES][FOREGROUND] += value.read_bytes;
+                usage.metrics[WRITE_BYTES][FOREGROUND] += value.write_bytes;
+                usage.metrics[FSYNC_COUNT][FOREGROUND] += value.fsync;
+            }
+            table->append(uid, usage);
+        } else if (!isFilteredOut && errno != ENOENT) {
+            // ENOENT means the UID was removed since the key was read.
+            return ErrnoError() << "Failed to read the entry for UID " << uid;
+        }
+        uint32_t nextUid;
+        ret = getNextMapKey(mMapFd.get(), &uid, &nextUid);
+        uid = nextUid;
+    }
+    if (errno != ENOENT) {
+        return ErrnoError() << "Failed to iterate " << CARWATCHDOG_UID_IO_STATS_MAP_PATH;
+    }
+    return {};
+}
+
+sp<UidIoStats> createUidIoStats() {
+    const auto& bpfUidIoStats = BpfUidIoStats::create();
+    if (bpfUidIoStats.ok()) {
+        ALOGI("Collecting per-UID I/O usage from eBPF map %s", CARWATCHDOG_UID_IO_STATS_MAP_PATH);
+        return *bpfUidIoStats;
+    }
+    ALOGI("Falling back to %s: %s", kUidIoStatsPath, bpfUidIoStats.error().message().c_str());
+    return new UidIoStats();
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_BPFUIDIOSTATS_H_
+#define WATCHDOG_SERVER_SRC_BPFUIDIOSTATS_H_
+
+#include <android-base/result.h>
+#include <android-base/unique_fd.h>
+#include <stdint.h>
+#include <utils/StrongPointer.h>
+
+#include <string>
+#include <vector>
+
+#include "UidIoStats.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Collects the per-UID I/O usage from the eBPF map maintained by the carwatchdogUidIoStats.o
+// programs instead of parsing `/proc/uid_io/stats`. The programs account every storage read,
+// write, and fsync as it happens, and the map is read with a handful of syscalls per UID.
+//
+// The programs can't tell whether a UID is in the foreground or background, so all usage is
+// reported under |FOREGROUND|.
+class BpfUidIoStats : public UidIoStats {
+public:
+    // Reads the usage from the given per-CPU hash map. Exposed for testing.
+    explicit BpfUidIoStats(android::base::unique_fd mapFd);
+
+    // Attaches the pinned programs to their tracepoints and opens the pinned map. Returns an
+    // error when the kernel doesn't support eBPF or the programs are not loaded.
+    static android::base::Result<android::sp<BpfUidIoStats>> create();
+
+    bool enabled() override { return mMapFd.get() != -1; }
+
+    std::string filePath() override;
+
+protected:
+    // Sums the per-CPU counters for each UID in the map.
+    android::base::Result<void> readUidIoStatsLocked(UidIoTable* table) override;
+
+private:
+    // Pinned map with the cumulative usage since the programs were loaded.
+    const android::base::unique_fd mMapFd;
+
+    // Number of possible CPUs, which is the number of values per key in the per-CPU map.
+    const size_t kCpuCount;
+
+    // Perf event fds that keep the programs attached for the lifetime of the collector.
+    std::vector<android::base::unique_fd> mTracepointFds;
+};
+
+// Returns the eBPF backed collector when it is supported. Otherwise, returns the collector that
+// reads `/proc/uid_io/stats`.
+android::sp<UidIoStats> createUidIoStats();
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_BPFUIDIOSTATS_H_
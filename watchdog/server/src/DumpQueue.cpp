@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "DumpQueue.h"
+
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+#include <log/log.h>
+
+#include <algorithm>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringAppendF;
+
+DumpQueue::DumpQueue(DumpHandler handler, size_t capacity,
+                     std::chrono::nanoseconds coalesceWindow) :
+      mHandler(std::move(handler)),
+      mCapacity(capacity),
+      mCoalesceWindow(coalesceWindow),
+      mTerminated(false),
+      mNumQueued(0),
+      mNumCoalesced(0),
+      mNumDropped(0),
+      mNumFailed(0) {
+    mThread = std::thread(&DumpQueue::run, this);
+}
+
+DumpQueue::~DumpQueue() {
+    terminate();
+}
+
+bool DumpQueue::enqueue(int32_t pid, std::function<void()> prepare) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTerminated) {
+            return false;
+        }
+        if (mPendingPids.count(pid) > 0) {
+            ++mNumCoalesced;
+            return true;
+        }
+        if (mRequests.size() >= mCapacity) {
+            ++mNumDropped;
+            ALOGW("Dropping the dump and kill request for process(pid: %d): The queue is full",
+                  pid);
+            return false;
+        }
+        mPendingPids.insert(pid);
+        mRequests.push_back(Request{pid, now(), std::move(prepare)});
+        ++mNumQueued;
+    }
+    mCondition.notify_one();
+    return true;
+}
+
+void DumpQueue::onDumpFinished(int32_t pid) {
+    const nsecs_t uptime = now();
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mDumpedPids.find(pid);
+    if (it == mDumpedPids.end()) {
+        return;
+    }
+    mKillLatency.record(uptime - it->second);
+    mDumpedPids.erase(it);
+}
+
+std::string DumpQueue::dump(const char* indent) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::string buffer;
+    StringAppendF(&buffer,
+                  "%sPending: %zu, queued: %" PRIu64 ", coalesced: %" PRIu64 ", dropped: %" PRIu64
+                  ", failed: %" PRIu64 "\n",
+                  indent, mPendingPids.size(), mNumQueued, mNumCoalesced, mNumDropped,
+                  mNumFailed);
+    StringAppendF(&buffer, "%sDump latency: %s\n", indent, mDumpLatency.toString().c_str());
+    StringAppendF(&buffer, "%sKill latency: %s\n", indent, mKillLatency.toString().c_str());
+    return buffer;
+}
+
+void DumpQueue::terminate() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTerminated) {
+            return;
+        }
+        mTerminated = true;
+        mRequests.clear();
+        mPendingPids.clear();
+    }
+    mCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void DumpQueue::run() {
+    while (true) {
+        std::vector<Request> requests;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [&]() { return mTerminated || !mRequests.empty(); });
+            if (mTerminated) {
+                return;
+            }
+            // Let the pids from the other timeout classes, which expire around the same time,
+            // join this request.
+            if (mCoalesceWindow.count() > 0 &&
+                mCondition.wait_for(lock, mCoalesceWindow, [&]() { return mTerminated; })) {
+                return;
+            }
+            requests.assign(std::make_move_iterator(mRequests.begin()),
+                            std::make_move_iterator(mRequests.end()));
+            mRequests.clear();
+        }
+        std::vector<int32_t> pids;
+        for (auto& request : requests) {
+            if (request.prepare != nullptr) {
+                request.prepare();
+            }
+            pids.push_back(request.pid);
+        }
+        const auto result = mHandler(pids);
+        if (!result.ok()) {
+            ALOGW("Failed to dump and kill processes: %s", result.error().message().c_str());
+        }
+        const nsecs_t uptime = now();
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& request : requests) {
+            mPendingPids.erase(request.pid);
+            mDumpLatency.record(uptime - request.queuedUptime);
+            if (!result.ok()) {
+                ++mNumFailed;
+                continue;
+            }
+            if (mDumpedPids.size() >= mCapacity) {
+                // The monitor didn't report the oldest pid. Stop tracking it.
+                mDumpedPids.erase(std::min_element(mDumpedPids.begin(), mDumpedPids.end(),
+                                                   [](const auto& lhs, const auto& rhs) {
+                                                       return lhs.second < rhs.second;
+                                                   }));
+            }
+            mDumpedPids[request.pid] = request.queuedUptime;
+        }
+    }
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
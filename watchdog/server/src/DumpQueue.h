@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_DUMPQUEUE_H_
+#define WATCHDOG_SERVER_SRC_DUMPQUEUE_H_
+
+#include <android-base/result.h>
+#include <android-base/thread_annotations.h>
+#include <stdint.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "PingDispatcher.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Hands the non-responding processes to the monitor on a worker thread, so the health check
+// doesn't wait for the monitor to dump them. The pids queued within |coalesceWindow| of the
+// first pending pid, including the pids from different timeout classes, are handed over in a
+// single call. A pid that is already pending is coalesced into the pending request and the
+// queue drops new pids once |capacity| pids are pending.
+//
+// The dump latency is measured from the time a pid is queued to the time the handler returns,
+// and the kill latency to the time the monitor reports that the process was dumped and killed.
+class DumpQueue : public RefBase {
+public:
+    using DumpHandler = std::function<base::Result<void>(const std::vector<int32_t>& pids)>;
+
+    explicit DumpQueue(DumpHandler handler, size_t capacity = kDefaultCapacity,
+                       std::chrono::nanoseconds coalesceWindow = kDefaultCoalesceWindow);
+    ~DumpQueue();
+
+    // Queues |pid| to be dumped and killed. |prepare|, when set, runs on the worker thread before
+    // the pid is handed to the handler. Returns false when the pid is dropped because the queue
+    // is full or terminated. Returns true when the pid is queued or already pending.
+    bool enqueue(int32_t pid, std::function<void()> prepare = nullptr);
+
+    // Records the kill latency of |pid| when it was handed to the handler by this queue.
+    void onDumpFinished(int32_t pid);
+
+    // Returns the queue counters and the latency histograms, one per line prefixed by |indent|.
+    std::string dump(const char* indent);
+
+    // Stops the worker thread after it finishes the handler call in progress. The pending pids
+    // are dropped.
+    void terminate();
+
+    static constexpr size_t kDefaultCapacity = 32;
+    static constexpr std::chrono::milliseconds kDefaultCoalesceWindow =
+            std::chrono::milliseconds(50);
+
+protected:
+    // Returns the current uptime. Overridden by tests.
+    virtual nsecs_t now() { return systemTime(SYSTEM_TIME_MONOTONIC); }
+
+private:
+    struct Request {
+        int32_t pid = -1;
+        nsecs_t queuedUptime = 0;
+        std::function<void()> prepare;
+    };
+
+    void run();
+
+    const DumpHandler mHandler;
+    const size_t mCapacity;
+    const std::chrono::nanoseconds mCoalesceWindow;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mTerminated GUARDED_BY(mMutex);
+    std::deque<Request> mRequests GUARDED_BY(mMutex);
+    // Pids that are queued or being handed to the handler.
+    std::unordered_set<int32_t> mPendingPids GUARDED_BY(mMutex);
+    // Uptime when the pids that were handed to the handler were queued. Holds at most
+    // |mCapacity| pids that the monitor hasn't reported yet.
+    std::unordered_map<int32_t, nsecs_t> mDumpedPids GUARDED_BY(mMutex);
+    uint64_t mNumQueued GUARDED_BY(mMutex);
+    uint64_t mNumCoalesced GUARDED_BY(mMutex);
+    uint64_t mNumDropped GUARDED_BY(mMutex);
+    uint64_t mNumFailed GUARDED_BY(mMutex);
+    LatencyHistogram mDumpLatency GUARDED_BY(mMutex);
+    LatencyHistogram mKillLatency GUARDED_BY(mMutex);
+    std::thread mThread;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_DUMPQUEUE_H_
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "carwatchdogd"
+
+#include "DumpWriter.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringAppendV;
+using android::base::WriteFully;
+
+void DumpWriter::append(std::string_view value) {
+    if (mOut != nullptr) {
+        mOut->append(value);
+        return;
+    }
+    if (value.size() > mBuffer.size() - mSize) {
+        flush();
+        if (value.size() > mBuffer.size()) {
+            writeToFd(value.data(), value.size());
+            return;
+        }
+    }
+    memcpy(mBuffer.data() + mSize, value.data(), value.size());
+    mSize += value.size();
+}
+
+void DumpWriter::appendF(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    appendV(format, args);
+    va_end(args);
+}
+
+void DumpWriter::appendV(const char* format, va_list args) {
+    if (mOut != nullptr) {
+        StringAppendV(mOut, format, args);
+        return;
+    }
+    va_list retryArgs;
+    va_copy(retryArgs, args);
+    // vsnprintf needs room for the terminating null, which is overwritten by the next append.
+    const size_t available = mBuffer.size() - mSize;
+    int length = vsnprintf(mBuffer.data() + mSize, available, format, args);
+    if (length < 0) {
+        va_end(retryArgs);
+        return;
+    }
+    if (static_cast<size_t>(length) < available) {
+        mSize += static_cast<size_t>(length);
+        va_end(retryArgs);
+        return;
+    }
+    flush();
+    if (static_cast<size_t>(length) < mBuffer.size()) {
+        vsnprintf(mBuffer.data(), mBuffer.size(), format, retryArgs);
+        mSize = static_cast<size_t>(length);
+    } else {
+        // Longer than the buffer. Only happens with unusually long package names or commands.
+        std::string line;
+        StringAppendV(&line, format, retryArgs);
+        writeToFd(line.data(), line.size());
+    }
+    va_end(retryArgs);
+}
+
+bool DumpWriter::flush() {
+    if (mSize > 0) {
+        writeToFd(mBuffer.data(), mSize);
+        mSize = 0;
+    }
+    return !mFailed;
+}
+
+void DumpWriter::writeToFd(const char* data, size_t size) {
+    if (!mFailed && !WriteFully(mFd, data, size)) {
+        mFailed = true;
+    }
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
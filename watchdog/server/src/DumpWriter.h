@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef WATCHDOG_SERVER_SRC_DUMPWRITER_H_
+#define WATCHDOG_SERVER_SRC_DUMPWRITER_H_
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <array>
+#include <string>
+#include <string_view>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Size of the buffer a fd backed DumpWriter formats into before writing to the fd.
+constexpr size_t kDumpWriterBufferSize = 4096;
+
+// Formats dump output into a fixed-size buffer that is written to a fd whenever it fills up, so
+// the memory used by a dump doesn't grow with the amount of data dumped. A DumpWriter constructed
+// with a string appends to the string instead, which lets the same formatting code back the
+// toString functions.
+class DumpWriter {
+public:
+    explicit DumpWriter(int fd) : mFd(fd), mOut(nullptr), mSize(0), mFailed(false) {}
+    explicit DumpWriter(std::string* out) : mFd(-1), mOut(out), mSize(0), mFailed(false) {}
+
+    ~DumpWriter() { flush(); }
+
+    DumpWriter(const DumpWriter&) = delete;
+    DumpWriter& operator=(const DumpWriter&) = delete;
+
+    void append(std::string_view value);
+    void appendF(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    // Writes the buffered output to the fd. Returns false when any write so far has failed, after
+    // which the rest of the output is dropped.
+    bool flush();
+
+private:
+    void appendV(const char* format, va_list args);
+    void writeToFd(const char* data, size_t size);
+
+    int mFd;
+    std::string* mOut;
+    std::array<char, kDumpWriterBufferSize> mBuffer;
+    size_t mSize;
+    bool mFailed;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_DUMPWRITER_H_
@@ -23,15 +23,13 @@
 #include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
-#include <binder/IServiceManager.h>
-#include <cutils/android_filesystem_config.h>
 #include <inttypes.h>
 #include <log/log.h>
 #include <processgroup/sched_policy.h>
 #include <pthread.h>
-#include <pwd.h>
 
 #include <algorithm>
+#include <future>
 #include <iomanip>
 #include <iterator>
 #include <limits>
@@ -41,23 +39,22 @@
 #include <unordered_set>
 #include <vector>
 
+#include "TopN.h"
+
 namespace android {
 namespace automotive {
 namespace watchdog {
 
-using android::defaultServiceManager;
-using android::IBinder;
-using android::IServiceManager;
 using android::sp;
 using android::String16;
 using android::base::Error;
 using android::base::ParseUint;
 using android::base::Result;
+using android::base::EndsWith;
 using android::base::Split;
 using android::base::StringAppendF;
 using android::base::StringPrintf;
 using android::base::WriteStringToFd;
-using android::content::pm::IPackageManagerNative;
 
 namespace {
 
@@ -70,6 +67,30 @@ const int32_t kDefaultPeriodicCollectionBufferSize = 180;
 
 // Minimum collection interval between subsequent collections.
 const std::chrono::nanoseconds kMinCollectionInterval = 1s;
+// Minimum custom collection interval when the collectors are restricted to the filtered packages.
+const std::chrono::nanoseconds kMinFilteredCollectionInterval = 100ms;
+
+// Periodic collection interval and duration of the collection burst after a pressure stall.
+const std::chrono::nanoseconds kPressureBurstCollectionInterval = 1s;
+const std::chrono::nanoseconds kPressureBurstDuration = 10s;
+
+// Default thresholds above which the adaptive periodic collection switches to
+// |kMinCollectionInterval|.
+const int32_t kDefaultAdaptiveIoWaitThresholdPercent = 5;
+const int32_t kDefaultAdaptiveMajorFaultsThreshold = 1000;
+// In KiB per second.
+const int32_t kDefaultAdaptiveWriteBytesThreshold = 10240;
+
+// Percent of the collection interval the memory PSI "some" stall must cross to put the memory
+// budget under pressure. The memory PSI trigger puts the budget under pressure too.
+const uint64_t kMemoryPressureStallPercent = 5;
+
+// Stalls that start a burst of periodic collections. Short stalls are averaged out over the
+// regular periodic collection interval, so the triggers use windows of 1 second.
+const std::vector<PressureTrigger> kPressureTriggers = {
+        {PRESSURE_IO, PRESSURE_SOME, /*threshold=*/100ms, /*window=*/1s},
+        {PRESSURE_MEMORY, PRESSURE_SOME, /*threshold=*/100ms, /*window=*/1s},
+};
 
 // Default values for the custom collection interval and max_duration.
 const std::chrono::nanoseconds kCustomCollectionInterval = 10s;
@@ -82,34 +103,46 @@ constexpr const char* kHelpText =
         "%s: Starts custom I/O performance data collection. Customize the collection behavior with "
         "the following optional arguments:\n"
         "\t%s <seconds>: Modifies the collection interval. Default behavior is to collect once "
-        "every %lld seconds.\n"
+        "every %lld seconds. Append 'ms' to the value to provide the interval in milliseconds.\n"
         "\t%s <seconds>: Modifies the maximum collection duration. Default behavior is to collect "
         "until %ld minutes before automatically stopping the custom collection and discarding "
         "the collected data.\n"
         "\t%s <package name>,<package, name>,...: Comma-separated value containing package names. "
         "When provided, the results are filtered only to the provided package names. Default "
-        "behavior is to list the results for the top %d packages.\n"
+        "behavior is to list the results for the top %d packages. The UIDs of the known packages "
+        "are resolved at the start, and only their stats are collected, so the collection "
+        "interval can be as low as %lld milliseconds and the totals cover only these packages.\n"
         "%s: Stops custom I/O performance data collection and generates a dump of "
-        "the collection report.\n\n"
+        "the collection report.\n"
+        "%s: Writes the binary history of the boot-time and periodic collections. Decode the "
+        "output with tools/ioanalyze/ioperf_history.py.\n"
+        "%s: Writes the boot-time collection as a JSON trace with the per-UID I/O over time and "
+        "the boot stages. Open the output in the Perfetto UI.\n\n"
         "When no options are specified, the carwatchdog report contains the I/O performance "
         "data collected during boot-time and over the last %ld minutes before the report "
-        "generation.";
+        "generation, followed by per-minute and per-10-minute rollups of the periodic "
+        "collection.";
 
 double percentage(uint64_t numer, uint64_t denom) {
     return denom == 0 ? 0.0 : (static_cast<double>(numer) / static_cast<double>(denom)) * 100.0;
 }
 
 struct UidProcessStats {
-    struct ProcessInfo {
-        std::string comm = "";
-        uint64_t count = 0;
-    };
+    UidProcessStats(uint64_t uid, size_t topNStatsPerSubcategory) :
+          uid(uid),
+          topNIoBlockedProcesses(topNStatsPerSubcategory),
+          topNMajorFaultProcesses(topNStatsPerSubcategory),
+          topNCpuTimeProcesses(topNStatsPerSubcategory) {}
+
     uint64_t uid = 0;
     uint32_t ioBlockedTasksCnt = 0;
     uint32_t totalTasksCnt = 0;
     uint64_t majorFaults = 0;
-    std::vector<ProcessInfo> topNIoBlockedProcesses = {};
-    std::vector<ProcessInfo> topNMajorFaultProcesses = {};
+    uint64_t cpuTime = 0;
+    // Process commands point to the |ProcessStats| the UID stats are built from.
+    TopN<const std::string*> topNIoBlockedProcesses;
+    TopN<const std::string*> topNMajorFaultProcesses;
+    TopN<const std::string*> topNCpuTimeProcesses;
 };
 
 std::unique_ptr<std::unordered_map<uint32_t, UidProcessStats>> getUidProcessStats(
@@ -121,21 +154,13 @@ std::unique_ptr<std::unordered_map<uint32_t, UidProcessStats>> getUidProcessStat
             continue;
         }
         uint32_t uid = static_cast<uint32_t>(stats.uid);
-        if (uidProcessStats->find(uid) == uidProcessStats->end()) {
-            (*uidProcessStats)[uid] = UidProcessStats{
-                    .uid = uid,
-                    .topNIoBlockedProcesses = std::vector<
-                            UidProcessStats::ProcessInfo>(topNStatsPerSubCategory,
-                                                          UidProcessStats::ProcessInfo{}),
-                    .topNMajorFaultProcesses = std::vector<
-                            UidProcessStats::ProcessInfo>(topNStatsPerSubCategory,
-                                                          UidProcessStats::ProcessInfo{}),
-            };
-        }
-        auto& curUidProcessStats = (*uidProcessStats)[uid];
+        auto& curUidProcessStats =
+                uidProcessStats->try_emplace(uid, uid, topNStatsPerSubCategory).first->second;
         // Top-level process stats has the aggregated major page faults count and this should be
         // persistent across thread creation/termination. Thus use the value from this field.
         curUidProcessStats.majorFaults += stats.process.majorFaults;
+        // Likewise, the top-level CPU time includes the time of the terminated threads.
+        curUidProcessStats.cpuTime += stats.process.cpuTime;
         curUidProcessStats.totalTasksCnt += stats.threads.size();
         // The process state is the same as the main thread state. Thus to avoid double counting
         // ignore the process state.
@@ -144,167 +169,387 @@ std::unique_ptr<std::unordered_map<uint32_t, UidProcessStats>> getUidProcessStat
             ioBlockedTasksCnt += threadStat.second.state == "D" ? 1 : 0;
         }
         curUidProcessStats.ioBlockedTasksCnt += ioBlockedTasksCnt;
-        for (auto it = curUidProcessStats.topNIoBlockedProcesses.begin();
-             it != curUidProcessStats.topNIoBlockedProcesses.end(); ++it) {
-            if (it->count < ioBlockedTasksCnt) {
-                curUidProcessStats.topNIoBlockedProcesses
-                        .emplace(it,
-                                 UidProcessStats::ProcessInfo{
-                                         .comm = stats.process.comm,
-                                         .count = ioBlockedTasksCnt,
-                                 });
-                curUidProcessStats.topNIoBlockedProcesses.pop_back();
-                break;
-            }
-        }
-        for (auto it = curUidProcessStats.topNMajorFaultProcesses.begin();
-             it != curUidProcessStats.topNMajorFaultProcesses.end(); ++it) {
-            if (it->count < stats.process.majorFaults) {
-                curUidProcessStats.topNMajorFaultProcesses
-                        .emplace(it,
-                                 UidProcessStats::ProcessInfo{
-                                         .comm = stats.process.comm,
-                                         .count = stats.process.majorFaults,
-                                 });
-                curUidProcessStats.topNMajorFaultProcesses.pop_back();
-                break;
-            }
-        }
+        curUidProcessStats.topNIoBlockedProcesses.push(ioBlockedTasksCnt, &stats.process.comm);
+        curUidProcessStats.topNMajorFaultProcesses.push(stats.process.majorFaults,
+                                                        &stats.process.comm);
+        curUidProcessStats.topNCpuTimeProcesses.push(stats.process.cpuTime, &stats.process.comm);
     }
     return uidProcessStats;
 }
 
-Result<std::chrono::seconds> parseSecondsFlag(Vector<String16> args, size_t pos) {
+// Clears |vector| and releases its capacity.
+template <typename T>
+void releaseVector(std::vector<T>* vector) {
+    std::vector<T>().swap(*vector);
+}
+
+// Drops the details of |record| that |level| doesn't allow for and releases their memory.
+void trimRecord(MemoryBudgetLevel level, IoPerfRecord* record) {
+    if (level == MemoryBudgetLevel::FULL_RECORDS) {
+        return;
+    }
+    ProcessIoPerfData& processIoPerfData = record->processIoPerfData;
+    TaskIoPerfData& taskIoPerfData = record->taskIoPerfData;
+    if (level == MemoryBudgetLevel::COUNTERS_ONLY) {
+        releaseVector(&record->uidIoPerfData.topNReads);
+        releaseVector(&record->uidIoPerfData.topNWrites);
+        releaseVector(&processIoPerfData.topNIoBlockedUids);
+        releaseVector(&processIoPerfData.topNIoBlockedUidsTotalTaskCnt);
+        releaseVector(&processIoPerfData.topNMajorFaultUids);
+        releaseVector(&processIoPerfData.topNCpuTimeUids);
+        releaseVector(&taskIoPerfData.topNWriteProcesses);
+        return;
+    }
+    for (auto* topN : {&processIoPerfData.topNIoBlockedUids, &processIoPerfData.topNMajorFaultUids,
+                       &processIoPerfData.topNCpuTimeUids}) {
+        for (auto& uidStats : *topN) {
+            releaseVector(&uidStats.topNProcesses);
+        }
+    }
+    for (auto& processStats : taskIoPerfData.topNWriteProcesses) {
+        releaseVector(&processStats.topNWriteThreads);
+    }
+}
+
+// Clears |record| for reuse without releasing the capacity of its top N vectors.
+void clearRecord(IoPerfRecord* record) {
+    UidIoPerfData& uidIoPerfData = record->uidIoPerfData;
+    uidIoPerfData.topNReads.clear();
+    uidIoPerfData.topNWrites.clear();
+    std::fill(&uidIoPerfData.total[0][0], &uidIoPerfData.total[0][0] + METRIC_TYPES * UID_STATES,
+              0);
+    record->systemIoPerfData = {};
+    record->pressurePerfData = {};
+    ProcessIoPerfData& processIoPerfData = record->processIoPerfData;
+    processIoPerfData.topNIoBlockedUids.clear();
+    processIoPerfData.topNIoBlockedUidsTotalTaskCnt.clear();
+    processIoPerfData.topNMajorFaultUids.clear();
+    processIoPerfData.totalMajorFaults = 0;
+    processIoPerfData.majorFaultsPercentChange = 0.0;
+    processIoPerfData.topNCpuTimeUids.clear();
+    processIoPerfData.totalCpuTime = 0;
+    record->taskIoPerfData.topNWriteProcesses.clear();
+}
+
+Result<std::chrono::nanoseconds> parseDurationFlag(Vector<String16> args, size_t pos) {
     if (args.size() < pos) {
         return Error() << "Value not provided";
     }
 
     uint64_t value;
     std::string strValue = std::string(String8(args[pos]).string());
+    const bool isMillis = EndsWith(strValue, "ms");
+    if (isMillis) {
+        strValue.resize(strValue.size() - 2);
+    }
     if (!ParseUint(strValue, &value)) {
-        return Error() << "Invalid value " << args[pos].string() << ", must be an integer";
+        return Error() << "Invalid value " << args[pos].string()
+                       << ", must be an integer optionally followed by 'ms'";
+    }
+    if (isMillis) {
+        return std::chrono::milliseconds(value);
     }
     return std::chrono::seconds(value);
 }
 
-}  // namespace
+// Returns true when the stats of |uid| with |packageName| must be dropped from the output of a
+// collection filtered to |collectionInfo.filterPackages|.
+bool isFilteredOut(const CollectionInfo& collectionInfo, uint32_t uid,
+                   const std::string& packageName) {
+    if (collectionInfo.filterPackages.empty()) {
+        return false;
+    }
+    if (!collectionInfo.filterAppIds.empty()) {
+        // Match by app ID as the package manager reports the shared user name for the packages
+        // sharing a UID.
+        return collectionInfo.filterAppIds.find(multiuser_get_app_id(uid)) ==
+                collectionInfo.filterAppIds.end();
+    }
+    return collectionInfo.filterPackages.find(packageName) == collectionInfo.filterPackages.end();
+}
 
-std::string toString(const UidIoPerfData& data) {
-    std::string buffer;
+std::string escapeJsonString(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (const char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            StringAppendF(&escaped, "\\u%04x", c);
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void writeTo(const UidIoPerfData& data, DumpWriter* writer) {
     if (data.topNReads.size() > 0) {
-        StringAppendF(&buffer, "\nTop N Reads:\n%s\n", std::string(12, '-').c_str());
-        StringAppendF(&buffer,
-                      "Android User ID, Package Name, Foreground Bytes, Foreground Bytes %%, "
-                      "Foreground Fsync, Foreground Fsync %%, Background Bytes, "
-                      "Background Bytes %%, Background Fsync, Background Fsync %%\n");
+        writer->appendF("\nTop N Reads:\n%s\n", std::string(12, '-').c_str());
+        writer->appendF("Android User ID, Package Name, Foreground Bytes, Foreground Bytes %%, "
+                        "Foreground Fsync, Foreground Fsync %%, Background Bytes, "
+                        "Background Bytes %%, Background Fsync, Background Fsync %%\n");
     }
     for (const auto& stat : data.topNReads) {
-        StringAppendF(&buffer, "%" PRIu32 ", %s", stat.userId, stat.packageName.c_str());
+        writer->appendF("%" PRIu32 ", %s", stat.userId, stat.packageName.c_str());
         for (int i = 0; i < UID_STATES; ++i) {
-            StringAppendF(&buffer, ", %" PRIu64 ", %.2f%%, %" PRIu64 ", %.2f%%", stat.bytes[i],
-                          percentage(stat.bytes[i], data.total[READ_BYTES][i]), stat.fsync[i],
-                          percentage(stat.fsync[i], data.total[FSYNC_COUNT][i]));
+            writer->appendF(", %" PRIu64 ", %.2f%%, %" PRIu64 ", %.2f%%", stat.bytes[i],
+                            percentage(stat.bytes[i], data.total[READ_BYTES][i]), stat.fsync[i],
+                            percentage(stat.fsync[i], data.total[FSYNC_COUNT][i]));
         }
-        StringAppendF(&buffer, "\n");
+        writer->append("\n");
     }
     if (data.topNWrites.size() > 0) {
-        StringAppendF(&buffer, "\nTop N Writes:\n%s\n", std::string(13, '-').c_str());
-        StringAppendF(&buffer,
-                      "Android User ID, Package Name, Foreground Bytes, Foreground Bytes %%, "
-                      "Foreground Fsync, Foreground Fsync %%, Background Bytes, "
-                      "Background Bytes %%, Background Fsync, Background Fsync %%\n");
+        writer->appendF("\nTop N Writes:\n%s\n", std::string(13, '-').c_str());
+        writer->appendF("Android User ID, Package Name, Foreground Bytes, Foreground Bytes %%, "
+                        "Foreground Fsync, Foreground Fsync %%, Background Bytes, "
+                        "Background Bytes %%, Background Fsync, Background Fsync %%\n");
     }
     for (const auto& stat : data.topNWrites) {
-        StringAppendF(&buffer, "%" PRIu32 ", %s", stat.userId, stat.packageName.c_str());
+        writer->appendF("%" PRIu32 ", %s", stat.userId, stat.packageName.c_str());
         for (int i = 0; i < UID_STATES; ++i) {
-            StringAppendF(&buffer, ", %" PRIu64 ", %.2f%%, %" PRIu64 ", %.2f%%", stat.bytes[i],
-                          percentage(stat.bytes[i], data.total[WRITE_BYTES][i]), stat.fsync[i],
-                          percentage(stat.fsync[i], data.total[FSYNC_COUNT][i]));
+            writer->appendF(", %" PRIu64 ", %.2f%%, %" PRIu64 ", %.2f%%", stat.bytes[i],
+                            percentage(stat.bytes[i], data.total[WRITE_BYTES][i]), stat.fsync[i],
+                            percentage(stat.fsync[i], data.total[FSYNC_COUNT][i]));
         }
-        StringAppendF(&buffer, "\n");
+        writer->append("\n");
     }
-    return buffer;
 }
 
-std::string toString(const SystemIoPerfData& data) {
-    std::string buffer;
-    StringAppendF(&buffer, "CPU I/O wait time/percent: %" PRIu64 " / %.2f%%\n", data.cpuIoWaitTime,
-                  percentage(data.cpuIoWaitTime, data.totalCpuTime));
-    StringAppendF(&buffer, "Number of I/O blocked processes/percent: %" PRIu32 " / %.2f%%\n",
-                  data.ioBlockedProcessesCnt,
-                  percentage(data.ioBlockedProcessesCnt, data.totalProcessesCnt));
-    return buffer;
+void writeTo(const SystemIoPerfData& data, DumpWriter* writer) {
+    writer->appendF("CPU I/O wait time/percent: %" PRIu64 " / %.2f%%\n", data.cpuIoWaitTime,
+                    percentage(data.cpuIoWaitTime, data.totalCpuTime));
+    writer->appendF("Number of I/O blocked processes/percent: %" PRIu32 " / %.2f%%\n",
+                    data.ioBlockedProcessesCnt,
+                    percentage(data.ioBlockedProcessesCnt, data.totalProcessesCnt));
 }
 
-std::string toString(const ProcessIoPerfData& data) {
-    std::string buffer;
-    StringAppendF(&buffer, "Number of major page faults since last collection: %" PRIu64 "\n",
-                  data.totalMajorFaults);
-    StringAppendF(&buffer,
-                  "Percentage of change in major page faults since last collection: %.2f%%\n",
-                  data.majorFaultsPercentChange);
+void writeTo(const PressurePerfData& data, DumpWriter* writer) {
+    writer->appendF("Pressure stall time since last collection (some / full):\n");
+    for (int i = 0; i < PRESSURE_RESOURCES; ++i) {
+        writer->appendF("\t%s: %" PRIu64 " / %" PRIu64 " us\n",
+                        toString(static_cast<PressureResource>(i)).c_str(),
+                        data.stallTime[i][PRESSURE_SOME], data.stallTime[i][PRESSURE_FULL]);
+    }
+}
+
+void writeTo(const ProcessIoPerfData& data, DumpWriter* writer) {
+    writer->appendF("Number of major page faults since last collection: %" PRIu64 "\n",
+                    data.totalMajorFaults);
+    writer->appendF("Percentage of change in major page faults since last collection: %.2f%%\n",
+                    data.majorFaultsPercentChange);
+    writer->appendF("CPU time in clock ticks since last collection: %" PRIu64 "\n",
+                    data.totalCpuTime);
     if (data.topNMajorFaultUids.size() > 0) {
-        StringAppendF(&buffer, "\nTop N major page faults:\n%s\n", std::string(24, '-').c_str());
-        StringAppendF(&buffer,
-                      "Android User ID, Package Name, Number of major page faults, "
-                      "Percentage of total major page faults\n");
-        StringAppendF(&buffer,
-                      "\tCommand, Number of major page faults, Percentage of UID's major page "
-                      "faults\n");
+        writer->appendF("\nTop N major page faults:\n%s\n", std::string(24, '-').c_str());
+        writer->appendF("Android User ID, Package Name, Number of major page faults, "
+                        "Percentage of total major page faults\n");
+        writer->appendF("\tCommand, Number of major page faults, Percentage of UID's major page "
+                        "faults\n");
     }
     for (const auto& uidStats : data.topNMajorFaultUids) {
-        StringAppendF(&buffer, "%" PRIu32 ", %s, %" PRIu64 ", %.2f%%\n", uidStats.userId,
-                      uidStats.packageName.c_str(), uidStats.count,
-                      percentage(uidStats.count, data.totalMajorFaults));
+        writer->appendF("%" PRIu32 ", %s, %" PRIu64 ", %.2f%%\n", uidStats.userId,
+                        uidStats.packageName.c_str(), uidStats.count,
+                        percentage(uidStats.count, data.totalMajorFaults));
         for (const auto& procStats : uidStats.topNProcesses) {
-            StringAppendF(&buffer, "\t%s, %" PRIu64 ", %.2f%%\n", procStats.comm.c_str(),
-                          procStats.count, percentage(procStats.count, uidStats.count));
+            writer->appendF("\t%s, %" PRIu64 ", %.2f%%\n", procStats.comm.c_str(),
+                            procStats.count, percentage(procStats.count, uidStats.count));
         }
     }
     if (data.topNIoBlockedUids.size() > 0) {
-        StringAppendF(&buffer, "\nTop N I/O waiting UIDs:\n%s\n", std::string(23, '-').c_str());
-        StringAppendF(&buffer,
-                      "Android User ID, Package Name, Number of owned tasks waiting for I/O, "
-                      "Percentage of owned tasks waiting for I/O\n");
-        StringAppendF(&buffer,
-                      "\tCommand, Number of I/O waiting tasks, Percentage of UID's tasks waiting "
-                      "for I/O\n");
+        writer->appendF("\nTop N I/O waiting UIDs:\n%s\n", std::string(23, '-').c_str());
+        writer->appendF("Android User ID, Package Name, Number of owned tasks waiting for I/O, "
+                        "Percentage of owned tasks waiting for I/O\n");
+        writer->appendF("\tCommand, Number of I/O waiting tasks, Percentage of UID's tasks waiting "
+                        "for I/O\n");
     }
     for (size_t i = 0; i < data.topNIoBlockedUids.size(); ++i) {
         const auto& uidStats = data.topNIoBlockedUids[i];
-        StringAppendF(&buffer, "%" PRIu32 ", %s, %" PRIu64 ", %.2f%%\n", uidStats.userId,
-                      uidStats.packageName.c_str(), uidStats.count,
-                      percentage(uidStats.count, data.topNIoBlockedUidsTotalTaskCnt[i]));
+        writer->appendF("%" PRIu32 ", %s, %" PRIu64 ", %.2f%%\n", uidStats.userId,
+                        uidStats.packageName.c_str(), uidStats.count,
+                        percentage(uidStats.count, data.topNIoBlockedUidsTotalTaskCnt[i]));
+        for (const auto& procStats : uidStats.topNProcesses) {
+            writer->appendF("\t%s, %" PRIu64 ", %.2f%%\n", procStats.comm.c_str(),
+                            procStats.count, percentage(procStats.count, uidStats.count));
+        }
+    }
+    if (data.topNCpuTimeUids.size() > 0) {
+        writer->appendF("\nTop N CPU time UIDs:\n%s\n", std::string(19, '-').c_str());
+        writer->appendF("Android User ID, Package Name, CPU time in clock ticks, Percentage of "
+                        "total CPU time of all processes\n");
+        writer->appendF("\tCommand, CPU time in clock ticks, Percentage of UID's CPU time\n");
+    }
+    for (const auto& uidStats : data.topNCpuTimeUids) {
+        writer->appendF("%" PRIu32 ", %s, %" PRIu64 ", %.2f%%\n", uidStats.userId,
+                        uidStats.packageName.c_str(), uidStats.count,
+                        percentage(uidStats.count, data.totalCpuTime));
         for (const auto& procStats : uidStats.topNProcesses) {
-            StringAppendF(&buffer, "\t%s, %" PRIu64 ", %.2f%%\n", procStats.comm.c_str(),
-                          procStats.count, percentage(procStats.count, uidStats.count));
+            writer->appendF("\t%s, %" PRIu64 ", %.2f%%\n", procStats.comm.c_str(),
+                            procStats.count, percentage(procStats.count, uidStats.count));
         }
     }
+}
+
+void writeTo(const TaskIoPerfData& data, DumpWriter* writer) {
+    if (data.topNWriteProcesses.size() > 0) {
+        writer->appendF("\nTop N Write Processes:\n%s\n", std::string(22, '-').c_str());
+        writer->appendF("Android User ID, Package Name, PID, Command, Read Bytes, Write Bytes\n");
+        writer->appendF("\tTID, Thread Name, Read Bytes, Write Bytes, Percentage of process's "
+                        "Write Bytes\n");
+    }
+    for (const auto& procStats : data.topNWriteProcesses) {
+        writer->appendF("%" PRIu32 ", %s, %" PRIu32 ", %s, %" PRIu64 ", %" PRIu64 "\n",
+                        procStats.userId, procStats.packageName.c_str(), procStats.pid,
+                        procStats.comm.c_str(), procStats.readBytes, procStats.writeBytes);
+        for (const auto& threadStats : procStats.topNWriteThreads) {
+            writer->appendF("\t%" PRIu32 ", %s, %" PRIu64 ", %" PRIu64 ", %.2f%%\n",
+                            threadStats.tid, threadStats.comm.c_str(), threadStats.readBytes,
+                            threadStats.writeBytes,
+                            percentage(threadStats.writeBytes, procStats.writeBytes));
+        }
+    }
+}
+
+void writeTo(const IoPerfRecord& record, DumpWriter* writer) {
+    writeTo(record.systemIoPerfData, writer);
+    writeTo(record.pressurePerfData, writer);
+    writeTo(record.processIoPerfData, writer);
+    writeTo(record.uidIoPerfData, writer);
+    writeTo(record.taskIoPerfData, writer);
+}
+
+}  // namespace
+
+std::string toString(const UidIoPerfData& data) {
+    std::string buffer;
+    DumpWriter writer(&buffer);
+    writeTo(data, &writer);
     return buffer;
 }
 
-std::string toString(const IoPerfRecord& record) {
+std::string toString(const SystemIoPerfData& data) {
     std::string buffer;
-    StringAppendF(&buffer, "%s%s%s", toString(record.systemIoPerfData).c_str(),
-                  toString(record.processIoPerfData).c_str(),
-                  toString(record.uidIoPerfData).c_str());
+    DumpWriter writer(&buffer);
+    writeTo(data, &writer);
     return buffer;
 }
 
-std::string toString(const CollectionInfo& collectionInfo) {
+std::string toString(const PressurePerfData& data) {
+    std::string buffer;
+    DumpWriter writer(&buffer);
+    writeTo(data, &writer);
+    return buffer;
+}
+
+std::string toString(const ProcessIoPerfData& data) {
+    std::string buffer;
+    DumpWriter writer(&buffer);
+    writeTo(data, &writer);
+    return buffer;
+}
+
+std::string toString(const TaskIoPerfData& data) {
+    std::string buffer;
+    DumpWriter writer(&buffer);
+    writeTo(data, &writer);
+    return buffer;
+}
+
+std::string toString(const IoPerfRecord& record) {
     std::string buffer;
-    StringAppendF(&buffer, "Number of collections: %zu\n", collectionInfo.records.size());
-    auto interval =
-            std::chrono::duration_cast<std::chrono::seconds>(collectionInfo.interval).count();
-    StringAppendF(&buffer, "Collection interval: %lld second%s\n", interval,
-                  ((interval > 1) ? "s" : ""));
+    DumpWriter writer(&buffer);
+    writeTo(record, &writer);
+    return buffer;
+}
+
+void writeTo(const CollectionInfo& collectionInfo, DumpWriter* writer) {
+    writer->appendF("Number of collections: %zu\n", collectionInfo.records.size());
+    if (collectionInfo.interval > 0ns && collectionInfo.interval < 1s) {
+        writer->appendF("Collection interval: %lld milliseconds\n",
+                        std::chrono::duration_cast<std::chrono::milliseconds>(
+                                collectionInfo.interval)
+                                .count());
+    } else {
+        auto interval =
+                std::chrono::duration_cast<std::chrono::seconds>(collectionInfo.interval).count();
+        writer->appendF("Collection interval: %lld second%s\n", interval,
+                        ((interval > 1) ? "s" : ""));
+    }
     for (size_t i = 0; i < collectionInfo.records.size(); ++i) {
         const auto& record = collectionInfo.records[i];
         std::stringstream timestamp;
         timestamp << std::put_time(std::localtime(&record.time), "%c %Z");
-        StringAppendF(&buffer, "Collection %zu: <%s>\n%s\n%s\n", i, timestamp.str().c_str(),
-                      std::string(45, '=').c_str(), toString(record).c_str());
+        writer->appendF("Collection %zu: <%s>\n%s\n", i, timestamp.str().c_str(),
+                        std::string(45, '=').c_str());
+        writeTo(record, writer);
+        writer->append("\n");
     }
+}
+
+std::string toString(const CollectionInfo& collectionInfo) {
+    std::string buffer;
+    DumpWriter writer(&buffer);
+    writeTo(collectionInfo, &writer);
+    return buffer;
+}
+
+std::string toBootTimelineTrace(const CollectionInfo& collectionInfo) {
+    std::string buffer = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                         "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+                         "\"args\":{\"name\":\"Boot-time I/O\"}}";
+    auto appendCounter = [&](const std::string& name, int64_t timestampUs, uint64_t readBytes,
+                             uint64_t writeBytes) {
+        StringAppendF(&buffer,
+                      ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%" PRId64
+                      ",\"pid\":0,\"args\":{\"read_bytes\":%" PRIu64 ",\"write_bytes\":%" PRIu64
+                      "}}",
+                      escapeJsonString(name).c_str(), timestampUs, readBytes, writeBytes);
+    };
+    // Counters hold their last value until the next sample, so the UIDs that drop out of the top N
+    // are sampled as zero.
+    std::unordered_set<std::string> lastTrackNames;
+    int lastBootStage = -1;
+    for (size_t i = 0; i < collectionInfo.records.size(); ++i) {
+        const IoPerfRecord& record = collectionInfo.records[i];
+        const int64_t timestampUs = ns2us(record.uptime);
+        if (record.bootStage != lastBootStage) {
+            StringAppendF(&buffer,
+                          ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%" PRId64
+                          ",\"pid\":0,\"tid\":0}",
+                          toString(record.bootStage).c_str(), timestampUs);
+            lastBootStage = record.bootStage;
+        }
+        const UidIoPerfData& data = record.uidIoPerfData;
+        appendCounter("Total", timestampUs,
+                      data.total[READ_BYTES][FOREGROUND] + data.total[READ_BYTES][BACKGROUND],
+                      data.total[WRITE_BYTES][FOREGROUND] + data.total[WRITE_BYTES][BACKGROUND]);
+        // Per-UID read and write bytes keyed by the track name.
+        std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> tracks;
+        auto trackName = [](const UidIoPerfData::Stats& stats) {
+            return stats.userId == 0
+                    ? stats.packageName
+                    : StringPrintf("%s (user %" PRIu32 ")", stats.packageName.c_str(),
+                                   stats.userId);
+        };
+        for (const auto& stats : data.topNReads) {
+            tracks[trackName(stats)].first = stats.bytes[FOREGROUND] + stats.bytes[BACKGROUND];
+        }
+        for (const auto& stats : data.topNWrites) {
+            tracks[trackName(stats)].second = stats.bytes[FOREGROUND] + stats.bytes[BACKGROUND];
+        }
+        for (const auto& name : lastTrackNames) {
+            tracks.try_emplace(name, 0, 0);
+        }
+        lastTrackNames.clear();
+        for (const auto& [name, bytes] : tracks) {
+            appendCounter(name, timestampUs, bytes.first, bytes.second);
+            if (bytes.first != 0 || bytes.second != 0) {
+                lastTrackNames.insert(name);
+            }
+        }
+    }
+    buffer += "\n]}\n";
     return buffer;
 }
 
@@ -319,6 +564,16 @@ Result<void> IoPerfCollection::start() {
                 sysprop::topNStatsPerCategory().value_or(kDefaultTopNStatsPerCategory));
         mTopNStatsPerSubcategory = static_cast<int>(
                 sysprop::topNStatsPerSubcategory().value_or(kDefaultTopNStatsPerSubcategory));
+        mIsTaskIoCollectionEnabled = sysprop::taskIoCollectionEnabled().value_or(false);
+        if (const auto memoryBudget = sysprop::memoryBudget().value_or(0); memoryBudget > 0) {
+            MemoryBudgetConfig config = {
+                    .rssLimitBytes = 1024 * static_cast<uint64_t>(memoryBudget),
+                    .cacheSize = static_cast<size_t>(
+                            sysprop::periodicCollectionBufferSize().value_or(
+                                    kDefaultPeriodicCollectionBufferSize)),
+            };
+            mMemoryBudget = std::make_unique<MemoryBudget>(config);
+        }
         std::chrono::nanoseconds boottimeCollectionInterval =
                 std::chrono::duration_cast<std::chrono::nanoseconds>(
                         std::chrono::seconds(sysprop::boottimeCollectionInterval().value_or(
@@ -342,6 +597,35 @@ Result<void> IoPerfCollection::start() {
                 .lastCollectionUptime = 0,
                 .records = {},
         };
+        mPeriodicRollup = std::make_unique<IoPerfRollup>(mTopNStatsPerCategory);
+        if (mWriteBudgetTracker == nullptr) {
+            sp<WriteBudgetTracker> tracker = new WriteBudgetTracker(
+                    1024 * 1024 * static_cast<uint64_t>(sysprop::dailyWriteBudget().value_or(0)),
+                    parsePackageWriteBudgets(sysprop::packageWriteBudgets().value_or("")));
+            if (tracker->enabled()) {
+                mWriteBudgetTracker = tracker;
+            }
+        }
+        std::chrono::nanoseconds periodicCollectionIdleInterval =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::seconds(
+                        sysprop::periodicCollectionIdleInterval().value_or(0)));
+        if (periodicCollectionIdleInterval > periodicCollectionInterval) {
+            AdaptiveIntervalConfig config = {
+                    .minInterval = kMinCollectionInterval,
+                    .defaultInterval = periodicCollectionInterval,
+                    .idleInterval = periodicCollectionIdleInterval,
+                    .ioWaitPercentThreshold = static_cast<uint32_t>(
+                            sysprop::adaptiveIoWaitThresholdPercent().value_or(
+                                    kDefaultAdaptiveIoWaitThresholdPercent)),
+                    .majorFaultsPerSecondThreshold = static_cast<uint64_t>(
+                            sysprop::adaptiveMajorFaultsThreshold().value_or(
+                                    kDefaultAdaptiveMajorFaultsThreshold)),
+                    .writeBytesPerSecondThreshold = 1024 *
+                            static_cast<uint64_t>(sysprop::adaptiveWriteBytesThreshold().value_or(
+                                    kDefaultAdaptiveWriteBytesThreshold)),
+            };
+            mAdaptiveInterval = std::make_unique<AdaptiveInterval>(config);
+        }
     }
 
     mCollectionThread = std::thread([&]() {
@@ -357,7 +641,12 @@ Result<void> IoPerfCollection::start() {
             mCurrCollectionEvent = CollectionEvent::BOOT_TIME;
             mBoottimeCollection.lastCollectionUptime = mHandlerLooper->now();
             mHandlerLooper->setLooper(Looper::prepare(/*opts=*/0));
-            mHandlerLooper->sendMessage(this, CollectionEvent::BOOT_TIME);
+            if (mBootFinishedBeforeStart) {
+                // The only boot-time collection is the one that ends it.
+                mHandlerLooper->sendMessage(this, SwitchEvent::END_BOOTTIME_COLLECTION);
+            } else {
+                mHandlerLooper->sendMessage(this, CollectionEvent::BOOT_TIME);
+            }
         }
         if (set_sched_policy(0, SP_BACKGROUND) != 0) {
             ALOGW("Failed to set background scheduling priority to I/O performance data collection "
@@ -376,6 +665,16 @@ Result<void> IoPerfCollection::start() {
             isCollectionActive = mCurrCollectionEvent != CollectionEvent::TERMINATED;
         }
     });
+    if (mProcPressure->enabled()) {
+        const auto& ret = mProcPressure->startMonitor(kPressureTriggers,
+                                                      [this](PressureResource resource) {
+                                                          onPressureStall(resource);
+                                                      });
+        if (!ret) {
+            ALOGW("Pressure stalls won't start collection bursts: %s",
+                  ret.error().message().c_str());
+        }
+    }
     return {};
 }
 
@@ -389,6 +688,8 @@ void IoPerfCollection::terminate() {
         ALOGE("Terminating I/O performance data collection");
         mCurrCollectionEvent = CollectionEvent::TERMINATED;
     }
+    // The monitor thread takes |mMutex| on pressure stalls, so stop it without holding |mMutex|.
+    mProcPressure->stopMonitor();
     if (mCollectionThread.joinable()) {
         mHandlerLooper->removeMessages(this);
         mHandlerLooper->wake();
@@ -398,6 +699,13 @@ void IoPerfCollection::terminate() {
 
 Result<void> IoPerfCollection::onBootFinished() {
     Mutex::Autolock lock(mMutex);
+    if (mCurrCollectionEvent == CollectionEvent::INIT) {
+        // The collection is started in the background after the binder interface is registered,
+        // so the boot may complete first.
+        ALOGI("Boot completed before I/O performance data collection started");
+        mBootFinishedBeforeStart = true;
+        return {};
+    }
     if (mCurrCollectionEvent != CollectionEvent::BOOT_TIME) {
         // This case happens when either the I/O perf collection has prematurely terminated before
         // boot complete notification is received or multiple boot complete notifications are
@@ -429,22 +737,22 @@ Result<void> IoPerfCollection::onCustomCollection(int fd, const Vector<String16>
         std::unordered_set<std::string> filterPackages;
         for (size_t i = 1; i < args.size(); ++i) {
             if (args[i] == String16(kIntervalFlag)) {
-                const auto& ret = parseSecondsFlag(args, i + 1);
+                const auto& ret = parseDurationFlag(args, i + 1);
                 if (!ret) {
                     return Error(BAD_VALUE)
                             << "Failed to parse " << kIntervalFlag << ": " << ret.error();
                 }
-                interval = std::chrono::duration_cast<std::chrono::nanoseconds>(*ret);
+                interval = *ret;
                 ++i;
                 continue;
             }
             if (args[i] == String16(kMaxDurationFlag)) {
-                const auto& ret = parseSecondsFlag(args, i + 1);
+                const auto& ret = parseDurationFlag(args, i + 1);
                 if (!ret) {
                     return Error(BAD_VALUE)
                             << "Failed to parse " << kMaxDurationFlag << ": " << ret.error();
                 }
-                maxDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(*ret);
+                maxDuration = *ret;
                 ++i;
                 continue;
             }
@@ -505,23 +813,124 @@ Result<void> IoPerfCollection::onDump(int fd) {
         return Error(FAILED_TRANSACTION) << ret.error();
     }
 
-    if (!WriteStringToFd(StringPrintf("%sI/O performance data reports:\n%sBoot-time collection "
-                                      "report:\n%s\n",
-                                      kDumpMajorDelimiter.c_str(), kDumpMajorDelimiter.c_str(),
-                                      std::string(28, '=').c_str()),
-                         fd) ||
-        !WriteStringToFd(toString(mBoottimeCollection), fd) ||
-        !WriteStringToFd(StringPrintf("%s\nPeriodic collection report:\n%s\n",
-                                      std::string(75, '-').c_str(), std::string(27, '=').c_str()),
-                         fd) ||
-        !WriteStringToFd(toString(mPeriodicCollection), fd) ||
-        !WriteStringToFd(kDumpMajorDelimiter, fd)) {
+    // Records are formatted one at a time into the writer's buffer, so the dump doesn't hold the
+    // whole report in memory.
+    DumpWriter writer(fd);
+    writer.appendF("%sI/O performance data reports:\n%sBoot-time collection report:\n%s\n",
+                   kDumpMajorDelimiter.c_str(), kDumpMajorDelimiter.c_str(),
+                   std::string(28, '=').c_str());
+    writeTo(mBoottimeCollection, &writer);
+    writer.appendF("%s\nPeriodic collection report:\n%s\n", std::string(75, '-').c_str(),
+                   std::string(27, '=').c_str());
+    if (mAdaptiveInterval != nullptr) {
+        writer.appendF("Adaptive collection interval: %lld seconds\n",
+                       std::chrono::duration_cast<std::chrono::seconds>(
+                               mAdaptiveInterval->interval())
+                               .count());
+    }
+    if (mMemoryBudget != nullptr) {
+        writer.append(mMemoryBudget->toString());
+    }
+    writeTo(mPeriodicCollection, &writer);
+    if (mPeriodicRollup != nullptr) {
+        writer.appendF("%s\nPeriodic collection rollups:\n%s\n", std::string(75, '-').c_str(),
+                       std::string(28, '=').c_str());
+        mPeriodicRollup->writeTo(&writer);
+    }
+    if (mWriteBudgetTracker != nullptr) {
+        writer.appendF("%s\nDaily write budgets:\n%s\n", std::string(75, '-').c_str(),
+                       std::string(20, '=').c_str());
+        mWriteBudgetTracker->writeTo(&writer);
+    }
+    writer.append(kDumpMajorDelimiter);
+    if (!writer.flush()) {
         return Error(FAILED_TRANSACTION)
                 << "Failed to dump the boot-time and periodic collection reports.";
     }
     return {};
 }
 
+Result<void> IoPerfCollection::onDumpHistory(int fd) {
+    const auto& ret = mIoPerfHistory->dump(fd);
+    if (!ret) {
+        return Error(FAILED_TRANSACTION) << "Failed to dump I/O performance history: "
+                                         << ret.error();
+    }
+    return {};
+}
+
+Result<void> IoPerfCollection::onDumpBootTimeline(int fd) {
+    Mutex::Autolock lock(mMutex);
+    if (!WriteStringToFd(toBootTimelineTrace(mBoottimeCollection), fd)) {
+        return Error(FAILED_TRANSACTION) << "Failed to dump the boot timeline";
+    }
+    return {};
+}
+
+Result<void> IoPerfCollection::onSuspend() {
+    {
+        Mutex::Autolock lock(mMutex);
+        if (mIsSuspended || mCurrCollectionEvent == CollectionEvent::INIT ||
+            mCurrCollectionEvent == CollectionEvent::TERMINATED) {
+            return {};
+        }
+        ALOGI("Suspending I/O performance data collection on %s collection",
+              toString(mCurrCollectionEvent).c_str());
+        mIsSuspended = true;
+        mHandlerLooper->removeMessages(this);
+        if (mCurrCollectionEvent == CollectionEvent::CUSTOM) {
+            // The message that ends the custom collection after its max duration was removed, and
+            // the records wouldn't cover the suspend anyway.
+            ALOGW("Ending custom I/O performance data collection as the system is suspending");
+            mCustomCollection = {};
+            mCurrCollectionEvent = CollectionEvent::PERIODIC;
+        }
+    }
+    if (mWriteBudgetTracker != nullptr) {
+        if (const auto ret = mWriteBudgetTracker->flush(); !ret.ok()) {
+            ALOGW("Failed to flush the write budget totals: %s", ret.error().message().c_str());
+        }
+    }
+    // A collection in flight syncs the history again after appending its record.
+    if (const auto ret = mIoPerfHistory->flush(); !ret.ok()) {
+        return Error() << "Failed to flush I/O perf history: " << ret.error();
+    }
+    return {};
+}
+
+Result<void> IoPerfCollection::onResume() {
+    Mutex::Autolock lock(mMutex);
+    if (!mIsSuspended) {
+        return {};
+    }
+    mIsSuspended = false;
+    if (mCurrCollectionEvent != CollectionEvent::BOOT_TIME &&
+        mCurrCollectionEvent != CollectionEvent::PERIODIC) {
+        return {};
+    }
+    ALOGI("Resuming I/O performance data collection on %s collection",
+          toString(mCurrCollectionEvent).c_str());
+    CollectionInfo* info = mCurrCollectionEvent == CollectionEvent::BOOT_TIME
+            ? &mBoottimeCollection
+            : &mPeriodicCollection;
+    if (mAdaptiveInterval != nullptr) {
+        mAdaptiveInterval->reset();
+    }
+    mPressureBurstEndUptime = 0;
+    info->lastCollectionUptime = mHandlerLooper->now();
+    mHandlerLooper->sendMessage(this, mCurrCollectionEvent);
+    return {};
+}
+
+Result<void> IoPerfCollection::onDumpSelfProfile(int fd) {
+    if (!WriteStringToFd(StringPrintf("I/O performance collection stages:\n%s",
+                                      mProfiler.dump("\t").c_str()),
+                         fd)) {
+        return Error(FAILED_TRANSACTION) << "Failed to dump I/O performance collection stages";
+    }
+    return {};
+}
+
 bool IoPerfCollection::dumpHelpText(int fd) {
     long periodicCacheMinutes =
             (std::chrono::duration_cast<std::chrono::seconds>(mPeriodicCollection.interval)
@@ -537,7 +946,11 @@ bool IoPerfCollection::dumpHelpText(int fd) {
                                                 kCustomCollectionDuration)
                                                 .count(),
                                         kFilterPackagesFlag, mTopNStatsPerCategory,
-                                        kEndCustomCollectionFlag, periodicCacheMinutes),
+                                        std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                kMinFilteredCollectionInterval)
+                                                .count(),
+                                        kEndCustomCollectionFlag, kDumpIoHistoryFlag,
+                                        kDumpBootTimelineFlag, periodicCacheMinutes),
                            fd);
 }
 
@@ -560,20 +973,50 @@ Result<void> IoPerfCollection::dumpCollectorsStatusLocked(int fd) {
                          fd)) {
         return Error() << "Failed to write ProcPidStat collector status";
     }
+    if (!mProcPressure->enabled() &&
+        !WriteStringToFd(StringPrintf("ProcPressure collector failed to access the directory %s",
+                                      mProcPressure->dirPath().c_str()),
+                         fd)) {
+        return Error() << "Failed to write ProcPressure collector status";
+    }
+    if (mIsTaskIoCollectionEnabled && !mProcPidIo->enabled() &&
+        !WriteStringToFd(StringPrintf("ProcPidIo collector failed to access the directory %s",
+                                      mProcPidIo->dirPath().c_str()),
+                         fd)) {
+        return Error() << "Failed to write ProcPidIo collector status";
+    }
     return {};
 }
 
 Result<void> IoPerfCollection::startCustomCollection(
         std::chrono::nanoseconds interval, std::chrono::nanoseconds maxDuration,
         const std::unordered_set<std::string>& filterPackages) {
-    if (interval < kMinCollectionInterval || maxDuration < kMinCollectionInterval) {
+    // Resolve the filtered packages once, so the collectors skip the other UIDs on every
+    // collection. Packages installed later are not collected.
+    std::unordered_set<uint32_t> filterAppIds;
+    if (!filterPackages.empty()) {
+        filterAppIds = mPackageNameResolver->getAppIds(filterPackages);
+        if (filterAppIds.empty()) {
+            ALOGW("Failed to resolve the UIDs of the filtered packages. Collecting all the UIDs "
+                  "and filtering the output.");
+        }
+    }
+    const std::chrono::nanoseconds minInterval =
+            filterAppIds.empty() ? kMinCollectionInterval : kMinFilteredCollectionInterval;
+    if (interval < minInterval || maxDuration < kMinCollectionInterval) {
         return Error(INVALID_OPERATION)
-                << "Collection interval and maximum duration must be >= "
+                << "Collection interval must be >= "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(minInterval).count()
+                << " milliseconds and maximum duration must be >= "
                 << std::chrono::duration_cast<std::chrono::milliseconds>(kMinCollectionInterval)
                            .count()
                 << " milliseconds.";
     }
     Mutex::Autolock lock(mMutex);
+    if (mIsSuspended) {
+        return Error(INVALID_OPERATION)
+                << "Cannot start a custom collection while the system is suspended";
+    }
     if (mCurrCollectionEvent != CollectionEvent::PERIODIC) {
         return Error(INVALID_OPERATION)
                 << "Cannot start a custom collection when "
@@ -585,6 +1028,7 @@ Result<void> IoPerfCollection::startCustomCollection(
             .interval = interval,
             .maxCacheSize = std::numeric_limits<std::size_t>::max(),
             .filterPackages = filterPackages,
+            .filterAppIds = filterAppIds,
             .lastCollectionUptime = mHandlerLooper->now(),
             .records = {},
     };
@@ -611,11 +1055,12 @@ Result<void> IoPerfCollection::endCustomCollection(int fd) {
         return Error(FAILED_TRANSACTION) << ret.error();
     }
 
-    if (!WriteStringToFd(StringPrintf("%sI/O performance data report for custom collection:\n%s",
-                                      kDumpMajorDelimiter.c_str(), kDumpMajorDelimiter.c_str()),
-                         fd) ||
-        !WriteStringToFd(toString(mCustomCollection), fd) ||
-        !WriteStringToFd(kDumpMajorDelimiter, fd)) {
+    DumpWriter writer(fd);
+    writer.appendF("%sI/O performance data report for custom collection:\n%s",
+                   kDumpMajorDelimiter.c_str(), kDumpMajorDelimiter.c_str());
+    writeTo(mCustomCollection, &writer);
+    writer.append(kDumpMajorDelimiter);
+    if (!writer.flush()) {
         return Error(FAILED_TRANSACTION) << "Failed to write custom collection report.";
     }
 
@@ -632,8 +1077,16 @@ void IoPerfCollection::handleMessage(const Message& message) {
         case static_cast<int>(SwitchEvent::END_BOOTTIME_COLLECTION):
             result = processCollectionEvent(CollectionEvent::BOOT_TIME, &mBoottimeCollection);
             if (result.ok()) {
+                Mutex::Autolock lock(mMutex);
                 mHandlerLooper->removeMessages(this);
                 mCurrCollectionEvent = CollectionEvent::PERIODIC;
+                if (mAdaptiveInterval != nullptr) {
+                    mAdaptiveInterval->reset();
+                }
+                if (mIsSuspended) {
+                    // |onResume| schedules the periodic collection.
+                    break;
+                }
                 mPeriodicCollection.lastCollectionUptime =
                         mHandlerLooper->now() + mPeriodicCollection.interval.count();
                 mHandlerLooper->sendMessageAtTime(mPeriodicCollection.lastCollectionUptime, this,
@@ -646,6 +1099,24 @@ void IoPerfCollection::handleMessage(const Message& message) {
         case static_cast<int>(CollectionEvent::CUSTOM):
             result = processCollectionEvent(CollectionEvent::CUSTOM, &mCustomCollection);
             break;
+        case static_cast<int>(SwitchEvent::START_PRESSURE_BURST): {
+            Mutex::Autolock lock(mMutex);
+            if (mCurrCollectionEvent != CollectionEvent::PERIODIC || mIsSuspended) {
+                return;
+            }
+            const nsecs_t now = mHandlerLooper->now();
+            const bool isBurstActive = mPressureBurstEndUptime > now;
+            mPressureBurstEndUptime = now + kPressureBurstDuration.count();
+            if (isBurstActive) {
+                return;
+            }
+            ALOGI("Pressure stall detected. Starting a burst of I/O performance data collection");
+            // Collect immediately instead of waiting for the next periodic collection.
+            mHandlerLooper->removeMessages(this);
+            mPeriodicCollection.lastCollectionUptime = now;
+            mHandlerLooper->sendMessage(this, CollectionEvent::PERIODIC);
+            return;
+        }
         case static_cast<int>(SwitchEvent::END_CUSTOM_COLLECTION): {
             Mutex::Autolock lock(mMutex);
             if (mCurrCollectionEvent != CollectionEvent::CUSTOM) {
@@ -657,6 +1128,9 @@ void IoPerfCollection::handleMessage(const Message& message) {
             mCustomCollection = {};
             mHandlerLooper->removeMessages(this);
             mCurrCollectionEvent = CollectionEvent::PERIODIC;
+            if (mAdaptiveInterval != nullptr) {
+                mAdaptiveInterval->reset();
+            }
             mPeriodicCollection.lastCollectionUptime = mHandlerLooper->now();
             mHandlerLooper->sendMessage(this, CollectionEvent::PERIODIC);
             return;
@@ -677,135 +1151,247 @@ void IoPerfCollection::handleMessage(const Message& message) {
 }
 
 Result<void> IoPerfCollection::processCollectionEvent(CollectionEvent event, CollectionInfo* info) {
+    CollectionInfo collectionInfo;
+    nsecs_t collectionUptime = 0;
+    {
+        Mutex::Autolock lock(mMutex);
+        // Messages sent to the looper are intrinsically racy such that a message from the previous
+        // collection event may land in the looper after the current collection has already begun.
+        // Thus verify the current collection event before starting the collection.
+        if (mCurrCollectionEvent != event) {
+            ALOGW("Skipping %s collection message on collection event %s", toString(event).c_str(),
+                  toString(mCurrCollectionEvent).c_str());
+            return {};
+        }
+        if (mIsSuspended) {
+            return {};
+        }
+        if (info->maxCacheSize == 0) {
+            return Error() << "Maximum cache size for " << toString(event)
+                           << " collection cannot be 0";
+        }
+        const std::chrono::nanoseconds minInterval = info->filterAppIds.empty()
+                ? kMinCollectionInterval
+                : kMinFilteredCollectionInterval;
+        if (info->interval < minInterval) {
+            return Error() << "Collection interval of "
+                           << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                      info->interval)
+                                      .count()
+                           << " milliseconds for " << toString(event)
+                           << " collection cannot be less than "
+                           << std::chrono::duration_cast<std::chrono::milliseconds>(minInterval)
+                                      .count()
+                           << " milliseconds";
+        }
+        collectionInfo.filterPackages = info->filterPackages;
+        collectionInfo.filterAppIds = info->filterAppIds;
+        collectionUptime = mHandlerLooper->now();
+        // |lastCollectionUptime| is the uptime the current collection was scheduled at.
+        mProfiler.record("Looper lag",
+                         std::max<nsecs_t>(collectionUptime - info->lastCollectionUptime, 0));
+    }
+    StageProfiler::ScopedTimer timer(&mProfiler, toString(event) + " collection",
+                                     /*trackHeap=*/true);
+    // Collect into a staging record without holding |mMutex| so the dump and custom collection
+    // requests don't wait on the `/proc` reads.
+    clearRecord(&mStagingRecord);
+    mStagingRecord.time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    mStagingRecord.uptime = collectionUptime;
+    if (event == CollectionEvent::BOOT_TIME) {
+        mStagingRecord.bootStage = mBootStageTracker->currentStage();
+    }
+    auto ret = collect(collectionInfo, &mStagingRecord);
+    if (!ret) {
+        return Error() << toString(event) << " collection failed: " << ret.error();
+    }
+    if (event == CollectionEvent::BOOT_TIME || event == CollectionEvent::PERIODIC) {
+        ret = mIoPerfHistory->append(event == CollectionEvent::BOOT_TIME ? BOOT_TIME_RECORD
+                                                                         : PERIODIC_RECORD,
+                                     mStagingRecord);
+        if (!ret) {
+            ALOGW("%s", ret.error().message().c_str());
+        }
+    }
     Mutex::Autolock lock(mMutex);
-    // Messages sent to the looper are intrinsically racy such that a message from the previous
-    // collection event may land in the looper after the current collection has already begun. Thus
-    // verify the current collection event before starting the collection.
     if (mCurrCollectionEvent != event) {
-        ALOGW("Skipping %s collection message on collection event %s", toString(event).c_str(),
-              toString(mCurrCollectionEvent).c_str());
+        ALOGW("Discarding %s collection record as the collection event changed to %s",
+              toString(event).c_str(), toString(mCurrCollectionEvent).c_str());
         return {};
     }
-    if (info->maxCacheSize == 0) {
-        return Error() << "Maximum cache size for " << toString(event) << " collection cannot be 0";
+    std::chrono::nanoseconds interval = info->interval;
+    if (event == CollectionEvent::PERIODIC) {
+        if (mAdaptiveInterval != nullptr) {
+            // Read the activity before pushing the record as the push swaps out its contents.
+            IoActivity activity = {
+                    .cpuIoWaitTime = mStagingRecord.systemIoPerfData.cpuIoWaitTime,
+                    .totalCpuTime = mStagingRecord.systemIoPerfData.totalCpuTime,
+                    .majorFaults = mStagingRecord.processIoPerfData.totalMajorFaults,
+                    .writeBytes = mStagingRecord.uidIoPerfData.total[WRITE_BYTES][FOREGROUND] +
+                            mStagingRecord.uidIoPerfData.total[WRITE_BYTES][BACKGROUND],
+            };
+            interval = mAdaptiveInterval->next(activity, info->lastCollectionUptime);
+        }
+        if (mPressureBurstEndUptime > info->lastCollectionUptime) {
+            interval = kPressureBurstCollectionInterval;
+        }
     }
-    if (info->interval < kMinCollectionInterval) {
-        return Error()
-                << "Collection interval of "
-                << std::chrono::duration_cast<std::chrono::seconds>(info->interval).count()
-                << " seconds for " << toString(event) << " collection cannot be less than "
-                << std::chrono::duration_cast<std::chrono::seconds>(kMinCollectionInterval).count()
-                << " seconds";
+    if (event == CollectionEvent::PERIODIC && mPeriodicRollup != nullptr) {
+        // Roll up before the push swaps out the contents of the staging record.
+        mPeriodicRollup->add(mStagingRecord);
     }
-    auto ret = collectLocked(info);
-    if (!ret) {
-        return Error() << toString(event) << " collection failed: " << ret.error();
+    const size_t maxCacheSize =
+            mMemoryBudget != nullptr ? applyMemoryBudgetLocked(info) : info->maxCacheSize;
+    info->records.push(&mStagingRecord, maxCacheSize);
+    if (mIsSuspended) {
+        // The system started suspending during the collection. Sync the record appended after
+        // |onSuspend| flushed the history and leave the collection parked.
+        if (const auto ret = mIoPerfHistory->flush(); !ret.ok()) {
+            ALOGW("%s", ret.error().message().c_str());
+        }
+        return {};
     }
-    info->lastCollectionUptime += info->interval.count();
+    info->lastCollectionUptime += interval.count();
     mHandlerLooper->sendMessageAtTime(info->lastCollectionUptime, this, event);
     return {};
 }
 
-Result<void> IoPerfCollection::collectLocked(CollectionInfo* collectionInfo) {
-    if (!mUidIoStats->enabled() && !mProcStat->enabled() && !mProcPidStat->enabled()) {
+size_t IoPerfCollection::applyMemoryBudgetLocked(CollectionInfo* info) {
+    const uint64_t memoryStallUs =
+            mStagingRecord.pressurePerfData.stallTime[PRESSURE_MEMORY][PRESSURE_SOME];
+    const uint64_t intervalUs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(info->interval).count());
+    const bool isUnderMemoryPressure =
+            mDidMemoryStall || memoryStallUs * 100 >= intervalUs * kMemoryPressureStallPercent;
+    mDidMemoryStall = false;
+    const MemoryBudgetLevel lastLevel = mMemoryBudget->level();
+    const MemoryBudgetLevel level = mMemoryBudget->update(isUnderMemoryPressure);
+    trimRecord(level, &mStagingRecord);
+    if (level > lastLevel) {
+        // The cached records keep the details collected before the level went up, so trim them
+        // too. Otherwise, the footprint drops only as the records are evicted.
+        for (auto* collection : {&mBoottimeCollection, &mPeriodicCollection, &mCustomCollection}) {
+            for (size_t i = 0; i < collection->records.size(); ++i) {
+                trimRecord(level, &collection->records[i]);
+            }
+        }
+        ALOGW("Carwatchdog memory budget level raised to %s at an RSS of %" PRIu64 " KiB",
+              toString(level).c_str(), mMemoryBudget->rssBytes() / 1024);
+    }
+    return mMemoryBudget->cacheSize(info->maxCacheSize);
+}
+
+Result<void> IoPerfCollection::collect(const CollectionInfo& collectionInfo,
+                                       IoPerfRecord* record) {
+    if (!mUidIoStats->enabled() && !mProcStat->enabled() && !mProcPidStat->enabled() &&
+        !mProcPressure->enabled()) {
         return Error() << "No collectors enabled";
     }
-    IoPerfRecord record{
-            .time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()),
-    };
-    auto ret = collectSystemIoPerfDataLocked(&record.systemIoPerfData);
+    // Restrict the collectors to the filtered packages, or lift the restriction once the custom
+    // collection ends.
+    mUidIoStats->setAppIdFilter(collectionInfo.filterAppIds);
+    mProcPidStat->setAppIdFilter(collectionInfo.filterAppIds);
+    // Each collector reads its own `/proc` files, so sample them in parallel. The process stats
+    // are the most expensive to collect and are collected on the calling thread.
+    auto systemRet = std::async(std::launch::async, [&]() -> Result<void> {
+        if (auto ret = collectSystemIoPerfData(&record->systemIoPerfData); !ret) {
+            return ret;
+        }
+        return collectPressurePerfData(&record->pressurePerfData);
+    });
+    const bool collectTaskIo = mIsTaskIoCollectionEnabled && mProcPidIo->enabled();
+    std::vector<uint32_t> topNWriteUids;
+    auto uidRet = std::async(std::launch::async, [&]() {
+        return collectUidIoPerfData(collectionInfo, &record->uidIoPerfData,
+                                    collectTaskIo ? &topNWriteUids : nullptr);
+    });
+    std::vector<ProcessStats> processStats;
+    auto processRet = collectProcessIoPerfData(collectionInfo, &record->processIoPerfData,
+                                               collectTaskIo ? &processStats : nullptr);
+    // Wait for all the collectors before returning as they write to |record|.
+    auto ret = systemRet.get();
+    auto uidIoRet = uidRet.get();
     if (!ret) {
         return ret;
     }
-    ret = collectProcessIoPerfDataLocked(*collectionInfo, &record.processIoPerfData);
-    if (!ret) {
-        return ret;
+    if (!processRet) {
+        return processRet;
     }
-    ret = collectUidIoPerfDataLocked(*collectionInfo, &record.uidIoPerfData);
-    if (!ret) {
-        return ret;
+    if (!uidIoRet) {
+        return uidIoRet;
     }
-    if (collectionInfo->records.size() > collectionInfo->maxCacheSize) {
-        collectionInfo->records.erase(collectionInfo->records.begin());  // Erase the oldest record.
+    // The per-task I/O is collected only for the processes of the top N writing UIDs, which are
+    // known only after both the UID and the process stats are collected.
+    if (collectTaskIo) {
+        return collectTaskIoPerfData(topNWriteUids, processStats, &record->taskIoPerfData);
     }
-    collectionInfo->records.emplace_back(record);
     return {};
 }
 
-Result<void> IoPerfCollection::collectUidIoPerfDataLocked(const CollectionInfo& collectionInfo,
-                                                          UidIoPerfData* uidIoPerfData) {
+Result<void> IoPerfCollection::collectUidIoPerfData(const CollectionInfo& collectionInfo,
+                                                    UidIoPerfData* uidIoPerfData,
+                                                    std::vector<uint32_t>* topNWriteUids) {
+    StageProfiler::ScopedTimer timer(&mProfiler, "UidIoStats");
     if (!mUidIoStats->enabled()) {
         // Don't return an error to avoid pre-mature termination. Instead, fetch data from other
         // collectors.
         return {};
     }
 
-    const Result<std::unordered_map<uint32_t, UidIoUsage>>& usage = mUidIoStats->collect();
+    const Result<UidIoUsages>& usage = mUidIoStats->collect();
     if (!usage) {
         return Error() << "Failed to collect uid I/O usage: " << usage.error();
     }
+    memcpy(uidIoPerfData->total, usage->total.metrics, sizeof(uidIoPerfData->total));
 
-    // Fetch only the top N reads and writes from the usage records.
-    UidIoUsage tempUsage = {};
-    std::vector<const UidIoUsage*> topNReads(mTopNStatsPerCategory, &tempUsage);
-    std::vector<const UidIoUsage*> topNWrites(mTopNStatsPerCategory, &tempUsage);
-    std::unordered_set<uint32_t> unmappedUids;
+    // Fetch only the top N reads and writes from the usage records. When filtering the packages,
+    // the package names are known only after ranking, so rank all the UIDs.
+    const size_t topNLimit = collectionInfo.filterPackages.empty()
+            ? static_cast<size_t>(mTopNStatsPerCategory)
+            : TopN<const UidIoUsage*>::kUnlimited;
+    TopN<const UidIoUsage*> topNReads(topNLimit);
+    TopN<const UidIoUsage*> topNWrites(topNLimit);
 
-    for (const auto& uIt : *usage) {
-        const UidIoUsage& curUsage = uIt.second;
+    for (const auto& curUsage : usage->usages) {
         if (curUsage.ios.isZero()) {
             continue;
         }
-        if (mUidToPackageNameMapping.find(curUsage.uid) == mUidToPackageNameMapping.end()) {
-            unmappedUids.insert(curUsage.uid);
-        }
-        uidIoPerfData->total[READ_BYTES][FOREGROUND] +=
-                curUsage.ios.metrics[READ_BYTES][FOREGROUND];
-        uidIoPerfData->total[READ_BYTES][BACKGROUND] +=
-                curUsage.ios.metrics[READ_BYTES][BACKGROUND];
-        uidIoPerfData->total[WRITE_BYTES][FOREGROUND] +=
-                curUsage.ios.metrics[WRITE_BYTES][FOREGROUND];
-        uidIoPerfData->total[WRITE_BYTES][BACKGROUND] +=
-                curUsage.ios.metrics[WRITE_BYTES][BACKGROUND];
-        uidIoPerfData->total[FSYNC_COUNT][FOREGROUND] +=
-                curUsage.ios.metrics[FSYNC_COUNT][FOREGROUND];
-        uidIoPerfData->total[FSYNC_COUNT][BACKGROUND] +=
-                curUsage.ios.metrics[FSYNC_COUNT][BACKGROUND];
-
-        for (auto it = topNReads.begin(); it != topNReads.end(); ++it) {
-            const UidIoUsage* curRead = *it;
-            if (curRead->ios.sumReadBytes() < curUsage.ios.sumReadBytes()) {
-                topNReads.emplace(it, &curUsage);
-                if (collectionInfo.filterPackages.empty()) {
-                    topNReads.pop_back();
-                }
-                break;
-            }
+        topNReads.push(curUsage.ios.sumReadBytes(), &curUsage);
+        topNWrites.push(curUsage.ios.sumWriteBytes(), &curUsage);
+    }
+
+    // Resolve the package names only for the top N UIDs, and for all the writing UIDs when
+    // tracking the write budgets.
+    const auto& sortedTopNReads = topNReads.sorted();
+    const auto& sortedTopNWrites = topNWrites.sorted();
+    std::unordered_set<uint32_t> uids;
+    for (const auto* topN : {&sortedTopNReads, &sortedTopNWrites}) {
+        for (const auto& entry : *topN) {
+            uids.insert(entry.value->uid);
         }
-        for (auto it = topNWrites.begin(); it != topNWrites.end(); ++it) {
-            const UidIoUsage* curWrite = *it;
-            if (curWrite->ios.sumWriteBytes() < curUsage.ios.sumWriteBytes()) {
-                topNWrites.emplace(it, &curUsage);
-                if (collectionInfo.filterPackages.empty()) {
-                    topNWrites.pop_back();
-                }
-                break;
+    }
+    std::vector<UidWriteBytes> writes;
+    if (mWriteBudgetTracker != nullptr) {
+        for (const auto& curUsage : usage->usages) {
+            if (const uint64_t bytes = curUsage.ios.sumWriteBytes(); bytes > 0) {
+                writes.push_back({.uid = curUsage.uid, .bytes = bytes});
+                uids.insert(curUsage.uid);
             }
         }
     }
-
-    const auto& ret = updateUidToPackageNameMapping(unmappedUids);
-    if (!ret) {
-        ALOGW("%s", ret.error().message().c_str());
+    const auto& packageNames = mPackageNameResolver->getPackageNames(uids);
+    if (mWriteBudgetTracker != nullptr) {
+        const auto& violations = mWriteBudgetTracker->update(time(nullptr), writes, packageNames);
+        if (!violations.empty() && mWriteBudgetCallback) {
+            mWriteBudgetCallback(violations);
+        }
     }
 
-    // Convert the top N I/O usage to UidIoPerfData.
-    for (const auto& usage : topNReads) {
-        if (usage->ios.isZero()) {
-            // End of non-zero usage records. This case occurs when the number of UIDs with active
-            // I/O operations is < |ro.carwatchdog.top_n_stats_per_category|.
-            break;
-        }
+    // Convert the top N I/O usage to UidIoPerfData. The accumulators hold only non-zero usages, so
+    // the lists are shorter than |ro.carwatchdog.top_n_stats_per_category| when fewer UIDs have
+    // active I/O operations.
+    for (const auto& entry : sortedTopNReads) {
+        const UidIoUsage* usage = entry.value;
         UidIoPerfData::Stats stats = {
                 .userId = multiuser_get_user_id(usage->uid),
                 .packageName = std::to_string(usage->uid),
@@ -814,23 +1400,17 @@ Result<void> IoPerfCollection::collectUidIoPerfDataLocked(const CollectionInfo&
                 .fsync = {usage->ios.metrics[FSYNC_COUNT][FOREGROUND],
                           usage->ios.metrics[FSYNC_COUNT][BACKGROUND]},
         };
-        if (mUidToPackageNameMapping.find(usage->uid) != mUidToPackageNameMapping.end()) {
-            stats.packageName = mUidToPackageNameMapping[usage->uid];
+        if (const auto nameIt = packageNames.find(usage->uid); nameIt != packageNames.end()) {
+            stats.packageName = nameIt->second;
         }
-        if (!collectionInfo.filterPackages.empty() &&
-            collectionInfo.filterPackages.find(stats.packageName) ==
-                    collectionInfo.filterPackages.end()) {
+        if (isFilteredOut(collectionInfo, usage->uid, stats.packageName)) {
             continue;
         }
         uidIoPerfData->topNReads.emplace_back(stats);
     }
 
-    for (const auto& usage : topNWrites) {
-        if (usage->ios.isZero()) {
-            // End of non-zero usage records. This case occurs when the number of UIDs with active
-            // I/O operations is < |ro.carwatchdog.top_n_stats_per_category|.
-            break;
-        }
+    for (const auto& entry : sortedTopNWrites) {
+        const UidIoUsage* usage = entry.value;
         UidIoPerfData::Stats stats = {
                 .userId = multiuser_get_user_id(usage->uid),
                 .packageName = std::to_string(usage->uid),
@@ -839,20 +1419,22 @@ Result<void> IoPerfCollection::collectUidIoPerfDataLocked(const CollectionInfo&
                 .fsync = {usage->ios.metrics[FSYNC_COUNT][FOREGROUND],
                           usage->ios.metrics[FSYNC_COUNT][BACKGROUND]},
         };
-        if (mUidToPackageNameMapping.find(usage->uid) != mUidToPackageNameMapping.end()) {
-            stats.packageName = mUidToPackageNameMapping[usage->uid];
+        if (const auto nameIt = packageNames.find(usage->uid); nameIt != packageNames.end()) {
+            stats.packageName = nameIt->second;
         }
-        if (!collectionInfo.filterPackages.empty() &&
-            collectionInfo.filterPackages.find(stats.packageName) ==
-                    collectionInfo.filterPackages.end()) {
+        if (isFilteredOut(collectionInfo, usage->uid, stats.packageName)) {
             continue;
         }
         uidIoPerfData->topNWrites.emplace_back(stats);
+        if (topNWriteUids != nullptr) {
+            topNWriteUids->push_back(usage->uid);
+        }
     }
     return {};
 }
 
-Result<void> IoPerfCollection::collectSystemIoPerfDataLocked(SystemIoPerfData* systemIoPerfData) {
+Result<void> IoPerfCollection::collectSystemIoPerfData(SystemIoPerfData* systemIoPerfData) {
+    StageProfiler::ScopedTimer timer(&mProfiler, "ProcStat");
     if (!mProcStat->enabled()) {
         // Don't return an error to avoid pre-mature termination. Instead, fetch data from other
         // collectors.
@@ -871,117 +1453,146 @@ Result<void> IoPerfCollection::collectSystemIoPerfDataLocked(SystemIoPerfData* s
     return {};
 }
 
-Result<void> IoPerfCollection::collectProcessIoPerfDataLocked(
-        const CollectionInfo& collectionInfo, ProcessIoPerfData* processIoPerfData) {
+Result<void> IoPerfCollection::collectPressurePerfData(PressurePerfData* pressurePerfData) {
+    StageProfiler::ScopedTimer timer(&mProfiler, "ProcPressure");
+    if (!mProcPressure->enabled()) {
+        // Don't return an error to avoid pre-mature termination. Instead, fetch data from other
+        // collectors.
+        return {};
+    }
+
+    const Result<ProcPressureInfo>& info = mProcPressure->collect();
+    if (!info) {
+        return Error() << "Failed to collect pressure stall info: " << info.error();
+    }
+    std::copy(&info->stallTime[0][0], &info->stallTime[0][0] + PRESSURE_RESOURCES * PRESSURE_TYPES,
+              &pressurePerfData->stallTime[0][0]);
+    return {};
+}
+
+void IoPerfCollection::onPressureStall(PressureResource resource) {
+    Mutex::Autolock lock(mMutex);
+    if (resource == PRESSURE_MEMORY) {
+        mDidMemoryStall = true;
+    }
+    if (mCurrCollectionEvent != CollectionEvent::PERIODIC) {
+        return;
+    }
+    mHandlerLooper->sendMessage(this, SwitchEvent::START_PRESSURE_BURST);
+}
+
+Result<void> IoPerfCollection::collectProcessIoPerfData(
+        const CollectionInfo& collectionInfo, ProcessIoPerfData* processIoPerfData,
+        std::vector<ProcessStats>* collectedProcessStats) {
+    StageProfiler::ScopedTimer timer(&mProfiler, "ProcPidStat");
     if (!mProcPidStat->enabled()) {
         // Don't return an error to avoid pre-mature termination. Instead, fetch data from other
         // collectors.
         return {};
     }
 
-    const Result<std::vector<ProcessStats>>& processStats = mProcPidStat->collect();
+    Result<std::vector<ProcessStats>> processStats = mProcPidStat->collect();
     if (!processStats) {
         return Error() << "Failed to collect process stats: " << processStats.error();
     }
 
     const auto& uidProcessStats = getUidProcessStats(*processStats, mTopNStatsPerSubcategory);
-    std::unordered_set<uint32_t> unmappedUids;
-    // Fetch only the top N I/O blocked UIDs and UIDs with most major page faults.
-    UidProcessStats temp = {};
-    std::vector<const UidProcessStats*> topNIoBlockedUids(mTopNStatsPerCategory, &temp);
-    std::vector<const UidProcessStats*> topNMajorFaultUids(mTopNStatsPerCategory, &temp);
+    // Fetch only the top N I/O blocked UIDs and UIDs with most major page faults or CPU time.
+    const size_t topNLimit = collectionInfo.filterPackages.empty()
+            ? static_cast<size_t>(mTopNStatsPerCategory)
+            : TopN<UidProcessStats*>::kUnlimited;
+    TopN<UidProcessStats*> topNIoBlockedUids(topNLimit);
+    TopN<UidProcessStats*> topNMajorFaultUids(topNLimit);
+    TopN<UidProcessStats*> topNCpuTimeUids(topNLimit);
     processIoPerfData->totalMajorFaults = 0;
-    for (const auto& it : *uidProcessStats) {
-        const UidProcessStats& curStats = it.second;
-        if (mUidToPackageNameMapping.find(curStats.uid) == mUidToPackageNameMapping.end()) {
-            unmappedUids.insert(curStats.uid);
-        }
+    processIoPerfData->totalCpuTime = 0;
+    for (auto& it : *uidProcessStats) {
+        UidProcessStats& curStats = it.second;
         processIoPerfData->totalMajorFaults += curStats.majorFaults;
-        for (auto it = topNIoBlockedUids.begin(); it != topNIoBlockedUids.end(); ++it) {
-            const UidProcessStats* topStats = *it;
-            if (topStats->ioBlockedTasksCnt < curStats.ioBlockedTasksCnt) {
-                topNIoBlockedUids.emplace(it, &curStats);
-                if (collectionInfo.filterPackages.empty()) {
-                    topNIoBlockedUids.pop_back();
-                }
-                break;
-            }
-        }
-        for (auto it = topNMajorFaultUids.begin(); it != topNMajorFaultUids.end(); ++it) {
-            const UidProcessStats* topStats = *it;
-            if (topStats->majorFaults < curStats.majorFaults) {
-                topNMajorFaultUids.emplace(it, &curStats);
-                if (collectionInfo.filterPackages.empty()) {
-                    topNMajorFaultUids.pop_back();
-                }
-                break;
-            }
-        }
+        processIoPerfData->totalCpuTime += curStats.cpuTime;
+        topNIoBlockedUids.push(curStats.ioBlockedTasksCnt, &curStats);
+        topNMajorFaultUids.push(curStats.majorFaults, &curStats);
+        topNCpuTimeUids.push(curStats.cpuTime, &curStats);
     }
 
-    const auto& ret = updateUidToPackageNameMapping(unmappedUids);
-    if (!ret) {
-        ALOGW("%s", ret.error().message().c_str());
+    // Resolve the package names only for the top N UIDs.
+    const auto& sortedTopNIoBlockedUids = topNIoBlockedUids.sorted();
+    const auto& sortedTopNMajorFaultUids = topNMajorFaultUids.sorted();
+    const auto& sortedTopNCpuTimeUids = topNCpuTimeUids.sorted();
+    std::unordered_set<uint32_t> uids;
+    for (const auto* topN :
+         {&sortedTopNIoBlockedUids, &sortedTopNMajorFaultUids, &sortedTopNCpuTimeUids}) {
+        for (const auto& entry : *topN) {
+            uids.insert(entry.value->uid);
+        }
     }
+    const auto& packageNames = mPackageNameResolver->getPackageNames(uids);
 
-    // Convert the top N uid process stats to ProcessIoPerfData.
-    for (const auto& it : topNIoBlockedUids) {
-        if (it->ioBlockedTasksCnt == 0) {
-            // End of non-zero elements. This case occurs when the number of UIDs with I/O blocked
-            // processes is < |ro.carwatchdog.top_n_stats_per_category|.
-            break;
-        }
+    // Convert the top N uid process stats to ProcessIoPerfData. The accumulators hold only
+    // non-zero stats, so the lists are shorter than |ro.carwatchdog.top_n_stats_per_category|
+    // when fewer UIDs have I/O blocked processes, major faults or CPU time.
+    for (const auto& entry : sortedTopNIoBlockedUids) {
+        UidProcessStats* it = entry.value;
         ProcessIoPerfData::UidStats stats = {
                 .userId = multiuser_get_user_id(it->uid),
                 .packageName = std::to_string(it->uid),
                 .count = it->ioBlockedTasksCnt,
         };
-        if (mUidToPackageNameMapping.find(it->uid) != mUidToPackageNameMapping.end()) {
-            stats.packageName = mUidToPackageNameMapping[it->uid];
+        if (const auto nameIt = packageNames.find(it->uid); nameIt != packageNames.end()) {
+            stats.packageName = nameIt->second;
         }
-        if (!collectionInfo.filterPackages.empty() &&
-            collectionInfo.filterPackages.find(stats.packageName) ==
-                    collectionInfo.filterPackages.end()) {
+        if (isFilteredOut(collectionInfo, it->uid, stats.packageName)) {
             continue;
         }
-        for (const auto& pIt : it->topNIoBlockedProcesses) {
-            if (pIt.count == 0) {
-                break;
-            }
+        for (const auto& pIt : it->topNIoBlockedProcesses.sorted()) {
             stats.topNProcesses.emplace_back(
-                    ProcessIoPerfData::UidStats::ProcessStats{pIt.comm, pIt.count});
+                    ProcessIoPerfData::UidStats::ProcessStats{*pIt.value, pIt.key});
         }
         processIoPerfData->topNIoBlockedUids.emplace_back(stats);
         processIoPerfData->topNIoBlockedUidsTotalTaskCnt.emplace_back(it->totalTasksCnt);
     }
-    for (const auto& it : topNMajorFaultUids) {
-        if (it->majorFaults == 0) {
-            // End of non-zero elements. This case occurs when the number of UIDs with major faults
-            // is < |ro.carwatchdog.top_n_stats_per_category|.
-            break;
-        }
+    for (const auto& entry : sortedTopNMajorFaultUids) {
+        UidProcessStats* it = entry.value;
         ProcessIoPerfData::UidStats stats = {
                 .userId = multiuser_get_user_id(it->uid),
                 .packageName = std::to_string(it->uid),
                 .count = it->majorFaults,
         };
-        if (mUidToPackageNameMapping.find(it->uid) != mUidToPackageNameMapping.end()) {
-            stats.packageName = mUidToPackageNameMapping[it->uid];
+        if (const auto nameIt = packageNames.find(it->uid); nameIt != packageNames.end()) {
+            stats.packageName = nameIt->second;
         }
-        if (!collectionInfo.filterPackages.empty() &&
-            collectionInfo.filterPackages.find(stats.packageName) ==
-                    collectionInfo.filterPackages.end()) {
+        if (isFilteredOut(collectionInfo, it->uid, stats.packageName)) {
             continue;
         }
-        for (const auto& pIt : it->topNMajorFaultProcesses) {
-            if (pIt.count == 0) {
-                break;
-            }
+        for (const auto& pIt : it->topNMajorFaultProcesses.sorted()) {
             stats.topNProcesses.emplace_back(
-                    ProcessIoPerfData::UidStats::ProcessStats{pIt.comm, pIt.count});
+                    ProcessIoPerfData::UidStats::ProcessStats{*pIt.value, pIt.key});
         }
         processIoPerfData->topNMajorFaultUids.emplace_back(stats);
     }
+    for (const auto& entry : sortedTopNCpuTimeUids) {
+        UidProcessStats* it = entry.value;
+        ProcessIoPerfData::UidStats stats = {
+                .userId = multiuser_get_user_id(it->uid),
+                .packageName = std::to_string(it->uid),
+                .count = it->cpuTime,
+        };
+        if (const auto nameIt = packageNames.find(it->uid); nameIt != packageNames.end()) {
+            stats.packageName = nameIt->second;
+        }
+        if (isFilteredOut(collectionInfo, it->uid, stats.packageName)) {
+            continue;
+        }
+        for (const auto& pIt : it->topNCpuTimeProcesses.sorted()) {
+            stats.topNProcesses.emplace_back(
+                    ProcessIoPerfData::UidStats::ProcessStats{*pIt.value, pIt.key});
+        }
+        processIoPerfData->topNCpuTimeUids.emplace_back(stats);
+    }
+    if (collectedProcessStats != nullptr) {
+        *collectedProcessStats = std::move(*processStats);
+    }
+    Mutex::Autolock lock(mCollectedDataMutex);
     if (mLastMajorFaults == 0) {
         processIoPerfData->majorFaultsPercentChange = 0;
     } else {
@@ -993,60 +1604,64 @@ Result<void> IoPerfCollection::collectProcessIoPerfDataLocked(
     return {};
 }
 
-Result<void> IoPerfCollection::updateUidToPackageNameMapping(
-    const std::unordered_set<uint32_t>& uids) {
-    std::vector<int32_t> appUids;
-
-    for (const auto& uid : uids) {
-        if (uid >= AID_APP_START) {
-            appUids.emplace_back(static_cast<int32_t>(uid));
-            continue;
-        }
-        // System/native UIDs.
-        passwd* usrpwd = getpwuid(uid);
-        if (!usrpwd) {
-            continue;
-        }
-        mUidToPackageNameMapping[uid] = std::string(usrpwd->pw_name);
-    }
-
-    if (appUids.empty()) {
+Result<void> IoPerfCollection::collectTaskIoPerfData(const std::vector<uint32_t>& topNWriteUids,
+                                                     const std::vector<ProcessStats>& processStats,
+                                                     TaskIoPerfData* taskIoPerfData) {
+    StageProfiler::ScopedTimer timer(&mProfiler, "ProcPidIo");
+    if (topNWriteUids.empty()) {
         return {};
     }
-
-    if (mPackageManager == nullptr) {
-        auto ret = retrievePackageManager();
-        if (!ret) {
-            return Error() << "Failed to retrieve package manager: " << ret.error();
+    std::unordered_set<uint32_t> uids(topNWriteUids.begin(), topNWriteUids.end());
+    std::vector<const ProcessStats*> processes;
+    for (const auto& stats : processStats) {
+        if (stats.uid >= 0 && uids.find(static_cast<uint32_t>(stats.uid)) != uids.end()) {
+            processes.push_back(&stats);
         }
     }
-
-    std::vector<std::string> packageNames;
-    const binder::Status& status = mPackageManager->getNamesForUids(appUids, &packageNames);
-    if (!status.isOk()) {
-        return Error() << "package_native::getNamesForUids failed: " << status.exceptionMessage();
+    const Result<std::vector<ProcessIoUsage>>& usages = mProcPidIo->collect(processes);
+    if (!usages) {
+        return Error() << "Failed to collect per-task I/O usage: " << usages.error();
     }
 
-    for (uint32_t i = 0; i < appUids.size(); i++) {
-        if (!packageNames[i].empty()) {
-            mUidToPackageNameMapping[appUids[i]] = packageNames[i];
-        }
-    }
-
-    return {};
-}
-
-Result<void> IoPerfCollection::retrievePackageManager() {
-    const sp<IServiceManager> sm = defaultServiceManager();
-    if (sm == nullptr) {
-        return Error() << "Failed to retrieve defaultServiceManager";
+    TopN<const ProcessIoUsage*> topNWriteProcesses(static_cast<size_t>(mTopNStatsPerCategory));
+    for (const auto& usage : *usages) {
+        topNWriteProcesses.push(usage.process.writeBytes, &usage);
     }
-
-    sp<IBinder> binder = sm->getService(String16("package_native"));
-    if (binder == nullptr) {
-        return Error() << "Failed to get service package_native";
+    // The package names were resolved when collecting the UID stats, so these are cache hits.
+    const auto& packageNames = mPackageNameResolver->getPackageNames(uids);
+    for (const auto& entry : topNWriteProcesses.sorted()) {
+        const ProcessIoUsage* usage = entry.value;
+        const uint32_t uid = static_cast<uint32_t>(usage->stats->uid);
+        TaskIoPerfData::ProcessStats stats = {
+                .userId = multiuser_get_user_id(uid),
+                .packageName = std::to_string(uid),
+                .pid = usage->stats->process.pid,
+                .comm = usage->stats->process.comm,
+                .readBytes = usage->process.readBytes,
+                .writeBytes = usage->process.writeBytes,
+        };
+        if (const auto nameIt = packageNames.find(uid); nameIt != packageNames.end()) {
+            stats.packageName = nameIt->second;
+        }
+        TopN<uint32_t> topNWriteThreads(static_cast<size_t>(mTopNStatsPerSubcategory));
+        for (const auto& [tid, bytes] : usage->threads) {
+            topNWriteThreads.push(bytes.writeBytes, tid);
+        }
+        for (const auto& tEntry : topNWriteThreads.sorted()) {
+            const TaskIoBytes& bytes = usage->threads.at(tEntry.value);
+            TaskIoPerfData::ProcessStats::ThreadStats threadStats = {
+                    .tid = tEntry.value,
+                    .readBytes = bytes.readBytes,
+                    .writeBytes = bytes.writeBytes,
+            };
+            if (const auto tIt = usage->stats->threads.find(tEntry.value);
+                tIt != usage->stats->threads.end()) {
+                threadStats.comm = tIt->second.comm;
+            }
+            stats.topNWriteThreads.emplace_back(threadStats);
+        }
+        taskIoPerfData->topNWriteProcesses.emplace_back(stats);
     }
-    mPackageManager = interface_cast<IPackageManagerNative>(binder);
     return {};
 }
 
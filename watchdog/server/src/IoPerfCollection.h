@@ -19,7 +19,6 @@
 
 #include <android-base/chrono_utils.h>
 #include <android-base/result.h>
-#include <android/content/pm/IPackageManagerNative.h>
 #include <cutils/multiuser.h>
 #include <gtest/gtest_prod.h>
 #include <time.h>
@@ -30,16 +29,31 @@
 #include <utils/StrongPointer.h>
 #include <utils/Vector.h>
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "AdaptiveInterval.h"
+#include "BootStageTracker.h"
+#include "BpfUidIoStats.h"
+#include "DumpWriter.h"
+#include "IoPerfHistory.h"
+#include "IoPerfRollup.h"
 #include "LooperWrapper.h"
+#include "MemoryBudget.h"
+#include "PackageNameResolver.h"
+#include "ProcPidIo.h"
 #include "ProcPidStat.h"
+#include "ProcPressure.h"
 #include "ProcStat.h"
+#include "RingBuffer.h"
+#include "StageProfiler.h"
 #include "UidIoStats.h"
+#include "WriteBudgetTracker.h"
 
 namespace android {
 namespace automotive {
@@ -50,6 +64,8 @@ constexpr const char* kEndCustomCollectionFlag = "--stop_io";
 constexpr const char* kIntervalFlag = "--interval";
 constexpr const char* kMaxDurationFlag = "--max_duration";
 constexpr const char* kFilterPackagesFlag = "--filter_packages";
+constexpr const char* kDumpIoHistoryFlag = "--dump_io_history";
+constexpr const char* kDumpBootTimelineFlag = "--dump_boot_timeline";
 
 // Performance data collected from the `/proc/uid_io/stats` file.
 struct UidIoPerfData {
@@ -76,6 +92,14 @@ struct SystemIoPerfData {
 
 std::string toString(const SystemIoPerfData& perfData);
 
+// Performance data collected from the `/proc/pressure/{cpu,io,memory}` files.
+struct PressurePerfData {
+    // Stall time in microseconds since the last collection.
+    uint64_t stallTime[PRESSURE_RESOURCES][PRESSURE_TYPES] = {{0}};
+};
+
+std::string toString(const PressurePerfData& perfData);
+
 // Performance data collected from the `/proc/[pid]/stat` and `/proc/[pid]/task/[tid]/stat` files.
 struct ProcessIoPerfData {
     struct UidStats {
@@ -95,15 +119,45 @@ struct ProcessIoPerfData {
     uint64_t totalMajorFaults = 0;
     // Percentage of increase/decrease in the major page faults since last collection.
     double majorFaultsPercentChange = 0.0;
+    // UIDs with the most user and system mode CPU time, in clock ticks, since last collection.
+    std::vector<UidStats> topNCpuTimeUids = {};
+    uint64_t totalCpuTime = 0;
 };
 
 std::string toString(const ProcessIoPerfData& data);
 
+// Performance data collected from the `/proc/[pid]/io` and `/proc/[pid]/task/[tid]/io` files of
+// the processes owned by the top N writing UIDs.
+struct TaskIoPerfData {
+    struct ProcessStats {
+        userid_t userId = 0;
+        std::string packageName;
+        uint32_t pid = 0;
+        std::string comm = "";
+        uint64_t readBytes = 0;
+        uint64_t writeBytes = 0;
+        struct ThreadStats {
+            uint32_t tid = 0;
+            std::string comm = "";
+            uint64_t readBytes = 0;
+            uint64_t writeBytes = 0;
+        };
+        std::vector<ThreadStats> topNWriteThreads = {};
+    };
+    std::vector<ProcessStats> topNWriteProcesses = {};
+};
+
+std::string toString(const TaskIoPerfData& data);
+
 struct IoPerfRecord {
     time_t time;  // Collection time.
+    nsecs_t uptime = 0;  // Collection uptime. Used as the timestamp of the boot timeline.
+    BootStage bootStage = BOOT_STAGE_INIT;  // Boot stage of the boot-time collection records.
     UidIoPerfData uidIoPerfData;
     SystemIoPerfData systemIoPerfData;
     ProcessIoPerfData processIoPerfData;
+    PressurePerfData pressurePerfData;
+    TaskIoPerfData taskIoPerfData;  // Empty unless |ro.carwatchdog.task_io_collection_enabled|.
 };
 
 std::string toString(const IoPerfRecord& record);
@@ -113,12 +167,24 @@ struct CollectionInfo {
     size_t maxCacheSize = 0;                  // Maximum cache size for the collection.
     std::unordered_set<std::string> filterPackages;  // Filter the output only to the specified
                                                      // packages.
+    std::unordered_set<uint32_t> filterAppIds;  // App IDs of |filterPackages|. When not empty, the
+                                                // collectors skip the UIDs of other app IDs.
     nsecs_t lastCollectionUptime = 0;         // Used to calculate the uptime for next collection.
-    std::vector<IoPerfRecord> records;        // Cache of collected performance records.
+    RingBuffer<IoPerfRecord> records;         // Cache of collected performance records. Holds at
+                                              // most |maxCacheSize| records.
 };
 
 std::string toString(const CollectionInfo& collectionInfo);
 
+// Writes the same report as |toString| one record at a time.
+void writeTo(const CollectionInfo& collectionInfo, DumpWriter* writer);
+
+// Returns the records of |collectionInfo| as a trace in the JSON trace event format, which the
+// Perfetto UI and chrome://tracing load directly. The trace has a counter track with the read and
+// write bytes of each top N UID and of all the UIDs, and an instant event at the start of each
+// boot stage.
+std::string toBootTimelineTrace(const CollectionInfo& collectionInfo);
+
 enum CollectionEvent {
     INIT = 0,
     BOOT_TIME,
@@ -133,7 +199,10 @@ enum SwitchEvent {
     // collection event to periodic collection.
     END_BOOTTIME_COLLECTION = CollectionEvent::LAST_EVENT + 1,
     // Ends custom collection, discards collected data and starts periodic collection.
-    END_CUSTOM_COLLECTION
+    END_CUSTOM_COLLECTION,
+    // Starts or extends a burst of |kPressureBurstCollectionInterval| periodic collections after a
+    // PSI trigger fires.
+    START_PRESSURE_BURST,
 };
 
 static inline std::string toString(CollectionEvent event) {
@@ -164,11 +233,22 @@ public:
           mPeriodicCollection({}),
           mCustomCollection({}),
           mCurrCollectionEvent(CollectionEvent::INIT),
-          mUidToPackageNameMapping({}),
-          mUidIoStats(new UidIoStats()),
+          mUidIoStats(createUidIoStats()),
           mProcStat(new ProcStat()),
           mProcPidStat(new ProcPidStat()),
-          mLastMajorFaults(0) {}
+          mProcPressure(new ProcPressure()),
+          mProcPidIo(new ProcPidIo()),
+          mIoPerfHistory(new IoPerfHistory()),
+          mLastMajorFaults(0),
+          mPressureBurstEndUptime(0),
+          mAdaptiveInterval(nullptr),
+          mMemoryBudget(nullptr),
+          mDidMemoryStall(false),
+          mIsSuspended(false),
+          mBootFinishedBeforeStart(false),
+          mPackageNameResolver(new PackageNameResolver()),
+          mBootStageTracker(new BootStageTracker()),
+          mProfiler("IoPerfCollection") {}
 
     ~IoPerfCollection() { terminate(); }
 
@@ -192,9 +272,35 @@ public:
     // Generates a dump from the boot-time and periodic collection events.
     virtual android::base::Result<void> onDump(int fd);
 
+    // Writes the raw binary history of the boot-time and periodic collection records, including
+    // the records from the previous carwatchdogd run.
+    virtual android::base::Result<void> onDumpHistory(int fd);
+
+    // Dumps the durations of the collection stages and the looper lag of the collection events.
+    virtual android::base::Result<void> onDumpSelfProfile(int fd);
+
+    // Writes the boot-time collection records as a trace. See |toBootTimelineTrace|.
+    virtual android::base::Result<void> onDumpBootTimeline(int fd);
+
+    // Parks the collection when the system suspends or shuts down: removes the pending collection
+    // messages, ends the custom collection, and syncs the history file to the storage. The
+    // collection thread and the pressure stall monitor stay idle until |onResume|.
+    virtual android::base::Result<void> onSuspend();
+
+    // Resumes the parked collection event with an immediate collection.
+    virtual android::base::Result<void> onResume();
+
     // Dumps the help text.
     bool dumpHelpText(int fd);
 
+    // Sets the callback that receives the packages which went over their daily write budget. The
+    // callback is called on a collection thread without holding any lock. Must be called before
+    // |start|.
+    void setWriteBudgetCallback(
+            const std::function<void(const std::vector<WriteBudgetViolation>&)>& callback) {
+        mWriteBudgetCallback = callback;
+    }
+
 private:
     // Dumps the collectors' status when they are disabled.
     android::base::Result<void> dumpCollectorsStatusLocked(int fd);
@@ -222,27 +328,43 @@ private:
     // Processes the events received by |handleMessage|.
     android::base::Result<void> processCollectionEvent(CollectionEvent event, CollectionInfo* info);
 
-    // Collects/stores the performance data for the current collection event.
-    android::base::Result<void> collectLocked(CollectionInfo* collectionInfo);
+    // Collects the performance data for a single collection into |record|. The collectors are
+    // sampled in parallel and |mMutex| must not be held, so dumps don't wait on `/proc` reads.
+    android::base::Result<void> collect(const CollectionInfo& collectionInfo,
+                                        IoPerfRecord* record);
 
-    // Collects performance data from the `/proc/uid_io/stats` file.
-    android::base::Result<void> collectUidIoPerfDataLocked(const CollectionInfo& collectionInfo,
-                                                           UidIoPerfData* uidIoPerfData);
+    // Collects performance data from the `/proc/uid_io/stats` file. When |topNWriteUids| is not
+    // null, sets it to the UIDs reported in |uidIoPerfData->topNWrites|.
+    android::base::Result<void> collectUidIoPerfData(
+            const CollectionInfo& collectionInfo, UidIoPerfData* uidIoPerfData,
+            std::vector<uint32_t>* topNWriteUids = nullptr);
 
     // Collects performance data from the `/proc/stats` file.
-    android::base::Result<void> collectSystemIoPerfDataLocked(SystemIoPerfData* systemIoPerfData);
+    android::base::Result<void> collectSystemIoPerfData(SystemIoPerfData* systemIoPerfData);
 
-    // Collects performance data from the `/proc/[pid]/stat` and
-    // `/proc/[pid]/task/[tid]/stat` files.
-    android::base::Result<void> collectProcessIoPerfDataLocked(
-            const CollectionInfo& collectionInfo, ProcessIoPerfData* processIoPerfData);
+    // Collects performance data from the `/proc/pressure/{cpu,io,memory}` files.
+    android::base::Result<void> collectPressurePerfData(PressurePerfData* pressurePerfData);
 
-    // Updates the |mUidToPackageNameMapping| for the given |uids|.
-    android::base::Result<void> updateUidToPackageNameMapping(
-            const std::unordered_set<uint32_t>& uids);
+    // Called on the pressure stall monitor thread when a PSI trigger fires.
+    void onPressureStall(PressureResource resource);
 
-    // Retrieves package manager from the default service manager.
-    android::base::Result<void> retrievePackageManager();
+    // Updates the memory budget level after collecting |mStagingRecord| and drops the details
+    // the level doesn't allow for from the records. Returns the number of records |info| should
+    // keep.
+    size_t applyMemoryBudgetLocked(CollectionInfo* info);
+
+    // Collects performance data from the `/proc/[pid]/stat` and
+    // `/proc/[pid]/task/[tid]/stat` files. When |collectedProcessStats| is not null, moves the
+    // collected process stats to it.
+    android::base::Result<void> collectProcessIoPerfData(
+            const CollectionInfo& collectionInfo, ProcessIoPerfData* processIoPerfData,
+            std::vector<ProcessStats>* collectedProcessStats = nullptr);
+
+    // Collects performance data from the `/proc/[pid]/io` and `/proc/[pid]/task/[tid]/io` files
+    // of the processes in |processStats| that are owned by |topNWriteUids|.
+    android::base::Result<void> collectTaskIoPerfData(const std::vector<uint32_t>& topNWriteUids,
+                                                      const std::vector<ProcessStats>& processStats,
+                                                      TaskIoPerfData* taskIoPerfData);
 
     // Top N per-UID stats per category.
     int mTopNStatsPerCategory;
@@ -250,6 +372,10 @@ private:
     // Top N per-process stats per subcategory.
     int mTopNStatsPerSubcategory;
 
+    // True when |ro.carwatchdog.task_io_collection_enabled| is set. Reading the io files of every
+    // task is expensive, so only the processes of the top N writing UIDs are collected.
+    bool mIsTaskIoCollectionEnabled = false;
+
     // Thread on which the actual collection happens.
     std::thread mCollectionThread;
 
@@ -275,25 +401,83 @@ private:
     // |startCustomCollection| and |endCustomCollection|.
     CollectionEvent mCurrCollectionEvent GUARDED_BY(mMutex);
 
-    // Cache of uid to package name mapping.
-    std::unordered_map<uint64_t, std::string> mUidToPackageNameMapping GUARDED_BY(mMutex);
+    // Record that the next collection writes to. Once a collection's cache is full, this holds the
+    // evicted record so its buffers are reused by the next collection. Accessed only on the
+    // collection thread.
+    IoPerfRecord mStagingRecord;
 
-    // Collector/parser for `/proc/uid_io/stats`.
-    android::sp<UidIoStats> mUidIoStats GUARDED_BY(mMutex);
+    // Guards the state carried between collections. The collectors read their `/proc` files in
+    // parallel without holding any lock.
+    Mutex mCollectedDataMutex;
+
+    // Collector/parser for `/proc/uid_io/stats`, or for the eBPF per-UID I/O map when supported.
+    // The collectors are assigned only on construction (or by tests before the collection starts)
+    // and have their own locking, so they are accessed without holding |mMutex|.
+    android::sp<UidIoStats> mUidIoStats;
 
     // Collector/parser for `/proc/stat`.
-    android::sp<ProcStat> mProcStat GUARDED_BY(mMutex);
+    android::sp<ProcStat> mProcStat;
 
     // Collector/parser for `/proc/PID/*` stat files.
-    android::sp<ProcPidStat> mProcPidStat GUARDED_BY(mMutex);
+    android::sp<ProcPidStat> mProcPidStat;
+
+    // Collector/parser for `/proc/PID/*` io files.
+    android::sp<ProcPidIo> mProcPidIo;
+
+    // Collector/parser for `/proc/pressure/*` files. Also monitors the PSI triggers that start the
+    // pressure stall collection bursts.
+    android::sp<ProcPressure> mProcPressure;
+
+    // Binary history of the boot-time and periodic collection records.
+    android::sp<IoPerfHistory> mIoPerfHistory;
 
     // Major faults delta from last collection. Useful when calculating the percentage change in
     // major faults since last collection.
-    uint64_t mLastMajorFaults GUARDED_BY(mMutex);
+    uint64_t mLastMajorFaults GUARDED_BY(mCollectedDataMutex);
+
+    // Uptime until which the periodic collection runs every |kPressureBurstCollectionInterval|
+    // after a pressure stall.
+    nsecs_t mPressureBurstEndUptime GUARDED_BY(mMutex);
+
+    // Adapts the periodic collection interval to the I/O activity. Null when the idle interval
+    // sysprop is not greater than the periodic collection interval.
+    std::unique_ptr<AdaptiveInterval> mAdaptiveInterval GUARDED_BY(mMutex);
+
+    // Bounds the footprint of the cached records. Null when |ro.carwatchdog.memory_budget| is not
+    // set.
+    std::unique_ptr<MemoryBudget> mMemoryBudget GUARDED_BY(mMutex);
+
+    // Coarser history of the periodic collection, kept for longer than |mPeriodicCollection|.
+    std::unique_ptr<IoPerfRollup> mPeriodicRollup GUARDED_BY(mMutex);
+
+    // Set when the memory PSI trigger fires. Cleared by the next memory budget update.
+    bool mDidMemoryStall GUARDED_BY(mMutex);
+
+    // Set between |onSuspend| and |onResume|. No collection is scheduled while set.
+    bool mIsSuspended GUARDED_BY(mMutex);
+
+    // Set when the boot completed before the collection thread started, in which case the
+    // boot-time collection ends with its first collection.
+    bool mBootFinishedBeforeStart GUARDED_BY(mMutex);
+
+    // Daily write bytes of each UID. Null when neither |ro.carwatchdog.daily_write_budget| nor
+    // |ro.carwatchdog.package_write_budgets| sets a budget. Assigned only on |start| and has its
+    // own locking.
+    android::sp<WriteBudgetTracker> mWriteBudgetTracker;
+
+    std::function<void(const std::vector<WriteBudgetViolation>&)> mWriteBudgetCallback;
+
+    // Resolves the package names of the top N UIDs. Has its own locking.
+    android::sp<PackageNameResolver> mPackageNameResolver;
+
+    // Tags the boot-time collection records with the boot stage. Has its own locking.
+    android::sp<BootStageTracker> mBootStageTracker;
 
-    // To get the package names from app uids.
-    android::sp<android::content::pm::IPackageManagerNative> mPackageManager GUARDED_BY(mMutex);
+    // Durations of the collectors and of the whole collections, and the delay between the
+    // scheduled and the actual start of the collections. Has its own locking.
+    StageProfiler mProfiler;
 
+    friend class IoPerfCollectionBenchmark;
     FRIEND_TEST(IoPerfCollectionTest, TestCollectionStartAndTerminate);
     FRIEND_TEST(IoPerfCollectionTest, TestValidCollectionSequence);
     FRIEND_TEST(IoPerfCollectionTest, TestCollectionTerminatesOnZeroEnabledCollectors);
@@ -304,8 +488,20 @@ private:
     FRIEND_TEST(IoPerfCollectionTest, TestProcUidIoStatsContentsFromDevice);
     FRIEND_TEST(IoPerfCollectionTest, TestValidProcStatFile);
     FRIEND_TEST(IoPerfCollectionTest, TestValidProcPidContents);
+    FRIEND_TEST(IoPerfCollectionTest, TestTopNCpuTimeUids);
     FRIEND_TEST(IoPerfCollectionTest, TestProcPidContentsLessThanTopNStatsLimit);
     FRIEND_TEST(IoPerfCollectionTest, TestCustomCollectionFiltersPackageNames);
+    FRIEND_TEST(IoPerfCollectionTest, TestHandlesInvalidDumpArguments);
+    FRIEND_TEST(IoPerfCollectionTest, TestPressureStallStartsCollectionBurst);
+    FRIEND_TEST(IoPerfCollectionTest, TestSuspendParksCollection);
+    FRIEND_TEST(IoPerfCollectionTest, TestAdaptivePeriodicCollectionInterval);
+    FRIEND_TEST(IoPerfCollectionTest, TestBootFinishedBeforeStart);
+    FRIEND_TEST(IoPerfCollectionTest, TestTaskIoPerfDataOfTopNWriteUids);
+    FRIEND_TEST(IoPerfCollectionTest, TestFilteredCustomCollectionSkipsOtherUids);
+    FRIEND_TEST(IoPerfCollectionTest, TestMemoryBudgetDropsRecordDetails);
+    FRIEND_TEST(IoPerfCollectionTest, TestBootTimelineTrace);
+    FRIEND_TEST(IoPerfCollectionTest, TestWriteBudgetViolations);
+    FRIEND_TEST(IoPerfCollectionTest, TestReplaysProcSnapshots);
 };
 
 }  // namespace watchdog
@@ -0,0 +1,279 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "IoPerfHistory.h"
+
+#include <android-base/file.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+
+#include "IoPerfCollection.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::Error;
+using android::base::ErrnoError;
+using android::base::Result;
+using android::base::unique_fd;
+using android::base::WriteFully;
+
+namespace {
+
+constexpr size_t kIoPerfHistoryMagicSize = sizeof(kIoPerfHistoryMagic) - 1;
+
+void writeVarint(uint64_t value, std::string* out) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+void writeSigned(int64_t value, std::string* out) {
+    writeVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63), out);
+}
+
+void writeDelta(uint64_t value, uint64_t last, std::string* out) {
+    writeSigned(static_cast<int64_t>(value - last), out);
+}
+
+std::string oldFilePath(const std::string& path) {
+    return path + ".old";
+}
+
+}  // namespace
+
+void IoPerfHistoryEncoder::encode(IoPerfHistoryRecordType type, const IoPerfRecord& record,
+                                  std::string* out) {
+    std::string payload;
+    const bool isDelta = mHasLastRecord;
+    if (!isDelta) {
+        mStringTable.clear();
+        mLastTime = 0;
+        std::fill(std::begin(mLastSystemData), std::end(mLastSystemData), 0);
+    }
+    payload.push_back(static_cast<char>(type));
+    payload.push_back(static_cast<char>(isDelta ? kIoPerfHistoryDeltaFlag : 0));
+
+    const int64_t time = static_cast<int64_t>(record.time);
+    writeSigned(time - mLastTime, &payload);
+    mLastTime = time;
+
+    const SystemIoPerfData& systemData = record.systemIoPerfData;
+    const uint64_t systemValues[] = {systemData.cpuIoWaitTime, systemData.totalCpuTime,
+                                     systemData.ioBlockedProcessesCnt,
+                                     systemData.totalProcessesCnt};
+    for (size_t i = 0; i < std::size(systemValues); ++i) {
+        writeDelta(systemValues[i], mLastSystemData[i], &payload);
+        mLastSystemData[i] = systemValues[i];
+    }
+
+    const PressurePerfData& pressureData = record.pressurePerfData;
+    for (int i = 0; i < PRESSURE_RESOURCES; ++i) {
+        for (int j = 0; j < PRESSURE_TYPES; ++j) {
+            writeVarint(pressureData.stallTime[i][j], &payload);
+        }
+    }
+
+    const UidIoPerfData& uidData = record.uidIoPerfData;
+    for (int i = 0; i < METRIC_TYPES; ++i) {
+        for (int j = 0; j < UID_STATES; ++j) {
+            writeVarint(uidData.total[i][j], &payload);
+        }
+    }
+    for (const auto* topN : {&uidData.topNReads, &uidData.topNWrites}) {
+        writeVarint(topN->size(), &payload);
+        for (const auto& stats : *topN) {
+            writeVarint(stats.userId, &payload);
+            writeString(stats.packageName, &payload);
+            for (int i = 0; i < UID_STATES; ++i) {
+                writeVarint(stats.bytes[i], &payload);
+            }
+            for (int i = 0; i < UID_STATES; ++i) {
+                writeVarint(stats.fsync[i], &payload);
+            }
+        }
+    }
+
+    const ProcessIoPerfData& processData = record.processIoPerfData;
+    writeVarint(processData.totalMajorFaults, &payload);
+    for (const auto* topN : {&processData.topNIoBlockedUids, &processData.topNMajorFaultUids}) {
+        const bool isIoBlocked = topN == &processData.topNIoBlockedUids;
+        writeVarint(topN->size(), &payload);
+        for (size_t i = 0; i < topN->size(); ++i) {
+            const auto& stats = (*topN)[i];
+            writeVarint(stats.userId, &payload);
+            writeString(stats.packageName, &payload);
+            writeVarint(stats.count, &payload);
+            if (isIoBlocked) {
+                writeVarint(i < processData.topNIoBlockedUidsTotalTaskCnt.size()
+                                    ? processData.topNIoBlockedUidsTotalTaskCnt[i]
+                                    : 0,
+                            &payload);
+            }
+            writeVarint(stats.topNProcesses.size(), &payload);
+            for (const auto& processStats : stats.topNProcesses) {
+                writeString(processStats.comm, &payload);
+                writeVarint(processStats.count, &payload);
+            }
+        }
+    }
+    writeVarint(processData.totalCpuTime, &payload);
+    writeVarint(processData.topNCpuTimeUids.size(), &payload);
+    for (const auto& stats : processData.topNCpuTimeUids) {
+        writeVarint(stats.userId, &payload);
+        writeString(stats.packageName, &payload);
+        writeVarint(stats.count, &payload);
+        writeVarint(stats.topNProcesses.size(), &payload);
+        for (const auto& processStats : stats.topNProcesses) {
+            writeString(processStats.comm, &payload);
+            writeVarint(processStats.count, &payload);
+        }
+    }
+
+    mHasLastRecord = true;
+    writeVarint(payload.size(), out);
+    out->append(payload);
+}
+
+void IoPerfHistoryEncoder::reset() {
+    mHasLastRecord = false;
+}
+
+void IoPerfHistoryEncoder::writeString(const std::string& value, std::string* out) {
+    const auto it = mStringTable.find(value);
+    if (it != mStringTable.end()) {
+        writeVarint(it->second + 1, out);
+        return;
+    }
+    mStringTable.emplace(value, mStringTable.size());
+    writeVarint(0, out);
+    writeVarint(value.size(), out);
+    out->append(value);
+}
+
+Result<void> IoPerfHistory::append(IoPerfHistoryRecordType type, const IoPerfRecord& record) {
+    Mutex::Autolock lock(mMutex);
+    if (mFd.get() == -1) {
+        auto ret = openLocked();
+        if (!ret) {
+            // /data is not available during early boot, so keep retrying on subsequent appends
+            // but report only the first failure.
+            if (mOpenFailed) {
+                return {};
+            }
+            mOpenFailed = true;
+            return Error() << "Failed to open I/O perf history file: " << ret.error();
+        }
+        mOpenFailed = false;
+    }
+    mBuffer.clear();
+    mEncoder.encode(type, record, &mBuffer);
+    if (mFileSize + mBuffer.size() > kMaxFileSize) {
+        auto ret = rotateLocked();
+        if (!ret) {
+            return Error() << "Failed to rotate I/O perf history file: " << ret.error();
+        }
+        mBuffer.clear();
+        mEncoder.encode(type, record, &mBuffer);
+    }
+    if (!WriteFully(mFd.get(), mBuffer.data(), mBuffer.size())) {
+        // The file may end with a partially written record. Start a new file on the next append
+        // so the partial record is the last one in the rotated file.
+        mFd.reset();
+        return ErrnoError() << "Failed to write to " << kPath;
+    }
+    mFileSize += mBuffer.size();
+    return {};
+}
+
+Result<void> IoPerfHistory::dump(int fd) {
+    Mutex::Autolock lock(mMutex);
+    char buffer[4096];
+    for (const auto& path : {oldFilePath(kPath), kPath}) {
+        unique_fd fileFd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (fileFd.get() == -1) {
+            if (errno == ENOENT) {
+                continue;
+            }
+            return ErrnoError() << "Failed to open " << path;
+        }
+        ssize_t size;
+        while ((size = TEMP_FAILURE_RETRY(read(fileFd.get(), buffer, sizeof(buffer)))) > 0) {
+            if (!WriteFully(fd, buffer, size)) {
+                return ErrnoError() << "Failed to write the contents of " << path;
+            }
+        }
+        if (size == -1) {
+            return ErrnoError() << "Failed to read " << path;
+        }
+    }
+    return {};
+}
+
+Result<void> IoPerfHistory::flush() {
+    Mutex::Autolock lock(mMutex);
+    if (mFd.get() != -1 && fsync(mFd.get()) != 0) {
+        return ErrnoError() << "Failed to sync " << kPath;
+    }
+    return {};
+}
+
+Result<void> IoPerfHistory::openLocked() {
+    // Keep the history from the previous carwatchdogd run in the rotated file. This also ensures
+    // a record partially written by a crashed run is never followed by a new record.
+    if (access(kPath.c_str(), F_OK) == 0) {
+        return rotateLocked();
+    }
+    mFd.reset(TEMP_FAILURE_RETRY(
+            open(kPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600)));
+    if (mFd.get() == -1) {
+        return ErrnoError() << "Failed to create " << kPath;
+    }
+    std::string header(kIoPerfHistoryMagic, kIoPerfHistoryMagicSize);
+    header.push_back(static_cast<char>(kIoPerfHistoryVersion));
+    if (!WriteFully(mFd.get(), header.data(), header.size())) {
+        mFd.reset();
+        return ErrnoError() << "Failed to write the header to " << kPath;
+    }
+    mFileSize = header.size();
+    mEncoder.reset();
+    return {};
+}
+
+Result<void> IoPerfHistory::rotateLocked() {
+    mFd.reset();
+    if (rename(kPath.c_str(), oldFilePath(kPath).c_str()) != 0) {
+        return ErrnoError() << "Failed to move " << kPath << " to " << oldFilePath(kPath);
+    }
+    return openLocked();
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_IOPERFHISTORY_H_
+#define WATCHDOG_SERVER_SRC_IOPERFHISTORY_H_
+
+#include <android-base/result.h>
+#include <android-base/unique_fd.h>
+#include <stdint.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+#include <string>
+#include <unordered_map>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+struct IoPerfRecord;
+
+constexpr const char* kIoPerfHistoryPath = "/data/misc/carwatchdog/ioperf_history";
+// Once the history file reaches this size, it is moved to |path| + ".old" and a new file is
+// started. Thus at most twice this size is used on disk.
+constexpr size_t kDefaultMaxIoPerfHistoryFileSize = 1024 * 1024;
+
+// Binary history file format. All integers are LEB128 varints and all signed values are zigzag
+// encoded. The decoder lives in packages/services/Car/tools/ioanalyze/ioperf_history.py and the
+// streaming summarizer in packages/services/Car/tools/ioanalyze/ioperf_analyze.cpp.
+//
+// File: kIoPerfHistoryMagic, version byte, then a sequence of records. Each record is a varint
+//       payload size followed by the payload.
+// Payload: type byte (|IoPerfHistoryRecordType|), flags byte (|kIoPerfHistoryDeltaFlag|), time,
+//       system I/O perf data, pressure perf data (since version 2), uid I/O perf data, and
+//       process I/O perf data in declaration order. The CPU time fields of the process I/O perf
+//       data are stored since version 3.
+//       |ProcessIoPerfData::majorFaultsPercentChange| is not stored as it is derived from
+//       consecutive |totalMajorFaults|.
+// Deltas: When the delta flag is set, the time and the system I/O perf data are stored as signed
+//       deltas from the previous record. Package names and commands are interned: a string is
+//       written as varint 0 followed by its length and bytes on first use, which assigns it the
+//       next index, and as (index + 1) afterwards. A record without the delta flag resets the
+//       string table.
+constexpr const char kIoPerfHistoryMagic[] = "CWIOHIST";
+constexpr uint8_t kIoPerfHistoryVersion = 3;
+constexpr uint8_t kIoPerfHistoryDeltaFlag = 1 << 0;
+
+enum IoPerfHistoryRecordType : uint8_t {
+    BOOT_TIME_RECORD = 1,
+    PERIODIC_RECORD = 2,
+};
+
+// Encodes I/O perf records relative to the previously encoded record.
+class IoPerfHistoryEncoder {
+public:
+    IoPerfHistoryEncoder() : mHasLastRecord(false), mLastTime(0), mLastSystemData{} {}
+
+    // Appends the framed encoding of |record| to |out|.
+    void encode(IoPerfHistoryRecordType type, const IoPerfRecord& record, std::string* out);
+
+    // Starts a new delta chain. The next encoded record is self-contained.
+    void reset();
+
+private:
+    void writeString(const std::string& value, std::string* out);
+
+    bool mHasLastRecord;
+    int64_t mLastTime;
+    uint64_t mLastSystemData[4];
+    std::unordered_map<std::string, uint64_t> mStringTable;
+};
+
+// Appends I/O perf records to a binary file so the history survives carwatchdogd restarts and can
+// be dumped without formatting each record.
+class IoPerfHistory : public RefBase {
+public:
+    explicit IoPerfHistory(const std::string& path = kIoPerfHistoryPath,
+                           size_t maxFileSize = kDefaultMaxIoPerfHistoryFileSize) :
+          kPath(path), kMaxFileSize(maxFileSize), mFileSize(0), mOpenFailed(false) {}
+
+    virtual ~IoPerfHistory() {}
+
+    // Appends |record| to the history file. The file is opened on the first append because
+    // carwatchdogd starts before /data is mounted.
+    virtual android::base::Result<void> append(IoPerfHistoryRecordType type,
+                                               const IoPerfRecord& record);
+
+    // Writes the raw contents of the rotated and the current history files to |fd|.
+    virtual android::base::Result<void> dump(int fd);
+
+    // Syncs the appended records to the storage. No-op when the file is not open.
+    virtual android::base::Result<void> flush();
+
+    std::string filePath() { return kPath; }
+
+private:
+    // Opens the history file for appending and writes the file header when the file is new.
+    android::base::Result<void> openLocked();
+
+    // Moves the current history file to |kPath| + ".old" and starts a new file.
+    android::base::Result<void> rotateLocked();
+
+    // Makes sure only one append or dump is running at any given time.
+    Mutex mMutex;
+
+    const std::string kPath;
+
+    const size_t kMaxFileSize;
+
+    android::base::unique_fd mFd GUARDED_BY(mMutex);
+
+    size_t mFileSize GUARDED_BY(mMutex);
+
+    // Set after the first open failure to avoid logging on every collection.
+    bool mOpenFailed GUARDED_BY(mMutex);
+
+    IoPerfHistoryEncoder mEncoder GUARDED_BY(mMutex);
+
+    // Reusable buffer for the encoded record.
+    std::string mBuffer GUARDED_BY(mMutex);
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_IOPERFHISTORY_H_
@@ -0,0 +1,187 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "carwatchdogd"
+
+#include "IoPerfRollup.h"
+
+#include <inttypes.h>
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "IoPerfCollection.h"
+#include "TopN.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+namespace {
+
+void mergeUidStats(const UidIoRollupStats& stats, std::map<std::pair<userid_t, std::string>,
+                                                           UidIoRollupStats>* uidStats) {
+    auto [it, inserted] =
+            uidStats->try_emplace(std::make_pair(stats.userId, stats.packageName), stats);
+    if (inserted) {
+        return;
+    }
+    for (int i = 0; i < UID_STATES; ++i) {
+        it->second.bytes[i] += stats.bytes[i];
+        it->second.fsync[i] += stats.fsync[i];
+    }
+}
+
+void selectTopN(size_t topNStats,
+                std::map<std::pair<userid_t, std::string>, UidIoRollupStats>* uidStats,
+                std::vector<UidIoRollupStats>* topN) {
+    TopN<UidIoRollupStats*> accumulator(topNStats);
+    for (auto& [key, stats] : *uidStats) {
+        accumulator.push(stats.bytes[FOREGROUND] + stats.bytes[BACKGROUND], &stats);
+    }
+    topN->clear();
+    for (const auto& entry : accumulator.sorted()) {
+        topN->emplace_back(std::move(*entry.value));
+    }
+    uidStats->clear();
+}
+
+void writeUidStats(const char* title, const std::vector<UidIoRollupStats>& topN,
+                   DumpWriter* writer) {
+    if (topN.empty()) {
+        return;
+    }
+    writer->appendF("%s (Android User ID, Package Name, Foreground Bytes, Foreground Fsync, "
+                    "Background Bytes, Background Fsync):\n",
+                    title);
+    for (const auto& stats : topN) {
+        writer->appendF("\t%" PRIu32 ", %s, %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 "\n",
+                        stats.userId, stats.packageName.c_str(), stats.bytes[FOREGROUND],
+                        stats.fsync[FOREGROUND], stats.bytes[BACKGROUND],
+                        stats.fsync[BACKGROUND]);
+    }
+}
+
+}  // namespace
+
+IoPerfRollup::IoPerfRollup(size_t topNStats, const std::vector<IoPerfRollupTierConfig>& tiers) :
+      kTopNStats(topNStats) {
+    for (const auto& config : tiers) {
+        mTiers.push_back(Tier{.config = config});
+    }
+}
+
+void IoPerfRollup::add(const IoPerfRecord& record) {
+    if (mTiers.empty()) {
+        return;
+    }
+    const UidIoPerfData& uidIoPerfData = record.uidIoPerfData;
+    IoPerfRollupRecord rollupRecord = {
+            .startTime = record.time,
+            .numRecords = 1,
+            .cpuIoWaitTime = record.systemIoPerfData.cpuIoWaitTime,
+            .totalCpuTime = record.systemIoPerfData.totalCpuTime,
+            .totalMajorFaults = record.processIoPerfData.totalMajorFaults,
+    };
+    std::copy(&uidIoPerfData.total[0][0], &uidIoPerfData.total[0][0] + METRIC_TYPES * UID_STATES,
+              &rollupRecord.total[0][0]);
+    for (const auto& [from, to] :
+         {std::make_pair(&uidIoPerfData.topNReads, &rollupRecord.topNReads),
+          std::make_pair(&uidIoPerfData.topNWrites, &rollupRecord.topNWrites)}) {
+        for (const auto& stats : *from) {
+            UidIoRollupStats& rollupStats = to->emplace_back();
+            rollupStats.userId = stats.userId;
+            rollupStats.packageName = stats.packageName;
+            std::copy(std::begin(stats.bytes), std::end(stats.bytes), rollupStats.bytes);
+            std::copy(std::begin(stats.fsync), std::end(stats.fsync), rollupStats.fsync);
+        }
+    }
+    addToTier(0, rollupRecord);
+}
+
+void IoPerfRollup::addToTier(size_t tierIndex, const IoPerfRollupRecord& record) {
+    Tier& tier = mTiers[tierIndex];
+    const time_t window = static_cast<time_t>(tier.config.window.count());
+    const time_t windowStart = record.startTime - record.startTime % window;
+    if (tier.pending.numRecords > 0 && tier.pending.startTime != windowStart) {
+        completeWindow(tierIndex);
+    }
+    IoPerfRollupRecord& pending = tier.pending;
+    if (pending.numRecords == 0) {
+        pending.startTime = windowStart;
+    }
+    pending.numRecords += record.numRecords;
+    for (int i = 0; i < METRIC_TYPES; ++i) {
+        for (int j = 0; j < UID_STATES; ++j) {
+            pending.total[i][j] += record.total[i][j];
+        }
+    }
+    pending.cpuIoWaitTime += record.cpuIoWaitTime;
+    pending.totalCpuTime += record.totalCpuTime;
+    pending.totalMajorFaults += record.totalMajorFaults;
+    for (const auto& stats : record.topNReads) {
+        mergeUidStats(stats, &tier.pendingReads);
+    }
+    for (const auto& stats : record.topNWrites) {
+        mergeUidStats(stats, &tier.pendingWrites);
+    }
+}
+
+void IoPerfRollup::completeWindow(size_t tierIndex) {
+    Tier& tier = mTiers[tierIndex];
+    selectTopN(kTopNStats, &tier.pendingReads, &tier.pending.topNReads);
+    selectTopN(kTopNStats, &tier.pendingWrites, &tier.pending.topNWrites);
+    if (tierIndex + 1 < mTiers.size()) {
+        addToTier(tierIndex + 1, tier.pending);
+    }
+    tier.records.push(&tier.pending, tier.config.maxRecords);
+    tier.pending = {};
+}
+
+void IoPerfRollup::writeTo(DumpWriter* writer) const {
+    for (const auto& tier : mTiers) {
+        const auto window =
+                std::chrono::duration_cast<std::chrono::minutes>(tier.config.window).count();
+        writer->appendF("\nRollup of %lld minute%s:\n%s\nNumber of windows: %zu\n",
+                        static_cast<long long>(window), window > 1 ? "s" : "",
+                        std::string(30, '=').c_str(), tier.records.size());
+        for (size_t i = tier.records.size(); i > 0; --i) {
+            const IoPerfRollupRecord& record = tier.records[i - 1];
+            std::stringstream timestamp;
+            timestamp << std::put_time(std::localtime(&record.startTime), "%c %Z");
+            writer->appendF("Window <%s>, %zu collections\n", timestamp.str().c_str(),
+                            record.numRecords);
+            writer->appendF("Read bytes (foreground / background): %" PRIu64 " / %" PRIu64 "\n",
+                            record.total[READ_BYTES][FOREGROUND],
+                            record.total[READ_BYTES][BACKGROUND]);
+            writer->appendF("Write bytes (foreground / background): %" PRIu64 " / %" PRIu64 "\n",
+                            record.total[WRITE_BYTES][FOREGROUND],
+                            record.total[WRITE_BYTES][BACKGROUND]);
+            writer->appendF("CPU I/O wait time / total CPU time: %" PRIu64 " / %" PRIu64 "\n",
+                            record.cpuIoWaitTime, record.totalCpuTime);
+            writer->appendF("Number of major page faults: %" PRIu64 "\n",
+                            record.totalMajorFaults);
+            writeUidStats("Top N Reads", record.topNReads, writer);
+            writeUidStats("Top N Writes", record.topNWrites, writer);
+        }
+    }
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef WATCHDOG_SERVER_SRC_IOPERFROLLUP_H_
+#define WATCHDOG_SERVER_SRC_IOPERFROLLUP_H_
+
+#include <cutils/multiuser.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DumpWriter.h"
+#include "RingBuffer.h"
+#include "UidIoStats.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+struct IoPerfRecord;
+
+// I/O usage of a UID summed over the records of a rollup window.
+struct UidIoRollupStats {
+    userid_t userId = 0;
+    std::string packageName;
+    uint64_t bytes[UID_STATES] = {0};
+    uint64_t fsync[UID_STATES] = {0};
+};
+
+// Aggregate of the periodic records collected during a window. Holds only the counters and the
+// top N reading and writing UIDs, so a rollup record is a fraction of the size of a periodic
+// record.
+struct IoPerfRollupRecord {
+    time_t startTime = 0;   // Start of the window, aligned to the window length.
+    size_t numRecords = 0;  // Number of periodic records aggregated into this record.
+    uint64_t total[METRIC_TYPES][UID_STATES] = {{0}};
+    uint64_t cpuIoWaitTime = 0;
+    uint64_t totalCpuTime = 0;
+    uint64_t totalMajorFaults = 0;
+    // UIDs with the most read or write bytes over the window. As the periodic records hold only
+    // their top N UIDs, the I/O of a UID in the samples where it wasn't among the top N is not
+    // included.
+    std::vector<UidIoRollupStats> topNReads;
+    std::vector<UidIoRollupStats> topNWrites;
+};
+
+struct IoPerfRollupTierConfig {
+    std::chrono::seconds window;  // Length of the window aggregated into one record.
+    size_t maxRecords;            // Number of records kept by the tier.
+};
+
+// The periodic collection keeps 10 second records for 30 minutes. The rollups extend the history
+// with 1 minute records for 6 hours and 10 minute records for a week.
+const std::vector<IoPerfRollupTierConfig> kDefaultIoPerfRollupTiers = {
+        {std::chrono::minutes(1), 360},
+        {std::chrono::minutes(10), 1008},
+};
+
+// Rolls the periodic records up into tiers of increasingly coarse windows. Each tier aggregates
+// the windows of the previous tier, and the first tier aggregates the periodic records, so a
+// record is merged once per tier no matter how long the history is. Not thread-safe. The owner
+// serializes the calls.
+class IoPerfRollup {
+public:
+    IoPerfRollup(size_t topNStats,
+                 const std::vector<IoPerfRollupTierConfig>& tiers = kDefaultIoPerfRollupTiers);
+
+    // Adds a periodic record. Its window in each tier is picked from |record.time|. A record for a
+    // new window completes the pending window of the tier.
+    void add(const IoPerfRecord& record);
+
+    // Writes the completed records of all the tiers, newest first.
+    void writeTo(DumpWriter* writer) const;
+
+    size_t numTiers() const { return mTiers.size(); }
+
+    // Completed records of |tier|, where index 0 is the oldest record.
+    const RingBuffer<IoPerfRollupRecord>& records(size_t tier) const {
+        return mTiers[tier].records;
+    }
+
+private:
+    using UidKey = std::pair<userid_t, std::string>;
+
+    struct Tier {
+        IoPerfRollupTierConfig config;
+        RingBuffer<IoPerfRollupRecord> records;
+        // Window being aggregated. Empty when |pending.numRecords| is 0.
+        IoPerfRollupRecord pending;
+        std::map<UidKey, UidIoRollupStats> pendingReads;
+        std::map<UidKey, UidIoRollupStats> pendingWrites;
+    };
+
+    void addToTier(size_t tierIndex, const IoPerfRollupRecord& record);
+    void completeWindow(size_t tierIndex);
+
+    const size_t kTopNStats;
+    std::vector<Tier> mTiers;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_IOPERFROLLUP_H_
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "MediatorHealthChannel.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <log/log.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <new>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::ErrnoError;
+using android::base::Result;
+using android::base::unique_fd;
+
+namespace {
+
+// Torn reads are retried a few times before dropping the report, so a stalled mediator can't
+// stall the health check.
+constexpr int kMaxReadAttempts = 3;
+
+bool readReport(const HealthReport& report, MediatorHealthReport* out) {
+    for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+        const uint32_t sequence = report.sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            continue;
+        }
+        out->sessionId = report.sessionId.load(std::memory_order_relaxed);
+        const uint32_t numClients = std::min(report.numClientsNotResponding.load(
+                                                     std::memory_order_relaxed),
+                                             kMaxClientsNotResponding);
+        out->clientsNotResponding.resize(numClients);
+        for (uint32_t i = 0; i < numClients; ++i) {
+            out->clientsNotResponding[i] =
+                    report.clientsNotResponding[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (report.sequence.load(std::memory_order_relaxed) == sequence) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+Result<std::unique_ptr<MediatorHealthChannel>> MediatorHealthChannel::create() {
+    unique_fd fd(memfd_create("carwatchdog_health_channel", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (fd.get() == -1) {
+        return ErrnoError() << "Failed to create the health channel memfd";
+    }
+    if (ftruncate(fd.get(), sizeof(HealthChannelLayout)) != 0) {
+        return ErrnoError() << "Failed to size the health channel memfd";
+    }
+    // The mediator maps the memory too, so the size must not change under either process.
+    if (fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        return ErrnoError() << "Failed to seal the health channel memfd";
+    }
+    void* addr = mmap(nullptr, sizeof(HealthChannelLayout), PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd.get(), 0);
+    if (addr == MAP_FAILED) {
+        return ErrnoError() << "Failed to map the health channel memfd";
+    }
+    // The memfd is zero-filled, which is the initial state of all the atomics.
+    HealthChannelLayout* layout = new (addr) HealthChannelLayout;
+    layout->magic = kHealthChannelMagic;
+    layout->version = kHealthChannelVersion;
+    return std::unique_ptr<MediatorHealthChannel>(
+            new MediatorHealthChannel(std::move(fd), layout));
+}
+
+MediatorHealthChannel::~MediatorHealthChannel() {
+    munmap(mLayout, sizeof(HealthChannelLayout));
+}
+
+Result<unique_fd> MediatorHealthChannel::dupFd() const {
+    unique_fd fd(fcntl(mFd.get(), F_DUPFD_CLOEXEC, 0));
+    if (fd.get() == -1) {
+        return ErrnoError() << "Failed to duplicate the health channel fd";
+    }
+    return fd;
+}
+
+void MediatorHealthChannel::ping(int32_t sessionId) {
+    mLayout->pingSessionId.store(sessionId, std::memory_order_relaxed);
+    mLayout->pingEpoch.fetch_add(1, std::memory_order_release);
+    // The memory is shared with another process, so the futex must not be private.
+    if (syscall(SYS_futex, &mLayout->pingEpoch, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0) < 0) {
+        ALOGW("Failed to wake up the mediator for session %d: %s", sessionId, strerror(errno));
+    }
+}
+
+std::vector<MediatorHealthReport> MediatorHealthChannel::takeReports() {
+    const uint32_t head = mLayout->reportHead.load(std::memory_order_acquire);
+    if (head - mReadHead > kNumHealthReports) {
+        // The older reports were overwritten. Unsigned arithmetic handles the head wrapping.
+        mReadHead = head - kNumHealthReports;
+    }
+    std::vector<MediatorHealthReport> reports;
+    for (; mReadHead != head; ++mReadHead) {
+        MediatorHealthReport report;
+        if (readReport(mLayout->reports[mReadHead % kNumHealthReports], &report)) {
+            reports.emplace_back(std::move(report));
+        } else {
+            ALOGW("Dropped a health report that the mediator is still writing");
+        }
+    }
+    return reports;
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
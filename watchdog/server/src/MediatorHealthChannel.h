@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_MEDIATORHEALTHCHANNEL_H_
+#define WATCHDOG_SERVER_SRC_MEDIATORHEALTHCHANNEL_H_
+
+#include <android-base/result.h>
+#include <android-base/unique_fd.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+constexpr uint32_t kHealthChannelMagic = 0x43574843;  // "CWHC"
+constexpr uint32_t kHealthChannelVersion = 1;
+constexpr uint32_t kNumHealthReports = 8;
+constexpr uint32_t kMaxClientsNotResponding = 64;
+
+// Liveness report written by the mediator. |sequence| is odd while the mediator writes the
+// report, so the server retries or drops the torn reads.
+struct HealthReport {
+    std::atomic<uint32_t> sequence;
+    std::atomic<int32_t> sessionId;
+    std::atomic<uint32_t> numClientsNotResponding;
+    std::atomic<int32_t> clientsNotResponding[kMaxClientsNotResponding];
+};
+
+// Layout of the shared memory. The server publishes each ping by storing |pingSessionId| and
+// incrementing |pingEpoch|, then wakes the futex waiters on |pingEpoch|. The mediator writes its
+// response to |reports[reportHead % kNumHealthReports]| and increments |reportHead|.
+struct HealthChannelLayout {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> pingEpoch;
+    std::atomic<int32_t> pingSessionId;
+    std::atomic<uint32_t> reportHead;
+    HealthReport reports[kNumHealthReports];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                      std::atomic<int32_t>::is_always_lock_free,
+              "Atomics shared between processes must be lock-free");
+
+struct MediatorHealthReport {
+    int32_t sessionId = 0;
+    std::vector<int32_t> clientsNotResponding;
+};
+
+// Shared-memory ring carrying the pings to the mediator and its liveness reports back, so the
+// health checks of the mediator don't wait on binder transactions. The ring is a sealed memfd
+// created once per mediator. Not thread-safe; the callers serialize the access.
+class MediatorHealthChannel {
+public:
+    static android::base::Result<std::unique_ptr<MediatorHealthChannel>> create();
+
+    ~MediatorHealthChannel();
+
+    // Returns a new fd of the shared memory for the mediator.
+    android::base::Result<android::base::unique_fd> dupFd() const;
+
+    // Publishes |sessionId| and wakes up the mediator.
+    void ping(int32_t sessionId);
+
+    // Returns the reports written since the last call, oldest first. When the mediator has
+    // written more than |kNumHealthReports| reports in the meantime, only the latest are kept.
+    std::vector<MediatorHealthReport> takeReports();
+
+private:
+    MediatorHealthChannel(android::base::unique_fd fd, HealthChannelLayout* layout) :
+          mFd(std::move(fd)), mLayout(layout), mReadHead(0) {}
+
+    const android::base::unique_fd mFd;
+    HealthChannelLayout* const mLayout;
+    // Number of reports read from the ring.
+    uint32_t mReadHead;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  // WATCHDOG_SERVER_SRC_MEDIATORHEALTHCHANNEL_H_
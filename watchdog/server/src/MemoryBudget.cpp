@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "MemoryBudget.h"
+
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::Error;
+using android::base::Result;
+using android::base::StringPrintf;
+
+std::string toString(MemoryBudgetLevel level) {
+    switch (level) {
+        case MemoryBudgetLevel::FULL_RECORDS:
+            return "FULL_RECORDS";
+        case MemoryBudgetLevel::DROP_SUBCATEGORIES:
+            return "DROP_SUBCATEGORIES";
+        case MemoryBudgetLevel::COUNTERS_ONLY:
+            return "COUNTERS_ONLY";
+        default:
+            return "INVALID";
+    }
+}
+
+MemoryBudgetLevel MemoryBudget::update(bool isUnderMemoryPressure) {
+    if (const auto& rss = readRssBytes(); rss) {
+        mRssBytes = *rss;
+    } else {
+        // Keep the last RSS so a transient read failure doesn't restore the detailed records.
+        ALOGW("Failed to read the RSS of carwatchdogd: %s", rss.error().message().c_str());
+    }
+    MemoryBudgetLevel target = FULL_RECORDS;
+    if (mRssBytes >= kConfig.rssLimitBytes) {
+        target = COUNTERS_ONLY;
+    } else if (isUnderMemoryPressure) {
+        target = mLevel >= DROP_SUBCATEGORIES ? COUNTERS_ONLY : DROP_SUBCATEGORIES;
+    } else if (mRssBytes >= kConfig.rssLimitBytes * kDropSubcategoriesRssFraction) {
+        target = DROP_SUBCATEGORIES;
+    }
+    if (target >= mLevel) {
+        mLevel = target;
+        mRecoveringCollections = 0;
+        return mLevel;
+    }
+    if (++mRecoveringCollections >= kRecoveryCollections) {
+        mLevel = static_cast<MemoryBudgetLevel>(mLevel - 1);
+        mRecoveringCollections = 0;
+    }
+    return mLevel;
+}
+
+size_t MemoryBudget::cacheSize(size_t maxCacheSize) const {
+    switch (mLevel) {
+        case DROP_SUBCATEGORIES:
+            return std::max<size_t>(std::min(maxCacheSize, kConfig.cacheSize / 2), 1);
+        case COUNTERS_ONLY:
+            return std::max<size_t>(std::min(maxCacheSize, kConfig.cacheSize / 4), 1);
+        default:
+            return maxCacheSize;
+    }
+}
+
+std::string MemoryBudget::toString() const {
+    return StringPrintf("Memory budget level: %s, RSS: %" PRIu64 " / %" PRIu64 " KiB\n",
+                        watchdog::toString(mLevel).c_str(), mRssBytes / 1024,
+                        kConfig.rssLimitBytes / 1024);
+}
+
+Result<uint64_t> MemoryBudget::readRssBytes() {
+    // /proc/self/statm format: <size> <resident> <shared> <text> <lib> <data> <dirty>, in pages.
+    if (const auto& ret = mReader.read(kStatmPath); !ret) {
+        return Error() << ret.error();
+    }
+    Tokenizer fields(mReader.contents(), ' ');
+    std::string_view field;
+    uint64_t residentPages = 0;
+    if (!fields.next(&field) || !fields.next(&field) || !parseNumber(field, &residentPages)) {
+        return Error() << "Invalid contents in " << kStatmPath << ": \"" << mReader.contents()
+                       << "\"";
+    }
+    return residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
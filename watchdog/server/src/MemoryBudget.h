@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_MEMORYBUDGET_H_
+#define WATCHDOG_SERVER_SRC_MEMORYBUDGET_H_
+
+#include <android-base/result.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "ProcFileReader.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+constexpr const char* kSelfStatmPath = "/proc/self/statm";
+
+// Detail kept in the collection records, from the most to the least detailed.
+enum MemoryBudgetLevel {
+    // Records hold all the collected data.
+    FULL_RECORDS = 0,
+    // Records drop the per-process details of the top N UIDs and the per-thread details of the
+    // top N processes.
+    DROP_SUBCATEGORIES,
+    // Records hold only the system-wide counters and totals.
+    COUNTERS_ONLY,
+};
+
+std::string toString(MemoryBudgetLevel level);
+
+struct MemoryBudgetConfig {
+    // RSS of carwatchdogd in bytes the collection tries to stay under.
+    uint64_t rssLimitBytes;
+    // Cache size of the periodic collection. The record caches are cut to a fraction of this size
+    // while the records drop their details.
+    size_t cacheSize;
+};
+
+// Picks how much detail the collection records keep, and how many of them are cached, from the
+// RSS of carwatchdogd and the system memory pressure. The records drop their sub-category details
+// as soon as the RSS nears |rssLimitBytes| or the system is under memory pressure, and keep only
+// the counters once the RSS reaches |rssLimitBytes| or the pressure lasts for another collection.
+// They regain one level of detail only after |kRecoveryCollections| consecutive collections
+// below the thresholds of the current level, so the level doesn't flap around a threshold.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(const MemoryBudgetConfig& config,
+                          const std::string& statmPath = kSelfStatmPath) :
+          kConfig(config),
+          kStatmPath(statmPath),
+          mLevel(FULL_RECORDS),
+          mRssBytes(0),
+          mRecoveringCollections(0) {}
+
+    // Updates the level after a collection. |isUnderMemoryPressure| is true when the memory PSI
+    // stall crossed its threshold since the last collection.
+    MemoryBudgetLevel update(bool isUnderMemoryPressure);
+
+    // Returns the number of records a collection with |maxCacheSize| should keep at the current
+    // level.
+    size_t cacheSize(size_t maxCacheSize) const;
+
+    MemoryBudgetLevel level() const { return mLevel; }
+
+    // RSS read by the last update.
+    uint64_t rssBytes() const { return mRssBytes; }
+
+    std::string toString() const;
+
+    // Fraction of |rssLimitBytes| above which the records drop their sub-category details.
+    static constexpr double kDropSubcategoriesRssFraction = 0.75;
+    static constexpr size_t kRecoveryCollections = 3;
+
+private:
+    // Returns the resident set size from the statm file at |kStatmPath|.
+    android::base::Result<uint64_t> readRssBytes();
+
+    const MemoryBudgetConfig kConfig;
+    const std::string kStatmPath;
+
+    // Reusable buffer for the contents of the statm file, so reading the RSS under memory
+    // pressure doesn't allocate.
+    ProcFileReader mReader;
+
+    MemoryBudgetLevel mLevel;
+    uint64_t mRssBytes;
+
+    // Consecutive collections that observed less pressure than the current level allows for.
+    size_t mRecoveringCollections;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_MEMORYBUDGET_H_
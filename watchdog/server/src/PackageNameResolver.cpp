@@ -0,0 +1,241 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "PackageNameResolver.h"
+
+#include <android-base/file.h>
+#include <binder/IServiceManager.h>
+#include <cutils/android_filesystem_config.h>
+#include <cutils/multiuser.h>
+#include <log/log.h>
+#include <pwd.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ProcFileReader.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::defaultServiceManager;
+using android::IBinder;
+using android::IServiceManager;
+using android::sp;
+using android::String16;
+using android::base::Error;
+using android::base::ReadFileToString;
+using android::base::Result;
+using android::content::pm::IPackageManagerNative;
+
+std::unordered_map<uint32_t, std::string> PackageNameResolver::getPackageNames(
+        const std::unordered_set<uint32_t>& uids) {
+    Mutex::Autolock lock(mMutex);
+    std::unordered_map<uint32_t, std::string> packageNames;
+    std::vector<int32_t> appUids;
+    const nsecs_t negativeEntryExpiryTime = now() + kNegativeEntryTtl.count();
+    // Drops the cached app package names when the package list changed, so a single stat call per
+    // lookup keeps the cache in sync with package installs and updates.
+    reloadPackagesListLocked();
+    for (const auto& uid : uids) {
+        if (const CacheEntry* entry = lookupLocked(uid); entry != nullptr) {
+            if (!entry->packageName.empty()) {
+                packageNames[uid] = entry->packageName;
+            }
+            continue;
+        }
+        if (uid < AID_APP_START) {
+            // System/native UIDs.
+            passwd* usrpwd = getpwuid(uid);
+            if (usrpwd == nullptr) {
+                insertLocked(uid, "", negativeEntryExpiryTime);
+                continue;
+            }
+            insertLocked(uid, usrpwd->pw_name, 0);
+            packageNames[uid] = usrpwd->pw_name;
+            continue;
+        }
+        if (const auto it = mPackagesListNames.find(multiuser_get_app_id(uid));
+            it != mPackagesListNames.end()) {
+            insertLocked(uid, it->second, 0);
+            packageNames[uid] = it->second;
+            continue;
+        }
+        appUids.emplace_back(static_cast<int32_t>(uid));
+    }
+    if (appUids.empty()) {
+        return packageNames;
+    }
+    const auto& names = getNamesFromPackageManagerLocked(appUids);
+    if (!names) {
+        // Don't cache the UIDs as negative entries so they are resolved once the package manager
+        // is available.
+        ALOGW("%s", names.error().message().c_str());
+        return packageNames;
+    }
+    for (size_t i = 0; i < appUids.size() && i < names->size(); ++i) {
+        const std::string& name = (*names)[i];
+        insertLocked(appUids[i], name, name.empty() ? negativeEntryExpiryTime : 0);
+        if (!name.empty()) {
+            packageNames[appUids[i]] = name;
+        }
+    }
+    return packageNames;
+}
+
+std::unordered_set<uint32_t> PackageNameResolver::getAppIds(
+        const std::unordered_set<std::string>& packageNames) {
+    Mutex::Autolock lock(mMutex);
+    reloadPackagesListLocked();
+    std::unordered_set<uint32_t> appIds;
+    for (const auto& packageName : packageNames) {
+        if (const auto it = mPackagesListAppIds.find(packageName);
+            it != mPackagesListAppIds.end()) {
+            appIds.insert(it->second);
+            continue;
+        }
+        // System/native package names are the user names of their UIDs.
+        if (passwd* usrpwd = getpwnam(packageName.c_str()); usrpwd != nullptr) {
+            appIds.insert(multiuser_get_app_id(usrpwd->pw_uid));
+        }
+    }
+    return appIds;
+}
+
+Result<std::vector<std::string>> PackageNameResolver::getNamesFromPackageManagerLocked(
+        const std::vector<int32_t>& uids) {
+    if (mPackageManager == nullptr) {
+        if (now() < mPackageManagerRetryTime) {
+            return Error() << "Skipping package name lookup until package manager is available";
+        }
+        const sp<IServiceManager> sm = defaultServiceManager();
+        if (sm == nullptr) {
+            return Error() << "Failed to retrieve defaultServiceManager";
+        }
+        // Don't use getService as it blocks for several seconds when the service hasn't started.
+        sp<IBinder> binder = sm->checkService(String16("package_native"));
+        if (binder == nullptr) {
+            mPackageManagerRetryTime = now() + kPackageManagerRetryInterval.count();
+            return Error() << "Failed to get service package_native";
+        }
+        mPackageManager = interface_cast<IPackageManagerNative>(binder);
+    }
+    std::vector<std::string> packageNames;
+    const binder::Status& status = mPackageManager->getNamesForUids(uids, &packageNames);
+    if (!status.isOk()) {
+        // The package manager may have died. Retrieve it again on the next lookup.
+        mPackageManager = nullptr;
+        return Error() << "package_native::getNamesForUids failed: " << status.exceptionMessage();
+    }
+    return packageNames;
+}
+
+const PackageNameResolver::CacheEntry* PackageNameResolver::lookupLocked(uint32_t uid) {
+    auto it = mCache.find(uid);
+    if (it == mCache.end()) {
+        return nullptr;
+    }
+    if (it->second.expiryTime != 0 && it->second.expiryTime <= now()) {
+        mLruOrder.erase(it->second.lruPosition);
+        mCache.erase(it);
+        return nullptr;
+    }
+    mLruOrder.splice(mLruOrder.begin(), mLruOrder, it->second.lruPosition);
+    return &it->second;
+}
+
+void PackageNameResolver::insertLocked(uint32_t uid, const std::string& packageName,
+                                       nsecs_t expiryTime) {
+    if (auto it = mCache.find(uid); it != mCache.end()) {
+        it->second.packageName = packageName;
+        it->second.expiryTime = expiryTime;
+        mLruOrder.splice(mLruOrder.begin(), mLruOrder, it->second.lruPosition);
+        return;
+    }
+    mLruOrder.push_front(uid);
+    mCache[uid] = CacheEntry{
+            .packageName = packageName,
+            .expiryTime = expiryTime,
+            .lruPosition = mLruOrder.begin(),
+    };
+    while (mCache.size() > kMaxCacheSize) {
+        mCache.erase(mLruOrder.back());
+        mLruOrder.pop_back();
+    }
+}
+
+void PackageNameResolver::reloadPackagesListLocked() {
+    struct stat st;
+    if (stat(kPackagesListPath.c_str(), &st) != 0) {
+        return;
+    }
+    if (st.st_mtim.tv_sec == mPackagesListMtime.tv_sec &&
+        st.st_mtim.tv_nsec == mPackagesListMtime.tv_nsec) {
+        return;
+    }
+    std::string contents;
+    if (!ReadFileToString(kPackagesListPath, &contents)) {
+        ALOGW("Failed to read %s", kPackagesListPath.c_str());
+        return;
+    }
+    mPackagesListMtime = st.st_mtim;
+    // Each line has the format "<package name> <app id> <debuggable> <data dir> ...".
+    std::unordered_map<uint32_t, std::string> packagesListNames;
+    std::unordered_map<std::string, uint32_t> packagesListAppIds;
+    std::unordered_set<uint32_t> sharedAppIds;
+    Tokenizer lines(contents, '\n');
+    std::string_view line;
+    while (lines.next(&line)) {
+        Tokenizer fields(line, ' ');
+        std::string_view packageName;
+        std::string_view appIdField;
+        uint32_t appId;
+        if (!fields.next(&packageName) || !fields.next(&appIdField) ||
+            !parseNumber(appIdField, &appId) || packageName.empty()) {
+            continue;
+        }
+        packagesListAppIds.emplace(packageName, appId);
+        if (!packagesListNames.try_emplace(appId, packageName).second) {
+            sharedAppIds.insert(appId);
+        }
+    }
+    for (const auto& appId : sharedAppIds) {
+        packagesListNames.erase(appId);
+    }
+    mPackagesListNames = std::move(packagesListNames);
+    mPackagesListAppIds = std::move(packagesListAppIds);
+    // Cached app package names may be stale after package updates. Names from the package manager
+    // are fetched again on the next lookup.
+    for (auto it = mCache.begin(); it != mCache.end();) {
+        if (it->first >= AID_APP_START) {
+            mLruOrder.erase(it->second.lruPosition);
+            it = mCache.erase(it);
+            continue;
+        }
+        ++it;
+    }
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_PACKAGENAMERESOLVER_H_
+#define WATCHDOG_SERVER_SRC_PACKAGENAMERESOLVER_H_
+
+#include <android-base/chrono_utils.h>
+#include <android-base/result.h>
+#include <android/content/pm/IPackageManagerNative.h>
+#include <gtest/gtest_prod.h>
+#include <stdint.h>
+#include <time.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+constexpr const char* kDefaultPackagesListPath = "/data/system/packages.list";
+
+// Resolves UIDs to package names for the I/O performance reports.
+//
+// Resolved names are kept in an LRU cache. Native UIDs are resolved with getpwuid. App UIDs are
+// resolved from `/data/system/packages.list`, which is reloaded whenever it changes, and the
+// remaining app UIDs are resolved with a single package_native::getNamesForUids call. UIDs
+// without a package name are cached as negative entries for |kNegativeEntryTtl| so they are not
+// looked up on every collection.
+class PackageNameResolver : public RefBase {
+public:
+    explicit PackageNameResolver(
+            const std::string& packagesListPath = kDefaultPackagesListPath,
+            size_t maxCacheSize = kDefaultMaxCacheSize) :
+          kPackagesListPath(packagesListPath),
+          kMaxCacheSize(maxCacheSize),
+          mPackagesListMtime({}),
+          mPackageManagerRetryTime(0) {}
+
+    virtual ~PackageNameResolver() {}
+
+    // Returns the package names for the given |uids|. UIDs without a known package name are
+    // omitted from the result.
+    virtual std::unordered_map<uint32_t, std::string> getPackageNames(
+            const std::unordered_set<uint32_t>& uids);
+
+    // Returns the app IDs of the given |packageNames|. Native package names are resolved with
+    // getpwnam and app package names from `/data/system/packages.list`, so every user's UID of a
+    // package shares the returned app ID. Unknown package names are omitted from the result.
+    virtual std::unordered_set<uint32_t> getAppIds(
+            const std::unordered_set<std::string>& packageNames);
+
+    static constexpr size_t kDefaultMaxCacheSize = 2048;
+    static constexpr std::chrono::nanoseconds kNegativeEntryTtl = 1min;
+    static constexpr std::chrono::nanoseconds kPackageManagerRetryInterval = 5s;
+
+protected:
+    // Current monotonic time. Overridden by tests.
+    virtual nsecs_t now() { return systemTime(SYSTEM_TIME_MONOTONIC); }
+
+    // Returns the names of the given app |uids| from the package manager. Names are empty for UIDs
+    // unknown to the package manager. Overridden by tests.
+    virtual android::base::Result<std::vector<std::string>> getNamesFromPackageManagerLocked(
+            const std::vector<int32_t>& uids);
+
+private:
+    struct CacheEntry {
+        std::string packageName;  // Empty for negative entries.
+        nsecs_t expiryTime;       // 0 for entries that don't expire.
+        std::list<uint32_t>::iterator lruPosition;
+    };
+
+    // Returns the cache entry for |uid| when present and not expired and marks it as the most
+    // recently used entry. Otherwise, returns nullptr.
+    const CacheEntry* lookupLocked(uint32_t uid);
+
+    // Adds or replaces the cache entry for |uid| and evicts the least recently used entries beyond
+    // |kMaxCacheSize|.
+    void insertLocked(uint32_t uid, const std::string& packageName, nsecs_t expiryTime);
+
+    // Reloads |mPackagesListNames| when |kPackagesListPath| changed since the last load.
+    void reloadPackagesListLocked();
+
+    // Makes sure only one resolution is running at any given time.
+    Mutex mMutex;
+
+    const std::string kPackagesListPath;
+
+    const size_t kMaxCacheSize;
+
+    std::unordered_map<uint32_t, CacheEntry> mCache GUARDED_BY(mMutex);
+
+    // UIDs in the order of their last use. The front is the most recently used UID.
+    std::list<uint32_t> mLruOrder GUARDED_BY(mMutex);
+
+    // App ID to package name mapping loaded from |kPackagesListPath|. App IDs shared by multiple
+    // packages are omitted because the package manager reports their shared user name instead.
+    std::unordered_map<uint32_t, std::string> mPackagesListNames GUARDED_BY(mMutex);
+
+    // Package name to app ID mapping loaded from |kPackagesListPath|, including the packages that
+    // share their app ID.
+    std::unordered_map<std::string, uint32_t> mPackagesListAppIds GUARDED_BY(mMutex);
+
+    // Last modification time of |kPackagesListPath| when it was loaded.
+    timespec mPackagesListMtime GUARDED_BY(mMutex);
+
+    // Package manager connection. Retrieved lazily as it is unavailable early in boot.
+    android::sp<android::content::pm::IPackageManagerNative> mPackageManager GUARDED_BY(mMutex);
+
+    // Earliest time to retry retrieving the package manager after a failure.
+    nsecs_t mPackageManagerRetryTime GUARDED_BY(mMutex);
+
+    FRIEND_TEST(PackageNameResolverTest, TestEvictsLeastRecentlyUsedEntries);
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_PACKAGENAMERESOLVER_H_
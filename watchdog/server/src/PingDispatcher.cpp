@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "PingDispatcher.h"
+
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+#include <log/log.h>
+
+#include <algorithm>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringAppendF;
+
+void LatencyHistogram::record(nsecs_t latency) {
+    const int64_t millis = ns2ms(latency);
+    const auto it = std::find_if(kBucketBoundsMillis.begin(), kBucketBoundsMillis.end(),
+                                 [&](int64_t bound) { return millis < bound; });
+    ++mCounts[std::distance(kBucketBoundsMillis.begin(), it)];
+    ++mTotal;
+    mMax = std::max(mMax, latency);
+}
+
+std::string LatencyHistogram::toString() const {
+    std::string buffer;
+    for (size_t i = 0; i < kBucketBoundsMillis.size(); ++i) {
+        StringAppendF(&buffer, "<%" PRId64 "ms: %" PRIu64 ", ", kBucketBoundsMillis[i],
+                      mCounts[i]);
+    }
+    StringAppendF(&buffer, ">=%" PRId64 "ms: %" PRIu64 ", max: %" PRId64 "ms",
+                  kBucketBoundsMillis.back(), mCounts.back(), ns2ms(mMax));
+    return buffer;
+}
+
+PingDispatcher::PingDispatcher(size_t numThreads) : mTerminated(false) {
+    for (size_t i = 0; i < numThreads; ++i) {
+        mThreads.emplace_back(&PingDispatcher::run, this);
+    }
+}
+
+PingDispatcher::~PingDispatcher() {
+    terminate();
+}
+
+bool PingDispatcher::dispatch(IBinder* binder, pid_t pid, int32_t sessionId,
+                              std::function<void()> ping) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTerminated) {
+            return false;
+        }
+        ClientState& state = mClients[binder];
+        if (state.inFlight) {
+            return false;
+        }
+        state.pid = pid;
+        state.inFlight = true;
+        state.sessionId = sessionId;
+        state.sentUptime = 0;
+        mTasks.push_back(Task{binder, std::move(ping)});
+    }
+    mCondition.notify_one();
+    return true;
+}
+
+void PingDispatcher::onPingResponded(IBinder* binder, int32_t sessionId) {
+    onPingResponded(binder, sessionId, now());
+}
+
+void PingDispatcher::onPingResponded(IBinder* binder, int32_t sessionId,
+                                     nsecs_t respondedUptime) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mClients.find(binder);
+    if (it == mClients.end() || it->second.sessionId != sessionId ||
+        it->second.sentUptime == 0) {
+        return;
+    }
+    it->second.histogram.record(std::max<nsecs_t>(respondedUptime - it->second.sentUptime, 0));
+    it->second.sentUptime = 0;
+}
+
+void PingDispatcher::remove(IBinder* binder) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mClients.erase(binder);
+}
+
+std::string PingDispatcher::dump(const char* indent) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::string buffer;
+    for (const auto& [binder, state] : mClients) {
+        StringAppendF(&buffer, "%spid = %d, in flight: %s, %s\n", indent, state.pid,
+                      state.inFlight ? "true" : "false", state.histogram.toString().c_str());
+    }
+    return buffer;
+}
+
+void PingDispatcher::terminate() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTerminated) {
+            return;
+        }
+        mTerminated = true;
+        mTasks.clear();
+    }
+    mCondition.notify_all();
+    for (auto& thread : mThreads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+void PingDispatcher::run() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [&]() { return mTerminated || !mTasks.empty(); });
+            if (mTerminated) {
+                return;
+            }
+            task = std::move(mTasks.front());
+            mTasks.pop_front();
+            auto it = mClients.find(task.binder);
+            if (it == mClients.end()) {
+                // The client was removed after the ping was queued.
+                continue;
+            }
+            it->second.sentUptime = now();
+        }
+        task.ping();
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mClients.find(task.binder);
+        if (it != mClients.end()) {
+            it->second.inFlight = false;
+        }
+    }
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_PINGDISPATCHER_H_
+#define WATCHDOG_SERVER_SRC_PINGDISPATCHER_H_
+
+#include <android-base/thread_annotations.h>
+#include <binder/IBinder.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Histogram of the ping round-trip latencies.
+class LatencyHistogram {
+public:
+    // Upper bounds of the buckets in milliseconds. The last bucket holds the rest.
+    static constexpr std::array<int64_t, 6> kBucketBoundsMillis = {10, 50, 100, 500, 1000, 3000};
+
+    void record(nsecs_t latency);
+    uint64_t count(size_t bucket) const { return mCounts[bucket]; }
+    uint64_t total() const { return mTotal; }
+    nsecs_t max() const { return mMax; }
+    std::string toString() const;
+
+private:
+    std::array<uint64_t, kBucketBoundsMillis.size() + 1> mCounts = {};
+    uint64_t mTotal = 0;
+    nsecs_t mMax = 0;
+};
+
+// Sends the health check pings to the clients on a small pool of worker threads, so a client
+// whose binder call blocks doesn't delay the pings to the other clients. Each client has at
+// most one ping queued or in flight at any given time. The round-trip latency is measured from
+// the time a worker sends the ping to the time the client responds.
+class PingDispatcher : public RefBase {
+public:
+    explicit PingDispatcher(size_t numThreads = kDefaultNumThreads);
+    ~PingDispatcher();
+
+    // Queues |ping| for the client identified by |binder|. Returns false without queueing when
+    // the previous ping to the client is still queued or in flight.
+    bool dispatch(IBinder* binder, pid_t pid, int32_t sessionId, std::function<void()> ping);
+
+    // Records the round-trip latency when |sessionId| is the last ping sent to |binder|.
+    void onPingResponded(IBinder* binder, int32_t sessionId);
+    // Same as above for a response that was received at |respondedUptime|.
+    void onPingResponded(IBinder* binder, int32_t sessionId, nsecs_t respondedUptime);
+
+    // Forgets the client identified by |binder|.
+    void remove(IBinder* binder);
+
+    // Returns the per-client ping latency histograms, one client per line prefixed by |indent|.
+    std::string dump(const char* indent);
+
+    // Stops the worker threads after they finish the pings in flight. The queued pings are
+    // dropped.
+    void terminate();
+
+    static constexpr size_t kDefaultNumThreads = 2;
+
+protected:
+    // Returns the current uptime. Overridden by tests.
+    virtual nsecs_t now() { return systemTime(SYSTEM_TIME_MONOTONIC); }
+
+private:
+    struct ClientState {
+        pid_t pid = -1;
+        // True from the time a ping is queued until the binder call returns.
+        bool inFlight = false;
+        int32_t sessionId = 0;
+        // Uptime when the last ping was sent. 0 after the client responded to it.
+        nsecs_t sentUptime = 0;
+        LatencyHistogram histogram;
+    };
+
+    struct Task {
+        IBinder* binder = nullptr;
+        std::function<void()> ping;
+    };
+
+    void run();
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mTerminated GUARDED_BY(mMutex);
+    std::deque<Task> mTasks GUARDED_BY(mMutex);
+    std::unordered_map<IBinder*, ClientState> mClients GUARDED_BY(mMutex);
+    std::vector<std::thread> mThreads;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_PINGDISPATCHER_H_
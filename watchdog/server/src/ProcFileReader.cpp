@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "ProcFileReader.h"
+
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::ErrnoError;
+using android::base::Result;
+using android::base::unique_fd;
+
+namespace {
+
+// Most `/proc` files read by the collectors fit in a single page. Larger files (e.g.,
+// `/proc/uid_io/stats` on devices with many packages) grow the buffer by doubling.
+constexpr size_t kInitialBufferSize = 4096;
+
+}  // namespace
+
+Result<void> ProcFileReader::read(const std::string& path) {
+    return readAt(AT_FDCWD, path.c_str());
+}
+
+Result<void> ProcFileReader::readAt(int dirFd, const char* relativePath) {
+    mSize = 0;
+    unique_fd fd(TEMP_FAILURE_RETRY(openat(dirFd, relativePath, O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        return ErrnoError() << "Failed to open " << relativePath;
+    }
+    return readFromStart(fd, relativePath);
+}
+
+Result<void> ProcFileReader::readKeepOpen(const std::string& path) {
+    mSize = 0;
+    if (!mFd.ok() || mFdPath != path) {
+        mFd.reset(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (!mFd.ok()) {
+            mFdPath.clear();
+            return ErrnoError() << "Failed to open " << path;
+        }
+        mFdPath = path;
+    }
+    if (const auto& ret = readFromStart(mFd, path.c_str()); !ret) {
+        // Reopen on the next read in case the fd went bad.
+        mFd.reset();
+        mFdPath.clear();
+        return ret;
+    }
+    return {};
+}
+
+Result<void> ProcFileReader::readFromStart(int fd, const char* name) {
+    mSize = 0;
+    if (mBuffer.empty()) {
+        mBuffer.resize(kInitialBufferSize);
+    }
+    // `/proc` files report a size of 0, so read until EOF instead of relying on fstat.
+    while (true) {
+        if (mSize == mBuffer.size()) {
+            mBuffer.resize(mBuffer.size() * 2);
+        }
+        // pread from explicit offsets, so a kept-open fd needs no seek between reads.
+        ssize_t bytesRead = TEMP_FAILURE_RETRY(
+                pread(fd, mBuffer.data() + mSize, mBuffer.size() - mSize, mSize));
+        if (bytesRead == -1) {
+            mSize = 0;
+            return ErrnoError() << "Failed to read " << name;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        mSize += static_cast<size_t>(bytesRead);
+    }
+    return {};
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_PROCFILEREADER_H_
+#define WATCHDOG_SERVER_SRC_PROCFILEREADER_H_
+
+#include <android-base/result.h>
+#include <android-base/unique_fd.h>
+#include <stdint.h>
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Reads the entire contents of a `/proc` file into a buffer that is reused across reads. The
+// buffer grows to fit the largest file read so far and is never shrunk, so steady-state reads
+// don't allocate. Callers must hold a reference to |contents()| only until the next read.
+class ProcFileReader {
+public:
+    ProcFileReader() : mSize(0) {}
+
+    // Reads the file at |path|. On error, the contents are empty.
+    android::base::Result<void> read(const std::string& path);
+
+    // Reads the file at |relativePath| under the directory referred to by |dirFd|. Useful when
+    // reading several files under a directory that is kept open across reads.
+    android::base::Result<void> readAt(int dirFd, const char* relativePath);
+
+    // Reads the file at |path| through an fd that is kept open across reads, so a collector
+    // polling the same file skips the path lookup and the open/close on every read. The file is
+    // reopened when |path| changes or a read fails. `/proc` files regenerate their contents
+    // when read from the start, so each read sees the current values.
+    android::base::Result<void> readKeepOpen(const std::string& path);
+
+    std::string_view contents() const { return std::string_view(mBuffer.data(), mSize); }
+
+private:
+    // Reads |fd| from offset 0 until EOF into |mBuffer|.
+    android::base::Result<void> readFromStart(int fd, const char* name);
+
+    std::vector<char> mBuffer;
+    size_t mSize;
+
+    // File kept open by |readKeepOpen| and its path.
+    android::base::unique_fd mFd;
+    std::string mFdPath;
+};
+
+// Splits a string view on the given delimiter without copying. Matches the semantics of
+// android::base::Split: adjacent delimiters produce empty tokens, as does a trailing delimiter.
+class Tokenizer {
+public:
+    Tokenizer(std::string_view data, char delimiter) :
+          mData(data), mPos(0), mDelimiter(delimiter), mDone(false) {}
+
+    // Sets |token| to the next token and returns true. Returns false when no tokens are left.
+    bool next(std::string_view* token) {
+        if (mDone) {
+            return false;
+        }
+        size_t end = mData.find(mDelimiter, mPos);
+        if (end == std::string_view::npos) {
+            *token = mData.substr(mPos);
+            mDone = true;
+            return true;
+        }
+        *token = mData.substr(mPos, end - mPos);
+        mPos = end + 1;
+        return true;
+    }
+
+    // Returns the contents not yet returned by |next|.
+    std::string_view remaining() const {
+        return mDone ? std::string_view() : mData.substr(mPos);
+    }
+
+private:
+    std::string_view mData;
+    size_t mPos;
+    char mDelimiter;
+    bool mDone;
+};
+
+// Parses the decimal value in |s| into |out|. Unlike android::base::ParseUint/ParseInt, this
+// doesn't require a null-terminated string. Returns false when |s| is not entirely a number.
+template <typename T>
+bool parseNumber(std::string_view s, T* out) {
+    static_assert(std::is_integral<T>::value, "parseNumber supports only integral types");
+    if (s.empty()) {
+        return false;
+    }
+    const char* end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(s.data(), end, *out);
+    return ec == std::errc() && ptr == end;
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_PROCFILEREADER_H_
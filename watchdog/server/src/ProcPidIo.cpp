@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "ProcPidIo.h"
+
+#include <android-base/strings.h>
+#include <log/log.h>
+#include <stdio.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::Error;
+using android::base::Result;
+using android::base::StartsWith;
+
+namespace {
+
+enum ReadError {
+    ERR_INVALID_FILE = 0,
+    ERR_FILE_OPEN_READ = 1,
+    NUM_ERRORS = 2,
+};
+
+// /proc/PID/io or /proc/PID/task/TID/io format:
+// rchar: <chars read>
+// wchar: <chars written>
+// syscr: <read syscalls>
+// syscw: <write syscalls>
+// read_bytes: <bytes fetched from the storage layer>
+// write_bytes: <bytes sent to the storage layer>
+// cancelled_write_bytes: <bytes not written because of truncation>
+constexpr std::string_view kReadBytesKey = "read_bytes:";
+constexpr std::string_view kWriteBytesKey = "write_bytes:";
+
+// Large enough to hold "/[pid]/task/[tid]/io" for any 32-bit pid and tid.
+constexpr size_t kMaxRelativePathLength = 48;
+
+bool parseIoLine(std::string_view line, std::string_view key, uint64_t* value) {
+    std::string_view field = line.substr(key.size());
+    while (!field.empty() && field.front() == ' ') {
+        field.remove_prefix(1);
+    }
+    return parseNumber(field, value);
+}
+
+}  // namespace
+
+Result<std::vector<ProcessIoUsage>> ProcPidIo::collect(
+        const std::vector<const ProcessStats*>& processes) {
+    if (!mEnabled) {
+        return Error() << "Can not access PID io files under " << mPath;
+    }
+
+    Mutex::Autolock lock(mMutex);
+    ++mCollectionId;
+    std::vector<ProcessIoUsage> usages;
+    usages.reserve(processes.size());
+    char relativePath[kMaxRelativePathLength];
+    for (const ProcessStats* stats : processes) {
+        const uint32_t pid = stats->process.pid;
+        TaskIoBytes bytes;
+        snprintf(relativePath, sizeof(relativePath), kIoFileFormat, pid);
+        if (const auto& ret = readIoFileLocked(relativePath, &bytes); !ret) {
+            // The process may terminate after ProcPidStat collected it.
+            if (ret.error().code() != ERR_FILE_OPEN_READ) {
+                return Error() << "Failed to read per-process io file for pid " << pid << ": "
+                               << ret.error().message();
+            }
+            continue;
+        }
+        ProcessIoUsage usage = {.stats = stats};
+        updateDeltaLocked(pid, stats->process.startTime, bytes, &mLastProcessIo, &usage.process);
+        for (const auto& [tid, threadStat] : stats->threads) {
+            snprintf(relativePath, sizeof(relativePath), "/%" PRIu32 "/task/%" PRIu32 "/io", pid,
+                     tid);
+            const auto& ret = readIoFileLocked(relativePath, &bytes);
+            if (!ret) {
+                if (ret.error().code() != ERR_FILE_OPEN_READ) {
+                    return Error() << "Failed to read per-thread io file for pid " << pid << ": "
+                                   << ret.error().message();
+                }
+                // The thread may terminate after ProcPidStat collected it.
+                continue;
+            }
+            updateDeltaLocked(tid, threadStat.startTime, bytes, &mLastThreadIo,
+                              &usage.threads[tid]);
+        }
+        usages.emplace_back(std::move(usage));
+    }
+
+    // Drop the entries for the tasks that terminated or are no longer collected.
+    for (auto* cache : {&mLastProcessIo, &mLastThreadIo}) {
+        for (auto it = cache->begin(); it != cache->end();) {
+            if (it->second.lastCollectionId != mCollectionId) {
+                it = cache->erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return usages;
+}
+
+Result<void> ProcPidIo::readIoFileLocked(const char* relativePath, TaskIoBytes* bytes) {
+    if (const auto& ret = mReader.read(mPath + relativePath); !ret) {
+        return Error(ERR_FILE_OPEN_READ) << ret.error();
+    }
+    Tokenizer lines(mReader.contents(), '\n');
+    std::string_view line;
+    bool didReadReadBytes = false;
+    bool didReadWriteBytes = false;
+    while (lines.next(&line)) {
+        if (StartsWith(line, kReadBytesKey)) {
+            if (didReadReadBytes || !parseIoLine(line, kReadBytesKey, &bytes->readBytes)) {
+                return Error(ERR_INVALID_FILE)
+                        << "Invalid read_bytes line: \"" << line << "\" in " << relativePath;
+            }
+            didReadReadBytes = true;
+        } else if (StartsWith(line, kWriteBytesKey)) {
+            if (didReadWriteBytes || !parseIoLine(line, kWriteBytesKey, &bytes->writeBytes)) {
+                return Error(ERR_INVALID_FILE)
+                        << "Invalid write_bytes line: \"" << line << "\" in " << relativePath;
+            }
+            didReadWriteBytes = true;
+        }
+    }
+    if (!didReadReadBytes || !didReadWriteBytes) {
+        return Error(ERR_INVALID_FILE) << "Missing read_bytes or write_bytes in " << relativePath;
+    }
+    return {};
+}
+
+void ProcPidIo::updateDeltaLocked(uint32_t id, uint64_t startTime, const TaskIoBytes& bytes,
+                                  std::unordered_map<uint32_t, CachedTaskIo>* cache,
+                                  TaskIoBytes* delta) {
+    auto [it, isNew] = cache->try_emplace(id);
+    CachedTaskIo& cached = it->second;
+    if (isNew || cached.startTime != startTime) {
+        // New/reused task so only record the baseline.
+        *delta = {};
+    } else {
+        // The counters are monotonic unless the kernel resets them, so guard against underflow.
+        delta->readBytes = bytes.readBytes >= cached.bytes.readBytes
+                ? bytes.readBytes - cached.bytes.readBytes
+                : 0;
+        delta->writeBytes = bytes.writeBytes >= cached.bytes.writeBytes
+                ? bytes.writeBytes - cached.bytes.writeBytes
+                : 0;
+    }
+    cached.startTime = startTime;
+    cached.bytes = bytes;
+    cached.lastCollectionId = mCollectionId;
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_PROCPIDIO_H_
+#define WATCHDOG_SERVER_SRC_PROCPIDIO_H_
+
+#include <android-base/result.h>
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ProcFileReader.h"
+#include "ProcPidStat.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+constexpr const char* kIoFileFormat = "/%" PRIu32 "/io";
+
+// Bytes read from and written to the storage layer.
+struct TaskIoBytes {
+    uint64_t readBytes = 0;
+    uint64_t writeBytes = 0;
+};
+
+struct ProcessIoUsage {
+    const ProcessStats* stats = nullptr;  // Stats of the process as collected by ProcPidStat.
+    TaskIoBytes process = {};             // Aggregated across all the threads, including the
+                                          // terminated threads.
+    std::unordered_map<uint32_t, TaskIoBytes> threads;  // Per-thread bytes keyed by TID.
+};
+
+// Collector/parser for `/proc/[pid]/io` and `/proc/[pid]/task/[tid]/io` files. Unlike the other
+// collectors, it reads the files only for the given processes, so the caller bounds the cost of
+// the collection by selecting the processes of interest.
+class ProcPidIo : public RefBase {
+public:
+    explicit ProcPidIo(const std::string& path = kProcDirPath) : mCollectionId(0), mPath(path) {
+        std::string pidIoPath =
+                android::base::StringPrintf((mPath + kIoFileFormat).c_str(), PID_FOR_INIT);
+        std::string tidIoPath =
+                android::base::StringPrintf((mPath + kTaskDirFormat + kIoFileFormat).c_str(),
+                                            PID_FOR_INIT, PID_FOR_INIT);
+        mEnabled = !access(pidIoPath.c_str(), R_OK) && !access(tidIoPath.c_str(), R_OK);
+    }
+
+    virtual ~ProcPidIo() {}
+
+    // Collects the I/O bytes delta since the last collection for the processes in |processes| and
+    // their threads. The first collection of a process or thread only records its baseline and
+    // reports no bytes, so the processes that were not collected the last time don't report their
+    // lifetime I/O. The returned usages refer to the elements of |processes|.
+    virtual android::base::Result<std::vector<ProcessIoUsage>> collect(
+            const std::vector<const ProcessStats*>& processes);
+
+    // Called by IoPerfCollection and tests.
+    virtual bool enabled() { return mEnabled; }
+
+    virtual std::string dirPath() { return mPath; }
+
+private:
+    // Cumulative bytes of a process or thread from the last collection.
+    struct CachedTaskIo {
+        uint64_t startTime = 0;  // Useful when identifying PID/TID reuse.
+        TaskIoBytes bytes = {};
+        uint64_t lastCollectionId = 0;  // Used to drop the entries for tasks no longer collected.
+    };
+
+    // Reads the io file at |relativePath| under |mPath| into |bytes|.
+    android::base::Result<void> readIoFileLocked(const char* relativePath, TaskIoBytes* bytes);
+
+    // Sets |delta| to the bytes since the cached entry of |id| in |cache| and updates the entry.
+    void updateDeltaLocked(uint32_t id, uint64_t startTime, const TaskIoBytes& bytes,
+                           std::unordered_map<uint32_t, CachedTaskIo>* cache, TaskIoBytes* delta);
+
+    // Makes sure only one collection is running at any given time.
+    Mutex mMutex;
+
+    // Reusable buffer for the contents of the io files.
+    ProcFileReader mReader GUARDED_BY(mMutex);
+
+    // Last cumulative bytes of the collected processes keyed by PID, and of their threads keyed
+    // by TID. PIDs and TIDs share a namespace, but the bytes of a process include the bytes of all
+    // its threads, so they are kept apart.
+    std::unordered_map<uint32_t, CachedTaskIo> mLastProcessIo GUARDED_BY(mMutex);
+    std::unordered_map<uint32_t, CachedTaskIo> mLastThreadIo GUARDED_BY(mMutex);
+
+    // Incremented on every collection.
+    uint64_t mCollectionId GUARDED_BY(mMutex);
+
+    // True if the below files are accessible:
+    // 1. Pid io file at |mPath| + |kIoFileFormat|
+    // 2. Tid io file at |mPath| + |kTaskDirFormat| + |kIoFileFormat|
+    // Otherwise, set to false.
+    bool mEnabled;
+
+    // Proc directory path. Default value is |kProcDirPath|.
+    // Updated by tests to point to a different location when needed.
+    std::string mPath;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_PROCPIDIO_H_
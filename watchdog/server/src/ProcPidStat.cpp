@@ -18,27 +18,29 @@
 
 #include "ProcPidStat.h"
 
-#include <android-base/file.h>
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
+#include <cutils/multiuser.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <log/log.h>
+#include <stdio.h>
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace android {
 namespace automotive {
 namespace watchdog {
 
-using android::base::EndsWith;
 using android::base::Error;
-using android::base::ParseInt;
 using android::base::ParseUint;
-using android::base::ReadFileToString;
 using android::base::Result;
-using android::base::Split;
+using android::base::StartsWith;
+using android::base::unique_fd;
 
 namespace {
 
@@ -59,60 +61,104 @@ enum ReadError {
 // <guest time> <children guest time> <start data addr> <end data addr> <start break addr>
 // <cmd line args start addr> <amd line args end addr> <env start addr> <env end addr> <exit code>
 // Example line: 1 (init) S 0 0 0 0 0 0 0 0 220 0 0 0 0 0 0 0 2 0 0 ...etc...
-bool parsePidStatLine(const std::string& line, PidStat* pidStat) {
-    std::vector<std::string> fields = Split(line, " ");
 
+// Indexes of the required fields relative to the first field after the comm string.
+constexpr size_t kStateIndex = 0;
+constexpr size_t kPpidIndex = 1;
+constexpr size_t kMajorFaultsIndex = 9;
+constexpr size_t kUserTimeIndex = 11;
+constexpr size_t kSystemTimeIndex = 12;
+constexpr size_t kNumThreadsIndex = 17;
+constexpr size_t kStartTimeIndex = 19;
+
+// Large enough to hold "[tid]/stat" for any 32-bit tid.
+constexpr size_t kMaxRelativePathLength = 32;
+
+// Upper bound on the number of pid directory fds kept open across collections. Keeps the daemon
+// well within its fd limit on systems with many processes. Processes beyond this limit are still
+// collected but their pid directory is re-opened on every collection.
+constexpr size_t kMaxCachedPidDirFds = 512;
+
+bool parsePidStatLine(std::string_view line, PidStat* pidStat) {
     // Note: Regex parsing for the below logic increased the time taken to run the
     // ProcPidStatTest#TestProcPidStatContentsFromDevice from 151.7ms to 1.3 seconds.
 
-    // Comm string is enclosed with ( ) brackets and may contain space(s). Thus calculate the
-    // commEndOffset based on the field that contains the closing bracket.
-    size_t commEndOffset = 0;
-    for (size_t i = 1; i < fields.size(); ++i) {
-        pidStat->comm += fields[i];
-        if (EndsWith(fields[i], ")")) {
-            commEndOffset = i - 1;
-            break;
-        }
-        pidStat->comm += " ";
+    // Comm string is enclosed with ( ) brackets and may contain space(s). Thus the comm string ends
+    // at the first closing bracket that is followed by a space.
+    size_t commStart = line.find(' ');
+    size_t commEnd = commStart == std::string_view::npos ? commStart : line.find(") ", commStart);
+    if (commEnd == std::string_view::npos || line[commStart + 1] != '(') {
+        ALOGW("Comm string not enclosed in brackets: \"%.*s\"", static_cast<int>(line.size()),
+              line.data());
+        return false;
     }
+    pidStat->comm.assign(line.data() + commStart + 2, commEnd - commStart - 2);
 
-    if (pidStat->comm.front() != '(' || pidStat->comm.back() != ')') {
-        ALOGW("Comm string `%s` not enclosed in brackets", pidStat->comm.c_str());
-        return false;
+    // The required data is in the first |kStartTimeIndex| + 1 fields after the comm string so make
+    // sure there are at least these many fields in the file.
+    Tokenizer tokenizer(line.substr(commEnd + 2), ' ');
+    std::string_view field;
+    size_t index = 0;
+    bool isValid = parseNumber(line.substr(0, commStart), &pidStat->pid);
+    for (; isValid && index <= kStartTimeIndex && tokenizer.next(&field); ++index) {
+        switch (index) {
+            case kStateIndex:
+                pidStat->state.assign(field.data(), field.size());
+                break;
+            case kPpidIndex:
+                isValid = parseNumber(field, &pidStat->ppid);
+                break;
+            case kMajorFaultsIndex:
+                isValid = parseNumber(field, &pidStat->majorFaults);
+                break;
+            case kUserTimeIndex:
+            case kSystemTimeIndex: {
+                uint64_t time = 0;
+                isValid = parseNumber(field, &time);
+                pidStat->cpuTime += time;
+                break;
+            }
+            case kNumThreadsIndex:
+                isValid = parseNumber(field, &pidStat->numThreads);
+                break;
+            case kStartTimeIndex:
+                isValid = parseNumber(field, &pidStat->startTime);
+                break;
+            default:
+                break;
+        }
     }
-    pidStat->comm.erase(pidStat->comm.begin());
-    pidStat->comm.erase(pidStat->comm.end() - 1);
-
-    // The required data is in the first 22 + |commEndOffset| fields so make sure there are at least
-    // these many fields in the file.
-    if (fields.size() < 22 + commEndOffset || !ParseUint(fields[0], &pidStat->pid) ||
-        !ParseUint(fields[3 + commEndOffset], &pidStat->ppid) ||
-        !ParseUint(fields[11 + commEndOffset], &pidStat->majorFaults) ||
-        !ParseUint(fields[19 + commEndOffset], &pidStat->numThreads) ||
-        !ParseUint(fields[21 + commEndOffset], &pidStat->startTime)) {
-        ALOGW("Invalid proc pid stat contents: \"%s\"", line.c_str());
+    if (!isValid || index <= kStartTimeIndex) {
+        ALOGW("Invalid proc pid stat contents: \"%.*s\"", static_cast<int>(line.size()),
+              line.data());
         return false;
     }
-    pidStat->state = fields[2 + commEndOffset];
     return true;
 }
 
-Result<void> readPidStatFile(const std::string& path, PidStat* pidStat) {
-    std::string buffer;
-    if (!ReadFileToString(path, &buffer)) {
-        return Error(ERR_FILE_OPEN_READ) << "ReadFileToString failed for " << path;
+Result<void> readPidStatFile(int dirFd, const char* relativePath, ProcFileReader* reader,
+                             PidStat* pidStat) {
+    if (const auto& ret = reader->readAt(dirFd, relativePath); !ret) {
+        return Error(ERR_FILE_OPEN_READ) << ret.error();
     }
-    std::vector<std::string> lines = Split(std::move(buffer), "\n");
-    if (lines.size() != 1 && (lines.size() != 2 || !lines[1].empty())) {
-        return Error(ERR_INVALID_FILE) << path << " contains " << lines.size() << " lines != 1";
+    Tokenizer lines(reader->contents(), '\n');
+    std::string_view line;
+    std::string_view nextLine;
+    lines.next(&line);
+    if (lines.next(&nextLine) && (!nextLine.empty() || lines.next(&nextLine))) {
+        return Error(ERR_INVALID_FILE) << relativePath << " contains more than 1 line";
     }
-    if (!parsePidStatLine(std::move(lines[0]), pidStat)) {
-        return Error(ERR_INVALID_FILE) << "Failed to parse the contents of " << path;
+    if (!parsePidStatLine(line, pidStat)) {
+        return Error(ERR_INVALID_FILE) << "Failed to parse the contents of " << relativePath;
     }
     return {};
 }
 
+unique_fd openDir(int dirFd, const char* relativePath) {
+    return unique_fd(
+            TEMP_FAILURE_RETRY(openat(dirFd, relativePath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+}
+
 }  // namespace
 
 Result<std::vector<ProcessStats>> ProcPidStat::collect() {
@@ -140,6 +186,7 @@ Result<std::vector<ProcessStats>> ProcPidStat::collect() {
         ProcessStats deltaStats = curStats;
         const ProcessStats& cachedStats = cachedIt->second;
         deltaStats.process.majorFaults -= cachedStats.process.majorFaults;
+        deltaStats.process.cpuTime -= cachedStats.process.cpuTime;
         for (auto& deltaThread : deltaStats.threads) {
             const auto& cachedThread = cachedStats.threads.find(deltaThread.first);
             if (cachedThread == cachedStats.threads.end() ||
@@ -148,48 +195,120 @@ Result<std::vector<ProcessStats>> ProcPidStat::collect() {
                 continue;
             }
             deltaThread.second.majorFaults -= cachedThread->second.majorFaults;
+            deltaThread.second.cpuTime -= cachedThread->second.cpuTime;
         }
         delta.emplace_back(deltaStats);
     }
-    mLastProcessStats = *processStats;
+    if (mAppIdFilter.empty()) {
+        mLastProcessStats = *processStats;
+        return delta;
+    }
+    // Keep the last stats of the running processes that were filtered out, so their delta is
+    // reported since their last collection once the filter is cleared.
+    for (auto it = mLastProcessStats.begin(); it != mLastProcessStats.end();) {
+        const auto cacheIt = mPidDirCache.find(it->first);
+        if (cacheIt == mPidDirCache.end() ||
+            cacheIt->second.startTime != it->second.process.startTime) {
+            it = mLastProcessStats.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const auto& [pid, curStats] : *processStats) {
+        mLastProcessStats[pid] = curStats;
+    }
     return delta;
 }
 
-Result<std::unordered_map<uint32_t, ProcessStats>> ProcPidStat::getProcessStatsLocked() const {
+void ProcPidStat::setAppIdFilter(const std::unordered_set<uint32_t>& appIds) {
+    Mutex::Autolock lock(mMutex);
+    if (mAppIdFilter != appIds) {
+        mAppIdFilter = appIds;
+    }
+}
+
+Result<std::unordered_map<uint32_t, ProcessStats>> ProcPidStat::getProcessStatsLocked() {
+    if (mPidDirCachePath != mPath) {
+        // Cached fds refer to the directories under the previous path.
+        mPidDirCache.clear();
+        mProcDirp.reset();
+        mPidDirCachePath = mPath;
+    }
+    ++mCollectionId;
+
     std::unordered_map<uint32_t, ProcessStats> processStats;
-    auto procDirp = std::unique_ptr<DIR, int (*)(DIR*)>(opendir(mPath.c_str()), closedir);
-    if (!procDirp) {
-        return Error() << "Failed to open " << mPath << " directory";
+    processStats.reserve(mLastProcessStats.size());
+    if (mProcDirp) {
+        rewinddir(mProcDirp.get());
+    } else {
+        mProcDirp.reset(opendir(mPath.c_str()));
+        if (!mProcDirp) {
+            return Error() << "Failed to open " << mPath << " directory";
+        }
     }
+    DIR* procDirp = mProcDirp.get();
     dirent* pidDir = nullptr;
-    while ((pidDir = readdir(procDirp.get())) != nullptr) {
-        // 1. Read top-level pid stats.
+    char relativePath[kMaxRelativePathLength];
+    while ((pidDir = readdir(procDirp)) != nullptr) {
+        // 1. Read top-level pid stats. Use the cached fd for the pid directory when available.
         uint32_t pid = 0;
         if (pidDir->d_type != DT_DIR || !ParseUint(pidDir->d_name, &pid)) {
             continue;
         }
         ProcessStats curStats;
-        std::string path = StringPrintf((mPath + kStatFileFormat).c_str(), pid);
-        const auto& ret = readPidStatFile(path, &curStats.process);
-        if (!ret) {
-            // PID may disappear between scanning the directory and parsing the stat file.
-            // Thus treat ERR_FILE_OPEN_READ errors as soft errors.
-            if (ret.error().code() != ERR_FILE_OPEN_READ) {
-                return Error() << "Failed to read top-level per-process stat file: "
-                               << ret.error().message().c_str();
+        auto cacheIt = mPidDirCache.find(pid);
+        if (cacheIt != mPidDirCache.end() && cacheIt->second.pidDirFd.ok()) {
+            const auto& ret = readPidStatFile(cacheIt->second.pidDirFd, "stat", &mReader,
+                                              &curStats.process);
+            if (!ret && ret.error().code() != ERR_FILE_OPEN_READ) {
+                return Error() << "Failed to read top-level per-process stat file for pid " << pid
+                               << ": " << ret.error().message().c_str();
+            }
+            if (!ret) {
+                // The cached fd refers to a terminated process whose PID was reused. Re-open the
+                // pid directory below.
+                cacheIt->second.pidDirFd.reset();
+            }
+        }
+        unique_fd uncachedPidDirFd;
+        if (cacheIt == mPidDirCache.end() || !cacheIt->second.pidDirFd.ok()) {
+            uncachedPidDirFd = openDir(dirfd(procDirp), pidDir->d_name);
+            if (!uncachedPidDirFd.ok()) {
+                // PID may disappear between scanning the directory and opening it.
+                ALOGW("Failed to open the directory for pid %" PRIu32, pid);
+                continue;
+            }
+            const auto& ret =
+                    readPidStatFile(uncachedPidDirFd, "stat", &mReader, &curStats.process);
+            if (!ret) {
+                // PID may disappear between scanning the directory and parsing the stat file.
+                // Thus treat ERR_FILE_OPEN_READ errors as soft errors.
+                if (ret.error().code() != ERR_FILE_OPEN_READ) {
+                    return Error() << "Failed to read top-level per-process stat file for pid "
+                                   << pid << ": " << ret.error().message().c_str();
+                }
+                ALOGW("Failed to read top-level per-process stat file for pid %" PRIu32 ": %s",
+                      pid, ret.error().message().c_str());
+                continue;
             }
-            ALOGW("Failed to read top-level per-process stat file %s: %s", path.c_str(),
-                  ret.error().message().c_str());
-            continue;
         }
+        if (cacheIt == mPidDirCache.end()) {
+            cacheIt = mPidDirCache.emplace(pid, CachedPidDir{}).first;
+        }
+        CachedPidDir& cachedPidDir = cacheIt->second;
+        cachedPidDir.lastCollectionId = mCollectionId;
+        if (uncachedPidDirFd.ok() && mPidDirCache.size() <= kMaxCachedPidDirFds) {
+            cachedPidDir.pidDirFd = std::move(uncachedPidDirFd);
+        }
+        int pidDirFd = cachedPidDir.pidDirFd.ok() ? cachedPidDir.pidDirFd.get()
+                                                  : uncachedPidDirFd.get();
 
-        // 2. When not found in the cache, fetch tgid/UID as soon as possible because processes
-        // may terminate during scanning.
-        const auto& it = mLastProcessStats.find(curStats.process.pid);
-        if (it == mLastProcessStats.end() ||
-            it->second.process.startTime != curStats.process.startTime || it->second.tgid == -1 ||
-            it->second.uid == -1) {
-            const auto& ret = getPidStatusLocked(&curStats);
+        // 2. When the PID is new or reused, fetch tgid/UID as soon as possible because processes
+        // may terminate during scanning. Otherwise, these static fields are fetched from the
+        // cache.
+        if (cachedPidDir.startTime != curStats.process.startTime || cachedPidDir.tgid == -1 ||
+            cachedPidDir.uid == -1) {
+            const auto& ret = getPidStatusLocked(pidDirFd, &curStats);
             if (!ret) {
                 if (ret.error().code() != ERR_FILE_OPEN_READ) {
                     return Error() << "Failed to read pid status for pid " << curStats.process.pid
@@ -199,10 +318,12 @@ Result<std::unordered_map<uint32_t, ProcessStats>> ProcPidStat::getProcessStatsL
                       ret.error().message().c_str());
                 // Default tgid and uid values are -1 (aka unknown).
             }
+            cachedPidDir.tgid = curStats.tgid;
+            cachedPidDir.uid = curStats.uid;
+            cachedPidDir.startTime = curStats.process.startTime;
         } else {
-            // Fetch from cache.
-            curStats.tgid = it->second.tgid;
-            curStats.uid = it->second.uid;
+            curStats.tgid = cachedPidDir.tgid;
+            curStats.uid = cachedPidDir.uid;
         }
 
         if (curStats.tgid != -1 && curStats.tgid != curStats.process.pid) {
@@ -211,12 +332,26 @@ Result<std::unordered_map<uint32_t, ProcessStats>> ProcPidStat::getProcessStatsL
             continue;
         }
 
+        if (!mAppIdFilter.empty() &&
+            (curStats.uid == -1 ||
+             mAppIdFilter.find(multiuser_get_app_id(static_cast<uid_t>(curStats.uid))) ==
+                     mAppIdFilter.end())) {
+            continue;
+        }
+
         // 3. Fetch per-thread stats.
-        std::string taskDir = StringPrintf((mPath + kTaskDirFormat).c_str(), pid);
-        auto taskDirp = std::unique_ptr<DIR, int (*)(DIR*)>(opendir(taskDir.c_str()), closedir);
+        unique_fd taskDirFd = openDir(pidDirFd, "task");
+        std::unique_ptr<DIR, int (*)(DIR*)> taskDirp(nullptr, closedir);
+        if (taskDirFd.ok()) {
+            taskDirp.reset(fdopendir(taskDirFd.get()));
+            if (taskDirp) {
+                // The DIR stream owns the fd now.
+                taskDirFd.release();
+            }
+        }
         if (!taskDirp) {
             // Treat this as a soft error so at least the process stats will be collected.
-            ALOGW("Failed to open %s directory", taskDir.c_str());
+            ALOGW("Failed to open the task directory for pid %" PRIu32, pid);
         }
         dirent* tidDir = nullptr;
         bool didReadMainThread = false;
@@ -231,16 +366,17 @@ Result<std::unordered_map<uint32_t, ProcessStats>> ProcPidStat::getProcessStatsL
             }
 
             PidStat curThreadStat = {};
-            path = StringPrintf((taskDir + kStatFileFormat).c_str(), tid);
-            const auto& ret = readPidStatFile(path, &curThreadStat);
+            snprintf(relativePath, sizeof(relativePath), "%" PRIu32 "/stat", tid);
+            const auto& ret =
+                    readPidStatFile(dirfd(taskDirp.get()), relativePath, &mReader, &curThreadStat);
             if (!ret) {
                 if (ret.error().code() != ERR_FILE_OPEN_READ) {
-                    return Error() << "Failed to read per-thread stat file: "
+                    return Error() << "Failed to read per-thread stat file for pid " << pid << ": "
                                    << ret.error().message().c_str();
                 }
                 // Maybe the thread terminated before reading the file so skip this thread and
                 // continue with scanning the next thread's stat.
-                ALOGW("Failed to read per-thread stat file %s: %s", path.c_str(),
+                ALOGW("Failed to read per-thread stat file for pid %" PRIu32 ": %s", pid,
                       ret.error().message().c_str());
                 continue;
             }
@@ -264,48 +400,60 @@ Result<std::unordered_map<uint32_t, ProcessStats>> ProcPidStat::getProcessStatsL
         }
         processStats[curStats.process.pid] = curStats;
     }
+
+    // 4. Drop the cache entries for the terminated processes.
+    for (auto it = mPidDirCache.begin(); it != mPidDirCache.end();) {
+        if (it->second.lastCollectionId != mCollectionId) {
+            it = mPidDirCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
     return processStats;
 }
 
-Result<void> ProcPidStat::getPidStatusLocked(ProcessStats* processStats) const {
-    std::string buffer;
-    std::string path = StringPrintf((mPath + kStatusFileFormat).c_str(), processStats->process.pid);
-    if (!ReadFileToString(path, &buffer)) {
-        return Error(ERR_FILE_OPEN_READ) << "ReadFileToString failed for " << path;
+Result<void> ProcPidStat::getPidStatusLocked(int pidDirFd, ProcessStats* processStats) {
+    if (const auto& ret = mReader.readAt(pidDirFd, "status"); !ret) {
+        return Error(ERR_FILE_OPEN_READ) << ret.error();
     }
-    std::vector<std::string> lines = Split(std::move(buffer), "\n");
+    Tokenizer lines(mReader.contents(), '\n');
+    std::string_view line;
     bool didReadUid = false;
     bool didReadTgid = false;
-    for (size_t i = 0; i < lines.size(); ++i) {
-        if (lines[i].empty()) {
+    while (lines.next(&line)) {
+        if (line.empty()) {
             continue;
         }
-        if (!lines[i].compare(0, 4, "Uid:")) {
+        if (StartsWith(line, "Uid:")) {
             if (didReadUid) {
                 return Error(ERR_INVALID_FILE)
-                        << "Duplicate UID line: \"" << lines[i] << "\" in file " << path;
+                        << "Duplicate UID line: \"" << line << "\" in status file";
             }
-            std::vector<std::string> fields = Split(lines[i], "\t");
-            if (fields.size() < 2 || !ParseInt(fields[1], &processStats->uid)) {
+            Tokenizer fields(line, '\t');
+            std::string_view field;
+            if (!fields.next(&field) || !fields.next(&field) ||
+                !parseNumber(field, &processStats->uid)) {
                 return Error(ERR_INVALID_FILE)
-                        << "Invalid UID line: \"" << lines[i] << "\" in file " << path;
+                        << "Invalid UID line: \"" << line << "\" in status file";
             }
             didReadUid = true;
-        } else if (!lines[i].compare(0, 5, "Tgid:")) {
+        } else if (StartsWith(line, "Tgid:")) {
             if (didReadTgid) {
                 return Error(ERR_INVALID_FILE)
-                        << "Duplicate Tgid line: \"" << lines[i] << "\" in file" << path;
+                        << "Duplicate Tgid line: \"" << line << "\" in status file";
             }
-            std::vector<std::string> fields = Split(lines[i], "\t");
-            if (fields.size() != 2 || !ParseInt(fields[1], &processStats->tgid)) {
+            Tokenizer fields(line, '\t');
+            std::string_view field;
+            if (!fields.next(&field) || !fields.next(&field) ||
+                !parseNumber(field, &processStats->tgid) || fields.next(&field)) {
                 return Error(ERR_INVALID_FILE)
-                        << "Invalid tgid line: \"" << lines[i] << "\" in file" << path;
+                        << "Invalid tgid line: \"" << line << "\" in status file";
             }
             didReadTgid = true;
         }
     }
     if (!didReadUid || !didReadTgid) {
-        return Error(ERR_INVALID_FILE) << "Incomplete file " << mPath + kStatusFileFormat;
+        return Error(ERR_INVALID_FILE) << "Incomplete status file";
     }
     return {};
 }
@@ -19,16 +19,22 @@
 
 #include <android-base/result.h>
 #include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <dirent.h>
 #include <gtest/gtest_prod.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <utils/Mutex.h>
 #include <utils/RefBase.h>
 
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "ProcFileReader.h"
+
 namespace android {
 namespace automotive {
 namespace watchdog {
@@ -50,6 +56,7 @@ struct PidStat {
     uint64_t majorFaults = 0;
     uint32_t numThreads = 0;
     uint64_t startTime = 0;  // Useful when identifying PID/TID reuse
+    uint64_t cpuTime = 0;    // User and system mode time in clock ticks
 };
 
 struct ProcessStats {
@@ -64,7 +71,7 @@ struct ProcessStats {
 class ProcPidStat : public RefBase {
 public:
     explicit ProcPidStat(const std::string& path = kProcDirPath) :
-          mLastProcessStats({}), mPath(path) {
+          mLastProcessStats({}), mCollectionId(0), mPath(path) {
         std::string pidStatPath = StringPrintf((mPath + kStatFileFormat).c_str(), PID_FOR_INIT);
         std::string tidStatPath = StringPrintf((mPath + kTaskDirFormat + kStatFileFormat).c_str(),
                                                PID_FOR_INIT, PID_FOR_INIT);
@@ -79,6 +86,11 @@ public:
     // Collects pid info delta since the last collection.
     virtual android::base::Result<std::vector<ProcessStats>> collect();
 
+    // Restricts the subsequent collections to the processes of the UIDs with the given |appIds|.
+    // The thread stats of the other processes are not read. Empty |appIds| collects all the
+    // processes.
+    virtual void setAppIdFilter(const std::unordered_set<uint32_t>& appIds);
+
     // Called by IoPerfCollection and tests.
     virtual bool enabled() { return mEnabled; }
 
@@ -88,18 +100,49 @@ private:
     // Reads the contents of the below files:
     // 1. Pid stat file at |mPath| + |kStatFileFormat|
     // 2. Tid stat file at |mPath| + |kTaskDirFormat| + |kStatFileFormat|
-    android::base::Result<std::unordered_map<uint32_t, ProcessStats>> getProcessStatsLocked() const;
-
-    // Reads the tgid and real UID for the given PID from |mPath| + |kStatusFileFormat|.
-    android::base::Result<void> getPidStatusLocked(ProcessStats* processStats) const;
+    android::base::Result<std::unordered_map<uint32_t, ProcessStats>> getProcessStatsLocked();
+
+    // Reads the tgid and real UID for the given PID from the status file under |pidDirFd|.
+    android::base::Result<void> getPidStatusLocked(int pidDirFd, ProcessStats* processStats);
+
+    // Per-process state persisted across collections. The static fields are re-read only when the
+    // PID is new or was reused, which is detected by a change in the start time.
+    struct CachedPidDir {
+        android::base::unique_fd pidDirFd;  // Open fd for the pid directory. May be invalid when
+                                            // too many fds are cached.
+        int64_t tgid = -1;
+        int64_t uid = -1;
+        uint64_t startTime = 0;
+        uint64_t lastCollectionId = 0;  // Used to drop the entries for terminated processes.
+    };
 
     // Makes sure only one collection is running at any given time.
     Mutex mMutex;
 
+    // Reusable buffer for the contents of the stat and status files.
+    ProcFileReader mReader GUARDED_BY(mMutex);
+
     // Last dump of per-process stats. Useful for calculating the delta and identifying PID/TID
     // reuse.
     std::unordered_map<uint32_t, ProcessStats> mLastProcessStats GUARDED_BY(mMutex);
 
+    // Cache of per-process state keyed by PID.
+    std::unordered_map<uint32_t, CachedPidDir> mPidDirCache GUARDED_BY(mMutex);
+
+    // Path under which the fds in |mPidDirCache| were opened. The cache is dropped when |mPath|
+    // changes.
+    std::string mPidDirCachePath GUARDED_BY(mMutex);
+
+    // Stream over the directory at |mPidDirCachePath|, kept open and rewound on every collection
+    // so the pid directories are listed without resolving the path again.
+    std::unique_ptr<DIR, int (*)(DIR*)> mProcDirp GUARDED_BY(mMutex){nullptr, closedir};
+
+    // App IDs the collection is restricted to. Empty when all the processes are collected.
+    std::unordered_set<uint32_t> mAppIdFilter GUARDED_BY(mMutex);
+
+    // Incremented on every collection.
+    uint64_t mCollectionId GUARDED_BY(mMutex);
+
     // True if the below files are accessible:
     // 1. Pid stat file at |mPath| + |kTaskStatFileFormat|
     // 2. Tid stat file at |mPath| + |kTaskDirFormat| + |kStatFileFormat|
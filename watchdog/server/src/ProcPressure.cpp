@@ -0,0 +1,247 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "ProcPressure.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::Error;
+using android::base::ErrnoError;
+using android::base::Result;
+using android::base::StartsWith;
+using android::base::StringPrintf;
+using android::base::unique_fd;
+using android::base::WriteFully;
+
+namespace {
+
+const char* const kPressureFileNames[PRESSURE_RESOURCES] = {"cpu", "io", "memory"};
+
+std::string pressureFilePath(const std::string& dirPath, PressureResource resource) {
+    return dirPath + "/" + kPressureFileNames[resource];
+}
+
+// Parses a "some avg10=0.00 avg60=0.00 avg300=0.00 total=12345" line.
+bool parsePressureLine(std::string_view line, PressureType* type, uint64_t* totalStallTime) {
+    Tokenizer tokenizer(line, ' ');
+    std::string_view field;
+    if (!tokenizer.next(&field)) {
+        return false;
+    }
+    if (field == "some") {
+        *type = PRESSURE_SOME;
+    } else if (field == "full") {
+        *type = PRESSURE_FULL;
+    } else {
+        return false;
+    }
+    while (tokenizer.next(&field)) {
+        if (StartsWith(field, "total=")) {
+            return parseNumber(field.substr(6), totalStallTime);
+        }
+    }
+    return false;
+}
+
+bool isAccessible(const std::string& dirPath) {
+    for (int i = 0; i < PRESSURE_RESOURCES; ++i) {
+        if (access(pressureFilePath(dirPath, static_cast<PressureResource>(i)).c_str(), R_OK) !=
+            0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+std::string toString(PressureResource resource) {
+    switch (resource) {
+        case PRESSURE_CPU:
+            return "CPU";
+        case PRESSURE_IO:
+            return "I/O";
+        case PRESSURE_MEMORY:
+            return "Memory";
+        default:
+            return "INVALID";
+    }
+}
+
+ProcPressure::ProcPressure(const std::string& dirPath) :
+      kDirPath(dirPath), kEnabled(isAccessible(dirPath)) {}
+
+Result<ProcPressureInfo> ProcPressure::collect() {
+    if (!kEnabled) {
+        return Error() << "Can not access the pressure files in " << kDirPath;
+    }
+
+    Mutex::Autolock lock(mMutex);
+    const auto& info = getProcPressureLocked();
+    if (!info) {
+        return Error() << "Failed to get pressure stall info: " << info.error();
+    }
+
+    ProcPressureInfo delta;
+    for (int i = 0; i < PRESSURE_RESOURCES; ++i) {
+        for (int j = 0; j < PRESSURE_TYPES; ++j) {
+            // The totals never decrease, so a smaller value means the kernel reset them.
+            delta.stallTime[i][j] = info->stallTime[i][j] >= mLastInfo.stallTime[i][j]
+                    ? info->stallTime[i][j] - mLastInfo.stallTime[i][j]
+                    : info->stallTime[i][j];
+        }
+    }
+    mLastInfo = *info;
+    return delta;
+}
+
+Result<ProcPressureInfo> ProcPressure::getProcPressureLocked() {
+    ProcPressureInfo info;
+    for (int i = 0; i < PRESSURE_RESOURCES; ++i) {
+        const std::string path = pressureFilePath(kDirPath, static_cast<PressureResource>(i));
+        if (const auto& ret = mReader.read(path); !ret) {
+            return Error() << "Failed to read " << path << ": " << ret.error();
+        }
+        Tokenizer lines(mReader.contents(), '\n');
+        std::string_view line;
+        bool didReadSome = false;
+        while (lines.next(&line)) {
+            if (line.empty()) {
+                continue;
+            }
+            PressureType type;
+            uint64_t totalStallTime;
+            if (!parsePressureLine(line, &type, &totalStallTime)) {
+                return Error() << "Failed to parse \"" << line << "\" in " << path;
+            }
+            info.stallTime[i][type] = totalStallTime;
+            didReadSome |= type == PRESSURE_SOME;
+        }
+        if (!didReadSome) {
+            return Error() << "Missing `some .*` line in " << path;
+        }
+    }
+    return info;
+}
+
+Result<void> ProcPressure::startMonitor(const std::vector<PressureTrigger>& triggers,
+                                        const std::function<void(PressureResource)>& onStall) {
+    Mutex::Autolock lock(mMonitorMutex);
+    if (mMonitorThread.joinable()) {
+        return Error() << "Pressure stall monitor is already running";
+    }
+    std::vector<unique_fd> triggerFds;
+    std::vector<PressureResource> resources;
+    std::string lastError;
+    for (const auto& trigger : triggers) {
+        const std::string path = pressureFilePath(kDirPath, trigger.resource);
+        unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC)));
+        // The kernel parses the trigger as a NUL-terminated string.
+        const std::string config =
+                StringPrintf("%s %lld %lld", trigger.type == PRESSURE_SOME ? "some" : "full",
+                             static_cast<long long>(trigger.threshold.count()),
+                             static_cast<long long>(trigger.window.count()));
+        if (fd.get() == -1 || !WriteFully(fd.get(), config.c_str(), config.size() + 1)) {
+            lastError = StringPrintf("Failed to register PSI trigger \"%s\" on %s: %s",
+                                     config.c_str(), path.c_str(), strerror(errno));
+            ALOGW("%s", lastError.c_str());
+            continue;
+        }
+        triggerFds.emplace_back(std::move(fd));
+        resources.push_back(trigger.resource);
+    }
+    if (triggerFds.empty()) {
+        return Error() << (lastError.empty() ? "No PSI triggers to register" : lastError);
+    }
+    mMonitorStopFd.reset(eventfd(0, EFD_CLOEXEC));
+    if (mMonitorStopFd.get() == -1) {
+        return ErrnoError() << "Failed to create eventfd for the pressure stall monitor";
+    }
+    mMonitorThread = std::thread(&ProcPressure::monitor, std::move(triggerFds),
+                                 std::move(resources), mMonitorStopFd.get(), onStall);
+    return {};
+}
+
+void ProcPressure::stopMonitor() {
+    Mutex::Autolock lock(mMonitorMutex);
+    if (!mMonitorThread.joinable()) {
+        return;
+    }
+    const uint64_t value = 1;
+    if (TEMP_FAILURE_RETRY(write(mMonitorStopFd.get(), &value, sizeof(value))) == -1) {
+        ALOGE("Failed to stop the pressure stall monitor: %s", strerror(errno));
+        mMonitorThread.detach();
+        return;
+    }
+    mMonitorThread.join();
+    mMonitorStopFd.reset();
+}
+
+void ProcPressure::monitor(std::vector<unique_fd> triggerFds,
+                           std::vector<PressureResource> resources, int stopFd,
+                           std::function<void(PressureResource)> onStall) {
+    if (int ret = pthread_setname_np(pthread_self(), "PressureMonitor"); ret != 0) {
+        ALOGW("Failed to set pressure stall monitor thread name: %d", ret);
+    }
+    std::vector<pollfd> pollFds;
+    for (const auto& fd : triggerFds) {
+        pollFds.push_back({.fd = fd.get(), .events = POLLPRI, .revents = 0});
+    }
+    pollFds.push_back({.fd = stopFd, .events = POLLIN, .revents = 0});
+    while (true) {
+        if (TEMP_FAILURE_RETRY(poll(pollFds.data(), pollFds.size(), /*timeout=*/-1)) == -1) {
+            ALOGE("Failed to poll the PSI triggers: %s", strerror(errno));
+            return;
+        }
+        if (pollFds.back().revents != 0) {
+            return;
+        }
+        for (size_t i = 0; i < triggerFds.size(); ++i) {
+            if (pollFds[i].revents & POLLERR) {
+                // The trigger is no longer valid. Negative fds are ignored by poll.
+                ALOGW("PSI trigger for %s stopped working", toString(resources[i]).c_str());
+                pollFds[i].fd = -1;
+                continue;
+            }
+            if (pollFds[i].revents & POLLPRI) {
+                onStall(resources[i]);
+            }
+        }
+    }
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
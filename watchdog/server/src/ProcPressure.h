@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_PROCPRESSURE_H_
+#define WATCHDOG_SERVER_SRC_PROCPRESSURE_H_
+
+#include <android-base/result.h>
+#include <android-base/unique_fd.h>
+#include <stdint.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ProcFileReader.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+constexpr const char* kProcPressureDirPath = "/proc/pressure";
+
+enum PressureResource {
+    PRESSURE_CPU = 0,
+    PRESSURE_IO,
+    PRESSURE_MEMORY,
+    PRESSURE_RESOURCES,
+};
+
+enum PressureType {
+    PRESSURE_SOME = 0,  // Some tasks stalled on the resource.
+    PRESSURE_FULL,      // All non-idle tasks stalled on the resource simultaneously.
+    PRESSURE_TYPES,
+};
+
+std::string toString(PressureResource resource);
+
+struct ProcPressureInfo {
+    // Stall time in microseconds. Kernels that don't report the full stall time for a resource
+    // (for example, CPU on older kernels) leave it as 0.
+    uint64_t stallTime[PRESSURE_RESOURCES][PRESSURE_TYPES] = {{0}};
+
+    bool operator==(const ProcPressureInfo& info) const {
+        return memcmp(&stallTime, &info.stallTime, sizeof(stallTime)) == 0;
+    }
+};
+
+// PSI trigger that fires when the tasks stall on |resource| for more than |threshold| within any
+// |window|. See Documentation/accounting/psi.rst in the kernel tree.
+struct PressureTrigger {
+    PressureResource resource;
+    PressureType type;
+    std::chrono::microseconds threshold;
+    std::chrono::microseconds window;
+};
+
+// Collector/parser for the `/proc/pressure/{cpu,io,memory}` Pressure Stall Information files.
+class ProcPressure : public RefBase {
+public:
+    explicit ProcPressure(const std::string& dirPath = kProcPressureDirPath);
+
+    virtual ~ProcPressure() { stopMonitor(); }
+
+    // Collects the stall time delta since the last collection.
+    virtual android::base::Result<ProcPressureInfo> collect();
+
+    // Returns true when all the pressure files are accessible. Otherwise, returns false.
+    // Called by IoPerfCollection and tests.
+    virtual bool enabled() { return kEnabled; }
+
+    virtual std::string dirPath() { return kDirPath; }
+
+    // Registers the |triggers| and calls |onStall| on a monitor thread whenever any of them fires.
+    // Returns an error when none of the triggers could be registered.
+    virtual android::base::Result<void> startMonitor(
+            const std::vector<PressureTrigger>& triggers,
+            const std::function<void(PressureResource)>& onStall);
+
+    // Stops the monitor thread and unregisters the triggers. Must not be called from |onStall|.
+    virtual void stopMonitor();
+
+private:
+    // Reads the cumulative stall times from the pressure files.
+    android::base::Result<ProcPressureInfo> getProcPressureLocked();
+
+    // Polls |triggerFds| until |mMonitorStopFd| is signaled.
+    static void monitor(std::vector<android::base::unique_fd> triggerFds,
+                        std::vector<PressureResource> resources, int stopFd,
+                        std::function<void(PressureResource)> onStall);
+
+    // Makes sure only one collection is running at any given time.
+    Mutex mMutex;
+
+    // Reusable buffer for the contents of the pressure files.
+    ProcFileReader mReader GUARDED_BY(mMutex);
+
+    // Last cumulative stall times.
+    ProcPressureInfo mLastInfo GUARDED_BY(mMutex);
+
+    // Path to the pressure files directory. Default path is |kProcPressureDirPath|.
+    const std::string kDirPath;
+
+    // True if all the pressure files are accessible.
+    const bool kEnabled;
+
+    // Makes sure only one monitor is running at any given time.
+    Mutex mMonitorMutex;
+
+    // Thread polling the PSI triggers.
+    std::thread mMonitorThread GUARDED_BY(mMonitorMutex);
+
+    // Eventfd that wakes up the monitor thread to stop it.
+    android::base::unique_fd mMonitorStopFd GUARDED_BY(mMonitorMutex);
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_PROCPRESSURE_H_
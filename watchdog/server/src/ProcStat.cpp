@@ -18,52 +18,54 @@
 
 #include "ProcStat.h"
 
-#include <android-base/file.h>
-#include <android-base/parseint.h>
+#include <android-base/macros.h>
 #include <android-base/strings.h>
 #include <log/log.h>
 
 #include <string>
-#include <vector>
+#include <string_view>
 
 namespace android {
 namespace automotive {
 namespace watchdog {
 
 using android::base::Error;
-using android::base::ReadFileToString;
 using android::base::Result;
 using android::base::StartsWith;
-using base::ParseUint;
-using base::Split;
 
 namespace {
 
-bool parseCpuStats(const std::string& data, CpuStats* cpuStats) {
-    std::vector<std::string> fields = Split(data, " ");
-    if (fields.size() == 12 && fields[1].empty()) {
+bool parseCpuStats(std::string_view data, CpuStats* cpuStats) {
+    Tokenizer tokenizer(data, ' ');
+    std::string_view field;
+    bool isValid = tokenizer.next(&field) && field == "cpu";
+    if (isValid && StartsWith(tokenizer.remaining(), " ")) {
         // The first cpu line will have an extra space after the first word. This will generate an
-        // empty element when the line is split on " ". Erase the extra element.
-        fields.erase(fields.begin() + 1);
+        // empty field when the line is split on " ". Skip the extra field.
+        tokenizer.next(&field);
     }
-    if (fields.size() != 11 || fields[0] != "cpu" || !ParseUint(fields[1], &cpuStats->userTime) ||
-        !ParseUint(fields[2], &cpuStats->niceTime) || !ParseUint(fields[3], &cpuStats->sysTime) ||
-        !ParseUint(fields[4], &cpuStats->idleTime) ||
-        !ParseUint(fields[5], &cpuStats->ioWaitTime) || !ParseUint(fields[6], &cpuStats->irqTime) ||
-        !ParseUint(fields[7], &cpuStats->softIrqTime) ||
-        !ParseUint(fields[8], &cpuStats->stealTime) ||
-        !ParseUint(fields[9], &cpuStats->guestTime) ||
-        !ParseUint(fields[10], &cpuStats->guestNiceTime)) {
-        ALOGW("Invalid cpu line: \"%s\"", data.c_str());
+    uint64_t* cpuFields[] = {
+            &cpuStats->userTime,    &cpuStats->niceTime,   &cpuStats->sysTime,
+            &cpuStats->idleTime,    &cpuStats->ioWaitTime, &cpuStats->irqTime,
+            &cpuStats->softIrqTime, &cpuStats->stealTime,  &cpuStats->guestTime,
+            &cpuStats->guestNiceTime,
+    };
+    for (size_t i = 0; isValid && i < arraysize(cpuFields); ++i) {
+        isValid = tokenizer.next(&field) && parseNumber(field, cpuFields[i]);
+    }
+    if (!isValid || tokenizer.next(&field)) {
+        ALOGW("Invalid cpu line: \"%.*s\"", static_cast<int>(data.size()), data.data());
         return false;
     }
     return true;
 }
 
-bool parseProcsCount(const std::string& data, uint32_t* out) {
-    std::vector<std::string> fields = Split(data, " ");
-    if (fields.size() != 2 || !StartsWith(fields[0], "procs_") || !ParseUint(fields[1], out)) {
-        ALOGW("Invalid procs_ line: \"%s\"", data.c_str());
+bool parseProcsCount(std::string_view data, uint32_t* out) {
+    Tokenizer tokenizer(data, ' ');
+    std::string_view field;
+    if (!tokenizer.next(&field) || !StartsWith(field, "procs_") || !tokenizer.next(&field) ||
+        !parseNumber(field, out) || tokenizer.next(&field)) {
+        ALOGW("Invalid procs_ line: \"%.*s\"", static_cast<int>(data.size()), data.data());
         return false;
     }
     return true;
@@ -104,48 +106,48 @@ Result<ProcStatInfo> ProcStat::collect() {
     return delta;
 }
 
-Result<ProcStatInfo> ProcStat::getProcStatLocked() const {
-    std::string buffer;
-    if (!ReadFileToString(kPath, &buffer)) {
-        return Error() << "ReadFileToString failed for " << kPath;
+Result<ProcStatInfo> ProcStat::getProcStatLocked() {
+    if (const auto& ret = mReader.readKeepOpen(kPath); !ret) {
+        return Error() << "Failed to read " << kPath << ": " << ret.error();
     }
 
-    std::vector<std::string> lines = Split(std::move(buffer), "\n");
+    Tokenizer lines(mReader.contents(), '\n');
     ProcStatInfo info;
     bool didReadProcsRunning = false;
     bool didReadProcsBlocked = false;
-    for (size_t i = 0; i < lines.size(); i++) {
-        if (lines[i].empty()) {
+    std::string_view line;
+    while (lines.next(&line)) {
+        if (line.empty()) {
             continue;
         }
-        if (!lines[i].compare(0, 4, "cpu ")) {
+        if (StartsWith(line, "cpu ")) {
             if (info.totalCpuTime() != 0) {
                 return Error() << "Duplicate `cpu .*` line in " << kPath;
             }
-            if (!parseCpuStats(std::move(lines[i]), &info.cpuStats)) {
+            if (!parseCpuStats(line, &info.cpuStats)) {
                 return Error() << "Failed to parse `cpu .*` line in " << kPath;
             }
-        } else if (!lines[i].compare(0, 6, "procs_")) {
-            if (!lines[i].compare(0, 13, "procs_running")) {
+        } else if (StartsWith(line, "procs_")) {
+            if (StartsWith(line, "procs_running")) {
                 if (didReadProcsRunning) {
                     return Error() << "Duplicate `procs_running .*` line in " << kPath;
                 }
-                if (!parseProcsCount(std::move(lines[i]), &info.runnableProcessesCnt)) {
+                if (!parseProcsCount(line, &info.runnableProcessesCnt)) {
                     return Error() << "Failed to parse `procs_running .*` line in " << kPath;
                 }
                 didReadProcsRunning = true;
                 continue;
-            } else if (!lines[i].compare(0, 13, "procs_blocked")) {
+            } else if (StartsWith(line, "procs_blocked")) {
                 if (didReadProcsBlocked) {
                     return Error() << "Duplicate `procs_blocked .*` line in " << kPath;
                 }
-                if (!parseProcsCount(std::move(lines[i]), &info.ioBlockedProcessesCnt)) {
+                if (!parseProcsCount(line, &info.ioBlockedProcessesCnt)) {
                     return Error() << "Failed to parse `procs_blocked .*` line in " << kPath;
                 }
                 didReadProcsBlocked = true;
                 continue;
             }
-            return Error() << "Unknown procs_ line `" << lines[i] << "` in " << kPath;
+            return Error() << "Unknown procs_ line `" << line << "` in " << kPath;
         }
     }
     if (info.totalCpuTime() == 0 || !didReadProcsRunning || !didReadProcsBlocked) {
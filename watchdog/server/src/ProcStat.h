@@ -22,6 +22,10 @@
 #include <utils/Mutex.h>
 #include <utils/RefBase.h>
 
+#include <string>
+
+#include "ProcFileReader.h"
+
 namespace android {
 namespace automotive {
 namespace watchdog {
@@ -82,11 +86,14 @@ public:
 
 private:
     // Reads the contents of |kPath|.
-    android::base::Result<ProcStatInfo> getProcStatLocked() const;
+    android::base::Result<ProcStatInfo> getProcStatLocked();
 
     // Makes sure only one collection is running at any given time.
     Mutex mMutex;
 
+    // Reusable buffer and kept-open fd for the file at |kPath|.
+    ProcFileReader mReader GUARDED_BY(mMutex);
+
     // Last dump of cpu stats from the file at |kPath|.
     CpuStats mLastCpuStats GUARDED_BY(mMutex);
 
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_RINGBUFFER_H_
+#define WATCHDOG_SERVER_SRC_RINGBUFFER_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// FIFO cache that holds at most |maxSize| elements, where |maxSize| is provided on each push so the
+// owner can change the limit at any time. Once full, a push swaps the new element with the oldest
+// element instead of shifting the remaining elements. The caller gets the evicted element back and
+// can reuse its allocations for the next push.
+template <typename T>
+class RingBuffer {
+public:
+    RingBuffer() : mHead(0) {}
+
+    size_t size() const { return mElements.size(); }
+
+    bool empty() const { return mElements.empty(); }
+
+    // Returns the element at |index|, where index 0 is the oldest element.
+    const T& operator[](size_t index) const {
+        return mElements[(mHead + index) % mElements.size()];
+    }
+
+    T& operator[](size_t index) { return mElements[(mHead + index) % mElements.size()]; }
+
+    void clear() {
+        mElements.clear();
+        mHead = 0;
+    }
+
+    // Adds |*element| as the newest element. When the buffer already holds |maxSize| elements,
+    // |*element| is swapped with the oldest element. Otherwise, |*element| is moved from.
+    void push(T* element, size_t maxSize) {
+        if (maxSize == 0) {
+            clear();
+            return;
+        }
+        if (mElements.size() > maxSize || (mElements.size() < maxSize && mHead != 0)) {
+            // The limit changed after the buffer wrapped around. Restore the insertion order before
+            // resizing.
+            std::rotate(mElements.begin(), mElements.begin() + mHead, mElements.end());
+            mHead = 0;
+            if (mElements.size() > maxSize) {
+                mElements.erase(mElements.begin(),
+                                mElements.begin() + (mElements.size() - maxSize));
+            }
+        }
+        if (mElements.size() < maxSize) {
+            mElements.emplace_back(std::move(*element));
+            return;
+        }
+        std::swap(mElements[mHead], *element);
+        mHead = (mHead + 1) % mElements.size();
+    }
+
+private:
+    std::vector<T> mElements;
+    // Position of the oldest element in |mElements|.
+    size_t mHead;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_RINGBUFFER_H_
@@ -18,6 +18,10 @@
 
 #include "ServiceManager.h"
 
+#include <log/log.h>
+
+#include "StartupTimeline.h"
+
 namespace android {
 namespace automotive {
 namespace watchdog {
@@ -31,6 +35,7 @@ using android::base::Result;
 sp<WatchdogProcessService> ServiceManager::sWatchdogProcessService = nullptr;
 sp<IoPerfCollection> ServiceManager::sIoPerfCollection = nullptr;
 sp<WatchdogBinderMediator> ServiceManager::sWatchdogBinderMediator = nullptr;
+std::thread ServiceManager::sIoPerfCollectionStarter;
 
 Result<void> ServiceManager::startServices(const sp<Looper>& looper) {
     if (sWatchdogProcessService != nullptr || sIoPerfCollection != nullptr ||
@@ -41,14 +46,32 @@ Result<void> ServiceManager::startServices(const sp<Looper>& looper) {
     if (!result.ok()) {
         return result;
     }
-    result = startIoPerfCollection();
+    result = createIoPerfCollection();
     if (!result.ok()) {
         return result;
     }
     return {};
 }
 
+void ServiceManager::startIoPerfCollectionAsync() {
+    sp<IoPerfCollection> service = sIoPerfCollection;
+    if (service == nullptr || sIoPerfCollectionStarter.joinable()) {
+        return;
+    }
+    sIoPerfCollectionStarter = std::thread([service]() {
+        StartupTimeline::ScopedPhase phase("I/O performance collection warm-up");
+        if (const auto& result = service->start(); !result.ok()) {
+            ALOGE("Failed to start I/O performance collection: %s",
+                  result.error().message().c_str());
+        }
+    });
+}
+
 void ServiceManager::terminateServices() {
+    // The collection must not be terminated while it is being started.
+    if (sIoPerfCollectionStarter.joinable()) {
+        sIoPerfCollectionStarter.join();
+    }
     if (sWatchdogProcessService != nullptr) {
         sWatchdogProcessService->terminate();
         sWatchdogProcessService = nullptr;
@@ -64,22 +87,30 @@ void ServiceManager::terminateServices() {
 }
 
 Result<void> ServiceManager::startProcessAnrMonitor(const sp<Looper>& looper) {
+    StartupTimeline::ScopedPhase phase("Process ANR monitor start");
     sWatchdogProcessService = new WatchdogProcessService(looper);
     return {};
 }
 
-Result<void> ServiceManager::startIoPerfCollection() {
+Result<void> ServiceManager::createIoPerfCollection() {
+    StartupTimeline::ScopedPhase phase("I/O performance collection creation");
     sp<IoPerfCollection> service = new IoPerfCollection();
-    const auto& result = service->start();
-    if (!result.ok()) {
-        return Error(result.error().code())
-                << "Failed to start I/O performance collection: " << result.error();
-    }
+    sp<WatchdogProcessService> processService = sWatchdogProcessService;
+    service->setWriteBudgetCallback(
+            [processService](const std::vector<WriteBudgetViolation>& violations) {
+                if (const auto ret = processService->notifyWriteBudgetExceeded(violations);
+                    !ret.ok()) {
+                    ALOGW("%s", ret.error().message().c_str());
+                }
+            });
+    // Binder calls can reach the collection before it is started, which it handles as a
+    // collection that hasn't begun yet.
     sIoPerfCollection = service;
     return {};
 }
 
 Result<void> ServiceManager::startBinderMediator() {
+    StartupTimeline::ScopedPhase phase("Binder mediator registration");
     sWatchdogBinderMediator = new WatchdogBinderMediator();
     const auto& result = sWatchdogBinderMediator->init(sWatchdogProcessService, sIoPerfCollection);
     if (!result.ok()) {
@@ -21,6 +21,8 @@
 #include <utils/Looper.h>
 #include <utils/StrongPointer.h>
 
+#include <thread>
+
 #include "IoPerfCollection.h"
 #include "WatchdogBinderMediator.h"
 #include "WatchdogProcessService.h"
@@ -29,19 +31,29 @@ namespace android {
 namespace automotive {
 namespace watchdog {
 
+// Starts the services in the order that gets the binder interface registered soonest: the
+// process ANR monitor and an idle I/O performance collection are set up first, the binder
+// mediator is registered with them, and only then does the collection warm up in the background.
 class ServiceManager {
 public:
     static android::base::Result<void> startServices(const android::sp<Looper>& looper);
     static android::base::Result<void> startBinderMediator();
+
+    // Starts the I/O performance collection on a background thread, so reading its sysprops and
+    // setting up its collectors doesn't delay the binder clients. The collection stays idle, and
+    // the daemon keeps running without it, if the start fails.
+    static void startIoPerfCollectionAsync();
+
     static void terminateServices();
 
 private:
     static android::base::Result<void> startProcessAnrMonitor(const android::sp<Looper>& looper);
-    static android::base::Result<void> startIoPerfCollection();
+    static android::base::Result<void> createIoPerfCollection();
 
     static android::sp<WatchdogProcessService> sWatchdogProcessService;
     static android::sp<IoPerfCollection> sIoPerfCollection;
     static android::sp<WatchdogBinderMediator> sWatchdogBinderMediator;
+    static std::thread sIoPerfCollectionStarter;
 };
 
 }  // namespace watchdog
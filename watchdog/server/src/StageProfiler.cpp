@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "StageProfiler.h"
+
+#include <android-base/stringprintf.h>
+#include <cutils/trace.h>
+#include <inttypes.h>
+#include <malloc.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringAppendF;
+
+namespace {
+
+// Upper bound of the bucket at |index| in nanoseconds.
+nsecs_t bucketUpperBound(size_t index) {
+    return static_cast<nsecs_t>(
+            std::ceil(1000.0 *
+                      std::exp2(static_cast<double>(index) /
+                                DurationHistogram::kBucketsPerPowerOfTwo)));
+}
+
+double toMillis(nsecs_t duration) {
+    return static_cast<double>(duration) / 1000000.0;
+}
+
+}  // namespace
+
+void DurationHistogram::record(nsecs_t duration) {
+    size_t index = 0;
+    if (duration >= 1000) {
+        const double log = std::log2(static_cast<double>(duration) / 1000.0);
+        index = std::min(static_cast<size_t>(log * kBucketsPerPowerOfTwo) + 1, kNumBuckets - 1);
+    }
+    ++mCounts[index];
+    ++mCount;
+    mMax = std::max(mMax, duration);
+}
+
+nsecs_t DurationHistogram::percentile(double percentile) const {
+    if (mCount == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(
+            1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(mCount))));
+    uint64_t sum = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        sum += mCounts[i];
+        if (sum >= rank) {
+            // The last bucket has no upper bound.
+            return i + 1 == kNumBuckets ? mMax : std::min(bucketUpperBound(i), mMax);
+        }
+    }
+    return mMax;
+}
+
+std::string DurationHistogram::toString() const {
+    return android::base::StringPrintf("count: %" PRIu64
+                                       ", p50: %.3fms, p95: %.3fms, p99: %.3fms, max: %.3fms",
+                                       mCount, toMillis(percentile(50)),
+                                       toMillis(percentile(95)), toMillis(percentile(99)),
+                                       toMillis(mMax));
+}
+
+void StageProfiler::record(const std::string& stage, nsecs_t duration) {
+    if (atrace_is_tag_enabled(ATRACE_TAG_SYSTEM_SERVER)) {
+        atrace_int64(ATRACE_TAG_SYSTEM_SERVER, (mComponent + ":" + stage).c_str(),
+                     ns2us(duration));
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStages[stage].durations.record(duration);
+}
+
+void StageProfiler::recordHeapGrowth(const std::string& stage, int64_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    StageStats& stats = mStages[stage];
+    ++stats.heapSamples;
+    stats.totalHeapGrowth += bytes;
+}
+
+std::string StageProfiler::dump(const char* indent) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::string buffer;
+    for (const auto& [stage, stats] : mStages) {
+        StringAppendF(&buffer, "%s%s: %s", indent, stage.c_str(),
+                      stats.durations.toString().c_str());
+        if (stats.heapSamples > 0) {
+            StringAppendF(&buffer, ", average heap growth: %" PRId64 " bytes",
+                          stats.totalHeapGrowth / static_cast<int64_t>(stats.heapSamples));
+        }
+        buffer += "\n";
+    }
+    return buffer;
+}
+
+int64_t StageProfiler::heapAllocatedBytes() {
+    const struct mallinfo info = mallinfo();
+    return static_cast<int64_t>(info.uordblks);
+}
+
+StageProfiler::ScopedTimer::ScopedTimer(StageProfiler* profiler, std::string stage,
+                                        bool trackHeap) :
+      mProfiler(profiler),
+      mStage(std::move(stage)),
+      mTrackHeap(trackHeap),
+      mStartTime(systemTime(SYSTEM_TIME_MONOTONIC)),
+      mStartHeapBytes(trackHeap ? heapAllocatedBytes() : 0) {}
+
+StageProfiler::ScopedTimer::~ScopedTimer() {
+    mProfiler->record(mStage, systemTime(SYSTEM_TIME_MONOTONIC) - mStartTime);
+    if (mTrackHeap) {
+        mProfiler->recordHeapGrowth(mStage, heapAllocatedBytes() - mStartHeapBytes);
+    }
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
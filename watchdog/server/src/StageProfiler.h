@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_STAGEPROFILER_H_
+#define WATCHDOG_SERVER_SRC_STAGEPROFILER_H_
+
+#include <android-base/thread_annotations.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Histogram of stage durations with logarithmic buckets, four per power of two, from 1us to
+// about 2 minutes. Percentiles are reported as the upper bound of their bucket, so they are
+// overestimated by at most 19%.
+class DurationHistogram {
+public:
+    void record(nsecs_t duration);
+    uint64_t count() const { return mCount; }
+    nsecs_t max() const { return mMax; }
+    // Returns the duration below which |percentile| percent of the durations fall.
+    nsecs_t percentile(double percentile) const;
+    std::string toString() const;
+
+    static constexpr size_t kBucketsPerPowerOfTwo = 4;
+    static constexpr size_t kNumBuckets = 27 * kBucketsPerPowerOfTwo;
+
+private:
+    std::array<uint64_t, kNumBuckets> mCounts = {};
+    uint64_t mCount = 0;
+    nsecs_t mMax = 0;
+};
+
+// Records the durations of the named stages of a component, such as the `/proc` collectors of
+// a collection, and reports their percentiles. Each recorded duration is also emitted as an
+// ATRACE counter named "<component>:<stage>" in microseconds, so the watchdog's own overhead
+// shows up in system traces.
+//
+// StageProfiler is thread-safe.
+class StageProfiler {
+public:
+    explicit StageProfiler(std::string component) : mComponent(std::move(component)) {}
+
+    void record(const std::string& stage, nsecs_t duration);
+
+    // Records the net heap growth of |stage|, which is an upper bound on the bytes it leaked
+    // and a lower bound on the bytes it allocated.
+    void recordHeapGrowth(const std::string& stage, int64_t bytes);
+
+    // Returns the stage percentiles, one stage per line prefixed by |indent|.
+    std::string dump(const char* indent);
+
+    // Returns the bytes allocated on the heap by the process.
+    static int64_t heapAllocatedBytes();
+
+    // Records the time from construction to destruction as |stage|. When |trackHeap| is true,
+    // the net heap growth during the time is recorded too. Tracking the heap walks the
+    // allocator's statistics, so only use it for the coarse stages.
+    class ScopedTimer {
+    public:
+        ScopedTimer(StageProfiler* profiler, std::string stage, bool trackHeap = false);
+        ~ScopedTimer();
+
+    private:
+        StageProfiler* mProfiler;
+        std::string mStage;
+        bool mTrackHeap;
+        nsecs_t mStartTime;
+        int64_t mStartHeapBytes;
+    };
+
+private:
+    struct StageStats {
+        DurationHistogram durations;
+        uint64_t heapSamples = 0;
+        int64_t totalHeapGrowth = 0;
+    };
+
+    const std::string mComponent;
+    std::mutex mMutex;
+    // Ordered by stage name so the dump is stable.
+    std::map<std::string, StageStats> mStages GUARDED_BY(mMutex);
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_STAGEPROFILER_H_
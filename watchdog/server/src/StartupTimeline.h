@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_STARTUPTIMELINE_H_
+#define WATCHDOG_SERVER_SRC_STARTUPTIMELINE_H_
+
+#include <android-base/stringprintf.h>
+#include <android-base/thread_annotations.h>
+#include <inttypes.h>
+#include <utils/Timers.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Records when each start-up phase of carwatchdogd began and how long it took, relative to the
+// first use of the timeline, so the self profile dump shows what held up the binder
+// registration and the collector warm-up.
+//
+// StartupTimeline is thread-safe.
+class StartupTimeline {
+public:
+    static StartupTimeline& get() {
+        // Phases may still finish on a background thread while the process exits, so it is never
+        // destroyed.
+        static StartupTimeline* timeline = new StartupTimeline();
+        return *timeline;
+    }
+
+    // Records |phase| as having run from |startTime| until now.
+    void record(const std::string& phase, nsecs_t startTime) {
+        const nsecs_t endTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPhases.push_back({phase, startTime - mOriginTime, endTime - startTime});
+    }
+
+    // Returns the phases in the order they finished, one per line prefixed by |indent|.
+    std::string dump(const char* indent) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::string buffer;
+        for (const auto& phase : mPhases) {
+            android::base::StringAppendF(&buffer, "%s%s: started at %" PRId64 "ms, took %" PRId64
+                                         "ms\n",
+                                         indent, phase.name.c_str(), ns2ms(phase.startOffset),
+                                         ns2ms(phase.duration));
+        }
+        return buffer;
+    }
+
+    // Records the time from construction to destruction as |phase|.
+    class ScopedPhase {
+    public:
+        explicit ScopedPhase(std::string phase) :
+              mPhase(std::move(phase)), mStartTime(systemTime(SYSTEM_TIME_MONOTONIC)) {}
+        ~ScopedPhase() { StartupTimeline::get().record(mPhase, mStartTime); }
+
+    private:
+        std::string mPhase;
+        nsecs_t mStartTime;
+    };
+
+private:
+    StartupTimeline() : mOriginTime(systemTime(SYSTEM_TIME_MONOTONIC)) {}
+
+    struct Phase {
+        std::string name;
+        nsecs_t startOffset;
+        nsecs_t duration;
+    };
+
+    const nsecs_t mOriginTime;
+    std::mutex mMutex;
+    std::vector<Phase> mPhases GUARDED_BY(mMutex);
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  // WATCHDOG_SERVER_SRC_STARTUPTIMELINE_H_
@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_TIMERWHEEL_H_
+#define WATCHDOG_SERVER_SRC_TIMERWHEEL_H_
+
+#include <stdint.h>
+#include <utils/Timers.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Hierarchical timer wheel that expires values by their uptime deadlines. Each level has
+// |kSlots| slots and each slot on a level spans |kSlots| slots of the level below it. So,
+// scheduling and cancelling are O(1) and advancing the wheel costs O(expired entries) plus
+// the amortized cascading from the upper levels.
+//
+// Deadlines are rounded up to |tick|, so values may expire up to one tick late. Deadlines
+// further than kSlots^kLevels ticks are clamped to the farthest tick.
+template <typename Key, typename Value>
+class TimerWheel {
+public:
+    explicit TimerWheel(std::chrono::nanoseconds tick) : kTick(tick.count()), mCurrentTick(0) {}
+
+    // Schedules |value| with |key| to expire at |deadline|. Replaces any value previously
+    // scheduled with |key|.
+    void schedule(const Key& key, Value value, nsecs_t deadline) {
+        cancel(key);
+        const uint64_t deadlineTick =
+                deadline <= 0 ? 0 : (static_cast<uint64_t>(deadline) + kTick - 1) / kTick;
+        place(Entry{key, std::move(value), deadlineTick});
+    }
+
+    // Removes the value scheduled with |key| and returns it.
+    std::optional<Value> cancel(const Key& key) {
+        auto it = mLocations.find(key);
+        if (it == mLocations.end()) {
+            return std::nullopt;
+        }
+        const Location location = it->second;
+        mLocations.erase(it);
+        Value value = std::move(location.it->value);
+        mLevels[location.level][location.slot].erase(location.it);
+        --mCounts[location.level];
+        return value;
+    }
+
+    // Advances the wheel to |now| and returns the values whose deadlines are at or before |now|.
+    std::vector<Value> advance(nsecs_t now) {
+        std::vector<Value> expired;
+        const uint64_t targetTick = now <= 0 ? 0 : static_cast<uint64_t>(now) / kTick;
+        expireCurrentTick(&expired);
+        while (mCurrentTick < targetTick) {
+            // Skip the ticks in which no value can expire or cascade down from an upper level.
+            uint64_t nextTick = mCurrentTick + 1;
+            for (size_t level = 0; level < kLevels && mCounts[level] == 0; ++level) {
+                nextTick = levelBoundaryAfter(mCurrentTick, level + 1);
+            }
+            mCurrentTick = std::min(nextTick, targetTick);
+            cascade();
+            expireCurrentTick(&expired);
+        }
+        return expired;
+    }
+
+    // Returns the uptime at which |advance| should be called next, or nullopt when the wheel is
+    // empty. This is either the earliest deadline or the time of the next cascade from an upper
+    // level, whichever comes first.
+    std::optional<nsecs_t> nextExpiry() const {
+        if (mLocations.empty()) {
+            return std::nullopt;
+        }
+        uint64_t nextTick = std::numeric_limits<uint64_t>::max();
+        if (mCounts[0] > 0) {
+            for (uint64_t tick = mCurrentTick; tick < mCurrentTick + kSlots; ++tick) {
+                if (!mLevels[0][tick & kSlotMask].empty()) {
+                    nextTick = tick;
+                    break;
+                }
+            }
+        }
+        for (size_t level = 1; level < kLevels; ++level) {
+            if (mCounts[level] == 0) {
+                continue;
+            }
+            const size_t shift = kSlotBits * level;
+            for (uint64_t index = (mCurrentTick >> shift) + 1;
+                 index <= (mCurrentTick >> shift) + kSlots; ++index) {
+                if (!mLevels[level][index & kSlotMask].empty()) {
+                    nextTick = std::min(nextTick, index << shift);
+                    break;
+                }
+            }
+        }
+        return static_cast<nsecs_t>(nextTick * kTick);
+    }
+
+    size_t size() const { return mLocations.size(); }
+
+    bool empty() const { return mLocations.empty(); }
+
+    void clear() {
+        for (auto& level : mLevels) {
+            for (auto& slot : level) {
+                slot.clear();
+            }
+        }
+        mCounts.fill(0);
+        mLocations.clear();
+    }
+
+private:
+    static constexpr size_t kSlotBits = 6;
+    static constexpr size_t kSlots = 1 << kSlotBits;
+    static constexpr uint64_t kSlotMask = kSlots - 1;
+    static constexpr size_t kLevels = 4;
+
+    struct Entry {
+        Key key;
+        Value value;
+        uint64_t deadlineTick;
+    };
+
+    using Slot = std::list<Entry>;
+
+    struct Location {
+        size_t level;
+        size_t slot;
+        typename Slot::iterator it;
+    };
+
+    // Returns the first tick after |tick| that is a multiple of the span of a slot on |level|.
+    static uint64_t levelBoundaryAfter(uint64_t tick, size_t level) {
+        if (level >= kLevels) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+        const size_t shift = kSlotBits * level;
+        return ((tick >> shift) + 1) << shift;
+    }
+
+    // Links |entry| into the slot that covers its deadline relative to the current tick.
+    void place(Entry entry) {
+        const uint64_t maxDelta = (static_cast<uint64_t>(1) << (kSlotBits * kLevels)) - 1;
+        uint64_t deadlineTick = std::max(entry.deadlineTick, mCurrentTick);
+        deadlineTick = std::min(deadlineTick, mCurrentTick + maxDelta);
+        const uint64_t delta = deadlineTick - mCurrentTick;
+        size_t level = 0;
+        while (level + 1 < kLevels && delta >= (static_cast<uint64_t>(1) << (kSlotBits *
+                                                                              (level + 1)))) {
+            ++level;
+        }
+        const size_t slot = (deadlineTick >> (kSlotBits * level)) & kSlotMask;
+        entry.deadlineTick = deadlineTick;
+        const Key key = entry.key;
+        Slot& slotEntries = mLevels[level][slot];
+        slotEntries.push_back(std::move(entry));
+        mLocations[key] = Location{level, slot, std::prev(slotEntries.end())};
+        ++mCounts[level];
+    }
+
+    // Moves the entries of the upper level slots that start at the current tick to the lower
+    // levels. The upper levels cascade first so their entries may cascade further down.
+    void cascade() {
+        for (size_t level = kLevels - 1; level > 0; --level) {
+            const size_t shift = kSlotBits * level;
+            if ((mCurrentTick & ((static_cast<uint64_t>(1) << shift) - 1)) != 0) {
+                continue;
+            }
+            Slot entries;
+            entries.swap(mLevels[level][(mCurrentTick >> shift) & kSlotMask]);
+            mCounts[level] -= entries.size();
+            for (auto& entry : entries) {
+                mLocations.erase(entry.key);
+                place(std::move(entry));
+            }
+        }
+    }
+
+    void expireCurrentTick(std::vector<Value>* expired) {
+        Slot& slot = mLevels[0][mCurrentTick & kSlotMask];
+        for (auto it = slot.begin(); it != slot.end();) {
+            if (it->deadlineTick > mCurrentTick) {
+                ++it;
+                continue;
+            }
+            mLocations.erase(it->key);
+            expired->emplace_back(std::move(it->value));
+            it = slot.erase(it);
+            --mCounts[0];
+        }
+    }
+
+    const uint64_t kTick;
+    uint64_t mCurrentTick;
+    std::array<std::array<Slot, kSlots>, kLevels> mLevels;
+    std::array<size_t, kLevels> mCounts = {};
+    std::unordered_map<Key, Location> mLocations;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_TIMERWHEEL_H_
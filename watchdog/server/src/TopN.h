@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_TOPN_H_
+#define WATCHDOG_SERVER_SRC_TOPN_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+// Accumulates the values with the |limit| largest non-zero keys. Values are kept in a bounded
+// min-heap, so each push is O(log limit) and the storage never exceeds |limit| entries.
+template <typename T>
+class TopN {
+public:
+    struct Entry {
+        uint64_t key;
+        T value;
+    };
+
+    // Keeps all the pushed values when |limit| is |kUnlimited|.
+    static constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+
+    explicit TopN(size_t limit) : mLimit(limit) {
+        if (limit != kUnlimited) {
+            mEntries.reserve(limit);
+        }
+    }
+
+    // Adds |value| when |key| is greater than the smallest key kept so far. Zero keys are ignored.
+    void push(uint64_t key, T value) {
+        if (key == 0 || mLimit == 0) {
+            return;
+        }
+        if (mEntries.size() < mLimit) {
+            mEntries.push_back(Entry{key, std::move(value)});
+            std::push_heap(mEntries.begin(), mEntries.end(), greaterKey);
+            return;
+        }
+        if (mEntries.front().key >= key) {
+            return;
+        }
+        std::pop_heap(mEntries.begin(), mEntries.end(), greaterKey);
+        mEntries.back() = Entry{key, std::move(value)};
+        std::push_heap(mEntries.begin(), mEntries.end(), greaterKey);
+    }
+
+    // Returns the entries in descending order of their keys. Must be called only once, after all
+    // the values are pushed.
+    const std::vector<Entry>& sorted() {
+        std::sort_heap(mEntries.begin(), mEntries.end(), greaterKey);
+        return mEntries;
+    }
+
+    size_t size() const { return mEntries.size(); }
+
+private:
+    static bool greaterKey(const Entry& lhs, const Entry& rhs) { return lhs.key > rhs.key; }
+
+    const size_t mLimit;
+    std::vector<Entry> mEntries;
+};
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_TOPN_H_
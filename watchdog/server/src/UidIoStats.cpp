@@ -19,50 +19,66 @@
 
 #include "UidIoStats.h"
 
-#include <android-base/file.h>
-#include <android-base/parseint.h>
+#include <android-base/macros.h>
 #include <android-base/stringprintf.h>
-#include <android-base/strings.h>
+#include <cutils/multiuser.h>
 #include <inttypes.h>
 #include <log/log.h>
 
+#include <algorithm>
+#include <numeric>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
-#include <utility>
 
 namespace android {
 namespace automotive {
 namespace watchdog {
 
 using android::base::Error;
-using android::base::ReadFileToString;
 using android::base::Result;
 using android::base::StringPrintf;
-using base::ParseUint;
-using base::Split;
 
 namespace {
 
-bool parseUidIoStats(const std::string& data, UidIoStat* uidIoStat) {
-    std::vector<std::string> fields = Split(data, " ");
-    if (fields.size() < 11 || !ParseUint(fields[0], &uidIoStat->uid) ||
-        !ParseUint(fields[1], &uidIoStat->io[FOREGROUND].rchar) ||
-        !ParseUint(fields[2], &uidIoStat->io[FOREGROUND].wchar) ||
-        !ParseUint(fields[3], &uidIoStat->io[FOREGROUND].readBytes) ||
-        !ParseUint(fields[4], &uidIoStat->io[FOREGROUND].writeBytes) ||
-        !ParseUint(fields[5], &uidIoStat->io[BACKGROUND].rchar) ||
-        !ParseUint(fields[6], &uidIoStat->io[BACKGROUND].wchar) ||
-        !ParseUint(fields[7], &uidIoStat->io[BACKGROUND].readBytes) ||
-        !ParseUint(fields[8], &uidIoStat->io[BACKGROUND].writeBytes) ||
-        !ParseUint(fields[9], &uidIoStat->io[FOREGROUND].fsync) ||
-        !ParseUint(fields[10], &uidIoStat->io[BACKGROUND].fsync)) {
-        ALOGW("Invalid uid I/O stats: \"%s\"", data.c_str());
+bool parseUid(std::string_view data, uint32_t* uid) {
+    Tokenizer tokenizer(data, ' ');
+    std::string_view field;
+    return tokenizer.next(&field) && parseNumber(field, uid);
+}
+
+bool parseUidIoStats(std::string_view data, UidIoStat* uidIoStat) {
+    Tokenizer tokenizer(data, ' ');
+    std::string_view field;
+    // Fields in the order they appear after the uid.
+    uint64_t* ioFields[] = {
+            &uidIoStat->io[FOREGROUND].rchar,     &uidIoStat->io[FOREGROUND].wchar,
+            &uidIoStat->io[FOREGROUND].readBytes, &uidIoStat->io[FOREGROUND].writeBytes,
+            &uidIoStat->io[BACKGROUND].rchar,     &uidIoStat->io[BACKGROUND].wchar,
+            &uidIoStat->io[BACKGROUND].readBytes, &uidIoStat->io[BACKGROUND].writeBytes,
+            &uidIoStat->io[FOREGROUND].fsync,     &uidIoStat->io[BACKGROUND].fsync,
+    };
+    bool isValid = tokenizer.next(&field) && parseNumber(field, &uidIoStat->uid);
+    for (size_t i = 0; isValid && i < arraysize(ioFields); ++i) {
+        isValid = tokenizer.next(&field) && parseNumber(field, ioFields[i]);
+    }
+    if (!isValid) {
+        ALOGW("Invalid uid I/O stats: \"%.*s\"", static_cast<int>(data.size()), data.data());
         return false;
     }
     return true;
 }
 
+void appendRow(const UidIoTable& from, size_t row, UidIoTable* to) {
+    to->uids.push_back(from.uids[row]);
+    for (int i = 0; i < METRIC_TYPES; ++i) {
+        for (int j = 0; j < UID_STATES; ++j) {
+            to->columns[i][j].push_back(from.columns[i][j][row]);
+        }
+    }
+}
+
 }  // namespace
 
 bool IoUsage::isZero() const {
@@ -84,69 +100,198 @@ std::string IoUsage::toString() const {
                         metrics[FSYNC_COUNT][FOREGROUND], metrics[FSYNC_COUNT][BACKGROUND]);
 }
 
-Result<std::unordered_map<uint32_t, UidIoUsage>> UidIoStats::collect() {
-    if (!kEnabled) {
-        return Error() << "Can not access " << kPath;
+const UidIoUsage* UidIoUsages::find(uint32_t uid) const {
+    const auto it = std::lower_bound(usages.begin(), usages.end(), uid,
+                                     [](const UidIoUsage& usage, uint32_t value) {
+                                         return usage.uid < value;
+                                     });
+    return it != usages.end() && it->uid == uid ? &*it : nullptr;
+}
+
+void UidIoTable::clear() {
+    uids.clear();
+    for (auto& metricColumns : columns) {
+        for (auto& column : metricColumns) {
+            column.clear();
+        }
+    }
+}
+
+void UidIoTable::reserve(size_t rows) {
+    uids.reserve(rows);
+    for (auto& metricColumns : columns) {
+        for (auto& column : metricColumns) {
+            column.reserve(rows);
+        }
+    }
+}
+
+void UidIoTable::append(uint32_t uid, const IoUsage& usage) {
+    uids.push_back(uid);
+    for (int i = 0; i < METRIC_TYPES; ++i) {
+        for (int j = 0; j < UID_STATES; ++j) {
+            columns[i][j].push_back(usage.metrics[i][j]);
+        }
+    }
+}
+
+void UidIoTable::sortByUid() {
+    if (std::is_sorted(uids.begin(), uids.end())) {
+        return;
+    }
+    std::vector<size_t> order(uids.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return uids[a] < uids[b]; });
+    std::vector<uint32_t> sortedUids(uids.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        sortedUids[i] = uids[order[i]];
+    }
+    uids.swap(sortedUids);
+    std::vector<uint64_t> sortedColumn(order.size());
+    for (auto& metricColumns : columns) {
+        for (auto& column : metricColumns) {
+            for (size_t i = 0; i < order.size(); ++i) {
+                sortedColumn[i] = column[order[i]];
+            }
+            column.swap(sortedColumn);
+        }
+    }
+}
+
+Result<UidIoUsages> UidIoStats::collect() {
+    if (!enabled()) {
+        return Error() << "Can not access " << filePath();
     }
 
     Mutex::Autolock lock(mMutex);
-    const auto& uidIoStats = getUidIoStatsLocked();
-    if (!uidIoStats.ok() || uidIoStats->empty()) {
-        return Error() << "Failed to get UID IO stats: " << uidIoStats.error();
-    }
-
-    std::unordered_map<uint32_t, UidIoUsage> usage;
-    for (const auto& it : *uidIoStats) {
-        const UidIoStat& uidIoStat = it.second;
-        usage[uidIoStat.uid] = {};
-        struct UidIoUsage& uidUsage = usage[uidIoStat.uid];
-        uidUsage.uid = uidIoStat.uid;
-
-        int64_t fgRdDelta = uidIoStat.io[FOREGROUND].readBytes -
-                            mLastUidIoStats[uidIoStat.uid].io[FOREGROUND].readBytes;
-        int64_t bgRdDelta = uidIoStat.io[BACKGROUND].readBytes -
-                            mLastUidIoStats[uidIoStat.uid].io[BACKGROUND].readBytes;
-        int64_t fgWrDelta = uidIoStat.io[FOREGROUND].writeBytes -
-                            mLastUidIoStats[uidIoStat.uid].io[FOREGROUND].writeBytes;
-        int64_t bgWrDelta = uidIoStat.io[BACKGROUND].writeBytes -
-                            mLastUidIoStats[uidIoStat.uid].io[BACKGROUND].writeBytes;
-        int64_t fgFsDelta =
-            uidIoStat.io[FOREGROUND].fsync - mLastUidIoStats[uidIoStat.uid].io[FOREGROUND].fsync;
-        int64_t bgFsDelta =
-            uidIoStat.io[BACKGROUND].fsync - mLastUidIoStats[uidIoStat.uid].io[BACKGROUND].fsync;
-
-        uidUsage.ios.metrics[READ_BYTES][FOREGROUND] += (fgRdDelta < 0) ? 0 : fgRdDelta;
-        uidUsage.ios.metrics[READ_BYTES][BACKGROUND] += (bgRdDelta < 0) ? 0 : bgRdDelta;
-        uidUsage.ios.metrics[WRITE_BYTES][FOREGROUND] += (fgWrDelta < 0) ? 0 : fgWrDelta;
-        uidUsage.ios.metrics[WRITE_BYTES][BACKGROUND] += (bgWrDelta < 0) ? 0 : bgWrDelta;
-        uidUsage.ios.metrics[FSYNC_COUNT][FOREGROUND] += (fgFsDelta < 0) ? 0 : fgFsDelta;
-        uidUsage.ios.metrics[FSYNC_COUNT][BACKGROUND] += (bgFsDelta < 0) ? 0 : bgFsDelta;
-    }
-    mLastUidIoStats = *uidIoStats;
-    return usage;
+    mCurUidIoStats.clear();
+    mCurUidIoStats.reserve(mLastUidIoStats.size());
+    if (const auto& ret = readUidIoStatsLocked(&mCurUidIoStats); !ret.ok()) {
+        return Error() << "Failed to get UID IO stats: " << ret.error();
+    }
+    if (mCurUidIoStats.size() == 0) {
+        return Error() << "Failed to get UID IO stats: " << filePath() << " has no UIDs";
+    }
+    mCurUidIoStats.sortByUid();
+
+    const UidIoTable& cur = mCurUidIoStats;
+    const UidIoTable& last = mLastUidIoStats;
+    const size_t rows = cur.size();
+
+    // Both tables are sorted by UID, so usually the last table has exactly the same UIDs and its
+    // columns are subtracted as is. Otherwise, merge-join the UIDs to line up the last counters
+    // with the current rows. The UIDs added since the last collection start from zero.
+    const bool isAligned = cur.uids == last.uids;
+    std::vector<size_t> lastRows;
+    if (!isAligned) {
+        lastRows.assign(rows, SIZE_MAX);
+        for (size_t i = 0, j = 0; i < rows && j < last.size();) {
+            if (cur.uids[i] == last.uids[j]) {
+                lastRows[i++] = j++;
+            } else if (cur.uids[i] < last.uids[j]) {
+                ++i;
+            } else {
+                ++j;
+            }
+        }
+    }
+
+    UidIoUsages usages;
+    usages.usages.resize(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        usages.usages[i].uid = cur.uids[i];
+    }
+    std::vector<uint64_t> deltas(rows);
+    for (int m = 0; m < METRIC_TYPES; ++m) {
+        for (int s = 0; s < UID_STATES; ++s) {
+            const uint64_t* curColumn = cur.columns[m][s].data();
+            const uint64_t* lastColumn = last.columns[m][s].data();
+            uint64_t* delta = deltas.data();
+            if (!isAligned) {
+                for (size_t i = 0; i < rows; ++i) {
+                    delta[i] = lastRows[i] == SIZE_MAX ? 0 : lastColumn[lastRows[i]];
+                }
+                lastColumn = delta;
+            }
+            // Branch-free loop, so the compiler vectorizes the subtraction and the sum. Counters
+            // that went backwards, e.g. after the UID was removed and added again, report zero.
+            uint64_t total = 0;
+            for (size_t i = 0; i < rows; ++i) {
+                const uint64_t value = curColumn[i] >= lastColumn[i] ? curColumn[i] - lastColumn[i]
+                                                                     : 0;
+                delta[i] = value;
+                total += value;
+            }
+            usages.total.metrics[m][s] = total;
+            for (size_t i = 0; i < rows; ++i) {
+                usages.usages[i].ios.metrics[m][s] = delta[i];
+            }
+        }
+    }
+
+    if (mAppIdFilter.empty()) {
+        std::swap(mLastUidIoStats, mCurUidIoStats);
+        return usages;
+    }
+    // Keep the last stats of the filtered out UIDs, so their usage is reported since their last
+    // collection once the filter is cleared.
+    mMergedUidIoStats.clear();
+    mMergedUidIoStats.reserve(std::max(rows, last.size()));
+    size_t i = 0, j = 0;
+    while (i < rows || j < last.size()) {
+        if (j == last.size() || (i < rows && cur.uids[i] <= last.uids[j])) {
+            if (j < last.size() && cur.uids[i] == last.uids[j]) {
+                ++j;
+            }
+            appendRow(cur, i++, &mMergedUidIoStats);
+        } else {
+            appendRow(last, j++, &mMergedUidIoStats);
+        }
+    }
+    std::swap(mLastUidIoStats, mMergedUidIoStats);
+    return usages;
 }
 
-Result<std::unordered_map<uint32_t, UidIoStat>> UidIoStats::getUidIoStatsLocked() const {
-    std::string buffer;
-    if (!ReadFileToString(kPath, &buffer)) {
-        return Error() << "ReadFileToString failed for " << kPath;
+void UidIoStats::setAppIdFilter(const std::unordered_set<uint32_t>& appIds) {
+    Mutex::Autolock lock(mMutex);
+    if (mAppIdFilter != appIds) {
+        mAppIdFilter = appIds;
     }
+}
 
-    std::vector<std::string> ioStats = Split(std::move(buffer), "\n");
-    std::unordered_map<uint32_t, UidIoStat> uidIoStats;
+bool UidIoStats::isFilteredOutLocked(uint32_t uid) const {
+    return !mAppIdFilter.empty() &&
+            mAppIdFilter.find(multiuser_get_app_id(uid)) == mAppIdFilter.end();
+}
+
+Result<void> UidIoStats::readUidIoStatsLocked(UidIoTable* table) {
+    if (const auto& ret = mReader.readKeepOpen(kPath); !ret) {
+        return Error() << "Failed to read " << kPath << ": " << ret.error();
+    }
+
+    Tokenizer lines(mReader.contents(), '\n');
     UidIoStat uidIoStat;
-    for (size_t i = 0; i < ioStats.size(); i++) {
-        if (ioStats[i].empty() || !ioStats[i].compare(0, 4, "task")) {
+    std::string_view line;
+    while (lines.next(&line)) {
+        if (line.empty() || line.compare(0, 4, "task") == 0) {
             // Skip per-task stats as CONFIG_UID_SYS_STATS_DEBUG is not set in the kernel and
             // the collected data is aggregated only per-UID.
             continue;
         }
-        if (!parseUidIoStats(std::move(ioStats[i]), &uidIoStat)) {
+        if (uint32_t uid; !mAppIdFilter.empty() && parseUid(line, &uid) &&
+            isFilteredOutLocked(uid)) {
+            continue;
+        }
+        if (!parseUidIoStats(line, &uidIoStat)) {
             return Error() << "Failed to parse the contents of " << kPath;
         }
-        uidIoStats[uidIoStat.uid] = uidIoStat;
+        const IoStat* io = uidIoStat.io;
+        table->append(uidIoStat.uid,
+                      IoUsage(io[FOREGROUND].readBytes, io[BACKGROUND].readBytes,
+                              io[FOREGROUND].writeBytes, io[BACKGROUND].writeBytes,
+                              io[FOREGROUND].fsync, io[BACKGROUND].fsync));
     }
-    return uidIoStats;
+    return {};
 }
 
 }  // namespace watchdog
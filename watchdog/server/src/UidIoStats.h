@@ -23,7 +23,10 @@
 #include <utils/RefBase.h>
 
 #include <string>
-#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ProcFileReader.h"
 
 namespace android {
 namespace automotive {
@@ -88,6 +91,36 @@ struct UidIoUsage {
     IoUsage ios = {};
 };
 
+// Per-UID I/O usage since the last collection, sorted by UID.
+struct UidIoUsages {
+    // Returns the usage of |uid| or nullptr when |uid| is not collected.
+    const UidIoUsage* find(uint32_t uid) const;
+
+    std::vector<UidIoUsage> usages;
+    // Sum of all the |usages|.
+    IoUsage total = {};
+};
+
+// Cumulative per-UID I/O stats laid out as one column per metric so the deltas between two
+// collections are computed with a single pass per column over contiguous counters.
+class UidIoTable {
+public:
+    size_t size() const { return uids.size(); }
+
+    void clear();
+
+    void reserve(size_t rows);
+
+    void append(uint32_t uid, const IoUsage& usage);
+
+    // Sorts the rows by UID. No-op when the rows are already sorted.
+    void sortByUid();
+
+    // Rows ordered by |uids|.
+    std::vector<uint32_t> uids;
+    std::vector<uint64_t> columns[METRIC_TYPES][UID_STATES];
+};
+
 class UidIoStats : public RefBase {
 public:
     explicit UidIoStats(const std::string& path = kUidIoStatsPath) :
@@ -96,7 +129,11 @@ public:
     virtual ~UidIoStats() {}
 
     // Collects the I/O usage since the last collection.
-    virtual android::base::Result<std::unordered_map<uint32_t, UidIoUsage>> collect();
+    virtual android::base::Result<UidIoUsages> collect();
+
+    // Restricts the subsequent collections to the UIDs with the given |appIds|. The usage of the
+    // other UIDs is neither parsed nor reported. Empty |appIds| collects all the UIDs.
+    virtual void setAppIdFilter(const std::unordered_set<uint32_t>& appIds);
 
     // Returns true when the uid_io stats file is accessible. Otherwise, returns false.
     // Called by IoPerfCollection and tests.
@@ -104,15 +141,31 @@ public:
 
     virtual std::string filePath() { return kPath; }
 
+protected:
+    // Appends the cumulative per-UID I/O stats from |kPath| to |table|. The rows may be in any
+    // order. Overridden by the collectors that read the stats from other sources.
+    virtual android::base::Result<void> readUidIoStatsLocked(UidIoTable* table);
+
+    // Returns true when the app ID filter excludes |uid|. Must be called only while collecting.
+    bool isFilteredOutLocked(uint32_t uid) const;
+
 private:
-    // Reads the contents of |kPath|.
-    android::base::Result<std::unordered_map<uint32_t, UidIoStat>> getUidIoStatsLocked() const;
 
     // Makes sure only one collection is running at any given time.
     Mutex mMutex;
 
-    // Last dump from the file at |kPath|.
-    std::unordered_map<uint32_t, UidIoStat> mLastUidIoStats GUARDED_BY(mMutex);
+    // Reusable buffer and kept-open fd for the file at |kPath|.
+    ProcFileReader mReader GUARDED_BY(mMutex);
+
+    // Last dump from the file at |kPath|, sorted by UID.
+    UidIoTable mLastUidIoStats GUARDED_BY(mMutex);
+
+    // Reusable tables for the current dump and the merged dump when filtering.
+    UidIoTable mCurUidIoStats GUARDED_BY(mMutex);
+    UidIoTable mMergedUidIoStats GUARDED_BY(mMutex);
+
+    // App IDs the collection is restricted to. Empty when all the UIDs are collected.
+    std::unordered_set<uint32_t> mAppIdFilter GUARDED_BY(mMutex);
 
     // True if kPath is accessible.
     const bool kEnabled;
@@ -31,6 +31,8 @@
 #include <log/log.h>
 #include <private/android_filesystem_config.h>
 
+#include "StartupTimeline.h"
+
 namespace android {
 namespace automotive {
 namespace watchdog {
@@ -52,6 +54,8 @@ constexpr const char* kHelpText =
         "CarWatchdog daemon dumpsys help page:\n"
         "Format: dumpsys android.automotive.watchdog.ICarWatchdog/default [options]\n\n"
         "%s or %s: Displays this help text.\n"
+        "%s: Displays the durations of the watchdog's own collection and health check stages,\n"
+        "and of its start-up phases.\n"
         "When no options are specified, carwatchdog report is generated.\n";
 
 Status checkSystemUser() {
@@ -119,6 +123,42 @@ status_t WatchdogBinderMediator::dump(int fd, const Vector<String16>& args) {
         return OK;
     }
 
+    if (numArgs == 1 && args[0] == String16(kDumpIoHistoryFlag)) {
+        auto ret = mIoPerfCollection->onDumpHistory(fd);
+        if (!ret.ok()) {
+            ALOGW("Failed to dump I/O perf history: %s", ret.error().message().c_str());
+            return ret.error().code();
+        }
+        return OK;
+    }
+
+    if (numArgs == 1 && args[0] == String16(kDumpBootTimelineFlag)) {
+        auto ret = mIoPerfCollection->onDumpBootTimeline(fd);
+        if (!ret.ok()) {
+            ALOGW("Failed to dump the boot timeline: %s", ret.error().message().c_str());
+            return ret.error().code();
+        }
+        return OK;
+    }
+
+    if (numArgs == 1 && args[0] == String16(kSelfProfileFlag)) {
+        auto ret = mWatchdogProcessService->dumpSelfProfile(fd);
+        if (ret.ok()) {
+            ret = mIoPerfCollection->onDumpSelfProfile(fd);
+        }
+        if (ret.ok() &&
+            !WriteStringToFd(StringPrintf("Start-up phases:\n%s",
+                                          StartupTimeline::get().dump("\t").c_str()),
+                             fd)) {
+            ret = Error(FAILED_TRANSACTION) << "Failed to dump the start-up phases";
+        }
+        if (!ret.ok()) {
+            ALOGW("Failed to dump the self profile: %s", ret.error().message().c_str());
+            return ret.error().code();
+        }
+        return OK;
+    }
+
     if (numArgs > 0) {
         ALOGW("Car watchdog cannot recognize the given option(%s). Dumping the current state...",
               Join(args, " ").c_str());
@@ -137,6 +177,27 @@ status_t WatchdogBinderMediator::dump(int fd, const Vector<String16>& args) {
     return OK;
 }
 
+Status WatchdogBinderMediator::notifyPowerCycleToIoPerfCollection(PowerCycle powerCycle) {
+    // The collection is parked together with the health checking so the looper timers and the
+    // /proc scans don't wake up the system during garage mode and suspend-prep.
+    Result<void> ret;
+    switch (powerCycle) {
+        case PowerCycle::POWER_CYCLE_SHUTDOWN:
+        case PowerCycle::POWER_CYCLE_SUSPEND:
+            ret = mIoPerfCollection->onSuspend();
+            break;
+        case PowerCycle::POWER_CYCLE_RESUME:
+            ret = mIoPerfCollection->onResume();
+            break;
+        default:
+            return Status::ok();
+    }
+    if (!ret.ok()) {
+        return fromExceptionCode(ret.error().code(), ret.error().message());
+    }
+    return Status::ok();
+}
+
 bool WatchdogBinderMediator::dumpHelpText(int fd, std::string errorMsg) {
     if (!errorMsg.empty()) {
         ALOGW("Error: %s", errorMsg.c_str());
@@ -146,7 +207,7 @@ bool WatchdogBinderMediator::dumpHelpText(int fd, std::string errorMsg) {
         }
     }
 
-    return WriteStringToFd(StringPrintf(kHelpText, kHelpFlag, kHelpShortFlag), fd) &&
+    return WriteStringToFd(StringPrintf(kHelpText, kHelpFlag, kHelpShortFlag, kSelfProfileFlag), fd) &&
             mIoPerfCollection->dumpHelpText(fd);
 }
 
@@ -198,6 +259,15 @@ Status WatchdogBinderMediator::tellDumpFinished(const android::sp<ICarWatchdogMo
     return mWatchdogProcessService->tellDumpFinished(monitor, pid);
 }
 
+Status WatchdogBinderMediator::openMediatorHealthChannel(const sp<ICarWatchdogClient>& mediator,
+                                                         os::ParcelFileDescriptor* channelFd) {
+    Status status = checkSystemUser();
+    if (!status.isOk()) {
+        return status;
+    }
+    return mWatchdogProcessService->openMediatorHealthChannel(mediator, channelFd);
+}
+
 Status WatchdogBinderMediator::notifySystemStateChange(StateType type, int32_t arg1, int32_t arg2) {
     Status status = checkSystemUser();
     if (!status.isOk()) {
@@ -210,7 +280,11 @@ Status WatchdogBinderMediator::notifySystemStateChange(StateType type, int32_t a
                 return fromExceptionCode(Status::EX_ILLEGAL_ARGUMENT,
                                          StringPrintf("Invalid power cycle %d", powerCycle));
             }
-            return mWatchdogProcessService->notifyPowerCycleChange(powerCycle);
+            status = mWatchdogProcessService->notifyPowerCycleChange(powerCycle);
+            if (!status.isOk()) {
+                return status;
+            }
+            return notifyPowerCycleToIoPerfCollection(powerCycle);
         }
         case StateType::USER_STATE: {
             userid_t userId = static_cast<userid_t>(arg1);
@@ -19,6 +19,7 @@
 
 #include <android-base/result.h>
 #include <android/automotive/watchdog/BnCarWatchdog.h>
+#include <android/automotive/watchdog/PowerCycle.h>
 #include <android/automotive/watchdog/StateType.h>
 #include <binder/IBinder.h>
 #include <binder/Status.h>
@@ -37,6 +38,9 @@ namespace watchdog {
 
 class ServiceManager;
 
+// Dumps the timings of carwatchdogd's own stages.
+constexpr const char* kSelfProfileFlag = "--self_profile";
+
 // WatchdogBinderMediator implements the carwatchdog binder APIs such that it forwards the calls
 // either to process ANR service or I/O performance data collection.
 class WatchdogBinderMediator : public BnCarWatchdog, public IBinder::DeathRecipient {
@@ -65,6 +69,8 @@ public:
     binder::Status tellDumpFinished(const android::sp<ICarWatchdogMonitor>& monitor,
                                     int32_t pid) override;
     binder::Status notifySystemStateChange(StateType type, int32_t arg1, int32_t arg2) override;
+    binder::Status openMediatorHealthChannel(const sp<ICarWatchdogClient>& mediator,
+                                             os::ParcelFileDescriptor* channelFd) override;
 
 protected:
     android::base::Result<void> init(android::sp<WatchdogProcessService> watchdogProcessService,
@@ -79,6 +85,8 @@ private:
         return mWatchdogProcessService->binderDied(who);
     }
     bool dumpHelpText(int fd, std::string errorMsg);
+    // Parks or resumes the I/O performance data collection on the power cycle change.
+    binder::Status notifyPowerCycleToIoPerfCollection(PowerCycle powerCycle);
 
     android::sp<WatchdogProcessService> mWatchdogProcessService;
     android::sp<IoPerfCollection> mIoPerfCollection;
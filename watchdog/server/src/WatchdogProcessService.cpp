@@ -24,11 +24,15 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <binder/IPCThreadState.h>
+#include <inttypes.h>
+
+#include <limits>
 
 namespace android {
 namespace automotive {
 namespace watchdog {
 
+using std::literals::chrono_literals::operator""ms;
 using std::literals::chrono_literals::operator""s;
 using android::base::Error;
 using android::base::GetProperty;
@@ -44,6 +48,12 @@ const std::vector<TimeoutLength> kTimeouts = {TimeoutLength::TIMEOUT_CRITICAL,
                                               TimeoutLength::TIMEOUT_MODERATE,
                                               TimeoutLength::TIMEOUT_NORMAL};
 
+// Looper message that expires the due health checks.
+const int kHealthCheckMessage = 0;
+
+// Resolution of the health check deadlines.
+const std::chrono::nanoseconds kHealthCheckTick = 100ms;
+
 std::chrono::nanoseconds timeoutToDurationNs(const TimeoutLength& timeout) {
     switch (timeout) {
         case TimeoutLength::TIMEOUT_CRITICAL:
@@ -55,6 +65,17 @@ std::chrono::nanoseconds timeoutToDurationNs(const TimeoutLength& timeout) {
     }
 }
 
+const char* timeoutToString(const TimeoutLength& timeout) {
+    switch (timeout) {
+        case TimeoutLength::TIMEOUT_CRITICAL:
+            return "critical";
+        case TimeoutLength::TIMEOUT_MODERATE:
+            return "moderate";
+        case TimeoutLength::TIMEOUT_NORMAL:
+            return "normal";
+    }
+}
+
 std::string pidArrayToString(const std::vector<int32_t>& pids) {
     size_t size = pids.size();
     if (size == 0) {
@@ -69,6 +90,25 @@ std::string pidArrayToString(const std::vector<int32_t>& pids) {
     return buffer;
 }
 
+Status openHealthChannel(std::shared_ptr<MediatorHealthChannel>* healthChannel, pid_t pid,
+                         os::ParcelFileDescriptor* channelFd) {
+    if (*healthChannel == nullptr) {
+        auto channel = MediatorHealthChannel::create();
+        if (!channel.ok()) {
+            return Status::fromExceptionCode(Status::EX_ILLEGAL_STATE,
+                                             channel.error().message().c_str());
+        }
+        *healthChannel = std::move(*channel);
+        ALOGI("Mediator(pid: %d) opened the health channel", pid);
+    }
+    auto fd = (*healthChannel)->dupFd();
+    if (!fd.ok()) {
+        return Status::fromExceptionCode(Status::EX_ILLEGAL_STATE, fd.error().message().c_str());
+    }
+    *channelFd = os::ParcelFileDescriptor(std::move(*fd));
+    return Status::ok();
+}
+
 bool isSystemShuttingDown() {
     std::string sysPowerCtl;
     std::istringstream tokenStream(GetProperty("sys.powerctl", ""));
@@ -78,13 +118,112 @@ bool isSystemShuttingDown() {
 
 }  // namespace
 
+WatchdogProcessService::ClientShard::ClientShard(size_t index, size_t numShards,
+                                                 TimeoutLength timeout) :
+      index(index),
+      numShards(numShards),
+      timeout(timeout),
+      healthCheckWheel(kHealthCheckTick),
+      nextHealthCheckUptime(0),
+      lastSessionId(static_cast<int32_t>(index)) {}
+
+bool WatchdogProcessService::ClientShard::markResponded(IBinder* binder, int32_t sessionId) {
+    LivenessSlot& slot = livenessSlot(sessionId);
+    // The slot is published by storing the binder before the session ID. When the slot is
+    // reused for another session after the binder check, the exchange below fails.
+    if (slot.sessionId.load() != sessionId || slot.binder.load() != binder) {
+        return false;
+    }
+    int32_t expected = sessionId;
+    if (!slot.sessionId.compare_exchange_strong(expected, -sessionId)) {
+        return false;
+    }
+    slot.respondedUptime.store(systemTime(SYSTEM_TIME_MONOTONIC));
+    return true;
+}
+
+void WatchdogProcessService::ClientShard::addClientLocked(IBinder* binder,
+                                                          ClientInfo clientInfo) {
+    clientsByUser[clientInfo.userId].insert(binder);
+    clients.insert(std::make_pair(binder, std::move(clientInfo)));
+}
+
+void WatchdogProcessService::ClientShard::eraseClientLocked(
+        std::unordered_map<IBinder*, ClientInfo>::iterator it) {
+    if (auto userIt = clientsByUser.find(it->second.userId); userIt != clientsByUser.end()) {
+        userIt->second.erase(it->first);
+        if (userIt->second.empty()) {
+            clientsByUser.erase(userIt);
+        }
+    }
+    clients.erase(it);
+}
+
+void WatchdogProcessService::ClientShard::setUserStoppedLocked(userid_t userId, bool isStopped) {
+    auto userIt = clientsByUser.find(userId);
+    if (userIt == clientsByUser.end()) {
+        return;
+    }
+    for (IBinder* binder : userIt->second) {
+        if (auto it = clients.find(binder); it != clients.end()) {
+            it->second.isUserStopped = isStopped;
+        }
+    }
+}
+
+void WatchdogProcessService::ClientShard::addPingedLocked(int32_t sessionId, IBinder* binder) {
+    pingedClients.insert(std::make_pair(sessionId, binder));
+    LivenessSlot& slot = livenessSlot(sessionId);
+    if (slot.sessionId.load() != 0) {
+        return;
+    }
+    slot.respondedUptime.store(0);
+    slot.binder.store(binder);
+    slot.sessionId.store(sessionId);
+}
+
+void WatchdogProcessService::ClientShard::erasePingedLocked(int32_t sessionId) {
+    pingedClients.erase(sessionId);
+    LivenessSlot& slot = livenessSlot(sessionId);
+    const int32_t slotSessionId = slot.sessionId.load();
+    if (slotSessionId == sessionId || slotSessionId == -sessionId) {
+        slot.sessionId.store(0);
+    }
+}
+
+void WatchdogProcessService::ClientShard::clearPingedLocked() {
+    pingedClients.clear();
+    for (auto& slot : livenessSlots) {
+        slot.sessionId.store(0);
+    }
+}
+
+std::optional<nsecs_t> WatchdogProcessService::ClientShard::takeResponseLocked(
+        int32_t sessionId) {
+    LivenessSlot& slot = livenessSlot(sessionId);
+    if (slot.sessionId.load() != -sessionId) {
+        return std::nullopt;
+    }
+    // The responded uptime is stored right after the mark, so it may not be visible yet.
+    nsecs_t respondedUptime = slot.respondedUptime.load();
+    if (respondedUptime == 0) {
+        respondedUptime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+    erasePingedLocked(sessionId);
+    return respondedUptime;
+}
+
 WatchdogProcessService::WatchdogProcessService(const sp<Looper>& handlerLooper) :
-      mHandlerLooper(handlerLooper), mLastSessionId(0) {
+      mHandlerLooper(handlerLooper),
+      mScheduledHealthCheckUptime(0),
+      mProfiler("WatchdogProcessService"),
+      mPingDispatcher(new PingDispatcher()) {
     mMessageHandler = new MessageHandlerImpl(this);
+    mDumpQueue = new DumpQueue(
+            [this](const std::vector<int32_t>& pids) { return requestDumpAndKill(pids); });
     mWatchdogEnabled = true;
-    for (const auto& timeout : kTimeouts) {
-        mClients.insert(std::make_pair(timeout, std::vector<ClientInfo>()));
-        mPingedClients.insert(std::make_pair(timeout, PingedClientMap()));
+    for (size_t i = 0; i < kTimeouts.size(); ++i) {
+        mClientShards.emplace_back(std::make_unique<ClientShard>(i, kTimeouts.size(), kTimeouts[i]));
     }
 }
 
@@ -151,30 +290,25 @@ Status WatchdogProcessService::unregisterMonitor(const sp<ICarWatchdogMonitor>&
 
 Status WatchdogProcessService::tellClientAlive(const sp<ICarWatchdogClient>& client,
                                                int32_t sessionId) {
-    Mutex::Autolock lock(mMutex);
-    return tellClientAliveLocked(client, sessionId);
+    return tellClientAliveInternal(client, sessionId);
 }
 
 Status WatchdogProcessService::tellMediatorAlive(const sp<ICarWatchdogClient>& mediator,
                                                  const std::vector<int32_t>& clientsNotResponding,
                                                  int32_t sessionId) {
-    Status status;
-    {
-        Mutex::Autolock lock(mMutex);
-        if (DEBUG) {
-            std::string buffer;
-            int size = clientsNotResponding.size();
-            if (size != 0) {
-                StringAppendF(&buffer, "%d", clientsNotResponding[0]);
-                for (int i = 1; i < clientsNotResponding.size(); i++) {
-                    StringAppendF(&buffer, ", %d", clientsNotResponding[i]);
-                }
-                ALOGD("Mediator(session: %d) responded with non-responding clients: %s", sessionId,
-                      buffer.c_str());
+    if (DEBUG) {
+        std::string buffer;
+        int size = clientsNotResponding.size();
+        if (size != 0) {
+            StringAppendF(&buffer, "%d", clientsNotResponding[0]);
+            for (int i = 1; i < clientsNotResponding.size(); i++) {
+                StringAppendF(&buffer, ", %d", clientsNotResponding[i]);
             }
+            ALOGD("Mediator(session: %d) responded with non-responding clients: %s", sessionId,
+                  buffer.c_str());
         }
-        status = tellClientAliveLocked(mediator, sessionId);
     }
+    Status status = tellClientAliveInternal(mediator, sessionId);
     if (status.isOk()) {
         dumpAndKillAllProcesses(clientsNotResponding);
     }
@@ -191,9 +325,32 @@ Status WatchdogProcessService::tellDumpFinished(const sp<ICarWatchdogMonitor>& m
                                   "The monitor is not registered or an invalid monitor is given");
     }
     ALOGI("Process(pid: %d) has been dumped and killed", pid);
+    mDumpQueue->onDumpFinished(pid);
     return Status::ok();
 }
 
+Status WatchdogProcessService::openMediatorHealthChannel(const sp<ICarWatchdogClient>& mediator,
+                                                         os::ParcelFileDescriptor* channelFd) {
+    std::vector<TimeoutLength> timeouts = {TimeoutLength::TIMEOUT_CRITICAL};
+    sp<IBinder> binder = BnCarWatchdog::asBinder(mediator);
+    Status status = Status::fromExceptionCode(Status::EX_ILLEGAL_ARGUMENT,
+                                              "The mediator has not been registered");
+    Mutex::Autolock lock(mMutex);
+    findClientAndProcessLocked(timeouts, binder,
+                               [&](ClientShard* /*shard*/,
+                                   std::unordered_map<IBinder*, ClientInfo>::iterator it) {
+                                   ClientInfo& clientInfo = it->second;
+                                   if (clientInfo.type == ClientType::Mediator) {
+                                       status = openHealthChannel(&clientInfo.healthChannel,
+                                                                  clientInfo.pid, channelFd);
+                                   }
+                               });
+    if (!status.isOk()) {
+        ALOGW("Cannot open the health channel: %s", status.exceptionMessage().c_str());
+    }
+    return status;
+}
+
 Status WatchdogProcessService::notifyPowerCycleChange(PowerCycle cycle) {
     std::string buffer;
     Mutex::Autolock lock(mMutex);
@@ -201,17 +358,17 @@ Status WatchdogProcessService::notifyPowerCycleChange(PowerCycle cycle) {
     switch (cycle) {
         case PowerCycle::POWER_CYCLE_SHUTDOWN:
             mWatchdogEnabled = false;
+            mHandlerLooper->removeMessages(mMessageHandler, kHealthCheckMessage);
             buffer = "SHUTDOWN power cycle";
             break;
         case PowerCycle::POWER_CYCLE_SUSPEND:
             mWatchdogEnabled = false;
+            mHandlerLooper->removeMessages(mMessageHandler, kHealthCheckMessage);
             buffer = "SUSPEND power cycle";
             break;
         case PowerCycle::POWER_CYCLE_RESUME:
             mWatchdogEnabled = true;
-            for (const auto& timeout : kTimeouts) {
-                startHealthCheckingLocked(timeout);
-            }
+            restartHealthCheckingLocked();
             buffer = "RESUME power cycle";
             break;
         default:
@@ -229,19 +386,27 @@ Status WatchdogProcessService::notifyPowerCycleChange(PowerCycle cycle) {
 Status WatchdogProcessService::notifyUserStateChange(userid_t userId, UserState state) {
     std::string buffer;
     Mutex::Autolock lock(mMutex);
+    bool isChanged = false;
     switch (state) {
         case UserState::USER_STATE_STARTED:
-            mStoppedUserId.erase(userId);
+            isChanged = mStoppedUserId.erase(userId) > 0;
             buffer = StringPrintf("user(%d) is started", userId);
             break;
         case UserState::USER_STATE_STOPPED:
-            mStoppedUserId.insert(userId);
+            isChanged = mStoppedUserId.insert(userId).second;
             buffer = StringPrintf("user(%d) is stopped", userId);
             break;
         default:
             ALOGW("Unsupported user state: %d", state);
             return Status::fromExceptionCode(Status::EX_ILLEGAL_ARGUMENT, "Unsupported user state");
     }
+    if (isChanged) {
+        const bool isStopped = state == UserState::USER_STATE_STOPPED;
+        for (const auto& shard : mClientShards) {
+            Mutex::Autolock shardLock(shard->mutex);
+            shard->setUserStoppedLocked(userId, isStopped);
+        }
+    }
     ALOGI("Received user state change: %s", buffer.c_str());
     return Status::ok();
 }
@@ -257,11 +422,11 @@ Result<void> WatchdogProcessService::dump(int fd, const Vector<String16>& /*args
                     fd);
     WriteStringToFd(StringPrintf("%sRegistered clients\n", indent), fd);
     int count = 1;
-    for (const auto& timeout : kTimeouts) {
-        std::vector<ClientInfo>& clients = mClients[timeout];
-        for (auto it = clients.begin(); it != clients.end(); it++, count++) {
+    for (const auto& shard : mClientShards) {
+        Mutex::Autolock shardLock(shard->mutex);
+        for (auto it = shard->clients.begin(); it != shard->clients.end(); it++, count++) {
             WriteStringToFd(StringPrintf("%sClient #%d: %s\n", doubleIndent, count,
-                                         it->toString().c_str()),
+                                         it->second.toString().c_str()),
                             fd);
         }
     }
@@ -282,65 +447,126 @@ Result<void> WatchdogProcessService::dump(int fd, const Vector<String16>& /*args
         }
     }
     WriteStringToFd(StringPrintf("%sStopped users: %s\n", indent, buffer.c_str()), fd);
+    WriteStringToFd(StringPrintf("%sPing round-trip latency\n", indent), fd);
+    WriteStringToFd(mPingDispatcher->dump(doubleIndent), fd);
+    WriteStringToFd(StringPrintf("%sDump and kill queue\n", indent), fd);
+    WriteStringToFd(mDumpQueue->dump(doubleIndent), fd);
     return {};
 }
 
-void WatchdogProcessService::doHealthCheck(int what) {
-    mHandlerLooper->removeMessages(mMessageHandler, what);
-    if (!isWatchdogEnabled()) {
-        return;
+Result<void> WatchdogProcessService::dumpSelfProfile(int fd) {
+    if (!WriteStringToFd(StringPrintf("CAR WATCHDOG PROCESS SERVICE STAGES\n%s",
+                                      mProfiler.dump("  ").c_str()),
+                         fd)) {
+        return Error(FAILED_TRANSACTION) << "Failed to dump the process service stages";
     }
-    const TimeoutLength timeout = static_cast<TimeoutLength>(what);
-    dumpAndKillClientsIfNotResponding(timeout);
+    return {};
+}
 
-    /* Generates a temporary/local vector containing clients.
-     * Using a local copy may send unnecessary ping messages to clients after they are unregistered.
-     * Clients should be able to handle them.
-     */
-    std::vector<ClientInfo> clientsToCheck;
-    PingedClientMap& pingedClients = mPingedClients[timeout];
+void WatchdogProcessService::doHealthCheck() {
+    mHandlerLooper->removeMessages(mMessageHandler, kHealthCheckMessage);
+    if (const nsecs_t scheduledUptime = mScheduledHealthCheckUptime.exchange(0);
+        scheduledUptime > 0) {
+        mProfiler.record("Looper lag",
+                         std::max<nsecs_t>(systemTime(SYSTEM_TIME_MONOTONIC) - scheduledUptime,
+                                           0));
+    }
+    StageProfiler::ScopedTimer timer(&mProfiler, "Health check");
     {
         Mutex::Autolock lock(mMutex);
-        pingedClients.clear();
-        clientsToCheck = mClients[timeout];
-        for (auto& clientInfo : clientsToCheck) {
-            if (mStoppedUserId.count(clientInfo.userId) > 0) {
+        if (!mWatchdogEnabled) {
+            return;
+        }
+    }
+    std::vector<ClientInfo> clientsNotResponding;
+    std::vector<int32_t> processesNotResponding;
+    // Pinging the clients may send unnecessary ping messages to clients after they are
+    // unregistered. Clients should be able to handle them.
+    std::vector<std::pair<ClientShard*, ClientInfo>> clientsToCheck;
+    for (const auto& shard : mClientShards) {
+        StageProfiler::ScopedTimer shardTimer(&mProfiler,
+                                              StringPrintf("Health check (%s)",
+                                                           timeoutToString(shard->timeout)));
+        Mutex::Autolock shardLock(shard->mutex);
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        const nsecs_t deadline = now + timeoutToDurationNs(shard->timeout).count();
+        reconcileLivenessLocked(shard.get());
+        for (IBinder* binder : shard->healthCheckWheel.advance(now)) {
+            auto it = shard->clients.find(binder);
+            if (it == shard->clients.end()) {
+                continue;
+            }
+            ClientInfo& clientInfo = it->second;
+            const bool isUserStopped = clientInfo.isUserStopped;
+            if (clientInfo.healthChannel != nullptr) {
+                takeHealthReportsLocked(shard.get(), clientInfo, &processesNotResponding);
+            }
+            if (shard->pingedClients.count(clientInfo.sessionId) > 0 &&
+                !shard->takeResponseLocked(clientInfo.sessionId)) {
+                // The client didn't respond to the last ping.
+                shard->erasePingedLocked(clientInfo.sessionId);
+                mPingDispatcher->remove(binder);
+                if (!isUserStopped) {
+                    clientsNotResponding.push_back(clientInfo);
+                }
+                shard->eraseClientLocked(it);
                 continue;
             }
-            int sessionId = getNewSessionId();
-            clientInfo.sessionId = sessionId;
-            pingedClients.insert(std::make_pair(sessionId, clientInfo));
+            clientInfo.sessionId = 0;
+            if (!isUserStopped) {
+                clientInfo.sessionId = getNewSessionIdLocked(shard.get());
+                shard->addPingedLocked(clientInfo.sessionId, binder);
+                if (clientInfo.healthChannel != nullptr) {
+                    // Pinging through the channel doesn't block, so it doesn't need the
+                    // dispatcher.
+                    clientInfo.healthChannel->ping(clientInfo.sessionId);
+                } else {
+                    clientsToCheck.push_back(std::make_pair(shard.get(), clientInfo));
+                }
+            }
+            shard->healthCheckWheel.schedule(binder, binder, deadline);
+            shard->nextHealthCheckUptime = deadline;
         }
     }
 
-    for (const auto& clientInfo : clientsToCheck) {
-        Status status = clientInfo.client->checkIfAlive(clientInfo.sessionId, timeout);
-        if (!status.isOk()) {
-            ALOGW("Sending a ping message to client(pid: %d) failed: %s", clientInfo.pid,
-                  status.exceptionMessage().c_str());
-            {
-                Mutex::Autolock lock(mMutex);
-                pingedClients.erase(clientInfo.sessionId);
+    dumpAndKillClientsIfNotResponding(clientsNotResponding);
+    dumpAndKillAllProcesses(processesNotResponding);
+    for (const auto& [shard, clientInfo] : clientsToCheck) {
+        const auto ping = [shard = shard, client = clientInfo.client, pid = clientInfo.pid,
+                           sessionId = clientInfo.sessionId]() {
+            Status status = client->checkIfAlive(sessionId, shard->timeout);
+            if (!status.isOk()) {
+                ALOGW("Sending a ping message to client(pid: %d) failed: %s", pid,
+                      status.exceptionMessage().c_str());
+                Mutex::Autolock shardLock(shard->mutex);
+                shard->erasePingedLocked(sessionId);
             }
+        };
+        // When the previous ping is still in flight, the client keeps the new session and is
+        // killed on the next health check unless it responds in time.
+        if (!mPingDispatcher->dispatch(BnCarWatchdog::asBinder(clientInfo.client).get(),
+                                       clientInfo.pid, clientInfo.sessionId, ping)) {
+            ALOGW("Previous ping message to client(pid: %d) is still in flight", clientInfo.pid);
         }
     }
-    // Though the size of pingedClients is a more specific measure, clientsToCheck is used as a
-    // conservative approach.
-    if (clientsToCheck.size() > 0) {
-        auto durationNs = timeoutToDurationNs(timeout);
-        mHandlerLooper->sendMessageDelayed(durationNs.count(), mMessageHandler, Message(what));
-    }
+    rearmHealthCheck();
 }
 
 void WatchdogProcessService::terminate() {
+    // Stop the dispatcher before locking the shards as the pings in flight may lock them. The
+    // dump queue locks |mMutex| to get the monitor.
+    mPingDispatcher->terminate();
+    mDumpQueue->terminate();
     Mutex::Autolock lock(mMutex);
-    for (const auto& timeout : kTimeouts) {
-        std::vector<ClientInfo>& clients = mClients[timeout];
-        for (auto it = clients.begin(); it != clients.end();) {
-            sp<IBinder> binder = BnCarWatchdog::asBinder((*it).client);
+    for (const auto& shard : mClientShards) {
+        Mutex::Autolock shardLock(shard->mutex);
+        for (const auto& [binder, clientInfo] : shard->clients) {
             binder->unlinkToDeath(this);
-            it = clients.erase(it);
         }
+        shard->clients.clear();
+        shard->clientsByUser.clear();
+        shard->clearPingedLocked();
+        shard->healthCheckWheel.clear();
     }
 }
 
@@ -355,10 +581,11 @@ void WatchdogProcessService::binderDied(const wp<IBinder>& who) {
         return;
     }
     findClientAndProcessLocked(kTimeouts, binder,
-                               [&](std::vector<ClientInfo>& clients,
-                                   std::vector<ClientInfo>::const_iterator it) {
-                                   ALOGW("Client(pid: %d) died", it->pid);
-                                   clients.erase(it);
+                               [&](ClientShard* shard,
+                                   std::unordered_map<IBinder*, ClientInfo>::iterator it) {
+                                   ALOGW("Client(pid: %d) died", it->second.pid);
+                                   cancelHealthCheckLocked(shard, binder);
+                                   shard->eraseClientLocked(it);
                                });
 }
 
@@ -382,15 +609,18 @@ Status WatchdogProcessService::registerClientLocked(const sp<ICarWatchdogClient>
         ALOGW("Cannot register the %s: %s", clientName, errorCause);
         return Status::fromExceptionCode(Status::EX_ILLEGAL_STATE, errorCause);
     }
-    std::vector<ClientInfo>& clients = mClients[timeout];
     pid_t callingPid = IPCThreadState::self()->getCallingPid();
     uid_t callingUid = IPCThreadState::self()->getCallingUid();
-    clients.push_back(ClientInfo(client, callingPid, callingUid, clientType));
-
-    // If the client array becomes non-empty, start health checking.
-    if (clients.size() == 1) {
-        startHealthCheckingLocked(timeout);
+    ClientInfo clientInfo(client, callingPid, multiuser_get_user_id(callingUid), clientType,
+                          timeout);
+    clientInfo.isUserStopped = mStoppedUserId.count(clientInfo.userId) > 0;
+    {
+        ClientShard& shard = shardFor(timeout);
+        Mutex::Autolock shardLock(shard.mutex);
+        shard.addClientLocked(binder.get(), std::move(clientInfo));
+        scheduleHealthCheckLocked(&shard, binder.get());
     }
+    rearmHealthCheck();
     if (DEBUG) {
         ALOGD("Car watchdog %s(pid: %d, timeout: %d) is registered", clientName, callingPid,
               timeout);
@@ -401,12 +631,14 @@ Status WatchdogProcessService::registerClientLocked(const sp<ICarWatchdogClient>
 Status WatchdogProcessService::unregisterClientLocked(const std::vector<TimeoutLength>& timeouts,
                                                       sp<IBinder> binder, ClientType clientType) {
     const char* clientName = clientType == ClientType::Regular ? "client" : "mediator";
-    bool result = findClientAndProcessLocked(timeouts, binder,
-                                             [&](std::vector<ClientInfo>& clients,
-                                                 std::vector<ClientInfo>::const_iterator it) {
-                                                 binder->unlinkToDeath(this);
-                                                 clients.erase(it);
-                                             });
+    bool result =
+            findClientAndProcessLocked(timeouts, binder,
+                                       [&](ClientShard* shard,
+                                           std::unordered_map<IBinder*, ClientInfo>::iterator it) {
+                                           binder->unlinkToDeath(this);
+                                           cancelHealthCheckLocked(shard, binder.get());
+                                           shard->eraseClientLocked(it);
+                                       });
     if (!result) {
         std::string errorStr = StringPrintf("The %s has not been registered", clientName);
         const char* errorCause = errorStr.c_str();
@@ -419,17 +651,23 @@ Status WatchdogProcessService::unregisterClientLocked(const std::vector<TimeoutL
     return Status::ok();
 }
 
-Status WatchdogProcessService::tellClientAliveLocked(const sp<ICarWatchdogClient>& client,
-                                                     int32_t sessionId) {
+Status WatchdogProcessService::tellClientAliveInternal(const sp<ICarWatchdogClient>& client,
+                                                       int32_t sessionId) {
     const sp<IBinder> binder = BnCarWatchdog::asBinder(client);
-    for (const auto& timeout : kTimeouts) {
-        PingedClientMap& clients = mPingedClients[timeout];
-        PingedClientMap::const_iterator it = clients.find(sessionId);
-        if (it == clients.cend() || binder != BnCarWatchdog::asBinder(it->second.client)) {
-            continue;
+    if (sessionId > 0) {
+        ClientShard& shard = *mClientShards[sessionId % mClientShards.size()];
+        // Fast path for the clients that respond at a high rate. The response is recorded by the
+        // next health check of the shard.
+        if (shard.markResponded(binder.get(), sessionId)) {
+            return Status::ok();
+        }
+        Mutex::Autolock shardLock(shard.mutex);
+        PingedClientMap::const_iterator it = shard.pingedClients.find(sessionId);
+        if (it != shard.pingedClients.cend() && binder == it->second) {
+            shard.erasePingedLocked(sessionId);
+            mPingDispatcher->onPingResponded(binder.get(), sessionId);
+            return Status::ok();
         }
-        clients.erase(it);
-        return Status::ok();
     }
     return Status::fromExceptionCode(Status::EX_ILLEGAL_ARGUMENT,
                                      "The client is not registered or the session ID is not found");
@@ -439,62 +677,156 @@ bool WatchdogProcessService::findClientAndProcessLocked(const std::vector<Timeou
                                                         const sp<IBinder> binder,
                                                         const Processor& processor) {
     for (const auto& timeout : timeouts) {
-        std::vector<ClientInfo>& clients = mClients[timeout];
-        for (auto it = clients.begin(); it != clients.end(); it++) {
-            if (BnCarWatchdog::asBinder((*it).client) != binder) {
-                continue;
-            }
-            if (processor != nullptr) {
-                processor(clients, it);
-            }
-            return true;
+        ClientShard& shard = shardFor(timeout);
+        Mutex::Autolock shardLock(shard.mutex);
+        auto it = shard.clients.find(binder.get());
+        if (it == shard.clients.end()) {
+            continue;
+        }
+        if (processor != nullptr) {
+            processor(&shard, it);
         }
+        return true;
     }
     return false;
 }
 
-Result<void> WatchdogProcessService::startHealthCheckingLocked(TimeoutLength timeout) {
-    PingedClientMap& clients = mPingedClients[timeout];
-    clients.clear();
-    int what = static_cast<int>(timeout);
-    auto durationNs = timeoutToDurationNs(timeout);
-    mHandlerLooper->sendMessageDelayed(durationNs.count(), mMessageHandler, Message(what));
-    return {};
+WatchdogProcessService::ClientShard& WatchdogProcessService::shardFor(TimeoutLength timeout) {
+    return *mClientShards[static_cast<size_t>(timeout)];
 }
 
-Result<void> WatchdogProcessService::dumpAndKillClientsIfNotResponding(TimeoutLength timeout) {
-    std::vector<int32_t> processIds;
-    std::vector<sp<ICarWatchdogClient>> clientsToNotify;
-    {
-        Mutex::Autolock lock(mMutex);
-        PingedClientMap& clients = mPingedClients[timeout];
-        for (PingedClientMap::const_iterator it = clients.cbegin(); it != clients.cend(); it++) {
-            pid_t pid = -1;
-            userid_t userId = -1;
-            sp<ICarWatchdogClient> client = it->second.client;
-            sp<IBinder> binder = BnCarWatchdog::asBinder(client);
-            std::vector<TimeoutLength> timeouts = {timeout};
-            findClientAndProcessLocked(timeouts, binder,
-                                       [&](std::vector<ClientInfo>& clients,
-                                           std::vector<ClientInfo>::const_iterator it) {
-                                           pid = (*it).pid;
-                                           userId = (*it).userId;
-                                           clients.erase(it);
-                                       });
-            if (pid != -1 && mStoppedUserId.count(userId) == 0) {
-                clientsToNotify.push_back(client);
-                processIds.push_back(pid);
-            }
+void WatchdogProcessService::scheduleHealthCheckLocked(ClientShard* shard, IBinder* binder) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (shard->healthCheckWheel.empty()) {
+        // Catch the idle wheel up with the current time. Otherwise, the deadline is placed
+        // relative to the time the wheel became empty and the wheel wakes up to cascade it.
+        shard->healthCheckWheel.advance(now);
+    }
+    if (shard->nextHealthCheckUptime <= now) {
+        shard->nextHealthCheckUptime = now + timeoutToDurationNs(shard->timeout).count();
+    }
+    shard->healthCheckWheel.schedule(binder, binder, shard->nextHealthCheckUptime);
+}
+
+void WatchdogProcessService::cancelHealthCheckLocked(ClientShard* shard, IBinder* binder) {
+    mPingDispatcher->remove(binder);
+    shard->healthCheckWheel.cancel(binder);
+    auto it = shard->clients.find(binder);
+    if (it != shard->clients.end()) {
+        shard->erasePingedLocked(it->second.sessionId);
+    }
+}
+
+int32_t WatchdogProcessService::getNewSessionIdLocked(ClientShard* shard) {
+    // Session IDs are positive and congruent to the shard index modulo the number of shards.
+    const int32_t numShards = static_cast<int32_t>(mClientShards.size());
+    if (shard->lastSessionId > std::numeric_limits<int32_t>::max() - numShards) {
+        shard->lastSessionId = static_cast<int32_t>(shard->index);
+    }
+    shard->lastSessionId += numShards;
+    return shard->lastSessionId;
+}
+
+void WatchdogProcessService::restartHealthCheckingLocked() {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (const auto& shard : mClientShards) {
+        Mutex::Autolock shardLock(shard->mutex);
+        shard->healthCheckWheel.clear();
+        shard->healthCheckWheel.advance(now);
+        shard->clearPingedLocked();
+        shard->nextHealthCheckUptime = now + timeoutToDurationNs(shard->timeout).count();
+        for (auto& [binder, clientInfo] : shard->clients) {
+            clientInfo.sessionId = 0;
+            shard->healthCheckWheel.schedule(binder, binder, shard->nextHealthCheckUptime);
         }
     }
-    for (auto&& client : clientsToNotify) {
-        client->prepareProcessTermination();
+    rearmHealthCheck();
+}
+
+void WatchdogProcessService::reconcileLivenessLocked(ClientShard* shard) {
+    std::vector<std::pair<int32_t, IBinder*>> pingedClients(shard->pingedClients.begin(),
+                                                            shard->pingedClients.end());
+    for (const auto& [sessionId, binder] : pingedClients) {
+        if (const auto respondedUptime = shard->takeResponseLocked(sessionId)) {
+            mPingDispatcher->onPingResponded(binder, sessionId, *respondedUptime);
+        }
     }
-    return dumpAndKillAllProcesses(processIds);
+}
+
+void WatchdogProcessService::takeHealthReportsLocked(ClientShard* shard,
+                                                     const ClientInfo& clientInfo,
+                                                     std::vector<int32_t>* processesNotResponding) {
+    for (const auto& report : clientInfo.healthChannel->takeReports()) {
+        // Reports of the earlier sessions arrived after their health checks had expired, like
+        // the late tellMediatorAlive calls, so they are dropped.
+        if (report.sessionId <= 0 || report.sessionId != clientInfo.sessionId ||
+            shard->pingedClients.count(report.sessionId) == 0) {
+            continue;
+        }
+        if (DEBUG && !report.clientsNotResponding.empty()) {
+            ALOGD("Mediator(session: %d) reported non-responding clients: %s", report.sessionId,
+                  pidArrayToString(report.clientsNotResponding).c_str());
+        }
+        shard->erasePingedLocked(report.sessionId);
+        processesNotResponding->insert(processesNotResponding->end(),
+                                       report.clientsNotResponding.begin(),
+                                       report.clientsNotResponding.end());
+    }
+}
+
+void WatchdogProcessService::rearmHealthCheck() {
+    Mutex::Autolock rearmLock(mRearmMutex);
+    std::optional<nsecs_t> nextExpiry;
+    for (const auto& shard : mClientShards) {
+        Mutex::Autolock shardLock(shard->mutex);
+        const auto& shardExpiry = shard->healthCheckWheel.nextExpiry();
+        if (shardExpiry && (!nextExpiry || *shardExpiry < *nextExpiry)) {
+            nextExpiry = shardExpiry;
+        }
+    }
+    mHandlerLooper->removeMessages(mMessageHandler, kHealthCheckMessage);
+    mScheduledHealthCheckUptime = nextExpiry.value_or(0);
+    if (nextExpiry) {
+        mHandlerLooper->sendMessageAtTime(*nextExpiry, mMessageHandler,
+                                          Message(kHealthCheckMessage));
+    }
+}
+
+Result<void> WatchdogProcessService::dumpAndKillClientsIfNotResponding(
+        const std::vector<ClientInfo>& clients) {
+    std::vector<int32_t> droppedPids;
+    for (const auto& clientInfo : clients) {
+        const auto prepare = [client = clientInfo.client]() {
+            client->prepareProcessTermination();
+        };
+        if (!mDumpQueue->enqueue(clientInfo.pid, prepare)) {
+            droppedPids.push_back(clientInfo.pid);
+        }
+    }
+    if (!droppedPids.empty()) {
+        return Error() << "Cannot dump and kill processes(pid = "
+                       << pidArrayToString(droppedPids) << "): The dump queue is full";
+    }
+    return {};
 }
 
 Result<void> WatchdogProcessService::dumpAndKillAllProcesses(
         const std::vector<int32_t>& processesNotResponding) {
+    std::vector<int32_t> droppedPids;
+    for (const auto& pid : processesNotResponding) {
+        if (!mDumpQueue->enqueue(pid)) {
+            droppedPids.push_back(pid);
+        }
+    }
+    if (!droppedPids.empty()) {
+        return Error() << "Cannot dump and kill processes(pid = "
+                       << pidArrayToString(droppedPids) << "): The dump queue is full";
+    }
+    return {};
+}
+
+Result<void> WatchdogProcessService::requestDumpAndKill(
+        const std::vector<int32_t>& processesNotResponding) {
     size_t size = processesNotResponding.size();
     if (size == 0) {
         return {};
@@ -524,12 +856,31 @@ Result<void> WatchdogProcessService::dumpAndKillAllProcesses(
     return {};
 }
 
-int32_t WatchdogProcessService::getNewSessionId() {
-    // Make sure that session id is always positive number.
-    if (++mLastSessionId <= 0) {
-        mLastSessionId = 1;
+Result<void> WatchdogProcessService::notifyWriteBudgetExceeded(
+        const std::vector<WriteBudgetViolation>& violations) {
+    if (violations.empty()) {
+        return {};
     }
-    return mLastSessionId;
+    sp<ICarWatchdogMonitor> monitor;
+    {
+        Mutex::Autolock lock(mMutex);
+        if (mMonitor == nullptr) {
+            return Error() << "Cannot report " << violations.size()
+                           << " package(s) over the write budget: Monitor is not set";
+        }
+        monitor = mMonitor;
+    }
+    for (const auto& violation : violations) {
+        ALOGW("Package %s (uid %" PRIu32 ") wrote %" PRIu64 " bytes today, over its budget of %"
+              PRIu64 " bytes",
+              violation.packageName.c_str(), violation.uid, violation.writtenBytes,
+              violation.budgetBytes);
+        monitor->onPackageWriteBudgetExceeded(String16(violation.packageName.c_str()),
+                                              multiuser_get_user_id(violation.uid),
+                                              static_cast<int64_t>(violation.writtenBytes),
+                                              static_cast<int64_t>(violation.budgetBytes));
+    }
+    return {};
 }
 
 bool WatchdogProcessService::isWatchdogEnabled() {
@@ -539,8 +890,8 @@ bool WatchdogProcessService::isWatchdogEnabled() {
 
 std::string WatchdogProcessService::ClientInfo::toString() {
     std::string buffer;
-    StringAppendF(&buffer, "pid = %d, userId = %d, type = %s", pid, userId,
-                  type == Regular ? "Regular" : "Mediator");
+    StringAppendF(&buffer, "pid = %d, userId = %d, type = %s, userStopped = %s", pid, userId,
+                  type == Regular ? "Regular" : "Mediator", isUserStopped ? "true" : "false");
     return buffer;
 }
 
@@ -550,10 +901,8 @@ WatchdogProcessService::MessageHandlerImpl::MessageHandlerImpl(
 
 void WatchdogProcessService::MessageHandlerImpl::handleMessage(const Message& message) {
     switch (message.what) {
-        case static_cast<int>(TimeoutLength::TIMEOUT_CRITICAL):
-        case static_cast<int>(TimeoutLength::TIMEOUT_MODERATE):
-        case static_cast<int>(TimeoutLength::TIMEOUT_NORMAL):
-            mService->doHealthCheck(message.what);
+        case kHealthCheckMessage:
+            mService->doHealthCheck();
             break;
         default:
             ALOGW("Unknown message: %d", message.what);
@@ -22,18 +22,31 @@
 #include <android/automotive/watchdog/PowerCycle.h>
 #include <android/automotive/watchdog/UserState.h>
 #include <binder/IBinder.h>
+#include <binder/ParcelFileDescriptor.h>
 #include <binder/Status.h>
 #include <cutils/multiuser.h>
 #include <utils/Looper.h>
 #include <utils/Mutex.h>
 #include <utils/String16.h>
 #include <utils/StrongPointer.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "DumpQueue.h"
+#include "MediatorHealthChannel.h"
+#include "PingDispatcher.h"
+#include "StageProfiler.h"
+#include "TimerWheel.h"
+#include "WriteBudgetTracker.h"
+
 namespace android {
 namespace automotive {
 namespace watchdog {
@@ -43,6 +56,8 @@ public:
     explicit WatchdogProcessService(const android::sp<Looper>& handlerLooper);
 
     virtual android::base::Result<void> dump(int fd, const Vector<String16>& args);
+    // Dumps the durations of the health checks per timeout and their looper lag.
+    virtual android::base::Result<void> dumpSelfProfile(int fd);
 
     virtual binder::Status registerClient(const sp<ICarWatchdogClient>& client,
                                           TimeoutLength timeout);
@@ -57,11 +72,18 @@ public:
                                              int32_t sessionId);
     virtual binder::Status tellDumpFinished(const android::sp<ICarWatchdogMonitor>& monitor,
                                             int32_t pid);
+    // Creates the health channel of the registered mediator on the first call and returns a new
+    // fd of the channel. The subsequent health checks of the mediator go through the channel.
+    virtual binder::Status openMediatorHealthChannel(const sp<ICarWatchdogClient>& mediator,
+                                                     os::ParcelFileDescriptor* channelFd);
     virtual binder::Status notifyPowerCycleChange(PowerCycle cycle);
     virtual binder::Status notifyUserStateChange(userid_t userId, UserState state);
+    // Reports the packages that went over their daily write budget to the registered monitor.
+    virtual android::base::Result<void> notifyWriteBudgetExceeded(
+            const std::vector<WriteBudgetViolation>& violations);
     virtual void binderDied(const android::wp<IBinder>& who);
 
-    void doHealthCheck(int what);
+    void doHealthCheck();
     void terminate();
 
 private:
@@ -72,21 +94,93 @@ private:
 
     struct ClientInfo {
         ClientInfo(const android::sp<ICarWatchdogClient>& client, pid_t pid, userid_t userId,
-                   ClientType type) :
+                   ClientType type, TimeoutLength timeout) :
               client(client),
               pid(pid),
               userId(userId),
-              type(type) {}
+              sessionId(0),
+              type(type),
+              timeout(timeout),
+              isUserStopped(false) {}
         std::string toString();
 
         android::sp<ICarWatchdogClient> client;
         pid_t pid;
         userid_t userId;
+        // Session ID of the last ping. 0 when the client wasn't pinged.
         int sessionId;
         ClientType type;
+        TimeoutLength timeout;
+        // Whether |userId| is stopped. The clients of the stopped users aren't pinged.
+        bool isUserStopped;
+        // Pings and liveness reports of the mediator when it has opened the channel. Shared by
+        // the copies of the client info taken by the health check.
+        std::shared_ptr<MediatorHealthChannel> healthChannel;
     };
 
-    typedef std::unordered_map<int, ClientInfo> PingedClientMap;
+    // Binders of the pinged clients indexed by their session IDs.
+    typedef std::unordered_map<int32_t, IBinder*> PingedClientMap;
+
+    // Lock-free record of a pinged session. tellClientAlive marks the session as responded
+    // without taking any lock and the health check reconciles the marks with the pinged clients.
+    struct LivenessSlot {
+        // Pinged session ID, its negation after the client responded, or 0 when unused.
+        std::atomic<int32_t> sessionId{0};
+        std::atomic<IBinder*> binder{nullptr};
+        // Uptime when the client responded to |sessionId|.
+        std::atomic<nsecs_t> respondedUptime{0};
+    };
+
+    static constexpr size_t kNumLivenessSlots = 256;
+
+    // Clients registered with the same timeout. Each shard has its own lock, so the clients of
+    // different timeouts don't contend with each other. Session IDs encode the index of their
+    // shard, so tellClientAlive looks up only the shard of the session.
+    struct ClientShard {
+        ClientShard(size_t index, size_t numShards, TimeoutLength timeout);
+
+        // Marks |sessionId| as responded by |binder| when the session owns its liveness slot.
+        // Doesn't lock the shard. Returns false when the caller should look up |pingedClients|.
+        bool markResponded(IBinder* binder, int32_t sessionId);
+        // The below helpers keep |clients| and |clientsByUser| in sync.
+        void addClientLocked(IBinder* binder, ClientInfo clientInfo);
+        void eraseClientLocked(std::unordered_map<IBinder*, ClientInfo>::iterator it);
+        // Updates the clients of |userId| only, so a user switch doesn't walk all the clients.
+        void setUserStoppedLocked(userid_t userId, bool isStopped);
+        // The below helpers keep |pingedClients| and |livenessSlots| in sync.
+        void addPingedLocked(int32_t sessionId, IBinder* binder);
+        void erasePingedLocked(int32_t sessionId);
+        void clearPingedLocked();
+        // Erases |sessionId| and returns its response uptime when the client has marked it as
+        // responded.
+        std::optional<nsecs_t> takeResponseLocked(int32_t sessionId);
+
+        const size_t index;
+        const size_t numShards;
+        const TimeoutLength timeout;
+        Mutex mutex;
+        // Registered clients indexed by their binders.
+        std::unordered_map<IBinder*, ClientInfo> clients GUARDED_BY(mutex);
+        // Binders of the registered clients indexed by their users.
+        std::unordered_map<userid_t, std::unordered_set<IBinder*>> clientsByUser
+                GUARDED_BY(mutex);
+        PingedClientMap pingedClients GUARDED_BY(mutex);
+        // Binders of the registered clients scheduled at their next health check deadlines. Each
+        // health check only visits the clients whose deadlines have expired.
+        TimerWheel<IBinder*, IBinder*> healthCheckWheel GUARDED_BY(mutex);
+        // Deadline of the pending health check. Newly registered clients join it, so the clients
+        // of the shard are checked in one batch.
+        nsecs_t nextHealthCheckUptime GUARDED_BY(mutex);
+        int32_t lastSessionId GUARDED_BY(mutex);
+        // Indexed by the session IDs of the shard. A session whose slot is taken by another
+        // pinged session is only tracked in |pingedClients|.
+        std::array<LivenessSlot, kNumLivenessSlots> livenessSlots;
+
+    private:
+        LivenessSlot& livenessSlot(int32_t sessionId) {
+            return livenessSlots[(sessionId / numShards) % kNumLivenessSlots];
+        }
+    };
 
     class MessageHandlerImpl : public MessageHandler {
     public:
@@ -104,30 +198,60 @@ private:
     binder::Status unregisterClientLocked(const std::vector<TimeoutLength>& timeouts,
                                           android::sp<IBinder> binder, ClientType clientType);
     bool isRegisteredLocked(const android::sp<ICarWatchdogClient>& client);
-    binder::Status tellClientAliveLocked(const android::sp<ICarWatchdogClient>& client,
-                                         int32_t sessionId);
-    base::Result<void> startHealthCheckingLocked(TimeoutLength timeout);
-    base::Result<void> dumpAndKillClientsIfNotResponding(TimeoutLength timeout);
+    binder::Status tellClientAliveInternal(const android::sp<ICarWatchdogClient>& client,
+                                           int32_t sessionId);
+    ClientShard& shardFor(TimeoutLength timeout);
+    // The below health check helpers require the lock of |shard|.
+    void scheduleHealthCheckLocked(ClientShard* shard, IBinder* binder);
+    void cancelHealthCheckLocked(ClientShard* shard, IBinder* binder);
+    int32_t getNewSessionIdLocked(ClientShard* shard);
+    void restartHealthCheckingLocked();
+    void rearmHealthCheck();
+    // Records the responses the clients of |shard| marked since the last reconciliation.
+    // Requires the lock of |shard|.
+    void reconcileLivenessLocked(ClientShard* shard);
+    // Records the response of the mediator to its current session from its health channel and
+    // appends the clients the mediator reported as not responding. Requires the lock of |shard|.
+    void takeHealthReportsLocked(ClientShard* shard, const ClientInfo& clientInfo,
+                                 std::vector<int32_t>* processesNotResponding);
+    // Queues the processes to be dumped and killed on |mDumpQueue|.
+    base::Result<void> dumpAndKillClientsIfNotResponding(const std::vector<ClientInfo>& clients);
     base::Result<void> dumpAndKillAllProcesses(const std::vector<int32_t>& processesNotResponding);
-    int32_t getNewSessionId();
+    // Hands the processes to the monitor. Called on the |mDumpQueue| worker thread.
+    base::Result<void> requestDumpAndKill(const std::vector<int32_t>& processesNotResponding);
     bool isWatchdogEnabled();
 
-    using Processor =
-            std::function<void(std::vector<ClientInfo>&, std::vector<ClientInfo>::const_iterator)>;
+    using Processor = std::function<void(ClientShard*,
+                                         std::unordered_map<IBinder*, ClientInfo>::iterator)>;
     bool findClientAndProcessLocked(const std::vector<TimeoutLength> timeouts,
                                     const android::sp<IBinder> binder, const Processor& processor);
 
 private:
     sp<Looper> mHandlerLooper;
     android::sp<MessageHandlerImpl> mMessageHandler;
+    // Serializes the client registrations and guards the service state. Must be locked before
+    // the shard locks.
     Mutex mMutex;
-    std::unordered_map<TimeoutLength, std::vector<ClientInfo>> mClients GUARDED_BY(mMutex);
-    std::unordered_map<TimeoutLength, PingedClientMap> mPingedClients GUARDED_BY(mMutex);
+    // Shards indexed by their timeouts.
+    std::vector<std::unique_ptr<ClientShard>> mClientShards;
+    // Stopped users. The clients of the users are marked when the users stop, so the health
+    // check doesn't read this set.
     std::unordered_set<userid_t> mStoppedUserId GUARDED_BY(mMutex);
     android::sp<ICarWatchdogMonitor> mMonitor GUARDED_BY(mMutex);
     bool mWatchdogEnabled GUARDED_BY(mMutex);
-    // mLastSessionId is accessed only within main thread. No need for mutual-exclusion.
-    int32_t mLastSessionId;
+    // Makes rescheduling the health check message atomic. Must be locked after |mMutex| and
+    // before the shard locks.
+    Mutex mRearmMutex;
+    // Uptime the health check message is scheduled at, or 0 when it isn't scheduled.
+    std::atomic<nsecs_t> mScheduledHealthCheckUptime;
+    // Durations of the health checks per timeout and the delay between the scheduled and the
+    // actual start of the health checks. Has its own locking.
+    StageProfiler mProfiler;
+    // Dumps and kills the non-responding processes off the looper thread.
+    android::sp<DumpQueue> mDumpQueue;
+    // Sends the pings off the looper thread. Declared last so it stops before the members its
+    // pings access are destroyed.
+    android::sp<PingDispatcher> mPingDispatcher;
 };
 
 }  // namespace watchdog
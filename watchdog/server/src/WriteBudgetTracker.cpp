@@ -0,0 +1,237 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "carwatchdogd"
+
+#include "WriteBudgetTracker.h"
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <cutils/multiuser.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <log/log.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::Dirname;
+using android::base::ErrnoError;
+using android::base::ParseInt;
+using android::base::ParseUint;
+using android::base::ReadFileToString;
+using android::base::Result;
+using android::base::Split;
+using android::base::StringAppendF;
+using android::base::Trim;
+using android::base::WriteStringToFile;
+
+namespace {
+
+constexpr int64_t kSecondsPerDay = 24 * 60 * 60;
+constexpr uint64_t kBytesPerMib = 1024 * 1024;
+
+int64_t toDay(time_t time) {
+    return static_cast<int64_t>(time) / kSecondsPerDay;
+}
+
+}  // namespace
+
+std::vector<WriteBudgetViolation> WriteBudgetTracker::update(
+        time_t now, const std::vector<UidWriteBytes>& writes,
+        const std::unordered_map<uint32_t, std::string>& packageNames) {
+    Mutex::Autolock lock(mMutex);
+    const int64_t day = toDay(now);
+    if (!mIsLoaded) {
+        loadLocked(day);
+    }
+    if (day != mDay) {
+        mTotals.clear();
+        mDay = day;
+        mIsDirty = true;
+    }
+    std::vector<WriteBudgetViolation> violations;
+    for (const auto& write : writes) {
+        if (write.bytes == 0) {
+            continue;
+        }
+        UidWriteTotal& total = mTotals[write.uid];
+        if (const auto it = packageNames.find(write.uid); it != packageNames.end()) {
+            total.packageName = it->second;
+        } else if (total.packageName.empty()) {
+            total.packageName = std::to_string(write.uid);
+        }
+        total.bytes += write.bytes;
+        mIsDirty = true;
+        if (total.isOverBudget) {
+            continue;
+        }
+        const uint64_t budget = budgetBytes(total.packageName);
+        if (budget == 0 || total.bytes <= budget) {
+            continue;
+        }
+        total.isOverBudget = true;
+        violations.push_back({
+                .uid = write.uid,
+                .packageName = total.packageName,
+                .writtenBytes = total.bytes,
+                .budgetBytes = budget,
+        });
+    }
+    // Persist right away when a UID goes over budget so it isn't reported again after a restart.
+    if (mIsDirty &&
+        (!violations.empty() ||
+         now - mLastPersistTime >= static_cast<time_t>(kPersistInterval.count()))) {
+        if (const auto ret = persistLocked(); !ret) {
+            ALOGW("Failed to persist the write budget totals: %s", ret.error().message().c_str());
+        }
+        // Retry on the next interval rather than on every collection while /data is unavailable.
+        mLastPersistTime = now;
+    }
+    return violations;
+}
+
+Result<void> WriteBudgetTracker::flush() {
+    Mutex::Autolock lock(mMutex);
+    if (!mIsDirty) {
+        return {};
+    }
+    return persistLocked();
+}
+
+void WriteBudgetTracker::writeTo(DumpWriter* writer) {
+    Mutex::Autolock lock(mMutex);
+    writer->appendF("Default daily write budget: %" PRIu64 " bytes\n", kDefaultBudgetBytes);
+    for (const auto& [packageName, budget] : kPackageBudgetBytes) {
+        writer->appendF("Daily write budget of %s: %" PRIu64 " bytes\n", packageName.c_str(),
+                        budget);
+    }
+    std::vector<std::pair<uint32_t, const UidWriteTotal*>> overBudget;
+    for (const auto& [uid, total] : mTotals) {
+        if (total.isOverBudget) {
+            overBudget.emplace_back(uid, &total);
+        }
+    }
+    if (overBudget.empty()) {
+        writer->append("No package went over its write budget today\n");
+        return;
+    }
+    std::sort(overBudget.begin(), overBudget.end(),
+              [](const auto& l, const auto& r) { return l.second->bytes > r.second->bytes; });
+    writer->append("Packages over their write budget today (Android User ID, Package Name, "
+                   "Written Bytes, Budget Bytes):\n");
+    for (const auto& [uid, total] : overBudget) {
+        writer->appendF("\t%" PRIu32 ", %s, %" PRIu64 ", %" PRIu64 "\n",
+                        multiuser_get_user_id(uid), total->packageName.c_str(), total->bytes,
+                        budgetBytes(total->packageName));
+    }
+}
+
+uint64_t WriteBudgetTracker::budgetBytes(const std::string& packageName) const {
+    if (const auto it = kPackageBudgetBytes.find(packageName); it != kPackageBudgetBytes.end()) {
+        return it->second;
+    }
+    return kDefaultBudgetBytes;
+}
+
+bool WriteBudgetTracker::enabled() const {
+    if (kDefaultBudgetBytes > 0) {
+        return true;
+    }
+    return std::any_of(kPackageBudgetBytes.begin(), kPackageBudgetBytes.end(),
+                       [](const auto& entry) { return entry.second > 0; });
+}
+
+void WriteBudgetTracker::loadLocked(int64_t day) {
+    std::string buffer;
+    if (!ReadFileToString(kPath, &buffer)) {
+        // /data is not available during early boot. Keep retrying until the file's directory is
+        // available.
+        if (errno == ENOENT && access(Dirname(kPath).c_str(), F_OK) == 0) {
+            mIsLoaded = true;
+        }
+        return;
+    }
+    mIsLoaded = true;
+    std::vector<std::string> lines = Split(buffer, "\n");
+    int64_t fileDay = 0;
+    if (lines.empty() || !ParseInt(Trim(lines[0]), &fileDay) || fileDay != day) {
+        return;
+    }
+    // Merge with the totals updated before the file could be read.
+    for (size_t i = 1; i < lines.size(); ++i) {
+        std::vector<std::string> fields = Split(lines[i], " ");
+        uint32_t uid = 0;
+        uint64_t bytes = 0;
+        uint32_t isOverBudget = 0;
+        if (fields.size() != 4 || !ParseUint(fields[0], &uid) || !ParseUint(fields[1], &bytes) ||
+            !ParseUint(fields[2], &isOverBudget)) {
+            continue;
+        }
+        UidWriteTotal& total = mTotals[uid];
+        if (total.packageName.empty()) {
+            total.packageName = fields[3];
+        }
+        total.bytes += bytes;
+        total.isOverBudget |= isOverBudget != 0;
+    }
+    mDay = day;
+}
+
+Result<void> WriteBudgetTracker::persistLocked() {
+    std::string buffer = std::to_string(mDay) + "\n";
+    for (const auto& [uid, total] : mTotals) {
+        StringAppendF(&buffer, "%" PRIu32 " %" PRIu64 " %d %s\n", uid, total.bytes,
+                      total.isOverBudget ? 1 : 0, total.packageName.c_str());
+    }
+    const std::string tmpPath = kPath + ".tmp";
+    if (!WriteStringToFile(buffer, tmpPath)) {
+        return ErrnoError() << "Failed to write " << tmpPath;
+    }
+    if (rename(tmpPath.c_str(), kPath.c_str()) != 0) {
+        return ErrnoError() << "Failed to rename " << tmpPath << " to " << kPath;
+    }
+    mIsLoaded = true;
+    mIsDirty = false;
+    return {};
+}
+
+std::unordered_map<std::string, uint64_t> parsePackageWriteBudgets(const std::string& value) {
+    std::unordered_map<std::string, uint64_t> budgets;
+    for (const auto& entry : Split(value, ",")) {
+        std::vector<std::string> fields = Split(Trim(entry), ":");
+        uint64_t budgetMib = 0;
+        if (fields.size() != 2 || fields[0].empty() || !ParseUint(fields[1], &budgetMib)) {
+            if (!Trim(entry).empty()) {
+                ALOGW("Ignoring malformed package write budget '%s'", entry.c_str());
+            }
+            continue;
+        }
+        budgets[fields[0]] = budgetMib * kBytesPerMib;
+    }
+    return budgets;
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
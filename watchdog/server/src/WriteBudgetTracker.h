@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_SRC_WRITEBUDGETTRACKER_H_
+#define WATCHDOG_SERVER_SRC_WRITEBUDGETTRACKER_H_
+
+#include <android-base/chrono_utils.h>
+#include <android-base/result.h>
+#include <stdint.h>
+#include <time.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DumpWriter.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+constexpr const char* kWriteBudgetPath = "/data/misc/carwatchdog/write_budget";
+
+// Write bytes of a UID since the last collection.
+struct UidWriteBytes {
+    uint32_t uid = 0;
+    uint64_t bytes = 0;
+};
+
+// UID whose write bytes went over its daily budget.
+struct WriteBudgetViolation {
+    uint32_t uid = 0;
+    std::string packageName;
+    uint64_t writtenBytes = 0;
+    uint64_t budgetBytes = 0;
+};
+
+// Accumulates the write bytes of each UID over the current UTC day and reports the UIDs that go
+// over their daily write budget. Each UID is reported at most once per day.
+//
+// The budget of a UID is the budget of its package name when one is configured, and the default
+// budget otherwise. A zero budget disables the tracking of the UID.
+//
+// The accumulated bytes are persisted to |path| so they survive carwatchdogd restarts. To avoid
+// adding to the flash wear it tracks, the file is rewritten at most once every
+// |kPersistInterval| and on |flush|.
+class WriteBudgetTracker : public RefBase {
+public:
+    WriteBudgetTracker(uint64_t defaultBudgetBytes,
+                       const std::unordered_map<std::string, uint64_t>& packageBudgetBytes,
+                       const std::string& path = kWriteBudgetPath) :
+          kDefaultBudgetBytes(defaultBudgetBytes),
+          kPackageBudgetBytes(packageBudgetBytes),
+          kPath(path),
+          mIsLoaded(false),
+          mDay(0),
+          mIsDirty(false),
+          mLastPersistTime(0) {}
+
+    virtual ~WriteBudgetTracker() {}
+
+    // Adds |writes| collected at |now| to the current day's totals and returns the UIDs that went
+    // over their budget with this update. |packageNames| holds the package names of the UIDs in
+    // |writes|. The persisted totals are loaded on the first update because carwatchdogd starts
+    // before /data is mounted.
+    virtual std::vector<WriteBudgetViolation> update(
+            time_t now, const std::vector<UidWriteBytes>& writes,
+            const std::unordered_map<uint32_t, std::string>& packageNames);
+
+    // Writes the current day's totals to the storage when they changed since the last write.
+    virtual android::base::Result<void> flush();
+
+    // Writes the budgets and the UIDs that went over their budget today.
+    void writeTo(DumpWriter* writer);
+
+    // Returns the budget of |packageName|.
+    uint64_t budgetBytes(const std::string& packageName) const;
+
+    // Returns true when any package has a non-zero budget.
+    bool enabled() const;
+
+    static constexpr std::chrono::seconds kPersistInterval = std::chrono::minutes(10);
+
+private:
+    struct UidWriteTotal {
+        std::string packageName;
+        uint64_t bytes = 0;
+        bool isOverBudget = false;
+    };
+
+    // Loads the persisted totals when they are from |day|.
+    void loadLocked(int64_t day);
+
+    android::base::Result<void> persistLocked();
+
+    // Makes sure only one update or flush is running at any given time.
+    Mutex mMutex;
+
+    const uint64_t kDefaultBudgetBytes;
+
+    const std::unordered_map<std::string, uint64_t> kPackageBudgetBytes;
+
+    const std::string kPath;
+
+    bool mIsLoaded GUARDED_BY(mMutex);
+
+    // Days since the epoch of |mTotals|.
+    int64_t mDay GUARDED_BY(mMutex);
+
+    std::unordered_map<uint32_t, UidWriteTotal> mTotals GUARDED_BY(mMutex);
+
+    // Set when |mTotals| changed since the last persist.
+    bool mIsDirty GUARDED_BY(mMutex);
+
+    time_t mLastPersistTime GUARDED_BY(mMutex);
+};
+
+// Parses the package budgets in the "<package name>:<budget in MiB>[,...]" format. Malformed
+// entries are skipped.
+std::unordered_map<std::string, uint64_t> parsePackageWriteBudgets(const std::string& value);
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_SRC_WRITEBUDGETTRACKER_H_
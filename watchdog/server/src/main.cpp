@@ -30,11 +30,14 @@
 
 #include <thread>
 
+#include "StartupTimeline.h"
+
 using android::IPCThreadState;
 using android::Looper;
 using android::ProcessState;
 using android::sp;
 using android::automotive::watchdog::ServiceManager;
+using android::automotive::watchdog::StartupTimeline;
 using android::base::Result;
 
 namespace {
@@ -60,6 +63,9 @@ void registerSigHandler() {
 }  // namespace
 
 int main(int /*argc*/, char** /*argv*/) {
+    // Start the timeline, which measures the phases from here
+    StartupTimeline::get();
+
     // Set up the looper
     sp<Looper> looper(Looper::prepare(/*opts=*/0));
 
@@ -74,10 +80,13 @@ int main(int /*argc*/, char** /*argv*/) {
     registerSigHandler();
 
     // Wait for the service manager before starting binder mediator.
-    while (android::base::GetProperty("init.svc.servicemanager", "") != "running") {
-        // Poll frequent enough so the CarWatchdogDaemonHelper can connect to the daemon during
-        // system boot up.
-        std::this_thread::sleep_for(250ms);
+    {
+        StartupTimeline::ScopedPhase phase("Service manager wait");
+        while (android::base::GetProperty("init.svc.servicemanager", "") != "running") {
+            // Poll frequent enough so the CarWatchdogDaemonHelper can connect to the daemon
+            // during system boot up.
+            std::this_thread::sleep_for(250ms);
+        }
     }
 
     // Set up the binder
@@ -94,6 +103,9 @@ int main(int /*argc*/, char** /*argv*/) {
         exit(result.error().code());
     }
 
+    // Warm up the collectors only now that the clients can reach the daemon.
+    ServiceManager::startIoPerfCollectionAsync();
+
     // Loop forever -- the health check runs on this thread in a handler, and the binder calls
     // remain responsive in their pool of threads.
     while (true) {
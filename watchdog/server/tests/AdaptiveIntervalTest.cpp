@@ -0,0 +1,122 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AdaptiveInterval.h"
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using std::chrono_literals::operator""s;
+
+namespace {
+
+const AdaptiveIntervalConfig kTestConfig = {
+        .minInterval = 1s,
+        .defaultInterval = 10s,
+        .idleInterval = 60s,
+        .ioWaitPercentThreshold = 5,
+        .majorFaultsPerSecondThreshold = 1000,
+        .writeBytesPerSecondThreshold = 1024 * 1024,
+};
+
+// Activity with all the metrics at half of their storm thresholds over 10 seconds.
+const IoActivity kActiveIoActivity = {
+        .cpuIoWaitTime = 25,
+        .totalCpuTime = 1000,
+        .majorFaults = 5000,
+        .writeBytes = 5 * 1024 * 1024,
+};
+
+}  // namespace
+
+TEST(AdaptiveIntervalTest, TestBacksOffToIdleInterval) {
+    AdaptiveInterval adaptiveInterval(kTestConfig);
+    nsecs_t uptime = s2ns(100);
+    const std::vector<int> expectedSeconds = {20, 40, 60, 60};
+    for (size_t i = 0; i < expectedSeconds.size(); ++i) {
+        auto interval = adaptiveInterval.next(IoActivity{}, uptime);
+        ASSERT_EQ(interval, std::chrono::seconds(expectedSeconds[i])) << "Iteration " << i;
+        uptime += interval.count();
+    }
+}
+
+TEST(AdaptiveIntervalTest, TestTightensOnEachStormThreshold) {
+    const std::vector<IoActivity> storms = {
+            {.cpuIoWaitTime = 60, .totalCpuTime = 1000},
+            {.majorFaults = 10001},
+            {.writeBytes = 10 * 1024 * 1024 + 1},
+    };
+    for (size_t i = 0; i < storms.size(); ++i) {
+        AdaptiveInterval adaptiveInterval(kTestConfig);
+        auto interval = adaptiveInterval.next(IoActivity{}, s2ns(100));
+        ASSERT_EQ(interval, 20s);
+        ASSERT_EQ(adaptiveInterval.next(storms[i], s2ns(110)), 1s) << "Storm " << i;
+    }
+}
+
+TEST(AdaptiveIntervalTest, TestNormalizesActivityByElapsedTime) {
+    AdaptiveInterval adaptiveInterval(kTestConfig);
+    adaptiveInterval.next(IoActivity{}, s2ns(100));
+    // 2000 major faults are below the threshold over 10 seconds but above it over 1 second.
+    ASSERT_EQ(adaptiveInterval.next({.majorFaults = 2000}, s2ns(110)), 10s);
+    ASSERT_EQ(adaptiveInterval.next({.majorFaults = 2000}, s2ns(111)), 1s);
+}
+
+TEST(AdaptiveIntervalTest, TestActiveSystemStaysAtDefaultInterval) {
+    AdaptiveInterval adaptiveInterval(kTestConfig);
+    nsecs_t uptime = s2ns(100);
+    ASSERT_EQ(adaptiveInterval.next(IoActivity{}, uptime), 20s);
+    uptime += s2ns(20);
+    ASSERT_EQ(adaptiveInterval.next(IoActivity{}, uptime), 40s);
+    uptime += s2ns(40);
+    // Activity above the idle fraction drops the interval straight to the default interval.
+    ASSERT_EQ(adaptiveInterval.next(kActiveIoActivity, uptime), 10s);
+    uptime += s2ns(10);
+    ASSERT_EQ(adaptiveInterval.next(kActiveIoActivity, uptime), 10s);
+    uptime += s2ns(10);
+    ASSERT_EQ(adaptiveInterval.next({.majorFaults = 20000}, uptime), 1s);
+    uptime += s2ns(1);
+    // After a storm, the interval doubles back to the default interval.
+    const std::vector<int> expectedSeconds = {2, 4, 8, 10, 10};
+    for (size_t i = 0; i < expectedSeconds.size(); ++i) {
+        // Scale the activity with the elapsed time to keep the rates unchanged.
+        const auto interval = adaptiveInterval.interval();
+        const double scale = static_cast<double>(interval.count()) / s2ns(10);
+        IoActivity activity = kActiveIoActivity;
+        activity.majorFaults *= scale;
+        activity.writeBytes *= scale;
+        ASSERT_EQ(adaptiveInterval.next(activity, uptime), std::chrono::seconds(expectedSeconds[i]))
+                << "Iteration " << i;
+        uptime += adaptiveInterval.interval().count();
+    }
+}
+
+TEST(AdaptiveIntervalTest, TestResetRestartsFromDefaultInterval) {
+    AdaptiveInterval adaptiveInterval(kTestConfig);
+    adaptiveInterval.next({.majorFaults = 100000}, s2ns(100));
+    ASSERT_EQ(adaptiveInterval.interval(), 1s);
+    adaptiveInterval.reset();
+    ASSERT_EQ(adaptiveInterval.interval(), 10s);
+    // Without a previous collection, the activity is normalized over the default interval.
+    ASSERT_EQ(adaptiveInterval.next({.majorFaults = 5000}, s2ns(500)), 10s);
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BootStageTracker.h"
+
+#include <string>
+#include <unordered_map>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+namespace {
+
+// Reads the system properties from a fixed mapping.
+class BootStageTrackerPeer : public BootStageTracker {
+public:
+    void setProperty(const std::string& name, const std::string& value) {
+        mProperties[name] = value;
+    }
+
+protected:
+    std::string getProperty(const std::string& name) override {
+        const auto it = mProperties.find(name);
+        return it == mProperties.end() ? "" : it->second;
+    }
+
+private:
+    std::unordered_map<std::string, std::string> mProperties;
+};
+
+}  // namespace
+
+TEST(BootStageTrackerTest, TestTracksBootStages) {
+    BootStageTrackerPeer tracker;
+    EXPECT_EQ(tracker.currentStage(), BOOT_STAGE_INIT);
+
+    tracker.setProperty("init.svc.zygote", "running");
+    EXPECT_EQ(tracker.currentStage(), BOOT_STAGE_ZYGOTE);
+
+    tracker.setProperty("sys.system_server.start_uptime", "12345");
+    EXPECT_EQ(tracker.currentStage(), BOOT_STAGE_SYSTEM_SERVER_READY);
+
+    tracker.setProperty("sys.user.0.ce_available", "true");
+    EXPECT_EQ(tracker.currentStage(), BOOT_STAGE_USER_UNLOCKED);
+}
+
+TEST(BootStageTrackerTest, TestDoesNotMoveBackOnServiceRestart) {
+    BootStageTrackerPeer tracker;
+    tracker.setProperty("init.svc.zygote", "running");
+    tracker.setProperty("sys.system_server.start_uptime", "12345");
+    ASSERT_EQ(tracker.currentStage(), BOOT_STAGE_SYSTEM_SERVER_READY);
+
+    // Zygote restarts and system_server resets its start uptime.
+    tracker.setProperty("init.svc.zygote", "restarting");
+    tracker.setProperty("sys.system_server.start_uptime", "");
+    EXPECT_EQ(tracker.currentStage(), BOOT_STAGE_SYSTEM_SERVER_READY);
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
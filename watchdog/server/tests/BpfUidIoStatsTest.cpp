@@ -0,0 +1,91 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BpfUidIoStats.h"
+
+#include <bpf/BpfUtils.h>
+#include <sys/sysinfo.h>
+
+#include <vector>
+
+#include "carwatchdog_uid_io_stats.h"
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::sp;
+using android::base::unique_fd;
+using android::bpf::createMap;
+using android::bpf::writeToMapEntry;
+
+namespace {
+
+// Creates an unpinned map with the same layout as the map maintained by the eBPF programs.
+unique_fd createUidIoStatsMap() {
+    return unique_fd(createMap(BPF_MAP_TYPE_PERCPU_HASH, sizeof(uint32_t),
+                               sizeof(uid_io_value), /*maxEntries=*/16, /*mapFlags=*/0));
+}
+
+// Writes |value| to the first CPU and |otherCpuValue| to all the other CPUs.
+void writeUidIoValue(int mapFd, uint32_t uid, const uid_io_value& value,
+                     const uid_io_value& otherCpuValue) {
+    std::vector<uid_io_value> values(get_nprocs_conf(), otherCpuValue);
+    values[0] = value;
+    ASSERT_EQ(writeToMapEntry(mapFd, &uid, values.data(), BPF_ANY), 0);
+}
+
+}  // namespace
+
+TEST(BpfUidIoStatsTest, TestSumsPerCpuValuesAndReportsDeltas) {
+    unique_fd mapFd = createUidIoStatsMap();
+    if (mapFd.get() == -1) {
+        GTEST_SKIP() << "Creating eBPF maps is not permitted";
+    }
+    const int fd = mapFd.get();
+    const size_t otherCpuCount = get_nprocs_conf() - 1;
+    writeUidIoValue(fd, 1001, {.read_bytes = 3000, .write_bytes = 500, .fsync = 20}, {});
+    writeUidIoValue(fd, 1009000, {.read_bytes = 100, .write_bytes = 200, .fsync = 1},
+                    {.read_bytes = 10, .write_bytes = 20, .fsync = 1});
+    sp<BpfUidIoStats> uidIoStats = new BpfUidIoStats(std::move(mapFd));
+    ASSERT_TRUE(uidIoStats->enabled());
+
+    auto usage = uidIoStats->collect();
+    ASSERT_TRUE(usage.ok()) << usage.error();
+    ASSERT_EQ(usage->usages.size(), 2u);
+    EXPECT_EQ(usage->find(1001)->ios, IoUsage(3000, 0, 500, 0, 20, 0));
+    EXPECT_EQ(usage->find(1009000)->ios,
+              IoUsage(100 + 10 * otherCpuCount, 0, 200 + 20 * otherCpuCount, 0,
+                      1 + otherCpuCount, 0));
+
+    writeUidIoValue(fd, 1001, {.read_bytes = 4000, .write_bytes = 500, .fsync = 25}, {});
+    usage = uidIoStats->collect();
+    ASSERT_TRUE(usage.ok()) << usage.error();
+    EXPECT_EQ(usage->find(1001)->ios, IoUsage(1000, 0, 0, 0, 5, 0));
+    EXPECT_TRUE(usage->find(1009000)->ios.isZero());
+}
+
+TEST(BpfUidIoStatsTest, TestDisabledWithoutMap) {
+    sp<BpfUidIoStats> uidIoStats = new BpfUidIoStats(unique_fd());
+
+    ASSERT_FALSE(uidIoStats->enabled());
+    ASSERT_FALSE(uidIoStats->collect().ok());
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
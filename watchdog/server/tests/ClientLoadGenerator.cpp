@@ -0,0 +1,179 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ClientLoadGenerator.h"
+
+#include <android/automotive/watchdog/BnCarWatchdogClient.h>
+
+#include <algorithm>
+#include <numeric>
+#include <thread>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+namespace testing {
+
+using android::binder::Status;
+
+namespace {
+
+nsecs_t now() {
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+}  // namespace
+
+// Synthetic client. Links to death without a remote process, so the service accepts it.
+class LoadClient : public BnCarWatchdogClient {
+public:
+    LoadClient(ClientLoadGenerator* generator, TimeoutLength timeout, bool isResponsive) :
+          mGenerator(generator), mTimeout(timeout), mIsResponsive(isResponsive) {}
+
+    Status checkIfAlive(int32_t sessionId, TimeoutLength /*timeout*/) override {
+        if (ClientLoadGenerator* generator = mGenerator.load(); generator != nullptr &&
+            mIsResponsive) {
+            generator->onPing(this, sessionId);
+        }
+        return Status::ok();
+    }
+
+    Status prepareProcessTermination() override { return Status::ok(); }
+
+    status_t linkToDeath(const sp<DeathRecipient>& /*recipient*/, void* /*cookie*/,
+                         uint32_t /*flags*/) override {
+        return OK;
+    }
+
+    status_t unlinkToDeath(const wp<DeathRecipient>& /*recipient*/, void* /*cookie*/,
+                           uint32_t /*flags*/, wp<DeathRecipient>* /*outRecipient*/) override {
+        return OK;
+    }
+
+    TimeoutLength timeout() const { return mTimeout; }
+
+    // Stops answering the pings.
+    void detach() { mGenerator.store(nullptr); }
+
+private:
+    std::atomic<ClientLoadGenerator*> mGenerator;
+    const TimeoutLength mTimeout;
+    const bool mIsResponsive;
+};
+
+void CallLatencies::merge(const CallLatencies& other) {
+    mSamples.insert(mSamples.end(), other.mSamples.begin(), other.mSamples.end());
+    mIsSorted = false;
+}
+
+nsecs_t CallLatencies::mean() const {
+    if (mSamples.empty()) {
+        return 0;
+    }
+    return std::accumulate(mSamples.begin(), mSamples.end(), static_cast<nsecs_t>(0)) /
+            static_cast<nsecs_t>(mSamples.size());
+}
+
+nsecs_t CallLatencies::percentile(double percent) {
+    if (mSamples.empty()) {
+        return 0;
+    }
+    if (!mIsSorted) {
+        std::sort(mSamples.begin(), mSamples.end());
+        mIsSorted = true;
+    }
+    const size_t index = static_cast<size_t>(percent / 100.0 * (mSamples.size() - 1) + 0.5);
+    return mSamples[std::min(index, mSamples.size() - 1)];
+}
+
+ClientLoadGenerator::ClientLoadGenerator(const sp<WatchdogProcessService>& service,
+                                         const ClientLoadConfig& config) :
+      mService(service), mConfig(config), mNumPings(0), mNumFailedResponses(0) {
+    mClients.reserve(config.numClients);
+    for (size_t i = 0; i < config.numClients; ++i) {
+        const bool isResponsive =
+                config.unresponsiveEvery == 0 || (i + 1) % config.unresponsiveEvery != 0;
+        mClients.emplace_back(new LoadClient(this, config.timeouts[i % config.timeouts.size()],
+                                             isResponsive));
+    }
+}
+
+ClientLoadGenerator::~ClientLoadGenerator() {
+    // The service may still hold the clients and ping them after the generator is gone.
+    for (auto& client : mClients) {
+        client->detach();
+    }
+}
+
+CallLatencies ClientLoadGenerator::registerClients() {
+    return callFromThreads([this](const sp<LoadClient>& client) {
+        return mService->registerClient(client, client->timeout());
+    });
+}
+
+CallLatencies ClientLoadGenerator::unregisterClients() {
+    return callFromThreads(
+            [this](const sp<LoadClient>& client) { return mService->unregisterClient(client); });
+}
+
+CallLatencies ClientLoadGenerator::aliveLatencies() {
+    Mutex::Autolock lock(mMutex);
+    return mAliveLatencies;
+}
+
+template <typename Call>
+CallLatencies ClientLoadGenerator::callFromThreads(const Call& call) {
+    const size_t numThreads = std::max<size_t>(mConfig.numCallerThreads, 1);
+    std::vector<CallLatencies> latencies(numThreads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < mClients.size(); i += numThreads) {
+                const nsecs_t start = now();
+                call(mClients[i]);
+                latencies[t].record(now() - start);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CallLatencies merged;
+    for (const auto& threadLatencies : latencies) {
+        merged.merge(threadLatencies);
+    }
+    return merged;
+}
+
+void ClientLoadGenerator::onPing(LoadClient* client, int32_t sessionId) {
+    mNumPings.fetch_add(1, std::memory_order_relaxed);
+    if (mConfig.responseDelay.count() > 0) {
+        std::this_thread::sleep_for(mConfig.responseDelay);
+    }
+    const nsecs_t start = now();
+    Status status = mService->tellClientAlive(client, sessionId);
+    const nsecs_t latency = now() - start;
+    if (!status.isOk()) {
+        mNumFailedResponses.fetch_add(1, std::memory_order_relaxed);
+    }
+    Mutex::Autolock lock(mMutex);
+    mAliveLatencies.record(latency);
+}
+
+}  // namespace testing
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
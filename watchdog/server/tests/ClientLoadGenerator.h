@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_TESTS_CLIENTLOADGENERATOR_H_
+#define WATCHDOG_SERVER_TESTS_CLIENTLOADGENERATOR_H_
+
+#include <android/automotive/watchdog/TimeoutLength.h>
+#include <utils/Mutex.h>
+#include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "WatchdogProcessService.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+namespace testing {
+
+class LoadClient;
+
+struct ClientLoadConfig {
+    // Number of synthetic clients. They are spread evenly over |timeouts|.
+    size_t numClients = 1000;
+    // Number of threads that make the register and unregister calls concurrently.
+    size_t numCallerThreads = 4;
+    std::vector<TimeoutLength> timeouts = {TimeoutLength::TIMEOUT_CRITICAL,
+                                           TimeoutLength::TIMEOUT_MODERATE,
+                                           TimeoutLength::TIMEOUT_NORMAL};
+    // Delay between a ping and the client's response.
+    std::chrono::nanoseconds responseDelay = std::chrono::nanoseconds(0);
+    // Every |unresponsiveEvery|-th client never responds to the pings. 0 when all the clients
+    // respond.
+    size_t unresponsiveEvery = 0;
+};
+
+// Latencies of the calls made to the service.
+class CallLatencies {
+public:
+    void record(nsecs_t latency) {
+        mSamples.push_back(latency);
+        mIsSorted = false;
+    }
+    void merge(const CallLatencies& other);
+
+    size_t count() const { return mSamples.size(); }
+    nsecs_t mean() const;
+    // Returns the latency under which |percent| of the calls completed.
+    nsecs_t percentile(double percent);
+
+private:
+    std::vector<nsecs_t> mSamples;
+    bool mIsSorted = false;
+};
+
+// Generates a synthetic binder client load on WatchdogProcessService. The clients are local
+// binder objects, so the calls measure the service without the binder transport. Each client
+// answers the pings with tellClientAlive from the service's ping thread. Terminate the service
+// before destroying the generator, so no ping is in flight.
+class ClientLoadGenerator {
+public:
+    ClientLoadGenerator(const android::sp<WatchdogProcessService>& service,
+                        const ClientLoadConfig& config);
+    ~ClientLoadGenerator();
+
+    // Registers all the clients from |ClientLoadConfig::numCallerThreads| threads and returns the
+    // registerClient latencies.
+    CallLatencies registerClients();
+
+    // Unregisters all the clients from |ClientLoadConfig::numCallerThreads| threads and returns
+    // the unregisterClient latencies.
+    CallLatencies unregisterClients();
+
+    // Returns the tellClientAlive latencies of all the responses so far.
+    CallLatencies aliveLatencies();
+
+    uint64_t numPings() const { return mNumPings.load(); }
+    uint64_t numFailedResponses() const { return mNumFailedResponses.load(); }
+
+private:
+    friend class LoadClient;
+
+    // Calls |call| for every client from the caller threads and returns the call latencies.
+    template <typename Call>
+    CallLatencies callFromThreads(const Call& call);
+
+    void onPing(LoadClient* client, int32_t sessionId);
+
+    const android::sp<WatchdogProcessService> mService;
+    const ClientLoadConfig mConfig;
+    std::vector<android::sp<LoadClient>> mClients;
+    std::atomic<uint64_t> mNumPings;
+    std::atomic<uint64_t> mNumFailedResponses;
+    Mutex mMutex;
+    CallLatencies mAliveLatencies GUARDED_BY(mMutex);
+};
+
+}  // namespace testing
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_TESTS_CLIENTLOADGENERATOR_H_
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DumpQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::Result;
+using std::chrono_literals::operator""ms;
+using std::chrono_literals::operator""s;
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+
+namespace {
+
+class DumpQueuePeer : public DumpQueue {
+public:
+    DumpQueuePeer(DumpHandler handler, size_t capacity, std::chrono::nanoseconds coalesceWindow) :
+          DumpQueue(std::move(handler), capacity, coalesceWindow), mNow(s2ns(100)) {}
+    ~DumpQueuePeer() { terminate(); }
+
+    void advance(nsecs_t duration) { mNow += duration; }
+
+protected:
+    nsecs_t now() override { return mNow; }
+
+private:
+    std::atomic<nsecs_t> mNow;
+};
+
+}  // namespace
+
+TEST(DumpQueueTest, TestCoalescesPidsWithinWindow) {
+    std::promise<std::vector<int32_t>> dumped;
+    sp<DumpQueue> queue = new DumpQueue(
+            [&](const std::vector<int32_t>& pids) -> Result<void> {
+                dumped.set_value(pids);
+                return {};
+            },
+            DumpQueue::kDefaultCapacity, 200ms);
+
+    ASSERT_TRUE(queue->enqueue(1));
+    ASSERT_TRUE(queue->enqueue(2));
+    ASSERT_TRUE(queue->enqueue(1));
+
+    auto future = dumped.get_future();
+    ASSERT_EQ(future.wait_for(1s), std::future_status::ready);
+    EXPECT_THAT(future.get(), ElementsAre(1, 2));
+    EXPECT_THAT(queue->dump(""), HasSubstr("queued: 2, coalesced: 1, dropped: 0"));
+    queue->terminate();
+}
+
+TEST(DumpQueueTest, TestSlowHandlerDoesNotBlockEnqueue) {
+    std::promise<void> handlerCalled;
+    std::promise<void> release;
+    std::shared_future<void> releaseFuture = release.get_future().share();
+    std::once_flag calledOnce;
+    sp<DumpQueue> queue = new DumpQueue(
+            [&](const std::vector<int32_t>&) -> Result<void> {
+                std::call_once(calledOnce, [&]() { handlerCalled.set_value(); });
+                releaseFuture.wait();
+                return {};
+            },
+            DumpQueue::kDefaultCapacity, 0ms);
+
+    ASSERT_TRUE(queue->enqueue(1));
+    ASSERT_EQ(handlerCalled.get_future().wait_for(1s), std::future_status::ready);
+
+    auto enqueued = std::async(std::launch::async, [&]() { return queue->enqueue(2); });
+    ASSERT_EQ(enqueued.wait_for(1s), std::future_status::ready)
+            << "Queueing a pid was blocked by the handler in progress";
+    EXPECT_TRUE(enqueued.get());
+    release.set_value();
+    queue->terminate();
+}
+
+TEST(DumpQueueTest, TestDropsPidsWhenFull) {
+    std::promise<void> handlerCalled;
+    std::promise<void> release;
+    std::shared_future<void> releaseFuture = release.get_future().share();
+    std::once_flag calledOnce;
+    sp<DumpQueue> queue = new DumpQueue(
+            [&](const std::vector<int32_t>&) -> Result<void> {
+                std::call_once(calledOnce, [&]() { handlerCalled.set_value(); });
+                releaseFuture.wait();
+                return {};
+            },
+            /*capacity=*/2, 0ms);
+
+    ASSERT_TRUE(queue->enqueue(1));
+    ASSERT_EQ(handlerCalled.get_future().wait_for(1s), std::future_status::ready);
+
+    EXPECT_TRUE(queue->enqueue(2));
+    EXPECT_TRUE(queue->enqueue(3));
+    EXPECT_FALSE(queue->enqueue(4)) << "Pid was queued when the queue is full";
+    EXPECT_TRUE(queue->enqueue(1)) << "Pending pid was not coalesced";
+    EXPECT_THAT(queue->dump(""), HasSubstr("queued: 3, coalesced: 1, dropped: 1"));
+    release.set_value();
+    queue->terminate();
+}
+
+TEST(DumpQueueTest, TestRunsPrepareBeforeHandler) {
+    std::vector<std::string> calls;
+    std::mutex callsMutex;
+    std::promise<void> dumped;
+    sp<DumpQueue> queue = new DumpQueue(
+            [&](const std::vector<int32_t>&) -> Result<void> {
+                std::lock_guard<std::mutex> lock(callsMutex);
+                calls.push_back("dump");
+                dumped.set_value();
+                return {};
+            },
+            DumpQueue::kDefaultCapacity, 100ms);
+
+    ASSERT_TRUE(queue->enqueue(1, [&]() {
+        std::lock_guard<std::mutex> lock(callsMutex);
+        calls.push_back("prepare");
+    }));
+    ASSERT_EQ(dumped.get_future().wait_for(1s), std::future_status::ready);
+    queue->terminate();
+
+    std::lock_guard<std::mutex> lock(callsMutex);
+    EXPECT_THAT(calls, ElementsAre("prepare", "dump"));
+}
+
+TEST(DumpQueueTest, TestRecordsDumpAndKillLatency) {
+    std::promise<void> dumped;
+    sp<DumpQueuePeer> queue;
+    queue = new DumpQueuePeer(
+            [&](const std::vector<int32_t>&) -> Result<void> {
+                queue->advance(ms2ns(20));
+                dumped.set_value();
+                return {};
+            },
+            DumpQueue::kDefaultCapacity, 0ms);
+
+    ASSERT_TRUE(queue->enqueue(1));
+    ASSERT_EQ(dumped.get_future().wait_for(1s), std::future_status::ready);
+    // Wait until the worker records the dump latency.
+    for (int i = 0; i < 100 && queue->dump("").find("Pending: 0") == std::string::npos; ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    queue->advance(s2ns(2));
+    queue->onDumpFinished(1);
+    queue->onDumpFinished(2);
+
+    const std::string dump = queue->dump("");
+    EXPECT_THAT(dump, HasSubstr("Dump latency: <10ms: 0, <50ms: 1,"));
+    EXPECT_THAT(dump,
+                HasSubstr("Kill latency: <10ms: 0, <50ms: 0, <100ms: 0, <500ms: 0, "
+                          "<1000ms: 0, <3000ms: 1,"));
+}
+
+TEST(DumpQueueTest, TestFailedHandlerIsNotTrackedForKillLatency) {
+    std::promise<void> dumped;
+    sp<DumpQueue> queue = new DumpQueue(
+            [&](const std::vector<int32_t>&) -> Result<void> {
+                dumped.set_value();
+                return android::base::Error() << "Monitor is not set";
+            },
+            DumpQueue::kDefaultCapacity, 0ms);
+
+    ASSERT_TRUE(queue->enqueue(1));
+    ASSERT_EQ(dumped.get_future().wait_for(1s), std::future_status::ready);
+    for (int i = 0; i < 100 && queue->dump("").find("failed: 1") == std::string::npos; ++i) {
+        std::this_thread::sleep_for(10ms);
+    }
+    queue->onDumpFinished(1);
+
+    const std::string dump = queue->dump("");
+    EXPECT_THAT(dump, HasSubstr("failed: 1"));
+    EXPECT_THAT(dump, HasSubstr("Kill latency: <10ms: 0, <50ms: 0,"));
+    queue->terminate();
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "DumpWriter.h"
+
+#include <android-base/file.h>
+
+#include <string>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::ReadFileToString;
+
+TEST(DumpWriterTest, TestAppendsToString) {
+    std::string out;
+    DumpWriter writer(&out);
+    writer.append("Number of collections: ");
+    writer.appendF("%d, %s\n", 2, "periodic");
+    ASSERT_TRUE(writer.flush());
+    EXPECT_EQ(out, "Number of collections: 2, periodic\n");
+}
+
+TEST(DumpWriterTest, TestWritesToFdAcrossBufferBoundaries) {
+    TemporaryFile dump;
+    std::string expected;
+    {
+        DumpWriter writer(dump.fd);
+        // Lines that don't evenly divide the buffer size leave the buffer partly filled when it
+        // is flushed.
+        for (int i = 0; i < 1000; ++i) {
+            writer.appendF("Collection %d: %s\n", i, std::string(i % 97, 'x').c_str());
+            expected += "Collection " + std::to_string(i) + ": " + std::string(i % 97, 'x') + "\n";
+        }
+        const std::string longLine(kDumpWriterBufferSize * 2 + 1, 'y');
+        writer.appendF("%s\n", longLine.c_str());
+        writer.append(longLine);
+        expected += longLine + "\n" + longLine;
+        writer.append("\nend\n");
+        expected += "\nend\n";
+        ASSERT_TRUE(writer.flush());
+    }
+    std::string contents;
+    ASSERT_TRUE(ReadFileToString(dump.path, &contents));
+    EXPECT_EQ(contents, expected);
+}
+
+TEST(DumpWriterTest, TestFlushesOnDestruction) {
+    TemporaryFile dump;
+    {
+        DumpWriter writer(dump.fd);
+        writer.append("report\n");
+    }
+    std::string contents;
+    ASSERT_TRUE(ReadFileToString(dump.path, &contents));
+    EXPECT_EQ(contents, "report\n");
+}
+
+TEST(DumpWriterTest, TestReportsWriteFailure) {
+    DumpWriter writer(-1);
+    writer.append("report\n");
+    EXPECT_FALSE(writer.flush());
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -18,17 +18,28 @@
 
 #include <WatchdogProperties.sysprop.h>
 #include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <cutils/android_filesystem_config.h>
+#include <sys/stat.h>
 
 #include <algorithm>
 #include <future>
 #include <queue>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "BootStageTracker.h"
+#include "IoPerfHistory.h"
 #include "LooperStub.h"
+#include "MemoryBudget.h"
+#include "PackageNameResolver.h"
 #include "ProcPidDir.h"
+#include "ProcPidIo.h"
+#include "ProcPressure.h"
 #include "ProcPidStat.h"
+#include "ProcSnapshotReplay.h"
 #include "ProcStat.h"
 #include "UidIoStats.h"
 #include "gmock/gmock.h"
@@ -38,10 +49,17 @@ namespace automotive {
 namespace watchdog {
 
 using android::base::Error;
+using android::base::ReadFileToString;
 using android::base::Result;
+using android::base::StringPrintf;
 using android::base::WriteStringToFile;
 using testing::LooperStub;
 using testing::populateProcPidDir;
+using testing::ProcSnapshotReplay;
+using ::testing::EndsWith;
+using ::testing::HasSubstr;
+using ::testing::StartsWith;
+using ::testing::UnorderedElementsAre;
 
 namespace {
 
@@ -53,21 +71,37 @@ const std::chrono::seconds kTestCustomCollectionDuration = 11s;
 class UidIoStatsStub : public UidIoStats {
 public:
     explicit UidIoStatsStub(bool enabled = false) : mEnabled(enabled) {}
-    Result<std::unordered_map<uint32_t, UidIoUsage>> collect() override {
+    Result<UidIoUsages> collect() override {
         if (mCache.empty()) {
             return Error() << "Cache is empty";
         }
         const auto entry = mCache.front();
         mCache.pop();
-        return entry;
+        UidIoUsages usages;
+        for (const auto& [uid, usage] : entry) {
+            usages.usages.push_back(usage);
+            for (int i = 0; i < METRIC_TYPES; ++i) {
+                for (int j = 0; j < UID_STATES; ++j) {
+                    usages.total.metrics[i][j] += usage.ios.metrics[i][j];
+                }
+            }
+        }
+        std::sort(usages.usages.begin(), usages.usages.end(),
+                  [](const UidIoUsage& l, const UidIoUsage& r) { return l.uid < r.uid; });
+        return usages;
+    }
+    void setAppIdFilter(const std::unordered_set<uint32_t>& appIds) override {
+        mAppIdFilter = appIds;
     }
     bool enabled() override { return mEnabled; }
     std::string filePath() override { return kUidIoStatsPath; }
     void push(const std::unordered_map<uint32_t, UidIoUsage>& entry) { mCache.push(entry); }
+    const std::unordered_set<uint32_t>& appIdFilter() const { return mAppIdFilter; }
 
 private:
     bool mEnabled;
     std::queue<std::unordered_map<uint32_t, UidIoUsage>> mCache;
+    std::unordered_set<uint32_t> mAppIdFilter;
 };
 
 class ProcStatStub : public ProcStat {
@@ -90,6 +124,26 @@ private:
     std::queue<ProcStatInfo> mCache;
 };
 
+// Captures the pressure stall callback so tests can simulate PSI triggers.
+class ProcPressureStub : public ProcPressure {
+public:
+    explicit ProcPressureStub(bool enabled = false) : mEnabled(enabled) {}
+    Result<ProcPressureInfo> collect() override { return ProcPressureInfo{}; }
+    bool enabled() override { return mEnabled; }
+    std::string dirPath() override { return kProcPressureDirPath; }
+    Result<void> startMonitor(const std::vector<PressureTrigger>& /*triggers*/,
+                              const std::function<void(PressureResource)>& onStall) override {
+        mOnStall = onStall;
+        return {};
+    }
+    void stopMonitor() override {}
+    void triggerStall(PressureResource resource) { mOnStall(resource); }
+
+private:
+    bool mEnabled;
+    std::function<void(PressureResource)> mOnStall;
+};
+
 class ProcPidStatStub : public ProcPidStat {
 public:
     explicit ProcPidStatStub(bool enabled = false) : mEnabled(enabled) {}
@@ -101,13 +155,94 @@ public:
         mCache.pop();
         return entry;
     }
+    void setAppIdFilter(const std::unordered_set<uint32_t>& appIds) override {
+        mAppIdFilter = appIds;
+    }
     bool enabled() override { return mEnabled; }
     std::string dirPath() override { return kProcDirPath; }
     void push(const std::vector<ProcessStats>& entry) { mCache.push(entry); }
+    const std::unordered_set<uint32_t>& appIdFilter() const { return mAppIdFilter; }
 
 private:
     bool mEnabled;
     std::queue<std::vector<ProcessStats>> mCache;
+    std::unordered_set<uint32_t> mAppIdFilter;
+};
+
+// Records the appended record types without writing to the history file on the device.
+class IoPerfHistoryStub : public IoPerfHistory {
+public:
+    Result<void> append(IoPerfHistoryRecordType type, const IoPerfRecord& /*record*/) override {
+        Mutex::Autolock lock(mStubMutex);
+        mAppendedTypes.push_back(type);
+        return {};
+    }
+    Result<void> dump(int /*fd*/) override { return {}; }
+    Result<void> flush() override {
+        Mutex::Autolock lock(mStubMutex);
+        ++mNumFlushes;
+        return {};
+    }
+    std::vector<IoPerfHistoryRecordType> appendedTypes() {
+        Mutex::Autolock lock(mStubMutex);
+        return mAppendedTypes;
+    }
+    int numFlushes() {
+        Mutex::Autolock lock(mStubMutex);
+        return mNumFlushes;
+    }
+
+private:
+    Mutex mStubMutex;
+    std::vector<IoPerfHistoryRecordType> mAppendedTypes;
+    int mNumFlushes = 0;
+};
+
+// Resolves the package names from a fixed mapping instead of the package manager.
+class PackageNameResolverStub : public PackageNameResolver {
+public:
+    explicit PackageNameResolverStub(
+            const std::unordered_map<uint32_t, std::string>& packageNames) :
+          mPackageNames(packageNames) {}
+
+    std::unordered_map<uint32_t, std::string> getPackageNames(
+            const std::unordered_set<uint32_t>& uids) override {
+        std::unordered_map<uint32_t, std::string> packageNames;
+        for (const auto& uid : uids) {
+            if (const auto it = mPackageNames.find(uid); it != mPackageNames.end()) {
+                packageNames[uid] = it->second;
+            }
+        }
+        return packageNames;
+    }
+
+    std::unordered_set<uint32_t> getAppIds(
+            const std::unordered_set<std::string>& packageNames) override {
+        std::unordered_set<uint32_t> appIds;
+        for (const auto& [uid, packageName] : mPackageNames) {
+            if (packageNames.find(packageName) != packageNames.end()) {
+                appIds.insert(multiuser_get_app_id(uid));
+            }
+        }
+        return appIds;
+    }
+
+private:
+    const std::unordered_map<uint32_t, std::string> mPackageNames;
+};
+
+// Reports the boot stage set by the test.
+class BootStageTrackerStub : public BootStageTracker {
+public:
+    void setZygoteRunning() { mIsZygoteRunning = true; }
+
+protected:
+    std::string getProperty(const std::string& name) override {
+        return mIsZygoteRunning && name == "init.svc.zygote" ? "running" : "";
+    }
+
+private:
+    bool mIsZygoteRunning = false;
 };
 
 bool isEqual(const UidIoPerfData& lhs, const UidIoPerfData& rhs) {
@@ -145,7 +280,8 @@ bool isEqual(const ProcessIoPerfData& lhs, const ProcessIoPerfData& rhs) {
     if (lhs.topNIoBlockedUids.size() != rhs.topNIoBlockedUids.size() ||
         lhs.topNMajorFaultUids.size() != rhs.topNMajorFaultUids.size() ||
         lhs.totalMajorFaults != rhs.totalMajorFaults ||
-        lhs.majorFaultsPercentChange != rhs.majorFaultsPercentChange) {
+        lhs.majorFaultsPercentChange != rhs.majorFaultsPercentChange ||
+        lhs.totalCpuTime != rhs.totalCpuTime) {
         return false;
     }
     auto comp = [&](const ProcessIoPerfData::UidStats& l,
@@ -168,7 +304,10 @@ bool isEqual(const ProcessIoPerfData& lhs, const ProcessIoPerfData& rhs) {
                        rhs.topNIoBlockedUidsTotalTaskCnt.begin()) &&
             lhs.topNMajorFaultUids.size() == rhs.topNMajorFaultUids.size() &&
             std::equal(lhs.topNMajorFaultUids.begin(), lhs.topNMajorFaultUids.end(),
-                       rhs.topNMajorFaultUids.begin(), comp);
+                       rhs.topNMajorFaultUids.begin(), comp) &&
+            lhs.topNCpuTimeUids.size() == rhs.topNCpuTimeUids.size() &&
+            std::equal(lhs.topNCpuTimeUids.begin(), lhs.topNCpuTimeUids.end(),
+                       rhs.topNCpuTimeUids.begin(), comp);
 }
 
 bool isEqual(const IoPerfRecord& lhs, const IoPerfRecord& rhs) {
@@ -181,6 +320,7 @@ bool isEqual(const IoPerfRecord& lhs, const IoPerfRecord& rhs) {
 
 TEST(IoPerfCollectionTest, TestCollectionStartAndTerminate) {
     sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
     const auto& ret = collector->start();
     ASSERT_TRUE(ret) << ret.error().message();
     ASSERT_TRUE(collector->mCollectionThread.joinable()) << "Collection thread not created";
@@ -217,10 +357,13 @@ TEST(IoPerfCollectionTest, TestValidCollectionSequence) {
     sp<ProcStatStub> procStatStub = new ProcStatStub(true);
     sp<ProcPidStatStub> procPidStatStub = new ProcPidStatStub(true);
     sp<LooperStub> looperStub = new LooperStub();
+    sp<IoPerfHistoryStub> ioPerfHistoryStub = new IoPerfHistoryStub();
 
     sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = ioPerfHistoryStub;
     collector->mUidIoStats = uidIoStatsStub;
     collector->mProcStat = procStatStub;
+    collector->mProcPressure = new ProcPressureStub();
     collector->mProcPidStat = procPidStatStub;
     collector->mHandlerLooper = looperStub;
 
@@ -229,7 +372,7 @@ TEST(IoPerfCollectionTest, TestValidCollectionSequence) {
 
     collector->mBoottimeCollection.interval = kTestBootInterval;
     collector->mPeriodicCollection.interval = kTestPeriodicInterval;
-    collector->mPeriodicCollection.maxCacheSize = 1;
+    collector->mPeriodicCollection.maxCacheSize = 2;
 
     // #1 Boot-time collection
     uidIoStatsStub->push({{1009, {.uid = 1009, .ios = {0, 20000, 0, 30000, 0, 300}}}});
@@ -416,6 +559,9 @@ TEST(IoPerfCollectionTest, TestValidCollectionSequence) {
             << "Boot-time collection record 3 doesn't match.\nExpected:\n"
             << toString(bootExpectedSecond) << "\nActual:\n"
             << toString(collector->mBoottimeCollection.records[2]);
+    ASSERT_EQ(ioPerfHistoryStub->appendedTypes(),
+              std::vector<IoPerfHistoryRecordType>(3, BOOT_TIME_RECORD))
+            << "Boot-time records not appended to the I/O perf history";
 
     // #4 Periodic collection
     uidIoStatsStub->push({
@@ -547,6 +693,10 @@ TEST(IoPerfCollectionTest, TestValidCollectionSequence) {
             << "Periodic collection snapshot 1, record 2 doesn't match.\nExpected:\n"
             << toString(periodicExpectedSecond) << "\nActual:\n"
             << toString(collector->mPeriodicCollection.records[1]);
+    std::vector<IoPerfHistoryRecordType> expectedHistoryTypes(3, BOOT_TIME_RECORD);
+    expectedHistoryTypes.insert(expectedHistoryTypes.end(), 2, PERIODIC_RECORD);
+    ASSERT_EQ(ioPerfHistoryStub->appendedTypes(), expectedHistoryTypes)
+            << "Periodic records not appended to the I/O perf history";
 
     // #6 Custom collection
     Vector<String16> args;
@@ -698,6 +848,8 @@ TEST(IoPerfCollectionTest, TestValidCollectionSequence) {
 
     // Custom collection cache should be emptied on ending the collection.
     ASSERT_EQ(collector->mCustomCollection.records.size(), 0);
+    ASSERT_EQ(ioPerfHistoryStub->appendedTypes(), expectedHistoryTypes)
+            << "Custom collection records must not be appended to the I/O perf history";
 
     // #7 periodic collection
     uidIoStatsStub->push({
@@ -781,8 +933,10 @@ TEST(IoPerfCollectionTest, TestValidCollectionSequence) {
 
 TEST(IoPerfCollectionTest, TestCollectionTerminatesOnZeroEnabledCollectors) {
     sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
     collector->mUidIoStats = new UidIoStatsStub();
     collector->mProcStat = new ProcStatStub();
+    collector->mProcPressure = new ProcPressureStub();
     collector->mProcPidStat = new ProcPidStatStub();
 
     const auto& ret = collector->start();
@@ -804,8 +958,10 @@ TEST(IoPerfCollectionTest, TestCollectionTerminatesOnZeroEnabledCollectors) {
 
 TEST(IoPerfCollectionTest, TestCollectionTerminatesOnError) {
     sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
     collector->mUidIoStats = new UidIoStatsStub(true);
     collector->mProcStat = new ProcStatStub(true);
+    collector->mProcPressure = new ProcPressureStub();
     collector->mProcPidStat = new ProcPidStatStub(true);
 
     // Stub caches are empty so polling them should trigger error.
@@ -833,10 +989,17 @@ TEST(IoPerfCollectionTest, TestCustomCollectionFiltersPackageNames) {
     sp<LooperStub> looperStub = new LooperStub();
 
     sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
     collector->mUidIoStats = uidIoStatsStub;
     collector->mProcStat = procStatStub;
+    collector->mProcPressure = new ProcPressureStub();
     collector->mProcPidStat = procPidStatStub;
     collector->mHandlerLooper = looperStub;
+    collector->mPackageNameResolver = new PackageNameResolverStub({
+            {1009, "android.car.cts"},
+            {2001, "system_server"},
+            {3456, "random_process"},
+    });
     // Filter by package name should ignore this limit.
     collector->mTopNStatsPerCategory = 1;
 
@@ -873,9 +1036,6 @@ TEST(IoPerfCollectionTest, TestCustomCollectionFiltersPackageNames) {
     ASSERT_TRUE(ret.ok()) << ret.error().message();
 
     // Custom collection
-    collector->mUidToPackageNameMapping[1009] = "android.car.cts";
-    collector->mUidToPackageNameMapping[2001] = "system_server";
-    collector->mUidToPackageNameMapping[3456] = "random_process";
     uidIoStatsStub->push({
             {1009, {.uid = 1009, .ios = {0, 14000, 0, 16000, 0, 100}}},
             {2001, {.uid = 2001, .ios = {0, 3400, 0, 6700, 0, 200}}},
@@ -989,6 +1149,79 @@ TEST(IoPerfCollectionTest, TestCustomCollectionFiltersPackageNames) {
     collector->terminate();
 }
 
+TEST(IoPerfCollectionTest, TestSuspendParksCollection) {
+    sp<UidIoStatsStub> uidIoStatsStub = new UidIoStatsStub(true);
+    sp<ProcStatStub> procStatStub = new ProcStatStub(true);
+    sp<ProcPidStatStub> procPidStatStub = new ProcPidStatStub(true);
+    sp<LooperStub> looperStub = new LooperStub();
+    sp<IoPerfHistoryStub> ioPerfHistoryStub = new IoPerfHistoryStub();
+
+    sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = ioPerfHistoryStub;
+    collector->mUidIoStats = uidIoStatsStub;
+    collector->mProcStat = procStatStub;
+    collector->mProcPressure = new ProcPressureStub();
+    collector->mProcPidStat = procPidStatStub;
+    collector->mHandlerLooper = looperStub;
+
+    auto ret = collector->start();
+    ASSERT_TRUE(ret) << ret.error().message();
+    collector->mPeriodicCollection.interval = kTestPeriodicInterval;
+
+    // Dummy boot-time collection
+    uidIoStatsStub->push({});
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+
+    // Dummy periodic collection
+    ret = collector->onBootFinished();
+    ASSERT_TRUE(ret) << ret.error().message();
+    uidIoStatsStub->push({});
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    const size_t numRecords = collector->mPeriodicCollection.records.size();
+
+    ret = collector->onSuspend();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(ioPerfHistoryStub->numFlushes(), 1) << "History wasn't flushed on suspend";
+    ret = collector->onSuspend();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(ioPerfHistoryStub->numFlushes(), 1) << "History was flushed on a repeated suspend";
+
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(collector->mPeriodicCollection.records.size(), numRecords)
+            << "Periodic collection happened while suspended";
+    Vector<String16> args;
+    args.push_back(String16(kStartCustomCollectionFlag));
+    ASSERT_FALSE(collector->onCustomCollection(-1, args).ok())
+            << "Custom collection started while suspended";
+
+    // Periodic collection resumes immediately instead of waiting for the remaining interval.
+    ret = collector->onResume();
+    ASSERT_TRUE(ret) << ret.error().message();
+    uidIoStatsStub->push({});
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(looperStub->numSecondsElapsed(), 0)
+            << "Periodic collection didn't resume immediately";
+    ASSERT_EQ(collector->mPeriodicCollection.records.size(), numRecords + 1);
+
+    uidIoStatsStub->push({});
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(looperStub->numSecondsElapsed(), kTestPeriodicInterval.count())
+            << "Periodic collection didn't reschedule after resume";
+}
+
 TEST(IoPerfCollectionTest, TestCustomCollectionTerminatesAfterMaxDuration) {
     sp<UidIoStatsStub> uidIoStatsStub = new UidIoStatsStub(true);
     sp<ProcStatStub> procStatStub = new ProcStatStub(true);
@@ -996,8 +1229,10 @@ TEST(IoPerfCollectionTest, TestCustomCollectionTerminatesAfterMaxDuration) {
     sp<LooperStub> looperStub = new LooperStub();
 
     sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
     collector->mUidIoStats = uidIoStatsStub;
     collector->mProcStat = procStatStub;
+    collector->mProcPressure = new ProcPressureStub();
     collector->mProcPidStat = procPidStatStub;
     collector->mHandlerLooper = looperStub;
 
@@ -1063,6 +1298,239 @@ TEST(IoPerfCollectionTest, TestCustomCollectionTerminatesAfterMaxDuration) {
     collector->terminate();
 }
 
+TEST(IoPerfCollectionTest, TestFilteredCustomCollectionSkipsOtherUids) {
+    sp<UidIoStatsStub> uidIoStatsStub = new UidIoStatsStub(true);
+    sp<ProcStatStub> procStatStub = new ProcStatStub(true);
+    sp<ProcPidStatStub> procPidStatStub = new ProcPidStatStub(true);
+    sp<LooperStub> looperStub = new LooperStub();
+
+    sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
+    collector->mUidIoStats = uidIoStatsStub;
+    collector->mProcStat = procStatStub;
+    collector->mProcPressure = new ProcPressureStub();
+    collector->mProcPidStat = procPidStatStub;
+    collector->mHandlerLooper = looperStub;
+    collector->mPackageNameResolver = new PackageNameResolverStub({
+            {10050, "com.example.app"},
+            {1009, "mediaserver"},
+    });
+
+    auto ret = collector->start();
+    ASSERT_TRUE(ret) << ret.error().message();
+
+    // Dummy boot-time collection
+    uidIoStatsStub->push({});
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+
+    // Dummy Periodic collection
+    ret = collector->onBootFinished();
+    ASSERT_TRUE(ret) << ret.error().message();
+    uidIoStatsStub->push({});
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    EXPECT_TRUE(uidIoStatsStub->appIdFilter().empty());
+
+    // Sub-second intervals are allowed only when the filtered packages are resolved.
+    auto customCollectionArgs = [](const char* filterPackages) {
+        Vector<String16> args;
+        args.push_back(String16(kStartCustomCollectionFlag));
+        args.push_back(String16(kIntervalFlag));
+        args.push_back(String16("100ms"));
+        args.push_back(String16(kFilterPackagesFlag));
+        args.push_back(String16(filterPackages));
+        return args;
+    };
+    ret = collector->onCustomCollection(-1, customCollectionArgs("com.example.unknown"));
+    ASSERT_FALSE(ret.ok())
+            << "Custom collection started at 100ms without resolving the filtered packages";
+
+    ret = collector->onCustomCollection(-1, customCollectionArgs("com.example.app"));
+    ASSERT_TRUE(ret.ok()) << ret.error().message();
+    ASSERT_EQ(collector->mCustomCollection.interval, 100ms);
+    EXPECT_THAT(collector->mCustomCollection.filterAppIds, UnorderedElementsAre(10050));
+
+    // Matches all the users of the filtered app ID.
+    uidIoStatsStub->push({
+            {10050, {.uid = 10050, .ios = {0, 100, 0, 200, 0, 1}}},
+            {1010050, {.uid = 1010050, .ios = {0, 300, 0, 400, 0, 1}}},
+            {1009, {.uid = 1009, .ios = {0, 500, 0, 600, 0, 1}}},
+    });
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(collector->mCurrCollectionEvent, CollectionEvent::CUSTOM);
+    EXPECT_THAT(uidIoStatsStub->appIdFilter(), UnorderedElementsAre(10050));
+    EXPECT_THAT(procPidStatStub->appIdFilter(), UnorderedElementsAre(10050));
+    ASSERT_EQ(collector->mCustomCollection.records.size(), 1);
+    const UidIoPerfData& uidIoPerfData = collector->mCustomCollection.records[0].uidIoPerfData;
+    ASSERT_EQ(uidIoPerfData.topNWrites.size(), 2) << toString(uidIoPerfData);
+    EXPECT_EQ(uidIoPerfData.topNWrites[0].userId, 10);
+    EXPECT_EQ(uidIoPerfData.topNWrites[1].packageName, "com.example.app");
+    collector->terminate();
+}
+
+TEST(IoPerfCollectionTest, TestPressureStallStartsCollectionBurst) {
+    sp<UidIoStatsStub> uidIoStatsStub = new UidIoStatsStub(true);
+    sp<ProcStatStub> procStatStub = new ProcStatStub(true);
+    sp<ProcPidStatStub> procPidStatStub = new ProcPidStatStub(true);
+    sp<ProcPressureStub> procPressureStub = new ProcPressureStub(true);
+    sp<LooperStub> looperStub = new LooperStub();
+
+    sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
+    collector->mUidIoStats = uidIoStatsStub;
+    collector->mProcStat = procStatStub;
+    collector->mProcPressure = procPressureStub;
+    collector->mProcPidStat = procPidStatStub;
+    collector->mHandlerLooper = looperStub;
+
+    auto ret = collector->start();
+    ASSERT_TRUE(ret) << ret.error().message();
+    collector->mPeriodicCollection.interval = kTestPeriodicInterval;
+
+    const auto pushEmptyStats = [&]() {
+        uidIoStatsStub->push({});
+        procStatStub->push(ProcStatInfo{});
+        procPidStatStub->push({});
+    };
+
+    // Pressure stalls during the boot-time collection are ignored.
+    pushEmptyStats();
+    procPressureStub->triggerStall(PRESSURE_IO);
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(collector->mCurrCollectionEvent, CollectionEvent::BOOT_TIME);
+
+    ret = collector->onBootFinished();
+    ASSERT_TRUE(ret) << ret.error().message();
+    pushEmptyStats();
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(collector->mCurrCollectionEvent, CollectionEvent::PERIODIC);
+
+    procPressureStub->triggerStall(PRESSURE_IO);
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+
+    // The burst collects immediately and then every second until the burst duration elapses.
+    for (int i = 0; i <= 10; ++i) {
+        pushEmptyStats();
+        ret = looperStub->pollCache();
+        ASSERT_TRUE(ret) << ret.error().message();
+        ASSERT_EQ(looperStub->numSecondsElapsed(), i == 0 ? 0 : 1)
+                << "Burst collection didn't happen at 1 second interval in iteration " << i;
+    }
+
+    pushEmptyStats();
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(looperStub->numSecondsElapsed(), kTestPeriodicInterval.count())
+            << "Periodic collection interval wasn't restored after the burst";
+    collector->terminate();
+}
+
+TEST(IoPerfCollectionTest, TestBootFinishedBeforeStart) {
+    sp<UidIoStatsStub> uidIoStatsStub = new UidIoStatsStub(true);
+    sp<ProcStatStub> procStatStub = new ProcStatStub(true);
+    sp<ProcPidStatStub> procPidStatStub = new ProcPidStatStub(true);
+    sp<LooperStub> looperStub = new LooperStub();
+
+    sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
+    collector->mUidIoStats = uidIoStatsStub;
+    collector->mProcStat = procStatStub;
+    collector->mProcPressure = new ProcPressureStub(false);
+    collector->mProcPidStat = procPidStatStub;
+    collector->mHandlerLooper = looperStub;
+
+    auto ret = collector->onBootFinished();
+    ASSERT_TRUE(ret) << ret.error().message();
+
+    ret = collector->start();
+    ASSERT_TRUE(ret) << ret.error().message();
+    collector->mPeriodicCollection.interval = kTestPeriodicInterval;
+
+    uidIoStatsStub->push({});
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(collector->mCurrCollectionEvent, CollectionEvent::PERIODIC)
+            << "Boot-time collection didn't end after its first collection";
+    ASSERT_EQ(collector->mBoottimeCollection.records.size(), 1u);
+    collector->terminate();
+}
+
+TEST(IoPerfCollectionTest, TestAdaptivePeriodicCollectionInterval) {
+    sp<UidIoStatsStub> uidIoStatsStub = new UidIoStatsStub(true);
+    sp<ProcStatStub> procStatStub = new ProcStatStub(true);
+    sp<ProcPidStatStub> procPidStatStub = new ProcPidStatStub(true);
+    sp<LooperStub> looperStub = new LooperStub();
+
+    sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
+    collector->mUidIoStats = uidIoStatsStub;
+    collector->mProcStat = procStatStub;
+    collector->mProcPressure = new ProcPressureStub(false);
+    collector->mProcPidStat = procPidStatStub;
+    collector->mHandlerLooper = looperStub;
+
+    auto ret = collector->start();
+    ASSERT_TRUE(ret) << ret.error().message();
+    collector->mPeriodicCollection.interval = kTestPeriodicInterval;
+    collector->mAdaptiveInterval = std::make_unique<AdaptiveInterval>(AdaptiveIntervalConfig{
+            .minInterval = 1s,
+            .defaultInterval = kTestPeriodicInterval,
+            .idleInterval = 4 * kTestPeriodicInterval,
+            .ioWaitPercentThreshold = 5,
+            .majorFaultsPerSecondThreshold = 1000,
+            .writeBytesPerSecondThreshold = 1024,
+    });
+
+    const auto pushStats = [&](const ProcStatInfo& procStatInfo) {
+        uidIoStatsStub->push({});
+        procStatStub->push(procStatInfo);
+        procPidStatStub->push({});
+    };
+
+    pushStats(ProcStatInfo{});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ret = collector->onBootFinished();
+    ASSERT_TRUE(ret) << ret.error().message();
+    pushStats(ProcStatInfo{});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(collector->mCurrCollectionEvent, CollectionEvent::PERIODIC);
+
+    // The interval backs off while idle, tightens to the minimum interval on the I/O wait storm
+    // and then backs off again.
+    const ProcStatInfo ioWaitStorm{
+            /*stats=*/{100, 0, 100, 100, /*ioWaitTime=*/900, 0, 0, 0, 0, 0},
+            /*runnableCnt=*/1,
+            /*ioBlockedCnt=*/5,
+    };
+    const std::vector<std::pair<ProcStatInfo, int>> collections = {
+            {ProcStatInfo{}, 2}, {ProcStatInfo{}, 4}, {ioWaitStorm, 8},
+            {ProcStatInfo{}, 1}, {ProcStatInfo{}, 2},
+    };
+    for (size_t i = 0; i < collections.size(); ++i) {
+        pushStats(collections[i].first);
+        ret = looperStub->pollCache();
+        ASSERT_TRUE(ret) << ret.error().message();
+        ASSERT_EQ(looperStub->numSecondsElapsed(), collections[i].second)
+                << "Unexpected adaptive collection interval in iteration " << i;
+    }
+    collector->terminate();
+}
+
 TEST(IoPerfCollectionTest, TestValidUidIoStatFile) {
     // Format: uid fgRdChar fgWrChar fgRdBytes fgWrBytes bgRdChar bgWrChar bgRdBytes bgWrBytes
     // fgFsync bgFsync
@@ -1118,7 +1586,7 @@ TEST(IoPerfCollectionTest, TestValidUidIoStatFile) {
     ASSERT_TRUE(collector.mUidIoStats->enabled()) << "Temporary file is inaccessible";
 
     struct UidIoPerfData actualUidIoPerfData = {};
-    auto ret = collector.collectUidIoPerfDataLocked(CollectionInfo{}, &actualUidIoPerfData);
+    auto ret = collector.collectUidIoPerfData(CollectionInfo{}, &actualUidIoPerfData);
     ASSERT_RESULT_OK(ret);
     EXPECT_TRUE(isEqual(expectedUidIoPerfData, actualUidIoPerfData))
         << "First snapshot doesn't match.\nExpected:\n"
@@ -1168,7 +1636,7 @@ TEST(IoPerfCollectionTest, TestValidUidIoStatFile) {
     });
     ASSERT_TRUE(WriteStringToFile(secondSnapshot, tf.path));
     actualUidIoPerfData = {};
-    ret = collector.collectUidIoPerfDataLocked(CollectionInfo{}, &actualUidIoPerfData);
+    ret = collector.collectUidIoPerfData(CollectionInfo{}, &actualUidIoPerfData);
     ASSERT_RESULT_OK(ret);
     EXPECT_TRUE(isEqual(expectedUidIoPerfData, actualUidIoPerfData))
         << "Second snapshot doesn't match.\nExpected:\n"
@@ -1213,7 +1681,7 @@ TEST(IoPerfCollectionTest, TestUidIOStatsLessThanTopNStatsLimit) {
     ASSERT_TRUE(collector.mUidIoStats->enabled()) << "Temporary file is inaccessible";
 
     struct UidIoPerfData actualUidIoPerfData = {};
-    const auto& ret = collector.collectUidIoPerfDataLocked(CollectionInfo{}, &actualUidIoPerfData);
+    const auto& ret = collector.collectUidIoPerfData(CollectionInfo{}, &actualUidIoPerfData);
     ASSERT_RESULT_OK(ret);
     EXPECT_TRUE(isEqual(expectedUidIoPerfData, actualUidIoPerfData))
         << "Collected data doesn't match.\nExpected:\n"
@@ -1254,7 +1722,7 @@ TEST(IoPerfCollectionTest, TestValidProcStatFile) {
     ASSERT_TRUE(collector.mProcStat->enabled()) << "Temporary file is inaccessible";
 
     struct SystemIoPerfData actualSystemIoPerfData = {};
-    auto ret = collector.collectSystemIoPerfDataLocked(&actualSystemIoPerfData);
+    auto ret = collector.collectSystemIoPerfData(&actualSystemIoPerfData);
     ASSERT_RESULT_OK(ret);
     EXPECT_TRUE(isEqual(expectedSystemIoPerfData, actualSystemIoPerfData))
             << "First snapshot doesn't match.\nExpected:\n"
@@ -1284,7 +1752,7 @@ TEST(IoPerfCollectionTest, TestValidProcStatFile) {
 
     ASSERT_TRUE(WriteStringToFile(secondSnapshot, tf.path));
     actualSystemIoPerfData = {};
-    ret = collector.collectSystemIoPerfDataLocked(&actualSystemIoPerfData);
+    ret = collector.collectSystemIoPerfData(&actualSystemIoPerfData);
     ASSERT_RESULT_OK(ret);
     EXPECT_TRUE(isEqual(expectedSystemIoPerfData, actualSystemIoPerfData))
             << "Second snapshot doesn't match.\nExpected:\n"
@@ -1375,7 +1843,7 @@ TEST(IoPerfCollectionTest, TestValidProcPidContents) {
             << "Files under the temporary proc directory are inaccessible";
 
     struct ProcessIoPerfData actualProcessIoPerfData = {};
-    ret = collector.collectProcessIoPerfDataLocked(CollectionInfo{}, &actualProcessIoPerfData);
+    ret = collector.collectProcessIoPerfData(CollectionInfo{}, &actualProcessIoPerfData);
     ASSERT_TRUE(ret) << "Failed to collect first snapshot: " << ret.error();
     EXPECT_TRUE(isEqual(expectedProcessIoPerfData, actualProcessIoPerfData))
             << "First snapshot doesn't match.\nExpected:\n"
@@ -1435,7 +1903,7 @@ TEST(IoPerfCollectionTest, TestValidProcPidContents) {
     collector.mProcPidStat->mPath = secondSnapshot.path;
 
     actualProcessIoPerfData = {};
-    ret = collector.collectProcessIoPerfDataLocked(CollectionInfo{}, &actualProcessIoPerfData);
+    ret = collector.collectProcessIoPerfData(CollectionInfo{}, &actualProcessIoPerfData);
     ASSERT_TRUE(ret) << "Failed to collect second snapshot: " << ret.error();
     EXPECT_TRUE(isEqual(expectedProcessIoPerfData, actualProcessIoPerfData))
             << "Second snapshot doesn't match.\nExpected:\n"
@@ -1443,6 +1911,67 @@ TEST(IoPerfCollectionTest, TestValidProcPidContents) {
             << toString(actualProcessIoPerfData);
 }
 
+TEST(IoPerfCollectionTest, TestTopNCpuTimeUids) {
+    std::unordered_map<uint32_t, std::vector<uint32_t>> pidToTids = {
+            {1, {1, 453}},
+            {18902, {18902, 21345}},
+            {28900, {28900}},
+    };
+    std::unordered_map<uint32_t, std::string> perProcessStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 0 0 30 20 0 0 0 0 2 0 0\n"},
+            {18902, "18902 (disk I/O) S 1 0 0 0 0 0 0 0 0 0 400 200 0 0 0 0 2 0 897654\n"},
+            {28900, "28900 (tombstoned) S 1 0 0 0 0 0 0 0 0 0 250 50 0 0 0 0 1 0 2345671\n"},
+    };
+    std::unordered_map<uint32_t, std::string> perProcessStatus = {
+            {1, "Pid:\t1\nTgid:\t1\nUid:\t0\t0\t0\t0\n"},
+            {18902, "Pid:\t18902\nTgid:\t18902\nUid:\t1009\t1009\t1009\t1009\n"},
+            {28900, "Pid:\t28900\nTgid:\t28900\nUid:\t1001234\t1001234\t1001234\t1001234\n"},
+    };
+    std::unordered_map<uint32_t, std::string> perThreadStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 0 0 30 20 0 0 0 0 2 0 0\n"},
+            {453, "453 (init) S 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 2 0 275\n"},
+            {18902, "18902 (disk I/O) S 1 0 0 0 0 0 0 0 0 0 100 50 0 0 0 0 2 0 897654\n"},
+            {21345, "21345 (disk I/O) S 1 0 0 0 0 0 0 0 0 0 300 150 0 0 0 0 2 0 904000\n"},
+            {28900, "28900 (tombstoned) S 1 0 0 0 0 0 0 0 0 0 250 50 0 0 0 0 1 0 2345671\n"},
+    };
+    struct ProcessIoPerfData expectedProcessIoPerfData = {};
+    expectedProcessIoPerfData.topNCpuTimeUids.push_back({
+            // uid: 1009
+            .userId = 0,
+            .packageName = "mount",
+            .count = 600,
+            .topNProcesses = {{"disk I/O", 600}},
+    });
+    expectedProcessIoPerfData.topNCpuTimeUids.push_back({
+            // uid: 1001234
+            .userId = 10,
+            .packageName = "1001234",
+            .count = 300,
+            .topNProcesses = {{"tombstoned", 300}},
+    });
+    expectedProcessIoPerfData.totalCpuTime = 950;
+
+    TemporaryDir procDir;
+    auto ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                                  perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+
+    IoPerfCollection collector;
+    collector.mProcPidStat = new ProcPidStat(procDir.path);
+    collector.mTopNStatsPerCategory = 2;
+    collector.mTopNStatsPerSubcategory = 2;
+    ASSERT_TRUE(collector.mProcPidStat->enabled())
+            << "Files under the temporary proc directory are inaccessible";
+
+    struct ProcessIoPerfData actualProcessIoPerfData = {};
+    ret = collector.collectProcessIoPerfData(CollectionInfo{}, &actualProcessIoPerfData);
+    ASSERT_TRUE(ret) << "Failed to collect proc pid contents: " << ret.error();
+    EXPECT_TRUE(isEqual(expectedProcessIoPerfData, actualProcessIoPerfData))
+            << "Collected data doesn't match.\nExpected:\n"
+            << toString(expectedProcessIoPerfData) << "\nActual:\n"
+            << toString(actualProcessIoPerfData);
+}
+
 TEST(IoPerfCollectionTest, TestProcPidContentsLessThanTopNStatsLimit) {
     std::unordered_map<uint32_t, std::vector<uint32_t>> pidToTids = {
             {1, {1, 453}},
@@ -1478,7 +2007,7 @@ TEST(IoPerfCollectionTest, TestProcPidContentsLessThanTopNStatsLimit) {
     collector.mTopNStatsPerSubcategory = 3;
     collector.mProcPidStat = new ProcPidStat(prodDir.path);
     struct ProcessIoPerfData actualProcessIoPerfData = {};
-    ret = collector.collectProcessIoPerfDataLocked(CollectionInfo{}, &actualProcessIoPerfData);
+    ret = collector.collectProcessIoPerfData(CollectionInfo{}, &actualProcessIoPerfData);
     ASSERT_TRUE(ret) << "Failed to collect proc pid contents: " << ret.error();
     EXPECT_TRUE(isEqual(expectedProcessIoPerfData, actualProcessIoPerfData))
             << "proc pid contents don't match.\nExpected:\n"
@@ -1486,8 +2015,326 @@ TEST(IoPerfCollectionTest, TestProcPidContentsLessThanTopNStatsLimit) {
             << toString(actualProcessIoPerfData);
 }
 
+TEST(IoPerfCollectionTest, TestTaskIoPerfDataOfTopNWriteUids) {
+    std::unordered_map<uint32_t, std::vector<uint32_t>> pidToTids = {
+            {1, {1}},
+            {2546, {2546, 3456, 4789}},
+            {7890, {7890}},
+            {18902, {18902}},
+    };
+    std::unordered_map<uint32_t, std::string> perProcessStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1 0 0\n"},
+            {2546, "2546 (system_server) S 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 3 0 1000\n"},
+            {7890, "7890 (logd) S 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1 0 2345\n"},
+            {18902, "18902 (disk I/O) S 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1 0 897654\n"},
+    };
+    std::unordered_map<uint32_t, std::string> perProcessStatus = {
+            {1, "Pid:\t1\nTgid:\t1\nUid:\t0\t0\t0\t0\n"},
+            {2546, "Pid:\t2546\nTgid:\t2546\nUid:\t1001000\t1001000\t1001000\t1001000\n"},
+            {7890, "Pid:\t7890\nTgid:\t7890\nUid:\t1001036\t1001036\t1001036\t1001036\n"},
+            {18902, "Pid:\t18902\nTgid:\t18902\nUid:\t1009\t1009\t1009\t1009\n"},
+    };
+    std::unordered_map<uint32_t, std::string> perThreadStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1 0 0\n"},
+            {2546, "2546 (system_server) S 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 3 0 1000\n"},
+            {3456, "3456 (binder:2546_1) S 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 3 0 2300\n"},
+            {4789, "4789 (PackageManager) D 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 3 0 4500\n"},
+            {7890, "7890 (logd) S 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1 0 2345\n"},
+            {18902, "18902 (disk I/O) S 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1 0 897654\n"},
+    };
+    TemporaryDir procDir;
+    auto ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                                  perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+    // Sets the cumulative write bytes of the processes and threads. Unlisted tasks wrote no bytes.
+    auto writeIoFiles = [&](const std::unordered_map<uint32_t, uint64_t>& processWriteBytes,
+                            const std::unordered_map<uint32_t, uint64_t>& threadWriteBytes) {
+        auto contents = [](const std::unordered_map<uint32_t, uint64_t>& writeBytes,
+                           uint32_t id) {
+            const auto it = writeBytes.find(id);
+            return StringPrintf("read_bytes: 0\nwrite_bytes: %" PRIu64 "\n",
+                                it == writeBytes.end() ? 0 : it->second);
+        };
+        for (const auto& [pid, tids] : pidToTids) {
+            ASSERT_TRUE(WriteStringToFile(contents(processWriteBytes, pid),
+                                          StringPrintf("%s/%" PRIu32 "/io", procDir.path, pid)));
+            for (const auto tid : tids) {
+                ASSERT_TRUE(WriteStringToFile(contents(threadWriteBytes, tid),
+                                              StringPrintf("%s/%" PRIu32 "/task/%" PRIu32 "/io",
+                                                           procDir.path, pid, tid)));
+            }
+        }
+    };
+    TemporaryFile uidIoStatsFile;
+    // Format: uid fgRdChar fgWrChar fgRdBytes fgWrBytes bgRdChar bgWrChar bgRdBytes bgWrBytes
+    // fgFsync bgFsync
+    ASSERT_TRUE(WriteStringToFile("1001000 0 0 0 5000 0 0 0 0 0 0\n"
+                                  "1001036 0 0 0 3000 0 0 0 0 0 0\n"
+                                  "1009 0 0 0 1000 0 0 0 0 0 0\n",
+                                  uidIoStatsFile.path));
+    writeIoFiles({}, {});
+
+    IoPerfCollection collector;
+    collector.mTopNStatsPerCategory = 2;
+    collector.mTopNStatsPerSubcategory = 1;
+    collector.mIsTaskIoCollectionEnabled = true;
+    collector.mUidIoStats = new UidIoStats(uidIoStatsFile.path);
+    collector.mProcStat = new ProcStatStub(false);
+    collector.mProcPidStat = new ProcPidStat(procDir.path);
+    collector.mProcPressure = new ProcPressureStub(false);
+    collector.mProcPidIo = new ProcPidIo(procDir.path);
+    collector.mPackageNameResolver =
+            new PackageNameResolverStub({{1001000, "shared:android.uid.system"}});
+    ASSERT_TRUE(collector.mProcPidIo->enabled()) << "Io files are inaccessible";
+
+    IoPerfRecord record = {};
+    ret = collector.collect(CollectionInfo{}, &record);
+    ASSERT_TRUE(ret) << "Failed to collect the first record: " << ret.error();
+    EXPECT_TRUE(record.taskIoPerfData.topNWriteProcesses.empty())
+            << "First collection reported lifetime I/O:\n"
+            << toString(record.taskIoPerfData);
+
+    ASSERT_TRUE(WriteStringToFile("1001000 0 0 0 10000 0 0 0 0 0 0\n"
+                                  "1001036 0 0 0 6000 0 0 0 0 0 0\n"
+                                  "1009 0 0 0 2000 0 0 0 0 0 0\n",
+                                  uidIoStatsFile.path));
+    // The process I/O of system_server includes the I/O of its terminated threads.
+    writeIoFiles({{2546, 6000}, {7890, 3000}, {18902, 9000}},
+                 {{2546, 500}, {3456, 1000}, {4789, 4000}, {7890, 3000}, {18902, 9000}});
+    record = {};
+    ret = collector.collect(CollectionInfo{}, &record);
+    ASSERT_TRUE(ret) << "Failed to collect the second record: " << ret.error();
+
+    const auto& processes = record.taskIoPerfData.topNWriteProcesses;
+    ASSERT_EQ(processes.size(), 2) << toString(record.taskIoPerfData);
+    EXPECT_EQ(processes[0].userId, 10);
+    EXPECT_EQ(processes[0].packageName, "shared:android.uid.system");
+    EXPECT_EQ(processes[0].pid, 2546);
+    EXPECT_EQ(processes[0].comm, "system_server");
+    EXPECT_EQ(processes[0].writeBytes, 6000);
+    ASSERT_EQ(processes[0].topNWriteThreads.size(), 1);
+    EXPECT_EQ(processes[0].topNWriteThreads[0].tid, 4789);
+    EXPECT_EQ(processes[0].topNWriteThreads[0].comm, "PackageManager");
+    EXPECT_EQ(processes[0].topNWriteThreads[0].writeBytes, 4000);
+    EXPECT_EQ(processes[1].packageName, "1001036");
+    EXPECT_EQ(processes[1].comm, "logd");
+    EXPECT_EQ(processes[1].writeBytes, 3000);
+    // "disk I/O" wrote the most bytes but its UID is not in the top N writing UIDs.
+}
+
+TEST(IoPerfCollectionTest, TestMemoryBudgetDropsRecordDetails) {
+    IoPerfRecord detailedRecord = {};
+    detailedRecord.uidIoPerfData.topNWrites.push_back({.userId = 10, .packageName = "app"});
+    detailedRecord.uidIoPerfData.total[WRITE_BYTES][FOREGROUND] = 1000;
+    detailedRecord.processIoPerfData.topNMajorFaultUids.push_back({
+            .userId = 10,
+            .packageName = "app",
+            .count = 100,
+            .topNProcesses = {{"app", 100}},
+    });
+    detailedRecord.processIoPerfData.totalMajorFaults = 100;
+    detailedRecord.taskIoPerfData.topNWriteProcesses.push_back({
+            .pid = 1000,
+            .comm = "app",
+            .writeBytes = 1000,
+            .topNWriteThreads = {{.tid = 1001, .comm = "worker", .writeBytes = 1000}},
+    });
+
+    TemporaryFile statm;
+    const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    ASSERT_TRUE(WriteStringToFile("4000 1 300 10 0 900 0\n", statm.path));
+    IoPerfCollection collector;
+    collector.mMemoryBudget =
+            std::make_unique<MemoryBudget>(MemoryBudgetConfig{.rssLimitBytes = 100 * pageSize,
+                                                              .cacheSize = 8},
+                                           statm.path);
+    collector.mPeriodicCollection.interval = kTestPeriodicInterval;
+    collector.mPeriodicCollection.maxCacheSize = 8;
+    IoPerfRecord cachedRecord = detailedRecord;
+    collector.mPeriodicCollection.records.push(&cachedRecord, 8);
+
+    // The memory PSI trigger drops the sub-category details.
+    collector.onPressureStall(PRESSURE_MEMORY);
+    collector.mStagingRecord = detailedRecord;
+    EXPECT_EQ(collector.applyMemoryBudgetLocked(&collector.mPeriodicCollection), 4);
+    const IoPerfRecord& staging = collector.mStagingRecord;
+    EXPECT_EQ(staging.uidIoPerfData.topNWrites.size(), 1);
+    ASSERT_EQ(staging.processIoPerfData.topNMajorFaultUids.size(), 1);
+    EXPECT_TRUE(staging.processIoPerfData.topNMajorFaultUids[0].topNProcesses.empty());
+    ASSERT_EQ(staging.taskIoPerfData.topNWriteProcesses.size(), 1);
+    EXPECT_TRUE(staging.taskIoPerfData.topNWriteProcesses[0].topNWriteThreads.empty());
+    const IoPerfRecord& cached = collector.mPeriodicCollection.records[0];
+    ASSERT_EQ(cached.processIoPerfData.topNMajorFaultUids.size(), 1);
+    EXPECT_TRUE(cached.processIoPerfData.topNMajorFaultUids[0].topNProcesses.empty())
+            << "Cached record was not trimmed";
+
+    // Reaching the RSS limit keeps only the counters.
+    ASSERT_TRUE(WriteStringToFile("4000 100 300 10 0 900 0\n", statm.path));
+    collector.mStagingRecord = detailedRecord;
+    EXPECT_EQ(collector.applyMemoryBudgetLocked(&collector.mPeriodicCollection), 2);
+    EXPECT_TRUE(staging.uidIoPerfData.topNWrites.empty());
+    EXPECT_TRUE(staging.processIoPerfData.topNMajorFaultUids.empty());
+    EXPECT_TRUE(staging.taskIoPerfData.topNWriteProcesses.empty());
+    EXPECT_EQ(staging.uidIoPerfData.total[WRITE_BYTES][FOREGROUND], 1000);
+    EXPECT_EQ(staging.processIoPerfData.totalMajorFaults, 100);
+    EXPECT_TRUE(cached.uidIoPerfData.topNWrites.empty()) << "Cached record was not trimmed";
+}
+
+TEST(IoPerfCollectionTest, TestBootTimelineTrace) {
+    sp<UidIoStatsStub> uidIoStatsStub = new UidIoStatsStub(true);
+    sp<ProcStatStub> procStatStub = new ProcStatStub(true);
+    sp<ProcPidStatStub> procPidStatStub = new ProcPidStatStub(true);
+    sp<BootStageTrackerStub> bootStageTrackerStub = new BootStageTrackerStub();
+    sp<LooperStub> looperStub = new LooperStub();
+
+    sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
+    collector->mUidIoStats = uidIoStatsStub;
+    collector->mProcStat = procStatStub;
+    collector->mProcPressure = new ProcPressureStub();
+    collector->mProcPidStat = procPidStatStub;
+    collector->mHandlerLooper = looperStub;
+    collector->mPackageNameResolver = new PackageNameResolverStub({
+            {1009, "android.car.cts"},
+            {1012345, "com.example.app"},
+    });
+    collector->mBootStageTracker = bootStageTrackerStub;
+
+    auto ret = collector->start();
+    ASSERT_TRUE(ret) << ret.error().message();
+    uidIoStatsStub->push({
+            {1009, {.uid = 1009, .ios = {0, 14000, 0, 16000, 0, 100}}},
+    });
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+
+    bootStageTrackerStub->setZygoteRunning();
+    uidIoStatsStub->push({
+            {1012345, {.uid = 1012345, .ios = {100, 0, 200, 0, 0, 0}}},
+    });
+    procStatStub->push(ProcStatInfo{});
+    procPidStatStub->push({});
+    ret = looperStub->pollCache();
+    ASSERT_TRUE(ret) << ret.error().message();
+    ASSERT_EQ(collector->mBoottimeCollection.records.size(), 2);
+
+    TemporaryFile dump;
+    ret = collector->onDumpBootTimeline(dump.fd);
+    ASSERT_TRUE(ret) << ret.error().message();
+    std::string trace;
+    ASSERT_TRUE(ReadFileToString(dump.path, &trace));
+    EXPECT_THAT(trace, StartsWith("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    EXPECT_THAT(trace, HasSubstr("{\"name\":\"init\",\"ph\":\"i\",\"s\":\"g\",\"ts\":0,"));
+    EXPECT_THAT(trace,
+                HasSubstr("{\"name\":\"zygote\",\"ph\":\"i\",\"s\":\"g\",\"ts\":1000000,"));
+    EXPECT_THAT(trace,
+                HasSubstr("{\"name\":\"android.car.cts\",\"ph\":\"C\",\"ts\":0,\"pid\":0,"
+                          "\"args\":{\"read_bytes\":14000,\"write_bytes\":16000}}"));
+    EXPECT_THAT(trace,
+                HasSubstr("{\"name\":\"android.car.cts\",\"ph\":\"C\",\"ts\":1000000,\"pid\":0,"
+                          "\"args\":{\"read_bytes\":0,\"write_bytes\":0}}"))
+            << "UID that dropped out of the top N was not sampled as zero";
+    EXPECT_THAT(trace,
+                HasSubstr("{\"name\":\"com.example.app (user 10)\",\"ph\":\"C\",\"ts\":1000000,"
+                          "\"pid\":0,\"args\":{\"read_bytes\":100,\"write_bytes\":200}}"));
+    EXPECT_THAT(trace, EndsWith("]}\n"));
+    collector->terminate();
+}
+
+TEST(IoPerfCollectionTest, TestWriteBudgetViolations) {
+    sp<UidIoStatsStub> uidIoStatsStub = new UidIoStatsStub(true);
+    TemporaryDir budgetDir;
+    IoPerfCollection collector;
+    collector.mUidIoStats = uidIoStatsStub;
+    collector.mTopNStatsPerCategory = 1;
+    collector.mPackageNameResolver = new PackageNameResolverStub({
+            {1009, "mount"},
+            {1012345, "com.example.app"},
+    });
+    collector.mWriteBudgetTracker =
+            new WriteBudgetTracker(/*defaultBudgetBytes=*/1000, {{"mount", 100000}},
+                                   StringPrintf("%s/write_budget", budgetDir.path));
+    std::vector<WriteBudgetViolation> violations;
+    collector.setWriteBudgetCallback([&](const std::vector<WriteBudgetViolation>& reported) {
+        violations.insert(violations.end(), reported.begin(), reported.end());
+    });
+
+    uidIoStatsStub->push({
+            {1009, {.uid = 1009, .ios = {0, 0, 0, 50000, 0, 0}}},
+            {1012345, {.uid = 1012345, .ios = {0, 0, 600, 0, 0, 0}}},
+    });
+    UidIoPerfData uidIoPerfData = {};
+    ASSERT_RESULT_OK(collector.collectUidIoPerfData(CollectionInfo{}, &uidIoPerfData));
+    EXPECT_TRUE(violations.empty());
+
+    uidIoStatsStub->push({
+            {1009, {.uid = 1009, .ios = {0, 0, 0, 50000, 0, 0}}},
+            {1012345, {.uid = 1012345, .ios = {0, 0, 600, 0, 0, 0}}},
+    });
+    uidIoPerfData = {};
+    ASSERT_RESULT_OK(collector.collectUidIoPerfData(CollectionInfo{}, &uidIoPerfData));
+    ASSERT_EQ(violations.size(), 1)
+            << "UID outside the top N writes was not checked against its budget";
+    EXPECT_EQ(violations[0].uid, 1012345);
+    EXPECT_EQ(violations[0].packageName, "com.example.app");
+    EXPECT_EQ(violations[0].writtenBytes, 1200);
+    EXPECT_EQ(violations[0].budgetBytes, 1000);
+}
+
+TEST(IoPerfCollectionTest, TestReplaysProcSnapshots) {
+    // Format: uid fgRdChar fgWrChar fgRdBytes fgWrBytes bgRdChar bgWrChar bgRdBytes bgWrBytes
+    // fgFsync bgFsync
+    const std::vector<std::pair<std::string, std::string>> snapshots = {
+            {"1009 0 0 0 0 40000 50000 20000 30000 0 300\n",
+             "cpu  6200 5700 1700 3100 1100 5200 3900 0 0 0\nprocs_running 17\n"
+             "procs_blocked 5\n"},
+            {"1009 0 0 0 0 40000 50000 25000 38000 0 310\n",
+             "cpu  6300 5700 1700 3100 1500 5200 3900 0 0 0\nprocs_running 10\n"
+             "procs_blocked 2\n"},
+    };
+    TemporaryDir recording;
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        const std::string snapshotPath = StringPrintf("%s/%zu", recording.path, i);
+        ASSERT_EQ(mkdir(snapshotPath.c_str(), 0700), 0);
+        ASSERT_EQ(mkdir((snapshotPath + "/uid_io").c_str(), 0700), 0);
+        ASSERT_TRUE(WriteStringToFile(snapshots[i].first, snapshotPath + "/uid_io/stats"));
+        ASSERT_TRUE(WriteStringToFile(snapshots[i].second, snapshotPath + "/stat"));
+    }
+    ProcSnapshotReplay replay(recording.path);
+    ASSERT_RESULT_OK(replay.result());
+    ASSERT_EQ(replay.size(), 2);
+
+    IoPerfCollection collector;
+    collector.mUidIoStats = new UidIoStats(replay.uidIoStatsPath());
+    collector.mProcStat = new ProcStat(replay.procStatPath());
+    collector.mTopNStatsPerCategory = 1;
+    collector.mPackageNameResolver = new PackageNameResolverStub({{1009, "mount"}});
+
+    UidIoPerfData uidIoPerfData = {};
+    SystemIoPerfData systemIoPerfData = {};
+    ASSERT_RESULT_OK(collector.collectUidIoPerfData(CollectionInfo{}, &uidIoPerfData));
+    ASSERT_RESULT_OK(collector.collectSystemIoPerfData(&systemIoPerfData));
+    EXPECT_EQ(uidIoPerfData.total[WRITE_BYTES][BACKGROUND], 30000);
+
+    ASSERT_TRUE(replay.next());
+    uidIoPerfData = {};
+    systemIoPerfData = {};
+    ASSERT_RESULT_OK(collector.collectUidIoPerfData(CollectionInfo{}, &uidIoPerfData));
+    ASSERT_RESULT_OK(collector.collectSystemIoPerfData(&systemIoPerfData));
+    EXPECT_EQ(uidIoPerfData.total[WRITE_BYTES][BACKGROUND], 8000)
+            << "Second snapshot was not diffed with the first";
+    ASSERT_EQ(uidIoPerfData.topNWrites.size(), 1);
+    EXPECT_EQ(uidIoPerfData.topNWrites[0].packageName, "mount");
+    EXPECT_EQ(systemIoPerfData.cpuIoWaitTime, 400);
+    EXPECT_EQ(systemIoPerfData.ioBlockedProcessesCnt, 2);
+    EXPECT_FALSE(replay.next()) << "Replay didn't stop after the last snapshot";
+}
+
 TEST(IoPerfCollectionTest, TestHandlesInvalidDumpArguments) {
     sp<IoPerfCollection> collector = new IoPerfCollection();
+    collector->mIoPerfHistory = new IoPerfHistoryStub();
     collector->start();
     Vector<String16> args;
     args.push_back(String16(kStartCustomCollectionFlag));
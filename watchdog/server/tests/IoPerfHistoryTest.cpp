@@ -0,0 +1,187 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IoPerfHistory.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+#include <string>
+
+#include "IoPerfCollection.h"
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::ReadFileToString;
+using android::base::StringPrintf;
+
+namespace {
+
+IoPerfRecord sampleRecord(time_t time) {
+    return IoPerfRecord{
+            .time = time,
+            .uidIoPerfData = {.topNReads = {{.userId = 0,
+                                             .packageName = "mount",
+                                             .bytes = {0, 20000},
+                                             .fsync{0, 300}}},
+                              .topNWrites = {{.userId = 10,
+                                              .packageName = "shared:android.uid.system",
+                                              .bytes = {1000, 100},
+                                              .fsync{50, 10}}},
+                              .total = {{0, 20000}, {1000, 100}, {50, 310}}},
+            .systemIoPerfData = {.cpuIoWaitTime = 1100,
+                                 .totalCpuTime = 26900,
+                                 .ioBlockedProcessesCnt = 5,
+                                 .totalProcessesCnt = 22},
+            .processIoPerfData = {.topNIoBlockedUids = {{0, "mount", 1, {{"disk I/O", 1}}}},
+                                  .topNIoBlockedUidsTotalTaskCnt = {1},
+                                  .topNMajorFaultUids = {{0, "mount", 5000, {{"disk I/O", 5000}}}},
+                                  .totalMajorFaults = 5000},
+            .pressurePerfData = {.stallTime = {{100, 0}, {2000, 1500}, {300, 200}}},
+    };
+}
+
+std::string fileHeader() {
+    return std::string(kIoPerfHistoryMagic) + static_cast<char>(kIoPerfHistoryVersion);
+}
+
+// Returns the payload of the record starting at |pos| and advances |pos| to the next record.
+// Record payloads in these tests are always smaller than 128 bytes.
+std::string nextPayload(const std::string& contents, size_t* pos) {
+    if (*pos >= contents.size()) {
+        return "";
+    }
+    size_t size = static_cast<uint8_t>(contents[*pos]);
+    std::string payload = contents.substr(*pos + 1, size);
+    *pos += 1 + size;
+    return payload;
+}
+
+}  // namespace
+
+TEST(IoPerfHistoryTest, TestEncodesDeltasFromPreviousRecord) {
+    IoPerfHistoryEncoder encoder;
+    std::string first;
+    encoder.encode(BOOT_TIME_RECORD, sampleRecord(1000), &first);
+    std::string second;
+    encoder.encode(PERIODIC_RECORD, sampleRecord(1010), &second);
+
+    size_t pos = 0;
+    const std::string firstPayload = nextPayload(first, &pos);
+    ASSERT_EQ(pos, first.size()) << "Record size doesn't match the framed payload";
+    ASSERT_GE(firstPayload.size(), 2);
+    EXPECT_EQ(firstPayload[0], BOOT_TIME_RECORD);
+    EXPECT_EQ(firstPayload[1], 0) << "First record must be self-contained";
+    EXPECT_NE(firstPayload.find("shared:android.uid.system"), std::string::npos);
+
+    pos = 0;
+    const std::string secondPayload = nextPayload(second, &pos);
+    ASSERT_GE(secondPayload.size(), 3);
+    EXPECT_EQ(secondPayload[0], PERIODIC_RECORD);
+    EXPECT_EQ(secondPayload[1], kIoPerfHistoryDeltaFlag);
+    EXPECT_EQ(secondPayload[2], 20) << "Time delta of 10 seconds not zigzag encoded";
+    EXPECT_EQ(secondPayload.find("shared:android.uid.system"), std::string::npos)
+            << "Package name not interned";
+    EXPECT_LT(secondPayload.size(), firstPayload.size());
+
+    encoder.reset();
+    std::string third;
+    encoder.encode(PERIODIC_RECORD, sampleRecord(1020), &third);
+    pos = 0;
+    const std::string thirdPayload = nextPayload(third, &pos);
+    EXPECT_EQ(thirdPayload.size(), firstPayload.size()) << "Reset didn't restart the delta chain";
+    EXPECT_EQ(thirdPayload[1], 0);
+}
+
+TEST(IoPerfHistoryTest, TestAppendWritesHeaderAndRecords) {
+    TemporaryDir dir;
+    const std::string path = StringPrintf("%s/history", dir.path);
+    sp<IoPerfHistory> history = new IoPerfHistory(path);
+
+    ASSERT_RESULT_OK(history->append(BOOT_TIME_RECORD, sampleRecord(1000)));
+    ASSERT_RESULT_OK(history->append(PERIODIC_RECORD, sampleRecord(1010)));
+
+    std::string contents;
+    ASSERT_TRUE(ReadFileToString(path, &contents));
+    ASSERT_EQ(contents.substr(0, fileHeader().size()), fileHeader());
+    size_t pos = fileHeader().size();
+    EXPECT_EQ(nextPayload(contents, &pos)[0], BOOT_TIME_RECORD);
+    EXPECT_EQ(nextPayload(contents, &pos)[0], PERIODIC_RECORD);
+    EXPECT_EQ(pos, contents.size());
+}
+
+TEST(IoPerfHistoryTest, TestKeepsHistoryFromPreviousRun) {
+    TemporaryDir dir;
+    const std::string path = StringPrintf("%s/history", dir.path);
+    sp<IoPerfHistory> history = new IoPerfHistory(path);
+    ASSERT_RESULT_OK(history->append(BOOT_TIME_RECORD, sampleRecord(1000)));
+    std::string previousContents;
+    ASSERT_TRUE(ReadFileToString(path, &previousContents));
+
+    history = new IoPerfHistory(path);
+    ASSERT_RESULT_OK(history->append(BOOT_TIME_RECORD, sampleRecord(2000)));
+
+    std::string oldContents;
+    ASSERT_TRUE(ReadFileToString(path + ".old", &oldContents));
+    EXPECT_EQ(oldContents, previousContents);
+
+    TemporaryFile dump;
+    ASSERT_RESULT_OK(history->dump(dump.fd));
+    std::string currentContents;
+    ASSERT_TRUE(ReadFileToString(path, &currentContents));
+    std::string dumpContents;
+    ASSERT_TRUE(ReadFileToString(dump.path, &dumpContents));
+    EXPECT_EQ(dumpContents, oldContents + currentContents);
+}
+
+TEST(IoPerfHistoryTest, TestRotatesAtMaxFileSize) {
+    TemporaryDir dir;
+    const std::string path = StringPrintf("%s/history", dir.path);
+    std::string record;
+    IoPerfHistoryEncoder().encode(PERIODIC_RECORD, sampleRecord(1000), &record);
+    // Fits the header and two self-contained records.
+    sp<IoPerfHistory> history = new IoPerfHistory(path, fileHeader().size() + 2 * record.size());
+
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_RESULT_OK(history->append(PERIODIC_RECORD, sampleRecord(1000 + i)));
+    }
+
+    std::string contents;
+    ASSERT_TRUE(ReadFileToString(path, &contents));
+    std::string oldContents;
+    ASSERT_TRUE(ReadFileToString(path + ".old", &oldContents));
+    EXPECT_LE(contents.size(), fileHeader().size() + 2 * record.size());
+    EXPECT_LE(oldContents.size(), fileHeader().size() + 2 * record.size());
+    EXPECT_EQ(contents.substr(0, fileHeader().size()), fileHeader());
+    EXPECT_EQ(oldContents.substr(0, fileHeader().size()), fileHeader());
+    size_t pos = fileHeader().size();
+    EXPECT_EQ(nextPayload(contents, &pos)[1], 0) << "Rotated file must start a new delta chain";
+}
+
+TEST(IoPerfHistoryTest, TestErrorOnInaccessibleDirectory) {
+    sp<IoPerfHistory> history = new IoPerfHistory("/invalid/path/history");
+
+    EXPECT_FALSE(history->append(PERIODIC_RECORD, sampleRecord(1000)).ok());
+    EXPECT_TRUE(history->append(PERIODIC_RECORD, sampleRecord(1010)).ok())
+            << "Consecutive open failures must be reported only once";
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
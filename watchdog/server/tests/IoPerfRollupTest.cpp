@@ -0,0 +1,119 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "IoPerfRollup.h"
+
+#include <string>
+
+#include "IoPerfCollection.h"
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using std::chrono_literals::operator""min;
+
+namespace {
+
+IoPerfRecord periodicRecord(time_t time, uint64_t writeBytes) {
+    return IoPerfRecord{
+            .time = time,
+            .uidIoPerfData = {.topNReads = {{.userId = 0,
+                                             .packageName = "mount",
+                                             .bytes = {0, 100},
+                                             .fsync{0, 1}}},
+                              .topNWrites = {{.userId = 10,
+                                              .packageName = "com.google.android.car.kitchensink",
+                                              .bytes = {writeBytes, 0},
+                                              .fsync{1, 0}},
+                                             {.userId = 0,
+                                              .packageName = "mount",
+                                              .bytes = {0, 10},
+                                              .fsync{0, 1}}},
+                              .total = {{0, 100}, {writeBytes, 10}, {1, 2}}},
+            .systemIoPerfData = {.cpuIoWaitTime = 10, .totalCpuTime = 1000},
+            .processIoPerfData = {.totalMajorFaults = 5},
+    };
+}
+
+}  // namespace
+
+TEST(IoPerfRollupTest, TestAggregatesRecordsOfWindow) {
+    IoPerfRollup rollup(/*topNStats=*/1, {{1min, 10}});
+    for (time_t time = 600; time < 660; time += 10) {
+        rollup.add(periodicRecord(time, 1000));
+    }
+    ASSERT_EQ(rollup.records(0).size(), 0) << "Window completed before the next window started";
+
+    rollup.add(periodicRecord(660, 1000));
+    ASSERT_EQ(rollup.records(0).size(), 1);
+    const IoPerfRollupRecord& record = rollup.records(0)[0];
+    EXPECT_EQ(record.startTime, 600);
+    EXPECT_EQ(record.numRecords, 6);
+    EXPECT_EQ(record.total[WRITE_BYTES][FOREGROUND], 6000);
+    EXPECT_EQ(record.total[READ_BYTES][BACKGROUND], 600);
+    EXPECT_EQ(record.cpuIoWaitTime, 60);
+    EXPECT_EQ(record.totalCpuTime, 6000);
+    EXPECT_EQ(record.totalMajorFaults, 30);
+    ASSERT_EQ(record.topNWrites.size(), 1) << "Top N writes not limited to the top N stats";
+    EXPECT_EQ(record.topNWrites[0].packageName, "com.google.android.car.kitchensink");
+    EXPECT_EQ(record.topNWrites[0].bytes[FOREGROUND], 6000);
+    EXPECT_EQ(record.topNWrites[0].fsync[FOREGROUND], 6);
+    ASSERT_EQ(record.topNReads.size(), 1);
+    EXPECT_EQ(record.topNReads[0].packageName, "mount");
+    EXPECT_EQ(record.topNReads[0].bytes[BACKGROUND], 600);
+}
+
+TEST(IoPerfRollupTest, TestRollsUpIntoCoarserTiers) {
+    IoPerfRollup rollup(/*topNStats=*/2, {{1min, 3}, {10min, 10}});
+    // 25 minutes of records every 30 seconds.
+    for (time_t time = 0; time < 25 * 60; time += 30) {
+        rollup.add(periodicRecord(time, 100));
+    }
+    ASSERT_EQ(rollup.numTiers(), 2);
+    ASSERT_EQ(rollup.records(0).size(), 3) << "First tier not bounded by its max records";
+    EXPECT_EQ(rollup.records(0)[2].startTime, 23 * 60);
+
+    ASSERT_EQ(rollup.records(1).size(), 2);
+    for (size_t i = 0; i < 2; ++i) {
+        const IoPerfRollupRecord& record = rollup.records(1)[i];
+        EXPECT_EQ(record.startTime, static_cast<time_t>(i * 10 * 60));
+        EXPECT_EQ(record.numRecords, 20);
+        EXPECT_EQ(record.total[WRITE_BYTES][FOREGROUND], 2000);
+        ASSERT_EQ(record.topNWrites.size(), 2);
+        EXPECT_EQ(record.topNWrites[0].bytes[FOREGROUND], 2000);
+        EXPECT_EQ(record.topNWrites[1].bytes[BACKGROUND], 200);
+    }
+}
+
+TEST(IoPerfRollupTest, TestWritesCompletedWindows) {
+    IoPerfRollup rollup(/*topNStats=*/2, {{1min, 10}});
+    rollup.add(periodicRecord(0, 1000));
+    rollup.add(periodicRecord(60, 1000));
+
+    std::string dump;
+    DumpWriter writer(&dump);
+    rollup.writeTo(&writer);
+    EXPECT_THAT(dump, ::testing::HasSubstr("Number of windows: 1\n"));
+    EXPECT_THAT(dump, ::testing::HasSubstr("1 collections\n"));
+    EXPECT_THAT(dump, ::testing::HasSubstr("com.google.android.car.kitchensink, 1000, 1, 0, 0"));
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MediatorHealthChannel.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::unique_fd;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+namespace {
+
+// Maps the channel the way the mediator does.
+class MediatorMapping {
+public:
+    explicit MediatorMapping(const MediatorHealthChannel& channel) {
+        auto fd = channel.dupFd();
+        EXPECT_TRUE(fd.ok()) << fd.error();
+        if (!fd.ok()) {
+            return;
+        }
+        mFd = std::move(*fd);
+        void* addr = mmap(nullptr, sizeof(HealthChannelLayout), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, mFd.get(), 0);
+        EXPECT_NE(addr, MAP_FAILED);
+        mLayout = addr == MAP_FAILED ? nullptr : static_cast<HealthChannelLayout*>(addr);
+    }
+
+    ~MediatorMapping() {
+        if (mLayout != nullptr) {
+            munmap(mLayout, sizeof(HealthChannelLayout));
+        }
+    }
+
+    int fd() const { return mFd.get(); }
+    HealthChannelLayout* layout() const { return mLayout; }
+
+    // Writes a report following the protocol of the mediator.
+    void writeReport(int32_t sessionId, const std::vector<int32_t>& clientsNotResponding) {
+        const uint32_t head = mLayout->reportHead.load();
+        HealthReport& report = mLayout->reports[head % kNumHealthReports];
+        report.sequence.fetch_add(1);
+        report.sessionId.store(sessionId);
+        report.numClientsNotResponding.store(clientsNotResponding.size());
+        for (size_t i = 0; i < clientsNotResponding.size(); ++i) {
+            report.clientsNotResponding[i].store(clientsNotResponding[i]);
+        }
+        report.sequence.fetch_add(1);
+        mLayout->reportHead.store(head + 1);
+    }
+
+private:
+    unique_fd mFd;
+    HealthChannelLayout* mLayout = nullptr;
+};
+
+std::unique_ptr<MediatorHealthChannel> createChannel() {
+    auto channel = MediatorHealthChannel::create();
+    EXPECT_TRUE(channel.ok()) << channel.error();
+    return channel.ok() ? std::move(*channel) : nullptr;
+}
+
+std::vector<int32_t> sessionIds(const std::vector<MediatorHealthReport>& reports) {
+    std::vector<int32_t> ids;
+    for (const auto& report : reports) {
+        ids.push_back(report.sessionId);
+    }
+    return ids;
+}
+
+}  // namespace
+
+TEST(MediatorHealthChannelTest, TestSharesSealedMemory) {
+    auto channel = createChannel();
+    ASSERT_NE(channel, nullptr);
+    MediatorMapping mediator(*channel);
+    ASSERT_NE(mediator.layout(), nullptr);
+
+    EXPECT_EQ(mediator.layout()->magic, kHealthChannelMagic);
+    EXPECT_EQ(mediator.layout()->version, kHealthChannelVersion);
+    struct stat st;
+    ASSERT_EQ(fstat(mediator.fd(), &st), 0);
+    EXPECT_EQ(static_cast<size_t>(st.st_size), sizeof(HealthChannelLayout));
+    EXPECT_NE(ftruncate(mediator.fd(), 0), 0) << "Mediator can shrink the channel";
+    EXPECT_EQ(fcntl(mediator.fd(), F_ADD_SEALS, F_SEAL_WRITE), -1)
+            << "Mediator can change the seals";
+}
+
+TEST(MediatorHealthChannelTest, TestPingWakesUpMediator) {
+    auto channel = createChannel();
+    ASSERT_NE(channel, nullptr);
+    MediatorMapping mediator(*channel);
+    ASSERT_NE(mediator.layout(), nullptr);
+    HealthChannelLayout* layout = mediator.layout();
+
+    int32_t pingedSessionId = 0;
+    std::thread waiter([&]() {
+        const timespec timeout = {.tv_sec = 5, .tv_nsec = 0};
+        while (layout->pingEpoch.load() == 0) {
+            syscall(SYS_futex, &layout->pingEpoch, FUTEX_WAIT, 0, &timeout, nullptr, 0);
+        }
+        pingedSessionId = layout->pingSessionId.load();
+    });
+    channel->ping(42);
+    waiter.join();
+
+    EXPECT_EQ(pingedSessionId, 42);
+    EXPECT_EQ(layout->pingEpoch.load(), 1u);
+}
+
+TEST(MediatorHealthChannelTest, TestTakesReportsInOrder) {
+    auto channel = createChannel();
+    ASSERT_NE(channel, nullptr);
+    MediatorMapping mediator(*channel);
+    ASSERT_NE(mediator.layout(), nullptr);
+
+    EXPECT_THAT(channel->takeReports(), IsEmpty());
+    mediator.writeReport(3, {});
+    mediator.writeReport(6, {1001, 1002});
+
+    const auto reports = channel->takeReports();
+    ASSERT_EQ(reports.size(), 2u);
+    EXPECT_EQ(reports[0].sessionId, 3);
+    EXPECT_THAT(reports[0].clientsNotResponding, IsEmpty());
+    EXPECT_EQ(reports[1].sessionId, 6);
+    EXPECT_THAT(reports[1].clientsNotResponding, ElementsAre(1001, 1002));
+    EXPECT_THAT(channel->takeReports(), IsEmpty()) << "Reports are taken twice";
+}
+
+TEST(MediatorHealthChannelTest, TestKeepsLatestReportsOnOverrun) {
+    auto channel = createChannel();
+    ASSERT_NE(channel, nullptr);
+    MediatorMapping mediator(*channel);
+    ASSERT_NE(mediator.layout(), nullptr);
+
+    for (int32_t sessionId = 1; sessionId <= static_cast<int32_t>(kNumHealthReports) + 2;
+         ++sessionId) {
+        mediator.writeReport(sessionId, {});
+    }
+
+    EXPECT_THAT(sessionIds(channel->takeReports()), ElementsAre(3, 4, 5, 6, 7, 8, 9, 10));
+}
+
+TEST(MediatorHealthChannelTest, TestDropsInvalidReports) {
+    auto channel = createChannel();
+    ASSERT_NE(channel, nullptr);
+    MediatorMapping mediator(*channel);
+    ASSERT_NE(mediator.layout(), nullptr);
+    HealthChannelLayout* layout = mediator.layout();
+
+    // The mediator stalled in the middle of the first report.
+    mediator.writeReport(3, {1001});
+    layout->reports[0].sequence.fetch_add(1);
+    // The second report claims more clients than the report holds.
+    mediator.writeReport(6, {1002});
+    layout->reports[1].numClientsNotResponding.store(kMaxClientsNotResponding + 100);
+
+    const auto reports = channel->takeReports();
+    ASSERT_EQ(reports.size(), 1u);
+    EXPECT_EQ(reports[0].sessionId, 6);
+    EXPECT_EQ(reports[0].clientsNotResponding.size(), kMaxClientsNotResponding);
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
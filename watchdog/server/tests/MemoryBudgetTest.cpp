@@ -0,0 +1,122 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MemoryBudget.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <limits>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringPrintf;
+using android::base::WriteStringToFile;
+
+namespace {
+
+const uint64_t kPageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+const uint64_t kLimitPages = 1000;
+
+const MemoryBudgetConfig kConfig = {
+        .rssLimitBytes = kLimitPages * kPageSize,
+        .cacheSize = 180,
+};
+
+bool writeRssPages(const std::string& path, uint64_t residentPages) {
+    return WriteStringToFile(StringPrintf("4000 %" PRIu64 " 300 10 0 900 0\n", residentPages),
+                             path);
+}
+
+}  // namespace
+
+TEST(MemoryBudgetTest, TestRssDropsRecordDetails) {
+    TemporaryFile statm;
+    MemoryBudget budget(kConfig, statm.path);
+
+    ASSERT_TRUE(writeRssPages(statm.path, kLimitPages / 2));
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/false), FULL_RECORDS);
+    EXPECT_EQ(budget.rssBytes(), kLimitPages / 2 * kPageSize);
+    EXPECT_EQ(budget.cacheSize(180), 180);
+    EXPECT_EQ(budget.cacheSize(std::numeric_limits<size_t>::max()),
+              std::numeric_limits<size_t>::max());
+
+    ASSERT_TRUE(writeRssPages(statm.path, kLimitPages * 8 / 10));
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/false), DROP_SUBCATEGORIES);
+    EXPECT_EQ(budget.cacheSize(180), 90);
+    EXPECT_EQ(budget.cacheSize(std::numeric_limits<size_t>::max()), 90)
+            << "Boot-time cache is not bounded";
+
+    ASSERT_TRUE(writeRssPages(statm.path, kLimitPages));
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/false), COUNTERS_ONLY);
+    EXPECT_EQ(budget.cacheSize(180), 45);
+    EXPECT_EQ(budget.cacheSize(10), 10);
+}
+
+TEST(MemoryBudgetTest, TestSustainedMemoryPressureKeepsOnlyCounters) {
+    TemporaryFile statm;
+    ASSERT_TRUE(writeRssPages(statm.path, 1));
+    MemoryBudget budget(kConfig, statm.path);
+
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/true), DROP_SUBCATEGORIES);
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/true), COUNTERS_ONLY);
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/true), COUNTERS_ONLY);
+}
+
+TEST(MemoryBudgetTest, TestRecoversOneLevelAtATime) {
+    TemporaryFile statm;
+    ASSERT_TRUE(writeRssPages(statm.path, kLimitPages));
+    MemoryBudget budget(kConfig, statm.path);
+    ASSERT_EQ(budget.update(/*isUnderMemoryPressure=*/false), COUNTERS_ONLY);
+
+    ASSERT_TRUE(writeRssPages(statm.path, 1));
+    for (size_t i = 1; i < MemoryBudget::kRecoveryCollections; ++i) {
+        EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/false), COUNTERS_ONLY)
+                << "Recovered after " << i << " collections";
+    }
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/false), DROP_SUBCATEGORIES);
+
+    // Pressure during the recovery drops the details again.
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/false), DROP_SUBCATEGORIES);
+    EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/true), COUNTERS_ONLY);
+    for (size_t i = 0; i < 2 * MemoryBudget::kRecoveryCollections; ++i) {
+        budget.update(/*isUnderMemoryPressure=*/false);
+    }
+    EXPECT_EQ(budget.level(), FULL_RECORDS);
+}
+
+TEST(MemoryBudgetTest, TestKeepsLastRssOnReadFailure) {
+    TemporaryFile statm;
+    ASSERT_TRUE(writeRssPages(statm.path, kLimitPages));
+    MemoryBudget budget(kConfig, statm.path);
+    ASSERT_EQ(budget.update(/*isUnderMemoryPressure=*/false), COUNTERS_ONLY);
+
+    ASSERT_TRUE(WriteStringToFile("invalid", statm.path));
+    for (size_t i = 0; i < MemoryBudget::kRecoveryCollections; ++i) {
+        EXPECT_EQ(budget.update(/*isUnderMemoryPressure=*/false), COUNTERS_ONLY);
+    }
+    EXPECT_EQ(budget.rssBytes(), kLimitPages * kPageSize);
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
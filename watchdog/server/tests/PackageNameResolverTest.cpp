@@ -0,0 +1,215 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PackageNameResolver.h"
+
+#include <android-base/file.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::Error;
+using android::base::Result;
+using android::base::WriteStringToFile;
+using ::testing::UnorderedElementsAre;
+
+namespace {
+
+// Resolves app UIDs from a fixed package manager mapping and controls the current time.
+class PackageNameResolverPeer : public PackageNameResolver {
+public:
+    explicit PackageNameResolverPeer(const std::string& packagesListPath,
+                                     size_t maxCacheSize = kDefaultMaxCacheSize) :
+          PackageNameResolver(packagesListPath, maxCacheSize),
+          mTime(1),
+          mIsPackageManagerAvailable(true) {}
+
+    void setTime(nsecs_t time) { mTime = time; }
+    void setPackageManagerNames(const std::unordered_map<int32_t, std::string>& names) {
+        mPackageManagerNames = names;
+    }
+    void setPackageManagerAvailable(bool isAvailable) { mIsPackageManagerAvailable = isAvailable; }
+    // Returns the UIDs requested from the package manager since the last call.
+    std::vector<std::vector<int32_t>> takeRequests() { return std::move(mRequests); }
+
+protected:
+    nsecs_t now() override { return mTime; }
+
+    Result<std::vector<std::string>> getNamesFromPackageManagerLocked(
+            const std::vector<int32_t>& uids) override {
+        mRequests.push_back(uids);
+        if (!mIsPackageManagerAvailable) {
+            return Error() << "Package manager unavailable";
+        }
+        std::vector<std::string> names;
+        for (const auto& uid : uids) {
+            const auto it = mPackageManagerNames.find(uid);
+            names.emplace_back(it == mPackageManagerNames.end() ? "" : it->second);
+        }
+        return names;
+    }
+
+private:
+    nsecs_t mTime;
+    bool mIsPackageManagerAvailable;
+    std::unordered_map<int32_t, std::string> mPackageManagerNames;
+    std::vector<std::vector<int32_t>> mRequests;
+};
+
+// Sets the modification time explicitly as consecutive writes may share the same timestamp.
+void writePackagesList(const std::string& path, const std::string& contents, time_t mtime) {
+    ASSERT_TRUE(WriteStringToFile(contents, path));
+    const timespec times[2] = {{.tv_sec = mtime}, {.tv_sec = mtime}};
+    ASSERT_EQ(utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+}
+
+}  // namespace
+
+TEST(PackageNameResolverTest, TestBatchesPackageManagerLookups) {
+    PackageNameResolverPeer resolver("/nonexistent/packages.list");
+    resolver.setPackageManagerNames(
+            {{10010, "com.example.first"}, {1110020, "com.example.second"}});
+
+    const auto& names = resolver.getPackageNames({1000, 10010, 1110020});
+
+    EXPECT_THAT(names,
+                UnorderedElementsAre(std::make_pair(1000u, "system"),
+                                     std::make_pair(10010u, "com.example.first"),
+                                     std::make_pair(1110020u, "com.example.second")));
+    const auto& requests = resolver.takeRequests();
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_THAT(requests[0], UnorderedElementsAre(10010, 1110020));
+
+    // Resolved names are served from the cache.
+    EXPECT_EQ(resolver.getPackageNames({1000, 10010, 1110020}), names);
+    EXPECT_TRUE(resolver.takeRequests().empty());
+}
+
+TEST(PackageNameResolverTest, TestExpiresNegativeEntries) {
+    PackageNameResolverPeer resolver("/nonexistent/packages.list");
+
+    EXPECT_TRUE(resolver.getPackageNames({10030}).empty());
+    EXPECT_EQ(resolver.takeRequests().size(), 1u);
+
+    resolver.setPackageManagerNames({{10030, "com.example.installed"}});
+    resolver.setTime(PackageNameResolver::kNegativeEntryTtl.count());
+    EXPECT_TRUE(resolver.getPackageNames({10030}).empty());
+    EXPECT_TRUE(resolver.takeRequests().empty());
+
+    resolver.setTime(PackageNameResolver::kNegativeEntryTtl.count() + 1);
+    EXPECT_THAT(resolver.getPackageNames({10030}),
+                UnorderedElementsAre(std::make_pair(10030u, "com.example.installed")));
+    EXPECT_EQ(resolver.takeRequests().size(), 1u);
+}
+
+TEST(PackageNameResolverTest, TestDoesNotCacheWhenPackageManagerUnavailable) {
+    PackageNameResolverPeer resolver("/nonexistent/packages.list");
+    resolver.setPackageManagerAvailable(false);
+    resolver.setPackageManagerNames({{10040, "com.example.app"}});
+
+    EXPECT_TRUE(resolver.getPackageNames({10040}).empty());
+
+    resolver.setPackageManagerAvailable(true);
+    EXPECT_THAT(resolver.getPackageNames({10040}),
+                UnorderedElementsAre(std::make_pair(10040u, "com.example.app")));
+    EXPECT_EQ(resolver.takeRequests().size(), 2u);
+}
+
+TEST(PackageNameResolverTest, TestResolvesFromPackagesList) {
+    TemporaryFile packagesList;
+    writePackagesList(packagesList.path,
+                      "com.example.first 10050 0 /data/user/0/com.example.first default 3003 0 "
+                      "1\n"
+                      "com.example.shared1 10060 0 /data/user/0/com.example.shared1 default 3003 0 "
+                      "1\n"
+                      "com.example.shared2 10060 0 /data/user/0/com.example.shared2 default 3003 0 "
+                      "1\n",
+                      1000);
+    PackageNameResolverPeer resolver(packagesList.path);
+    resolver.setPackageManagerNames({{10060, "shared:com.example.shared"}});
+
+    // App IDs shared by multiple packages are resolved with the package manager.
+    EXPECT_THAT(resolver.getPackageNames({10050, 1010050, 10060}),
+                UnorderedElementsAre(std::make_pair(10050u, "com.example.first"),
+                                     std::make_pair(1010050u, "com.example.first"),
+                                     std::make_pair(10060u, "shared:com.example.shared")));
+    const auto& requests = resolver.takeRequests();
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_THAT(requests[0], UnorderedElementsAre(10060));
+
+    // The list is reloaded when it changes and the cached app package names are dropped.
+    writePackagesList(packagesList.path,
+                      "com.example.updated 10050 0 /data/user/0/com.example.updated default 3003 "
+                      "0 1\n",
+                      2000);
+    EXPECT_THAT(resolver.getPackageNames({10050}),
+                UnorderedElementsAre(std::make_pair(10050u, "com.example.updated")));
+    EXPECT_TRUE(resolver.takeRequests().empty());
+}
+
+TEST(PackageNameResolverTest, TestResolvesAppIds) {
+    TemporaryFile packagesList;
+    writePackagesList(packagesList.path,
+                      "com.example.first 10050 0 /data/user/0/com.example.first default 3003 0 "
+                      "1\n"
+                      "com.example.shared1 10060 0 /data/user/0/com.example.shared1 default 3003 0 "
+                      "1\n"
+                      "com.example.shared2 10060 0 /data/user/0/com.example.shared2 default 3003 0 "
+                      "1\n",
+                      1000);
+    PackageNameResolverPeer resolver(packagesList.path);
+
+    EXPECT_THAT(resolver.getAppIds({"com.example.first", "com.example.shared2", "root",
+                                    "com.example.unknown"}),
+                UnorderedElementsAre(10050u, 10060u, 0u));
+    EXPECT_TRUE(resolver.takeRequests().empty()) << "Package manager was queried";
+}
+
+TEST(PackageNameResolverTest, TestEvictsLeastRecentlyUsedEntries) {
+    PackageNameResolverPeer resolver("/nonexistent/packages.list", /*maxCacheSize=*/2);
+    resolver.setPackageManagerNames({{10070, "com.example.first"},
+                                     {10080, "com.example.second"},
+                                     {10090, "com.example.third"}});
+
+    resolver.getPackageNames({10070});
+    resolver.getPackageNames({10080});
+    // Marks 10070 as the most recently used entry.
+    resolver.getPackageNames({10070});
+    resolver.getPackageNames({10090});
+    resolver.takeRequests();
+
+    EXPECT_EQ(resolver.mCache.size(), 2u);
+    EXPECT_EQ(resolver.mCache.count(10080), 0u);
+
+    resolver.getPackageNames({10070, 10090});
+    EXPECT_TRUE(resolver.takeRequests().empty());
+    resolver.getPackageNames({10080});
+    EXPECT_EQ(resolver.takeRequests().size(), 1u);
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PingDispatcher.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using std::chrono_literals::operator""s;
+using ::testing::HasSubstr;
+
+namespace {
+
+class PingDispatcherPeer : public PingDispatcher {
+public:
+    PingDispatcherPeer() : mNow(s2ns(100)) {}
+    ~PingDispatcherPeer() { terminate(); }
+
+    void advance(nsecs_t duration) { mNow += duration; }
+
+protected:
+    nsecs_t now() override { return mNow; }
+
+private:
+    std::atomic<nsecs_t> mNow;
+};
+
+// Dispatches a ping that returns only after |release| is fulfilled.
+std::future<void> dispatchBlockingPing(PingDispatcher* dispatcher, IBinder* binder,
+                                       std::shared_future<void> release) {
+    auto sent = std::make_shared<std::promise<void>>();
+    std::future<void> sentFuture = sent->get_future();
+    EXPECT_TRUE(dispatcher->dispatch(binder, /*pid=*/1, /*sessionId=*/1, [sent, release]() {
+        sent->set_value();
+        release.wait();
+    }));
+    return sentFuture;
+}
+
+}  // namespace
+
+TEST(PingDispatcherTest, TestSlowClientDoesNotDelayOtherClients) {
+    sp<PingDispatcherPeer> dispatcher = new PingDispatcherPeer();
+    sp<BBinder> slowClient = new BBinder();
+    sp<BBinder> client = new BBinder();
+    std::promise<void> release;
+
+    auto slowPingSent =
+            dispatchBlockingPing(dispatcher.get(), slowClient.get(), release.get_future().share());
+    ASSERT_EQ(slowPingSent.wait_for(1s), std::future_status::ready);
+
+    std::promise<void> pinged;
+    ASSERT_TRUE(dispatcher->dispatch(client.get(), /*pid=*/2, /*sessionId=*/2,
+                                     [&]() { pinged.set_value(); }));
+    ASSERT_EQ(pinged.get_future().wait_for(1s), std::future_status::ready)
+            << "Ping to a healthy client was delayed by the slow client";
+    release.set_value();
+}
+
+TEST(PingDispatcherTest, TestSkipsClientWithPingInFlight) {
+    sp<PingDispatcherPeer> dispatcher = new PingDispatcherPeer();
+    sp<BBinder> client = new BBinder();
+    std::promise<void> release;
+
+    auto pingSent =
+            dispatchBlockingPing(dispatcher.get(), client.get(), release.get_future().share());
+    ASSERT_EQ(pingSent.wait_for(1s), std::future_status::ready);
+    ASSERT_FALSE(dispatcher->dispatch(client.get(), /*pid=*/1, /*sessionId=*/2, []() {}))
+            << "Dispatched a second ping while the first one is in flight";
+    ASSERT_THAT(dispatcher->dump(""), HasSubstr("in flight: true"));
+
+    release.set_value();
+    auto deadline = std::chrono::steady_clock::now() + 1s;
+    while (!dispatcher->dispatch(client.get(), /*pid=*/1, /*sessionId=*/3, []() {})) {
+        ASSERT_LT(std::chrono::steady_clock::now(), deadline)
+                << "Client stayed in flight after its ping returned";
+        std::this_thread::yield();
+    }
+}
+
+TEST(PingDispatcherTest, TestRecordsRoundTripLatency) {
+    sp<PingDispatcherPeer> dispatcher = new PingDispatcherPeer();
+    sp<BBinder> client = new BBinder();
+
+    std::promise<void> pinged;
+    ASSERT_TRUE(dispatcher->dispatch(client.get(), /*pid=*/123, /*sessionId=*/7,
+                                     [&]() { pinged.set_value(); }));
+    ASSERT_EQ(pinged.get_future().wait_for(1s), std::future_status::ready);
+
+    dispatcher->advance(ms2ns(120));
+    // Responses to other sessions are ignored.
+    dispatcher->onPingResponded(client.get(), /*sessionId=*/6);
+    dispatcher->onPingResponded(client.get(), /*sessionId=*/7);
+    // Duplicate responses are recorded only once.
+    dispatcher->onPingResponded(client.get(), /*sessionId=*/7);
+
+    const std::string dump = dispatcher->dump("  ");
+    EXPECT_THAT(dump, HasSubstr("  pid = 123"));
+    EXPECT_THAT(dump, HasSubstr("<100ms: 0, <500ms: 1, <1000ms: 0"));
+    EXPECT_THAT(dump, HasSubstr("max: 120ms"));
+
+    dispatcher->remove(client.get());
+    EXPECT_EQ(dispatcher->dump(""), "");
+}
+
+TEST(PingDispatcherTest, TestLatencyHistogramBuckets) {
+    LatencyHistogram histogram;
+    const std::vector<int64_t> latenciesMillis = {0, 9, 10, 75, 999, 2999, 3000, 60000};
+    for (const auto& millis : latenciesMillis) {
+        histogram.record(ms2ns(millis));
+    }
+    EXPECT_EQ(histogram.total(), latenciesMillis.size());
+    EXPECT_EQ(histogram.max(), ms2ns(60000));
+    const std::vector<uint64_t> expectedCounts = {2, 1, 1, 0, 1, 1, 2};
+    for (size_t i = 0; i < expectedCounts.size(); ++i) {
+        EXPECT_EQ(histogram.count(i), expectedCounts[i]) << "Bucket " << i;
+    }
+}
+
+TEST(PingDispatcherTest, TestDropsPingsAfterTerminate) {
+    sp<PingDispatcherPeer> dispatcher = new PingDispatcherPeer();
+    sp<BBinder> client = new BBinder();
+    dispatcher->terminate();
+    ASSERT_FALSE(dispatcher->dispatch(client.get(), /*pid=*/1, /*sessionId=*/1, []() {}));
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProcFileReader.h"
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::Split;
+using android::base::WriteStringToFile;
+
+namespace {
+
+std::vector<std::string> tokenize(std::string_view data, char delimiter) {
+    std::vector<std::string> tokens;
+    Tokenizer tokenizer(data, delimiter);
+    std::string_view token;
+    while (tokenizer.next(&token)) {
+        tokens.emplace_back(token);
+    }
+    return tokens;
+}
+
+}  // namespace
+
+TEST(ProcFileReaderTest, TestTokenizerMatchesSplit) {
+    const std::vector<std::string> inputs = {
+            "",
+            "cpu",
+            "cpu  6200 5700 1700",
+            "1 (init) S 0 0\n",
+            "\n\nprocs_running 1\n\nprocs_blocked 0\n",
+    };
+    for (const auto& input : inputs) {
+        EXPECT_EQ(Split(input, " "), tokenize(input, ' ')) << "Input: \"" << input << "\"";
+        EXPECT_EQ(Split(input, "\n"), tokenize(input, '\n')) << "Input: \"" << input << "\"";
+    }
+}
+
+TEST(ProcFileReaderTest, TestTokenizerRemaining) {
+    Tokenizer tokenizer("cpu  6200 5700", ' ');
+    std::string_view token;
+    ASSERT_TRUE(tokenizer.next(&token));
+    EXPECT_EQ("cpu", token);
+    EXPECT_EQ(" 6200 5700", tokenizer.remaining());
+    ASSERT_TRUE(tokenizer.next(&token));
+    ASSERT_TRUE(tokenizer.next(&token));
+    ASSERT_TRUE(tokenizer.next(&token));
+    EXPECT_EQ("5700", token);
+    EXPECT_TRUE(tokenizer.remaining().empty());
+    EXPECT_FALSE(tokenizer.next(&token));
+}
+
+TEST(ProcFileReaderTest, TestParseNumber) {
+    uint64_t unsignedValue = 0;
+    EXPECT_TRUE(parseNumber("18446744073709551615", &unsignedValue));
+    EXPECT_EQ(18446744073709551615u, unsignedValue);
+    EXPECT_FALSE(parseNumber("", &unsignedValue));
+    EXPECT_FALSE(parseNumber("-1", &unsignedValue));
+    EXPECT_FALSE(parseNumber("12a", &unsignedValue));
+    EXPECT_FALSE(parseNumber(" 12", &unsignedValue));
+    EXPECT_FALSE(parseNumber("18446744073709551616", &unsignedValue));
+
+    int64_t signedValue = 0;
+    EXPECT_TRUE(parseNumber("-1", &signedValue));
+    EXPECT_EQ(-1, signedValue);
+
+    // Parses only the provided view of a larger string.
+    std::string_view view = std::string_view("1234 5678").substr(0, 4);
+    uint32_t value = 0;
+    EXPECT_TRUE(parseNumber(view, &value));
+    EXPECT_EQ(1234u, value);
+}
+
+TEST(ProcFileReaderTest, TestReadReusesBuffer) {
+    TemporaryFile tf;
+    ASSERT_NE(tf.fd, -1);
+    const std::string largeContents(3 * 4096 + 17, 'x');
+    ASSERT_TRUE(WriteStringToFile(largeContents, tf.path));
+
+    ProcFileReader reader;
+    ASSERT_TRUE(reader.read(tf.path));
+    EXPECT_EQ(largeContents, reader.contents());
+
+    const std::string smallContents = "procs_running 1\n";
+    ASSERT_TRUE(WriteStringToFile(smallContents, tf.path));
+    ASSERT_TRUE(reader.read(tf.path));
+    EXPECT_EQ(smallContents, reader.contents());
+}
+
+TEST(ProcFileReaderTest, TestReadKeepOpenRereadsFromStart) {
+    TemporaryFile tf;
+    ASSERT_NE(tf.fd, -1);
+    const std::string firstContents = "cpu  1 2 3\nprocs_running 17\n";
+    ASSERT_TRUE(WriteStringToFile(firstContents, tf.path));
+
+    ProcFileReader reader;
+    ASSERT_TRUE(reader.readKeepOpen(tf.path));
+    EXPECT_EQ(firstContents, reader.contents());
+
+    const std::string secondContents = "procs_running 2\n";
+    ASSERT_TRUE(WriteStringToFile(secondContents, tf.path));
+    ASSERT_TRUE(reader.readKeepOpen(tf.path));
+    EXPECT_EQ(secondContents, reader.contents());
+
+    TemporaryFile otherFile;
+    ASSERT_TRUE(WriteStringToFile(firstContents, otherFile.path));
+    ASSERT_TRUE(reader.readKeepOpen(otherFile.path));
+    EXPECT_EQ(firstContents, reader.contents());
+}
+
+TEST(ProcFileReaderTest, TestErrorOnMissingFile) {
+    TemporaryDir td;
+    ProcFileReader reader;
+    EXPECT_FALSE(reader.read(std::string(td.path) + "/missing"));
+    EXPECT_TRUE(reader.contents().empty());
+    EXPECT_FALSE(reader.readKeepOpen(std::string(td.path) + "/missing"));
+    EXPECT_TRUE(reader.contents().empty());
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProcPidIo.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringPrintf;
+using android::base::WriteStringToFile;
+
+namespace {
+
+std::string ioFileContents(uint64_t readBytes, uint64_t writeBytes) {
+    return StringPrintf("rchar: 4096\nwchar: 8192\nsyscr: 10\nsyscw: 20\nread_bytes: %" PRIu64
+                        "\nwrite_bytes: %" PRIu64 "\ncancelled_write_bytes: 0\n",
+                        readBytes, writeBytes);
+}
+
+// Writes the io files for |pid| and its |tids| under |procDirPath|.
+::testing::AssertionResult writeIoFiles(const std::string& procDirPath, uint32_t pid,
+                                        const std::string& processIo,
+                                        const std::vector<std::pair<uint32_t, std::string>>& tids) {
+    const std::string pidDir = StringPrintf("%s/%" PRIu32, procDirPath.c_str(), pid);
+    mkdir(pidDir.c_str(), 0700);
+    mkdir((pidDir + "/task").c_str(), 0700);
+    if (!WriteStringToFile(processIo, pidDir + "/io")) {
+        return ::testing::AssertionFailure() << "Failed to write io file for pid " << pid;
+    }
+    for (const auto& [tid, threadIo] : tids) {
+        const std::string tidDir = StringPrintf("%s/task/%" PRIu32, pidDir.c_str(), tid);
+        mkdir(tidDir.c_str(), 0700);
+        if (!WriteStringToFile(threadIo, tidDir + "/io")) {
+            return ::testing::AssertionFailure() << "Failed to write io file for tid " << tid;
+        }
+    }
+    return ::testing::AssertionSuccess();
+}
+
+ProcessStats processStats(uint32_t pid, uint64_t startTime, const std::vector<uint32_t>& tids) {
+    ProcessStats stats = {
+            .tgid = pid,
+            .uid = 10001234,
+            .process = {.pid = pid, .comm = "proc", .startTime = startTime},
+    };
+    for (const auto tid : tids) {
+        stats.threads[tid] = PidStat{.pid = tid, .comm = "thread", .startTime = startTime};
+    }
+    return stats;
+}
+
+}  // namespace
+
+TEST(ProcPidIoTest, TestReportsDeltaSinceLastCollection) {
+    TemporaryDir procDir;
+    ASSERT_TRUE(writeIoFiles(procDir.path, 1, ioFileContents(100, 200),
+                             {{1, ioFileContents(40, 50)}, {2, ioFileContents(60, 150)}}));
+    ProcPidIo procPidIo(procDir.path);
+    ASSERT_TRUE(procPidIo.enabled()) << "Files under the path `" << procDir.path
+                                     << "` are inaccessible";
+
+    const ProcessStats stats = processStats(1, 1000, {1, 2});
+    auto usages = procPidIo.collect({&stats});
+    ASSERT_TRUE(usages) << usages.error().message();
+    ASSERT_EQ(usages->size(), 1);
+    EXPECT_EQ((*usages)[0].stats, &stats);
+    EXPECT_EQ((*usages)[0].process.writeBytes, 0) << "First collection reported lifetime I/O";
+    EXPECT_EQ((*usages)[0].threads.at(2).writeBytes, 0);
+
+    ASSERT_TRUE(writeIoFiles(procDir.path, 1, ioFileContents(150, 1200),
+                             {{1, ioFileContents(40, 50)}, {2, ioFileContents(110, 1150)}}));
+    usages = procPidIo.collect({&stats});
+    ASSERT_TRUE(usages) << usages.error().message();
+    ASSERT_EQ(usages->size(), 1);
+    const ProcessIoUsage& usage = (*usages)[0];
+    EXPECT_EQ(usage.process.readBytes, 50);
+    EXPECT_EQ(usage.process.writeBytes, 1000);
+    ASSERT_EQ(usage.threads.size(), 2);
+    EXPECT_EQ(usage.threads.at(1).writeBytes, 0);
+    EXPECT_EQ(usage.threads.at(2).readBytes, 50);
+    EXPECT_EQ(usage.threads.at(2).writeBytes, 1000);
+}
+
+TEST(ProcPidIoTest, TestHandlesPidTidReuse) {
+    TemporaryDir procDir;
+    ASSERT_TRUE(writeIoFiles(procDir.path, 1, ioFileContents(100, 200),
+                             {{1, ioFileContents(100, 200)}}));
+    ProcPidIo procPidIo(procDir.path);
+    ASSERT_TRUE(procPidIo.enabled());
+
+    const ProcessStats stats = processStats(1, 1000, {1});
+    const auto& ret = procPidIo.collect({&stats});
+    ASSERT_TRUE(ret) << ret.error().message();
+
+    ASSERT_TRUE(writeIoFiles(procDir.path, 1, ioFileContents(10, 20),
+                             {{1, ioFileContents(10, 20)}}));
+    const ProcessStats reusedStats = processStats(1, 2000, {1});
+    const auto& usages = procPidIo.collect({&reusedStats});
+    ASSERT_TRUE(usages) << usages.error().message();
+    ASSERT_EQ(usages->size(), 1);
+    EXPECT_EQ((*usages)[0].process.writeBytes, 0) << "Delta computed across PID reuse";
+    EXPECT_EQ((*usages)[0].threads.at(1).writeBytes, 0) << "Delta computed across TID reuse";
+}
+
+TEST(ProcPidIoTest, TestSkipsTerminatedTasks) {
+    TemporaryDir procDir;
+    ASSERT_TRUE(writeIoFiles(procDir.path, 1, ioFileContents(100, 200),
+                             {{1, ioFileContents(100, 200)}}));
+    ProcPidIo procPidIo(procDir.path);
+    ASSERT_TRUE(procPidIo.enabled());
+
+    // Thread 2 and process 3 terminated after the process stats were collected.
+    const ProcessStats stats = processStats(1, 1000, {1, 2});
+    const ProcessStats terminatedStats = processStats(3, 1000, {3});
+    const auto& usages = procPidIo.collect({&stats, &terminatedStats});
+    ASSERT_TRUE(usages) << usages.error().message();
+    ASSERT_EQ(usages->size(), 1);
+    EXPECT_EQ((*usages)[0].stats, &stats);
+    EXPECT_EQ((*usages)[0].threads.size(), 1);
+}
+
+TEST(ProcPidIoTest, TestErrorOnInvalidIoFile) {
+    TemporaryDir procDir;
+    ASSERT_TRUE(writeIoFiles(procDir.path, 1, "rchar: 100\nread_bytes: abc\nwrite_bytes: 10\n",
+                             {{1, ioFileContents(100, 200)}}));
+    ProcPidIo procPidIo(procDir.path);
+    ASSERT_TRUE(procPidIo.enabled());
+
+    const ProcessStats stats = processStats(1, 1000, {1});
+    EXPECT_FALSE(procPidIo.collect({&stats}).ok()) << "No error returned for invalid io file";
+
+    ASSERT_TRUE(writeIoFiles(procDir.path, 1, "rchar: 100\nwchar: 200\n",
+                             {{1, ioFileContents(100, 200)}}));
+    EXPECT_FALSE(procPidIo.collect({&stats}).ok())
+            << "No error returned for io file without bytes";
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
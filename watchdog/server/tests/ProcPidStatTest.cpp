@@ -39,9 +39,9 @@ namespace {
 std::string toString(const PidStat& stat) {
     return StringPrintf("PID: %" PRIu32 ", PPID: %" PRIu32 ", Comm: %s, State: %s, "
                         "Major page faults: %" PRIu64 ", Num threads: %" PRIu32
-                        ", Start time: %" PRIu64,
+                        ", Start time: %" PRIu64 ", CPU time: %" PRIu64,
                         stat.pid, stat.ppid, stat.comm.c_str(), stat.state.c_str(),
-                        stat.majorFaults, stat.numThreads, stat.startTime);
+                        stat.majorFaults, stat.numThreads, stat.startTime, stat.cpuTime);
 }
 
 std::string toString(const ProcessStats& stats) {
@@ -68,7 +68,8 @@ std::string toString(const std::vector<ProcessStats>& stats) {
 bool isEqual(const PidStat& lhs, const PidStat& rhs) {
     return lhs.pid == rhs.pid && lhs.comm == rhs.comm && lhs.state == rhs.state &&
             lhs.ppid == rhs.ppid && lhs.majorFaults == rhs.majorFaults &&
-            lhs.numThreads == rhs.numThreads && lhs.startTime == rhs.startTime;
+            lhs.numThreads == rhs.numThreads && lhs.startTime == rhs.startTime &&
+            lhs.cpuTime == rhs.cpuTime;
 }
 
 bool isEqual(std::vector<ProcessStats>* lhs, std::vector<ProcessStats>* rhs) {
@@ -452,6 +453,188 @@ TEST(ProcPidStatTest, TestHandlesPidTidReuse) {
             << toString(*actual);
 }
 
+TEST(ProcPidStatTest, TestReadsStaticFieldsOnlyForNewPids) {
+    std::unordered_map<uint32_t, std::vector<uint32_t>> pidToTids = {
+            {1, {1}},
+    };
+
+    std::unordered_map<uint32_t, std::string> perProcessStat = {
+            {1, "1 (init) R 1 0 0 0 0 0 0 0 250 0 0 0 0 0 0 0 1 0 1000\n"},
+    };
+
+    std::unordered_map<uint32_t, std::string> perProcessStatus = {
+            {1, "Pid:\t1\nTgid:\t1\nUid:\t10001234\t10001234\t10001234\t10001234\n"},
+    };
+
+    std::unordered_map<uint32_t, std::string> perThreadStat = {
+            {1, "1 (init) R 1 0 0 0 0 0 0 0 250 0 0 0 0 0 0 0 1 0 1000\n"},
+    };
+
+    TemporaryDir procDir;
+    auto ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                                  perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+
+    ProcPidStat procPidStat(procDir.path);
+    ASSERT_TRUE(procPidStat.enabled())
+            << "Files under the path `" << procDir.path << "` are inaccessible";
+
+    auto actual = procPidStat.collect();
+    ASSERT_TRUE(actual) << "Failed to collect proc pid stat: " << actual.error();
+    ASSERT_EQ(1, actual->size());
+    EXPECT_EQ(10001234, actual->front().uid);
+
+    // The status file is not re-read for a known PID with the same start time.
+    perProcessStatus = {
+            {1, "Pid:\t1\nTgid:\t1\nUid:\t10005678\t10005678\t10005678\t10005678\n"},
+    };
+    ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                             perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+
+    actual = procPidStat.collect();
+    ASSERT_TRUE(actual) << "Failed to collect proc pid stat: " << actual.error();
+    ASSERT_EQ(1, actual->size());
+    EXPECT_EQ(10001234, actual->front().uid);
+
+    // The status file is re-read when the PID is reused, which is detected by the start time.
+    perProcessStat = {
+            {1, "1 (logd) R 1 0 0 0 0 0 0 0 300 0 0 0 0 0 0 0 1 0 2000\n"},
+    };
+    perThreadStat = {
+            {1, "1 (logd) R 1 0 0 0 0 0 0 0 300 0 0 0 0 0 0 0 1 0 2000\n"},
+    };
+    ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                             perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+
+    actual = procPidStat.collect();
+    ASSERT_TRUE(actual) << "Failed to collect proc pid stat: " << actual.error();
+    ASSERT_EQ(1, actual->size());
+    EXPECT_EQ(10005678, actual->front().uid);
+    EXPECT_EQ("logd", actual->front().process.comm);
+}
+
+TEST(ProcPidStatTest, TestCpuTimeDelta) {
+    std::unordered_map<uint32_t, std::vector<uint32_t>> pidToTids = {
+            {1, {1, 453}},
+    };
+
+    std::unordered_map<uint32_t, std::string> perProcessStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 220 0 700 300 0 0 0 0 2 0 0\n"},
+    };
+
+    std::unordered_map<uint32_t, std::string> perProcessStatus = {
+            {1, "Pid:\t1\nTgid:\t1\nUid:\t0\t0\t0\t0\n"},
+    };
+
+    std::unordered_map<uint32_t, std::string> perThreadStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 200 0 600 250 0 0 0 0 2 0 0\n"},
+            {453, "453 (init) S 0 0 0 0 0 0 0 0 20 0 100 50 0 0 0 0 2 0 275\n"},
+    };
+
+    TemporaryDir procDir;
+    auto ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                                  perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+
+    ProcPidStat procPidStat(procDir.path);
+    ASSERT_TRUE(procPidStat.enabled())
+            << "Files under the path `" << procDir.path << "` are inaccessible";
+
+    auto actual = procPidStat.collect();
+    ASSERT_TRUE(actual) << "Failed to collect proc pid stat: " << actual.error();
+    ASSERT_EQ(1, actual->size());
+    EXPECT_EQ(1000, actual->front().process.cpuTime) << "User and system times weren't summed";
+    EXPECT_EQ(850, actual->front().threads[1].cpuTime);
+    EXPECT_EQ(150, actual->front().threads[453].cpuTime);
+
+    perProcessStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 220 0 900 400 0 0 0 0 2 0 0\n"},
+    };
+    perThreadStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 200 0 750 320 0 0 0 0 2 0 0\n"},
+            {453, "453 (init) S 0 0 0 0 0 0 0 0 20 0 150 80 0 0 0 0 2 0 275\n"},
+    };
+    ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                             perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+
+    actual = procPidStat.collect();
+    ASSERT_TRUE(actual) << "Failed to collect proc pid stat: " << actual.error();
+    ASSERT_EQ(1, actual->size());
+    EXPECT_EQ(300, actual->front().process.cpuTime);
+    EXPECT_EQ(220, actual->front().threads[1].cpuTime);
+    EXPECT_EQ(80, actual->front().threads[453].cpuTime);
+}
+
+TEST(ProcPidStatTest, TestAppIdFilter) {
+    std::unordered_map<uint32_t, std::vector<uint32_t>> pidToTids = {
+            {1, {1, 2}},
+            {100, {100}},
+            {200, {200}},
+    };
+
+    std::unordered_map<uint32_t, std::string> perProcessStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 220 0 0 0 0 0 0 0 2 0 0\n"},
+            {100, "100 (app) S 1 0 0 0 0 0 0 0 600 0 0 0 0 0 0 0 1 0 1000\n"},
+            {200, "200 (app_user10) S 1 0 0 0 0 0 0 0 700 0 0 0 0 0 0 0 1 0 1100\n"},
+    };
+
+    std::unordered_map<uint32_t, std::string> perProcessStatus = {
+            {1, "Pid:\t1\nTgid:\t1\nUid:\t0\t0\t0\t0\n"},
+            {100, "Pid:\t100\nTgid:\t100\nUid:\t10001234\t10001234\t10001234\t10001234\n"},
+            {200, "Pid:\t200\nTgid:\t200\nUid:\t11001234\t11001234\t11001234\t11001234\n"},
+    };
+
+    std::unordered_map<uint32_t, std::string> perThreadStat = {
+            {1, "1 (init) S 0 0 0 0 0 0 0 0 200 0 0 0 0 0 0 0 1 0 0\n"},
+            {2, "2 (init) S 0 0 0 0 0 0 0 0 20 0 0 0 0 0 0 0 1 0 0\n"},
+            {100, "100 (app) S 1 0 0 0 0 0 0 0 600 0 0 0 0 0 0 0 1 0 1000\n"},
+            {200, "200 (app_user10) S 1 0 0 0 0 0 0 0 700 0 0 0 0 0 0 0 1 0 1100\n"},
+    };
+
+    TemporaryDir procDir;
+    auto ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                                  perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+
+    ProcPidStat procPidStat(procDir.path);
+    ASSERT_TRUE(procPidStat.enabled())
+            << "Files under the path `" << procDir.path << "` are inaccessible";
+    auto actual = procPidStat.collect();
+    ASSERT_TRUE(actual) << "Failed to collect proc pid stat: " << actual.error();
+    ASSERT_EQ(3, actual->size());
+
+    // Only the processes of the filtered app ID are collected, across all the users.
+    procPidStat.setAppIdFilter({1234});
+    perProcessStat[1] = "1 (init) S 0 0 0 0 0 0 0 0 320 0 0 0 0 0 0 0 2 0 0\n";
+    perProcessStat[100] = "100 (app) S 1 0 0 0 0 0 0 0 650 0 0 0 0 0 0 0 1 0 1000\n";
+    ret = populateProcPidDir(procDir.path, pidToTids, perProcessStat, perProcessStatus,
+                             perThreadStat);
+    ASSERT_TRUE(ret) << "Failed to populate proc pid dir: " << ret.error();
+    actual = procPidStat.collect();
+    ASSERT_TRUE(actual) << "Failed to collect proc pid stat: " << actual.error();
+    ASSERT_EQ(2, actual->size()) << toString(*actual);
+    for (const auto& stats : *actual) {
+        EXPECT_NE(stats.process.pid, 1) << "Filtered out process was collected";
+        if (stats.process.pid == 100) {
+            EXPECT_EQ(stats.process.majorFaults, 50);
+        }
+    }
+
+    // The filtered out processes report the delta since their last collection.
+    procPidStat.setAppIdFilter({});
+    actual = procPidStat.collect();
+    ASSERT_TRUE(actual) << "Failed to collect proc pid stat: " << actual.error();
+    ASSERT_EQ(3, actual->size());
+    for (const auto& stats : *actual) {
+        if (stats.process.pid == 1) {
+            EXPECT_EQ(stats.process.majorFaults, 100);
+        }
+    }
+}
+
 TEST(ProcPidStatTest, TestErrorOnCorruptedProcessStatFile) {
     std::unordered_map<uint32_t, std::vector<uint32_t>> pidToTids = {
             {1, {1}},
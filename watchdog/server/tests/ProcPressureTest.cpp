@@ -0,0 +1,128 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProcPressure.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+
+#include <string>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringAppendF;
+using android::base::WriteStringToFile;
+
+namespace {
+
+std::string toString(const ProcPressureInfo& info) {
+    std::string buffer;
+    for (int i = 0; i < PRESSURE_RESOURCES; ++i) {
+        StringAppendF(&buffer, "%s: some %" PRIu64 " full %" PRIu64 "\n",
+                      toString(static_cast<PressureResource>(i)).c_str(),
+                      info.stallTime[i][PRESSURE_SOME], info.stallTime[i][PRESSURE_FULL]);
+    }
+    return buffer;
+}
+
+std::string pressureContents(uint64_t someTotal, uint64_t fullTotal) {
+    return "some avg10=0.12 avg60=0.05 avg300=0.01 total=" + std::to_string(someTotal) +
+            "\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=" + std::to_string(fullTotal) + "\n";
+}
+
+void writePressureFiles(const TemporaryDir& dir, const std::string& cpu, const std::string& io,
+                        const std::string& memory) {
+    ASSERT_TRUE(WriteStringToFile(cpu, std::string(dir.path) + "/cpu"));
+    ASSERT_TRUE(WriteStringToFile(io, std::string(dir.path) + "/io"));
+    ASSERT_TRUE(WriteStringToFile(memory, std::string(dir.path) + "/memory"));
+}
+
+}  // namespace
+
+TEST(ProcPressureTest, TestValidPressureFiles) {
+    TemporaryDir dir;
+    // Older kernels report only the "some" line for CPU.
+    writePressureFiles(dir, "some avg10=1.00 avg60=0.50 avg300=0.10 total=5000\n",
+                       pressureContents(2000, 1000), pressureContents(300, 100));
+    ProcPressure procPressure(dir.path);
+    ASSERT_TRUE(procPressure.enabled()) << "Temporary files are inaccessible";
+
+    ProcPressureInfo expectedFirstDelta;
+    expectedFirstDelta.stallTime[PRESSURE_CPU][PRESSURE_SOME] = 5000;
+    expectedFirstDelta.stallTime[PRESSURE_IO][PRESSURE_SOME] = 2000;
+    expectedFirstDelta.stallTime[PRESSURE_IO][PRESSURE_FULL] = 1000;
+    expectedFirstDelta.stallTime[PRESSURE_MEMORY][PRESSURE_SOME] = 300;
+    expectedFirstDelta.stallTime[PRESSURE_MEMORY][PRESSURE_FULL] = 100;
+    auto actualInfo = procPressure.collect();
+    ASSERT_TRUE(actualInfo) << actualInfo.error();
+    EXPECT_EQ(*actualInfo, expectedFirstDelta) << "First snapshot doesn't match.\nExpected:\n"
+                                               << toString(expectedFirstDelta) << "\nActual:\n"
+                                               << toString(*actualInfo);
+
+    writePressureFiles(dir, pressureContents(5500, 0), pressureContents(2600, 1100),
+                       pressureContents(300, 100));
+    ProcPressureInfo expectedSecondDelta;
+    expectedSecondDelta.stallTime[PRESSURE_CPU][PRESSURE_SOME] = 500;
+    expectedSecondDelta.stallTime[PRESSURE_IO][PRESSURE_SOME] = 600;
+    expectedSecondDelta.stallTime[PRESSURE_IO][PRESSURE_FULL] = 100;
+    actualInfo = procPressure.collect();
+    ASSERT_TRUE(actualInfo) << actualInfo.error();
+    EXPECT_EQ(*actualInfo, expectedSecondDelta) << "Second snapshot doesn't match.\nExpected:\n"
+                                                << toString(expectedSecondDelta) << "\nActual:\n"
+                                                << toString(*actualInfo);
+}
+
+TEST(ProcPressureTest, TestErrorOnInvalidPressureFile) {
+    TemporaryDir dir;
+    writePressureFiles(dir, pressureContents(5000, 0), "some avg10=0.00 total=abc\n",
+                       pressureContents(300, 100));
+    ProcPressure procPressure(dir.path);
+    ASSERT_TRUE(procPressure.enabled()) << "Temporary files are inaccessible";
+    EXPECT_FALSE(procPressure.collect().ok()) << "No error returned for invalid total";
+
+    writePressureFiles(dir, pressureContents(5000, 0),
+                       "full avg10=0.00 avg60=0.00 avg300=0.00 total=100\n",
+                       pressureContents(300, 100));
+    EXPECT_FALSE(procPressure.collect().ok()) << "No error returned for missing `some` line";
+}
+
+TEST(ProcPressureTest, TestDisabledWithMissingPressureFile) {
+    TemporaryDir dir;
+    ASSERT_TRUE(WriteStringToFile(pressureContents(0, 0), std::string(dir.path) + "/io"));
+    ProcPressure procPressure(dir.path);
+
+    EXPECT_FALSE(procPressure.enabled());
+    EXPECT_FALSE(procPressure.collect().ok());
+}
+
+TEST(ProcPressureTest, TestStartMonitorFailsWithoutTriggers) {
+    TemporaryDir dir;
+    ProcPressure procPressure(dir.path);
+
+    EXPECT_FALSE(procPressure.startMonitor({{PRESSURE_IO, PRESSURE_SOME, 100ms, 1s}},
+                                           [](PressureResource) {})
+                         .ok());
+    procPressure.stopMonitor();
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProcSnapshotReplay.h"
+
+#include <android-base/parseint.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+namespace testing {
+
+using android::base::Error;
+using android::base::ParseUint;
+using android::base::Result;
+
+ProcSnapshotReplay::ProcSnapshotReplay(const std::string& recordingPath) :
+      mCurrentPath(std::string(mLinkDir.path) + "/current"), mPosition(0) {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir(recordingPath.c_str()), closedir);
+    if (!dir) {
+        mResult = Error() << "Failed to open " << recordingPath << ": " << strerror(errno);
+        return;
+    }
+    std::vector<std::pair<uint64_t, std::string>> snapshots;
+    for (dirent* entry = readdir(dir.get()); entry != nullptr; entry = readdir(dir.get())) {
+        uint64_t index = 0;
+        if (entry->d_type != DT_DIR || !ParseUint(entry->d_name, &index)) {
+            continue;
+        }
+        snapshots.emplace_back(index, recordingPath + "/" + entry->d_name);
+    }
+    if (snapshots.empty()) {
+        mResult = Error() << "No snapshots in " << recordingPath;
+        return;
+    }
+    std::sort(snapshots.begin(), snapshots.end());
+    for (auto& [index, path] : snapshots) {
+        mSnapshotPaths.emplace_back(std::move(path));
+    }
+    mResult = select(0);
+}
+
+bool ProcSnapshotReplay::next() {
+    if (mPosition + 1 >= mSnapshotPaths.size()) {
+        return false;
+    }
+    mResult = select(mPosition + 1);
+    return mResult.ok();
+}
+
+Result<void> ProcSnapshotReplay::rewind() {
+    return select(0);
+}
+
+Result<void> ProcSnapshotReplay::select(size_t position) {
+    // Swap the symlink with a rename, so the current path always resolves to a snapshot.
+    const std::string tmpPath = mCurrentPath + ".tmp";
+    unlink(tmpPath.c_str());
+    if (symlink(mSnapshotPaths[position].c_str(), tmpPath.c_str()) != 0) {
+        return Error() << "Failed to link " << tmpPath << ": " << strerror(errno);
+    }
+    if (rename(tmpPath.c_str(), mCurrentPath.c_str()) != 0) {
+        return Error() << "Failed to rename " << tmpPath << ": " << strerror(errno);
+    }
+    mPosition = position;
+    return {};
+}
+
+}  // namespace testing
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
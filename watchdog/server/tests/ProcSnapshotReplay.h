@@ -0,0 +1,79 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WATCHDOG_SERVER_TESTS_PROCSNAPSHOTREPLAY_H_
+#define WATCHDOG_SERVER_TESTS_PROCSNAPSHOTREPLAY_H_
+
+#include <android-base/file.h>
+#include <android-base/result.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+namespace testing {
+
+// Replays a recording of `/proc` snapshots through the path-based collectors.
+//
+// A recording is a directory with one subdirectory per snapshot, named by the snapshot's index
+// and replayed in the numeric order. Each snapshot mirrors the parts of `/proc` read by the
+// collectors: `uid_io/stats`, `stat`, `pressure/{cpu,io,memory}`, and `[pid]/{stat,status,io}`
+// with `[pid]/task/[tid]/{stat,io}`. Record the snapshots on a device with
+// benchmarks/record_proc_snapshots.sh.
+//
+// The collectors are created with the paths returned by this class, which point into a symlink
+// to the current snapshot. |next| swaps the symlink to the next snapshot, so the collectors see
+// the snapshots one after another without any waiting between them.
+class ProcSnapshotReplay {
+public:
+    explicit ProcSnapshotReplay(const std::string& recordingPath);
+
+    const android::base::Result<void>& result() const { return mResult; }
+
+    size_t size() const { return mSnapshotPaths.size(); }
+
+    // Index of the current snapshot.
+    size_t position() const { return mPosition; }
+
+    // Moves to the next snapshot. Returns false after the last snapshot.
+    bool next();
+
+    // Moves back to the first snapshot.
+    android::base::Result<void> rewind();
+
+    std::string uidIoStatsPath() const { return mCurrentPath + "/uid_io/stats"; }
+    std::string procStatPath() const { return mCurrentPath + "/stat"; }
+    std::string procDirPath() const { return mCurrentPath; }
+    std::string procPressureDirPath() const { return mCurrentPath + "/pressure"; }
+
+private:
+    android::base::Result<void> select(size_t position);
+
+    TemporaryDir mLinkDir;
+    std::string mCurrentPath;
+    std::vector<std::string> mSnapshotPaths;
+    size_t mPosition;
+    android::base::Result<void> mResult;
+};
+
+}  // namespace testing
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
+
+#endif  //  WATCHDOG_SERVER_TESTS_PROCSNAPSHOTREPLAY_H_
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RingBuffer.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+namespace {
+
+std::vector<int> toVector(const RingBuffer<std::vector<int>>& buffer) {
+    std::vector<int> values;
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        values.emplace_back(buffer[i].front());
+    }
+    return values;
+}
+
+}  // namespace
+
+TEST(RingBufferTest, TestPushEvictsOldest) {
+    RingBuffer<std::vector<int>> buffer;
+    for (int i = 1; i <= 5; ++i) {
+        std::vector<int> element = {i};
+        buffer.push(&element, 3);
+        if (i <= 3) {
+            EXPECT_TRUE(element.empty()) << "Element not moved into the buffer";
+        } else {
+            EXPECT_EQ(element, std::vector<int>({i - 3})) << "Oldest element not swapped out";
+        }
+    }
+    EXPECT_EQ(toVector(buffer), std::vector<int>({3, 4, 5}));
+}
+
+TEST(RingBufferTest, TestPushReusesEvictedElement) {
+    RingBuffer<std::vector<int>> buffer;
+    std::vector<int> element;
+    for (int i = 0; i < 2; ++i) {
+        element = {i};
+        buffer.push(&element, 2);
+    }
+    element.assign(100, 2);
+    const int* data = element.data();
+    buffer.push(&element, 2);
+    element.assign(1, 3);
+    buffer.push(&element, 2);
+    ASSERT_EQ(buffer[0].size(), 100);
+    EXPECT_EQ(buffer[0].data(), data) << "Element copied instead of swapped";
+    EXPECT_EQ(toVector(buffer), std::vector<int>({2, 3}));
+}
+
+TEST(RingBufferTest, TestMaxSizeChange) {
+    RingBuffer<std::vector<int>> buffer;
+    for (int i = 1; i <= 4; ++i) {
+        std::vector<int> element = {i};
+        buffer.push(&element, 3);
+    }
+    ASSERT_EQ(toVector(buffer), std::vector<int>({2, 3, 4}));
+
+    std::vector<int> element = {5};
+    buffer.push(&element, 4);
+    EXPECT_EQ(toVector(buffer), std::vector<int>({2, 3, 4, 5})) << "Buffer didn't grow";
+
+    element = {6};
+    buffer.push(&element, 2);
+    EXPECT_EQ(toVector(buffer), std::vector<int>({5, 6})) << "Buffer didn't shrink";
+
+    buffer.clear();
+    EXPECT_TRUE(buffer.empty());
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
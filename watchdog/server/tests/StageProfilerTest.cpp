@@ -0,0 +1,92 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StageProfiler.h"
+
+#include <string>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using ::testing::HasSubstr;
+using ::testing::StartsWith;
+
+TEST(StageProfilerTest, TestPercentilesOfUniformDurations) {
+    DurationHistogram histogram;
+    for (int i = 1; i <= 100; ++i) {
+        histogram.record(ms2ns(i));
+    }
+    EXPECT_EQ(histogram.count(), 100);
+    EXPECT_EQ(histogram.max(), ms2ns(100));
+    // Percentiles are the upper bounds of their buckets, which are at most 19% higher.
+    EXPECT_GE(histogram.percentile(50), ms2ns(50));
+    EXPECT_LE(histogram.percentile(50), ms2ns(60));
+    EXPECT_GE(histogram.percentile(95), ms2ns(95));
+    EXPECT_LE(histogram.percentile(95), ms2ns(100));
+    EXPECT_EQ(histogram.percentile(100), ms2ns(100));
+}
+
+TEST(StageProfilerTest, TestPercentilesOfOutliers) {
+    DurationHistogram histogram;
+    for (int i = 0; i < 98; ++i) {
+        histogram.record(us2ns(10));
+    }
+    histogram.record(s2ns(1));
+    histogram.record(s2ns(2));
+    EXPECT_LE(histogram.percentile(50), us2ns(12));
+    EXPECT_LE(histogram.percentile(95), us2ns(12));
+    EXPECT_GE(histogram.percentile(99), s2ns(1));
+    EXPECT_EQ(histogram.max(), s2ns(2));
+}
+
+TEST(StageProfilerTest, TestEmptyAndOutOfRangeDurations) {
+    DurationHistogram histogram;
+    EXPECT_EQ(histogram.percentile(50), 0);
+    histogram.record(0);
+    histogram.record(s2ns(3600));
+    EXPECT_LE(histogram.percentile(50), us2ns(1));
+    EXPECT_EQ(histogram.percentile(100), s2ns(3600));
+}
+
+TEST(StageProfilerTest, TestDumpsStagesInNameOrder) {
+    StageProfiler profiler("Test");
+    profiler.record("b stage", ms2ns(2));
+    profiler.record("a stage", ms2ns(1));
+    profiler.recordHeapGrowth("b stage", 100);
+    profiler.recordHeapGrowth("b stage", 300);
+
+    const std::string dump = profiler.dump("\t");
+    EXPECT_THAT(dump, StartsWith("\ta stage: count: 1, p50: "));
+    EXPECT_THAT(dump, HasSubstr("\n\tb stage: count: 1, p50: "));
+    EXPECT_THAT(dump, HasSubstr("average heap growth: 200 bytes\n"));
+}
+
+TEST(StageProfilerTest, TestScopedTimerRecordsStage) {
+    StageProfiler profiler("Test");
+    {
+        StageProfiler::ScopedTimer timer(&profiler, "scoped", /*trackHeap=*/true);
+    }
+    const std::string dump = profiler.dump("");
+    EXPECT_THAT(dump, StartsWith("scoped: count: 1, p50: "));
+    EXPECT_THAT(dump, HasSubstr("average heap growth: "));
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
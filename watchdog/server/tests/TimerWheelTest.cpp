@@ -0,0 +1,134 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using std::chrono_literals::operator""ms;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+namespace {
+
+const nsecs_t kTick = 100'000'000;  // 100ms
+
+}  // namespace
+
+TEST(TimerWheelTest, TestExpiresAtDeadline) {
+    TimerWheel<int, int> wheel(100ms);
+    wheel.schedule(1, 1, 3 * kTick);
+    wheel.schedule(2, 2, 3 * kTick + 1);
+    wheel.schedule(3, 3, 10 * kTick);
+    ASSERT_EQ(wheel.size(), 3);
+    ASSERT_EQ(wheel.nextExpiry(), 3 * kTick);
+
+    ASSERT_THAT(wheel.advance(3 * kTick - 1), IsEmpty());
+    ASSERT_THAT(wheel.advance(3 * kTick), ElementsAre(1));
+    // Deadlines are rounded up to the next tick.
+    ASSERT_EQ(wheel.nextExpiry(), 4 * kTick);
+    ASSERT_THAT(wheel.advance(4 * kTick), ElementsAre(2));
+    ASSERT_THAT(wheel.advance(20 * kTick), ElementsAre(3));
+    ASSERT_TRUE(wheel.empty());
+    ASSERT_EQ(wheel.nextExpiry(), std::nullopt);
+}
+
+TEST(TimerWheelTest, TestBatchesValuesInTheSameTick) {
+    TimerWheel<int, int> wheel(100ms);
+    for (int i = 0; i < 100; ++i) {
+        wheel.schedule(i, i, 30 * kTick);
+    }
+    ASSERT_THAT(wheel.advance(29 * kTick), IsEmpty());
+    ASSERT_EQ(wheel.advance(30 * kTick).size(), 100);
+}
+
+TEST(TimerWheelTest, TestCancelAndReschedule) {
+    TimerWheel<int, int> wheel(100ms);
+    wheel.schedule(1, 10, 5 * kTick);
+    wheel.schedule(2, 20, 5 * kTick);
+    ASSERT_EQ(wheel.cancel(1), 10);
+    ASSERT_EQ(wheel.cancel(1), std::nullopt);
+    // Rescheduling replaces the previous value and deadline.
+    wheel.schedule(2, 21, 8 * kTick);
+    ASSERT_EQ(wheel.size(), 1);
+    ASSERT_THAT(wheel.advance(5 * kTick), IsEmpty());
+    ASSERT_THAT(wheel.advance(8 * kTick), ElementsAre(21));
+}
+
+TEST(TimerWheelTest, TestPastDeadlinesExpireOnNextAdvance) {
+    TimerWheel<int, int> wheel(100ms);
+    ASSERT_THAT(wheel.advance(50 * kTick), IsEmpty());
+    wheel.schedule(1, 1, 10 * kTick);
+    ASSERT_EQ(wheel.nextExpiry(), 50 * kTick);
+    ASSERT_THAT(wheel.advance(50 * kTick), ElementsAre(1));
+}
+
+TEST(TimerWheelTest, TestCascadesFromUpperLevels) {
+    TimerWheel<int, int> wheel(100ms);
+    // Deadlines spanning every level of the wheel.
+    const std::vector<nsecs_t> deadlineTicks = {1, 63, 64, 65, 4095, 4096, 4097, 300000, 16000000};
+    for (size_t i = 0; i < deadlineTicks.size(); ++i) {
+        wheel.schedule(i, i, deadlineTicks[i] * kTick);
+    }
+    for (size_t i = 0; i < deadlineTicks.size(); ++i) {
+        ASSERT_THAT(wheel.advance(deadlineTicks[i] * kTick - 1), IsEmpty())
+                << "Value " << i << " expired before its deadline";
+        ASSERT_THAT(wheel.advance(deadlineTicks[i] * kTick), ElementsAre(i))
+                << "Value " << i << " didn't expire at its deadline";
+    }
+    ASSERT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, TestClampsFarDeadlines) {
+    TimerWheel<int, int> wheel(100ms);
+    const nsecs_t maxTicks = 1 << 24;
+    wheel.schedule(1, 1, 2 * maxTicks * kTick);
+    ASSERT_THAT(wheel.advance((maxTicks - 2) * kTick), IsEmpty());
+    ASSERT_THAT(wheel.advance((maxTicks - 1) * kTick), ElementsAre(1));
+}
+
+TEST(TimerWheelTest, TestNextExpiryNeverSkipsDeadlines) {
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<nsecs_t> deadlines(1, 20000 * kTick);
+    TimerWheel<int, nsecs_t> wheel(100ms);
+    std::vector<nsecs_t> expected;
+    for (int i = 0; i < 500; ++i) {
+        const nsecs_t deadline = deadlines(random);
+        wheel.schedule(i, deadline, deadline);
+        expected.push_back((deadline + kTick - 1) / kTick * kTick);
+    }
+    std::sort(expected.begin(), expected.end());
+    std::vector<nsecs_t> actual;
+    while (auto nextExpiry = wheel.nextExpiry()) {
+        for (const auto& deadline : wheel.advance(*nextExpiry)) {
+            ASSERT_LE(deadline, *nextExpiry);
+            actual.push_back(*nextExpiry);
+        }
+    }
+    ASSERT_EQ(actual, expected);
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
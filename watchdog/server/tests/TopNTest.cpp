@@ -0,0 +1,82 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TopN.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+namespace {
+
+template <typename T>
+std::vector<uint64_t> sortedKeys(TopN<T>* topN) {
+    std::vector<uint64_t> keys;
+    for (const auto& entry : topN->sorted()) {
+        keys.emplace_back(entry.key);
+    }
+    return keys;
+}
+
+}  // namespace
+
+TEST(TopNTest, TestKeepsLargestKeysInDescendingOrder) {
+    TopN<std::string> topN(3);
+    const std::vector<uint64_t> keys = {5, 1, 9, 3, 7, 2, 8};
+    for (const auto& key : keys) {
+        topN.push(key, std::to_string(key));
+    }
+    ASSERT_EQ(topN.size(), 3);
+    const auto& sorted = topN.sorted();
+    ASSERT_EQ(sorted.size(), 3);
+    EXPECT_EQ(sorted[0].value, "9");
+    EXPECT_EQ(sorted[1].value, "8");
+    EXPECT_EQ(sorted[2].value, "7");
+}
+
+TEST(TopNTest, TestIgnoresZeroKeys) {
+    TopN<int> topN(3);
+    topN.push(0, 1);
+    topN.push(4, 2);
+    topN.push(0, 3);
+    EXPECT_EQ(sortedKeys(&topN), std::vector<uint64_t>({4}));
+}
+
+TEST(TopNTest, TestUnlimited) {
+    TopN<int> topN(TopN<int>::kUnlimited);
+    for (uint64_t key = 1; key <= 100; ++key) {
+        topN.push(key, 0);
+    }
+    const auto keys = sortedKeys(&topN);
+    ASSERT_EQ(keys.size(), 100);
+    EXPECT_EQ(keys.front(), 100);
+    EXPECT_EQ(keys.back(), 1);
+}
+
+TEST(TopNTest, TestZeroLimit) {
+    TopN<int> topN(0);
+    topN.push(10, 0);
+    EXPECT_EQ(topN.size(), 0);
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android
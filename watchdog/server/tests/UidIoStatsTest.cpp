@@ -54,13 +54,15 @@ TEST(UidIoStatsTest, TestValidStatFile) {
 
     const auto& actualFirstUsage = uidIoStats.collect();
     EXPECT_TRUE(actualFirstUsage) << actualFirstUsage.error();
-    EXPECT_EQ(expectedFirstUsage.size(), actualFirstUsage->size());
+    EXPECT_EQ(expectedFirstUsage.size(), actualFirstUsage->usages.size());
     for (const auto& it : expectedFirstUsage) {
-        if (actualFirstUsage->find(it.first) == actualFirstUsage->end()) {
+        const UidIoUsage* actualUsage = actualFirstUsage->find(it.first);
+        if (actualUsage == nullptr) {
             ADD_FAILURE() << "Expected uid " << it.first << " not found in the first snapshot";
+            continue;
         }
         const UidIoUsage& expected = it.second;
-        const UidIoUsage& actual = actualFirstUsage->at(it.first);
+        const UidIoUsage& actual = *actualUsage;
         EXPECT_EQ(expected.uid, actual.uid);
         EXPECT_EQ(expected.ios, actual.ios)
             << "Unexpected I/O usage for uid " << it.first << " in first snapshot.\nExpected:\n"
@@ -85,13 +87,15 @@ TEST(UidIoStatsTest, TestValidStatFile) {
     ASSERT_TRUE(WriteStringToFile(secondSnapshot, tf.path));
     const auto& actualSecondUsage = uidIoStats.collect();
     EXPECT_TRUE(actualSecondUsage) << actualSecondUsage.error();
-    EXPECT_EQ(expectedSecondUsage.size(), actualSecondUsage->size());
+    EXPECT_EQ(expectedSecondUsage.size(), actualSecondUsage->usages.size());
     for (const auto& it : expectedSecondUsage) {
-        if (actualSecondUsage->find(it.first) == actualSecondUsage->end()) {
+        const UidIoUsage* actualUsage = actualSecondUsage->find(it.first);
+        if (actualUsage == nullptr) {
             ADD_FAILURE() << "Expected uid " << it.first << " not found in the second snapshot";
+            continue;
         }
         const UidIoUsage& expected = it.second;
-        const UidIoUsage& actual = actualSecondUsage->at(it.first);
+        const UidIoUsage& actual = *actualUsage;
         EXPECT_EQ(expected.uid, actual.uid);
         EXPECT_EQ(expected.ios, actual.ios)
             << "Unexpected I/O usage for uid " << it.first << " in second snapshot:.\nExpected:\n"
@@ -99,6 +103,73 @@ TEST(UidIoStatsTest, TestValidStatFile) {
     }
 }
 
+TEST(UidIoStatsTest, TestAppIdFilter) {
+    TemporaryFile tf;
+    ASSERT_NE(tf.fd, -1);
+    ASSERT_TRUE(WriteStringToFile("1001234 5000 1000 3000 500 0 0 0 0 20 0\n"
+                                  "1009 0 0 0 0 40000 50000 20000 30000 0 300\n"
+                                  "1101234 100 100 100 100 0 0 0 0 1 0\n",
+                                  tf.path));
+    UidIoStats uidIoStats(tf.path);
+    ASSERT_TRUE(uidIoStats.enabled()) << "Temporary file is inaccessible";
+    auto usage = uidIoStats.collect();
+    ASSERT_TRUE(usage) << usage.error();
+    ASSERT_EQ(usage->usages.size(), 3);
+
+    // Only the UIDs of the filtered app ID are collected, across all the users.
+    uidIoStats.setAppIdFilter({1234});
+    ASSERT_TRUE(WriteStringToFile("1001234 6000 2000 4000 1500 0 0 0 0 30 0\n"
+                                  "1009 0 0 0 0 40000 50000 21000 31000 0 310\n"
+                                  "1101234 200 200 200 200 0 0 0 0 2 0\n",
+                                  tf.path));
+    usage = uidIoStats.collect();
+    ASSERT_TRUE(usage) << usage.error();
+    ASSERT_EQ(usage->usages.size(), 2);
+    EXPECT_EQ(usage->find(1001234)->ios, IoUsage(1000, 0, 1000, 0, 10, 0));
+    EXPECT_EQ(usage->find(1101234)->ios, IoUsage(100, 0, 100, 0, 1, 0));
+
+    // The filtered out UIDs report their usage since their last collection.
+    uidIoStats.setAppIdFilter({});
+    ASSERT_TRUE(WriteStringToFile("1001234 6000 2000 4000 1500 0 0 0 0 30 0\n"
+                                  "1009 0 0 0 0 40000 50000 22000 32000 0 320\n"
+                                  "1101234 200 200 200 200 0 0 0 0 2 0\n",
+                                  tf.path));
+    usage = uidIoStats.collect();
+    ASSERT_TRUE(usage) << usage.error();
+    ASSERT_EQ(usage->usages.size(), 3);
+    EXPECT_EQ(usage->find(1009)->ios, IoUsage(0, 2000, 0, 2000, 0, 20));
+    EXPECT_TRUE(usage->find(1001234)->ios.isZero());
+}
+
+TEST(UidIoStatsTest, TestSortsUidsAndSumsTotal) {
+    TemporaryFile tf;
+    ASSERT_NE(tf.fd, -1);
+    ASSERT_TRUE(WriteStringToFile("1009 0 0 0 0 40000 50000 20000 30000 0 300\n"
+                                  "1001234 5000 1000 3000 500 0 0 0 0 20 0\n"
+                                  "1005 500 100 30 50 300 400 100 200 45 60\n",
+                                  tf.path));
+    UidIoStats uidIoStats(tf.path);
+    ASSERT_TRUE(uidIoStats.enabled()) << "Temporary file is inaccessible";
+    auto usage = uidIoStats.collect();
+    ASSERT_TRUE(usage) << usage.error();
+    ASSERT_EQ(usage->usages.size(), 3);
+    EXPECT_EQ(usage->usages[0].uid, 1005);
+    EXPECT_EQ(usage->usages[1].uid, 1009);
+    EXPECT_EQ(usage->usages[2].uid, 1001234);
+    EXPECT_EQ(usage->total, IoUsage(3030, 20100, 550, 30200, 65, 360));
+    EXPECT_EQ(usage->find(1006), nullptr);
+
+    // Counters that went backwards report zero instead of wrapping around.
+    ASSERT_TRUE(WriteStringToFile("1001234 6000 2000 2000 1500 0 0 0 0 30 0\n"
+                                  "1009 0 0 0 0 40000 50000 21000 31000 0 310\n",
+                                  tf.path));
+    usage = uidIoStats.collect();
+    ASSERT_TRUE(usage) << usage.error();
+    ASSERT_EQ(usage->usages.size(), 2);
+    EXPECT_EQ(usage->find(1001234)->ios, IoUsage(0, 0, 1000, 0, 10, 0));
+    EXPECT_EQ(usage->total, IoUsage(0, 1000, 1000, 1000, 10, 10));
+}
+
 TEST(UidIoStatsTest, TestErrorOnInvalidStatFile) {
     // Format: uid fgRdChar fgWrChar fgRdBytes fgWrBytes bgRdChar bgWrChar bgRdBytes bgWrBytes
     // fgFsync bgFsync
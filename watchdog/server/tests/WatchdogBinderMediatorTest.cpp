@@ -44,6 +44,7 @@ class MockWatchdogProcessService : public WatchdogProcessService {
 public:
     MockWatchdogProcessService() : WatchdogProcessService(nullptr) {}
     MOCK_METHOD(Result<void>, dump, (int fd, const Vector<String16>& args), (override));
+    MOCK_METHOD(Result<void>, dumpSelfProfile, (int fd), (override));
 
     MOCK_METHOD(Status, registerClient,
                 (const sp<ICarWatchdogClient>& client, TimeoutLength timeout), (override));
@@ -60,6 +61,9 @@ public:
                 (override));
     MOCK_METHOD(Status, tellDumpFinished,
                 (const android::sp<ICarWatchdogMonitor>& monitor, int32_t pid), (override));
+    MOCK_METHOD(Status, openMediatorHealthChannel,
+                (const sp<ICarWatchdogClient>& mediator, os::ParcelFileDescriptor* channelFd),
+                (override));
     MOCK_METHOD(Status, notifyPowerCycleChange, (PowerCycle cycle), (override));
     MOCK_METHOD(Status, notifyUserStateChange, (userid_t userId, UserState state), (override));
     MOCK_METHOD(void, binderDied, (const android::wp<IBinder>& who), (override));
@@ -72,6 +76,11 @@ public:
     MOCK_METHOD(Result<void>, onCustomCollection, (int fd, const Vector<String16>& args),
                 (override));
     MOCK_METHOD(Result<void>, onDump, (int fd), (override));
+    MOCK_METHOD(Result<void>, onDumpHistory, (int fd), (override));
+    MOCK_METHOD(Result<void>, onDumpSelfProfile, (int fd), (override));
+    MOCK_METHOD(Result<void>, onDumpBootTimeline, (int fd), (override));
+    MOCK_METHOD(Result<void>, onSuspend, (), (override));
+    MOCK_METHOD(Result<void>, onResume, (), (override));
 };
 
 class MockICarWatchdogClient : public ICarWatchdogClient {
@@ -175,6 +184,36 @@ TEST_F(WatchdogBinderMediatorTest, TestHandlesStopCustomIoPerfCollection) {
     ASSERT_EQ(mWatchdogBinderMediator->dump(-1, args), OK);
 }
 
+TEST_F(WatchdogBinderMediatorTest, TestHandlesDumpIoPerfHistory) {
+    EXPECT_CALL(*mMockIoPerfCollection, onDumpHistory(-1)).WillOnce(Return(Result<void>()));
+    EXPECT_CALL(*mMockIoPerfCollection, onDump(_)).Times(0);
+
+    Vector<String16> args;
+    args.push_back(String16(kDumpIoHistoryFlag));
+    ASSERT_EQ(mWatchdogBinderMediator->dump(-1, args), OK);
+}
+
+TEST_F(WatchdogBinderMediatorTest, TestHandlesDumpBootTimeline) {
+    EXPECT_CALL(*mMockIoPerfCollection, onDumpBootTimeline(-1)).WillOnce(Return(Result<void>()));
+    EXPECT_CALL(*mMockIoPerfCollection, onDump(_)).Times(0);
+
+    Vector<String16> args;
+    args.push_back(String16(kDumpBootTimelineFlag));
+    ASSERT_EQ(mWatchdogBinderMediator->dump(-1, args), OK);
+}
+
+TEST_F(WatchdogBinderMediatorTest, TestHandlesDumpSelfProfile) {
+    EXPECT_CALL(*mMockWatchdogProcessService, dumpSelfProfile(-1))
+            .WillOnce(Return(Result<void>()));
+    EXPECT_CALL(*mMockIoPerfCollection, onDumpSelfProfile(-1)).WillOnce(Return(Result<void>()));
+    EXPECT_CALL(*mMockWatchdogProcessService, dump(_, _)).Times(0);
+    EXPECT_CALL(*mMockIoPerfCollection, onDump(_)).Times(0);
+
+    Vector<String16> args;
+    args.push_back(String16(kSelfProfileFlag));
+    ASSERT_EQ(mWatchdogBinderMediator->dump(-1, args), OK);
+}
+
 TEST_F(WatchdogBinderMediatorTest, TestErrorOnInvalidDumpArgs) {
     Vector<String16> args;
     args.push_back(String16("--invalid_option"));
@@ -289,6 +328,24 @@ TEST_F(WatchdogBinderMediatorTest, TestTellMediatorAlive) {
     ASSERT_TRUE(status.isOk()) << status;
 }
 
+TEST_F(WatchdogBinderMediatorTest, TestErrorOnOpenMediatorHealthChannelWithNonSystemCallingUid) {
+    sp<ICarWatchdogClient> mediator = new MockICarWatchdogClient();
+    os::ParcelFileDescriptor channelFd;
+    EXPECT_CALL(*mMockWatchdogProcessService, openMediatorHealthChannel(_, _)).Times(0);
+    Status status = mWatchdogBinderMediator->openMediatorHealthChannel(mediator, &channelFd);
+    ASSERT_FALSE(status.isOk()) << status;
+}
+
+TEST_F(WatchdogBinderMediatorTest, TestOpenMediatorHealthChannel) {
+    setSystemCallingUid();
+    sp<ICarWatchdogClient> mediator = new MockICarWatchdogClient();
+    os::ParcelFileDescriptor channelFd;
+    EXPECT_CALL(*mMockWatchdogProcessService, openMediatorHealthChannel(mediator, &channelFd))
+            .WillOnce(Return(Status::ok()));
+    Status status = mWatchdogBinderMediator->openMediatorHealthChannel(mediator, &channelFd);
+    ASSERT_TRUE(status.isOk()) << status;
+}
+
 TEST_F(WatchdogBinderMediatorTest, TestErrorOnTellDumpFinishedWithNonSystemCallingUid) {
     sp<ICarWatchdogMonitor> monitor = new MockICarWatchdogMonitor();
     EXPECT_CALL(*mMockWatchdogProcessService, tellDumpFinished(_, _)).Times(0);
@@ -322,12 +379,23 @@ TEST_F(WatchdogBinderMediatorTest, TestNotifyPowerCycleChange) {
     EXPECT_CALL(*mMockWatchdogProcessService,
                 notifyPowerCycleChange(PowerCycle::POWER_CYCLE_SUSPEND))
             .WillOnce(Return(Status::ok()));
+    EXPECT_CALL(*mMockIoPerfCollection, onSuspend()).WillOnce(Return(Result<void>()));
     Status status =
             mWatchdogBinderMediator
                     ->notifySystemStateChange(type,
                                               static_cast<int32_t>(PowerCycle::POWER_CYCLE_SUSPEND),
                                               -1);
     ASSERT_TRUE(status.isOk()) << status;
+
+    EXPECT_CALL(*mMockWatchdogProcessService,
+                notifyPowerCycleChange(PowerCycle::POWER_CYCLE_RESUME))
+            .WillOnce(Return(Status::ok()));
+    EXPECT_CALL(*mMockIoPerfCollection, onResume()).WillOnce(Return(Result<void>()));
+    status = mWatchdogBinderMediator
+                     ->notifySystemStateChange(type,
+                                               static_cast<int32_t>(PowerCycle::POWER_CYCLE_RESUME),
+                                               -1);
+    ASSERT_TRUE(status.isOk()) << status;
 }
 
 TEST_F(WatchdogBinderMediatorTest, TestErrorOnNotifyPowerCycleChangeWithInvalidArgs) {
@@ -16,6 +16,10 @@
 
 #include "WatchdogProcessService.h"
 
+#include <android-base/file.h>
+#include <cutils/multiuser.h>
+
+#include "ClientLoadGenerator.h"
 #include "gmock/gmock.h"
 
 namespace android {
@@ -23,8 +27,13 @@ namespace automotive {
 namespace watchdog {
 
 using android::sp;
+using android::base::ReadFileToString;
 using binder::Status;
+using testing::ClientLoadConfig;
+using testing::ClientLoadGenerator;
 using ::testing::_;
+using ::testing::HasSubstr;
+using ::testing::Not;
 using ::testing::Return;
 
 namespace {
@@ -56,6 +65,10 @@ public:
     sp<MockBinder> getBinder() const { return mBinder; }
 
     MOCK_METHOD(IBinder*, onAsBinder, (), (override));
+    MOCK_METHOD(Status, onPackageWriteBudgetExceeded,
+                (const String16& packageName, int32_t userId, int64_t writtenBytes,
+                 int64_t budgetBytes),
+                (override));
 
 private:
     sp<MockBinder> mBinder;
@@ -198,6 +211,30 @@ TEST_F(WatchdogProcessServiceTest, TestTellMediatorAlive) {
             << "tellMediatorAlive not synced with checkIfAlive should return an error";
 }
 
+TEST_F(WatchdogProcessServiceTest, TestOpenMediatorHealthChannel) {
+    sp<ICarWatchdogClient> mediator = expectNormalCarWatchdogClient();
+    os::ParcelFileDescriptor channelFd;
+    ASSERT_FALSE(mWatchdogProcessService->openMediatorHealthChannel(mediator, &channelFd).isOk())
+            << "Opening the health channel of an unregistered mediator should return an error";
+
+    mWatchdogProcessService->registerMediator(mediator);
+    Status status = mWatchdogProcessService->openMediatorHealthChannel(mediator, &channelFd);
+    ASSERT_TRUE(status.isOk()) << status;
+    ASSERT_NE(channelFd.get(), -1);
+    os::ParcelFileDescriptor otherChannelFd;
+    status = mWatchdogProcessService->openMediatorHealthChannel(mediator, &otherChannelFd);
+    ASSERT_TRUE(status.isOk()) << status;
+    ASSERT_NE(otherChannelFd.get(), -1);
+}
+
+TEST_F(WatchdogProcessServiceTest, TestErrorOnOpenHealthChannelOfClient) {
+    sp<ICarWatchdogClient> client = expectNormalCarWatchdogClient();
+    mWatchdogProcessService->registerClient(client, TimeoutLength::TIMEOUT_CRITICAL);
+    os::ParcelFileDescriptor channelFd;
+    ASSERT_FALSE(mWatchdogProcessService->openMediatorHealthChannel(client, &channelFd).isOk())
+            << "Only the mediator should be able to open the health channel";
+}
+
 TEST_F(WatchdogProcessServiceTest, TestTellDumpFinished) {
     sp<ICarWatchdogMonitor> monitor = expectNormalCarWatchdogMonitor();
     ASSERT_FALSE(mWatchdogProcessService->tellDumpFinished(monitor, 1234).isOk())
@@ -207,6 +244,65 @@ TEST_F(WatchdogProcessServiceTest, TestTellDumpFinished) {
     ASSERT_TRUE(status.isOk()) << status;
 }
 
+TEST_F(WatchdogProcessServiceTest, TestNotifyUserStateChange) {
+    const userid_t userId = multiuser_get_user_id(getuid());
+    sp<MockCarWatchdogClient> registeredClient = expectNormalCarWatchdogClient();
+    mWatchdogProcessService->registerClient(registeredClient, TimeoutLength::TIMEOUT_CRITICAL);
+    const auto dumpClients = [&]() {
+        TemporaryFile dump;
+        EXPECT_TRUE(mWatchdogProcessService->dump(dump.fd, Vector<String16>()).ok());
+        std::string contents;
+        EXPECT_TRUE(ReadFileToString(dump.path, &contents));
+        return contents;
+    };
+
+    Status status =
+            mWatchdogProcessService->notifyUserStateChange(userId, UserState::USER_STATE_STOPPED);
+    ASSERT_TRUE(status.isOk()) << status;
+    EXPECT_THAT(dumpClients(), HasSubstr("userStopped = true"))
+            << "Registered client wasn't marked when its user stopped";
+
+    sp<MockCarWatchdogClient> newClient = expectNormalCarWatchdogClient();
+    mWatchdogProcessService->registerClient(newClient, TimeoutLength::TIMEOUT_NORMAL);
+    EXPECT_THAT(dumpClients(), Not(HasSubstr("userStopped = false")))
+            << "Client registered by a stopped user wasn't marked";
+
+    status = mWatchdogProcessService->notifyUserStateChange(userId, UserState::USER_STATE_STARTED);
+    ASSERT_TRUE(status.isOk()) << status;
+    EXPECT_THAT(dumpClients(), Not(HasSubstr("userStopped = true")))
+            << "Clients weren't unmarked when their user started";
+
+    mWatchdogProcessService->unregisterClient(registeredClient);
+    mWatchdogProcessService->notifyUserStateChange(userId, UserState::USER_STATE_STOPPED);
+    EXPECT_THAT(dumpClients(), HasSubstr("userStopped = true"));
+}
+
+TEST_F(WatchdogProcessServiceTest, TestNotifyWriteBudgetExceeded) {
+    std::vector<WriteBudgetViolation> violations = {{.uid = 1012345,
+                                                     .packageName = "com.example.app",
+                                                     .writtenBytes = 2000,
+                                                     .budgetBytes = 1000}};
+    ASSERT_FALSE(mWatchdogProcessService->notifyWriteBudgetExceeded(violations).ok())
+            << "Write budget violations reported without a monitor";
+
+    sp<MockCarWatchdogMonitor> monitor = expectNormalCarWatchdogMonitor();
+    mWatchdogProcessService->registerMonitor(monitor);
+    EXPECT_CALL(*monitor,
+                onPackageWriteBudgetExceeded(String16("com.example.app"), 10, 2000, 1000))
+            .WillOnce(Return(Status::ok()));
+    auto ret = mWatchdogProcessService->notifyWriteBudgetExceeded(violations);
+    ASSERT_TRUE(ret.ok()) << ret.error().message();
+}
+
+TEST_F(WatchdogProcessServiceTest, TestClientLoadGenerator) {
+    ClientLoadConfig config;
+    config.numClients = 100;
+    ClientLoadGenerator generator(mWatchdogProcessService, config);
+    ASSERT_EQ(generator.registerClients().count(), 100);
+    ASSERT_EQ(generator.unregisterClients().count(), 100);
+    ASSERT_EQ(generator.numFailedResponses(), 0);
+}
+
 }  // namespace watchdog
 }  // namespace automotive
 }  // namespace android
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WriteBudgetTracker.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+#include <string>
+
+#include "gmock/gmock.h"
+
+namespace android {
+namespace automotive {
+namespace watchdog {
+
+using android::base::StringPrintf;
+
+namespace {
+
+// Noon of an arbitrary UTC day.
+constexpr time_t kNoon = 1600000000 / 86400 * 86400 + 12 * 60 * 60;
+
+const std::unordered_map<uint32_t, std::string> kPackageNames = {
+        {1001000, "shared:android.uid.system"},
+        {1010123, "com.google.android.car.kitchensink"},
+};
+
+}  // namespace
+
+TEST(WriteBudgetTrackerTest, TestReportsUidOnceAfterGoingOverBudget) {
+    TemporaryDir dir;
+    sp<WriteBudgetTracker> tracker =
+            new WriteBudgetTracker(/*defaultBudgetBytes=*/1000,
+                                   {{"com.google.android.car.kitchensink", 5000}},
+                                   StringPrintf("%s/write_budget", dir.path));
+
+    auto violations = tracker->update(kNoon, {{1001000, 600}, {1010123, 3000}}, kPackageNames);
+    ASSERT_TRUE(violations.empty());
+
+    violations = tracker->update(kNoon + 60, {{1001000, 600}, {1010123, 3000}}, kPackageNames);
+    ASSERT_EQ(violations.size(), 2);
+    EXPECT_EQ(violations[0].uid, 1001000);
+    EXPECT_EQ(violations[0].packageName, "shared:android.uid.system");
+    EXPECT_EQ(violations[0].writtenBytes, 1200);
+    EXPECT_EQ(violations[0].budgetBytes, 1000);
+    EXPECT_EQ(violations[1].uid, 1010123);
+    EXPECT_EQ(violations[1].writtenBytes, 6000);
+    EXPECT_EQ(violations[1].budgetBytes, 5000) << "Package budget doesn't override the default";
+
+    violations = tracker->update(kNoon + 120, {{1001000, 600}}, kPackageNames);
+    EXPECT_TRUE(violations.empty()) << "UID over budget reported more than once a day";
+
+    violations = tracker->update(kNoon + 86400, {{1001000, 1200}}, kPackageNames);
+    ASSERT_EQ(violations.size(), 1) << "Totals not reset on the next day";
+    EXPECT_EQ(violations[0].writtenBytes, 1200);
+}
+
+TEST(WriteBudgetTrackerTest, TestZeroBudgetDisablesTracking) {
+    TemporaryDir dir;
+    sp<WriteBudgetTracker> tracker =
+            new WriteBudgetTracker(/*defaultBudgetBytes=*/0,
+                                   {{"com.google.android.car.kitchensink", 100}},
+                                   StringPrintf("%s/write_budget", dir.path));
+    ASSERT_TRUE(tracker->enabled());
+
+    auto violations = tracker->update(kNoon, {{1001000, 1000000}, {1010123, 200}}, kPackageNames);
+    ASSERT_EQ(violations.size(), 1);
+    EXPECT_EQ(violations[0].uid, 1010123);
+
+    sp<WriteBudgetTracker> disabled =
+            new WriteBudgetTracker(/*defaultBudgetBytes=*/0, {},
+                                   StringPrintf("%s/write_budget", dir.path));
+    EXPECT_FALSE(disabled->enabled());
+}
+
+TEST(WriteBudgetTrackerTest, TestKeepsTotalsAcrossRestarts) {
+    TemporaryDir dir;
+    const std::string path = StringPrintf("%s/write_budget", dir.path);
+    {
+        sp<WriteBudgetTracker> tracker = new WriteBudgetTracker(1000, {}, path);
+        ASSERT_EQ(tracker->update(kNoon, {{1010123, 800}}, kPackageNames).size(), 0);
+        ASSERT_EQ(tracker->update(kNoon + 60, {{1001000, 1500}}, kPackageNames).size(), 1);
+        ASSERT_RESULT_OK(tracker->flush());
+    }
+
+    sp<WriteBudgetTracker> tracker = new WriteBudgetTracker(1000, {}, path);
+    auto violations =
+            tracker->update(kNoon + 120, {{1001000, 100}, {1010123, 300}}, kPackageNames);
+    ASSERT_EQ(violations.size(), 1) << "UID reported before the restart was reported again";
+    EXPECT_EQ(violations[0].uid, 1010123);
+    EXPECT_EQ(violations[0].writtenBytes, 1100);
+
+    sp<WriteBudgetTracker> nextDayTracker = new WriteBudgetTracker(1000, {}, path);
+    EXPECT_TRUE(nextDayTracker->update(kNoon + 86400, {{1010123, 300}}, kPackageNames).empty())
+            << "Totals of the previous day were loaded";
+}
+
+TEST(WriteBudgetTrackerTest, TestParsePackageWriteBudgets) {
+    const auto& budgets =
+            parsePackageWriteBudgets("com.google.android.car.kitchensink:10, mount:2,bad,:3,x:y");
+    ASSERT_EQ(budgets.size(), 2);
+    EXPECT_EQ(budgets.at("com.google.android.car.kitchensink"), 10 * 1024 * 1024);
+    EXPECT_EQ(budgets.at("mount"), 2 * 1024 * 1024);
+}
+
+}  // namespace watchdog
+}  // namespace automotive
+}  // namespace android